@@ -50,12 +50,15 @@
 /* MbedTLS transport include. */
 #include "mbedtls_pkcs11_posix.h"
 
-/*Include backoff algorithm header for retry logic.*/
-#include "backoff_algorithm.h"
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
 
 /* Clock for timer. */
 #include "clock.h"
 
+/* Outgoing publishes waiting for a PUBACK. */
+#include "mqtt_inflight.h"
+
 /**
  * These configurations are required. Throw compilation error if the below
  * configs are not defined.
@@ -131,10 +134,11 @@
 #define CONNACK_RECV_TIMEOUT_MS                  ( 1000U )
 
 /**
- * @brief Maximum number of outgoing publishes maintained in the application
- * until an ack is received from the broker.
+ * @brief Size of the table of outgoing publishes maintained in the application
+ * until an ack is received from the broker, with a slot free beyond the
+ * #MQTT_INFLIGHT_WINDOW publishes in flight.
  */
-#define MAX_OUTGOING_PUBLISHES                   ( 5U )
+#define MAX_OUTGOING_PUBLISHES                   MQTT_INFLIGHT_TABLE_SIZE( MQTT_INFLIGHT_WINDOW )
 
 /**
  * @brief Invalid packet identifier for the MQTT packets. Zero is always an
@@ -174,23 +178,6 @@
 #define METRICS_STRING_LENGTH                    ( ( uint16_t ) ( sizeof( METRICS_STRING ) - 1 ) )
 /*-----------------------------------------------------------*/
 
-/**
- * @brief Structure to keep the MQTT publish packets until an ack is received
- * for QoS1 publishes.
- */
-typedef struct PublishPackets
-{
-    /**
-     * @brief Packet identifier of the publish packet.
-     */
-    uint16_t packetId;
-
-    /**
-     * @brief Publish info of the publish packet.
-     */
-    MQTTPublishInfo_t pubInfo;
-} PublishPackets_t;
-
 /* Each compilation unit must define the NetworkContext struct. */
 struct NetworkContext
 {
@@ -215,12 +202,13 @@ static uint16_t globalSubscribePacketIdentifier = 0U;
 static uint16_t globalUnsubscribePacketIdentifier = 0U;
 
 /**
- * @brief Array to keep the outgoing publish messages.
+ * @brief Table of the outgoing publish messages, by packet id.
  *
  * These stored outgoing publish messages are kept until a successful ack
  * is received.
  */
-static PublishPackets_t outgoingPublishPackets[ MAX_OUTGOING_PUBLISHES ] = { 0 };
+static MqttInflightEntry_t outgoingPublishEntries[ MAX_OUTGOING_PUBLISHES ] = { 0 };
+static MqttInflight_t outgoingPublishes = MQTT_INFLIGHT_INITIALIZER( outgoingPublishEntries, MQTT_INFLIGHT_WINDOW );
 
 /**
  * @brief The network buffer must remain valid for the lifetime of the MQTT context.
@@ -254,14 +242,6 @@ static bool mqttSessionEstablished = false;
 static MQTTPublishCallback_t appPublishCallback = NULL;
 /*-----------------------------------------------------------*/
 
-/**
- * @brief The random number generator to use for exponential backoff with
- * jitter retry logic.
- *
- * @return The generated random number.
- */
-static uint32_t generateRandomNumber( void );
-
 /**
  * @brief Connect to the MQTT broker with reconnection retries.
  *
@@ -282,32 +262,13 @@ static bool connectToBrokerWithBackoffRetries( NetworkContext_t * pNetworkContex
                                                char * pPrivateKeyLabel );
 
 /**
- * @brief Get the free index in the #outgoingPublishPackets array at which an
- * outgoing publish can be stored.
- *
- * @param[out] pIndex The index at which an outgoing publish can be stored.
- *
- * @return false if no more publishes can be stored;
- * true if an index to store the next outgoing publish is obtained.
- */
-static bool getNextFreeIndexForOutgoingPublishes( uint8_t * pIndex );
-
-/**
- * @brief Clean up the outgoing publish at given index from the
- * #outgoingPublishPackets array.
- *
- * @param[in] index The index at which a publish message has to be cleaned up.
- */
-static void cleanupOutgoingPublishAt( uint8_t index );
-
-/**
- * @brief Clean up all the outgoing publishes in the #outgoingPublishPackets array.
+ * @brief Clean up all the outgoing publishes in the #outgoingPublishes table.
  */
 static void cleanupOutgoingPublishes( void );
 
 /**
  * @brief Clean up the publish packet with the given packet id in the
- * #outgoingPublishPackets array.
+ * #outgoingPublishes table.
  *
  * @param[in] packetId Packet id of the packet to be clean.
  */
@@ -336,13 +297,18 @@ static void mqttCallback( MQTTContext_t * pMqttContext,
  * false otherwise.
  */
 static bool handlePublishResend( MQTTContext_t * pMqttContext );
-/*-----------------------------------------------------------*/
-
-static uint32_t generateRandomNumber()
-{
-    return( ( uint32_t ) rand() );
-}
 
+/**
+ * @brief Function to run the process loop until another QoS1 publish may be
+ * sent, with fewer publishes waiting for a PUBACK than the window of the
+ * #outgoingPublishes table.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ *
+ * @return false if the process loop failed or a PUBACK timed out; true once
+ * the window is open.
+ */
+static bool waitForPublishWindow( MQTTContext_t * pMqttContext );
 /*-----------------------------------------------------------*/
 
 static bool connectToBrokerWithBackoffRetries( NetworkContext_t * pNetworkContext,
@@ -351,11 +317,11 @@ static bool connectToBrokerWithBackoffRetries( NetworkContext_t * pNetworkContex
                                                char * pPrivateKeyLabel )
 {
     bool returnStatus = false;
-    BackoffAlgorithmStatus_t backoffAlgStatus = BackoffAlgorithmSuccess;
+    bool retry = true;
     MbedtlsPkcs11Status_t tlsStatus = MBEDTLS_PKCS11_SUCCESS;
-    BackoffAlgorithmContext_t reconnectParams;
+    ReconnectPolicy_t reconnectPolicy;
     MbedtlsPkcs11Credentials_t tlsCredentials = { 0 };
-    uint16_t nextRetryBackOff = 0U;
+    uint32_t nextRetryBackOff = 0U;
     const char * alpn[] = { ALPN_PROTOCOL_NAME, NULL };
 
     /* Set the pParams member of the network context with desired transport. */
@@ -386,10 +352,10 @@ static bool connectToBrokerWithBackoffRetries( NetworkContext_t * pNetworkContex
     }
 
     /* Initialize reconnect attempts and interval */
-    BackoffAlgorithm_InitializeParams( &reconnectParams,
-                                       CONNECTION_RETRY_BACKOFF_BASE_MS,
-                                       CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
-                                       CONNECTION_RETRY_MAX_ATTEMPTS );
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           CONNECTION_RETRY_BACKOFF_BASE_MS,
+                           CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                           CONNECTION_RETRY_MAX_ATTEMPTS );
 
     do
     {
@@ -414,96 +380,43 @@ static bool connectToBrokerWithBackoffRetries( NetworkContext_t * pNetworkContex
         }
         else
         {
-            /* Generate a random number and get back-off value (in milliseconds) for the next connection retry. */
-            backoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &reconnectParams, generateRandomNumber(), &nextRetryBackOff );
+            /* Get the back-off value (in milliseconds) for the next connection retry. */
+            retry = ReconnectPolicy_NextDelay( &reconnectPolicy, ReconnectFailureNetwork, &nextRetryBackOff );
 
-            if( backoffAlgStatus == BackoffAlgorithmRetriesExhausted )
+            if( retry == false )
             {
                 LogError( ( "Connection to the broker failed, all attempts exhausted." ) );
             }
-            else if( backoffAlgStatus == BackoffAlgorithmSuccess )
+            else
             {
                 LogWarn( ( "Connection to the broker failed. Retrying connection "
-                           "after %hu ms backoff.",
-                           ( unsigned short ) nextRetryBackOff ) );
+                           "after %u ms backoff.",
+                           ( unsigned ) nextRetryBackOff ) );
                 Clock_SleepMs( nextRetryBackOff );
             }
         }
-    } while( ( tlsStatus != MBEDTLS_PKCS11_SUCCESS ) && ( backoffAlgStatus == BackoffAlgorithmSuccess ) );
+    } while( ( tlsStatus != MBEDTLS_PKCS11_SUCCESS ) && ( retry == true ) );
 
     return returnStatus;
 }
 /*-----------------------------------------------------------*/
 
-static bool getNextFreeIndexForOutgoingPublishes( uint8_t * pIndex )
-{
-    bool returnStatus = false;
-    uint8_t index = 0;
-
-    assert( outgoingPublishPackets != NULL );
-    assert( pIndex != NULL );
-
-    for( index = 0; index < MAX_OUTGOING_PUBLISHES; index++ )
-    {
-        /* A free index is marked by invalid packet id. Check if the the index
-         * has a free slot. */
-        if( outgoingPublishPackets[ index ].packetId == MQTT_PACKET_ID_INVALID )
-        {
-            returnStatus = true;
-            break;
-        }
-    }
-
-    /* Copy the available index into the output param. */
-    if( returnStatus == true )
-    {
-        *pIndex = index;
-    }
-
-    return returnStatus;
-}
-/*-----------------------------------------------------------*/
-
-static void cleanupOutgoingPublishAt( uint8_t index )
-{
-    assert( outgoingPublishPackets != NULL );
-    assert( index < MAX_OUTGOING_PUBLISHES );
-
-    /* Clear the outgoing publish packet. */
-    ( void ) memset( &( outgoingPublishPackets[ index ] ),
-                     0x00,
-                     sizeof( outgoingPublishPackets[ index ] ) );
-}
-/*-----------------------------------------------------------*/
-
 static void cleanupOutgoingPublishes( void )
 {
-    assert( outgoingPublishPackets != NULL );
-
     /* Clean up all the outgoing publish packets. */
-    ( void ) memset( outgoingPublishPackets, 0x00, sizeof( outgoingPublishPackets ) );
+    MqttInflight_Clear( &outgoingPublishes );
 }
 /*-----------------------------------------------------------*/
 
 static void cleanupOutgoingPublishWithPacketID( uint16_t packetId )
 {
-    uint8_t index = 0;
-
-    assert( outgoingPublishPackets != NULL );
     assert( packetId != MQTT_PACKET_ID_INVALID );
 
     /* Clean up the saved outgoing publish with packet Id equal to packetId. */
-    for( index = 0; index < MAX_OUTGOING_PUBLISHES; index++ )
+    if( MqttInflight_Acknowledge( &outgoingPublishes, packetId ) == true )
     {
-        if( outgoingPublishPackets[ index ].packetId == packetId )
-        {
-            cleanupOutgoingPublishAt( index );
-
-            LogDebug( ( "Cleaned up outgoing publish packet with packet id %u.",
-                        packetId ) );
-
-            break;
-        }
+        LogDebug( ( "Cleaned up outgoing publish packet with packet id %u.",
+                    packetId ) );
     }
 }
 /*-----------------------------------------------------------*/
@@ -570,8 +483,8 @@ static void mqttCallback( MQTTContext_t * pMqttContext,
                 LogDebug( ( "PUBACK received for packet id %u.",
                             packetIdentifier ) );
 
-                /* Cleanup the publish packet from the #outgoingPublishPackets
-                 * array when a PUBACK is received. */
+                /* Cleanup the publish packet from the #outgoingPublishes
+                 * table when a PUBACK is received. */
                 cleanupOutgoingPublishWithPacketID( packetIdentifier );
                 break;
 
@@ -586,49 +499,87 @@ static void mqttCallback( MQTTContext_t * pMqttContext,
 
 static bool handlePublishResend( MQTTContext_t * pMqttContext )
 {
-    bool returnStatus = false;
+    bool returnStatus = true;
     MQTTStatus_t mqttStatus = MQTTSuccess;
-    uint8_t index = 0U;
-
-    assert( outgoingPublishPackets != NULL );
+    MqttInflightEntry_t * pEntry = NULL;
 
-    /* Resend all the QoS1 publishes still in the #outgoingPublishPackets array.
+    /* Resend all the QoS1 publishes still in the #outgoingPublishes table,
+     * in the order they were first sent.
      * These are the publishes that haven't received a PUBACK yet. When a PUBACK
-     * is received, the corresponding publish is removed from the array. */
-    for( index = 0U; index < MAX_OUTGOING_PUBLISHES; index++ )
+     * is received, the corresponding publish is removed from the table. */
+    pEntry = MqttInflight_Next( &outgoingPublishes, NULL );
+
+    while( pEntry != NULL )
     {
-        if( outgoingPublishPackets[ index ].packetId != MQTT_PACKET_ID_INVALID )
+        pEntry->publishInfo.dup = true;
+        pEntry->sentTimeMs = Clock_GetTimeMs();
+
+        LogDebug( ( "Sending duplicate PUBLISH with packet id %u.",
+                    pEntry->packetId ) );
+        mqttStatus = MQTT_Publish( pMqttContext,
+                                   &pEntry->publishInfo,
+                                   pEntry->packetId );
+
+        if( mqttStatus != MQTTSuccess )
         {
-            outgoingPublishPackets[ index ].pubInfo.dup = true;
+            LogError( ( "Sending duplicate PUBLISH for packet id %u "
+                        " failed with status %s.",
+                        pEntry->packetId,
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            returnStatus = false;
+            break;
+        }
+        else
+        {
+            LogDebug( ( "Sent duplicate PUBLISH successfully for packet id %u.",
+                        pEntry->packetId ) );
+        }
 
-            LogDebug( ( "Sending duplicate PUBLISH with packet id %u.",
-                        outgoingPublishPackets[ index ].packetId ) );
-            mqttStatus = MQTT_Publish( pMqttContext,
-                                       &outgoingPublishPackets[ index ].pubInfo,
-                                       outgoingPublishPackets[ index ].packetId );
+        pEntry = MqttInflight_Next( &outgoingPublishes, pEntry );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static bool waitForPublishWindow( MQTTContext_t * pMqttContext )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MqttInflightEntry_t * pEntry = NULL;
+
+    assert( pMqttContext != NULL );
+
+    while( ( returnStatus == true ) &&
+           ( MqttInflight_WindowOpen( &outgoingPublishes ) == false ) )
+    {
+        pEntry = MqttInflight_CheckTimeout( &outgoingPublishes,
+                                            Clock_GetTimeMs(),
+                                            MQTT_INFLIGHT_ACK_TIMEOUT_MS );
+
+        if( pEntry != NULL )
+        {
+            LogError( ( "No PUBACK for packet id %u in %u ms, allowing %u publishes in flight.",
+                        pEntry->packetId,
+                        ( unsigned ) MQTT_INFLIGHT_ACK_TIMEOUT_MS,
+                        ( unsigned ) MqttInflight_Window( &outgoingPublishes ) ) );
+            returnStatus = false;
+        }
+        else
+        {
+            /* A single iteration, which returns once the next packet is in or
+             * the transport receive times out. */
+            mqttStatus = MQTT_ProcessLoop( pMqttContext, 0U );
 
             if( mqttStatus != MQTTSuccess )
             {
-                LogError( ( "Sending duplicate PUBLISH for packet id %u "
-                            " failed with status %s.",
-                            outgoingPublishPackets[ index ].packetId,
+                LogError( ( "MQTT_ProcessLoop returned with status = %s.",
                             MQTT_Status_strerror( mqttStatus ) ) );
-                break;
-            }
-            else
-            {
-                LogDebug( ( "Sent duplicate PUBLISH successfully for packet id %u.",
-                            outgoingPublishPackets[ index ].packetId ) );
+                returnStatus = false;
             }
         }
     }
 
-    /* Were all the unacknowledged QoS1 publishes successfully re-sent? */
-    if( index == MAX_OUTGOING_PUBLISHES )
-    {
-        returnStatus = true;
-    }
-
     return returnStatus;
 }
 /*-----------------------------------------------------------*/
@@ -949,49 +900,56 @@ bool PublishToTopic( const char * pTopicFilter,
 {
     bool returnStatus = false;
     MQTTStatus_t mqttStatus = MQTTSuccess;
-    uint8_t publishIndex = MAX_OUTGOING_PUBLISHES;
+    MqttInflightEntry_t * pEntry = NULL;
     MQTTContext_t * pMqttContext = &mqttContext;
 
     assert( pMqttContext != NULL );
     assert( pTopicFilter != NULL );
     assert( topicFilterLength > 0 );
 
-    /* Get the next free index for the outgoing publish. All QoS1 outgoing
-     * publishes are stored until a PUBACK is received. These messages are
-     * stored for supporting a resend if a network connection is broken before
-     * receiving a PUBACK. */
-    returnStatus = getNextFreeIndexForOutgoingPublishes( &publishIndex );
+    /* Wait for the window to let another publish out. */
+    returnStatus = waitForPublishWindow( pMqttContext );
 
-    if( returnStatus == false )
+    if( returnStatus == true )
     {
-        LogError( ( "Unable to find a free spot for outgoing PUBLISH message." ) );
+        /* Store the outgoing publish under a new packet id. All QoS1
+         * outgoing publishes are stored until a PUBACK is received. These
+         * messages are stored for supporting a resend if a network connection
+         * is broken before receiving a PUBACK. */
+        pEntry = MqttInflight_Add( &outgoingPublishes, MQTT_GetPacketId( pMqttContext ) );
+        returnStatus = ( pEntry != NULL );
+
+        if( returnStatus == false )
+        {
+            LogError( ( "Unable to find a free spot for outgoing PUBLISH message." ) );
+        }
     }
-    else
+
+    if( returnStatus == true )
     {
         LogDebug( ( "Published payload: %.*s",
                     ( int ) payloadLength,
                     ( const char * ) pPayload ) );
 
-        /* This example publishes to only one topic and uses QOS1. */
-        outgoingPublishPackets[ publishIndex ].pubInfo.qos = MQTTQoS1;
-        outgoingPublishPackets[ publishIndex ].pubInfo.pTopicName = pTopicFilter;
-        outgoingPublishPackets[ publishIndex ].pubInfo.topicNameLength = topicFilterLength;
-        outgoingPublishPackets[ publishIndex ].pubInfo.pPayload = pPayload;
-        outgoingPublishPackets[ publishIndex ].pubInfo.payloadLength = payloadLength;
-
-        /* Get a new packet id. */
-        outgoingPublishPackets[ publishIndex ].packetId = MQTT_GetPacketId( pMqttContext );
+        /* This example publishes to only one topic and uses QOS1. The entry
+         * references the topic and payload without copying them. */
+        pEntry->publishInfo.qos = MQTTQoS1;
+        pEntry->publishInfo.pTopicName = pTopicFilter;
+        pEntry->publishInfo.topicNameLength = topicFilterLength;
+        pEntry->publishInfo.pPayload = pPayload;
+        pEntry->publishInfo.payloadLength = payloadLength;
+        pEntry->sentTimeMs = Clock_GetTimeMs();
 
         /* Send PUBLISH packet. */
         mqttStatus = MQTT_Publish( pMqttContext,
-                                   &outgoingPublishPackets[ publishIndex ].pubInfo,
-                                   outgoingPublishPackets[ publishIndex ].packetId );
+                                   &pEntry->publishInfo,
+                                   pEntry->packetId );
 
         if( mqttStatus != MQTTSuccess )
         {
             LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
                         MQTT_Status_strerror( mqttStatus ) ) );
-            cleanupOutgoingPublishAt( publishIndex );
+            cleanupOutgoingPublishWithPacketID( pEntry->packetId );
             returnStatus = false;
         }
         else
@@ -999,7 +957,7 @@ bool PublishToTopic( const char * pTopicFilter,
             LogDebug( ( "PUBLISH sent for topic %.*s to broker with packet ID %u.",
                         topicFilterLength,
                         pTopicFilter,
-                        outgoingPublishPackets[ publishIndex ].packetId ) );
+                        pEntry->packetId ) );
         }
     }
 
@@ -15,6 +15,19 @@
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "protocol_examples_common.h"
+#include "provisioning_timer.h"
+#include "factory_provisioning.h"
+
+#if FACTORY_PROVISIONING_ENABLED
+#include "core_pkcs11_config.h"
+#include "core_pkcs11_pal.h"
+#endif
+
+#if CONFIG_FLEET_PROV_CSR_PREGENERATION
+#include "core_pkcs11_config.h"
+#include "pkcs11_operations.h"
+#include "key_pool.h"
+#endif
 
 int aws_iot_demo_main( int argc, char ** argv );
 
@@ -24,6 +37,8 @@ static const char *TAG = "OTA_MQTT";
 
 void app_main()
 {
+    ProvisioningTimer_Start();
+
     ESP_LOGI(TAG, "[APP] Startup..");
     ESP_LOGI(TAG, "[APP] Free memory: %d bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
@@ -40,7 +55,34 @@ void app_main()
         /* Retry nvs_flash_init */
         ESP_ERROR_CHECK(nvs_flash_init());
     }
+
+#if FACTORY_PROVISIONING_ENABLED
+    /* A unit without its claim certificate is on the production line, so
+     * take its credentials from the station before anything reads them. */
+    if (PKCS11_PAL_Initialize() == CKR_OK &&
+        PKCS11_PAL_FindObject((CK_BYTE_PTR) pkcs11configLABEL_CLAIM_CERTIFICATE,
+                              strlen(pkcs11configLABEL_CLAIM_CERTIFICATE)) == CK_INVALID_HANDLE) {
+        if (FactoryProvisioning_Run(CONFIG_FACTORY_PROVISIONING_WAIT_MS) != FactoryProvisioningSuccess) {
+            ESP_LOGW(TAG, "Not provisioned by the factory station, the demo will load its own claim credentials.");
+        }
+    }
+#endif
     
+#if KEY_POOL_SIZE > 0
+    /* Entries left by an earlier boot are ready now; the others are filled
+     * while Wi-Fi and the claim connection come up. */
+    if (!KeyPool_Start()) {
+        ESP_LOGW(TAG, "Key pool not started, the demo will generate the key and CSR once connected.");
+    }
+#elif CONFIG_FLEET_PROV_CSR_PREGENERATION
+    /* The key pair and CSR don't depend on the network, so generate them
+     * while Wi-Fi and the claim connection come up. */
+    if (!startKeyAndCsrPregeneration(pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
+                                     pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS)) {
+        ESP_LOGW(TAG, "Key and CSR generation not started, the demo will generate them once connected.");
+    }
+#endif
+
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
@@ -48,7 +90,9 @@ void app_main()
      * Read "Establishing Wi-Fi or Ethernet Connection" section in
      * examples/protocols/README.md for more information about this function.
      */
+    ProvisioningTimer_BeginPhase(ProvisioningPhaseWifi);
     ESP_ERROR_CHECK(example_connect());
+    ProvisioningTimer_EndPhase(ProvisioningPhaseWifi);
 
     aws_iot_demo_main(0,NULL);
 }
@@ -32,23 +32,14 @@
 /**
  * @brief Establish a MQTT connection.
  *
- * @param[in] appCallback The callback function used to receive incoming
- * publishes and incoming acks from MQTT library.
+ * @param[in] eventCallback The callback function used to receive incoming
+ * publishes. The acks are handled by the MQTT session.
  *
  * @return EXIT_SUCCESS if an MQTT session is established;
  * EXIT_FAILURE otherwise.
  */
 int32_t EstablishMqttSession( MQTTEventCallback_t eventCallback );
 
-/**
- * @brief Handle the incoming packet if it's not related to the device shadow.
- *
- * @param[in] pPacketInfo Packet Info pointer for the incoming packet.
- * @param[in] packetIdentifier Packet identifier of the incoming packet.
- */
-void HandleOtherIncomingPacket( MQTTPacketInfo_t * pPacketInfo,
-                                uint16_t packetIdentifier );
-
 /**
  * @brief Close the MQTT connection.
  *
@@ -70,6 +61,21 @@ int32_t DisconnectMqttSession( void );
 int32_t SubscribeToTopic( const char * pTopicFilter,
                           uint16_t topicFilterLength );
 
+/**
+ * @brief Subscribe to several MQTT topic filters with a single SUBSCRIBE.
+ *
+ * @param[in] pSubscriptionList The topic filters and their QoS.
+ * @param[in] subscriptionCount Number of entries in pSubscriptionList.
+ * @param[out] pSubAckCodes The SUBACK return code of each topic filter, or
+ * NULL.
+ *
+ * @return EXIT_SUCCESS if every topic filter was granted;
+ * EXIT_FAILURE otherwise.
+ */
+int32_t SubscribeToTopics( const MQTTSubscribeInfo_t * pSubscriptionList,
+                           size_t subscriptionCount,
+                           MQTTSubAckStatus_t * pSubAckCodes );
+
 /**
  * @brief Sends an MQTT UNSUBSCRIBE to unsubscribe from the shadow
  * topic.
@@ -84,6 +90,19 @@ int32_t SubscribeToTopic( const char * pTopicFilter,
 int32_t UnsubscribeFromTopic( const char * pTopicFilter,
                               uint16_t topicFilterLength );
 
+/**
+ * @brief Unsubscribe from several MQTT topic filters with a single
+ * UNSUBSCRIBE.
+ *
+ * @param[in] pSubscriptionList The topic filters.
+ * @param[in] subscriptionCount Number of entries in pSubscriptionList.
+ *
+ * @return EXIT_SUCCESS if UNSUBSCRIBE was successfully sent;
+ * EXIT_FAILURE otherwise.
+ */
+int32_t UnsubscribeFromTopics( const MQTTSubscribeInfo_t * pSubscriptionList,
+                               size_t subscriptionCount );
+
 /**
  * @brief Publish a message to a MQTT topic.
  *
@@ -0,0 +1,573 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file key_pool.c
+ * @brief Keeps device key pairs and their CSRs generated ahead of time.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Config include. */
+#include "demo_config.h"
+
+/* Interface include. */
+#include "key_pool.h"
+
+#if ( KEY_POOL_SIZE > 0 )
+
+/* FreeRTOS includes. */
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/event_groups.h"
+    #include "freertos/task.h"
+
+/* ESP-IDF includes. */
+    #include "nvs.h"
+
+/* PKCS #11 includes. */
+    #include "core_pkcs11_config.h"
+    #include "core_pkcs11_pal.h"
+    #include "pkcs11_operations.h"
+
+    #if ( 2 * KEY_POOL_SIZE ) > CONFIG_CORE_PKCS_EXTRA_OBJECTS
+        #error "CONFIG_CORE_PKCS_EXTRA_OBJECTS must hold the two keys of each entry of the key pool."
+    #endif
+
+    #if KEY_POOL_SIZE > 32
+        #error "The key pool has at most 32 entries."
+    #endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The NVS namespace of the CSRs of the entries.
+ */
+    #define KEY_POOL_NVS_NAMESPACE     "key_pool"
+
+/**
+ * @brief Size of the buffers holding a CSR, as in the PKCS #11 operations.
+ */
+    #define KEY_POOL_CSR_LENGTH        2048
+
+/**
+ * @brief Size of the buffers holding a label or an NVS key of an entry.
+ */
+    #define KEY_POOL_NAME_LENGTH       32
+
+/**
+ * @brief How long the task waits before generating again after a failure.
+ */
+    #define KEY_POOL_RETRY_DELAY_MS    10000U
+
+/**
+ * @brief Set in #poolEvents whenever the task makes an entry ready.
+ */
+    #define ENTRY_READY_BIT            ( ( EventBits_t ) 1U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The entries with a key pair and a CSR, and the ones taken, one bit
+ * per entry. Guarded by #poolLock.
+ */
+    static uint32_t readyEntries = 0U;
+    static uint32_t takenEntries = 0U;
+    static portMUX_TYPE poolLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief The task filling the entries, NULL if it isn't running.
+ */
+    static TaskHandle_t refillTaskHandle = NULL;
+
+/**
+ * @brief The session the task generates with.
+ */
+    static CK_SESSION_HANDLE poolSession;
+
+/**
+ * @brief Where #KeyPool_Take learns that an entry was made ready.
+ */
+    static EventGroupHandle_t poolEvents = NULL;
+    static StaticEventGroup_t poolEventsBuffer;
+
+/**
+ * @brief The CSR being generated by the task, and the one handed out by
+ * #KeyPool_Take.
+ */
+    static char generatedCsr[ KEY_POOL_CSR_LENGTH ];
+    static char takenCsr[ KEY_POOL_CSR_LENGTH ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes the private and public key labels of an entry.
+ */
+    static void entryLabels( uint32_t index,
+                             char * pPrivKeyLabel,
+                             char * pPubKeyLabel );
+
+/**
+ * @brief Writes the NVS key of the CSR of an entry.
+ */
+    static void entryCsrKey( uint32_t index,
+                             char * pKey );
+
+/**
+ * @brief Whether an earlier boot left both the CSR and the private key of an
+ * entry.
+ */
+    static bool entryStored( nvs_handle_t handle,
+                             uint32_t index );
+
+/**
+ * @brief Generates the key pair and CSR of an entry and stores the CSR.
+ */
+    static bool fillEntry( uint32_t index );
+
+/**
+ * @brief The task filling the entries not ready, then waiting for one to be
+ * used.
+ */
+    static void refillTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+    static void entryLabels( uint32_t index,
+                             char * pPrivKeyLabel,
+                             char * pPubKeyLabel )
+    {
+        ( void ) snprintf( pPrivKeyLabel, KEY_POOL_NAME_LENGTH, "Pool Priv Key %u", ( unsigned ) index );
+        ( void ) snprintf( pPubKeyLabel, KEY_POOL_NAME_LENGTH, "Pool Pub Key %u", ( unsigned ) index );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void entryCsrKey( uint32_t index,
+                             char * pKey )
+    {
+        ( void ) snprintf( pKey, KEY_POOL_NAME_LENGTH, "csr%u", ( unsigned ) index );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool entryStored( nvs_handle_t handle,
+                             uint32_t index )
+    {
+        char privKeyLabel[ KEY_POOL_NAME_LENGTH ];
+        char pubKeyLabel[ KEY_POOL_NAME_LENGTH ];
+        char csrKey[ KEY_POOL_NAME_LENGTH ];
+        size_t csrLength = 0U;
+
+        entryLabels( index, privKeyLabel, pubKeyLabel );
+        entryCsrKey( index, csrKey );
+
+        return( ( nvs_get_blob( handle, csrKey, NULL, &csrLength ) == ESP_OK ) &&
+                ( csrLength > 0U ) &&
+                ( csrLength <= sizeof( takenCsr ) ) &&
+                ( PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) privKeyLabel,
+                                         strlen( privKeyLabel ) ) != CK_INVALID_HANDLE ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool fillEntry( uint32_t index )
+    {
+        char privKeyLabel[ KEY_POOL_NAME_LENGTH ];
+        char pubKeyLabel[ KEY_POOL_NAME_LENGTH ];
+        char csrKey[ KEY_POOL_NAME_LENGTH ];
+        size_t csrLength = 0U;
+        nvs_handle_t handle;
+        esp_err_t err;
+        bool status = false;
+
+        entryLabels( index, privKeyLabel, pubKeyLabel );
+        entryCsrKey( index, csrKey );
+
+        err = nvs_open( KEY_POOL_NVS_NAMESPACE, NVS_READWRITE, &handle );
+
+        if( err == ESP_OK )
+        {
+            /* The CSR goes first, so a reset during the generation doesn't
+             * leave the CSR of the key pair replaced. */
+            err = nvs_erase_key( handle, csrKey );
+
+            if( err == ESP_ERR_NVS_NOT_FOUND )
+            {
+                err = ESP_OK;
+            }
+
+            if( err == ESP_OK )
+            {
+                err = nvs_commit( handle );
+            }
+
+            if( ( err == ESP_OK ) &&
+                ( generateKeyAndCsr( poolSession,
+                                     privKeyLabel,
+                                     pubKeyLabel,
+                                     generatedCsr,
+                                     sizeof( generatedCsr ),
+                                     &csrLength ) == true ) )
+            {
+                /* With the terminator, for #KeyPool_Take. */
+                err = nvs_set_blob( handle, csrKey, generatedCsr, csrLength + 1U );
+
+                if( err == ESP_OK )
+                {
+                    err = nvs_commit( handle );
+                }
+
+                status = ( err == ESP_OK );
+            }
+
+            nvs_close( handle );
+        }
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Failed to store the CSR of key pool entry %u: %s.",
+                        ( unsigned ) index, esp_err_to_name( err ) ) );
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void refillTask( void * pParameters )
+    {
+        uint32_t index;
+        uint32_t bit;
+        TickType_t startTick;
+
+        ( void ) pParameters;
+
+        for( ; ; )
+        {
+            portENTER_CRITICAL( &poolLock );
+
+            for( index = 0U; index < KEY_POOL_SIZE; index++ )
+            {
+                bit = 1UL << index;
+
+                if( ( ( readyEntries | takenEntries ) & bit ) == 0U )
+                {
+                    break;
+                }
+            }
+
+            portEXIT_CRITICAL( &poolLock );
+
+            if( index == KEY_POOL_SIZE )
+            {
+                /* Every entry is ready or taken; #KeyPool_Release wakes the
+                 * task when one is used. */
+                ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+            }
+            else
+            {
+                startTick = xTaskGetTickCount();
+
+                if( fillEntry( index ) == true )
+                {
+                    LogInfo( ( "Generated key pool entry %u in %u ms.",
+                               ( unsigned ) index,
+                               ( unsigned ) ( ( xTaskGetTickCount() - startTick ) * portTICK_PERIOD_MS ) ) );
+
+                    portENTER_CRITICAL( &poolLock );
+                    readyEntries |= bit;
+                    portEXIT_CRITICAL( &poolLock );
+
+                    ( void ) xEventGroupSetBits( poolEvents, ENTRY_READY_BIT );
+                }
+                else
+                {
+                    LogError( ( "Failed to generate key pool entry %u.", ( unsigned ) index ) );
+                    vTaskDelay( pdMS_TO_TICKS( KEY_POOL_RETRY_DELAY_MS ) );
+                }
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool KeyPool_Start( void )
+    {
+        bool status = false;
+        CK_FUNCTION_LIST_PTR functionList = NULL;
+        nvs_handle_t handle;
+        uint32_t index;
+
+        assert( poolEvents == NULL );
+
+        poolEvents = xEventGroupCreateStatic( &poolEventsBuffer );
+
+        /* Also initializes the PKCS #11 module, before the PAL is used. */
+        if( xInitializePkcs11Session( &poolSession ) != CKR_OK )
+        {
+            LogError( ( "Failed to open a PKCS #11 session for the key pool." ) );
+        }
+        else
+        {
+            if( nvs_open( KEY_POOL_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK )
+            {
+                for( index = 0U; index < KEY_POOL_SIZE; index++ )
+                {
+                    if( entryStored( handle, index ) == true )
+                    {
+                        readyEntries |= 1UL << index;
+                    }
+                }
+
+                nvs_close( handle );
+            }
+
+            LogInfo( ( "Key pool has %d of %u entries ready.",
+                       __builtin_popcount( readyEntries ), ( unsigned ) KEY_POOL_SIZE ) );
+
+            if( readyEntries != 0U )
+            {
+                ( void ) xEventGroupSetBits( poolEvents, ENTRY_READY_BIT );
+            }
+
+            /* Like the pregeneration task: just above idle, on the core the
+             * Wi-Fi and TCP/IP tasks don't prefer. */
+            status = ( xTaskCreatePinnedToCore( refillTask,
+                                                "key_pool",
+                                                CONFIG_FLEET_PROV_CSR_PREGENERATION_STACK_SIZE,
+                                                NULL,
+                                                tskIDLE_PRIORITY + 1,
+                                                &refillTaskHandle,
+                                                portNUM_PROCESSORS - 1 ) == pdPASS );
+
+            if( status == false )
+            {
+                LogError( ( "Failed to create the key pool task." ) );
+                refillTaskHandle = NULL;
+
+                if( C_GetFunctionList( &functionList ) == CKR_OK )
+                {
+                    ( void ) functionList->C_CloseSession( poolSession );
+                }
+            }
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool KeyPool_Take( const char ** ppCsr,
+                       size_t * pCsrLength,
+                       uint32_t * pIndex )
+    {
+        bool status = false;
+        bool found = false;
+        uint32_t index = 0U;
+        uint32_t available;
+        char csrKey[ KEY_POOL_NAME_LENGTH ];
+        size_t csrLength;
+        nvs_handle_t handle;
+        esp_err_t err;
+
+        assert( ppCsr != NULL );
+        assert( pCsrLength != NULL );
+        assert( pIndex != NULL );
+
+        while( ( status == false ) && ( poolEvents != NULL ) )
+        {
+            portENTER_CRITICAL( &poolLock );
+            available = readyEntries & ~takenEntries;
+            found = ( available != 0U );
+
+            if( found == true )
+            {
+                index = ( uint32_t ) __builtin_ctz( available );
+                takenEntries |= 1UL << index;
+            }
+
+            portEXIT_CRITICAL( &poolLock );
+
+            if( found == true )
+            {
+                entryCsrKey( index, csrKey );
+                csrLength = sizeof( takenCsr );
+                err = nvs_open( KEY_POOL_NVS_NAMESPACE, NVS_READONLY, &handle );
+
+                if( err == ESP_OK )
+                {
+                    err = nvs_get_blob( handle, csrKey, takenCsr, &csrLength );
+                    nvs_close( handle );
+                }
+
+                if( ( err == ESP_OK ) && ( csrLength > 0U ) && ( takenCsr[ csrLength - 1U ] == '\0' ) )
+                {
+                    *ppCsr = takenCsr;
+                    *pCsrLength = csrLength - 1U;
+                    *pIndex = index;
+                    status = true;
+                }
+                else
+                {
+                    LogError( ( "Failed to read the CSR of key pool entry %u.", ( unsigned ) index ) );
+
+                    /* Generated again, and another entry is looked for. */
+                    KeyPool_Release( index, true );
+                }
+            }
+            else if( refillTaskHandle == NULL )
+            {
+                /* Nothing will be made ready. */
+                break;
+            }
+            else
+            {
+                /* Waiting rather than failing keeps the caller from
+                 * generating alongside the task, with the same signing
+                 * context. The bit may be left from an entry taken since, in
+                 * which case the entries are only looked at once more. */
+                ( void ) xEventGroupWaitBits( poolEvents, ENTRY_READY_BIT,
+                                              pdTRUE, pdTRUE, portMAX_DELAY );
+            }
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool KeyPool_Promote( uint32_t index )
+    {
+        char privKeyLabel[ KEY_POOL_NAME_LENGTH ];
+        char pubKeyLabel[ KEY_POOL_NAME_LENGTH ];
+        CK_OBJECT_HANDLE privKeyHandle;
+        CK_OBJECT_HANDLE pubKeyHandle;
+        CK_BYTE_PTR pKeyDer = NULL;
+        CK_ULONG keyDerLength = 0;
+        CK_BBOOL isPrivate = CK_FALSE;
+        CK_ATTRIBUTE deviceKeyLabel;
+        CK_RV result = CKR_OK;
+
+        assert( index < KEY_POOL_SIZE );
+        assert( ( takenEntries & ( 1UL << index ) ) != 0U );
+
+        entryLabels( index, privKeyLabel, pubKeyLabel );
+
+        privKeyHandle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) privKeyLabel, strlen( privKeyLabel ) );
+        pubKeyHandle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pubKeyLabel, strlen( pubKeyLabel ) );
+
+        if( privKeyHandle == CK_INVALID_HANDLE )
+        {
+            result = CKR_OBJECT_HANDLE_INVALID;
+        }
+        else
+        {
+            result = PKCS11_PAL_GetObjectValue( privKeyHandle, &pKeyDer, &keyDerLength, &isPrivate );
+        }
+
+        if( result == CKR_OK )
+        {
+            /* The device public key is read from the private key file, so
+             * only the private key is saved under the device label. */
+            deviceKeyLabel.type = CKA_LABEL;
+            deviceKeyLabel.pValue = pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS;
+            deviceKeyLabel.ulValueLen = sizeof( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS ) - 1U;
+
+            if( PKCS11_PAL_SaveObject( &deviceKeyLabel, pKeyDer, keyDerLength ) == CK_INVALID_HANDLE )
+            {
+                result = CKR_DEVICE_ERROR;
+            }
+
+            PKCS11_PAL_GetObjectValueCleanup( pKeyDer, keyDerLength );
+        }
+
+        /* In the transaction too, so no copy of the device key is left
+         * behind once it commits. */
+        if( result == CKR_OK )
+        {
+            result = PKCS11_PAL_DestroyObject( privKeyHandle );
+        }
+
+        if( ( result == CKR_OK ) && ( pubKeyHandle != CK_INVALID_HANDLE ) )
+        {
+            result = PKCS11_PAL_DestroyObject( pubKeyHandle );
+        }
+
+        if( result != CKR_OK )
+        {
+            LogError( ( "Failed to move key pool entry %u to the device key: %lu.",
+                        ( unsigned ) index, ( unsigned long ) result ) );
+        }
+
+        return( result == CKR_OK );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void KeyPool_Release( uint32_t index,
+                          bool used )
+    {
+        uint32_t bit = 1UL << index;
+        char csrKey[ KEY_POOL_NAME_LENGTH ];
+        nvs_handle_t handle;
+
+        assert( index < KEY_POOL_SIZE );
+
+        if( used == true )
+        {
+            /* Not ready on the next boot either, even if the task doesn't
+             * get to it before a reset. */
+            entryCsrKey( index, csrKey );
+
+            if( nvs_open( KEY_POOL_NVS_NAMESPACE, NVS_READWRITE, &handle ) == ESP_OK )
+            {
+                ( void ) nvs_erase_key( handle, csrKey );
+                ( void ) nvs_commit( handle );
+                nvs_close( handle );
+            }
+        }
+
+        portENTER_CRITICAL( &poolLock );
+
+        if( used == true )
+        {
+            readyEntries &= ~bit;
+        }
+
+        takenEntries &= ~bit;
+        portEXIT_CRITICAL( &poolLock );
+
+        if( ( used == true ) && ( refillTaskHandle != NULL ) )
+        {
+            ( void ) xTaskNotifyGive( refillTaskHandle );
+        }
+        else if( used == false )
+        {
+            /* Ready to be taken again. */
+            ( void ) xEventGroupSetBits( poolEvents, ENTRY_READY_BIT );
+        }
+    }
+
+#endif /* if ( KEY_POOL_SIZE > 0 ) */
@@ -0,0 +1,113 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file key_pool.h
+ * @brief A pool of device key pairs generated ahead of time, each with the
+ * CSR signed by it, so that provisioning or a certificate rotation doesn't
+ * wait for a key generation.
+ *
+ * Each entry is a key pair in the PKCS #11 module under labels of its own
+ * and its CSR in NVS, so entries generated on one boot are used on a later
+ * one. A low priority task fills the entries missing, at boot and whenever
+ * one is used. Taking an entry hands out its CSR straight away; once the
+ * certificate for it is received, the key pair is moved to the labels of the
+ * device key and the entry is filled again.
+ */
+
+#ifndef KEY_POOL_H_
+#define KEY_POOL_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Number of key pairs kept ready, 0 without a pool.
+ */
+#ifndef KEY_POOL_SIZE
+    #ifdef CONFIG_FLEET_PROV_KEY_POOL_SIZE
+        #define KEY_POOL_SIZE    CONFIG_FLEET_PROV_KEY_POOL_SIZE
+    #else
+        #define KEY_POOL_SIZE    0
+    #endif
+#endif
+
+#if ( KEY_POOL_SIZE > 0 )
+
+/**
+ * @brief Find the entries left ready by earlier boots and start the task
+ * filling the others.
+ *
+ * The PKCS #11 module is initialized on the calling task, before the task
+ * starts, so that it isn't initialized by two tasks at once.
+ *
+ * @return True if the task was started.
+ */
+    bool KeyPool_Start( void );
+
+/**
+ * @brief Take a ready entry, waiting for the task to fill one if none is.
+ *
+ * @param[out] ppCsr The null-terminated CSR of the entry, in a buffer of the
+ * pool valid until the next call.
+ * @param[out] pCsrLength The length of the CSR.
+ * @param[out] pIndex The entry, for #KeyPool_Promote and #KeyPool_Release.
+ *
+ * @return False if the pool was never started or its CSR can't be read.
+ */
+    bool KeyPool_Take( const char ** ppCsr,
+                       size_t * pCsrLength,
+                       uint32_t * pIndex );
+
+/**
+ * @brief Move the key pair of a taken entry to the labels of the device
+ * key pair.
+ *
+ * Call it in a transaction of the PAL, with the certificate of the key saved
+ * in the same transaction, so the device never holds a key that doesn't
+ * match its certificate.
+ *
+ * @param[in] index The entry from #KeyPool_Take.
+ *
+ * @return True if the key was saved under the device label.
+ */
+    bool KeyPool_Promote( uint32_t index );
+
+/**
+ * @brief Give back a taken entry.
+ *
+ * @param[in] index The entry from #KeyPool_Take.
+ * @param[in] used Whether the transaction with #KeyPool_Promote was
+ * committed. The entry is then filled again with a new key pair; otherwise
+ * it stays ready to be taken again.
+ */
+    void KeyPool_Release( uint32_t index,
+                          bool used );
+
+#endif /* if ( KEY_POOL_SIZE > 0 ) */
+
+#endif /* ifndef KEY_POOL_H_ */
@@ -49,12 +49,20 @@
 #include "mbedtls/oid.h"
 #include "mbedtls/pk.h"
 #include "mbedtls/pk_internal.h"
+#include "mbedtls/platform_util.h"
 #include "mbedtls/sha256.h"
 #include "mbedtls/x509_crt.h"
 #include "mbedtls/x509_csr.h"
 
 #include "pem2der.h"
 
+#if CONFIG_FLEET_PROV_CSR_PREGENERATION
+    /* FreeRTOS includes. */
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/event_groups.h"
+    #include "freertos/task.h"
+#endif
+
 /**
  * @brief Size of buffer in which to hold the certificate signing request (CSR).
  */
@@ -141,6 +149,49 @@ typedef struct SigningCallbackContext
  */
 static SigningCallbackContext_t signingContext = { 0 };
 
+#if CONFIG_FLEET_PROV_CSR_PREGENERATION
+
+/**
+ * @brief Size of buffer in which the generation task holds the CSR.
+ */
+    #define DEVICE_CSR_BUFFER_LENGTH    2048
+
+/**
+ * @brief Set in #pregenerationEvents when the generation task is done,
+ * successfully or not.
+ */
+    #define PREGENERATION_DONE_BIT      ( ( EventBits_t ) 1U )
+
+/**
+ * @brief What the generation task needs, set before it starts.
+ */
+    typedef struct PregenerationContext
+    {
+        CK_SESSION_HANDLE p11Session;
+        const char * pPrivKeyLabel;
+        const char * pPubKeyLabel;
+    } PregenerationContext_t;
+
+    static PregenerationContext_t pregenerationContext;
+
+/**
+ * @brief The CSR written by the generation task, or by #getDeviceCsr when
+ * the task didn't run, and whether it succeeded. Only read once
+ * #PREGENERATION_DONE_BIT is set.
+ */
+    static char deviceCsr[ DEVICE_CSR_BUFFER_LENGTH ];
+    static size_t deviceCsrLength = 0U;
+    static bool pregenerationStatus = false;
+
+/**
+ * @brief Where the demo task learns that the generation task is done. NULL
+ * until the generation is started.
+ */
+    static EventGroupHandle_t pregenerationEvents = NULL;
+    static StaticEventGroup_t pregenerationEventsBuffer;
+
+#endif /* if CONFIG_FLEET_PROV_CSR_PREGENERATION */
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -199,8 +250,9 @@ static CK_RV provisionPrivateRSAKey( CK_SESSION_HANDLE session,
  * @brief Import the specified private key into storage.
  *
  * @param[in] session The PKCS #11 session.
- * @param[in] privateKey The private key to store, in PEM format.
- * @param[in] privateKeyLength The length of the key, including null terminator.
+ * @param[in] privateKey The private key to store, in PEM or DER format.
+ * @param[in] privateKeyLength The length of the key, including the null
+ * terminator of a PEM key.
  * @param[in] label The label to store the key.
  */
 static CK_RV provisionPrivateKey( CK_SESSION_HANDLE session,
@@ -221,6 +273,36 @@ static CK_RV provisionCertificate( CK_SESSION_HANDLE session,
                                    size_t certificateLength,
                                    const char * label );
 
+/**
+ * @brief Create a certificate object from a DER certificate, replacing the
+ * object of the same label.
+ *
+ * @param[in] session The PKCS #11 session.
+ * @param[in] pDer The certificate to store, in DER format.
+ * @param[in] derLength The length of #pDer.
+ * @param[in] label The label to store the certificate.
+ */
+static CK_RV createCertificateObject( CK_SESSION_HANDLE session,
+                                      const uint8_t * pDer,
+                                      size_t derLength,
+                                      const char * label );
+
+/**
+ * @brief Decode a PEM object to DER over its own buffer.
+ *
+ * The base64 body is decoded from the front, so every byte is written behind
+ * the byte being read, and the object needs no second buffer.
+ *
+ * @param[in,out] pPem The PEM object, overwritten by the DER object.
+ * @param[in] pemLength The length of #pPem, without a null terminator.
+ * @param[out] pDerLength The length of the DER object at #pPem.
+ *
+ * @return True if #pPem is one well-formed PEM object.
+ */
+static bool pemToDerInPlace( char * pPem,
+                             size_t pemLength,
+                             size_t * pDerLength );
+
 /**
  * @brief Read the specified ECDSA public key into the MbedTLS ECDSA context.
  *
@@ -281,6 +363,17 @@ static CK_RV generateKeyPairEC( CK_SESSION_HANDLE session,
                                 CK_OBJECT_HANDLE_PTR privateKeyHandlePtr,
                                 CK_OBJECT_HANDLE_PTR publicKeyHandlePtr );
 
+#if CONFIG_FLEET_PROV_CSR_PREGENERATION
+
+/**
+ * @brief Task generating the device key pair and CSR with its own PKCS #11
+ * session, then deleting itself.
+ *
+ * @param[in] pParameters The #PregenerationContext_t of the task.
+ */
+    static void keyAndCsrPregenerationTask( void * pParameters );
+#endif
+
 /*-----------------------------------------------------------*/
 
 static bool readFile( const char * path,
@@ -684,37 +777,10 @@ static CK_RV provisionCertificate( CK_SESSION_HANDLE session,
                                    size_t certificateLength,
                                    const char * label )
 {
-    PKCS11_CertificateTemplate_t certificateTemplate;
-    CK_OBJECT_CLASS certificateClass = CKO_CERTIFICATE;
-    CK_CERTIFICATE_TYPE certificateType = CKC_X_509;
-    CK_FUNCTION_LIST_PTR functionList = NULL;
     CK_RV result = CKR_OK;
     uint8_t * derObject = NULL;
     int32_t conversion = 0;
     size_t derLen = 0;
-    CK_BBOOL tokenStorage = CK_TRUE;
-    CK_BYTE subject[] = "TestSubject";
-    CK_OBJECT_HANDLE objectHandle = CK_INVALID_HANDLE;
-
-    /* Initialize the client certificate template. */
-    certificateTemplate.xObjectClass.type = CKA_CLASS;
-    certificateTemplate.xObjectClass.pValue = &certificateClass;
-    certificateTemplate.xObjectClass.ulValueLen = sizeof( certificateClass );
-    certificateTemplate.xSubject.type = CKA_SUBJECT;
-    certificateTemplate.xSubject.pValue = subject;
-    certificateTemplate.xSubject.ulValueLen = strlen( ( const char * ) subject );
-    certificateTemplate.xValue.type = CKA_VALUE;
-    certificateTemplate.xValue.pValue = ( CK_VOID_PTR ) certificate;
-    certificateTemplate.xValue.ulValueLen = ( CK_ULONG ) certificateLength;
-    certificateTemplate.xLabel.type = CKA_LABEL;
-    certificateTemplate.xLabel.pValue = ( CK_VOID_PTR ) label;
-    certificateTemplate.xLabel.ulValueLen = strlen( label );
-    certificateTemplate.xCertificateType.type = CKA_CERTIFICATE_TYPE;
-    certificateTemplate.xCertificateType.pValue = &certificateType;
-    certificateTemplate.xCertificateType.ulValueLen = sizeof( CK_CERTIFICATE_TYPE );
-    certificateTemplate.xTokenObject.type = CKA_TOKEN;
-    certificateTemplate.xTokenObject.pValue = &tokenStorage;
-    certificateTemplate.xTokenObject.ulValueLen = sizeof( tokenStorage );
 
     if( certificate == NULL )
     {
@@ -722,28 +788,18 @@ static CK_RV provisionCertificate( CK_SESSION_HANDLE session,
         result = CKR_ATTRIBUTE_VALUE_INVALID;
     }
 
-    if( result == CKR_OK )
-    {
-        result = C_GetFunctionList( &functionList );
-
-        if( result != CKR_OK )
-        {
-            LogError( ( "Could not get a PKCS #11 function pointer." ) );
-        }
-    }
-
     if( result == CKR_OK )
     {
         /* Convert the certificate to DER format from PEM. The DER key should
          * be about 3/4 the size of the PEM key, so mallocing the PEM key size
          * is sufficient. */
-        derObject = ( uint8_t * ) malloc( certificateTemplate.xValue.ulValueLen );
-        derLen = certificateTemplate.xValue.ulValueLen;
+        derObject = ( uint8_t * ) malloc( certificateLength );
+        derLen = certificateLength;
 
         if( derObject != NULL )
         {
-            conversion = convert_pem_to_der( ( unsigned char * ) certificateTemplate.xValue.pValue,
-                                             certificateTemplate.xValue.ulValueLen,
+            conversion = convert_pem_to_der( ( const unsigned char * ) certificate,
+                                             certificateLength,
                                              derObject, &derLen );
 
             if( 0 != conversion )
@@ -761,10 +817,62 @@ static CK_RV provisionCertificate( CK_SESSION_HANDLE session,
 
     if( result == CKR_OK )
     {
-        /* Set the template pointers to refer to the DER converted objects. */
-        certificateTemplate.xValue.pValue = derObject;
-        certificateTemplate.xValue.ulValueLen = derLen;
+        result = createCertificateObject( session, derObject, derLen, label );
+    }
+
+    if( derObject != NULL )
+    {
+        free( derObject );
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+static CK_RV createCertificateObject( CK_SESSION_HANDLE session,
+                                      const uint8_t * pDer,
+                                      size_t derLength,
+                                      const char * label )
+{
+    PKCS11_CertificateTemplate_t certificateTemplate;
+    CK_OBJECT_CLASS certificateClass = CKO_CERTIFICATE;
+    CK_CERTIFICATE_TYPE certificateType = CKC_X_509;
+    CK_FUNCTION_LIST_PTR functionList = NULL;
+    CK_RV result = CKR_OK;
+    CK_BBOOL tokenStorage = CK_TRUE;
+    CK_BYTE subject[] = "TestSubject";
+    CK_OBJECT_HANDLE objectHandle = CK_INVALID_HANDLE;
+
+    /* Initialize the client certificate template. */
+    certificateTemplate.xObjectClass.type = CKA_CLASS;
+    certificateTemplate.xObjectClass.pValue = &certificateClass;
+    certificateTemplate.xObjectClass.ulValueLen = sizeof( certificateClass );
+    certificateTemplate.xSubject.type = CKA_SUBJECT;
+    certificateTemplate.xSubject.pValue = subject;
+    certificateTemplate.xSubject.ulValueLen = strlen( ( const char * ) subject );
+    certificateTemplate.xValue.type = CKA_VALUE;
+    certificateTemplate.xValue.pValue = ( CK_VOID_PTR ) pDer;
+    certificateTemplate.xValue.ulValueLen = ( CK_ULONG ) derLength;
+    certificateTemplate.xLabel.type = CKA_LABEL;
+    certificateTemplate.xLabel.pValue = ( CK_VOID_PTR ) label;
+    certificateTemplate.xLabel.ulValueLen = strlen( label );
+    certificateTemplate.xCertificateType.type = CKA_CERTIFICATE_TYPE;
+    certificateTemplate.xCertificateType.pValue = &certificateType;
+    certificateTemplate.xCertificateType.ulValueLen = sizeof( CK_CERTIFICATE_TYPE );
+    certificateTemplate.xTokenObject.type = CKA_TOKEN;
+    certificateTemplate.xTokenObject.pValue = &tokenStorage;
+    certificateTemplate.xTokenObject.ulValueLen = sizeof( tokenStorage );
+
+    result = C_GetFunctionList( &functionList );
+
+    if( result != CKR_OK )
+    {
+        LogError( ( "Could not get a PKCS #11 function pointer." ) );
+    }
 
+    if( result == CKR_OK )
+    {
         /* Best effort clean-up of the existing object, if it exists. */
         destroyProvidedObjects( session, ( CK_BYTE_PTR * ) &label, &certificateClass, 1 );
 
@@ -777,12 +885,124 @@ static CK_RV provisionCertificate( CK_SESSION_HANDLE session,
                                                &objectHandle );
     }
 
-    if( derObject != NULL )
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool pemToDerInPlace( char * pPem,
+                             size_t pemLength,
+                             size_t * pDerLength )
+{
+    static const char pemBegin[] = "-----BEGIN ";
+    static const char pemEnd[] = "-----END ";
+    size_t readIndex = 0U;
+    size_t writeIndex = 0U;
+    uint32_t quantum = 0U;
+    size_t quantumLength = 0U;
+    size_t paddingLength = 0U;
+    bool status = ( pemLength > sizeof( pemBegin ) ) &&
+                  ( strncmp( pPem, pemBegin, sizeof( pemBegin ) - 1U ) == 0 );
+
+    /* Skip the header line. */
+    while( ( status == true ) && ( readIndex < pemLength ) && ( pPem[ readIndex ] != '\n' ) )
     {
-        free( derObject );
+        readIndex++;
     }
 
-    return result;
+    for( ; ( status == true ) && ( readIndex < pemLength ) && ( pPem[ readIndex ] != '-' ); readIndex++ )
+    {
+        char c = pPem[ readIndex ];
+        uint32_t value = 0U;
+
+        if( ( c == '\n' ) || ( c == '\r' ) )
+        {
+            continue;
+        }
+        else if( c == '=' )
+        {
+            paddingLength++;
+            continue;
+        }
+        else if( paddingLength > 0U )
+        {
+            /* Nothing can follow the padding. */
+            status = false;
+        }
+        else if( ( c >= 'A' ) && ( c <= 'Z' ) )
+        {
+            value = ( uint32_t ) ( c - 'A' );
+        }
+        else if( ( c >= 'a' ) && ( c <= 'z' ) )
+        {
+            value = ( uint32_t ) ( c - 'a' ) + 26U;
+        }
+        else if( ( c >= '0' ) && ( c <= '9' ) )
+        {
+            value = ( uint32_t ) ( c - '0' ) + 52U;
+        }
+        else if( c == '+' )
+        {
+            value = 62U;
+        }
+        else if( c == '/' )
+        {
+            value = 63U;
+        }
+        else
+        {
+            status = false;
+        }
+
+        if( status == true )
+        {
+            quantum = ( quantum << 6 ) | value;
+            quantumLength++;
+
+            /* Four characters of base64 decode to three bytes. */
+            if( quantumLength == 4U )
+            {
+                pPem[ writeIndex++ ] = ( char ) ( quantum >> 16 );
+                pPem[ writeIndex++ ] = ( char ) ( quantum >> 8 );
+                pPem[ writeIndex++ ] = ( char ) quantum;
+                quantum = 0U;
+                quantumLength = 0U;
+            }
+        }
+    }
+
+    /* The body must be followed by the footer line, and padded to a whole
+     * quantum. */
+    if( ( status == true ) &&
+        ( ( ( pemLength - readIndex ) < ( sizeof( pemEnd ) - 1U ) ) ||
+          ( strncmp( &pPem[ readIndex ], pemEnd, sizeof( pemEnd ) - 1U ) != 0 ) ||
+          ( ( quantumLength + paddingLength ) % 4U != 0U ) ||
+          ( quantumLength == 1U ) ) )
+    {
+        status = false;
+    }
+
+    if( ( status == true ) && ( quantumLength == 2U ) )
+    {
+        pPem[ writeIndex++ ] = ( char ) ( quantum >> 4 );
+    }
+    else if( ( status == true ) && ( quantumLength == 3U ) )
+    {
+        pPem[ writeIndex++ ] = ( char ) ( quantum >> 10 );
+        pPem[ writeIndex++ ] = ( char ) ( quantum >> 2 );
+    }
+
+    if( ( status == true ) && ( writeIndex == 0U ) )
+    {
+        status = false;
+    }
+
+    if( status == true )
+    {
+        *pDerLength = writeIndex;
+    }
+
+    return status;
 }
 
 /*-----------------------------------------------------------*/
@@ -1170,6 +1390,144 @@ bool generateKeyAndCsr( CK_SESSION_HANDLE p11Session,
 
 /*-----------------------------------------------------------*/
 
+#if CONFIG_FLEET_PROV_CSR_PREGENERATION
+
+    static void keyAndCsrPregenerationTask( void * pParameters )
+    {
+        PregenerationContext_t * pContext = ( PregenerationContext_t * ) pParameters;
+        CK_FUNCTION_LIST_PTR functionList = NULL;
+        TickType_t startTick = xTaskGetTickCount();
+
+        pregenerationStatus = generateKeyAndCsr( pContext->p11Session,
+                                                 pContext->pPrivKeyLabel,
+                                                 pContext->pPubKeyLabel,
+                                                 deviceCsr,
+                                                 sizeof( deviceCsr ),
+                                                 &deviceCsrLength );
+
+        if( pregenerationStatus == true )
+        {
+            LogInfo( ( "Generated the device key and CSR in %u ms.",
+                       ( unsigned ) ( ( xTaskGetTickCount() - startTick ) * portTICK_PERIOD_MS ) ) );
+        }
+        else
+        {
+            LogError( ( "Failed to generate the device key and CSR." ) );
+        }
+
+        /* Only close the session of the task. The module stays initialized
+         * for the session of the demo. */
+        if( C_GetFunctionList( &functionList ) == CKR_OK )
+        {
+            ( void ) functionList->C_CloseSession( pContext->p11Session );
+        }
+
+        ( void ) xEventGroupSetBits( pregenerationEvents, PREGENERATION_DONE_BIT );
+
+        vTaskDelete( NULL );
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool startKeyAndCsrPregeneration( const char * pPrivKeyLabel,
+                                      const char * pPubKeyLabel )
+    {
+        bool status = false;
+        CK_FUNCTION_LIST_PTR functionList = NULL;
+
+        assert( pPrivKeyLabel != NULL );
+        assert( pPubKeyLabel != NULL );
+        assert( pregenerationEvents == NULL );
+
+        pregenerationContext.pPrivKeyLabel = pPrivKeyLabel;
+        pregenerationContext.pPubKeyLabel = pPubKeyLabel;
+
+        if( xInitializePkcs11Session( &( pregenerationContext.p11Session ) ) != CKR_OK )
+        {
+            LogError( ( "Failed to open a PKCS #11 session for the key and CSR generation." ) );
+        }
+        else
+        {
+            pregenerationEvents = xEventGroupCreateStatic( &pregenerationEventsBuffer );
+
+            /* Just above idle, on the core the Wi-Fi and TCP/IP tasks don't
+             * prefer, so connecting isn't slowed down. */
+            status = ( xTaskCreatePinnedToCore( keyAndCsrPregenerationTask,
+                                                "csr_pregen",
+                                                CONFIG_FLEET_PROV_CSR_PREGENERATION_STACK_SIZE,
+                                                &pregenerationContext,
+                                                tskIDLE_PRIORITY + 1,
+                                                NULL,
+                                                portNUM_PROCESSORS - 1 ) == pdPASS );
+
+            if( status == false )
+            {
+                LogError( ( "Failed to create the key and CSR generation task." ) );
+
+                if( C_GetFunctionList( &functionList ) == CKR_OK )
+                {
+                    ( void ) functionList->C_CloseSession( pregenerationContext.p11Session );
+                }
+
+                /* Nothing to wait for. */
+                ( void ) xEventGroupSetBits( pregenerationEvents, PREGENERATION_DONE_BIT );
+            }
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool getDeviceCsr( CK_SESSION_HANDLE p11Session,
+                       const char * pPrivKeyLabel,
+                       const char * pPubKeyLabel,
+                       const char ** ppCsr,
+                       size_t * pCsrLength )
+    {
+        bool status = false;
+
+        assert( pPrivKeyLabel != NULL );
+        assert( pPubKeyLabel != NULL );
+        assert( ppCsr != NULL );
+        assert( pCsrLength != NULL );
+
+        if( pregenerationEvents != NULL )
+        {
+            /* The bit isn't cleared, so a retry of the demo gets the same CSR. */
+            ( void ) xEventGroupWaitBits( pregenerationEvents, PREGENERATION_DONE_BIT,
+                                          pdFALSE, pdTRUE, portMAX_DELAY );
+
+            status = pregenerationStatus;
+        }
+
+        if( status == false )
+        {
+            LogWarn( ( "No pre-generated CSR, generating the key and CSR now." ) );
+
+            /* The generation task is done or never ran, so the buffer is free. */
+            pregenerationStatus = generateKeyAndCsr( p11Session,
+                                                     pPrivKeyLabel,
+                                                     pPubKeyLabel,
+                                                     deviceCsr,
+                                                     sizeof( deviceCsr ),
+                                                     &deviceCsrLength );
+            status = pregenerationStatus;
+        }
+
+        if( status == true )
+        {
+            *ppCsr = deviceCsr;
+            *pCsrLength = deviceCsrLength;
+        }
+
+        return status;
+    }
+
+#endif /* if CONFIG_FLEET_PROV_CSR_PREGENERATION */
+
+/*-----------------------------------------------------------*/
+
 bool loadCertificate( CK_SESSION_HANDLE p11Session,
                       const char * pCertificate,
                       const char * pLabel,
@@ -1190,6 +1548,64 @@ bool loadCertificate( CK_SESSION_HANDLE p11Session,
 
 /*-----------------------------------------------------------*/
 
+bool loadCertificateInPlace( CK_SESSION_HANDLE p11Session,
+                             char * pCertificate,
+                             const char * pLabel,
+                             size_t certificateLength )
+{
+    CK_RV ret = CKR_ARGUMENTS_BAD;
+    size_t derLength = 0U;
+
+    assert( pCertificate != NULL );
+    assert( pLabel != NULL );
+
+    if( pemToDerInPlace( pCertificate, certificateLength, &derLength ) == true )
+    {
+        ret = createCertificateObject( p11Session,
+                                       ( const uint8_t * ) pCertificate,
+                                       derLength,
+                                       pLabel );
+    }
+    else
+    {
+        LogError( ( "Failed to convert provided certificate." ) );
+    }
+
+    return( ret == CKR_OK );
+}
+
+/*-----------------------------------------------------------*/
+
+bool loadPrivateKeyInPlace( CK_SESSION_HANDLE p11Session,
+                            char * pPrivateKey,
+                            const char * pLabel,
+                            size_t privateKeyLength )
+{
+    CK_RV ret = CKR_ARGUMENTS_BAD;
+    size_t derLength = 0U;
+
+    assert( pPrivateKey != NULL );
+    assert( pLabel != NULL );
+
+    if( pemToDerInPlace( pPrivateKey, privateKeyLength, &derLength ) == true )
+    {
+        /* MbedTLS parses a DER key in place. */
+        ret = provisionPrivateKey( p11Session, pPrivateKey, derLength, pLabel );
+    }
+    else
+    {
+        LogError( ( "Failed to convert provided private key." ) );
+    }
+
+    /* Only the PKCS #11 module keeps a copy of the key. The tail of the PEM
+     * object isn't overwritten by the DER object, so all of it is cleared. */
+    mbedtls_platform_zeroize( pPrivateKey, privateKeyLength );
+
+    return( ret == CKR_OK );
+}
+
+/*-----------------------------------------------------------*/
+
 bool pkcs11CloseSession( CK_SESSION_HANDLE p11Session )
 {
     CK_RV result = CKR_OK;
@@ -30,6 +30,9 @@
 /* corePKCS11 include. */
 #include "core_pkcs11.h"
 
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
 /**
  * @brief Loads the claim credentials into the PKCS #11 module. Claim
  * credentials are used in "Provisioning by Claim" workflow of Fleet
@@ -79,6 +82,50 @@ bool generateKeyAndCsr( CK_SESSION_HANDLE p11Session,
                         size_t csrBufferLength,
                         size_t * pOutCsrLength );
 
+#if CONFIG_FLEET_PROV_CSR_PREGENERATION
+
+/**
+ * @brief Start generating the device key pair and CSR on a low priority task,
+ * so that they are ready by the time the claim connection is up.
+ *
+ * The PKCS #11 module is initialized on the calling task, before the
+ * generation task starts, so that it isn't initialized by two tasks at once.
+ *
+ * @param[in] pPrivKeyLabel PKCS #11 label for the private key. Must stay
+ * valid until the generation is done.
+ * @param[in] pPubKeyLabel PKCS #11 label for the public key. Must stay valid
+ * until the generation is done.
+ *
+ * @return True if the task was started.
+ */
+    bool startKeyAndCsrPregeneration( const char * pPrivKeyLabel,
+                                      const char * pPubKeyLabel );
+
+/**
+ * @brief Get the CSR of the device key pair, waiting for the generation
+ * started by #startKeyAndCsrPregeneration.
+ *
+ * If the generation wasn't started or failed, the key pair and CSR are
+ * generated on the calling task. Either way the CSR stays in a buffer of the
+ * module, so the caller needs no buffer of its own.
+ *
+ * @param[in] p11Session The PKCS #11 session to generate with on the
+ * calling task.
+ * @param[in] pPrivKeyLabel PKCS #11 label for the private key.
+ * @param[in] pPubKeyLabel PKCS #11 label for the public key.
+ * @param[out] ppCsr The null-terminated CSR.
+ * @param[out] pCsrLength The length of the CSR.
+ *
+ * @return True if a CSR was generated.
+ */
+    bool getDeviceCsr( CK_SESSION_HANDLE p11Session,
+                       const char * pPrivKeyLabel,
+                       const char * pPubKeyLabel,
+                       const char ** ppCsr,
+                       size_t * pCsrLength );
+
+#endif /* if CONFIG_FLEET_PROV_CSR_PREGENERATION */
+
 /**
  * @brief Save the device client certificate into the PKCS #11 module.
  *
@@ -94,6 +141,39 @@ bool loadCertificate( CK_SESSION_HANDLE p11Session,
                       const char * pLabel,
                       size_t certificateLength );
 
+/**
+ * @brief Save the device client certificate into the PKCS #11 module,
+ * decoding it to DER over its own buffer instead of into a copy.
+ *
+ * @param[in] p11Session The PKCS #11 session to use.
+ * @param[in,out] pCertificate The PEM certificate to save. Overwritten.
+ * @param[in] pLabel PKCS #11 label for the certificate.
+ * @param[in] certificateLength Length of #pCertificate.
+ *
+ * @return True on success.
+ */
+bool loadCertificateInPlace( CK_SESSION_HANDLE p11Session,
+                             char * pCertificate,
+                             const char * pLabel,
+                             size_t certificateLength );
+
+/**
+ * @brief Save the device private key into the PKCS #11 module, decoding it
+ * to DER over its own buffer instead of into a copy.
+ *
+ * @param[in] p11Session The PKCS #11 session to use.
+ * @param[in,out] pPrivateKey The PEM private key to save. Cleared, whether
+ * or not it could be saved.
+ * @param[in] pLabel PKCS #11 label for the private key.
+ * @param[in] privateKeyLength Length of #pPrivateKey.
+ *
+ * @return True on success.
+ */
+bool loadPrivateKeyInPlace( CK_SESSION_HANDLE p11Session,
+                            char * pPrivateKey,
+                            const char * pLabel,
+                            size_t privateKeyLength );
+
 /**
  * @brief Close the PKCS #11 session.
  *
@@ -15,6 +15,7 @@
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "protocol_examples_common.h"
+#include "provisioning_timer.h"
 
 int aws_iot_demo_main( int argc, char ** argv );
 
@@ -29,6 +30,8 @@ static const char *TAG = "SHADOW_EXAMPLE";
 
 void app_main()
 {
+    ProvisioningTimer_Start();
+
     ESP_LOGI(TAG, "[APP] Startup..");
     ESP_LOGI(TAG, "[APP] Free memory: %d bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
@@ -53,7 +56,9 @@ void app_main()
      * Read "Establishing Wi-Fi or Ethernet Connection" section in
      * examples/protocols/README.md for more information about this function.
      */
+    ProvisioningTimer_BeginPhase(ProvisioningPhaseWifi);
     ESP_ERROR_CHECK(example_connect());
+    ProvisioningTimer_EndPhase(ProvisioningPhaseWifi);
 
     aws_iot_demo_main(0,NULL);
 }
@@ -121,6 +121,14 @@
     #define CLIENT_IDENTIFIER    CONFIG_MQTT_CLIENT_IDENTIFIER
 #endif
 
+/**
+ * @brief Whether the session with the provisioned certificate is brought up
+ * before the claim session is closed.
+ */
+#ifndef PROVISIONING_HANDOVER
+    #define PROVISIONING_HANDOVER    CONFIG_EXAMPLE_PROVISIONING_HANDOVER
+#endif
+
 /**
  * @brief Size of the network buffer for MQTT packets.
  */
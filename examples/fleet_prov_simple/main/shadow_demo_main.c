@@ -61,9 +61,18 @@
 #include "shadow_demo_helpers.h"
 #include "fleet_provisioning_serializer.h"
 
+/* Transport interface implementation, for the credential cache. */
+#include "network_transport.h"
+
 /* AWS IoT Fleet Provisioning Library. */
 #include "fleet_provisioning.h"
 
+/* Fleet provisioning request correlation. */
+#include "provisioning_requests.h"
+
+/* Provisioning phase timing. */
+#include "provisioning_timer.h"
+
 /* Shadow config include. */
 #include "shadow_config.h"
 
@@ -83,13 +92,6 @@
  */
 #define DEVICE_SERIAL_NUMBER_LENGTH          ( ( uint16_t ) ( sizeof( DEVICE_SERIAL_NUMBER ) - 1 ) )
 
-/**
- * @brief Size of AWS IoT Thing name buffer.
- *
- * See https://docs.aws.amazon.com/iot/latest/apireference/API_CreateThing.html#iot-CreateThing-request-thingName
- */
-#define MAX_THING_NAME_LENGTH                128
-
 /**
  * @brief The maximum number of times to run the loop in this demo.
  *
@@ -112,53 +114,103 @@
 #define CSR_BUFFER_LENGTH                              2048
 
 /**
- * @brief Size of buffer in which to hold the certificate.
+ * @brief How long to wait for the response to a fleet provisioning request.
  */
-#define CERT_BUFFER_LENGTH                             2048
+#define RESPONSE_TIMEOUT_MS                                15000U
 
 /**
- * @brief Size of buffer in which to hold the certificate id.
- *
- * See https://docs.aws.amazon.com/iot/latest/apireference/API_Certificate.html#iot-Type-Certificate-certificateId
+ * @brief Number of entries in #keyCertificateResponseTopics and
+ * #registerThingResponseTopics.
  */
-#define CERT_ID_BUFFER_LENGTH                          64
+#define PROVISIONING_RESPONSE_TOPIC_COUNT              2
 
 /**
- * @brief Size of buffer in which to hold the certificate ownership token.
+ * @brief The responses to CreateKeysAndCertificate, subscribed to with a
+ * single SUBSCRIBE.
  */
-#define OWNERSHIP_TOKEN_BUFFER_LENGTH                  512
+static const MQTTSubscribeInfo_t keyCertificateResponseTopics[ PROVISIONING_RESPONSE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( CREATE_KEYS_ACCEPTED_TOPIC ),
+        .topicFilterLength = FP_FORMAT( CREATE_KEYS_ACCEPTED_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( CREATE_KEYS_REJECTED_TOPIC ),
+        .topicFilterLength = FP_FORMAT( CREATE_KEYS_REJECTED_LENGTH )
+    }
+};
 
 /**
- * @brief Size of buffer in which to hold the private key.
+ * @brief The responses to RegisterThing, subscribed to with a single
+ * SUBSCRIBE.
  */
-#define PRIV_KEY_BUFFER_LENGTH                             2048
+static const MQTTSubscribeInfo_t registerThingResponseTopics[ PROVISIONING_RESPONSE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( REGISTER_ACCEPTED_TOPIC )( PROVISIONING_TEMPLATE_NAME ),
+        .topicFilterLength = FP_FORMAT( REGISTER_ACCEPTED_LENGTH )( PROVISIONING_TEMPLATE_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( REGISTER_REJECTED_TOPIC )( PROVISIONING_TEMPLATE_NAME ),
+        .topicFilterLength = FP_FORMAT( REGISTER_REJECTED_LENGTH )( PROVISIONING_TEMPLATE_NAME_LENGTH )
+    }
+};
 
 /**
- * @brief Status values of the Fleet Provisioning response.
+ * @brief Number of entries in #shadowDeleteTopics.
  */
-typedef enum
-{
-    ResponseNotReceived,
-    ResponseAccepted,
-    ResponseRejected
-} ResponseStatus_t;
-
-/*-----------------------------------------------------------*/
+#define SHADOW_DELETE_TOPIC_COUNT                      2U
 
 /**
- * @brief Status reported from the MQTT publish callback.
+ * @brief Number of entries in #shadowUpdateTopics.
  */
-static ResponseStatus_t responseStatus;
+#define SHADOW_UPDATE_TOPIC_COUNT                      3U
 
 /**
- * @brief Buffer to hold the provisioned AWS IoT Thing name.
+ * @brief The responses to `/delete`, subscribed to with a single SUBSCRIBE.
  */
-static char thingName[ MAX_THING_NAME_LENGTH ];
+static const MQTTSubscribeInfo_t shadowDeleteTopics[ SHADOW_DELETE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
 
 /**
- * @brief Length of the AWS IoT Thing name.
+ * @brief The topics the demo listens on while it updates the shadow,
+ * subscribed to with a single SUBSCRIBE.
  */
-static size_t thingNameLength;
+static const MQTTSubscribeInfo_t shadowUpdateTopics[ SHADOW_UPDATE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
+
+/*-----------------------------------------------------------*/
 
 /**
  * @brief Buffer to hold responses received from the AWS IoT Fleet Provisioning
@@ -173,6 +225,18 @@ static uint8_t payloadBuffer[ NETWORK_BUFFER_SIZE ];
  */
 static size_t payloadLength;
 
+/**
+ * @brief Buffer to hold the CreateKeysAndCertificate response. The provisioned
+ * credentials are parsed in place and used from here, so it must not be reused
+ * for the RegisterThing exchange.
+ */
+static uint8_t credentialsBuffer[ NETWORK_BUFFER_SIZE ];
+
+/**
+ * @brief Length of the payload stored in #credentialsBuffer.
+ */
+static size_t credentialsLength;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -327,9 +391,33 @@ static bool shadowDeleted = false;
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Run the MQTT process loop to get a response.
+ * @brief Publish #payloadBuffer as a fleet provisioning request and wait for
+ * its response, which is copied into @p pResponseBuffer.
+ *
+ * The request is registered before it is published, so a response arriving
+ * in the process loop run by PublishToTopic is not missed, and the wait ends
+ * as soon as the publish callback hands the response over.
+ *
+ * @param[in] pTopic The topic of the request.
+ * @param[in] topicLength The length of @p pTopic.
+ * @param[in] acceptedTopic The topic of an accepted response.
+ * @param[in] rejectedTopic The topic of a rejected response.
+ * @param[in] pApiName Name of the API for logging.
+ * @param[out] pResponseBuffer The buffer the response is copied into. Can be
+ * #payloadBuffer.
+ * @param[in] responseBufferLength The size of @p pResponseBuffer.
+ * @param[out] pResponseLength The length of the response.
+ *
+ * @return EXIT_SUCCESS if the request was accepted; EXIT_FAILURE otherwise.
  */
-static int32_t waitForResponse( void );
+static int32_t sendProvisioningRequest( const char * pTopic,
+                                        uint16_t topicLength,
+                                        FleetProvisioningTopic_t acceptedTopic,
+                                        FleetProvisioningTopic_t rejectedTopic,
+                                        const char * pApiName,
+                                        uint8_t * pResponseBuffer,
+                                        size_t responseBufferLength,
+                                        size_t * pResponseLength );
 
 /**
  * @brief Subscribe to the CreateKeysAndCertificate accepted and rejected topics.
@@ -384,25 +472,75 @@ static int32_t unsubscribeFromKeyCertificateResponseTopics( void );
  */
 static int32_t unsubscribeFromRegisterThingResponseTopics( void );
 
+#if PROVISIONING_TIMER_PUBLISH
+
+/**
+ * @brief Publish the provisioning timing record on the connection with the
+ * provisioned certificate. Provisioning doesn't fail if it can't be sent.
+ */
+    static void publishProvisioningTiming( void );
+#endif
+
 /*-----------------------------------------------------------*/
 
-static int32_t waitForResponse( void )
+static int32_t sendProvisioningRequest( const char * pTopic,
+                                        uint16_t topicLength,
+                                        FleetProvisioningTopic_t acceptedTopic,
+                                        FleetProvisioningTopic_t rejectedTopic,
+                                        const char * pApiName,
+                                        uint8_t * pResponseBuffer,
+                                        size_t responseBufferLength,
+                                        size_t * pResponseLength )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    responseStatus = ResponseNotReceived;
+    int returnStatus = EXIT_FAILURE;
+    ProvisioningRequest_t * pRequest = NULL;
+    ProvisioningRequestStatus_t requestStatus = ProvisioningRequestFailed;
 
-    /* responseStatus is updated from the MQTT publish callback. */
-    ( void ) ProcessLoop();
+    pRequest = ProvisioningRequest_Start( acceptedTopic,
+                                          rejectedTopic,
+                                          pResponseBuffer,
+                                          responseBufferLength,
+                                          RESPONSE_TIMEOUT_MS );
 
-    if( responseStatus == ResponseNotReceived )
+    if( pRequest != NULL )
     {
-        LogError( ( "Timed out waiting for response." ) );
+        returnStatus = PublishToTopic( pTopic,
+                                       topicLength,
+                                       ( char * ) payloadBuffer,
+                                       payloadLength );
+
+        if( returnStatus != EXIT_SUCCESS )
+        {
+            LogError( ( "Failed to publish to fleet provisioning topic: %.*s.",
+                        topicLength,
+                        pTopic ) );
+            ProvisioningRequest_Cancel( pRequest );
+        }
     }
 
-    if( responseStatus == ResponseAccepted )
+    if( returnStatus == EXIT_SUCCESS )
     {
-        returnStatus = EXIT_SUCCESS;
+        /* This task receives from the connection, so the process loop runs
+         * in short slices until the response is in. */
+        requestStatus = ProvisioningRequest_Wait( pRequest, ProcessLoopWithTimeout, pResponseLength );
+
+        if( requestStatus == ProvisioningRequestAccepted )
+        {
+            LogInfo( ( "Received accepted response from Fleet Provisioning %s API.", pApiName ) );
+        }
+        else
+        {
+            if( requestStatus == ProvisioningRequestRejected )
+            {
+                LogError( ( "Received rejected response from Fleet Provisioning %s API.", pApiName ) );
+            }
+            else
+            {
+                LogError( ( "No response from Fleet Provisioning %s API.", pApiName ) );
+            }
+
+            returnStatus = EXIT_FAILURE;
+        }
     }
 
     return returnStatus;
@@ -412,29 +550,13 @@ static int32_t waitForResponse( void )
 
 static int32_t subscribeToKeyCertificateResponseTopics( void )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = SubscribeToTopic( FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC,
-                                     FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH );
+    int returnStatus = SubscribeToTopics( keyCertificateResponseTopics,
+                                          PROVISIONING_RESPONSE_TOPIC_COUNT,
+                                          NULL );
 
     if( returnStatus != EXIT_SUCCESS )
     {
-        LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH,
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC ) );
-    }
-
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        returnStatus = SubscribeToTopic( FP_CBOR_CREATE_KEYS_REJECTED_TOPIC,
-                                   FP_CBOR_CREATE_KEYS_REJECTED_LENGTH );
-
-        if( returnStatus != EXIT_SUCCESS )
-        {
-            LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                        FP_CBOR_CREATE_KEYS_REJECTED_LENGTH,
-                        FP_CBOR_CREATE_KEYS_REJECTED_TOPIC ) );
-        }
+        LogError( ( "Failed to subscribe to the CreateKeysAndCertificate response topics." ) );
     }
 
     return returnStatus;
@@ -444,29 +566,12 @@ static int32_t subscribeToKeyCertificateResponseTopics( void )
 
 static int32_t unsubscribeFromKeyCertificateResponseTopics( void )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = UnsubscribeFromTopic(  FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC,
-                                        FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH );
+    int returnStatus = UnsubscribeFromTopics( keyCertificateResponseTopics,
+                                              PROVISIONING_RESPONSE_TOPIC_COUNT );
 
     if( returnStatus != EXIT_SUCCESS )
     {
-        LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH,
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC ) );
-    }
-
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        returnStatus = UnsubscribeFromTopic(  FP_CBOR_CREATE_KEYS_REJECTED_TOPIC,
-                                            FP_CBOR_CREATE_KEYS_REJECTED_LENGTH );
-
-        if( returnStatus != EXIT_SUCCESS )
-        {
-            LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                        FP_CBOR_CREATE_KEYS_REJECTED_LENGTH,
-                        FP_CBOR_CREATE_KEYS_REJECTED_TOPIC ) );
-        }
+        LogError( ( "Failed to unsubscribe from the CreateKeysAndCertificate response topics." ) );
     }
 
     return returnStatus;
@@ -476,29 +581,13 @@ static int32_t unsubscribeFromKeyCertificateResponseTopics( void )
 
 static int32_t subscribeToRegisterThingResponseTopics( void )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = SubscribeToTopic( FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                     FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
+    int returnStatus = SubscribeToTopics( registerThingResponseTopics,
+                                          PROVISIONING_RESPONSE_TOPIC_COUNT,
+                                          NULL );
 
     if( returnStatus != EXIT_SUCCESS )
     {
-        LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                    FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                    FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-    }
-
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        returnStatus = SubscribeToTopic( FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                   FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
-
-        if( returnStatus != EXIT_SUCCESS )
-        {
-            LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                        FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                        FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-        }
+        LogError( ( "Failed to subscribe to the RegisterThing response topics." ) );
     }
 
     return returnStatus;
@@ -508,29 +597,12 @@ static int32_t subscribeToRegisterThingResponseTopics( void )
 
 static int32_t unsubscribeFromRegisterThingResponseTopics( void )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = UnsubscribeFromTopic(FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                        FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
+    int returnStatus = UnsubscribeFromTopics( registerThingResponseTopics,
+                                              PROVISIONING_RESPONSE_TOPIC_COUNT );
 
     if( returnStatus != EXIT_SUCCESS )
     {
-        LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                    FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                    FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-    }
-
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        returnStatus =UnsubscribeFromTopic( FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                   FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
-
-        if( returnStatus != EXIT_SUCCESS )
-        {
-            LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                        FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                        FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-        }
+        LogError( ( "Failed to unsubscribe from the RegisterThing response topics." ) );
     }
 
     return returnStatus;
@@ -551,7 +623,6 @@ static void provisioningPublishCallback(    MQTTContext_t * pMqttContext,
 
     FleetProvisioningStatus_t status;
     FleetProvisioningTopic_t api;
-    const char * cborDump;
 
     ( void ) pMqttContext;
 
@@ -593,59 +664,11 @@ static void provisioningPublishCallback(    MQTTContext_t * pMqttContext,
         else if ( status == FleetProvisioningSuccess )
         {
             LogInfo( ( "FleetProvisioningSuccess" ) );
-            if( api == FleetProvCborCreateKeysAndCertAccepted )
-            {
-                LogInfo( ( "Received accepted response from Fleet Provisioning CreateKeysAndCertificate API." ) );
-                
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogInfo( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseAccepted;
 
-                /* Copy the payload from the MQTT library's buffer to #payloadBuffer. */
-                ( void ) memcpy( ( void * ) payloadBuffer,
-                                ( const void * ) pDeserializedInfo->pPublishInfo->pPayload,
-                                ( size_t ) pDeserializedInfo->pPublishInfo->payloadLength );
-
-                payloadLength = pDeserializedInfo->pPublishInfo->payloadLength;
-            }
-            else if( api == FleetProvCborCreateKeysAndCertRejected )
-            {
-                LogError( ( "Received rejected response from Fleet Provisioning CreateKeysAndCertificate API." ) );
-                
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogError( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseRejected;
-            }
-            else if( api == FleetProvCborRegisterThingAccepted )
+            /* Wake the task waiting for this response. */
+            if( ProvisioningRequests_HandleResponse( api, pDeserializedInfo->pPublishInfo ) == false )
             {
-                LogInfo( ( "Received accepted response from Fleet Provisioning RegisterThing API." ) );
-
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogInfo( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseAccepted;
-
-                /* Copy the payload from the MQTT library's buffer to #payloadBuffer. */
-                ( void ) memcpy( ( void * ) payloadBuffer,
-                                ( const void * ) pDeserializedInfo->pPublishInfo->pPayload,
-                                ( size_t ) pDeserializedInfo->pPublishInfo->payloadLength );
-
-                payloadLength = pDeserializedInfo->pPublishInfo->payloadLength;
-            }
-            else if( api == FleetProvCborRegisterThingRejected )
-            {
-                LogError( ( "Received rejected response from Fleet Provisioning RegisterThing API." ) );
-
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogError( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseRejected;
-            }
-            else
-            {
-                LogError( ( "Received message on unexpected Fleet Provisioning topic. Topic: %.*s.",
+                LogError( ( "Received Fleet Provisioning message with no request waiting for it. Topic: %.*s.",
                             ( int ) pDeserializedInfo->pPublishInfo->topicNameLength,
                             ( const char * ) pDeserializedInfo->pPublishInfo->pTopicName ) );
             }
@@ -655,10 +678,11 @@ static void provisioningPublishCallback(    MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
-/* This is the callback function invoked by the MQTT stack when it receives
- * incoming messages. This function demonstrates how to use the Shadow_MatchTopicString
- * function to determine whether the incoming message is a device shadow message
- * or not. If it is, it handles the message depending on the message type.
+/* This is the callback function invoked by the MQTT session when it receives
+ * incoming publishes; the session handles the acknowledgements. This function
+ * demonstrates how to use the Shadow_MatchTopicString function to determine
+ * whether the incoming message is a device shadow message or not. If it is, it
+ * handles the message depending on the message type.
  */
 static void eventCallback( MQTTContext_t * pMqttContext,
                            MQTTPacketInfo_t * pPacketInfo,
@@ -669,7 +693,6 @@ static void eventCallback( MQTTContext_t * pMqttContext,
     uint8_t thingNameLength = 0U;
     const char * pShadowName = NULL;
     uint8_t shadowNameLength = 0U;
-    uint16_t packetIdentifier;
 
     ( void ) pMqttContext;
 
@@ -677,8 +700,6 @@ static void eventCallback( MQTTContext_t * pMqttContext,
     assert( pMqttContext != NULL );
     assert( pPacketInfo != NULL );
 
-    packetIdentifier = pDeserializedInfo->packetIdentifier;
-
     /* Handle incoming publish. The lower 4 bits of the publish packet
      * type is used for the dup, QoS, and retain flags. Hence masking
      * out the lower bits to check if the packet is publish. */
@@ -739,14 +760,31 @@ static void eventCallback( MQTTContext_t * pMqttContext,
             eventCallbackError = true;
         }
     }
-    else
+}
+
+/*-----------------------------------------------------------*/
+
+#if PROVISIONING_TIMER_PUBLISH
+
+    static void publishProvisioningTiming( void )
     {
-        HandleOtherIncomingPacket( pPacketInfo, packetIdentifier );
+        static char record[ PROVISIONING_TIMER_RECORD_LENGTH ];
+        size_t recordLength = ProvisioningTimer_GetRecord( record, sizeof( record ) );
+
+        if( ( recordLength > 0U ) &&
+            ( PublishToTopic( PROVISIONING_TIMER_TOPIC,
+                              ( int32_t ) strlen( PROVISIONING_TIMER_TOPIC ),
+                              record,
+                              recordLength ) != EXIT_SUCCESS ) )
+        {
+            LogWarn( ( "Failed to publish the provisioning timing record." ) );
+        }
     }
-}
 
 /*-----------------------------------------------------------*/
 
+#endif /* if PROVISIONING_TIMER_PUBLISH */
+
 /**
  * @brief Entry point of shadow demo.
  */
@@ -754,32 +792,28 @@ int aws_iot_demo_main( int argc,
           char ** argv )
 {
     int returnStatus = EXIT_SUCCESS;
-    /* Buffer for holding received certificate until it is saved. */
-    char certificate[ CERT_BUFFER_LENGTH ];
-    size_t certificateLength;
-    /* Buffer for holding the certificate ID. */
-    char certificateId[ CERT_ID_BUFFER_LENGTH ];
-    size_t certificateIdLength;
-    /* Buffer for holding the certificate ownership token. */
-    char ownershipToken[ OWNERSHIP_TOKEN_BUFFER_LENGTH ];
-    size_t ownershipTokenLength;
-    /* Buffer for holding the private key. */
-    char privateKey[ PRIV_KEY_BUFFER_LENGTH ];
-    size_t privateKeyLength;
+    /* The provisioned credentials, in #credentialsBuffer. */
+    ProvisioningResponse_t credentials;
+    /* The RegisterThing response, in #payloadBuffer. */
+    ProvisioningResponse_t registration;
     bool connectionEstablished = false;
+    /* Whether traffic switched to the session with the provisioned
+     * certificate without a reconnect. */
+    bool handedOver = false;
+    #if PROVISIONING_HANDOVER
+        /* Whether that session was started alongside the claim session. */
+        bool handoverStarted = false;
+    #endif
 
     /* Silence compiler warnings about unused variables. */
     ( void ) argc;
     ( void ) argv;
 
+    /* Set up the table matching fleet provisioning responses to requests. */
+    ProvisioningRequests_Init();
+
     do
     {
-        /* Initialize the buffer lengths to their max lengths. */
-        certificateLength = CERT_BUFFER_LENGTH;
-        certificateIdLength = CERT_ID_BUFFER_LENGTH;
-        ownershipTokenLength = OWNERSHIP_TOKEN_BUFFER_LENGTH;
-        privateKeyLength = PRIV_KEY_BUFFER_LENGTH;
-
         // TODO: Initialize the PKCS #11 module
 
         /**** Connect to AWS IoT Core with provisioning claim credentials *****/
@@ -788,7 +822,9 @@ int aws_iot_demo_main( int argc,
          * connection fails, retries after a timeout. Timeout value will
          * exponentially increase until maximum attempts are reached. */
         LogInfo( ( "Establishing MQTT session with claim certificate..." ) );
+        ProvisioningTimer_BeginPhase( ProvisioningPhaseClaimConnect );
         returnStatus = EstablishMqttSession( provisioningPublishCallback );
+        ProvisioningTimer_EndPhase( ProvisioningPhaseClaimConnect );
 
         if( returnStatus != EXIT_SUCCESS )
         {
@@ -806,8 +842,7 @@ int aws_iot_demo_main( int argc,
         if( returnStatus == EXIT_SUCCESS )
         {
             /* Subscribe to the CreateKeysAndCertificate accepted and rejected
-             * topics. In this demo we use CBOR encoding for the payloads,
-             * so we use the CBOR variants of the topics. */
+             * topics, in the payload format selected in menuconfig. */
             returnStatus = subscribeToKeyCertificateResponseTopics();
         }
 
@@ -817,51 +852,45 @@ int aws_iot_demo_main( int argc,
 
         if ( returnStatus == EXIT_SUCCESS )
         {
-            /* Publish to the CreateKeysAndCertificate API. */
-            returnStatus = PublishToTopic( FP_CBOR_CREATE_KEYS_PUBLISH_TOPIC,
-                            FP_CBOR_CREATE_KEYS_PUBLISH_LENGTH,
-                            ( char * ) payloadBuffer,
-                            payloadLength );
-
-            if( returnStatus == EXIT_FAILURE )
-            {
-                LogError( ( "Failed to publish to fleet provisioning topic: %.*s.",
-                            FP_CBOR_CREATE_KEYS_PUBLISH_LENGTH,
-                            FP_CBOR_CREATE_KEYS_PUBLISH_TOPIC ) );
-            }
+            /* Publish to the CreateKeysAndCertificate API and get the response. */
+            ProvisioningTimer_BeginPhase( ProvisioningPhaseCreateCertificate );
+            returnStatus = sendProvisioningRequest( FP_FORMAT( CREATE_KEYS_PUBLISH_TOPIC ),
+                                                    FP_FORMAT( CREATE_KEYS_PUBLISH_LENGTH ),
+                                                    FP_FORMAT_TOPIC( CreateKeysAndCertAccepted ),
+                                                    FP_FORMAT_TOPIC( CreateKeysAndCertRejected ),
+                                                    "CreateKeysAndCertificate",
+                                                        credentialsBuffer,
+                                                        NETWORK_BUFFER_SIZE,
+                                                        &credentialsLength );
+            ProvisioningTimer_EndPhase( ProvisioningPhaseCreateCertificate );
         }
-
-        // if ( returnStatus == EXIT_SUCCESS )
-        // {
-        //     /* Get the response to the CreateKeysAndCertificate request. */
-        //     returnStatus = waitForResponse();
-        // }
         
         if( returnStatus == EXIT_SUCCESS )
         {
             /* From the response, extract the certificate, certificate ID, and
              * certificate ownership token. */
-            bool parseStatus = parseKeyCertResponse(    payloadBuffer,
-                                                        payloadLength,
-                                                        certificate,
-                                                        &certificateLength,
-                                                        certificateId,
-                                                        &certificateIdLength,
-                                                        ownershipToken,
-                                                        &ownershipTokenLength,
-                                                        privateKey,
-                                                        &privateKeyLength );
+            bool parseStatus = parseKeyCertResponse( credentialsBuffer,
+                                                     credentialsLength,
+                                                     NETWORK_BUFFER_SIZE,
+                                                     &credentials );
 
             if( parseStatus == true )
             {
-                LogInfo( ( "Received certificate: %.*s", ( int ) certificateLength, certificate ) );
-                LogInfo( ( "Received certificate with Id: %.*s", ( int ) certificateIdLength, certificateId ) );
-                LogInfo( ( "Received ownershipToken: %.*s", ( int ) ownershipTokenLength, ownershipToken ) );
-                LogInfo( ( "Received privateKey: %.*s", ( int ) privateKeyLength, privateKey ) );
-                provisioned_cert = certificate;
-                provisioned_privatekey = privateKey;
+                LogInfo( ( "Received certificate: %s", credentials.certificatePem.pString ) );
+                LogInfo( ( "Received certificate with Id: %s", credentials.certificateId.pString ) );
+                LogInfo( ( "Received ownershipToken: %s", credentials.certificateOwnershipToken.pString ) );
+                LogInfo( ( "Received privateKey: %s", credentials.privateKey.pString ) );
+                provisioned_cert = ( char * ) credentials.certificatePem.pString;
+                provisioned_privatekey = ( char * ) credentials.privateKey.pString;
+                /* The provisioned credentials may reuse buffers the transport has
+                 * already parsed, so drop the cached copies before reconnecting. */
+                vTlsCredentialCacheInvalidate();
                 returnStatus = EXIT_SUCCESS;
             }
+            else
+            {
+                returnStatus = EXIT_FAILURE;
+            }
         }
 
         // Note: Skipped saving certificate into PKCS #11
@@ -892,8 +921,8 @@ int aws_iot_demo_main( int argc,
             /* Create the request payload to publish to the RegisterThing API. */
             bool generateStatus = generateRegisterThingRequest( payloadBuffer,
                                                                 NETWORK_BUFFER_SIZE,
-                                                                ownershipToken,
-                                                                ownershipTokenLength,
+                                                                credentials.certificateOwnershipToken.pString,
+                                                                credentials.certificateOwnershipToken.length,
                                                                 DEVICE_SERIAL_NUMBER,
                                                                 DEVICE_SERIAL_NUMBER_LENGTH,
                                                                 &payloadLength );
@@ -913,55 +942,78 @@ int aws_iot_demo_main( int argc,
 
         if( returnStatus == EXIT_SUCCESS )
         {
-            /* Publish the RegisterThing request. */
-            returnStatus = PublishToTopic(  FP_CBOR_REGISTER_PUBLISH_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                            FP_CBOR_REGISTER_PUBLISH_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                                            ( char * ) payloadBuffer,
-                                            payloadLength );
-
-            if( returnStatus != EXIT_SUCCESS )
-            {
-                LogError( ( "Failed to publish to fleet provisioning topic: %.*s.",
-                            FP_CBOR_REGISTER_PUBLISH_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                            FP_CBOR_REGISTER_PUBLISH_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-            }
-        }
-
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            /* Get the response to the RegisterThing request. */
-            returnStatus = waitForResponse();
+            /* Publish the RegisterThing request and get the response. */
+            ProvisioningTimer_BeginPhase( ProvisioningPhaseRegisterThing );
+            returnStatus = sendProvisioningRequest( FP_FORMAT( REGISTER_PUBLISH_TOPIC )( PROVISIONING_TEMPLATE_NAME ),
+                                                    FP_FORMAT( REGISTER_PUBLISH_LENGTH )( PROVISIONING_TEMPLATE_NAME_LENGTH ),
+                                                    FP_FORMAT_TOPIC( RegisterThingAccepted ),
+                                                    FP_FORMAT_TOPIC( RegisterThingRejected ),
+                                                    "RegisterThing",
+                                                        payloadBuffer,
+                                                        NETWORK_BUFFER_SIZE,
+                                                        &payloadLength );
+            ProvisioningTimer_EndPhase( ProvisioningPhaseRegisterThing );
         }
 
         if( returnStatus == EXIT_SUCCESS )
         {
             /* Extract the Thing name from the response. */
-            thingNameLength = MAX_THING_NAME_LENGTH;
-            bool parseStatus = parseRegisterThingResponse(  payloadBuffer,
-                                                            payloadLength,
-                                                            thingName,
-                                                            &thingNameLength );
+            bool parseStatus = parseRegisterThingResponse( payloadBuffer,
+                                                           payloadLength,
+                                                           NETWORK_BUFFER_SIZE,
+                                                           &registration );
 
             if( parseStatus == true )
             {
-                LogInfo( ( "Received AWS IoT Thing name: %.*s", ( int ) thingNameLength, thingName ) );
+                LogInfo( ( "Received AWS IoT Thing name: %s", registration.thingName.pString ) );
                 returnStatus = EXIT_SUCCESS;
             }
+            else
+            {
+                returnStatus = EXIT_FAILURE;
+            }
         }
         
+        #if PROVISIONING_HANDOVER
+            /* RegisterThing activated the certificate, so connect with it
+             * while the claim session finishes its cleanup. */
+            if( returnStatus == EXIT_SUCCESS )
+            {
+                LogInfo( ( "Establishing MQTT session with provisioned certificate alongside the claim session..." ) );
+                ProvisioningTimer_BeginPhase( ProvisioningPhaseDeviceConnect );
+                handoverStarted = ( StartProvisionedMqttSessionHandover( eventCallback ) == EXIT_SUCCESS );
+            }
+        #endif
+
         if( returnStatus == EXIT_SUCCESS )
         {
             /* Unsubscribe from the RegisterThing topics. */
             returnStatus = unsubscribeFromRegisterThingResponseTopics();
         }
         
+        /**** Switch to the provisioned certificate ***************************/
+
+        #if PROVISIONING_HANDOVER
+            if( handoverStarted == true )
+            {
+                /* Closes the claim session once the provisioned one is up. */
+                handedOver = ( FinishProvisionedMqttSessionHandover() == EXIT_SUCCESS );
+                ProvisioningTimer_EndPhase( ProvisioningPhaseDeviceConnect );
+
+                if( handedOver == false )
+                {
+                    LogWarn( ( "Handover to the provisioned certificate failed. Reconnecting instead." ) );
+                }
+            }
+        #endif
+
         /**** Disconnect from AWS IoT Core ************************************/
 
         /* As we have completed the provisioning workflow, we disconnect from
          * the connection using the provisioning claim credentials. We will
          * establish a new MQTT connection with the newly provisioned
          * credentials. */
-        if( connectionEstablished == true )
+        if( ( connectionEstablished == true ) && ( handedOver == false ) )
         {
             returnStatus = DisconnectMqttSession();
             if ( returnStatus == EXIT_SUCCESS )
@@ -974,8 +1026,13 @@ int aws_iot_demo_main( int argc,
 
         if ( returnStatus == EXIT_SUCCESS )
         {
-            LogInfo( ( "Establishing MQTT session with provisioned certificate..." ) );
-            returnStatus = EstablishProvisionedMqttSession( eventCallback );
+            if( handedOver == false )
+            {
+                LogInfo( ( "Establishing MQTT session with provisioned certificate..." ) );
+                ProvisioningTimer_BeginPhase( ProvisioningPhaseDeviceConnect );
+                returnStatus = EstablishProvisionedMqttSession( eventCallback );
+                ProvisioningTimer_EndPhase( ProvisioningPhaseDeviceConnect );
+            }
 
             if( returnStatus != EXIT_SUCCESS )
             {
@@ -988,6 +1045,12 @@ int aws_iot_demo_main( int argc,
             {
                 LogInfo( ( "Sucessfully established connection with provisioned credentials." ) );
                 connectionEstablished = true;
+
+                ProvisioningTimer_Finish();
+
+                #if PROVISIONING_TIMER_PUBLISH
+                    publishProvisioningTiming();
+                #endif
             }
         }
 
@@ -1001,15 +1064,7 @@ int aws_iot_demo_main( int argc,
 
             /* First of all, try to delete any Shadow document in the cloud.
              * Try to subscribe to `/delete/accepted` and `/delete/rejected` topics. */
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
-                                             SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-        
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            /* Try to subscribe to `/delete/rejected` topic. */
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
-                                             SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            returnStatus = SubscribeToTopics( shadowDeleteTopics, SHADOW_DELETE_TOPIC_COUNT, NULL );
         }
 
         /* A buffer containing the update document. It has static duration to prevent
@@ -1028,14 +1083,7 @@ int aws_iot_demo_main( int argc,
         /* Unsubscribe from the `/delete/accepted` and 'delete/rejected` topics.*/
         if( returnStatus == EXIT_SUCCESS )
         {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            returnStatus = UnsubscribeFromTopics( shadowDeleteTopics, SHADOW_DELETE_TOPIC_COUNT );
         }
 
         /* Check if an incoming publish on `/delete/accepted` or `/delete/rejected`
@@ -1068,21 +1116,7 @@ int aws_iot_demo_main( int argc,
 
         /* Successfully connect to MQTT broker, the next step is
          * to subscribe shadow topics. */
-        returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
-                                            SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-
-
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
-                                                SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
-                                                SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
+        returnStatus = SubscribeToTopics( shadowUpdateTopics, SHADOW_UPDATE_TOPIC_COUNT, NULL );
 
         /* This demo uses a constant #THING_NAME and #SHADOW_NAME known at compile time therefore
             * we can use macros to assemble shadow topic strings.
@@ -1184,20 +1218,7 @@ int aws_iot_demo_main( int argc,
         if( returnStatus == EXIT_SUCCESS )
         {
             LogInfo( ( "Start to unsubscribe shadow topics and disconnect from MQTT. \r\n" ) );
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            returnStatus = UnsubscribeFromTopics( shadowUpdateTopics, SHADOW_UPDATE_TOPIC_COUNT );
         }
         
         /**** Finish **********************************************************/
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "esp_system.h"
 #include "nvs.h"
@@ -16,6 +17,7 @@
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "protocol_examples_common.h"
+#include "provisioning_timer.h"
 
 #include "shadow_demo_helpers.h"
 
@@ -25,6 +27,45 @@ int aws_iot_demo_main( int argc, char ** argv );
 
 static const char *TAG = "SHADOW_EXAMPLE";
 
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
+/* Read the certificate and key stored as DER blobs by a provisioning run.
+ * Returns false if they are absent, so that credentials stored as PEM by an
+ * earlier build are read instead. */
+static bool read_der_credentials(nvs_handle_t handle)
+{
+    size_t cert_size = 0;
+    size_t key_size = 0;
+    char* der = NULL;
+
+    if (nvs_get_blob(handle, "aws_cert_der", NULL, &cert_size) != ESP_OK ||
+        nvs_get_blob(handle, "aws_key_der", NULL, &key_size) != ESP_OK)
+    {
+        return false;
+    }
+
+    /* Kept for the life of the application, like the PEM credentials. */
+    der = malloc(cert_size + key_size);
+
+    if (der == NULL ||
+        nvs_get_blob(handle, "aws_cert_der", der, &cert_size) != ESP_OK ||
+        nvs_get_blob(handle, "aws_key_der", der + cert_size, &key_size) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to read the DER CERT and KEY from NVS.");
+        free(der);
+        return false;
+    }
+
+    provisioned_cert = der;
+    provisioned_cert_length = cert_size;
+    provisioned_privatekey = der + cert_size;
+    provisioned_privatekey_length = key_size;
+
+    ESP_LOGI(TAG, "DER CERT (%u bytes) and KEY (%u bytes) read from NVS.",
+        (unsigned) cert_size, (unsigned) key_size);
+    return true;
+}
+#endif
+
 /*
  * Prototypes for the demos that can be started from this project.  Note the
  * Shadow demo is not actually started until the network is already.
@@ -60,59 +101,81 @@ void app_main()
     // Read
     ESP_LOGI(TAG, "Reading content from NVS...");
 
-    size_t required_cert_size;
-    size_t required_certID_size;
-    size_t required_token_size;
-    size_t required_key_size;
-    nvs_err = nvs_get_str(my_handle, "aws_cert", NULL, &required_cert_size);
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
+    provisioned = read_der_credentials(my_handle);
+#endif
 
-    if (nvs_err != ESP_OK)
+    if (!provisioned)
     {
-        if (nvs_err == ESP_ERR_NVS_NOT_FOUND)
+        size_t required_cert_size;
+        size_t required_certID_size;
+        size_t required_token_size;
+        size_t required_key_size;
+        nvs_err = nvs_get_str(my_handle, "aws_cert", NULL, &required_cert_size);
+
+        if (nvs_err != ESP_OK)
         {
-            ESP_LOGI(TAG, "CERT not found in NVS, proceeding with Fleet Provisioning...");
-        } else {
-            ESP_LOGE(TAG, "Error (%s) reading!\n", esp_err_to_name(nvs_err));
+            if (nvs_err == ESP_ERR_NVS_NOT_FOUND)
+            {
+                ESP_LOGI(TAG, "CERT not found in NVS, proceeding with Fleet Provisioning...");
+            } else {
+                ESP_LOGE(TAG, "Error (%s) reading!\n", esp_err_to_name(nvs_err));
+            }
+            provisioned = false;
+        } else if (nvs_err == ESP_OK)
+        {
+            nvs_err = nvs_get_str(my_handle, "aws_key", NULL, &required_key_size);
         }
-        provisioned = false;
-    } else if (nvs_err == ESP_OK)
-    {
-        nvs_err = nvs_get_str(my_handle, "aws_key", NULL, &required_key_size);
-    }
     
-    switch (nvs_err)
-    {
-    case ESP_OK:
-        ESP_LOGI(TAG, "CERT and KEY found in NVS.");
-        provisioned = true;
-        break;
-    case ESP_ERR_NVS_NOT_FOUND:
-        ESP_LOGI(TAG, "CERT and KEY not found in NVS, proceeding with Fleet Provisioning...");
-        provisioned = false;
-        break;
-
-    default:
-        ESP_LOGE(TAG, "Error (%s) reading!\n", esp_err_to_name(nvs_err));
-        provisioned = false;
-        break;
-    }
+        switch (nvs_err)
+        {
+        case ESP_OK:
+            ESP_LOGI(TAG, "CERT and KEY found in NVS.");
+            provisioned = true;
+            break;
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGI(TAG, "CERT and KEY not found in NVS, proceeding with Fleet Provisioning...");
+            provisioned = false;
+            break;
+
+        default:
+            ESP_LOGE(TAG, "Error (%s) reading!\n", esp_err_to_name(nvs_err));
+            provisioned = false;
+            break;
+        }
     
-    if (provisioned)
-    {
-        char* aws_cert = malloc(required_cert_size);
-        char* aws_key = malloc(required_key_size);
-        nvs_get_str(my_handle, "aws_cert", aws_cert, &required_cert_size);
-        nvs_get_str(my_handle, "aws_key", aws_key, &required_key_size);
-
-        // Storing into global variable for AWS IoT use (Note: in production, either store in PKCS11 or save as local variable)
-        provisioned_cert = aws_cert;
-        provisioned_privatekey = aws_key;
-
-        ESP_LOGI(TAG, "CERT read from NVS: %s", aws_cert);
-        ESP_LOGI(TAG, "KEY read from NVS: %s", aws_key);
+        if (provisioned)
+        {
+            /* One allocation for both, kept for the life of the application. The
+             * transport keys its parsed copies on these addresses, so they must
+             * not move between connections. */
+            char* aws_cert = malloc(required_cert_size + required_key_size);
+            char* aws_key = aws_cert + required_cert_size;
+
+            if (aws_cert == NULL ||
+                nvs_get_str(my_handle, "aws_cert", aws_cert, &required_cert_size) != ESP_OK ||
+                nvs_get_str(my_handle, "aws_key", aws_key, &required_key_size) != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Failed to read CERT and KEY from NVS, proceeding with Fleet Provisioning...");
+                free(aws_cert);
+                provisioned = false;
+            } else {
+                // Storing into global variable for AWS IoT use (Note: in production, either store in PKCS11 or save as local variable)
+                provisioned_cert = aws_cert;
+                provisioned_privatekey = aws_key;
+
+                ESP_LOGI(TAG, "CERT (%u bytes) and KEY (%u bytes) read from NVS.",
+                    (unsigned) required_cert_size, (unsigned) required_key_size);
+            }
+        }
     }
     nvs_close(my_handle);
     /* --- End of reading CERT and KEY from NVS --- */
+
+    /* A device provisioned on an earlier boot has nothing to time. */
+    if (!provisioned) {
+        ProvisioningTimer_Start();
+    }
     
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -121,7 +184,9 @@ void app_main()
      * Read "Establishing Wi-Fi or Ethernet Connection" section in
      * examples/protocols/README.md for more information about this function.
      */
+    ProvisioningTimer_BeginPhase(ProvisioningPhaseWifi);
     ESP_ERROR_CHECK(example_connect());
+    ProvisioningTimer_EndPhase(ProvisioningPhaseWifi);
 
     aws_iot_demo_main(0,NULL);
 }
@@ -121,6 +121,22 @@
     #define CLIENT_IDENTIFIER    CONFIG_MQTT_CLIENT_IDENTIFIER
 #endif
 
+/**
+ * @brief Whether the session with the provisioned certificate is brought up
+ * before the claim session is closed.
+ */
+#ifndef PROVISIONING_HANDOVER
+    #define PROVISIONING_HANDOVER    CONFIG_EXAMPLE_PROVISIONING_HANDOVER
+#endif
+
+/**
+ * @brief Whether a provisioned device keeps its MQTT session and shadow
+ * subscriptions from one boot to the next.
+ */
+#ifndef FAST_RECONNECT
+    #define FAST_RECONNECT    CONFIG_EXAMPLE_FAST_RECONNECT
+#endif
+
 /**
  * @brief Size of the network buffer for MQTT packets.
  */
@@ -40,11 +40,18 @@ bool provisioned;
 char* provisioned_cert;
 char* provisioned_privatekey;
 
+/**
+ * @brief Lengths of the provisioned certificate and key when they are DER,
+ * or zero when they are PEM strings.
+ */
+size_t provisioned_cert_length;
+size_t provisioned_privatekey_length;
+
 /**
  * @brief Establish a MQTT connection.
  *
- * @param[in] appCallback The callback function used to receive incoming
- * publishes and incoming acks from MQTT library.
+ * @param[in] eventCallback The callback function used to receive incoming
+ * publishes. The acks are handled by the MQTT session.
  *
  * @return EXIT_SUCCESS if an MQTT session is established;
  * EXIT_FAILURE otherwise.
@@ -52,24 +59,40 @@ char* provisioned_privatekey;
 int32_t EstablishMqttSession( MQTTEventCallback_t eventCallback );
 
 /**
- * @brief Establish a MQTT connection.
+ * @brief Establish a MQTT connection with the provisioned certificate,
+ * resuming the session the broker holds for the device if there is one.
  *
- * @param[in] appCallback The callback function used to receive incoming
- * publishes and incoming acks from MQTT library.
+ * @param[in] eventCallback The callback function used to receive incoming
+ * publishes. The acks are handled by the MQTT session.
+ * @param[out] pSessionPresent Set to whether the broker resumed the earlier
+ * session, with its subscriptions. Can be NULL.
  *
  * @return EXIT_SUCCESS if an MQTT session is established;
  * EXIT_FAILURE otherwise.
  */
-int32_t EstablishProvisionedMqttSession( MQTTEventCallback_t eventCallback );
+int32_t EstablishProvisionedMqttSession( MQTTEventCallback_t eventCallback,
+                                         bool * pSessionPresent );
 
 /**
- * @brief Handle the incoming packet if it's not related to the device shadow.
- *
- * @param[in] pPacketInfo Packet Info pointer for the incoming packet.
- * @param[in] packetIdentifier Packet identifier of the incoming packet.
+ * @brief Start connecting with the provisioned certificate in the
+ * background, while the claim session stays in use.
+ * @param[in] eventCallback The callback function used to receive incoming
+ * publishes on the provisioned session.
+ * @return EXIT_SUCCESS if the connect was started;
+ * EXIT_FAILURE otherwise.
  */
-void HandleOtherIncomingPacket( MQTTPacketInfo_t * pPacketInfo,
-                                uint16_t packetIdentifier );
+int32_t StartProvisionedMqttSessionHandover( MQTTEventCallback_t eventCallback );
+
+/**
+ * @brief Switch to the session started by
+ * #StartProvisionedMqttSessionHandover once it is connected, and close the
+ * claim session.
+ * @param[out] pSessionPresent Whether the broker resumed the session.
+ * @return EXIT_SUCCESS if the provisioned session is established;
+ * EXIT_FAILURE otherwise. #DisconnectMqttSession then closes the session in
+ * use.
+ */
+int32_t FinishProvisionedMqttSessionHandover( bool * pSessionPresent );
 
 /**
  * @brief Close the MQTT connection.
@@ -92,6 +115,21 @@ int32_t DisconnectMqttSession( void );
 int32_t SubscribeToTopic( const char * pTopicFilter,
                           uint16_t topicFilterLength );
 
+/**
+ * @brief Subscribe to several MQTT topic filters with a single SUBSCRIBE.
+ *
+ * @param[in] pSubscriptionList The topic filters and their QoS.
+ * @param[in] subscriptionCount Number of entries in pSubscriptionList.
+ * @param[out] pSubAckCodes The SUBACK return code of each topic filter, or
+ * NULL.
+ *
+ * @return EXIT_SUCCESS if every topic filter was granted;
+ * EXIT_FAILURE otherwise.
+ */
+int32_t SubscribeToTopics( const MQTTSubscribeInfo_t * pSubscriptionList,
+                           size_t subscriptionCount,
+                           MQTTSubAckStatus_t * pSubAckCodes );
+
 /**
  * @brief Sends an MQTT UNSUBSCRIBE to unsubscribe from the shadow
  * topic.
@@ -106,6 +144,19 @@ int32_t SubscribeToTopic( const char * pTopicFilter,
 int32_t UnsubscribeFromTopic( const char * pTopicFilter,
                               uint16_t topicFilterLength );
 
+/**
+ * @brief Unsubscribe from several MQTT topic filters with a single
+ * UNSUBSCRIBE.
+ *
+ * @param[in] pSubscriptionList The topic filters.
+ * @param[in] subscriptionCount Number of entries in pSubscriptionList.
+ *
+ * @return EXIT_SUCCESS if UNSUBSCRIBE was successfully sent;
+ * EXIT_FAILURE otherwise.
+ */
+int32_t UnsubscribeFromTopics( const MQTTSubscribeInfo_t * pSubscriptionList,
+                               size_t subscriptionCount );
+
 /**
  * @brief Publish a message to a MQTT topic.
  *
@@ -130,4 +181,16 @@ int32_t PublishToTopic( const char * pTopicFilter,
  */
 bool ProcessLoop( void );
 
+/**
+ * @brief Invoke the core MQTT library's process loop function for at most
+ * @p timeoutMs milliseconds, so a caller can check for a response between
+ * short runs of the loop.
+ *
+ * @param[in] timeoutMs The time to run the process loop for.
+ *
+ * @return true if process loop was successful;
+ * false otherwise.
+ */
+bool ProcessLoopWithTimeout( uint32_t timeoutMs );
+
 #endif /* ifndef SHADOW_DEMO_HELPERS_H_ */
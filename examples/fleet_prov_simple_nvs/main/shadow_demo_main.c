@@ -61,9 +61,18 @@
 #include "shadow_demo_helpers.h"
 #include "fleet_provisioning_serializer.h"
 
+/* Transport interface implementation, for the credential cache. */
+#include "network_transport.h"
+
 /* AWS IoT Fleet Provisioning Library. */
 #include "fleet_provisioning.h"
 
+/* Fleet provisioning request correlation. */
+#include "provisioning_requests.h"
+
+/* Provisioning phase timing. */
+#include "provisioning_timer.h"
+
 /* Shadow config include. */
 #include "shadow_config.h"
 
@@ -77,6 +86,11 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
+    /* mbedTLS include for the PEM decoder. */
+    #include "mbedtls/pem.h"
+#endif
+
 /**
  * @brief The length of #PROVISIONING_TEMPLATE_NAME.
  */
@@ -87,13 +101,6 @@
  */
 #define DEVICE_SERIAL_NUMBER_LENGTH          ( ( uint16_t ) ( sizeof( DEVICE_SERIAL_NUMBER ) - 1 ) )
 
-/**
- * @brief Size of AWS IoT Thing name buffer.
- *
- * See https://docs.aws.amazon.com/iot/latest/apireference/API_CreateThing.html#iot-CreateThing-request-thingName
- */
-#define MAX_THING_NAME_LENGTH                128
-
 /**
  * @brief The maximum number of times to run the loop in this demo.
  *
@@ -116,53 +123,95 @@
 #define CSR_BUFFER_LENGTH                              2048
 
 /**
- * @brief Size of buffer in which to hold the certificate.
+ * @brief How long to wait for the response to a fleet provisioning request.
  */
-#define CERT_BUFFER_LENGTH                             2048
+#define RESPONSE_TIMEOUT_MS                                15000U
 
 /**
- * @brief Size of buffer in which to hold the certificate id.
- *
- * See https://docs.aws.amazon.com/iot/latest/apireference/API_Certificate.html#iot-Type-Certificate-certificateId
+ * @brief Number of entries in #shadowDeleteTopics.
  */
-#define CERT_ID_BUFFER_LENGTH                          64
+#define SHADOW_DELETE_TOPIC_COUNT                      2U
 
 /**
- * @brief Size of buffer in which to hold the certificate ownership token.
+ * @brief Number of entries in #shadowUpdateTopics.
  */
-#define OWNERSHIP_TOKEN_BUFFER_LENGTH                  512
+#define SHADOW_UPDATE_TOPIC_COUNT                      3U
 
 /**
- * @brief Size of buffer in which to hold the private key.
+ * @brief The responses to `/delete`, subscribed to with a single SUBSCRIBE.
  */
-#define PRIV_KEY_BUFFER_LENGTH                             2048
+static const MQTTSubscribeInfo_t shadowDeleteTopics[ SHADOW_DELETE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
 
 /**
- * @brief Status values of the Fleet Provisioning response.
+ * @brief The topics the demo listens on while it updates the shadow,
+ * subscribed to with a single SUBSCRIBE.
  */
-typedef enum
+static const MQTTSubscribeInfo_t shadowUpdateTopics[ SHADOW_UPDATE_TOPIC_COUNT ] =
 {
-    ResponseNotReceived,
-    ResponseAccepted,
-    ResponseRejected
-} ResponseStatus_t;
-
-/*-----------------------------------------------------------*/
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
 
 /**
- * @brief Status reported from the MQTT publish callback.
+ * @brief Number of entries in #provisioningResponseTopics.
  */
-static ResponseStatus_t responseStatus;
+#define PROVISIONING_RESPONSE_TOPIC_COUNT                  4
 
-/**
- * @brief Buffer to hold the provisioned AWS IoT Thing name.
- */
-static char thingName[ MAX_THING_NAME_LENGTH ];
+/*-----------------------------------------------------------*/
 
 /**
- * @brief Length of the AWS IoT Thing name.
+ * @brief The response topics of both fleet provisioning APIs, subscribed to
+ * together once the claim connection is up so that the requests can then be
+ * sent one after the other without a round trip to the broker in between.
  */
-static size_t thingNameLength;
+static const MQTTSubscribeInfo_t provisioningResponseTopics[ PROVISIONING_RESPONSE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( CREATE_KEYS_ACCEPTED_TOPIC ),
+        .topicFilterLength = FP_FORMAT( CREATE_KEYS_ACCEPTED_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( CREATE_KEYS_REJECTED_TOPIC ),
+        .topicFilterLength = FP_FORMAT( CREATE_KEYS_REJECTED_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( REGISTER_ACCEPTED_TOPIC )( PROVISIONING_TEMPLATE_NAME ),
+        .topicFilterLength = FP_FORMAT( REGISTER_ACCEPTED_LENGTH )( PROVISIONING_TEMPLATE_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = FP_FORMAT( REGISTER_REJECTED_TOPIC )( PROVISIONING_TEMPLATE_NAME ),
+        .topicFilterLength = FP_FORMAT( REGISTER_REJECTED_LENGTH )( PROVISIONING_TEMPLATE_NAME_LENGTH )
+    }
+};
 
 /**
  * @brief Buffer to hold responses received from the AWS IoT Fleet Provisioning
@@ -177,6 +226,18 @@ static uint8_t payloadBuffer[ NETWORK_BUFFER_SIZE ];
  */
 static size_t payloadLength;
 
+/**
+ * @brief Buffer to hold the CreateKeysAndCertificate response. The provisioned
+ * credentials are parsed in place and used from here, so it must not be reused
+ * for the RegisterThing exchange.
+ */
+static uint8_t credentialsBuffer[ NETWORK_BUFFER_SIZE ];
+
+/**
+ * @brief Length of the payload stored in #credentialsBuffer.
+ */
+static size_t credentialsLength;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -331,19 +392,71 @@ static bool shadowDeleted = false;
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Run the MQTT process loop to get a response.
+ * @brief Publish #payloadBuffer as a fleet provisioning request and wait for
+ * its response, which is copied into @p pResponseBuffer.
+ *
+ * The request is registered before it is published, so a response arriving
+ * in the process loop run by PublishToTopic is not missed, and the wait ends
+ * as soon as the publish callback hands the response over.
+ *
+ * @param[in] pTopic The topic of the request.
+ * @param[in] topicLength The length of @p pTopic.
+ * @param[in] acceptedTopic The topic of an accepted response.
+ * @param[in] rejectedTopic The topic of a rejected response.
+ * @param[in] pApiName Name of the API for logging.
+ * @param[out] pResponseBuffer The buffer the response is copied into. Can be
+ * #payloadBuffer.
+ * @param[in] responseBufferLength The size of @p pResponseBuffer.
+ * @param[out] pResponseLength The length of the response.
+ *
+ * @return EXIT_SUCCESS if the request was accepted; EXIT_FAILURE otherwise.
  */
-static int32_t waitForResponse( void );
+static int32_t sendProvisioningRequest( const char * pTopic,
+                                        uint16_t topicLength,
+                                        FleetProvisioningTopic_t acceptedTopic,
+                                        FleetProvisioningTopic_t rejectedTopic,
+                                        const char * pApiName,
+                                        uint8_t * pResponseBuffer,
+                                        size_t responseBufferLength,
+                                        size_t * pResponseLength );
 
 /**
- * @brief Subscribe to the CreateKeysAndCertificate accepted and rejected topics.
+ * @brief Subscribe to the CreateKeysAndCertificate and RegisterThing accepted
+ * and rejected topics, with a single SUBSCRIBE.
  */
-static int32_t subscribeToKeyCertificateResponseTopics( void );
+static int32_t subscribeToProvisioningResponseTopics( void );
 
 /**
- * @brief Subscribe to the RegisterThing accepted and rejected topics.
+ * @brief Unsubscribe from every fleet provisioning response topic, with a
+ * single UNSUBSCRIBE.
  */
-static int32_t subscribeToRegisterThingResponseTopics( void );
+static int32_t unsubscribeFromProvisioningResponseTopics( void );
+
+#if PROVISIONING_TIMER_PUBLISH
+
+/**
+ * @brief Publish the provisioning timing record on the connection with the
+ * provisioned certificate. Provisioning doesn't fail if it can't be sent.
+ */
+    static void publishProvisioningTiming( void );
+#endif
+
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
+
+/**
+ * @brief Convert a PEM object to DER and store it in NVS as a blob.
+ *
+ * @param[in] handle The NVS handle to store into.
+ * @param[in] pKey The NVS key of the blob.
+ * @param[in] pPem The NUL-terminated PEM object.
+ *
+ * @return ESP_OK; ESP_ERR_INVALID_ARG if @p pPem isn't a PEM object; or the
+ * error of nvs_set_blob.
+ */
+    static esp_err_t storeCredentialDer( nvs_handle_t handle,
+                                         const char * pKey,
+                                         const char * pPem );
+#endif
 
 /**
  * @brief This example uses the MQTT library of the AWS IoT Device SDK for
@@ -373,103 +486,115 @@ static void eventCallback( MQTTContext_t * pMqttContext,
                            MQTTPacketInfo_t * pPacketInfo,
                            MQTTDeserializedInfo_t * pDeserializedInfo );
 
-/**
- * @brief Subscribe to the CreateKeysAndCertificate accepted and rejected topics.
- */
-static int32_t subscribeToKeyCertificateResponseTopics( void );
-
-/**
- * @brief Unsubscribe from the CreateKeysAndCertificate accepted and rejected topics.
- */
-static int32_t unsubscribeFromKeyCertificateResponseTopics( void );
+/*-----------------------------------------------------------*/
 
-/**
- * @brief Unsubscribe from the RegisterThing accepted and rejected topics.
- */
-static int32_t unsubscribeFromRegisterThingResponseTopics( void );
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
 
-/*-----------------------------------------------------------*/
+    static esp_err_t storeCredentialDer( nvs_handle_t handle,
+                                         const char * pKey,
+                                         const char * pPem )
+    {
+        static const char begin[] = "-----BEGIN ";
+        esp_err_t status = ESP_ERR_INVALID_ARG;
+        const char * pLabel = strstr( pPem, begin );
+        const char * pLabelEnd = NULL;
+        char header[ 64 ];
+        char footer[ 64 ];
+        int labelLength = 0;
+        mbedtls_pem_context pem;
+        const unsigned char * pDer = NULL;
+        size_t derLength = 0U;
+        size_t used = 0U;
+
+        if( pLabel != NULL )
+        {
+            pLabel += sizeof( begin ) - 1U;
+            pLabelEnd = strstr( pLabel, "-----" );
+        }
 
-static int32_t waitForResponse( void )
-{
-    int returnStatus = EXIT_SUCCESS;
+        /* The label is short, such as "CERTIFICATE" or "RSA PRIVATE KEY". */
+        if( ( pLabelEnd != NULL ) && ( ( pLabelEnd - pLabel ) <= 40 ) )
+        {
+            labelLength = ( int ) ( pLabelEnd - pLabel );
+            ( void ) snprintf( header, sizeof( header ), "-----BEGIN %.*s-----", labelLength, pLabel );
+            ( void ) snprintf( footer, sizeof( footer ), "-----END %.*s-----", labelLength, pLabel );
 
-    responseStatus = ResponseNotReceived;
+            mbedtls_pem_init( &pem );
 
-    /* responseStatus is updated from the MQTT publish callback. */
-    ( void ) ProcessLoop();
+            if( ( mbedtls_pem_read_buffer( &pem, header, footer, ( const unsigned char * ) pPem,
+                                           NULL, 0U, &used ) == 0 ) &&
+                ( ( pDer = mbedtls_pem_get_buffer( &pem, &derLength ) ) != NULL ) )
+            {
+                status = nvs_set_blob( handle, pKey, pDer, derLength );
+            }
 
-    if( responseStatus == ResponseNotReceived )
-    {
-        LogError( ( "Timed out waiting for response." ) );
-    }
+            mbedtls_pem_free( &pem );
+        }
 
-    if( responseStatus == ResponseAccepted )
-    {
-        returnStatus = EXIT_SUCCESS;
+        return status;
     }
 
-    return returnStatus;
-}
-
 /*-----------------------------------------------------------*/
 
-static int32_t subscribeToKeyCertificateResponseTopics( void )
-{
-    int returnStatus = EXIT_SUCCESS;
+#endif /* if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER */
 
-    returnStatus = SubscribeToTopic( FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC,
-                                     FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH );
+static int32_t sendProvisioningRequest( const char * pTopic,
+                                        uint16_t topicLength,
+                                        FleetProvisioningTopic_t acceptedTopic,
+                                        FleetProvisioningTopic_t rejectedTopic,
+                                        const char * pApiName,
+                                        uint8_t * pResponseBuffer,
+                                        size_t responseBufferLength,
+                                        size_t * pResponseLength )
+{
+    int returnStatus = EXIT_FAILURE;
+    ProvisioningRequest_t * pRequest = NULL;
+    ProvisioningRequestStatus_t requestStatus = ProvisioningRequestFailed;
 
-    if( returnStatus != EXIT_SUCCESS )
-    {
-        LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH,
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC ) );
-    }
+    pRequest = ProvisioningRequest_Start( acceptedTopic,
+                                          rejectedTopic,
+                                          pResponseBuffer,
+                                          responseBufferLength,
+                                          RESPONSE_TIMEOUT_MS );
 
-    if( returnStatus == EXIT_SUCCESS )
+    if( pRequest != NULL )
     {
-        returnStatus = SubscribeToTopic( FP_CBOR_CREATE_KEYS_REJECTED_TOPIC,
-                                   FP_CBOR_CREATE_KEYS_REJECTED_LENGTH );
+        returnStatus = PublishToTopic( pTopic,
+                                       topicLength,
+                                       ( char * ) payloadBuffer,
+                                       payloadLength );
 
         if( returnStatus != EXIT_SUCCESS )
         {
-            LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                        FP_CBOR_CREATE_KEYS_REJECTED_LENGTH,
-                        FP_CBOR_CREATE_KEYS_REJECTED_TOPIC ) );
+            LogError( ( "Failed to publish to fleet provisioning topic: %.*s.",
+                        topicLength,
+                        pTopic ) );
+            ProvisioningRequest_Cancel( pRequest );
         }
     }
 
-    return returnStatus;
-}
-
-/*-----------------------------------------------------------*/
-
-static int32_t unsubscribeFromKeyCertificateResponseTopics( void )
-{
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = UnsubscribeFromTopic(  FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC,
-                                        FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH );
-
-    if( returnStatus != EXIT_SUCCESS )
-    {
-        LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH,
-                    FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC ) );
-    }
-
     if( returnStatus == EXIT_SUCCESS )
     {
-        returnStatus = UnsubscribeFromTopic(  FP_CBOR_CREATE_KEYS_REJECTED_TOPIC,
-                                            FP_CBOR_CREATE_KEYS_REJECTED_LENGTH );
+        /* This task receives from the connection, so the process loop runs
+         * in short slices until the response is in. */
+        requestStatus = ProvisioningRequest_Wait( pRequest, ProcessLoopWithTimeout, pResponseLength );
 
-        if( returnStatus != EXIT_SUCCESS )
+        if( requestStatus == ProvisioningRequestAccepted )
+        {
+            LogInfo( ( "Received accepted response from Fleet Provisioning %s API.", pApiName ) );
+        }
+        else
         {
-            LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                        FP_CBOR_CREATE_KEYS_REJECTED_LENGTH,
-                        FP_CBOR_CREATE_KEYS_REJECTED_TOPIC ) );
+            if( requestStatus == ProvisioningRequestRejected )
+            {
+                LogError( ( "Received rejected response from Fleet Provisioning %s API.", pApiName ) );
+            }
+            else
+            {
+                LogError( ( "No response from Fleet Provisioning %s API.", pApiName ) );
+            }
+
+            returnStatus = EXIT_FAILURE;
         }
     }
 
@@ -478,31 +603,15 @@ static int32_t unsubscribeFromKeyCertificateResponseTopics( void )
 
 /*-----------------------------------------------------------*/
 
-static int32_t subscribeToRegisterThingResponseTopics( void )
+static int32_t subscribeToProvisioningResponseTopics( void )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = SubscribeToTopic( FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                     FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
+    int returnStatus = SubscribeToTopics( provisioningResponseTopics,
+                                          PROVISIONING_RESPONSE_TOPIC_COUNT,
+                                          NULL );
 
     if( returnStatus != EXIT_SUCCESS )
     {
-        LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                    FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                    FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-    }
-
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        returnStatus = SubscribeToTopic( FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                   FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
-
-        if( returnStatus != EXIT_SUCCESS )
-        {
-            LogError( ( "Failed to subscribe to fleet provisioning topic: %.*s.",
-                        FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                        FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-        }
+        LogError( ( "Failed to subscribe to the fleet provisioning response topics." ) );
     }
 
     return returnStatus;
@@ -510,31 +619,14 @@ static int32_t subscribeToRegisterThingResponseTopics( void )
 
 /*-----------------------------------------------------------*/
 
-static int32_t unsubscribeFromRegisterThingResponseTopics( void )
+static int32_t unsubscribeFromProvisioningResponseTopics( void )
 {
-    int returnStatus = EXIT_SUCCESS;
-
-    returnStatus = UnsubscribeFromTopic(FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                        FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
+    int returnStatus = UnsubscribeFromTopics( provisioningResponseTopics,
+                                              PROVISIONING_RESPONSE_TOPIC_COUNT );
 
     if( returnStatus != EXIT_SUCCESS )
     {
-        LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                    FP_CBOR_REGISTER_ACCEPTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                    FP_CBOR_REGISTER_ACCEPTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-    }
-
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        returnStatus =UnsubscribeFromTopic( FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                   FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ) );
-
-        if( returnStatus != EXIT_SUCCESS )
-        {
-            LogError( ( "Failed to unsubscribe from fleet provisioning topic: %.*s.",
-                        FP_CBOR_REGISTER_REJECTED_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                        FP_CBOR_REGISTER_REJECTED_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-        }
+        LogError( ( "Failed to unsubscribe from the fleet provisioning response topics." ) );
     }
 
     return returnStatus;
@@ -555,7 +647,6 @@ static void provisioningPublishCallback(    MQTTContext_t * pMqttContext,
 
     FleetProvisioningStatus_t status;
     FleetProvisioningTopic_t api;
-    const char * cborDump;
 
     ( void ) pMqttContext;
 
@@ -597,59 +688,11 @@ static void provisioningPublishCallback(    MQTTContext_t * pMqttContext,
         else if ( status == FleetProvisioningSuccess )
         {
             LogInfo( ( "FleetProvisioningSuccess" ) );
-            if( api == FleetProvCborCreateKeysAndCertAccepted )
-            {
-                LogInfo( ( "Received accepted response from Fleet Provisioning CreateKeysAndCertificate API." ) );
-                
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogInfo( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseAccepted;
-
-                /* Copy the payload from the MQTT library's buffer to #payloadBuffer. */
-                ( void ) memcpy( ( void * ) payloadBuffer,
-                                ( const void * ) pDeserializedInfo->pPublishInfo->pPayload,
-                                ( size_t ) pDeserializedInfo->pPublishInfo->payloadLength );
-
-                payloadLength = pDeserializedInfo->pPublishInfo->payloadLength;
-            }
-            else if( api == FleetProvCborCreateKeysAndCertRejected )
-            {
-                LogError( ( "Received rejected response from Fleet Provisioning CreateKeysAndCertificate API." ) );
-                
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogError( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseRejected;
-            }
-            else if( api == FleetProvCborRegisterThingAccepted )
-            {
-                LogInfo( ( "Received accepted response from Fleet Provisioning RegisterThing API." ) );
-
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogInfo( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseAccepted;
 
-                /* Copy the payload from the MQTT library's buffer to #payloadBuffer. */
-                ( void ) memcpy( ( void * ) payloadBuffer,
-                                ( const void * ) pDeserializedInfo->pPublishInfo->pPayload,
-                                ( size_t ) pDeserializedInfo->pPublishInfo->payloadLength );
-
-                payloadLength = pDeserializedInfo->pPublishInfo->payloadLength;
-            }
-            else if( api == FleetProvCborRegisterThingRejected )
+            /* Wake the task waiting for this response. */
+            if( ProvisioningRequests_HandleResponse( api, pDeserializedInfo->pPublishInfo ) == false )
             {
-                LogError( ( "Received rejected response from Fleet Provisioning RegisterThing API." ) );
-
-                cborDump = pDeserializedInfo->pPublishInfo->pPayload;
-                // LogError( ( "Payload: %s", cborDump ) );
-
-                responseStatus = ResponseRejected;
-            }
-            else
-            {
-                LogError( ( "Received message on unexpected Fleet Provisioning topic. Topic: %.*s.",
+                LogError( ( "Received Fleet Provisioning message with no request waiting for it. Topic: %.*s.",
                             ( int ) pDeserializedInfo->pPublishInfo->topicNameLength,
                             ( const char * ) pDeserializedInfo->pPublishInfo->pTopicName ) );
             }
@@ -659,10 +702,11 @@ static void provisioningPublishCallback(    MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
-/* This is the callback function invoked by the MQTT stack when it receives
- * incoming messages. This function demonstrates how to use the Shadow_MatchTopicString
- * function to determine whether the incoming message is a device shadow message
- * or not. If it is, it handles the message depending on the message type.
+/* This is the callback function invoked by the MQTT session when it receives
+ * incoming publishes; the session handles the acknowledgements. This function
+ * demonstrates how to use the Shadow_MatchTopicString function to determine
+ * whether the incoming message is a device shadow message or not. If it is, it
+ * handles the message depending on the message type.
  */
 static void eventCallback( MQTTContext_t * pMqttContext,
                            MQTTPacketInfo_t * pPacketInfo,
@@ -673,7 +717,6 @@ static void eventCallback( MQTTContext_t * pMqttContext,
     uint8_t thingNameLength = 0U;
     const char * pShadowName = NULL;
     uint8_t shadowNameLength = 0U;
-    uint16_t packetIdentifier;
 
     ( void ) pMqttContext;
 
@@ -681,8 +724,6 @@ static void eventCallback( MQTTContext_t * pMqttContext,
     assert( pMqttContext != NULL );
     assert( pPacketInfo != NULL );
 
-    packetIdentifier = pDeserializedInfo->packetIdentifier;
-
     /* Handle incoming publish. The lower 4 bits of the publish packet
      * type is used for the dup, QoS, and retain flags. Hence masking
      * out the lower bits to check if the packet is publish. */
@@ -743,14 +784,31 @@ static void eventCallback( MQTTContext_t * pMqttContext,
             eventCallbackError = true;
         }
     }
-    else
+}
+
+/*-----------------------------------------------------------*/
+
+#if PROVISIONING_TIMER_PUBLISH
+
+    static void publishProvisioningTiming( void )
     {
-        HandleOtherIncomingPacket( pPacketInfo, packetIdentifier );
+        static char record[ PROVISIONING_TIMER_RECORD_LENGTH ];
+        size_t recordLength = ProvisioningTimer_GetRecord( record, sizeof( record ) );
+
+        if( ( recordLength > 0U ) &&
+            ( PublishToTopic( PROVISIONING_TIMER_TOPIC,
+                              ( int32_t ) strlen( PROVISIONING_TIMER_TOPIC ),
+                              record,
+                              recordLength ) != EXIT_SUCCESS ) )
+        {
+            LogWarn( ( "Failed to publish the provisioning timing record." ) );
+        }
     }
-}
 
 /*-----------------------------------------------------------*/
 
+#endif /* if PROVISIONING_TIMER_PUBLISH */
+
 /**
  * @brief Entry point of shadow demo.
  */
@@ -758,32 +816,31 @@ int aws_iot_demo_main( int argc,
           char ** argv )
 {
     int returnStatus = EXIT_SUCCESS;
-    /* Buffer for holding received certificate until it is saved. */
-    char certificate[ CERT_BUFFER_LENGTH ];
-    size_t certificateLength;
-    /* Buffer for holding the certificate ID. */
-    char certificateId[ CERT_ID_BUFFER_LENGTH ];
-    size_t certificateIdLength;
-    /* Buffer for holding the certificate ownership token. */
-    char ownershipToken[ OWNERSHIP_TOKEN_BUFFER_LENGTH ];
-    size_t ownershipTokenLength;
-    /* Buffer for holding the private key. */
-    char privateKey[ PRIV_KEY_BUFFER_LENGTH ];
-    size_t privateKeyLength;
+    /* The provisioned credentials, in #credentialsBuffer. */
+    ProvisioningResponse_t credentials;
+    /* The RegisterThing response, in #payloadBuffer. */
+    ProvisioningResponse_t registration;
     bool connectionEstablished = false;
+    /* Whether traffic switched to the session with the provisioned
+     * certificate without a reconnect. */
+    bool handedOver = false;
+    #if PROVISIONING_HANDOVER
+        /* Whether that session was started alongside the claim session. */
+        bool handoverStarted = false;
+    #endif
+    /* Whether the broker kept the MQTT session, and the shadow subscriptions,
+     * of the last boot. */
+    bool sessionPresent = false;
 
     /* Silence compiler warnings about unused variables. */
     ( void ) argc;
     ( void ) argv;
 
+    /* Set up the table matching fleet provisioning responses to requests. */
+    ProvisioningRequests_Init();
+
     do
     {
-        /* Initialize the buffer lengths to their max lengths. */
-        certificateLength = CERT_BUFFER_LENGTH;
-        certificateIdLength = CERT_ID_BUFFER_LENGTH;
-        ownershipTokenLength = OWNERSHIP_TOKEN_BUFFER_LENGTH;
-        privateKeyLength = PRIV_KEY_BUFFER_LENGTH;
-
         // TODO: Initialize the PKCS #11 module
 
         /**** Connect to AWS IoT Core with provisioning claim credentials *****/
@@ -794,7 +851,9 @@ int aws_iot_demo_main( int argc,
             * connection fails, retries after a timeout. Timeout value will
             * exponentially increase until maximum attempts are reached. */
             LogInfo( ( "Establishing MQTT session with claim certificate..." ) );
+            ProvisioningTimer_BeginPhase( ProvisioningPhaseClaimConnect );
             returnStatus = EstablishMqttSession( provisioningPublishCallback );
+            ProvisioningTimer_EndPhase( ProvisioningPhaseClaimConnect );
 
             if( returnStatus != EXIT_SUCCESS )
             {
@@ -806,69 +865,61 @@ int aws_iot_demo_main( int argc,
                 connectionEstablished = true;
             }
 
-            /**** Call the CreateKeysAndCertificate API ***************************/
-
-            /* We use the CreateKeysAndCertificate API to obtain a client certificate. */
+            /* Subscribe to the accepted and rejected topics of both APIs at
+            * once, so no request waits for a SUBACK, in the payload format
+            * selected in menuconfig. */
             if( returnStatus == EXIT_SUCCESS )
             {
-                /* Subscribe to the CreateKeysAndCertificate accepted and rejected
-                * topics. In this demo we use CBOR encoding for the payloads,
-                * so we use the CBOR variants of the topics. */
-                returnStatus = subscribeToKeyCertificateResponseTopics();
+                returnStatus = subscribeToProvisioningResponseTopics();
             }
 
+            /**** Call the CreateKeysAndCertificate API ***************************/
+
+            /* We use the CreateKeysAndCertificate API to obtain a client certificate. */
+
             // Note: Skipped create a new key and CSR.
 
             // Note: Skipped generateCsrRequest()
 
             if ( returnStatus == EXIT_SUCCESS )
             {
-                /* Publish to the CreateKeysAndCertificate API. */
-                returnStatus = PublishToTopic( FP_CBOR_CREATE_KEYS_PUBLISH_TOPIC,
-                                FP_CBOR_CREATE_KEYS_PUBLISH_LENGTH,
-                                ( char * ) payloadBuffer,
-                                payloadLength );
-
-                if( returnStatus == EXIT_FAILURE )
-                {
-                    LogError( ( "Failed to publish to fleet provisioning topic: %.*s.",
-                                FP_CBOR_CREATE_KEYS_PUBLISH_LENGTH,
-                                FP_CBOR_CREATE_KEYS_PUBLISH_TOPIC ) );
-                }
+                /* Publish to the CreateKeysAndCertificate API and get the response. */
+                ProvisioningTimer_BeginPhase( ProvisioningPhaseCreateCertificate );
+                returnStatus = sendProvisioningRequest( FP_FORMAT( CREATE_KEYS_PUBLISH_TOPIC ),
+                                                        FP_FORMAT( CREATE_KEYS_PUBLISH_LENGTH ),
+                                                        FP_FORMAT_TOPIC( CreateKeysAndCertAccepted ),
+                                                        FP_FORMAT_TOPIC( CreateKeysAndCertRejected ),
+                                                        "CreateKeysAndCertificate",
+                                                        credentialsBuffer,
+                                                        NETWORK_BUFFER_SIZE,
+                                                        &credentialsLength );
+                ProvisioningTimer_EndPhase( ProvisioningPhaseCreateCertificate );
             }
 
-            // if ( returnStatus == EXIT_SUCCESS )
-            // {
-            //     /* Get the response to the CreateKeysAndCertificate request. */
-            //     returnStatus = waitForResponse();
-            // }
-            
             if( returnStatus == EXIT_SUCCESS )
             {
                 /* From the response, extract the certificate, certificate ID, and
                 * certificate ownership token. */
-                bool parseStatus = parseKeyCertResponse(    payloadBuffer,
-                                                            payloadLength,
-                                                            certificate,
-                                                            &certificateLength,
-                                                            certificateId,
-                                                            &certificateIdLength,
-                                                            ownershipToken,
-                                                            &ownershipTokenLength,
-                                                            privateKey,
-                                                            &privateKeyLength );
+                bool parseStatus = parseKeyCertResponse( credentialsBuffer,
+                                                         credentialsLength,
+                                                         NETWORK_BUFFER_SIZE,
+                                                         &credentials );
 
                 if( parseStatus == true )
                 {
-                    LogInfo( ( "Received certificate: %.*s", ( int ) certificateLength, certificate ) );
-                    LogInfo( ( "Received certificate with Id: %.*s", ( int ) certificateIdLength, certificateId ) );
-                    LogInfo( ( "Received ownershipToken: %.*s", ( int ) ownershipTokenLength, ownershipToken ) );
-                    LogInfo( ( "Received privateKey: %.*s", ( int ) privateKeyLength, privateKey ) );
-                    provisioned_cert = certificate;
-                    provisioned_certID = certificateId;
-                    provisioned_ownership_token = ownershipToken;
-                    provisioned_privatekey = privateKey;
+                    LogInfo( ( "Received certificate: %s", credentials.certificatePem.pString ) );
+                    LogInfo( ( "Received certificate with Id: %s", credentials.certificateId.pString ) );
+                    LogInfo( ( "Received ownershipToken: %s", credentials.certificateOwnershipToken.pString ) );
+                    LogInfo( ( "Received privateKey: %s", credentials.privateKey.pString ) );
+                    provisioned_cert = ( char * ) credentials.certificatePem.pString;
+                    provisioned_certID = ( char * ) credentials.certificateId.pString;
+                    provisioned_ownership_token = ( char * ) credentials.certificateOwnershipToken.pString;
+                    provisioned_privatekey = ( char * ) credentials.privateKey.pString;
+                    /* The provisioned credentials may reuse buffers the transport has
+                     * already parsed, so drop the cached copies before reconnecting. */
+                    vTlsCredentialCacheInvalidate();
                     /* --- Storing CERT and KEY into NVS --- */
+                    ProvisioningTimer_BeginPhase( ProvisioningPhaseStore );
                     nvs_handle_t my_handle;
                     esp_err_t nvs_err = nvs_open("storage", NVS_READWRITE, &my_handle);
                     if (nvs_err != ESP_OK) {
@@ -878,16 +929,24 @@ int aws_iot_demo_main( int argc,
 
                         // Write
                         printf("Updating CERT and KEY in NVS ... ");
-                        nvs_err = nvs_set_str(my_handle, "aws_cert", certificate);
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
+                        nvs_err = storeCredentialDer(my_handle, "aws_cert_der", credentials.certificatePem.pString);
+#else
+                        nvs_err = nvs_set_str(my_handle, "aws_cert", credentials.certificatePem.pString);
+#endif
                         printf((nvs_err != ESP_OK) ? "Failed!\n" : "Done in storing CERT in NVS\n");
 
-                        nvs_err = nvs_set_str(my_handle, "aws_certID", certificateId);
+                        nvs_err = nvs_set_str(my_handle, "aws_certID", credentials.certificateId.pString);
                         printf((nvs_err != ESP_OK) ? "Failed!\n" : "Done in storing CERT_ID in NVS\n");
 
-                        nvs_err = nvs_set_str(my_handle, "aws_token", ownershipToken);
+                        nvs_err = nvs_set_str(my_handle, "aws_token", credentials.certificateOwnershipToken.pString);
                         printf((nvs_err != ESP_OK) ? "Failed!\n" : "Done in storing TOKEN in NVS\n");
 
-                        nvs_err = nvs_set_str(my_handle, "aws_key", privateKey);
+#if CONFIG_EXAMPLE_STORE_CREDENTIALS_DER
+                        nvs_err = storeCredentialDer(my_handle, "aws_key_der", credentials.privateKey.pString);
+#else
+                        nvs_err = nvs_set_str(my_handle, "aws_key", credentials.privateKey.pString);
+#endif
                         printf((nvs_err != ESP_OK) ? "Failed!\n" : "Done in storing KEY in NVS\n");
 
                         // Commit written value.
@@ -901,10 +960,15 @@ int aws_iot_demo_main( int argc,
                         // Close
                         nvs_close(my_handle);
                     }
+                    ProvisioningTimer_EndPhase( ProvisioningPhaseStore );
                     /* --- END of storing CERT and KEY in NVS --- */
 
                     returnStatus = EXIT_SUCCESS;
                 }
+                else
+                {
+                    returnStatus = EXIT_FAILURE;
+                }
             }
 
             // Note: Skipped saving certificate into PKCS #11
@@ -918,12 +982,6 @@ int aws_iot_demo_main( int argc,
             // }
             
 
-            if ( returnStatus == EXIT_SUCCESS )
-            {
-                /* Unsubscribe from the CreateKeysAndCertificate topics. */
-                returnStatus = unsubscribeFromKeyCertificateResponseTopics();
-            }
-
             /**** Call the RegisterThing API **************************************/
 
             /* We then use the RegisterThing API to activate the received certificate,
@@ -935,8 +993,8 @@ int aws_iot_demo_main( int argc,
                 /* Create the request payload to publish to the RegisterThing API. */
                 bool generateStatus = generateRegisterThingRequest( payloadBuffer,
                                                                     NETWORK_BUFFER_SIZE,
-                                                                    ownershipToken,
-                                                                    ownershipTokenLength,
+                                                                    credentials.certificateOwnershipToken.pString,
+                                                                    credentials.certificateOwnershipToken.length,
                                                                     DEVICE_SERIAL_NUMBER,
                                                                     DEVICE_SERIAL_NUMBER_LENGTH,
                                                                     &payloadLength );
@@ -948,63 +1006,85 @@ int aws_iot_demo_main( int argc,
                 }
             }
 
-            if ( returnStatus == EXIT_SUCCESS )
-            {
-                /* Subscribe to the RegisterThing response topics. */
-                returnStatus = subscribeToRegisterThingResponseTopics();
-            }
-
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                /* Publish the RegisterThing request. */
-                returnStatus = PublishToTopic(  FP_CBOR_REGISTER_PUBLISH_TOPIC( PROVISIONING_TEMPLATE_NAME ),
-                                                FP_CBOR_REGISTER_PUBLISH_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                                                ( char * ) payloadBuffer,
-                                                payloadLength );
-
-                if( returnStatus != EXIT_SUCCESS )
-                {
-                    LogError( ( "Failed to publish to fleet provisioning topic: %.*s.",
-                                FP_CBOR_REGISTER_PUBLISH_LENGTH( PROVISIONING_TEMPLATE_NAME_LENGTH ),
-                                FP_CBOR_REGISTER_PUBLISH_TOPIC( PROVISIONING_TEMPLATE_NAME ) ) );
-                }
-            }
-
             if( returnStatus == EXIT_SUCCESS )
             {
-                /* Get the response to the RegisterThing request. */
-                returnStatus = waitForResponse();
+                /* Publish the RegisterThing request and get the response. */
+                ProvisioningTimer_BeginPhase( ProvisioningPhaseRegisterThing );
+                returnStatus = sendProvisioningRequest( FP_FORMAT( REGISTER_PUBLISH_TOPIC )( PROVISIONING_TEMPLATE_NAME ),
+                                                        FP_FORMAT( REGISTER_PUBLISH_LENGTH )( PROVISIONING_TEMPLATE_NAME_LENGTH ),
+                                                        FP_FORMAT_TOPIC( RegisterThingAccepted ),
+                                                        FP_FORMAT_TOPIC( RegisterThingRejected ),
+                                                        "RegisterThing",
+                                                        payloadBuffer,
+                                                        NETWORK_BUFFER_SIZE,
+                                                        &payloadLength );
+                ProvisioningTimer_EndPhase( ProvisioningPhaseRegisterThing );
             }
 
             if( returnStatus == EXIT_SUCCESS )
             {
                 /* Extract the Thing name from the response. */
-                thingNameLength = MAX_THING_NAME_LENGTH;
-                bool parseStatus = parseRegisterThingResponse(  payloadBuffer,
-                                                                payloadLength,
-                                                                thingName,
-                                                                &thingNameLength );
+                bool parseStatus = parseRegisterThingResponse( payloadBuffer,
+                                                               payloadLength,
+                                                               NETWORK_BUFFER_SIZE,
+                                                               &registration );
 
                 if( parseStatus == true )
                 {
-                    LogInfo( ( "Received AWS IoT Thing name: %.*s", ( int ) thingNameLength, thingName ) );
+                    LogInfo( ( "Received AWS IoT Thing name: %s", registration.thingName.pString ) );
                     returnStatus = EXIT_SUCCESS;
                 }
+                else
+                {
+                    returnStatus = EXIT_FAILURE;
+                }
             }
             
+            #if PROVISIONING_HANDOVER
+                /* RegisterThing activated the certificate, so connect with it
+                 * while the claim session finishes its cleanup. */
+                if( returnStatus == EXIT_SUCCESS )
+                {
+                    LogInfo( ( "Establishing MQTT session with provisioned certificate alongside the claim session..." ) );
+                    ProvisioningTimer_BeginPhase( ProvisioningPhaseDeviceConnect );
+                    handoverStarted = ( StartProvisionedMqttSessionHandover( eventCallback ) == EXIT_SUCCESS );
+                }
+            #endif
+
             if( returnStatus == EXIT_SUCCESS )
             {
-                /* Unsubscribe from the RegisterThing topics. */
-                returnStatus = unsubscribeFromRegisterThingResponseTopics();
+                /* The claim session is persistent, so drop its subscriptions,
+                 * all in one UNSUBSCRIBE. */
+                returnStatus = unsubscribeFromProvisioningResponseTopics();
             }
             
+            /**** Switch to the provisioned certificate ***************************/
+
+            #if PROVISIONING_HANDOVER
+                if( handoverStarted == true )
+                {
+                    /* Closes the claim session once the provisioned one is up. */
+                    handedOver = ( FinishProvisionedMqttSessionHandover( &sessionPresent ) == EXIT_SUCCESS );
+                    ProvisioningTimer_EndPhase( ProvisioningPhaseDeviceConnect );
+
+                    if( handedOver == false )
+                    {
+                        LogWarn( ( "Handover to the provisioned certificate failed. Reconnecting instead." ) );
+                    }
+                }
+            #endif
+
             /**** Disconnect from AWS IoT Core ************************************/
 
             /* As we have completed the provisioning workflow, we disconnect from
             * the connection using the provisioning claim credentials. We will
             * establish a new MQTT connection with the newly provisioned
             * credentials. */
-            if( connectionEstablished == true )
+            if( handedOver == true )
+            {
+                provisioned = true;
+            }
+            else if( connectionEstablished == true )
             {
                 returnStatus = DisconnectMqttSession();
                 if ( returnStatus == EXIT_SUCCESS )
@@ -1019,8 +1099,13 @@ int aws_iot_demo_main( int argc,
 
         if ( returnStatus == EXIT_SUCCESS && provisioned == true )
         {
-            LogInfo( ( "Establishing MQTT session with provisioned certificate..." ) );
-            returnStatus = EstablishProvisionedMqttSession( eventCallback );
+            if( handedOver == false )
+            {
+                LogInfo( ( "Establishing MQTT session with provisioned certificate..." ) );
+                ProvisioningTimer_BeginPhase( ProvisioningPhaseDeviceConnect );
+                returnStatus = EstablishProvisionedMqttSession( eventCallback, &sessionPresent );
+                ProvisioningTimer_EndPhase( ProvisioningPhaseDeviceConnect );
+            }
 
             if( returnStatus != EXIT_SUCCESS )
             {
@@ -1033,100 +1118,91 @@ int aws_iot_demo_main( int argc,
             {
                 LogInfo( ( "Sucessfully established connection with provisioned credentials." ) );
                 connectionEstablished = true;
+
+                /* Does nothing when the device was provisioned on an earlier boot. */
+                ProvisioningTimer_Finish();
+
+                #if PROVISIONING_TIMER_PUBLISH
+                    publishProvisioningTiming();
+                #endif
             }
         }
 
         /**** Update Thing Status documents ***********************************/
 
-        if ( returnStatus == EXIT_SUCCESS )
-        {
-            /* Reset the shadow delete status flags. */
-            deleteResponseReceived = false;
-            shadowDeleted = false;
-
-            /* First of all, try to delete any Shadow document in the cloud.
-             * Try to subscribe to `/delete/accepted` and `/delete/rejected` topics. */
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
-                                             SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-        
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            /* Try to subscribe to `/delete/rejected` topic. */
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
-                                             SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-
         /* A buffer containing the update document. It has static duration to prevent
          * it from being placed on the call stack. */
         static char updateDocument[ SHADOW_REPORTED_JSON_LENGTH + 1 ] = { 0 };
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            /* Publish to Shadow `delete` topic to attempt to delete the
-             * Shadow document if exists. */
-            returnStatus = PublishToTopic( SHADOW_TOPIC_STR_DELETE( THING_NAME, SHADOW_NAME ),
-                                            SHADOW_TOPIC_LEN_DELETE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
-                                            updateDocument,
-                                            0U );
-        }
 
-        /* Unsubscribe from the `/delete/accepted` and 'delete/rejected` topics.*/
-        if( returnStatus == EXIT_SUCCESS )
+        if( ( returnStatus == EXIT_SUCCESS ) && ( FAST_RECONNECT != 0 ) && ( sessionPresent == true ) )
         {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            /* The broker kept the subscriptions of the last boot, and with them
+             * the shadow that boot left, so go straight to the update. */
+            LogInfo( ( "MQTT session resumed, keeping the shadow subscriptions of the last boot." ) );
         }
-
-        if( returnStatus == EXIT_SUCCESS )
+        else
         {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
+            if( returnStatus == EXIT_SUCCESS )
+            {
+                /* Reset the shadow delete status flags. */
+                deleteResponseReceived = false;
+                shadowDeleted = false;
 
-        /* Check if an incoming publish on `/delete/accepted` or `/delete/rejected`
-         * topics. If a response is not received, mark the demo execution as a failure.*/
-        if( ( returnStatus == EXIT_SUCCESS ) && ( deleteResponseReceived != true ) )
-        {
-            LogError( ( "Failed to receive a response for Shadow delete." ) );
-            returnStatus = EXIT_FAILURE;
-        }
+                /* First of all, try to delete any Shadow document in the cloud.
+                 * Try to subscribe to `/delete/accepted` and `/delete/rejected` topics. */
+                returnStatus = SubscribeToTopics( shadowDeleteTopics, SHADOW_DELETE_TOPIC_COUNT, NULL );
+            }
 
-        /* Check if Shadow document delete was successful. A delete can be
-        * successful in cases listed below.
-        *  1. If an incoming publish is received on `/delete/accepted` topic.
-        *  2. If an incoming publish is received on `/delete/rejected` topic
-        *     with an error code 404. This indicates that a delete was
-        *     attempted when a Shadow document is not available for the
-        *     Thing. */
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            if( shadowDeleted == false )
+            if( returnStatus == EXIT_SUCCESS )
             {
-                LogError( ( "Shadow delete operation failed." ) );
-                returnStatus = EXIT_FAILURE;
+                /* Publish to Shadow `delete` topic to attempt to delete the
+                 * Shadow document if exists. */
+                returnStatus = PublishToTopic( SHADOW_TOPIC_STR_DELETE( THING_NAME, SHADOW_NAME ),
+                                                SHADOW_TOPIC_LEN_DELETE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
+                                                updateDocument,
+                                                0U );
             }
-            else
+
+            /* Unsubscribe from the `/delete/accepted` and 'delete/rejected` topics.*/
+            if( returnStatus == EXIT_SUCCESS )
             {
-                LogInfo( ( "Shadow delete success.") );
+                returnStatus = UnsubscribeFromTopics( shadowDeleteTopics, SHADOW_DELETE_TOPIC_COUNT );
             }
-        }
-
-        /* Successfully connect to MQTT broker, the next step is
-         * to subscribe shadow topics. */
-        returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
-                                            SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
 
+            /* Check if an incoming publish on `/delete/accepted` or `/delete/rejected`
+             * topics. If a response is not received, mark the demo execution as a failure.*/
+            if( ( returnStatus == EXIT_SUCCESS ) && ( deleteResponseReceived != true ) )
+            {
+                LogError( ( "Failed to receive a response for Shadow delete." ) );
+                returnStatus = EXIT_FAILURE;
+            }
 
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
-                                                SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
+            /* Check if Shadow document delete was successful. A delete can be
+            * successful in cases listed below.
+            *  1. If an incoming publish is received on `/delete/accepted` topic.
+            *  2. If an incoming publish is received on `/delete/rejected` topic
+            *     with an error code 404. This indicates that a delete was
+            *     attempted when a Shadow document is not available for the
+            *     Thing. */
+            if( returnStatus == EXIT_SUCCESS )
+            {
+                if( shadowDeleted == false )
+                {
+                    LogError( ( "Shadow delete operation failed." ) );
+                    returnStatus = EXIT_FAILURE;
+                }
+                else
+                {
+                    LogInfo( ( "Shadow delete success.") );
+                }
+            }
 
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
-                                                SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            /* Successfully connect to MQTT broker, the next step is
+             * to subscribe shadow topics. */
+            if( returnStatus == EXIT_SUCCESS )
+            {
+                returnStatus = SubscribeToTopics( shadowUpdateTopics, SHADOW_UPDATE_TOPIC_COUNT, NULL );
+            }
         }
 
         /* This demo uses a constant #THING_NAME and #SHADOW_NAME known at compile time therefore
@@ -1226,25 +1302,18 @@ int aws_iot_demo_main( int argc,
             }
         }
 
-        if( returnStatus == EXIT_SUCCESS )
+        if( ( returnStatus == EXIT_SUCCESS ) && ( FAST_RECONNECT != 0 ) )
         {
-            LogInfo( ( "Start to unsubscribe shadow topics and disconnect from MQTT. \r\n" ) );
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            /* Leave the subscriptions in the session the broker keeps, so the
+             * next boot doesn't subscribe again. */
+            LogInfo( ( "Keeping the shadow subscriptions and disconnecting from MQTT." ) );
         }
-
-        if( returnStatus == EXIT_SUCCESS )
+        else if( returnStatus == EXIT_SUCCESS )
         {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+            LogInfo( ( "Start to unsubscribe shadow topics and disconnect from MQTT. \r\n" ) );
+            returnStatus = UnsubscribeFromTopics( shadowUpdateTopics, SHADOW_UPDATE_TOPIC_COUNT );
         }
 
-        if( returnStatus == EXIT_SUCCESS )
-        {
-            returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
-                                                    SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-        }
-        
         /**** Finish **********************************************************/
 
         if( connectionEstablished == true )
@@ -98,4 +98,16 @@
  */
 #define REQUEST_BODY                      "{ \"message\": \"Hello, world\" }"
 
+/**
+ * @brief The presigned S3 PUT URL a partition is uploaded to, or an empty
+ * string to skip the upload.
+ */
+#define UPLOAD_URL                        CONFIG_EXAMPLE_UPLOAD_URL
+
+/**
+ * @brief The label of the data partition uploaded, such as a core dump or
+ * log partition.
+ */
+#define UPLOAD_PARTITION_LABEL            CONFIG_EXAMPLE_UPLOAD_PARTITION_LABEL
+
 #endif /* ifndef DEMO_CONFIG_H_ */
@@ -39,6 +39,12 @@
 
 /* Transport interface implementation include header for TLS. */
 #include "network_transport.h"
+
+/* Include the pool of HTTP connections. */
+#include "http_connection_pool.h"
+
+/* Include the streamed request body. */
+#include "http_upload.h"
        
 #ifndef ROOT_CA_PEM
     extern const char root_cert_auth_pem_start[] asm("_binary_root_cert_auth_pem_start");
@@ -92,11 +98,47 @@
  */
 #define POST_PATH_LENGTH           ( sizeof( POST_PATH ) - 1 )
 
+/**
+ * @brief The time to wait for a connection from the connection pool, while
+ * another one to the server is being opened or all are in use.
+ */
+#define CONNECTION_POOL_TIMEOUT_MS    ( 5000U )
+
 /**
  * @brief Length of the request body.
  */
 #define REQUEST_BODY_LENGTH        ( sizeof( REQUEST_BODY ) - 1 )
 
+/**
+ * @brief The length of the HTTP PUT method.
+ */
+#define HTTP_METHOD_PUT_LENGTH     ( sizeof( HTTP_METHOD_PUT ) - 1 )
+
+/**
+ * @brief The length of the upload URL.
+ */
+#define UPLOAD_URL_LENGTH          ( sizeof( UPLOAD_URL ) - 1 )
+
+/**
+ * @brief The length of the longest host name of the upload URL, with its
+ * terminating NUL.
+ */
+#define UPLOAD_HOST_LENGTH         ( 256U )
+
+/**
+ * @brief The HTTPS port of the upload URL.
+ */
+#define UPLOAD_HTTPS_PORT          ( 443 )
+
+/**
+ * @brief How the end of the uploaded body is told to the server.
+ */
+#ifdef CONFIG_EXAMPLE_UPLOAD_CHUNKED
+    #define UPLOAD_FRAMING    HttpUploadChunked
+#else
+    #define UPLOAD_FRAMING    HttpUploadContentLength
+#endif
+
 /**
  * @brief A buffer used in the demo for storing HTTP request headers and
  * HTTP response headers and body.
@@ -108,18 +150,20 @@
 static uint8_t userBuffer[ USER_BUFFER_LENGTH ];
 
 /**
- * @brief Static buffer for TLS Context Semaphore.
+ * @brief The transport interface of the connection taken from the pool.
  */
-static StaticSemaphore_t xTlsContextSemaphoreBuffer;
+static const TransportInterface_t * pPooledTransport = NULL;
 
 /*-----------------------------------------------------------*/
 
 int aws_iot_demo_main( int argc, char ** argv );
 
 /**
- * @brief Connect to HTTP server with reconnection retries.
+ * @brief Take a connection to the HTTP server from the connection pool into
+ * #pPooledTransport.
  *
- * @param[out] pNetworkContext The output parameter to return the created network context.
+ * @param[out] pNetworkContext The output parameter to return the server and
+ * credentials of the connection.
  *
  * @return EXIT_FAILURE on failure; EXIT_SUCCESS on successful connection.
  */
@@ -143,20 +187,23 @@ static int32_t sendHttpRequest( const TransportInterface_t * pTransportInterface
                                 const char * pPath,
                                 size_t pathLen );
 
+/**
+ * @brief Stream the data partition #UPLOAD_PARTITION_LABEL from flash to
+ * #UPLOAD_URL with a PUT request, over a connection from the pool.
+ *
+ * @return EXIT_FAILURE on failure; EXIT_SUCCESS on success.
+ */
+static int32_t uploadPartition( void );
+
 /*-----------------------------------------------------------*/
 
 static int32_t connectToServer( NetworkContext_t * pNetworkContext )
 {
     int32_t returnStatus = EXIT_FAILURE;
 
-    /* Status returned by transport implementation. */
-    TlsTransportStatus_t tlsStatus;
-
     /* Initialize TLS credentials. */
     pNetworkContext->pcHostname = AWS_IOT_ENDPOINT;
     pNetworkContext->xPort = AWS_HTTPS_PORT;
-    pNetworkContext->pxTls = NULL;
-    pNetworkContext->xTlsContextSemaphore = xSemaphoreCreateMutexStatic(&xTlsContextSemaphoreBuffer);
 
 #ifdef CONFIG_EXAMPLE_USE_SECURE_ELEMENT
     pNetworkContext->pcClientCertPem = NULL;
@@ -187,16 +234,13 @@ static int32_t connectToServer( NetworkContext_t * pNetworkContext )
          pNetworkContext->pAlpnProtos = NULL;
     }
 
-    /* Establish a TLS session with the HTTP server. This example connects
-     * to the HTTP server as specified in AWS_IOT_ENDPOINT and AWS_HTTPS_PORT
-     * in demo_config.h. */
-    LogInfo( ( "Establishing a TLS session to %.*s:%d.",
-               ( int32_t ) AWS_IOT_ENDPOINT_LENGTH,
-               AWS_IOT_ENDPOINT,
-               AWS_HTTPS_PORT ) );
-    tlsStatus = xTlsConnect ( pNetworkContext );
+    /* Take a TLS session with the HTTP server from the pool, which
+     * establishes one if it has none open. This example connects to the HTTP
+     * server as specified in AWS_IOT_ENDPOINT and AWS_HTTPS_PORT in
+     * demo_config.h. */
+    pPooledTransport = HttpConnectionPool_Acquire( pNetworkContext, CONNECTION_POOL_TIMEOUT_MS );
 
-    if( tlsStatus == TLS_TRANSPORT_SUCCESS )
+    if( pPooledTransport != NULL )
     {
         returnStatus = EXIT_SUCCESS;
     }
@@ -319,6 +363,123 @@ static int32_t sendHttpRequest( const TransportInterface_t * pTransportInterface
 
 /*-----------------------------------------------------------*/
 
+static int32_t uploadPartition( void )
+{
+    int32_t returnStatus = EXIT_FAILURE;
+    /* The server of the upload URL, without client credentials. */
+    NetworkContext_t uploadSettings = { 0 };
+    char host[ UPLOAD_HOST_LENGTH ];
+    const char * pAddress = NULL;
+    size_t addressLen = 0U;
+    const char * pPath = NULL;
+    size_t pathLen = 0U;
+    const TransportInterface_t * pTransport = NULL;
+    const esp_partition_t * pPartition = NULL;
+    HttpUploadSource_t source;
+    HTTPRequestInfo_t requestInfo;
+    HTTPRequestHeaders_t requestHeaders;
+    HTTPResponse_t response;
+    HTTPStatus_t httpStatus;
+
+    pPartition = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                           UPLOAD_PARTITION_LABEL );
+
+    if( pPartition == NULL )
+    {
+        LogError( ( "No data partition labelled %s to upload.", UPLOAD_PARTITION_LABEL ) );
+        httpStatus = HTTPInvalidParameter;
+    }
+    else
+    {
+        httpStatus = getUrlAddress( UPLOAD_URL, UPLOAD_URL_LENGTH, &pAddress, &addressLen );
+    }
+
+    if( httpStatus == HTTPSuccess )
+    {
+        /* The path is sent with the query, which holds the signature. */
+        httpStatus = getUrlPath( UPLOAD_URL, UPLOAD_URL_LENGTH, &pPath, &pathLen );
+        pathLen = ( pPath != NULL ) ? ( size_t ) ( ( UPLOAD_URL + UPLOAD_URL_LENGTH ) - pPath ) : 0U;
+    }
+
+    if( ( httpStatus != HTTPSuccess ) || ( addressLen >= sizeof( host ) ) )
+    {
+        LogError( ( "Failed to parse the upload URL %s.", UPLOAD_URL ) );
+    }
+    else
+    {
+        ( void ) memcpy( host, pAddress, addressLen );
+        host[ addressLen ] = '\0';
+
+        uploadSettings.pcHostname = host;
+        uploadSettings.xPort = UPLOAD_HTTPS_PORT;
+        uploadSettings.pcServerRootCAPem = root_cert_auth_pem_start;
+        uploadSettings.disableSni = 0;
+
+        pTransport = HttpConnectionPool_Acquire( &uploadSettings, CONNECTION_POOL_TIMEOUT_MS );
+    }
+
+    if( pTransport != NULL )
+    {
+        ( void ) memset( &requestInfo, 0, sizeof( requestInfo ) );
+        ( void ) memset( &requestHeaders, 0, sizeof( requestHeaders ) );
+        ( void ) memset( &response, 0, sizeof( response ) );
+
+        requestInfo.pHost = host;
+        requestInfo.hostLen = addressLen;
+        requestInfo.pMethod = HTTP_METHOD_PUT;
+        requestInfo.methodLen = HTTP_METHOD_PUT_LENGTH;
+        requestInfo.pPath = pPath;
+        requestInfo.pathLen = pathLen;
+        requestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+
+        /* The request headers and the response share the user buffer; the
+         * body is read from flash as it is sent. */
+        requestHeaders.pBuffer = userBuffer;
+        requestHeaders.bufferLen = USER_BUFFER_LENGTH;
+        response.pBuffer = userBuffer;
+        response.bufferLen = USER_BUFFER_LENGTH;
+
+        ( void ) memset( &source, 0, sizeof( source ) );
+        source.pPartition = pPartition;
+        source.partitionOffset = 0U;
+        source.length = pPartition->size;
+
+        httpStatus = HTTPClient_InitializeRequestHeaders( &requestHeaders, &requestInfo );
+
+        if( httpStatus == HTTPSuccess )
+        {
+            LogInfo( ( "Uploading partition %s of %u bytes to %s...",
+                       pPartition->label, ( unsigned ) pPartition->size, host ) );
+
+            httpStatus = HttpUpload_Send( pTransport, &requestHeaders, &source,
+                                          UPLOAD_FRAMING, &response, 0 );
+        }
+
+        if( httpStatus != HTTPSuccess )
+        {
+            LogError( ( "Failed to upload partition %s: Error=%s.",
+                        pPartition->label, HTTPClient_strerror( httpStatus ) ) );
+        }
+        else if( ( response.statusCode < 200U ) || ( response.statusCode > 299U ) )
+        {
+            LogError( ( "Upload of partition %s rejected with status %u:\n%.*s",
+                        pPartition->label, response.statusCode,
+                        ( int32_t ) response.bodyLen, response.pBody ) );
+        }
+        else
+        {
+            LogInfo( ( "Uploaded partition %s.", pPartition->label ) );
+            returnStatus = EXIT_SUCCESS;
+        }
+
+        HttpConnectionPool_Release( pTransport, HttpConnectionClose );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Entry point of demo.
  *
@@ -327,7 +488,9 @@ static int32_t sendHttpRequest( const TransportInterface_t * pTransportInterface
  * communication is encrypted. After which, HTTP Client Library API is used to
  * make a POST request to AWS IoT Core in order to publish a message to a topic
  * named topic with QoS=1 so that all clients subscribed to the topic receive
- * the message at least once. Any possible errors are also logged.
+ * the message at least once. When an upload URL is configured, a data
+ * partition is then streamed from flash to it with a PUT request. Any
+ * possible errors are also logged.
  *
  * @note This example is single-threaded and uses statically allocated memory.
  *
@@ -337,9 +500,7 @@ int aws_iot_demo_main( int argc,
 {
     /* Return value of main. */
     int32_t returnStatus = EXIT_SUCCESS;
-    /* The transport layer interface used by the HTTP Client library. */
-    TransportInterface_t transportInterface;
-    /* The network context for the transport layer interface. */
+    /* The server and credentials of the connection taken from the pool. */
     NetworkContext_t networkContext = {0};
 
     ( void ) argc;
@@ -372,26 +533,24 @@ int aws_iot_demo_main( int argc,
         }
     }
 
-    /* Define the transport interface. */
-    if( returnStatus == EXIT_SUCCESS )
-    {
-        ( void ) memset( &transportInterface, 0, sizeof( transportInterface ) );
-        transportInterface.recv = espTlsTransportRecv;
-        transportInterface.send = espTlsTransportSend;
-        transportInterface.pNetworkContext = &networkContext;
-    }
-
     /*********************** Send HTTPS request. ************************/
 
     if( returnStatus == EXIT_SUCCESS )
     {
-        returnStatus = sendHttpRequest( &transportInterface,
+        returnStatus = sendHttpRequest( pPooledTransport,
                                         HTTP_METHOD_POST,
                                         HTTP_METHOD_POST_LENGTH,
                                         POST_PATH,
                                         POST_PATH_LENGTH );
     }
 
+    /*********************** Upload a partition. ************************/
+
+    if( ( returnStatus == EXIT_SUCCESS ) && ( UPLOAD_URL_LENGTH > 0U ) )
+    {
+        returnStatus = uploadPartition();
+    }
+
     if( returnStatus == EXIT_SUCCESS )
     {
         /* Log message indicating an iteration completed successfully. */
@@ -401,7 +560,11 @@ int aws_iot_demo_main( int argc,
     /************************** Disconnect. *****************************/
 
     /* End TLS session, then close TCP connection. */
-    ( void ) xTlsDisconnect( &networkContext );
+    if( pPooledTransport != NULL )
+    {
+        HttpConnectionPool_Release( pPooledTransport, HttpConnectionClose );
+        pPooledTransport = NULL;
+    }
 
     return returnStatus;
 }
@@ -34,8 +34,8 @@
 /* Demo utils header. */
 #include "http_demo_utils.h"
 
-/*Include backoff algorithm header for retry logic.*/
-#include "backoff_algorithm.h"
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
 
 /*Include clock header for millisecond sleep function. */
 #include "clock.h"
@@ -72,50 +72,21 @@ struct NetworkContext
 
 /*-----------------------------------------------------------*/
 
-/**
- * @brief The random number generator to use for exponential backoff with
- * jitter retry logic.
- *
- * @return The generated random number.
- */
-static uint32_t generateRandomNumber();
-
-/*-----------------------------------------------------------*/
-
-static uint32_t generateRandomNumber()
-{
-    return( rand() );
-}
-
-/*-----------------------------------------------------------*/
-
 int32_t connectToServerWithBackoffRetries( TransportConnect_t connectFunction,
                                            NetworkContext_t * pNetworkContext )
 {
     int32_t returnStatus = EXIT_FAILURE;
-    /* Status returned by the retry utilities. */
-    BackoffAlgorithmStatus_t backoffAlgStatus = BackoffAlgorithmSuccess;
-    /* Struct containing the next backoff time. */
-    BackoffAlgorithmContext_t reconnectParams;
-    uint16_t nextRetryBackOff = 0U;
-    struct timespec tp;
+    bool retry = true;
+    ReconnectPolicy_t reconnectPolicy;
+    uint32_t nextRetryBackOff = 0U;
 
     assert( connectFunction != NULL );
 
-    /* Seed pseudo random number generator used in the demo for
-     * backoff period calculation when retrying failed network operations
-     * with broker. */
-
-    /* Get current time to seed pseudo random number generator. */
-    ( void ) clock_gettime( CLOCK_REALTIME, &tp );
-    /* Seed pseudo random number generator with nanoseconds. */
-    srand( tp.tv_nsec );
-
     /* Initialize reconnect attempts and interval */
-    BackoffAlgorithm_InitializeParams( &reconnectParams,
-                                       CONNECTION_RETRY_BACKOFF_BASE_MS,
-                                       CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
-                                       CONNECTION_RETRY_MAX_ATTEMPTS );
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           CONNECTION_RETRY_BACKOFF_BASE_MS,
+                           CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                           CONNECTION_RETRY_MAX_ATTEMPTS );
 
     /* Attempt to connect to HTTP server. If connection fails, retry after
      * a timeout. Timeout value will exponentially increase until maximum
@@ -126,14 +97,14 @@ int32_t connectToServerWithBackoffRetries( TransportConnect_t connectFunction,
 
         if( returnStatus != EXIT_SUCCESS )
         {
-            /* Generate a random number and get back-off value (in milliseconds) for the next connection retry. */
-            backoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &reconnectParams, generateRandomNumber(), &nextRetryBackOff );
+            /* Get the back-off value (in milliseconds) for the next connection retry. */
+            retry = ReconnectPolicy_NextDelay( &reconnectPolicy, ReconnectFailureNetwork, &nextRetryBackOff );
 
-            if( backoffAlgStatus == BackoffAlgorithmSuccess )
+            if( retry == true )
             {
                 LogWarn( ( "Connection to the HTTP server failed. Retrying "
-                           "connection after %hu ms backoff.",
-                           ( unsigned short ) nextRetryBackOff ) );
+                           "connection after %u ms backoff.",
+                           ( unsigned ) nextRetryBackOff ) );
                 Clock_SleepMs( nextRetryBackOff );
             }
             else
@@ -141,7 +112,7 @@ int32_t connectToServerWithBackoffRetries( TransportConnect_t connectFunction,
                 LogError( ( "Connection to the HTTP server failed, all attempts exhausted." ) );
             }
         }
-    } while( ( returnStatus == EXIT_FAILURE ) && ( backoffAlgStatus == BackoffAlgorithmSuccess ) );
+    } while( ( returnStatus == EXIT_FAILURE ) && ( retry == true ) );
 
     if( returnStatus == EXIT_FAILURE )
     {
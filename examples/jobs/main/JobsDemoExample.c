@@ -47,17 +47,37 @@
  * jobs queued (as JSON documents) for the Thing resource (associated with this demo application) on the cloud,
  * then executes the jobs and updates the status of the jobs back to the cloud.
  * The demo expects job documents to have an "action" JSON key. Actions can
- * be one of "print", "publish", or "exit".
+ * be one of "print", "publish", or "exit". Each action is registered with its
+ * handler in a job dispatch table, see job_dispatch.h, which finds the action
+ * of a job document with one hash of its name.
  * A "print" job logs a message to the local console, and must contain a "message",
  * e.g. { "action": "print", "message": "Hello World!" }.
  * A "publish" job publishes a message to an MQTT Topic. The job document must
  * contain a "message" and "topic" to publish to, e.g.
  * { "action": "publish", "topic": "demo/jobs", "message": "Hello World!" }.
  * An "exit" job exits the demo. Sending { "action": "exit" } will end the demo program.
+ * With CONFIG_LOGGING_RUNTIME_LEVELS, a "log_level" job sets the log levels given
+ * in its "message", see log_control.h, e.g.
+ * { "action": "log_level", "message": "JobsDemo=debug,MQTT=warn" }.
+ *
+ * Actions registered to run on a worker are run by a pool of worker tasks, while the demo
+ * task keeps the MQTT connection; the others, quick and needing the MQTT connection, are run
+ * by the demo task as their document arrives. The demo task lists the pending jobs with the
+ * GetPendingJobExecutions API and fetches the documents of up to #jobsexampleMAX_OUTSTANDING_JOBS
+ * of them with the DescribeJobExecution API, so the next jobs are already parsed and queued
+ * while the current ones run. The workers hand finished jobs back to the demo task, which
+ * reports their status. A job running longer than the timeout of its action is reported as
+ * failed; an inline job can't be interrupted, so only a warning is logged for it.
+ *
+ * Progress reported by a running job is coalesced per job: each worker keeps only the latest
+ * report of its job, and a report is sent once the previous update of the job is answered,
+ * with the expectedVersion of the execution so that a conflicting update is rejected instead
+ * of overwriting it. The final status of a job is sent as soon as the job is done.
  */
 
 /* Standard includes. */
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -67,17 +87,35 @@
 
 /* Kernel includes. */
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
 
 /* Jobs library header. */
 #include "jobs.h"
 
 /* JSON library includes. */
-#include "core_json.h"
+#include "json_index.h"
 
 /* Include common MQTT demo helpers. */
 #include "mqtt_demo_helpers.h"
 
+/* Include shared buffer arena. */
+#include "buffer_arena.h"
+
+/* Include job action dispatch table. */
+#include "job_dispatch.h"
+
+#if CONFIG_JOBS_DEMO_DEFENDER_METRICS
+    /* Include Device Defender library and metrics collector. */
+    #include "defender.h"
+    #include "defender_metrics.h"
+#endif
+
+#if CONFIG_LOGGING_RUNTIME_LEVELS
+    /* Include run time log levels. */
+    #include "log_control.h"
+#endif
+
 /*------------- Demo configurations -------------------------*/
 
 #ifndef democonfigTHING_NAME
@@ -137,6 +175,56 @@
  */
 #define jobsexampleQUERY_KEY_FOR_JOBS_DOC_LENGTH    ( sizeof( jobsexampleQUERY_KEY_FOR_JOBS_DOC ) - 1 )
 
+/**
+ * @brief The query key to use for searching the status of a job execution in
+ * message payload from AWS IoT Jobs service.
+ */
+#define jobsexampleQUERY_KEY_FOR_STATUS             jobsexampleEXECUTION_KEY  ".status"
+
+/**
+ * @brief The length of #jobsexampleQUERY_KEY_FOR_STATUS.
+ */
+#define jobsexampleQUERY_KEY_FOR_STATUS_LENGTH      ( sizeof( jobsexampleQUERY_KEY_FOR_STATUS ) - 1 )
+
+/**
+ * @brief The query key to use for searching the version of a job execution in
+ * a DescribeJobExecution response or a NextJobExecutionChanged notification.
+ */
+#define jobsexampleQUERY_KEY_FOR_VERSION            jobsexampleEXECUTION_KEY  ".versionNumber"
+
+/**
+ * @brief The length of #jobsexampleQUERY_KEY_FOR_VERSION.
+ */
+#define jobsexampleQUERY_KEY_FOR_VERSION_LENGTH     ( sizeof( jobsexampleQUERY_KEY_FOR_VERSION ) - 1 )
+
+/**
+ * @brief The query key to use for searching the version of a job execution in
+ * an UpdateJobExecution response, accepted or rejected.
+ */
+#define jobsexampleQUERY_KEY_FOR_STATE_VERSION           "executionState.versionNumber"
+
+/**
+ * @brief The length of #jobsexampleQUERY_KEY_FOR_STATE_VERSION.
+ */
+#define jobsexampleQUERY_KEY_FOR_STATE_VERSION_LENGTH    ( sizeof( jobsexampleQUERY_KEY_FOR_STATE_VERSION ) - 1 )
+
+/**
+ * @brief The query key to use for searching the error code of a rejected
+ * UpdateJobExecution request.
+ */
+#define jobsexampleQUERY_KEY_FOR_CODE               "code"
+
+/**
+ * @brief The length of #jobsexampleQUERY_KEY_FOR_CODE.
+ */
+#define jobsexampleQUERY_KEY_FOR_CODE_LENGTH        ( sizeof( jobsexampleQUERY_KEY_FOR_CODE ) - 1 )
+
+/**
+ * @brief The error code of an update whose expectedVersion isn't the version
+ * of the job execution.
+ */
+#define jobsexampleVERSION_MISMATCH                 "VersionMismatch"
+
 /**
  * @brief The query key to use for searching the Action key in Jobs document
  * from AWS IoT Jobs service.
@@ -181,16 +269,96 @@
  */
 #define jobsexampleQUERY_KEY_FOR_TOPIC_LENGTH       ( sizeof( jobsexampleQUERY_KEY_FOR_TOPIC ) - 1 )
 
+/**
+ * @brief The number of tokens for indexing a message from AWS IoT Jobs.
+ *
+ * A document takes a token per key and per value, so this fits about 120
+ * members, the most a message that fits in the network buffer has.
+ */
+#define jobsexampleMAX_JSON_TOKENS                  ( 256U )
+
+/**
+ * @brief The JSON keys of the lists of jobs in a GetPendingJobExecutions
+ * response, in the order they are fetched.
+ */
+#define jobsexampleIN_PROGRESS_JOBS_KEY             "inProgressJobs"
+#define jobsexampleQUEUED_JOBS_KEY                  "queuedJobs"
+
+/**
+ * @brief The number of worker tasks executing jobs.
+ */
+#define jobsexampleWORKER_COUNT                     democonfigJOBS_WORKER_COUNT
+
+/**
+ * @brief The stack size of a worker task.
+ */
+#define jobsexampleWORKER_STACKSIZE                 4096
+
+/**
+ * @brief The most jobs fetched, waiting for a worker, running or waiting for
+ * their status update at once.
+ */
+#define jobsexampleMAX_OUTSTANDING_JOBS             democonfigJOBS_PREFETCH_DEPTH
+
+/**
+ * @brief The longest topic of a "publish" job.
+ */
+#define jobsexampleMAX_TOPIC_LENGTH                 ( 128U )
+
+/**
+ * @brief The longest message of a "print" or "publish" job.
+ */
+#define jobsexampleMAX_MESSAGE_LENGTH               ( 256U )
+
+/**
+ * @brief How long a "print" job may run on a worker before it is reported as
+ * failed, and how long an action run by the demo task may take before a
+ * warning is logged.
+ */
+#define jobsexamplePRINT_TIMEOUT_MS                 ( 5000U )
+#define jobsexampleINLINE_TIMEOUT_MS                ( 50U )
+
+/**
+ * @brief How long to wait for the response to a GetPendingJobExecutions or
+ * DescribeJobExecution request before asking again.
+ */
+#define jobsexampleREQUEST_TIMEOUT_TICKS            ( pdMS_TO_TICKS( 10000U ) )
+
+/**
+ * @brief The timeout of the process loop of the demo task, short so that the
+ * status of a finished job goes out soon after a worker is done with it.
+ */
+#define jobsexamplePROCESS_LOOP_TIMEOUT_MS          ( 100U )
+
+/**
+ * @brief The number of topics in #xDemoTopics.
+ */
+#if CONFIG_JOBS_DEMO_DEFENDER_METRICS
+    #define jobsexampleTOPIC_COUNT                  ( 2U )
+#else
+    #define jobsexampleTOPIC_COUNT                  ( 1U )
+#endif
+
+/**
+ * @brief The longest statusDetails JSON object a job reports with its progress.
+ */
+#define jobsexampleMAX_STATUS_DETAILS_LENGTH        ( 96U )
+
+/**
+ * @brief The longest UpdateJobExecution request document.
+ */
+#define jobsexampleMAX_UPDATE_LENGTH                ( jobsexampleMAX_STATUS_DETAILS_LENGTH + 128U )
+
 /**
  * @brief Utility macro to generate the PUBLISH topic string to the
- * DescribePendingJobExecution API of AWS IoT Jobs service for requesting
- * the next pending job information.
+ * GetPendingJobExecutions API of AWS IoT Jobs service for listing the
+ * pending jobs.
  *
  * @param[in] thingName The name of the Thing resource to query for the
- * next pending job.
+ * pending jobs.
  */
-#define START_NEXT_JOB_TOPIC( thingName ) \
-    ( JOBS_API_PREFIX thingName JOBS_API_BRIDGE JOBS_API_STARTNEXT )
+#define GET_PENDING_JOBS_TOPIC( thingName ) \
+    ( JOBS_API_PREFIX thingName JOBS_API_BRIDGE JOBS_API_GETPENDING )
 
 /**
  * @brief Utility macro to generate the subscription topic string for the
@@ -203,13 +371,6 @@
 #define NEXT_JOB_EXECUTION_CHANGED_TOPIC( thingName ) \
     ( JOBS_API_PREFIX thingName JOBS_API_BRIDGE JOBS_API_NEXTJOBCHANGED )
 
-/**
- * @brief Format a JSON status message.
- *
- * @param[in] x one of "IN_PROGRESS", "SUCCEEDED", or "FAILED"
- */
-#define MAKE_STATUS_REPORT( x )    "{\"status\":\"" x "\"}"
-
 /**
  * @brief The maximum number of times to run the loop in this demo.
  *
@@ -229,15 +390,66 @@
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Currently supported actions that a job document can specify.
+ * @brief A job, as handed from the demo task to a worker and back.
+ *
+ * The values of the job document are copied out of the MQTT buffer, which is
+ * reused for the next packet. The topic and message are empty if the document
+ * has none, each action checking for those it needs.
+ */
+typedef struct JobExecution
+{
+    char cJobId[ JOBS_JOBID_MAX_LENGTH ];
+    uint16_t usJobIdLength;
+    const JobDispatchAction_t * pxAction;
+    char cTopic[ jobsexampleMAX_TOPIC_LENGTH ];
+    uint16_t usTopicLength;
+    char cMessage[ jobsexampleMAX_MESSAGE_LENGTH ];
+    size_t xMessageLength;
+    const char * pcStatus; /**< Set by the worker, "SUCCEEDED" or "FAILED". */
+} JobExecution_t;
+
+/**
+ * @brief The latest progress of the job a worker runs.
+ */
+typedef struct JobProgress
+{
+    char cJobId[ JOBS_JOBID_MAX_LENGTH ];
+    uint16_t usJobIdLength;
+    char cStatusDetails[ jobsexampleMAX_STATUS_DETAILS_LENGTH ];
+    size_t xStatusDetailsLength;
+} JobProgress_t;
+
+/**
+ * @brief States of a #JobSlot_t.
+ */
+typedef enum JobSlotState
+{
+    JOB_SLOT_FREE,       /**< Not in use. */
+    JOB_SLOT_DESCRIBING, /**< The job document is requested. */
+    JOB_SLOT_ACCEPTED,   /**< Queued for a worker or running. */
+    JOB_SLOT_REPORTED    /**< The final status is sent, and not yet answered. */
+} JobSlotState_t;
+
+/**
+ * @brief A job the demo knows of, so that it is fetched and run once however
+ * many times the service lists it.
  */
-typedef enum JobActionType
+typedef struct JobSlot
 {
-    JOB_ACTION_PRINT,   /**< Print a message. */
-    JOB_ACTION_PUBLISH, /**< Publish a message to an MQTT topic. */
-    JOB_ACTION_EXIT,    /**< Exit the demo. */
-    JOB_ACTION_UNKNOWN  /**< Unknown action. */
-} JobActionType;
+    char cJobId[ JOBS_JOBID_MAX_LENGTH ];
+    uint16_t usJobIdLength;
+    JobSlotState_t xState;
+    TickType_t xRequestTick; /**< When the job document or the last status update was sent. */
+    const char * pcStatus;   /**< The latest status, NULL until the job reports one. */
+    char cStatusDetails[ jobsexampleMAX_STATUS_DETAILS_LENGTH ];
+    size_t xStatusDetailsLength;
+    BaseType_t xStatusPending;            /**< Whether the latest status is yet to be sent. */
+    UBaseType_t uxUpdatesInFlight;        /**< The status updates sent and not yet answered. */
+    uint32_t ulVersion;                   /**< The versionNumber of the execution, 0 if unknown. */
+    const JobDispatchAction_t * pxAction; /**< The action of the job, once it is queued for a worker. */
+    BaseType_t xStarted;                  /**< Whether the worker reported starting the job. */
+    TickType_t xStartTick;                /**< When the start was reported, the timeout runs from there. */
+} JobSlot_t;
 
 /*-----------------------------------------------------------*/
 
@@ -256,19 +468,33 @@ static NetworkContext_t xNetworkContext;
  */
 // static TlsTransportParams_t xTlsTransportParams;
 
+#if BUFFER_ARENA_ENABLED
+
+/**
+ * @brief Buffer used to hold MQTT messages being sent and received, borrowed
+ * from the buffer arena by the MQTT session for each connection.
+ */
+    static MQTTFixedBuffer_t xBuffer =
+    {
+        .pBuffer = NULL,
+        .size    = democonfigNETWORK_BUFFER_SIZE
+    };
+#else
+
 /**
  * @brief Static buffer used to hold MQTT messages being sent and received.
  */
-static uint8_t ucSharedBuffer[ democonfigNETWORK_BUFFER_SIZE ];
+    static uint8_t ucSharedBuffer[ democonfigNETWORK_BUFFER_SIZE ];
 
 /**
  * @brief Static buffer used to hold MQTT messages being sent and received.
  */
-static MQTTFixedBuffer_t xBuffer =
-{
-    .pBuffer = ucSharedBuffer,
-    .size    = democonfigNETWORK_BUFFER_SIZE
-};
+    static MQTTFixedBuffer_t xBuffer =
+    {
+        .pBuffer = ucSharedBuffer,
+        .size    = democonfigNETWORK_BUFFER_SIZE
+    };
+#endif /* if BUFFER_ARENA_ENABLED */
 
 /**
  * @brief A global flag which represents whether a job for the "Exit" action
@@ -276,6 +502,83 @@ static MQTTFixedBuffer_t xBuffer =
  */
 static BaseType_t xExitActionJobReceived = pdFALSE;
 
+/**
+ * @brief The actions of the demo, registered and built before the workers
+ * start, and only read after.
+ */
+static JobDispatchTable_t xJobActions;
+
+/**
+ * @brief Tokens of the message from AWS IoT Jobs being handled.
+ */
+static JsonIndexToken_t xJobTokens[ jobsexampleMAX_JSON_TOKENS ];
+
+/**
+ * @brief The jobs fetched and not yet reported, owned by the demo task.
+ */
+static JobSlot_t xJobSlots[ jobsexampleMAX_OUTSTANDING_JOBS ];
+
+/**
+ * @brief Jobs waiting for a worker, and jobs the workers are done with.
+ *
+ * Both hold #jobsexampleMAX_OUTSTANDING_JOBS jobs, so sends never block.
+ */
+static QueueHandle_t xPendingJobs = NULL;
+static QueueHandle_t xCompletedJobs = NULL;
+
+/**
+ * @brief The latest progress of the job each worker runs.
+ *
+ * Each is a queue of one item that every report overwrites, so reports made
+ * faster than they can be sent replace each other.
+ */
+static QueueHandle_t xProgressMailboxes[ jobsexampleWORKER_COUNT ];
+
+/**
+ * @brief The job being parsed by the MQTT callback, static to keep it off
+ * the stack of the demo task.
+ */
+static JobExecution_t xReceivedJob;
+
+/**
+ * @brief The topics the demo subscribes to once it is connected, with a
+ * single SUBSCRIBE: NextJobExecutionChanged, then the Device Defender
+ * rejected topic if metrics are reported.
+ */
+static const MQTTSubscribeInfo_t xDemoTopics[ jobsexampleTOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = NEXT_JOB_EXECUTION_CHANGED_TOPIC( democonfigTHING_NAME ),
+        .topicFilterLength = sizeof( NEXT_JOB_EXECUTION_CHANGED_TOPIC( democonfigTHING_NAME ) ) - 1
+    },
+    #if CONFIG_JOBS_DEMO_DEFENDER_METRICS
+        {
+            .qos = MQTTQoS1,
+            .pTopicFilter = DEFENDER_API_CBOR_REJECTED( democonfigTHING_NAME ),
+            .topicFilterLength = sizeof( DEFENDER_API_CBOR_REJECTED( democonfigTHING_NAME ) ) - 1
+        }
+    #endif
+};
+
+/**
+ * @brief Whether the list of pending jobs is to be requested.
+ */
+static BaseType_t xRefreshPendingJobs = pdFALSE;
+
+/**
+ * @brief Whether the last list of pending jobs had more than there were free
+ * slots for.
+ */
+static BaseType_t xMoreJobsPending = pdFALSE;
+
+/**
+ * @brief Whether a GetPendingJobExecutions request waits for its response,
+ * and since when.
+ */
+static BaseType_t xGetPendingInFlight = pdFALSE;
+static TickType_t xGetPendingTick = 0U;
+
 /**
  * @brief A global flag which represents whether an error was encountered while
  * executing the demo.
@@ -287,16 +590,24 @@ static BaseType_t xDemoEncounteredError = pdFALSE;
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Converts a string in a job document to a #JobActionType
- * value.
- *
- * @param[in] pcAction The job action as a string.
- * @param[in] xActionLength The length of @p pcAction.
- *
- * @return A #JobActionType equivalent to the given string.
+ * @brief Registers the actions of the demo in #xJobActions and builds it.
  */
-static JobActionType prvGetAction( const char * pcAction,
-                                   size_t xActionLength );
+static void prvRegisterJobActions( void );
+
+/**
+ * @brief The handlers of the actions, see #JobDispatchHandler_t. @p pvJob is a
+ * #JobExecution_t.
+ */
+static bool prvPrintAction( void * pvJob,
+                            void * pvContext );
+static bool prvPublishAction( void * pvJob,
+                              void * pvContext );
+static bool prvExitAction( void * pvJob,
+                           void * pvContext );
+#if CONFIG_LOGGING_RUNTIME_LEVELS
+    static bool prvLogLevelAction( void * pvJob,
+                                   void * pvContext );
+#endif
 
 /**
  * @brief This example uses the MQTT library of the AWS IoT Device SDK for
@@ -326,30 +637,172 @@ static void prvEventCallback( MQTTContext_t * pxMqttContext,
 static void prvNextJobHandler( MQTTPublishInfo_t * pxPublishInfo );
 
 /**
- * @brief Sends an update for a job to the UpdateJobExecution API of the AWS IoT Jobs service.
+ * @brief Sends the latest status of a job to the UpdateJobExecution API of the AWS IoT Jobs service.
  *
- * @param[in] pcJobId The job ID whose status has to be updated.
- * @param[in] usJobIdLength The length of the job ID string.
- * @param[in] pcJobStatusReport The JSON formatted report to send to the AWS IoT Jobs service
- * to update the status of @p pcJobId.
+ * The update names the version of the execution it applies to when no other
+ * update of the job is in flight and the version is known.
+ *
+ * @param[in,out] pxSlot The slot of the job, with its status set.
+ */
+static void prvSendUpdateForJob( JobSlot_t * pxSlot );
+
+/**
+ * @brief Process an UpdateJobExecution response.
+ *
+ * @param[in] pxPublishInfo Deserialized publish info pointer for the incoming
+ * packet.
+ * @param[in] pcJobId The job ID in the topic of the response.
+ * @param[in] usJobIdLength The length of @p pcJobId.
+ * @param[in] xAccepted pdTRUE for an accepted response, pdFALSE for a rejected one.
+ */
+static void prvUpdateResponseHandler( MQTTPublishInfo_t * pxPublishInfo,
+                                      const char * pcJobId,
+                                      uint16_t usJobIdLength,
+                                      BaseType_t xAccepted );
+
+/**
+ * @brief Reads the version of a job execution from a JSON document.
+ *
+ * @param[in] pxIndex The index of the document.
+ * @param[in] pcQuery The key of the version.
+ * @param[in] xQueryLength The length of @p pcQuery.
+ * @param[out] pulVersion The version.
+ *
+ * @return pdPASS if the document has the version, pdFAIL otherwise.
  */
-static void prvSendUpdateForJob( char * pcJobId,
-                                 uint16_t usJobIdLength,
-                                 const char * pcJobStatusReport );
+static BaseType_t prvParseVersion( const JsonIndex_t * pxIndex,
+                                   const char * pcQuery,
+                                   size_t xQueryLength,
+                                   uint32_t * pulVersion );
 
 /**
- * @brief Executes a job received from AWS IoT Jobs service and sends an update back to the service.
- * It parses the received job document, executes the job depending on the job "Action" type, and
- * sends an update to AWS for the Job.
+ * @brief Copies the action of a job document, and the values the action
+ * needs, into a job for a worker.
  *
- * @param[in] pxPublishInfo The PUBLISH packet containing the job document received from the
+ * @param[in] pxIndex The index of the job execution document received from the
  * AWS IoT Jobs service.
- * @param[in] pcJobId The ID of the job to execute.
- * @param[in] usJobIdLength The length of the job ID string.
+ * @param[in,out] pxJob The job, with its ID set.
+ *
+ * @return pdPASS if the document has what its action needs, pdFAIL if the
+ * job is to be reported as failed.
+ */
+static BaseType_t prvParseJobDocument( const JsonIndex_t * pxIndex,
+                                       JobExecution_t * pxJob );
+
+/**
+ * @brief Process a GetPendingJobExecutions response, requesting the job
+ * document of every job listed that isn't fetched yet, while slots are free.
+ *
+ * @param[in] pxPublishInfo Deserialized publish info pointer for the incoming
+ * packet.
+ */
+static void prvPendingJobsHandler( MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Publishes to the GetPendingJobExecutions API of AWS IoT Jobs.
+ */
+static void prvRequestPendingJobs( void );
+
+/**
+ * @brief Publishes to the DescribeJobExecution API of AWS IoT Jobs for the
+ * job of a slot.
+ *
+ * @param[in] pxSlot The slot, claimed with #prvClaimSlot.
+ */
+static void prvDescribeJob( JobSlot_t * pxSlot );
+
+/**
+ * @brief Finds the slot of a job.
+ *
+ * @return The slot, or NULL if the job isn't fetched.
+ */
+static JobSlot_t * prvFindSlot( const char * pcJobId,
+                                size_t xJobIdLength );
+
+/**
+ * @brief Takes a free slot for a job, in the #JOB_SLOT_DESCRIBING state.
+ *
+ * @return The slot, or NULL if none is free or the demo is exiting.
+ */
+static JobSlot_t * prvClaimSlot( const char * pcJobId,
+                                 size_t xJobIdLength );
+
+/**
+ * @brief Counts the slots in a state.
+ */
+static UBaseType_t prvCountSlots( JobSlotState_t xState );
+
+/**
+ * @brief Frees the slots, and clears the GetPendingJobExecutions request,
+ * whose responses are overdue.
+ */
+static void prvExpireRequests( void );
+
+/**
+ * @brief Makes the MQTT operations of the jobs the workers are done with,
+ * and reports their status.
+ */
+static void prvCompleteJobs( void );
+
+/**
+ * @brief Copies the latest progress of the jobs running on the workers into
+ * their slots.
+ */
+static void prvCollectProgress( void );
+
+/**
+ * @brief Sends the progress of the running jobs that have no update in flight.
+ */
+static void prvSendProgress( void );
+
+/**
+ * @brief Reports the progress of a job, from the worker running it.
+ *
+ * @param[in] uxWorker The index of the worker.
+ * @param[in] pxJob The job.
+ * @param[in] pcStatusDetails The statusDetails of the job, a JSON object.
+ */
+static void prvReportProgress( UBaseType_t uxWorker,
+                               const JobExecution_t * pxJob,
+                               const char * pcStatusDetails );
+
+/**
+ * @brief Runs a job, on a worker task.
+ *
+ * @param[in] uxWorker The index of the worker.
+ * @param[in,out] pxJob The job, whose status is set.
+ */
+static void prvExecuteJob( UBaseType_t uxWorker,
+                           JobExecution_t * pxJob );
+
+/**
+ * @brief Runs a job of an inline action on the demo task and reports its
+ * status.
+ *
+ * @param[in] pxSlot The slot of the job.
+ * @param[in] pxJob The job.
+ */
+static void prvRunJobInline( JobSlot_t * pxSlot,
+                             JobExecution_t * pxJob );
+
+/**
+ * @brief Sends the final status of a job, and frees the slot once it is
+ * answered.
+ *
+ * @param[in] pxSlot The slot of the job.
+ * @param[in] pcStatus "SUCCEEDED" or "FAILED".
+ * @param[in] pcStatusDetails The statusDetails JSON object, or NULL for none.
+ */
+static void prvFinishJob( JobSlot_t * pxSlot,
+                          const char * pcStatus,
+                          const char * pcStatusDetails );
+
+/**
+ * @brief A worker task, running the jobs of #xPendingJobs one at a time.
+ *
+ * @param[in] pvParameters The index of the worker.
  */
-static void prvProcessJobDocument( MQTTPublishInfo_t * pxPublishInfo,
-                                   char * pcJobId,
-                                   uint16_t usJobIdLength );
+static void prvJobWorkerTask( void * pvParameters );
 
 /**
  * @brief The task used to demonstrate the Jobs library API.
@@ -362,231 +815,839 @@ static void prvJobsDemoTask( void * pvParameters );
 
 /*-----------------------------------------------------------*/
 
-static JobActionType prvGetAction( const char * pcAction,
-                                   size_t xActionLength )
+static bool prvPrintAction( void * pvJob,
+                            void * pvContext )
 {
-    JobActionType xAction = JOB_ACTION_UNKNOWN;
+    JobExecution_t * pxJob = ( JobExecution_t * ) pvJob;
+    bool xSucceeded = false;
 
-    configASSERT( pcAction != NULL );
+    ( void ) pvContext;
 
-    if( strncmp( pcAction, "print", xActionLength ) == 0 )
-    {
-        xAction = JOB_ACTION_PRINT;
-    }
-    else if( strncmp( pcAction, "publish", xActionLength ) == 0 )
+    if( pxJob->xMessageLength == 0U )
     {
-        xAction = JOB_ACTION_PUBLISH;
+        LogError( ( "Job document schema is invalid. Missing \"message\" key for \"print\" action type." ) );
     }
-    else if( strncmp( pcAction, "exit", xActionLength ) == 0 )
+    else
     {
-        xAction = JOB_ACTION_EXIT;
+        LogInfo( ( "Received job contains \"print\" action." ) );
+
+        /* Print the given message if the action is "print". */
+        LogInfo( ( "\r\n"
+                   "/*-----------------------------------------------------------*/\r\n"
+                   "\r\n"
+                   "%.*s\r\n"
+                   "\r\n"
+                   "/*-----------------------------------------------------------*/\r\n"
+                   "\r\n", ( int ) pxJob->xMessageLength, pxJob->cMessage ) );
+        xSucceeded = true;
     }
 
-    return xAction;
+    return xSucceeded;
 }
 
-static void prvSendUpdateForJob( char * pcJobId,
-                                 uint16_t usJobIdLength,
-                                 const char * pcJobStatusReport )
-{
-    char pUpdateJobTopic[ JOBS_API_MAX_LENGTH( THING_NAME_LENGTH ) ];
-    size_t ulTopicLength = 0;
-    JobsStatus_t xStatus = JobsSuccess;
+/*-----------------------------------------------------------*/
 
-    configASSERT( ( pcJobId != NULL ) && ( usJobIdLength > 0 ) );
-    configASSERT( pcJobStatusReport != NULL );
+static bool prvPublishAction( void * pvJob,
+                              void * pvContext )
+{
+    JobExecution_t * pxJob = ( JobExecution_t * ) pvJob;
+    bool xSucceeded = false;
 
-    /* Generate the PUBLISH topic string for the UpdateJobExecution API of AWS IoT Jobs service. */
-    xStatus = Jobs_Update( pUpdateJobTopic,
-                           sizeof( pUpdateJobTopic ),
-                           democonfigTHING_NAME,
-                           THING_NAME_LENGTH,
-                           pcJobId,
-                           usJobIdLength,
-                           &ulTopicLength );
+    ( void ) pvContext;
 
-    if( xStatus == JobsSuccess )
+    /* Publish to the parsed MQTT topic with the message obtained from
+     * the Jobs document. The demo task runs this, as it owns the MQTT
+     * connection. */
+    if( ( pxJob->usTopicLength == 0U ) || ( pxJob->xMessageLength == 0U ) )
     {
-        if( xPublishToTopic( &xMqttContext,
-                             pUpdateJobTopic,
-                             ulTopicLength,
-                             pcJobStatusReport,
-                             strlen( pcJobStatusReport ) ) == pdFALSE )
-        {
-            /* Set global flag to terminate demo as PUBLISH operation to update job status failed. */
-            xDemoEncounteredError = pdTRUE;
-
-            LogError( ( "Failed to update the status of job: JobID=%.*s, NewStatePayload=%s",
-                        usJobIdLength, pcJobId, pcJobStatusReport ) );
-        }
+        LogError( ( "Job document schema is invalid. Missing \"topic\" or \"message\" key for \"publish\" action type." ) );
     }
-    else
+    else if( xPublishToTopic( &xMqttContext,
+                              pxJob->cTopic,
+                              pxJob->usTopicLength,
+                              pxJob->cMessage,
+                              pxJob->xMessageLength ) == pdFALSE )
     {
-        /* Set global flag to terminate demo as topic generation for UpdateJobExecution API failed. */
+        /* Set global flag to terminate demo as PUBLISH operation to execute job failed. */
         xDemoEncounteredError = pdTRUE;
 
-        LogError( ( "Failed to generate Publish topic string for sending job update: "
-                    "JobID=%.*s, NewStatePayload=%s",
-                    usJobIdLength, pcJobId, pcJobStatusReport ) );
+        LogError( ( "Failed to execute job with \"publish\" action: Failed to publish to topic. "
+                    "JobID=%.*s, Topic=%.*s",
+                    pxJob->usJobIdLength, pxJob->cJobId, pxJob->usTopicLength, pxJob->cTopic ) );
     }
+    else
+    {
+        xSucceeded = true;
+    }
+
+    return xSucceeded;
 }
 
-static void prvProcessJobDocument( MQTTPublishInfo_t * pxPublishInfo,
-                                   char * pcJobId,
-                                   uint16_t usJobIdLength )
+/*-----------------------------------------------------------*/
+
+static bool prvExitAction( void * pvJob,
+                           void * pvContext )
 {
-    char * pcAction = NULL;
-    size_t uActionLength = 0U;
-    JSONStatus_t xJsonStatus = JSONSuccess;
+    ( void ) pvJob;
+    ( void ) pvContext;
 
-    configASSERT( pxPublishInfo != NULL );
-    configASSERT( ( pxPublishInfo->pPayload != NULL ) && ( pxPublishInfo->payloadLength > 0 ) );
+    LogInfo( ( "Received job contains \"exit\" action. Updating state of demo." ) );
+    xExitActionJobReceived = pdTRUE;
 
-    xJsonStatus = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                               pxPublishInfo->payloadLength,
-                               jobsexampleQUERY_KEY_FOR_ACTION,
-                               jobsexampleQUERY_KEY_FOR_ACTION_LENGTH,
-                               &pcAction,
-                               &uActionLength );
+    return true;
+}
 
-    if( xJsonStatus != JSONSuccess )
-    {
-        LogError( ( "Job document schema is invalid. Missing expected \"action\" key in document." ) );
-        prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "FAILED" ) );
-    }
-    else
+/*-----------------------------------------------------------*/
+
+#if CONFIG_LOGGING_RUNTIME_LEVELS
+    static bool prvLogLevelAction( void * pvJob,
+                                   void * pvContext )
     {
-        JobActionType xActionType = JOB_ACTION_UNKNOWN;
-        char * pcMessage = NULL;
-        size_t ulMessageLength = 0U;
+        JobExecution_t * pxJob = ( JobExecution_t * ) pvJob;
+        bool xSucceeded = false;
 
-        xActionType = prvGetAction( pcAction, uActionLength );
+        ( void ) pvContext;
 
-        switch( xActionType )
+        LogInfo( ( "Received job contains \"log_level\" action: %.*s",
+                   ( int ) pxJob->xMessageLength, pxJob->cMessage ) );
+
+        if( LogControl_Apply( pxJob->cMessage, pxJob->xMessageLength ) == false )
+        {
+            LogError( ( "Log levels are malformed: %.*s",
+                        ( int ) pxJob->xMessageLength, pxJob->cMessage ) );
+        }
+        else
         {
-            case JOB_ACTION_EXIT:
-                LogInfo( ( "Received job contains \"exit\" action. Updating state of demo." ) );
-                xExitActionJobReceived = pdTRUE;
-                prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "SUCCEEDED" ) );
-                break;
+            xSucceeded = true;
+        }
 
-            case JOB_ACTION_PRINT:
-                LogInfo( ( "Received job contains \"print\" action." ) );
+        return xSucceeded;
+    }
+#endif /* if CONFIG_LOGGING_RUNTIME_LEVELS */
 
-                xJsonStatus = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                           pxPublishInfo->payloadLength,
-                                           jobsexampleQUERY_KEY_FOR_MESSAGE,
-                                           jobsexampleQUERY_KEY_FOR_MESSAGE_LENGTH,
-                                           &pcMessage,
-                                           &ulMessageLength );
+/*-----------------------------------------------------------*/
 
-                if( xJsonStatus == JSONSuccess )
-                {
-                    /* Print the given message if the action is "print". */
-                    LogInfo( ( "\r\n"
-                               "/*-----------------------------------------------------------*/\r\n"
-                               "\r\n"
-                               "%.*s\r\n"
-                               "\r\n"
-                               "/*-----------------------------------------------------------*/\r\n"
-                               "\r\n", ulMessageLength, pcMessage ) );
-                    prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "SUCCEEDED" ) );
-                }
-                else
-                {
-                    LogError( ( "Job document schema is invalid. Missing \"message\" for \"print\" action type." ) );
-                    prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "FAILED" ) );
-                }
+static void prvRegisterJobActions( void )
+{
+    bool xRegistered;
+
+    JobDispatch_Init( &xJobActions );
+
+    /* "publish" and "exit" need the demo task, and "log_level" is quick. */
+    xRegistered = JobDispatch_Register( &xJobActions, "print", prvPrintAction,
+                                        JobDispatchWorker, jobsexamplePRINT_TIMEOUT_MS, NULL ) &&
+                  JobDispatch_Register( &xJobActions, "publish", prvPublishAction,
+                                        JobDispatchInline, jobsexampleINLINE_TIMEOUT_MS, NULL ) &&
+                  JobDispatch_Register( &xJobActions, "exit", prvExitAction,
+                                        JobDispatchInline, jobsexampleINLINE_TIMEOUT_MS, NULL );
+
+    #if CONFIG_LOGGING_RUNTIME_LEVELS
+        xRegistered = xRegistered &&
+                      JobDispatch_Register( &xJobActions, "log_level", prvLogLevelAction,
+                                            JobDispatchInline, jobsexampleINLINE_TIMEOUT_MS, NULL );
+    #endif
+
+    xRegistered = xRegistered && JobDispatch_Build( &xJobActions );
+    configASSERT( xRegistered == true );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSendUpdateForJob( JobSlot_t * pxSlot )
+{
+    char pUpdateJobTopic[ JOBS_API_MAX_LENGTH( THING_NAME_LENGTH ) ];
+    char cUpdateDocument[ jobsexampleMAX_UPDATE_LENGTH ];
+    char cExpectedVersion[ sizeof( ",\"expectedVersion\":4294967295" ) ];
+    size_t ulTopicLength = 0;
+    int lDocumentLength = 0;
+    JobsStatus_t xStatus = JobsSuccess;
+
+    configASSERT( pxSlot != NULL );
+    configASSERT( pxSlot->pcStatus != NULL );
+
+    /* With an update in flight, the version the next one applies to isn't known yet. */
+    cExpectedVersion[ 0 ] = '\0';
+
+    if( ( pxSlot->uxUpdatesInFlight == 0U ) && ( pxSlot->ulVersion != 0U ) )
+    {
+        ( void ) snprintf( cExpectedVersion, sizeof( cExpectedVersion ),
+                           ",\"expectedVersion\":%lu", ( unsigned long ) pxSlot->ulVersion );
+    }
+
+    /* The response carries the execution state, and with it the version after the update. */
+    lDocumentLength = snprintf( cUpdateDocument, sizeof( cUpdateDocument ),
+                                "{\"status\":\"%s\"%s%.*s%s,\"includeJobExecutionState\":true}",
+                                pxSlot->pcStatus,
+                                ( pxSlot->xStatusDetailsLength > 0U ) ? ",\"statusDetails\":" : "",
+                                ( int ) pxSlot->xStatusDetailsLength, pxSlot->cStatusDetails,
+                                cExpectedVersion );
+    configASSERT( ( lDocumentLength > 0 ) && ( ( size_t ) lDocumentLength < sizeof( cUpdateDocument ) ) );
+
+    /* Generate the PUBLISH topic string for the UpdateJobExecution API of AWS IoT Jobs service. */
+    xStatus = Jobs_Update( pUpdateJobTopic,
+                           sizeof( pUpdateJobTopic ),
+                           democonfigTHING_NAME,
+                           THING_NAME_LENGTH,
+                           pxSlot->cJobId,
+                           pxSlot->usJobIdLength,
+                           &ulTopicLength );
+
+    if( xStatus == JobsSuccess )
+    {
+        if( xPublishToTopic( &xMqttContext,
+                             pUpdateJobTopic,
+                             ulTopicLength,
+                             cUpdateDocument,
+                             ( size_t ) lDocumentLength ) == pdFALSE )
+        {
+            /* Set global flag to terminate demo as PUBLISH operation to update job status failed. */
+            xDemoEncounteredError = pdTRUE;
+
+            LogError( ( "Failed to update the status of job: JobID=%.*s, NewStatePayload=%s",
+                        pxSlot->usJobIdLength, pxSlot->cJobId, cUpdateDocument ) );
+        }
+        else
+        {
+            pxSlot->uxUpdatesInFlight++;
+            pxSlot->xStatusPending = pdFALSE;
+            pxSlot->xRequestTick = xTaskGetTickCount();
+        }
+    }
+    else
+    {
+        /* Set global flag to terminate demo as topic generation for UpdateJobExecution API failed. */
+        xDemoEncounteredError = pdTRUE;
+
+        LogError( ( "Failed to generate Publish topic string for sending job update: "
+                    "JobID=%.*s, NewStatePayload=%s",
+                    pxSlot->usJobIdLength, pxSlot->cJobId, cUpdateDocument ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseVersion( const JsonIndex_t * pxIndex,
+                                   const char * pcQuery,
+                                   size_t xQueryLength,
+                                   uint32_t * pulVersion )
+{
+    BaseType_t xResult = pdFAIL;
+    const char * pcValue = NULL;
+    size_t xValueLength = 0U;
+    JsonIndexType_t xType;
+    char cNumber[ sizeof( "4294967295" ) ];
+
+    configASSERT( ( pxIndex != NULL ) && ( pcQuery != NULL ) && ( pulVersion != NULL ) );
+
+    if( ( JsonIndex_Search( pxIndex, pcQuery, xQueryLength, &pcValue, &xValueLength, &xType ) == JsonIndexSuccess ) &&
+        ( xType == JsonIndexNumber ) &&
+        ( xValueLength < sizeof( cNumber ) ) )
+    {
+        /* The value isn't terminated in the document. */
+        ( void ) memcpy( cNumber, pcValue, xValueLength );
+        cNumber[ xValueLength ] = '\0';
+        *pulVersion = ( uint32_t ) strtoul( cNumber, NULL, 10 );
+        xResult = pdPASS;
+    }
+
+    return xResult;
+}
 
-                break;
+/*-----------------------------------------------------------*/
 
-            case JOB_ACTION_PUBLISH:
-                LogInfo( ( "Received job contains \"publish\" action." ) );
-                char * pcTopic = NULL;
-                size_t ulTopicLength = 0U;
+static BaseType_t prvParseJobDocument( const JsonIndex_t * pxIndex,
+                                       JobExecution_t * pxJob )
+{
+    const char * pcAction = NULL;
+    size_t uActionLength = 0U;
+    const char * pcValue = NULL;
+    size_t ulValueLength = 0U;
+    BaseType_t xStatus = pdPASS;
+
+    configASSERT( ( pxIndex != NULL ) && ( pxJob != NULL ) );
+
+    if( JsonIndex_Search( pxIndex,
+                          jobsexampleQUERY_KEY_FOR_ACTION,
+                          jobsexampleQUERY_KEY_FOR_ACTION_LENGTH,
+                          &pcAction,
+                          &uActionLength,
+                          NULL ) != JsonIndexSuccess )
+    {
+        LogError( ( "Job document schema is invalid. Missing expected \"action\" key in document." ) );
+        xStatus = pdFAIL;
+    }
+    else
+    {
+        pxJob->pxAction = JobDispatch_Find( &xJobActions, pcAction, uActionLength );
 
-                xJsonStatus = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                           pxPublishInfo->payloadLength,
-                                           jobsexampleQUERY_KEY_FOR_TOPIC,
-                                           jobsexampleQUERY_KEY_FOR_TOPIC_LENGTH,
-                                           &pcTopic,
-                                           &ulTopicLength );
+        if( pxJob->pxAction == NULL )
+        {
+            LogError( ( "Received Job document with unknown action %.*s.",
+                        ( int ) uActionLength, pcAction ) );
+            xStatus = pdFAIL;
+        }
+    }
 
-                /* Search for "topic" key in the Jobs document.*/
-                if( xJsonStatus != JSONSuccess )
+    /* Search for the "topic" key in the Jobs document, which "publish" needs. */
+    if( ( xStatus == pdPASS ) &&
+        ( JsonIndex_Search( pxIndex,
+                            jobsexampleQUERY_KEY_FOR_TOPIC,
+                            jobsexampleQUERY_KEY_FOR_TOPIC_LENGTH,
+                            &pcValue,
+                            &ulValueLength,
+                            NULL ) == JsonIndexSuccess ) )
+    {
+        if( ulValueLength > sizeof( pxJob->cTopic ) )
+        {
+            LogError( ( "Job document topic of %u bytes is longer than %u.",
+                        ( unsigned ) ulValueLength, ( unsigned ) sizeof( pxJob->cTopic ) ) );
+            xStatus = pdFAIL;
+        }
+        else
+        {
+            ( void ) memcpy( pxJob->cTopic, pcValue, ulValueLength );
+            pxJob->usTopicLength = ( uint16_t ) ulValueLength;
+        }
+    }
+
+    /* Search for the "message" key in the Jobs document, which "print",
+     * "publish" and "log_level" need. */
+    if( ( xStatus == pdPASS ) &&
+        ( JsonIndex_Search( pxIndex,
+                            jobsexampleQUERY_KEY_FOR_MESSAGE,
+                            jobsexampleQUERY_KEY_FOR_MESSAGE_LENGTH,
+                            &pcValue,
+                            &ulValueLength,
+                            NULL ) == JsonIndexSuccess ) )
+    {
+        if( ulValueLength > sizeof( pxJob->cMessage ) )
+        {
+            LogError( ( "Job document message of %u bytes is longer than %u.",
+                        ( unsigned ) ulValueLength, ( unsigned ) sizeof( pxJob->cMessage ) ) );
+            xStatus = pdFAIL;
+        }
+        else
+        {
+            ( void ) memcpy( pxJob->cMessage, pcValue, ulValueLength );
+            pxJob->xMessageLength = ulValueLength;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static JobSlot_t * prvFindSlot( const char * pcJobId,
+                                size_t xJobIdLength )
+{
+    JobSlot_t * pxSlot = NULL;
+    UBaseType_t uxIndex;
+
+    for( uxIndex = 0; ( uxIndex < jobsexampleMAX_OUTSTANDING_JOBS ) && ( pxSlot == NULL ); uxIndex++ )
+    {
+        if( ( xJobSlots[ uxIndex ].xState != JOB_SLOT_FREE ) &&
+            ( xJobSlots[ uxIndex ].usJobIdLength == xJobIdLength ) &&
+            ( memcmp( xJobSlots[ uxIndex ].cJobId, pcJobId, xJobIdLength ) == 0 ) )
+        {
+            pxSlot = &xJobSlots[ uxIndex ];
+        }
+    }
+
+    return pxSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+static JobSlot_t * prvClaimSlot( const char * pcJobId,
+                                 size_t xJobIdLength )
+{
+    JobSlot_t * pxSlot = NULL;
+    UBaseType_t uxIndex;
+
+    configASSERT( ( xJobIdLength > 0U ) && ( xJobIdLength < JOBS_JOBID_MAX_LENGTH ) );
+
+    /* No more jobs are fetched once an "exit" job is done. */
+    for( uxIndex = 0; ( uxIndex < jobsexampleMAX_OUTSTANDING_JOBS ) && ( pxSlot == NULL ) &&
+         ( xExitActionJobReceived == pdFALSE ); uxIndex++ )
+    {
+        if( xJobSlots[ uxIndex ].xState == JOB_SLOT_FREE )
+        {
+            pxSlot = &xJobSlots[ uxIndex ];
+            ( void ) memcpy( pxSlot->cJobId, pcJobId, xJobIdLength );
+            pxSlot->usJobIdLength = ( uint16_t ) xJobIdLength;
+            pxSlot->xState = JOB_SLOT_DESCRIBING;
+            pxSlot->xRequestTick = xTaskGetTickCount();
+            pxSlot->pcStatus = NULL;
+            pxSlot->xStatusDetailsLength = 0U;
+            pxSlot->xStatusPending = pdFALSE;
+            pxSlot->uxUpdatesInFlight = 0U;
+            pxSlot->ulVersion = 0U;
+            pxSlot->pxAction = NULL;
+            pxSlot->xStarted = pdFALSE;
+        }
+    }
+
+    return pxSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+static UBaseType_t prvCountSlots( JobSlotState_t xState )
+{
+    UBaseType_t uxCount = 0U;
+    UBaseType_t uxIndex;
+
+    for( uxIndex = 0; uxIndex < jobsexampleMAX_OUTSTANDING_JOBS; uxIndex++ )
+    {
+        if( xJobSlots[ uxIndex ].xState == xState )
+        {
+            uxCount++;
+        }
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvExpireRequests( void )
+{
+    TickType_t xNow = xTaskGetTickCount();
+    UBaseType_t uxIndex;
+
+    for( uxIndex = 0; uxIndex < jobsexampleMAX_OUTSTANDING_JOBS; uxIndex++ )
+    {
+        if( ( xJobSlots[ uxIndex ].xState == JOB_SLOT_DESCRIBING ) &&
+            ( ( xNow - xJobSlots[ uxIndex ].xRequestTick ) > jobsexampleREQUEST_TIMEOUT_TICKS ) )
+        {
+            LogWarn( ( "No job document for JobId=%.*s, fetching it again.",
+                       xJobSlots[ uxIndex ].usJobIdLength, xJobSlots[ uxIndex ].cJobId ) );
+            xJobSlots[ uxIndex ].xState = JOB_SLOT_FREE;
+            xRefreshPendingJobs = pdTRUE;
+        }
+        else if( ( xJobSlots[ uxIndex ].xState == JOB_SLOT_ACCEPTED ) &&
+                 ( xJobSlots[ uxIndex ].xStarted == pdTRUE ) &&
+                 ( xJobSlots[ uxIndex ].pxAction->timeoutMs > 0U ) &&
+                 ( ( xNow - xJobSlots[ uxIndex ].xStartTick ) > pdMS_TO_TICKS( xJobSlots[ uxIndex ].pxAction->timeoutMs ) ) )
+        {
+            /* The worker can't be stopped, its result is dropped once it is done. */
+            LogError( ( "JobId=%.*s ran for longer than the %u ms of its action, reporting it as failed.",
+                        xJobSlots[ uxIndex ].usJobIdLength, xJobSlots[ uxIndex ].cJobId,
+                        ( unsigned ) xJobSlots[ uxIndex ].pxAction->timeoutMs ) );
+            prvFinishJob( &xJobSlots[ uxIndex ], "FAILED", "{\"reason\":\"timeout\"}" );
+        }
+        else if( ( xJobSlots[ uxIndex ].uxUpdatesInFlight > 0U ) &&
+                 ( ( xNow - xJobSlots[ uxIndex ].xRequestTick ) > jobsexampleREQUEST_TIMEOUT_TICKS ) )
+        {
+            /* Whether the updates were applied isn't known, and so neither is the version. */
+            xJobSlots[ uxIndex ].uxUpdatesInFlight = 0U;
+            xJobSlots[ uxIndex ].ulVersion = 0U;
+
+            if( xJobSlots[ uxIndex ].xState == JOB_SLOT_REPORTED )
+            {
+                xJobSlots[ uxIndex ].xState = JOB_SLOT_FREE;
+            }
+            else
+            {
+                xJobSlots[ uxIndex ].xStatusPending = pdTRUE;
+            }
+        }
+        else
+        {
+            /* Waiting for a worker or a response. */
+        }
+    }
+
+    if( ( xGetPendingInFlight == pdTRUE ) &&
+        ( ( xNow - xGetPendingTick ) > jobsexampleREQUEST_TIMEOUT_TICKS ) )
+    {
+        LogWarn( ( "No response to the request for pending jobs, requesting them again." ) );
+        xGetPendingInFlight = pdFALSE;
+        xRefreshPendingJobs = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRequestPendingJobs( void )
+{
+    /* Publish to AWS IoT Jobs on the GetPendingJobExecutions API to list the pending jobs.
+     *
+     * Note: It is not required to make MQTT subscriptions to the response topics of the
+     * API because the AWS IoT Jobs service sends responses for the PUBLISH commands on
+     * the same MQTT connection irrespective of whether the client has subscribed to
+     * the response topics or not. */
+    if( xPublishToTopic( &xMqttContext,
+                         GET_PENDING_JOBS_TOPIC( democonfigTHING_NAME ),
+                         sizeof( GET_PENDING_JOBS_TOPIC( democonfigTHING_NAME ) ) - 1,
+                         NULL,
+                         0 ) == pdFALSE )
+    {
+        /* Set global flag to terminate demo as the pending jobs can't be listed. */
+        xDemoEncounteredError = pdTRUE;
+
+        LogError( ( "Failed to publish to GetPendingJobExecutions API of AWS IoT Jobs service: "
+                    "Topic=%s", GET_PENDING_JOBS_TOPIC( democonfigTHING_NAME ) ) );
+    }
+    else
+    {
+        xRefreshPendingJobs = pdFALSE;
+        xGetPendingInFlight = pdTRUE;
+        xGetPendingTick = xTaskGetTickCount();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDescribeJob( JobSlot_t * pxSlot )
+{
+    char pDescribeJobTopic[ JOBS_API_MAX_LENGTH( THING_NAME_LENGTH ) ];
+    size_t ulTopicLength = 0;
+
+    configASSERT( pxSlot != NULL );
+
+    /* Generate the PUBLISH topic string for the DescribeJobExecution API of AWS IoT Jobs service. */
+    if( Jobs_Describe( pDescribeJobTopic,
+                       sizeof( pDescribeJobTopic ),
+                       democonfigTHING_NAME,
+                       THING_NAME_LENGTH,
+                       pxSlot->cJobId,
+                       pxSlot->usJobIdLength,
+                       &ulTopicLength ) != JobsSuccess )
+    {
+        LogError( ( "Failed to generate Publish topic string for describing job: JobID=%.*s",
+                    pxSlot->usJobIdLength, pxSlot->cJobId ) );
+        pxSlot->xState = JOB_SLOT_FREE;
+    }
+    else if( xPublishToTopic( &xMqttContext,
+                              pDescribeJobTopic,
+                              ulTopicLength,
+                              NULL,
+                              0 ) == pdFALSE )
+    {
+        /* Set global flag to terminate demo as PUBLISH operation to fetch a job failed. */
+        xDemoEncounteredError = pdTRUE;
+
+        LogError( ( "Failed to publish to DescribeJobExecution API of AWS IoT Jobs service: JobID=%.*s",
+                    pxSlot->usJobIdLength, pxSlot->cJobId ) );
+        pxSlot->xState = JOB_SLOT_FREE;
+    }
+    else
+    {
+        LogDebug( ( "Requested the job document of JobId=%.*s.",
+                    pxSlot->usJobIdLength, pxSlot->cJobId ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPendingJobsHandler( MQTTPublishInfo_t * pxPublishInfo )
+{
+    static const char * const pcLists[] = { jobsexampleIN_PROGRESS_JOBS_KEY, jobsexampleQUEUED_JOBS_KEY };
+    JsonIndex_t xIndex;
+    size_t xList;
+    size_t xArray = 0U;
+    size_t xToken = 0U;
+    uint32_t ulElement;
+    char cQuery[ 24 ];
+    int lQueryLength;
+    const char * pcJobId = NULL;
+    size_t ulJobIdLength = 0U;
+    JobSlot_t * pxSlot = NULL;
+    BaseType_t xListed = pdTRUE;
+
+    configASSERT( pxPublishInfo != NULL );
+
+    xGetPendingInFlight = pdFALSE;
+    xMoreJobsPending = pdFALSE;
+
+    if( JsonIndex_Build( &xIndex,
+                         pxPublishInfo->pPayload,
+                         pxPublishInfo->payloadLength,
+                         xJobTokens,
+                         jobsexampleMAX_JSON_TOKENS ) != JsonIndexSuccess )
+    {
+        LogError( ( "Received invalid JSON payload from AWS IoT Jobs service" ) );
+    }
+    else
+    {
+        for( xList = 0; xList < ( sizeof( pcLists ) / sizeof( pcLists[ 0 ] ) ); xList++ )
+        {
+            xListed = ( JsonIndex_Find( &xIndex, JSON_INDEX_ROOT, pcLists[ xList ],
+                                        strlen( pcLists[ xList ] ), &xArray ) == JsonIndexSuccess ) ? pdTRUE : pdFALSE;
+
+            for( ulElement = 0; xListed == pdTRUE; ulElement++ )
+            {
+                lQueryLength = snprintf( cQuery, sizeof( cQuery ), "[%u].jobId", ( unsigned ) ulElement );
+
+                if( JsonIndex_Find( &xIndex, xArray, cQuery, ( size_t ) lQueryLength, &xToken ) != JsonIndexSuccess )
                 {
-                    LogError( ( "Job document schema is invalid. Missing \"topic\" key for \"publish\" action type." ) );
-                    prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "FAILED" ) );
+                    xListed = pdFALSE;
                 }
                 else
                 {
-                    xJsonStatus = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                               pxPublishInfo->payloadLength,
-                                               jobsexampleQUERY_KEY_FOR_MESSAGE,
-                                               jobsexampleQUERY_KEY_FOR_MESSAGE_LENGTH,
-                                               &pcMessage,
-                                               &ulMessageLength );
-
-                    /* Search for "message" key in Jobs document.*/
-                    if( xJsonStatus == JSONSuccess )
-                    {
-                        /* Publish to the parsed MQTT topic with the message obtained from
-                         * the Jobs document.*/
-                        if( xPublishToTopic( &xMqttContext,
-                                             pcTopic,
-                                             ulTopicLength,
-                                             pcMessage,
-                                             ulMessageLength ) == pdFALSE )
-                        {
-                            /* Set global flag to terminate demo as PUBLISH operation to execute job failed. */
-                            xDemoEncounteredError = pdTRUE;
+                    JsonIndex_Get( &xIndex, xToken, &pcJobId, &ulJobIdLength, NULL );
 
-                            LogError( ( "Failed to execute job with \"publish\" action: Failed to publish to topic. "
-                                        "JobID=%.*s, Topic=%.*s",
-                                        usJobIdLength, pcJobId, ulTopicLength, pcTopic ) );
-                        }
-
-                        prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "SUCCEEDED" ) );
+                    if( ( ulJobIdLength == 0U ) || ( ulJobIdLength >= JOBS_JOBID_MAX_LENGTH ) )
+                    {
+                        LogWarn( ( "Skipping a pending job with an ID of %u bytes.", ( unsigned ) ulJobIdLength ) );
+                    }
+                    else if( prvFindSlot( pcJobId, ulJobIdLength ) != NULL )
+                    {
+                        /* Already fetched. */
                     }
                     else
                     {
-                        LogError( ( "Job document schema is invalid. Missing \"message\" key for \"publish\" action type." ) );
-                        prvSendUpdateForJob( pcJobId, usJobIdLength, MAKE_STATUS_REPORT( "FAILED" ) );
+                        pxSlot = prvClaimSlot( pcJobId, ulJobIdLength );
+
+                        if( pxSlot == NULL )
+                        {
+                            /* Listed again once a job is done. */
+                            xMoreJobsPending = pdTRUE;
+                        }
+                        else
+                        {
+                            prvDescribeJob( pxSlot );
+                        }
                     }
                 }
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvExecuteJob( UBaseType_t uxWorker,
+                           JobExecution_t * pxJob )
+{
+    bool xSucceeded;
+
+    configASSERT( ( pxJob != NULL ) && ( pxJob->pxAction != NULL ) );
+
+    prvReportProgress( uxWorker, pxJob, "{\"step\":\"started\"}" );
+
+    xSucceeded = pxJob->pxAction->handler( pxJob, pxJob->pxAction->pContext );
+    pxJob->pcStatus = xSucceeded ? "SUCCEEDED" : "FAILED";
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReportProgress( UBaseType_t uxWorker,
+                               const JobExecution_t * pxJob,
+                               const char * pcStatusDetails )
+{
+    JobProgress_t xProgress;
+
+    configASSERT( ( pxJob != NULL ) && ( pcStatusDetails != NULL ) );
+    configASSERT( uxWorker < jobsexampleWORKER_COUNT );
 
-                break;
+    ( void ) memcpy( xProgress.cJobId, pxJob->cJobId, pxJob->usJobIdLength );
+    xProgress.usJobIdLength = pxJob->usJobIdLength;
+    xProgress.xStatusDetailsLength = strlen( pcStatusDetails );
+    configASSERT( xProgress.xStatusDetailsLength <= sizeof( xProgress.cStatusDetails ) );
+    ( void ) memcpy( xProgress.cStatusDetails, pcStatusDetails, xProgress.xStatusDetailsLength );
 
-            default:
-                configPRINTF( ( "Received Job document with unknown action %.*s.",
-                                uActionLength, pcAction ) );
-                break;
+    /* Replaces a report the demo task hasn't taken yet. */
+    ( void ) xQueueOverwrite( xProgressMailboxes[ uxWorker ], &xProgress );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvJobWorkerTask( void * pvParameters )
+{
+    JobExecution_t xJob;
+    UBaseType_t uxWorker = ( UBaseType_t ) ( uintptr_t ) pvParameters;
+
+    for( ; ; )
+    {
+        if( xQueueReceive( xPendingJobs, &xJob, portMAX_DELAY ) == pdTRUE )
+        {
+            prvExecuteJob( uxWorker, &xJob );
+            ( void ) xQueueSend( xCompletedJobs, &xJob, portMAX_DELAY );
         }
     }
 }
 
+/*-----------------------------------------------------------*/
+
+static void prvCompleteJobs( void )
+{
+    static JobExecution_t xJob;
+    JobSlot_t * pxSlot = NULL;
+
+    while( xQueueReceive( xCompletedJobs, &xJob, 0U ) == pdTRUE )
+    {
+        pxSlot = prvFindSlot( xJob.cJobId, xJob.usJobIdLength );
+
+        if( ( pxSlot == NULL ) || ( pxSlot->xState != JOB_SLOT_ACCEPTED ) )
+        {
+            /* Run for the connection before the last reconnect and fetched
+             * again since, or already reported as timed out. */
+            LogDebug( ( "Dropping the result of JobId=%.*s.", xJob.usJobIdLength, xJob.cJobId ) );
+        }
+        else
+        {
+            prvFinishJob( pxSlot, xJob.pcStatus, NULL );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRunJobInline( JobSlot_t * pxSlot,
+                             JobExecution_t * pxJob )
+{
+    TickType_t xStartTick = xTaskGetTickCount();
+    TickType_t xElapsed;
+    bool xSucceeded;
+
+    configASSERT( ( pxSlot != NULL ) && ( pxJob != NULL ) );
+
+    xSucceeded = pxJob->pxAction->handler( pxJob, pxJob->pxAction->pContext );
+    xElapsed = xTaskGetTickCount() - xStartTick;
+
+    /* An inline action holds up the MQTT connection while it runs, and so
+     * belongs on a worker if it takes long. */
+    if( ( pxJob->pxAction->timeoutMs > 0U ) &&
+        ( xElapsed > pdMS_TO_TICKS( pxJob->pxAction->timeoutMs ) ) )
+    {
+        LogWarn( ( "Inline action \"%s\" of JobId=%.*s took %u ms, more than its %u ms.",
+                   pxJob->pxAction->pName, pxJob->usJobIdLength, pxJob->cJobId,
+                   ( unsigned ) ( xElapsed * portTICK_PERIOD_MS ),
+                   ( unsigned ) pxJob->pxAction->timeoutMs ) );
+    }
+
+    prvFinishJob( pxSlot, xSucceeded ? "SUCCEEDED" : "FAILED", NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvFinishJob( JobSlot_t * pxSlot,
+                          const char * pcStatus,
+                          const char * pcStatusDetails )
+{
+    configASSERT( ( pxSlot != NULL ) && ( pcStatus != NULL ) );
+
+    /* The final status is sent without waiting for the updates in flight,
+     * and replaces any progress not sent yet. The slot is kept until the
+     * update is answered, so that a listing or notification sent before
+     * the update doesn't run the job again. */
+    pxSlot->pcStatus = pcStatus;
+    pxSlot->xStatusDetailsLength = 0U;
+
+    if( pcStatusDetails != NULL )
+    {
+        pxSlot->xStatusDetailsLength = strlen( pcStatusDetails );
+        configASSERT( pxSlot->xStatusDetailsLength <= sizeof( pxSlot->cStatusDetails ) );
+        ( void ) memcpy( pxSlot->cStatusDetails, pcStatusDetails, pxSlot->xStatusDetailsLength );
+    }
+
+    prvSendUpdateForJob( pxSlot );
+    pxSlot->xState = JOB_SLOT_REPORTED;
+
+    if( xMoreJobsPending == pdTRUE )
+    {
+        xRefreshPendingJobs = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCollectProgress( void )
+{
+    static JobProgress_t xProgress;
+    JobSlot_t * pxSlot = NULL;
+    UBaseType_t uxWorker;
+
+    for( uxWorker = 0; uxWorker < jobsexampleWORKER_COUNT; uxWorker++ )
+    {
+        if( xQueueReceive( xProgressMailboxes[ uxWorker ], &xProgress, 0U ) == pdTRUE )
+        {
+            pxSlot = prvFindSlot( xProgress.cJobId, xProgress.usJobIdLength );
+
+            /* Progress of a job already reported, or of the previous connection, is dropped. */
+            if( ( pxSlot != NULL ) && ( pxSlot->xState == JOB_SLOT_ACCEPTED ) )
+            {
+                /* Every job reports as it starts, the timeout of its action
+                 * runs from the first report taken. */
+                if( pxSlot->xStarted == pdFALSE )
+                {
+                    pxSlot->xStarted = pdTRUE;
+                    pxSlot->xStartTick = xTaskGetTickCount();
+                }
+
+                ( void ) memcpy( pxSlot->cStatusDetails, xProgress.cStatusDetails, xProgress.xStatusDetailsLength );
+                pxSlot->xStatusDetailsLength = xProgress.xStatusDetailsLength;
+                pxSlot->pcStatus = "IN_PROGRESS";
+                pxSlot->xStatusPending = pdTRUE;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSendProgress( void )
+{
+    UBaseType_t uxIndex;
+
+    for( uxIndex = 0; uxIndex < jobsexampleMAX_OUTSTANDING_JOBS; uxIndex++ )
+    {
+        /* Progress made while an update is in flight waits for its answer,
+         * and is replaced by later progress meanwhile. */
+        if( ( xJobSlots[ uxIndex ].xState == JOB_SLOT_ACCEPTED ) &&
+            ( xJobSlots[ uxIndex ].xStatusPending == pdTRUE ) &&
+            ( xJobSlots[ uxIndex ].uxUpdatesInFlight == 0U ) )
+        {
+            prvSendUpdateForJob( &xJobSlots[ uxIndex ] );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvNextJobHandler( MQTTPublishInfo_t * pxPublishInfo )
 {
+    JsonIndex_t xIndex;
+    JsonIndexStatus_t xIndexStatus;
+    JobSlot_t * pxSlot = NULL;
+
     configASSERT( pxPublishInfo != NULL );
     configASSERT( ( pxPublishInfo->pPayload != NULL ) && ( pxPublishInfo->payloadLength > 0 ) );
 
-    /* Check validity of JSON message response from server.*/
-    if( JSON_Validate( pxPublishInfo->pPayload, pxPublishInfo->payloadLength ) != JSONSuccess )
+    /* Check validity of JSON message response from server, indexing it so
+     * the keys of the job are looked up without scanning it again.*/
+    xIndexStatus = JsonIndex_Build( &xIndex,
+                                    pxPublishInfo->pPayload,
+                                    pxPublishInfo->payloadLength,
+                                    xJobTokens,
+                                    jobsexampleMAX_JSON_TOKENS );
+
+    if( xIndexStatus == JsonIndexOutOfTokens )
+    {
+        LogError( ( "JSON payload from AWS IoT Jobs service has more than %u keys and values.",
+                    ( unsigned ) jobsexampleMAX_JSON_TOKENS ) );
+    }
+    else if( xIndexStatus != JsonIndexSuccess )
     {
         LogError( ( "Received invalid JSON payload from AWS IoT Jobs service" ) );
     }
     else
     {
-        char * pcJobId = NULL;
+        const char * pcJobId = NULL;
         size_t ulJobIdLength = 0U;
+        const char * pcStatus = NULL;
+        size_t ulStatusLength = 0U;
 
         /* Parse the Job ID of the next pending job execution from the JSON payload. */
-        if( JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                         pxPublishInfo->payloadLength,
-                         jobsexampleQUERY_KEY_FOR_JOB_ID,
-                         jobsexampleQUERY_KEY_FOR_JOB_ID_LENGTH,
-                         &pcJobId,
-                         &ulJobIdLength ) != JSONSuccess )
+        if( JsonIndex_Search( &xIndex,
+                              jobsexampleQUERY_KEY_FOR_JOB_ID,
+                              jobsexampleQUERY_KEY_FOR_JOB_ID_LENGTH,
+                              &pcJobId,
+                              &ulJobIdLength,
+                              NULL ) != JsonIndexSuccess )
         {
             LogWarn( ( "Failed to parse Job ID in message received from AWS IoT Jobs service: "
                        "IncomingTopic=%.*s, Payload=%.*s",
@@ -599,8 +1660,187 @@ static void prvNextJobHandler( MQTTPublishInfo_t * pxPublishInfo )
             LogInfo( ( "Received a Job from AWS IoT Jobs service: JobId=%.*s",
                        ulJobIdLength, pcJobId ) );
 
-            /* Process the Job document and execute the job. */
-            prvProcessJobDocument( pxPublishInfo, pcJobId, ( uint16_t ) ulJobIdLength );
+            pxSlot = prvFindSlot( pcJobId, ulJobIdLength );
+
+            if( pxSlot == NULL )
+            {
+                /* A job announced by NextJobExecutionChanged, not requested. */
+                pxSlot = prvClaimSlot( pcJobId, ulJobIdLength );
+            }
+
+            if( pxSlot == NULL )
+            {
+                LogInfo( ( "All %u job slots are in use, the job is fetched once one is done.",
+                           ( unsigned ) jobsexampleMAX_OUTSTANDING_JOBS ) );
+                xMoreJobsPending = pdTRUE;
+            }
+            else if( pxSlot->xState != JOB_SLOT_DESCRIBING )
+            {
+                /* NextJobExecutionChanged names the same job until it is done. */
+            }
+            else if( ( JsonIndex_Search( &xIndex,
+                                         jobsexampleQUERY_KEY_FOR_STATUS,
+                                         jobsexampleQUERY_KEY_FOR_STATUS_LENGTH,
+                                         &pcStatus,
+                                         &ulStatusLength,
+                                         NULL ) == JsonIndexSuccess ) &&
+                     ( ( ulStatusLength != ( sizeof( "QUEUED" ) - 1U ) ) ||
+                       ( strncmp( pcStatus, "QUEUED", ulStatusLength ) != 0 ) ) &&
+                     ( ( ulStatusLength != ( sizeof( "IN_PROGRESS" ) - 1U ) ) ||
+                       ( strncmp( pcStatus, "IN_PROGRESS", ulStatusLength ) != 0 ) ) )
+            {
+                /* Listed before it was done, and described after. */
+                LogDebug( ( "Skipping JobId=%.*s in status %.*s.",
+                            ( int ) ulJobIdLength, pcJobId, ( int ) ulStatusLength, pcStatus ) );
+                pxSlot->xState = JOB_SLOT_FREE;
+            }
+            else
+            {
+                ( void ) memset( &xReceivedJob, 0x00, sizeof( xReceivedJob ) );
+                ( void ) memcpy( xReceivedJob.cJobId, pcJobId, ulJobIdLength );
+                xReceivedJob.usJobIdLength = ( uint16_t ) ulJobIdLength;
+
+                /* The updates of the job name the version they apply to. */
+                if( prvParseVersion( &xIndex,
+                                     jobsexampleQUERY_KEY_FOR_VERSION,
+                                     jobsexampleQUERY_KEY_FOR_VERSION_LENGTH,
+                                     &pxSlot->ulVersion ) == pdFAIL )
+                {
+                    pxSlot->ulVersion = 0U;
+                }
+
+                /* Parse the Job document, then run the job or queue it for a worker. */
+                if( prvParseJobDocument( &xIndex, &xReceivedJob ) == pdFAIL )
+                {
+                    prvFinishJob( pxSlot, "FAILED", NULL );
+                }
+                else if( xReceivedJob.pxAction->mode == JobDispatchInline )
+                {
+                    prvRunJobInline( pxSlot, &xReceivedJob );
+                }
+                else
+                {
+                    pxSlot->xState = JOB_SLOT_ACCEPTED;
+                    pxSlot->pxAction = xReceivedJob.pxAction;
+                    ( void ) xQueueSend( xPendingJobs, &xReceivedJob, 0U );
+                }
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvUpdateResponseHandler( MQTTPublishInfo_t * pxPublishInfo,
+                                      const char * pcJobId,
+                                      uint16_t usJobIdLength,
+                                      BaseType_t xAccepted )
+{
+    JsonIndex_t xIndex;
+    BaseType_t xIndexed = pdFALSE;
+    BaseType_t xVersionMismatch = pdFALSE;
+    JobSlot_t * pxSlot = NULL;
+    const char * pcCode = NULL;
+    size_t ulCodeLength = 0U;
+    uint32_t ulVersion = 0U;
+
+    configASSERT( pxPublishInfo != NULL );
+
+    if( ( pxPublishInfo->payloadLength > 0U ) &&
+        ( JsonIndex_Build( &xIndex,
+                           pxPublishInfo->pPayload,
+                           pxPublishInfo->payloadLength,
+                           xJobTokens,
+                           jobsexampleMAX_JSON_TOKENS ) == JsonIndexSuccess ) )
+    {
+        xIndexed = pdTRUE;
+    }
+
+    if( ( xAccepted == pdFALSE ) &&
+        ( xIndexed == pdTRUE ) &&
+        ( JsonIndex_Search( &xIndex,
+                            jobsexampleQUERY_KEY_FOR_CODE,
+                            jobsexampleQUERY_KEY_FOR_CODE_LENGTH,
+                            &pcCode,
+                            &ulCodeLength,
+                            NULL ) == JsonIndexSuccess ) &&
+        ( ulCodeLength == ( sizeof( jobsexampleVERSION_MISMATCH ) - 1U ) ) &&
+        ( strncmp( pcCode, jobsexampleVERSION_MISMATCH, ulCodeLength ) == 0 ) )
+    {
+        xVersionMismatch = pdTRUE;
+    }
+
+    pxSlot = ( pcJobId != NULL ) ? prvFindSlot( pcJobId, usJobIdLength ) : NULL;
+
+    if( ( xAccepted == pdFALSE ) && ( xVersionMismatch == pdFALSE ) )
+    {
+        /* Set the global flag to terminate the demo, because the request for updating and executing the job status
+         * has been rejected by the AWS IoT Jobs service. */
+        xDemoEncounteredError = pdTRUE;
+
+        LogWarn( ( "Request for job update rejected: RejectedResponse=%.*s.",
+                   pxPublishInfo->payloadLength,
+                   ( const char * ) pxPublishInfo->pPayload ) );
+
+        LogError( ( "Terminating demo as request to update job status has been rejected by "
+                    "AWS IoT Jobs service..." ) );
+    }
+    else if( ( pxSlot == NULL ) || ( pxSlot->uxUpdatesInFlight == 0U ) )
+    {
+        /* The answer to an update that timed out. */
+        LogDebug( ( "Dropping a late update response for JobId=%.*s.", usJobIdLength, pcJobId ) );
+    }
+    else
+    {
+        pxSlot->uxUpdatesInFlight--;
+
+        /* An accepted response has the version after the update, a rejected one
+         * the current version. */
+        if( ( xIndexed == pdTRUE ) &&
+            ( prvParseVersion( &xIndex,
+                               jobsexampleQUERY_KEY_FOR_STATE_VERSION,
+                               jobsexampleQUERY_KEY_FOR_STATE_VERSION_LENGTH,
+                               &ulVersion ) == pdPASS ) )
+        {
+            pxSlot->ulVersion = ulVersion;
+        }
+        else if( ( xAccepted == pdTRUE ) && ( pxSlot->ulVersion != 0U ) )
+        {
+            pxSlot->ulVersion++;
+        }
+        else
+        {
+            pxSlot->ulVersion = 0U;
+        }
+
+        if( xVersionMismatch == pdTRUE )
+        {
+            LogWarn( ( "Status update of JobId=%.*s conflicted with version %lu of the execution, sending it again.",
+                       usJobIdLength, pcJobId, ( unsigned long ) pxSlot->ulVersion ) );
+
+            if( pxSlot->xState != JOB_SLOT_REPORTED )
+            {
+                pxSlot->xStatusPending = pdTRUE;
+            }
+            else if( pxSlot->uxUpdatesInFlight == 0U )
+            {
+                /* The final status names a version only when it is the one update
+                 * in flight, so this is its answer. */
+                prvSendUpdateForJob( pxSlot );
+            }
+            else
+            {
+                /* Progress overtaken by the final status, which is still in flight. */
+            }
+        }
+        else
+        {
+            if( ( pxSlot->xState == JOB_SLOT_REPORTED ) && ( pxSlot->uxUpdatesInFlight == 0U ) )
+            {
+                pxSlot->xState = JOB_SLOT_FREE;
+            }
+
+            LogInfo( ( "Job update status request has been accepted by AWS Iot Jobs service." ) );
         }
     }
 }
@@ -616,16 +1856,12 @@ static void prvEventCallback( MQTTContext_t * pxMqttContext,
                               MQTTPacketInfo_t * pxPacketInfo,
                               MQTTDeserializedInfo_t * pxDeserializedInfo )
 {
-    uint16_t usPacketIdentifier;
-
     ( void ) pxMqttContext;
 
     configASSERT( pxDeserializedInfo != NULL );
     configASSERT( pxMqttContext != NULL );
     configASSERT( pxPacketInfo != NULL );
 
-    usPacketIdentifier = pxDeserializedInfo->packetIdentifier;
-
     /* Handle incoming publish. The lower 4 bits of the publish packet
      * type is used for the dup, QoS, and retain flags. Hence masking
      * out the lower bits to check if the packet is publish. */
@@ -634,6 +1870,9 @@ static void prvEventCallback( MQTTContext_t * pxMqttContext,
         configASSERT( pxDeserializedInfo->pPublishInfo != NULL );
         JobsTopic_t topicType = JobsMaxTopic;
         JobsStatus_t xStatus = JobsError;
+        char * pcJobId = NULL;
+        uint16_t usJobIdLength = 0U;
+        JobSlot_t * pxSlot = NULL;
 
         LogDebug( ( "Received an incoming publish message: TopicName=%.*s",
                     pxDeserializedInfo->pPublishInfo->topicNameLength,
@@ -645,39 +1884,61 @@ static void prvEventCallback( MQTTContext_t * pxMqttContext,
                                    democonfigTHING_NAME,
                                    THING_NAME_LENGTH,
                                    &topicType,
-                                   NULL,
-                                   NULL );
+                                   &pcJobId,
+                                   &usJobIdLength );
 
         if( xStatus == JobsSuccess )
         {
             /* Upon successful return, the messageType has been filled in. */
-            if( ( topicType == JobsStartNextSuccess ) || ( topicType == JobsNextJobChanged ) )
+            if( ( topicType == JobsStartNextSuccess ) || ( topicType == JobsNextJobChanged ) ||
+                ( topicType == JobsDescribeSuccess ) )
             {
+                if( topicType == JobsNextJobChanged )
+                {
+                    /* The jobs queued behind the next one may have changed too. */
+                    xRefreshPendingJobs = pdTRUE;
+                }
+
                 /* Handler function to process payload. */
                 prvNextJobHandler( pxDeserializedInfo->pPublishInfo );
             }
-            else if( topicType == JobsUpdateSuccess )
+            else if( topicType == JobsGetPendingSuccess )
             {
-                LogInfo( ( "Job update status request has been accepted by AWS Iot Jobs service." ) );
+                prvPendingJobsHandler( pxDeserializedInfo->pPublishInfo );
             }
-            else if( topicType == JobsStartNextFailed )
+            else if( topicType == JobsGetPendingFailed )
             {
-                LogWarn( ( "Request for next job description rejected: RejectedResponse=%.*s.",
+                xGetPendingInFlight = pdFALSE;
+
+                LogWarn( ( "Request for pending jobs rejected: RejectedResponse=%.*s.",
                            pxDeserializedInfo->pPublishInfo->payloadLength,
                            ( const char * ) pxDeserializedInfo->pPublishInfo->pPayload ) );
             }
-            else if( topicType == JobsUpdateFailed )
+            else if( topicType == JobsDescribeFailed )
             {
-                /* Set the global flag to terminate the demo, because the request for updating and executing the job status
-                 * has been rejected by the AWS IoT Jobs service. */
-                xDemoEncounteredError = pdTRUE;
+                pxSlot = ( pcJobId != NULL ) ? prvFindSlot( pcJobId, usJobIdLength ) : NULL;
+
+                if( ( pxSlot != NULL ) && ( pxSlot->xState == JOB_SLOT_DESCRIBING ) )
+                {
+                    pxSlot->xState = JOB_SLOT_FREE;
+                }
 
-                LogWarn( ( "Request for job update rejected: RejectedResponse=%.*s.",
+                LogWarn( ( "Request for job document rejected: RejectedResponse=%.*s.",
+                           pxDeserializedInfo->pPublishInfo->payloadLength,
+                           ( const char * ) pxDeserializedInfo->pPublishInfo->pPayload ) );
+            }
+            else if( ( topicType == JobsUpdateSuccess ) || ( topicType == JobsUpdateFailed ) )
+            {
+                prvUpdateResponseHandler( pxDeserializedInfo->pPublishInfo,
+                                          pcJobId,
+                                          usJobIdLength,
+                                          ( topicType == JobsUpdateSuccess ) ? pdTRUE : pdFALSE );
+            }
+            else if( topicType == JobsStartNextFailed )
+            {
+                LogWarn( ( "Request for next job description rejected: RejectedResponse=%.*s.",
                            pxDeserializedInfo->pPublishInfo->payloadLength,
                            ( const char * ) pxDeserializedInfo->pPublishInfo->pPayload ) );
-
-                LogError( ( "Terminating demo as request to update job status has been rejected by "
-                            "AWS IoT Jobs service..." ) );
             }
             else
             {
@@ -687,9 +1948,19 @@ static void prvEventCallback( MQTTContext_t * pxMqttContext,
         }
         else if( xStatus == JobsNoMatch )
         {
-            LogWarn( ( "Incoming message topic does not belong to AWS IoT Jobs!: topic=%.*s",
-                       pxDeserializedInfo->pPublishInfo->topicNameLength,
-                       ( const char * ) pxDeserializedInfo->pPublishInfo->pTopicName ) );
+            BaseType_t xHandled = pdFALSE;
+
+            #if CONFIG_JOBS_DEMO_DEFENDER_METRICS
+                /* Responses to the metrics reports are logged by the collector. */
+                xHandled = DefenderMetrics_HandleResponse( pxDeserializedInfo->pPublishInfo ) ? pdTRUE : pdFALSE;
+            #endif
+
+            if( xHandled == pdFALSE )
+            {
+                LogWarn( ( "Incoming message topic does not belong to AWS IoT Jobs!: topic=%.*s",
+                           pxDeserializedInfo->pPublishInfo->topicNameLength,
+                           ( const char * ) pxDeserializedInfo->pPublishInfo->pTopicName ) );
+            }
         }
         else
         {
@@ -698,10 +1969,6 @@ static void prvEventCallback( MQTTContext_t * pxMqttContext,
                         ( const char * ) pxDeserializedInfo->pPublishInfo->pTopicName ) );
         }
     }
-    else
-    {
-        vHandleOtherIncomingPacket( pxPacketInfo, usPacketIdentifier );
-    }
 }
 
 /*-----------------------------------------------------------*/
@@ -747,10 +2014,32 @@ void prvJobsDemoTask( void * pvParameters )
     BaseType_t xDemoStatus = pdPASS;
     UBaseType_t uxDemoRunCount = 0UL;
     BaseType_t retryDemoLoop = pdFALSE;
+    UBaseType_t uxWorker;
+    MQTTSubAckStatus_t xSubAckCodes[ jobsexampleTOPIC_COUNT ];
 
     /* Remove compiler warnings about unused parameters. */
     ( void ) pvParameters;
 
+    /* The workers read the actions of the jobs they are given. */
+    prvRegisterJobActions();
+
+    /* Create the queues between the demo task and the workers, and the workers. */
+    xPendingJobs = xQueueCreate( jobsexampleMAX_OUTSTANDING_JOBS, sizeof( JobExecution_t ) );
+    xCompletedJobs = xQueueCreate( jobsexampleMAX_OUTSTANDING_JOBS, sizeof( JobExecution_t ) );
+    configASSERT( ( xPendingJobs != NULL ) && ( xCompletedJobs != NULL ) );
+
+    for( uxWorker = 0; uxWorker < jobsexampleWORKER_COUNT; uxWorker++ )
+    {
+        xProgressMailboxes[ uxWorker ] = xQueueCreate( 1, sizeof( JobProgress_t ) );
+        configASSERT( xProgressMailboxes[ uxWorker ] != NULL );
+
+        if( xTaskCreate( prvJobWorkerTask, "JobWorker", jobsexampleWORKER_STACKSIZE,
+                         ( void * ) ( uintptr_t ) uxWorker, tskIDLE_PRIORITY, NULL ) != pdPASS )
+        {
+            LogError( ( "Failed to create job worker task %u.", ( unsigned ) uxWorker ) );
+        }
+    }
+
     /* Set the pParams member of the network context with desired transport. */
     // xNetworkContext.pParams = &xTlsTransportParams;
 
@@ -804,49 +2093,59 @@ void prvJobsDemoTask( void * pvParameters )
                        "/*-----------------------------------------------------------*/\r\n" ) );
 
             /* Subscribe to the NextJobExecutionChanged API topic to receive notifications about the next pending
-             * job in the queue for the Thing resource used by this demo. */
-            if( xSubscribeToTopic( &xMqttContext,
-                                   NEXT_JOB_EXECUTION_CHANGED_TOPIC( democonfigTHING_NAME ),
-                                   sizeof( NEXT_JOB_EXECUTION_CHANGED_TOPIC( democonfigTHING_NAME ) ) - 1 ) != pdPASS )
+             * job in the queue for the Thing resource used by this demo, with the other topics of the demo
+             * in the same SUBSCRIBE. */
+            ( void ) xSubscribeToTopics( &xMqttContext, xDemoTopics, jobsexampleTOPIC_COUNT, xSubAckCodes );
+
+            if( xSubAckCodes[ 0 ] == MQTTSubAckFailure )
             {
                 xDemoStatus = pdFAIL;
                 LogError( ( "Failed to subscribe to NextJobExecutionChanged API of AWS IoT Jobs service: Topic=%s",
                             NEXT_JOB_EXECUTION_CHANGED_TOPIC( democonfigTHING_NAME ) ) );
             }
-        }
 
-        if( xDemoStatus == pdPASS )
-        {
-            /* Publish to AWS IoT Jobs on the StartNextPendingJobExecution API to request the next pending job.
-             *
-             * Note: It is not required to make MQTT subscriptions to the response topics of the
-             * StartNextPendingJobExecution API because the AWS IoT Jobs service sends responses for
-             * the PUBLISH commands on the same MQTT connection irrespective of whether the client has subscribed
-             * to the response topics or not.
-             * This demo processes incoming messages from the response topics of the API in the prvEventCallback()
-             * handler that is supplied to the coreMQTT library. */
-            if( xPublishToTopic( &xMqttContext,
-                                 START_NEXT_JOB_TOPIC( democonfigTHING_NAME ),
-                                 sizeof( START_NEXT_JOB_TOPIC( democonfigTHING_NAME ) ) - 1,
-                                 NULL,
-                                 0 ) != pdPASS )
-            {
-                xDemoStatus = pdFAIL;
-                LogError( ( "Failed to publish to StartNextPendingJobExecution API of AWS IoT Jobs service: "
-                            "Topic=%s", START_NEXT_JOB_TOPIC( democonfigTHING_NAME ) ) );
-            }
+            #if CONFIG_JOBS_DEMO_DEFENDER_METRICS
+                /* The Device Defender rejected topic only logs why a metrics
+                 * report is rejected. A failure only loses the log. */
+                if( xSubAckCodes[ 1 ] == MQTTSubAckFailure )
+                {
+                    LogWarn( ( "Failed to subscribe to the Device Defender rejected topic: Topic=%s",
+                               DEFENDER_API_CBOR_REJECTED( democonfigTHING_NAME ) ) );
+                }
+            #endif
         }
 
-        /* Keep on running the demo until we receive a job for the "exit" action to exit the demo. */
-        while( ( xExitActionJobReceived == pdFALSE ) &&
+        /* Forget the jobs of the previous connection, and list the pending jobs. */
+        ( void ) memset( xJobSlots, 0x00, sizeof( xJobSlots ) );
+        ( void ) xQueueReset( xPendingJobs );
+        xGetPendingInFlight = pdFALSE;
+        xMoreJobsPending = pdFALSE;
+        xRefreshPendingJobs = pdTRUE;
+
+        /* Keep on running the demo until we receive a job for the "exit" action to exit the demo,
+         * and the jobs running with it are done and their final status accepted. */
+        while( ( ( xExitActionJobReceived == pdFALSE ) ||
+                 ( ( prvCountSlots( JOB_SLOT_ACCEPTED ) + prvCountSlots( JOB_SLOT_REPORTED ) ) > 0U ) ) &&
                ( xDemoEncounteredError == pdFALSE ) &&
                ( xDemoStatus == pdPASS ) )
         {
             MQTTStatus_t xMqttStatus = MQTTSuccess;
 
+            prvExpireRequests();
+
+            /* List the pending jobs again when there is room to fetch more. */
+            if( ( xRefreshPendingJobs == pdTRUE ) &&
+                ( xGetPendingInFlight == pdFALSE ) &&
+                ( xExitActionJobReceived == pdFALSE ) &&
+                ( prvCountSlots( JOB_SLOT_FREE ) > 0U ) )
+            {
+                prvRequestPendingJobs();
+            }
+
             /* Check if we have notification for the next pending job in the queue from the
-             * NextJobExecutionChanged API of the AWS IoT Jobs service. */
-            xMqttStatus = MQTT_ProcessLoop( &xMqttContext, mqttexamplePROCESS_LOOP_TIMEOUT_MS );
+             * NextJobExecutionChanged API of the AWS IoT Jobs service, and responses to the
+             * requests for pending jobs and job documents. */
+            xMqttStatus = MQTT_ProcessLoop( &xMqttContext, jobsexamplePROCESS_LOOP_TIMEOUT_MS );
 
             if( xMqttStatus != MQTTSuccess )
             {
@@ -854,6 +2153,19 @@ void prvJobsDemoTask( void * pvParameters )
                 LogError( ( "Failed to receive notification about next pending job: "
                             "MQTT_ProcessLoop failed" ) );
             }
+            else
+            {
+                /* Progress is taken before the jobs done, whose final status replaces it. */
+                prvCollectProgress();
+                prvCompleteJobs();
+                prvSendProgress();
+
+                #if CONFIG_JOBS_DEMO_DEFENDER_METRICS
+                    /* Only reads the tick count until a report is due. */
+                    ( void ) DefenderMetrics_PublishIfDue( &xMqttContext, &xNetworkContext,
+                                                           democonfigTHING_NAME, THING_NAME_LENGTH );
+                #endif
+            }
         }
 
         /* Increment the demo run count. */
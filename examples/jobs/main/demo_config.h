@@ -151,4 +151,14 @@
  */
 #define democonfigNETWORK_BUFFER_SIZE    CONFIG_MQTT_NETWORK_BUFFER_SIZE
 
+/**
+ * @brief Number of tasks running jobs.
+ */
+#define democonfigJOBS_WORKER_COUNT      CONFIG_JOBS_DEMO_WORKERS
+
+/**
+ * @brief Number of jobs fetched ahead of the workers.
+ */
+#define democonfigJOBS_PREFETCH_DEPTH    CONFIG_JOBS_DEMO_PREFETCH_DEPTH
+
 #endif /* DEMO_CONFIG_H */
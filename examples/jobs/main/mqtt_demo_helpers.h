@@ -46,9 +46,10 @@
  * @param[out] pxNetworkContext The memory for the NetworkContext_t required for the
  * MQTT connection.
  * @param[in] pxNetworkBuffer The buffer space for initializing the @p pxMqttContext MQTT
- * context used in the MQTT connection.
+ * context used in the MQTT connection. With the buffer arena, a NULL buffer
+ * is borrowed from the arena until the session is disconnected.
  * @param[in] eventCallback The callback function used to receive incoming
- * publishes and incoming acks from MQTT library.
+ * publishes. The acks are handled by the MQTT session.
  *
  * @return The status of the final connection attempt.
  */
@@ -57,15 +58,6 @@ BaseType_t xEstablishMqttSession( MQTTContext_t * pxMqttContext,
                                   MQTTFixedBuffer_t * pxNetworkBuffer,
                                   MQTTEventCallback_t eventCallback );
 
-/**
- * @brief Handle the incoming packet if it's not related to the device shadow.
- *
- * @param[in] pxPacketInfo Packet Info pointer for the incoming packet.
- * @param[in] usPacketIdentifier Packet identifier of the incoming packet.
- */
-void vHandleOtherIncomingPacket( MQTTPacketInfo_t * pxPacketInfo,
-                                 uint16_t usPacketIdentifier );
-
 /**
  * @brief Close the MQTT connection.
  *
@@ -94,6 +86,23 @@ BaseType_t xSubscribeToTopic( MQTTContext_t * pxMqttContext,
                               const char * pcTopicFilter,
                               uint16_t usTopicFilterLength );
 
+/**
+ * @brief Subscribe to several MQTT topic filters with a single SUBSCRIBE.
+ *
+ * @param[in] pxMqttContext The MQTT context for the MQTT connection.
+ * @param[in] pxSubscriptionList The topic filters and their QoS.
+ * @param[in] xSubscriptionCount Number of entries in pxSubscriptionList.
+ * @param[out] pxSubAckCodes The SUBACK return code of each topic filter, or
+ * NULL.
+ *
+ * @return pdPASS if every topic filter was granted;
+ * pdFAIL otherwise.
+ */
+BaseType_t xSubscribeToTopics( MQTTContext_t * pxMqttContext,
+                               const MQTTSubscribeInfo_t * pxSubscriptionList,
+                               size_t xSubscriptionCount,
+                               MQTTSubAckStatus_t * pxSubAckCodes );
+
 /**
  * @brief Sends an MQTT UNSUBSCRIBE to unsubscribe from the shadow
  * topic.
@@ -109,6 +118,21 @@ BaseType_t xUnsubscribeFromTopic( MQTTContext_t * pxMqttContext,
                                   const char * pcTopicFilter,
                                   uint16_t usTopicFilterLength );
 
+/**
+ * @brief Unsubscribe from several MQTT topic filters with a single
+ * UNSUBSCRIBE.
+ *
+ * @param[in] pxMqttContext The MQTT context for the MQTT connection.
+ * @param[in] pxSubscriptionList The topic filters.
+ * @param[in] xSubscriptionCount Number of entries in pxSubscriptionList.
+ *
+ * @return pdPASS if UNSUBSCRIBE was successfully sent;
+ * pdFAIL otherwise.
+ */
+BaseType_t xUnsubscribeFromTopics( MQTTContext_t * pxMqttContext,
+                                   const MQTTSubscribeInfo_t * pxSubscriptionList,
+                                   size_t xSubscriptionCount );
+
 /**
  * @brief Publish a message to a MQTT topic.
  *
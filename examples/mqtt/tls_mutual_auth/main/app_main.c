@@ -18,10 +18,27 @@
 
 #include "esp_log.h"
 
+#include "boot_profile.h"
+#include "boot_step.h"
+
+#if CONFIG_WIFI_FAST_CONNECT_ENABLE && CONFIG_EXAMPLE_CONNECT_WIFI
+    #include "network_transport.h"
+    #include "wifi_fast_connect.h"
+    #define USE_WIFI_FAST_CONNECT 1
+#endif
+
 int aws_iot_demo_main( int argc, char ** argv );
+bool aws_iot_demo_preload_credentials( void * pContext );
 
 static const char *TAG = "MQTT_EXAMPLE";
 
+#if USE_WIFI_FAST_CONNECT
+static void networkReady(void)
+{
+    BootProfile_EndPhase(BootPhaseNetwork);
+}
+#endif
+
 /*
  * Prototypes for the demos that can be started from this project.  Note the
  * MQTT demo is not actually started until the network is already.
@@ -29,13 +46,23 @@ static const char *TAG = "MQTT_EXAMPLE";
 
 void app_main()
 {
+    /* Parsing the credentials needs neither the network nor NVS, so it runs
+     * while they come up. */
+    static BootStep_t credentialsStep = BOOT_STEP( "credentials", aws_iot_demo_preload_credentials,
+                                                   NULL, BootPhaseCredentials );
+
+    BootProfile_Start();
+
     ESP_LOGI(TAG, "[APP] Startup..");
     ESP_LOGI(TAG, "[APP] Free memory: %d bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
 
     esp_log_level_set("*", ESP_LOG_INFO);
-    
+
+    BootStep_Start(&credentialsStep);
+
     /* Initialize NVS partition */
+    BootProfile_BeginPhase(BootPhaseNvs);
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         /* NVS partition was truncated
@@ -45,15 +72,29 @@ void app_main()
         /* Retry nvs_flash_init */
         ESP_ERROR_CHECK(nvs_flash_init());
     }
-    
+    BootProfile_EndPhase(BootPhaseNvs);
+
+    BootProfile_BeginPhase(BootPhaseNetif);
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+    BootProfile_EndPhase(BootPhaseNetif);
 
     /* This helper function configures Wi-Fi or Ethernet, as selected in menuconfig.
      * Read "Establishing Wi-Fi or Ethernet Connection" section in
      * examples/protocols/README.md for more information about this function.
      */
+    BootProfile_BeginPhase(BootPhaseNetwork);
+#if USE_WIFI_FAST_CONNECT
+    /* Wi-Fi comes up in the background, and the first TLS connect waits
+     * for the address, so its handshake starts as soon as there is one. */
+    ESP_ERROR_CHECK(WifiFastConnect_Start(CONFIG_EXAMPLE_WIFI_SSID, CONFIG_EXAMPLE_WIFI_PASSWORD, networkReady));
+    vTlsTransportSetNetworkWait(WifiFastConnect_WaitReady);
+#else
     ESP_ERROR_CHECK(example_connect());
+    BootProfile_EndPhase(BootPhaseNetwork);
+#endif
+
+    BootStep_Wait(&credentialsStep);
 
     aws_iot_demo_main(0,NULL);
 }
@@ -60,6 +60,15 @@
     #define AWS_IOT_ENDPOINT    CONFIG_MQTT_BROKER_ENDPOINT
 #endif
 
+/**
+ * @brief Further endpoints of the MQTT broker, separated by commas, such as
+ * the ATS endpoint of another region or a custom domain. A failed connect
+ * fails over to the healthiest of them before backing off.
+ */
+#ifndef AWS_IOT_FALLBACK_ENDPOINTS
+    #define AWS_IOT_FALLBACK_ENDPOINTS    CONFIG_MQTT_BROKER_FALLBACK_ENDPOINTS
+#endif
+
 /**
  * @brief AWS IoT MQTT broker port number.
  *
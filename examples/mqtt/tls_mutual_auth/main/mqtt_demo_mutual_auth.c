@@ -72,9 +72,20 @@
 /*Include backoff algorithm header for retry logic.*/
 #include "backoff_algorithm.h"
 
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
+#include "endpoint_set.h"
+#include "esp_random.h"
+
 /* Clock for timer. */
 #include "clock.h"
 
+/* Shared buffer arena. */
+#include "buffer_arena.h"
+
+/* Boot phase profile. */
+#include "boot_profile.h"
+
 /**
  * These configuration settings are required to run the mutual auth demo.
  * Throw compilation error if the below configs are not defined.
@@ -83,10 +94,24 @@
 #ifndef ROOT_CA_PEM
     #if CONFIG_BROKER_CERTIFICATE_OVERRIDDEN == 1
     static const char root_cert_auth_pem_start[]  = "-----BEGIN CERTIFICATE-----\n" CONFIG_BROKER_CERTIFICATE_OVERRIDE "\n-----END CERTIFICATE-----";
+    #elif CONFIG_EXAMPLE_EMBED_CREDENTIALS_DER
+    extern const char root_cert_auth_pem_start[]   asm("_binary_root_cert_auth_pem_der_start");
     #else
     extern const char root_cert_auth_pem_start[]   asm("_binary_root_cert_auth_pem_start");
     #endif
+    #if CONFIG_EXAMPLE_EMBED_CREDENTIALS_DER
+    extern const char root_cert_auth_pem_end[]   asm("_binary_root_cert_auth_pem_der_end");
+    #else
     extern const char root_cert_auth_pem_end[]   asm("_binary_root_cert_auth_pem_end");
+    #endif
+#endif
+
+/* The transport takes DER credentials with their length, and PEM credentials
+ * with a length of zero. */
+#if CONFIG_EXAMPLE_EMBED_CREDENTIALS_DER && ( CONFIG_BROKER_CERTIFICATE_OVERRIDDEN != 1 )
+    #define ROOT_CA_DER_LENGTH    ( ( size_t ) ( root_cert_auth_pem_end - root_cert_auth_pem_start ) )
+#else
+    #define ROOT_CA_DER_LENGTH    0U
 #endif
 
 #ifndef CLIENT_IDENTIFIER
@@ -104,13 +129,24 @@
  *!!! store keys securely, such as within a secure element.
  */
 
-    #ifndef CLIENT_CERTIFICATE_PEM
-        extern const char client_cert_pem_start[] asm("_binary_client_crt_start");
-        extern const char client_cert_pem_end[] asm("_binary_client_crt_end");
-    #endif
-    #ifndef CLIENT_PRIVATE_KEY_PEM
-        extern const char client_key_pem_start[] asm("_binary_client_key_start");
-        extern const char client_key_pem_end[] asm("_binary_client_key_end");
+    #if CONFIG_EXAMPLE_EMBED_CREDENTIALS_DER
+        extern const char client_cert_pem_start[] asm("_binary_client_crt_der_start");
+        extern const char client_cert_pem_end[] asm("_binary_client_crt_der_end");
+        extern const char client_key_pem_start[] asm("_binary_client_key_der_start");
+        extern const char client_key_pem_end[] asm("_binary_client_key_der_end");
+        #define CLIENT_CERT_DER_LENGTH    ( ( size_t ) ( client_cert_pem_end - client_cert_pem_start ) )
+        #define CLIENT_KEY_DER_LENGTH     ( ( size_t ) ( client_key_pem_end - client_key_pem_start ) )
+    #else
+        #ifndef CLIENT_CERTIFICATE_PEM
+            extern const char client_cert_pem_start[] asm("_binary_client_crt_start");
+            extern const char client_cert_pem_end[] asm("_binary_client_crt_end");
+        #endif
+        #ifndef CLIENT_PRIVATE_KEY_PEM
+            extern const char client_key_pem_start[] asm("_binary_client_key_start");
+            extern const char client_key_pem_end[] asm("_binary_client_key_end");
+        #endif
+        #define CLIENT_CERT_DER_LENGTH    0U
+        #define CLIENT_KEY_DER_LENGTH     0U
     #endif
 #else
 
@@ -127,11 +163,6 @@
     #endif
 #endif /* ifndef CLIENT_USERNAME */
 
-/**
- * @brief Length of MQTT server host name.
- */
-#define AWS_IOT_ENDPOINT_LENGTH         ( ( uint16_t ) ( sizeof( AWS_IOT_ENDPOINT ) - 1 ) )
-
 /**
  * @brief Length of client identifier.
  */
@@ -325,10 +356,14 @@ static PublishPackets_t outgoingPublishPackets[ MAX_OUTGOING_PUBLISHES ] = { 0 }
  */
 static MQTTSubscribeInfo_t pGlobalSubscriptionList[ 1 ];
 
+#if !BUFFER_ARENA_ENABLED
+
 /**
  * @brief The network buffer must remain valid for the lifetime of the MQTT context.
+ * With the buffer arena, it is borrowed while connected instead.
  */
-static uint8_t buffer[ NETWORK_BUFFER_SIZE ];
+    static uint8_t buffer[ NETWORK_BUFFER_SIZE ];
+#endif
 
 /**
  * @brief Status of latest Subscribe ACK;
@@ -342,10 +377,43 @@ static MQTTSubAckStatus_t globalSubAckStatus = MQTTSubAckFailure;
  */
 static StaticSemaphore_t xTlsContextSemaphoreBuffer;
 
+/**
+ * @brief The broker endpoints, parsed into #endpointSet on the first connect.
+ */
+static char endpointList[] = AWS_IOT_ENDPOINT "," AWS_IOT_FALLBACK_ENDPOINTS;
+
+/**
+ * @brief Health of the broker endpoints, kept across reconnects.
+ */
+static EndpointSet_t endpointSet;
+
+/**
+ * @brief Index in #endpointSet of the endpoint connected to.
+ */
+static size_t currentEndpoint = 0U;
+
 /*-----------------------------------------------------------*/
 
 int aws_iot_demo_main( int argc, char ** argv );
 
+/**
+ * @brief Parse the credentials into the transport credential cache, so the
+ * first connect doesn't have to. Run as a boot step while the network comes
+ * up.
+ *
+ * @param[in] pContext Unused.
+ *
+ * @return true.
+ */
+bool aws_iot_demo_preload_credentials( void * pContext );
+
+/**
+ * @brief Set the credentials of the TLS session in a network context.
+ *
+ * @param[out] pNetworkContext The network context.
+ */
+static void setCredentials( NetworkContext_t * pNetworkContext );
+
 /**
  * @brief The random number generator to use for exponential backoff with
  * jitter retry logic.
@@ -357,9 +425,11 @@ static uint32_t generateRandomNumber();
 /**
  * @brief Connect to MQTT broker with reconnection retries.
  *
- * If connection fails, retry is attempted after a timeout.
- * Timeout value will exponentially increase until maximum
- * timeout value is reached or the number of attempts are exhausted.
+ * Each attempt goes to the healthiest endpoint of #endpointSet, so a failed
+ * attempt fails over to the next endpoint at once. Once every endpoint has
+ * failed, retry is attempted after a timeout. Timeout value will
+ * exponentially increase until maximum timeout value is reached or the
+ * number of attempts are exhausted.
  *
  * @param[out] pNetworkContext The output parameter to return the created network context.
  *
@@ -442,6 +512,28 @@ static int establishMqttSession( MQTTContext_t * pMqttContext,
  */
 static int disconnectMqttSession( MQTTContext_t * pMqttContext );
 
+#if BUFFER_ARENA_ENABLED
+
+/**
+ * @brief Borrows the network buffer of the MQTT context from the buffer
+ * arena, unless it holds one already.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ *
+ * @return EXIT_SUCCESS if the context has a network buffer; EXIT_FAILURE if
+ * no slot of the arena is free.
+ */
+    static int borrowNetworkBuffer( MQTTContext_t * pMqttContext );
+
+/**
+ * @brief Returns the network buffer of the MQTT context to the buffer arena,
+ * for other components to use while the demo is disconnected.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ */
+    static void returnNetworkBuffer( MQTTContext_t * pMqttContext );
+#endif
+
 /**
  * @brief Sends an MQTT SUBSCRIBE to subscribe to #MQTT_EXAMPLE_TOPIC
  * defined at the top of the file.
@@ -539,27 +631,15 @@ static int handleResubscribe( MQTTContext_t * pMqttContext );
 
 static uint32_t generateRandomNumber()
 {
-    return( rand() );
+    return( esp_random() );
 }
 
 /*-----------------------------------------------------------*/
-static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext )
-{
-    int returnStatus = EXIT_SUCCESS;
-    BackoffAlgorithmStatus_t backoffAlgStatus = BackoffAlgorithmSuccess;
-    TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
-    BackoffAlgorithmContext_t reconnectParams;
-
-    pNetworkContext->pcHostname = AWS_IOT_ENDPOINT;
-    pNetworkContext->xPort = AWS_MQTT_PORT;
-    pNetworkContext->pxTls = NULL;
-    pNetworkContext->xTlsContextSemaphore = xSemaphoreCreateMutexStatic(&xTlsContextSemaphoreBuffer);
 
-    pNetworkContext->disableSni = 0;
-    uint16_t nextRetryBackOff;
-
-    /* Initialize credentials for establishing TLS session. */
+static void setCredentials( NetworkContext_t * pNetworkContext )
+{
     pNetworkContext->pcServerRootCAPem = root_cert_auth_pem_start;
+    pNetworkContext->uxServerRootCALength = ROOT_CA_DER_LENGTH;
 
     /* If #CLIENT_USERNAME is defined, username/password is used for authenticating
      * the client. */
@@ -569,6 +649,7 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
     pNetworkContext->use_secure_element = true;
 #elif CONFIG_EXAMPLE_USE_DS_PERIPHERAL
     pNetworkContext->pcClientCertPem = client_cert_pem_start;
+    pNetworkContext->uxClientCertLength = CLIENT_CERT_DER_LENGTH;
     pNetworkContext->pcClientKeyPem = NULL;
 #error "Populate the ds_data structure and remove this line"
     /* pNetworkContext->ds_data = DS_DATA; */
@@ -577,8 +658,54 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
     #ifndef CLIENT_USERNAME
         pNetworkContext->pcClientCertPem = client_cert_pem_start;
         pNetworkContext->pcClientKeyPem = client_key_pem_start;
+        pNetworkContext->uxClientCertLength = CLIENT_CERT_DER_LENGTH;
+        pNetworkContext->uxClientKeyLength = CLIENT_KEY_DER_LENGTH;
     #endif
 #endif
+}
+
+/*-----------------------------------------------------------*/
+
+bool aws_iot_demo_preload_credentials( void * pContext )
+{
+    NetworkContext_t xNetworkContext = { 0 };
+
+    ( void ) pContext;
+
+    setCredentials( &xNetworkContext );
+    vTlsCredentialPreload( &xNetworkContext );
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext )
+{
+    int returnStatus = EXIT_SUCCESS;
+    bool retry = true;
+    bool attempted = false, allAvoided = false;
+    TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
+    ReconnectFailure_t lastFailure = ReconnectFailureNetwork;
+    ReconnectPolicy_t reconnectPolicy;
+    const char * pHostName = NULL;
+    uint32_t attemptStartMs = 0U;
+
+    if( endpointSet.count == 0U )
+    {
+        ( void ) EndpointSet_Init( &endpointSet, endpointList );
+    }
+
+    pNetworkContext->pcHostname = EndpointSet_HostName( &endpointSet, currentEndpoint );
+    pNetworkContext->xPort = AWS_MQTT_PORT;
+    pNetworkContext->pxTls = NULL;
+    pNetworkContext->xTlsContextSemaphore = xSemaphoreCreateMutexStatic(&xTlsContextSemaphoreBuffer);
+
+    pNetworkContext->disableSni = 0;
+    uint32_t nextRetryBackOff = 0U;
+
+    /* Initialize credentials for establishing TLS session. */
+    setCredentials( pNetworkContext );
     /* AWS IoT requires devices to send the Server Name Indication (SNI)
      * extension to the Transport Layer Security (TLS) protocol and provide
      * the complete endpoint address in the host_name field. Details about
@@ -612,45 +739,76 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
     }
 
     /* Initialize reconnect attempts and interval */
-    BackoffAlgorithm_InitializeParams( &reconnectParams,
-                                       CONNECTION_RETRY_BACKOFF_BASE_MS,
-                                       CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
-                                       CONNECTION_RETRY_MAX_ATTEMPTS );
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           CONNECTION_RETRY_BACKOFF_BASE_MS,
+                           CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                           CONNECTION_RETRY_MAX_ATTEMPTS );
 
-    /* Attempt to connect to MQTT broker. If connection fails, retry after
+    /* Attempt to connect to MQTT broker. If connection fails, fail over to
+     * the next healthy endpoint; once every endpoint has failed, retry after
      * a timeout. Timeout value will exponentially increase until maximum
      * attempts are reached.
      */
     do
     {
-        /* Establish a TLS session with the MQTT broker. This example connects
-         * to the MQTT broker as specified in AWS_IOT_ENDPOINT and AWS_MQTT_PORT
-         * at the demo config header. */
-        LogInfo( ( "Establishing a TLS session to %.*s:%d.",
-                   AWS_IOT_ENDPOINT_LENGTH,
-                   AWS_IOT_ENDPOINT,
-                   AWS_MQTT_PORT ) );
-        tlsStatus = xTlsConnect ( pNetworkContext );
-
-        if( tlsStatus != TLS_TRANSPORT_SUCCESS )
+        currentEndpoint = EndpointSet_Select( &endpointSet, &allAvoided );
+
+        if( ( allAvoided == true ) && ( attempted == true ) )
         {
-            /* Generate a random number and get back-off value (in milliseconds) for the next connection retry. */
-            backoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &reconnectParams, generateRandomNumber(), &nextRetryBackOff );
+            /* Get the back-off value (in milliseconds) for the next connection retry. A
+             * refused handshake waits longer. */
+            retry = ReconnectPolicy_NextDelay( &reconnectPolicy, lastFailure, &nextRetryBackOff );
 
-            if( backoffAlgStatus == BackoffAlgorithmRetriesExhausted )
+            if( retry == false )
             {
                 LogError( ( "Connection to the broker failed, all attempts exhausted." ) );
                 returnStatus = EXIT_FAILURE;
             }
-            else if( backoffAlgStatus == BackoffAlgorithmSuccess )
+            else
             {
-                LogWarn( ( "Connection to the broker failed. Retrying connection "
-                           "after %hu ms backoff.",
-                           ( unsigned short ) nextRetryBackOff ) );
+                LogWarn( ( "Connection to every broker endpoint failed. Retrying connection "
+                           "after %u ms backoff.",
+                           ( unsigned ) nextRetryBackOff ) );
                 Clock_SleepMs( nextRetryBackOff );
             }
         }
-    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( backoffAlgStatus == BackoffAlgorithmSuccess ) );
+
+        if( retry == true )
+        {
+            pHostName = EndpointSet_HostName( &endpointSet, currentEndpoint );
+
+            /* A TLS session is only resumed by the server that issued it. */
+            if( strcmp( pHostName, pNetworkContext->pcHostname ) != 0 )
+            {
+                vTlsSessionClear( pNetworkContext );
+                pNetworkContext->pcHostname = pHostName;
+            }
+
+            /* Establish a TLS session with the MQTT broker. This example connects
+             * to the MQTT broker endpoints listed in AWS_IOT_ENDPOINT and
+             * AWS_IOT_FALLBACK_ENDPOINTS, on AWS_MQTT_PORT, at the demo config
+             * header. */
+            LogInfo( ( "Establishing a TLS session to %s:%d.",
+                       pHostName,
+                       AWS_MQTT_PORT ) );
+            BootProfile_BeginPhase( BootPhaseTls );
+            attemptStartMs = Clock_GetTimeMs();
+            tlsStatus = xTlsConnect ( pNetworkContext );
+            attempted = true;
+
+            if( tlsStatus != TLS_TRANSPORT_SUCCESS )
+            {
+                lastFailure = ( tlsStatus == TLS_TRANSPORT_HANDSHAKE_FAILED ) ?
+                              ReconnectFailureRefused : ReconnectFailureNetwork;
+                EndpointSet_ReportFailure( &endpointSet, currentEndpoint );
+            }
+            else
+            {
+                EndpointSet_ReportSuccess( &endpointSet, currentEndpoint, Clock_GetTimeMs() - attemptStartMs );
+                BootProfile_EndPhase( BootPhaseTls );
+            }
+        }
+    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( retry == true ) );
 
     return returnStatus;
 }
@@ -1083,6 +1241,7 @@ static int establishMqttSession( MQTTContext_t * pMqttContext,
     #endif /* ifdef CLIENT_USERNAME */
 
     /* Send MQTT CONNECT packet to broker. */
+    BootProfile_BeginPhase( BootPhaseMqtt );
     mqttStatus = MQTT_Connect( pMqttContext, &connectInfo, NULL, CONNACK_RECV_TIMEOUT_MS, pSessionPresent );
 
     if( mqttStatus != MQTTSuccess )
@@ -1094,6 +1253,8 @@ static int establishMqttSession( MQTTContext_t * pMqttContext,
     else
     {
         LogInfo( ( "MQTT connection successfully established with broker.\n\n" ) );
+        BootProfile_EndPhase( BootPhaseMqtt );
+        BootProfile_Finish();
     }
 
     return returnStatus;
@@ -1283,7 +1444,11 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
     transport.recv = espTlsTransportRecv;
 
     /* Fill the values for network buffer. */
-    networkBuffer.pBuffer = buffer;
+    #if BUFFER_ARENA_ENABLED
+        networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, NETWORK_BUFFER_SIZE );
+    #else
+        networkBuffer.pBuffer = buffer;
+    #endif
     networkBuffer.size = NETWORK_BUFFER_SIZE;
 
     /* Initialize MQTT library. */
@@ -1293,7 +1458,12 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
                             eventCallback,
                             &networkBuffer );
 
-    if( mqttStatus != MQTTSuccess )
+    if( networkBuffer.pBuffer == NULL )
+    {
+        returnStatus = EXIT_FAILURE;
+        LogError( ( "No network buffer available for the MQTT context." ) );
+    }
+    else if( mqttStatus != MQTTSuccess )
     {
         returnStatus = EXIT_FAILURE;
         LogError( ( "MQTT init failed: Status = %s.", MQTT_Status_strerror( mqttStatus ) ) );
@@ -1304,6 +1474,38 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
+#if BUFFER_ARENA_ENABLED
+
+    static int borrowNetworkBuffer( MQTTContext_t * pMqttContext )
+    {
+        int returnStatus = EXIT_SUCCESS;
+
+        if( pMqttContext->networkBuffer.pBuffer == NULL )
+        {
+            pMqttContext->networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, NETWORK_BUFFER_SIZE );
+        }
+
+        if( pMqttContext->networkBuffer.pBuffer == NULL )
+        {
+            returnStatus = EXIT_FAILURE;
+            LogError( ( "No network buffer available for the MQTT context." ) );
+        }
+
+        return returnStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void returnNetworkBuffer( MQTTContext_t * pMqttContext )
+    {
+        ( void ) BufferArena_Free( BufferArenaOwnerMqtt, pMqttContext->networkBuffer.pBuffer );
+        pMqttContext->networkBuffer.pBuffer = NULL;
+    }
+
+#endif /* if BUFFER_ARENA_ENABLED */
+
+/*-----------------------------------------------------------*/
+
 static int subscribePublishLoop( MQTTContext_t * pMqttContext,
                                  bool * pClientSessionPresent )
 {
@@ -1322,14 +1524,19 @@ static int subscribePublishLoop( MQTTContext_t * pMqttContext,
     createCleanSession = ( *pClientSessionPresent == true ) ? false : true;
 
     /* Establish MQTT session on top of TCP+TLS connection. */
-    LogInfo( ( "Creating an MQTT connection to %.*s.",
-               AWS_IOT_ENDPOINT_LENGTH,
-               AWS_IOT_ENDPOINT ) );
+    LogInfo( ( "Creating an MQTT connection to %s.",
+               EndpointSet_HostName( &endpointSet, currentEndpoint ) ) );
 
     /* Sends an MQTT Connect packet using the established TLS session,
      * then waits for connection acknowledgment (CONNACK) packet. */
     returnStatus = establishMqttSession( pMqttContext, createCleanSession, &brokerSessionPresent );
 
+    if( returnStatus == EXIT_FAILURE )
+    {
+        /* A broker that accepts the TLS session but not the CONNECT counts
+         * against its endpoint, so the next connect goes to another. */
+        EndpointSet_ReportFailure( &endpointSet, currentEndpoint );
+    }
 
     if( returnStatus == EXIT_SUCCESS )
     {
@@ -1474,9 +1681,8 @@ static int subscribePublishLoop( MQTTContext_t * pMqttContext,
      * disconnect, client must close the network connection. */
     if( mqttSessionEstablished == true )
     {
-        LogInfo( ( "Disconnecting the MQTT connection with %.*s.",
-                   AWS_IOT_ENDPOINT_LENGTH,
-                   AWS_IOT_ENDPOINT ) );
+        LogInfo( ( "Disconnecting the MQTT connection with %s.",
+                   EndpointSet_HostName( &endpointSet, currentEndpoint ) ) );
 
         if( returnStatus == EXIT_FAILURE )
         {
@@ -1519,19 +1725,10 @@ int aws_iot_demo_main( int argc,
     MQTTContext_t mqttContext = { 0 };
     NetworkContext_t xNetworkContext = { 0 };
     bool clientSessionPresent = false;
-    struct timespec tp;
 
     ( void ) argc;
     ( void ) argv;
 
-    /* Seed pseudo random number generator (provided by ISO C standard library) for
-     * use by retry utils library when retrying failed network operations. */
-
-    /* Get current time to seed pseudo random number generator. */
-    ( void ) clock_gettime( CLOCK_REALTIME, &tp );
-    /* Seed pseudo random number generator with nanoseconds. */
-    srand( tp.tv_nsec );
-
     /* Initialize MQTT library. Initialization of the MQTT library needs to be
      * done only once in this demo. */
     returnStatus = initializeMqtt( &mqttContext, &xNetworkContext );
@@ -1545,14 +1742,20 @@ int aws_iot_demo_main( int argc,
              * attempts are reached or maximum timeout value is reached. The function
              * returns EXIT_FAILURE if the TCP connection cannot be established to
              * broker after configured number of attempts. */
-            returnStatus = connectToServerWithBackoffRetries( &xNetworkContext );
+            #if BUFFER_ARENA_ENABLED
+                returnStatus = borrowNetworkBuffer( &mqttContext );
+
+                if( returnStatus == EXIT_SUCCESS )
+            #endif
+            {
+                returnStatus = connectToServerWithBackoffRetries( &xNetworkContext );
+            }
+
             if( returnStatus == EXIT_FAILURE )
             {
                 /* Log error to indicate connection failure after all
                  * reconnect attempts are over. */
-                LogError( ( "Failed to connect to MQTT broker %.*s.",
-                            AWS_IOT_ENDPOINT_LENGTH,
-                            AWS_IOT_ENDPOINT ) );
+                LogError( ( "Failed to connect to any MQTT broker endpoint." ) );
             }
             else
             {
@@ -1569,6 +1772,10 @@ int aws_iot_demo_main( int argc,
             /* End TLS session, then close TCP connection. */
             ( void ) xTlsDisconnect( &xNetworkContext );
 
+            #if BUFFER_ARENA_ENABLED
+                returnNetworkBuffer( &mqttContext );
+            #endif
+
             LogInfo( ( "Short delay before starting the next iteration....\n" ) );
             sleep( MQTT_SUBPUB_LOOP_DELAY_SECONDS );
         }
@@ -0,0 +1,85 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file agent_services.h
+ * @brief The services sharing the connection of the MQTT agent task.
+ *
+ * Each service is set up in two steps. Its init function registers the
+ * subscription manager callbacks of the service, before the agent task
+ * starts dispatching. Its start function creates the task of the service,
+ * which waits for the connection and subscribes and publishes through the
+ * helpers of mqtt_agent_task.h.
+ */
+
+#ifndef AGENT_SERVICES_H_
+#define AGENT_SERVICES_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+
+/* Include the prebuilt topics of the thing. */
+#include "thing_topics.h"
+
+/**
+ * @brief The Shadow and Jobs topics of the thing, built at start-up.
+ */
+extern ThingTopics_t thingTopics;
+
+/**
+ * @brief Reports a state to the classic shadow and follows its deltas.
+ */
+bool ShadowAgent_Init( void );
+bool ShadowAgent_Start( void );
+
+/**
+ * @brief Lists the pending jobs of the thing.
+ */
+bool JobsAgent_Init( void );
+bool JobsAgent_Start( void );
+
+/**
+ * @brief Publishes the Device Defender metrics reports.
+ */
+bool DefenderAgent_Init( void );
+bool DefenderAgent_Start( void );
+
+/**
+ * @brief Runs the OTA agent over the shared connection.
+ */
+bool OtaAgent_Init( void );
+bool OtaAgent_Start( void );
+
+/**
+ * @brief Sends latency probes through the shared connection.
+ */
+bool LatencyProbeAgent_Init( void );
+bool LatencyProbeAgent_Start( void );
+
+/**
+ * @brief Publishes steady telemetry and prints the soak report.
+ */
+bool SoakAgent_Init( void );
+bool SoakAgent_Start( void );
+
+#endif /* ifndef AGENT_SERVICES_H_ */
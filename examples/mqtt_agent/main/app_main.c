@@ -0,0 +1,112 @@
+/* mqtt_agent example
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "esp_system.h"
+#include "nvs_flash.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "protocol_examples_common.h"
+
+#include "esp_log.h"
+
+#if CONFIG_LOGGING_DEFERRED
+    #include "deferred_log.h"
+#endif
+
+#if CONFIG_MEM_ACCOUNTING_ENABLE
+    #include "mem_accounting.h"
+#endif
+
+#include "resource_profile.h"
+
+#if CONFIG_WIFI_FAST_CONNECT_ENABLE && CONFIG_EXAMPLE_CONNECT_WIFI
+    #include "network_transport.h"
+    #include "wifi_fast_connect.h"
+    #define USE_WIFI_FAST_CONNECT 1
+#endif
+
+#include "demo_config.h"
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+static const char *TAG = "MQTT_AGENT";
+
+ThingTopics_t thingTopics;
+
+void app_main()
+{
+    ESP_LOGI(TAG, "[APP] Startup..");
+    ESP_LOGI(TAG, "[APP] Free memory: %d bytes", esp_get_free_heap_size());
+    ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
+
+    esp_log_level_set("*", ESP_LOG_INFO);
+
+    ResourceProfile_Log();
+
+#if CONFIG_LOGGING_DEFERRED
+    DeferredLog_Init();
+#endif
+
+#if CONFIG_MEM_ACCOUNTING_ENABLE
+    /* Report the heap of the services, and the task stacks. */
+    MemAccounting_Init();
+#endif
+
+    /* Initialize NVS partition */
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        /* NVS partition was truncated
+         * and needs to be erased */
+        ESP_ERROR_CHECK(nvs_flash_erase());
+
+        /* Retry nvs_flash_init */
+        ESP_ERROR_CHECK(nvs_flash_init());
+    }
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    /* This helper function configures Wi-Fi or Ethernet, as selected in menuconfig.
+     * Read "Establishing Wi-Fi or Ethernet Connection" section in
+     * examples/protocols/README.md for more information about this function.
+     */
+#if USE_WIFI_FAST_CONNECT
+    /* The agent task connects to the broker as soon as Wi-Fi has an
+     * address, and again after every reconnect of the station. */
+    ESP_ERROR_CHECK(WifiFastConnect_Start(CONFIG_EXAMPLE_WIFI_SSID, CONFIG_EXAMPLE_WIFI_PASSWORD, NULL));
+    vTlsTransportSetNetworkWait(WifiFastConnect_WaitReady);
+#else
+    ESP_ERROR_CHECK(example_connect());
+#endif
+
+    if (!ThingTopics_Init(&thingTopics, THING_NAME, THING_NAME_LENGTH, NULL, 0)) {
+        ESP_LOGE(TAG, "The thing name is too long for the topics table.");
+        return;
+    }
+
+    /* The callbacks are registered before the agent task dispatches. */
+    if (!ShadowAgent_Init() || !JobsAgent_Init() || !DefenderAgent_Init() || !OtaAgent_Init() ||
+        !LatencyProbeAgent_Init() || !SoakAgent_Init()) {
+        ESP_LOGE(TAG, "Failed to register the callbacks of the services.");
+        return;
+    }
+
+    if (!MqttAgentTask_Start()) {
+        ESP_LOGE(TAG, "Failed to start the MQTT agent task.");
+        return;
+    }
+
+    if (!ShadowAgent_Start() || !JobsAgent_Start() || !DefenderAgent_Start() || !OtaAgent_Start() ||
+        !LatencyProbeAgent_Start() || !SoakAgent_Start()) {
+        ESP_LOGE(TAG, "Failed to start the services.");
+    }
+}
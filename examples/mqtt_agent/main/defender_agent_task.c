@@ -0,0 +1,192 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file defender_agent_task.c
+ * @brief The Device Defender service of the MQTT agent example.
+ *
+ * The metrics collector samples the network and the heap from the service
+ * task, including the counters of the shared transport, and the service
+ * publishes the report through the agent. The responses are logged by the
+ * collector from the agent task.
+ */
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Include Device Defender library and metrics collector. */
+#include "defender.h"
+#include "defender_metrics.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+#if CONFIG_EXAMPLE_AGENT_DEFENDER
+
+/**
+ * @brief The stack of the service task, in bytes. The collector uses about
+ * 400 bytes of it.
+ */
+    #define DEFENDER_TASK_STACK_SIZE    ( 3072U )
+
+/**
+ * @brief The priority of the service task, below the agent task.
+ */
+    #define DEFENDER_TASK_PRIORITY      ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief The response topics of the CBOR report API, which the callbacks
+ * registered for them keep pointing to.
+ */
+    static char acceptedTopic[ DEFENDER_API_MAX_LENGTH( DEFENDER_THINGNAME_MAX_LENGTH ) ];
+    static uint16_t acceptedTopicLength = 0U;
+    static char rejectedTopic[ DEFENDER_API_MAX_LENGTH( DEFENDER_THINGNAME_MAX_LENGTH ) ];
+    static uint16_t rejectedTopicLength = 0U;
+
+/**
+ * @brief The report being published. Only the service task uses it.
+ */
+    static DefenderMetricsReport_t report;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Logs a response to a report.
+ */
+    static void reportResponseCallback( MQTTContext_t * pContext,
+                                        MQTTPublishInfo_t * pPublishInfo,
+                                        void * pUserContext );
+
+/**
+ * @brief The service task.
+ */
+    static void defenderTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+    static void reportResponseCallback( MQTTContext_t * pContext,
+                                        MQTTPublishInfo_t * pPublishInfo,
+                                        void * pUserContext )
+    {
+        ( void ) pContext;
+        ( void ) pUserContext;
+
+        ( void ) DefenderMetrics_HandleResponse( pPublishInfo );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void defenderTask( void * pParameters )
+    {
+        MQTTPublishInfo_t publishInfo = { 0 };
+        bool subscribed = false;
+
+        ( void ) pParameters;
+
+        /* The agent subscribes again after a reconnect, so this is done once. */
+        while( subscribed == false )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            subscribed = ( MqttAgentTask_Subscribe( acceptedTopic, acceptedTopicLength, MQTTQoS1 ) == MQTTSuccess ) &&
+                         ( MqttAgentTask_Subscribe( rejectedTopic, rejectedTopicLength, MQTTQoS1 ) == MQTTSuccess );
+        }
+
+        for( ; ; )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+
+            if( DefenderMetrics_PrepareIfDue( MqttAgentTask_GetNetworkContext(),
+                                              THING_NAME, THING_NAME_LENGTH, &report ) == DefenderMetricsSuccess )
+            {
+                publishInfo.qos = MQTTQoS0;
+                publishInfo.pTopicName = report.topic;
+                publishInfo.topicNameLength = report.topicLength;
+                publishInfo.pPayload = report.pPayload;
+                publishInfo.payloadLength = report.payloadLength;
+
+                if( MqttAgentTask_Publish( &publishInfo ) == MQTTSuccess )
+                {
+                    DefenderMetrics_ReportPublished( &report );
+                }
+            }
+
+            /* A report that isn't due only reads the tick count. */
+            vTaskDelay( pdMS_TO_TICKS( 1000U ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool DefenderAgent_Init( void )
+    {
+        bool registered = false;
+
+        registered = ( Defender_GetTopic( acceptedTopic, sizeof( acceptedTopic ), THING_NAME, THING_NAME_LENGTH,
+                                          DefenderCborReportAccepted, &acceptedTopicLength ) == DefenderSuccess ) &&
+                     ( Defender_GetTopic( rejectedTopic, sizeof( rejectedTopic ), THING_NAME, THING_NAME_LENGTH,
+                                          DefenderCborReportRejected, &rejectedTopicLength ) == DefenderSuccess );
+
+        registered = registered &&
+                     ( SubscriptionManager_RegisterCallback( acceptedTopic, acceptedTopicLength,
+                                                             reportResponseCallback, NULL ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS ) &&
+                     ( SubscriptionManager_RegisterCallback( rejectedTopic, rejectedTopicLength,
+                                                             reportResponseCallback, NULL ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS );
+
+        if( registered == false )
+        {
+            LogError( ( "Failed to register the Device Defender callbacks." ) );
+        }
+
+        return registered;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool DefenderAgent_Start( void )
+    {
+        return xTaskCreate( defenderTask, "DefenderAgent", DEFENDER_TASK_STACK_SIZE, NULL,
+                            DEFENDER_TASK_PRIORITY, NULL ) == pdPASS;
+    }
+
+#else /* if CONFIG_EXAMPLE_AGENT_DEFENDER */
+
+    bool DefenderAgent_Init( void )
+    {
+        return true;
+    }
+
+    bool DefenderAgent_Start( void )
+    {
+        return true;
+    }
+
+#endif /* if CONFIG_EXAMPLE_AGENT_DEFENDER */
@@ -0,0 +1,317 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file jobs_agent_task.c
+ * @brief The Jobs service of the MQTT agent example.
+ *
+ * The service lists the pending jobs of the thing once connected, and again
+ * whenever AWS IoT Jobs notifies that the list changed. It only reads the
+ * job lists, on their own topics: the next job is claimed and run by the OTA
+ * service, on the topics of the next job, so that the two don't compete for
+ * the same job executions.
+ *
+ * With CONFIG_EXAMPLE_AGENT_JOBS_POLL_INTERVAL_MS, the lists are also
+ * requested at that interval, as a steady load for soak runs.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* JSON library includes. */
+#include "core_json.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+/* Include the performance metrics registry. */
+#include "perf_metrics.h"
+
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+#if CONFIG_EXAMPLE_AGENT_JOBS
+
+/**
+ * @brief The stack of the service task, in bytes.
+ */
+    #define JOBS_TASK_STACK_SIZE    ( 3072U )
+
+/**
+ * @brief The priority of the service task, below the agent task.
+ */
+    #define JOBS_TASK_PRIORITY      ( tskIDLE_PRIORITY + 2U )
+
+/**
+ * @brief The most jobs of a list that are logged.
+ */
+    #define JOBS_MAX_LISTED         ( 8U )
+
+/**
+ * @brief The size of a query for a job ID in a list.
+ */
+    #define JOBS_QUERY_SIZE         ( sizeof( "inProgressJobs[0].jobId" ) + 2U )
+
+/**
+ * @brief The request payload of GetPendingJobExecutions.
+ */
+    #define JOBS_GET_PAYLOAD        "{\"clientToken\":\"" CLIENT_IDENTIFIER "\"}"
+
+/**
+ * @brief How long the service waits for a disconnect before it requests the
+ * lists again.
+ */
+    #if ( CONFIG_EXAMPLE_AGENT_JOBS_POLL_INTERVAL_MS > 0 )
+        #define JOBS_POLL_WAIT      pdMS_TO_TICKS( CONFIG_EXAMPLE_AGENT_JOBS_POLL_INTERVAL_MS )
+    #else
+        #define JOBS_POLL_WAIT      portMAX_DELAY
+    #endif
+
+/**
+ * @brief The lists requested, and those received and parsed.
+ */
+    PERF_METRICS_COUNTER( requestsMetric, "jobs_list_requests" );
+    PERF_METRICS_COUNTER( listsMetric, "jobs_lists_parsed" );
+
+/**
+ * @brief The lists of the two responses, in the order they are logged.
+ */
+    static const char * const notifyLists[] = { "jobs.QUEUED", "jobs.IN_PROGRESS" };
+    static const char * const getLists[] = { "queuedJobs", "inProgressJobs" };
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Logs the job IDs of the lists of a response.
+ *
+ * @param[in] pPublishInfo The response.
+ * @param[in] ppLists The keys of its queued and in progress lists.
+ */
+    static void logJobLists( const MQTTPublishInfo_t * pPublishInfo,
+                             const char * const * ppLists );
+
+/**
+ * @brief Logs the lists of a notification or of a GetPendingJobExecutions
+ * response.
+ */
+    static void jobListCallback( MQTTContext_t * pContext,
+                                 MQTTPublishInfo_t * pPublishInfo,
+                                 void * pUserContext );
+
+/**
+ * @brief Logs a GetPendingJobExecutions rejection.
+ */
+    static void jobRejectedCallback( MQTTContext_t * pContext,
+                                     MQTTPublishInfo_t * pPublishInfo,
+                                     void * pUserContext );
+
+/**
+ * @brief The service task.
+ */
+    static void jobsTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+    static void logJobLists( const MQTTPublishInfo_t * pPublishInfo,
+                             const char * const * ppLists )
+    {
+        char query[ JOBS_QUERY_SIZE ];
+        char * pJobId = NULL;
+        size_t jobIdLength = 0U;
+        size_t list;
+        size_t i;
+        int queryLength;
+
+        for( list = 0U; list < 2U; list++ )
+        {
+            for( i = 0U; i < JOBS_MAX_LISTED; i++ )
+            {
+                queryLength = snprintf( query, sizeof( query ), "%s[%u].jobId", ppLists[ list ], ( unsigned ) i );
+
+                if( ( queryLength <= 0 ) || ( ( size_t ) queryLength >= sizeof( query ) ) ||
+                    ( JSON_Search( ( char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength,
+                                   query, ( size_t ) queryLength, &pJobId, &jobIdLength ) != JSONSuccess ) )
+                {
+                    break;
+                }
+
+                LogInfo( ( "Job %.*s is %s.", ( int ) jobIdLength, pJobId,
+                           ( list == 0U ) ? "queued" : "in progress" ) );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void jobListCallback( MQTTContext_t * pContext,
+                                 MQTTPublishInfo_t * pPublishInfo,
+                                 void * pUserContext )
+    {
+        ( void ) pContext;
+
+        if( JSON_Validate( ( const char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength ) != JSONSuccess )
+        {
+            LogError( ( "Received an invalid job list on %.*s.",
+                        pPublishInfo->topicNameLength, pPublishInfo->pTopicName ) );
+        }
+        else
+        {
+            LogInfo( ( "Pending jobs of %s:", THING_NAME ) );
+            logJobLists( pPublishInfo, ( const char * const * ) pUserContext );
+
+            PERF_METRICS_REGISTER( listsMetric );
+            PERF_METRICS_ADD( listsMetric, 1U );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void jobRejectedCallback( MQTTContext_t * pContext,
+                                     MQTTPublishInfo_t * pPublishInfo,
+                                     void * pUserContext )
+    {
+        ( void ) pContext;
+        ( void ) pUserContext;
+
+        LogError( ( "GetPendingJobExecutions rejected: %.*s",
+                    ( int ) pPublishInfo->payloadLength,
+                    ( const char * ) pPublishInfo->pPayload ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void jobsTask( void * pParameters )
+    {
+        static const ThingTopic_t topics[] =
+        {
+            ThingTopicJobsNotify,
+            ThingTopicJobsGetAccepted,
+            ThingTopicJobsGetRejected
+        };
+        MQTTPublishInfo_t publishInfo = { 0 };
+        const char * pTopic = NULL;
+        uint16_t topicLength = 0U;
+        bool subscribed = false;
+        size_t i;
+
+        ( void ) pParameters;
+
+        /* The agent subscribes again after a reconnect, so this is done once. */
+        while( subscribed == false )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            subscribed = true;
+
+            for( i = 0U; ( i < ( sizeof( topics ) / sizeof( topics[ 0 ] ) ) ) && ( subscribed == true ); i++ )
+            {
+                pTopic = ThingTopics_Get( &thingTopics, topics[ i ], &topicLength );
+                subscribed = ( MqttAgentTask_Subscribe( pTopic, topicLength, MQTTQoS1 ) == MQTTSuccess );
+            }
+        }
+
+        publishInfo.qos = MQTTQoS1;
+        publishInfo.pTopicName = ThingTopics_Get( &thingTopics, ThingTopicJobsGet, &publishInfo.topicNameLength );
+        publishInfo.pPayload = JOBS_GET_PAYLOAD;
+        publishInfo.payloadLength = sizeof( JOBS_GET_PAYLOAD ) - 1U;
+
+        for( ; ; )
+        {
+            /* Changes made while disconnected are not notified, so the list is
+             * requested again on every connection. */
+            if( MqttAgentTask_Publish( &publishInfo ) == MQTTSuccess )
+            {
+                PERF_METRICS_REGISTER( requestsMetric );
+                PERF_METRICS_ADD( requestsMetric, 1U );
+            }
+
+            if( MqttAgentTask_WaitForConnection( false, JOBS_POLL_WAIT ) == true )
+            {
+                ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool JobsAgent_Init( void )
+    {
+        const char * pTopic = NULL;
+        uint16_t topicLength = 0U;
+        bool registered = false;
+
+        pTopic = ThingTopics_Get( &thingTopics, ThingTopicJobsNotify, &topicLength );
+        registered = ( SubscriptionManager_RegisterCallback( pTopic, topicLength, jobListCallback,
+                                                             ( void * ) notifyLists ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS );
+
+        if( registered == true )
+        {
+            pTopic = ThingTopics_Get( &thingTopics, ThingTopicJobsGetAccepted, &topicLength );
+            registered = ( SubscriptionManager_RegisterCallback( pTopic, topicLength, jobListCallback,
+                                                                 ( void * ) getLists ) ==
+                           SUBSCRIPTION_MANAGER_SUCCESS );
+        }
+
+        if( registered == true )
+        {
+            pTopic = ThingTopics_Get( &thingTopics, ThingTopicJobsGetRejected, &topicLength );
+            registered = ( SubscriptionManager_RegisterCallback( pTopic, topicLength, jobRejectedCallback, NULL ) ==
+                           SUBSCRIPTION_MANAGER_SUCCESS );
+        }
+
+        if( registered == false )
+        {
+            LogError( ( "Failed to register the jobs callbacks." ) );
+        }
+
+        return registered;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool JobsAgent_Start( void )
+    {
+        return xTaskCreate( jobsTask, "JobsAgent", JOBS_TASK_STACK_SIZE, NULL,
+                            JOBS_TASK_PRIORITY, NULL ) == pdPASS;
+    }
+
+#else /* if CONFIG_EXAMPLE_AGENT_JOBS */
+
+    bool JobsAgent_Init( void )
+    {
+        return true;
+    }
+
+    bool JobsAgent_Start( void )
+    {
+        return true;
+    }
+
+#endif /* if CONFIG_EXAMPLE_AGENT_JOBS */
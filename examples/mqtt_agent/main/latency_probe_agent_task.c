@@ -0,0 +1,196 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file latency_probe_agent_task.c
+ * @brief The latency probe service of the MQTT agent example.
+ *
+ * The service publishes a probe every CONFIG_LATENCY_PROBE_INTERVAL_MS to a
+ * topic of the thing it subscribes to, and takes it back from its callback
+ * the way the other services take their messages, so that the percentiles
+ * of latency_probe.h cover the whole path of a command: the agent lanes, the
+ * transport, the broker, the subscription manager and the hand-over to a
+ * service task.
+ */
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+#include "latency_probe.h"
+
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+#if LATENCY_PROBE_ENABLED
+
+/**
+ * @brief The stack of the service task, in bytes.
+ */
+    #define PROBE_TASK_STACK_SIZE     ( 2560U )
+
+/**
+ * @brief The priority of the service task, that of the other services, so
+ * that the hand-over it measures is theirs.
+ */
+    #define PROBE_TASK_PRIORITY       ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief The topic the probes are published to and received from.
+ */
+    #define PROBE_TOPIC               THING_NAME "/latency-probe"
+    #define PROBE_TOPIC_LENGTH        ( ( uint16_t ) ( sizeof( PROBE_TOPIC ) - 1U ) )
+
+/**
+ * @brief The bit of the task notification set by the callback.
+ */
+    #define PROBE_RECEIVED_BIT        ( 1UL << 0 )
+
+/**
+ * @brief The service task, notified by the callback.
+ */
+    static TaskHandle_t probeTaskHandle = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Hands the probe in flight over to the service task.
+ */
+    static void probeCallback( MQTTContext_t * pContext,
+                               MQTTPublishInfo_t * pPublishInfo,
+                               void * pUserContext );
+
+/**
+ * @brief The service task.
+ */
+    static void probeTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+    static void probeCallback( MQTTContext_t * pContext,
+                               MQTTPublishInfo_t * pPublishInfo,
+                               void * pUserContext )
+    {
+        ( void ) pContext;
+        ( void ) pUserContext;
+
+        if( LatencyProbe_Match( pPublishInfo->pPayload, pPublishInfo->payloadLength ) )
+        {
+            ( void ) xTaskNotify( probeTaskHandle, PROBE_RECEIVED_BIT, eSetBits );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void probeTask( void * pParameters )
+    {
+        const TickType_t interval = pdMS_TO_TICKS( CONFIG_LATENCY_PROBE_INTERVAL_MS );
+        char payload[ LATENCY_PROBE_PAYLOAD_SIZE ];
+        MQTTPublishInfo_t publishInfo = { 0 };
+        TickType_t lastWakeTime = 0U;
+        uint32_t notifiedBits = 0U;
+        uint32_t probesReceived = 0U;
+        bool subscribed = false;
+
+        ( void ) pParameters;
+
+        /* The agent subscribes again after a reconnect, so this is done once. */
+        while( subscribed == false )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            subscribed = ( MqttAgentTask_Subscribe( PROBE_TOPIC, PROBE_TOPIC_LENGTH, MQTTQoS0 ) == MQTTSuccess );
+        }
+
+        publishInfo.qos = MQTTQoS0;
+        publishInfo.pTopicName = PROBE_TOPIC;
+        publishInfo.topicNameLength = PROBE_TOPIC_LENGTH;
+        publishInfo.pPayload = payload;
+
+        for( ; ; )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            lastWakeTime = xTaskGetTickCount();
+
+            publishInfo.payloadLength = LatencyProbe_Start( payload, sizeof( payload ) );
+
+            /* A probe that doesn't come back within the interval is lost. */
+            if( ( MqttAgentTask_PublishProbe( &publishInfo ) == MQTTSuccess ) &&
+                ( xTaskNotifyWait( 0U, PROBE_RECEIVED_BIT, &notifiedBits, interval ) == pdTRUE ) &&
+                ( ( notifiedBits & PROBE_RECEIVED_BIT ) != 0U ) )
+            {
+                LatencyProbe_Finish();
+                probesReceived++;
+
+                if( ( probesReceived % LATENCY_PROBE_WINDOW ) == 0U )
+                {
+                    LatencyProbe_Dump();
+                }
+            }
+
+            vTaskDelayUntil( &lastWakeTime, interval );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool LatencyProbeAgent_Init( void )
+    {
+        bool registered = ( SubscriptionManager_RegisterCallback( PROBE_TOPIC, PROBE_TOPIC_LENGTH,
+                                                                  probeCallback, NULL ) ==
+                            SUBSCRIPTION_MANAGER_SUCCESS );
+
+        if( registered == false )
+        {
+            LogError( ( "Failed to register the latency probe callback." ) );
+        }
+
+        return registered;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool LatencyProbeAgent_Start( void )
+    {
+        return xTaskCreate( probeTask, "LatencyProbe", PROBE_TASK_STACK_SIZE, NULL,
+                            PROBE_TASK_PRIORITY, &probeTaskHandle ) == pdPASS;
+    }
+
+#else /* if LATENCY_PROBE_ENABLED */
+
+    bool LatencyProbeAgent_Init( void )
+    {
+        return true;
+    }
+
+    bool LatencyProbeAgent_Start( void )
+    {
+        return true;
+    }
+
+#endif /* if LATENCY_PROBE_ENABLED */
@@ -0,0 +1,1270 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_agent_task.c
+ * @brief The coreMQTT-Agent task owning the connection shared by the
+ * services.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+
+/* MQTT agent port includes. */
+#include "freertos_agent_message.h"
+#include "freertos_command_pool.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
+
+/* Keep-alive interval of the network. */
+#include "mqtt_keep_alive.h"
+
+/* Transport interface include. */
+#include "network_transport.h"
+
+/* Clock for timer. */
+#include "clock.h"
+
+/* Core affinity and priority of the tasks. */
+#include "task_layout.h"
+
+/* Stamps of the latency probes. */
+#include "latency_probe.h"
+
+/* Shedding of QoS 0 publishes on a congested uplink. */
+#include "publish_shedding.h"
+
+#if CONFIG_EXAMPLE_AGENT_OTA
+/* Slabs of the network buffer handed to the OTA agent. */
+    #include "ota_event_pool.h"
+#endif
+
+#include "mqtt_agent_task.h"
+
+extern const char root_cert_auth_pem_start[] asm("_binary_root_cert_auth_pem_start");
+extern const char client_cert_pem_start[] asm("_binary_client_crt_start");
+extern const char client_key_pem_start[] asm("_binary_client_key_start");
+
+/**
+ * @brief ALPN (Application-Layer Protocol Negotiation) protocol name for AWS IoT MQTT.
+ *
+ * This will be used if the AWS_MQTT_PORT is configured as 443 for AWS IoT MQTT broker.
+ * Please see more details about the ALPN protocol for AWS IoT MQTT endpoint
+ * in the link below.
+ * https://aws.amazon.com/blogs/iot/mqtt-with-tls-client-authentication-on-port-443-why-it-is-useful-and-how-it-works/
+ */
+#define AWS_IOT_MQTT_ALPN                        "x-amzn-mqtt-ca"
+
+/**
+ * @brief Length of MQTT server host name.
+ */
+#define AWS_IOT_ENDPOINT_LENGTH                  ( ( uint16_t ) ( sizeof( AWS_IOT_ENDPOINT ) - 1 ) )
+
+/**
+ * @brief Length of client identifier.
+ */
+#define CLIENT_IDENTIFIER_LENGTH                 ( ( uint16_t ) ( sizeof( CLIENT_IDENTIFIER ) - 1 ) )
+
+/**
+ * @brief Timeout for receiving CONNACK packet in milli seconds.
+ */
+#define CONNACK_RECV_TIMEOUT_MS                  ( 2000U )
+
+/**
+ * @brief The maximum time interval in seconds which is allowed to elapse
+ * between two Control Packets. The agent sends the PINGREQ. Replaced by the
+ * interval learned for the network when CONFIG_MQTT_KEEP_ALIVE_ADAPTIVE is
+ * enabled.
+ */
+#define MQTT_KEEP_ALIVE_INTERVAL_SECONDS         ( 60U )
+
+/**
+ * @brief The longest a helper waits for a free command structure and for
+ * room in the lane of its command, in milliseconds.
+ */
+#define MQTT_AGENT_COMMAND_BLOCK_TIME_MS         ( 5000U )
+
+/**
+ * @brief The maximum back-off delay (in milliseconds) for retrying connection to server.
+ */
+#define CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS    ( 30000U )
+
+/**
+ * @brief The base back-off delay (in milliseconds) to use for connection retry attempts.
+ */
+#define CONNECTION_RETRY_BACKOFF_BASE_MS         ( 500U )
+
+/**
+ * @brief The MQTT metrics string expected by AWS IoT.
+ */
+#define METRICS_STRING                           "?SDK=" OS_NAME "&Version=" OS_VERSION "&Platform=" HARDWARE_PLATFORM_NAME "&OTALib=" OTA_LIB
+
+/**
+ * @brief The length of the MQTT metrics string expected by AWS IoT.
+ */
+#define METRICS_STRING_LENGTH                    ( ( uint16_t ) ( sizeof( METRICS_STRING ) - 1 ) )
+
+/**
+ * @brief The length of each lane of the command queue.
+ */
+#define AGENT_COMMAND_QUEUE_LENGTH               CONFIG_EXAMPLE_AGENT_COMMAND_QUEUE_LENGTH
+
+/**
+ * @brief The most subscriptions remembered for a reconnect.
+ */
+#define AGENT_MAX_SUBSCRIPTIONS                  CONFIG_EXAMPLE_AGENT_MAX_SUBSCRIPTIONS
+
+/**
+ * @brief The longest topic filter remembered for a reconnect, with its
+ * terminator. A thing name takes up to 128 bytes of it.
+ */
+#define AGENT_TOPIC_FILTER_SIZE                  ( 192U )
+
+/**
+ * @brief The size of the cork buffer batches of commands are written
+ * through, or 0.
+ */
+#define AGENT_CORK_BUFFER_SIZE                   CONFIG_EXAMPLE_AGENT_CORK_BUFFER_SIZE
+
+/**
+ * @brief Bits of #connectionEvents. Exactly one of them is set.
+ */
+#define CONNECTED_BIT                            ( ( EventBits_t ) 1U << 0 )
+#define DISCONNECTED_BIT                         ( ( EventBits_t ) 1U << 1 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The context of a command waited for by a helper, on the stack of
+ * the task that queued it.
+ */
+struct MQTTAgentCommandContext
+{
+    TaskHandle_t taskToNotify;
+    MQTTStatus_t returnCode;
+    uint8_t subackCode;
+    AgentMessageLane_t lane;
+    bool probe;
+    #if PUBLISH_SHEDDING_ENABLED
+        bool sheddable;                 /**< Whether #ticket was admitted. */
+        bool shed;                      /**< Whether the publish was shed. */
+        PublishSheddingTicket_t ticket; /**< The ticket of a QoS 0 publish in the bulk lane. */
+    #endif
+};
+
+/**
+ * @brief A subscription remembered for a reconnect. The filter is copied, as
+ * the OTA library builds its filters on the stack.
+ */
+typedef struct AgentSubscription
+{
+    char topicFilter[ AGENT_TOPIC_FILTER_SIZE ];
+    uint16_t topicFilterLength;
+    MQTTQoS_t qos;
+} AgentSubscription_t;
+
+/**
+ * @brief Static buffer for TLS Context Semaphore.
+ */
+static StaticSemaphore_t tlsContextSemaphoreBuffer;
+
+/**
+ * @brief The network context of the shared connection.
+ */
+static NetworkContext_t networkContext;
+
+/**
+ * @brief The agent, and the MQTT context in it.
+ */
+static MQTTAgentContext_t agentContext;
+
+/**
+ * @brief The command queue of the agent, with a control and a bulk lane.
+ */
+static MQTTAgentMessageContext_t commandMessageContext;
+static MQTTAgentCommand_t * controlQueueStorage[ AGENT_COMMAND_QUEUE_LENGTH ];
+static MQTTAgentCommand_t * bulkQueueStorage[ AGENT_COMMAND_QUEUE_LENGTH ];
+static StaticQueue_t controlQueueBuffer;
+static StaticQueue_t bulkQueueBuffer;
+
+#if CONFIG_EXAMPLE_AGENT_OTA && OTA_EVENT_POOL_ZERO_COPY
+
+/**
+ * @brief The network buffer of the connection, split into slabs so that the
+ * OTA agent is handed its payloads in the slab they were received into.
+ */
+    static uint8_t networkBuffer[ OTA_EVENT_POOL_SLABS * OTA_EVENT_POOL_SLAB_SIZE( NETWORK_BUFFER_SIZE ) ] __attribute__( ( aligned( 4 ) ) );
+#else
+
+/**
+ * @brief The network buffer of the connection, which every incoming packet
+ * is received into.
+ */
+    static uint8_t networkBuffer[ NETWORK_BUFFER_SIZE ];
+#endif
+
+#if ( AGENT_CORK_BUFFER_SIZE > 0 )
+
+/**
+ * @brief Where the packets of a batch of commands are collected.
+ */
+    static uint8_t corkBuffer[ AGENT_CORK_BUFFER_SIZE ];
+#endif
+
+#if CONFIG_EXAMPLE_AGENT_SOAK
+
+/**
+ * @brief The counters of the transport, for the soak report.
+ */
+    static TlsTransportMetrics_t transportMetrics;
+#endif
+
+/**
+ * @brief The agent task.
+ */
+static TaskHandle_t agentTaskHandle = NULL;
+
+/**
+ * @brief Whether the connection is up.
+ */
+static EventGroupHandle_t connectionEvents = NULL;
+static StaticEventGroup_t connectionEventsBuffer;
+
+/**
+ * @brief The subscriptions of the services, subscribed again when a reconnect
+ * finds no session on the broker.
+ */
+static AgentSubscription_t subscriptions[ AGENT_MAX_SUBSCRIPTIONS ];
+static size_t subscriptionCount = 0U;
+static SemaphoreHandle_t subscriptionsMutex = NULL;
+static StaticSemaphore_t subscriptionsMutexBuffer;
+
+/**
+ * @brief A copy of the subscriptions, valid until the agent has sent them
+ * again.
+ */
+static AgentSubscription_t resubscriptions[ AGENT_MAX_SUBSCRIPTIONS ];
+static MQTTSubscribeInfo_t resubscribeList[ AGENT_MAX_SUBSCRIPTIONS ];
+static MQTTAgentSubscribeArgs_t resubscribeArgs;
+
+/**
+ * @brief Whether a session was started, after which connections ask the
+ * broker to keep it.
+ */
+static bool sessionStarted = false;
+
+#if MQTT_KEEP_ALIVE_ADAPTIVE
+
+/**
+ * @brief The keep-alive interval learned for the network.
+ */
+    static MqttKeepAlive_t keepAlive;
+#endif
+
+#if PUBLISH_SHEDDING_ENABLED && ( AGENT_CORK_BUFFER_SIZE > 0 )
+
+/**
+ * @brief Whether the transport is corked, when writes only fill the cork
+ * buffer and don't tell how the link is doing.
+ */
+    static bool corked = false;
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sets the credentials and the endpoint of the connection.
+ */
+static void initializeNetworkContext( void );
+
+/**
+ * @brief Connects the TLS session and sends the MQTT CONNECT.
+ *
+ * @param[out] pSessionPresent Whether the broker had kept the session.
+ * @param[out] pFailure Why the connection failed, if it did.
+ *
+ * @return true if the broker accepted the connection.
+ */
+static bool connectToBroker( bool * pSessionPresent,
+                             ReconnectFailure_t * pFailure );
+
+/**
+ * @brief Resumes the session after a connection, and subscribes again if the
+ * broker didn't keep it.
+ */
+static MQTTStatus_t resumeSession( bool sessionPresent );
+
+/**
+ * @brief Marks the connection as up or down.
+ */
+static void setConnected( bool connected );
+
+/**
+ * @brief Dispatches an incoming PUBLISH to the callbacks of the services.
+ */
+static void incomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
+                                     uint16_t packetId,
+                                     MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Queues a command in the lane picked by its helper, or by
+ * Agent_MessageDefaultLane for the commands of the agent task itself.
+ */
+static AgentMessageLane_t selectLane( const MQTTAgentCommand_t * pCommand );
+
+/**
+ * @brief Wakes up the task waiting for a command.
+ */
+static void commandCompleteCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                     MQTTAgentReturnInfo_t * pReturnInfo );
+
+/**
+ * @brief Logs the outcome of the subscriptions sent again.
+ */
+static void resubscribeCompleteCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                         MQTTAgentReturnInfo_t * pReturnInfo );
+
+/**
+ * @brief Sets up a command waited for by the calling task.
+ */
+static void prepareCommand( MQTTAgentCommandContext_t * pCommandContext,
+                            MQTTAgentCommandInfo_t * pCommandInfo );
+
+/**
+ * @brief Waits for a command queued with @a queueStatus to complete.
+ *
+ * @return The error of the queue, or the outcome of the command.
+ */
+static MQTTStatus_t waitForCommand( MQTTStatus_t queueStatus,
+                                    const MQTTAgentCommandContext_t * pCommandContext );
+
+/**
+ * @brief Publishes a message in @a lane and waits for it, stamping its send
+ * if it is a latency probe.
+ */
+static MQTTStatus_t publishCommand( MQTTPublishInfo_t * pPublishInfo,
+                                    AgentMessageLane_t lane,
+                                    bool probe );
+
+/**
+ * @brief Adds a subscription to #subscriptions, once.
+ */
+static bool rememberSubscription( const MQTTSubscribeInfo_t * pSubscribeInfo );
+
+/**
+ * @brief Removes a subscription from #subscriptions.
+ */
+static void forgetSubscription( const char * pTopicFilter,
+                                uint16_t topicFilterLength );
+
+#if PUBLISH_SHEDDING_ENABLED
+
+/**
+ * @brief Receives the next command, completing the publishes shed while they
+ * were queued without sending them.
+ */
+    static bool receiveCommand( MQTTAgentMessageContext_t * pMsgCtx,
+                                MQTTAgentCommand_t ** pReceivedCommand,
+                                uint32_t blockTimeMs );
+
+/**
+ * @brief Writes to the transport, and feeds the time taken to the congestion
+ * monitor.
+ */
+    static int32_t meteredSend( NetworkContext_t * pNetworkContext,
+                                const void * pBuffer,
+                                size_t bytesToSend );
+#endif
+
+#if ( AGENT_CORK_BUFFER_SIZE > 0 )
+
+/**
+ * @brief Corks the transport before a batch of commands.
+ */
+    static void batchBegin( void * pBatchContext );
+
+/**
+ * @brief Writes out the packets of a batch of commands.
+ */
+    static void batchEnd( void * pBatchContext );
+#endif
+
+/**
+ * @brief The task the agent runs in.
+ */
+static void agentTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+static void initializeNetworkContext( void )
+{
+    networkContext.pcHostname = AWS_IOT_ENDPOINT;
+    networkContext.xPort = AWS_MQTT_PORT;
+    networkContext.pxTls = NULL;
+    networkContext.xTlsContextSemaphore = xSemaphoreCreateMutexStatic( &tlsContextSemaphoreBuffer );
+    networkContext.disableSni = 0;
+
+    /* Initialize credentials for establishing TLS session. */
+    networkContext.pcServerRootCAPem = root_cert_auth_pem_start;
+
+    #ifdef CONFIG_EXAMPLE_USE_SECURE_ELEMENT
+        networkContext.pcClientCertPem = NULL;
+        networkContext.pcClientKeyPem = NULL;
+        networkContext.use_secure_element = true;
+    #elif CONFIG_EXAMPLE_USE_DS_PERIPHERAL
+        networkContext.pcClientCertPem = client_cert_pem_start;
+        networkContext.pcClientKeyPem = NULL;
+        #error "Populate the ds_data structure and remove this line"
+        /* networkContext.ds_data = DS_DATA; */
+        /* The ds_data can be populated using the API's provided by esp_secure_cert_mgr */
+    #else
+        networkContext.pcClientCertPem = client_cert_pem_start;
+        networkContext.pcClientKeyPem = client_key_pem_start;
+    #endif
+
+    if( AWS_MQTT_PORT == 443 )
+    {
+        static const char * pcAlpnProtocols[] = { AWS_IOT_MQTT_ALPN, NULL };
+
+        networkContext.pAlpnProtos = pcAlpnProtocols;
+    }
+    else
+    {
+        networkContext.pAlpnProtos = NULL;
+    }
+
+    #if ( AGENT_CORK_BUFFER_SIZE > 0 )
+        networkContext.pucCorkBuffer = corkBuffer;
+        networkContext.uxCorkBufferSize = sizeof( corkBuffer );
+    #endif
+
+    #if CONFIG_EXAMPLE_AGENT_SOAK
+        networkContext.pxMetrics = &transportMetrics;
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+static bool connectToBroker( bool * pSessionPresent,
+                             ReconnectFailure_t * pFailure )
+{
+    MQTTStatus_t mqttStatus = MQTTBadParameter;
+    MQTTConnectInfo_t connectInfo = { 0 };
+    TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
+    bool connected = false;
+
+    LogInfo( ( "Establishing a TLS session to %.*s:%d.",
+               AWS_IOT_ENDPOINT_LENGTH,
+               AWS_IOT_ENDPOINT,
+               AWS_MQTT_PORT ) );
+
+    tlsStatus = xTlsConnect( &networkContext );
+
+    if( tlsStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        LogWarn( ( "Failed to establish a TLS session to %.*s.",
+                   AWS_IOT_ENDPOINT_LENGTH,
+                   AWS_IOT_ENDPOINT ) );
+        *pFailure = ( tlsStatus == TLS_TRANSPORT_HANDSHAKE_FAILED ) ?
+                    ReconnectFailureRefused : ReconnectFailureNetwork;
+    }
+    else
+    {
+        /* Start clean once, then ask the broker to keep the subscriptions
+         * and the QoS 1 messages in flight across reconnects. */
+        connectInfo.cleanSession = ( sessionStarted == false );
+        connectInfo.pClientIdentifier = CLIENT_IDENTIFIER;
+        connectInfo.clientIdentifierLength = CLIENT_IDENTIFIER_LENGTH;
+        #if MQTT_KEEP_ALIVE_ADAPTIVE
+            connectInfo.keepAliveSeconds = MqttKeepAlive_Next( &keepAlive );
+        #else
+            connectInfo.keepAliveSeconds = MQTT_KEEP_ALIVE_INTERVAL_SECONDS;
+        #endif
+        connectInfo.pUserName = METRICS_STRING;
+        connectInfo.userNameLength = METRICS_STRING_LENGTH;
+
+        /* The agent task is the only user of the MQTT context. */
+        mqttStatus = MQTT_Connect( &agentContext.mqttContext, &connectInfo, NULL,
+                                   CONNACK_RECV_TIMEOUT_MS, pSessionPresent );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Connection with MQTT broker failed with status %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+
+            /* A CONNACK refusing the connection, such as when the broker
+             * is unavailable or throttling the account. */
+            *pFailure = ( mqttStatus == MQTTServerRefused ) ?
+                        ReconnectFailureRefused : ReconnectFailureNetwork;
+        }
+        else
+        {
+            LogInfo( ( "MQTT connection established with broker, session %s.",
+                       ( *pSessionPresent == true ) ? "resumed" : "new" ) );
+            sessionStarted = true;
+            connected = true;
+        }
+    }
+
+    return connected;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t resumeSession( bool sessionPresent )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTAgentCommandInfo_t commandInfo = { 0 };
+    size_t count = 0U;
+    size_t i;
+
+    /* Resends the QoS 1 publishes of a kept session, or fails them back to
+     * the tasks waiting on them. */
+    status = MQTTAgent_ResumeSession( &agentContext, sessionPresent );
+
+    if( ( status == MQTTSuccess ) && ( sessionPresent == false ) )
+    {
+        ( void ) xSemaphoreTake( subscriptionsMutex, portMAX_DELAY );
+        count = subscriptionCount;
+        ( void ) memcpy( resubscriptions, subscriptions, count * sizeof( AgentSubscription_t ) );
+        ( void ) xSemaphoreGive( subscriptionsMutex );
+
+        for( i = 0U; i < count; i++ )
+        {
+            resubscribeList[ i ].pTopicFilter = resubscriptions[ i ].topicFilter;
+            resubscribeList[ i ].topicFilterLength = resubscriptions[ i ].topicFilterLength;
+            resubscribeList[ i ].qos = resubscriptions[ i ].qos;
+        }
+
+        resubscribeArgs.pSubscribeInfo = resubscribeList;
+        resubscribeArgs.numSubscriptions = count;
+
+        if( resubscribeArgs.numSubscriptions > 0U )
+        {
+            LogInfo( ( "Subscribing again to %u topic filters.",
+                       ( unsigned ) resubscribeArgs.numSubscriptions ) );
+
+            /* Queued from the agent task itself, so it must not block. The
+             * command is sent once the command loop runs. */
+            commandInfo.cmdCompleteCallback = resubscribeCompleteCallback;
+            commandInfo.blockTimeMs = 0U;
+            status = MQTTAgent_Subscribe( &agentContext, &resubscribeArgs, &commandInfo );
+
+            if( status != MQTTSuccess )
+            {
+                LogError( ( "Failed to queue the subscriptions: %s.", MQTT_Status_strerror( status ) ) );
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void setConnected( bool connected )
+{
+    ( void ) xEventGroupClearBits( connectionEvents, ( connected == true ) ? DISCONNECTED_BIT : CONNECTED_BIT );
+    ( void ) xEventGroupSetBits( connectionEvents, ( connected == true ) ? CONNECTED_BIT : DISCONNECTED_BIT );
+}
+
+/*-----------------------------------------------------------*/
+
+static void incomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
+                                     uint16_t packetId,
+                                     MQTTPublishInfo_t * pPublishInfo )
+{
+    ( void ) packetId;
+
+    LATENCY_PROBE_STAMP( LatencyProbeReceive );
+
+    /* The agent sends the PUBACK of a QoS 1 message. */
+    SubscriptionManager_DispatchHandler( &pMqttAgentContext->mqttContext, pPublishInfo );
+
+    /* The radio is awake to receive, so a PINGREQ due soon goes out now. */
+    ( void ) MqttKeepAlive_PingIfDue( &pMqttAgentContext->mqttContext );
+}
+
+/*-----------------------------------------------------------*/
+
+static AgentMessageLane_t selectLane( const MQTTAgentCommand_t * pCommand )
+{
+    AgentMessageLane_t lane = AGENT_MESSAGE_LANE_CONTROL;
+
+    if( pCommand->pCmdContext != NULL )
+    {
+        lane = pCommand->pCmdContext->lane;
+    }
+    else
+    {
+        lane = Agent_MessageDefaultLane( pCommand );
+    }
+
+    return lane;
+}
+
+/*-----------------------------------------------------------*/
+
+static void commandCompleteCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                     MQTTAgentReturnInfo_t * pReturnInfo )
+{
+    pCommandContext->returnCode = pReturnInfo->returnCode;
+
+    /* A QoS 0 publish completes once written to the transport. */
+    if( pCommandContext->probe == true )
+    {
+        LATENCY_PROBE_STAMP( LatencyProbeSend );
+    }
+
+    /* The codes are in the network buffer, and only valid until then. */
+    if( pReturnInfo->pSubackCodes != NULL )
+    {
+        pCommandContext->subackCode = pReturnInfo->pSubackCodes[ 0 ];
+    }
+
+    ( void ) xTaskNotify( pCommandContext->taskToNotify, MQTT_AGENT_TASK_NOTIFY_BIT, eSetBits );
+}
+
+/*-----------------------------------------------------------*/
+
+static void resubscribeCompleteCallback( MQTTAgentCommandContext_t * pCommandContext,
+                                         MQTTAgentReturnInfo_t * pReturnInfo )
+{
+    size_t i;
+
+    ( void ) pCommandContext;
+
+    if( pReturnInfo->returnCode != MQTTSuccess )
+    {
+        LogError( ( "Failed to subscribe again: %s.", MQTT_Status_strerror( pReturnInfo->returnCode ) ) );
+    }
+    else
+    {
+        for( i = 0U; i < resubscribeArgs.numSubscriptions; i++ )
+        {
+            if( pReturnInfo->pSubackCodes[ i ] == ( uint8_t ) MQTTSubAckFailure )
+            {
+                LogError( ( "The broker refused the subscription to %.*s.",
+                            resubscribeList[ i ].topicFilterLength,
+                            resubscribeList[ i ].pTopicFilter ) );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prepareCommand( MQTTAgentCommandContext_t * pCommandContext,
+                            MQTTAgentCommandInfo_t * pCommandInfo )
+{
+    /* The agent task would wait for itself, from a subscription callback. */
+    assert( xTaskGetCurrentTaskHandle() != agentTaskHandle );
+
+    pCommandContext->taskToNotify = xTaskGetCurrentTaskHandle();
+    pCommandContext->returnCode = MQTTIllegalState;
+    pCommandContext->subackCode = 0U;
+    pCommandContext->lane = AGENT_MESSAGE_LANE_CONTROL;
+    pCommandContext->probe = false;
+    #if PUBLISH_SHEDDING_ENABLED
+        pCommandContext->sheddable = false;
+        pCommandContext->shed = false;
+    #endif
+
+    pCommandInfo->cmdCompleteCallback = commandCompleteCallback;
+    pCommandInfo->pCmdCompleteCallbackContext = pCommandContext;
+    pCommandInfo->blockTimeMs = MQTT_AGENT_COMMAND_BLOCK_TIME_MS;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t waitForCommand( MQTTStatus_t queueStatus,
+                                    const MQTTAgentCommandContext_t * pCommandContext )
+{
+    MQTTStatus_t status = queueStatus;
+    uint32_t notifiedBits = 0U;
+
+    if( queueStatus == MQTTSuccess )
+    {
+        /* Without a timeout: the context is on this stack, and the agent
+         * completes every command, failing those in flight when a
+         * reconnect finds no session. Other bits are left to the caller. */
+        do
+        {
+            ( void ) xTaskNotifyWait( 0U, MQTT_AGENT_TASK_NOTIFY_BIT, &notifiedBits, portMAX_DELAY );
+        } while( ( notifiedBits & MQTT_AGENT_TASK_NOTIFY_BIT ) == 0U );
+
+        status = pCommandContext->returnCode;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t publishCommand( MQTTPublishInfo_t * pPublishInfo,
+                                    AgentMessageLane_t lane,
+                                    bool probe )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTAgentCommandContext_t commandContext;
+    MQTTAgentCommandInfo_t commandInfo = { 0 };
+    bool shed = false;
+
+    prepareCommand( &commandContext, &commandInfo );
+    commandContext.lane = lane;
+    commandContext.probe = probe;
+
+    #if PUBLISH_SHEDDING_ENABLED
+        /* Probes measure the link as it is, so they are never shed. */
+        if( ( pPublishInfo->qos == MQTTQoS0 ) && ( lane == AGENT_MESSAGE_LANE_BULK ) && ( probe == false ) )
+        {
+            commandContext.sheddable = PublishShedding_Admit( &commandContext.ticket,
+                                                              pPublishInfo->pTopicName,
+                                                              pPublishInfo->topicNameLength,
+                                                              uxQueueMessagesWaiting( commandMessageContext.bulkQueue ) );
+            shed = ( commandContext.sheddable == false );
+        }
+    #endif
+
+    if( shed == false )
+    {
+        status = MQTTAgent_Publish( &agentContext, pPublishInfo, &commandInfo );
+
+        #if PUBLISH_SHEDDING_ENABLED
+            /* The agent never receives a command that wasn't queued. */
+            if( ( status != MQTTSuccess ) && ( commandContext.sheddable == true ) )
+            {
+                ( void ) PublishShedding_Dequeued( &commandContext.ticket );
+            }
+        #endif
+
+        status = waitForCommand( status, &commandContext );
+
+        #if PUBLISH_SHEDDING_ENABLED
+            shed = commandContext.shed;
+        #endif
+    }
+
+    if( shed == true )
+    {
+        /* Not written, so a caller keeping what it reports, such as the
+         * deltas of the metrics, sends it with the next publish. */
+        status = MQTTNoMemory;
+        LogDebug( ( "Shed a publish to %.*s on the congested uplink.",
+                    pPublishInfo->topicNameLength, pPublishInfo->pTopicName ) );
+    }
+    else if( status != MQTTSuccess )
+    {
+        LogError( ( "Failed to publish to %.*s: %s.",
+                    pPublishInfo->topicNameLength, pPublishInfo->pTopicName,
+                    MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool rememberSubscription( const MQTTSubscribeInfo_t * pSubscribeInfo )
+{
+    AgentSubscription_t * pSubscription = NULL;
+    size_t i;
+
+    if( pSubscribeInfo->topicFilterLength < AGENT_TOPIC_FILTER_SIZE )
+    {
+        ( void ) xSemaphoreTake( subscriptionsMutex, portMAX_DELAY );
+
+        for( i = 0U; ( i < subscriptionCount ) && ( pSubscription == NULL ); i++ )
+        {
+            if( ( subscriptions[ i ].topicFilterLength == pSubscribeInfo->topicFilterLength ) &&
+                ( memcmp( subscriptions[ i ].topicFilter, pSubscribeInfo->pTopicFilter,
+                          pSubscribeInfo->topicFilterLength ) == 0 ) )
+            {
+                pSubscription = &subscriptions[ i ];
+            }
+        }
+
+        if( ( pSubscription == NULL ) && ( subscriptionCount < AGENT_MAX_SUBSCRIPTIONS ) )
+        {
+            pSubscription = &subscriptions[ subscriptionCount++ ];
+            ( void ) memcpy( pSubscription->topicFilter, pSubscribeInfo->pTopicFilter, pSubscribeInfo->topicFilterLength );
+            pSubscription->topicFilter[ pSubscribeInfo->topicFilterLength ] = '\0';
+            pSubscription->topicFilterLength = pSubscribeInfo->topicFilterLength;
+        }
+
+        if( pSubscription != NULL )
+        {
+            pSubscription->qos = pSubscribeInfo->qos;
+        }
+
+        ( void ) xSemaphoreGive( subscriptionsMutex );
+    }
+
+    return pSubscription != NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void forgetSubscription( const char * pTopicFilter,
+                                uint16_t topicFilterLength )
+{
+    size_t i;
+
+    ( void ) xSemaphoreTake( subscriptionsMutex, portMAX_DELAY );
+
+    for( i = 0U; i < subscriptionCount; i++ )
+    {
+        if( ( subscriptions[ i ].topicFilterLength == topicFilterLength ) &&
+            ( memcmp( subscriptions[ i ].topicFilter, pTopicFilter, topicFilterLength ) == 0 ) )
+        {
+            subscriptions[ i ] = subscriptions[ --subscriptionCount ];
+            break;
+        }
+    }
+
+    ( void ) xSemaphoreGive( subscriptionsMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+#if PUBLISH_SHEDDING_ENABLED
+
+    static bool receiveCommand( MQTTAgentMessageContext_t * pMsgCtx,
+                                MQTTAgentCommand_t ** pReceivedCommand,
+                                uint32_t blockTimeMs )
+    {
+        MQTTAgentCommandContext_t * pCommandContext = NULL;
+        MQTTAgentReturnInfo_t returnInfo = { 0 };
+        bool received = Agent_MessageReceive( pMsgCtx, pReceivedCommand, blockTimeMs );
+
+        /* Only the publishes of publishCommand hold a ticket, and every
+         * command is received once, so each ticket is handed back once. */
+        while( ( received == true ) &&
+               ( ( *pReceivedCommand )->pCmdContext != NULL ) &&
+               ( ( *pReceivedCommand )->pCmdContext->sheddable == true ) &&
+               ( PublishShedding_Dequeued( &( *pReceivedCommand )->pCmdContext->ticket ) == false ) )
+        {
+            pCommandContext = ( *pReceivedCommand )->pCmdContext;
+            pCommandContext->shed = true;
+            ( void ) Agent_ReleaseCommand( *pReceivedCommand );
+
+            returnInfo.returnCode = MQTTNoMemory;
+            commandCompleteCallback( pCommandContext, &returnInfo );
+
+            /* The agent goes on with its loop if nothing else is queued. */
+            received = Agent_MessageReceive( pMsgCtx, pReceivedCommand, 0U );
+        }
+
+        return received;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int32_t meteredSend( NetworkContext_t * pNetworkContext,
+                                const void * pBuffer,
+                                size_t bytesToSend )
+    {
+        uint64_t startUs = Clock_GetTimeUs();
+        int32_t bytesSent = espTlsTransportSend( pNetworkContext, pBuffer, bytesToSend );
+
+        #if ( AGENT_CORK_BUFFER_SIZE > 0 )
+            if( corked == false )
+        #endif
+        {
+            PublishShedding_RecordSend( ( uint32_t ) ( Clock_GetTimeUs() - startUs ) );
+        }
+
+        return bytesSent;
+    }
+
+#endif /* if PUBLISH_SHEDDING_ENABLED */
+
+/*-----------------------------------------------------------*/
+
+#if ( AGENT_CORK_BUFFER_SIZE > 0 )
+
+    static void batchBegin( void * pBatchContext )
+    {
+        #if PUBLISH_SHEDDING_ENABLED
+            corked = true;
+        #endif
+
+        vTlsTransportCork( ( NetworkContext_t * ) pBatchContext );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void batchEnd( void * pBatchContext )
+    {
+        int32_t status;
+
+        #if PUBLISH_SHEDDING_ENABLED
+            uint64_t startUs = Clock_GetTimeUs();
+        #endif
+
+        status = lTlsTransportUncork( ( NetworkContext_t * ) pBatchContext );
+
+        #if PUBLISH_SHEDDING_ENABLED
+            /* The whole batch is written here. */
+            corked = false;
+            PublishShedding_RecordSend( ( uint32_t ) ( Clock_GetTimeUs() - startUs ) );
+        #endif
+
+        /* A failed write breaks the connection, which the next receive of
+         * the command loop reports. */
+        if( status != 0 )
+        {
+            LogError( ( "Failed to write out a batch of commands." ) );
+        }
+    }
+
+#endif /* if ( AGENT_CORK_BUFFER_SIZE > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+static void agentTask( void * pParameters )
+{
+    ReconnectPolicy_t reconnectPolicy;
+    ReconnectFailure_t failure = ReconnectFailureNetwork;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    bool sessionPresent = false;
+    bool connectionLost = false;
+    uint32_t nextRetryBackOff = 0U;
+    TickType_t connectedTick = 0U;
+
+    ( void ) pParameters;
+
+    #if MQTT_KEEP_ALIVE_ADAPTIVE
+        MqttKeepAlive_Init( &keepAlive );
+    #endif
+
+    /* The agent never gives up on the connection. */
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           CONNECTION_RETRY_BACKOFF_BASE_MS,
+                           CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                           RECONNECT_POLICY_RETRY_FOREVER );
+
+    for( ; ; )
+    {
+        failure = ReconnectFailureNetwork;
+        connectionLost = false;
+
+        if( connectToBroker( &sessionPresent, &failure ) == true )
+        {
+            mqttStatus = resumeSession( sessionPresent );
+
+            if( mqttStatus == MQTTSuccess )
+            {
+                /* The next drop starts backing off from the base delay. */
+                ReconnectPolicy_Init( &reconnectPolicy,
+                                      CONNECTION_RETRY_BACKOFF_BASE_MS,
+                                      CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                                      RECONNECT_POLICY_RETRY_FOREVER );
+
+                setConnected( true );
+                connectedTick = xTaskGetTickCount();
+
+                /* Sends the commands of the services and receives for them
+                 * until the connection fails. */
+                mqttStatus = MQTTAgent_CommandLoop( &agentContext );
+
+                setConnected( false );
+
+                #if MQTT_KEEP_ALIVE_ADAPTIVE
+                    MqttKeepAlive_ConnectionEnded( &keepAlive, &agentContext.mqttContext, mqttStatus,
+                                                   ( uint32_t ) ( xTaskGetTickCount() - connectedTick ) * portTICK_PERIOD_MS );
+                #else
+                    ( void ) connectedTick;
+                #endif
+
+                LogWarn( ( "MQTT agent command loop exited with status %s.",
+                           MQTT_Status_strerror( mqttStatus ) ) );
+                connectionLost = true;
+            }
+        }
+
+        ( void ) xTlsDisconnect( &networkContext );
+
+        if( connectionLost == true )
+        {
+            /* When the broker goes down, the whole fleet loses it at once,
+             * so the first reconnect is spread. */
+            nextRetryBackOff = ReconnectPolicy_SpreadDelayMs( true );
+        }
+        else
+        {
+            ( void ) ReconnectPolicy_NextDelay( &reconnectPolicy, failure, &nextRetryBackOff );
+        }
+
+        LogInfo( ( "Reconnecting to the broker after %u ms backoff.",
+                   ( unsigned ) nextRetryBackOff ) );
+        vTaskDelay( pdMS_TO_TICKS( nextRetryBackOff ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttAgentTask_Start( void )
+{
+    MQTTStatus_t mqttStatus = MQTTBadParameter;
+    MQTTAgentMessageInterface_t messageInterface = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    TransportInterface_t transport = { 0 };
+    QueueHandle_t controlQueue = NULL;
+    QueueHandle_t bulkQueue = NULL;
+    bool started = false;
+
+    connectionEvents = xEventGroupCreateStatic( &connectionEventsBuffer );
+    subscriptionsMutex = xSemaphoreCreateMutexStatic( &subscriptionsMutexBuffer );
+    setConnected( false );
+
+    initializeNetworkContext();
+
+    /* Bulk publishes, such as metrics reports and stream block requests,
+     * wait behind subscriptions and the other publishes. */
+    Agent_InitializePool();
+    controlQueue = xQueueCreateStatic( AGENT_COMMAND_QUEUE_LENGTH, sizeof( MQTTAgentCommand_t * ),
+                                       ( uint8_t * ) controlQueueStorage, &controlQueueBuffer );
+    bulkQueue = xQueueCreateStatic( AGENT_COMMAND_QUEUE_LENGTH, sizeof( MQTTAgentCommand_t * ),
+                                    ( uint8_t * ) bulkQueueStorage, &bulkQueueBuffer );
+    Agent_MessageInitLanes( &commandMessageContext, controlQueue, bulkQueue, selectLane );
+
+    #if ( AGENT_CORK_BUFFER_SIZE > 0 )
+        Agent_MessageEnableBatching( &commandMessageContext, batchBegin, batchEnd, &networkContext );
+    #endif
+
+    messageInterface.pMsgCtx = &commandMessageContext;
+    messageInterface.send = Agent_MessageSend;
+    #if PUBLISH_SHEDDING_ENABLED
+        messageInterface.recv = receiveCommand;
+    #else
+        messageInterface.recv = Agent_MessageReceive;
+    #endif
+    messageInterface.getCommand = Agent_GetCommand;
+    messageInterface.releaseCommand = Agent_ReleaseCommand;
+
+    transport.pNetworkContext = &networkContext;
+    #if PUBLISH_SHEDDING_ENABLED
+        transport.send = meteredSend;
+    #else
+        transport.send = espTlsTransportSend;
+    #endif
+    transport.recv = espTlsTransportRecv;
+
+    fixedBuffer.pBuffer = networkBuffer;
+    fixedBuffer.size = NETWORK_BUFFER_SIZE;
+
+    mqttStatus = MQTTAgent_Init( &agentContext,
+                                 &messageInterface,
+                                 &fixedBuffer,
+                                 &transport,
+                                 Clock_GetTimeMs,
+                                 incomingPublishCallback,
+                                 NULL );
+
+    #if CONFIG_EXAMPLE_AGENT_OTA && OTA_EVENT_POOL_ZERO_COPY
+        if( mqttStatus == MQTTSuccess )
+        {
+            /* Receive into the slabs before the agent task reads a packet. */
+            OtaEventPool_AttachSlabs( &agentContext.mqttContext, networkBuffer, NETWORK_BUFFER_SIZE );
+        }
+    #endif
+
+    if( mqttStatus != MQTTSuccess )
+    {
+        LogError( ( "MQTT agent init failed: Status = %s.", MQTT_Status_strerror( mqttStatus ) ) );
+    }
+    #if TASK_LAYOUT_ENABLED
+        else if( TaskLayout_CreateTask( TaskLayoutAgent, agentTask, "MQTTAgent", NULL,
+                                        &agentTaskHandle ) != pdPASS )
+    #else
+        else if( xTaskCreate( agentTask, "MQTTAgent", CONFIG_EXAMPLE_AGENT_TASK_STACK_SIZE, NULL,
+                              CONFIG_EXAMPLE_AGENT_TASK_PRIORITY, &agentTaskHandle ) != pdPASS )
+    #endif
+    {
+        LogError( ( "Failed to create the MQTT agent task." ) );
+    }
+    else
+    {
+        started = true;
+    }
+
+    return started;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttAgentTask_WaitForConnection( bool connected,
+                                      TickType_t ticksToWait )
+{
+    EventBits_t bit = ( connected == true ) ? CONNECTED_BIT : DISCONNECTED_BIT;
+
+    return ( xEventGroupWaitBits( connectionEvents, bit, pdFALSE, pdFALSE, ticksToWait ) & bit ) != 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgentTask_Subscribe( const char * pTopicFilter,
+                                      uint16_t topicFilterLength,
+                                      MQTTQoS_t qos )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTAgentCommandContext_t commandContext;
+    MQTTAgentCommandInfo_t commandInfo = { 0 };
+    MQTTSubscribeInfo_t subscribeInfo = { 0 };
+    MQTTAgentSubscribeArgs_t subscribeArgs = { 0 };
+
+    assert( ( pTopicFilter != NULL ) && ( topicFilterLength > 0U ) );
+
+    subscribeInfo.pTopicFilter = pTopicFilter;
+    subscribeInfo.topicFilterLength = topicFilterLength;
+    subscribeInfo.qos = qos;
+    subscribeArgs.pSubscribeInfo = &subscribeInfo;
+    subscribeArgs.numSubscriptions = 1U;
+
+    prepareCommand( &commandContext, &commandInfo );
+    status = waitForCommand( MQTTAgent_Subscribe( &agentContext, &subscribeArgs, &commandInfo ),
+                             &commandContext );
+
+    if( ( status == MQTTSuccess ) && ( commandContext.subackCode == ( uint8_t ) MQTTSubAckFailure ) )
+    {
+        status = MQTTServerRefused;
+    }
+
+    if( status != MQTTSuccess )
+    {
+        LogError( ( "Failed to subscribe to %.*s: %s.",
+                    topicFilterLength, pTopicFilter, MQTT_Status_strerror( status ) ) );
+    }
+    else if( rememberSubscription( &subscribeInfo ) == false )
+    {
+        LogWarn( ( "Subscribed to %.*s, but the subscription won't be restored on a reconnect: "
+                   "all %u slots are in use, or the filter is longer than %u bytes.",
+                   topicFilterLength, pTopicFilter, ( unsigned ) AGENT_MAX_SUBSCRIPTIONS,
+                   ( unsigned ) ( AGENT_TOPIC_FILTER_SIZE - 1U ) ) );
+    }
+    else
+    {
+        LogInfo( ( "Subscribed to %.*s.", topicFilterLength, pTopicFilter ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgentTask_Unsubscribe( const char * pTopicFilter,
+                                        uint16_t topicFilterLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTAgentCommandContext_t commandContext;
+    MQTTAgentCommandInfo_t commandInfo = { 0 };
+    MQTTSubscribeInfo_t subscribeInfo = { 0 };
+    MQTTAgentSubscribeArgs_t subscribeArgs = { 0 };
+
+    assert( ( pTopicFilter != NULL ) && ( topicFilterLength > 0U ) );
+
+    /* Not subscribed again on a reconnect, even if the UNSUBSCRIBE fails. */
+    forgetSubscription( pTopicFilter, topicFilterLength );
+
+    subscribeInfo.pTopicFilter = pTopicFilter;
+    subscribeInfo.topicFilterLength = topicFilterLength;
+    subscribeArgs.pSubscribeInfo = &subscribeInfo;
+    subscribeArgs.numSubscriptions = 1U;
+
+    prepareCommand( &commandContext, &commandInfo );
+    status = waitForCommand( MQTTAgent_Unsubscribe( &agentContext, &subscribeArgs, &commandInfo ),
+                             &commandContext );
+
+    if( status != MQTTSuccess )
+    {
+        LogError( ( "Failed to unsubscribe from %.*s: %s.",
+                    topicFilterLength, pTopicFilter, MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgentTask_Publish( MQTTPublishInfo_t * pPublishInfo )
+{
+    assert( pPublishInfo != NULL );
+
+    return MqttAgentTask_PublishOnLane( pPublishInfo,
+                                        ( pPublishInfo->qos == MQTTQoS0 ) ?
+                                        AGENT_MESSAGE_LANE_BULK : AGENT_MESSAGE_LANE_CONTROL );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgentTask_PublishOnLane( MQTTPublishInfo_t * pPublishInfo,
+                                          AgentMessageLane_t lane )
+{
+    assert( pPublishInfo != NULL );
+
+    return publishCommand( pPublishInfo, lane, false );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgentTask_PublishProbe( MQTTPublishInfo_t * pPublishInfo )
+{
+    assert( ( pPublishInfo != NULL ) && ( pPublishInfo->qos == MQTTQoS0 ) );
+
+    return publishCommand( pPublishInfo, AGENT_MESSAGE_LANE_BULK, true );
+}
+
+/*-----------------------------------------------------------*/
+
+const NetworkContext_t * MqttAgentTask_GetNetworkContext( void )
+{
+    return &networkContext;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttAgentTask_GetQueueStats( AgentMessageStats_t * pStats )
+{
+    return Agent_MessageGetStats( &commandMessageContext, pStats );
+}
@@ -0,0 +1,183 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_agent_task.h
+ * @brief The task owning the MQTT connection shared by the services.
+ *
+ * A single coreMQTT-Agent task holds the TLS connection and the MQTT context.
+ * The services never touch the MQTT context: they queue commands to the agent
+ * with the blocking helpers below, and receive their messages through
+ * callbacks registered with the subscription manager, which the agent task
+ * calls for every incoming PUBLISH.
+ *
+ * The callbacks run on the agent task, so they must not call the helpers,
+ * which would wait for the agent task itself. They hand the message over to
+ * their service instead.
+ *
+ * The helpers wait for the agent on #MQTT_AGENT_TASK_NOTIFY_BIT of the task
+ * notification of the caller, which leaves the other bits to the services.
+ *
+ * Commands are queued in two lanes, and the agent serves the control lane
+ * first. Subscriptions and QoS 1 publishes are control commands, and QoS 0
+ * publishes bulk commands, unless MqttAgentTask_PublishOnLane picks the lane.
+ *
+ * With CONFIG_PUBLISH_SHEDDING_ENABLE, QoS 0 publishes in the bulk lane are
+ * shed by the policy of their topic while the uplink is congested, before
+ * they are queued or while they wait in the queue, and fail with
+ * MQTTNoMemory without being sent.
+ */
+
+#ifndef MQTT_AGENT_TASK_H_
+#define MQTT_AGENT_TASK_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+
+/* MQTT agent port includes. */
+#include "freertos_agent_message.h"
+
+/* Transport interface include. */
+#include "network_transport.h"
+
+/**
+ * @brief The bit of the task notification the helpers wait on.
+ */
+#define MQTT_AGENT_TASK_NOTIFY_BIT    ( 1UL << 31 )
+
+/**
+ * @brief Starts the agent task, which connects and then keeps the connection
+ * up, reconnecting with backoff whenever it drops.
+ *
+ * The subscription manager callbacks of the services must be registered
+ * before, as the registry is read by the agent task without a lock.
+ *
+ * @return true if the task was created.
+ */
+bool MqttAgentTask_Start( void );
+
+/**
+ * @brief Waits for the connection to be up, or down.
+ *
+ * @param[in] connected Whether to wait for the connection to be up.
+ * @param[in] ticksToWait The longest time to wait.
+ *
+ * @return true if the connection is in the state waited for.
+ */
+bool MqttAgentTask_WaitForConnection( bool connected,
+                                      TickType_t ticksToWait );
+
+/**
+ * @brief Subscribes to a topic filter and waits for the SUBACK.
+ *
+ * A copy of the filter is kept, and subscribed again by the agent task if a
+ * reconnect finds no session on the broker.
+ *
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ * @param[in] qos The maximum QoS of the subscription.
+ *
+ * @return MQTTSuccess if the broker granted the subscription,
+ * MQTTServerRefused if it refused it, or the error of the command.
+ */
+MQTTStatus_t MqttAgentTask_Subscribe( const char * pTopicFilter,
+                                      uint16_t topicFilterLength,
+                                      MQTTQoS_t qos );
+
+/**
+ * @brief Unsubscribes from a topic filter and waits for the UNSUBACK.
+ *
+ * @param[in] pTopicFilter The topic filter, as it was subscribed.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ *
+ * @return MQTTSuccess, or the error of the command.
+ */
+MQTTStatus_t MqttAgentTask_Unsubscribe( const char * pTopicFilter,
+                                        uint16_t topicFilterLength );
+
+/**
+ * @brief Publishes a message and waits until it is sent at QoS 0, or
+ * acknowledged at QoS 1.
+ *
+ * The topic and payload are not copied, and must stay valid until the call
+ * returns.
+ *
+ * @param[in] pPublishInfo The message.
+ *
+ * @return MQTTSuccess, MQTTNoMemory if it was shed, or the error of the
+ * command.
+ */
+MQTTStatus_t MqttAgentTask_Publish( MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Publishes a message in the given lane, as #MqttAgentTask_Publish.
+ *
+ * For messages whose QoS doesn't say how urgent they are, such as the QoS 0
+ * job status updates of the OTA agent, which must not wait behind its block
+ * requests.
+ *
+ * @param[in] pPublishInfo The message.
+ * @param[in] lane The lane of the command.
+ *
+ * @return MQTTSuccess, MQTTNoMemory if it was shed, or the error of the
+ * command.
+ */
+MQTTStatus_t MqttAgentTask_PublishOnLane( MQTTPublishInfo_t * pPublishInfo,
+                                          AgentMessageLane_t lane );
+
+/**
+ * @brief Publishes a QoS 0 latency probe in the bulk lane, as
+ * #MqttAgentTask_Publish, and stamps its send when the agent wrote it. A
+ * probe is never shed.
+ *
+ * @param[in] pPublishInfo The probe.
+ *
+ * @return MQTTSuccess, or the error of the command.
+ */
+MQTTStatus_t MqttAgentTask_PublishProbe( MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief The network context of the shared connection, for the metrics of
+ * its transport.
+ */
+const NetworkContext_t * MqttAgentTask_GetNetworkContext( void );
+
+/**
+ * @brief Copies the counters of the command queue of the agent, both lanes
+ * together.
+ *
+ * @param[out] pStats Where to write the counters.
+ *
+ * @return true if CONFIG_MQTT_AGENT_COMMAND_STATS is enabled and @a pStats
+ * was written.
+ */
+bool MqttAgentTask_GetQueueStats( AgentMessageStats_t * pStats );
+
+#endif /* ifndef MQTT_AGENT_TASK_H_ */
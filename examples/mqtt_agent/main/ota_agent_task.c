@@ -0,0 +1,761 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file ota_agent_task.c
+ * @brief The OTA service of the MQTT agent example.
+ *
+ * The OTA agent subscribes and publishes through the agent like the other
+ * services. With the zero-copy mode of the event pool, the network buffer of
+ * the agent is split into slabs, and the subscription manager callbacks hand
+ * the slab holding a job document or stream block to the OTA agent, which
+ * decodes the block from there. Otherwise, or when no slab is free, the
+ * payload is copied into a buffer of the pool.
+ *
+ * The block requests are queued in the bulk lane of the agent, and every other
+ * command of the OTA agent in the control lane, so a download neither delays
+ * the job updates nor the commands of the other services.
+ *
+ * A supervisor task starts the OTA agent on the first connection, resumes it
+ * on the next ones and suspends it while the agent task is disconnected.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_system.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+/* Shedding of QoS 0 publishes on a congested uplink. */
+#include "publish_shedding.h"
+
+/* Core affinity and priority of the tasks. */
+#include "task_layout.h"
+
+#if CONFIG_EXAMPLE_AGENT_OTA
+
+/* OTA Library include. */
+    #include "ota.h"
+    #include "ota_config.h"
+
+/* OTA Library Interface include. */
+    #include "ota_os_freertos.h"
+    #include "ota_mqtt_interface.h"
+    #include "ota_pal.h"
+
+/* Include the buffer pool of the OTA events. */
+    #include "ota_event_pool.h"
+
+/* Include firmware version struct definition. */
+    #include "ota_appversion32.h"
+
+    #if ( CONFIG_MQTT_NETWORK_BUFFER_SIZE < ( ( 1 << CONFIG_LOG2_FILE_BLOCK_SIZE ) + 128 ) )
+        #error "CONFIG_MQTT_NETWORK_BUFFER_SIZE must hold a block of the OTA stream and 128 bytes of headers."
+    #endif
+
+    extern const char pcAwsCodeSigningCertPem[] asm("_binary_aws_codesign_crt_start");
+
+/**
+ * @brief The stack of the OTA agent task, in bytes.
+ */
+    #define OTA_AGENT_TASK_STACK_SIZE        ( 6144U )
+
+/**
+ * @brief The priority of the OTA agent task. It is below the agent task, so
+ * that the blocks are handed over as soon as they are received.
+ */
+    #define OTA_AGENT_TASK_PRIORITY          ( tskIDLE_PRIORITY + 2U )
+
+/**
+ * @brief The stack of the supervisor task, in bytes.
+ */
+    #define OTA_SUPERVISOR_STACK_SIZE        ( 3072U )
+
+/**
+ * @brief The priority of the supervisor task.
+ */
+    #define OTA_SUPERVISOR_PRIORITY          ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief The period of the OTA statistics logged while connected, in
+ * milliseconds.
+ */
+    #define OTA_STATS_INTERVAL_MS            ( 5000U )
+
+/**
+ * @brief The maximum size of the file paths used in the demo.
+ */
+    #define OTA_MAX_FILE_PATH_SIZE           ( 260U )
+
+/**
+ * @brief The maximum size of the stream name required for downloading update
+ * file from streaming service.
+ */
+    #define OTA_MAX_STREAM_NAME_SIZE         ( 128U )
+
+/**
+ * @brief The topic filter of every stream of the thing.
+ */
+    #define OTA_STREAM_TOPIC_FILTER          "$aws/things/+/streams/#"
+
+/**
+ * @brief The end of the topics block requests are published on.
+ */
+    #define OTA_STREAM_REQUEST_SUFFIX        "/get/cbor"
+
+/**
+ * @brief The start of the topics of the streams of this thing.
+ */
+    #define OTA_STREAM_TOPIC_PREFIX          "$aws/things/" THING_NAME "/streams/"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Struct for firmware version.
+ */
+    const AppVersion32_t appFirmwareVersion =
+    {
+        .u.x.major = APP_VERSION_MAJOR,
+        .u.x.minor = APP_VERSION_MINOR,
+        .u.x.build = APP_VERSION_BUILD,
+    };
+
+/**
+ * @brief Update File path buffer.
+ */
+    static uint8_t updateFilePath[ OTA_MAX_FILE_PATH_SIZE ];
+
+/**
+ * @brief Certificate File path buffer.
+ */
+    static uint8_t certFilePath[ OTA_MAX_FILE_PATH_SIZE ];
+
+/**
+ * @brief Stream name buffer.
+ */
+    static uint8_t streamName[ OTA_MAX_STREAM_NAME_SIZE ];
+
+/**
+ * @brief Decode memory.
+ */
+    static uint8_t decodeMem[ otaconfigFILE_BLOCK_SIZE ];
+
+/**
+ * @brief Bitmap memory.
+ */
+    static uint8_t bitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
+
+/**
+ * @brief The buffer passed to the OTA Agent from application while initializing.
+ */
+    static OtaAppBuffer_t otaBuffer =
+    {
+        .pUpdateFilePath    = updateFilePath,
+        .updateFilePathsize = OTA_MAX_FILE_PATH_SIZE,
+        .pCertFilePath      = certFilePath,
+        .certFilePathSize   = OTA_MAX_FILE_PATH_SIZE,
+        .pStreamName        = streamName,
+        .streamNameSize     = OTA_MAX_STREAM_NAME_SIZE,
+        .pDecodeMemory      = decodeMem,
+        .decodeMemorySize   = otaconfigFILE_BLOCK_SIZE,
+        .pFileBitmap        = bitmap,
+        .fileBitmapSize     = OTA_MAX_BLOCK_BITMAP_SIZE
+    };
+
+/**
+ * @brief The library interfaces, which must stay valid while the OTA agent
+ * runs.
+ */
+    static OtaInterfaces_t otaInterfaces;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Takes the slab holding a job document or a block, or copies it into
+ * an event buffer.
+ *
+ * @param[in] pContext The MQTT context of the agent the payload was received with.
+ * @param[in] pPublishInfo The received PUBLISH.
+ *
+ * @return The event, or NULL if no buffer is available.
+ */
+    static OtaEventData_t * otaEventBufferTake( MQTTContext_t * pContext,
+                                                const MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief The callback of the OTA agent for the events of a job.
+ */
+    static void otaAppCallback( OtaJobEvent_t event,
+                                const void * pData );
+
+/**
+ * @brief Hands the job documents of the next pending job to the OTA agent.
+ */
+    static void mqttJobCallback( MQTTContext_t * pContext,
+                                 MQTTPublishInfo_t * pPublishInfo,
+                                 void * pUserContext );
+
+/**
+ * @brief Hands the blocks of a stream to the OTA agent.
+ */
+    static void mqttDataCallback( MQTTContext_t * pContext,
+                                  MQTTPublishInfo_t * pPublishInfo,
+                                  void * pUserContext );
+
+/**
+ * @brief The MQTT interface of the OTA agent, which goes through the agent.
+ */
+    static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
+                                          uint16_t topicFilterLength,
+                                          uint8_t qos );
+    static OtaMqttStatus_t mqttPublish( const char * const pacTopic,
+                                        uint16_t topicLen,
+                                        const char * pMsg,
+                                        uint32_t msgSize,
+                                        uint8_t qos );
+    static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
+                                            uint16_t topicFilterLength,
+                                            uint8_t qos );
+
+/**
+ * @brief Sets the OS, MQTT and PAL interfaces of the OTA agent.
+ */
+    static void setOtaInterfaces( OtaInterfaces_t * pOtaInterfaces );
+
+/**
+ * @brief The task running the OTA agent.
+ */
+    static void otaAgentTask( void * pParameters );
+
+/**
+ * @brief The task following the connection of the agent task.
+ */
+    static void otaSupervisorTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+    static OtaEventData_t * otaEventBufferTake( MQTTContext_t * pContext,
+                                                const MQTTPublishInfo_t * pPublishInfo )
+    {
+        OtaEventData_t * pData = NULL;
+
+        #if OTA_EVENT_POOL_ZERO_COPY
+            pData = OtaEventPool_TakePayload( pContext, pPublishInfo );
+        #else
+            ( void ) pContext;
+        #endif
+
+        if( ( pData == NULL ) && ( pPublishInfo->payloadLength <= OTA_DATA_BLOCK_SIZE ) )
+        {
+            pData = OtaEventPool_Get();
+
+            if( pData != NULL )
+            {
+                ( void ) memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+                pData->dataLength = pPublishInfo->payloadLength;
+            }
+        }
+
+        return pData;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void otaAppCallback( OtaJobEvent_t event,
+                                const void * pData )
+    {
+        OtaErr_t err = OtaErrUninitialized;
+        esp_err_t ret = ESP_OK;
+
+        switch( event )
+        {
+            case OtaJobEventActivate:
+                LogInfo( ( "Received OtaJobEventActivate callback from OTA Agent." ) );
+
+                /* Activate the new firmware image. */
+                OTA_ActivateNewImage();
+
+                /* Shutdown OTA Agent, if it is required that the unsubscribe operations are not
+                 * performed while shutting down please set the second parameter to 0 instead of 1. */
+                OTA_Shutdown( 0, 1 );
+
+                /* Requires manual activation of new image.*/
+                LogError( ( "New image activation failed." ) );
+
+                break;
+
+            case OtaJobEventFail:
+                LogInfo( ( "Received OtaJobEventFail callback from OTA Agent." ) );
+
+                /* Nothing special to do. The OTA agent handles it. */
+                break;
+
+            case OtaJobEventStartTest:
+
+                /* The image is accepted, as the other services reached the
+                 * broker with it over the same connection. */
+                LogInfo( ( "Received OtaJobEventStartTest callback from OTA Agent." ) );
+                err = OTA_SetImageState( OtaImageStateAccepted );
+
+                if( err == OtaErrNone )
+                {
+                    /* Erasing passive partition */
+                    ret = otaPal_EraseLastBootPartition();
+
+                    if( ret != ESP_OK )
+                    {
+                        LogError( ( "Failed to erase last boot partition! (%d)", ret ) );
+                    }
+                }
+                else
+                {
+                    LogError( ( "Failed to set image state as accepted." ) );
+                }
+
+                break;
+
+            case OtaJobEventProcessed:
+                LogDebug( ( "Received OtaJobEventProcessed callback from OTA Agent." ) );
+
+                if( pData != NULL )
+                {
+                    OtaEventPool_Free( ( OtaEventData_t * ) pData );
+                }
+
+                break;
+
+            case OtaJobEventSelfTestFailed:
+                LogDebug( ( "Received OtaJobEventSelfTestFailed callback from OTA Agent." ) );
+
+                /* Requires manual activation of previous image as self-test for
+                 * new image downloaded failed.*/
+                LogError( ( "Self-test failed, shutting down OTA Agent." ) );
+
+                /* Shutdown OTA Agent, if it is required that the unsubscribe operations are not
+                 * performed while shutting down please set the second parameter to 0 instead of 1. */
+                OTA_Shutdown( 0, 1 );
+
+                break;
+
+            default:
+                LogDebug( ( "Received invalid callback event from OTA Agent." ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void mqttJobCallback( MQTTContext_t * pContext,
+                                 MQTTPublishInfo_t * pPublishInfo,
+                                 void * pUserContext )
+    {
+        OtaEventData_t * pData = NULL;
+        OtaEventMsg_t eventMsg = { 0 };
+
+        assert( pPublishInfo != NULL );
+
+        ( void ) pUserContext;
+
+        switch( ThingTopics_Classify( &thingTopics, pPublishInfo->pTopicName, pPublishInfo->topicNameLength ) )
+        {
+            case ThingTopicJobsNextGetAccepted:
+            case ThingTopicJobsNotifyNext:
+
+                pData = otaEventBufferTake( pContext, pPublishInfo );
+
+                if( pData != NULL )
+                {
+                    eventMsg.eventId = OtaAgentEventReceivedJobDocument;
+                    eventMsg.pEventData = pData;
+
+                    /* Send job document received event. */
+                    OTA_SignalEvent( &eventMsg );
+                }
+                else
+                {
+                    LogRateLimited( LogError, ( "No OTA data buffers available." ) );
+                }
+
+                break;
+
+            default:
+                LogInfo( ( "Received job message %.*s size %zu.",
+                           pPublishInfo->topicNameLength,
+                           pPublishInfo->pTopicName,
+                           pPublishInfo->payloadLength ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void mqttDataCallback( MQTTContext_t * pContext,
+                                  MQTTPublishInfo_t * pPublishInfo,
+                                  void * pUserContext )
+    {
+        OtaEventData_t * pData = NULL;
+        OtaEventMsg_t eventMsg = { 0 };
+
+        assert( pPublishInfo != NULL );
+
+        ( void ) pUserContext;
+
+        LogDebug( ( "Received data message callback, size %zu.", pPublishInfo->payloadLength ) );
+
+        #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+            OtaRequestWindow_BlockReceived();
+        #endif
+
+        pData = otaEventBufferTake( pContext, pPublishInfo );
+
+        if( pData != NULL )
+        {
+            eventMsg.eventId = OtaAgentEventReceivedFileBlock;
+            eventMsg.pEventData = pData;
+
+            /* Send file block received event. */
+            OTA_SignalEvent( &eventMsg );
+        }
+        else
+        {
+            LogRateLimited( LogError, ( "No OTA data buffers available." ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
+                                          uint16_t topicFilterLength,
+                                          uint8_t qos )
+    {
+        OtaMqttStatus_t otaRet = OtaMqttSuccess;
+
+        assert( ( pTopicFilter != NULL ) && ( topicFilterLength > 0U ) );
+
+        /* The callbacks were registered by OtaAgent_Init, as the registry
+         * isn't shared safely with the agent task once it runs. */
+        if( MqttAgentTask_Subscribe( pTopicFilter, topicFilterLength, ( MQTTQoS_t ) qos ) != MQTTSuccess )
+        {
+            otaRet = OtaMqttSubscribeFailed;
+        }
+
+        return otaRet;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Whether a publish on the topic is a request for blocks of a stream. */
+    static bool isStreamRequest( const char * pacTopic,
+                                 uint16_t topicLen )
+    {
+        const size_t suffixLen = sizeof( OTA_STREAM_REQUEST_SUFFIX ) - 1U;
+
+        return ( topicLen >= suffixLen ) &&
+               ( memcmp( &pacTopic[ topicLen - suffixLen ], OTA_STREAM_REQUEST_SUFFIX, suffixLen ) == 0 );
+    }
+
+    static OtaMqttStatus_t mqttPublish( const char * const pacTopic,
+                                        uint16_t topicLen,
+                                        const char * pMsg,
+                                        uint32_t msgSize,
+                                        uint8_t qos )
+    {
+        OtaMqttStatus_t otaRet = OtaMqttSuccess;
+        MQTTPublishInfo_t publishInfo = { 0 };
+        bool streamRequest = isStreamRequest( pacTopic, topicLen );
+
+        publishInfo.pTopicName = pacTopic;
+        publishInfo.topicNameLength = topicLen;
+        publishInfo.qos = ( MQTTQoS_t ) qos;
+        publishInfo.pPayload = pMsg;
+        publishInfo.payloadLength = msgSize;
+
+        #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+            /* Start timing the request before its blocks can arrive. */
+            if( streamRequest == true )
+            {
+                OtaRequestWindow_RequestSent();
+            }
+        #endif
+
+        /* Only the block requests are bulk traffic. The job status updates
+         * go in the control lane even at QoS 0, so that a job isn't left
+         * waiting behind the blocks of its own download. */
+        if( MqttAgentTask_PublishOnLane( &publishInfo, ( streamRequest == true ) ?
+                                         AGENT_MESSAGE_LANE_BULK : AGENT_MESSAGE_LANE_CONTROL ) != MQTTSuccess )
+        {
+            otaRet = OtaMqttPublishFailed;
+        }
+
+        return otaRet;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
+                                            uint16_t topicFilterLength,
+                                            uint8_t qos )
+    {
+        OtaMqttStatus_t otaRet = OtaMqttSuccess;
+
+        ( void ) qos;
+
+        if( MqttAgentTask_Unsubscribe( pTopicFilter, topicFilterLength ) != MQTTSuccess )
+        {
+            otaRet = OtaMqttUnsubscribeFailed;
+        }
+
+        return otaRet;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void setOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
+    {
+        /* Initialize OTA library OS Interface. */
+        pOtaInterfaces->os.event.init = OtaInitEvent_FreeRTOS;
+        pOtaInterfaces->os.event.send = OtaSendEvent_FreeRTOS;
+        pOtaInterfaces->os.event.recv = OtaReceiveEvent_FreeRTOS;
+        pOtaInterfaces->os.event.deinit = OtaDeinitEvent_FreeRTOS;
+        pOtaInterfaces->os.timer.start = OtaStartTimer_FreeRTOS;
+        pOtaInterfaces->os.timer.stop = OtaStopTimer_FreeRTOS;
+        pOtaInterfaces->os.timer.delete = OtaDeleteTimer_FreeRTOS;
+        pOtaInterfaces->os.mem.malloc = Malloc_FreeRTOS;
+        pOtaInterfaces->os.mem.free = Free_FreeRTOS;
+
+        /* Initialize the OTA library MQTT Interface.*/
+        pOtaInterfaces->mqtt.subscribe = mqttSubscribe;
+        pOtaInterfaces->mqtt.publish = mqttPublish;
+        pOtaInterfaces->mqtt.unsubscribe = mqttUnsubscribe;
+
+        /* Initialize the OTA library PAL Interface.*/
+        pOtaInterfaces->pal.getPlatformImageState = otaPal_GetPlatformImageState;
+        pOtaInterfaces->pal.setPlatformImageState = otaPal_SetPlatformImageState;
+        pOtaInterfaces->pal.writeBlock = otaPal_WriteBlock;
+        pOtaInterfaces->pal.activate = otaPal_ActivateNewImage;
+        pOtaInterfaces->pal.closeFile = otaPal_CloseFile;
+        pOtaInterfaces->pal.reset = otaPal_ResetDevice;
+        pOtaInterfaces->pal.abort = otaPal_Abort;
+        pOtaInterfaces->pal.createFile = otaPal_CreateFileForRx;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void otaAgentTask( void * pParameters )
+    {
+        /* Calling OTA agent task. */
+        OTA_EventProcessingTask( pParameters );
+        LogInfo( ( "OTA Agent stopped." ) );
+        vTaskDelete( NULL );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void otaSupervisorTask( void * pParameters )
+    {
+        OtaEventMsg_t eventMsg = { 0 };
+        OtaAgentStatistics_t otaStatistics = { 0 };
+        OtaEventPoolStats_t poolStats = { 0 };
+        bool started = false;
+
+        ( void ) pParameters;
+
+        while( OTA_GetState() != OtaAgentStateStopped )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+
+            if( started == false )
+            {
+                /* Send start event to OTA Agent.*/
+                eventMsg.eventId = OtaAgentEventStart;
+                OTA_SignalEvent( &eventMsg );
+                started = true;
+            }
+            else if( OTA_GetState() == OtaAgentStateSuspended )
+            {
+                /* The agent task restored the subscriptions of the OTA agent. */
+                ( void ) OTA_Resume();
+            }
+
+            while( MqttAgentTask_WaitForConnection( false, pdMS_TO_TICKS( OTA_STATS_INTERVAL_MS ) ) == false )
+            {
+                /* Get OTA statistics for currently executing job. */
+                OTA_GetStatistics( &otaStatistics );
+
+                LogInfo( ( " Received: %u   Queued: %u   Processed: %u   Dropped: %u",
+                           otaStatistics.otaPacketsReceived,
+                           otaStatistics.otaPacketsQueued,
+                           otaStatistics.otaPacketsProcessed,
+                           otaStatistics.otaPacketsDropped ) );
+
+                /* Get event buffer pool statistics. */
+                OtaEventPool_GetStats( &poolStats );
+
+                LogInfo( ( " Event buffers in use: %u   High-water: %u   Dropped for lack of a buffer: %u",
+                           poolStats.inUse,
+                           poolStats.highWater,
+                           poolStats.drops ) );
+            }
+
+            /* Suspend OTA operations until the agent task reconnects. */
+            if( OTA_Suspend() != OtaErrNone )
+            {
+                LogError( ( "OTA failed to suspend." ) );
+            }
+        }
+
+        LogInfo( ( "OTA supervisor stopped." ) );
+        vTaskDelete( NULL );
+    }
+
+/*-----------------------------------------------------------*/
+
+    #if CONFIG_OTA_PAL_FAST_COMMIT
+
+/* Checks run on a new image before it is committed. A real device would check
+ * its own peripherals and services here; the demo only needs the heap it runs on. */
+        static bool otaHealthCheck( void )
+        {
+            return esp_get_free_heap_size() > 0;
+        }
+
+    #endif
+
+/*-----------------------------------------------------------*/
+
+    bool OtaAgent_Init( void )
+    {
+        uint16_t notifyNextLength = 0U;
+        uint16_t nextAcceptedLength = 0U;
+        const char * pNotifyNext = ThingTopics_Get( &thingTopics, ThingTopicJobsNotifyNext, &notifyNextLength );
+        const char * pNextAccepted = ThingTopics_Get( &thingTopics, ThingTopicJobsNextGetAccepted, &nextAcceptedLength );
+        bool registered = false;
+
+        OtaEventPool_Init();
+
+        /* The exact next job topics leave the other jobs topics to the Jobs
+         * service. */
+        registered = ( SubscriptionManager_RegisterCallback( pNotifyNext, notifyNextLength,
+                                                             mqttJobCallback, NULL ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS ) &&
+                     ( SubscriptionManager_RegisterCallback( pNextAccepted, nextAcceptedLength,
+                                                             mqttJobCallback, NULL ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS ) &&
+                     ( SubscriptionManager_RegisterCallback( OTA_STREAM_TOPIC_FILTER,
+                                                             sizeof( OTA_STREAM_TOPIC_FILTER ) - 1U,
+                                                             mqttDataCallback, NULL ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS );
+
+        #if PUBLISH_SHEDDING_ENABLED
+            /* A shed block request stalls the download until the OTA agent
+             * times out and asks again, which costs more than the request. */
+            registered = registered &&
+                         PublishShedding_AddRule( OTA_STREAM_TOPIC_PREFIX, PublishSheddingKeep, 1U );
+        #endif
+
+        if( registered == false )
+        {
+            LogError( ( "Failed to register the OTA callbacks." ) );
+        }
+
+        return registered;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool OtaAgent_Start( void )
+    {
+        OtaErr_t otaRet = OtaErrNone;
+        bool status = true;
+
+        setOtaInterfaces( &otaInterfaces );
+
+        /* Set OTA Code Signing Certificate */
+        if( !otaPal_SetCodeSigningCertificate( pcAwsCodeSigningCertPem ) )
+        {
+            LogError( ( "Failed to allocate memory for Code Signing Certificate" ) );
+            status = false;
+        }
+
+        #if CONFIG_OTA_PAL_FAST_COMMIT
+            /* Commit an image in self test now rather than after the job round trip. */
+            ( void ) otaPal_FastCommit( otaHealthCheck );
+        #endif
+
+        LogInfo( ( "OTA over the MQTT agent, Application version %u.%u.%u",
+                   appFirmwareVersion.u.x.major,
+                   appFirmwareVersion.u.x.minor,
+                   appFirmwareVersion.u.x.build ) );
+
+        if( status == true )
+        {
+            if( ( otaRet = OTA_Init( &otaBuffer,
+                                     &otaInterfaces,
+                                     ( const uint8_t * ) ( CLIENT_IDENTIFIER ),
+                                     otaAppCallback ) ) != OtaErrNone )
+            {
+                LogError( ( "Failed to initialize OTA Agent, exiting = %u.", otaRet ) );
+                status = false;
+            }
+        }
+
+        #if TASK_LAYOUT_ENABLED
+            status = status &&
+                     ( TaskLayout_CreateTask( TaskLayoutOta, otaAgentTask, "OtaAgent", NULL,
+                                              NULL ) == pdPASS ) &&
+        #else
+            status = status &&
+                     ( xTaskCreate( otaAgentTask, "OtaAgent", OTA_AGENT_TASK_STACK_SIZE, NULL,
+                                    OTA_AGENT_TASK_PRIORITY, NULL ) == pdPASS ) &&
+        #endif
+                     ( xTaskCreate( otaSupervisorTask, "OtaSupervisor", OTA_SUPERVISOR_STACK_SIZE, NULL,
+                                    OTA_SUPERVISOR_PRIORITY, NULL ) == pdPASS );
+
+        return status;
+    }
+
+#else /* if CONFIG_EXAMPLE_AGENT_OTA */
+
+    bool OtaAgent_Init( void )
+    {
+        return true;
+    }
+
+    bool OtaAgent_Start( void )
+    {
+        return true;
+    }
+
+#endif /* if CONFIG_EXAMPLE_AGENT_OTA */
@@ -0,0 +1,580 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_agent_task.c
+ * @brief The Device Shadow service of the MQTT agent example.
+ *
+ * The service reports a powerOn state to the classic shadow of the thing,
+ * and reports it again whenever a delta changes it. The delta callback runs
+ * on the agent task, so it only records the new state and wakes the service
+ * task, which publishes the report.
+ *
+ * The named shadows listed in CONFIG_EXAMPLE_AGENT_SHADOW_NAMES are followed
+ * the same way, through the named shadow manager: their messages arrive on
+ * three wildcard subscriptions however many shadows there are.
+ *
+ * With CONFIG_EXAMPLE_AGENT_SHADOW_REPORT_INTERVAL_MS, the classic shadow is
+ * also reported again at that interval without a delta, as a steady load
+ * for soak runs.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* JSON library includes. */
+#include "core_json.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+/* Include the named shadow manager. */
+#include "named_shadows.h"
+
+/* Include the performance metrics registry. */
+#include "perf_metrics.h"
+
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+#if CONFIG_EXAMPLE_AGENT_SHADOW
+
+/**
+ * @brief The stack of the service task, in bytes.
+ */
+    #define SHADOW_TASK_STACK_SIZE    ( 4096U )
+
+/**
+ * @brief The priority of the service task, below the agent task.
+ */
+    #define SHADOW_TASK_PRIORITY      ( tskIDLE_PRIORITY + 2U )
+
+/**
+ * @brief The bit of the task notification a delta of the classic shadow
+ * sets, and of the first named shadow, the next named shadows taking the
+ * next bits.
+ */
+    #define SHADOW_DELTA_BIT          ( 1UL << 0 )
+    #define NAMED_SHADOW_DELTA_BIT    ( 1UL << 1 )
+
+/**
+ * @brief The most named shadows followed, one notification bit each.
+ */
+    #define MAX_NAMED_SHADOWS         ( 16U )
+
+/**
+ * @brief The size of the buffer the topic of a named shadow is written into.
+ */
+    #define NAMED_SHADOW_TOPIC_SIZE   ( 256U )
+
+/**
+ * @brief How long the service waits for a delta before it reports the state
+ * of the classic shadow again.
+ */
+    #if ( CONFIG_EXAMPLE_AGENT_SHADOW_REPORT_INTERVAL_MS > 0 )
+        #define SHADOW_REPORT_WAIT    pdMS_TO_TICKS( CONFIG_EXAMPLE_AGENT_SHADOW_REPORT_INTERVAL_MS )
+    #else
+        #define SHADOW_REPORT_WAIT    portMAX_DELAY
+    #endif
+
+/**
+ * @brief The format of the reported state, with the state and a client
+ * token.
+ */
+    #define SHADOW_REPORTED_JSON       \
+    "{"                                \
+    "\"state\":{"                      \
+    "\"reported\":{"                   \
+    "\"powerOn\":%lu"                  \
+    "}"                                \
+    "},"                               \
+    "\"clientToken\":\"%06lu\""        \
+    "}"
+
+/**
+ * @brief The size of the buffer the reported state is written into.
+ */
+    #define SHADOW_REPORTED_JSON_SIZE    ( sizeof( SHADOW_REPORTED_JSON ) + 16U )
+
+/**
+ * @brief The service task, woken by deltas.
+ */
+    static TaskHandle_t shadowTaskHandle = NULL;
+
+/**
+ * @brief The state reported, and the desired state received in the last
+ * delta. The desired state is written by the agent task.
+ */
+    static uint32_t currentPowerOnState = 0U;
+    static uint32_t desiredPowerOnState = 0U;
+
+/**
+ * @brief The version of the last delta applied.
+ */
+    static uint32_t currentVersion = 0U;
+
+/**
+ * @brief The named shadows, and the states reported to them and received in
+ * their last deltas, indexed as #namedShadowTable.
+ */
+    static NamedShadows_t namedShadows;
+    static NamedShadow_t namedShadowTable[ MAX_NAMED_SHADOWS ];
+    static size_t namedShadowCount = 0U;
+    static uint32_t namedCurrentPowerOnStates[ MAX_NAMED_SHADOWS ];
+    static uint32_t namedDesiredPowerOnStates[ MAX_NAMED_SHADOWS ];
+
+/**
+ * @brief The reports published, to the classic and the named shadows.
+ */
+    PERF_METRICS_COUNTER( reportsMetric, "shadow_reports" );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Records the desired state of a delta and wakes the service task.
+ */
+    static void deltaCallback( MQTTContext_t * pContext,
+                               MQTTPublishInfo_t * pPublishInfo,
+                               void * pUserContext );
+
+/**
+ * @brief Logs the response to a report.
+ */
+    static void updateResponseCallback( MQTTContext_t * pContext,
+                                        MQTTPublishInfo_t * pPublishInfo,
+                                        void * pUserContext );
+
+/**
+ * @brief Records the desired state of a delta of a named shadow and wakes
+ * the service task, or logs the response to a report.
+ */
+    static void namedShadowCallback( NamedShadow_t * pShadow,
+                                     NamedShadowTopic_t topic,
+                                     MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Fills #namedShadowTable from the comma separated names of
+ * CONFIG_EXAMPLE_AGENT_SHADOW_NAMES.
+ *
+ * @return false if there are too many names.
+ */
+    static bool loadShadowNames( void );
+
+/**
+ * @brief Subscribes to the shadow topics the service receives on.
+ */
+    static bool subscribeToShadowTopics( void );
+
+/**
+ * @brief Publishes a state to a shadow.
+ *
+ * @param[in] pTopic The update topic of the shadow.
+ * @param[in] topicLength The length of @p pTopic.
+ * @param[in] powerOn The state.
+ */
+    static void reportState( const char * pTopic,
+                             uint16_t topicLength,
+                             uint32_t powerOn );
+
+/**
+ * @brief Publishes the current state to a named shadow.
+ */
+    static void reportNamedState( size_t index );
+
+/**
+ * @brief The service task.
+ */
+    static void shadowTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+    static void deltaCallback( MQTTContext_t * pContext,
+                               MQTTPublishInfo_t * pPublishInfo,
+                               void * pUserContext )
+    {
+        JSONStatus_t result = JSONSuccess;
+        char * pOutValue = NULL;
+        size_t outValueLength = 0U;
+        uint32_t version = 0U;
+
+        ( void ) pContext;
+        ( void ) pUserContext;
+
+        result = JSON_Validate( ( const char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength );
+
+        if( result == JSONSuccess )
+        {
+            result = JSON_Search( ( char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength,
+                                  "version", sizeof( "version" ) - 1,
+                                  &pOutValue, &outValueLength );
+        }
+
+        if( result == JSONSuccess )
+        {
+            version = ( uint32_t ) strtoul( pOutValue, NULL, 10 );
+
+            /* Deltas can arrive twice, and out of order. */
+            if( version <= currentVersion )
+            {
+                LogWarn( ( "Dropped a shadow delta of version %u, older than version %u.",
+                           ( unsigned ) version, ( unsigned ) currentVersion ) );
+                result = JSONNotFound;
+            }
+            else
+            {
+                currentVersion = version;
+                result = JSON_Search( ( char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength,
+                                      "state.powerOn", sizeof( "state.powerOn" ) - 1,
+                                      &pOutValue, &outValueLength );
+            }
+        }
+
+        if( result == JSONSuccess )
+        {
+            __atomic_store_n( &desiredPowerOnState, ( uint32_t ) strtoul( pOutValue, NULL, 10 ), __ATOMIC_RELAXED );
+            ( void ) xTaskNotify( shadowTaskHandle, SHADOW_DELTA_BIT, eSetBits );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void updateResponseCallback( MQTTContext_t * pContext,
+                                        MQTTPublishInfo_t * pPublishInfo,
+                                        void * pUserContext )
+    {
+        ( void ) pContext;
+
+        if( pUserContext == NULL )
+        {
+            LogDebug( ( "Shadow update accepted." ) );
+        }
+        else
+        {
+            LogError( ( "Shadow update rejected: %.*s",
+                        ( int ) pPublishInfo->payloadLength,
+                        ( const char * ) pPublishInfo->pPayload ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void namedShadowCallback( NamedShadow_t * pShadow,
+                                     NamedShadowTopic_t topic,
+                                     MQTTPublishInfo_t * pPublishInfo )
+    {
+        size_t index = ( size_t ) ( uintptr_t ) pShadow->pUserContext;
+        char * pOutValue = NULL;
+        size_t outValueLength = 0U;
+
+        /* The manager already dropped the deltas that aren't newer. */
+        if( ( topic == NamedShadowUpdateDelta ) &&
+            ( JSON_Validate( ( const char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength ) == JSONSuccess ) &&
+            ( JSON_Search( ( char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength,
+                           "state.powerOn", sizeof( "state.powerOn" ) - 1,
+                           &pOutValue, &outValueLength ) == JSONSuccess ) )
+        {
+            __atomic_store_n( &namedDesiredPowerOnStates[ index ], ( uint32_t ) strtoul( pOutValue, NULL, 10 ), __ATOMIC_RELAXED );
+            ( void ) xTaskNotify( shadowTaskHandle, NAMED_SHADOW_DELTA_BIT << index, eSetBits );
+        }
+        else if( topic == NamedShadowUpdateAccepted )
+        {
+            LogDebug( ( "Shadow %.*s update accepted.", ( int ) pShadow->nameLength, pShadow->pName ) );
+        }
+        else if( topic == NamedShadowUpdateRejected )
+        {
+            LogError( ( "Shadow %.*s update rejected: %.*s",
+                        ( int ) pShadow->nameLength, pShadow->pName,
+                        ( int ) pPublishInfo->payloadLength,
+                        ( const char * ) pPublishInfo->pPayload ) );
+        }
+        else
+        {
+            /* Not used by the service. */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool loadShadowNames( void )
+    {
+        static const char names[] = CONFIG_EXAMPLE_AGENT_SHADOW_NAMES;
+        const char * pName = names;
+        const char * pEnd = NULL;
+        bool loaded = true;
+
+        while( ( *pName != '\0' ) && ( loaded == true ) )
+        {
+            pEnd = strchr( pName, ',' );
+
+            if( pEnd == NULL )
+            {
+                pEnd = pName + strlen( pName );
+            }
+
+            if( pEnd == pName )
+            {
+                /* An empty name, between two commas. */
+            }
+            else if( namedShadowCount == MAX_NAMED_SHADOWS )
+            {
+                LogError( ( "More than %u named shadows.", ( unsigned ) MAX_NAMED_SHADOWS ) );
+                loaded = false;
+            }
+            else
+            {
+                namedShadowTable[ namedShadowCount ].pName = pName;
+                namedShadowTable[ namedShadowCount ].nameLength = ( uint16_t ) ( pEnd - pName );
+                namedShadowTable[ namedShadowCount ].callback = namedShadowCallback;
+                namedShadowTable[ namedShadowCount ].pUserContext = ( void * ) ( uintptr_t ) namedShadowCount;
+                namedShadowCount++;
+            }
+
+            pName = ( *pEnd == ',' ) ? ( pEnd + 1 ) : pEnd;
+        }
+
+        return loaded;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool subscribeToShadowTopics( void )
+    {
+        static const ThingTopic_t topics[] =
+        {
+            ThingTopicShadowUpdateDelta,
+            ThingTopicShadowUpdateAccepted,
+            ThingTopicShadowUpdateRejected
+        };
+        const char * pTopic = NULL;
+        uint16_t topicLength = 0U;
+        bool subscribed = true;
+        size_t i;
+
+        for( i = 0U; ( i < ( sizeof( topics ) / sizeof( topics[ 0 ] ) ) ) && ( subscribed == true ); i++ )
+        {
+            pTopic = ThingTopics_Get( &thingTopics, topics[ i ], &topicLength );
+            subscribed = ( MqttAgentTask_Subscribe( pTopic, topicLength, MQTTQoS1 ) == MQTTSuccess );
+        }
+
+        /* The same three filters however many named shadows there are. */
+        for( i = 0U; ( i < NAMED_SHADOWS_FILTER_COUNT ) && ( namedShadowCount > 0U ) && ( subscribed == true ); i++ )
+        {
+            pTopic = NamedShadows_GetFilter( &namedShadows, i, &topicLength );
+            subscribed = ( MqttAgentTask_Subscribe( pTopic, topicLength, MQTTQoS1 ) == MQTTSuccess );
+        }
+
+        return subscribed;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void reportState( const char * pTopic,
+                             uint16_t topicLength,
+                             uint32_t powerOn )
+    {
+        char payload[ SHADOW_REPORTED_JSON_SIZE ];
+        MQTTPublishInfo_t publishInfo = { 0 };
+        int length = 0;
+
+        length = snprintf( payload, sizeof( payload ), SHADOW_REPORTED_JSON,
+                           ( unsigned long ) powerOn,
+                           ( unsigned long ) ( xTaskGetTickCount() % 1000000U ) );
+        assert( ( length > 0 ) && ( ( size_t ) length < sizeof( payload ) ) );
+
+        publishInfo.qos = MQTTQoS1;
+        publishInfo.pTopicName = pTopic;
+        publishInfo.topicNameLength = topicLength;
+        publishInfo.pPayload = payload;
+        publishInfo.payloadLength = ( size_t ) length;
+
+        if( MqttAgentTask_Publish( &publishInfo ) == MQTTSuccess )
+        {
+            PERF_METRICS_REGISTER( reportsMetric );
+            PERF_METRICS_ADD( reportsMetric, 1U );
+
+            LogInfo( ( "Reported powerOn %u to %.*s.", ( unsigned ) powerOn, ( int ) topicLength, pTopic ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void reportNamedState( size_t index )
+    {
+        char topic[ NAMED_SHADOW_TOPIC_SIZE ];
+        uint16_t topicLength = 0U;
+
+        topicLength = NamedShadows_GetTopic( &namedShadows, &namedShadowTable[ index ], "update",
+                                             topic, sizeof( topic ) );
+
+        if( topicLength == 0U )
+        {
+            LogError( ( "The update topic of shadow %.*s is longer than %u bytes.",
+                        ( int ) namedShadowTable[ index ].nameLength, namedShadowTable[ index ].pName,
+                        ( unsigned ) sizeof( topic ) ) );
+        }
+        else
+        {
+            reportState( topic, topicLength, namedCurrentPowerOnStates[ index ] );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void shadowTask( void * pParameters )
+    {
+        uint32_t notifiedBits = 0U;
+        bool subscribed = false;
+        const char * pUpdateTopic = NULL;
+        uint16_t updateTopicLength = 0U;
+        size_t i;
+
+        ( void ) pParameters;
+
+        /* The agent subscribes again after a reconnect, so this is done once. */
+        while( subscribed == false )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            subscribed = subscribeToShadowTopics();
+        }
+
+        pUpdateTopic = ThingTopics_Get( &thingTopics, ThingTopicShadowUpdate, &updateTopicLength );
+        reportState( pUpdateTopic, updateTopicLength, currentPowerOnState );
+
+        for( i = 0U; i < namedShadowCount; i++ )
+        {
+            reportNamedState( i );
+        }
+
+        for( ; ; )
+        {
+            if( xTaskNotifyWait( 0U, UINT32_MAX, &notifiedBits, SHADOW_REPORT_WAIT ) == pdFALSE )
+            {
+                /* No delta within the report interval. */
+                notifiedBits = 0U;
+                reportState( pUpdateTopic, updateTopicLength, currentPowerOnState );
+            }
+
+            if( ( notifiedBits & SHADOW_DELTA_BIT ) != 0U )
+            {
+                currentPowerOnState = __atomic_load_n( &desiredPowerOnState, __ATOMIC_RELAXED );
+                LogInfo( ( "The shadow asks for powerOn %u.", ( unsigned ) currentPowerOnState ) );
+
+                reportState( pUpdateTopic, updateTopicLength, currentPowerOnState );
+            }
+
+            for( i = 0U; i < namedShadowCount; i++ )
+            {
+                if( ( notifiedBits & ( NAMED_SHADOW_DELTA_BIT << i ) ) != 0U )
+                {
+                    namedCurrentPowerOnStates[ i ] = __atomic_load_n( &namedDesiredPowerOnStates[ i ], __ATOMIC_RELAXED );
+                    LogInfo( ( "Shadow %.*s asks for powerOn %u.",
+                               ( int ) namedShadowTable[ i ].nameLength, namedShadowTable[ i ].pName,
+                               ( unsigned ) namedCurrentPowerOnStates[ i ] ) );
+
+                    reportNamedState( i );
+                }
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool ShadowAgent_Init( void )
+    {
+        static const char rejected = 1;
+        const char * pTopic = NULL;
+        uint16_t topicLength = 0U;
+        bool registered = false;
+
+        pTopic = ThingTopics_Get( &thingTopics, ThingTopicShadowUpdateDelta, &topicLength );
+        registered = ( SubscriptionManager_RegisterCallback( pTopic, topicLength, deltaCallback, NULL ) ==
+                       SUBSCRIPTION_MANAGER_SUCCESS );
+
+        if( registered == true )
+        {
+            pTopic = ThingTopics_Get( &thingTopics, ThingTopicShadowUpdateAccepted, &topicLength );
+            registered = ( SubscriptionManager_RegisterCallback( pTopic, topicLength, updateResponseCallback, NULL ) ==
+                           SUBSCRIPTION_MANAGER_SUCCESS );
+        }
+
+        if( registered == true )
+        {
+            /* The user context tells a rejection from an acceptance. */
+            pTopic = ThingTopics_Get( &thingTopics, ThingTopicShadowUpdateRejected, &topicLength );
+            registered = ( SubscriptionManager_RegisterCallback( pTopic, topicLength, updateResponseCallback,
+                                                                 ( void * ) &rejected ) ==
+                           SUBSCRIPTION_MANAGER_SUCCESS );
+        }
+
+        if( registered == true )
+        {
+            registered = loadShadowNames();
+        }
+
+        if( ( registered == true ) && ( namedShadowCount > 0U ) )
+        {
+            registered = NamedShadows_Init( &namedShadows, THING_NAME, THING_NAME_LENGTH,
+                                            namedShadowTable, namedShadowCount ) &&
+                         NamedShadows_Register( &namedShadows );
+        }
+
+        if( registered == false )
+        {
+            LogError( ( "Failed to register the shadow callbacks." ) );
+        }
+
+        return registered;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool ShadowAgent_Start( void )
+    {
+        return xTaskCreate( shadowTask, "ShadowAgent", SHADOW_TASK_STACK_SIZE, NULL,
+                            SHADOW_TASK_PRIORITY, &shadowTaskHandle ) == pdPASS;
+    }
+
+#else /* if CONFIG_EXAMPLE_AGENT_SHADOW */
+
+    bool ShadowAgent_Init( void )
+    {
+        return true;
+    }
+
+    bool ShadowAgent_Start( void )
+    {
+        return true;
+    }
+
+#endif /* if CONFIG_EXAMPLE_AGENT_SHADOW */
@@ -0,0 +1,494 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file soak_agent_task.c
+ * @brief The soak benchmark service of the MQTT agent example.
+ *
+ * The service publishes telemetry at a steady rate alongside the other
+ * services, and prints a report of the whole firmware every
+ * CONFIG_EXAMPLE_AGENT_SOAK_REPORT_INTERVAL_S, so that two builds can be
+ * compared on the same mixed load. With sdkconfig.soak, the shadow and jobs
+ * services also publish at a steady rate, and an OTA job created for the
+ * thing downloads over the same connection.
+ *
+ * The report is a block of lines starting with "SOAK ", each a record of
+ * key=value fields, from "SOAK begin" to "SOAK end". The counters are
+ * totals since boot, so that a report missed from the log loses nothing.
+ * Records of a component that isn't built, or whose statistics are off, are
+ * left out. tools/soak_report.py reads them from the monitor output.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* Include Demo Config as the first non-system header. */
+#include "demo_config.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+/* MQTT agent port includes. */
+#include "freertos_agent_message.h"
+#include "freertos_command_pool.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+/* Include the performance metrics registry. */
+#include "perf_metrics.h"
+
+/* Include the heap accounting of the components. */
+#include "mem_accounting.h"
+
+#include "mqtt_agent_task.h"
+#include "agent_services.h"
+
+#if CONFIG_EXAMPLE_AGENT_SOAK
+
+    #if CONFIG_EXAMPLE_AGENT_OTA
+        #include "ota.h"
+        #include "ota_event_pool.h"
+    #endif
+
+/**
+ * @brief The stack of the load task, in bytes.
+ */
+    #define LOAD_TASK_STACK_SIZE      ( 2560U + CONFIG_EXAMPLE_AGENT_SOAK_TELEMETRY_SIZE )
+
+/**
+ * @brief The stack of the report task, in bytes.
+ */
+    #define REPORT_TASK_STACK_SIZE    ( 3072U )
+
+/**
+ * @brief The priority of the tasks, that of the latency probes, below the
+ * other services.
+ */
+    #define SOAK_TASK_PRIORITY        ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief The topic of the telemetry.
+ */
+    #define TELEMETRY_TOPIC           THING_NAME "/soak/telemetry"
+    #define TELEMETRY_TOPIC_LENGTH    ( ( uint16_t ) ( sizeof( TELEMETRY_TOPIC ) - 1U ) )
+
+/**
+ * @brief The start of a telemetry message, before its padding.
+ */
+    #define TELEMETRY_FORMAT          "{\"seq\":%lu,\"uptime_ms\":%lu,\"pad\":\""
+
+/**
+ * @brief The version of the report format, bumped when a field changes
+ * meaning.
+ */
+    #define REPORT_FORMAT             ( 1U )
+
+/**
+ * @brief The size of the buffer a histogram record is written into.
+ */
+    #define METRIC_LINE_SIZE          ( 192U )
+
+/**
+ * @brief The telemetry published and failed, and the time spent in the
+ * publishes, written by the load task.
+ */
+    static uint32_t telemetrySent = 0U;
+    static uint32_t telemetryFailed = 0U;
+    static uint64_t publishTotalUs = 0U;
+    static uint32_t publishMaxUs = 0U;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes the telemetry at its interval.
+ */
+    static void loadTask( void * pParameters );
+
+/**
+ * @brief Prints a report at its interval.
+ */
+    static void reportTask( void * pParameters );
+
+/**
+ * @brief Prints one report.
+ *
+ * @param[in] report The number of the report, from 1.
+ */
+    static void printReport( uint32_t report );
+
+/**
+ * @brief Prints the records of the heap and the task stacks.
+ */
+    static void printMemory( void );
+
+/**
+ * @brief Prints the records of the transport and of the agent.
+ */
+    static void printConnection( void );
+
+/**
+ * @brief Prints a record for every registered performance metric.
+ */
+    static void printMetrics( void );
+
+/*-----------------------------------------------------------*/
+
+    static void loadTask( void * pParameters )
+    {
+        static char payload[ CONFIG_EXAMPLE_AGENT_SOAK_TELEMETRY_SIZE + 1U ];
+        const TickType_t interval = pdMS_TO_TICKS( CONFIG_EXAMPLE_AGENT_SOAK_TELEMETRY_INTERVAL_MS );
+        MQTTPublishInfo_t publishInfo = { 0 };
+        TickType_t lastWakeTime = 0U;
+        uint32_t sequence = 0U;
+        int64_t startUs = 0;
+        uint32_t elapsedUs = 0U;
+        int length = 0;
+
+        ( void ) pParameters;
+
+        #if CONFIG_EXAMPLE_AGENT_SOAK_TELEMETRY_QOS1
+            publishInfo.qos = MQTTQoS1;
+        #else
+            publishInfo.qos = MQTTQoS0;
+        #endif
+        publishInfo.pTopicName = TELEMETRY_TOPIC;
+        publishInfo.topicNameLength = TELEMETRY_TOPIC_LENGTH;
+        publishInfo.pPayload = payload;
+
+        for( ; ; )
+        {
+            ( void ) MqttAgentTask_WaitForConnection( true, portMAX_DELAY );
+            lastWakeTime = xTaskGetTickCount();
+
+            /* Padded to the configured size, a message too small for the
+             * fields is sent as it is. */
+            length = snprintf( payload, sizeof( payload ), TELEMETRY_FORMAT,
+                               ( unsigned long ) sequence++,
+                               ( unsigned long ) ( esp_timer_get_time() / 1000 ) );
+
+            if( ( length > 0 ) && ( ( size_t ) length + 2U < sizeof( payload ) ) )
+            {
+                ( void ) memset( &payload[ length ], 'x', sizeof( payload ) - 3U - ( size_t ) length );
+                ( void ) memcpy( &payload[ sizeof( payload ) - 3U ], "\"}", 2U );
+                length = ( int ) sizeof( payload ) - 1;
+            }
+            else
+            {
+                length = ( int ) strnlen( payload, sizeof( payload ) - 1U );
+            }
+
+            publishInfo.payloadLength = ( size_t ) length;
+
+            startUs = esp_timer_get_time();
+
+            if( MqttAgentTask_Publish( &publishInfo ) == MQTTSuccess )
+            {
+                elapsedUs = ( uint32_t ) ( esp_timer_get_time() - startUs );
+
+                __atomic_store_n( &publishTotalUs, publishTotalUs + elapsedUs, __ATOMIC_RELAXED );
+                __atomic_store_n( &publishMaxUs, ( elapsedUs > publishMaxUs ) ? elapsedUs : publishMaxUs,
+                                  __ATOMIC_RELAXED );
+                __atomic_store_n( &telemetrySent, telemetrySent + 1U, __ATOMIC_RELAXED );
+            }
+            else
+            {
+                __atomic_store_n( &telemetryFailed, telemetryFailed + 1U, __ATOMIC_RELAXED );
+            }
+
+            vTaskDelayUntil( &lastWakeTime, interval );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void reportTask( void * pParameters )
+    {
+        const TickType_t interval = pdMS_TO_TICKS( CONFIG_EXAMPLE_AGENT_SOAK_REPORT_INTERVAL_S * 1000U );
+        TickType_t lastWakeTime = xTaskGetTickCount();
+        uint32_t report = 0U;
+
+        ( void ) pParameters;
+
+        for( ; ; )
+        {
+            vTaskDelayUntil( &lastWakeTime, interval );
+            printReport( ++report );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void printReport( uint32_t report )
+    {
+        uint32_t sent = __atomic_load_n( &telemetrySent, __ATOMIC_RELAXED );
+
+        #if CONFIG_EXAMPLE_AGENT_OTA
+            OtaAgentStatistics_t otaStatistics = { 0 };
+            OtaEventPoolStats_t poolStats = { 0 };
+        #endif
+
+        /* The records are printed rather than logged, so that the log level
+         * and the deferred log don't drop or reorder them. */
+        printf( "SOAK begin report=%u format=%u uptime_s=%u version=%s idf=%s\n",
+                ( unsigned ) report, REPORT_FORMAT,
+                ( unsigned ) ( esp_timer_get_time() / 1000000 ),
+                esp_ota_get_app_description()->version,
+                esp_get_idf_version() );
+
+        printMemory();
+        printConnection();
+
+        #if CONFIG_EXAMPLE_AGENT_OTA
+            OTA_GetStatistics( &otaStatistics );
+            OtaEventPool_GetStats( &poolStats );
+
+            printf( "SOAK ota received=%u queued=%u processed=%u dropped=%u "
+                    "events_high_water=%u event_drops=%u\n",
+                    ( unsigned ) otaStatistics.otaPacketsReceived,
+                    ( unsigned ) otaStatistics.otaPacketsQueued,
+                    ( unsigned ) otaStatistics.otaPacketsProcessed,
+                    ( unsigned ) otaStatistics.otaPacketsDropped,
+                    ( unsigned ) poolStats.highWater,
+                    ( unsigned ) poolStats.drops );
+        #endif
+
+        printf( "SOAK load telemetry_sent=%u telemetry_failed=%u publish_avg_us=%u publish_max_us=%u\n",
+                ( unsigned ) sent,
+                ( unsigned ) __atomic_load_n( &telemetryFailed, __ATOMIC_RELAXED ),
+                ( unsigned ) ( ( sent > 0U ) ? ( __atomic_load_n( &publishTotalUs, __ATOMIC_RELAXED ) / sent ) : 0U ),
+                ( unsigned ) __atomic_load_n( &publishMaxUs, __ATOMIC_RELAXED ) );
+
+        printMetrics();
+
+        printf( "SOAK end report=%u\n", ( unsigned ) report );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void printMemory( void )
+    {
+        #if MEM_ACCOUNTING_ENABLED
+            static const char * const componentNames[ MemComponentCount ] = { "ota", "pkcs11", "crypto" };
+            MemAccountingStats_t memStats;
+            uint32_t component;
+        #endif
+
+        #if ( configUSE_TRACE_FACILITY == 1 )
+            UBaseType_t taskCount = 0U;
+            TaskStatus_t * pTasks = NULL;
+            UBaseType_t i;
+        #endif
+
+        printf( "SOAK heap free=%u min_free=%u largest=%u\n",
+                ( unsigned ) heap_caps_get_free_size( MALLOC_CAP_DEFAULT ),
+                ( unsigned ) heap_caps_get_minimum_free_size( MALLOC_CAP_DEFAULT ),
+                ( unsigned ) heap_caps_get_largest_free_block( MALLOC_CAP_DEFAULT ) );
+
+        #if MEM_ACCOUNTING_ENABLED
+            for( component = 0U; component < ( uint32_t ) MemComponentCount; component++ )
+            {
+                MemAccounting_Get( ( MemComponent_t ) component, &memStats );
+                printf( "SOAK mem name=%s current=%u peak=%u allocations=%u failures=%u\n",
+                        componentNames[ component ],
+                        ( unsigned ) memStats.currentBytes,
+                        ( unsigned ) memStats.peakBytes,
+                        ( unsigned ) memStats.allocations,
+                        ( unsigned ) memStats.failures );
+            }
+        #endif
+
+        #if ( configUSE_TRACE_FACILITY == 1 )
+            taskCount = uxTaskGetNumberOfTasks() + 2U;
+            pTasks = pvPortMalloc( taskCount * sizeof( TaskStatus_t ) );
+
+            if( pTasks != NULL )
+            {
+                taskCount = uxTaskGetSystemState( pTasks, taskCount, NULL );
+
+                /* The high-water mark is in bytes on ESP-IDF. */
+                for( i = 0U; i < taskCount; i++ )
+                {
+                    printf( "SOAK stack task=%s unused=%u\n",
+                            pTasks[ i ].pcTaskName,
+                            ( unsigned ) pTasks[ i ].usStackHighWaterMark );
+                }
+
+                vPortFree( pTasks );
+            }
+        #endif /* if ( configUSE_TRACE_FACILITY == 1 ) */
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void printConnection( void )
+    {
+        const TlsTransportMetrics_t * pTransport = MqttAgentTask_GetNetworkContext()->pxMetrics;
+        AgentCommandPoolStats_t poolStats;
+        AgentMessageStats_t queueStats;
+        uint32_t handshakes = 0U;
+        size_t bucket;
+
+        #if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+            SubscriptionManagerDispatchStats_t dispatchStats;
+        #endif
+
+        for( bucket = 0U; ( pTransport != NULL ) && ( bucket < TLS_TRANSPORT_HISTOGRAM_BUCKETS ); bucket++ )
+        {
+            handshakes += pTransport->xHandshake.ulBuckets[ bucket ];
+        }
+
+        /* The counters are updated by the agent task without a lock, and may
+         * be a send or a receive behind. */
+        if( pTransport != NULL )
+        {
+            printf( "SOAK transport sent=%llu received=%llu send_calls=%u recv_calls=%u send_errors=%u "
+                    "recv_errors=%u send_max_us=%u recv_max_us=%u handshakes=%u handshake_failures=%u "
+                    "handshake_avg_us=%u\n",
+                    ( unsigned long long ) pTransport->ullBytesSent,
+                    ( unsigned long long ) pTransport->ullBytesReceived,
+                    ( unsigned ) pTransport->ulSendCalls,
+                    ( unsigned ) pTransport->ulRecvCalls,
+                    ( unsigned ) pTransport->ulSendErrors,
+                    ( unsigned ) pTransport->ulRecvErrors,
+                    ( unsigned ) pTransport->xSendLatency.ulMaxUs,
+                    ( unsigned ) pTransport->xRecvLatency.ulMaxUs,
+                    ( unsigned ) handshakes,
+                    ( unsigned ) pTransport->ulHandshakeFailures,
+                    ( unsigned ) ( ( handshakes > 0U ) ? ( pTransport->xHandshake.ullTotalUs / handshakes ) : 0U ) );
+        }
+
+        if( Agent_GetPoolStats( &poolStats ) == true )
+        {
+            printf( "SOAK pool size=%u free=%u min_free=%u gets=%u timeouts=%u max_wait_us=%u\n",
+                    ( unsigned ) poolStats.poolSize,
+                    ( unsigned ) poolStats.freeCommands,
+                    ( unsigned ) poolStats.minFreeCommands,
+                    ( unsigned ) poolStats.getCalls,
+                    ( unsigned ) poolStats.timeouts,
+                    ( unsigned ) poolStats.maxWaitUs );
+        }
+
+        if( MqttAgentTask_GetQueueStats( &queueStats ) == true )
+        {
+            printf( "SOAK queue sends=%u send_timeouts=%u depth_high_water=%u batched=%u\n",
+                    ( unsigned ) queueStats.sendCalls,
+                    ( unsigned ) queueStats.sendTimeouts,
+                    ( unsigned ) queueStats.depthHighWater,
+                    ( unsigned ) queueStats.batchedReceives );
+        }
+
+        #if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+            if( SubscriptionManager_GetDispatchStats( &dispatchStats ) == true )
+            {
+                printf( "SOAK dispatch deferred=%u dispatched=%u dropped=%u inlined=%u depth_high_water=%u\n",
+                        ( unsigned ) dispatchStats.deferred,
+                        ( unsigned ) dispatchStats.dispatched,
+                        ( unsigned ) dispatchStats.dropped,
+                        ( unsigned ) dispatchStats.inlined,
+                        ( unsigned ) dispatchStats.queueHighWater );
+            }
+        #endif
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void printMetrics( void )
+    {
+        char line[ METRIC_LINE_SIZE ];
+        const PerfMetric_t * pMetric = NULL;
+        size_t length = 0U;
+        size_t bucket;
+
+        /* The totals since boot, so the deltas of the Device Defender
+         * reports are left alone. */
+        for( pMetric = PerfMetrics_NextRegistered( NULL ); pMetric != NULL;
+             pMetric = PerfMetrics_NextRegistered( pMetric ) )
+        {
+            if( pMetric->type != PerfMetricHistogram )
+            {
+                printf( "SOAK metric name=%s type=%s value=%u\n", pMetric->pName,
+                        ( pMetric->type == PerfMetricCounter ) ? "counter" : "gauge",
+                        ( unsigned ) PerfMetrics_Total( pMetric, 0U ) );
+            }
+            else
+            {
+                /* Written as one line, so that other output doesn't cut it. */
+                length = ( size_t ) snprintf( line, sizeof( line ), "SOAK metric name=%s type=histogram buckets=",
+                                              pMetric->pName );
+
+                for( bucket = 0U; ( bucket < pMetric->bucketCount ) && ( length < sizeof( line ) ); bucket++ )
+                {
+                    length += ( size_t ) snprintf( &line[ length ], sizeof( line ) - length,
+                                                   ( bucket == 0U ) ? "%u" : ",%u",
+                                                   ( unsigned ) PerfMetrics_Total( pMetric, bucket ) );
+                }
+
+                printf( "%s\n", line );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool SoakAgent_Init( void )
+    {
+        LogInfo( ( "Soak benchmark: telemetry of %u bytes every %u ms, a report every %u s.",
+                   ( unsigned ) CONFIG_EXAMPLE_AGENT_SOAK_TELEMETRY_SIZE,
+                   ( unsigned ) CONFIG_EXAMPLE_AGENT_SOAK_TELEMETRY_INTERVAL_MS,
+                   ( unsigned ) CONFIG_EXAMPLE_AGENT_SOAK_REPORT_INTERVAL_S ) );
+
+        return true;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool SoakAgent_Start( void )
+    {
+        return ( xTaskCreate( loadTask, "SoakLoad", LOAD_TASK_STACK_SIZE, NULL,
+                              SOAK_TASK_PRIORITY, NULL ) == pdPASS ) &&
+               ( xTaskCreate( reportTask, "SoakReport", REPORT_TASK_STACK_SIZE, NULL,
+                              SOAK_TASK_PRIORITY, NULL ) == pdPASS );
+    }
+
+#else /* if CONFIG_EXAMPLE_AGENT_SOAK */
+
+    bool SoakAgent_Init( void )
+    {
+        return true;
+    }
+
+    bool SoakAgent_Start( void )
+    {
+        return true;
+    }
+
+#endif /* if CONFIG_EXAMPLE_AGENT_SOAK */
@@ -0,0 +1,162 @@
+#!/usr/bin/env python
+#
+# Reads the soak reports of the MQTT agent demo from monitor logs, and prints
+# the last complete report of a log, or compares those of two logs. Counters
+# are also given per minute of uptime, so that runs of slightly different
+# lengths compare. A report is a block of lines from "SOAK begin" to
+# "SOAK end", each a record of key=value fields; see soak_agent_task.c.
+
+import argparse
+import re
+import sys
+
+RECORD = re.compile(r'SOAK (\w+)((?: [\w.]+=\S*)*)\s*$')
+
+# The records of several instances, and the field naming the instance.
+INSTANCE_FIELDS = {'mem': 'name', 'stack': 'task', 'metric': 'name'}
+
+# Fields that are levels, not totals since boot, so have no rate.
+LEVELS = {
+    'heap.free', 'heap.min_free', 'heap.largest',
+    'transport.send_max_us', 'transport.recv_max_us', 'transport.handshake_avg_us',
+    'pool.size', 'pool.free', 'pool.min_free', 'pool.max_wait_us',
+    'queue.depth_high_water', 'dispatch.depth_high_water', 'ota.events_high_water',
+    'load.publish_avg_us', 'load.publish_max_us',
+}
+
+
+def parse_fields(text):
+    return dict(field.split('=', 1) for field in text.split())
+
+
+def flatten(kind, fields, report):
+    prefix = kind
+
+    if kind in INSTANCE_FIELDS:
+        prefix = '{}.{}'.format(kind, fields.pop(INSTANCE_FIELDS[kind], '?'))
+
+    metric_type = fields.pop('type', None)
+
+    for key, value in fields.items():
+        if key == 'buckets':
+            for bucket, count in enumerate(value.split(',')):
+                report['values']['{}[{}]'.format(prefix, bucket)] = int(count)
+        else:
+            report['values']['{}.{}'.format(prefix, key)] = int(value)
+
+    if kind == 'mem' or kind == 'stack' or metric_type == 'gauge':
+        report['levels'].update(k for k in report['values'] if k.startswith(prefix + '.'))
+
+
+def load(path):
+    last = None
+    report = None
+
+    with open(path, errors='replace') as log:
+        for line in log:
+            match = RECORD.search(line)
+
+            if not match:
+                continue
+
+            kind, fields = match.group(1), parse_fields(match.group(2))
+
+            if kind == 'begin':
+                report = {'header': fields, 'values': {}, 'levels': set()}
+            elif report is None:
+                continue
+            elif kind == 'end':
+                if fields.get('report') == report['header']['report']:
+                    last = report
+
+                report = None
+            else:
+                try:
+                    flatten(kind, fields, report)
+                except ValueError:
+                    # A line cut by other output.
+                    report = None
+
+    if last is None:
+        sys.exit('{}: no complete soak report'.format(path))
+
+    return last
+
+
+def is_level(report, key):
+    return key in LEVELS or key in report['levels']
+
+
+def per_minute(report, key):
+    minutes = int(report['header']['uptime_s']) / 60.0
+
+    if is_level(report, key) or minutes <= 0:
+        return None
+
+    return report['values'][key] / minutes
+
+
+def describe(report, path):
+    header = report['header']
+    print('{}: report {}, {} s, version {}, IDF {}'.format(
+        path, header['report'], header['uptime_s'], header.get('version', '?'), header.get('idf', '?')))
+
+
+def format_value(report, key):
+    value = report['values'][key]
+    rate = per_minute(report, key)
+
+    return '{}'.format(value) if rate is None else '{} ({:.1f}/min)'.format(value, rate)
+
+
+def show(report):
+    for key in sorted(report['values']):
+        print('{:<48} {:>28}'.format(key, format_value(report, key)))
+
+
+def compare(baseline, current):
+    print('{:<48} {:>28} {:>28} {:>8}'.format('', 'baseline', 'current', 'change'))
+
+    for key in sorted(set(baseline['values']) | set(current['values'])):
+        if key not in current['values']:
+            print('{:<48} {:>28} {:>28} {:>8}'.format(key, format_value(baseline, key), '-', 'removed'))
+            continue
+
+        if key not in baseline['values']:
+            print('{:<48} {:>28} {:>28} {:>8}'.format(key, '-', format_value(current, key), 'new'))
+            continue
+
+        # Counters compare by rate, levels by value.
+        before = per_minute(baseline, key)
+        after = per_minute(current, key)
+
+        if before is None or after is None:
+            before = baseline['values'][key]
+            after = current['values'][key]
+
+        change = '{:+.1f}%'.format(100.0 * (after - before) / before) if before else ''
+        print('{:<48} {:>28} {:>28} {:>8}'.format(
+            key, format_value(baseline, key), format_value(current, key), change))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Show or compare the soak reports of the MQTT agent demo.')
+    parser.add_argument('logs', nargs='+', metavar='log', help='monitor log, or the baseline and current logs')
+    args = parser.parse_args()
+
+    if len(args.logs) > 2:
+        parser.error('give one log, or two to compare')
+
+    reports = [load(path) for path in args.logs]
+
+    for path, report in zip(args.logs, reports):
+        describe(report, path)
+
+    if len(reports) == 1:
+        show(reports[0])
+    else:
+        compare(reports[0], reports[1])
+
+
+if __name__ == '__main__':
+    main()
@@ -20,6 +20,12 @@ int aws_iot_demo_main( int argc, char ** argv );
 
 #include "esp_log.h"
 
+#if CONFIG_MEM_ACCOUNTING_ENABLE
+    #include "mem_accounting.h"
+#endif
+
+#include "resource_profile.h"
+
 static const char *TAG = "OTA_MQTT";
 
 void app_main()
@@ -29,6 +35,13 @@ void app_main()
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
 
     esp_log_level_set("*", ESP_LOG_INFO);
+
+    ResourceProfile_Log();
+
+#if CONFIG_MEM_ACCOUNTING_ENABLE
+    /* Report the heap of the OTA agent and PKCS #11, and the task stacks. */
+    MemAccounting_Init();
+#endif
     
     /* Initialize NVS partition */
     esp_err_t ret = nvs_flash_init();
@@ -51,4 +64,8 @@ void app_main()
     ESP_ERROR_CHECK(example_connect());
 
     aws_iot_demo_main(0,NULL);
+
+#if CONFIG_MEM_ACCOUNTING_ENABLE
+    MemAccounting_Report();
+#endif
 }
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <strings.h>
+#include <sys/param.h>
 
 /* Include Demo Config as the first non-system header. */
 #include "demo_config.h"
@@ -42,11 +44,11 @@
 
 /* pthread include. */
 #include <pthread.h>
-#include "semaphore.h"
 #include <unistd.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_pthread.h"
+#include "esp_system.h"
 
 /* MQTT include. */
 #include "core_mqtt.h"
@@ -61,6 +63,10 @@
 /*Include backoff algorithm header for retry logic.*/
 #include "backoff_algorithm.h"
 
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
+#include "esp_random.h"
+
 /* OTA Library include. */
 #include "ota.h"
 #include "ota_config.h"
@@ -70,9 +76,29 @@
 #include "ota_mqtt_interface.h"
 #include "ota_pal.h"
 
+/* Include OTA event buffer pool. */
+#include "ota_event_pool.h"
+
+/* Include the buffer placement policy. */
+#include "mem_placement.h"
+
+/* Include the shared buffer arena. */
+#include "buffer_arena.h"
+
+/* Include the prebuilt topics of the thing. */
+#include "thing_topics.h"
+
+/* Include the pool of HTTP connections. */
+#include "http_connection_pool.h"
+
 /* Include firmware version struct definition. */
 #include "ota_appversion32.h"
 
+#if CONFIG_EXAMPLE_OTA_PEER_DISTRIBUTION
+    /* Include the server of the running image to peers. */
+    #include "ota_peer_server.h"
+#endif
+
 #ifndef ROOT_CA_CERT_PATH
     extern const char root_cert_auth_pem_start[]   asm("_binary_root_cert_auth_pem_start");
     extern const char root_cert_auth_pem_end[]   asm("_binary_root_cert_auth_pem_end");
@@ -235,6 +261,12 @@ extern const char pcAwsCodeSigningCertPem[] asm("_binary_aws_codesign_crt_start"
 /* HTTP buffers used for http request and response. */
 #define HTTP_USER_BUFFER_LENGTH          ( otaconfigFILE_BLOCK_SIZE + HTTP_HEADER_SIZE_MAX )
 
+/**
+ * @brief The time to wait for a connection to the HTTP server from the
+ * connection pool, while another one is being opened or all are in use.
+ */
+#define HTTP_CONNECTION_TIMEOUT_MS       ( 5000U )
+
 /**
  * @brief The MQTT metrics string expected by AWS IoT.
  */
@@ -280,6 +312,57 @@ extern const char pcAwsCodeSigningCertPem[] asm("_binary_aws_codesign_crt_start"
 #define HTTP_RESPONSE_FORBIDDEN          ( 403 )
 #define HTTP_RESPONSE_NOT_FOUND          ( 404 )
 
+#if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+
+/**
+ * @brief The number of connections fetching blocks ahead of the OTA agent.
+ */
+    #define PREFETCH_CONNECTIONS      CONFIG_EXAMPLE_OTA_HTTP_CONNECTIONS
+
+/**
+ * @brief The number of blocks fetched with each request.
+ */
+    #define PREFETCH_RANGE_BLOCKS     CONFIG_EXAMPLE_OTA_HTTP_RANGE_BLOCKS
+
+/**
+ * @brief The most blocks fetched ahead of the OTA agent. Two event buffers are
+ * left for job documents and for blocks fetched on demand.
+ */
+    #define PREFETCH_WINDOW           ( otaconfigMAX_NUM_OTA_DATA_BUFFERS - 2U )
+
+    #if CONFIG_MAX_NUM_OTA_DATA_BUFFERS < 3
+        #error "Fetching blocks ahead of the OTA agent needs at least 3 OTA data buffers."
+    #endif
+
+    #if CONFIG_EXAMPLE_OTA_HTTP_CONNECTIONS >= CONFIG_HTTP_CONNECTION_POOL_SIZE
+        #error "The HTTP connection pool needs a connection for blocks fetched on demand besides the prefetch connections."
+    #endif
+
+/**
+ * @brief Size of the buffer of a connection, for the request and the response
+ * headers. The body of a response is received into event buffers.
+ */
+    #define PREFETCH_BUFFER_LENGTH    ( OTA_MAX_URL_SIZE + HTTP_HEADER_SIZE_MAX )
+
+/**
+ * @brief Times a range is requested, the part of it left once more after a
+ * connection failed.
+ */
+    #define PREFETCH_ATTEMPTS         ( 2U )
+
+/**
+ * @brief Time a prefetch connection waits for the server to take or send data.
+ */
+    #define PREFETCH_TIMEOUT_MS       ( 10000U )
+
+/**
+ * @brief The response headers a prefetch connection reads.
+ */
+    #define HTTP_CONTENT_LENGTH_FIELD    "Content-Length"
+    #define HTTP_CONTENT_RANGE_FIELD     "Content-Range"
+    #define HTTP_CONNECTION_FIELD        "Connection"
+#endif
+
 /*-----------------------------------------------------------*/
 
 /* Linkage for error reporting. */
@@ -306,7 +389,8 @@ static StaticSemaphore_t xTlsContextSemaphoreBuffer;
 static NetworkContext_t networkContextMqtt;
 
 /**
- * @brief Network connection context used for HTTP connection.
+ * @brief The server and credentials of the HTTP connections, which are
+ * taken from the connection pool.
  */
 static NetworkContext_t networkContextHttp;
 
@@ -319,6 +403,8 @@ static NetworkContext_t networkContextHttp;
  */
 static char serverHost[ 256 ];
 
+#if !BUFFER_ARENA_ENABLED
+
 /**
  * @brief A buffer used in the demo for storing HTTP request headers and
  * HTTP response headers and body.
@@ -326,11 +412,11 @@ static char serverHost[ 256 ];
  * @note This demo shows how the same buffer can be re-used for storing the HTTP
  * response after the HTTP request is sent out. However, the user can also
  * decide to use separate buffers for storing the HTTP request and response.
+ *
+ * With the buffer arena, the buffer is borrowed for each request instead.
  */
-static uint8_t httpUserBuffer[ HTTP_USER_BUFFER_LENGTH ];
-
-/* The transport layer interface used by the HTTP Client library. */
-TransportInterface_t transportInterfaceHttp;
+    static uint8_t httpUserBuffer[ HTTP_USER_BUFFER_LENGTH ] MEM_PLACEMENT_BULK_ATTR;
+#endif
 
 /**
  * @brief MQTT connection context used in this demo.
@@ -347,6 +433,11 @@ static bool mqttSessionEstablished = false;
  */
 static pthread_mutex_t mqttMutex;
 
+/**
+ * @brief The jobs topics of the thing, built once at start-up.
+ */
+static ThingTopics_t thingTopics;
+
 /**
  * @brief The host address string extracted from the pre-signed URL.
  *
@@ -360,10 +451,75 @@ static char serverHost[ 256 ];
  */
 static size_t serverHostLength;
 
+#if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+
+/**
+ * @brief A block fetched ahead of the OTA agent, while pData isn't NULL.
+ */
+    typedef struct PrefetchSlot
+    {
+        uint32_t block;
+        OtaEventData_t * pData;
+    } PrefetchSlot_t;
+
+/**
+ * @brief A connection fetching blocks ahead of the OTA agent.
+ */
+    typedef struct PrefetchConnection
+    {
+        const TransportInterface_t * pTransport; /* Taken from the connection pool while not NULL. */
+        bool started;
+        pthread_t thread;
+        uint32_t generation; /* The blocks from fetchNext to fetchEnd are still */
+        uint32_t fetchNext;  /* being fetched, guarded by the prefetch mutex. */
+        uint32_t fetchEnd;
+        uint8_t buffer[ PREFETCH_BUFFER_LENGTH + 1U ];
+    } PrefetchConnection_t;
+
+/**
+ * @brief The parsed headers of a response to a prefetch connection.
+ */
+    typedef struct PrefetchResponse
+    {
+        uint32_t statusCode;
+        uint32_t contentLength;
+        uint32_t fileSize;       /* From Content-Range, 0 if it doesn't match the range requested. */
+        bool connectionClose;
+        uint8_t * pBody;         /* Start of the body received with the headers, */
+        size_t bodyInBuffer;     /* of this many bytes. */
+    } PrefetchResponse_t;
+
+/**
+ * @brief Blocks fetched ahead of the OTA agent, guarded by the mutex.
+ *
+ * The connections fetch the blocks from deliverNext on, at most
+ * PREFETCH_WINDOW of them, so each has its own slot.
+ */
+    typedef struct PrefetchState
+    {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        bool running;
+        uint32_t generation;   /* Changed when the blocks fetched are abandoned. */
+        uint32_t deliverNext;  /* Block expected to be asked for next. */
+        uint32_t fetchNext;    /* First block no connection is fetching yet. */
+        uint32_t fileSize;     /* Size of the file, or 0 until a response gave it. */
+        uint32_t hits;         /* Blocks handed over from the slots. */
+        uint32_t misses;       /* Blocks fetched on demand. */
+        PrefetchSlot_t slots[ PREFETCH_WINDOW ];
+    } PrefetchState_t;
+
+    static PrefetchState_t prefetch =
+    {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .cond  = PTHREAD_COND_INITIALIZER
+    };
+
 /**
- * @brief Semaphore for synchronizing buffer operations.
+ * @brief The connections fetching blocks ahead of the OTA agent.
  */
-static osi_sem_t bufferSemaphore;
+    static PrefetchConnection_t prefetchConnections[ PREFETCH_CONNECTIONS ];
+#endif
 
 /**
  * @brief Enum for type of OTA job messages received.
@@ -375,10 +531,14 @@ typedef enum jobMessageType
     jobMessageTypeMax
 } jobMessageType_t;
 
+#if !BUFFER_ARENA_ENABLED
+
 /**
  * @brief The network buffer must remain valid when OTA library task is running.
+ * With the buffer arena, it is borrowed while connected instead.
  */
-static uint8_t otaNetworkBuffer[ OTA_NETWORK_BUFFER_SIZE ];
+    static uint8_t otaNetworkBuffer[ OTA_NETWORK_BUFFER_SIZE ] MEM_PLACEMENT_NETWORK_ATTR;
+#endif
 
 /**
  * @brief The location of the path within the pre-signed URL.
@@ -420,11 +580,6 @@ uint8_t updateUrl[ OTA_MAX_URL_SIZE ];
  */
 uint8_t authScheme[ OTA_MAX_URL_SIZE ];
 
-/**
- * @brief Event buffer.
- */
-static OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
-
 /**
  * @brief The buffer passed to the OTA Agent from application while initializing.
  */
@@ -570,6 +725,36 @@ static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
  */
 static OtaHttpStatus_t httpDeinit( void );
 
+#if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+
+/**
+ * @brief Start fetching the file of the pre-signed URL connected to by
+ * httpInit ahead of the OTA agent.
+ */
+    static void prefetchStart( void );
+
+/**
+ * @brief Stop fetching ahead of the OTA agent and close its connections.
+ */
+    static void prefetchStop( void );
+
+/**
+ * @brief Hand the block the OTA agent asked for to it, if it was fetched
+ * ahead.
+ *
+ * Waits for the block if a connection is fetching it. A block other than the
+ * one following the last asked for abandons the blocks fetched, and the
+ * connections carry on from it.
+ *
+ * @param[in] rangeStart Starting index of the file data
+ * @param[in] rangeEnd Last index of the file data
+ * @return true if the block was handed to the OTA agent, false if it has to
+ * be fetched on demand.
+ */
+    static bool prefetchDeliver( uint32_t rangeStart,
+                                 uint32_t rangeEnd );
+#endif
+
 /**
  * @brief Initialize MQTT by setting up transport interface and network.
  *
@@ -665,18 +850,22 @@ static void mqttEventCallback( MQTTContext_t * pMqttContext,
  * @param[in] pContext MQTT context which stores the connection.
  * @param[in] pPublishInfo MQTT packet information which stores details of the
  * job document.
+ * @param[in] pUserContext Unused user context.
  */
 static void mqttJobCallback( MQTTContext_t * pContext,
-                             MQTTPublishInfo_t * pPublishInfo );
+                             MQTTPublishInfo_t * pPublishInfo,
+                             void * pUserContext );
 
 /**
  * @brief Callback that notifies the OTA library when a data block is received.
  *
  * @param[in] pContext MQTT context which stores the connection.
  * @param[in] pPublishInfo MQTT packet that stores the information of the file block.
+ * @param[in] pUserContext Unused user context.
  */
 static void mqttDataCallback( MQTTContext_t * pContext,
-                              MQTTPublishInfo_t * pPublishInfo );
+                              MQTTPublishInfo_t * pPublishInfo,
+                              void * pUserContext );
 
 static SubscriptionManagerCallback_t otaMessageCallback[] = { mqttJobCallback, mqttDataCallback };
 
@@ -684,48 +873,14 @@ static SubscriptionManagerCallback_t otaMessageCallback[] = { mqttJobCallback, m
 
 void otaEventBufferFree( OtaEventData_t * const pxBuffer )
 {
-    if( osi_sem_take( &bufferSemaphore, 0 ) == 0 )
-    {
-        pxBuffer->bufferUsed = false;
-        ( void ) osi_sem_give( &bufferSemaphore );
-    }
-    else
-    {
-        LogError( ( "Failed to get buffer semaphore: "
-                    ",errno=%s",
-                    strerror( errno ) ) );
-    }
+    OtaEventPool_Free( pxBuffer );
 }
 
 /*-----------------------------------------------------------*/
 
 OtaEventData_t * otaEventBufferGet( void )
 {
-    uint32_t ulIndex = 0;
-    OtaEventData_t * pFreeBuffer = NULL;
-
-    if( osi_sem_take( &bufferSemaphore, 0 ) == 0 )
-    {
-        for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
-        {
-            if( eventBuffer[ ulIndex ].bufferUsed == false )
-            {
-                eventBuffer[ ulIndex ].bufferUsed = true;
-                pFreeBuffer = &eventBuffer[ ulIndex ];
-                break;
-            }
-        }
-
-        ( void ) osi_sem_give( &bufferSemaphore );
-    }
-    else
-    {
-        LogError( ( "Failed to get buffer semaphore: "
-                    ",errno=%s",
-                    strerror( errno ) ) );
-    }
-
-    return pFreeBuffer;
+    return OtaEventPool_Get();
 }
 
 /*-----------------------------------------------------------*/
@@ -814,37 +969,20 @@ static void otaAppCallback( OtaJobEvent_t event,
 jobMessageType_t getJobMessageType( const char * pTopicName,
                                     uint16_t topicNameLength )
 {
-    uint16_t index = 0U;
-    MQTTStatus_t mqttStatus = MQTTSuccess;
-    bool isMatch = false;
     jobMessageType_t jobMessageIndex = jobMessageTypeMax;
 
-    /* For suppressing compiler-warning: unused variable. */
-    ( void ) mqttStatus;
-
-    /* Lookup table for OTA job message string. */
-    static const char * const pJobTopicFilters[ jobMessageTypeMax ] =
+    switch( ThingTopics_Classify( &thingTopics, pTopicName, topicNameLength ) )
     {
-        OTA_TOPIC_PREFIX OTA_TOPIC_JOBS "/$next/get/accepted",
-        OTA_TOPIC_PREFIX OTA_TOPIC_JOBS "/notify-next",
-    };
+        case ThingTopicJobsNextGetAccepted:
+            jobMessageIndex = jobMessageTypeNextGetAccepted;
+            break;
 
-    /* Match the input topic filter against the wild-card pattern of topics filters
-    * relevant for the OTA Update service to determine the type of topic filter. */
-    for( ; index < jobMessageTypeMax; index++ )
-    {
-        mqttStatus = MQTT_MatchTopic( pTopicName,
-                                      topicNameLength,
-                                      pJobTopicFilters[ index ],
-                                      strlen( pJobTopicFilters[ index ] ),
-                                      &isMatch );
-        assert( mqttStatus == MQTTSuccess );
+        case ThingTopicJobsNotifyNext:
+            jobMessageIndex = jobMessageTypeNextNotify;
+            break;
 
-        if( isMatch )
-        {
-            jobMessageIndex = index;
+        default:
             break;
-        }
     }
 
     return jobMessageIndex;
@@ -853,7 +991,8 @@ jobMessageType_t getJobMessageType( const char * pTopicName,
 /*-----------------------------------------------------------*/
 
 static void mqttJobCallback( MQTTContext_t * pContext,
-                             MQTTPublishInfo_t * pPublishInfo )
+                             MQTTPublishInfo_t * pPublishInfo,
+                             void * pUserContext )
 {
     OtaEventData_t * pData;
     OtaEventMsg_t eventMsg = { 0 };
@@ -863,6 +1002,7 @@ static void mqttJobCallback( MQTTContext_t * pContext,
     assert( pContext != NULL );
 
     ( void ) pContext;
+    ( void ) pUserContext;
 
     jobMessageType = getJobMessageType( pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
 
@@ -885,7 +1025,7 @@ static void mqttJobCallback( MQTTContext_t * pContext,
             }
             else
             {
-                LogError( ( "No OTA data buffers available." ) );
+                LogRateLimited( LogError, ( "No OTA data buffers available." ) );
             }
 
             break;
@@ -900,7 +1040,8 @@ static void mqttJobCallback( MQTTContext_t * pContext,
 /*-----------------------------------------------------------*/
 
 static void mqttDataCallback( MQTTContext_t * pContext,
-                              MQTTPublishInfo_t * pPublishInfo )
+                              MQTTPublishInfo_t * pPublishInfo,
+                              void * pUserContext )
 {
     OtaEventData_t * pData;
     OtaEventMsg_t eventMsg = { 0 };
@@ -909,6 +1050,7 @@ static void mqttDataCallback( MQTTContext_t * pContext,
     assert( pContext != NULL );
 
     ( void ) pContext;
+    ( void ) pUserContext;
 
     LogInfo( ( "Received data message callback, size %zu.\n\n", pPublishInfo->payloadLength ) );
 
@@ -926,7 +1068,7 @@ static void mqttDataCallback( MQTTContext_t * pContext,
     }
     else
     {
-        LogError( ( "No OTA data buffers available." ) );
+        LogRateLimited( LogError, ( "No OTA data buffers available." ) );
     }
 }
 
@@ -987,7 +1129,7 @@ static void mqttEventCallback( MQTTContext_t * pMqttContext,
 
 static uint32_t generateRandomNumber()
 {
-    return( rand() );
+    return( esp_random() );
 }
 
 /*-----------------------------------------------------------*/
@@ -1011,7 +1153,11 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
     transport.recv = espTlsTransportRecv;
 
     /* Fill the values for network buffer. */
-    networkBuffer.pBuffer = otaNetworkBuffer;
+    #if BUFFER_ARENA_ENABLED
+        networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, OTA_NETWORK_BUFFER_SIZE );
+    #else
+        networkBuffer.pBuffer = otaNetworkBuffer;
+    #endif
     networkBuffer.size = OTA_NETWORK_BUFFER_SIZE;
 
     /* Initialize MQTT library. */
@@ -1021,7 +1167,12 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
                             mqttEventCallback,
                             &networkBuffer );
 
-    if( mqttStatus != MQTTSuccess )
+    if( networkBuffer.pBuffer == NULL )
+    {
+        returnStatus = EXIT_FAILURE;
+        LogError( ( "No network buffer available for the MQTT context." ) );
+    }
+    else if( mqttStatus != MQTTSuccess )
     {
         returnStatus = EXIT_FAILURE;
         LogError( ( "MQTT init failed: Status = %s.", MQTT_Status_strerror( mqttStatus ) ) );
@@ -1035,16 +1186,16 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
 static int priv_connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext )
 {
     int returnStatus = EXIT_SUCCESS;
-    BackoffAlgorithmStatus_t backoffAlgStatus = BackoffAlgorithmSuccess;
+    bool retry = true;
     TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
-    BackoffAlgorithmContext_t reconnectParams;
+    ReconnectPolicy_t reconnectPolicy;
     pNetworkContext->pcHostname = AWS_IOT_ENDPOINT;
     pNetworkContext->xPort = AWS_MQTT_PORT;
     pNetworkContext->pxTls = NULL;
     pNetworkContext->xTlsContextSemaphore = xSemaphoreCreateMutexStatic(&xTlsContextSemaphoreBuffer);
 
     pNetworkContext->disableSni = 0;
-    uint16_t nextRetryBackOff;
+    uint32_t nextRetryBackOff = 0U;
 
     /* Initialize credentials for establishing TLS session. */
     pNetworkContext->pcServerRootCAPem = root_cert_auth_pem_start;
@@ -1083,10 +1234,10 @@ static int priv_connectToServerWithBackoffRetries( NetworkContext_t * pNetworkCo
     }
 
     /* Initialize reconnect attempts and interval */
-    BackoffAlgorithm_InitializeParams( &reconnectParams,
-                                       CONNECTION_RETRY_BACKOFF_BASE_MS,
-                                       CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
-                                       CONNECTION_RETRY_MAX_ATTEMPTS );
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           CONNECTION_RETRY_BACKOFF_BASE_MS,
+                           CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                           CONNECTION_RETRY_MAX_ATTEMPTS );
 
     /* Attempt to connect to MQTT broker. If connection fails, retry after
      * a timeout. Timeout value will exponentially increase until maximum
@@ -1105,23 +1256,27 @@ static int priv_connectToServerWithBackoffRetries( NetworkContext_t * pNetworkCo
 
         if( tlsStatus != TLS_TRANSPORT_SUCCESS )
         {
-            /* Generate a random number and get back-off value (in milliseconds) for the next connection retry. */
-            backoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &reconnectParams, generateRandomNumber(), &nextRetryBackOff );
-
-            if( backoffAlgStatus == BackoffAlgorithmRetriesExhausted )
+            /* Get the back-off value (in milliseconds) for the next connection retry. A
+             * refused handshake waits longer. */
+            retry = ReconnectPolicy_NextDelay( &reconnectPolicy,
+                                               ( tlsStatus == TLS_TRANSPORT_HANDSHAKE_FAILED ) ?
+                                               ReconnectFailureRefused : ReconnectFailureNetwork,
+                                               &nextRetryBackOff );
+
+            if( retry == false )
             {
                 LogError( ( "Connection to the broker failed, all attempts exhausted." ) );
                 returnStatus = EXIT_FAILURE;
             }
-            else if( backoffAlgStatus == BackoffAlgorithmSuccess )
+            else
             {
                 LogWarn( ( "Connection to the broker failed. Retrying connection "
-                           "after %hu ms backoff.",
-                           ( unsigned short ) nextRetryBackOff ) );
+                           "after %u ms backoff.",
+                           ( unsigned ) nextRetryBackOff ) );
                 Clock_SleepMs( nextRetryBackOff );
             }
         }
-    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( backoffAlgStatus == BackoffAlgorithmSuccess ) );
+    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( retry == true ) );
 
     return returnStatus;
 }
@@ -1228,7 +1383,18 @@ static int establishConnection( void )
      * attempts are reached or maximum timeout value is reached. The function
      * returns EXIT_FAILURE if the TCP connection cannot be established to
      * broker after configured number of attempts. */
-    returnStatus = priv_connectToServerWithBackoffRetries( &networkContextMqtt );
+    #if BUFFER_ARENA_ENABLED
+        /* Borrow the buffer again if the last connection gave it back. */
+        if( mqttContext.networkBuffer.pBuffer == NULL )
+        {
+            mqttContext.networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, OTA_NETWORK_BUFFER_SIZE );
+        }
+
+        if( mqttContext.networkBuffer.pBuffer != NULL )
+    #endif
+    {
+        returnStatus = priv_connectToServerWithBackoffRetries( &networkContextMqtt );
+    }
 
     if( returnStatus != EXIT_SUCCESS )
     {
@@ -1300,43 +1466,86 @@ static void disconnect( void )
 
     /* End TLS session, then close TCP connection. */
     ( void ) xTlsDisconnect( &networkContextMqtt );
+
+    #if BUFFER_ARENA_ENABLED
+        /* Lend the buffer to other components until the next connection,
+         * under the lock so that no publish is using it. */
+        if( pthread_mutex_lock( &mqttMutex ) == 0 )
+        {
+            ( void ) BufferArena_Free( BufferArenaOwnerMqtt, mqttContext.networkBuffer.pBuffer );
+            mqttContext.networkBuffer.pBuffer = NULL;
+
+            pthread_mutex_unlock( &mqttMutex );
+        }
+    #endif
 }
 
-static int32_t connectToS3Server( NetworkContext_t * pNetworkContext,
-                                  const char * pUrl )
+/* Take a connection to the server of the pre-signed URL from the connection
+ * pool. The server is set from pUrl first if it isn't NULL, which is only done
+ * while no other task is taking connections. */
+static const TransportInterface_t * connectToS3Server( const char * pUrl )
 {
-    int32_t returnStatus = EXIT_SUCCESS;
+    NetworkContext_t * pNetworkContext = &networkContextHttp;
     HTTPStatus_t httpStatus = HTTPSuccess;
 
     /* The location of the host address within the pre-signed URL. */
     const char * pAddress = NULL;
 
-    /* Status returned by OpenSSL transport implementation. */
-    TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
+    #if CONFIG_EXAMPLE_OTA_PEER_DISTRIBUTION
+        /* A peer on the local network serves its image over plain HTTP, at
+         * the port in the URL. The image is authenticated by its signature
+         * in the job document, as an image from S3. */
+        if( ( pUrl != NULL ) && ( strncasecmp( pUrl, "http://", 7 ) == 0 ) )
+        {
+            httpStatus = getUrlAddress( pUrl, strlen( pUrl ), &pAddress, &serverHostLength );
 
-    pNetworkContext->disableSni = 0;
+            if( ( httpStatus != HTTPSuccess ) || ( serverHostLength >= sizeof( serverHost ) ) )
+            {
+                LogError( ( "URL %s parsing failed. Error code: %d",
+                            pUrl,
+                            httpStatus ) );
+                return NULL;
+            }
+
+            memcpy( serverHost, pAddress, serverHostLength );
+            serverHost[ serverHostLength ] = '\0';
+
+            /* The credentials and ALPN protocols are ignored without TLS. */
+            pNetworkContext->pcHostname = serverHost;
+            pNetworkContext->xPort = ( pAddress[ serverHostLength ] == ':' ) ?
+                                     atoi( &pAddress[ serverHostLength + 1U ] ) : 80;
+            pNetworkContext->xPlainTcp = true;
 
-    /* Initialize TLS credentials. */
-    pNetworkContext->pcServerRootCAPem = http_root_cert_auth_pem_start;
+            LogInfo( ( "Downloading the image from peer %s:%d.",
+                       serverHost, pNetworkContext->xPort ) );
+
+            pUrl = NULL;
+        }
+    #endif /* if CONFIG_EXAMPLE_OTA_PEER_DISTRIBUTION */
+
+    if( pUrl != NULL )
+    {
+        pNetworkContext->xPlainTcp = false;
+        pNetworkContext->disableSni = 0;
+
+        /* Initialize TLS credentials. */
+        pNetworkContext->pcServerRootCAPem = http_root_cert_auth_pem_start;
 
 #ifdef CONFIG_EXAMPLE_USE_SECURE_ELEMENT
-    pNetworkContext->pcClientCertPem = NULL;
-    pNetworkContext->pcClientKeyPem = NULL;
-    pNetworkContext->use_secure_element = true;
+        pNetworkContext->pcClientCertPem = NULL;
+        pNetworkContext->pcClientKeyPem = NULL;
+        pNetworkContext->use_secure_element = true;
 #elif CONFIG_EXAMPLE_USE_DS_PERIPHERAL
-    pNetworkContext->pcClientCertPem = client_cert_pem_start;
-    pNetworkContext->pcClientKeyPem = NULL;
+        pNetworkContext->pcClientCertPem = client_cert_pem_start;
+        pNetworkContext->pcClientKeyPem = NULL;
 #error "Populate the ds_data structure and remove this line"
-    /* pNetworkContext->ds_data = DS_DATA; */
-    /* The ds_data can be populated using the API's provided by esp_secure_cert_mgr */
+        /* pNetworkContext->ds_data = DS_DATA; */
+        /* The ds_data can be populated using the API's provided by esp_secure_cert_mgr */
 #else
-    pNetworkContext->pcClientCertPem = client_cert_pem_start;
-    pNetworkContext->pcClientKeyPem = client_key_pem_start;
+        pNetworkContext->pcClientCertPem = client_cert_pem_start;
+        pNetworkContext->pcClientKeyPem = client_key_pem_start;
 #endif
 
-    /* Retrieve the address location and length from S3_PRESIGNED_GET_URL. */
-    if( pUrl != NULL )
-    {
         /* Retrieve the address location and length from S3_PRESIGNED_GET_URL. */
         httpStatus = getUrlAddress( pUrl,
                                     strlen( pUrl ),
@@ -1353,10 +1562,7 @@ static int32_t connectToS3Server( NetworkContext_t * pNetworkContext,
         /* serverHost should consist only of the host address. */
         memcpy( serverHost, pAddress, serverHostLength );
         serverHost[ serverHostLength ] = '\0';
-    }
 
-    if( returnStatus != EXIT_FAILURE )
-    {
         /* Initialize server information. */
         pNetworkContext->pcHostname = serverHost;
         pNetworkContext->xPort = AWS_HTTPS_PORT;
@@ -1371,20 +1577,11 @@ static int32_t connectToS3Server( NetworkContext_t * pNetworkContext,
         } else {
              pNetworkContext->pAlpnProtos = NULL;
         }
-
-        /* Establish a TLS session with the HTTP server. This example connects
-         * to the HTTP server as specified in SERVER_HOST and HTTPS_PORT in
-         * demo_config.h. */
-        LogInfo( ( "Establishing a TLS session with %s:%d.",
-                   serverHost,
-                   AWS_HTTPS_PORT ) );
-
-        tlsStatus = xTlsConnect ( pNetworkContext );
-
-        returnStatus = ( tlsStatus == TLS_TRANSPORT_SUCCESS ) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    return returnStatus;
+    /* A connection kept open since the last request is handed out at once.
+     * Otherwise a TLS session is established with the HTTP server. */
+    return HttpConnectionPool_Acquire( pNetworkContext, HTTP_CONNECTION_TIMEOUT_MS );
 }
 
 /*-----------------------------------------------------------*/
@@ -1418,7 +1615,7 @@ static OtaHttpStatus_t handleHttpResponse( const HTTPResponse_t * pResponse )
             }
             else
             {
-                LogError( ( "Error: No OTA data buffers available." ) );
+                LogRateLimited( LogError, ( "Error: No OTA data buffers available." ) );
 
                 ret = OtaHttpRequestFailed;
             }
@@ -1446,6 +1643,590 @@ static OtaHttpStatus_t handleHttpResponse( const HTTPResponse_t * pResponse )
     return ret;
 }
 
+/*-----------------------------------------------------------*/
+
+#if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+
+/* Take a connection to the server of the pre-signed URL from the pool. */
+    static bool prefetchConnect( PrefetchConnection_t * pConnection )
+    {
+        pConnection->pTransport = connectToS3Server( NULL );
+
+        if( pConnection->pTransport == NULL )
+        {
+            LogWarn( ( "Failed to open a prefetch connection to %s.", serverHost ) );
+        }
+
+        return pConnection->pTransport != NULL;
+    }
+
+/* Send len bytes over a prefetch connection. */
+    static bool prefetchSend( PrefetchConnection_t * pConnection,
+                              const uint8_t * pData,
+                              size_t len )
+    {
+        uint32_t lastProgressMs = Clock_GetTimeMs();
+        int32_t sent;
+
+        while( len > 0U )
+        {
+            sent = pConnection->pTransport->send( pConnection->pTransport->pNetworkContext, pData, len );
+
+            if( sent < 0 )
+            {
+                break;
+            }
+            else if( sent > 0 )
+            {
+                pData += sent;
+                len -= ( size_t ) sent;
+                lastProgressMs = Clock_GetTimeMs();
+            }
+            else if( ( Clock_GetTimeMs() - lastProgressMs ) > PREFETCH_TIMEOUT_MS )
+            {
+                break;
+            }
+        }
+
+        return len == 0U;
+    }
+
+/* Receive up to len bytes over a prefetch connection, at least one unless it
+ * fails or times out. Returns the number of bytes received, or -1. */
+    static int32_t prefetchRecvSome( PrefetchConnection_t * pConnection,
+                                     uint8_t * pBuffer,
+                                     size_t len )
+    {
+        uint32_t startMs = Clock_GetTimeMs();
+        int32_t received = 0;
+
+        while( ( received == 0 ) && ( ( Clock_GetTimeMs() - startMs ) <= PREFETCH_TIMEOUT_MS ) )
+        {
+            received = pConnection->pTransport->recv( pConnection->pTransport->pNetworkContext, pBuffer, len );
+        }
+
+        return ( received > 0 ) ? received : -1;
+    }
+
+/* The value of a field of NUL terminated response headers, or NULL. */
+    static const char * prefetchFindHeader( const char * pHeaders,
+                                            const char * pField )
+    {
+        size_t fieldLen = strlen( pField );
+        const char * pLine = strstr( pHeaders, "\r\n" );
+        const char * pValue = NULL;
+
+        while( ( pLine != NULL ) && ( pValue == NULL ) )
+        {
+            pLine += 2;
+
+            if( ( strncasecmp( pLine, pField, fieldLen ) == 0 ) && ( pLine[ fieldLen ] == ':' ) )
+            {
+                pValue = &pLine[ fieldLen + 1U ];
+                pValue += strspn( pValue, " \t" );
+            }
+            else
+            {
+                pLine = strstr( pLine, "\r\n" );
+            }
+        }
+
+        return pValue;
+    }
+
+/* Receive and parse the headers of a response. The first bytes of the body
+ * received with them are left in the buffer. Returns false if the headers
+ * can't be received or aren't those of the range requested. */
+    static bool prefetchRecvHeaders( PrefetchConnection_t * pConnection,
+                                     uint32_t rangeStart,
+                                     PrefetchResponse_t * pResponse )
+    {
+        char * pHeaders = ( char * ) pConnection->buffer;
+        char * pEnd = NULL;
+        const char * pValue;
+        size_t len = 0;
+        int32_t received = 0;
+        unsigned int statusCode = 0;
+        unsigned long first = 0;
+        unsigned long last = 0;
+        unsigned long size = 0;
+
+        ( void ) memset( pResponse, 0, sizeof( *pResponse ) );
+
+        while( ( pEnd == NULL ) && ( received >= 0 ) && ( len < PREFETCH_BUFFER_LENGTH ) )
+        {
+            received = prefetchRecvSome( pConnection, &pConnection->buffer[ len ], PREFETCH_BUFFER_LENGTH - len );
+
+            if( received > 0 )
+            {
+                len += ( size_t ) received;
+                pConnection->buffer[ len ] = '\0';
+                pEnd = strstr( pHeaders, "\r\n\r\n" );
+            }
+        }
+
+        if( pEnd != NULL )
+        {
+            pEnd[ 2 ] = '\0';
+            pResponse->pBody = ( uint8_t * ) &pEnd[ 4 ];
+            pResponse->bodyInBuffer = len - ( size_t ) ( pResponse->pBody - pConnection->buffer );
+
+            ( void ) sscanf( pHeaders, "HTTP/%*u.%*u %u", &statusCode );
+            pResponse->statusCode = statusCode;
+
+            pValue = prefetchFindHeader( pHeaders, HTTP_CONTENT_LENGTH_FIELD );
+            pResponse->contentLength = ( pValue != NULL ) ? ( uint32_t ) strtoul( pValue, NULL, 10 ) : 0U;
+
+            pValue = prefetchFindHeader( pHeaders, HTTP_CONNECTION_FIELD );
+            pResponse->connectionClose = ( pValue != NULL ) && ( strncasecmp( pValue, "close", 5 ) == 0 );
+
+            pValue = prefetchFindHeader( pHeaders, HTTP_CONTENT_RANGE_FIELD );
+
+            /* The value is "bytes <first>-<last>/<size>". */
+            if( ( pValue != NULL ) &&
+                ( sscanf( pValue, "bytes %lu-%lu/%lu", &first, &last, &size ) == 3 ) &&
+                ( first == rangeStart ) && ( last - first + 1U == pResponse->contentLength ) )
+            {
+                pResponse->fileSize = ( uint32_t ) size;
+            }
+        }
+
+        return ( pEnd != NULL ) &&
+               ( ( pResponse->statusCode != HTTP_RESPONSE_PARTIAL_CONTENT ) || ( pResponse->fileSize != 0U ) );
+    }
+
+/* Put a fetched block in its slot, or free it if it was abandoned while
+ * being fetched. Called with the mutex held. */
+    static void prefetchPost( PrefetchConnection_t * pConnection,
+                              uint32_t block,
+                              OtaEventData_t * pData )
+    {
+        PrefetchSlot_t * pSlot = &prefetch.slots[ block % PREFETCH_WINDOW ];
+
+        if( ( pConnection->generation == prefetch.generation ) && ( block >= prefetch.deliverNext ) )
+        {
+            pSlot->block = block;
+            pSlot->pData = pData;
+        }
+        else
+        {
+            otaEventBufferFree( pData );
+        }
+
+        pConnection->fetchNext = block + 1U;
+        ( void ) pthread_cond_broadcast( &prefetch.cond );
+    }
+
+/* Wait until block fits in the slots. Returns false if it was abandoned. */
+    static bool prefetchWaitForSlot( uint32_t block,
+                                     uint32_t generation )
+    {
+        bool wanted;
+
+        ( void ) pthread_mutex_lock( &prefetch.mutex );
+
+        while( prefetch.running && ( generation == prefetch.generation ) &&
+               ( block >= prefetch.deliverNext + PREFETCH_WINDOW ) )
+        {
+            ( void ) pthread_cond_wait( &prefetch.cond, &prefetch.mutex );
+        }
+
+        wanted = prefetch.running && ( generation == prefetch.generation ) && ( block >= prefetch.deliverNext );
+
+        ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+        return wanted;
+    }
+
+/* Receive the next block of a response body, of length bytes, into an event
+ * buffer. The first bytes come from what was received with the headers. */
+    static OtaEventData_t * prefetchRecvBlock( PrefetchConnection_t * pConnection,
+                                               PrefetchResponse_t * pResponse,
+                                               uint32_t length )
+    {
+        OtaEventData_t * pData = otaEventBufferGet();
+        uint32_t filled = MIN( ( uint32_t ) pResponse->bodyInBuffer, length );
+        int32_t received = 0;
+
+        if( pData != NULL )
+        {
+            memcpy( pData->data, pResponse->pBody, filled );
+            pResponse->pBody += filled;
+            pResponse->bodyInBuffer -= filled;
+
+            while( ( filled < length ) && ( received >= 0 ) )
+            {
+                received = prefetchRecvSome( pConnection, &pData->data[ filled ], length - filled );
+
+                if( received > 0 )
+                {
+                    filled += ( uint32_t ) received;
+                }
+            }
+
+            if( filled < length )
+            {
+                otaEventBufferFree( pData );
+                pData = NULL;
+            }
+            else
+            {
+                pData->dataLength = length;
+            }
+        }
+
+        return pData;
+    }
+
+/* Fetch the blocks claimed by a connection, streaming the body of the
+ * response into event buffers a block at a time. Blocks that couldn't be
+ * fetched are left to be fetched on demand. */
+    static void prefetchFetch( PrefetchConnection_t * pConnection )
+    {
+        uint32_t firstBlock = pConnection->fetchNext;
+        uint32_t blockCount = pConnection->fetchEnd - pConnection->fetchNext;
+        uint32_t generation = pConnection->generation;
+        HTTPRequestInfo_t requestInfo = { 0 };
+        HTTPRequestHeaders_t requestHeaders = { 0 };
+        HTTPStatus_t httpStatus = HTTPNetworkError;
+        PrefetchResponse_t response = { 0 };
+        OtaEventData_t * pData;
+        uint32_t rangeStart = firstBlock * otaconfigFILE_BLOCK_SIZE;
+        uint32_t offset = 0;
+        uint32_t length;
+        uint32_t i = 0;
+        bool received = false;
+
+        if( prefetchConnect( pConnection ) )
+        {
+            requestInfo.pHost = serverHost;
+            requestInfo.hostLen = serverHostLength;
+            requestInfo.pMethod = HTTP_METHOD_GET;
+            requestInfo.methodLen = sizeof( HTTP_METHOD_GET ) - 1;
+            requestInfo.pPath = pPath;
+            requestInfo.pathLen = strlen( pPath );
+            requestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+
+            requestHeaders.pBuffer = pConnection->buffer;
+            requestHeaders.bufferLen = PREFETCH_BUFFER_LENGTH;
+
+            httpStatus = HTTPClient_InitializeRequestHeaders( &requestHeaders, &requestInfo );
+
+            if( httpStatus == HTTPSuccess )
+            {
+                httpStatus = HTTPClient_AddRangeHeader( &requestHeaders,
+                                                        ( int32_t ) rangeStart,
+                                                        ( int32_t ) ( rangeStart + ( blockCount * otaconfigFILE_BLOCK_SIZE ) - 1U ) );
+            }
+
+            received = ( httpStatus == HTTPSuccess ) &&
+                       prefetchSend( pConnection, requestHeaders.pBuffer, requestHeaders.headersLen ) &&
+                       prefetchRecvHeaders( pConnection, rangeStart, &response );
+        }
+        else
+        {
+            /* Don't retry the connection at once. */
+            vTaskDelay( CONNECTION_RETRY_BACKOFF_BASE_MS / portTICK_PERIOD_MS );
+        }
+
+        if( received && ( response.statusCode == HTTP_RESPONSE_PARTIAL_CONTENT ) )
+        {
+            ( void ) pthread_mutex_lock( &prefetch.mutex );
+            prefetch.fileSize = response.fileSize;
+            ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+            for( ; received && ( i < blockCount ) && ( offset < response.contentLength ); i++ )
+            {
+                length = MIN( response.contentLength - offset, otaconfigFILE_BLOCK_SIZE );
+
+                /* Only the last block of the file is short. Leave the rest of
+                 * the range to be fetched on demand if the block was abandoned
+                 * or the OTA agent has no event buffer to spare. */
+                received = ( ( length == otaconfigFILE_BLOCK_SIZE ) || ( rangeStart + offset + length == response.fileSize ) ) &&
+                           prefetchWaitForSlot( firstBlock + i, generation );
+
+                pData = received ? prefetchRecvBlock( pConnection, &response, length ) : NULL;
+                received = ( pData != NULL );
+
+                if( received )
+                {
+                    ( void ) pthread_mutex_lock( &prefetch.mutex );
+                    prefetchPost( pConnection, firstBlock + i, pData );
+                    ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+                    offset += length;
+                }
+            }
+        }
+        else if( received )
+        {
+            /* The URL may have expired, which the request on demand reports to
+             * the OTA agent. */
+            LogWarn( ( "Prefetch of blocks %u to %u failed: status %u.",
+                       firstBlock,
+                       firstBlock + blockCount - 1U,
+                       response.statusCode ) );
+        }
+
+        /* The connection can only take the next request once the whole body
+         * has been read. */
+        if( pConnection->pTransport != NULL )
+        {
+            HttpConnectionPool_Release( pConnection->pTransport,
+                                        ( !received || ( offset != response.contentLength ) || response.connectionClose ) ?
+                                        HttpConnectionReconnect : HttpConnectionReuse );
+            pConnection->pTransport = NULL;
+        }
+    }
+
+/* The number of blocks of the file, or UINT32_MAX until a response gave its
+ * size. Called with the mutex held. */
+    static uint32_t prefetchFileBlocks( void )
+    {
+        return ( prefetch.fileSize == 0U ) ? UINT32_MAX :
+               ( prefetch.fileSize + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE;
+    }
+
+/* The number of blocks a connection can fetch next, from fetchNext on. A
+ * range may reach past the slots, as its blocks are only received once they
+ * fit in. Called with the mutex held. */
+    static uint32_t prefetchClaim( void )
+    {
+        uint32_t fileBlocks = prefetchFileBlocks();
+        uint32_t count = 0;
+
+        if( ( prefetch.fetchNext < prefetch.deliverNext + PREFETCH_WINDOW ) && ( prefetch.fetchNext < fileBlocks ) )
+        {
+            count = MIN( fileBlocks - prefetch.fetchNext, ( uint32_t ) PREFETCH_RANGE_BLOCKS );
+        }
+
+        return count;
+    }
+
+/* Abandon the blocks fetched and carry on from block. Called with the mutex held. */
+    static void prefetchRestart( uint32_t block )
+    {
+        uint32_t i;
+
+        for( i = 0; i < PREFETCH_WINDOW; i++ )
+        {
+            if( prefetch.slots[ i ].pData != NULL )
+            {
+                otaEventBufferFree( prefetch.slots[ i ].pData );
+                prefetch.slots[ i ].pData = NULL;
+            }
+        }
+
+        prefetch.generation++;
+        prefetch.deliverNext = block;
+        prefetch.fetchNext = block;
+
+        ( void ) pthread_cond_broadcast( &prefetch.cond );
+    }
+
+/* Thread fetching ranges of blocks over one connection. */
+    static void * prefetchThread( void * pParam )
+    {
+        PrefetchConnection_t * pConnection = ( PrefetchConnection_t * ) pParam;
+        uint32_t blockCount;
+        uint32_t attempt;
+
+        ( void ) pthread_mutex_lock( &prefetch.mutex );
+
+        while( prefetch.running )
+        {
+            blockCount = prefetchClaim();
+
+            if( blockCount == 0U )
+            {
+                ( void ) pthread_cond_wait( &prefetch.cond, &prefetch.mutex );
+            }
+            else
+            {
+                pConnection->generation = prefetch.generation;
+                pConnection->fetchNext = prefetch.fetchNext;
+                pConnection->fetchEnd = prefetch.fetchNext + blockCount;
+                prefetch.fetchNext += blockCount;
+
+                for( attempt = 0;
+                     ( attempt < PREFETCH_ATTEMPTS ) && prefetch.running &&
+                     ( pConnection->generation == prefetch.generation ) &&
+                     ( MAX( pConnection->fetchNext, prefetch.deliverNext ) < pConnection->fetchEnd );
+                     attempt++ )
+                {
+                    /* Skip the blocks the OTA agent has fetched on demand meanwhile. */
+                    pConnection->fetchNext = MAX( pConnection->fetchNext, prefetch.deliverNext );
+
+                    ( void ) pthread_mutex_unlock( &prefetch.mutex );
+                    prefetchFetch( pConnection );
+                    ( void ) pthread_mutex_lock( &prefetch.mutex );
+
+                    /* Ranges claimed before the size of the file was known
+                     * may reach past its end. */
+                    pConnection->fetchEnd = MIN( pConnection->fetchEnd, prefetchFileBlocks() );
+                }
+
+                /* The blocks left are fetched on demand. */
+                pConnection->fetchEnd = pConnection->fetchNext;
+                ( void ) pthread_cond_broadcast( &prefetch.cond );
+            }
+        }
+
+        ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+        return NULL;
+    }
+
+/* Whether a connection is fetching block, or is going to. Called with the
+ * mutex held. */
+    static bool prefetchPending( uint32_t block )
+    {
+        bool pending = ( block >= prefetch.fetchNext ) && ( block < prefetchFileBlocks() );
+        uint32_t i;
+
+        for( i = 0; i < PREFETCH_CONNECTIONS; i++ )
+        {
+            pending = pending ||
+                      ( ( prefetchConnections[ i ].generation == prefetch.generation ) &&
+                        ( block >= prefetchConnections[ i ].fetchNext ) &&
+                        ( block < prefetchConnections[ i ].fetchEnd ) );
+        }
+
+        return pending;
+    }
+
+    static void prefetchStart( void )
+    {
+        uint32_t i;
+        uint32_t started = 0;
+
+        ( void ) pthread_mutex_lock( &prefetch.mutex );
+        prefetch.running = true;
+        prefetch.fileSize = 0;
+        prefetchRestart( 0 );
+        ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+        for( i = 0; i < PREFETCH_CONNECTIONS; i++ )
+        {
+            prefetchConnections[ i ].started = ( pthread_create( &prefetchConnections[ i ].thread,
+                                                                 NULL,
+                                                                 prefetchThread,
+                                                                 &prefetchConnections[ i ] ) == 0 );
+
+            if( prefetchConnections[ i ].started )
+            {
+                started++;
+            }
+        }
+
+        if( started < PREFETCH_CONNECTIONS )
+        {
+            LogWarn( ( "Only %u of %u prefetch threads started.", started, PREFETCH_CONNECTIONS ) );
+        }
+
+        if( started == 0U )
+        {
+            /* Fetch every block on demand. */
+            ( void ) pthread_mutex_lock( &prefetch.mutex );
+            prefetch.running = false;
+            ( void ) pthread_mutex_unlock( &prefetch.mutex );
+        }
+    }
+
+    static void prefetchStop( void )
+    {
+        uint32_t i;
+
+        ( void ) pthread_mutex_lock( &prefetch.mutex );
+        prefetch.running = false;
+        ( void ) pthread_cond_broadcast( &prefetch.cond );
+        ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+        for( i = 0; i < PREFETCH_CONNECTIONS; i++ )
+        {
+            if( prefetchConnections[ i ].started )
+            {
+                ( void ) pthread_join( prefetchConnections[ i ].thread, NULL );
+                prefetchConnections[ i ].started = false;
+            }
+        }
+
+        /* No thread is left to post blocks. */
+        ( void ) pthread_mutex_lock( &prefetch.mutex );
+
+        if( ( prefetch.hits + prefetch.misses ) > 0U )
+        {
+            LogInfo( ( "Blocks fetched ahead: %u   Fetched on demand: %u",
+                       prefetch.hits,
+                       prefetch.misses ) );
+            prefetch.hits = 0;
+            prefetch.misses = 0;
+        }
+
+        prefetchRestart( 0 );
+        ( void ) pthread_mutex_unlock( &prefetch.mutex );
+    }
+
+    static bool prefetchDeliver( uint32_t rangeStart,
+                                 uint32_t rangeEnd )
+    {
+        uint32_t block = rangeStart / otaconfigFILE_BLOCK_SIZE;
+        PrefetchSlot_t * pSlot = &prefetch.slots[ block % PREFETCH_WINDOW ];
+        OtaEventData_t * pData = NULL;
+        OtaEventMsg_t eventMsg = { 0 };
+
+        ( void ) pthread_mutex_lock( &prefetch.mutex );
+
+        if( prefetch.running && ( ( rangeStart % otaconfigFILE_BLOCK_SIZE ) == 0U ) )
+        {
+            if( block != prefetch.deliverNext )
+            {
+                prefetchRestart( block );
+            }
+
+            while( prefetch.running && ( pSlot->pData == NULL ) && prefetchPending( block ) )
+            {
+                ( void ) pthread_cond_wait( &prefetch.cond, &prefetch.mutex );
+            }
+
+            if( ( pSlot->pData != NULL ) && ( pSlot->block == block ) &&
+                ( pSlot->pData->dataLength == rangeEnd - rangeStart + 1U ) )
+            {
+                pData = pSlot->pData;
+                prefetch.hits++;
+            }
+            else
+            {
+                if( pSlot->pData != NULL )
+                {
+                    otaEventBufferFree( pSlot->pData );
+                }
+
+                prefetch.misses++;
+            }
+
+            pSlot->pData = NULL;
+            prefetch.deliverNext = block + 1U;
+            ( void ) pthread_cond_broadcast( &prefetch.cond );
+        }
+
+        ( void ) pthread_mutex_unlock( &prefetch.mutex );
+
+        if( pData != NULL )
+        {
+            /* Send file block received event. */
+            eventMsg.eventId = OtaAgentEventReceivedFileBlock;
+            eventMsg.pEventData = pData;
+            OTA_SignalEvent( &eventMsg );
+        }
+
+        return pData != NULL;
+    }
+
+#endif /* CONFIG_EXAMPLE_OTA_HTTP_PREFETCH */
+
+/*-----------------------------------------------------------*/
+
 static OtaHttpStatus_t httpInit( char * pUrl )
 {
     /* OTA lib return error code. */
@@ -1454,8 +2235,8 @@ static OtaHttpStatus_t httpInit( char * pUrl )
     /* HTTPS Client library return status. */
     HTTPStatus_t httpStatus = HTTPSuccess;
 
-    /* Return value from libraries. */
-    int32_t returnStatus = EXIT_SUCCESS;
+    /* The connection to the HTTP server. */
+    const TransportInterface_t * pTransport = NULL;
 
     /* The length of the path within the pre-signed URL. This variable is
      * defined in order to store the length returned from parsing the URL, but
@@ -1464,23 +2245,18 @@ static OtaHttpStatus_t httpInit( char * pUrl )
      * S3 presigned URL. */
     size_t pathLen = 0;
 
-    /* Establish HTTPs connection */
-    LogInfo( ( "Performing TLS handshake on top of the TCP connection." ) );
+    #if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+        /* The URL of the file fetched ahead is about to change. */
+        prefetchStop();
+    #endif
 
-    /* Attempt to connect to the HTTPs server. If connection fails, retry after
-     * a timeout. Timeout value will be exponentially increased till the maximum
-     * attempts are reached or maximum timeout value is reached. The function
-     * returns EXIT_FAILURE if the TCP connection cannot be established to
-     * broker after configured number of attempts. */
-    returnStatus = connectToS3Server( &networkContextHttp, pUrl );
+    /* Open a connection to the HTTPs server, which the pool keeps open for
+     * the requests of the file blocks. */
+    pTransport = connectToS3Server( pUrl );
 
-    if( returnStatus == EXIT_SUCCESS )
+    if( pTransport != NULL )
     {
-        /* Define the transport interface. */
-        ( void ) memset( &transportInterfaceHttp, 0, sizeof( transportInterfaceHttp ) );
-        transportInterfaceHttp.recv = espTlsTransportRecv;
-        transportInterfaceHttp.send = espTlsTransportSend;
-        transportInterfaceHttp.pNetworkContext = &networkContextHttp;
+        HttpConnectionPool_Release( pTransport, HttpConnectionReuse );
 
         /* Retrieve the path location from url. This
          * function returns the length of the path without the query into
@@ -1491,6 +2267,13 @@ static OtaHttpStatus_t httpInit( char * pUrl )
                                  &pathLen );
 
         ret = ( httpStatus == HTTPSuccess ) ? OtaHttpSuccess : OtaHttpInitFailed;
+
+        #if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+            if( ret == OtaHttpSuccess )
+            {
+                prefetchStart();
+            }
+        #endif
     }
     else
     {
@@ -1522,14 +2305,43 @@ static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
     /* Return value of all methods from the HTTP Client library API. */
     HTTPStatus_t httpStatus = HTTPSuccess;
 
+    /* The connection to the HTTP server. */
+    const TransportInterface_t * pTransport = NULL;
+
     /* Reconnection required flag. */
     bool reconnectRequired = false;
 
+    /* The buffer of the request headers and of the response. */
+    #if BUFFER_ARENA_ENABLED
+        uint8_t * pUserBuffer = NULL;
+    #else
+        uint8_t * pUserBuffer = httpUserBuffer;
+    #endif
+
     /* Initialize all HTTP Client library API structs to 0. */
     ( void ) memset( &requestInfo, 0, sizeof( requestInfo ) );
     ( void ) memset( &response, 0, sizeof( response ) );
     ( void ) memset( &requestHeaders, 0, sizeof( requestHeaders ) );
 
+    #if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+        /* The block was fetched ahead, and has been handed to the OTA agent. */
+        if( prefetchDeliver( rangeStart, rangeEnd ) )
+        {
+            return OtaHttpSuccess;
+        }
+    #endif
+
+    #if BUFFER_ARENA_ENABLED
+        /* Borrowed for this request only. The OTA agent requests the block
+         * again if no slot is free. */
+        pUserBuffer = BufferArena_Alloc( BufferArenaOwnerHttp, HTTP_USER_BUFFER_LENGTH );
+
+        if( pUserBuffer == NULL )
+        {
+            return OtaHttpRequestFailed;
+        }
+    #endif
+
     /* Initialize the request object. */
     requestInfo.pHost = serverHost;
     requestInfo.hostLen = serverHostLength;
@@ -1543,7 +2355,7 @@ static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
     requestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
 
     /* Set the buffer used for storing request headers. */
-    requestHeaders.pBuffer = httpUserBuffer;
+    requestHeaders.pBuffer = pUserBuffer;
     requestHeaders.bufferLen = HTTP_USER_BUFFER_LENGTH;
 
     httpStatus = HTTPClient_InitializeRequestHeaders( &requestHeaders,
@@ -1553,13 +2365,27 @@ static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
 
     if( httpStatus == HTTPSuccess )
     {
+        pTransport = connectToS3Server( NULL );
+
+        if( pTransport == NULL )
+        {
+            LogError( ( "Failed to connect to HTTP server %s.",
+                        serverHost ) );
+
+            #if BUFFER_ARENA_ENABLED
+                ( void ) BufferArena_Free( BufferArenaOwnerHttp, pUserBuffer );
+            #endif
+
+            return OtaHttpRequestFailed;
+        }
+
         /* Initialize the response object. The same buffer used for storing
          * request headers is reused here. */
-        response.pBuffer = httpUserBuffer;
+        response.pBuffer = pUserBuffer;
         response.bufferLen = HTTP_USER_BUFFER_LENGTH;
 
         /* Send the request and receive the response. */
-        httpStatus = HTTPClient_Send( &transportInterfaceHttp,
+        httpStatus = HTTPClient_Send( pTransport,
                                       &requestHeaders,
                                       NULL,
                                       0,
@@ -1574,17 +2400,18 @@ static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
 
     if( httpStatus != HTTPSuccess )
     {
-        if( ( httpStatus == HTTPNoResponse ) || ( httpStatus == HTTPNetworkError ) )
-        {
-            reconnectRequired = true;
-        }
-        else
+        /* The OTA agent requests the block again after a network error, by
+         * when the connection has been reopened in the background. */
+        if( ( httpStatus != HTTPNoResponse ) && ( httpStatus != HTTPNetworkError ) )
         {
             LogError( ( "HTTPClient_Send failed: Error=%s.",
                         HTTPClient_strerror( httpStatus ) ) );
 
             ret = OtaHttpRequestFailed;
         }
+
+        /* What is left of the response can't be told from the next one. */
+        reconnectRequired = true;
     }
     else
     {
@@ -1598,27 +2425,17 @@ static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
         ret = handleHttpResponse( &response );
     }
 
-    if( reconnectRequired == true )
+    if( pTransport != NULL )
     {
-        /* End TLS session, then close TCP connection. */
-        ( void ) xTlsDisconnect( &networkContextHttp );
-
-        /* Try establishing connection to S3 server again. */
-        if( connectToS3Server( &networkContextHttp, NULL ) == EXIT_SUCCESS )
-        {
-            ret = HTTPSuccess;
-        }
-        else
-        {
-            /* Log an error to indicate connection failure after all
-             * reconnect attempts are over. */
-            LogError( ( "Failed to connect to HTTP server %s.",
-                        serverHost ) );
-
-            ret = OtaHttpRequestFailed;
-        }
+        /* The pool reconnects in the background, before the next request. */
+        HttpConnectionPool_Release( pTransport,
+                                    reconnectRequired ? HttpConnectionReconnect : HttpConnectionReuse );
     }
 
+    #if BUFFER_ARENA_ENABLED
+        ( void ) BufferArena_Free( BufferArenaOwnerHttp, pUserBuffer );
+    #endif
+
     return ret;
 }
 
@@ -1626,7 +2443,12 @@ static OtaHttpStatus_t httpDeinit( void )
 {
     OtaHttpStatus_t ret = OtaHttpSuccess;
 
-    /* Nothing special to do here .*/
+    #if CONFIG_EXAMPLE_OTA_HTTP_PREFETCH
+        prefetchStop();
+    #endif
+
+    /* No more blocks are requested from the server. */
+    HttpConnectionPool_CloseIdle( &networkContextHttp );
 
     return ret;
 }
@@ -1669,7 +2491,8 @@ static void registerSubscriptionManagerCallback( const char * pTopicFilter,
             /* Register callback to subscription manager. */
             subscriptionStatus = SubscriptionManager_RegisterCallback( pWildCardTopicFilters[ index ],
                                                                        strlen( pWildCardTopicFilters[ index ] ),
-                                                                       otaMessageCallback[ index ] );
+                                                                       otaMessageCallback[ index ],
+                                                                       NULL );
 
             if( subscriptionStatus != SUBSCRIPTION_MANAGER_SUCCESS )
             {
@@ -1934,6 +2757,19 @@ static void * otaThread( void * pParam )
     return NULL;
 }
 
+/*-----------------------------------------------------------*/
+
+#if CONFIG_OTA_PAL_FAST_COMMIT
+
+/* Checks run on a new image before it is committed. A real device would check
+ * its own peripherals and services here; the demo only needs the heap it runs on. */
+    static bool otaHealthCheck( void )
+    {
+        return esp_get_free_heap_size() > 0;
+    }
+
+#endif
+
 /*-----------------------------------------------------------*/
 static int startOTADemo( void )
 {
@@ -1955,6 +2791,9 @@ static int startOTADemo( void )
     /* OTA library packet statistics per job.*/
     OtaAgentStatistics_t otaStatistics = { 0 };
 
+    /* OTA event buffer pool statistics.*/
+    OtaEventPoolStats_t poolStats = { 0 };
+
     /* OTA Agent thread handle.*/
     pthread_t threadHandle;
 
@@ -1974,6 +2813,11 @@ static int startOTADemo( void )
          returnStatus = EXIT_FAILURE;
     }
 
+#if CONFIG_OTA_PAL_FAST_COMMIT
+    /* Commit an image in self test now rather than after the job round trip. */
+    otaPal_FastCommit( otaHealthCheck );
+#endif
+
     /****************************** Init OTA Library. ******************************/
 
     if( returnStatus == EXIT_SUCCESS )
@@ -1990,6 +2834,15 @@ static int startOTADemo( void )
         }
     }
 
+    #if CONFIG_EXAMPLE_OTA_PEER_DISTRIBUTION
+        /* Serve the running image to peers on the local network. Requests are
+         * refused until the image has been accepted after its self-test. */
+        if( returnStatus == EXIT_SUCCESS )
+        {
+            ( void ) OtaPeerServer_Start();
+        }
+    #endif
+
     /****************************** Create OTA Task. ******************************/
 
     if( returnStatus == EXIT_SUCCESS )
@@ -2064,6 +2917,14 @@ static int startOTADemo( void )
                                otaStatistics.otaPacketsProcessed,
                                otaStatistics.otaPacketsDropped ) );
 
+                    /* Get event buffer pool statistics. */
+                    OtaEventPool_GetStats( &poolStats );
+
+                    LogInfo( ( " Event buffers in use: %u   High-water: %u   Dropped for lack of a buffer: %u",
+                               poolStats.inUse,
+                               poolStats.highWater,
+                               poolStats.drops ) );
+
                     /* Delay if mqtt process loop is set to zero.*/
                     if( MQTT_PROCESS_LOOP_TIMEOUT_MS > 0 )
                     {
@@ -2140,8 +3001,7 @@ int aws_iot_demo_main( int argc,
     /* Return error status. */
     int returnStatus = EXIT_SUCCESS;
 
-    /* Semaphore initialization flag. */
-    bool bufferSemInitialized = false;
+    /* Mutex initialization flag. */
     bool mqttMutexInitialized = false;
 
     /* Maximum time in milliseconds to wait before exiting demo . */
@@ -2152,22 +3012,18 @@ int aws_iot_demo_main( int argc,
                appFirmwareVersion.u.x.minor,
                appFirmwareVersion.u.x.build ) );
 
-    /* Initialize semaphore for buffer operations. */
-    if( osi_sem_new( &bufferSemaphore, 0x7FFFU, 1 ) != 0 )
+    /* Initialize the pool of buffers for OTA events. */
+    OtaEventPool_Init();
+
+    /* Build the topics of the thing the OTA library is given. */
+    if( ThingTopics_Init( &thingTopics, CLIENT_IDENTIFIER, CLIENT_IDENTIFIER_LENGTH, NULL, 0U ) == false )
     {
-        LogError( ( "Failed to initialize buffer semaphore"
-                    ",errno=%s",
-                    strerror( errno ) ) );
+        LogError( ( "The topics of thing %s don't fit in the topic table.", CLIENT_IDENTIFIER ) );
 
         returnStatus = EXIT_FAILURE;
     }
-    else
-    {
-        bufferSemInitialized = true;
-    }
-
     /* Initialize mutex for coreMQTT APIs. */
-    if( pthread_mutex_init( &mqttMutex, NULL ) != 0 )
+    else if( pthread_mutex_init( &mqttMutex, NULL ) != 0 )
     {
         LogError( ( "Failed to initialize mutex for mqtt apis"
                     ",errno=%s",
@@ -2197,20 +3053,7 @@ int aws_iot_demo_main( int argc,
     disconnect();
 
     /* Disconnect from S3 and close connection. */
-    xTlsDisconnect( &networkContextHttp );
-
-    if( bufferSemInitialized == true )
-    {
-        /* Cleanup semaphore created for buffer operations. */
-        if( osi_sem_free( &bufferSemaphore ) != 0 )
-        {
-            LogError( ( "Failed to destroy buffer semaphore"
-                        ",errno=%s",
-                        strerror( errno ) ) );
-
-            returnStatus = EXIT_FAILURE;
-        }
-    }
+    HttpConnectionPool_CloseIdle( &networkContextHttp );
 
     if( mqttMutexInitialized == true )
     {
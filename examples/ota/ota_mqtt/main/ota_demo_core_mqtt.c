@@ -28,6 +28,7 @@
 /* Standard includes. */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <errno.h>
 
@@ -42,11 +43,11 @@
 
 /* pthread include. */
 #include <pthread.h>
-#include "semaphore.h"
 #include <unistd.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_pthread.h"
+#include "esp_system.h"
 
 /* MQTT include. */
 #include "core_mqtt.h"
@@ -55,6 +56,10 @@
 /*Include backoff algorithm header for retry logic.*/
 #include "backoff_algorithm.h"
 
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
+#include "esp_random.h"
+
 /* OTA Library include. */
 #include "ota.h"
 #include "ota_config.h"
@@ -64,6 +69,21 @@
 #include "ota_mqtt_interface.h"
 #include "ota_pal.h"
 
+/* Include OTA event buffer pool. */
+#include "ota_event_pool.h"
+
+/* Include the buffer placement policy. */
+#include "mem_placement.h"
+
+/* Include the shared buffer arena. */
+#include "buffer_arena.h"
+
+/* Include the prebuilt topics of the thing. */
+#include "thing_topics.h"
+
+/* Include the capture of the transport for replay. */
+#include "transport_capture.h"
+
 /* Include firmware version struct definition. */
 #include "ota_appversion32.h"
 
@@ -139,9 +159,10 @@ extern const char pcAwsCodeSigningCertPem[] asm("_binary_aws_codesign_crt_start"
 #define MQTT_PUBLISH_RETRY_MAX_ATTEMPS      ( 3U )
 
 /**
- * @brief Period for demo loop sleep in milliseconds.
+ * @brief The longest the demo loop waits for the broker before checking the
+ * state of the OTA agent again, in milliseconds.
  */
-#define OTA_EXAMPLE_LOOP_SLEEP_PERIOD_MS    ( 5U )
+#define OTA_EXAMPLE_MAX_IDLE_WAIT_MS        ( 1000U )
 
 /**
  * @brief Size of the network buffer to receive the MQTT message.
@@ -152,6 +173,12 @@ extern const char pcAwsCodeSigningCertPem[] asm("_binary_aws_codesign_crt_start"
 
 #define OTA_NETWORK_BUFFER_SIZE                  ( otaconfigFILE_BLOCK_SIZE + 128 )
 
+/**
+ * @brief Whether the network buffer is borrowed from the buffer arena while
+ * connected. The slabs of the zero-copy mode stay static.
+ */
+#define OTA_NETWORK_BUFFER_BORROWED              ( BUFFER_ARENA_ENABLED && !OTA_EVENT_POOL_ZERO_COPY )
+
 /**
  * @brief The delay used in the main OTA Demo task loop to periodically output the OTA
  * statistics like number of packets received, dropped, processed and queued per connection.
@@ -237,6 +264,11 @@ extern const char pcAwsCodeSigningCertPem[] asm("_binary_aws_codesign_crt_start"
  */
 #define OTA_TOPIC_STREAM    "streams"
 
+/**
+ * @brief The end of the topics block requests are published on.
+ */
+#define OTA_STREAM_REQUEST_SUFFIX    "/get/cbor"
+
 
 /*-----------------------------------------------------------*/
 
@@ -279,9 +311,9 @@ static bool mqttSessionEstablished = false;
 static pthread_mutex_t mqttMutex;
 
 /**
- * @brief Semaphore for synchronizing buffer operations.
+ * @brief The jobs topics of the thing, built once at start-up.
  */
-static osi_sem_t bufferSemaphore;
+static ThingTopics_t thingTopics;
 
 /**
  * @brief Enum for type of OTA job messages received.
@@ -296,7 +328,14 @@ typedef enum jobMessageType
 /**
  * @brief The network buffer must remain valid when OTA library task is running.
  */
-static uint8_t otaNetworkBuffer[ OTA_NETWORK_BUFFER_SIZE ];
+#if OTA_EVENT_POOL_ZERO_COPY
+
+/* The network buffer is split into slabs, so that payloads are handed to the
+ * OTA agent in the slab they were received into. */
+    static uint8_t otaNetworkBuffer[ OTA_EVENT_POOL_SLABS * OTA_EVENT_POOL_SLAB_SIZE( OTA_NETWORK_BUFFER_SIZE ) ] __attribute__( ( aligned( 4 ) ) ) MEM_PLACEMENT_NETWORK_ATTR;
+#elif !OTA_NETWORK_BUFFER_BORROWED
+    static uint8_t otaNetworkBuffer[ OTA_NETWORK_BUFFER_SIZE ] MEM_PLACEMENT_NETWORK_ATTR;
+#endif
 
 /**
  * @brief Update File path buffer.
@@ -323,11 +362,6 @@ uint8_t decodeMem[ otaconfigFILE_BLOCK_SIZE ];
  */
 uint8_t bitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
 
-/**
- * @brief Event buffer.
- */
-static OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
-
 /**
  * @brief The buffer passed to the OTA Agent from application while initializing.
  */
@@ -466,6 +500,15 @@ static void disconnect( void );
  */
 static int establishConnection( void );
 
+/**
+ * @brief Sleep until the broker sends something, a keep-alive is due or
+ * #OTA_EXAMPLE_MAX_IDLE_WAIT_MS elapses, without holding the MQTT mutex.
+ *
+ * @return 1 if a packet is waiting, 0 on timeout, or -1 if the connection
+ * failed.
+ */
+static int32_t waitForIncomingPacket( void );
+
 /**
  * @brief Initialize MQTT by setting up transport interface and network.
  *
@@ -535,18 +578,36 @@ static void mqttEventCallback( MQTTContext_t * pMqttContext,
  * @param[in] pContext MQTT context which stores the connection.
  * @param[in] pPublishInfo MQTT packet information which stores details of the
  * job document.
+ * @param[in] pUserContext Unused user context.
  */
 static void mqttJobCallback( MQTTContext_t * pContext,
-                             MQTTPublishInfo_t * pPublishInfo );
+                             MQTTPublishInfo_t * pPublishInfo,
+                             void * pUserContext );
 
 /**
  * @brief Callback that notifies the OTA library when a data block is received.
  *
  * @param[in] pContext MQTT context which stores the connection.
  * @param[in] pPublishInfo MQTT packet that stores the information of the file block.
+ * @param[in] pUserContext Unused user context.
  */
 static void mqttDataCallback( MQTTContext_t * pContext,
-                              MQTTPublishInfo_t * pPublishInfo );
+                              MQTTPublishInfo_t * pPublishInfo,
+                              void * pUserContext );
+
+/**
+ * @brief Get an OTA event holding the payload of a received PUBLISH.
+ *
+ * The payload is handed over in place when the zero-copy mode of the event
+ * pool allows it, and copied into an event buffer otherwise.
+ *
+ * @param[in] pContext MQTT context the PUBLISH was received with.
+ * @param[in] pPublishInfo The received PUBLISH.
+ *
+ * @return The event, or NULL if no buffer is available.
+ */
+static OtaEventData_t * otaEventBufferTake( MQTTContext_t * pContext,
+                                            const MQTTPublishInfo_t * pPublishInfo );
 
 static SubscriptionManagerCallback_t otaMessageCallback[] = { mqttJobCallback, mqttDataCallback };
 
@@ -554,48 +615,41 @@ static SubscriptionManagerCallback_t otaMessageCallback[] = { mqttJobCallback, m
 
 void otaEventBufferFree( OtaEventData_t * const pxBuffer )
 {
-    if( osi_sem_take( &bufferSemaphore, 0 ) == 0 )
-    {
-        pxBuffer->bufferUsed = false;
-        ( void ) osi_sem_give( &bufferSemaphore );
-    }
-    else
-    {
-        LogError( ( "Failed to get buffer semaphore: "
-                    ",errno=%s",
-                    strerror( errno ) ) );
-    }
+    OtaEventPool_Free( pxBuffer );
 }
 
 /*-----------------------------------------------------------*/
 
 OtaEventData_t * otaEventBufferGet( void )
 {
-    uint32_t ulIndex = 0;
-    OtaEventData_t * pFreeBuffer = NULL;
+    return OtaEventPool_Get();
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaEventData_t * otaEventBufferTake( MQTTContext_t * pContext,
+                                            const MQTTPublishInfo_t * pPublishInfo )
+{
+    OtaEventData_t * pData = NULL;
 
-    if( osi_sem_take( &bufferSemaphore, 0 ) == 0 )
+    #if OTA_EVENT_POOL_ZERO_COPY
+        pData = OtaEventPool_TakePayload( pContext, pPublishInfo );
+    #else
+        ( void ) pContext;
+    #endif
+
+    if( pData == NULL )
     {
-        for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
+        pData = otaEventBufferGet();
+
+        if( pData != NULL )
         {
-            if( eventBuffer[ ulIndex ].bufferUsed == false )
-            {
-                eventBuffer[ ulIndex ].bufferUsed = true;
-                pFreeBuffer = &eventBuffer[ ulIndex ];
-                break;
-            }
+            memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+            pData->dataLength = pPublishInfo->payloadLength;
         }
-
-        ( void ) osi_sem_give( &bufferSemaphore );
-    }
-    else
-    {
-        LogError( ( "Failed to get buffer semaphore: "
-                    ",errno=%s",
-                    strerror( errno ) ) );
     }
 
-    return pFreeBuffer;
+    return pData;
 }
 
 /*-----------------------------------------------------------*/
@@ -611,6 +665,11 @@ static void otaAppCallback( OtaJobEvent_t event,
         case OtaJobEventActivate:
             LogInfo( ( "Received OtaJobEventActivate callback from OTA Agent." ) );
 
+            #if CONFIG_TRANSPORT_CAPTURE
+                /* Write out the capture before the reset. */
+                TransportCapture_Stop();
+            #endif
+
             /* Activate the new firmware image. */
             OTA_ActivateNewImage();
 
@@ -683,37 +742,20 @@ static void otaAppCallback( OtaJobEvent_t event,
 jobMessageType_t getJobMessageType( const char * pTopicName,
                                     uint16_t topicNameLength )
 {
-    uint16_t index = 0U;
-    MQTTStatus_t mqttStatus = MQTTSuccess;
-    bool isMatch = false;
     jobMessageType_t jobMessageIndex = jobMessageTypeMax;
 
-    /* For suppressing compiler-warning: unused variable. */
-    ( void ) mqttStatus;
-
-    /* Lookup table for OTA job message string. */
-    static const char * const pJobTopicFilters[ jobMessageTypeMax ] =
+    switch( ThingTopics_Classify( &thingTopics, pTopicName, topicNameLength ) )
     {
-        OTA_TOPIC_PREFIX OTA_TOPIC_JOBS "/$next/get/accepted",
-        OTA_TOPIC_PREFIX OTA_TOPIC_JOBS "/notify-next",
-    };
+        case ThingTopicJobsNextGetAccepted:
+            jobMessageIndex = jobMessageTypeNextGetAccepted;
+            break;
 
-    /* Match the input topic filter against the wild-card pattern of topics filters
-    * relevant for the OTA Update service to determine the type of topic filter. */
-    for( ; index < jobMessageTypeMax; index++ )
-    {
-        mqttStatus = MQTT_MatchTopic( pTopicName,
-                                      topicNameLength,
-                                      pJobTopicFilters[ index ],
-                                      strlen( pJobTopicFilters[ index ] ),
-                                      &isMatch );
-        assert( mqttStatus == MQTTSuccess );
+        case ThingTopicJobsNotifyNext:
+            jobMessageIndex = jobMessageTypeNextNotify;
+            break;
 
-        if( isMatch )
-        {
-            jobMessageIndex = index;
+        default:
             break;
-        }
     }
 
     return jobMessageIndex;
@@ -722,7 +764,8 @@ jobMessageType_t getJobMessageType( const char * pTopicName,
 /*-----------------------------------------------------------*/
 
 static void mqttJobCallback( MQTTContext_t * pContext,
-                             MQTTPublishInfo_t * pPublishInfo )
+                             MQTTPublishInfo_t * pPublishInfo,
+                             void * pUserContext )
 {
     OtaEventData_t * pData;
     OtaEventMsg_t eventMsg = { 0 };
@@ -732,6 +775,7 @@ static void mqttJobCallback( MQTTContext_t * pContext,
     assert( pContext != NULL );
 
     ( void ) pContext;
+    ( void ) pUserContext;
 
     jobMessageType = getJobMessageType( pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
 
@@ -740,12 +784,10 @@ static void mqttJobCallback( MQTTContext_t * pContext,
         case jobMessageTypeNextGetAccepted:
         case jobMessageTypeNextNotify:
 
-            pData = otaEventBufferGet();
+            pData = otaEventBufferTake( pContext, pPublishInfo );
 
             if( pData != NULL )
             {
-                memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
-                pData->dataLength = pPublishInfo->payloadLength;
                 eventMsg.eventId = OtaAgentEventReceivedJobDocument;
                 eventMsg.pEventData = pData;
 
@@ -754,7 +796,7 @@ static void mqttJobCallback( MQTTContext_t * pContext,
             }
             else
             {
-                LogError( ( "No OTA data buffers available." ) );
+                LogRateLimited( LogError, ( "No OTA data buffers available." ) );
             }
 
             break;
@@ -769,7 +811,8 @@ static void mqttJobCallback( MQTTContext_t * pContext,
 /*-----------------------------------------------------------*/
 
 static void mqttDataCallback( MQTTContext_t * pContext,
-                              MQTTPublishInfo_t * pPublishInfo )
+                              MQTTPublishInfo_t * pPublishInfo,
+                              void * pUserContext )
 {
     OtaEventData_t * pData;
     OtaEventMsg_t eventMsg = { 0 };
@@ -778,15 +821,18 @@ static void mqttDataCallback( MQTTContext_t * pContext,
     assert( pContext != NULL );
 
     ( void ) pContext;
+    ( void ) pUserContext;
 
     LogInfo( ( "Received data message callback, size %zu.\n\n", pPublishInfo->payloadLength ) );
 
-    pData = otaEventBufferGet();
+    #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+        OtaRequestWindow_BlockReceived();
+    #endif
+
+    pData = otaEventBufferTake( pContext, pPublishInfo );
 
     if( pData != NULL )
     {
-        memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
-        pData->dataLength = pPublishInfo->payloadLength;
         eventMsg.eventId = OtaAgentEventReceivedFileBlock;
         eventMsg.pEventData = pData;
 
@@ -795,7 +841,7 @@ static void mqttDataCallback( MQTTContext_t * pContext,
     }
     else
     {
-        LogError( ( "No OTA data buffers available." ) );
+        LogRateLimited( LogError, ( "No OTA data buffers available." ) );
     }
 }
 
@@ -856,7 +902,7 @@ static void mqttEventCallback( MQTTContext_t * pMqttContext,
 
 static uint32_t generateRandomNumber()
 {
-    return( rand() );
+    return( esp_random() );
 }
 
 /*-----------------------------------------------------------*/
@@ -881,8 +927,20 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
     transport.send = espTlsTransportSend;
     transport.recv = espTlsTransportRecv;
 
+    #if CONFIG_TRANSPORT_CAPTURE
+        /* Record the connection for replay on POSIX. */
+        if( TransportCapture_StartConfigured() == true )
+        {
+            TransportCapture_Wrap( &transport );
+        }
+    #endif
+
     /* Fill the values for network buffer. */
-    networkBuffer.pBuffer = otaNetworkBuffer;
+    #if OTA_NETWORK_BUFFER_BORROWED
+        networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, OTA_NETWORK_BUFFER_SIZE );
+    #else
+        networkBuffer.pBuffer = otaNetworkBuffer;
+    #endif
     networkBuffer.size = OTA_NETWORK_BUFFER_SIZE;
 
     /* Initialize MQTT library. */
@@ -892,12 +950,24 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
                             mqttEventCallback,
                             &networkBuffer );
 
-    if( mqttStatus != MQTTSuccess )
+    if( networkBuffer.pBuffer == NULL )
+    {
+        returnStatus = EXIT_FAILURE;
+        LogError( ( "No network buffer available for the MQTT context." ) );
+    }
+    else if( mqttStatus != MQTTSuccess )
     {
         returnStatus = EXIT_FAILURE;
         LogError( ( "MQTT init failed: Status = %s.", MQTT_Status_strerror( mqttStatus ) ) );
     }
 
+    #if OTA_EVENT_POOL_ZERO_COPY
+        else
+        {
+            OtaEventPool_AttachSlabs( pMqttContext, otaNetworkBuffer, OTA_NETWORK_BUFFER_SIZE );
+        }
+    #endif
+
     return returnStatus;
 }
 
@@ -906,16 +976,16 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
 static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext )
 {
     int returnStatus = EXIT_SUCCESS;
-    BackoffAlgorithmStatus_t backoffAlgStatus = BackoffAlgorithmSuccess;
+    bool retry = true;
     TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
-    BackoffAlgorithmContext_t reconnectParams;
+    ReconnectPolicy_t reconnectPolicy;
     pNetworkContext->pcHostname = AWS_IOT_ENDPOINT;
     pNetworkContext->xPort = AWS_MQTT_PORT;
     pNetworkContext->pxTls = NULL;
     pNetworkContext->xTlsContextSemaphore = xSemaphoreCreateMutexStatic(&xTlsContextSemaphoreBuffer);
 
     pNetworkContext->disableSni = 0;
-    uint16_t nextRetryBackOff;
+    uint32_t nextRetryBackOff = 0U;
 
     /* Initialize credentials for establishing TLS session. */
     pNetworkContext->pcServerRootCAPem = root_cert_auth_pem_start;
@@ -971,10 +1041,10 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
     }
 
     /* Initialize reconnect attempts and interval */
-    BackoffAlgorithm_InitializeParams( &reconnectParams,
-                                       CONNECTION_RETRY_BACKOFF_BASE_MS,
-                                       CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
-                                       CONNECTION_RETRY_MAX_ATTEMPTS );
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           CONNECTION_RETRY_BACKOFF_BASE_MS,
+                           CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                           CONNECTION_RETRY_MAX_ATTEMPTS );
 
     /* Attempt to connect to MQTT broker. If connection fails, retry after
      * a timeout. Timeout value will exponentially increase until maximum
@@ -992,23 +1062,27 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
         tlsStatus = xTlsConnect ( pNetworkContext );
         if( tlsStatus != TLS_TRANSPORT_SUCCESS )
         {
-            /* Generate a random number and get back-off value (in milliseconds) for the next connection retry. */
-            backoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &reconnectParams, generateRandomNumber(), &nextRetryBackOff );
-
-            if( backoffAlgStatus == BackoffAlgorithmRetriesExhausted )
+            /* Get the back-off value (in milliseconds) for the next connection retry. A
+             * refused handshake waits longer. */
+            retry = ReconnectPolicy_NextDelay( &reconnectPolicy,
+                                               ( tlsStatus == TLS_TRANSPORT_HANDSHAKE_FAILED ) ?
+                                               ReconnectFailureRefused : ReconnectFailureNetwork,
+                                               &nextRetryBackOff );
+
+            if( retry == false )
             {
                 LogError( ( "Connection to the broker failed, all attempts exhausted." ) );
                 returnStatus = EXIT_FAILURE;
             }
-            else if( backoffAlgStatus == BackoffAlgorithmSuccess )
+            else
             {
                 LogWarn( ( "Connection to the broker failed. Retrying connection "
-                           "after %hu ms backoff.",
-                           ( unsigned short ) nextRetryBackOff ) );
+                           "after %u ms backoff.",
+                           ( unsigned ) nextRetryBackOff ) );
                 vTaskDelay( nextRetryBackOff/portTICK_PERIOD_MS );
             }
         }
-    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( backoffAlgStatus == BackoffAlgorithmSuccess ) );
+    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( retry == true ) );
 
     return returnStatus;
 }
@@ -1115,7 +1189,18 @@ static int establishConnection( void )
      * attempts are reached or maximum timeout value is reached. The function
      * returns EXIT_FAILURE if the TCP connection cannot be established to
      * broker after configured number of attempts. */
-    returnStatus = connectToServerWithBackoffRetries( &networkContext );
+    #if OTA_NETWORK_BUFFER_BORROWED
+        /* Borrow the buffer again if the last connection gave it back. */
+        if( mqttContext.networkBuffer.pBuffer == NULL )
+        {
+            mqttContext.networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, OTA_NETWORK_BUFFER_SIZE );
+        }
+
+        if( mqttContext.networkBuffer.pBuffer != NULL )
+    #endif
+    {
+        returnStatus = connectToServerWithBackoffRetries( &networkContext );
+    }
 
     if( returnStatus != EXIT_SUCCESS )
     {
@@ -1126,6 +1211,10 @@ static int establishConnection( void )
     }
     else
     {
+        #if CONFIG_TRANSPORT_CAPTURE
+            TransportCapture_MarkConnect();
+        #endif
+
         /* Establish MQTT session on top of TCP+TLS connection. */
         LogInfo( ( "Creating an MQTT connection to %.*s.",
                    AWS_IOT_ENDPOINT_LENGTH,
@@ -1156,6 +1245,33 @@ static int establishConnection( void )
 
 /*-----------------------------------------------------------*/
 
+static int32_t waitForIncomingPacket( void )
+{
+    uint32_t waitMs = OTA_EXAMPLE_MAX_IDLE_WAIT_MS;
+    uint32_t keepAliveMs = ( uint32_t ) mqttContext.keepAliveIntervalSec * 1000U;
+    uint32_t idleMs = 0U;
+
+    if( keepAliveMs > 0U )
+    {
+        /* Read without the lock. A publish from the OTA agent racing with this
+         * only makes the wait end early. */
+        idleMs = Clock_GetTimeMs() - mqttContext.lastPacketTime;
+
+        if( idleMs >= keepAliveMs )
+        {
+            waitMs = 0U;
+        }
+        else if( ( keepAliveMs - idleMs ) < waitMs )
+        {
+            waitMs = keepAliveMs - idleMs;
+        }
+    }
+
+    return lTlsTransportWaitReadable( &networkContext, waitMs );
+}
+
+/*-----------------------------------------------------------*/
+
 static void disconnect( void )
 {
     /* Disconnect from broker. */
@@ -1187,6 +1303,18 @@ static void disconnect( void )
 
     /* End TLS session, then close TCP connection. */
     ( void ) xTlsDisconnect( &networkContext );
+
+    #if OTA_NETWORK_BUFFER_BORROWED
+        /* Lend the buffer to other components until the next connection,
+         * under the lock so that no publish is using it. */
+        if( pthread_mutex_lock( &mqttMutex ) == 0 )
+        {
+            ( void ) BufferArena_Free( BufferArenaOwnerMqtt, mqttContext.networkBuffer.pBuffer );
+            mqttContext.networkBuffer.pBuffer = NULL;
+
+            pthread_mutex_unlock( &mqttMutex );
+        }
+    #endif
 }
 
 /*-----------------------------------------------------------*/
@@ -1226,7 +1354,8 @@ static void registerSubscriptionManagerCallback( const char * pTopicFilter,
             /* Register callback to subscription manager. */
             subscriptionStatus = SubscriptionManager_RegisterCallback( pWildCardTopicFilters[ index ],
                                                                        strlen( pWildCardTopicFilters[ index ] ),
-                                                                       otaMessageCallback[ index ] );
+                                                                       otaMessageCallback[ index ],
+                                                                       NULL );
 
             if( subscriptionStatus != SUBSCRIPTION_MANAGER_SUCCESS )
             {
@@ -1302,6 +1431,20 @@ static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
 
 /*-----------------------------------------------------------*/
 
+#if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+
+/* Whether a publish on the topic is a request for blocks of a stream. */
+    static bool isStreamRequest( const char * pacTopic,
+                                 uint16_t topicLen )
+    {
+        const size_t suffixLen = sizeof( OTA_STREAM_REQUEST_SUFFIX ) - 1U;
+
+        return ( topicLen >= suffixLen ) &&
+               ( memcmp( &pacTopic[ topicLen - suffixLen ], OTA_STREAM_REQUEST_SUFFIX, suffixLen ) == 0 );
+    }
+
+#endif
+
 static OtaMqttStatus_t mqttPublish( const char * const pacTopic,
                                     uint16_t topicLen,
                                     const char * pMsg,
@@ -1333,6 +1476,14 @@ static OtaMqttStatus_t mqttPublish( const char * const pacTopic,
 
     if( pthread_mutex_lock( &mqttMutex ) == 0 )
     {
+        #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+            /* Start timing the request before its blocks can arrive. */
+            if( isStreamRequest( pacTopic, topicLen ) )
+            {
+                OtaRequestWindow_RequestSent();
+            }
+        #endif
+
         do
         {
             mqttStatus = MQTT_Publish( pMqttContext,
@@ -1485,6 +1636,19 @@ static void * otaThread( void * pParam )
     LogInfo( ( "OTA Agent stopped." ) );
     return NULL;
 }
+
+/*-----------------------------------------------------------*/
+
+#if CONFIG_OTA_PAL_FAST_COMMIT
+
+/* Checks run on a new image before it is committed. A real device would check
+ * its own peripherals and services here; the demo only needs the heap it runs on. */
+    static bool otaHealthCheck( void )
+    {
+        return esp_get_free_heap_size() > 0;
+    }
+
+#endif
 /*-----------------------------------------------------------*/
 static int startOTADemo( void )
 {
@@ -1506,6 +1670,14 @@ static int startOTADemo( void )
     /* OTA library packet statistics per job.*/
     OtaAgentStatistics_t otaStatistics = { 0 };
 
+    /* OTA event buffer pool statistics.*/
+    OtaEventPoolStats_t poolStats = { 0 };
+
+    #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+        /* Adaptive block request window statistics.*/
+        OtaRequestWindowStats_t windowStats = { 0 };
+    #endif
+
     /* OTA Agent thread handle.*/
     pthread_t threadHandle;
 
@@ -1525,6 +1697,11 @@ static int startOTADemo( void )
          returnStatus = EXIT_FAILURE;
     }
 
+#if CONFIG_OTA_PAL_FAST_COMMIT
+    /* Commit an image in self test now rather than after the job round trip. */
+    otaPal_FastCommit( otaHealthCheck );
+#endif
+
     LogInfo( ( "OTA over MQTT demo, Application version %u.%u.%u",
                appFirmwareVersion.u.x.major,
                appFirmwareVersion.u.x.minor,
@@ -1592,11 +1769,20 @@ static int startOTADemo( void )
 
             if( mqttSessionEstablished == true )
             {
+                /* Block in the network stack rather than in the process loop, so
+                 * the task only wakes up when there is work and the OTA agent
+                 * can publish meanwhile. */
+                if( waitForIncomingPacket() < 0 )
+                {
+                    LogError( ( "Failed to wait for data from the broker." ) );
+                    mqttStatus = MQTTRecvFailed;
+                }
                 /* Acquire the mqtt mutex lock. */
-                if( pthread_mutex_lock( &mqttMutex ) == 0 )
+                else if( pthread_mutex_lock( &mqttMutex ) == 0 )
                 {
-                    /* Loop to receive packet from transport interface. */
-                    mqttStatus = MQTT_ProcessLoop( &mqttContext, MQTT_PROCESS_LOOP_TIMEOUT_MS );
+                    /* Handle the waiting packet, or send the keep-alive, in a
+                     * single iteration. */
+                    mqttStatus = MQTT_ProcessLoop( &mqttContext, 0U );
 
                     pthread_mutex_unlock( &mqttMutex );
                 }
@@ -1618,11 +1804,25 @@ static int startOTADemo( void )
                                otaStatistics.otaPacketsProcessed,
                                otaStatistics.otaPacketsDropped ) );
 
-                    /* Delay if mqtt process loop is set to zero.*/
-                    if( MQTT_PROCESS_LOOP_TIMEOUT_MS > 0 )
-                    {
-                        vTaskDelay( OTA_EXAMPLE_LOOP_SLEEP_PERIOD_MS/portTICK_PERIOD_MS );
-                    }
+                    /* Get event buffer pool statistics. */
+                    OtaEventPool_GetStats( &poolStats );
+
+                    LogInfo( ( " Event buffers in use: %u   High-water: %u   Dropped for lack of a buffer: %u",
+                               poolStats.inUse,
+                               poolStats.highWater,
+                               poolStats.drops ) );
+
+                    #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+                        /* Get the adaptive block request window. */
+                        OtaRequestWindow_GetStats( &windowStats );
+
+                        LogInfo( ( " Block window: %u   SRTT: %u ms   Min RTT: %u ms   Rounds: %u   Losses: %u",
+                                   windowStats.window,
+                                   windowStats.srttMs,
+                                   windowStats.minRttMs,
+                                   windowStats.rounds,
+                                   windowStats.losses ) );
+                    #endif
                 }
                 else
                 {
@@ -1691,29 +1891,24 @@ int aws_iot_demo_main( int argc,
     /* Return error status. */
     int returnStatus = EXIT_SUCCESS;
 
-    /* Semaphore initialization flag. */
-    bool bufferSemInitialized = false;
+    /* Mutex initialization flag. */
     bool mqttMutexInitialized = false;
 
     /* Maximum time in milliseconds to wait before exiting demo . */
     int16_t waitTimeoutMs = OTA_DEMO_EXIT_TIMEOUT_MS;
 
-    /* Initialize semaphore for buffer operations. */
-    if( osi_sem_new( &bufferSemaphore, 0x7FFFU, 1 ) != 0 )
+    /* Initialize the pool of buffers for OTA events. */
+    OtaEventPool_Init();
+
+    /* Build the topics of the thing the OTA library is given. */
+    if( ThingTopics_Init( &thingTopics, CLIENT_IDENTIFIER, CLIENT_IDENTIFIER_LENGTH, NULL, 0U ) == false )
     {
-        LogError( ( "Failed to initialize buffer semaphore"
-                    ",errno=%s",
-                    strerror( errno ) ) );
+        LogError( ( "The topics of thing %s don't fit in the topic table.", CLIENT_IDENTIFIER ) );
 
         returnStatus = EXIT_FAILURE;
     }
-    else
-    {
-        bufferSemInitialized = true;
-    }
-
     /* Initialize mutex for coreMQTT APIs. */
-    if( pthread_mutex_init( &mqttMutex, NULL ) != 0 )
+    else if( pthread_mutex_init( &mqttMutex, NULL ) != 0 )
     {
         LogError( ( "Failed to initialize mutex for mqtt apis"
                     ",errno=%s",
@@ -1742,18 +1937,9 @@ int aws_iot_demo_main( int argc,
     /* Disconnect from broker and close connection. */
     disconnect();
 
-    if( bufferSemInitialized == true )
-    {
-        /* Cleanup semaphore created for buffer operations. */
-        if( osi_sem_free( &bufferSemaphore ) != 0 )
-        {
-            LogError( ( "Failed to destroy buffer semaphore"
-                        ",errno=%s",
-                        strerror( errno ) ) );
-
-            returnStatus = EXIT_FAILURE;
-        }
-    }
+    #if CONFIG_TRANSPORT_CAPTURE
+        TransportCapture_Stop();
+    #endif
 
     if( mqttMutexInitialized == true )
     {
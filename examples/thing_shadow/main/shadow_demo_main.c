@@ -39,11 +39,15 @@
  * 4. Publish a desired state of powerOn by using helper functions in shadow_demo_helpers.c.  That will cause
  * a delta message to be sent to device.
  * 5. Handle incoming MQTT messages in eventCallback, determine whether the message is related to the device
- * shadow by using a function defined by the Device Shadow library (Shadow_MatchTopicString). If the message is a
+ * shadow by looking its topic up in the topic table built at start-up (ThingTopics_Classify). If the message is a
  * device shadow delta message, set a flag for the main function to know, then the main function will publish
  * a second message to update the reported state of powerOn.
  * 6. Handle incoming message again in eventCallback. If the message is from update/accepted, verify that it
  * has the same clientToken as previously published in the update message. That will mark the end of the demo.
+ *
+ * With CONFIG_SHADOW_CACHE, what the shadow acknowledged is kept in NVS. A run that restores it skips the
+ * delete of step 1, follows the document through /update/documents, and only fetches it with /get when a
+ * version was missed.
  */
 
 /* Standard includes. */
@@ -66,87 +70,36 @@
 /* Clock for timer. */
 #include "clock.h"
 
+/* Prebuilt topics of the thing. */
+#include "thing_topics.h"
+
+/* Reported state, sent as changes. */
+#include "shadow_state.h"
+
+/* Shadow cache include. */
+#include "shadow_cache.h"
+
+/* JSON writer include. */
+#include "json_writer.h"
+
+/* Delta parser generated from main/demo_shadow.json. */
+#include "demo_shadow.h"
+
 /* shadow demo helpers header. */
 #include "shadow_demo_helpers.h"
 
 /**
- * @brief Format string representing a Shadow document with a "desired" state.
- *
- * The real json document will look like this:
- * {
- *   "state": {
- *     "desired": {
- *       "powerOn": 1
- *     }
- *   },
- *   "clientToken": "021909"
- * }
- *
- * Note the client token, which is optional for all Shadow updates. The client
- * token must be unique at any given time, but may be reused once the update is
- * completed. For this demo, a timestamp is used for a client token.
- */
-#define SHADOW_DESIRED_JSON     \
-    "{"                         \
-    "\"state\":{"               \
-    "\"desired\":{"             \
-    "\"powerOn\":%01d"          \
-    "}"                         \
-    "},"                        \
-    "\"clientToken\":\"%06lu\"" \
-    "}"
-
-/**
- * @brief The expected size of #SHADOW_DESIRED_JSON.
+ * @brief Size of the buffer shadow update documents are built in.
  *
- * Because all the format specifiers in #SHADOW_DESIRED_JSON include a length,
- * its full actual size is known by pre-calculation, here's the formula why
- * the length need to minus 3:
- * 1. The length of "%01d" is 4.
- * 2. The length of %06lu is 5.
- * 3. The actual length we will use in case 1. is 1 ( for the state of powerOn ).
- * 4. The actual length we will use in case 2. is 6 ( for the clientToken length ).
- * 5. Thus the additional size 3 = 4 + 5 - 1 - 6 + 1 (termination character).
- *
- * In your own application, you could calculate the size of the json doc in this way.
+ * It holds the desired state document, and the reported state changes built by
+ * #ShadowState_BuildUpdate.
  */
-#define SHADOW_DESIRED_JSON_LENGTH    ( sizeof( SHADOW_DESIRED_JSON ) - 3 )
-
-/**
- * @brief Format string representing a Shadow document with a "reported" state.
- *
- * The real json document will look like this:
- * {
- *   "state": {
- *     "reported": {
- *       "powerOn": 1
- *     }
- *   },
- *   "clientToken": "021909"
- * }
- *
- * Note the client token, which is required for all Shadow updates. The client
- * token must be unique at any given time, but may be reused once the update is
- * completed. For this demo, a timestamp is used for a client token.
- */
-#define SHADOW_REPORTED_JSON    \
-    "{"                         \
-    "\"state\":{"               \
-    "\"reported\":{"            \
-    "\"powerOn\":%01d"          \
-    "}"                         \
-    "},"                        \
-    "\"clientToken\":\"%06lu\"" \
-    "}"
+#define SHADOW_UPDATE_DOCUMENT_SIZE    ( 128U )
 
 /**
- * @brief The expected size of #SHADOW_REPORTED_JSON.
- *
- * Because all the format specifiers in #SHADOW_REPORTED_JSON include a length,
- * its full size is known at compile-time by pre-calculation. Users could refer to
- * the way how to calculate the actual length in #SHADOW_DESIRED_JSON_LENGTH.
+ * @brief Index of the powerOn field in #reportedFields.
  */
-#define SHADOW_REPORTED_JSON_LENGTH    ( sizeof( SHADOW_REPORTED_JSON ) - 3 )
+#define REPORTED_POWER_ON              ( 0U )
 
 /**
  * @brief The maximum number of times to run the loop in this demo.
@@ -218,6 +171,118 @@ static bool deleteResponseReceived = false;
  */
 static bool shadowDeleted = false;
 
+/**
+ * @brief The shadow topics of #THING_NAME and #SHADOW_NAME, built once the
+ * demo starts so that incoming topics are classified without parsing them.
+ */
+static ThingTopics_t shadowTopics;
+
+/**
+ * @brief The fields of the reported state of the device.
+ */
+static ShadowField_t reportedFields[] =
+{
+    SHADOW_FIELD( "powerOn", ShadowFieldInteger )
+};
+
+/**
+ * @brief The reported state, with what the shadow last acknowledged, so an
+ * update only carries the fields that changed.
+ */
+static ShadowState_t reportedState;
+
+#if SHADOW_CACHE
+
+/**
+ * @brief The NVS entry #reportedState is saved to and restored from.
+ */
+    static ShadowCache_t shadowCache;
+#endif
+
+/**
+ * @brief Whether what the shadow acknowledged was restored from NVS, in which
+ * case the demo carries on from the cached document instead of deleting it.
+ */
+static bool shadowCached = false;
+
+/**
+ * @brief Set when an `/update/documents` message doesn't follow from the
+ * known version, so the demo fetches the whole document with `/get`.
+ */
+static bool shadowGetNeeded = false;
+
+/**
+ * @brief Number of entries in #shadowUpdateTopics.
+ */
+#define SHADOW_UPDATE_TOPIC_COUNT      4U
+
+/**
+ * @brief Number of entries in #shadowDeleteTopics and #shadowGetTopics.
+ */
+#define SHADOW_RESPONSE_TOPIC_COUNT    2U
+
+/**
+ * @brief The topics the demo listens on while it runs, subscribed to with a
+ * single SUBSCRIBE so the demo is ready one round trip after it connects.
+ */
+static const MQTTSubscribeInfo_t shadowUpdateTopics[ SHADOW_UPDATE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_UPDATE_DOCS( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_UPDATE_DOCS( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
+
+/**
+ * @brief The responses to `/delete`.
+ */
+static const MQTTSubscribeInfo_t shadowDeleteTopics[ SHADOW_RESPONSE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
+
+/**
+ * @brief The responses to `/get`.
+ */
+static const MQTTSubscribeInfo_t shadowGetTopics[ SHADOW_RESPONSE_TOPIC_COUNT ] =
+{
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_GET_ACC( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_GET_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    },
+    {
+        .qos = MQTTQoS1,
+        .pTopicFilter = SHADOW_TOPIC_STR_GET_REJ( THING_NAME, SHADOW_NAME ),
+        .topicFilterLength = SHADOW_TOPIC_LEN_GET_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH )
+    }
+};
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -269,6 +334,26 @@ static void updateAcceptedHandler( MQTTPublishInfo_t * pPublishInfo );
  */
 static void deleteRejectedHandler( MQTTPublishInfo_t * pPublishInfo );
 
+/**
+ * @brief Fetches the whole shadow document with `/get`, for the reported state
+ * to catch up after versions were missed.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int fetchShadowDocument( void );
+
+/**
+ * @brief Subscribes to a list of shadow topics with one SUBSCRIBE, and logs
+ * each topic the broker refused.
+ *
+ * @param[in] pTopics The topics.
+ * @param[in] count The number of topics, at most #SHADOW_UPDATE_TOPIC_COUNT.
+ *
+ * @return EXIT_SUCCESS if every topic was granted, EXIT_FAILURE otherwise.
+ */
+static int subscribeToShadowTopics( const MQTTSubscribeInfo_t * pTopics,
+                                    size_t count );
+
 /*-----------------------------------------------------------*/
 
 static void deleteRejectedHandler( MQTTPublishInfo_t * pPublishInfo )
@@ -331,6 +416,7 @@ static void deleteRejectedHandler( MQTTPublishInfo_t * pPublishInfo )
     if( errorCode == 404UL )
     {
         shadowDeleted = true;
+        ShadowState_Reset( &reportedState );
     }
 }
 
@@ -339,11 +425,9 @@ static void deleteRejectedHandler( MQTTPublishInfo_t * pPublishInfo )
 static void updateDeltaHandler( MQTTPublishInfo_t * pPublishInfo )
 {
     static uint32_t currentVersion = 0; /* Remember the latestVersion # we've ever received */
+    DemoShadowState_t delta = { 0 };
+    uint32_t fields = 0U;
     uint32_t version = 0U;
-    uint32_t newState = 0U;
-    char * outValue = NULL;
-    uint32_t outValueLength = 0U;
-    JSONStatus_t result = JSONSuccess;
 
     assert( pPublishInfo != NULL );
     assert( pPublishInfo->pPayload != NULL );
@@ -364,83 +448,52 @@ static void updateDeltaHandler( MQTTPublishInfo_t * pPublishInfo )
      *      },
      *      "clientToken": "388062"
      *  }
-     */
-
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( ( const char * ) pPublishInfo->pPayload,
-                            pPublishInfo->payloadLength );
-
-    if( result == JSONSuccess )
-    {
-        /* Then we start to get the version value by JSON keyword "version". */
-        result = JSON_Search( ( char * ) pPublishInfo->pPayload,
-                              pPublishInfo->payloadLength,
-                              "version",
-                              sizeof( "version" ) - 1,
-                              &outValue,
-                              ( size_t * ) &outValueLength );
-    }
-    else
+     *
+     * The parser generated from main/demo_shadow.json validates the document
+     * and reads the version and the fields of the schema in a single pass. */
+    if( DemoShadow_ParseDelta( ( const char * ) pPublishInfo->pPayload,
+                               pPublishInfo->payloadLength,
+                               &delta,
+                               &fields,
+                               &version ) == false )
     {
         LogError( ( "The json document is invalid!!" ) );
         eventCallbackError = true;
     }
-
-    if( result == JSONSuccess )
-    {
-        LogInfo( ( "version: %.*s",
-                   outValueLength,
-                   outValue ) );
-
-        /* Convert the extracted value to an unsigned integer value. */
-        version = ( uint32_t ) strtoul( outValue, NULL, 10 );
-    }
-    else
+    else if( version == 0U )
     {
         LogError( ( "No version in json document!!" ) );
         eventCallbackError = true;
     }
-
-    LogInfo( ( "version:%d, currentVersion:%d \r\n", version, currentVersion ) );
-
-    /* When the version is much newer than the on we retained, that means the powerOn
-     * state is valid for us. */
-    if( version > currentVersion )
-    {
-        /* Set to received version as the current version. */
-        currentVersion = version;
-
-        /* Get powerOn state from json documents. */
-        result = JSON_Search( ( char * ) pPublishInfo->pPayload,
-                              pPublishInfo->payloadLength,
-                              "state.powerOn",
-                              sizeof( "state.powerOn" ) - 1,
-                              &outValue,
-                              ( size_t * ) &outValueLength );
-    }
-    else
+    else if( version <= currentVersion )
     {
         /* In this demo, we discard the incoming message
          * if the version number is not newer than the latest
          * that we've received before. Your application may use a
          * different approach.
          */
-        LogWarn( ( "The received version is smaller than current one!!" ) );
+        LogWarn( ( "The received version %u is not newer than current one %u!!",
+                   ( unsigned ) version, ( unsigned ) currentVersion ) );
     }
-
-    if( result == JSONSuccess )
+    else if( ( fields & DEMO_SHADOW_POWER_ON ) == 0U )
     {
-        /* Convert the powerOn state value to an unsigned integer value. */
-        newState = ( uint32_t ) strtoul( outValue, NULL, 10 );
+        currentVersion = version;
+        LogError( ( "No powerOn in json document!!" ) );
+        eventCallbackError = true;
+    }
+    else
+    {
+        /* Set to received version as the current version. */
+        currentVersion = version;
 
-        LogInfo( ( "The new power on state newState:%d, currentPowerOnState:%d \r\n",
-                   newState, currentPowerOnState ) );
+        LogInfo( ( "The new power on state newState:%u, currentPowerOnState:%u, version:%u \r\n",
+                   ( unsigned ) delta.powerOn, ( unsigned ) currentPowerOnState, ( unsigned ) version ) );
 
-        if( newState != currentPowerOnState )
+        if( delta.powerOn != currentPowerOnState )
         {
             /* The received powerOn state is different from the one we retained before, so we switch them
              * and set the flag. */
-            currentPowerOnState = newState;
+            currentPowerOnState = delta.powerOn;
 
             /* State change will be handled in main(), where we will publish a "reported"
              * state to the device shadow. We do not do it here because we are inside of
@@ -449,11 +502,6 @@ static void updateDeltaHandler( MQTTPublishInfo_t * pPublishInfo )
             stateChanged = true;
         }
     }
-    else
-    {
-        LogError( ( "No powerOn in json document!!" ) );
-        eventCallbackError = true;
-    }
 }
 
 /*-----------------------------------------------------------*/
@@ -530,6 +578,15 @@ static void updateAcceptedHandler( MQTTPublishInfo_t * pPublishInfo )
         {
             LogInfo( ( "Received response from the device shadow. Previously published "
                        "update with clientToken=%u has been accepted. ", clientToken ) );
+
+            /* A desired state update is accepted with the same client token,
+             * so only count it as reported if it was the reported state. */
+            if( ShadowState_HandleAccepted( &reportedState,
+                                            ( const char * ) pPublishInfo->pPayload,
+                                            pPublishInfo->payloadLength ) == true )
+            {
+                LogInfo( ( "The reported state is now at version %u.", ( unsigned ) reportedState.version ) );
+            }
         }
         else
         {
@@ -546,21 +603,16 @@ static void updateAcceptedHandler( MQTTPublishInfo_t * pPublishInfo )
 
 /*-----------------------------------------------------------*/
 
-/* This is the callback function invoked by the MQTT stack when it receives
- * incoming messages. This function demonstrates how to use the Shadow_MatchTopicString
- * function to determine whether the incoming message is a device shadow message
- * or not. If it is, it handles the message depending on the message type.
+/* This is the callback function invoked by the MQTT session when it receives
+ * incoming publishes; the session handles the acknowledgements. It looks the topic up in the table of prebuilt topics of
+ * the thing to determine whether the incoming message is a device shadow
+ * message or not. If it is, it handles the message depending on its topic.
  */
 static void eventCallback( MQTTContext_t * pMqttContext,
                            MQTTPacketInfo_t * pPacketInfo,
                            MQTTDeserializedInfo_t * pDeserializedInfo )
 {
-    ShadowMessageType_t messageType = ShadowMessageTypeMaxNum;
-    const char * pThingName = NULL;
-    uint8_t thingNameLength = 0U;
-    const char * pShadowName = NULL;
-    uint8_t shadowNameLength = 0U;
-    uint16_t packetIdentifier;
+    ThingTopic_t topic = ThingTopicNone;
 
     ( void ) pMqttContext;
 
@@ -568,8 +620,6 @@ static void eventCallback( MQTTContext_t * pMqttContext,
     assert( pMqttContext != NULL );
     assert( pPacketInfo != NULL );
 
-    packetIdentifier = pDeserializedInfo->packetIdentifier;
-
     /* Handle incoming publish. The lower 4 bits of the publish packet
      * type is used for the dup, QoS, and retain flags. Hence masking
      * out the lower bits to check if the packet is publish. */
@@ -578,41 +628,77 @@ static void eventCallback( MQTTContext_t * pMqttContext,
         assert( pDeserializedInfo->pPublishInfo != NULL );
         LogInfo( ( "pPublishInfo->pTopicName:%s.", pDeserializedInfo->pPublishInfo->pTopicName ) );
 
-        /* Let the Device Shadow library tell us whether this is a device shadow message. */
-        if( SHADOW_SUCCESS == Shadow_MatchTopicString( pDeserializedInfo->pPublishInfo->pTopicName,
-                                                       pDeserializedInfo->pPublishInfo->topicNameLength,
-                                                       &messageType,
-                                                       &pThingName,
-                                                       &thingNameLength,
-                                                       &pShadowName,
-                                                       &shadowNameLength ) )
+        /* Find which topic of the thing this is, if any. */
+        topic = ThingTopics_Classify( &shadowTopics,
+                                      pDeserializedInfo->pPublishInfo->pTopicName,
+                                      pDeserializedInfo->pPublishInfo->topicNameLength );
+
+        if( topic != ThingTopicNone )
         {
-            /* Upon successful return, the messageType has been filled in. */
-            if( messageType == ShadowMessageTypeUpdateDelta )
+            if( topic == ThingTopicShadowUpdateDelta )
             {
+                /* The next reported state update expects the version of the delta. */
+                ShadowState_HandleDelta( &reportedState,
+                                         ( const char * ) pDeserializedInfo->pPublishInfo->pPayload,
+                                         pDeserializedInfo->pPublishInfo->payloadLength );
+
                 /* Handler function to process payload. */
                 updateDeltaHandler( pDeserializedInfo->pPublishInfo );
             }
-            else if( messageType == ShadowMessageTypeUpdateAccepted )
+            else if( topic == ThingTopicShadowUpdateAccepted )
             {
                 /* Handler function to process payload. */
                 updateAcceptedHandler( pDeserializedInfo->pPublishInfo );
             }
-            else if( messageType == ShadowMessageTypeUpdateDocuments )
+            else if( topic == ThingTopicShadowUpdateDocuments )
             {
                 LogInfo( ( "/update/documents json payload:%s.", ( const char * ) pDeserializedInfo->pPublishInfo->pPayload ) );
+
+                /* Carry on from the known version, or fall back to /get. */
+                if( ShadowState_HandleDocuments( &reportedState,
+                                                 ( const char * ) pDeserializedInfo->pPublishInfo->pPayload,
+                                                 pDeserializedInfo->pPublishInfo->payloadLength ) == ShadowDocumentDiverged )
+                {
+                    shadowGetNeeded = true;
+                }
+            }
+            else if( topic == ThingTopicShadowGetAccepted )
+            {
+                LogInfo( ( "Received an MQTT incoming publish on /get/accepted topic." ) );
+
+                if( ShadowState_HandleGetAccepted( &reportedState,
+                                                   ( const char * ) pDeserializedInfo->pPublishInfo->pPayload,
+                                                   pDeserializedInfo->pPublishInfo->payloadLength ) == true )
+                {
+                    shadowGetNeeded = false;
+                }
             }
-            else if( messageType == ShadowMessageTypeUpdateRejected )
+            else if( topic == ThingTopicShadowGetRejected )
+            {
+                LogInfo( ( "/get/rejected json payload:%s.", ( const char * ) pDeserializedInfo->pPublishInfo->pPayload ) );
+
+                /* There is no document to catch up with, or it can't be read:
+                 * report every field again. */
+                ShadowState_Reset( &reportedState );
+                shadowGetNeeded = false;
+            }
+            else if( topic == ThingTopicShadowUpdateRejected )
             {
                 LogInfo( ( "/update/rejected json payload:%s.", ( const char * ) pDeserializedInfo->pPublishInfo->pPayload ) );
+
+                /* The changes of a rejected update are sent again by the next one. */
+                ( void ) ShadowState_HandleRejected( &reportedState,
+                                                     ( const char * ) pDeserializedInfo->pPublishInfo->pPayload,
+                                                     pDeserializedInfo->pPublishInfo->payloadLength );
             }
-            else if( messageType == ShadowMessageTypeDeleteAccepted )
+            else if( topic == ThingTopicShadowDeleteAccepted )
             {
                 LogInfo( ( "Received an MQTT incoming publish on /delete/accepted topic." ) );
                 shadowDeleted = true;
+                ShadowState_Reset( &reportedState );
                 deleteResponseReceived = true;
             }
-            else if( messageType == ShadowMessageTypeDeleteRejected )
+            else if( topic == ThingTopicShadowDeleteRejected )
             {
                 /* Handler function to process payload. */
                 deleteRejectedHandler( pDeserializedInfo->pPublishInfo );
@@ -620,19 +706,81 @@ static void eventCallback( MQTTContext_t * pMqttContext,
             }
             else
             {
-                LogInfo( ( "Other message type:%d !!", messageType ) );
+                LogInfo( ( "Other message topic:%d !!", topic ) );
             }
+
+            #if SHADOW_CACHE
+                /* Only writes NVS when what the shadow acknowledged changed. */
+                ( void ) ShadowCache_Save( &shadowCache, &reportedState );
+            #endif
         }
         else
         {
-            LogError( ( "Shadow_MatchTopicString parse failed:%s !!", ( const char * ) pDeserializedInfo->pPublishInfo->pTopicName ) );
+            LogError( ( "Not a topic of this thing:%s !!", ( const char * ) pDeserializedInfo->pPublishInfo->pTopicName ) );
             eventCallbackError = true;
         }
     }
-    else
+}
+
+/*-----------------------------------------------------------*/
+
+static int subscribeToShadowTopics( const MQTTSubscribeInfo_t * pTopics,
+                                    size_t count )
+{
+    MQTTSubAckStatus_t subAckCodes[ SHADOW_UPDATE_TOPIC_COUNT ];
+    int returnStatus = EXIT_SUCCESS;
+    size_t i;
+
+    assert( count <= SHADOW_UPDATE_TOPIC_COUNT );
+
+    returnStatus = SubscribeToTopics( pTopics, count, subAckCodes );
+
+    for( i = 0U; ( i < count ) && ( returnStatus != EXIT_SUCCESS ); i++ )
+    {
+        if( subAckCodes[ i ] == MQTTSubAckFailure )
+        {
+            LogError( ( "Not subscribed to %.*s.",
+                        pTopics[ i ].topicFilterLength,
+                        pTopics[ i ].pTopicFilter ) );
+        }
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static int fetchShadowDocument( void )
+{
+    int returnStatus = EXIT_SUCCESS;
+
+    LogInfo( ( "Fetching the shadow document, versions were missed." ) );
+
+    returnStatus = subscribeToShadowTopics( shadowGetTopics, SHADOW_RESPONSE_TOPIC_COUNT );
+
+    if( returnStatus == EXIT_SUCCESS )
+    {
+        /* An empty payload asks for the whole document. PublishToTopic runs
+         * the process loop, in which the response arrives. */
+        returnStatus = PublishToTopic( SHADOW_TOPIC_STR_GET( THING_NAME, SHADOW_NAME ),
+                                       SHADOW_TOPIC_LEN_GET( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
+                                       "",
+                                       0U );
+    }
+
+    if( returnStatus == EXIT_SUCCESS )
+    {
+        returnStatus = UnsubscribeFromTopics( shadowGetTopics, SHADOW_RESPONSE_TOPIC_COUNT );
+    }
+
+    if( ( returnStatus == EXIT_SUCCESS ) && ( shadowGetNeeded == true ) )
     {
-        HandleOtherIncomingPacket( pPacketInfo, packetIdentifier );
+        LogWarn( ( "No response to /get, reporting every field again." ) );
+        ShadowState_Reset( &reportedState );
+        shadowGetNeeded = false;
     }
+
+    return returnStatus;
 }
 
 /*-----------------------------------------------------------*/
@@ -666,13 +814,33 @@ int aws_iot_demo_main( int argc,
 
     /* A buffer containing the update document. It has static duration to prevent
      * it from being placed on the call stack. */
-    static char updateDocument[ SHADOW_REPORTED_JSON_LENGTH + 1 ] = { 0 };
+    static char updateDocument[ SHADOW_UPDATE_DOCUMENT_SIZE ] = { 0 };
+    size_t updateDocumentLength = 0U;
+    uint32_t reportWaitMs = 0U;
+    JsonWriter_t writer;
 
     ( void ) argc;
     ( void ) argv;
 
     do
     {
+        if( ThingTopics_Init( &shadowTopics, THING_NAME, THING_NAME_LENGTH,
+                              ( SHADOW_NAME_LENGTH > 0U ) ? SHADOW_NAME : NULL, SHADOW_NAME_LENGTH ) == false )
+        {
+            LogError( ( "The topics of thing %s don't fit in the topic table.", THING_NAME ) );
+            returnStatus = EXIT_FAILURE;
+            break;
+        }
+
+        ShadowState_Init( &reportedState, reportedFields, sizeof( reportedFields ) / sizeof( reportedFields[ 0 ] ) );
+        shadowGetNeeded = false;
+
+        #if SHADOW_CACHE
+            ShadowCache_Init( &shadowCache, THING_NAME, THING_NAME_LENGTH,
+                              ( SHADOW_NAME_LENGTH > 0U ) ? SHADOW_NAME : NULL, SHADOW_NAME_LENGTH );
+            shadowCached = ShadowCache_Restore( &shadowCache, &reportedState );
+        #endif
+
         returnStatus = EstablishMqttSession( eventCallback );
 
         if( returnStatus == EXIT_FAILURE )
@@ -682,87 +850,65 @@ int aws_iot_demo_main( int argc,
         }
         else
         {
-            /* Reset the shadow delete status flags. */
-            deleteResponseReceived = false;
-            shadowDeleted = false;
-
-            /* First of all, try to delete any Shadow document in the cloud.
-             * Try to subscribe to `/delete/accepted` and `/delete/rejected` topics. */
-            returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
-                                             SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                /* Try to subscribe to `/delete/rejected` topic. */
-                returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
-                                                 SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
-
-            if( returnStatus == EXIT_SUCCESS )
+            /* A cached document is carried on from, not deleted. */
+            if( shadowCached == false )
             {
-                /* Publish to Shadow `delete` topic to attempt to delete the
-                 * Shadow document if exists. */
-                returnStatus = PublishToTopic( SHADOW_TOPIC_STR_DELETE( THING_NAME, SHADOW_NAME ),
-                                               SHADOW_TOPIC_LEN_DELETE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
-                                               updateDocument,
-                                               0U );
-            }
+                /* Reset the shadow delete status flags. */
+                deleteResponseReceived = false;
+                shadowDeleted = false;
 
-            /* Unsubscribe from the `/delete/accepted` and 'delete/rejected` topics.*/
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_DELETE_ACC( THING_NAME, SHADOW_NAME ),
-                                                     SHADOW_TOPIC_LEN_DELETE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
+                /* First of all, try to delete any Shadow document in the cloud.
+                 * Try to subscribe to `/delete/accepted` and `/delete/rejected` topics. */
+                returnStatus = subscribeToShadowTopics( shadowDeleteTopics, SHADOW_RESPONSE_TOPIC_COUNT );
 
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_DELETE_REJ( THING_NAME, SHADOW_NAME ),
-                                                     SHADOW_TOPIC_LEN_DELETE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
+                if( returnStatus == EXIT_SUCCESS )
+                {
+                    /* Publish to Shadow `delete` topic to attempt to delete the
+                     * Shadow document if exists. */
+                    returnStatus = PublishToTopic( SHADOW_TOPIC_STR_DELETE( THING_NAME, SHADOW_NAME ),
+                                                   SHADOW_TOPIC_LEN_DELETE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
+                                                   updateDocument,
+                                                   0U );
+                }
 
-            /* Check if an incoming publish on `/delete/accepted` or `/delete/rejected`
-             * topics. If a response is not received, mark the demo execution as a failure.*/
-            if( ( returnStatus == EXIT_SUCCESS ) && ( deleteResponseReceived != true ) )
-            {
-                LogError( ( "Failed to receive a response for Shadow delete." ) );
-                returnStatus = EXIT_FAILURE;
-            }
+                /* Unsubscribe from the `/delete/accepted` and 'delete/rejected` topics.*/
+                if( returnStatus == EXIT_SUCCESS )
+                {
+                    returnStatus = UnsubscribeFromTopics( shadowDeleteTopics, SHADOW_RESPONSE_TOPIC_COUNT );
+                }
 
-            /* Check if Shadow document delete was successful. A delete can be
-             * successful in cases listed below.
-             *  1. If an incoming publish is received on `/delete/accepted` topic.
-             *  2. If an incoming publish is received on `/delete/rejected` topic
-             *     with an error code 404. This indicates that a delete was
-             *     attempted when a Shadow document is not available for the
-             *     Thing. */
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                if( shadowDeleted == false )
+                /* Check if an incoming publish on `/delete/accepted` or `/delete/rejected`
+                 * topics. If a response is not received, mark the demo execution as a failure.*/
+                if( ( returnStatus == EXIT_SUCCESS ) && ( deleteResponseReceived != true ) )
                 {
-                    LogError( ( "Shadow delete operation failed." ) );
+                    LogError( ( "Failed to receive a response for Shadow delete." ) );
                     returnStatus = EXIT_FAILURE;
                 }
+
+                /* Check if Shadow document delete was successful. A delete can be
+                 * successful in cases listed below.
+                 *  1. If an incoming publish is received on `/delete/accepted` topic.
+                 *  2. If an incoming publish is received on `/delete/rejected` topic
+                 *     with an error code 404. This indicates that a delete was
+                 *     attempted when a Shadow document is not available for the
+                 *     Thing. */
+                if( returnStatus == EXIT_SUCCESS )
+                {
+                    if( shadowDeleted == false )
+                    {
+                        LogError( ( "Shadow delete operation failed." ) );
+                        returnStatus = EXIT_FAILURE;
+                    }
+                }
             }
 
             /* Successfully connect to MQTT broker, the next step is
              * to subscribe shadow topics. */
+            /* The documents keep the acknowledged state current between
+             * updates, instead of a /get after every connect. */
             if( returnStatus == EXIT_SUCCESS )
             {
-                returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
-                                                 SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
-
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
-                                                 SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
-
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                returnStatus = SubscribeToTopic( SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
-                                                 SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+                returnStatus = subscribeToShadowTopics( shadowUpdateTopics, SHADOW_UPDATE_TOPIC_COUNT );
             }
 
             /* This demo uses a constant #THING_NAME and #SHADOW_NAME known at compile time therefore
@@ -805,24 +951,47 @@ int aws_iot_demo_main( int argc,
                 /* desired power on state . */
                 LogInfo( ( "Send desired power state with 1." ) );
 
-                ( void ) memset( updateDocument,
-                                 0x00,
-                                 sizeof( updateDocument ) );
-
                 /* Keep the client token in global variable used to compare if
                  * the same token in /update/accepted. */
                 clientToken = ( Clock_GetTimeMs() % 1000000 );
 
-                snprintf( updateDocument,
-                          SHADOW_DESIRED_JSON_LENGTH + 1,
-                          SHADOW_DESIRED_JSON,
-                          ( int ) 1,
-                          ( long unsigned ) clientToken );
-
-                returnStatus = PublishToTopic( SHADOW_TOPIC_STR_UPDATE( THING_NAME, SHADOW_NAME ),
-                                               SHADOW_TOPIC_LEN_UPDATE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
-                                               updateDocument,
-                                               ( SHADOW_DESIRED_JSON_LENGTH + 1 ) );
+                /* The document is written straight into the publish buffer:
+                 * {
+                 *   "state": {
+                 *     "desired": {
+                 *       "powerOn": 1
+                 *     }
+                 *   },
+                 *   "clientToken": "021909"
+                 * }
+                 *
+                 * Note the client token, which is optional for all Shadow updates. The client
+                 * token must be unique at any given time, but may be reused once the update is
+                 * completed. For this demo, a timestamp is used for a client token.
+                 */
+                JsonWriter_Init( &writer, updateDocument, sizeof( updateDocument ) );
+                JsonWriter_BeginObject( &writer, NULL );
+                JsonWriter_BeginObject( &writer, "state" );
+                JsonWriter_BeginObject( &writer, "desired" );
+                JsonWriter_AddInteger( &writer, "powerOn", 1 );
+                JsonWriter_EndObject( &writer );
+                JsonWriter_EndObject( &writer );
+                JsonWriter_AddToken( &writer, "clientToken", clientToken, 6U );
+                JsonWriter_EndObject( &writer );
+
+                if( JsonWriter_Finish( &writer, &updateDocumentLength ) == false )
+                {
+                    LogError( ( "The desired state document needs %u bytes, the buffer has %u.",
+                                ( unsigned ) ( updateDocumentLength + 1U ), ( unsigned ) sizeof( updateDocument ) ) );
+                    returnStatus = EXIT_FAILURE;
+                }
+                else
+                {
+                    returnStatus = PublishToTopic( SHADOW_TOPIC_STR_UPDATE( THING_NAME, SHADOW_NAME ),
+                                                   SHADOW_TOPIC_LEN_UPDATE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
+                                                   updateDocument,
+                                                   updateDocumentLength );
+                }
             }
 
             if( returnStatus == EXIT_SUCCESS )
@@ -833,28 +1002,68 @@ int aws_iot_demo_main( int argc,
                  * Check if the state change flag has been modified or not. If it's modified,
                  * then we publish reported state to update topic.
                  */
-                if( stateChanged == true )
+
+                /* Catch up with versions missed before the update is compared
+                 * with what the shadow has. */
+                if( shadowGetNeeded == true )
+                {
+                    returnStatus = fetchShadowDocument();
+                }
+
+                if( returnStatus != EXIT_SUCCESS )
+                {
+                    LogError( ( "Failed to fetch the shadow document." ) );
+                }
+                else if( stateChanged == true )
                 {
                     /* Report the latest power state back to device shadow. */
                     LogInfo( ( "Report to the state change: %d", currentPowerOnState ) );
-                    ( void ) memset( updateDocument,
-                                     0x00,
-                                     sizeof( updateDocument ) );
+                    ( void ) ShadowState_SetInteger( &reportedState, REPORTED_POWER_ON, currentPowerOnState );
 
                     /* Keep the client token in global variable used to compare if
                      * the same token in /update/accepted. */
                     clientToken = ( Clock_GetTimeMs() % 1000000 );
 
-                    snprintf( updateDocument,
-                              SHADOW_REPORTED_JSON_LENGTH + 1,
-                              SHADOW_REPORTED_JSON,
-                              ( int ) currentPowerOnState,
-                              ( long unsigned ) clientToken );
-
-                    returnStatus = PublishToTopic( SHADOW_TOPIC_STR_UPDATE( THING_NAME, SHADOW_NAME ),
-                                                   SHADOW_TOPIC_LEN_UPDATE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
-                                                   updateDocument,
-                                                   ( SHADOW_REPORTED_JSON_LENGTH + 1 ) );
+                    /* Only the fields that differ from what the shadow acknowledged
+                     * last are sent, once the change has waited out the coalescing
+                     * window in which any other change would join it. */
+                    updateDocumentLength = ShadowState_Process( &reportedState,
+                                                                Clock_GetTimeMs(),
+                                                                clientToken,
+                                                                updateDocument,
+                                                                sizeof( updateDocument ) );
+
+                    if( updateDocumentLength == 0U )
+                    {
+                        reportWaitMs = ShadowState_TimeToDeadline( &reportedState, Clock_GetTimeMs() );
+
+                        if( reportWaitMs != UINT32_MAX )
+                        {
+                            Clock_SleepMs( reportWaitMs );
+                            updateDocumentLength = ShadowState_Process( &reportedState,
+                                                                        Clock_GetTimeMs(),
+                                                                        clientToken,
+                                                                        updateDocument,
+                                                                        sizeof( updateDocument ) );
+                        }
+                    }
+
+                    if( updateDocumentLength > 0U )
+                    {
+                        returnStatus = PublishToTopic( SHADOW_TOPIC_STR_UPDATE( THING_NAME, SHADOW_NAME ),
+                                                       SHADOW_TOPIC_LEN_UPDATE( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ),
+                                                       updateDocument,
+                                                       updateDocumentLength );
+
+                        if( returnStatus != EXIT_SUCCESS )
+                        {
+                            ShadowState_CancelUpdate( &reportedState );
+                        }
+                    }
+                    else
+                    {
+                        LogInfo( ( "The shadow already has the reported state." ) );
+                    }
                 }
                 else
                 {
@@ -865,20 +1074,7 @@ int aws_iot_demo_main( int argc,
             if( returnStatus == EXIT_SUCCESS )
             {
                 LogInfo( ( "Start to unsubscribe shadow topics and disconnect from MQTT. \r\n" ) );
-                returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_DELTA( THING_NAME, SHADOW_NAME ),
-                                                     SHADOW_TOPIC_LEN_UPDATE_DELTA( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
-
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_ACC( THING_NAME, SHADOW_NAME ),
-                                                     SHADOW_TOPIC_LEN_UPDATE_ACC( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
-            }
-
-            if( returnStatus == EXIT_SUCCESS )
-            {
-                returnStatus = UnsubscribeFromTopic( SHADOW_TOPIC_STR_UPDATE_REJ( THING_NAME, SHADOW_NAME ),
-                                                     SHADOW_TOPIC_LEN_UPDATE_REJ( THING_NAME_LENGTH, SHADOW_NAME_LENGTH ) );
+                returnStatus = UnsubscribeFromTopics( shadowUpdateTopics, SHADOW_UPDATE_TOPIC_COUNT );
             }
 
             /* The MQTT session is always disconnected, even there were prior failures. */
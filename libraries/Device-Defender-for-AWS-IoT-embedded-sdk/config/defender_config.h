@@ -60,6 +60,10 @@
 #endif
 
 /* Device Defender configurations */
-
+#if CONFIG_DEFENDER_USE_LONG_KEYS
+    #define DEFENDER_USE_LONG_KEYS    1
+#else
+    #define DEFENDER_USE_LONG_KEYS    0
+#endif
 
 #endif /* DEFENDER_CONFIG_H */
\ No newline at end of file
@@ -0,0 +1,226 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file boot_profile.c
+ * @brief Implementation of the boot profile.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the boot profile. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Boot Profile"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "boot_profile.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The version of the record, for whoever aggregates it.
+ */
+#define RECORD_VERSION    1
+
+/**
+ * @brief The times of a phase. The clock counts from the start of the
+ * application, so it doesn't wrap during a boot.
+ */
+typedef struct PhaseTimes
+{
+    uint32_t beginMs;
+    uint32_t endMs;
+    bool begun;
+    bool ended;
+} PhaseTimes_t;
+
+/**
+ * @brief The keys of the phases in the record, in the order of
+ * #BootPhase_t.
+ */
+static const char * const phaseKeys[ BootPhaseCount ] =
+{
+    "nvs",
+    "netif",
+    "wifi",
+    "creds",
+    "tls",
+    "mqtt"
+};
+
+static PhaseTimes_t phases[ BootPhaseCount ];
+
+/**
+ * @brief When app_main started profiling, and when the broker accepted the
+ * first CONNECT.
+ */
+static uint32_t mainMs = 0U;
+static uint32_t connectMs = 0U;
+
+static bool started = false;
+static bool finished = false;
+
+/**
+ * @brief Append to the record in @a pBuffer with snprintf.
+ *
+ * @return false if the record doesn't fit.
+ */
+static bool appendToRecord( char * pBuffer,
+                            size_t bufferLength,
+                            size_t * pLength,
+                            const char * pFormat,
+                            ... );
+
+/*-----------------------------------------------------------*/
+
+static bool appendToRecord( char * pBuffer,
+                            size_t bufferLength,
+                            size_t * pLength,
+                            const char * pFormat,
+                            ... )
+{
+    va_list args;
+    int written = 0;
+
+    va_start( args, pFormat );
+    written = vsnprintf( &pBuffer[ *pLength ], bufferLength - *pLength, pFormat, args );
+    va_end( args );
+
+    if( ( written >= 0 ) && ( ( size_t ) written < ( bufferLength - *pLength ) ) )
+    {
+        *pLength += ( size_t ) written;
+    }
+    else
+    {
+        written = -1;
+    }
+
+    return( written >= 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+void BootProfile_Start( void )
+{
+    ( void ) memset( phases, 0x00, sizeof( phases ) );
+    mainMs = Clock_GetTimeMs();
+    connectMs = 0U;
+    started = true;
+    finished = false;
+}
+
+/*-----------------------------------------------------------*/
+
+void BootProfile_BeginPhase( BootPhase_t phase )
+{
+    assert( phase < BootPhaseCount );
+
+    if( ( started == true ) && ( finished == false ) && ( phases[ phase ].begun == false ) )
+    {
+        phases[ phase ].beginMs = Clock_GetTimeMs();
+        phases[ phase ].begun = true;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void BootProfile_EndPhase( BootPhase_t phase )
+{
+    assert( phase < BootPhaseCount );
+
+    if( ( finished == false ) && ( phases[ phase ].begun == true ) && ( phases[ phase ].ended == false ) )
+    {
+        phases[ phase ].endMs = Clock_GetTimeMs();
+        phases[ phase ].ended = true;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void BootProfile_Finish( void )
+{
+    char record[ BOOT_PROFILE_RECORD_LENGTH ];
+
+    if( ( started == true ) && ( finished == false ) )
+    {
+        connectMs = Clock_GetTimeMs();
+        finished = true;
+
+        if( BootProfile_GetRecord( record, sizeof( record ) ) > 0U )
+        {
+            LogInfo( ( "Boot profile: %s", record ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t BootProfile_GetRecord( char * pBuffer,
+                              size_t bufferLength )
+{
+    size_t length = 0U;
+    bool status = finished;
+    size_t i;
+
+    assert( pBuffer != NULL );
+
+    if( status == true )
+    {
+        status = appendToRecord( pBuffer, bufferLength, &length,
+                                 "{\"v\":%d,\"main\":%u,\"connect\":%u",
+                                 RECORD_VERSION, ( unsigned ) mainMs, ( unsigned ) connectMs );
+    }
+
+    for( i = 0; ( status == true ) && ( i < BootPhaseCount ); i++ )
+    {
+        /* A phase still running when the broker accepted the CONNECT
+         * wasn't on the way to it. */
+        if( phases[ i ].ended == true )
+        {
+            status = appendToRecord( pBuffer, bufferLength, &length, ",\"%s\":[%u,%u]",
+                                     phaseKeys[ i ], ( unsigned ) phases[ i ].beginMs,
+                                     ( unsigned ) ( phases[ i ].endMs - phases[ i ].beginMs ) );
+        }
+    }
+
+    if( status == true )
+    {
+        status = appendToRecord( pBuffer, bufferLength, &length, "}" );
+    }
+
+    return ( status == true ) ? length : 0U;
+}
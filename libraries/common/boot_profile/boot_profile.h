@@ -0,0 +1,107 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file boot_profile.h
+ * @brief Time the phases of a cold boot, from reset to the first MQTT
+ * CONNECT accepted by the broker.
+ *
+ * Times are milliseconds since the application started. A phase is kept as
+ * when it began and how long it took, so phases that overlap, such as
+ * parsing credentials while Wi-Fi associates, show as overlapping. A phase
+ * begun again, as when a connect is retried, keeps its first begin, so that
+ * it spans the retries. Once connected, the phases are written as one compact JSON
+ * record, such as
+ * {"v":1,"main":312,"connect":2874,"nvs":[313,21],"wifi":[340,1920],...},
+ * and logged. "main" is when #BootProfile_Start was called, which covers
+ * the startup code and constructors before app_main. Phases that didn't run
+ * are left out.
+ */
+
+#ifndef BOOT_PROFILE_H_
+#define BOOT_PROFILE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of a buffer that holds any record.
+ */
+#define BOOT_PROFILE_RECORD_LENGTH    256U
+
+/**
+ * @brief The phases of a boot.
+ */
+typedef enum BootPhase
+{
+    BootPhaseNvs,         /**< Initializing the NVS partition. */
+    BootPhaseNetif,       /**< Initializing the TCP/IP stack and the default event loop. */
+    BootPhaseNetwork,     /**< Bringing up Wi-Fi or Ethernet, up to having an address. */
+    BootPhaseCredentials, /**< Loading and parsing the TLS credentials. */
+    BootPhaseTls,         /**< DNS lookup, TCP connect and TLS handshake with the broker. */
+    BootPhaseMqtt,        /**< MQTT CONNECT up to the CONNACK. */
+    BootPhaseCount
+} BootPhase_t;
+
+/**
+ * @brief Start profiling the boot. To be called first thing in app_main.
+ */
+void BootProfile_Start( void );
+
+/**
+ * @brief Note the start of a phase. Each phase is timed by one task at a
+ * time; it may be a different task from the one that started profiling.
+ *
+ * @param[in] phase The phase.
+ */
+void BootProfile_BeginPhase( BootPhase_t phase );
+
+/**
+ * @brief Note the end of a phase. Does nothing if the phase wasn't begun.
+ *
+ * @param[in] phase The phase.
+ */
+void BootProfile_EndPhase( BootPhase_t phase );
+
+/**
+ * @brief Stop profiling once the first MQTT CONNECT is accepted, and log
+ * the record. Only the first call after #BootProfile_Start has an effect,
+ * so it can be called on every connect.
+ */
+void BootProfile_Finish( void );
+
+/**
+ * @brief Write the record of the finished boot.
+ *
+ * @param[out] pBuffer The buffer to write the record to, of at least
+ * #BOOT_PROFILE_RECORD_LENGTH bytes to hold any record.
+ * @param[in] bufferLength The size of @a pBuffer.
+ *
+ * @return The length of the null-terminated record, or 0 if profiling
+ * isn't finished or the record doesn't fit.
+ */
+size_t BootProfile_GetRecord( char * pBuffer,
+                              size_t bufferLength );
+
+#endif /* ifndef BOOT_PROFILE_H_ */
@@ -0,0 +1,130 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file boot_step.c
+ * @brief Implementation of concurrent boot steps.
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for boot steps. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Boot Step"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* FreeRTOS includes. */
+#include "freertos/task.h"
+
+#include "boot_step.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run a step, time its phase and signal that it is done.
+ */
+static void runStep( BootStep_t * pStep );
+
+#if BOOT_STEP_PARALLEL
+
+/**
+ * @brief The task of a step.
+ */
+    static void stepTask( void * pParameters );
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void runStep( BootStep_t * pStep )
+{
+    BootProfile_BeginPhase( pStep->phase );
+    pStep->result = pStep->function( pStep->pContext );
+    BootProfile_EndPhase( pStep->phase );
+
+    if( pStep->result == false )
+    {
+        LogError( ( "Boot step %s failed.", pStep->pName ) );
+    }
+
+    ( void ) xSemaphoreGive( pStep->done );
+}
+
+/*-----------------------------------------------------------*/
+
+#if BOOT_STEP_PARALLEL
+
+    static void stepTask( void * pParameters )
+    {
+        runStep( ( BootStep_t * ) pParameters );
+        vTaskDelete( NULL );
+    }
+#endif
+
+/*-----------------------------------------------------------*/
+
+void BootStep_Start( BootStep_t * pStep )
+{
+    configASSERT( ( pStep != NULL ) && ( pStep->function != NULL ) && ( pStep->started == false ) );
+
+    pStep->done = xSemaphoreCreateBinaryStatic( &pStep->doneBuffer );
+    pStep->result = false;
+    pStep->started = true;
+
+    #if BOOT_STEP_PARALLEL
+        /* The step runs at the priority of the task that starts it, which
+         * goes on with work of its own, mostly waiting on the network. */
+        if( xTaskCreate( stepTask, pStep->pName, BOOT_STEP_STACK_SIZE, pStep,
+                         uxTaskPriorityGet( NULL ), NULL ) != pdPASS )
+        {
+            LogWarn( ( "No task for boot step %s, running it in place.", pStep->pName ) );
+            runStep( pStep );
+        }
+    #else
+        runStep( pStep );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+bool BootStep_Wait( BootStep_t * pStep )
+{
+    bool result = false;
+
+    configASSERT( pStep != NULL );
+
+    if( pStep->started == true )
+    {
+        /* Take the semaphore and give it back, so the step can be waited
+         * for more than once. */
+        ( void ) xSemaphoreTake( pStep->done, portMAX_DELAY );
+        ( void ) xSemaphoreGive( pStep->done );
+        result = pStep->result;
+    }
+
+    return result;
+}
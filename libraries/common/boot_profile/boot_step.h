@@ -0,0 +1,114 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file boot_step.h
+ * @brief Run independent initialization steps of a boot concurrently.
+ *
+ * A step is started as soon as what it depends on is ready and waited for
+ * just before its result is needed, so that, for example, credentials are
+ * parsed while Wi-Fi associates instead of after it. Each step runs in a
+ * task of its own, which deletes itself once the step is done, and times
+ * its boot phase.
+ */
+
+#ifndef BOOT_STEP_H_
+#define BOOT_STEP_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+#include "boot_profile.h"
+
+/**
+ * @brief Whether steps run in tasks of their own, or in the task that
+ * starts them.
+ */
+#ifndef BOOT_STEP_PARALLEL
+    #define BOOT_STEP_PARALLEL    CONFIG_BOOT_PROFILE_PARALLEL_INIT
+#endif
+
+#if BOOT_STEP_PARALLEL
+
+/**
+ * @brief Stack size in bytes of the task of a step.
+ */
+    #define BOOT_STEP_STACK_SIZE    CONFIG_BOOT_PROFILE_STEP_STACK_SIZE
+#endif
+
+/**
+ * @brief The work of a step.
+ *
+ * @param[in] pContext The context of the step.
+ *
+ * @return true if the step succeeded.
+ */
+typedef bool ( * BootStepFunction_t )( void * pContext );
+
+/**
+ * @brief A step. Set it up with #BOOT_STEP; the members after @a phase are
+ * private.
+ */
+typedef struct BootStep
+{
+    const char * pName;          /**< @brief Name of the step, for its task and logs. */
+    BootStepFunction_t function; /**< @brief The work of the step. */
+    void * pContext;             /**< @brief Passed to @a function. */
+    BootPhase_t phase;           /**< @brief The phase the step is timed as. */
+
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuffer;
+    bool started;
+    bool result;
+} BootStep_t;
+
+/**
+ * @brief Initializer of a #BootStep_t.
+ */
+#define BOOT_STEP( name, stepFunction, context, stepPhase ) \
+    { .pName = ( name ), .function = ( stepFunction ), .pContext = ( context ), .phase = ( stepPhase ) }
+
+/**
+ * @brief Start a step. If its task can't be created, or steps don't run
+ * concurrently, the step is run before returning.
+ *
+ * @param[in] pStep The step, which must not be started already.
+ */
+void BootStep_Start( BootStep_t * pStep );
+
+/**
+ * @brief Wait for a started step to be done.
+ *
+ * @param[in] pStep The step.
+ *
+ * @return The result of the step; false if it wasn't started.
+ */
+bool BootStep_Wait( BootStep_t * pStep );
+
+#endif /* ifndef BOOT_STEP_H_ */
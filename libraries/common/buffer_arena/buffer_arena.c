@@ -0,0 +1,321 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file buffer_arena.c
+ * @brief Implementation of the buffer arena.
+ *
+ * The slots of a class are contiguous in one static array, smallest class
+ * first, so the class and slot of a buffer follow from its offset. A bitmap
+ * per class marks the slots in use. Slots are taken and returned per
+ * connection or per OTA event, so a short critical section is cheaper than
+ * anything lock-free.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the buffer arena. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Buffer Arena"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "buffer_arena.h"
+
+#if BUFFER_ARENA_ENABLED
+
+    #if ( BUFFER_ARENA_SMALL_SIZE > BUFFER_ARENA_MEDIUM_SIZE ) || ( BUFFER_ARENA_MEDIUM_SIZE > BUFFER_ARENA_LARGE_SIZE )
+        #error "The slot sizes of the buffer arena must grow from small to large."
+    #endif
+
+    #if ( BUFFER_ARENA_SMALL_COUNT > 32 ) || ( BUFFER_ARENA_MEDIUM_COUNT > 32 ) || ( BUFFER_ARENA_LARGE_COUNT > 32 )
+        #error "A class of the buffer arena has at most 32 slots."
+    #endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A slot size rounded up to keep every slot 8-byte aligned.
+ */
+    #define SLOT_SIZE( size )    ( ( ( size_t ) ( size ) + 7U ) & ~( ( size_t ) 7U ) )
+
+/**
+ * @brief The number of size classes.
+ */
+    #define CLASS_COUNT          ( 3U )
+
+/**
+ * @brief Bytes of every slot of the arena.
+ */
+    #define ARENA_BYTES                                                   \
+    ( ( SLOT_SIZE( BUFFER_ARENA_SMALL_SIZE ) * BUFFER_ARENA_SMALL_COUNT ) +   \
+      ( SLOT_SIZE( BUFFER_ARENA_MEDIUM_SIZE ) * BUFFER_ARENA_MEDIUM_COUNT ) + \
+      ( SLOT_SIZE( BUFFER_ARENA_LARGE_SIZE ) * BUFFER_ARENA_LARGE_COUNT ) )
+
+/**
+ * @brief The number of slots of the arena.
+ */
+    #define ARENA_SLOTS \
+    ( BUFFER_ARENA_SMALL_COUNT + BUFFER_ARENA_MEDIUM_COUNT + BUFFER_ARENA_LARGE_COUNT )
+
+/**
+ * @brief A size class.
+ */
+    typedef struct SlotClass
+    {
+        size_t slotSize;   /**< Bytes of a slot. */
+        uint32_t count;    /**< Slots of the class. */
+        size_t offset;     /**< Offset of the first slot in the arena. */
+        uint32_t firstSlot; /**< Index of the first slot in #slotOwners. */
+    } SlotClass_t;
+
+    static const SlotClass_t classes[ CLASS_COUNT ] =
+    {
+        {
+            SLOT_SIZE( BUFFER_ARENA_SMALL_SIZE ), BUFFER_ARENA_SMALL_COUNT,
+            0U,
+            0U
+        },
+        {
+            SLOT_SIZE( BUFFER_ARENA_MEDIUM_SIZE ), BUFFER_ARENA_MEDIUM_COUNT,
+            SLOT_SIZE( BUFFER_ARENA_SMALL_SIZE ) * BUFFER_ARENA_SMALL_COUNT,
+            BUFFER_ARENA_SMALL_COUNT
+        },
+        {
+            SLOT_SIZE( BUFFER_ARENA_LARGE_SIZE ), BUFFER_ARENA_LARGE_COUNT,
+            ( SLOT_SIZE( BUFFER_ARENA_SMALL_SIZE ) * BUFFER_ARENA_SMALL_COUNT ) +
+            ( SLOT_SIZE( BUFFER_ARENA_MEDIUM_SIZE ) * BUFFER_ARENA_MEDIUM_COUNT ),
+            BUFFER_ARENA_SMALL_COUNT + BUFFER_ARENA_MEDIUM_COUNT
+        }
+    };
+
+/**
+ * @brief The quota of each owner.
+ */
+    static const size_t quotas[ BufferArenaOwnerCount ] =
+    {
+        BUFFER_ARENA_QUOTA_MQTT,
+        BUFFER_ARENA_QUOTA_HTTP,
+        BUFFER_ARENA_QUOTA_OTA
+    };
+
+/**
+ * @brief The slots.
+ */
+    static uint8_t arena[ ARENA_BYTES ] __attribute__( ( aligned( 8 ) ) );
+
+/**
+ * @brief Bit n is set while slot n of the class is in use.
+ */
+    static uint32_t usedSlots[ CLASS_COUNT ];
+
+/**
+ * @brief The owner of every slot in use.
+ */
+    static uint8_t slotOwners[ ARENA_SLOTS ];
+
+/**
+ * @brief What each owner holds, updated under #arenaLock.
+ */
+    static BufferArenaStats_t ownerStats[ BufferArenaOwnerCount ];
+
+/**
+ * @brief Guards the bitmaps and the counters.
+ */
+    static portMUX_TYPE arenaLock = portMUX_INITIALIZER_UNLOCKED;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Finds the class and slot of a buffer in the arena.
+ *
+ * @return false if @a pBuffer isn't the start of a slot.
+ */
+    static bool locateSlot( const void * pBuffer,
+                            uint32_t * pClass,
+                            uint32_t * pSlot );
+
+/*-----------------------------------------------------------*/
+
+    static bool locateSlot( const void * pBuffer,
+                            uint32_t * pClass,
+                            uint32_t * pSlot )
+    {
+        size_t offset;
+        uint32_t i;
+        bool found = false;
+
+        if( BufferArena_Contains( pBuffer ) )
+        {
+            offset = ( size_t ) ( ( const uint8_t * ) pBuffer - arena );
+            i = CLASS_COUNT;
+
+            /* The class is the last one with slots starting at or before the offset. */
+            while( ( i > 0U ) && ( ( classes[ i - 1U ].count == 0U ) || ( offset < classes[ i - 1U ].offset ) ) )
+            {
+                i--;
+            }
+
+            if( i > 0U )
+            {
+                offset -= classes[ i - 1U ].offset;
+                *pClass = i - 1U;
+                *pSlot = ( uint32_t ) ( offset / classes[ i - 1U ].slotSize );
+                found = ( ( offset % classes[ i - 1U ].slotSize ) == 0U );
+            }
+        }
+
+        return found;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void * BufferArena_Alloc( BufferArenaOwner_t owner,
+                              size_t size )
+    {
+        BufferArenaStats_t * pStats = &ownerStats[ owner ];
+        void * pBuffer = NULL;
+        uint32_t freeSlots;
+        uint32_t slot;
+        uint32_t i;
+        bool overQuota = false;
+
+        configASSERT( owner < BufferArenaOwnerCount );
+
+        taskENTER_CRITICAL( &arenaLock );
+
+        for( i = 0U; ( i < CLASS_COUNT ) && ( pBuffer == NULL ) && ( overQuota == false ); i++ )
+        {
+            freeSlots = ~usedSlots[ i ] & ( ( classes[ i ].count >= 32U ) ? UINT32_MAX : ( ( 1UL << classes[ i ].count ) - 1U ) );
+
+            if( ( classes[ i ].slotSize >= size ) && ( freeSlots != 0U ) )
+            {
+                if( ( quotas[ owner ] != 0U ) && ( ( pStats->currentBytes + classes[ i ].slotSize ) > quotas[ owner ] ) )
+                {
+                    /* A larger slot would exceed the quota too. */
+                    overQuota = true;
+                }
+                else
+                {
+                    slot = ( uint32_t ) __builtin_ctz( freeSlots );
+                    usedSlots[ i ] |= ( 1UL << slot );
+                    slotOwners[ classes[ i ].firstSlot + slot ] = ( uint8_t ) owner;
+                    pBuffer = &arena[ classes[ i ].offset + ( slot * classes[ i ].slotSize ) ];
+
+                    pStats->currentBytes += classes[ i ].slotSize;
+
+                    if( pStats->currentBytes > pStats->peakBytes )
+                    {
+                        pStats->peakBytes = pStats->currentBytes;
+                    }
+                }
+            }
+        }
+
+        if( pBuffer == NULL )
+        {
+            pStats->failures++;
+        }
+
+        taskEXIT_CRITICAL( &arenaLock );
+
+        if( pBuffer == NULL )
+        {
+            LogRateLimited( LogWarn, ( "No arena slot for %u bytes for owner %u%s.", ( unsigned ) size, ( unsigned ) owner,
+                                       overQuota ? ", which is at its quota" : "" ) );
+        }
+
+        return pBuffer;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool BufferArena_Free( BufferArenaOwner_t owner,
+                           void * pBuffer )
+    {
+        uint32_t classIndex = 0U;
+        uint32_t slot = 0U;
+        bool freed = false;
+
+        if( pBuffer != NULL )
+        {
+            if( locateSlot( pBuffer, &classIndex, &slot ) == true )
+            {
+                taskENTER_CRITICAL( &arenaLock );
+
+                if( ( ( usedSlots[ classIndex ] & ( 1UL << slot ) ) != 0U ) &&
+                    ( slotOwners[ classes[ classIndex ].firstSlot + slot ] == ( uint8_t ) owner ) )
+                {
+                    usedSlots[ classIndex ] &= ~( 1UL << slot );
+                    ownerStats[ owner ].currentBytes -= classes[ classIndex ].slotSize;
+                    freed = true;
+                }
+
+                taskEXIT_CRITICAL( &arenaLock );
+            }
+
+            if( freed == false )
+            {
+                LogError( ( "Buffer %p is not an arena slot held by owner %u.", pBuffer, ( unsigned ) owner ) );
+            }
+        }
+
+        return freed;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool BufferArena_Contains( const void * pBuffer )
+    {
+        const uint8_t * pBytes = ( const uint8_t * ) pBuffer;
+
+        return ( pBytes >= arena ) && ( pBytes < &arena[ ARENA_BYTES ] );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void BufferArena_GetStats( BufferArenaOwner_t owner,
+                               BufferArenaStats_t * pStats )
+    {
+        configASSERT( owner < BufferArenaOwnerCount );
+
+        taskENTER_CRITICAL( &arenaLock );
+        *pStats = ownerStats[ owner ];
+        taskEXIT_CRITICAL( &arenaLock );
+
+        pStats->quotaBytes = quotas[ owner ];
+    }
+
+#endif /* if BUFFER_ARENA_ENABLED */
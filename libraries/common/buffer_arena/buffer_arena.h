@@ -0,0 +1,150 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file buffer_arena.h
+ * @brief A fixed arena that network and OTA buffers are borrowed from.
+ *
+ * The arena is split into slots of three size classes. A buffer takes the
+ * smallest free slot that fits it, and is returned to the arena when the
+ * connection or event it was for is done, so that components which are not
+ * at their peak at the same time share the same RAM. Each owner has a quota
+ * of slot bytes, so that one of them can't take every slot.
+ */
+
+#ifndef BUFFER_ARENA_H_
+#define BUFFER_ARENA_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the demos borrow their buffers from the arena.
+ */
+#ifndef BUFFER_ARENA_ENABLED
+    #if CONFIG_BUFFER_ARENA_ENABLE
+        #define BUFFER_ARENA_ENABLED    1
+    #else
+        #define BUFFER_ARENA_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief Bytes and number of the slots of each class, smallest first.
+ */
+#ifndef BUFFER_ARENA_SMALL_SIZE
+    #define BUFFER_ARENA_SMALL_SIZE    CONFIG_BUFFER_ARENA_SMALL_SIZE
+#endif
+#ifndef BUFFER_ARENA_SMALL_COUNT
+    #define BUFFER_ARENA_SMALL_COUNT    CONFIG_BUFFER_ARENA_SMALL_COUNT
+#endif
+#ifndef BUFFER_ARENA_MEDIUM_SIZE
+    #define BUFFER_ARENA_MEDIUM_SIZE    CONFIG_BUFFER_ARENA_MEDIUM_SIZE
+#endif
+#ifndef BUFFER_ARENA_MEDIUM_COUNT
+    #define BUFFER_ARENA_MEDIUM_COUNT    CONFIG_BUFFER_ARENA_MEDIUM_COUNT
+#endif
+#ifndef BUFFER_ARENA_LARGE_SIZE
+    #define BUFFER_ARENA_LARGE_SIZE    CONFIG_BUFFER_ARENA_LARGE_SIZE
+#endif
+#ifndef BUFFER_ARENA_LARGE_COUNT
+    #define BUFFER_ARENA_LARGE_COUNT    CONFIG_BUFFER_ARENA_LARGE_COUNT
+#endif
+
+/**
+ * @brief Most slot bytes each owner can hold at once, 0 for no limit.
+ */
+#ifndef BUFFER_ARENA_QUOTA_MQTT
+    #define BUFFER_ARENA_QUOTA_MQTT    CONFIG_BUFFER_ARENA_QUOTA_MQTT
+#endif
+#ifndef BUFFER_ARENA_QUOTA_HTTP
+    #define BUFFER_ARENA_QUOTA_HTTP    CONFIG_BUFFER_ARENA_QUOTA_HTTP
+#endif
+#ifndef BUFFER_ARENA_QUOTA_OTA
+    #define BUFFER_ARENA_QUOTA_OTA    CONFIG_BUFFER_ARENA_QUOTA_OTA
+#endif
+
+/**
+ * @brief The components borrowing from the arena.
+ */
+typedef enum BufferArenaOwner
+{
+    BufferArenaOwnerMqtt, /**< MQTT network buffers. */
+    BufferArenaOwnerHttp, /**< HTTP request and response buffers. */
+    BufferArenaOwnerOta,  /**< OTA event buffers. */
+    BufferArenaOwnerCount
+} BufferArenaOwner_t;
+
+/**
+ * @brief The slots held by an owner.
+ */
+typedef struct BufferArenaStats
+{
+    size_t currentBytes; /**< Bytes of the slots held now. */
+    size_t peakBytes;    /**< The most bytes held at once. */
+    size_t quotaBytes;   /**< The quota, 0 for no limit. */
+    uint32_t failures;   /**< Allocations refused for the quota or for lack of a slot. */
+} BufferArenaStats_t;
+
+/**
+ * @brief Borrows a slot of at least @a size bytes, 8-byte aligned.
+ *
+ * The smallest class with a free slot that fits is used. Safe to call from
+ * any task.
+ *
+ * @return The slot, or NULL if @a owner would exceed its quota or no slot
+ * that fits is free.
+ */
+void * BufferArena_Alloc( BufferArenaOwner_t owner,
+                          size_t size );
+
+/**
+ * @brief Returns a slot to the arena. NULL is ignored.
+ *
+ * @param[in] owner The owner that borrowed @a pBuffer, checked against the
+ * one recorded.
+ * @param[in] pBuffer A slot from #BufferArena_Alloc.
+ *
+ * @return false if @a pBuffer is NULL, or isn't a slot in use by @a owner,
+ * for example because it was freed already.
+ */
+bool BufferArena_Free( BufferArenaOwner_t owner,
+                       void * pBuffer );
+
+/**
+ * @brief Whether @a pBuffer is in the arena.
+ */
+bool BufferArena_Contains( const void * pBuffer );
+
+/**
+ * @brief Reads the slots held by an owner.
+ */
+void BufferArena_GetStats( BufferArenaOwner_t owner,
+                           BufferArenaStats_t * pStats );
+
+#endif /* ifndef BUFFER_ARENA_H_ */
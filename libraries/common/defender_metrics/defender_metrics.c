@@ -0,0 +1,856 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file defender_metrics.c
+ * @brief Implementation of the Device Defender metrics collector.
+ *
+ * For details on the report format, see:
+ * https://docs.aws.amazon.com/iot/latest/developerguide/detect-device-side-metrics.html
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_heap_caps.h"
+
+/* lwIP includes. */
+#include "lwip/netif.h"
+#include "lwip/stats.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/priv/tcpip_priv.h"
+
+/* TinyCBOR library for CBOR encoding and decoding operations. */
+#include "cbor.h"
+
+/* Include Device Defender library. */
+#include "defender.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the collector. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Defender Metrics"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "defender_metrics.h"
+#include "perf_metrics.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A key of the report, as the arguments of cbor_encode_text_string.
+ */
+#define REPORT_KEY( key )    ( key ), ( sizeof( key ) - 1U )
+
+/**
+ * @brief The version of the report format.
+ */
+#define REPORT_VERSION    "1.0"
+
+/**
+ * @brief The longest "address:port" of a connection, for an IPv6 address in
+ * brackets.
+ */
+#define REMOTE_ADDRESS_LENGTH    ( IPADDR_STRLEN_MAX + sizeof( "[]:65535" ) )
+
+/**
+ * @brief Whether an encoding error is other than running out of buffer,
+ * after which TinyCBOR carries on to count the bytes missing.
+ */
+#define ENCODE_FAILED( error )    ( ( ( error ) & ~CborErrorOutOfMemory ) != CborNoError )
+
+/**
+ * @brief The arguments of the lwIP call reading the socket tables.
+ */
+typedef struct CollectCall
+{
+    struct tcpip_api_call_data call; /**< Must be first, lwIP hands it back. */
+    DefenderMetrics_t * pMetrics;
+} CollectCall_t;
+
+/**
+ * @brief The metrics of the report being published.
+ */
+static DefenderMetrics_t reportMetrics;
+
+/**
+ * @brief The buffer reports are encoded into.
+ */
+static uint8_t reportBuffer[ DEFENDER_METRICS_REPORT_BUFFER_SIZE ];
+
+/**
+ * @brief A copy of the metrics of the TLS transport.
+ */
+static TlsTransportMetrics_t transportMetrics;
+
+/**
+ * @brief When the last report was published, if any.
+ */
+static TickType_t lastReportTick = 0U;
+static bool reported = false;
+
+/**
+ * @brief The ID of the last report.
+ */
+static uint64_t lastReportId = 0U;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Adds a port to a list, once.
+ */
+static void addPort( uint16_t * pPorts,
+                     uint16_t * pCount,
+                     uint16_t * pTotal,
+                     uint16_t port );
+
+/**
+ * @brief Reads the socket tables and the network counters, in the lwIP core.
+ */
+static err_t collectNetwork( struct tcpip_api_call_data * pCall );
+
+/**
+ * @brief The ID of the next report: the time if it is set, and one more than
+ * the last ID otherwise.
+ */
+static uint64_t nextReportId( void );
+
+/**
+ * @brief Encodes a key and an unsigned integer into a map.
+ */
+static CborError encodeUint( CborEncoder * pMap,
+                             const char * pKey,
+                             size_t keyLength,
+                             uint64_t value );
+
+/**
+ * @brief Encodes a listening ports metric into the metrics map.
+ */
+static CborError encodePorts( CborEncoder * pMap,
+                              const char * pKey,
+                              size_t keyLength,
+                              const uint16_t * pPorts,
+                              uint16_t count,
+                              uint16_t total );
+
+/**
+ * @brief Encodes the established connections metric into the metrics map.
+ */
+static CborError encodeConnections( CborEncoder * pMap,
+                                    const DefenderMetrics_t * pMetrics );
+
+/**
+ * @brief Encodes the network statistics metric into the metrics map.
+ */
+static CborError encodeNetworkStats( CborEncoder * pMap,
+                                     const DefenderMetrics_t * pMetrics );
+
+/**
+ * @brief The number of custom metrics of a report.
+ */
+static size_t customMetricCount( const DefenderMetrics_t * pMetrics );
+
+/**
+ * @brief Encodes a number custom metric into the custom metrics map.
+ */
+static CborError encodeCustomNumber( CborEncoder * pMap,
+                                     const char * pName,
+                                     uint64_t value );
+
+#if PERF_METRICS_ENABLED
+
+/**
+ * @brief Encodes the snapshot of a registered performance metric into the
+ * custom metrics map, a histogram as a number list of its bucket deltas.
+ */
+    static CborError encodePerfMetric( CborEncoder * pMap,
+                                       const PerfMetric_t * pMetric );
+#endif
+
+/**
+ * @brief Encodes the custom metrics map into the report.
+ */
+static CborError encodeCustomMetrics( CborEncoder * pReport,
+                                      const DefenderMetrics_t * pMetrics );
+
+/*-----------------------------------------------------------*/
+
+static void addPort( uint16_t * pPorts,
+                     uint16_t * pCount,
+                     uint16_t * pTotal,
+                     uint16_t port )
+{
+    uint16_t i;
+    bool found = false;
+
+    /* The IPv4 and IPv6 PCBs of a socket share its port. */
+    for( i = 0; ( i < *pCount ) && ( found == false ); i++ )
+    {
+        found = ( pPorts[ i ] == port );
+    }
+
+    if( found == false )
+    {
+        if( *pCount < DEFENDER_METRICS_MAX_PORTS )
+        {
+            pPorts[ *pCount ] = port;
+            ( *pCount )++;
+        }
+
+        ( *pTotal )++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static err_t collectNetwork( struct tcpip_api_call_data * pCall )
+{
+    DefenderMetrics_t * pMetrics = ( ( CollectCall_t * ) pCall )->pMetrics;
+    const struct tcp_pcb_listen * pListen = NULL;
+    const struct tcp_pcb * pTcp = NULL;
+    const struct udp_pcb * pUdp = NULL;
+    DefenderMetricsConnection_t * pConnection = NULL;
+
+    #if MIB2_STATS
+        struct netif * pNetif = NULL;
+    #endif
+
+    for( pListen = tcp_listen_pcbs.listen_pcbs; pListen != NULL; pListen = pListen->next )
+    {
+        addPort( pMetrics->tcpPorts, &pMetrics->tcpPortCount, &pMetrics->tcpPortTotal, pListen->local_port );
+    }
+
+    /* A connected UDP PCB is a client, such as DNS or SNTP. */
+    for( pUdp = udp_pcbs; pUdp != NULL; pUdp = pUdp->next )
+    {
+        if( ( pUdp->local_port != 0U ) && ( ( pUdp->flags & UDP_FLAGS_CONNECTED ) == 0U ) )
+        {
+            addPort( pMetrics->udpPorts, &pMetrics->udpPortCount, &pMetrics->udpPortTotal, pUdp->local_port );
+        }
+    }
+
+    for( pTcp = tcp_active_pcbs; pTcp != NULL; pTcp = pTcp->next )
+    {
+        if( pTcp->state == ESTABLISHED )
+        {
+            if( pMetrics->connectionCount < DEFENDER_METRICS_MAX_CONNECTIONS )
+            {
+                pConnection = &pMetrics->connections[ pMetrics->connectionCount ];
+                ip_addr_copy( pConnection->remoteAddress, pTcp->remote_ip );
+                pConnection->remotePort = pTcp->remote_port;
+                pConnection->localPort = pTcp->local_port;
+                pMetrics->connectionCount++;
+            }
+
+            pMetrics->connectionTotal++;
+        }
+    }
+
+    #if LWIP_STATS && LINK_STATS
+        pMetrics->packetsIn = lwip_stats.link.recv;
+        pMetrics->packetsOut = lwip_stats.link.xmit;
+        pMetrics->hasPacketCounts = true;
+    #endif
+
+    #if MIB2_STATS
+        NETIF_FOREACH( pNetif )
+        {
+            pMetrics->bytesIn += pNetif->mib2_counters.ifinoctets;
+            pMetrics->bytesOut += pNetif->mib2_counters.ifoutoctets;
+        }
+        pMetrics->hasByteCounts = true;
+    #endif
+
+    return ERR_OK;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint64_t nextReportId( void )
+{
+    time_t now = time( NULL );
+
+    /* Before SNTP sets the clock, the time is a few seconds after 1970. */
+    if( ( now > 0 ) && ( ( uint64_t ) now > lastReportId ) )
+    {
+        lastReportId = ( uint64_t ) now;
+    }
+    else
+    {
+        lastReportId++;
+    }
+
+    return lastReportId;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError encodeUint( CborEncoder * pMap,
+                             const char * pKey,
+                             size_t keyLength,
+                             uint64_t value )
+{
+    CborError cborRet = cbor_encode_text_string( pMap, pKey, keyLength );
+
+    if( !ENCODE_FAILED( cborRet ) )
+    {
+        cborRet |= cbor_encode_uint( pMap, value );
+    }
+
+    return cborRet;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError encodePorts( CborEncoder * pMap,
+                              const char * pKey,
+                              size_t keyLength,
+                              const uint16_t * pPorts,
+                              uint16_t count,
+                              uint16_t total )
+{
+    CborEncoder metricEncoder, portsEncoder, portEncoder;
+    CborError cborRet;
+    uint16_t i;
+
+    /* { "ports": [ { "port": 443 }, ... ], "total": 1 } */
+    cborRet = cbor_encode_text_string( pMap, pKey, keyLength );
+    cborRet |= cbor_encoder_create_map( pMap, &metricEncoder, 2 );
+    cborRet |= cbor_encode_text_string( &metricEncoder, REPORT_KEY( DEFENDER_REPORT_PORTS_KEY ) );
+    cborRet |= cbor_encoder_create_array( &metricEncoder, &portsEncoder, count );
+
+    for( i = 0; ( i < count ) && !ENCODE_FAILED( cborRet ); i++ )
+    {
+        cborRet |= cbor_encoder_create_map( &portsEncoder, &portEncoder, 1 );
+        cborRet |= encodeUint( &portEncoder, REPORT_KEY( DEFENDER_REPORT_PORT_KEY ), pPorts[ i ] );
+        cborRet |= cbor_encoder_close_container( &portsEncoder, &portEncoder );
+    }
+
+    cborRet |= cbor_encoder_close_container( &metricEncoder, &portsEncoder );
+    cborRet |= encodeUint( &metricEncoder, REPORT_KEY( DEFENDER_REPORT_TOTAL_KEY ), total );
+    cborRet |= cbor_encoder_close_container( pMap, &metricEncoder );
+
+    return cborRet;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError encodeConnections( CborEncoder * pMap,
+                                    const DefenderMetrics_t * pMetrics )
+{
+    CborEncoder metricEncoder, establishedEncoder, connectionsEncoder, connectionEncoder;
+    CborError cborRet;
+    const DefenderMetricsConnection_t * pConnection = NULL;
+    char address[ REMOTE_ADDRESS_LENGTH ];
+    char ip[ IPADDR_STRLEN_MAX ];
+    int addressLength = 0;
+    uint16_t i;
+
+    /* { "established_connections": { "connections": [ { "remote_addr": "a:p",
+     * "local_port": 1 }, ... ], "total": 1 } } */
+    cborRet = cbor_encode_text_string( pMap, REPORT_KEY( DEFENDER_REPORT_TCP_CONNECTIONS_KEY ) );
+    cborRet |= cbor_encoder_create_map( pMap, &metricEncoder, 1 );
+    cborRet |= cbor_encode_text_string( &metricEncoder, REPORT_KEY( DEFENDER_REPORT_ESTABLISHED_CONNECTIONS_KEY ) );
+    cborRet |= cbor_encoder_create_map( &metricEncoder, &establishedEncoder, 2 );
+    cborRet |= cbor_encode_text_string( &establishedEncoder, REPORT_KEY( DEFENDER_REPORT_CONNECTIONS_KEY ) );
+    cborRet |= cbor_encoder_create_array( &establishedEncoder, &connectionsEncoder, pMetrics->connectionCount );
+
+    for( i = 0; ( i < pMetrics->connectionCount ) && !ENCODE_FAILED( cborRet ); i++ )
+    {
+        pConnection = &pMetrics->connections[ i ];
+        ( void ) ipaddr_ntoa_r( &pConnection->remoteAddress, ip, sizeof( ip ) );
+        addressLength = snprintf( address, sizeof( address ),
+                                  IP_IS_V6_VAL( pConnection->remoteAddress ) ? "[%s]:%u" : "%s:%u",
+                                  ip, ( unsigned ) pConnection->remotePort );
+        assert( ( addressLength > 0 ) && ( ( size_t ) addressLength < sizeof( address ) ) );
+
+        cborRet |= cbor_encoder_create_map( &connectionsEncoder, &connectionEncoder, 2 );
+        cborRet |= cbor_encode_text_string( &connectionEncoder, REPORT_KEY( DEFENDER_REPORT_REMOTE_ADDR_KEY ) );
+        cborRet |= cbor_encode_text_string( &connectionEncoder, address, ( size_t ) addressLength );
+        cborRet |= encodeUint( &connectionEncoder, REPORT_KEY( DEFENDER_REPORT_LOCAL_PORT_KEY ), pConnection->localPort );
+        cborRet |= cbor_encoder_close_container( &connectionsEncoder, &connectionEncoder );
+    }
+
+    cborRet |= cbor_encoder_close_container( &establishedEncoder, &connectionsEncoder );
+    cborRet |= encodeUint( &establishedEncoder, REPORT_KEY( DEFENDER_REPORT_TOTAL_KEY ), pMetrics->connectionTotal );
+    cborRet |= cbor_encoder_close_container( &metricEncoder, &establishedEncoder );
+    cborRet |= cbor_encoder_close_container( pMap, &metricEncoder );
+
+    return cborRet;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError encodeNetworkStats( CborEncoder * pMap,
+                                     const DefenderMetrics_t * pMetrics )
+{
+    CborEncoder statsEncoder;
+    CborError cborRet;
+    size_t counters = 0U;
+
+    counters += ( pMetrics->hasByteCounts == true ) ? 2U : 0U;
+    counters += ( pMetrics->hasPacketCounts == true ) ? 2U : 0U;
+
+    cborRet = cbor_encode_text_string( pMap, REPORT_KEY( DEFENDER_REPORT_NETWORK_STATS_KEY ) );
+    cborRet |= cbor_encoder_create_map( pMap, &statsEncoder, counters );
+
+    if( pMetrics->hasByteCounts == true )
+    {
+        cborRet |= encodeUint( &statsEncoder, REPORT_KEY( DEFENDER_REPORT_BYTES_IN_KEY ), pMetrics->bytesIn );
+        cborRet |= encodeUint( &statsEncoder, REPORT_KEY( DEFENDER_REPORT_BYTES_OUT_KEY ), pMetrics->bytesOut );
+    }
+
+    if( pMetrics->hasPacketCounts == true )
+    {
+        cborRet |= encodeUint( &statsEncoder, REPORT_KEY( DEFENDER_REPORT_PKTS_IN_KEY ), pMetrics->packetsIn );
+        cborRet |= encodeUint( &statsEncoder, REPORT_KEY( DEFENDER_REPORT_PKTS_OUT_KEY ), pMetrics->packetsOut );
+    }
+
+    cborRet |= cbor_encoder_close_container( pMap, &statsEncoder );
+
+    return cborRet;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t customMetricCount( const DefenderMetrics_t * pMetrics )
+{
+    size_t count = pMetrics->perfMetricCount;
+
+    #if DEFENDER_METRICS_CUSTOM
+        count += ( pMetrics->hasTransport == true ) ? 8U : 3U;
+    #endif
+
+    return count;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError encodeCustomNumber( CborEncoder * pMap,
+                                     const char * pName,
+                                     uint64_t value )
+{
+    CborEncoder valuesEncoder, valueEncoder;
+    CborError cborRet;
+
+    /* "name": [ { "number": 1 } ] */
+    cborRet = cbor_encode_text_stringz( pMap, pName );
+    cborRet |= cbor_encoder_create_array( pMap, &valuesEncoder, 1 );
+    cborRet |= cbor_encoder_create_map( &valuesEncoder, &valueEncoder, 1 );
+    cborRet |= encodeUint( &valueEncoder, REPORT_KEY( DEFENDER_REPORT_NUMBER_KEY ), value );
+    cborRet |= cbor_encoder_close_container( &valuesEncoder, &valueEncoder );
+    cborRet |= cbor_encoder_close_container( pMap, &valuesEncoder );
+
+    return cborRet;
+}
+
+/*-----------------------------------------------------------*/
+
+#if PERF_METRICS_ENABLED
+
+    static CborError encodePerfMetric( CborEncoder * pMap,
+                                       const PerfMetric_t * pMetric )
+    {
+        CborEncoder valuesEncoder, valueEncoder, listEncoder;
+        CborError cborRet = CborNoError;
+        size_t bucket;
+
+        if( pMetric->type != PerfMetricHistogram )
+        {
+            cborRet = encodeCustomNumber( pMap, pMetric->pName, PerfMetrics_Delta( pMetric, 0U ) );
+        }
+        else
+        {
+            /* "name": [ { "number_list": [ 1, 2, ... ] } ] */
+            cborRet = cbor_encode_text_stringz( pMap, pMetric->pName );
+            cborRet |= cbor_encoder_create_array( pMap, &valuesEncoder, 1 );
+            cborRet |= cbor_encoder_create_map( &valuesEncoder, &valueEncoder, 1 );
+            cborRet |= cbor_encode_text_string( &valueEncoder, REPORT_KEY( DEFENDER_REPORT_NUMBER_LIST_KEY ) );
+            cborRet |= cbor_encoder_create_array( &valueEncoder, &listEncoder, pMetric->bucketCount );
+
+            for( bucket = 0U; ( bucket < pMetric->bucketCount ) && !ENCODE_FAILED( cborRet ); bucket++ )
+            {
+                cborRet |= cbor_encode_uint( &listEncoder, PerfMetrics_Delta( pMetric, bucket ) );
+            }
+
+            cborRet |= cbor_encoder_close_container( &valueEncoder, &listEncoder );
+            cborRet |= cbor_encoder_close_container( &valuesEncoder, &valueEncoder );
+            cborRet |= cbor_encoder_close_container( pMap, &valuesEncoder );
+        }
+
+        return cborRet;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if PERF_METRICS_ENABLED */
+
+static CborError encodeCustomMetrics( CborEncoder * pReport,
+                                      const DefenderMetrics_t * pMetrics )
+{
+    CborEncoder customEncoder;
+    CborError cborRet;
+
+    #if PERF_METRICS_ENABLED
+        const PerfMetric_t * pPerfMetric = NULL;
+        size_t i;
+    #endif
+
+    /* The names are those the custom metrics are created with in AWS IoT. */
+    cborRet = cbor_encode_text_string( pReport, REPORT_KEY( DEFENDER_REPORT_CUSTOM_METRICS_KEY ) );
+    cborRet |= cbor_encoder_create_map( pReport, &customEncoder, customMetricCount( pMetrics ) );
+
+    #if DEFENDER_METRICS_CUSTOM
+        cborRet |= encodeCustomNumber( &customEncoder, "heap_free", pMetrics->heapFree );
+        cborRet |= encodeCustomNumber( &customEncoder, "heap_min_free", pMetrics->heapMinimumFree );
+        cborRet |= encodeCustomNumber( &customEncoder, "heap_largest_block", pMetrics->heapLargestBlock );
+
+        if( pMetrics->hasTransport == true )
+        {
+            cborRet |= encodeCustomNumber( &customEncoder, "tls_bytes_sent", pMetrics->transportBytesSent );
+            cborRet |= encodeCustomNumber( &customEncoder, "tls_bytes_received", pMetrics->transportBytesReceived );
+            cborRet |= encodeCustomNumber( &customEncoder, "tls_send_errors", pMetrics->transportSendErrors );
+            cborRet |= encodeCustomNumber( &customEncoder, "tls_recv_errors", pMetrics->transportRecvErrors );
+            cborRet |= encodeCustomNumber( &customEncoder, "tls_handshake_failures", pMetrics->transportHandshakeFailures );
+        }
+    #endif
+
+    #if PERF_METRICS_ENABLED
+        /* The metrics of the snapshot taken when the report was collected. */
+        pPerfMetric = PerfMetrics_Next( NULL );
+
+        for( i = 0U; ( i < pMetrics->perfMetricCount ) && ( pPerfMetric != NULL ) && !ENCODE_FAILED( cborRet ); i++ )
+        {
+            cborRet |= encodePerfMetric( &customEncoder, pPerfMetric );
+            pPerfMetric = PerfMetrics_Next( pPerfMetric );
+        }
+    #endif
+
+    cborRet |= cbor_encoder_close_container( pReport, &customEncoder );
+
+    return cborRet;
+}
+
+/*-----------------------------------------------------------*/
+
+DefenderMetricsStatus_t DefenderMetrics_Collect( DefenderMetrics_t * pMetrics,
+                                                 const NetworkContext_t * pNetworkContext )
+{
+    DefenderMetricsStatus_t status = DefenderMetricsSuccess;
+    CollectCall_t collectCall;
+
+    if( pMetrics == NULL )
+    {
+        status = DefenderMetricsBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pMetrics, 0x00, sizeof( *pMetrics ) );
+
+        /* The PCB lists are only consistent in the lwIP core. */
+        collectCall.pMetrics = pMetrics;
+
+        if( tcpip_api_call( collectNetwork, &collectCall.call ) != ERR_OK )
+        {
+            LogError( ( "Failed to read the lwIP socket tables." ) );
+            status = DefenderMetricsCollectFailed;
+        }
+
+        pMetrics->heapFree = ( uint32_t ) heap_caps_get_free_size( MALLOC_CAP_DEFAULT );
+        pMetrics->heapMinimumFree = ( uint32_t ) heap_caps_get_minimum_free_size( MALLOC_CAP_DEFAULT );
+        pMetrics->heapLargestBlock = ( uint32_t ) heap_caps_get_largest_free_block( MALLOC_CAP_DEFAULT );
+
+        if( ( pNetworkContext != NULL ) && ( pNetworkContext->pxMetrics != NULL ) )
+        {
+            vTlsTransportMetricsGet( pNetworkContext, &transportMetrics );
+            pMetrics->transportBytesSent = transportMetrics.ullBytesSent;
+            pMetrics->transportBytesReceived = transportMetrics.ullBytesReceived;
+            pMetrics->transportSendErrors = transportMetrics.ulSendErrors;
+            pMetrics->transportRecvErrors = transportMetrics.ulRecvErrors;
+            pMetrics->transportHandshakeFailures = transportMetrics.ulHandshakeFailures;
+            pMetrics->hasTransport = true;
+        }
+
+        #if PERF_METRICS_ENABLED
+            pMetrics->perfMetricCount = PerfMetrics_Snapshot();
+        #endif
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+DefenderMetricsStatus_t DefenderMetrics_Encode( const DefenderMetrics_t * pMetrics,
+                                                uint64_t reportId,
+                                                uint8_t * pBuffer,
+                                                size_t bufferLength,
+                                                size_t * pEncodedLength )
+{
+    DefenderMetricsStatus_t status = DefenderMetricsSuccess;
+    CborEncoder encoder, reportEncoder, headerEncoder, metricsEncoder;
+    CborError cborRet = CborNoError;
+    size_t metricCount = 3U;
+
+    if( ( pMetrics == NULL ) || ( pBuffer == NULL ) || ( pEncodedLength == NULL ) )
+    {
+        status = DefenderMetricsBadParameter;
+    }
+    else
+    {
+        /* Network statistics are left out when lwIP doesn't count. */
+        if( ( pMetrics->hasByteCounts == true ) || ( pMetrics->hasPacketCounts == true ) )
+        {
+            metricCount++;
+        }
+
+        cbor_encoder_init( &encoder, pBuffer, bufferLength, 0 );
+
+        /* { "header": { "report_id": 1, "version": "1.0" }, "metrics": { ... },
+         * "custom_metrics": { ... } } */
+        cborRet = cbor_encoder_create_map( &encoder, &reportEncoder, ( customMetricCount( pMetrics ) > 0U ) ? 3U : 2U );
+        cborRet |= cbor_encode_text_string( &reportEncoder, REPORT_KEY( DEFENDER_REPORT_HEADER_KEY ) );
+        cborRet |= cbor_encoder_create_map( &reportEncoder, &headerEncoder, 2 );
+        cborRet |= encodeUint( &headerEncoder, REPORT_KEY( DEFENDER_REPORT_ID_KEY ), reportId );
+        cborRet |= cbor_encode_text_string( &headerEncoder, REPORT_KEY( DEFENDER_REPORT_VERSION_KEY ) );
+        cborRet |= cbor_encode_text_string( &headerEncoder, REPORT_KEY( REPORT_VERSION ) );
+        cborRet |= cbor_encoder_close_container( &reportEncoder, &headerEncoder );
+
+        cborRet |= cbor_encode_text_string( &reportEncoder, REPORT_KEY( DEFENDER_REPORT_METRICS_KEY ) );
+        cborRet |= cbor_encoder_create_map( &reportEncoder, &metricsEncoder, metricCount );
+        cborRet |= encodePorts( &metricsEncoder, REPORT_KEY( DEFENDER_REPORT_TCP_LISTENING_PORTS_KEY ),
+                                pMetrics->tcpPorts, pMetrics->tcpPortCount, pMetrics->tcpPortTotal );
+        cborRet |= encodePorts( &metricsEncoder, REPORT_KEY( DEFENDER_REPORT_UDP_LISTENING_PORTS_KEY ),
+                                pMetrics->udpPorts, pMetrics->udpPortCount, pMetrics->udpPortTotal );
+        cborRet |= encodeConnections( &metricsEncoder, pMetrics );
+
+        if( metricCount > 3U )
+        {
+            cborRet |= encodeNetworkStats( &metricsEncoder, pMetrics );
+        }
+
+        cborRet |= cbor_encoder_close_container( &reportEncoder, &metricsEncoder );
+
+        if( customMetricCount( pMetrics ) > 0U )
+        {
+            cborRet |= encodeCustomMetrics( &reportEncoder, pMetrics );
+        }
+
+        cborRet |= cbor_encoder_close_container( &encoder, &reportEncoder );
+
+        if( ENCODE_FAILED( cborRet ) )
+        {
+            LogError( ( "Error during CBOR encoding: %s", cbor_error_string( cborRet ) ) );
+            status = DefenderMetricsEncodeFailed;
+        }
+        else if( cborRet != CborNoError )
+        {
+            LogError( ( "A metrics report needs a buffer of %u bytes, the buffer has %u.",
+                        ( unsigned ) ( bufferLength + cbor_encoder_get_extra_bytes_needed( &encoder ) ),
+                        ( unsigned ) bufferLength ) );
+            status = DefenderMetricsBufferTooSmall;
+        }
+        else
+        {
+            *pEncodedLength = cbor_encoder_get_buffer_size( &encoder, pBuffer );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+DefenderMetricsStatus_t DefenderMetrics_PrepareIfDue( const NetworkContext_t * pNetworkContext,
+                                                      const char * pThingName,
+                                                      uint16_t thingNameLength,
+                                                      DefenderMetricsReport_t * pReport )
+{
+    DefenderMetricsStatus_t status = DefenderMetricsSuccess;
+    TickType_t now = xTaskGetTickCount();
+    size_t reportLength = 0U;
+
+    if( ( pThingName == NULL ) || ( pReport == NULL ) )
+    {
+        status = DefenderMetricsBadParameter;
+    }
+    else if( ( reported == true ) &&
+             ( ( now - lastReportTick ) < ( ( TickType_t ) DEFENDER_METRICS_INTERVAL_S * configTICK_RATE_HZ ) ) )
+    {
+        status = DefenderMetricsNotDue;
+    }
+    else
+    {
+        /* A failed report waits for the next interval too, so that a failing
+         * connection costs no more than a working one. */
+        lastReportTick = now;
+        reported = true;
+
+        /* The socket tables are still reported if the counters can't be read. */
+        ( void ) DefenderMetrics_Collect( &reportMetrics, pNetworkContext );
+        status = DefenderMetrics_Encode( &reportMetrics, nextReportId(),
+                                         reportBuffer, sizeof( reportBuffer ), &reportLength );
+    }
+
+    if( status == DefenderMetricsSuccess )
+    {
+        if( Defender_GetTopic( pReport->topic, sizeof( pReport->topic ), pThingName, thingNameLength,
+                               DefenderCborReportPublish, &pReport->topicLength ) != DefenderSuccess )
+        {
+            LogError( ( "Failed to make the Device Defender report topic." ) );
+            status = DefenderMetricsPublishFailed;
+        }
+        else
+        {
+            pReport->pPayload = reportBuffer;
+            pReport->payloadLength = reportLength;
+            pReport->reportId = lastReportId;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void DefenderMetrics_ReportPublished( const DefenderMetricsReport_t * pReport )
+{
+    assert( pReport != NULL );
+
+    #if PERF_METRICS_ENABLED
+        /* The next report carries what changed since this one. */
+        PerfMetrics_Commit();
+    #endif
+
+    LogInfo( ( "Published a metrics report of %u bytes, ID %llu.",
+               ( unsigned ) pReport->payloadLength, ( unsigned long long ) pReport->reportId ) );
+}
+
+/*-----------------------------------------------------------*/
+
+DefenderMetricsStatus_t DefenderMetrics_PublishIfDue( MQTTContext_t * pMqttContext,
+                                                      const NetworkContext_t * pNetworkContext,
+                                                      const char * pThingName,
+                                                      uint16_t thingNameLength )
+{
+    DefenderMetricsStatus_t status = DefenderMetricsSuccess;
+    DefenderMetricsReport_t report;
+    MQTTPublishInfo_t publishInfo;
+    MQTTStatus_t mqttStatus;
+
+    if( pMqttContext == NULL )
+    {
+        status = DefenderMetricsBadParameter;
+    }
+    else
+    {
+        status = DefenderMetrics_PrepareIfDue( pNetworkContext, pThingName, thingNameLength, &report );
+    }
+
+    if( status == DefenderMetricsSuccess )
+    {
+        ( void ) memset( &publishInfo, 0x00, sizeof( publishInfo ) );
+        publishInfo.qos = MQTTQoS0;
+        publishInfo.pTopicName = report.topic;
+        publishInfo.topicNameLength = report.topicLength;
+        publishInfo.pPayload = report.pPayload;
+        publishInfo.payloadLength = report.payloadLength;
+
+        mqttStatus = MQTT_Publish( pMqttContext, &publishInfo, 0U );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Failed to publish the metrics report: %s.", MQTT_Status_strerror( mqttStatus ) ) );
+            status = DefenderMetricsPublishFailed;
+        }
+        else
+        {
+            DefenderMetrics_ReportPublished( &report );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool DefenderMetrics_HandleResponse( const MQTTPublishInfo_t * pPublishInfo )
+{
+    DefenderTopic_t api = DefenderInvalidTopic;
+    const char * pThingName = NULL;
+    uint16_t thingNameLength = 0U;
+    CborParser parser;
+    CborValue response, details, code;
+    char errorCode[ 32 ];
+    size_t errorCodeLength = sizeof( errorCode );
+    bool matched = false;
+
+    assert( pPublishInfo != NULL );
+
+    matched = ( Defender_MatchTopic( pPublishInfo->pTopicName, pPublishInfo->topicNameLength,
+                                     &api, &pThingName, &thingNameLength ) == DefenderSuccess );
+
+    if( matched && ( api == DefenderCborReportAccepted ) )
+    {
+        LogDebug( ( "Metrics report accepted." ) );
+    }
+    else if( matched && ( api == DefenderCborReportRejected ) )
+    {
+        /* { "statusDetails": { "ErrorCode": "...", ... }, ... } */
+        if( ( cbor_parser_init( pPublishInfo->pPayload, pPublishInfo->payloadLength, 0, &parser, &response ) == CborNoError ) &&
+            cbor_value_is_map( &response ) &&
+            ( cbor_value_map_find_value( &response, "statusDetails", &details ) == CborNoError ) &&
+            cbor_value_is_map( &details ) &&
+            ( cbor_value_map_find_value( &details, "ErrorCode", &code ) == CborNoError ) &&
+            cbor_value_is_text_string( &code ) &&
+            ( cbor_value_copy_text_string( &code, errorCode, &errorCodeLength, NULL ) == CborNoError ) )
+        {
+            LogWarn( ( "Metrics report rejected: %s.", errorCode ) );
+        }
+        else
+        {
+            LogWarn( ( "Metrics report rejected." ) );
+        }
+    }
+    else
+    {
+        /* Another topic, or a JSON report response. */
+    }
+
+    return matched;
+}
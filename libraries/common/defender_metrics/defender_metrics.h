@@ -0,0 +1,298 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file defender_metrics.h
+ * @brief Collect Device Defender metrics on the device and report them in CBOR.
+ *
+ * A report holds the listening TCP and UDP ports and the established TCP
+ * connections, read from the lwIP socket tables, the packet and byte counters
+ * of lwIP, and, as custom metrics, the heap statistics, the counters of the
+ * TLS transport and the metrics registered with perf_metrics.h. It is
+ * encoded into a buffer allocated once, and published on the CBOR report
+ * topic of the thing no more often than #DEFENDER_METRICS_INTERVAL_S.
+ *
+ * Budget, fixed at build time:
+ * - RAM: sizeof( DefenderMetrics_t ), which is 4 bytes per port and 8 bytes
+ *   (20 with IPv6) per connection on top of 64 bytes, a copy of the transport
+ *   metrics of about 250 bytes, and #DEFENDER_METRICS_REPORT_BUFFER_SIZE, all
+ *   static. No heap is allocated. #DefenderMetrics_PublishIfDue uses about
+ *   400 bytes of stack.
+ * - CPU: one walk of the lwIP PCB lists, while holding the lwIP core, and
+ *   one encoding pass over at most #DEFENDER_METRICS_MAX_PORTS ports of each
+ *   protocol and #DEFENDER_METRICS_MAX_CONNECTIONS connections, per report.
+ *   A call that isn't due only reads the tick count.
+ *
+ * With short keys and the default limits, a full report takes about 900
+ * bytes. Long keys, selected with DEFENDER_USE_LONG_KEYS, take about half as
+ * much again.
+ *
+ * The functions are not reentrant, and are to be called from the task that
+ * owns the MQTT connection, or, with #DefenderMetrics_PrepareIfDue, from a
+ * single task that publishes the report through the owner, such as a task
+ * sending commands to the MQTT agent.
+ */
+
+#ifndef DEFENDER_METRICS_H_
+#define DEFENDER_METRICS_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* lwIP includes. */
+#include "lwip/ip_addr.h"
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* Include the TLS transport, for its metrics. */
+#include "network_transport.h"
+
+/* Include Device Defender library, for the length of its topics. */
+#include "defender.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The shortest time between two reports, in seconds.
+ */
+#ifndef DEFENDER_METRICS_INTERVAL_S
+    #define DEFENDER_METRICS_INTERVAL_S    CONFIG_DEFENDER_METRICS_INTERVAL_S
+#endif
+
+/**
+ * @brief The most listening ports of each protocol a report lists.
+ */
+#ifndef DEFENDER_METRICS_MAX_PORTS
+    #define DEFENDER_METRICS_MAX_PORTS    CONFIG_DEFENDER_METRICS_MAX_PORTS
+#endif
+
+/**
+ * @brief The most established TCP connections a report lists.
+ */
+#ifndef DEFENDER_METRICS_MAX_CONNECTIONS
+    #define DEFENDER_METRICS_MAX_CONNECTIONS    CONFIG_DEFENDER_METRICS_MAX_CONNECTIONS
+#endif
+
+/**
+ * @brief The size of the buffer a report is encoded into.
+ */
+#ifndef DEFENDER_METRICS_REPORT_BUFFER_SIZE
+    #define DEFENDER_METRICS_REPORT_BUFFER_SIZE    CONFIG_DEFENDER_METRICS_REPORT_BUFFER_SIZE
+#endif
+
+/**
+ * @brief Whether reports carry the heap and transport custom metrics.
+ */
+#ifndef DEFENDER_METRICS_CUSTOM
+    #if CONFIG_DEFENDER_METRICS_CUSTOM
+        #define DEFENDER_METRICS_CUSTOM    1
+    #else
+        #define DEFENDER_METRICS_CUSTOM    0
+    #endif
+#endif
+
+/**
+ * @brief Outcome of a collector function.
+ */
+typedef enum DefenderMetricsStatus
+{
+    DefenderMetricsSuccess,        /**< The metrics were collected, encoded or published. */
+    DefenderMetricsBadParameter,   /**< A parameter was NULL. */
+    DefenderMetricsNotDue,         /**< The last report is less than an interval old. */
+    DefenderMetricsCollectFailed,  /**< The lwIP tables couldn't be read. */
+    DefenderMetricsBufferTooSmall, /**< The report doesn't fit in the buffer. */
+    DefenderMetricsEncodeFailed,   /**< CBOR encoding failed for another reason. */
+    DefenderMetricsPublishFailed   /**< The topic couldn't be made, or the publish failed. */
+} DefenderMetricsStatus_t;
+
+/**
+ * @brief An established TCP connection.
+ */
+typedef struct DefenderMetricsConnection
+{
+    ip_addr_t remoteAddress;
+    uint16_t remotePort;
+    uint16_t localPort;
+} DefenderMetricsConnection_t;
+
+/**
+ * @brief The metrics of one report.
+ *
+ * The lists keep the first entries found. Their totals count every entry,
+ * including those that didn't fit.
+ */
+typedef struct DefenderMetrics
+{
+    uint16_t tcpPorts[ DEFENDER_METRICS_MAX_PORTS ];
+    uint16_t tcpPortCount;
+    uint16_t tcpPortTotal;
+    uint16_t udpPorts[ DEFENDER_METRICS_MAX_PORTS ];
+    uint16_t udpPortCount;
+    uint16_t udpPortTotal;
+    DefenderMetricsConnection_t connections[ DEFENDER_METRICS_MAX_CONNECTIONS ];
+    uint16_t connectionCount;
+    uint16_t connectionTotal;
+
+    /* Network counters, when lwIP keeps them: packets with LWIP_STATS, bytes
+     * with MIB2_STATS. */
+    bool hasPacketCounts;
+    bool hasByteCounts;
+    uint64_t packetsIn;
+    uint64_t packetsOut;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+
+    /* Heap of the default capabilities, in bytes. */
+    uint32_t heapFree;
+    uint32_t heapMinimumFree;
+    uint32_t heapLargestBlock;
+
+    /* Counters of the TLS transport, when it keeps metrics. */
+    bool hasTransport;
+    uint64_t transportBytesSent;
+    uint64_t transportBytesReceived;
+    uint32_t transportSendErrors;
+    uint32_t transportRecvErrors;
+    uint32_t transportHandshakeFailures;
+
+    /* The number of registered performance metrics in the snapshot taken for
+     * the report, 0 without PERF_METRICS_ENABLED. */
+    size_t perfMetricCount;
+} DefenderMetrics_t;
+
+/**
+ * @brief A report ready to be published, made by
+ * #DefenderMetrics_PrepareIfDue.
+ */
+typedef struct DefenderMetricsReport
+{
+    char topic[ DEFENDER_API_MAX_LENGTH( DEFENDER_THINGNAME_MAX_LENGTH ) ];
+    uint16_t topicLength;
+
+    /* The encoded report, in a static buffer reused by the next report. */
+    const uint8_t * pPayload;
+    size_t payloadLength;
+    uint64_t reportId;
+} DefenderMetricsReport_t;
+
+/**
+ * @brief Samples the metrics of a report.
+ *
+ * @param[out] pMetrics The metrics.
+ * @param[in] pNetworkContext The connection whose transport metrics are
+ * reported, or NULL.
+ *
+ * @return #DefenderMetricsSuccess, #DefenderMetricsBadParameter, or
+ * #DefenderMetricsCollectFailed if the lwIP tables couldn't be read, in which
+ * case the other metrics are still set.
+ */
+DefenderMetricsStatus_t DefenderMetrics_Collect( DefenderMetrics_t * pMetrics,
+                                                 const NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Encodes a report in CBOR.
+ *
+ * @param[in] pMetrics The metrics.
+ * @param[in] reportId The report ID, larger than that of the last report.
+ * @param[out] pBuffer The buffer to encode into.
+ * @param[in] bufferLength The size of @a pBuffer.
+ * @param[out] pEncodedLength The length of the report.
+ *
+ * @return #DefenderMetricsSuccess, #DefenderMetricsBadParameter,
+ * #DefenderMetricsBufferTooSmall, in which case the size needed is logged, or
+ * #DefenderMetricsEncodeFailed.
+ */
+DefenderMetricsStatus_t DefenderMetrics_Encode( const DefenderMetrics_t * pMetrics,
+                                                uint64_t reportId,
+                                                uint8_t * pBuffer,
+                                                size_t bufferLength,
+                                                size_t * pEncodedLength );
+
+/**
+ * @brief Collects, encodes and publishes a report at QoS 0, if the last one
+ * is an interval old, to be called from the loop of the MQTT task.
+ *
+ * The first call always reports. A report that fails isn't retried before
+ * the next interval.
+ *
+ * @param[in] pMqttContext The MQTT connection.
+ * @param[in] pNetworkContext The network context of the connection.
+ * @param[in] pThingName The name of the thing to report for.
+ * @param[in] thingNameLength The length of @a pThingName.
+ *
+ * @return #DefenderMetricsSuccess once a report is published,
+ * #DefenderMetricsNotDue, or why reporting failed.
+ */
+DefenderMetricsStatus_t DefenderMetrics_PublishIfDue( MQTTContext_t * pMqttContext,
+                                                      const NetworkContext_t * pNetworkContext,
+                                                      const char * pThingName,
+                                                      uint16_t thingNameLength );
+
+/**
+ * @brief Collects and encodes a report, if the last one is an interval old,
+ * for the application to publish at QoS 0 on its topic.
+ *
+ * The payload stays valid until the next call that is due, so the report can
+ * be handed to another task, as long as it is published before then. A
+ * report that fails isn't retried before the next interval.
+ *
+ * @param[in] pNetworkContext The network context of the connection, or NULL.
+ * @param[in] pThingName The name of the thing to report for.
+ * @param[in] thingNameLength The length of @a pThingName.
+ * @param[out] pReport The topic and payload of the report.
+ *
+ * @return #DefenderMetricsSuccess once a report is ready,
+ * #DefenderMetricsNotDue, or why it couldn't be made.
+ */
+DefenderMetricsStatus_t DefenderMetrics_PrepareIfDue( const NetworkContext_t * pNetworkContext,
+                                                      const char * pThingName,
+                                                      uint16_t thingNameLength,
+                                                      DefenderMetricsReport_t * pReport );
+
+/**
+ * @brief Records that a report made by #DefenderMetrics_PrepareIfDue was
+ * published, so that the next report carries the performance metrics that
+ * changed since.
+ *
+ * @param[in] pReport The report published.
+ */
+void DefenderMetrics_ReportPublished( const DefenderMetricsReport_t * pReport );
+
+/**
+ * @brief Logs the response of Device Defender to a CBOR report, to be called
+ * from the MQTT publish callback.
+ *
+ * The application subscribes to the accepted and rejected topics of the
+ * CBOR report API to receive the responses.
+ *
+ * @param[in] pPublishInfo The incoming PUBLISH message.
+ *
+ * @return true if the message is a Device Defender response.
+ */
+bool DefenderMetrics_HandleResponse( const MQTTPublishInfo_t * pPublishInfo );
+
+#endif /* ifndef DEFENDER_METRICS_H_ */
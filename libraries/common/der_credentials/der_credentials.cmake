@@ -0,0 +1,31 @@
+# Embeds PEM credentials in an application as DER, converted at build time.
+#
+# Include this file from the project CMakeLists.txt, after project(), and call
+# target_add_der_data where target_add_binary_data would be called:
+#
+#   target_add_der_data(${CMAKE_PROJECT_NAME}.elf "main/certs/client.crt")
+#
+# The data is linked as for target_add_binary_data, under the file name with
+# ".der" appended, so the example above defines _binary_client_crt_der_start
+# and _binary_client_crt_der_end. The DER data is not NUL-terminated; its
+# length is the difference between the two symbols.
+
+set(DER_CREDENTIALS_DIR "${CMAKE_CURRENT_LIST_DIR}")
+
+function(target_add_der_data target pem_file)
+    idf_build_get_property(python PYTHON)
+    idf_build_get_property(build_dir BUILD_DIR)
+
+    get_filename_component(pem_path "${pem_file}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_SOURCE_DIR}")
+    get_filename_component(pem_name "${pem_file}" NAME)
+    set(der_path "${build_dir}/der_credentials/${pem_name}.der")
+
+    add_custom_command(OUTPUT "${der_path}"
+        COMMAND ${python} "${DER_CREDENTIALS_DIR}/pem_to_der.py" "${pem_path}" "${der_path}"
+        MAIN_DEPENDENCY "${pem_path}"
+        DEPENDS "${DER_CREDENTIALS_DIR}/pem_to_der.py"
+        COMMENT "Converting ${pem_name} to DER"
+        VERBATIM)
+
+    target_add_binary_data(${target} "${der_path}" BINARY)
+endfunction()
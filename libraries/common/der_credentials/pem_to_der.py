@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+#
+# Converts a PEM file holding one certificate or unencrypted private key to
+# DER. Used by der_credentials.cmake at build time.
+
+import binascii
+import re
+import sys
+
+PEM_BLOCK = re.compile(r'-----BEGIN ([A-Z0-9 ]+)-----(.*?)-----END \1-----', re.DOTALL)
+
+
+def pem_to_der(pem):
+    blocks = PEM_BLOCK.findall(pem)
+
+    if len(blocks) != 1:
+        raise ValueError('expected one PEM object, found {}'.format(len(blocks)))
+
+    label, body = blocks[0]
+
+    if 'Proc-Type:' in body or 'ENCRYPTED' in label:
+        raise ValueError('{} is encrypted, which DER cannot hold'.format(label))
+
+    return binascii.a2b_base64(''.join(body.split()))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: {} <input.pem> <output.der>'.format(sys.argv[0]))
+
+    with open(sys.argv[1], 'r') as pem_file:
+        pem = pem_file.read()
+
+    try:
+        der = pem_to_der(pem)
+    except (ValueError, binascii.Error) as error:
+        sys.exit('{}: {}'.format(sys.argv[1], error))
+
+    with open(sys.argv[2], 'wb') as der_file:
+        der_file.write(der)
+
+
+if __name__ == '__main__':
+    main()
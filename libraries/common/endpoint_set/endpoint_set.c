@@ -0,0 +1,255 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file endpoint_set.c
+ * @brief Implementation of the endpoint set.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the endpoint set. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Endpoint Set"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "endpoint_set.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A failure rate of 1, in the fixed point of #EndpointHealth_t.
+ */
+#define FAILURE_RATE_ONE    ( 256U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether an endpoint is being avoided at @a nowMs.
+ */
+static bool isAvoided( const EndpointHealth_t * pEndpoint,
+                       uint32_t nowMs );
+
+/**
+ * @brief The score of an endpoint; lower is better.
+ */
+static uint32_t score( const EndpointHealth_t * pEndpoint );
+
+/*-----------------------------------------------------------*/
+
+static bool isAvoided( const EndpointHealth_t * pEndpoint,
+                       uint32_t nowMs )
+{
+    /* The difference stays right across the wrap of the clock. */
+    return ( pEndpoint->failuresInRow > 0U ) &&
+           ( ( int32_t ) ( pEndpoint->avoidUntilMs - nowMs ) > 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t score( const EndpointHealth_t * pEndpoint )
+{
+    return pEndpoint->rttMs +
+           ( uint32_t ) ( ( ( uint64_t ) ENDPOINT_SET_FAILURE_PENALTY_MS * pEndpoint->failureRate ) / FAILURE_RATE_ONE );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t EndpointSet_Init( EndpointSet_t * pSet,
+                         char * pList )
+{
+    char * pName = pList;
+    char * pEnd = NULL;
+    char * pNext = NULL;
+
+    assert( ( pSet != NULL ) && ( pList != NULL ) );
+
+    ( void ) memset( pSet, 0, sizeof( *pSet ) );
+
+    while( pName != NULL )
+    {
+        pNext = strchr( pName, ',' );
+
+        if( pNext != NULL )
+        {
+            *pNext = '\0';
+            pNext++;
+        }
+
+        while( *pName == ' ' )
+        {
+            pName++;
+        }
+
+        pEnd = pName + strlen( pName );
+
+        while( ( pEnd > pName ) && ( pEnd[ -1 ] == ' ' ) )
+        {
+            pEnd--;
+        }
+
+        *pEnd = '\0';
+
+        if( ( pEnd > pName ) && ( pSet->count < ENDPOINT_SET_MAX_ENDPOINTS ) )
+        {
+            pSet->endpoints[ pSet->count ].pHostName = pName;
+            pSet->endpoints[ pSet->count ].hostNameLength = ( uint16_t ) ( pEnd - pName );
+            pSet->count++;
+        }
+        else if( pEnd > pName )
+        {
+            LogWarn( ( "Ignoring endpoint %s past the first %u.", pName, ( unsigned ) ENDPOINT_SET_MAX_ENDPOINTS ) );
+        }
+        else
+        {
+            /* Empty name. */
+        }
+
+        pName = pNext;
+    }
+
+    return pSet->count;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t EndpointSet_Select( const EndpointSet_t * pSet,
+                           bool * pAvoided )
+{
+    uint32_t nowMs = Clock_GetTimeMs();
+    const EndpointHealth_t * pEndpoint = NULL;
+    size_t best = 0U, soonest = 0U, i;
+    bool found = false;
+
+    assert( ( pSet != NULL ) && ( pSet->count > 0U ) && ( pAvoided != NULL ) );
+
+    for( i = 0U; i < pSet->count; i++ )
+    {
+        pEndpoint = &pSet->endpoints[ i ];
+
+        if( isAvoided( pEndpoint, nowMs ) == false )
+        {
+            if( ( found == false ) || ( score( pEndpoint ) < score( &pSet->endpoints[ best ] ) ) )
+            {
+                best = i;
+                found = true;
+            }
+        }
+        else if( ( int32_t ) ( pEndpoint->avoidUntilMs - pSet->endpoints[ soonest ].avoidUntilMs ) < 0 )
+        {
+            soonest = i;
+        }
+        else
+        {
+            /* Avoided for longer than another. */
+        }
+    }
+
+    *pAvoided = ( found == false );
+
+    return ( found == true ) ? best : soonest;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * EndpointSet_HostName( const EndpointSet_t * pSet,
+                                   size_t index )
+{
+    assert( ( pSet != NULL ) && ( index < pSet->count ) );
+
+    return pSet->endpoints[ index ].pHostName;
+}
+
+/*-----------------------------------------------------------*/
+
+void EndpointSet_ReportSuccess( EndpointSet_t * pSet,
+                                size_t index,
+                                uint32_t rttMs )
+{
+    EndpointHealth_t * pEndpoint = NULL;
+
+    assert( ( pSet != NULL ) && ( index < pSet->count ) );
+
+    pEndpoint = &pSet->endpoints[ index ];
+
+    /* Averages over about the last four attempts. The first measure replaces
+     * the score of 0 that had the endpoint tried. */
+    pEndpoint->rttMs = ( pEndpoint->measured == true ) ?
+                       ( ( ( pEndpoint->rttMs * 3U ) + rttMs ) / 4U ) : rttMs;
+    pEndpoint->failureRate -= pEndpoint->failureRate / 4U;
+    pEndpoint->failuresInRow = 0U;
+    pEndpoint->measured = true;
+
+    LogDebug( ( "Endpoint %s: handshake %u ms, score %u.",
+                pEndpoint->pHostName,
+                ( unsigned ) rttMs,
+                ( unsigned ) score( pEndpoint ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void EndpointSet_ReportFailure( EndpointSet_t * pSet,
+                                size_t index )
+{
+    EndpointHealth_t * pEndpoint = NULL;
+    uint32_t avoidMs = ENDPOINT_SET_QUARANTINE_BASE_MS;
+    uint32_t i;
+
+    assert( ( pSet != NULL ) && ( index < pSet->count ) );
+
+    pEndpoint = &pSet->endpoints[ index ];
+    pEndpoint->failureRate += ( FAILURE_RATE_ONE - pEndpoint->failureRate ) / 4U;
+    pEndpoint->failuresInRow++;
+
+    for( i = 1U; ( i < pEndpoint->failuresInRow ) && ( avoidMs < ENDPOINT_SET_QUARANTINE_MAX_MS ); i++ )
+    {
+        avoidMs *= 2U;
+    }
+
+    if( avoidMs > ENDPOINT_SET_QUARANTINE_MAX_MS )
+    {
+        avoidMs = ENDPOINT_SET_QUARANTINE_MAX_MS;
+    }
+
+    pEndpoint->avoidUntilMs = Clock_GetTimeMs() + avoidMs;
+
+    LogInfo( ( "Avoiding endpoint %s for %u ms after %u failure(s) in a row.",
+               pEndpoint->pHostName,
+               ( unsigned ) avoidMs,
+               ( unsigned ) pEndpoint->failuresInRow ) );
+}
+
+/*-----------------------------------------------------------*/
@@ -0,0 +1,159 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file endpoint_set.h
+ * @brief A set of broker endpoints scored by their health, to connect to the
+ * fastest healthy one and fail over after a single failed attempt.
+ *
+ * Each endpoint keeps an average of its TLS handshake times and of its
+ * recent failure rate; its score is the average time plus
+ * #ENDPOINT_SET_FAILURE_PENALTY_MS scaled by the failure rate. A failed
+ * endpoint is avoided for #ENDPOINT_SET_QUARANTINE_BASE_MS, doubling with
+ * each failure in a row, so the next attempt goes to another endpoint without
+ * waiting. Only once every endpoint is avoided does the caller need to back
+ * off. An endpoint never measured scores 0, so each is tried once, in the
+ * order of the list, before the scores decide.
+ *
+ * The set is not thread-safe.
+ */
+
+#ifndef ENDPOINT_SET_H_
+#define ENDPOINT_SET_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The most endpoints in a set.
+ */
+#ifndef ENDPOINT_SET_MAX_ENDPOINTS
+    #define ENDPOINT_SET_MAX_ENDPOINTS         CONFIG_ENDPOINT_SET_MAX_ENDPOINTS
+#endif
+
+/**
+ * @brief The score penalty of an endpoint that always fails, in milliseconds.
+ */
+#ifndef ENDPOINT_SET_FAILURE_PENALTY_MS
+    #define ENDPOINT_SET_FAILURE_PENALTY_MS    CONFIG_ENDPOINT_SET_FAILURE_PENALTY_MS
+#endif
+
+/**
+ * @brief The time an endpoint is avoided after a failure, and the longest
+ * after failures in a row, in milliseconds.
+ */
+#ifndef ENDPOINT_SET_QUARANTINE_BASE_MS
+    #define ENDPOINT_SET_QUARANTINE_BASE_MS    CONFIG_ENDPOINT_SET_QUARANTINE_BASE_MS
+#endif
+#ifndef ENDPOINT_SET_QUARANTINE_MAX_MS
+    #define ENDPOINT_SET_QUARANTINE_MAX_MS     CONFIG_ENDPOINT_SET_QUARANTINE_MAX_MS
+#endif
+
+/**
+ * @brief The health of one endpoint.
+ *
+ * The fields other than the host name are private to this module.
+ */
+typedef struct EndpointHealth
+{
+    const char * pHostName;        /**< @brief Host name, terminated. */
+    uint16_t hostNameLength;
+    uint32_t rttMs;                /* Average handshake time; 0 until measured. */
+    uint32_t failureRate;          /* Recent failure rate, in 1/256. */
+    uint32_t failuresInRow;
+    uint32_t avoidUntilMs;         /* Time the endpoint may be tried again. */
+    bool measured;
+} EndpointHealth_t;
+
+/**
+ * @brief A set of endpoints.
+ *
+ * The fields are private to this module.
+ */
+typedef struct EndpointSet
+{
+    EndpointHealth_t endpoints[ ENDPOINT_SET_MAX_ENDPOINTS ];
+    size_t count;
+} EndpointSet_t;
+
+/**
+ * @brief Sets up a set from a list of host names separated by commas, such
+ * as "primary-ats.iot.us-east-1.amazonaws.com,iot.example.com". Spaces
+ * around the names and empty names are skipped.
+ *
+ * @param[out] pSet The set to initialize.
+ * @param[in] pList The list. The set points into it, and replaces its commas
+ * with terminators, so it must outlive the set.
+ *
+ * @return The number of endpoints in the set.
+ */
+size_t EndpointSet_Init( EndpointSet_t * pSet,
+                         char * pList );
+
+/**
+ * @brief Picks the endpoint for the next attempt: the one with the lowest
+ * score among those not avoided, the earliest in the list on a tie.
+ *
+ * @param[in] pSet The set, of at least one endpoint.
+ * @param[out] pAvoided Set to true if every endpoint is avoided, in which
+ * case the one avoided for the shortest time left is picked and the caller
+ * should back off first.
+ *
+ * @return The index of the endpoint.
+ */
+size_t EndpointSet_Select( const EndpointSet_t * pSet,
+                           bool * pAvoided );
+
+/**
+ * @brief The host name of an endpoint.
+ */
+const char * EndpointSet_HostName( const EndpointSet_t * pSet,
+                                   size_t index );
+
+/**
+ * @brief Records a successful connection to an endpoint.
+ *
+ * @param[in] pSet The set.
+ * @param[in] index The endpoint.
+ * @param[in] rttMs The time the TLS handshake took, in milliseconds.
+ */
+void EndpointSet_ReportSuccess( EndpointSet_t * pSet,
+                                size_t index,
+                                uint32_t rttMs );
+
+/**
+ * @brief Records a failed connection to an endpoint, which is then avoided
+ * for a while.
+ *
+ * @param[in] pSet The set.
+ * @param[in] index The endpoint.
+ */
+void EndpointSet_ReportFailure( EndpointSet_t * pSet,
+                                size_t index );
+
+#endif /* ifndef ENDPOINT_SET_H_ */
@@ -0,0 +1,317 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file energy_meter.c
+ * @brief Implementation of the energy estimates of operations.
+ *
+ * The radio time and the totals are counters updated with relaxed atomic
+ * operations, so that any task can report radio time or end an operation
+ * without a lock. An operation reads the radio counters when it opens and
+ * when it ends, and is given the difference, capped at its own duration.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the energy meter. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Energy Meter"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "perf_metrics.h"
+
+#include "energy_meter.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The bytes in a megabyte, which OTA files are reported per.
+ */
+#define BYTES_PER_MB    ( 1024U * 1024U )
+
+/**
+ * @brief The microjoules drawn at @a milliamps for @a microseconds:
+ * millivolts times milliamps are microwatts, and microwatts times
+ * microseconds are picojoules.
+ */
+#define MICROJOULES( milliamps, microseconds )                                         \
+    ( ( ( uint64_t ) ENERGY_METER_SUPPLY_MV * ( uint64_t ) ( milliamps ) * ( microseconds ) ) \
+      / 1000000U )
+
+/**
+ * @brief The time the radio spent in each state.
+ */
+static uint64_t radioTimeUs[ EnergyRadioCount ];
+
+/**
+ * @brief The totals of each kind of operation.
+ */
+static uint32_t opCounts[ EnergyOpCount ];
+static uint64_t opEnergyUj[ EnergyOpCount ];
+static uint64_t opBytes[ EnergyOpCount ];
+
+/**
+ * @brief The names of the kinds of operation, for the log.
+ */
+static const char * const opNames[ EnergyOpCount ] =
+{
+    "handshake",
+    "publish",
+    "keep-alive",
+    "OTA file",
+    "flash write"
+};
+
+/* The energy of each operation, in microjoules, with buckets spanning the
+ * range each kind is expected in, and the total of each kind. */
+PERF_METRICS_HISTOGRAM( handshakeMetric, "energy_handshake_uj",
+                        30000U, 100000U, 300000U, 1000000U, 3000000U );
+PERF_METRICS_HISTOGRAM( publishMetric, "energy_publish_uj",
+                        100U, 300U, 1000U, 3000U, 10000U, 30000U );
+PERF_METRICS_HISTOGRAM( keepAliveMetric, "energy_keep_alive_uj",
+                        100U, 300U, 1000U, 3000U, 10000U, 30000U );
+PERF_METRICS_HISTOGRAM( otaMetric, "energy_ota_uj_per_mb",
+                        300000U, 1000000U, 3000000U, 10000000U, 30000000U );
+PERF_METRICS_HISTOGRAM( flashWriteMetric, "energy_flash_write_uj",
+                        30U, 100U, 300U, 1000U, 3000U, 10000U );
+PERF_METRICS_COUNTER( handshakeTotalMetric, "energy_handshake_total_uj" );
+PERF_METRICS_COUNTER( publishTotalMetric, "energy_publish_total_uj" );
+PERF_METRICS_COUNTER( keepAliveTotalMetric, "energy_keep_alive_total_uj" );
+PERF_METRICS_COUNTER( otaTotalMetric, "energy_ota_total_uj" );
+PERF_METRICS_COUNTER( flashWriteTotalMetric, "energy_flash_write_total_uj" );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Adds the energy of an operation to the metrics of its kind.
+ *
+ * @param[in] op The kind of operation.
+ * @param[in] energyUj The energy of the operation.
+ * @param[in] reportedUj The energy to observe in the histogram, per
+ * megabyte for OTA files.
+ */
+static void recordMetrics( EnergyOp_t op,
+                           uint64_t energyUj,
+                           uint64_t reportedUj );
+
+/*-----------------------------------------------------------*/
+
+#if PERF_METRICS_ENABLED
+
+    static void recordMetrics( EnergyOp_t op,
+                               uint64_t energyUj,
+                               uint64_t reportedUj )
+    {
+        static PerfMetric_t * const histograms[ EnergyOpCount ] =
+        {
+            &handshakeMetric, &publishMetric, &keepAliveMetric, &otaMetric, &flashWriteMetric
+        };
+        static PerfMetric_t * const totals[ EnergyOpCount ] =
+        {
+            &handshakeTotalMetric, &publishTotalMetric, &keepAliveTotalMetric, &otaTotalMetric,
+            &flashWriteTotalMetric
+        };
+
+        /* Registered on first use, so that kinds of operation a device never
+         * performs aren't exported. Registering again does nothing. */
+        PerfMetrics_Register( histograms[ op ] );
+        PerfMetrics_Register( totals[ op ] );
+
+        PerfMetrics_Observe( histograms[ op ], ( reportedUj > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) reportedUj );
+        PerfMetrics_Add( totals[ op ], ( uint32_t ) energyUj );
+    }
+
+#else /* if PERF_METRICS_ENABLED */
+
+    static void recordMetrics( EnergyOp_t op,
+                               uint64_t energyUj,
+                               uint64_t reportedUj )
+    {
+        ( void ) op;
+        ( void ) energyUj;
+        ( void ) reportedUj;
+    }
+
+#endif /* if PERF_METRICS_ENABLED */
+
+/*-----------------------------------------------------------*/
+
+EnergyScope_t EnergyMeter_Begin( EnergyOp_t op )
+{
+    EnergyScope_t scope = { 0 };
+    size_t radio;
+
+    assert( op < EnergyOpCount );
+
+    scope.op = op;
+
+    for( radio = 0U; radio < EnergyRadioCount; radio++ )
+    {
+        scope.radioStartUs[ radio ] = __atomic_load_n( &radioTimeUs[ radio ], __ATOMIC_RELAXED );
+    }
+
+    scope.cpuKnown = EnergyMeter_PortCpuTimeUs( &scope.cpuStartUs );
+    scope.measuredKnown = EnergyMeter_PortEnergyUj( &scope.measuredStartUj );
+    scope.startUs = Clock_GetTimeUs();
+
+    return scope;
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t EnergyMeter_End( EnergyScope_t * pScope,
+                          size_t bytes )
+{
+    uint64_t durationUs = Clock_GetTimeUs() - pScope->startUs;
+    uint64_t radioUs[ EnergyRadioCount ];
+    uint64_t cpuUs = durationUs;
+    uint64_t measuredUj = 0U;
+    uint64_t energyUj;
+    uint64_t reportedUj;
+    uint32_t cpuEndUs = 0U;
+    size_t radio;
+
+    assert( ( pScope != NULL ) && ( pScope->op < EnergyOpCount ) );
+
+    for( radio = 0U; radio < EnergyRadioCount; radio++ )
+    {
+        radioUs[ radio ] = __atomic_load_n( &radioTimeUs[ radio ], __ATOMIC_RELAXED ) -
+                           pScope->radioStartUs[ radio ];
+
+        /* Other operations may have used the radio at the same time. */
+        if( radioUs[ radio ] > durationUs )
+        {
+            radioUs[ radio ] = durationUs;
+        }
+    }
+
+    if( pScope->cpuKnown && EnergyMeter_PortCpuTimeUs( &cpuEndUs ) )
+    {
+        cpuUs = ( uint32_t ) ( cpuEndUs - pScope->cpuStartUs );
+    }
+
+    if( pScope->measuredKnown && EnergyMeter_PortEnergyUj( &measuredUj ) &&
+        ( measuredUj >= pScope->measuredStartUj ) )
+    {
+        energyUj = measuredUj - pScope->measuredStartUj;
+    }
+    else
+    {
+        energyUj = MICROJOULES( ENERGY_METER_RADIO_TX_MA, radioUs[ EnergyRadioTx ] ) +
+                   MICROJOULES( ENERGY_METER_RADIO_RX_MA, radioUs[ EnergyRadioRx ] ) +
+                   MICROJOULES( ENERGY_METER_CPU_MA, cpuUs );
+    }
+
+    reportedUj = energyUj;
+
+    if( ( pScope->op == EnergyOpOta ) && ( bytes > 0U ) )
+    {
+        reportedUj = ( energyUj * BYTES_PER_MB ) / bytes;
+    }
+
+    ( void ) __atomic_add_fetch( &opCounts[ pScope->op ], 1U, __ATOMIC_RELAXED );
+    ( void ) __atomic_add_fetch( &opEnergyUj[ pScope->op ], energyUj, __ATOMIC_RELAXED );
+    ( void ) __atomic_add_fetch( &opBytes[ pScope->op ], ( uint64_t ) bytes, __ATOMIC_RELAXED );
+
+    recordMetrics( pScope->op, energyUj, reportedUj );
+
+    LogDebug( ( "%s: %llu uJ in %llu us, tx %llu us, rx %llu us, cpu %llu us.",
+                opNames[ pScope->op ],
+                ( unsigned long long ) energyUj,
+                ( unsigned long long ) durationUs,
+                ( unsigned long long ) radioUs[ EnergyRadioTx ],
+                ( unsigned long long ) radioUs[ EnergyRadioRx ],
+                ( unsigned long long ) cpuUs ) );
+
+    return energyUj;
+}
+
+/*-----------------------------------------------------------*/
+
+void EnergyMeter_AddRadioTime( EnergyRadio_t radio,
+                               uint64_t durationUs )
+{
+    assert( radio < EnergyRadioCount );
+
+    ( void ) __atomic_add_fetch( &radioTimeUs[ radio ], durationUs, __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+void EnergyMeter_Read( EnergyOp_t op,
+                       EnergyTotals_t * pTotals )
+{
+    assert( ( op < EnergyOpCount ) && ( pTotals != NULL ) );
+
+    pTotals->count = __atomic_load_n( &opCounts[ op ], __ATOMIC_RELAXED );
+    pTotals->energyUj = __atomic_load_n( &opEnergyUj[ op ], __ATOMIC_RELAXED );
+    pTotals->bytes = __atomic_load_n( &opBytes[ op ], __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+void EnergyMeter_Dump( void )
+{
+    EnergyTotals_t totals;
+    uint64_t meanUj;
+    size_t op;
+
+    for( op = 0U; op < EnergyOpCount; op++ )
+    {
+        EnergyMeter_Read( ( EnergyOp_t ) op, &totals );
+
+        if( totals.count == 0U )
+        {
+            continue;
+        }
+
+        if( op == EnergyOpOta )
+        {
+            meanUj = ( totals.bytes > 0U ) ? ( ( totals.energyUj * BYTES_PER_MB ) / totals.bytes ) : 0U;
+        }
+        else
+        {
+            meanUj = totals.energyUj / totals.count;
+        }
+
+        LogInfo( ( "%-12s %6lu ops, %10llu uJ, %8llu uJ %s.",
+                   opNames[ op ],
+                   ( unsigned long ) totals.count,
+                   ( unsigned long long ) totals.energyUj,
+                   ( unsigned long long ) meanUj,
+                   ( op == EnergyOpOta ) ? "per MB" : "each" ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
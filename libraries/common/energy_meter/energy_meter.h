@@ -0,0 +1,233 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file energy_meter.h
+ * @brief Estimate the energy, in microjoules, that each kind of operation
+ * takes: TLS handshakes, publishes, keep-alive pings, OTA files and flash
+ * writes.
+ *
+ * An operation is measured from ENERGY_METER_BEGIN to ENERGY_METER_END, on
+ * one task. Its energy is estimated from the time the radio was transmitting
+ * and receiving, which the transport reports with ENERGY_METER_RADIO around
+ * its calls, and the CPU time of the task, from the port, each at the current
+ * drawn in that state:
+ *
+ *     E = V * ( I_tx * t_tx + I_rx * t_rx + I_cpu * t_cpu )
+ *
+ * Radio time is counted for the whole device, so operations that overlap on
+ * different tasks are each given the radio time of both. Where the port reads
+ * an external power monitor, as the POSIX port can, the energy it measured
+ * over the operation is used in place of the estimate.
+ *
+ * The energy of each operation is observed in a histogram of the performance
+ * metrics, and added to a counter of the total, so that a change in the
+ * energy of an operation shows in the metrics the way a change in latency
+ * does. OTA files are reported per megabyte received.
+ *
+ * With ENERGY_METER_ENABLED set to 0, the macros expand to nothing, and their
+ * arguments aren't evaluated. On ESP-IDF it follows
+ * CONFIG_ENERGY_METER_ENABLE; other builds define it.
+ */
+
+#ifndef ENERGY_METER_H_
+#define ENERGY_METER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+/**
+ * @brief Whether energy is estimated.
+ */
+#ifndef ENERGY_METER_ENABLED
+    #if CONFIG_ENERGY_METER_ENABLE
+        #define ENERGY_METER_ENABLED    1
+    #else
+        #define ENERGY_METER_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief The supply voltage, in millivolts, and the currents drawn, in
+ * milliamps, by the radio transmitting and receiving and by a busy CPU.
+ * The defaults are those of the ESP32 datasheet with Wi-Fi.
+ */
+#ifndef ENERGY_METER_SUPPLY_MV
+    #ifdef CONFIG_ENERGY_METER_SUPPLY_MV
+        #define ENERGY_METER_SUPPLY_MV    CONFIG_ENERGY_METER_SUPPLY_MV
+    #else
+        #define ENERGY_METER_SUPPLY_MV    3300
+    #endif
+#endif
+
+#ifndef ENERGY_METER_RADIO_TX_MA
+    #ifdef CONFIG_ENERGY_METER_RADIO_TX_MA
+        #define ENERGY_METER_RADIO_TX_MA    CONFIG_ENERGY_METER_RADIO_TX_MA
+    #else
+        #define ENERGY_METER_RADIO_TX_MA    190
+    #endif
+#endif
+
+#ifndef ENERGY_METER_RADIO_RX_MA
+    #ifdef CONFIG_ENERGY_METER_RADIO_RX_MA
+        #define ENERGY_METER_RADIO_RX_MA    CONFIG_ENERGY_METER_RADIO_RX_MA
+    #else
+        #define ENERGY_METER_RADIO_RX_MA    100
+    #endif
+#endif
+
+#ifndef ENERGY_METER_CPU_MA
+    #ifdef CONFIG_ENERGY_METER_CPU_MA
+        #define ENERGY_METER_CPU_MA    CONFIG_ENERGY_METER_CPU_MA
+    #else
+        #define ENERGY_METER_CPU_MA    40
+    #endif
+#endif
+
+/**
+ * @brief The kinds of operation measured.
+ */
+typedef enum EnergyOp
+{
+    EnergyOpHandshake,  /**< A TLS handshake, successful or not. */
+    EnergyOpPublish,    /**< Sending a publish. */
+    EnergyOpKeepAlive,  /**< Sending a keep-alive ping. */
+    EnergyOpOta,        /**< Receiving an OTA file, reported per megabyte. */
+    EnergyOpFlashWrite, /**< Writing a block to flash. */
+    EnergyOpCount
+} EnergyOp_t;
+
+/**
+ * @brief The states of the radio.
+ */
+typedef enum EnergyRadio
+{
+    EnergyRadioTx, /**< Transmitting. */
+    EnergyRadioRx, /**< Receiving, or listening for data. */
+    EnergyRadioCount
+} EnergyRadio_t;
+
+/**
+ * @brief An operation being measured.
+ *
+ * The fields are private to this module.
+ */
+typedef struct EnergyScope
+{
+    EnergyOp_t op;
+    uint64_t startUs;
+    uint64_t radioStartUs[ EnergyRadioCount ];
+    uint32_t cpuStartUs;
+    bool cpuKnown;
+    uint64_t measuredStartUj;
+    bool measuredKnown;
+} EnergyScope_t;
+
+/**
+ * @brief The operations of a kind measured so far.
+ */
+typedef struct EnergyTotals
+{
+    uint32_t count;    /**< The operations that ended. */
+    uint64_t energyUj; /**< Their energy. */
+    uint64_t bytes;    /**< The bytes they gave, for OTA files. */
+} EnergyTotals_t;
+
+#if ENERGY_METER_ENABLED
+
+/**
+ * @brief Opens the operation @a scope, of the kind @a op, to be ended by
+ * ENERGY_METER_END in the same block.
+ */
+    #define ENERGY_METER_BEGIN( scope, op )            EnergyScope_t scope = EnergyMeter_Begin( op )
+    #define ENERGY_METER_END( scope, bytes )           EnergyMeter_End( &( scope ), ( bytes ) )
+    #define ENERGY_METER_RADIO( radio, durationUs )    EnergyMeter_AddRadioTime( ( radio ), ( durationUs ) )
+
+#else /* if ENERGY_METER_ENABLED */
+
+    /* A declaration, so that the operation can open before the declarations
+     * of a block. */
+    #define ENERGY_METER_BEGIN( scope, op )            extern int scope ## Disabled __attribute__( ( unused ) )
+    #define ENERGY_METER_END( scope, bytes )           do {} while( 0 )
+    #define ENERGY_METER_RADIO( radio, durationUs )    do {} while( 0 )
+
+#endif /* if ENERGY_METER_ENABLED */
+
+/**
+ * @brief Opens an operation on the calling task.
+ *
+ * @param[in] op The kind of operation.
+ *
+ * @return The operation, to pass to #EnergyMeter_End.
+ */
+EnergyScope_t EnergyMeter_Begin( EnergyOp_t op );
+
+/**
+ * @brief Ends an operation, on the task that opened it, and records its
+ * energy.
+ *
+ * @param[in] pScope An operation returned by #EnergyMeter_Begin.
+ * @param[in] bytes The bytes the operation moved. An OTA file is reported
+ * per megabyte of them; other kinds ignore them.
+ *
+ * @return The energy of the operation, in microjoules.
+ */
+uint64_t EnergyMeter_End( EnergyScope_t * pScope,
+                          size_t bytes );
+
+/**
+ * @brief Counts time the radio spent transmitting or receiving.
+ */
+void EnergyMeter_AddRadioTime( EnergyRadio_t radio,
+                               uint64_t durationUs );
+
+/**
+ * @brief Reads the totals of a kind of operation.
+ */
+void EnergyMeter_Read( EnergyOp_t op,
+                       EnergyTotals_t * pTotals );
+
+/**
+ * @brief Logs the totals and the mean energy of each kind of operation.
+ */
+void EnergyMeter_Dump( void );
+
+/**
+ * @brief The port functions, called by energy_meter.c.
+ *
+ * #EnergyMeter_PortCpuTimeUs gives the CPU time of the calling task, in
+ * microseconds, wrapping at 32 bits. #EnergyMeter_PortEnergyUj gives the
+ * energy an external monitor measured since some fixed time. Each returns
+ * false if the port can't tell, in which case the time of the operation is
+ * taken as CPU time, and the energy is estimated.
+ */
+bool EnergyMeter_PortCpuTimeUs( uint32_t * pTimeUs );
+bool EnergyMeter_PortEnergyUj( uint64_t * pEnergyUj );
+
+#endif /* ifndef ENERGY_METER_H_ */
@@ -0,0 +1,75 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file energy_meter_esp.c
+ * @brief The ESP-IDF port of the energy meter.
+ *
+ * The CPU time of a task comes from the FreeRTOS run time statistics, when
+ * they are kept and counted in microseconds with esp_timer. There is no
+ * power monitor on the device, so energy is always estimated.
+ */
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "energy_meter.h"
+
+/**
+ * @brief Whether the run time of a task is kept, in microseconds.
+ */
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY && \
+    CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER
+    #define TASK_RUN_TIME_US    1
+#else
+    #define TASK_RUN_TIME_US    0
+#endif
+
+/*-----------------------------------------------------------*/
+
+bool EnergyMeter_PortCpuTimeUs( uint32_t * pTimeUs )
+{
+    #if TASK_RUN_TIME_US
+        TaskStatus_t status;
+
+        /* Without the stack high-water mark or the state, which take a walk
+         * of the stack and of the lists. */
+        vTaskGetInfo( NULL, &status, pdFALSE, eRunning );
+        *pTimeUs = ( uint32_t ) status.ulRunTimeCounter;
+
+        return true;
+    #else
+        ( void ) pTimeUs;
+
+        return false;
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+bool EnergyMeter_PortEnergyUj( uint64_t * pEnergyUj )
+{
+    ( void ) pEnergyUj;
+
+    return false;
+}
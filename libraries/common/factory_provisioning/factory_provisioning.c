@@ -0,0 +1,795 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file factory_provisioning.c
+ * @brief Implementation of the factory provisioning station mode.
+ *
+ * A bundle is received whole into one buffer, checked, and parsed twice:
+ * once to validate every record before anything is stored, and once to
+ * store them. The values are then read back from storage over the values in
+ * the buffer, which is hashed in place for the reply.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the factory provisioning. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Factory Provisioning"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "factory_provisioning.h"
+
+#if FACTORY_PROVISIONING_ENABLED
+
+/* The port the station is on. */
+    #if CONFIG_FACTORY_PROVISIONING_PORT_USB_SERIAL_JTAG
+        #include "driver/usb_serial_jtag.h"
+    #else
+        #include "driver/uart.h"
+    #endif
+
+/* PKCS #11 includes. */
+    #include "core_pkcs11.h"
+    #include "core_pkcs11_pal.h"
+    #include "core_pkcs11_pal_transaction.h"
+
+/* SHA-256 of the records read back. */
+    #include "mbedtls/sha256.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The magic numbers of the bundle, of the reply and of the unit
+ * waiting, "FPB1", "FPR1" and "FPW1" in memory.
+ */
+    #define BUNDLE_MAGIC           ( 0x31425046UL )
+    #define REPLY_MAGIC            ( 0x31525046UL )
+    #define WAITING_MAGIC          ( 0x31575046UL )
+
+/**
+ * @brief The sizes of the parts of the frames.
+ */
+    #define BUNDLE_HEADER_SIZE     ( 8U )
+    #define CRC_SIZE               ( 4U )
+    #define RECORD_HEADER_SIZE     ( 4U )
+    #define DIGEST_SIZE            ( 32U )
+    #define REPLY_SIZE             ( 8U + DIGEST_SIZE + CRC_SIZE )
+
+/**
+ * @brief The kinds of records.
+ */
+    #define RECORD_PKCS11_OBJECT   ( 1U )
+    #define RECORD_CONFIG_VALUE    ( 2U )
+
+/**
+ * @brief The longest PKCS #11 label of a record.
+ */
+    #define MAX_LABEL_LENGTH       ( 32U )
+
+/**
+ * @brief The longest NVS key, without its terminator.
+ */
+    #define MAX_KEY_LENGTH         ( NVS_KEY_NAME_MAX_SIZE - 1U )
+
+    #if CONFIG_FACTORY_PROVISIONING_PORT_USB_SERIAL_JTAG
+
+/**
+ * @brief The buffers of the USB Serial/JTAG driver.
+ */
+        #define PORT_RX_BUFFER_SIZE    ( 1024U )
+        #define PORT_TX_BUFFER_SIZE    ( 256U )
+    #else
+
+/**
+ * @brief The UART the station is on, and the receive buffer of its driver.
+ */
+        #define PORT_UART              ( ( uart_port_t ) CONFIG_FACTORY_PROVISIONING_UART_NUM )
+        #define PORT_RX_BUFFER_SIZE    ( 4096U )
+    #endif
+
+/**
+ * @brief A record of the payload.
+ */
+    typedef struct Record
+    {
+        uint8_t kind;
+        const char * pName;
+        size_t nameLength;
+        uint8_t * pValue;
+        size_t valueLength;
+    } Record_t;
+
+    #if !CONFIG_FACTORY_PROVISIONING_PORT_USB_SERIAL_JTAG
+
+/**
+ * @brief Whether the UART driver was installed here, and is removed when
+ * done.
+ */
+        static bool uartInstalled = false;
+    #endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Installs the driver of the port.
+ */
+    static bool portOpen( void );
+
+/**
+ * @brief Removes the driver of the port, if it was installed by #portOpen.
+ */
+    static void portClose( void );
+
+/**
+ * @brief Reads up to @a length bytes.
+ *
+ * @return The bytes read, 0 if none came for @a timeoutMs.
+ */
+    static size_t portRead( uint8_t * pBuffer,
+                            size_t length,
+                            uint32_t timeoutMs );
+
+/**
+ * @brief Writes all of @a length bytes.
+ */
+    static void portWrite( const uint8_t * pBuffer,
+                           size_t length );
+
+/**
+ * @brief Drops the bytes received but not read.
+ */
+    static void portFlush( void );
+
+/**
+ * @brief Reads exactly @a length bytes, each within the byte timeout.
+ */
+    static bool readExact( uint8_t * pBuffer,
+                           size_t length );
+
+/**
+ * @brief Waits for the magic of a bundle, skipping anything else.
+ *
+ * @return false if no magic came for @a waitMs.
+ */
+    static bool waitForMagic( uint32_t waitMs );
+
+/**
+ * @brief Reads a little-endian integer.
+ */
+    static uint32_t readLe32( const uint8_t * pBytes );
+    static uint16_t readLe16( const uint8_t * pBytes );
+
+/**
+ * @brief Writes a little-endian integer.
+ */
+    static void writeLe32( uint8_t * pBytes,
+                           uint32_t value );
+
+/**
+ * @brief Takes the next record of a payload.
+ *
+ * @param[in] pPayload The payload.
+ * @param[in] payloadLength The length of @a pPayload.
+ * @param[in,out] pOffset The offset of the record, then of the next one.
+ * @param[out] pRecord The record.
+ *
+ * @return false if the record overruns the payload, or has an unknown kind
+ * or a name too short or too long.
+ */
+    static bool nextRecord( uint8_t * pPayload,
+                            size_t payloadLength,
+                            size_t * pOffset,
+                            Record_t * pRecord );
+
+/**
+ * @brief Stores every record of a validated payload.
+ */
+    static FactoryProvisioningStatus_t storeRecords( uint8_t * pPayload,
+                                                     size_t payloadLength );
+
+/**
+ * @brief Reads every record back from storage over its value, and hashes
+ * the payload.
+ */
+    static FactoryProvisioningStatus_t readBackRecords( uint8_t * pPayload,
+                                                        size_t payloadLength,
+                                                        uint8_t * pDigest );
+
+/**
+ * @brief Receives, stores and acknowledges one bundle.
+ */
+    static FactoryProvisioningStatus_t receiveBundle( uint8_t * pPayload );
+
+/**
+ * @brief Sends the reply to a bundle.
+ */
+    static void sendReply( FactoryProvisioningStatus_t status,
+                           const uint8_t * pDigest );
+
+/*-----------------------------------------------------------*/
+
+    #if CONFIG_FACTORY_PROVISIONING_PORT_USB_SERIAL_JTAG
+
+        static bool portOpen( void )
+        {
+            usb_serial_jtag_driver_config_t config =
+            {
+                .rx_buffer_size = PORT_RX_BUFFER_SIZE,
+                .tx_buffer_size = PORT_TX_BUFFER_SIZE
+            };
+
+            return usb_serial_jtag_driver_install( &config ) == ESP_OK;
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void portClose( void )
+        {
+            ( void ) usb_serial_jtag_driver_uninstall();
+        }
+
+/*-----------------------------------------------------------*/
+
+        static size_t portRead( uint8_t * pBuffer,
+                                size_t length,
+                                uint32_t timeoutMs )
+        {
+            int bytesRead = usb_serial_jtag_read_bytes( pBuffer, length, pdMS_TO_TICKS( timeoutMs ) );
+
+            return ( bytesRead > 0 ) ? ( size_t ) bytesRead : 0U;
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void portWrite( const uint8_t * pBuffer,
+                               size_t length )
+        {
+            ( void ) usb_serial_jtag_write_bytes( pBuffer, length, portMAX_DELAY );
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void portFlush( void )
+        {
+            uint8_t discard[ 64 ];
+
+            while( portRead( discard, sizeof( discard ), 0U ) > 0U )
+            {
+            }
+        }
+
+    #else /* if CONFIG_FACTORY_PROVISIONING_PORT_USB_SERIAL_JTAG */
+
+        static bool portOpen( void )
+        {
+            uart_config_t config =
+            {
+                .baud_rate = CONFIG_FACTORY_PROVISIONING_UART_BAUD,
+                .data_bits = UART_DATA_8_BITS,
+                .parity = UART_PARITY_DISABLE,
+                .stop_bits = UART_STOP_BITS_1,
+                .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+                .source_clk = UART_SCLK_APB
+            };
+            bool opened = true;
+
+            /* The console may have installed the driver of UART0 already. */
+            if( uart_is_driver_installed( PORT_UART ) == false )
+            {
+                opened = ( uart_driver_install( PORT_UART, PORT_RX_BUFFER_SIZE, 0, 0, NULL, 0 ) == ESP_OK );
+                uartInstalled = opened;
+            }
+
+            return opened && ( uart_param_config( PORT_UART, &config ) == ESP_OK );
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void portClose( void )
+        {
+            ( void ) uart_wait_tx_done( PORT_UART, portMAX_DELAY );
+
+            if( uartInstalled == true )
+            {
+                ( void ) uart_driver_delete( PORT_UART );
+                uartInstalled = false;
+            }
+        }
+
+/*-----------------------------------------------------------*/
+
+        static size_t portRead( uint8_t * pBuffer,
+                                size_t length,
+                                uint32_t timeoutMs )
+        {
+            int bytesRead = uart_read_bytes( PORT_UART, pBuffer, length, pdMS_TO_TICKS( timeoutMs ) );
+
+            return ( bytesRead > 0 ) ? ( size_t ) bytesRead : 0U;
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void portWrite( const uint8_t * pBuffer,
+                               size_t length )
+        {
+            ( void ) uart_write_bytes( PORT_UART, pBuffer, length );
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void portFlush( void )
+        {
+            ( void ) uart_flush_input( PORT_UART );
+        }
+
+    #endif /* if CONFIG_FACTORY_PROVISIONING_PORT_USB_SERIAL_JTAG */
+
+/*-----------------------------------------------------------*/
+
+    static bool readExact( uint8_t * pBuffer,
+                           size_t length )
+    {
+        size_t received = 0U;
+        size_t bytesRead = 1U;
+
+        while( ( received < length ) && ( bytesRead > 0U ) )
+        {
+            bytesRead = portRead( &pBuffer[ received ], length - received, FACTORY_PROVISIONING_BYTE_TIMEOUT_MS );
+            received += bytesRead;
+        }
+
+        return received == length;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool waitForMagic( uint32_t waitMs )
+    {
+        TickType_t start = xTaskGetTickCount();
+        TickType_t waitTicks = pdMS_TO_TICKS( waitMs );
+        TickType_t elapsed = 0U;
+        uint32_t window = 0U;
+        uint8_t byte = 0U;
+
+        /* The bytes are shifted in from the top, so the window reads as the
+         * last four bytes in memory order. */
+        while( ( window != BUNDLE_MAGIC ) && ( elapsed < waitTicks ) )
+        {
+            if( portRead( &byte, 1U, ( uint32_t ) ( waitTicks - elapsed ) * portTICK_PERIOD_MS ) > 0U )
+            {
+                window = ( window >> 8 ) | ( ( uint32_t ) byte << 24 );
+            }
+
+            elapsed = xTaskGetTickCount() - start;
+        }
+
+        return window == BUNDLE_MAGIC;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t readLe32( const uint8_t * pBytes )
+    {
+        return ( uint32_t ) pBytes[ 0 ] | ( ( uint32_t ) pBytes[ 1 ] << 8 ) |
+               ( ( uint32_t ) pBytes[ 2 ] << 16 ) | ( ( uint32_t ) pBytes[ 3 ] << 24 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static uint16_t readLe16( const uint8_t * pBytes )
+    {
+        return ( uint16_t ) ( pBytes[ 0 ] | ( pBytes[ 1 ] << 8 ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void writeLe32( uint8_t * pBytes,
+                           uint32_t value )
+    {
+        pBytes[ 0 ] = ( uint8_t ) value;
+        pBytes[ 1 ] = ( uint8_t ) ( value >> 8 );
+        pBytes[ 2 ] = ( uint8_t ) ( value >> 16 );
+        pBytes[ 3 ] = ( uint8_t ) ( value >> 24 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool nextRecord( uint8_t * pPayload,
+                            size_t payloadLength,
+                            size_t * pOffset,
+                            Record_t * pRecord )
+    {
+        size_t offset = *pOffset;
+        bool valid = ( payloadLength - offset ) >= RECORD_HEADER_SIZE;
+
+        if( valid == true )
+        {
+            pRecord->kind = pPayload[ offset ];
+            pRecord->nameLength = pPayload[ offset + 1U ];
+            pRecord->valueLength = readLe16( &pPayload[ offset + 2U ] );
+            offset += RECORD_HEADER_SIZE;
+
+            valid = ( ( payloadLength - offset ) >= pRecord->nameLength ) &&
+                    ( ( payloadLength - offset - pRecord->nameLength ) >= pRecord->valueLength ) &&
+                    ( pRecord->nameLength > 0U ) &&
+                    ( ( ( pRecord->kind == RECORD_PKCS11_OBJECT ) && ( pRecord->nameLength <= MAX_LABEL_LENGTH ) &&
+                        ( pRecord->valueLength > 0U ) ) ||
+                      ( ( pRecord->kind == RECORD_CONFIG_VALUE ) && ( pRecord->nameLength <= MAX_KEY_LENGTH ) ) );
+        }
+
+        if( valid == true )
+        {
+            pRecord->pName = ( const char * ) &pPayload[ offset ];
+            pRecord->pValue = &pPayload[ offset + pRecord->nameLength ];
+            *pOffset = offset + pRecord->nameLength + pRecord->valueLength;
+        }
+
+        return valid;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static FactoryProvisioningStatus_t storeRecords( uint8_t * pPayload,
+                                                     size_t payloadLength )
+    {
+        FactoryProvisioningStatus_t status = FactoryProvisioningSuccess;
+        CK_ATTRIBUTE label = { .type = CKA_LABEL };
+        nvs_handle_t configHandle = 0;
+        bool configOpen = false;
+        char key[ NVS_KEY_NAME_MAX_SIZE ];
+        Record_t record;
+        size_t offset = 0U;
+
+        if( ( PKCS11_PAL_Initialize() != CKR_OK ) || ( PKCS11_PAL_BeginTransaction() != CKR_OK ) )
+        {
+            LogError( ( "Failed to start a PKCS #11 transaction." ) );
+            status = FactoryProvisioningStoreFailed;
+        }
+
+        while( ( status == FactoryProvisioningSuccess ) && ( offset < payloadLength ) )
+        {
+            /* Validated before, so every record is taken. */
+            ( void ) nextRecord( pPayload, payloadLength, &offset, &record );
+
+            if( record.kind == RECORD_PKCS11_OBJECT )
+            {
+                label.pValue = ( void * ) record.pName;
+                label.ulValueLen = record.nameLength;
+
+                if( PKCS11_PAL_SaveObject( &label, record.pValue, record.valueLength ) == CK_INVALID_HANDLE )
+                {
+                    LogError( ( "Failed to save the object %.*s.", ( int ) record.nameLength, record.pName ) );
+                    status = FactoryProvisioningStoreFailed;
+                }
+            }
+            else
+            {
+                if( configOpen == false )
+                {
+                    configOpen = ( nvs_open( FACTORY_PROVISIONING_NVS_NAMESPACE, NVS_READWRITE, &configHandle ) == ESP_OK );
+                }
+
+                ( void ) memcpy( key, record.pName, record.nameLength );
+                key[ record.nameLength ] = '\0';
+
+                if( ( configOpen == false ) ||
+                    ( nvs_set_blob( configHandle, key, record.pValue, record.valueLength ) != ESP_OK ) )
+                {
+                    LogError( ( "Failed to store the value %s.", key ) );
+                    status = FactoryProvisioningStoreFailed;
+                }
+            }
+        }
+
+        /* The values are committed first, so that a unit with the objects
+         * of the bundle always has its configuration too. */
+        if( ( status == FactoryProvisioningSuccess ) && ( configOpen == true ) &&
+            ( nvs_commit( configHandle ) != ESP_OK ) )
+        {
+            LogError( ( "Failed to commit the configuration values." ) );
+            status = FactoryProvisioningStoreFailed;
+        }
+
+        if( configOpen == true )
+        {
+            nvs_close( configHandle );
+        }
+
+        if( status == FactoryProvisioningSuccess )
+        {
+            if( PKCS11_PAL_CommitTransaction( NULL ) != CKR_OK )
+            {
+                LogError( ( "Failed to commit the PKCS #11 objects." ) );
+                status = FactoryProvisioningStoreFailed;
+            }
+        }
+        else
+        {
+            PKCS11_PAL_AbortTransaction();
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static FactoryProvisioningStatus_t readBackRecords( uint8_t * pPayload,
+                                                        size_t payloadLength,
+                                                        uint8_t * pDigest )
+    {
+        FactoryProvisioningStatus_t status = FactoryProvisioningSuccess;
+        mbedtls_sha256_context sha;
+        CK_OBJECT_HANDLE handle = CK_INVALID_HANDLE;
+        CK_BYTE_PTR pData = NULL;
+        CK_ULONG dataLength = 0;
+        CK_BBOOL isPrivate = CK_FALSE;
+        nvs_handle_t configHandle = 0;
+        bool configOpen = false;
+        char key[ NVS_KEY_NAME_MAX_SIZE ];
+        size_t valueLength = 0U;
+        Record_t record;
+        size_t offset = 0U;
+
+        while( ( status == FactoryProvisioningSuccess ) && ( offset < payloadLength ) )
+        {
+            ( void ) nextRecord( pPayload, payloadLength, &offset, &record );
+
+            if( record.kind == RECORD_PKCS11_OBJECT )
+            {
+                handle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) record.pName, record.nameLength );
+
+                if( ( handle == CK_INVALID_HANDLE ) ||
+                    ( PKCS11_PAL_GetObjectValue( handle, &pData, &dataLength, &isPrivate ) != CKR_OK ) )
+                {
+                    status = FactoryProvisioningStoreFailed;
+                }
+                else
+                {
+                    /* A different length fails the digest as well. */
+                    if( dataLength == record.valueLength )
+                    {
+                        ( void ) memcpy( record.pValue, pData, dataLength );
+                    }
+                    else
+                    {
+                        status = FactoryProvisioningStoreFailed;
+                    }
+
+                    PKCS11_PAL_GetObjectValueCleanup( pData, dataLength );
+                }
+            }
+            else
+            {
+                if( configOpen == false )
+                {
+                    configOpen = ( nvs_open( FACTORY_PROVISIONING_NVS_NAMESPACE, NVS_READONLY, &configHandle ) == ESP_OK );
+                }
+
+                ( void ) memcpy( key, record.pName, record.nameLength );
+                key[ record.nameLength ] = '\0';
+                valueLength = record.valueLength;
+
+                if( ( configOpen == false ) ||
+                    ( nvs_get_blob( configHandle, key, record.pValue, &valueLength ) != ESP_OK ) ||
+                    ( valueLength != record.valueLength ) )
+                {
+                    status = FactoryProvisioningStoreFailed;
+                }
+            }
+
+            if( status != FactoryProvisioningSuccess )
+            {
+                LogError( ( "The record %.*s doesn't read back as it was sent.",
+                            ( int ) record.nameLength, record.pName ) );
+            }
+        }
+
+        if( configOpen == true )
+        {
+            nvs_close( configHandle );
+        }
+
+        mbedtls_sha256_init( &sha );
+        ( void ) mbedtls_sha256_starts_ret( &sha, 0 );
+        ( void ) mbedtls_sha256_update_ret( &sha, pPayload, payloadLength );
+        ( void ) mbedtls_sha256_finish_ret( &sha, pDigest );
+        mbedtls_sha256_free( &sha );
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static FactoryProvisioningStatus_t receiveBundle( uint8_t * pPayload )
+    {
+        FactoryProvisioningStatus_t status = FactoryProvisioningSuccess;
+        uint8_t header[ BUNDLE_HEADER_SIZE ];
+        uint8_t crc[ CRC_SIZE ];
+        uint8_t digest[ DIGEST_SIZE ] = { 0 };
+        int64_t startUs = esp_timer_get_time();
+        size_t payloadLength = 0U;
+        size_t offset = 0U;
+        Record_t record;
+
+        /* The magic was just read. */
+        writeLe32( header, BUNDLE_MAGIC );
+
+        if( readExact( &header[ 4 ], sizeof( header ) - 4U ) == false )
+        {
+            status = FactoryProvisioningBadCrc;
+        }
+        else
+        {
+            payloadLength = readLe32( &header[ 4 ] );
+
+            if( payloadLength > FACTORY_PROVISIONING_MAX_PAYLOAD )
+            {
+                status = FactoryProvisioningTooLarge;
+            }
+            else if( ( readExact( pPayload, payloadLength ) == false ) ||
+                     ( readExact( crc, sizeof( crc ) ) == false ) ||
+                     ( esp_rom_crc32_le( esp_rom_crc32_le( 0U, header, sizeof( header ) ), pPayload, payloadLength ) !=
+                       readLe32( crc ) ) )
+            {
+                status = FactoryProvisioningBadCrc;
+            }
+            else
+            {
+                while( ( status == FactoryProvisioningSuccess ) && ( offset < payloadLength ) )
+                {
+                    if( nextRecord( pPayload, payloadLength, &offset, &record ) == false )
+                    {
+                        status = FactoryProvisioningBadBundle;
+                    }
+                }
+            }
+        }
+
+        if( status == FactoryProvisioningSuccess )
+        {
+            status = storeRecords( pPayload, payloadLength );
+        }
+
+        if( status == FactoryProvisioningSuccess )
+        {
+            status = readBackRecords( pPayload, payloadLength, digest );
+        }
+        else
+        {
+            /* What is left of a bad frame would be taken for the next. */
+            portFlush();
+        }
+
+        sendReply( status, digest );
+
+        LogInfo( ( "Bundle of %u bytes handled in %u ms with status %d.",
+                   ( unsigned ) payloadLength,
+                   ( unsigned ) ( ( esp_timer_get_time() - startUs ) / 1000 ),
+                   ( int ) status ) );
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void sendReply( FactoryProvisioningStatus_t status,
+                           const uint8_t * pDigest )
+    {
+        uint8_t reply[ REPLY_SIZE ] = { 0 };
+
+        writeLe32( reply, REPLY_MAGIC );
+        reply[ 4 ] = ( uint8_t ) status;
+        ( void ) memcpy( &reply[ 8 ], pDigest, DIGEST_SIZE );
+        writeLe32( &reply[ 8U + DIGEST_SIZE ], esp_rom_crc32_le( 0U, reply, 8U + DIGEST_SIZE ) );
+
+        portWrite( reply, sizeof( reply ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    FactoryProvisioningStatus_t FactoryProvisioning_Run( uint32_t waitMs )
+    {
+        FactoryProvisioningStatus_t status = FactoryProvisioningNoBundle;
+        uint8_t * pPayload = NULL;
+        uint8_t waiting[ 4 ];
+
+        if( portOpen() == false )
+        {
+            LogError( ( "Failed to open the port of the station." ) );
+        }
+        else
+        {
+            pPayload = malloc( FACTORY_PROVISIONING_MAX_PAYLOAD );
+
+            if( pPayload == NULL )
+            {
+                LogError( ( "No memory for a bundle of %u bytes.", ( unsigned ) FACTORY_PROVISIONING_MAX_PAYLOAD ) );
+            }
+            else
+            {
+                LogInfo( ( "Waiting %u ms for a bundle from the station.", ( unsigned ) waitMs ) );
+
+                /* Bytes sent before the driver was installed are lost, so
+                 * the station waits for this. */
+                writeLe32( waiting, WAITING_MAGIC );
+                portWrite( waiting, sizeof( waiting ) );
+
+                while( ( status != FactoryProvisioningSuccess ) && ( waitForMagic( waitMs ) == true ) )
+                {
+                    status = receiveBundle( pPayload );
+                }
+
+                /* The private keys of the bundle don't stay on the heap. */
+                ( void ) memset( pPayload, 0, FACTORY_PROVISIONING_MAX_PAYLOAD );
+                free( pPayload );
+            }
+
+            portClose();
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool FactoryProvisioning_GetConfig( const char * pKey,
+                                        void * pValue,
+                                        size_t * pValueLength )
+    {
+        nvs_handle_t handle = 0;
+        bool found = false;
+
+        assert( ( pKey != NULL ) && ( pValue != NULL ) && ( pValueLength != NULL ) );
+
+        if( nvs_open( FACTORY_PROVISIONING_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK )
+        {
+            found = ( nvs_get_blob( handle, pKey, pValue, pValueLength ) == ESP_OK );
+            nvs_close( handle );
+        }
+
+        return found;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if FACTORY_PROVISIONING_ENABLED */
@@ -0,0 +1,155 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file factory_provisioning.h
+ * @brief Write the credentials and configuration of a unit on the production
+ * line from one bundle sent by the station over UART or USB.
+ *
+ * When the unit starts listening it sends the four bytes "FPW1", and the
+ * station then sends one frame, little-endian:
+ *
+ *   uint32 magic           "FPB1"
+ *   uint32 payload length
+ *   payload                records, back to back
+ *   uint32 CRC-32          of the magic, the length and the payload
+ *
+ * Each record is:
+ *
+ *   uint8  kind            1: PKCS #11 object, 2: configuration value
+ *   uint8  name length
+ *   uint16 value length
+ *   name                   the PKCS #11 label, or the NVS key of the value
+ *   value                  the DER object, or the value
+ *
+ * The PKCS #11 objects, such as "Claim Cert" and "Claim Key", are saved
+ * through the NVS PAL in one transaction, so a unit reset while it is written
+ * keeps either all of them or none. The configuration values are stored as
+ * blobs in the FACTORY_PROVISIONING_NVS_NAMESPACE namespace and committed
+ * before the transaction. Objects skip the C_CreateObject path: they are
+ * stored as they are, so they must already be DER.
+ *
+ * The unit then reads every record back from storage and replies:
+ *
+ *   uint32 magic           "FPR1"
+ *   uint8  status          a #FactoryProvisioningStatus_t
+ *   uint8  reserved[ 3 ]
+ *   uint8  digest[ 32 ]    SHA-256 of the records as read back
+ *   uint32 CRC-32          of the bytes before it
+ *
+ * As the records read back are those sent, the digest is the SHA-256 of the
+ * payload when everything was stored. tools/factory_station.py builds and
+ * sends a bundle and checks the reply. On UART0 the reply is mixed with the
+ * log, so the station looks for its magic.
+ */
+
+#ifndef FACTORY_PROVISIONING_H_
+#define FACTORY_PROVISIONING_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the unit listens for a bundle from the station at boot.
+ */
+#ifndef FACTORY_PROVISIONING_ENABLED
+    #if CONFIG_FACTORY_PROVISIONING_ENABLE
+        #define FACTORY_PROVISIONING_ENABLED    1
+    #else
+        #define FACTORY_PROVISIONING_ENABLED    0
+    #endif
+#endif
+
+#if FACTORY_PROVISIONING_ENABLED
+
+/**
+ * @brief The largest payload of a bundle.
+ */
+    #ifndef FACTORY_PROVISIONING_MAX_PAYLOAD
+        #define FACTORY_PROVISIONING_MAX_PAYLOAD    CONFIG_FACTORY_PROVISIONING_MAX_PAYLOAD
+    #endif
+
+/**
+ * @brief The longest gap between two bytes of a frame, in milliseconds.
+ */
+    #ifndef FACTORY_PROVISIONING_BYTE_TIMEOUT_MS
+        #define FACTORY_PROVISIONING_BYTE_TIMEOUT_MS    CONFIG_FACTORY_PROVISIONING_BYTE_TIMEOUT_MS
+    #endif
+
+/**
+ * @brief The NVS namespace of the configuration values.
+ */
+    #ifndef FACTORY_PROVISIONING_NVS_NAMESPACE
+        #define FACTORY_PROVISIONING_NVS_NAMESPACE    CONFIG_FACTORY_PROVISIONING_NVS_NAMESPACE
+    #endif
+
+/**
+ * @brief The outcome of a bundle, as sent in the reply.
+ */
+typedef enum FactoryProvisioningStatus
+{
+    FactoryProvisioningSuccess = 0, /**< Everything was stored and read back. */
+    FactoryProvisioningBadCrc,      /**< The frame was damaged. */
+    FactoryProvisioningBadBundle,   /**< A record overran the payload, or had an unknown kind or a bad name. */
+    FactoryProvisioningTooLarge,    /**< The payload was larger than FACTORY_PROVISIONING_MAX_PAYLOAD. */
+    FactoryProvisioningStoreFailed, /**< Storage failed, and the transaction was aborted. */
+    FactoryProvisioningNoBundle     /**< No bundle came. Never sent. */
+} FactoryProvisioningStatus_t;
+
+/**
+ * @brief Listens for bundles from the station, and stores and acknowledges
+ * each of them, until one is stored or no frame starts for @a waitMs.
+ *
+ * A bundle that fails is acknowledged with its status, and the station may
+ * send it again within @a waitMs. Called at boot, before anything else reads
+ * the objects; NVS must be initialized.
+ *
+ * @param[in] waitMs How long to wait for the start of a frame.
+ *
+ * @return FactoryProvisioningSuccess once a bundle was stored,
+ * FactoryProvisioningNoBundle if none came, or the status of the last bundle
+ * that failed.
+ */
+FactoryProvisioningStatus_t FactoryProvisioning_Run( uint32_t waitMs );
+
+/**
+ * @brief Reads a configuration value stored from a bundle.
+ *
+ * @param[in] pKey The NVS key of the value.
+ * @param[out] pValue Where the value is copied.
+ * @param[in,out] pValueLength The size of @a pValue, then the length of the
+ * value.
+ *
+ * @return true if the value was found and fit.
+ */
+bool FactoryProvisioning_GetConfig( const char * pKey,
+                                    void * pValue,
+                                    size_t * pValueLength );
+
+#endif /* if FACTORY_PROVISIONING_ENABLED */
+
+#endif /* ifndef FACTORY_PROVISIONING_H_ */
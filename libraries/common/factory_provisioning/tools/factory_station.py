@@ -0,0 +1,177 @@
+#!/usr/bin/env python
+#
+# Provisions a unit from the factory station: builds a bundle of PKCS #11
+# objects and configuration values, sends it in one frame over the serial
+# port of the unit, and checks that the SHA-256 the unit read back matches
+# the bundle. For example:
+#
+#   factory_station.py /dev/ttyUSB0 \
+#       --object "Claim Cert=claim_cert.der" --object "Claim Key=claim_key.der" \
+#       --config "endpoint=abc-ats.iot.us-east-1.amazonaws.com"
+#
+# The frames are described in factory_provisioning.h. The unit listens for
+# CONFIG_FACTORY_PROVISIONING_WAIT_MS after boot, so the station resets it
+# and waits for it to say so first, unless --no-reset is given.
+
+import argparse
+import hashlib
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+BUNDLE_MAGIC = b'FPB1'
+WAITING_MAGIC = b'FPW1'
+REPLY_MAGIC = b'FPR1'
+REPLY = struct.Struct('<4sB3x32sI')
+RECORD = struct.Struct('<BBH')
+PKCS11_OBJECT = 1
+CONFIG_VALUE = 2
+MAX_LABEL_LENGTH = 32
+MAX_KEY_LENGTH = 15
+STATUSES = ['success', 'bad CRC', 'bad bundle', 'too large', 'store failed']
+
+
+def parse_pair(text):
+    name, separator, value = text.partition('=')
+
+    if not separator or not name:
+        raise argparse.ArgumentTypeError('expected NAME=VALUE, got {}'.format(text))
+
+    return name, value
+
+
+def build_payload(objects, configs):
+    payload = b''
+
+    for label, path in objects:
+        if len(label) > MAX_LABEL_LENGTH:
+            sys.exit('label {} is longer than {} characters'.format(label, MAX_LABEL_LENGTH))
+
+        with open(path, 'rb') as object_file:
+            value = object_file.read()
+
+        if value.startswith(b'-----BEGIN'):
+            sys.exit('{} is PEM, the unit stores objects as DER'.format(path))
+
+        payload += RECORD.pack(PKCS11_OBJECT, len(label), len(value)) + label.encode() + value
+
+    for key, value in configs:
+        if len(key) > MAX_KEY_LENGTH:
+            sys.exit('key {} is longer than {} characters'.format(key, MAX_KEY_LENGTH))
+
+        # A value of @file is the contents of the file.
+        if value.startswith('@'):
+            with open(value[1:], 'rb') as value_file:
+                value = value_file.read()
+        else:
+            value = value.encode()
+
+        payload += RECORD.pack(CONFIG_VALUE, len(key), len(value)) + key.encode() + value
+
+    return payload
+
+
+def build_frame(payload):
+    header = BUNDLE_MAGIC + struct.pack('<I', len(payload))
+
+    return header + payload + struct.pack('<I', zlib.crc32(header + payload) & 0xFFFFFFFF)
+
+
+def wait_for(port, magic, timeout):
+    received = b''
+    deadline = time.monotonic() + timeout
+
+    while time.monotonic() < deadline:
+        received = received[-len(magic):] + port.read(max(1, port.in_waiting))
+
+        if magic in received:
+            return True
+
+    return False
+
+
+def read_reply(port, timeout):
+    # The reply may come among log lines, so look for its magic.
+    received = b''
+    deadline = time.monotonic() + timeout
+
+    while time.monotonic() < deadline:
+        received += port.read(max(1, port.in_waiting))
+        start = received.find(REPLY_MAGIC)
+
+        if start >= 0 and len(received) - start >= REPLY.size:
+            reply = received[start:start + REPLY.size]
+
+            if zlib.crc32(reply[:-4]) & 0xFFFFFFFF == REPLY.unpack(reply)[3]:
+                return REPLY.unpack(reply)
+
+            received = received[start + 1:]
+
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Provision a unit from one bundle of credentials and configuration.')
+    parser.add_argument('port', help='serial port of the unit')
+    parser.add_argument('--baud', type=int, default=921600,
+                        help='CONFIG_FACTORY_PROVISIONING_UART_BAUD (default 921600)')
+    parser.add_argument('--object', type=parse_pair, action='append', default=[], metavar='LABEL=FILE',
+                        help='PKCS #11 object to store, as DER')
+    parser.add_argument('--config', type=parse_pair, action='append', default=[], metavar='KEY=VALUE',
+                        help='configuration value to store, or KEY=@FILE')
+    parser.add_argument('--timeout', type=float, default=10.0,
+                        help='seconds to wait for the reply (default 10)')
+    parser.add_argument('--retries', type=int, default=2,
+                        help='times to send the bundle again when it fails (default 2)')
+    parser.add_argument('--no-reset', action='store_true',
+                        help='do not reset the unit through RTS first')
+    args = parser.parse_args()
+
+    payload = build_payload(args.object, args.config)
+
+    if not payload:
+        sys.exit('nothing to provision')
+
+    frame = build_frame(payload)
+    expected = hashlib.sha256(payload).digest()
+
+    with serial.Serial(args.port, args.baud, timeout=0.05) as port:
+        if not args.no_reset:
+            port.dtr = False
+            port.rts = True
+            time.sleep(0.1)
+            port.reset_input_buffer()
+            port.rts = False
+
+            if not wait_for(port, WAITING_MAGIC, args.timeout):
+                sys.exit('the unit is not waiting for a bundle')
+
+        start = time.monotonic()
+
+        for attempt in range(args.retries + 1):
+            port.write(frame)
+            reply = read_reply(port, args.timeout)
+
+            if reply is None:
+                print('attempt {}: no reply'.format(attempt + 1))
+                continue
+
+            status, digest = reply[1], reply[2]
+
+            if status != 0:
+                print('attempt {}: {}'.format(attempt + 1, STATUSES[status] if status < len(STATUSES) else status))
+            elif digest != expected:
+                sys.exit('the unit stored something else than the bundle')
+            else:
+                print('provisioned {} bytes in {:.0f} ms, digest {}'.format(
+                    len(payload), (time.monotonic() - start) * 1000, digest.hex()))
+                return
+
+    sys.exit('failed to provision the unit')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,382 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fleet_provisioning_serializer_benchmark.c
+ * @brief Measures the bytes on air and the CPU of the CBOR and JSON payloads
+ * of fleet provisioning.
+ *
+ * Each payload is built as the demos and AWS IoT build it, with a CSR the
+ * size of a P-256 one and a certificate and private key the size of RSA-2048
+ * ones. Requests are timed as the demos build them. Responses are copied into
+ * the receive buffer before each parse, as the MQTT callback receives them,
+ * since the parser terminates the fields in place.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/* Payload libraries. */
+#include "cbor.h"
+#include "json_writer.h"
+#include "fleet_provisioning_serializer.h"
+
+/* Header include. */
+#include "fleet_provisioning_serializer_benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Lengths of the fields of the payloads.
+ */
+#define BENCHMARK_CSR_LENGTH                480U
+#define BENCHMARK_CERTIFICATE_ID_LENGTH     64U
+#define BENCHMARK_CERTIFICATE_PEM_LENGTH    1220U
+#define BENCHMARK_PRIVATE_KEY_LENGTH        1680U
+#define BENCHMARK_OWNERSHIP_TOKEN_LENGTH    460U
+
+/**
+ * @brief Size of the payload buffers, with room for the largest response
+ * with the JSON escapes of its newlines.
+ */
+#define BENCHMARK_BUFFER_LENGTH             ( 4096U )
+
+/**
+ * @brief Times each payload is built or parsed in each format.
+ */
+#define BENCHMARK_ITERATIONS                ( 200U )
+
+/**
+ * @brief Serial number and Thing name of the RegisterThing payloads.
+ */
+#define BENCHMARK_SERIAL                    "benchmark-serial-0001"
+#define BENCHMARK_THING_NAME                "benchmark-thing-0001"
+
+/*-----------------------------------------------------------*/
+
+static const char * TAG = "FleetProvSerializerBenchmark";
+
+/**
+ * @brief The responses of AWS IoT.
+ */
+typedef enum BenchmarkResponse
+{
+    BenchmarkKeyCertResponse,
+    BenchmarkCsrResponse,
+    BenchmarkRegisterThingResponse,
+    BenchmarkResponseCount
+} BenchmarkResponse_t;
+
+static const char * const responseNames[ BenchmarkResponseCount ] =
+{
+    "CreateKeysAndCertificate response",
+    "CreateCertificateFromCsr response",
+    "RegisterThing response"
+};
+
+/**
+ * @brief The fields of the payloads, in one buffer.
+ */
+static char fields[ BENCHMARK_CSR_LENGTH + BENCHMARK_CERTIFICATE_ID_LENGTH +
+                    BENCHMARK_CERTIFICATE_PEM_LENGTH + BENCHMARK_PRIVATE_KEY_LENGTH +
+                    BENCHMARK_OWNERSHIP_TOKEN_LENGTH ];
+
+static char * const pCsr = fields;
+static char * const pCertificateId = fields + BENCHMARK_CSR_LENGTH;
+static char * const pCertificatePem = fields + BENCHMARK_CSR_LENGTH + BENCHMARK_CERTIFICATE_ID_LENGTH;
+static char * const pPrivateKey = fields + BENCHMARK_CSR_LENGTH + BENCHMARK_CERTIFICATE_ID_LENGTH +
+                                  BENCHMARK_CERTIFICATE_PEM_LENGTH;
+static char * const pOwnershipToken = fields + BENCHMARK_CSR_LENGTH + BENCHMARK_CERTIFICATE_ID_LENGTH +
+                                      BENCHMARK_CERTIFICATE_PEM_LENGTH + BENCHMARK_PRIVATE_KEY_LENGTH;
+
+/**
+ * @brief The encoded response, and where requests are built and responses
+ * copied to be parsed.
+ */
+static uint8_t response[ BENCHMARK_BUFFER_LENGTH ];
+static uint8_t payloadBuffer[ BENCHMARK_BUFFER_LENGTH ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Fills a field with PEM text: a header and base64 lines of 64
+ * characters, as the PEM encoders write them.
+ */
+static void fillPem( char * pBuffer,
+                     size_t length,
+                     const char * pLabel );
+
+/**
+ * @brief Encodes a response of AWS IoT in CBOR.
+ *
+ * @return The length of the response, or 0 if it doesn't fit.
+ */
+static size_t writeCborResponse( BenchmarkResponse_t kind );
+
+/**
+ * @brief Encodes a response of AWS IoT in JSON.
+ *
+ * @return The length of the response, or 0 if it doesn't fit.
+ */
+static size_t writeJsonResponse( BenchmarkResponse_t kind );
+
+/**
+ * @brief Builds the requests and parses the responses in one format, and
+ * logs their sizes and times.
+ */
+static void runFormat( const ProvisioningPayloadFormat_t * pFormat,
+                       size_t ( * writeResponse )( BenchmarkResponse_t kind ) );
+
+/*-----------------------------------------------------------*/
+
+static void fillPem( char * pBuffer,
+                     size_t length,
+                     const char * pLabel )
+{
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t header = ( size_t ) snprintf( pBuffer, length, "-----BEGIN %s-----\n", pLabel );
+    size_t i;
+
+    for( i = header; i < length; i++ )
+    {
+        pBuffer[ i ] = ( ( ( i - header ) % 65U ) == 64U ) ? '\n' : base64[ ( i * 7U ) % 64U ];
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t writeCborResponse( BenchmarkResponse_t kind )
+{
+    CborEncoder encoder, map, configuration;
+    CborError error = CborNoError;
+    size_t length = 0U;
+
+    cbor_encoder_init( &encoder, response, sizeof( response ), 0 );
+
+    if( kind == BenchmarkRegisterThingResponse )
+    {
+        error |= cbor_encoder_create_map( &encoder, &map, 2 );
+        error |= cbor_encode_text_stringz( &map, "deviceConfiguration" );
+        error |= cbor_encoder_create_map( &map, &configuration, 1 );
+        error |= cbor_encode_text_stringz( &configuration, "Fallback" );
+        error |= cbor_encode_text_stringz( &configuration, "false" );
+        error |= cbor_encoder_close_container( &map, &configuration );
+        error |= cbor_encode_text_stringz( &map, "thingName" );
+        error |= cbor_encode_text_stringz( &map, BENCHMARK_THING_NAME );
+    }
+    else
+    {
+        error |= cbor_encoder_create_map( &encoder, &map, ( kind == BenchmarkKeyCertResponse ) ? 4 : 3 );
+        error |= cbor_encode_text_stringz( &map, "certificateId" );
+        error |= cbor_encode_text_string( &map, pCertificateId, BENCHMARK_CERTIFICATE_ID_LENGTH );
+        error |= cbor_encode_text_stringz( &map, "certificatePem" );
+        error |= cbor_encode_text_string( &map, pCertificatePem, BENCHMARK_CERTIFICATE_PEM_LENGTH );
+
+        if( kind == BenchmarkKeyCertResponse )
+        {
+            error |= cbor_encode_text_stringz( &map, "privateKey" );
+            error |= cbor_encode_text_string( &map, pPrivateKey, BENCHMARK_PRIVATE_KEY_LENGTH );
+        }
+
+        error |= cbor_encode_text_stringz( &map, "certificateOwnershipToken" );
+        error |= cbor_encode_text_string( &map, pOwnershipToken, BENCHMARK_OWNERSHIP_TOKEN_LENGTH );
+    }
+
+    error |= cbor_encoder_close_container( &encoder, &map );
+
+    if( error == CborNoError )
+    {
+        length = cbor_encoder_get_buffer_size( &encoder, response );
+    }
+
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t writeJsonResponse( BenchmarkResponse_t kind )
+{
+    JsonWriter_t writer;
+    size_t length = 0U;
+
+    JsonWriter_Init( &writer, ( char * ) response, sizeof( response ) );
+    JsonWriter_BeginObject( &writer, NULL );
+
+    if( kind == BenchmarkRegisterThingResponse )
+    {
+        JsonWriter_BeginObject( &writer, "deviceConfiguration" );
+        JsonWriter_AddString( &writer, "Fallback", "false", strlen( "false" ) );
+        JsonWriter_EndObject( &writer );
+        JsonWriter_AddString( &writer, "thingName", BENCHMARK_THING_NAME, strlen( BENCHMARK_THING_NAME ) );
+    }
+    else
+    {
+        JsonWriter_AddString( &writer, "certificateId", pCertificateId, BENCHMARK_CERTIFICATE_ID_LENGTH );
+        JsonWriter_AddString( &writer, "certificatePem", pCertificatePem, BENCHMARK_CERTIFICATE_PEM_LENGTH );
+
+        if( kind == BenchmarkKeyCertResponse )
+        {
+            JsonWriter_AddString( &writer, "privateKey", pPrivateKey, BENCHMARK_PRIVATE_KEY_LENGTH );
+        }
+
+        JsonWriter_AddString( &writer, "certificateOwnershipToken", pOwnershipToken,
+                              BENCHMARK_OWNERSHIP_TOKEN_LENGTH );
+    }
+
+    JsonWriter_EndObject( &writer );
+
+    if( JsonWriter_Finish( &writer, &length ) == false )
+    {
+        length = 0U;
+    }
+
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+static void runFormat( const ProvisioningPayloadFormat_t * pFormat,
+                       size_t ( * writeResponse )( BenchmarkResponse_t kind ) )
+{
+    ProvisioningResponse_t parsed;
+    BenchmarkResponse_t kind;
+    size_t length = 0U;
+    size_t valid;
+    uint32_t i;
+    int64_t start;
+    int64_t elapsed;
+
+    valid = 0U;
+    start = esp_timer_get_time();
+
+    for( i = 0; i < BENCHMARK_ITERATIONS; i++ )
+    {
+        if( pFormat->generateCsrRequest( payloadBuffer, sizeof( payloadBuffer ),
+                                         pCsr, BENCHMARK_CSR_LENGTH, &length ) == true )
+        {
+            valid++;
+        }
+    }
+
+    elapsed = esp_timer_get_time() - start;
+
+    if( valid != BENCHMARK_ITERATIONS )
+    {
+        ESP_LOGE( TAG, "%s: CreateCertificateFromCsr request failed.", pFormat->pName );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "%s: CreateCertificateFromCsr request, %u bytes, built in %u us.",
+                  pFormat->pName, ( unsigned ) length, ( unsigned ) ( elapsed / BENCHMARK_ITERATIONS ) );
+    }
+
+    valid = 0U;
+    start = esp_timer_get_time();
+
+    for( i = 0; i < BENCHMARK_ITERATIONS; i++ )
+    {
+        if( pFormat->generateRegisterThingRequest( payloadBuffer, sizeof( payloadBuffer ),
+                                                   pOwnershipToken, BENCHMARK_OWNERSHIP_TOKEN_LENGTH,
+                                                   BENCHMARK_SERIAL, strlen( BENCHMARK_SERIAL ),
+                                                   &length ) == true )
+        {
+            valid++;
+        }
+    }
+
+    elapsed = esp_timer_get_time() - start;
+
+    if( valid != BENCHMARK_ITERATIONS )
+    {
+        ESP_LOGE( TAG, "%s: RegisterThing request failed.", pFormat->pName );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "%s: RegisterThing request, %u bytes, built in %u us.",
+                  pFormat->pName, ( unsigned ) length, ( unsigned ) ( elapsed / BENCHMARK_ITERATIONS ) );
+    }
+
+    for( kind = BenchmarkKeyCertResponse; kind < BenchmarkResponseCount; kind++ )
+    {
+        length = writeResponse( kind );
+
+        if( length == 0U )
+        {
+            ESP_LOGE( TAG, "%s: %s doesn't fit in the buffer.", pFormat->pName, responseNames[ kind ] );
+            continue;
+        }
+
+        valid = 0U;
+        start = esp_timer_get_time();
+
+        for( i = 0; i < BENCHMARK_ITERATIONS; i++ )
+        {
+            ( void ) memcpy( payloadBuffer, response, length );
+
+            if( pFormat->parseResponse( payloadBuffer, length, sizeof( payloadBuffer ), &parsed ) == true )
+            {
+                valid++;
+            }
+        }
+
+        elapsed = esp_timer_get_time() - start;
+
+        if( ( valid != BENCHMARK_ITERATIONS ) ||
+            ( ( kind == BenchmarkKeyCertResponse ) && ( parsed.privateKey.length != BENCHMARK_PRIVATE_KEY_LENGTH ) ) ||
+            ( ( kind == BenchmarkCsrResponse ) && ( parsed.certificatePem.length != BENCHMARK_CERTIFICATE_PEM_LENGTH ) ) ||
+            ( ( kind == BenchmarkRegisterThingResponse ) && ( parsed.thingName.pString == NULL ) ) )
+        {
+            ESP_LOGE( TAG, "%s: %s not parsed.", pFormat->pName, responseNames[ kind ] );
+        }
+        else
+        {
+            ESP_LOGI( TAG, "%s: %s, %u bytes, parsed in %u us.",
+                      pFormat->pName, responseNames[ kind ], ( unsigned ) length,
+                      ( unsigned ) ( elapsed / BENCHMARK_ITERATIONS ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void FleetProvSerializer_RunBenchmark( void )
+{
+    size_t i;
+
+    fillPem( pCsr, BENCHMARK_CSR_LENGTH, "CERTIFICATE REQUEST" );
+    fillPem( pCertificatePem, BENCHMARK_CERTIFICATE_PEM_LENGTH, "CERTIFICATE" );
+    fillPem( pPrivateKey, BENCHMARK_PRIVATE_KEY_LENGTH, "RSA PRIVATE KEY" );
+    fillPem( pOwnershipToken, BENCHMARK_OWNERSHIP_TOKEN_LENGTH, "TOKEN" );
+
+    for( i = 0; i < BENCHMARK_CERTIFICATE_ID_LENGTH; i++ )
+    {
+        pCertificateId[ i ] = "0123456789abcdef"[ ( i * 5U ) % 16U ];
+    }
+
+    runFormat( &provisioningPayloadCbor, writeCborResponse );
+    runFormat( &provisioningPayloadJson, writeJsonResponse );
+}
@@ -0,0 +1,41 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fleet_provisioning_serializer_benchmark.h
+ * @brief Benchmark of the CBOR and JSON payloads of fleet provisioning.
+ */
+
+#ifndef FLEET_PROVISIONING_SERIALIZER_BENCHMARK_H_
+#define FLEET_PROVISIONING_SERIALIZER_BENCHMARK_H_
+
+/**
+ * @brief Build the requests and parse the responses of the fleet
+ * provisioning APIs in CBOR and in JSON, and log the bytes of each payload
+ * and the time to build or parse it.
+ *
+ * The payloads are built in static buffers; the benchmark takes under a
+ * second and runs on the calling task.
+ */
+void FleetProvSerializer_RunBenchmark( void );
+
+#endif /* ifndef FLEET_PROVISIONING_SERIALIZER_BENCHMARK_H_ */
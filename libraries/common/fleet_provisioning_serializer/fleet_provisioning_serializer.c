@@ -0,0 +1,889 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fleet_provisioning_serializer.c
+ * @brief CBOR and JSON serialization of fleet provisioning requests and
+ * single-pass, zero-copy parsing of their responses.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "fleet_provisioning_serializer.h"
+
+#if FLEET_PROV_SERIALIZER_CBOR
+    /* TinyCBOR library for CBOR encoding and decoding operations. */
+    #include "cbor.h"
+#endif
+
+#if FLEET_PROV_SERIALIZER_JSON
+    /* JSON libraries of the Jobs and Shadow demos. */
+    #include "json_index.h"
+    #include "json_writer.h"
+#endif
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the serializer. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Fleet Provisioning Serializer"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A response key and the field of #ProvisioningResponse_t it fills.
+ */
+typedef struct ResponseKey
+{
+    const char * pKey;
+    size_t keyLength;
+    size_t fieldOffset;
+} ResponseKey_t;
+
+#define RESPONSE_KEY( key, field ) \
+    { key, sizeof( key ) - 1U, offsetof( ProvisioningResponse_t, field ) }
+
+/**
+ * @brief The field of @a pFields the key @a i of #responseKeys fills.
+ */
+#define RESPONSE_FIELD( pFields, i ) \
+    ( ( ProvisioningString_t * ) ( ( uint8_t * ) ( pFields ) + responseKeys[ i ].fieldOffset ) )
+
+/**
+ * @brief The keys #parseProvisioningResponse extracts.
+ *
+ * For details on the response payload formats, see:
+ * https://docs.aws.amazon.com/iot/latest/developerguide/fleet-provision-api.html
+ */
+static const ResponseKey_t responseKeys[] =
+{
+    RESPONSE_KEY( "certificatePem",            certificatePem ),
+    RESPONSE_KEY( "certificateId",             certificateId ),
+    RESPONSE_KEY( "certificateOwnershipToken", certificateOwnershipToken ),
+    RESPONSE_KEY( "privateKey",                privateKey ),
+    RESPONSE_KEY( "thingName",                 thingName )
+};
+
+#define RESPONSE_KEY_COUNT    ( sizeof( responseKeys ) / sizeof( responseKeys[ 0 ] ) )
+
+/*-----------------------------------------------------------*/
+
+#if FLEET_PROV_SERIALIZER_CBOR
+
+/**
+ * @brief Points a view at a text string of the payload, without copying.
+ *
+ * A chunked string isn't contiguous in the payload, and AWS IoT doesn't send
+ * them, so it is rejected.
+ *
+ * @param[in] pValue The text string.
+ * @param[out] pView The view of the string.
+ */
+    static CborError getStringView( const CborValue * pValue,
+                                    ProvisioningString_t * pView );
+
+/**
+ * @brief The field of @a pFields a key fills, or NULL for an unknown key.
+ */
+    static ProvisioningString_t * findField( const ProvisioningString_t * pKey,
+                                             ProvisioningResponse_t * pFields );
+
+/**
+ * @brief #generateCsrRequest in CBOR.
+ */
+    static bool cborGenerateCsrRequest( uint8_t * pBuffer,
+                                        size_t bufferLength,
+                                        const char * pCsr,
+                                        size_t csrLength,
+                                        size_t * pOutLengthWritten );
+
+/**
+ * @brief #generateRegisterThingRequest in CBOR.
+ */
+    static bool cborGenerateRegisterThingRequest( uint8_t * pBuffer,
+                                                  size_t bufferLength,
+                                                  const char * pCertificateOwnershipToken,
+                                                  size_t certificateOwnershipTokenLength,
+                                                  const char * pSerial,
+                                                  size_t serialLength,
+                                                  size_t * pOutLengthWritten );
+
+/**
+ * @brief #parseProvisioningResponse in CBOR.
+ */
+    static bool cborParseResponse( uint8_t * pResponse,
+                                   size_t length,
+                                   size_t bufferLength,
+                                   ProvisioningResponse_t * pFields );
+
+#endif /* if FLEET_PROV_SERIALIZER_CBOR */
+
+#if FLEET_PROV_SERIALIZER_JSON
+
+/**
+ * @brief Decodes the escapes of a JSON string where it is. Every escape is
+ * at least as long as what it decodes to, so the string only gets shorter.
+ *
+ * @param[in,out] pView The string, without its quotes. Its length is updated.
+ *
+ * @return false for an escaped UTF-16 surrogate, which AWS IoT doesn't send.
+ */
+    static bool unescapeInPlace( ProvisioningString_t * pView );
+
+/**
+ * @brief #generateCsrRequest in JSON.
+ */
+    static bool jsonGenerateCsrRequest( uint8_t * pBuffer,
+                                        size_t bufferLength,
+                                        const char * pCsr,
+                                        size_t csrLength,
+                                        size_t * pOutLengthWritten );
+
+/**
+ * @brief #generateRegisterThingRequest in JSON.
+ */
+    static bool jsonGenerateRegisterThingRequest( uint8_t * pBuffer,
+                                                  size_t bufferLength,
+                                                  const char * pCertificateOwnershipToken,
+                                                  size_t certificateOwnershipTokenLength,
+                                                  const char * pSerial,
+                                                  size_t serialLength,
+                                                  size_t * pOutLengthWritten );
+
+/**
+ * @brief #parseProvisioningResponse in JSON.
+ */
+    static bool jsonParseResponse( uint8_t * pResponse,
+                                   size_t length,
+                                   size_t bufferLength,
+                                   ProvisioningResponse_t * pFields );
+
+#endif /* if FLEET_PROV_SERIALIZER_JSON */
+
+/**
+ * @brief NUL-terminates the fields found, in the buffer of the response.
+ *
+ * Every string is followed by the next item or the end of the payload,
+ * neither needed any more, so it is terminated where it is.
+ *
+ * @return false if a field ends at the end of the buffer.
+ */
+static bool terminateFields( uint8_t * pResponse,
+                             size_t bufferLength,
+                             ProvisioningResponse_t * pFields );
+
+/**
+ * @brief Logs that a field a response must have is missing.
+ *
+ * @return false if @a pField is absent.
+ */
+static bool checkField( const ProvisioningString_t * pField,
+                        const char * pKey,
+                        const char * pApiName );
+
+/*-----------------------------------------------------------*/
+
+#if FLEET_PROV_SERIALIZER_CBOR
+
+    static CborError getStringView( const CborValue * pValue,
+                                    ProvisioningString_t * pView )
+    {
+        CborError cborRet = CborNoError;
+        CborValue next;
+        const char * pChunk = NULL;
+        size_t chunkLength = 0U;
+        size_t stringLength = 0U;
+
+        if( !cbor_value_is_length_known( pValue ) )
+        {
+            cborRet = CborErrorUnknownLength;
+        }
+        else
+        {
+            cborRet = cbor_value_get_string_length( pValue, &stringLength );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            /* A string of known length is a single chunk. */
+            cborRet = cbor_value_get_text_string_chunk( pValue, &pChunk, &chunkLength, &next );
+        }
+
+        if( ( cborRet == CborNoError ) && ( ( pChunk == NULL ) || ( chunkLength != stringLength ) ) )
+        {
+            cborRet = CborErrorUnknownLength;
+        }
+
+        if( cborRet == CborNoError )
+        {
+            pView->pString = pChunk;
+            pView->length = chunkLength;
+        }
+
+        return cborRet;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static ProvisioningString_t * findField( const ProvisioningString_t * pKey,
+                                             ProvisioningResponse_t * pFields )
+    {
+        ProvisioningString_t * pField = NULL;
+        size_t i;
+
+        for( i = 0; i < RESPONSE_KEY_COUNT; i++ )
+        {
+            if( ( pKey->length == responseKeys[ i ].keyLength ) &&
+                ( memcmp( pKey->pString, responseKeys[ i ].pKey, pKey->length ) == 0 ) )
+            {
+                pField = RESPONSE_FIELD( pFields, i );
+                break;
+            }
+        }
+
+        return pField;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool cborGenerateCsrRequest( uint8_t * pBuffer,
+                                        size_t bufferLength,
+                                        const char * pCsr,
+                                        size_t csrLength,
+                                        size_t * pOutLengthWritten )
+    {
+        CborEncoder encoder, mapEncoder;
+        CborError cborRet;
+
+        assert( pBuffer != NULL );
+        assert( pCsr != NULL );
+        assert( pOutLengthWritten != NULL );
+
+        /* For details on the CreateCertificatefromCsr request payload format, see:
+         * https://docs.aws.amazon.com/iot/latest/developerguide/fleet-provision-api.html#create-cert-csr-request-payload
+         */
+        cbor_encoder_init( &encoder, pBuffer, bufferLength, 0 );
+        /* The CreateCertificateFromCsr request payload is a map with one key. */
+        cborRet = cbor_encoder_create_map( &encoder, &mapEncoder, 1 );
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_stringz( &mapEncoder, "certificateSigningRequest" );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_string( &mapEncoder, pCsr, csrLength );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encoder_close_container( &encoder, &mapEncoder );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            *pOutLengthWritten = cbor_encoder_get_buffer_size( &encoder, ( uint8_t * ) pBuffer );
+        }
+        else
+        {
+            LogError( ( "Error during CBOR encoding: %s", cbor_error_string( cborRet ) ) );
+
+            if( ( cborRet & CborErrorOutOfMemory ) != 0 )
+            {
+                LogError( ( "Cannot fit CreateCertificateFromCsr request payload into buffer." ) );
+            }
+        }
+
+        return( cborRet == CborNoError );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool cborGenerateRegisterThingRequest( uint8_t * pBuffer,
+                                                  size_t bufferLength,
+                                                  const char * pCertificateOwnershipToken,
+                                                  size_t certificateOwnershipTokenLength,
+                                                  const char * pSerial,
+                                                  size_t serialLength,
+                                                  size_t * pOutLengthWritten )
+    {
+        CborEncoder encoder, mapEncoder, parametersEncoder;
+        CborError cborRet;
+
+        assert( pBuffer != NULL );
+        assert( pCertificateOwnershipToken != NULL );
+        assert( pSerial != NULL );
+        assert( pOutLengthWritten != NULL );
+
+        /* For details on the RegisterThing request payload format, see:
+         * https://docs.aws.amazon.com/iot/latest/developerguide/fleet-provision-api.html#register-thing-request-payload
+         */
+        cbor_encoder_init( &encoder, pBuffer, bufferLength, 0 );
+        /* The RegisterThing request payload is a map with two keys. */
+        cborRet = cbor_encoder_create_map( &encoder, &mapEncoder, 2 );
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_stringz( &mapEncoder, "certificateOwnershipToken" );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_string( &mapEncoder, pCertificateOwnershipToken, certificateOwnershipTokenLength );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_stringz( &mapEncoder, "parameters" );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            /* Parameters in this example is length 1. */
+            cborRet = cbor_encoder_create_map( &mapEncoder, &parametersEncoder, 1 );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_stringz( &parametersEncoder, "SerialNumber" );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_text_string( &parametersEncoder, pSerial, serialLength );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encoder_close_container( &mapEncoder, &parametersEncoder );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encoder_close_container( &encoder, &mapEncoder );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            *pOutLengthWritten = cbor_encoder_get_buffer_size( &encoder, ( uint8_t * ) pBuffer );
+        }
+        else
+        {
+            LogError( ( "Error during CBOR encoding: %s", cbor_error_string( cborRet ) ) );
+
+            if( ( cborRet & CborErrorOutOfMemory ) != 0 )
+            {
+                LogError( ( "Cannot fit RegisterThing request payload into buffer." ) );
+            }
+        }
+
+        return( cborRet == CborNoError );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool cborParseResponse( uint8_t * pResponse,
+                                   size_t length,
+                                   size_t bufferLength,
+                                   ProvisioningResponse_t * pFields )
+    {
+        CborError cborRet;
+        CborParser parser;
+        CborValue map;
+        CborValue element;
+        ProvisioningString_t key = { 0 };
+        ProvisioningString_t * pField = NULL;
+
+        assert( pResponse != NULL );
+        assert( pFields != NULL );
+
+        ( void ) memset( pFields, 0x00, sizeof( ProvisioningResponse_t ) );
+
+        cborRet = cbor_parser_init( pResponse, length, 0, &parser, &map );
+
+        if( cborRet != CborNoError )
+        {
+            LogError( ( "Error initializing parser for fleet provisioning response: %s.", cbor_error_string( cborRet ) ) );
+        }
+        else if( !cbor_value_is_map( &map ) )
+        {
+            LogError( ( "Fleet provisioning response is not a map." ) );
+            cborRet = CborErrorIllegalType;
+        }
+        else
+        {
+            cborRet = cbor_value_enter_container( &map, &element );
+        }
+
+        while( ( cborRet == CborNoError ) && !cbor_value_at_end( &element ) )
+        {
+            pField = NULL;
+
+            if( !cbor_value_is_text_string( &element ) )
+            {
+                cborRet = CborErrorIllegalType;
+            }
+            else
+            {
+                cborRet = getStringView( &element, &key );
+            }
+
+            if( cborRet == CborNoError )
+            {
+                pField = findField( &key, pFields );
+                cborRet = cbor_value_advance( &element );
+            }
+
+            if( ( cborRet == CborNoError ) && ( pField != NULL ) )
+            {
+                if( !cbor_value_is_text_string( &element ) )
+                {
+                    LogError( ( "\"%.*s\" is an unexpected type in fleet provisioning response.",
+                                ( int ) key.length, key.pString ) );
+                    cborRet = CborErrorIllegalType;
+                }
+                else
+                {
+                    cborRet = getStringView( &element, pField );
+                }
+            }
+
+            if( cborRet == CborNoError )
+            {
+                /* Skips the value whole, even a map such as "deviceConfiguration". */
+                cborRet = cbor_value_advance( &element );
+            }
+        }
+
+        if( cborRet != CborNoError )
+        {
+            LogError( ( "Failed to parse fleet provisioning response: %s.", cbor_error_string( cborRet ) ) );
+        }
+
+        return( ( cborRet == CborNoError ) &&
+                terminateFields( pResponse, bufferLength, pFields ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    const ProvisioningPayloadFormat_t provisioningPayloadCbor =
+    {
+        .pName                        = "CBOR",
+        .generateCsrRequest           = cborGenerateCsrRequest,
+        .generateRegisterThingRequest = cborGenerateRegisterThingRequest,
+        .parseResponse                = cborParseResponse
+    };
+
+/*-----------------------------------------------------------*/
+
+#endif /* if FLEET_PROV_SERIALIZER_CBOR */
+
+#if FLEET_PROV_SERIALIZER_JSON
+
+    static bool unescapeInPlace( ProvisioningString_t * pView )
+    {
+        char * pText = ( char * ) pView->pString;
+        size_t in = 0U;
+        size_t out = 0U;
+        uint32_t codePoint;
+        size_t i;
+        char c;
+        bool status = true;
+
+        /* The index validated the string, so every escape is complete and
+         * every \u has four hex digits. */
+        while( ( status == true ) && ( in < pView->length ) )
+        {
+            c = pText[ in++ ];
+
+            if( c != '\\' )
+            {
+                pText[ out++ ] = c;
+                continue;
+            }
+
+            c = pText[ in++ ];
+
+            switch( c )
+            {
+                case 'b':
+                    pText[ out++ ] = '\b';
+                    break;
+
+                case 'f':
+                    pText[ out++ ] = '\f';
+                    break;
+
+                case 'n':
+                    pText[ out++ ] = '\n';
+                    break;
+
+                case 'r':
+                    pText[ out++ ] = '\r';
+                    break;
+
+                case 't':
+                    pText[ out++ ] = '\t';
+                    break;
+
+                case 'u':
+                    codePoint = 0U;
+
+                    for( i = 0U; i < 4U; i++ )
+                    {
+                        c = pText[ in++ ];
+                        codePoint = ( codePoint << 4 ) |
+                                    ( uint32_t ) ( ( c <= '9' ) ? ( c - '0' ) : ( ( c | 0x20 ) - 'a' + 10 ) );
+                    }
+
+                    /* Six characters decode to at most three bytes of UTF-8. */
+                    if( ( codePoint >= 0xD800U ) && ( codePoint <= 0xDFFFU ) )
+                    {
+                        LogError( ( "Escaped UTF-16 surrogate in fleet provisioning response." ) );
+                        status = false;
+                    }
+                    else if( codePoint < 0x80U )
+                    {
+                        pText[ out++ ] = ( char ) codePoint;
+                    }
+                    else if( codePoint < 0x800U )
+                    {
+                        pText[ out++ ] = ( char ) ( 0xC0U | ( codePoint >> 6 ) );
+                        pText[ out++ ] = ( char ) ( 0x80U | ( codePoint & 0x3FU ) );
+                    }
+                    else
+                    {
+                        pText[ out++ ] = ( char ) ( 0xE0U | ( codePoint >> 12 ) );
+                        pText[ out++ ] = ( char ) ( 0x80U | ( ( codePoint >> 6 ) & 0x3FU ) );
+                        pText[ out++ ] = ( char ) ( 0x80U | ( codePoint & 0x3FU ) );
+                    }
+
+                    break;
+
+                default:
+                    /* A quote, a backslash or a slash. */
+                    pText[ out++ ] = c;
+                    break;
+            }
+        }
+
+        pView->length = out;
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool jsonGenerateCsrRequest( uint8_t * pBuffer,
+                                        size_t bufferLength,
+                                        const char * pCsr,
+                                        size_t csrLength,
+                                        size_t * pOutLengthWritten )
+    {
+        JsonWriter_t writer;
+        size_t length = 0U;
+        bool status;
+
+        assert( pBuffer != NULL );
+        assert( pCsr != NULL );
+        assert( pOutLengthWritten != NULL );
+
+        /* For details on the CreateCertificatefromCsr request payload format, see:
+         * https://docs.aws.amazon.com/iot/latest/developerguide/fleet-provision-api.html#create-cert-csr-request-payload
+         */
+        JsonWriter_Init( &writer, ( char * ) pBuffer, bufferLength );
+        JsonWriter_BeginObject( &writer, NULL );
+        JsonWriter_AddString( &writer, "certificateSigningRequest", pCsr, csrLength );
+        JsonWriter_EndObject( &writer );
+        status = JsonWriter_Finish( &writer, &length );
+
+        if( status == true )
+        {
+            *pOutLengthWritten = length;
+        }
+        else
+        {
+            LogError( ( "Cannot fit CreateCertificateFromCsr request payload into buffer, %u bytes needed.",
+                        ( unsigned ) ( length + 1U ) ) );
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool jsonGenerateRegisterThingRequest( uint8_t * pBuffer,
+                                                  size_t bufferLength,
+                                                  const char * pCertificateOwnershipToken,
+                                                  size_t certificateOwnershipTokenLength,
+                                                  const char * pSerial,
+                                                  size_t serialLength,
+                                                  size_t * pOutLengthWritten )
+    {
+        JsonWriter_t writer;
+        size_t length = 0U;
+        bool status;
+
+        assert( pBuffer != NULL );
+        assert( pCertificateOwnershipToken != NULL );
+        assert( pSerial != NULL );
+        assert( pOutLengthWritten != NULL );
+
+        /* For details on the RegisterThing request payload format, see:
+         * https://docs.aws.amazon.com/iot/latest/developerguide/fleet-provision-api.html#register-thing-request-payload
+         */
+        JsonWriter_Init( &writer, ( char * ) pBuffer, bufferLength );
+        JsonWriter_BeginObject( &writer, NULL );
+        JsonWriter_AddString( &writer, "certificateOwnershipToken",
+                              pCertificateOwnershipToken, certificateOwnershipTokenLength );
+        JsonWriter_BeginObject( &writer, "parameters" );
+        JsonWriter_AddString( &writer, "SerialNumber", pSerial, serialLength );
+        JsonWriter_EndObject( &writer );
+        JsonWriter_EndObject( &writer );
+        status = JsonWriter_Finish( &writer, &length );
+
+        if( status == true )
+        {
+            *pOutLengthWritten = length;
+        }
+        else
+        {
+            LogError( ( "Cannot fit RegisterThing request payload into buffer, %u bytes needed.",
+                        ( unsigned ) ( length + 1U ) ) );
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool jsonParseResponse( uint8_t * pResponse,
+                                   size_t length,
+                                   size_t bufferLength,
+                                   ProvisioningResponse_t * pFields )
+    {
+        JsonIndexToken_t tokens[ FLEET_PROV_SERIALIZER_JSON_TOKENS ];
+        JsonIndex_t index;
+        JsonIndexStatus_t indexStatus;
+        JsonIndexType_t type = JsonIndexNull;
+        ProvisioningString_t * pField = NULL;
+        const char * pValue = NULL;
+        size_t valueLength = 0U;
+        size_t token = 0U;
+        size_t i;
+        bool status = false;
+
+        assert( pResponse != NULL );
+        assert( pFields != NULL );
+
+        ( void ) memset( pFields, 0x00, sizeof( ProvisioningResponse_t ) );
+
+        /* One pass over the payload; each lookup then skips whole members. */
+        indexStatus = JsonIndex_Build( &index, ( const char * ) pResponse, length,
+                                       tokens, FLEET_PROV_SERIALIZER_JSON_TOKENS );
+
+        if( indexStatus != JsonIndexSuccess )
+        {
+            LogError( ( "Failed to parse fleet provisioning response: %d.", ( int ) indexStatus ) );
+        }
+        else
+        {
+            JsonIndex_Get( &index, JSON_INDEX_ROOT, &pValue, &valueLength, &type );
+            status = ( type == JsonIndexObject );
+
+            if( status == false )
+            {
+                LogError( ( "Fleet provisioning response is not an object." ) );
+            }
+        }
+
+        for( i = 0; ( status == true ) && ( i < RESPONSE_KEY_COUNT ); i++ )
+        {
+            if( JsonIndex_Find( &index, JSON_INDEX_ROOT, responseKeys[ i ].pKey,
+                                responseKeys[ i ].keyLength, &token ) == JsonIndexSuccess )
+            {
+                JsonIndex_Get( &index, token, &pValue, &valueLength, &type );
+
+                if( type != JsonIndexString )
+                {
+                    LogError( ( "\"%s\" is an unexpected type in fleet provisioning response.",
+                                responseKeys[ i ].pKey ) );
+                    status = false;
+                }
+                else
+                {
+                    pField = RESPONSE_FIELD( pFields, i );
+                    pField->pString = pValue;
+                    pField->length = valueLength;
+                    status = unescapeInPlace( pField );
+                }
+            }
+        }
+
+        return( ( status == true ) &&
+                terminateFields( pResponse, bufferLength, pFields ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    const ProvisioningPayloadFormat_t provisioningPayloadJson =
+    {
+        .pName                        = "JSON",
+        .generateCsrRequest           = jsonGenerateCsrRequest,
+        .generateRegisterThingRequest = jsonGenerateRegisterThingRequest,
+        .parseResponse                = jsonParseResponse
+    };
+
+/*-----------------------------------------------------------*/
+
+#endif /* if FLEET_PROV_SERIALIZER_JSON */
+
+static bool terminateFields( uint8_t * pResponse,
+                             size_t bufferLength,
+                             ProvisioningResponse_t * pFields )
+{
+    ProvisioningString_t * pFirst = &( pFields->certificatePem );
+    size_t i;
+    size_t end;
+    bool status = true;
+
+    for( i = 0; i < ( sizeof( ProvisioningResponse_t ) / sizeof( ProvisioningString_t ) ); i++ )
+    {
+        if( pFirst[ i ].pString != NULL )
+        {
+            end = ( size_t ) ( pFirst[ i ].pString - ( const char * ) pResponse ) + pFirst[ i ].length;
+
+            if( end >= bufferLength )
+            {
+                LogError( ( "No room to terminate a field at the end of a fleet provisioning response." ) );
+                status = false;
+                break;
+            }
+
+            pResponse[ end ] = ( uint8_t ) '\0';
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool checkField( const ProvisioningString_t * pField,
+                        const char * pKey,
+                        const char * pApiName )
+{
+    if( pField->pString == NULL )
+    {
+        LogError( ( "\"%s\" not found in %s response.", pKey, pApiName ) );
+    }
+
+    return( pField->pString != NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+bool generateCsrRequest( uint8_t * pBuffer,
+                         size_t bufferLength,
+                         const char * pCsr,
+                         size_t csrLength,
+                         size_t * pOutLengthWritten )
+{
+    return PROVISIONING_PAYLOAD_FORMAT->generateCsrRequest( pBuffer, bufferLength, pCsr, csrLength,
+                                                            pOutLengthWritten );
+}
+
+/*-----------------------------------------------------------*/
+
+bool generateRegisterThingRequest( uint8_t * pBuffer,
+                                   size_t bufferLength,
+                                   const char * pCertificateOwnershipToken,
+                                   size_t certificateOwnershipTokenLength,
+                                   const char * pSerial,
+                                   size_t serialLength,
+                                   size_t * pOutLengthWritten )
+{
+    return PROVISIONING_PAYLOAD_FORMAT->generateRegisterThingRequest( pBuffer, bufferLength,
+                                                                      pCertificateOwnershipToken,
+                                                                      certificateOwnershipTokenLength,
+                                                                      pSerial, serialLength,
+                                                                      pOutLengthWritten );
+}
+
+/*-----------------------------------------------------------*/
+
+bool parseProvisioningResponse( uint8_t * pResponse,
+                                size_t length,
+                                size_t bufferLength,
+                                ProvisioningResponse_t * pFields )
+{
+    return PROVISIONING_PAYLOAD_FORMAT->parseResponse( pResponse, length, bufferLength, pFields );
+}
+
+/*-----------------------------------------------------------*/
+
+bool parseKeyCertResponse( uint8_t * pResponse,
+                           size_t length,
+                           size_t bufferLength,
+                           ProvisioningResponse_t * pFields )
+{
+    return( parseProvisioningResponse( pResponse, length, bufferLength, pFields ) &&
+            checkField( &( pFields->certificatePem ), "certificatePem", "CreateKeysAndCertificate" ) &&
+            checkField( &( pFields->certificateId ), "certificateId", "CreateKeysAndCertificate" ) &&
+            checkField( &( pFields->certificateOwnershipToken ), "certificateOwnershipToken", "CreateKeysAndCertificate" ) &&
+            checkField( &( pFields->privateKey ), "privateKey", "CreateKeysAndCertificate" ) );
+}
+
+/*-----------------------------------------------------------*/
+
+bool parseCsrResponse( uint8_t * pResponse,
+                       size_t length,
+                       size_t bufferLength,
+                       ProvisioningResponse_t * pFields )
+{
+    return( parseProvisioningResponse( pResponse, length, bufferLength, pFields ) &&
+            checkField( &( pFields->certificatePem ), "certificatePem", "CreateCertificateFromCsr" ) &&
+            checkField( &( pFields->certificateId ), "certificateId", "CreateCertificateFromCsr" ) &&
+            checkField( &( pFields->certificateOwnershipToken ), "certificateOwnershipToken", "CreateCertificateFromCsr" ) );
+}
+
+/*-----------------------------------------------------------*/
+
+bool parseRegisterThingResponse( uint8_t * pResponse,
+                                 size_t length,
+                                 size_t bufferLength,
+                                 ProvisioningResponse_t * pFields )
+{
+    return( parseProvisioningResponse( pResponse, length, bufferLength, pFields ) &&
+            checkField( &( pFields->thingName ), "thingName", "RegisterThing" ) );
+}
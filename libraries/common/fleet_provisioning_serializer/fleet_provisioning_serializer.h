@@ -0,0 +1,282 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fleet_provisioning_serializer.h
+ * @brief Serialize fleet provisioning requests and parse their responses in
+ * CBOR or JSON.
+ *
+ * The format is chosen with FLEET_PROV_PAYLOAD_JSON, and the topics of the
+ * same format are named with #FP_FORMAT and #FP_FORMAT_TOPIC, so a demo
+ * builds with either. CBOR takes tinyCBOR; JSON takes json_writer and
+ * json_index, which the Jobs and Shadow demos use already.
+ *
+ * The parsers don't copy. A response is walked once, and each field is
+ * returned as a view into the buffer the response was received in, which is
+ * NUL-terminated in place so that PEM strings can be handed to mbedTLS or
+ * stored as they are. JSON strings are also unescaped in place. The views
+ * are valid as long as that buffer isn't reused.
+ */
+
+#ifndef FLEET_PROVISIONING_SERIALIZER_H_
+#define FLEET_PROVISIONING_SERIALIZER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the payloads are JSON, instead of CBOR.
+ */
+#ifndef FLEET_PROV_PAYLOAD_JSON
+    #ifdef CONFIG_FLEET_PROV_PAYLOAD_JSON
+        #define FLEET_PROV_PAYLOAD_JSON    1
+    #else
+        #define FLEET_PROV_PAYLOAD_JSON    0
+    #endif
+#endif
+
+/**
+ * @brief Whether both formats are built, for the benchmark comparing them.
+ */
+#ifndef FLEET_PROV_SERIALIZER_BENCHMARK
+    #ifdef CONFIG_FLEET_PROV_SERIALIZER_BENCHMARK
+        #define FLEET_PROV_SERIALIZER_BENCHMARK    1
+    #else
+        #define FLEET_PROV_SERIALIZER_BENCHMARK    0
+    #endif
+#endif
+
+/**
+ * @brief The formats built.
+ */
+#define FLEET_PROV_SERIALIZER_CBOR    ( ( FLEET_PROV_PAYLOAD_JSON == 0 ) || ( FLEET_PROV_SERIALIZER_BENCHMARK != 0 ) )
+#define FLEET_PROV_SERIALIZER_JSON    ( ( FLEET_PROV_PAYLOAD_JSON != 0 ) || ( FLEET_PROV_SERIALIZER_BENCHMARK != 0 ) )
+
+/**
+ * @brief The tokens the JSON parser indexes a response with, on the stack of
+ * the parsing task. A response of n members takes 2n + 1, more with
+ * "deviceConfiguration" in a RegisterThing response.
+ */
+#ifndef FLEET_PROV_SERIALIZER_JSON_TOKENS
+    #ifdef CONFIG_FLEET_PROV_SERIALIZER_JSON_TOKENS
+        #define FLEET_PROV_SERIALIZER_JSON_TOKENS    CONFIG_FLEET_PROV_SERIALIZER_JSON_TOKENS
+    #else
+        #define FLEET_PROV_SERIALIZER_JSON_TOKENS    48
+    #endif
+#endif
+
+/**
+ * @brief A macro of fleet_provisioning.h in the selected format, such as
+ * `FP_FORMAT( CREATE_CERT_PUBLISH_TOPIC )` for
+ * `FP_CBOR_CREATE_CERT_PUBLISH_TOPIC` or `FP_JSON_CREATE_CERT_PUBLISH_TOPIC`.
+ */
+#if FLEET_PROV_PAYLOAD_JSON
+    #define FP_FORMAT( name )          FP_JSON_ ## name
+#else
+    #define FP_FORMAT( name )          FP_CBOR_ ## name
+#endif
+
+/**
+ * @brief A FleetProvisioningTopic_t in the selected format, such as
+ * `FP_FORMAT_TOPIC( RegisterThingAccepted )` for
+ * `FleetProvCborRegisterThingAccepted` or `FleetProvJsonRegisterThingAccepted`.
+ */
+#if FLEET_PROV_PAYLOAD_JSON
+    #define FP_FORMAT_TOPIC( name )    FleetProvJson ## name
+#else
+    #define FP_FORMAT_TOPIC( name )    FleetProvCbor ## name
+#endif
+
+/**
+ * @brief A text string field of a response, in the response buffer.
+ */
+typedef struct ProvisioningString
+{
+    const char * pString; /**< NUL-terminated value, or NULL if the field is absent. */
+    size_t length;        /**< Length of the value, without the terminator. */
+} ProvisioningString_t;
+
+/**
+ * @brief The fields of the fleet provisioning responses used by the demos.
+ * A response only has some of them.
+ */
+typedef struct ProvisioningResponse
+{
+    ProvisioningString_t certificatePem;
+    ProvisioningString_t certificateId;
+    ProvisioningString_t certificateOwnershipToken;
+    ProvisioningString_t privateKey;
+    ProvisioningString_t thingName;
+} ProvisioningResponse_t;
+
+/**
+ * @brief The serializer and parser of one payload format.
+ *
+ * The functions below use the selected format; the benchmark calls the
+ * formats through these.
+ */
+typedef struct ProvisioningPayloadFormat
+{
+    const char * pName;
+
+    bool ( * generateCsrRequest )( uint8_t * pBuffer,
+                                   size_t bufferLength,
+                                   const char * pCsr,
+                                   size_t csrLength,
+                                   size_t * pOutLengthWritten );
+
+    bool ( * generateRegisterThingRequest )( uint8_t * pBuffer,
+                                             size_t bufferLength,
+                                             const char * pCertificateOwnershipToken,
+                                             size_t certificateOwnershipTokenLength,
+                                             const char * pSerial,
+                                             size_t serialLength,
+                                             size_t * pOutLengthWritten );
+
+    bool ( * parseResponse )( uint8_t * pResponse,
+                              size_t length,
+                              size_t bufferLength,
+                              ProvisioningResponse_t * pFields );
+} ProvisioningPayloadFormat_t;
+
+#if FLEET_PROV_SERIALIZER_CBOR
+    extern const ProvisioningPayloadFormat_t provisioningPayloadCbor;
+#endif
+
+#if FLEET_PROV_SERIALIZER_JSON
+    extern const ProvisioningPayloadFormat_t provisioningPayloadJson;
+#endif
+
+/**
+ * @brief The selected format.
+ */
+#if FLEET_PROV_PAYLOAD_JSON
+    #define PROVISIONING_PAYLOAD_FORMAT    ( &provisioningPayloadJson )
+#else
+    #define PROVISIONING_PAYLOAD_FORMAT    ( &provisioningPayloadCbor )
+#endif
+
+/**
+ * @brief Creates the request payload to be published to the
+ * CreateCertificateFromCsr API in order to request a certificate from AWS IoT
+ * for the included Certificate Signing Request (CSR).
+ *
+ * @param[in] pBuffer Buffer into which to write the publish request payload.
+ * @param[in] bufferLength Length of #pBuffer.
+ * @param[in] pCsr The CSR to include in the request payload.
+ * @param[in] csrLength The length of #pCsr.
+ * @param[out] pOutLengthWritten The length of the publish request payload.
+ */
+bool generateCsrRequest( uint8_t * pBuffer,
+                         size_t bufferLength,
+                         const char * pCsr,
+                         size_t csrLength,
+                         size_t * pOutLengthWritten );
+
+/**
+ * @brief Creates the request payload to be published to the RegisterThing API
+ * in order to activate the provisioned certificate and receive a Thing name.
+ *
+ * @param[in] pBuffer Buffer into which to write the publish request payload.
+ * @param[in] bufferLength Length of #pBuffer.
+ * @param[in] pCertificateOwnershipToken The certificate's certificate
+ * ownership token. Must not be in #pBuffer.
+ * @param[in] certificateOwnershipTokenLength Length of
+ * #pCertificateOwnershipToken.
+ * @param[in] pSerial The serial number of the device.
+ * @param[in] serialLength Length of #pSerial.
+ * @param[out] pOutLengthWritten The length of the publish request payload.
+ */
+bool generateRegisterThingRequest( uint8_t * pBuffer,
+                                   size_t bufferLength,
+                                   const char * pCertificateOwnershipToken,
+                                   size_t certificateOwnershipTokenLength,
+                                   const char * pSerial,
+                                   size_t serialLength,
+                                   size_t * pOutLengthWritten );
+
+/**
+ * @brief Extracts every known field of a fleet provisioning response in one
+ * pass over its map. Unknown keys, such as "deviceConfiguration", are skipped.
+ *
+ * Once the map is parsed, the byte after each field found is overwritten with
+ * a NUL terminator, and JSON strings are unescaped, so the response can't be
+ * parsed again.
+ *
+ * @param[in,out] pResponse The response payload.
+ * @param[in] length Length of the payload.
+ * @param[in] bufferLength Size of the buffer holding the payload. It must be
+ * larger than #length, to terminate a field at the end of the payload.
+ * @param[out] pFields The fields found. Absent fields have a NULL string.
+ *
+ * @return True if the response is a map whose known fields are all text
+ * strings.
+ */
+bool parseProvisioningResponse( uint8_t * pResponse,
+                                size_t length,
+                                size_t bufferLength,
+                                ProvisioningResponse_t * pFields );
+
+/**
+ * @brief Extracts the certificate, certificate ID, certificate ownership
+ * token and private key from a CreateKeysAndCertificate accepted response.
+ *
+ * See #parseProvisioningResponse for the parameters.
+ *
+ * @return True if the response has all four fields.
+ */
+bool parseKeyCertResponse( uint8_t * pResponse,
+                           size_t length,
+                           size_t bufferLength,
+                           ProvisioningResponse_t * pFields );
+
+/**
+ * @brief Extracts the certificate, certificate ID, and certificate ownership
+ * token from a CreateCertificateFromCsr accepted response.
+ *
+ * See #parseProvisioningResponse for the parameters.
+ *
+ * @return True if the response has all three fields.
+ */
+bool parseCsrResponse( uint8_t * pResponse,
+                       size_t length,
+                       size_t bufferLength,
+                       ProvisioningResponse_t * pFields );
+
+/**
+ * @brief Extracts the Thing name from a RegisterThing accepted response.
+ *
+ * See #parseProvisioningResponse for the parameters.
+ *
+ * @return True if the response has a Thing name.
+ */
+bool parseRegisterThingResponse( uint8_t * pResponse,
+                                 size_t length,
+                                 size_t bufferLength,
+                                 ProvisioningResponse_t * pFields );
+
+#endif /* ifndef FLEET_PROVISIONING_SERIALIZER_H_ */
@@ -0,0 +1,818 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/**
+ * @file http_connection_pool.c
+ * @brief Implementation of the HTTP connection pool.
+ *
+ * Every slot of the pool holds a network context and the transport interface
+ * handed out for it. A slot is only touched by the task that owns it: the
+ * caller it is handed out to, or the pool task while it reconnects or closes
+ * it. The mutex guards the state of the slots, not the connections, so no
+ * connect or disconnect is done while holding it.
+ *
+ * The pool task reconnects the connections released with
+ * HttpConnectionReconnect, backing off while the server can't be reached. It
+ * also checks that the unused connections are still open, reconnecting those
+ * the server has closed, until they have been unused for
+ * HTTP_CONNECTION_POOL_KEEP_WARM_MS.
+ */
+
+/* Standard includes. */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the HTTP connection pool. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "HTTP Connection Pool"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Include backoff algorithm header for retry logic. */
+#include "backoff_algorithm.h"
+
+/* Include clock header for millisecond time. */
+#include "clock.h"
+
+#include "http_connection_pool.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The maximum number of background connects to a server that fail in
+ * a row before the pool stops reconnecting to it.
+ */
+#define RECONNECT_MAX_ATTEMPTS            ( 5U )
+
+/**
+ * @brief The maximum back-off delay (in milliseconds) between background connects.
+ */
+#define RECONNECT_MAX_BACKOFF_DELAY_MS    ( 5000U )
+
+/**
+ * @brief The base back-off delay (in milliseconds) between background connects.
+ */
+#define RECONNECT_BACKOFF_BASE_MS         ( 500U )
+
+/**
+ * @brief The length of the longest host name, with its terminating NUL.
+ */
+#define HOST_NAME_LENGTH                  ( 256U )
+
+/**
+ * @brief Stack size of the pool task, which runs TLS handshakes.
+ */
+#define POOL_TASK_STACK_SIZE              CONFIG_HTTP_CONNECTION_POOL_TASK_STACK_SIZE
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The state of a slot of the pool.
+ */
+typedef enum PoolSlotState
+{
+    PoolSlotFree,      /**< @brief No server. */
+    PoolSlotIdle,      /**< @brief Connected and unused. */
+    PoolSlotInUse,     /**< @brief Handed out, or being connected for the caller that took it. */
+    PoolSlotStale,     /**< @brief Disconnected, to be reconnected by the pool task at retryAtMs. */
+    PoolSlotRefreshing /**< @brief Being reconnected or closed by the pool task. */
+} PoolSlotState_t;
+
+/**
+ * @brief A slot of the pool.
+ */
+typedef struct PoolSlot
+{
+    PoolSlotState_t state;
+    bool closeRequested;                /**< @brief Close the connection instead of keeping it once the owner is done. */
+    char host[ HOST_NAME_LENGTH ];      /**< @brief The server, along with networkContext.xPort. */
+    NetworkContext_t networkContext;
+    StaticSemaphore_t contextSemaphoreBuffer;
+    TransportInterface_t transport;
+    uint32_t lastUsedMs;                /**< @brief When the connection was last released. */
+    uint32_t retryAtMs;                 /**< @brief When to reconnect a stale slot. */
+    BackoffAlgorithmContext_t backoff;  /**< @brief Back-off of the background connects. */
+} PoolSlot_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The slots of the pool.
+ */
+static PoolSlot_t poolSlots[ HTTP_CONNECTION_POOL_SIZE ];
+
+/**
+ * @brief The counters of the pool, guarded by poolMutex.
+ */
+static HttpConnectionPoolStats_t poolStats;
+
+/**
+ * @brief Guards the state of the slots.
+ */
+static pthread_mutex_t poolMutex;
+
+/**
+ * @brief Signalled whenever the state of a slot changes, for the pool task
+ * and for the callers waiting for a connection.
+ */
+static pthread_cond_t poolCond;
+
+/**
+ * @brief Sets up the pool on first use.
+ */
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Wait for poolCond for up to waitMs milliseconds. Called with the mutex held.
+ */
+static void waitForChange( uint32_t waitMs )
+{
+    struct timespec deadline;
+
+    ( void ) clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_sec += ( time_t ) ( waitMs / 1000U );
+    deadline.tv_nsec += ( long ) ( waitMs % 1000U ) * 1000000L;
+
+    if( deadline.tv_nsec >= 1000000000L )
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    ( void ) pthread_cond_timedwait( &poolCond, &poolMutex, &deadline );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether a slot holds the server of pSettings.
+ */
+static bool isServer( const PoolSlot_t * pSlot,
+                      const NetworkContext_t * pSettings )
+{
+    return ( pSlot->state != PoolSlotFree ) &&
+           ( pSlot->networkContext.xPort == pSettings->xPort ) &&
+           ( strcmp( pSlot->host, pSettings->pcHostname ) == 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Set the credentials of a slot to those of pSettings, to connect to
+ * its server. Called by the owner of the slot.
+ *
+ * @param[in] pSlot The slot, already keyed to the server.
+ * @param[in] pSettings The server and the credentials.
+ * @param[in] newServer Whether the slot held another server before.
+ */
+static void setCredentials( PoolSlot_t * pSlot,
+                            const NetworkContext_t * pSettings,
+                            bool newServer )
+{
+    NetworkContext_t * pContext = &pSlot->networkContext;
+
+    /* A session is only resumed with the server it was negotiated with. */
+    if( newServer && ( pContext->pxTlsSession != NULL ) )
+    {
+        vTlsSessionClear( pContext );
+    }
+
+    pContext->pcHostname = pSlot->host;
+    pContext->pcServerRootCAPem = pSettings->pcServerRootCAPem;
+    pContext->pcClientCertPem = pSettings->pcClientCertPem;
+    pContext->pcClientKeyPem = pSettings->pcClientKeyPem;
+    pContext->uxServerRootCALength = pSettings->uxServerRootCALength;
+    pContext->uxClientCertLength = pSettings->uxClientCertLength;
+    pContext->uxClientKeyLength = pSettings->uxClientKeyLength;
+    pContext->use_secure_element = pSettings->use_secure_element;
+    pContext->ds_data = pSettings->ds_data;
+    pContext->pAlpnProtos = pSettings->pAlpnProtos;
+    pContext->disableSni = pSettings->disableSni;
+    pContext->xPlainTcp = pSettings->xPlainTcp;
+    pContext->ulConnectTimeoutMs = pSettings->ulConnectTimeoutMs;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Open the connection of a slot. Called by the owner of the slot.
+ */
+static bool openConnection( PoolSlot_t * pSlot )
+{
+    TlsTransportStatus_t tlsStatus;
+
+    LogInfo( ( "Establishing a TLS session with %s:%d.",
+               pSlot->host,
+               pSlot->networkContext.xPort ) );
+
+    tlsStatus = xTlsConnect( &pSlot->networkContext );
+
+    if( tlsStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        LogWarn( ( "Failed to connect to %s:%d: status %d.",
+                   pSlot->host,
+                   pSlot->networkContext.xPort,
+                   tlsStatus ) );
+    }
+
+    return tlsStatus == TLS_TRANSPORT_SUCCESS;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Close the connection of a slot, if it is open. Called by the owner of the slot.
+ */
+static void closeConnection( PoolSlot_t * pSlot )
+{
+    if( pSlot->networkContext.pxTls != NULL )
+    {
+        ( void ) xTlsDisconnect( &pSlot->networkContext );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether the unused connection of a slot is still open.
+ *
+ * Nothing is expected from the server between requests. Data waiting on the
+ * connection is either part of a response that wasn't read in full, or the
+ * server closing it.
+ */
+static bool isAlive( PoolSlot_t * pSlot )
+{
+    esp_tls_t * pTls = pSlot->networkContext.pxTls;
+    int sockFd = -1;
+    uint8_t byte;
+    bool alive = false;
+
+    if( ( pTls != NULL ) &&
+        ( esp_tls_get_bytes_avail( pTls ) == 0 ) &&
+        ( esp_tls_get_conn_sockfd( pTls, &sockFd ) == ESP_OK ) )
+    {
+        alive = ( recv( sockFd, &byte, 1, MSG_PEEK | MSG_DONTWAIT ) < 0 ) &&
+                ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) );
+    }
+
+    return alive;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Mark a slot to be reconnected by the pool task. Called with the mutex held.
+ */
+static void markStale( PoolSlot_t * pSlot )
+{
+    pSlot->state = PoolSlotStale;
+    pSlot->retryAtMs = Clock_GetTimeMs();
+    BackoffAlgorithm_InitializeParams( &pSlot->backoff,
+                                       RECONNECT_BACKOFF_BASE_MS,
+                                       RECONNECT_MAX_BACKOFF_DELAY_MS,
+                                       RECONNECT_MAX_ATTEMPTS );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Mark a slot as free. Called with the mutex held.
+ */
+static void markFree( PoolSlot_t * pSlot )
+{
+    pSlot->state = PoolSlotFree;
+    pSlot->closeRequested = false;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reconnect a stale slot the pool task has taken, backing off if
+ * the connect fails. Called with the mutex held, which is released while
+ * connecting.
+ */
+static void refreshSlot( PoolSlot_t * pSlot )
+{
+    uint16_t nextRetryBackOff = 0U;
+    bool connected;
+
+    ( void ) pthread_mutex_unlock( &poolMutex );
+    connected = openConnection( pSlot );
+    ( void ) pthread_mutex_lock( &poolMutex );
+
+    if( connected && pSlot->closeRequested )
+    {
+        /* Closed with HttpConnectionPool_CloseIdle while connecting. */
+        ( void ) pthread_mutex_unlock( &poolMutex );
+        closeConnection( pSlot );
+        ( void ) pthread_mutex_lock( &poolMutex );
+        markFree( pSlot );
+    }
+    else if( connected )
+    {
+        poolStats.reconnects++;
+        pSlot->state = PoolSlotIdle;
+    }
+    else if( pSlot->closeRequested )
+    {
+        markFree( pSlot );
+    }
+    else
+    {
+        poolStats.failures++;
+
+        if( BackoffAlgorithm_GetNextBackoff( &pSlot->backoff, ( uint32_t ) rand(), &nextRetryBackOff ) == BackoffAlgorithmSuccess )
+        {
+            pSlot->state = PoolSlotStale;
+            pSlot->retryAtMs = Clock_GetTimeMs() + nextRetryBackOff;
+        }
+        else
+        {
+            LogError( ( "Failed to reconnect to %s:%d, all attempts exhausted.",
+                        pSlot->host,
+                        pSlot->networkContext.xPort ) );
+            markFree( pSlot );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Close the unused connection of a slot the pool task has taken.
+ * Called with the mutex held, which is released while disconnecting.
+ */
+static void retireSlot( PoolSlot_t * pSlot )
+{
+    LogInfo( ( "Closing the connection to %s:%d, unused for %u ms.",
+               pSlot->host,
+               pSlot->networkContext.xPort,
+               ( unsigned ) ( Clock_GetTimeMs() - pSlot->lastUsedMs ) ) );
+
+    ( void ) pthread_mutex_unlock( &poolMutex );
+    closeConnection( pSlot );
+    ( void ) pthread_mutex_lock( &poolMutex );
+
+    markFree( pSlot );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Task reconnecting stale slots and retiring unused connections.
+ */
+static void * poolTask( void * pParam )
+{
+    PoolSlot_t * pSlot;
+    uint32_t nowMs;
+    uint32_t waitMs;
+    uint32_t i;
+    bool retire;
+
+    ( void ) pParam;
+
+    ( void ) pthread_mutex_lock( &poolMutex );
+
+    for( ; ; )
+    {
+        nowMs = Clock_GetTimeMs();
+        waitMs = HTTP_CONNECTION_POOL_CHECK_MS;
+        pSlot = NULL;
+        retire = false;
+
+        for( i = 0; ( pSlot == NULL ) && ( i < HTTP_CONNECTION_POOL_SIZE ); i++ )
+        {
+            if( poolSlots[ i ].state == PoolSlotStale )
+            {
+                if( ( int32_t ) ( poolSlots[ i ].retryAtMs - nowMs ) <= 0 )
+                {
+                    pSlot = &poolSlots[ i ];
+                }
+                else
+                {
+                    waitMs = MIN( waitMs, poolSlots[ i ].retryAtMs - nowMs );
+                }
+            }
+            else if( poolSlots[ i ].state == PoolSlotIdle )
+            {
+                if( ( nowMs - poolSlots[ i ].lastUsedMs ) >= HTTP_CONNECTION_POOL_KEEP_WARM_MS )
+                {
+                    pSlot = &poolSlots[ i ];
+                    retire = true;
+                }
+                else if( !isAlive( &poolSlots[ i ] ) )
+                {
+                    /* Its socket is closed below, once the slot is taken. */
+                    LogInfo( ( "The connection to %s:%d was closed by the server.",
+                               poolSlots[ i ].host,
+                               poolSlots[ i ].networkContext.xPort ) );
+                    poolStats.stale++;
+                    pSlot = &poolSlots[ i ];
+                }
+            }
+        }
+
+        if( pSlot == NULL )
+        {
+            waitForChange( waitMs );
+        }
+        else
+        {
+            if( !retire && ( pSlot->state == PoolSlotIdle ) )
+            {
+                pSlot->state = PoolSlotRefreshing;
+                ( void ) pthread_mutex_unlock( &poolMutex );
+                closeConnection( pSlot );
+                ( void ) pthread_mutex_lock( &poolMutex );
+                markStale( pSlot );
+            }
+
+            pSlot->state = PoolSlotRefreshing;
+
+            if( retire )
+            {
+                retireSlot( pSlot );
+            }
+            else
+            {
+                refreshSlot( pSlot );
+            }
+
+            ( void ) pthread_cond_broadcast( &poolCond );
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Set up the slots and start the pool task.
+ */
+static void poolInit( void )
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    uint32_t i;
+    int ret;
+
+    ( void ) pthread_mutex_init( &poolMutex, NULL );
+    ( void ) pthread_cond_init( &poolCond, NULL );
+
+    memset( poolSlots, 0x00, sizeof( poolSlots ) );
+
+    for( i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        poolSlots[ i ].networkContext.xTlsContextSemaphore = xSemaphoreCreateMutexStatic( &poolSlots[ i ].contextSemaphoreBuffer );
+        poolSlots[ i ].transport.send = espTlsTransportSend;
+        poolSlots[ i ].transport.recv = espTlsTransportRecv;
+        poolSlots[ i ].transport.pNetworkContext = &poolSlots[ i ].networkContext;
+    }
+
+    ( void ) pthread_attr_init( &attr );
+    ( void ) pthread_attr_setstacksize( &attr, POOL_TASK_STACK_SIZE );
+    ( void ) pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    ret = pthread_create( &thread, &attr, poolTask, NULL );
+    ( void ) pthread_attr_destroy( &attr );
+
+    /* Connections are still handed out, but only reconnected on demand. */
+    if( ret != 0 )
+    {
+        LogError( ( "Failed to start the connection pool task: %d.", ret ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take a slot for the server of pSettings. Called with the mutex held.
+ *
+ * @param[in] pSettings The server.
+ * @param[out] pNeedsConnect Set if the connection of the slot has to be opened.
+ * @param[out] pNewServer Set if the slot held another server, which its
+ * connection has to be closed to.
+ *
+ * @return The slot, marked in use, or NULL if the caller has to wait.
+ */
+static PoolSlot_t * takeSlot( const NetworkContext_t * pSettings,
+                              bool * pNeedsConnect,
+                              bool * pNewServer )
+{
+    PoolSlot_t * pSlot = NULL;
+    PoolSlot_t * pStale = NULL;
+    PoolSlot_t * pFree = NULL;
+    PoolSlot_t * pOldest = NULL;
+    bool refreshing = false;
+    uint32_t i;
+
+    for( i = 0; ( pSlot == NULL ) && ( i < HTTP_CONNECTION_POOL_SIZE ); i++ )
+    {
+        if( isServer( &poolSlots[ i ], pSettings ) )
+        {
+            if( poolSlots[ i ].state == PoolSlotIdle )
+            {
+                pSlot = &poolSlots[ i ];
+            }
+            else if( poolSlots[ i ].state == PoolSlotStale )
+            {
+                pStale = &poolSlots[ i ];
+            }
+            else if( poolSlots[ i ].state == PoolSlotRefreshing )
+            {
+                refreshing = true;
+            }
+        }
+        else if( poolSlots[ i ].state == PoolSlotFree )
+        {
+            pFree = &poolSlots[ i ];
+        }
+        else if( ( ( poolSlots[ i ].state == PoolSlotIdle ) || ( poolSlots[ i ].state == PoolSlotStale ) ) &&
+                 ( ( pOldest == NULL ) || ( ( int32_t ) ( poolSlots[ i ].lastUsedMs - pOldest->lastUsedMs ) < 0 ) ) )
+        {
+            pOldest = &poolSlots[ i ];
+        }
+    }
+
+    /* An open connection is checked by the caller. A connection the pool task
+     * is opening is waited for, as it is quicker than opening another one. */
+    *pNeedsConnect = ( pSlot == NULL );
+    *pNewServer = false;
+
+    if( pSlot != NULL )
+    {
+        /* Taken as it is. */
+    }
+    else if( pStale != NULL )
+    {
+        pSlot = pStale;
+    }
+    else if( !refreshing )
+    {
+        pSlot = ( pFree != NULL ) ? pFree : pOldest;
+    }
+
+    if( pSlot != NULL )
+    {
+        /* The key is read by other callers, so it is only changed with the mutex held. */
+        if( !isServer( pSlot, pSettings ) )
+        {
+            *pNewServer = ( pSlot->networkContext.xPort != pSettings->xPort ) ||
+                          ( strcmp( pSlot->host, pSettings->pcHostname ) != 0 );
+            ( void ) strcpy( pSlot->host, pSettings->pcHostname );
+            pSlot->networkContext.xPort = pSettings->xPort;
+        }
+
+        pSlot->state = PoolSlotInUse;
+        pSlot->closeRequested = false;
+    }
+
+    return pSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+const TransportInterface_t * HttpConnectionPool_Acquire( const NetworkContext_t * pSettings,
+                                                         uint32_t timeoutMs )
+{
+    PoolSlot_t * pSlot = NULL;
+    uint32_t startMs = Clock_GetTimeMs();
+    uint32_t elapsedMs = 0U;
+    bool needsConnect = false;
+    bool newServer = false;
+    bool connected = false;
+
+    if( ( pSettings == NULL ) || ( pSettings->pcHostname == NULL ) ||
+        ( strlen( pSettings->pcHostname ) >= HOST_NAME_LENGTH ) )
+    {
+        LogError( ( "Invalid server for a pooled connection." ) );
+        return NULL;
+    }
+
+    ( void ) pthread_once( &poolOnce, poolInit );
+
+    ( void ) pthread_mutex_lock( &poolMutex );
+
+    for( pSlot = takeSlot( pSettings, &needsConnect, &newServer );
+         ( pSlot == NULL ) && ( elapsedMs < timeoutMs );
+         pSlot = takeSlot( pSettings, &needsConnect, &newServer ) )
+    {
+        waitForChange( timeoutMs - elapsedMs );
+        elapsedMs = Clock_GetTimeMs() - startMs;
+    }
+
+    if( pSlot == NULL )
+    {
+        poolStats.timeouts++;
+        LogWarn( ( "No connection to %s:%d within %u ms.",
+                   pSettings->pcHostname,
+                   pSettings->xPort,
+                   ( unsigned ) timeoutMs ) );
+    }
+
+    ( void ) pthread_mutex_unlock( &poolMutex );
+
+    if( pSlot != NULL )
+    {
+        /* The slot is owned by the caller now. */
+        if( !needsConnect && !isAlive( pSlot ) )
+        {
+            LogInfo( ( "The connection to %s:%d was closed by the server.",
+                       pSlot->host,
+                       pSlot->networkContext.xPort ) );
+            needsConnect = true;
+        }
+
+        if( needsConnect )
+        {
+            closeConnection( pSlot );
+            setCredentials( pSlot, pSettings, newServer );
+            connected = openConnection( pSlot );
+        }
+        else
+        {
+            connected = true;
+        }
+
+        ( void ) pthread_mutex_lock( &poolMutex );
+
+        if( connected )
+        {
+            poolStats.acquires++;
+
+            if( needsConnect )
+            {
+                poolStats.connects++;
+            }
+            else
+            {
+                poolStats.reuses++;
+            }
+        }
+        else
+        {
+            poolStats.failures++;
+            markFree( pSlot );
+            ( void ) pthread_cond_broadcast( &poolCond );
+            pSlot = NULL;
+        }
+
+        ( void ) pthread_mutex_unlock( &poolMutex );
+    }
+
+    return ( pSlot != NULL ) ? &pSlot->transport : NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void HttpConnectionPool_Release( const TransportInterface_t * pTransport,
+                                 HttpConnectionRelease_t release )
+{
+    PoolSlot_t * pSlot = NULL;
+    uint32_t i;
+
+    for( i = 0; ( pSlot == NULL ) && ( i < HTTP_CONNECTION_POOL_SIZE ); i++ )
+    {
+        if( pTransport == &poolSlots[ i ].transport )
+        {
+            pSlot = &poolSlots[ i ];
+        }
+    }
+
+    if( pSlot == NULL )
+    {
+        LogError( ( "Released a transport that is not from the pool." ) );
+    }
+    else
+    {
+        ( void ) pthread_mutex_lock( &poolMutex );
+
+        if( pSlot->closeRequested )
+        {
+            release = HttpConnectionClose;
+        }
+
+        pSlot->lastUsedMs = Clock_GetTimeMs();
+
+        ( void ) pthread_mutex_unlock( &poolMutex );
+
+        if( release != HttpConnectionReuse )
+        {
+            closeConnection( pSlot );
+        }
+
+        ( void ) pthread_mutex_lock( &poolMutex );
+
+        if( pSlot->closeRequested || ( release == HttpConnectionClose ) )
+        {
+            if( pSlot->networkContext.pxTls != NULL )
+            {
+                /* Closed with HttpConnectionPool_CloseIdle meanwhile. */
+                pSlot->state = PoolSlotRefreshing;
+                retireSlot( pSlot );
+            }
+
+            markFree( pSlot );
+        }
+        else if( release == HttpConnectionReconnect )
+        {
+            markStale( pSlot );
+        }
+        else
+        {
+            pSlot->state = PoolSlotIdle;
+        }
+
+        ( void ) pthread_cond_broadcast( &poolCond );
+        ( void ) pthread_mutex_unlock( &poolMutex );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void HttpConnectionPool_CloseIdle( const NetworkContext_t * pSettings )
+{
+    PoolSlot_t * pSlot;
+    uint32_t i;
+
+    ( void ) pthread_once( &poolOnce, poolInit );
+
+    ( void ) pthread_mutex_lock( &poolMutex );
+
+    for( i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        pSlot = &poolSlots[ i ];
+
+        if( ( pSlot->state == PoolSlotFree ) ||
+            ( ( pSettings != NULL ) && ( ( pSettings->pcHostname == NULL ) || !isServer( pSlot, pSettings ) ) ) )
+        {
+            /* Nothing to close. */
+        }
+        else if( pSlot->state == PoolSlotIdle )
+        {
+            pSlot->state = PoolSlotRefreshing;
+            retireSlot( pSlot );
+        }
+        else if( pSlot->state == PoolSlotStale )
+        {
+            markFree( pSlot );
+        }
+        else
+        {
+            /* Closed by its owner. */
+            pSlot->closeRequested = true;
+        }
+    }
+
+    ( void ) pthread_cond_broadcast( &poolCond );
+    ( void ) pthread_mutex_unlock( &poolMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+void HttpConnectionPool_GetStats( HttpConnectionPoolStats_t * pStats )
+{
+    ( void ) pthread_once( &poolOnce, poolInit );
+
+    ( void ) pthread_mutex_lock( &poolMutex );
+    *pStats = poolStats;
+    ( void ) pthread_mutex_unlock( &poolMutex );
+}
+
+/*-----------------------------------------------------------*/
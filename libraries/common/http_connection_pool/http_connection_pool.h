@@ -0,0 +1,127 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_connection_pool.h
+ * @brief A pool of TLS connections to HTTP servers, kept open between requests
+ * and reconnected in the background when the server closes them.
+ *
+ * Connections are keyed by host name and port. A caller acquires a transport
+ * interface for a server, sends one or more requests over it, and releases
+ * it, telling the pool whether the connection can take the next request.
+ */
+
+#ifndef HTTP_CONNECTION_POOL_H_
+#define HTTP_CONNECTION_POOL_H_
+
+#include <stdint.h>
+
+/* Include the TLS transport, for NetworkContext_t. */
+#include "network_transport.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The number of connections the pool holds, to any servers.
+ */
+#define HTTP_CONNECTION_POOL_SIZE          CONFIG_HTTP_CONNECTION_POOL_SIZE
+
+/**
+ * @brief How long an unused connection is kept open, in milliseconds.
+ */
+#define HTTP_CONNECTION_POOL_KEEP_WARM_MS  CONFIG_HTTP_CONNECTION_POOL_KEEP_WARM_MS
+
+/**
+ * @brief How often unused connections are checked, in milliseconds.
+ */
+#define HTTP_CONNECTION_POOL_CHECK_MS      CONFIG_HTTP_CONNECTION_POOL_CHECK_MS
+
+/**
+ * @brief What becomes of a connection given back with HttpConnectionPool_Release.
+ */
+typedef enum HttpConnectionRelease
+{
+    HttpConnectionReuse,     /**< @brief Every response was read in full, keep the connection for the next request. */
+    HttpConnectionReconnect, /**< @brief The connection failed or the server closes it, open a new one in the background. */
+    HttpConnectionClose      /**< @brief The server is not needed any more, close the connection. */
+} HttpConnectionRelease_t;
+
+/**
+ * @brief Counters of the pool, as returned by HttpConnectionPool_GetStats.
+ */
+typedef struct HttpConnectionPoolStats
+{
+    uint32_t acquires;     /**< @brief Connections handed out. */
+    uint32_t reuses;       /**< @brief Connections handed out that were already open. */
+    uint32_t connects;     /**< @brief Connections opened while a caller waited. */
+    uint32_t reconnects;   /**< @brief Connections opened in the background. */
+    uint32_t stale;        /**< @brief Unused connections found closed by the server. */
+    uint32_t failures;     /**< @brief Connects that failed. */
+    uint32_t timeouts;     /**< @brief Calls to HttpConnectionPool_Acquire that found no connection in time. */
+} HttpConnectionPoolStats_t;
+
+/**
+ * @brief Get a connection to the server of pSettings.
+ *
+ * An open connection to the server is handed out if there is one, after
+ * checking that the server hasn't closed it. Otherwise a connection is opened,
+ * reusing the slot of the connection unused for longest if every slot is
+ * taken, and the call waits for it. The call also waits up to timeoutMs for
+ * a connection being opened in the background, or for a slot to be released
+ * when all of them are in use.
+ *
+ * @param[in] pSettings The server and the credentials, in the fields of a
+ * network context that xTlsConnect reads. The host name is copied; the
+ * credentials and ALPN protocols must stay valid until the connection is
+ * closed.
+ * @param[in] timeoutMs How long to wait for a slot or for a background connect.
+ *
+ * @return A transport interface for the connection, or NULL if no connection
+ * could be opened.
+ */
+const TransportInterface_t * HttpConnectionPool_Acquire( const NetworkContext_t * pSettings,
+                                                         uint32_t timeoutMs );
+
+/**
+ * @brief Give back a connection got from HttpConnectionPool_Acquire.
+ *
+ * @param[in] pTransport The transport interface of the connection.
+ * @param[in] release Whether the connection can take the next request.
+ */
+void HttpConnectionPool_Release( const TransportInterface_t * pTransport,
+                                 HttpConnectionRelease_t release );
+
+/**
+ * @brief Close the unused connections to the server of pSettings, or to every
+ * server if pSettings is NULL, and stop reconnecting to it.
+ *
+ * Connections in use are closed when they are released.
+ */
+void HttpConnectionPool_CloseIdle( const NetworkContext_t * pSettings );
+
+/**
+ * @brief Copy the counters of the pool into pStats.
+ */
+void HttpConnectionPool_GetStats( HttpConnectionPoolStats_t * pStats );
+
+#endif /* ifndef HTTP_CONNECTION_POOL_H_ */
@@ -0,0 +1,479 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_upload.c
+ * @brief Implementation of the streamed HTTP request body.
+ *
+ * HTTPClient_Send is given a transport interface of this module, whose
+ * context is the upload and which forwards to the transport of the caller.
+ * Once the last byte of the request headers has gone out, its send function
+ * sends the whole body before returning, so coreHTTP goes on to receive the
+ * response as if it had sent a request without a body. A body that fails
+ * fails that send, which coreHTTP reports as HTTPNetworkError.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <sys/param.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the HTTP upload. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "HTTP Upload"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Include clock header for millisecond time. */
+#include "clock.h"
+
+/* Include flash mapping, for the windows of the partition. */
+#include "esp_spi_flash.h"
+
+#include "http_upload.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Length of the longest chunk size line, "ffffffff\r\n".
+ */
+#define CHUNK_SIZE_LINE_LENGTH    ( 10U )
+
+/**
+ * @brief The line ending the data of a chunk, and the last chunk.
+ */
+#define CHUNK_END                 "\r\n"
+#define LAST_CHUNK                "0\r\n\r\n"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief An upload in progress, the context of its transport interface.
+ */
+typedef struct UploadContext
+{
+    const TransportInterface_t * pTransport; /**< @brief The transport of the caller. */
+    const HttpUploadSource_t * pSource;
+    HttpUploadFraming_t framing;
+    size_t headersLength;                    /**< @brief Length of the request headers. */
+    size_t headersSent;                      /**< @brief Bytes of the request headers sent so far. */
+    bool bodyStarted;                        /**< @brief Whether the body was sent, or tried. */
+    size_t bodySent;                         /**< @brief Bytes of the body sent so far. */
+} UploadContext_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends buffers in full through the vectored send of the transport.
+ *
+ * @param[in] pContext The upload.
+ * @param[in,out] pVectors The buffers, advanced past what is sent.
+ * @param[in] count The number of @a pVectors.
+ *
+ * @return false if the transport failed, or made no progress for
+ * HTTP_UPLOAD_SEND_TIMEOUT_MS.
+ */
+static bool sendVectors( UploadContext_t * pContext,
+                         TlsTransportOutVector_t * pVectors,
+                         size_t count );
+
+/**
+ * @brief Sends a part of the body, framed as a chunk with chunked framing.
+ */
+static bool sendChunk( UploadContext_t * pContext,
+                       const uint8_t * pData,
+                       size_t length );
+
+/**
+ * @brief Sends the body from the partition, mapping a window at a time.
+ */
+static bool sendFromPartition( UploadContext_t * pContext );
+
+/**
+ * @brief Sends the body from the buffer the callback fills.
+ */
+static bool sendFromCallback( UploadContext_t * pContext );
+
+/**
+ * @brief Sends the body and, with chunked framing, the last chunk.
+ */
+static bool sendBody( UploadContext_t * pContext );
+
+/**
+ * @brief The send function of the upload transport: forwards the request
+ * headers, then sends the body after their last byte.
+ */
+static int32_t uploadSend( NetworkContext_t * pNetworkContext,
+                           const void * pBuffer,
+                           size_t bytesToSend );
+
+/**
+ * @brief The receive function of the upload transport, forwarding to the
+ * transport of the caller.
+ */
+static int32_t uploadRecv( NetworkContext_t * pNetworkContext,
+                           void * pBuffer,
+                           size_t bytesToRecv );
+
+/*-----------------------------------------------------------*/
+
+static bool sendVectors( UploadContext_t * pContext,
+                         TlsTransportOutVector_t * pVectors,
+                         size_t count )
+{
+    uint32_t lastProgressMs = Clock_GetTimeMs();
+    int32_t sent;
+    size_t remaining;
+    bool status = true;
+
+    while( ( status == true ) && ( count > 0U ) )
+    {
+        sent = espTlsTransportWritev( pContext->pTransport->pNetworkContext, pVectors, count );
+
+        if( sent < 0 )
+        {
+            LogError( ( "Failed to send the request body: Error=%d.", ( int ) sent ) );
+            status = false;
+        }
+        else if( sent == 0 )
+        {
+            if( ( Clock_GetTimeMs() - lastProgressMs ) > HTTP_UPLOAD_SEND_TIMEOUT_MS )
+            {
+                LogError( ( "Timed out sending the request body after %u bytes.",
+                            ( unsigned ) pContext->bodySent ) );
+                status = false;
+            }
+        }
+        else
+        {
+            lastProgressMs = Clock_GetTimeMs();
+            remaining = ( size_t ) sent;
+
+            /* Skip the buffers sent, and what was sent of the next one. */
+            while( ( count > 0U ) && ( remaining >= pVectors->iov_len ) )
+            {
+                remaining -= pVectors->iov_len;
+                pVectors++;
+                count--;
+            }
+
+            if( count > 0U )
+            {
+                pVectors->iov_base = ( const uint8_t * ) pVectors->iov_base + remaining;
+                pVectors->iov_len -= remaining;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool sendChunk( UploadContext_t * pContext,
+                       const uint8_t * pData,
+                       size_t length )
+{
+    char sizeLine[ CHUNK_SIZE_LINE_LENGTH + 1U ];
+    TlsTransportOutVector_t vectors[ 3 ];
+    size_t count = 0U;
+    bool status;
+
+    if( pContext->framing == HttpUploadChunked )
+    {
+        vectors[ count ].iov_base = sizeLine;
+        vectors[ count ].iov_len = ( size_t ) snprintf( sizeLine, sizeof( sizeLine ), "%x\r\n", ( unsigned ) length );
+        count++;
+    }
+
+    vectors[ count ].iov_base = pData;
+    vectors[ count ].iov_len = length;
+    count++;
+
+    if( pContext->framing == HttpUploadChunked )
+    {
+        vectors[ count ].iov_base = CHUNK_END;
+        vectors[ count ].iov_len = sizeof( CHUNK_END ) - 1U;
+        count++;
+    }
+
+    status = sendVectors( pContext, vectors, count );
+
+    if( status == true )
+    {
+        pContext->bodySent += length;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool sendFromPartition( UploadContext_t * pContext )
+{
+    const HttpUploadSource_t * pSource = pContext->pSource;
+    spi_flash_mmap_handle_t mapHandle;
+    const void * pWindow = NULL;
+    size_t windowLength;
+    size_t offset;
+    size_t chunkLength;
+    esp_err_t err;
+    bool status = true;
+
+    while( ( status == true ) && ( pContext->bodySent < pSource->length ) )
+    {
+        /* The mapping is rounded out to MMU pages, so a window that isn't
+         * page-aligned may take one more page. */
+        windowLength = MIN( pSource->length - pContext->bodySent, HTTP_UPLOAD_MMAP_WINDOW );
+        err = esp_partition_mmap( pSource->pPartition, pSource->partitionOffset + pContext->bodySent,
+                                  windowLength, SPI_FLASH_MMAP_DATA, &pWindow, &mapHandle );
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Failed to map %u bytes of partition %s at %u: Error=%d.",
+                        ( unsigned ) windowLength, pSource->pPartition->label,
+                        ( unsigned ) ( pSource->partitionOffset + pContext->bodySent ), ( int ) err ) );
+            status = false;
+        }
+
+        for( offset = 0U; ( status == true ) && ( offset < windowLength ); offset += chunkLength )
+        {
+            chunkLength = MIN( windowLength - offset, HTTP_UPLOAD_CHUNK_SIZE );
+            status = sendChunk( pContext, ( const uint8_t * ) pWindow + offset, chunkLength );
+        }
+
+        if( err == ESP_OK )
+        {
+            spi_flash_munmap( mapHandle );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool sendFromCallback( UploadContext_t * pContext )
+{
+    const HttpUploadSource_t * pSource = pContext->pSource;
+    size_t toRead;
+    int32_t bytesRead = 1;
+    bool status = true;
+
+    while( ( status == true ) && ( bytesRead > 0 ) && ( pContext->bodySent < pSource->length ) )
+    {
+        toRead = MIN( pSource->length - pContext->bodySent, pSource->bufferLength );
+        bytesRead = pSource->read( pSource->pReadContext, pContext->bodySent, pSource->pBuffer, toRead );
+
+        if( ( bytesRead < 0 ) || ( ( size_t ) bytesRead > toRead ) )
+        {
+            LogError( ( "Failed to read the request body at %u: Error=%d.",
+                        ( unsigned ) pContext->bodySent, ( int ) bytesRead ) );
+            status = false;
+        }
+        else if( bytesRead == 0 )
+        {
+            /* Only a body of unknown length may end early. */
+            if( pSource->length != SIZE_MAX )
+            {
+                LogError( ( "The request body ended after %u of %u bytes.",
+                            ( unsigned ) pContext->bodySent, ( unsigned ) pSource->length ) );
+                status = false;
+            }
+        }
+        else
+        {
+            status = sendChunk( pContext, pSource->pBuffer, ( size_t ) bytesRead );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool sendBody( UploadContext_t * pContext )
+{
+    TlsTransportOutVector_t lastChunk;
+    uint32_t startMs = Clock_GetTimeMs();
+    uint32_t elapsedMs;
+    bool status;
+
+    if( pContext->pSource->pPartition != NULL )
+    {
+        status = sendFromPartition( pContext );
+    }
+    else
+    {
+        status = sendFromCallback( pContext );
+    }
+
+    if( ( status == true ) && ( pContext->framing == HttpUploadChunked ) )
+    {
+        lastChunk.iov_base = LAST_CHUNK;
+        lastChunk.iov_len = sizeof( LAST_CHUNK ) - 1U;
+        status = sendVectors( pContext, &lastChunk, 1U );
+    }
+
+    if( status == true )
+    {
+        elapsedMs = Clock_GetTimeMs() - startMs;
+        LogInfo( ( "Sent a request body of %u bytes in %u ms.",
+                   ( unsigned ) pContext->bodySent, ( unsigned ) elapsedMs ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t uploadSend( NetworkContext_t * pNetworkContext,
+                           const void * pBuffer,
+                           size_t bytesToSend )
+{
+    UploadContext_t * pContext = ( UploadContext_t * ) pNetworkContext;
+    int32_t sent;
+
+    sent = pContext->pTransport->send( pContext->pTransport->pNetworkContext, pBuffer, bytesToSend );
+
+    if( sent > 0 )
+    {
+        pContext->headersSent += ( size_t ) sent;
+    }
+
+    if( ( sent > 0 ) && ( pContext->headersSent >= pContext->headersLength ) &&
+        ( pContext->bodyStarted == false ) )
+    {
+        pContext->bodyStarted = true;
+
+        if( sendBody( pContext ) == false )
+        {
+            sent = -1;
+        }
+    }
+
+    return sent;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t uploadRecv( NetworkContext_t * pNetworkContext,
+                           void * pBuffer,
+                           size_t bytesToRecv )
+{
+    UploadContext_t * pContext = ( UploadContext_t * ) pNetworkContext;
+
+    return pContext->pTransport->recv( pContext->pTransport->pNetworkContext, pBuffer, bytesToRecv );
+}
+
+/*-----------------------------------------------------------*/
+
+HTTPStatus_t HttpUpload_Send( const TransportInterface_t * pTransport,
+                              HTTPRequestHeaders_t * pRequestHeaders,
+                              const HttpUploadSource_t * pSource,
+                              HttpUploadFraming_t framing,
+                              HTTPResponse_t * pResponse,
+                              uint32_t sendFlags )
+{
+    UploadContext_t context;
+    TransportInterface_t uploadTransport;
+    char lengthText[ 24 ];
+    int lengthTextLength;
+    HTTPStatus_t httpStatus = HTTPSuccess;
+
+    if( ( pTransport == NULL ) || ( pRequestHeaders == NULL ) || ( pSource == NULL ) || ( pResponse == NULL ) )
+    {
+        LogError( ( "Invalid parameter: NULL pointer." ) );
+        httpStatus = HTTPInvalidParameter;
+    }
+    else if( ( pSource->pPartition == NULL ) &&
+             ( ( pSource->read == NULL ) || ( pSource->pBuffer == NULL ) || ( pSource->bufferLength == 0U ) ) )
+    {
+        LogError( ( "Invalid parameter: the source has neither a partition nor a callback with a buffer." ) );
+        httpStatus = HTTPInvalidParameter;
+    }
+    else if( ( pSource->pPartition != NULL ) &&
+             ( ( pSource->partitionOffset > pSource->pPartition->size ) ||
+               ( pSource->length > ( pSource->pPartition->size - pSource->partitionOffset ) ) ) )
+    {
+        LogError( ( "Invalid parameter: %u bytes at %u don't fit in partition %s.",
+                    ( unsigned ) pSource->length, ( unsigned ) pSource->partitionOffset,
+                    pSource->pPartition->label ) );
+        httpStatus = HTTPInvalidParameter;
+    }
+    else if( ( framing == HttpUploadContentLength ) && ( pSource->length == SIZE_MAX ) )
+    {
+        LogError( ( "Invalid parameter: a Content-Length needs the length of the body." ) );
+        httpStatus = HTTPInvalidParameter;
+    }
+    else if( framing == HttpUploadContentLength )
+    {
+        lengthTextLength = snprintf( lengthText, sizeof( lengthText ), "%lu", ( unsigned long ) pSource->length );
+        httpStatus = HTTPClient_AddHeader( pRequestHeaders,
+                                           "Content-Length", sizeof( "Content-Length" ) - 1U,
+                                           lengthText, ( size_t ) lengthTextLength );
+    }
+    else
+    {
+        httpStatus = HTTPClient_AddHeader( pRequestHeaders,
+                                           "Transfer-Encoding", sizeof( "Transfer-Encoding" ) - 1U,
+                                           "chunked", sizeof( "chunked" ) - 1U );
+    }
+
+    if( httpStatus == HTTPSuccess )
+    {
+        ( void ) memset( &context, 0, sizeof( context ) );
+        context.pTransport = pTransport;
+        context.pSource = pSource;
+        context.framing = framing;
+        context.headersLength = pRequestHeaders->headersLen;
+
+        /* coreHTTP hands the context back to the functions of the upload
+         * transport without looking into it. */
+        ( void ) memset( &uploadTransport, 0, sizeof( uploadTransport ) );
+        uploadTransport.pNetworkContext = ( NetworkContext_t * ) &context;
+        uploadTransport.send = uploadSend;
+        uploadTransport.recv = uploadRecv;
+
+        /* The framing header is already in, so coreHTTP mustn't add one. */
+        httpStatus = HTTPClient_Send( &uploadTransport, pRequestHeaders, NULL, 0U, pResponse,
+                                      sendFlags | HTTP_SEND_DISABLE_CONTENT_LENGTH_FLAG );
+    }
+    else if( httpStatus != HTTPInvalidParameter )
+    {
+        LogError( ( "Failed to add the framing header of the request body: Error=%s.",
+                    HTTPClient_strerror( httpStatus ) ) );
+    }
+
+    return httpStatus;
+}
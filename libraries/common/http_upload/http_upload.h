@@ -0,0 +1,142 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_upload.h
+ * @brief Streams a request body from a flash partition or a read callback,
+ * so uploads don't have to fit in RAM.
+ *
+ * coreHTTP sends the request headers and parses the response as usual, in
+ * the buffers of the caller. The body is sent between the two, in chunks of
+ * HTTP_UPLOAD_CHUNK_SIZE, through espTlsTransportWritev: straight from the
+ * memory-mapped partition, or from the buffer the callback fills. The
+ * framing is a Content-Length, which S3 presigned PUT URLs require, or
+ * chunked transfer coding for a body of unknown length.
+ */
+
+#ifndef HTTP_UPLOAD_H_
+#define HTTP_UPLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include the HTTP client, for the request headers and the response. */
+#include "core_http_client.h"
+
+/* Include the TLS transport, for espTlsTransportWritev. */
+#include "network_transport.h"
+
+#include "esp_partition.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The most bytes of the body sent with one vectored send.
+ */
+#define HTTP_UPLOAD_CHUNK_SIZE        CONFIG_HTTP_UPLOAD_CHUNK_SIZE
+
+/**
+ * @brief The most bytes of a partition mapped at once.
+ */
+#define HTTP_UPLOAD_MMAP_WINDOW       CONFIG_HTTP_UPLOAD_MMAP_WINDOW
+
+/**
+ * @brief How long a send may make no progress before the upload fails, in
+ * milliseconds.
+ */
+#define HTTP_UPLOAD_SEND_TIMEOUT_MS   CONFIG_HTTP_UPLOAD_SEND_TIMEOUT_MS
+
+/**
+ * @brief Reads the next part of a body.
+ *
+ * @param[in] pContext The context given with the callback.
+ * @param[in] offset The offset in the body of the first byte to read.
+ * @param[out] pBuffer Where to read to.
+ * @param[in] length The size of @a pBuffer.
+ *
+ * @return The bytes read, 0 at the end of the body, or a negative value on
+ * error, which fails the upload.
+ */
+typedef int32_t ( * HttpUploadRead_t )( void * pContext,
+                                        size_t offset,
+                                        uint8_t * pBuffer,
+                                        size_t length );
+
+/**
+ * @brief How the end of the body is told to the server.
+ */
+typedef enum HttpUploadFraming
+{
+    HttpUploadContentLength, /**< @brief A Content-Length header; the length of the body must be known. */
+    HttpUploadChunked        /**< @brief Chunked transfer coding; a callback may end the body anywhere. */
+} HttpUploadFraming_t;
+
+/**
+ * @brief Where the body comes from: a partition or a callback.
+ */
+typedef struct HttpUploadSource
+{
+    /* A partition, mapped a window at a time. NULL to use the callback. */
+    const esp_partition_t * pPartition;
+    size_t partitionOffset; /**< @brief Offset of the body in the partition. */
+
+    /* A callback filling a buffer of the caller, of any size. */
+    HttpUploadRead_t read;
+    void * pReadContext;
+    uint8_t * pBuffer;
+    size_t bufferLength;
+
+    /* Length of the body. With a callback and chunked framing, SIZE_MAX for
+     * a body ending where the callback returns 0. */
+    size_t length;
+} HttpUploadSource_t;
+
+/**
+ * @brief Sends a request with a body streamed from a source, and receives
+ * its response.
+ *
+ * Adds the Content-Length or Transfer-Encoding header to the request
+ * headers, so they must have room for it.
+ *
+ * @param[in] pTransport The transport interface of a connection of the TLS
+ * transport, such as one from HttpConnectionPool_Acquire.
+ * @param[in] pRequestHeaders Request headers initialized with
+ * HTTPClient_InitializeRequestHeaders.
+ * @param[in] pSource The body.
+ * @param[in] framing How the end of the body is told.
+ * @param[out] pResponse The response, in the buffer of the caller, which
+ * may be that of the request headers.
+ * @param[in] sendFlags Flags of HTTPClient_Send.
+ *
+ * @return HTTPSuccess once the response is received; HTTPNetworkError if
+ * the body couldn't be read or sent; another error of HTTPClient_Send
+ * otherwise.
+ */
+HTTPStatus_t HttpUpload_Send( const TransportInterface_t * pTransport,
+                              HTTPRequestHeaders_t * pRequestHeaders,
+                              const HttpUploadSource_t * pSource,
+                              HttpUploadFraming_t framing,
+                              HTTPResponse_t * pResponse,
+                              uint32_t sendFlags );
+
+#endif /* ifndef HTTP_UPLOAD_H_ */
@@ -0,0 +1,221 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file job_dispatch.c
+ * @brief Implementation of the job action table.
+ *
+ * With at most 16 actions in 64 slots, most seeds leave no two actions in the
+ * same slot, so the search for one when the table is built is short.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "job_dispatch.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The most seeds tried before giving up on a perfect hash.
+ */
+#define MAX_SEEDS    ( 4096U )
+
+/* The slots hold the index of an action plus one in a byte, and must be a
+ * power of two. */
+#if ( JOB_DISPATCH_MAX_ACTIONS > 16 )
+    #error "JOB_DISPATCH_MAX_ACTIONS must be at most 16."
+#endif
+#if ( ( JOB_DISPATCH_HASH_SLOTS & ( JOB_DISPATCH_HASH_SLOTS - 1U ) ) != 0U )
+    #error "JOB_DISPATCH_HASH_SLOTS must be a power of two."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief FNV-1a of @a length bytes mixed with @a seed, reduced to a slot.
+ */
+static size_t hashSlot( uint32_t seed,
+                        const char * pData,
+                        size_t length );
+
+/**
+ * @brief Fills the slots of the hash with @a seed.
+ *
+ * @return false if two actions land in the same slot.
+ */
+static bool tryHashSeed( JobDispatchTable_t * pTable,
+                         uint32_t seed );
+
+/*-----------------------------------------------------------*/
+
+static size_t hashSlot( uint32_t seed,
+                        const char * pData,
+                        size_t length )
+{
+    uint32_t hash = 2166136261U ^ seed;
+    size_t i;
+
+    for( i = 0; i < length; i++ )
+    {
+        hash ^= ( uint8_t ) pData[ i ];
+        hash *= 16777619U;
+    }
+
+    /* Fold the high bits in, the low bits of FNV alone mix poorly. */
+    return ( size_t ) ( ( hash ^ ( hash >> 15 ) ) & ( JOB_DISPATCH_HASH_SLOTS - 1U ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool tryHashSeed( JobDispatchTable_t * pTable,
+                         uint32_t seed )
+{
+    bool status = true;
+    size_t slot;
+    size_t i;
+
+    ( void ) memset( pTable->slots, 0x00, sizeof( pTable->slots ) );
+
+    for( i = 0; ( i < pTable->count ) && ( status == true ); i++ )
+    {
+        slot = hashSlot( seed, pTable->actions[ i ].pName, pTable->actions[ i ].nameLength );
+
+        if( pTable->slots[ slot ] != 0U )
+        {
+            status = false;
+        }
+        else
+        {
+            pTable->slots[ slot ] = ( uint8_t ) ( i + 1U );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void JobDispatch_Init( JobDispatchTable_t * pTable )
+{
+    assert( pTable != NULL );
+
+    ( void ) memset( pTable, 0x00, sizeof( *pTable ) );
+}
+
+/*-----------------------------------------------------------*/
+
+bool JobDispatch_Register( JobDispatchTable_t * pTable,
+                           const char * pName,
+                           JobDispatchHandler_t handler,
+                           JobDispatchMode_t mode,
+                           uint32_t timeoutMs,
+                           void * pContext )
+{
+    bool status;
+    size_t nameLength;
+    size_t i;
+    JobDispatchAction_t * pAction;
+
+    assert( pTable != NULL );
+    assert( pName != NULL );
+    assert( handler != NULL );
+
+    nameLength = strlen( pName );
+    status = ( pTable->built == false ) &&
+             ( pTable->count < JOB_DISPATCH_MAX_ACTIONS ) &&
+             ( nameLength > 0U ) &&
+             ( nameLength <= UINT16_MAX );
+
+    for( i = 0; ( i < pTable->count ) && ( status == true ); i++ )
+    {
+        status = ( pTable->actions[ i ].nameLength != nameLength ) ||
+                 ( memcmp( pTable->actions[ i ].pName, pName, nameLength ) != 0 );
+    }
+
+    if( status == true )
+    {
+        pAction = &pTable->actions[ pTable->count ];
+        pAction->pName = pName;
+        pAction->nameLength = ( uint16_t ) nameLength;
+        pAction->mode = mode;
+        pAction->timeoutMs = timeoutMs;
+        pAction->handler = handler;
+        pAction->pContext = pContext;
+        pTable->count++;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool JobDispatch_Build( JobDispatchTable_t * pTable )
+{
+    bool status = true;
+    uint32_t seed = 0U;
+
+    assert( pTable != NULL );
+
+    while( ( status == true ) && ( tryHashSeed( pTable, seed ) == false ) )
+    {
+        seed++;
+
+        /* Practically unreachable, as most seeds work. */
+        status = ( seed < MAX_SEEDS );
+    }
+
+    pTable->seed = seed;
+    pTable->built = status;
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+const JobDispatchAction_t * JobDispatch_Find( const JobDispatchTable_t * pTable,
+                                              const char * pName,
+                                              size_t nameLength )
+{
+    const JobDispatchAction_t * pAction = NULL;
+    uint8_t entry = 0U;
+
+    assert( pTable != NULL );
+    assert( ( pName != NULL ) || ( nameLength == 0U ) );
+
+    if( ( pTable->built == true ) && ( nameLength > 0U ) )
+    {
+        entry = pTable->slots[ hashSlot( pTable->seed, pName, nameLength ) ];
+    }
+
+    /* The hash is only perfect for the actions of the table, so check the one
+     * in the slot. */
+    if( ( entry != 0U ) &&
+        ( pTable->actions[ entry - 1U ].nameLength == nameLength ) &&
+        ( memcmp( pName, pTable->actions[ entry - 1U ].pName, nameLength ) == 0 ) )
+    {
+        pAction = &pTable->actions[ entry - 1U ];
+    }
+
+    return pAction;
+}
@@ -0,0 +1,162 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file job_dispatch.h
+ * @brief A table of the job actions an application handles, built once and
+ * looked up with a perfect hash.
+ *
+ * The application registers each action name with its handler, how it is run
+ * and how long it may take, then builds the table before the first job
+ * arrives. The length of every name is taken when it is registered, and a
+ * hash seed leaving no two names in the same slot is searched for when the
+ * table is built, so that finding the action of a job document costs one
+ * hash of its name and one comparison however many actions there are.
+ *
+ * The table only stores the handlers: running a handler inline or on a
+ * worker, and enforcing its timeout, is up to the application.
+ */
+
+#ifndef JOB_DISPATCH_H_
+#define JOB_DISPATCH_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The most actions in a table.
+ */
+#ifndef JOB_DISPATCH_MAX_ACTIONS
+    #define JOB_DISPATCH_MAX_ACTIONS    CONFIG_JOB_DISPATCH_MAX_ACTIONS
+#endif
+
+/**
+ * @brief Slots of the perfect hash, a power of two at least four times the
+ * number of actions, so that a seed is found within a few tries.
+ */
+#define JOB_DISPATCH_HASH_SLOTS         ( 64U )
+
+/**
+ * @brief How the handler of an action is run.
+ */
+typedef enum JobDispatchMode
+{
+    JobDispatchInline = 0, /**< By the task that received the job, before it handles the next packet. */
+    JobDispatchWorker      /**< By a worker task, leaving the task that received the job free. */
+} JobDispatchMode_t;
+
+/**
+ * @brief Runs a job.
+ *
+ * @param[in] pJob The job, as the application represents it.
+ * @param[in] pContext The context the action was registered with.
+ *
+ * @return true if the job succeeded.
+ */
+typedef bool ( * JobDispatchHandler_t )( void * pJob,
+                                         void * pContext );
+
+/**
+ * @brief A registered action.
+ */
+typedef struct JobDispatchAction
+{
+    const char * pName;           /**< @brief Name of the action in job documents. */
+    uint16_t nameLength;          /**< @brief Length of #pName, taken when it is registered. */
+    JobDispatchMode_t mode;       /**< @brief How #handler is run. */
+    uint32_t timeoutMs;           /**< @brief How long a job may take, 0 for no limit. */
+    JobDispatchHandler_t handler; /**< @brief Runs a job of the action. */
+    void * pContext;              /**< @brief Passed to #handler. */
+} JobDispatchAction_t;
+
+/**
+ * @brief The actions of an application.
+ *
+ * The fields are private to this module.
+ */
+typedef struct JobDispatchTable
+{
+    JobDispatchAction_t actions[ JOB_DISPATCH_MAX_ACTIONS ];
+    size_t count;
+    bool built;
+
+    /* Seed of the perfect hash, and the action in each slot plus one, or 0. */
+    uint32_t seed;
+    uint8_t slots[ JOB_DISPATCH_HASH_SLOTS ];
+} JobDispatchTable_t;
+
+/**
+ * @brief Empties a table.
+ *
+ * @param[out] pTable The table.
+ */
+void JobDispatch_Init( JobDispatchTable_t * pTable );
+
+/**
+ * @brief Adds an action to a table that isn't built yet.
+ *
+ * @param[in] pTable The table.
+ * @param[in] pName The name of the action, NUL-terminated, kept by the table.
+ * @param[in] handler Runs a job of the action.
+ * @param[in] mode How @a handler is run.
+ * @param[in] timeoutMs How long a job may take, 0 for no limit.
+ * @param[in] pContext Passed to @a handler.
+ *
+ * @return false if the table is built or full, or already has the name.
+ */
+bool JobDispatch_Register( JobDispatchTable_t * pTable,
+                           const char * pName,
+                           JobDispatchHandler_t handler,
+                           JobDispatchMode_t mode,
+                           uint32_t timeoutMs,
+                           void * pContext );
+
+/**
+ * @brief Searches for the hash seed of the actions registered, after which no
+ * more can be registered.
+ *
+ * @param[in] pTable The table.
+ *
+ * @return false if no seed was found, which is practically unreachable.
+ */
+bool JobDispatch_Build( JobDispatchTable_t * pTable );
+
+/**
+ * @brief Finds the action of a job document.
+ *
+ * @param[in] pTable A table built by #JobDispatch_Build.
+ * @param[in] pName The action of the job, not NUL-terminated.
+ * @param[in] nameLength The length of @a pName.
+ *
+ * @return The action, valid as long as the table, or NULL if it isn't
+ * registered or the table isn't built.
+ */
+const JobDispatchAction_t * JobDispatch_Find( const JobDispatchTable_t * pTable,
+                                              const char * pName,
+                                              size_t nameLength );
+
+#endif /* ifndef JOB_DISPATCH_H_ */
@@ -0,0 +1,292 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/**
+ * @file json_index_benchmark.c
+ * @brief Measures the lookups of a job handler with JSON_Search and with the
+ * JSON token index.
+ *
+ * Each document is a job execution as AWS IoT Jobs sends it on
+ * $aws/things/<thing>/jobs/notify-next, with a job document listing update
+ * steps ahead of the keys the handler reads, so every lookup has to get past
+ * them. Per document, the handler validates it and reads the job ID, action,
+ * message and topic:
+ * - with coreJSON, JSON_Validate and one JSON_Search per key, as the Jobs
+ *   demo did;
+ * - with the index, one JsonIndex_Build and one JsonIndex_Search per key.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/* JSON includes. */
+#include "core_json.h"
+#include "json_writer.h"
+#include "json_index.h"
+
+/* Header include. */
+#include "json_index_benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sizes of the documents, in bytes.
+ */
+#define BENCHMARK_DOCUMENT_SIZES    { 1024U, 4096U, 8192U }
+
+/**
+ * @brief Size of the document buffer, above the largest document.
+ */
+#define BENCHMARK_BUFFER_LENGTH     ( 8192U + 512U )
+
+/**
+ * @brief Tokens for the largest document.
+ */
+#define BENCHMARK_MAX_TOKENS        ( 768U )
+
+/**
+ * @brief Times each document is handled with each method.
+ */
+#define BENCHMARK_ITERATIONS        ( 200U )
+
+/*-----------------------------------------------------------*/
+
+static const char * TAG = "JsonIndexBenchmark";
+
+/**
+ * @brief The keys the handler reads.
+ */
+static const char * queries[] =
+{
+    "execution.jobId",
+    "execution.jobDocument.action",
+    "execution.jobDocument.message",
+    "execution.jobDocument.topic"
+};
+
+#define QUERY_COUNT    ( sizeof( queries ) / sizeof( queries[ 0 ] ) )
+
+static char document[ BENCHMARK_BUFFER_LENGTH ];
+
+static JsonIndexToken_t tokens[ BENCHMARK_MAX_TOKENS ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes a job execution document with @a stepCount update steps.
+ *
+ * @return The length of the document, or 0 if it doesn't fit.
+ */
+static size_t writeDocument( size_t stepCount );
+
+/**
+ * @brief Handles the document with JSON_Search.
+ *
+ * @return Number of keys found.
+ */
+static size_t searchDocument( size_t length );
+
+/**
+ * @brief Handles the document with the index.
+ *
+ * @return Number of keys found.
+ */
+static size_t indexDocument( size_t length );
+
+/*-----------------------------------------------------------*/
+
+static size_t writeDocument( size_t stepCount )
+{
+    JsonWriter_t writer;
+    char text[ 64 ];
+    size_t length = 0U;
+    size_t i;
+    int written;
+
+    JsonWriter_Init( &writer, document, sizeof( document ) );
+    JsonWriter_BeginObject( &writer, NULL );
+    JsonWriter_AddString( &writer, "clientToken", "benchmark-token", strlen( "benchmark-token" ) );
+    JsonWriter_AddUnsigned( &writer, "timestamp", 1700000000U );
+    JsonWriter_BeginObject( &writer, "execution" );
+    JsonWriter_AddString( &writer, "jobId", "benchmark-job", strlen( "benchmark-job" ) );
+    JsonWriter_AddString( &writer, "status", "QUEUED", strlen( "QUEUED" ) );
+    JsonWriter_AddUnsigned( &writer, "queuedAt", 1700000000U );
+    JsonWriter_AddUnsigned( &writer, "lastUpdatedAt", 1700000000U );
+    JsonWriter_AddUnsigned( &writer, "versionNumber", 1U );
+    JsonWriter_AddUnsigned( &writer, "executionNumber", 1U );
+    JsonWriter_BeginObject( &writer, "jobDocument" );
+    JsonWriter_BeginArray( &writer, "steps" );
+
+    for( i = 0; i < stepCount; i++ )
+    {
+        JsonWriter_BeginObject( &writer, NULL );
+        written = snprintf( text, sizeof( text ), "step-%u", ( unsigned ) i );
+        JsonWriter_AddString( &writer, "name", text, ( size_t ) written );
+        written = snprintf( text, sizeof( text ), "https://example.com/firmware/image-%u.bin", ( unsigned ) i );
+        JsonWriter_AddString( &writer, "url", text, ( size_t ) written );
+        JsonWriter_AddString( &writer, "sha256",
+                              "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08", 64U );
+        JsonWriter_AddUnsigned( &writer, "size", 123456U + i );
+        JsonWriter_AddUnsigned( &writer, "retries", 3U );
+        JsonWriter_AddBoolean( &writer, "reboot", ( i % 2U ) == 0U );
+        JsonWriter_EndObject( &writer );
+    }
+
+    JsonWriter_EndArray( &writer );
+    JsonWriter_AddString( &writer, "action", "publish", strlen( "publish" ) );
+    JsonWriter_AddString( &writer, "message", "Hello from the benchmark", strlen( "Hello from the benchmark" ) );
+    JsonWriter_AddString( &writer, "topic", "benchmark/topic", strlen( "benchmark/topic" ) );
+    JsonWriter_EndObject( &writer );
+    JsonWriter_EndObject( &writer );
+    JsonWriter_EndObject( &writer );
+
+    if( JsonWriter_Finish( &writer, &length ) == false )
+    {
+        length = 0U;
+    }
+
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t searchDocument( size_t length )
+{
+    char * pValue = NULL;
+    size_t valueLength = 0U;
+    size_t found = 0U;
+    size_t i;
+
+    if( JSON_Validate( document, length ) == JSONSuccess )
+    {
+        for( i = 0; i < QUERY_COUNT; i++ )
+        {
+            if( JSON_Search( document, length, queries[ i ], strlen( queries[ i ] ),
+                             &pValue, &valueLength ) == JSONSuccess )
+            {
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t indexDocument( size_t length )
+{
+    JsonIndex_t index;
+    const char * pValue = NULL;
+    size_t valueLength = 0U;
+    size_t found = 0U;
+    size_t i;
+
+    if( JsonIndex_Build( &index, document, length, tokens, BENCHMARK_MAX_TOKENS ) == JsonIndexSuccess )
+    {
+        for( i = 0; i < QUERY_COUNT; i++ )
+        {
+            if( JsonIndex_Search( &index, queries[ i ], strlen( queries[ i ] ),
+                                  &pValue, &valueLength, NULL ) == JsonIndexSuccess )
+            {
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonIndex_RunBenchmark( void )
+{
+    static const size_t sizes[] = BENCHMARK_DOCUMENT_SIZES;
+    size_t run;
+    size_t steps;
+    size_t length;
+    size_t searchFound;
+    size_t indexFound;
+    uint32_t i;
+    int64_t start;
+    int64_t searchTime;
+    int64_t indexTime;
+
+    for( run = 0; run < ( sizeof( sizes ) / sizeof( sizes[ 0 ] ) ); run++ )
+    {
+        /* Add steps until the document reaches its size. */
+        steps = 0U;
+
+        do
+        {
+            length = writeDocument( steps );
+            steps++;
+        } while( ( length != 0U ) && ( length < sizes[ run ] ) );
+
+        if( length == 0U )
+        {
+            ESP_LOGE( TAG, "A document of %u bytes doesn't fit in the buffer.", ( unsigned ) sizes[ run ] );
+            continue;
+        }
+
+        searchFound = 0U;
+        start = esp_timer_get_time();
+
+        for( i = 0; i < BENCHMARK_ITERATIONS; i++ )
+        {
+            searchFound += searchDocument( length );
+        }
+
+        searchTime = esp_timer_get_time() - start;
+
+        indexFound = 0U;
+        start = esp_timer_get_time();
+
+        for( i = 0; i < BENCHMARK_ITERATIONS; i++ )
+        {
+            indexFound += indexDocument( length );
+        }
+
+        indexTime = esp_timer_get_time() - start;
+
+        if( ( searchFound != ( BENCHMARK_ITERATIONS * QUERY_COUNT ) ) || ( indexFound != searchFound ) )
+        {
+            ESP_LOGE( TAG, "%u bytes: found %u keys with JSON_Search and %u with the index, expected %u.",
+                      ( unsigned ) length, ( unsigned ) searchFound, ( unsigned ) indexFound,
+                      ( unsigned ) ( BENCHMARK_ITERATIONS * QUERY_COUNT ) );
+        }
+        else
+        {
+            ESP_LOGI( TAG, "%u bytes, %u keys: JSON_Search %u us, index %u us per document.",
+                      ( unsigned ) length, ( unsigned ) QUERY_COUNT,
+                      ( unsigned ) ( searchTime / BENCHMARK_ITERATIONS ),
+                      ( unsigned ) ( indexTime / BENCHMARK_ITERATIONS ) );
+        }
+    }
+}
@@ -0,0 +1,973 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file json_index.c
+ * @brief Implementation of the JSON token index.
+ *
+ * The document is scanned once, left to right, with a stack of the open
+ * objects and arrays in place of recursion. A token is added when its value
+ * starts; the token of an object or array learns its length and the token
+ * after its last member when it closes.
+ *
+ * With #JSON_INDEX_WORD_SCAN, string bodies and runs of spaces are checked a
+ * machine word at a time, with the SWAR tests of "Bit Twiddling Hacks": a
+ * word is skipped whole when none of its bytes is a quote, a backslash or a
+ * control character, and handled a byte at a time otherwise. Where SSE2 is
+ * available, as on x86 hosts, a word is a 128-bit vector checked with byte
+ * compares instead. The tests only say whether a word holds such a byte,
+ * never which, so the tokens are those of the byte scanner.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+#if defined( __SSE2__ )
+    #include <emmintrin.h>
+#endif
+
+#include "json_index.h"
+
+/*-----------------------------------------------------------*/
+
+#if JSON_INDEX_WORD_SCAN
+
+    #if defined( __SSE2__ )
+
+/**
+ * @brief A vector of 16 bytes.
+ */
+        typedef __m128i ScanWord_t;
+
+/**
+ * @brief The alignment of the words loaded. Unaligned vector loads cost the
+ * same as aligned ones, so a word is loaded from any offset.
+ */
+        #define WORD_ALIGNMENT               ( 1U )
+
+/**
+ * @brief A mask with a bit set for each byte of @a word equal to @a byte.
+ */
+        #define BYTES_EQUAL( word, byte )    _mm_movemask_epi8( _mm_cmpeq_epi8( ( word ), _mm_set1_epi8( ( char ) ( byte ) ) ) )
+
+/**
+ * @brief A mask with a bit set for each byte of @a word below 0x20.
+ */
+        #define BYTES_CONTROL( word )        _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_min_epu8( ( word ), _mm_set1_epi8( 0x1F ) ), ( word ) ) )
+
+/**
+ * @brief Whether every byte of @a word is a space.
+ */
+        #define IS_SPACES( word )            ( BYTES_EQUAL( word, ' ' ) == 0xFFFF )
+
+/**
+ * @brief Whether a byte of @a word is a quote, a backslash or a control
+ * character.
+ */
+        #define HAS_STRING_STOP( word )                                                    \
+    ( ( BYTES_EQUAL( word, '"' ) | BYTES_EQUAL( word, '\\' ) | BYTES_CONTROL( word ) ) != 0 )
+    #else /* if defined( __SSE2__ ) */
+
+/**
+ * @brief A machine word, of 64 bits where loads of 64 bits are cheap.
+ */
+        #if ( UINTPTR_MAX > 0xFFFFFFFFU )
+            typedef uint64_t ScanWord_t;
+        #else
+            typedef uint32_t ScanWord_t;
+        #endif
+
+/**
+ * @brief The alignment of the words loaded, their size.
+ */
+        #define WORD_ALIGNMENT       ( sizeof( ScanWord_t ) )
+
+/**
+ * @brief A word with every byte set to @a byte.
+ */
+        #define WORD_OF( byte )      ( ( ( ScanWord_t ) ~( ScanWord_t ) 0U / 0xFFU ) * ( ScanWord_t ) ( byte ) )
+
+/**
+ * @brief Non-zero if a byte of @a word is zero.
+ */
+        #define HAS_ZERO( word )     ( ( ( word ) - WORD_OF( 0x01U ) ) & ~( word ) & WORD_OF( 0x80U ) )
+
+/**
+ * @brief Non-zero if a byte of @a word is below 0x20.
+ */
+        #define HAS_CONTROL( word )  ( ( ( word ) - WORD_OF( 0x20U ) ) & ~( word ) & WORD_OF( 0x80U ) )
+
+/**
+ * @brief Whether every byte of @a word is a space.
+ */
+        #define IS_SPACES( word )    ( ( word ) == WORD_OF( ' ' ) )
+
+/**
+ * @brief Whether a byte of @a word is a quote, a backslash or a control
+ * character.
+ */
+        #define HAS_STRING_STOP( word )                                                           \
+    ( ( HAS_ZERO( ( word ) ^ WORD_OF( '"' ) ) | HAS_ZERO( ( word ) ^ WORD_OF( '\\' ) ) | \
+        HAS_CONTROL( word ) ) != 0U )
+    #endif /* if defined( __SSE2__ ) */
+
+#endif /* if JSON_INDEX_WORD_SCAN */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief What the scanner expects next.
+ */
+typedef enum ScanState
+{
+    ScanValue,  /* A value, at the top or after a ':' or in an array. */
+    ScanKey,    /* A key of an object. */
+    ScanAfter   /* A ',' or the end of the innermost object or array. */
+} ScanState_t;
+
+/**
+ * @brief The document being indexed.
+ */
+typedef struct Scanner
+{
+    const char * pDocument;
+    size_t length;
+    size_t offset;
+    JsonIndexToken_t * pTokens;
+    size_t maxTokens;
+    size_t count;
+} Scanner_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Skips whitespace.
+ */
+static void skipSpace( Scanner_t * pScanner );
+
+#if JSON_INDEX_WORD_SCAN
+
+/**
+ * @brief Loads the word at an offset of the document aligned to
+ * #WORD_ALIGNMENT.
+ */
+    static ScanWord_t loadWord( const char * pDocument,
+                                size_t offset );
+
+/**
+ * @brief Skips the words of spaces from an offset aligned to #WORD_ALIGNMENT.
+ *
+ * @return The offset of the first word that isn't all spaces, or of the
+ * last bytes shorter than a word. @a offset if it isn't aligned.
+ */
+    static size_t skipSpaceWords( const char * pDocument,
+                                  size_t offset,
+                                  size_t length );
+
+/**
+ * @brief Skips the words of a string body from an offset aligned to
+ * #WORD_ALIGNMENT.
+ *
+ * @return The offset of the first word holding a quote, backslash or control
+ * character, or of the last bytes shorter than a word. @a offset if it isn't
+ * aligned.
+ */
+    static size_t skipStringWords( const char * pDocument,
+                                   size_t offset,
+                                   size_t length );
+#endif /* if JSON_INDEX_WORD_SCAN */
+
+/**
+ * @brief Adds a token.
+ *
+ * @return #JsonIndexSuccess or #JsonIndexOutOfTokens.
+ */
+static JsonIndexStatus_t addToken( Scanner_t * pScanner,
+                                   JsonIndexType_t type,
+                                   size_t start,
+                                   size_t length,
+                                   bool isKey );
+
+/**
+ * @brief Scans a string starting at its opening quote, checking its escapes.
+ *
+ * @param[in] pScanner The scanner.
+ * @param[out] pStart The offset past the opening quote.
+ * @param[out] pLength The length up to the closing quote.
+ *
+ * @return true for a valid string.
+ */
+static bool scanString( Scanner_t * pScanner,
+                        size_t * pStart,
+                        size_t * pLength );
+
+/**
+ * @brief Scans a number, in the grammar of RFC 8259.
+ *
+ * @return true for a valid number.
+ */
+static bool scanNumber( Scanner_t * pScanner );
+
+/**
+ * @brief Scans a literal such as `true`.
+ *
+ * @return true if the literal is at the offset.
+ */
+static bool scanLiteral( Scanner_t * pScanner,
+                         const char * pLiteral,
+                         size_t literalLength );
+
+/**
+ * @brief Scans a value, adding its token and opening it if it is an object
+ * or array.
+ *
+ * @return #JsonIndexSuccess, or why the document couldn't be indexed.
+ */
+static JsonIndexStatus_t scanValue( Scanner_t * pScanner,
+                                    uint16_t * pStack,
+                                    size_t * pDepth,
+                                    ScanState_t * pState );
+
+/**
+ * @brief Finds the member of an object with a key.
+ *
+ * @return The token of the value, or the #JsonIndexToken_t.next of the object
+ * if no key matches.
+ */
+static size_t findKey( const JsonIndex_t * pIndex,
+                       size_t object,
+                       const char * pKey,
+                       size_t keyLength );
+
+/**
+ * @brief Finds an element of an array.
+ *
+ * @return The token of the element, or the #JsonIndexToken_t.next of the
+ * array if it has fewer elements.
+ */
+static size_t findElement( const JsonIndex_t * pIndex,
+                           size_t array,
+                           size_t element );
+
+/*-----------------------------------------------------------*/
+
+static void skipSpace( Scanner_t * pScanner )
+{
+    char c;
+
+    while( pScanner->offset < pScanner->length )
+    {
+        #if JSON_INDEX_WORD_SCAN
+            pScanner->offset = skipSpaceWords( pScanner->pDocument, pScanner->offset, pScanner->length );
+
+            if( pScanner->offset == pScanner->length )
+            {
+                break;
+            }
+        #endif
+
+        c = pScanner->pDocument[ pScanner->offset ];
+
+        if( ( c != ' ' ) && ( c != '\t' ) && ( c != '\n' ) && ( c != '\r' ) )
+        {
+            break;
+        }
+
+        pScanner->offset++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if JSON_INDEX_WORD_SCAN
+
+    static ScanWord_t loadWord( const char * pDocument,
+                                size_t offset )
+    {
+        ScanWord_t word;
+
+        /* The offset is aligned, so this is a single load. */
+        ( void ) memcpy( &word, __builtin_assume_aligned( &pDocument[ offset ], WORD_ALIGNMENT ), sizeof( word ) );
+
+        return word;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static size_t skipSpaceWords( const char * pDocument,
+                                  size_t offset,
+                                  size_t length )
+    {
+        size_t i = offset;
+
+        if( ( ( uintptr_t ) &pDocument[ i ] % WORD_ALIGNMENT ) == 0U )
+        {
+            while( ( ( length - i ) >= sizeof( ScanWord_t ) ) &&
+                   IS_SPACES( loadWord( pDocument, i ) ) )
+            {
+                i += sizeof( ScanWord_t );
+            }
+        }
+
+        return i;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static size_t skipStringWords( const char * pDocument,
+                                   size_t offset,
+                                   size_t length )
+    {
+        size_t i = offset;
+        ScanWord_t word;
+
+        if( ( ( uintptr_t ) &pDocument[ i ] % WORD_ALIGNMENT ) == 0U )
+        {
+            while( ( length - i ) >= sizeof( ScanWord_t ) )
+            {
+                word = loadWord( pDocument, i );
+
+                if( HAS_STRING_STOP( word ) )
+                {
+                    break;
+                }
+
+                i += sizeof( ScanWord_t );
+            }
+        }
+
+        return i;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if JSON_INDEX_WORD_SCAN */
+
+static JsonIndexStatus_t addToken( Scanner_t * pScanner,
+                                   JsonIndexType_t type,
+                                   size_t start,
+                                   size_t length,
+                                   bool isKey )
+{
+    JsonIndexStatus_t status = JsonIndexSuccess;
+    JsonIndexToken_t * pToken = NULL;
+
+    if( pScanner->count == pScanner->maxTokens )
+    {
+        status = JsonIndexOutOfTokens;
+    }
+    else
+    {
+        pToken = &pScanner->pTokens[ pScanner->count ];
+        pToken->start = ( uint16_t ) start;
+        pToken->length = ( uint16_t ) length;
+        pToken->next = ( uint16_t ) ( pScanner->count + 1U );
+        pToken->type = ( uint8_t ) type;
+        pToken->isKey = ( isKey == true ) ? 1U : 0U;
+        pScanner->count++;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool scanString( Scanner_t * pScanner,
+                        size_t * pStart,
+                        size_t * pLength )
+{
+    const char * p = pScanner->pDocument;
+    size_t i = pScanner->offset + 1U;
+    size_t hex;
+    bool valid = false;
+    unsigned char c;
+
+    *pStart = i;
+
+    while( i < pScanner->length )
+    {
+        #if JSON_INDEX_WORD_SCAN
+            i = skipStringWords( p, i, pScanner->length );
+
+            if( i == pScanner->length )
+            {
+                break;
+            }
+        #endif
+
+        c = ( unsigned char ) p[ i ];
+
+        if( c == ( unsigned char ) '"' )
+        {
+            valid = true;
+            break;
+        }
+        else if( c < 0x20U )
+        {
+            break;
+        }
+        else if( c == ( unsigned char ) '\\' )
+        {
+            i++;
+
+            if( i == pScanner->length )
+            {
+                break;
+            }
+            else if( p[ i ] == 'u' )
+            {
+                for( hex = 0U; hex < 4U; hex++ )
+                {
+                    i++;
+
+                    if( ( i == pScanner->length ) ||
+                        ( ( ( p[ i ] < '0' ) || ( p[ i ] > '9' ) ) &&
+                          ( ( p[ i ] < 'a' ) || ( p[ i ] > 'f' ) ) &&
+                          ( ( p[ i ] < 'A' ) || ( p[ i ] > 'F' ) ) ) )
+                    {
+                        break;
+                    }
+                }
+
+                if( hex < 4U )
+                {
+                    break;
+                }
+            }
+            else if( strchr( "\"\\/bfnrt", p[ i ] ) == NULL )
+            {
+                break;
+            }
+            else
+            {
+                /* A single character escape. */
+            }
+        }
+        else
+        {
+            /* An unescaped character, which coreJSON also checks as UTF-8;
+             * the index leaves that to whoever decodes the string. */
+        }
+
+        i++;
+    }
+
+    if( valid == true )
+    {
+        *pLength = i - *pStart;
+        pScanner->offset = i + 1U;
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool scanNumber( Scanner_t * pScanner )
+{
+    const char * p = pScanner->pDocument;
+    size_t n = pScanner->length;
+    size_t i = pScanner->offset;
+    size_t digits;
+    bool valid = true;
+
+    if( p[ i ] == '-' )
+    {
+        i++;
+    }
+
+    /* An integer part without leading zeros. */
+    if( ( i < n ) && ( p[ i ] == '0' ) )
+    {
+        i++;
+    }
+    else
+    {
+        for( digits = 0U; ( i < n ) && ( p[ i ] >= '0' ) && ( p[ i ] <= '9' ); digits++ )
+        {
+            i++;
+        }
+
+        valid = ( digits > 0U );
+    }
+
+    if( ( valid == true ) && ( i < n ) && ( p[ i ] == '.' ) )
+    {
+        i++;
+
+        for( digits = 0U; ( i < n ) && ( p[ i ] >= '0' ) && ( p[ i ] <= '9' ); digits++ )
+        {
+            i++;
+        }
+
+        valid = ( digits > 0U );
+    }
+
+    if( ( valid == true ) && ( i < n ) && ( ( p[ i ] == 'e' ) || ( p[ i ] == 'E' ) ) )
+    {
+        i++;
+
+        if( ( i < n ) && ( ( p[ i ] == '+' ) || ( p[ i ] == '-' ) ) )
+        {
+            i++;
+        }
+
+        for( digits = 0U; ( i < n ) && ( p[ i ] >= '0' ) && ( p[ i ] <= '9' ); digits++ )
+        {
+            i++;
+        }
+
+        valid = ( digits > 0U );
+    }
+
+    pScanner->offset = i;
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool scanLiteral( Scanner_t * pScanner,
+                         const char * pLiteral,
+                         size_t literalLength )
+{
+    bool valid = false;
+
+    if( ( ( pScanner->length - pScanner->offset ) >= literalLength ) &&
+        ( memcmp( &pScanner->pDocument[ pScanner->offset ], pLiteral, literalLength ) == 0 ) )
+    {
+        pScanner->offset += literalLength;
+        valid = true;
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+static JsonIndexStatus_t scanValue( Scanner_t * pScanner,
+                                    uint16_t * pStack,
+                                    size_t * pDepth,
+                                    ScanState_t * pState )
+{
+    JsonIndexStatus_t status = JsonIndexSuccess;
+    size_t start = pScanner->offset;
+    size_t stringStart = 0U;
+    size_t stringLength = 0U;
+    JsonIndexType_t type = JsonIndexNull;
+    bool valid = true;
+    char c;
+
+    if( start == pScanner->length )
+    {
+        status = JsonIndexIllegalDocument;
+    }
+    else
+    {
+        c = pScanner->pDocument[ start ];
+
+        if( ( c == '{' ) || ( c == '[' ) )
+        {
+            type = ( c == '{' ) ? JsonIndexObject : JsonIndexArray;
+
+            if( *pDepth == JSON_INDEX_MAX_DEPTH )
+            {
+                status = JsonIndexMaxDepthExceeded;
+            }
+            else
+            {
+                status = addToken( pScanner, type, start, 0U, false );
+            }
+
+            if( status == JsonIndexSuccess )
+            {
+                pStack[ *pDepth ] = ( uint16_t ) ( pScanner->count - 1U );
+                ( *pDepth )++;
+                pScanner->offset++;
+                *pState = ( type == JsonIndexObject ) ? ScanKey : ScanValue;
+
+                /* An empty object or array closes at once. */
+                skipSpace( pScanner );
+
+                if( ( pScanner->offset < pScanner->length ) &&
+                    ( pScanner->pDocument[ pScanner->offset ] == ( ( type == JsonIndexObject ) ? '}' : ']' ) ) )
+                {
+                    *pState = ScanAfter;
+                    ( *pDepth )--;
+                    pScanner->offset++;
+                    pScanner->pTokens[ pStack[ *pDepth ] ].length = ( uint16_t ) ( pScanner->offset - start );
+                }
+            }
+        }
+        else
+        {
+            if( c == '"' )
+            {
+                type = JsonIndexString;
+                valid = scanString( pScanner, &stringStart, &stringLength );
+            }
+            else if( ( c == '-' ) || ( ( c >= '0' ) && ( c <= '9' ) ) )
+            {
+                type = JsonIndexNumber;
+                valid = scanNumber( pScanner );
+            }
+            else if( c == 't' )
+            {
+                type = JsonIndexTrue;
+                valid = scanLiteral( pScanner, "true", 4U );
+            }
+            else if( c == 'f' )
+            {
+                type = JsonIndexFalse;
+                valid = scanLiteral( pScanner, "false", 5U );
+            }
+            else if( c == 'n' )
+            {
+                type = JsonIndexNull;
+                valid = scanLiteral( pScanner, "null", 4U );
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if( valid == false )
+            {
+                status = JsonIndexIllegalDocument;
+            }
+            else if( type == JsonIndexString )
+            {
+                status = addToken( pScanner, type, stringStart, stringLength, false );
+            }
+            else
+            {
+                status = addToken( pScanner, type, start, pScanner->offset - start, false );
+            }
+
+            *pState = ScanAfter;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+JsonIndexStatus_t JsonIndex_Build( JsonIndex_t * pIndex,
+                                   const char * pDocument,
+                                   size_t documentLength,
+                                   JsonIndexToken_t * pTokens,
+                                   size_t maxTokens )
+{
+    JsonIndexStatus_t status = JsonIndexSuccess;
+    Scanner_t scanner;
+    uint16_t stack[ JSON_INDEX_MAX_DEPTH ];
+    size_t depth = 0U;
+    size_t keyStart = 0U;
+    size_t keyLength = 0U;
+    size_t open = 0U;
+    ScanState_t state = ScanValue;
+    char c;
+
+    if( ( pIndex == NULL ) || ( pDocument == NULL ) || ( pTokens == NULL ) ||
+        ( documentLength > UINT16_MAX ) )
+    {
+        status = JsonIndexBadParameter;
+    }
+    else
+    {
+        scanner.pDocument = pDocument;
+        scanner.length = documentLength;
+        scanner.offset = 0U;
+        scanner.pTokens = pTokens;
+        scanner.maxTokens = ( maxTokens >= UINT16_MAX ) ? ( UINT16_MAX - 1U ) : maxTokens;
+        scanner.count = 0U;
+
+        pIndex->pDocument = pDocument;
+        pIndex->pTokens = pTokens;
+        pIndex->tokenCount = 0U;
+    }
+
+    while( status == JsonIndexSuccess )
+    {
+        skipSpace( &scanner );
+
+        if( state == ScanValue )
+        {
+            status = scanValue( &scanner, stack, &depth, &state );
+        }
+        else if( state == ScanKey )
+        {
+            if( ( scanner.offset == scanner.length ) ||
+                ( pDocument[ scanner.offset ] != '"' ) ||
+                ( scanString( &scanner, &keyStart, &keyLength ) == false ) )
+            {
+                status = JsonIndexIllegalDocument;
+            }
+            else
+            {
+                status = addToken( &scanner, JsonIndexString, keyStart, keyLength, true );
+            }
+
+            if( status == JsonIndexSuccess )
+            {
+                skipSpace( &scanner );
+
+                if( ( scanner.offset == scanner.length ) || ( pDocument[ scanner.offset ] != ':' ) )
+                {
+                    status = JsonIndexIllegalDocument;
+                }
+                else
+                {
+                    scanner.offset++;
+                    state = ScanValue;
+                }
+            }
+        }
+        else if( depth == 0U )
+        {
+            /* The top-level value is complete: only whitespace may follow. */
+            if( scanner.offset != scanner.length )
+            {
+                status = JsonIndexIllegalDocument;
+            }
+
+            break;
+        }
+        else
+        {
+            open = stack[ depth - 1U ];
+            c = ( scanner.offset < scanner.length ) ? pDocument[ scanner.offset ] : '\0';
+
+            if( c == ',' )
+            {
+                scanner.offset++;
+                state = ( pTokens[ open ].type == ( uint8_t ) JsonIndexObject ) ? ScanKey : ScanValue;
+            }
+            else if( c == ( ( pTokens[ open ].type == ( uint8_t ) JsonIndexObject ) ? '}' : ']' ) )
+            {
+                scanner.offset++;
+                pTokens[ open ].length = ( uint16_t ) ( scanner.offset - pTokens[ open ].start );
+                pTokens[ open ].next = ( uint16_t ) scanner.count;
+                depth--;
+            }
+            else
+            {
+                status = JsonIndexIllegalDocument;
+            }
+        }
+    }
+
+    if( status == JsonIndexSuccess )
+    {
+        pIndex->tokenCount = scanner.count;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t findKey( const JsonIndex_t * pIndex,
+                       size_t object,
+                       const char * pKey,
+                       size_t keyLength )
+{
+    const JsonIndexToken_t * pTokens = pIndex->pTokens;
+    size_t end = pTokens[ object ].next;
+    size_t key = object + 1U;
+
+    /* Keys and values alternate, and a value's next is the following key. */
+    while( key < end )
+    {
+        if( ( pTokens[ key ].length == keyLength ) &&
+            ( memcmp( &pIndex->pDocument[ pTokens[ key ].start ], pKey, keyLength ) == 0 ) )
+        {
+            break;
+        }
+
+        key = pTokens[ key + 1U ].next;
+    }
+
+    return ( key < end ) ? ( key + 1U ) : end;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t findElement( const JsonIndex_t * pIndex,
+                           size_t array,
+                           size_t element )
+{
+    const JsonIndexToken_t * pTokens = pIndex->pTokens;
+    size_t end = pTokens[ array ].next;
+    size_t value = array + 1U;
+    size_t i;
+
+    for( i = 0U; ( i < element ) && ( value < end ); i++ )
+    {
+        value = pTokens[ value ].next;
+    }
+
+    return value;
+}
+
+/*-----------------------------------------------------------*/
+
+JsonIndexStatus_t JsonIndex_Find( const JsonIndex_t * pIndex,
+                                  size_t from,
+                                  const char * pQuery,
+                                  size_t queryLength,
+                                  size_t * pToken )
+{
+    JsonIndexStatus_t status = JsonIndexSuccess;
+    size_t token = from;
+    size_t found = 0U;
+    size_t i = 0U;
+    size_t keyStart = 0U;
+    size_t element = 0U;
+    size_t digits = 0U;
+
+    if( ( pIndex == NULL ) || ( pQuery == NULL ) || ( pToken == NULL ) ||
+        ( from >= pIndex->tokenCount ) || ( queryLength == 0U ) )
+    {
+        status = JsonIndexNotFound;
+    }
+
+    while( ( status == JsonIndexSuccess ) && ( i < queryLength ) )
+    {
+        if( pQuery[ i ] == '[' )
+        {
+            i++;
+            element = 0U;
+
+            for( digits = 0U; ( i < queryLength ) && ( pQuery[ i ] >= '0' ) && ( pQuery[ i ] <= '9' ); digits++ )
+            {
+                element = ( element * 10U ) + ( size_t ) ( pQuery[ i ] - '0' );
+                i++;
+            }
+
+            if( ( digits == 0U ) || ( digits > 5U ) || ( i == queryLength ) || ( pQuery[ i ] != ']' ) ||
+                ( pIndex->pTokens[ token ].type != ( uint8_t ) JsonIndexArray ) )
+            {
+                status = JsonIndexNotFound;
+            }
+            else
+            {
+                i++;
+                found = findElement( pIndex, token, element );
+            }
+        }
+        else
+        {
+            keyStart = i;
+
+            while( ( i < queryLength ) && ( pQuery[ i ] != '.' ) && ( pQuery[ i ] != '[' ) )
+            {
+                i++;
+            }
+
+            if( ( i == keyStart ) || ( pIndex->pTokens[ token ].type != ( uint8_t ) JsonIndexObject ) )
+            {
+                status = JsonIndexNotFound;
+            }
+            else
+            {
+                found = findKey( pIndex, token, &pQuery[ keyStart ], i - keyStart );
+            }
+        }
+
+        if( status == JsonIndexSuccess )
+        {
+            if( found == pIndex->pTokens[ token ].next )
+            {
+                status = JsonIndexNotFound;
+            }
+            else
+            {
+                token = found;
+            }
+        }
+
+        /* A '.' separates keys, and is followed by one. */
+        if( ( status == JsonIndexSuccess ) && ( i < queryLength ) && ( pQuery[ i ] == '.' ) )
+        {
+            i++;
+
+            if( ( i == queryLength ) || ( pQuery[ i ] == '.' ) || ( pQuery[ i ] == '[' ) )
+            {
+                status = JsonIndexNotFound;
+            }
+        }
+    }
+
+    if( status == JsonIndexSuccess )
+    {
+        *pToken = token;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonIndex_Get( const JsonIndex_t * pIndex,
+                    size_t token,
+                    const char ** ppValue,
+                    size_t * pValueLength,
+                    JsonIndexType_t * pType )
+{
+    const JsonIndexToken_t * pToken = &pIndex->pTokens[ token ];
+
+    *ppValue = &pIndex->pDocument[ pToken->start ];
+    *pValueLength = pToken->length;
+
+    if( pType != NULL )
+    {
+        *pType = ( JsonIndexType_t ) pToken->type;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+JsonIndexStatus_t JsonIndex_Search( const JsonIndex_t * pIndex,
+                                    const char * pQuery,
+                                    size_t queryLength,
+                                    const char ** ppValue,
+                                    size_t * pValueLength,
+                                    JsonIndexType_t * pType )
+{
+    JsonIndexStatus_t status = JsonIndexNotFound;
+    size_t token = 0U;
+
+    if( ( ppValue != NULL ) && ( pValueLength != NULL ) )
+    {
+        status = JsonIndex_Find( pIndex, JSON_INDEX_ROOT, pQuery, queryLength, &token );
+    }
+
+    if( status == JsonIndexSuccess )
+    {
+        JsonIndex_Get( pIndex, token, ppValue, pValueLength, pType );
+    }
+
+    return status;
+}
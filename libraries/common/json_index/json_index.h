@@ -0,0 +1,203 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file json_index.h
+ * @brief Tokenize a JSON document once and answer path queries from the
+ * tokens.
+ *
+ * JSON_Search scans the document from its start on every call, so a handler
+ * looking up k keys in a document of n bytes costs k scans of n bytes.
+ * #JsonIndex_Build validates the document and records every key and value in
+ * a token array the caller provides, in a single pass. Each token knows
+ * where the value after it starts, so #JsonIndex_Search walks a query such as
+ * `execution.jobDocument.action` by skipping whole members instead of
+ * scanning their text: the cost of a lookup is the number of members it
+ * passes, not the size of the document.
+ *
+ * Queries use the syntax of JSON_Search: keys separated by `.`, and array
+ * elements as `[index]`. Keys are compared without decoding escapes, and the
+ * first of duplicate keys is found, as with JSON_Search. A string value is
+ * returned without its quotes, an object or array with its brackets.
+ *
+ * The index points into the document, which must outlive it and not change.
+ * Documents are at most 65535 bytes.
+ */
+
+#ifndef JSON_INDEX_H_
+#define JSON_INDEX_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether string bodies and indentation are scanned a word at a time.
+ */
+#ifndef JSON_INDEX_WORD_SCAN
+    #define JSON_INDEX_WORD_SCAN    CONFIG_JSON_INDEX_WORD_SCAN
+#endif
+
+/**
+ * @brief The deepest nesting of objects and arrays accepted.
+ */
+#ifndef JSON_INDEX_MAX_DEPTH
+    #define JSON_INDEX_MAX_DEPTH    ( 32U )
+#endif
+
+/**
+ * @brief The token of the top-level value.
+ */
+#define JSON_INDEX_ROOT    ( 0U )
+
+/**
+ * @brief Return codes of the index functions.
+ */
+typedef enum JsonIndexStatus
+{
+    JsonIndexSuccess,          /**< The document was indexed, or the query found. */
+    JsonIndexBadParameter,     /**< A NULL pointer, or a document longer than 65535 bytes. */
+    JsonIndexIllegalDocument,  /**< The document isn't valid JSON. */
+    JsonIndexMaxDepthExceeded, /**< Nested deeper than #JSON_INDEX_MAX_DEPTH. */
+    JsonIndexOutOfTokens,      /**< The document has more keys and values than tokens. */
+    JsonIndexNotFound          /**< The query doesn't match, or is malformed. */
+} JsonIndexStatus_t;
+
+/**
+ * @brief The JSON type of a value.
+ */
+typedef enum JsonIndexType
+{
+    JsonIndexObject,
+    JsonIndexArray,
+    JsonIndexString,
+    JsonIndexNumber,
+    JsonIndexTrue,
+    JsonIndexFalse,
+    JsonIndexNull
+} JsonIndexType_t;
+
+/**
+ * @brief A key or value of the document.
+ *
+ * The fields are private to this module.
+ */
+typedef struct JsonIndexToken
+{
+    uint16_t start;  /* Offset of the text, past the opening quote of a string. */
+    uint16_t length; /* Length of the text, without the quotes of a string. */
+    uint16_t next;   /* Token after this one and everything inside it. */
+    uint8_t type;    /* A JsonIndexType_t. */
+    uint8_t isKey;
+} JsonIndexToken_t;
+
+/**
+ * @brief An indexed document.
+ *
+ * The fields are private to this module.
+ */
+typedef struct JsonIndex
+{
+    const char * pDocument;
+    JsonIndexToken_t * pTokens;
+    size_t tokenCount;
+} JsonIndex_t;
+
+/**
+ * @brief Validates a document and records its tokens.
+ *
+ * A document takes one token per value and one per key: an object of n
+ * members holding scalars takes 2n + 1.
+ *
+ * @param[out] pIndex The index to build.
+ * @param[in] pDocument The document.
+ * @param[in] documentLength The length of @a pDocument.
+ * @param[out] pTokens The tokens.
+ * @param[in] maxTokens The number of @a pTokens.
+ *
+ * @return #JsonIndexSuccess, or why the document couldn't be indexed.
+ */
+JsonIndexStatus_t JsonIndex_Build( JsonIndex_t * pIndex,
+                                   const char * pDocument,
+                                   size_t documentLength,
+                                   JsonIndexToken_t * pTokens,
+                                   size_t maxTokens );
+
+/**
+ * @brief Finds the value at a query, relative to a value of the document.
+ *
+ * @param[in] pIndex The index.
+ * @param[in] from The token of the object or array the query starts from,
+ * #JSON_INDEX_ROOT for the whole document or one found by an earlier call.
+ * @param[in] pQuery The query.
+ * @param[in] queryLength The length of @a pQuery.
+ * @param[out] pToken The token of the value.
+ *
+ * @return #JsonIndexSuccess or #JsonIndexNotFound.
+ */
+JsonIndexStatus_t JsonIndex_Find( const JsonIndex_t * pIndex,
+                                  size_t from,
+                                  const char * pQuery,
+                                  size_t queryLength,
+                                  size_t * pToken );
+
+/**
+ * @brief Gets the text and type of the value of a token.
+ *
+ * @param[in] pIndex The index.
+ * @param[in] token A token returned by #JsonIndex_Find.
+ * @param[out] ppValue The text of the value, in the document.
+ * @param[out] pValueLength The length of the text.
+ * @param[out] pType The type of the value. Can be NULL.
+ */
+void JsonIndex_Get( const JsonIndex_t * pIndex,
+                    size_t token,
+                    const char ** ppValue,
+                    size_t * pValueLength,
+                    JsonIndexType_t * pType );
+
+/**
+ * @brief Finds the value at a query from the top of the document, like
+ * JSON_Search.
+ *
+ * @param[in] pIndex The index.
+ * @param[in] pQuery The query.
+ * @param[in] queryLength The length of @a pQuery.
+ * @param[out] ppValue The text of the value, in the document.
+ * @param[out] pValueLength The length of the text.
+ * @param[out] pType The type of the value. Can be NULL.
+ *
+ * @return #JsonIndexSuccess or #JsonIndexNotFound.
+ */
+JsonIndexStatus_t JsonIndex_Search( const JsonIndex_t * pIndex,
+                                    const char * pQuery,
+                                    size_t queryLength,
+                                    const char ** ppValue,
+                                    size_t * pValueLength,
+                                    JsonIndexType_t * pType );
+
+#endif /* ifndef JSON_INDEX_H_ */
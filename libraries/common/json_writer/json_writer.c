@@ -0,0 +1,430 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file json_writer.c
+ * @brief Implementation of the streaming JSON writer.
+ *
+ * Every write goes through #writeBytes, which counts the bytes whether they
+ * fit or not and copies nothing once one write didn't fit, so the buffer
+ * always holds a prefix of the document.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The digits of the longest 64-bit unsigned integer.
+ */
+#define UINT64_MAX_DIGITS    ( 20U )
+
+/**
+ * @brief The bit of the innermost open container.
+ */
+#define DEPTH_BIT( depth )    ( ( uint32_t ) 1U << ( ( depth ) - 1U ) )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Appends @a length bytes to the document, if they fit with the
+ * terminator, and counts them either way.
+ */
+static void writeBytes( JsonWriter_t * pWriter,
+                        const char * pData,
+                        size_t length );
+
+/**
+ * @brief Appends a string in quotes, escaping the characters JSON requires.
+ */
+static void writeEscaped( JsonWriter_t * pWriter,
+                          const char * pValue,
+                          size_t valueLength );
+
+/**
+ * @brief Appends the decimal digits of @a value, at least @a minDigits of
+ * them.
+ */
+static void writeDecimal( JsonWriter_t * pWriter,
+                          uint64_t value,
+                          size_t minDigits );
+
+/**
+ * @brief Appends what precedes a value: the comma after the previous
+ * element and the key, and checks that the key matches the container.
+ */
+static void beginValue( JsonWriter_t * pWriter,
+                        const char * pKey );
+
+/**
+ * @brief Opens an object or array.
+ */
+static void beginContainer( JsonWriter_t * pWriter,
+                            const char * pKey,
+                            bool isArray );
+
+/**
+ * @brief Closes the innermost container, which must be of the given kind.
+ */
+static void endContainer( JsonWriter_t * pWriter,
+                          bool isArray );
+
+/*-----------------------------------------------------------*/
+
+static void writeBytes( JsonWriter_t * pWriter,
+                        const char * pData,
+                        size_t length )
+{
+    if( ( pWriter->overflow == false ) &&
+        ( length < ( pWriter->bufferLength - pWriter->length ) ) )
+    {
+        ( void ) memcpy( &pWriter->pBuffer[ pWriter->length ], pData, length );
+    }
+    else
+    {
+        pWriter->overflow = true;
+    }
+
+    pWriter->length += length;
+}
+
+/*-----------------------------------------------------------*/
+
+static void writeEscaped( JsonWriter_t * pWriter,
+                          const char * pValue,
+                          size_t valueLength )
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    char escape[ 6 ] = { '\\', 'u', '0', '0', '0', '0' };
+    size_t runStart = 0U;
+    uint8_t c = 0U;
+    size_t i;
+
+    writeBytes( pWriter, "\"", 1U );
+
+    for( i = 0; i < valueLength; i++ )
+    {
+        c = ( uint8_t ) pValue[ i ];
+
+        if( ( c == ( uint8_t ) '"' ) || ( c == ( uint8_t ) '\\' ) || ( c < 0x20U ) )
+        {
+            /* Copy the characters that need no escape in one go. */
+            writeBytes( pWriter, &pValue[ runStart ], i - runStart );
+            runStart = i + 1U;
+
+            if( c >= 0x20U )
+            {
+                escape[ 1 ] = ( char ) c;
+                writeBytes( pWriter, escape, 2U );
+            }
+            else if( c == ( uint8_t ) '\n' )
+            {
+                writeBytes( pWriter, "\\n", 2U );
+            }
+            else if( c == ( uint8_t ) '\r' )
+            {
+                writeBytes( pWriter, "\\r", 2U );
+            }
+            else if( c == ( uint8_t ) '\t' )
+            {
+                writeBytes( pWriter, "\\t", 2U );
+            }
+            else
+            {
+                escape[ 1 ] = 'u';
+                escape[ 4 ] = hexDigits[ c >> 4 ];
+                escape[ 5 ] = hexDigits[ c & 0x0FU ];
+                writeBytes( pWriter, escape, sizeof( escape ) );
+            }
+        }
+    }
+
+    writeBytes( pWriter, &pValue[ runStart ], valueLength - runStart );
+    writeBytes( pWriter, "\"", 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void writeDecimal( JsonWriter_t * pWriter,
+                          uint64_t value,
+                          size_t minDigits )
+{
+    char digits[ UINT64_MAX_DIGITS ];
+    size_t start = sizeof( digits );
+
+    if( minDigits > sizeof( digits ) )
+    {
+        minDigits = sizeof( digits );
+    }
+
+    /* Digits are produced from the last one. */
+    do
+    {
+        start--;
+        digits[ start ] = ( char ) ( '0' + ( value % 10U ) );
+        value /= 10U;
+    } while( ( value > 0U ) || ( ( sizeof( digits ) - start ) < minDigits ) );
+
+    writeBytes( pWriter, &digits[ start ], sizeof( digits ) - start );
+}
+
+/*-----------------------------------------------------------*/
+
+static void beginValue( JsonWriter_t * pWriter,
+                        const char * pKey )
+{
+    bool inArray = false;
+
+    if( pWriter->depth == 0U )
+    {
+        /* Only the top-level value has no container, and it has no key. */
+        pWriter->invalid = pWriter->invalid || ( pKey != NULL ) || ( pWriter->length > 0U );
+    }
+    else
+    {
+        inArray = ( ( pWriter->isArray & DEPTH_BIT( pWriter->depth ) ) != 0U );
+        pWriter->invalid = pWriter->invalid || ( inArray == ( pKey != NULL ) );
+
+        if( ( pWriter->hasElement & DEPTH_BIT( pWriter->depth ) ) != 0U )
+        {
+            writeBytes( pWriter, ",", 1U );
+        }
+
+        pWriter->hasElement |= DEPTH_BIT( pWriter->depth );
+    }
+
+    if( pKey != NULL )
+    {
+        writeEscaped( pWriter, pKey, strlen( pKey ) );
+        writeBytes( pWriter, ":", 1U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void beginContainer( JsonWriter_t * pWriter,
+                            const char * pKey,
+                            bool isArray )
+{
+    assert( pWriter != NULL );
+
+    beginValue( pWriter, pKey );
+
+    if( pWriter->depth == JSON_WRITER_MAX_DEPTH )
+    {
+        pWriter->invalid = true;
+    }
+    else
+    {
+        pWriter->depth++;
+        pWriter->hasElement &= ~DEPTH_BIT( pWriter->depth );
+
+        if( isArray == true )
+        {
+            pWriter->isArray |= DEPTH_BIT( pWriter->depth );
+        }
+        else
+        {
+            pWriter->isArray &= ~DEPTH_BIT( pWriter->depth );
+        }
+
+        writeBytes( pWriter, ( isArray == true ) ? "[" : "{", 1U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void endContainer( JsonWriter_t * pWriter,
+                          bool isArray )
+{
+    assert( pWriter != NULL );
+
+    if( ( pWriter->depth == 0U ) ||
+        ( ( ( pWriter->isArray & DEPTH_BIT( pWriter->depth ) ) != 0U ) != isArray ) )
+    {
+        pWriter->invalid = true;
+    }
+    else
+    {
+        writeBytes( pWriter, ( isArray == true ) ? "]" : "}", 1U );
+        pWriter->depth--;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_Init( JsonWriter_t * pWriter,
+                      char * pBuffer,
+                      size_t bufferLength )
+{
+    assert( pWriter != NULL );
+    assert( ( pBuffer != NULL ) || ( bufferLength == 0U ) );
+
+    ( void ) memset( pWriter, 0x00, sizeof( *pWriter ) );
+    pWriter->pBuffer = pBuffer;
+    pWriter->bufferLength = bufferLength;
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_BeginObject( JsonWriter_t * pWriter,
+                             const char * pKey )
+{
+    beginContainer( pWriter, pKey, false );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_EndObject( JsonWriter_t * pWriter )
+{
+    endContainer( pWriter, false );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_BeginArray( JsonWriter_t * pWriter,
+                            const char * pKey )
+{
+    beginContainer( pWriter, pKey, true );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_EndArray( JsonWriter_t * pWriter )
+{
+    endContainer( pWriter, true );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_AddString( JsonWriter_t * pWriter,
+                           const char * pKey,
+                           const char * pValue,
+                           size_t valueLength )
+{
+    assert( pWriter != NULL );
+    assert( ( pValue != NULL ) || ( valueLength == 0U ) );
+
+    beginValue( pWriter, pKey );
+    writeEscaped( pWriter, pValue, valueLength );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_AddInteger( JsonWriter_t * pWriter,
+                            const char * pKey,
+                            int64_t value )
+{
+    assert( pWriter != NULL );
+
+    beginValue( pWriter, pKey );
+
+    if( value < 0 )
+    {
+        writeBytes( pWriter, "-", 1U );
+
+        /* Negated as unsigned, so INT64_MIN doesn't overflow. */
+        writeDecimal( pWriter, ( uint64_t ) 0U - ( uint64_t ) value, 1U );
+    }
+    else
+    {
+        writeDecimal( pWriter, ( uint64_t ) value, 1U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_AddUnsigned( JsonWriter_t * pWriter,
+                             const char * pKey,
+                             uint64_t value )
+{
+    assert( pWriter != NULL );
+
+    beginValue( pWriter, pKey );
+    writeDecimal( pWriter, value, 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_AddToken( JsonWriter_t * pWriter,
+                          const char * pKey,
+                          uint64_t value,
+                          size_t minDigits )
+{
+    assert( pWriter != NULL );
+
+    beginValue( pWriter, pKey );
+    writeBytes( pWriter, "\"", 1U );
+    writeDecimal( pWriter, value, minDigits );
+    writeBytes( pWriter, "\"", 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+void JsonWriter_AddBoolean( JsonWriter_t * pWriter,
+                            const char * pKey,
+                            bool value )
+{
+    assert( pWriter != NULL );
+
+    beginValue( pWriter, pKey );
+
+    if( value == true )
+    {
+        writeBytes( pWriter, "true", 4U );
+    }
+    else
+    {
+        writeBytes( pWriter, "false", 5U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool JsonWriter_Finish( JsonWriter_t * pWriter,
+                        size_t * pLength )
+{
+    bool status = false;
+
+    assert( pWriter != NULL );
+
+    /* writeBytes leaves room for the terminator. */
+    if( ( pWriter->overflow == false ) && ( pWriter->length < pWriter->bufferLength ) )
+    {
+        pWriter->pBuffer[ pWriter->length ] = '\0';
+    }
+
+    if( pLength != NULL )
+    {
+        *pLength = pWriter->length;
+    }
+
+    status = ( pWriter->overflow == false ) && ( pWriter->invalid == false ) &&
+             ( pWriter->depth == 0U ) && ( pWriter->length > 0U );
+
+    return status;
+}
@@ -0,0 +1,170 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file json_writer.h
+ * @brief Write a JSON document straight into the buffer it is sent from.
+ *
+ * The document is written member by member into the caller's buffer: the
+ * payload buffer of the publish, so there is no template, no intermediate
+ * copy and no allocation. Keys and strings are escaped and numbers are
+ * formatted without stdio. The writer counts every byte of the document,
+ * including those that didn't fit, so an overflow is reported with the
+ * buffer size that would have been needed instead of a truncated document.
+ *
+ * A writer is driven by one task and holds no locks.
+ */
+
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The deepest nesting of objects and arrays.
+ */
+#define JSON_WRITER_MAX_DEPTH    ( 32U )
+
+/**
+ * @brief A document being written.
+ *
+ * The fields are private to this module.
+ */
+typedef struct JsonWriter
+{
+    char * pBuffer;
+    size_t bufferLength;
+
+    /* Length of the document so far, even past the end of the buffer. */
+    size_t length;
+
+    /* One bit per open container: whether it is an array, and whether it
+     * has an element yet, so the next one is preceded by a comma. */
+    uint32_t isArray;
+    uint32_t hasElement;
+    uint8_t depth;
+
+    bool overflow;
+    bool invalid;
+} JsonWriter_t;
+
+/**
+ * @brief Starts a document in a buffer.
+ *
+ * @param[out] pWriter The writer to initialize.
+ * @param[in] pBuffer Where the document is written.
+ * @param[in] bufferLength The size of @a pBuffer. One byte is kept for the
+ * terminator written by #JsonWriter_Finish.
+ */
+void JsonWriter_Init( JsonWriter_t * pWriter,
+                      char * pBuffer,
+                      size_t bufferLength );
+
+/**
+ * @brief Opens an object.
+ *
+ * @param[in] pWriter The writer.
+ * @param[in] pKey The NUL-terminated key of the member inside an object, or
+ * NULL for the top level or an element of an array. The same applies to
+ * the key of every function adding a value.
+ */
+void JsonWriter_BeginObject( JsonWriter_t * pWriter,
+                             const char * pKey );
+
+/**
+ * @brief Closes the innermost object.
+ */
+void JsonWriter_EndObject( JsonWriter_t * pWriter );
+
+/**
+ * @brief Opens an array.
+ */
+void JsonWriter_BeginArray( JsonWriter_t * pWriter,
+                            const char * pKey );
+
+/**
+ * @brief Closes the innermost array.
+ */
+void JsonWriter_EndArray( JsonWriter_t * pWriter );
+
+/**
+ * @brief Adds a string, escaped.
+ *
+ * @param[in] pWriter The writer.
+ * @param[in] pKey The key, or NULL.
+ * @param[in] pValue The string, which needn't be NUL-terminated.
+ * @param[in] valueLength The length of @a pValue.
+ */
+void JsonWriter_AddString( JsonWriter_t * pWriter,
+                           const char * pKey,
+                           const char * pValue,
+                           size_t valueLength );
+
+/**
+ * @brief Adds a signed integer.
+ */
+void JsonWriter_AddInteger( JsonWriter_t * pWriter,
+                            const char * pKey,
+                            int64_t value );
+
+/**
+ * @brief Adds an unsigned integer.
+ */
+void JsonWriter_AddUnsigned( JsonWriter_t * pWriter,
+                             const char * pKey,
+                             uint64_t value );
+
+/**
+ * @brief Adds an unsigned integer as a string of at least @a minDigits
+ * digits, padded with zeros, such as the client tokens of the demos.
+ */
+void JsonWriter_AddToken( JsonWriter_t * pWriter,
+                          const char * pKey,
+                          uint64_t value,
+                          size_t minDigits );
+
+/**
+ * @brief Adds true or false.
+ */
+void JsonWriter_AddBoolean( JsonWriter_t * pWriter,
+                            const char * pKey,
+                            bool value );
+
+/**
+ * @brief Ends the document and NUL-terminates it.
+ *
+ * @param[in] pWriter The writer.
+ * @param[out] pLength The length of the document, without the terminator.
+ * After an overflow, the length it would have had, so a buffer of
+ * @a pLength + 1 bytes holds it. Can be NULL.
+ *
+ * @return false if the document didn't fit, a container is still open, or a
+ * key was missing or out of place.
+ */
+bool JsonWriter_Finish( JsonWriter_t * pWriter,
+                        size_t * pLength );
+
+#endif /* ifndef JSON_WRITER_H_ */
@@ -0,0 +1,433 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file latency_probe.c
+ * @brief Implementation of the latency probes.
+ *
+ * The probe in flight is stamped from the service task and from the agent
+ * task. The service task publishes the sequence number, then the state, and
+ * the agent task reads the state before the sequence number, so that a probe
+ * coming back after the next one started is told apart. The stamps are 32
+ * bits, to be stored atomically on any core, which is enough for the
+ * differences between them.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the latency probes. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Latency Probe"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "perf_metrics.h"
+
+#include "latency_probe.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The start of the payload of a probe, followed by its sequence
+ * number and a closing brace.
+ */
+#define PROBE_PREFIX           "{\"probe\":"
+#define PROBE_PREFIX_LENGTH    ( sizeof( PROBE_PREFIX ) - 1U )
+
+/**
+ * @brief The states of the probe in flight.
+ */
+#define PROBE_IDLE             ( 0U )
+#define PROBE_IN_FLIGHT        ( 1U )
+#define PROBE_MATCHED          ( 2U )
+
+/**
+ * @brief The times kept for each probe. The time of each stage but the
+ * enqueue is the time since the stage before, and is kept at the index of
+ * the stage; the enqueue has none, and its index keeps the whole round trip.
+ */
+#define INTERVAL_TOTAL         ( ( size_t ) LatencyProbeEnqueue )
+#define INTERVAL_COUNT         ( ( size_t ) LatencyProbeStageCount )
+
+/**
+ * @brief The probe in flight.
+ */
+static uint32_t probeSequence = 0U;
+static uint32_t probeState = PROBE_IDLE;
+static uint32_t probeStampsUs[ LatencyProbeStageCount ];
+
+/**
+ * @brief The receive of the latest incoming PUBLISH, kept for the probe
+ * once the PUBLISH is known to be the probe. Only the agent task uses it.
+ */
+static uint32_t lastReceiveUs = 0U;
+
+/**
+ * @brief The times of the latest probes, a ring per interval. Only the
+ * service task uses them.
+ */
+static uint32_t windowUs[ INTERVAL_COUNT ][ LATENCY_PROBE_WINDOW ];
+static size_t windowCount = 0U;
+static size_t windowNext = 0U;
+
+/**
+ * @brief The probes that didn't come back before the next one started.
+ */
+static uint32_t probesLost = 0U;
+
+/**
+ * @brief The names of the intervals, for the log.
+ */
+static const char * const intervalNames[ INTERVAL_COUNT ] =
+{
+    "total",
+    "send",
+    "receive",
+    "dispatch",
+    "handler"
+};
+
+/* The 50th and 99th percentiles of each interval over the window, and the
+ * probes lost. */
+PERF_METRICS_GAUGE( totalP50Metric, "probe_total_p50_us" );
+PERF_METRICS_GAUGE( totalP99Metric, "probe_total_p99_us" );
+PERF_METRICS_GAUGE( sendP50Metric, "probe_send_p50_us" );
+PERF_METRICS_GAUGE( sendP99Metric, "probe_send_p99_us" );
+PERF_METRICS_GAUGE( receiveP50Metric, "probe_receive_p50_us" );
+PERF_METRICS_GAUGE( receiveP99Metric, "probe_receive_p99_us" );
+PERF_METRICS_GAUGE( dispatchP50Metric, "probe_dispatch_p50_us" );
+PERF_METRICS_GAUGE( dispatchP99Metric, "probe_dispatch_p99_us" );
+PERF_METRICS_GAUGE( handlerP50Metric, "probe_handler_p50_us" );
+PERF_METRICS_GAUGE( handlerP99Metric, "probe_handler_p99_us" );
+PERF_METRICS_COUNTER( lostMetric, "probe_lost" );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The time now, in microseconds, wrapping at 32 bits.
+ */
+static uint32_t nowUs( void );
+
+/**
+ * @brief Reads the sequence number of a probe payload.
+ *
+ * @return true if the payload is a probe.
+ */
+static bool parseSequence( const char * pPayload,
+                           size_t payloadLength,
+                           uint32_t * pSequence );
+
+/**
+ * @brief The nearest-rank percentile of the times of an interval in the
+ * window.
+ */
+static uint32_t percentile( size_t interval,
+                            uint32_t percent );
+
+/**
+ * @brief Sets the percentile gauges of every interval.
+ */
+static void recordMetrics( void );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t nowUs( void )
+{
+    return ( uint32_t ) Clock_GetTimeUs();
+}
+
+/*-----------------------------------------------------------*/
+
+static bool parseSequence( const char * pPayload,
+                           size_t payloadLength,
+                           uint32_t * pSequence )
+{
+    uint64_t sequence = 0U;
+    size_t i = PROBE_PREFIX_LENGTH;
+
+    /* At least one digit and the closing brace. */
+    if( ( payloadLength < ( PROBE_PREFIX_LENGTH + 2U ) ) ||
+        ( memcmp( pPayload, PROBE_PREFIX, PROBE_PREFIX_LENGTH ) != 0 ) ||
+        ( pPayload[ payloadLength - 1U ] != '}' ) )
+    {
+        return false;
+    }
+
+    for( ; i < ( payloadLength - 1U ); i++ )
+    {
+        if( ( pPayload[ i ] < '0' ) || ( pPayload[ i ] > '9' ) )
+        {
+            return false;
+        }
+
+        sequence = ( sequence * 10U ) + ( uint64_t ) ( pPayload[ i ] - '0' );
+
+        if( sequence > UINT32_MAX )
+        {
+            return false;
+        }
+    }
+
+    *pSequence = ( uint32_t ) sequence;
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t percentile( size_t interval,
+                            uint32_t percent )
+{
+    uint32_t sorted[ LATENCY_PROBE_WINDOW ];
+    uint32_t value;
+    size_t rank;
+    size_t i;
+    size_t j;
+
+    assert( windowCount > 0U );
+
+    /* An insertion sort, which is quick enough for a window this small. */
+    for( i = 0U; i < windowCount; i++ )
+    {
+        value = windowUs[ interval ][ i ];
+
+        for( j = i; ( j > 0U ) && ( sorted[ j - 1U ] > value ); j-- )
+        {
+            sorted[ j ] = sorted[ j - 1U ];
+        }
+
+        sorted[ j ] = value;
+    }
+
+    rank = ( ( ( size_t ) percent * windowCount ) + 99U ) / 100U;
+
+    return sorted[ ( rank > 0U ) ? ( rank - 1U ) : 0U ];
+}
+
+/*-----------------------------------------------------------*/
+
+#if PERF_METRICS_ENABLED
+
+    static void recordMetrics( void )
+    {
+        static PerfMetric_t * const p50Metrics[ INTERVAL_COUNT ] =
+        {
+            &totalP50Metric, &sendP50Metric, &receiveP50Metric, &dispatchP50Metric, &handlerP50Metric
+        };
+        static PerfMetric_t * const p99Metrics[ INTERVAL_COUNT ] =
+        {
+            &totalP99Metric, &sendP99Metric, &receiveP99Metric, &dispatchP99Metric, &handlerP99Metric
+        };
+        size_t interval;
+
+        for( interval = 0U; interval < INTERVAL_COUNT; interval++ )
+        {
+            /* Registering again does nothing. */
+            PerfMetrics_Register( p50Metrics[ interval ] );
+            PerfMetrics_Register( p99Metrics[ interval ] );
+
+            PerfMetrics_Set( p50Metrics[ interval ], percentile( interval, 50U ) );
+            PerfMetrics_Set( p99Metrics[ interval ], percentile( interval, 99U ) );
+        }
+    }
+
+#else /* if PERF_METRICS_ENABLED */
+
+    static void recordMetrics( void )
+    {
+    }
+
+#endif /* if PERF_METRICS_ENABLED */
+
+/*-----------------------------------------------------------*/
+
+size_t LatencyProbe_Start( char * pBuffer,
+                           size_t bufferSize )
+{
+    uint32_t sequence = __atomic_load_n( &probeSequence, __ATOMIC_RELAXED ) + 1U;
+    int length;
+    size_t stage;
+
+    assert( pBuffer != NULL );
+
+    length = snprintf( pBuffer, bufferSize, PROBE_PREFIX "%lu}", ( unsigned long ) sequence );
+
+    if( ( length < 0 ) || ( ( size_t ) length >= bufferSize ) )
+    {
+        return 0U;
+    }
+
+    if( __atomic_load_n( &probeState, __ATOMIC_ACQUIRE ) != PROBE_IDLE )
+    {
+        ( void ) __atomic_add_fetch( &probesLost, 1U, __ATOMIC_RELAXED );
+        PERF_METRICS_REGISTER( lostMetric );
+        PERF_METRICS_ADD( lostMetric, 1U );
+        LogWarn( ( "Probe %lu didn't come back.", ( unsigned long ) ( sequence - 1U ) ) );
+    }
+
+    for( stage = 0U; stage < ( size_t ) LatencyProbeStageCount; stage++ )
+    {
+        __atomic_store_n( &probeStampsUs[ stage ], 0U, __ATOMIC_RELAXED );
+    }
+
+    __atomic_store_n( &probeSequence, sequence, __ATOMIC_RELAXED );
+    __atomic_store_n( &probeStampsUs[ LatencyProbeEnqueue ], nowUs(), __ATOMIC_RELAXED );
+    __atomic_store_n( &probeState, PROBE_IN_FLIGHT, __ATOMIC_RELEASE );
+
+    return ( size_t ) length;
+}
+
+/*-----------------------------------------------------------*/
+
+void LatencyProbe_Stamp( LatencyProbeStage_t stage )
+{
+    assert( ( stage == LatencyProbeSend ) || ( stage == LatencyProbeReceive ) );
+
+    if( stage == LatencyProbeReceive )
+    {
+        lastReceiveUs = nowUs();
+    }
+    else if( __atomic_load_n( &probeState, __ATOMIC_ACQUIRE ) == PROBE_IN_FLIGHT )
+    {
+        __atomic_store_n( &probeStampsUs[ LatencyProbeSend ], nowUs(), __ATOMIC_RELAXED );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool LatencyProbe_Match( const void * pPayload,
+                         size_t payloadLength )
+{
+    uint32_t sequence = 0U;
+
+    assert( ( pPayload != NULL ) || ( payloadLength == 0U ) );
+
+    if( ( payloadLength == 0U ) ||
+        ( parseSequence( pPayload, payloadLength, &sequence ) == false ) ||
+        ( __atomic_load_n( &probeState, __ATOMIC_ACQUIRE ) != PROBE_IN_FLIGHT ) ||
+        ( sequence != __atomic_load_n( &probeSequence, __ATOMIC_RELAXED ) ) )
+    {
+        LogDebug( ( "Ignored a late or unknown probe." ) );
+
+        return false;
+    }
+
+    __atomic_store_n( &probeStampsUs[ LatencyProbeReceive ], lastReceiveUs, __ATOMIC_RELAXED );
+    __atomic_store_n( &probeStampsUs[ LatencyProbeDispatch ], nowUs(), __ATOMIC_RELAXED );
+    __atomic_store_n( &probeState, PROBE_MATCHED, __ATOMIC_RELEASE );
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+void LatencyProbe_Finish( void )
+{
+    uint32_t stampsUs[ LatencyProbeStageCount ];
+    size_t stage;
+
+    if( __atomic_load_n( &probeState, __ATOMIC_ACQUIRE ) != PROBE_MATCHED )
+    {
+        return;
+    }
+
+    __atomic_store_n( &probeStampsUs[ LatencyProbeHandler ], nowUs(), __ATOMIC_RELAXED );
+
+    for( stage = 0U; stage < ( size_t ) LatencyProbeStageCount; stage++ )
+    {
+        stampsUs[ stage ] = __atomic_load_n( &probeStampsUs[ stage ], __ATOMIC_RELAXED );
+    }
+
+    /* A probe whose send wasn't stamped was sent by another path; its send is
+     * counted with the network. */
+    if( stampsUs[ LatencyProbeSend ] == 0U )
+    {
+        stampsUs[ LatencyProbeSend ] = stampsUs[ LatencyProbeEnqueue ];
+    }
+
+    for( stage = 1U; stage < ( size_t ) LatencyProbeStageCount; stage++ )
+    {
+        windowUs[ stage ][ windowNext ] = stampsUs[ stage ] - stampsUs[ stage - 1U ];
+    }
+
+    windowUs[ INTERVAL_TOTAL ][ windowNext ] = stampsUs[ LatencyProbeHandler ] - stampsUs[ LatencyProbeEnqueue ];
+
+    LogDebug( ( "Probe %lu: send %lu us, receive %lu us, dispatch %lu us, handler %lu us.",
+                ( unsigned long ) __atomic_load_n( &probeSequence, __ATOMIC_RELAXED ),
+                ( unsigned long ) windowUs[ LatencyProbeSend ][ windowNext ],
+                ( unsigned long ) windowUs[ LatencyProbeReceive ][ windowNext ],
+                ( unsigned long ) windowUs[ LatencyProbeDispatch ][ windowNext ],
+                ( unsigned long ) windowUs[ LatencyProbeHandler ][ windowNext ] ) );
+
+    windowNext = ( windowNext + 1U ) % LATENCY_PROBE_WINDOW;
+
+    if( windowCount < LATENCY_PROBE_WINDOW )
+    {
+        windowCount++;
+    }
+
+    __atomic_store_n( &probeState, PROBE_IDLE, __ATOMIC_RELEASE );
+
+    recordMetrics();
+}
+
+/*-----------------------------------------------------------*/
+
+void LatencyProbe_Dump( void )
+{
+    size_t interval;
+
+    if( windowCount == 0U )
+    {
+        LogInfo( ( "No probe came back, %lu lost.",
+                   ( unsigned long ) __atomic_load_n( &probesLost, __ATOMIC_RELAXED ) ) );
+
+        return;
+    }
+
+    for( interval = 0U; interval < INTERVAL_COUNT; interval++ )
+    {
+        LogInfo( ( "%-8s p50 %8lu us, p99 %8lu us.",
+                   intervalNames[ interval ],
+                   ( unsigned long ) percentile( interval, 50U ),
+                   ( unsigned long ) percentile( interval, 99U ) ) );
+    }
+
+    LogInfo( ( "Over the latest %lu probes, %lu lost in all.",
+               ( unsigned long ) windowCount,
+               ( unsigned long ) __atomic_load_n( &probesLost, __ATOMIC_RELAXED ) ) );
+}
+
+/*-----------------------------------------------------------*/
@@ -0,0 +1,166 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file latency_probe.h
+ * @brief Break the latency of a message down into the stages it goes
+ * through, from probes the device publishes to a topic it subscribes to.
+ *
+ * A probe is timestamped, in microseconds, at each stage of its round trip:
+ *
+ * - enqueue: the probe is built and its publish command queued.
+ * - send: the agent task wrote the PUBLISH to the transport.
+ * - receive: the agent task read a PUBLISH back from the transport.
+ * - dispatch: the subscription manager called the callback of the topic.
+ * - handler: the service task took the probe from the callback.
+ *
+ * All the stamps are taken on the device, so the clocks of the device and of
+ * the broker don't need to agree. The time between each stage and the one
+ * before, and the whole round trip, are kept for the latest
+ * LATENCY_PROBE_WINDOW probes, and their 50th and 99th percentiles are
+ * exported as gauges of the performance metrics, such as
+ * "probe_receive_p99_us" for the time from the send to the receive, which is
+ * the network and the broker.
+ *
+ * One probe is in flight at a time. Starting one before the previous one came
+ * back counts the previous one as lost, and a probe coming back late is
+ * ignored.
+ *
+ * The agent task stamps the send and the receive with LATENCY_PROBE_STAMP.
+ * With LATENCY_PROBE_ENABLED set to 0, the macro expands to nothing. On
+ * ESP-IDF it follows CONFIG_LATENCY_PROBE_ENABLE; other builds define it.
+ */
+
+#ifndef LATENCY_PROBE_H_
+#define LATENCY_PROBE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+/**
+ * @brief Whether probes are sent and the stages stamped.
+ */
+#ifndef LATENCY_PROBE_ENABLED
+    #if CONFIG_LATENCY_PROBE_ENABLE
+        #define LATENCY_PROBE_ENABLED    1
+    #else
+        #define LATENCY_PROBE_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief The number of the latest probes the percentiles are taken over.
+ */
+#ifndef LATENCY_PROBE_WINDOW
+    #ifdef CONFIG_LATENCY_PROBE_WINDOW
+        #define LATENCY_PROBE_WINDOW    CONFIG_LATENCY_PROBE_WINDOW
+    #else
+        #define LATENCY_PROBE_WINDOW    32
+    #endif
+#endif
+
+/**
+ * @brief The size of the buffer a probe is built in.
+ */
+#define LATENCY_PROBE_PAYLOAD_SIZE    ( sizeof( "{\"probe\":4294967295}" ) )
+
+/**
+ * @brief The stages of the round trip of a probe.
+ */
+typedef enum LatencyProbeStage
+{
+    LatencyProbeEnqueue,  /**< The publish of the probe was queued. */
+    LatencyProbeSend,     /**< The PUBLISH was written to the transport. */
+    LatencyProbeReceive,  /**< A PUBLISH was read from the transport. */
+    LatencyProbeDispatch, /**< The callback of the probe topic was called. */
+    LatencyProbeHandler,  /**< The service task took the probe. */
+    LatencyProbeStageCount
+} LatencyProbeStage_t;
+
+#if LATENCY_PROBE_ENABLED
+
+/**
+ * @brief Stamps @a stage of the probe in flight.
+ */
+    #define LATENCY_PROBE_STAMP( stage )    LatencyProbe_Stamp( stage )
+
+#else
+
+    #define LATENCY_PROBE_STAMP( stage )    do {} while( 0 )
+
+#endif /* if LATENCY_PROBE_ENABLED */
+
+/**
+ * @brief Starts a probe: builds its payload and stamps the enqueue. The
+ * payload is to be published, at QoS 0, right away.
+ *
+ * @param[out] pBuffer Where to build the payload.
+ * @param[in] bufferSize The size of @a pBuffer, at least
+ * #LATENCY_PROBE_PAYLOAD_SIZE.
+ *
+ * @return The length of the payload, or 0 if it doesn't fit.
+ */
+size_t LatencyProbe_Start( char * pBuffer,
+                           size_t bufferSize );
+
+/**
+ * @brief Stamps the send or the receive. The send is stamped when the
+ * publish command of the probe completes, and the receive for every incoming
+ * PUBLISH, before it is dispatched; the receive is kept for the probe once
+ * the probe is matched.
+ *
+ * @param[in] stage #LatencyProbeSend or #LatencyProbeReceive.
+ */
+void LatencyProbe_Stamp( LatencyProbeStage_t stage );
+
+/**
+ * @brief Tells whether a message on the probe topic is the probe in flight,
+ * and if so stamps its dispatch. To be called by the subscription callback of
+ * the topic, on the agent task.
+ *
+ * @param[in] pPayload The payload of the message.
+ * @param[in] payloadLength The length of @a pPayload.
+ *
+ * @return true if it is the probe in flight, to be handed to the service.
+ */
+bool LatencyProbe_Match( const void * pPayload,
+                         size_t payloadLength );
+
+/**
+ * @brief Stamps the handler of the matched probe, and records its stages in
+ * the percentiles. To be called by the service task.
+ */
+void LatencyProbe_Finish( void );
+
+/**
+ * @brief Logs the percentiles of each stage, and the probes lost.
+ */
+void LatencyProbe_Dump( void );
+
+#endif /* ifndef LATENCY_PROBE_H_ */
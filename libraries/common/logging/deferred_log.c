@@ -0,0 +1,816 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file deferred_log.c
+ * @brief Implementation of the deferred logging backend.
+ *
+ * The ring is a bounded queue of fixed slots, each with a sequence number
+ * that tells whose turn it is. A task logging claims the next slot with a
+ * compare-and-swap on the write position, fills it, and publishes it by
+ * advancing its sequence. The single reader takes slots in order, and hands
+ * each back by advancing its sequence by a lap of the ring.
+ *
+ * The arguments are stored in the slot as the types the format string gives
+ * them, so the reader walks the same format to get them back and formats
+ * each conversion with snprintf.
+ */
+
+/* Standard includes. */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "deferred_log.h"
+
+#if ( ( DEFERRED_LOG_RECORDS & ( DEFERRED_LOG_RECORDS - 1 ) ) != 0 )
+    #error "DEFERRED_LOG_RECORDS must be a power of two."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The longest line written, without the prefix.
+ */
+#define LINE_LENGTH          256U
+
+/**
+ * @brief The longest conversion specification that is reformatted.
+ */
+#define SPEC_LENGTH          16U
+
+/**
+ * @brief The stack of the task formatting the records, in bytes.
+ */
+#define TASK_STACK_SIZE      3072U
+
+/**
+ * @brief The tag of the messages of this module.
+ */
+#define TAG                  "DeferredLog"
+
+/**
+ * @brief The C type an argument is passed as.
+ */
+typedef enum ArgumentType
+{
+    ArgumentNone,       /**< %%, which takes no argument. */
+    ArgumentInt,        /**< int, and the types promoted to it. */
+    ArgumentLong,       /**< long. */
+    ArgumentLongLong,   /**< long long and intmax_t. */
+    ArgumentSize,       /**< size_t and ptrdiff_t. */
+    ArgumentDouble,     /**< double, and float promoted to it. */
+    ArgumentLongDouble, /**< long double. */
+    ArgumentPointer,    /**< %p and %n. */
+    ArgumentString      /**< %s, copied into the record. */
+} ArgumentType_t;
+
+/**
+ * @brief A conversion specification of a format string.
+ */
+typedef struct ConversionSpec
+{
+    size_t length;       /**< Characters from the '%' through the conversion. */
+    ArgumentType_t type; /**< The type of its argument. */
+    size_t starCount;    /**< The '*' width and precision, each taking an int first. */
+    bool starPrecision;  /**< Whether the precision is taken from an argument. */
+    int precision;       /**< A literal precision, or -1. */
+} ConversionSpec_t;
+
+/**
+ * @brief A slot of the ring.
+ */
+typedef struct DeferredLogRecord
+{
+    uint32_t sequence;
+    const char * pTag;
+    const char * pFormat;
+    uint32_t timestamp;
+    esp_log_level_t level;
+    uint16_t length;    /**< Bytes of arguments used. */
+    bool truncated;     /**< Whether arguments were left out. */
+    uint8_t arguments[ DEFERRED_LOG_ARGS_SIZE ];
+} DeferredLogRecord_t;
+
+/**
+ * @brief The letter and color of each level in the prefix of ESP_LOGx.
+ */
+static const char levelLetters[] = "NEWIDV";
+static const char * const levelColors[] =
+{
+    "", LOG_COLOR_E, LOG_COLOR_W, LOG_COLOR_I, LOG_COLOR_D, LOG_COLOR_V
+};
+
+/**
+ * @brief The ring.
+ */
+static DeferredLogRecord_t ring[ DEFERRED_LOG_RECORDS ];
+
+/**
+ * @brief The position of the next slot written, and of the next slot read.
+ * They only go up, the slot is the position modulo the size of the ring.
+ */
+static uint32_t writePosition = 0U;
+static uint32_t readPosition = 0U;
+
+/**
+ * @brief Messages dropped because the ring was full.
+ */
+static uint32_t droppedCount = 0U;
+
+/**
+ * @brief Whether the task formatting the records runs.
+ */
+static bool started = false;
+
+/**
+ * @brief The task formatting the records.
+ */
+static StaticTask_t taskBuffer;
+static StackType_t taskStack[ TASK_STACK_SIZE ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Parses the conversion specification starting at the '%' @a pSpec.
+ */
+static void parseSpec( const char * pSpec,
+                       ConversionSpec_t * pConversion );
+
+/**
+ * @brief Appends an argument to a record.
+ *
+ * @return false, with the record marked truncated, if it doesn't fit.
+ */
+static bool putArgument( DeferredLogRecord_t * pRecord,
+                         const void * pValue,
+                         size_t length );
+
+/**
+ * @brief Appends a string to a record, as much as fits and at most
+ * @a maxLength characters, NUL-terminated.
+ *
+ * @return false if it didn't fit whole.
+ */
+static bool putString( DeferredLogRecord_t * pRecord,
+                       const char * pString,
+                       int maxLength );
+
+/**
+ * @brief Copies the arguments of a message into a record.
+ */
+static void captureArguments( DeferredLogRecord_t * pRecord,
+                              va_list * pArguments );
+
+/**
+ * @brief Formats the conversion @a pSpec with its arguments, taken from
+ * @a ppArgument, which is moved past them.
+ *
+ * @return The characters written, as snprintf, or -1 if the arguments aren't
+ * in the record.
+ */
+static int formatConversion( const char * pSpec,
+                             const ConversionSpec_t * pConversion,
+                             const uint8_t ** ppArgument,
+                             const uint8_t * pEnd,
+                             char * pOut,
+                             size_t outLength );
+
+/**
+ * @brief Formats a record into @a pLine.
+ */
+static void formatRecord( const DeferredLogRecord_t * pRecord,
+                          char * pLine,
+                          size_t lineLength );
+
+/**
+ * @brief Writes a formatted message with the prefix of ESP_LOGx.
+ */
+static void writeLine( esp_log_level_t level,
+                       const char * pTag,
+                       uint32_t timestamp,
+                       const char * pLine );
+
+/**
+ * @brief Writes the records of the ring, one after the other.
+ */
+static void deferredLogTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+static void parseSpec( const char * pSpec,
+                       ConversionSpec_t * pConversion )
+{
+    const char * pChar = pSpec + 1;
+    int longCount = 0;
+    bool sizeModifier = false;
+    bool longDouble = false;
+
+    ( void ) memset( pConversion, 0x00, sizeof( *pConversion ) );
+    pConversion->precision = -1;
+
+    while( ( *pChar != '\0' ) && ( strchr( "-+ #0", *pChar ) != NULL ) )
+    {
+        pChar++;
+    }
+
+    if( *pChar == '*' )
+    {
+        pConversion->starCount++;
+        pChar++;
+    }
+
+    while( ( *pChar >= '0' ) && ( *pChar <= '9' ) )
+    {
+        pChar++;
+    }
+
+    if( *pChar == '.' )
+    {
+        pChar++;
+        pConversion->precision = 0;
+
+        if( *pChar == '*' )
+        {
+            pConversion->starCount++;
+            pConversion->starPrecision = true;
+            pChar++;
+        }
+
+        while( ( *pChar >= '0' ) && ( *pChar <= '9' ) )
+        {
+            pConversion->precision = ( pConversion->precision * 10 ) + ( *pChar - '0' );
+            pChar++;
+        }
+    }
+
+    while( ( *pChar != '\0' ) && ( strchr( "hlLjzt", *pChar ) != NULL ) )
+    {
+        longCount += ( *pChar == 'l' ) ? 1 : 0;
+        longCount += ( *pChar == 'j' ) ? 2 : 0;
+        sizeModifier = sizeModifier || ( *pChar == 'z' ) || ( *pChar == 't' );
+        longDouble = longDouble || ( *pChar == 'L' );
+        pChar++;
+    }
+
+    switch( *pChar )
+    {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            pConversion->type = ( sizeModifier == true ) ? ArgumentSize :
+                                ( longCount >= 2 ) ? ArgumentLongLong :
+                                ( longCount == 1 ) ? ArgumentLong : ArgumentInt;
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            pConversion->type = ( longDouble == true ) ? ArgumentLongDouble : ArgumentDouble;
+            break;
+
+        case 's':
+            pConversion->type = ArgumentString;
+            break;
+
+        case 'p':
+        case 'n':
+            pConversion->type = ArgumentPointer;
+            break;
+
+        default:
+            /* %%, or a format cut short. */
+            pConversion->type = ArgumentNone;
+            pConversion->starCount = 0U;
+            break;
+    }
+
+    pConversion->length = ( size_t ) ( pChar - pSpec ) + ( ( *pChar != '\0' ) ? 1U : 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool putArgument( DeferredLogRecord_t * pRecord,
+                         const void * pValue,
+                         size_t length )
+{
+    bool fits = ( ( pRecord->length + length ) <= sizeof( pRecord->arguments ) );
+
+    if( fits == true )
+    {
+        ( void ) memcpy( &pRecord->arguments[ pRecord->length ], pValue, length );
+        pRecord->length += ( uint16_t ) length;
+    }
+    else
+    {
+        pRecord->truncated = true;
+    }
+
+    return fits;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool putString( DeferredLogRecord_t * pRecord,
+                       const char * pString,
+                       int maxLength )
+{
+    size_t room = sizeof( pRecord->arguments ) - pRecord->length;
+    size_t limit = ( maxLength < 0 ) ? SIZE_MAX : ( size_t ) maxLength;
+    size_t length = 0U;
+    bool fits = false;
+
+    if( pString == NULL )
+    {
+        pString = "(null)";
+    }
+
+    if( room > 0U )
+    {
+        /* Room for the terminator, and one more character to tell whether
+         * the string was cut. */
+        length = strnlen( pString, ( limit < room ) ? limit : room );
+        fits = ( length < room );
+
+        if( fits == false )
+        {
+            length = room - 1U;
+        }
+
+        ( void ) memcpy( &pRecord->arguments[ pRecord->length ], pString, length );
+        pRecord->arguments[ pRecord->length + length ] = ( uint8_t ) '\0';
+        pRecord->length += ( uint16_t ) ( length + 1U );
+    }
+
+    if( fits == false )
+    {
+        pRecord->truncated = true;
+    }
+
+    return fits;
+}
+
+/*-----------------------------------------------------------*/
+
+static void captureArguments( DeferredLogRecord_t * pRecord,
+                              va_list * pArguments )
+{
+    const char * pChar = pRecord->pFormat;
+    ConversionSpec_t spec;
+    bool fits = true;
+    size_t i;
+    int star = 0;
+    int precision = -1;
+    int intValue;
+    long longValue;
+    long long longLongValue;
+    size_t sizeValue;
+    double doubleValue;
+    long double longDoubleValue;
+    void * pointerValue;
+
+    while( ( fits == true ) && ( ( pChar = strchr( pChar, '%' ) ) != NULL ) )
+    {
+        parseSpec( pChar, &spec );
+        pChar += spec.length;
+        precision = spec.precision;
+
+        for( i = 0U; ( i < spec.starCount ) && ( fits == true ); i++ )
+        {
+            star = va_arg( *pArguments, int );
+            fits = putArgument( pRecord, &star, sizeof( star ) );
+        }
+
+        if( spec.starPrecision == true )
+        {
+            precision = star;
+        }
+
+        if( fits == true )
+        {
+            switch( spec.type )
+            {
+                case ArgumentInt:
+                    intValue = va_arg( *pArguments, int );
+                    fits = putArgument( pRecord, &intValue, sizeof( intValue ) );
+                    break;
+
+                case ArgumentLong:
+                    longValue = va_arg( *pArguments, long );
+                    fits = putArgument( pRecord, &longValue, sizeof( longValue ) );
+                    break;
+
+                case ArgumentLongLong:
+                    longLongValue = va_arg( *pArguments, long long );
+                    fits = putArgument( pRecord, &longLongValue, sizeof( longLongValue ) );
+                    break;
+
+                case ArgumentSize:
+                    sizeValue = va_arg( *pArguments, size_t );
+                    fits = putArgument( pRecord, &sizeValue, sizeof( sizeValue ) );
+                    break;
+
+                case ArgumentDouble:
+                    doubleValue = va_arg( *pArguments, double );
+                    fits = putArgument( pRecord, &doubleValue, sizeof( doubleValue ) );
+                    break;
+
+                case ArgumentLongDouble:
+                    longDoubleValue = va_arg( *pArguments, long double );
+                    fits = putArgument( pRecord, &longDoubleValue, sizeof( longDoubleValue ) );
+                    break;
+
+                case ArgumentPointer:
+                    pointerValue = va_arg( *pArguments, void * );
+                    fits = putArgument( pRecord, &pointerValue, sizeof( pointerValue ) );
+                    break;
+
+                case ArgumentString:
+                    fits = putString( pRecord, va_arg( *pArguments, const char * ), precision );
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int formatConversion( const char * pSpec,
+                             const ConversionSpec_t * pConversion,
+                             const uint8_t ** ppArgument,
+                             const uint8_t * pEnd,
+                             char * pOut,
+                             size_t outLength )
+{
+    const uint8_t * pArgument = *ppArgument;
+    char specText[ SPEC_LENGTH ];
+    size_t argumentLength = 0U;
+    size_t i;
+    int stars[ 2 ] = { 0, 0 };
+    int written = -1;
+    bool complete = ( pConversion->length < SPEC_LENGTH );
+    union
+    {
+        int intValue;
+        long longValue;
+        long long longLongValue;
+        size_t sizeValue;
+        double doubleValue;
+        long double longDoubleValue;
+        void * pointerValue;
+    } value;
+
+    for( i = 0U; ( i < pConversion->starCount ) && ( complete == true ); i++ )
+    {
+        complete = ( ( size_t ) ( pEnd - pArgument ) >= sizeof( int ) );
+
+        if( complete == true )
+        {
+            ( void ) memcpy( &stars[ i ], pArgument, sizeof( int ) );
+            pArgument += sizeof( int );
+        }
+    }
+
+    switch( pConversion->type )
+    {
+        case ArgumentLong:
+            argumentLength = sizeof( value.longValue );
+            break;
+
+        case ArgumentLongLong:
+            argumentLength = sizeof( value.longLongValue );
+            break;
+
+        case ArgumentSize:
+            argumentLength = sizeof( value.sizeValue );
+            break;
+
+        case ArgumentDouble:
+            argumentLength = sizeof( value.doubleValue );
+            break;
+
+        case ArgumentLongDouble:
+            argumentLength = sizeof( value.longDoubleValue );
+            break;
+
+        case ArgumentPointer:
+            argumentLength = sizeof( value.pointerValue );
+            break;
+
+        case ArgumentString:
+            /* Strings are always stored terminated. */
+            argumentLength = ( pArgument < pEnd ) ? ( strlen( ( const char * ) pArgument ) + 1U ) : 1U;
+            break;
+
+        default:
+            argumentLength = sizeof( value.intValue );
+            break;
+    }
+
+    complete = complete && ( ( size_t ) ( pEnd - pArgument ) >= argumentLength );
+
+    if( complete == true )
+    {
+        ( void ) memcpy( specText, pSpec, pConversion->length );
+        specText[ pConversion->length ] = '\0';
+
+        if( pConversion->type != ArgumentString )
+        {
+            ( void ) memcpy( &value, pArgument, argumentLength );
+        }
+
+        /* Reformat the conversion with its own argument, after the int of each
+         * star. */
+        #define FORMAT_ARGUMENT( argument )                                                   \
+    ( ( pConversion->starCount == 0U ) ? snprintf( pOut, outLength, specText, argument ) :    \
+      ( pConversion->starCount == 1U ) ? snprintf( pOut, outLength, specText, stars[ 0 ], argument ) : \
+      snprintf( pOut, outLength, specText, stars[ 0 ], stars[ 1 ], argument ) )
+
+        switch( pConversion->type )
+        {
+            case ArgumentLong:
+                written = FORMAT_ARGUMENT( value.longValue );
+                break;
+
+            case ArgumentLongLong:
+                written = FORMAT_ARGUMENT( value.longLongValue );
+                break;
+
+            case ArgumentSize:
+                written = FORMAT_ARGUMENT( value.sizeValue );
+                break;
+
+            case ArgumentDouble:
+                written = FORMAT_ARGUMENT( value.doubleValue );
+                break;
+
+            case ArgumentLongDouble:
+                written = FORMAT_ARGUMENT( value.longDoubleValue );
+                break;
+
+            case ArgumentPointer:
+                /* The pointer of %n is not written through. */
+                written = ( pSpec[ pConversion->length - 1U ] == 'n' ) ? 0 : FORMAT_ARGUMENT( value.pointerValue );
+                break;
+
+            case ArgumentString:
+                written = FORMAT_ARGUMENT( ( const char * ) pArgument );
+                break;
+
+            default:
+                written = FORMAT_ARGUMENT( value.intValue );
+                break;
+        }
+
+        #undef FORMAT_ARGUMENT
+
+        written = ( written < 0 ) ? 0 : written;
+        *ppArgument = pArgument + argumentLength;
+    }
+
+    return written;
+}
+
+/*-----------------------------------------------------------*/
+
+static void formatRecord( const DeferredLogRecord_t * pRecord,
+                          char * pLine,
+                          size_t lineLength )
+{
+    const char * pChar = pRecord->pFormat;
+    const uint8_t * pArgument = pRecord->arguments;
+    const uint8_t * pEnd = &pRecord->arguments[ pRecord->length ];
+    ConversionSpec_t spec;
+    size_t used = 0U;
+    int written = 0;
+
+    while( ( *pChar != '\0' ) && ( used < ( lineLength - 1U ) ) && ( written >= 0 ) )
+    {
+        if( *pChar != '%' )
+        {
+            pLine[ used ] = *pChar;
+            used++;
+            pChar++;
+        }
+        else
+        {
+            parseSpec( pChar, &spec );
+
+            if( spec.type == ArgumentNone )
+            {
+                /* %%, or a lone % at the end. */
+                pLine[ used ] = '%';
+                used++;
+                pChar += ( spec.length > 1U ) ? spec.length : 1U;
+            }
+            else
+            {
+                written = formatConversion( pChar, &spec, &pArgument, pEnd, &pLine[ used ], lineLength - used );
+
+                if( written >= 0 )
+                {
+                    used += ( size_t ) written;
+                    used = ( used < lineLength ) ? used : ( lineLength - 1U );
+                    pChar += spec.length;
+                }
+            }
+        }
+    }
+
+    if( ( written < 0 ) || ( pRecord->truncated == true ) )
+    {
+        /* Mark that arguments, or the end of a string, didn't fit. */
+        used = ( used < ( lineLength - 4U ) ) ? used : ( lineLength - 4U );
+        ( void ) memcpy( &pLine[ used ], "...", 3U );
+        used += 3U;
+    }
+
+    pLine[ used ] = '\0';
+}
+
+/*-----------------------------------------------------------*/
+
+static void writeLine( esp_log_level_t level,
+                       const char * pTag,
+                       uint32_t timestamp,
+                       const char * pLine )
+{
+    size_t index = ( ( size_t ) level <= ESP_LOG_VERBOSE ) ? ( size_t ) level : ESP_LOG_VERBOSE;
+
+    /* The format of the ESP_LOGx macros. */
+    esp_log_write( level, pTag, "%s%c (%u) %s: %s%s\n", levelColors[ index ], levelLetters[ index ],
+                   ( unsigned ) timestamp, pTag, pLine, ( index == ESP_LOG_NONE ) ? "" : LOG_RESET_COLOR );
+}
+
+/*-----------------------------------------------------------*/
+
+static void deferredLogTask( void * pParameters )
+{
+    static char line[ LINE_LENGTH ];
+    DeferredLogRecord_t * pRecord = NULL;
+    uint32_t dropped = 0U;
+
+    ( void ) pParameters;
+
+    for( ; ; )
+    {
+        pRecord = &ring[ readPosition & ( DEFERRED_LOG_RECORDS - 1U ) ];
+
+        if( __atomic_load_n( &pRecord->sequence, __ATOMIC_ACQUIRE ) == ( readPosition + 1U ) )
+        {
+            formatRecord( pRecord, line, sizeof( line ) );
+            writeLine( pRecord->level, pRecord->pTag, pRecord->timestamp, line );
+
+            /* Hand the slot back for the next lap of the writers. */
+            __atomic_store_n( &pRecord->sequence, readPosition + DEFERRED_LOG_RECORDS, __ATOMIC_RELEASE );
+            readPosition++;
+
+            dropped = __atomic_exchange_n( &droppedCount, 0U, __ATOMIC_RELAXED );
+
+            if( dropped > 0U )
+            {
+                ( void ) snprintf( line, sizeof( line ), "%u messages dropped, the ring was full.", ( unsigned ) dropped );
+                writeLine( ESP_LOG_WARN, TAG, esp_log_timestamp(), line );
+            }
+        }
+        else
+        {
+            /* Empty, or the next writer hasn't published its slot yet. */
+            vTaskDelay( pdMS_TO_TICKS( DEFERRED_LOG_POLL_MS ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void DeferredLog_Init( void )
+{
+    uint32_t i;
+
+    if( __atomic_load_n( &started, __ATOMIC_RELAXED ) == false )
+    {
+        for( i = 0U; i < DEFERRED_LOG_RECORDS; i++ )
+        {
+            ring[ i ].sequence = i;
+        }
+
+        ( void ) xTaskCreateStatic( deferredLogTask, "deferred_log", TASK_STACK_SIZE, NULL,
+                                    DEFERRED_LOG_TASK_PRIORITY, taskStack, &taskBuffer );
+
+        __atomic_store_n( &started, true, __ATOMIC_RELEASE );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void DeferredLog_Write( esp_log_level_t level,
+                        const char * pTag,
+                        const char * pFormat,
+                        ... )
+{
+    DeferredLogRecord_t * pRecord = NULL;
+    uint32_t position;
+    int32_t lag;
+    size_t index;
+    va_list arguments;
+
+    va_start( arguments, pFormat );
+
+    if( __atomic_load_n( &started, __ATOMIC_ACQUIRE ) == false )
+    {
+        /* Nothing reads the ring yet. */
+        index = ( ( size_t ) level <= ESP_LOG_VERBOSE ) ? ( size_t ) level : ESP_LOG_VERBOSE;
+        esp_log_write( level, pTag, "%s%c (%u) %s: ", levelColors[ index ], levelLetters[ index ],
+                       ( unsigned ) esp_log_timestamp(), pTag );
+        esp_log_writev( level, pTag, pFormat, arguments );
+        esp_log_write( level, pTag, "%s\n", ( index == ESP_LOG_NONE ) ? "" : LOG_RESET_COLOR );
+    }
+    else
+    {
+        position = __atomic_load_n( &writePosition, __ATOMIC_RELAXED );
+
+        for( ; ; )
+        {
+            pRecord = &ring[ position & ( DEFERRED_LOG_RECORDS - 1U ) ];
+            lag = ( int32_t ) ( __atomic_load_n( &pRecord->sequence, __ATOMIC_ACQUIRE ) - position );
+
+            if( lag == 0 )
+            {
+                /* The slot is free for this position: claim it. */
+                if( __atomic_compare_exchange_n( &writePosition, &position, position + 1U, true,
+                                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                {
+                    break;
+                }
+            }
+            else if( lag < 0 )
+            {
+                /* The reader hasn't handed the slot back from the last lap. */
+                pRecord = NULL;
+                break;
+            }
+            else
+            {
+                /* Another writer claimed it first. */
+                position = __atomic_load_n( &writePosition, __ATOMIC_RELAXED );
+            }
+        }
+
+        if( pRecord == NULL )
+        {
+            ( void ) __atomic_add_fetch( &droppedCount, 1U, __ATOMIC_RELAXED );
+        }
+        else
+        {
+            pRecord->pTag = pTag;
+            pRecord->pFormat = pFormat;
+            pRecord->timestamp = esp_log_timestamp();
+            pRecord->level = level;
+            pRecord->length = 0U;
+            pRecord->truncated = false;
+            captureArguments( pRecord, &arguments );
+
+            __atomic_store_n( &pRecord->sequence, position + 1U, __ATOMIC_RELEASE );
+        }
+    }
+
+    va_end( arguments );
+}
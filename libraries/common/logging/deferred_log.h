@@ -0,0 +1,111 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file deferred_log.h
+ * @brief A logging backend that records messages and formats them later.
+ *
+ * #DeferredLog_Write copies the format string pointer, the level, the tag
+ * pointer, the timestamp and the raw arguments into a slot of a lock-free
+ * ring, and returns. A task of low priority formats the records and writes
+ * them with esp_log_write, so a task that logs on every message doesn't wait
+ * for vprintf and the UART. The call costs a few dozen cycles and a walk over
+ * the format string to find its arguments. Only strings are copied, up to
+ * the room left in the slot, since the buffers they point to don't outlive
+ * the call.
+ *
+ * The format strings and tags must be literals or otherwise live for the
+ * program, which is the case with the logging macros. When the ring is full,
+ * messages are dropped and counted, and the count is logged with the next
+ * message written. Messages logged before #DeferredLog_Init are written at
+ * once.
+ */
+
+#ifndef DEFERRED_LOG_H_
+#define DEFERRED_LOG_H_
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The number of slots of the ring, a power of two.
+ */
+#ifndef DEFERRED_LOG_RECORDS
+    #define DEFERRED_LOG_RECORDS    CONFIG_LOGGING_DEFERRED_RECORDS
+#endif
+
+/**
+ * @brief The bytes of arguments a slot holds.
+ */
+#ifndef DEFERRED_LOG_ARGS_SIZE
+    #define DEFERRED_LOG_ARGS_SIZE    CONFIG_LOGGING_DEFERRED_ARGS_SIZE
+#endif
+
+/**
+ * @brief The priority of the task formatting the records.
+ */
+#ifndef DEFERRED_LOG_TASK_PRIORITY
+    #define DEFERRED_LOG_TASK_PRIORITY    CONFIG_LOGGING_DEFERRED_TASK_PRIORITY
+#endif
+
+/**
+ * @brief How long the task sleeps once the ring is empty.
+ */
+#ifndef DEFERRED_LOG_POLL_MS
+    #define DEFERRED_LOG_POLL_MS    CONFIG_LOGGING_DEFERRED_POLL_MS
+#endif
+
+/**
+ * @brief Records a message of @a level, if the level is compiled in, like
+ * ESP_LOG_LEVEL_LOCAL.
+ */
+#define DEFERRED_LOG( level, tag, ... )                       \
+    do {                                                      \
+        if( LOG_LOCAL_LEVEL >= ( level ) )                    \
+        {                                                     \
+            DeferredLog_Write( ( level ), ( tag ), __VA_ARGS__ ); \
+        }                                                     \
+    } while( 0 )
+
+/**
+ * @brief Starts the task formatting the records. Must be called once, from
+ * app_main.
+ */
+void DeferredLog_Init( void );
+
+/**
+ * @brief Records a message, to be formatted later.
+ *
+ * @param[in] level The level of the message.
+ * @param[in] pTag The tag of the message, which must outlive the record.
+ * @param[in] pFormat The printf format of the message, which must outlive the
+ * record.
+ */
+void DeferredLog_Write( esp_log_level_t level,
+                        const char * pTag,
+                        const char * pFormat,
+                        ... ) __attribute__( ( format( printf, 3, 4 ) ) );
+
+#endif /* ifndef DEFERRED_LOG_H_ */
@@ -0,0 +1,277 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file log_control.c
+ * @brief Implementation of the run time log levels and rate limiting.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+#include "log_control.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The longest LIBRARY_LOG_NAME that levels can be set for.
+ */
+#define MAX_NAME_LENGTH    32U
+
+/**
+ * @brief The credit of one message in a bucket. Credit is added at
+ * #LOG_CONTROL_RATE_LIMIT_PER_MINUTE per tick.
+ */
+#define MESSAGE_CREDIT     ( 60U * ( uint32_t ) configTICK_RATE_HZ )
+
+/**
+ * @brief The credit of a full bucket.
+ */
+#define FULL_CREDIT        ( ( uint32_t ) LOG_CONTROL_RATE_LIMIT_BURST * MESSAGE_CREDIT )
+
+/**
+ * @brief A level pair of #LogControl_Apply.
+ */
+typedef struct LevelPair
+{
+    const char * pName;
+    size_t nameLength;
+    uint8_t level;
+} LevelPair_t;
+
+/**
+ * @brief The registered modules.
+ */
+static LogModule_t * moduleList = NULL;
+
+/**
+ * @brief Guards the buckets of all call sites.
+ */
+static portMUX_TYPE rateLimitLock = portMUX_INITIALIZER_UNLOCKED;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Parses a level name or number.
+ *
+ * @return false if it isn't one.
+ */
+static bool parseLevel( const char * pText,
+                        size_t length,
+                        uint8_t * pLevel );
+
+/**
+ * @brief Parses the pair of @a pLevels that ends at a comma or at
+ * @a pEnd, and moves @a ppNext past it.
+ */
+static bool parsePair( const char ** ppNext,
+                       const char * pEnd,
+                       LevelPair_t * pPair );
+
+/*-----------------------------------------------------------*/
+
+static bool parseLevel( const char * pText,
+                        size_t length,
+                        uint8_t * pLevel )
+{
+    static const char * const names[] = { "none", "error", "warn", "info", "debug" };
+    bool parsed = false;
+    uint8_t i;
+
+    if( ( length == 1U ) && ( pText[ 0 ] >= '0' ) && ( pText[ 0 ] <= '4' ) )
+    {
+        *pLevel = ( uint8_t ) ( pText[ 0 ] - '0' );
+        parsed = true;
+    }
+
+    for( i = 0U; ( i < ( sizeof( names ) / sizeof( names[ 0 ] ) ) ) && ( parsed == false ); i++ )
+    {
+        if( ( strlen( names[ i ] ) == length ) && ( strncmp( names[ i ], pText, length ) == 0 ) )
+        {
+            *pLevel = i;
+            parsed = true;
+        }
+    }
+
+    return parsed;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool parsePair( const char ** ppNext,
+                       const char * pEnd,
+                       LevelPair_t * pPair )
+{
+    const char * pStart = *ppNext;
+    const char * pComma = memchr( pStart, ',', ( size_t ) ( pEnd - pStart ) );
+    const char * pPairEnd = ( pComma != NULL ) ? pComma : pEnd;
+    const char * pEquals = memchr( pStart, '=', ( size_t ) ( pPairEnd - pStart ) );
+    bool parsed = false;
+
+    if( ( pEquals != NULL ) && ( pEquals > pStart ) &&
+        ( ( size_t ) ( pEquals - pStart ) <= MAX_NAME_LENGTH ) )
+    {
+        pPair->pName = pStart;
+        pPair->nameLength = ( size_t ) ( pEquals - pStart );
+        parsed = parseLevel( pEquals + 1, ( size_t ) ( pPairEnd - pEquals - 1 ), &pPair->level );
+    }
+
+    *ppNext = ( pComma != NULL ) ? ( pComma + 1 ) : pEnd;
+
+    return parsed;
+}
+
+/*-----------------------------------------------------------*/
+
+void LogControl_Register( LogModule_t * pModule )
+{
+    assert( pModule != NULL );
+
+    pModule->pNext = moduleList;
+    moduleList = pModule;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogControl_SetLevel( const char * pName,
+                          size_t nameLength,
+                          uint8_t level )
+{
+    char tag[ MAX_NAME_LENGTH + 1U ];
+    LogModule_t * pModule = NULL;
+    bool all = ( nameLength == 1U ) && ( pName[ 0 ] == '*' );
+    bool found = false;
+
+    assert( pName != NULL );
+
+    for( pModule = moduleList; pModule != NULL; pModule = pModule->pNext )
+    {
+        if( ( all == true ) ||
+            ( ( strlen( pModule->pName ) == nameLength ) && ( strncmp( pModule->pName, pName, nameLength ) == 0 ) ) )
+        {
+            /* A single store, read by the logging macros without a lock. */
+            pModule->level = level;
+            found = true;
+        }
+    }
+
+    if( ( found == true ) && ( nameLength <= MAX_NAME_LENGTH ) )
+    {
+        /* The log levels have the values of esp_log_level_t. */
+        ( void ) memcpy( tag, pName, nameLength );
+        tag[ nameLength ] = '\0';
+        esp_log_level_set( tag, ( esp_log_level_t ) level );
+    }
+
+    return found;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogControl_Apply( const char * pLevels,
+                       size_t length )
+{
+    const char * pNext = pLevels;
+    const char * pEnd = pLevels + length;
+    LevelPair_t pair;
+    bool valid = ( length > 0U );
+
+    assert( pLevels != NULL );
+
+    /* Check every pair before applying any. */
+    while( ( valid == true ) && ( pNext < pEnd ) )
+    {
+        valid = parsePair( &pNext, pEnd, &pair );
+    }
+
+    pNext = pLevels;
+
+    while( ( valid == true ) && ( pNext < pEnd ) )
+    {
+        ( void ) parsePair( &pNext, pEnd, &pair );
+
+        if( LogControl_SetLevel( pair.pName, pair.nameLength, pair.level ) == false )
+        {
+            ESP_LOGW( "LogControl", "No module is named %.*s.", ( int ) pair.nameLength, pair.pName );
+        }
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogControl_RateLimit( LogRateLimit_t * pLimit,
+                           uint32_t * pSuppressed )
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t elapsed;
+    bool allowed = false;
+
+    assert( ( pLimit != NULL ) && ( pSuppressed != NULL ) );
+
+    taskENTER_CRITICAL( &rateLimitLock );
+
+    if( pLimit->started == false )
+    {
+        pLimit->credit = FULL_CREDIT;
+        pLimit->started = true;
+    }
+    else
+    {
+        /* Refill, without overflowing after a long quiet spell. */
+        elapsed = now - pLimit->lastTick;
+        elapsed = ( elapsed < ( FULL_CREDIT / LOG_CONTROL_RATE_LIMIT_PER_MINUTE ) ) ?
+                  elapsed : ( FULL_CREDIT / LOG_CONTROL_RATE_LIMIT_PER_MINUTE );
+        pLimit->credit += ( uint32_t ) elapsed * LOG_CONTROL_RATE_LIMIT_PER_MINUTE;
+        pLimit->credit = ( pLimit->credit < FULL_CREDIT ) ? pLimit->credit : FULL_CREDIT;
+    }
+
+    pLimit->lastTick = now;
+
+    if( pLimit->credit >= MESSAGE_CREDIT )
+    {
+        pLimit->credit -= MESSAGE_CREDIT;
+        *pSuppressed = pLimit->suppressed;
+        pLimit->suppressed = 0U;
+        allowed = true;
+    }
+    else
+    {
+        pLimit->suppressed++;
+    }
+
+    taskEXIT_CRITICAL( &rateLimitLock );
+
+    return allowed;
+}
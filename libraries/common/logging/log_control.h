@@ -0,0 +1,143 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file log_control.h
+ * @brief Run time log levels per LIBRARY_LOG_NAME, and rate limiting of
+ * repeated messages.
+ *
+ * With CONFIG_LOGGING_RUNTIME_LEVELS, each file including logging_stack.h
+ * has a #LogModule_t of its LIBRARY_LOG_NAME, registered before app_main,
+ * and the logging macros compare its level before writing. Every level up
+ * to #LOG_CONTROL_CEILING is compiled in, and a module starts at its
+ * LIBRARY_LOG_LEVEL, so a level can be raised in the field without a
+ * rebuild. #LogControl_Apply takes the levels as text, such as
+ * "OTA=debug,MQTT=warn", for a job or a shadow field to set them.
+ */
+
+#ifndef LOG_CONTROL_H_
+#define LOG_CONTROL_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The most verbose level compiled in with run time levels.
+ */
+#ifndef LOG_CONTROL_CEILING
+    #define LOG_CONTROL_CEILING    CONFIG_LOGGING_RUNTIME_CEILING
+#endif
+
+/**
+ * @brief The messages a rate limited call site writes in a burst.
+ */
+#ifndef LOG_CONTROL_RATE_LIMIT_BURST
+    #define LOG_CONTROL_RATE_LIMIT_BURST    CONFIG_LOGGING_RATE_LIMIT_BURST
+#endif
+
+/**
+ * @brief The messages a rate limited call site writes per minute, once its
+ * burst is spent.
+ */
+#ifndef LOG_CONTROL_RATE_LIMIT_PER_MINUTE
+    #define LOG_CONTROL_RATE_LIMIT_PER_MINUTE    CONFIG_LOGGING_RATE_LIMIT_PER_MINUTE
+#endif
+
+/**
+ * @brief The level of the files sharing a LIBRARY_LOG_NAME.
+ */
+typedef struct LogModule
+{
+    const char * pName;
+    volatile uint8_t level;
+    struct LogModule * pNext;
+} LogModule_t;
+
+/**
+ * @brief The token bucket of a rate limited call site.
+ *
+ * The fields are private to this module. A zeroed bucket is full.
+ */
+typedef struct LogRateLimit
+{
+    bool started;
+    uint32_t credit;
+    TickType_t lastTick;
+    uint32_t suppressed;
+} LogRateLimit_t;
+
+/**
+ * @brief Adds a module to the registry, from the constructor that
+ * logging_stack.h adds to each file. Not thread safe.
+ */
+void LogControl_Register( LogModule_t * pModule );
+
+/**
+ * @brief Sets the level of the modules named @a pName, or of every module
+ * for "*", and the ESP-IDF level of the tag, whose filter runs after this
+ * one.
+ *
+ * @param[in] pName The LIBRARY_LOG_NAME.
+ * @param[in] nameLength The length of @a pName.
+ * @param[in] level LOG_NONE to LOG_DEBUG. Levels above #LOG_CONTROL_CEILING
+ * only write what is compiled in.
+ *
+ * @return false if no module has the name.
+ */
+bool LogControl_SetLevel( const char * pName,
+                          size_t nameLength,
+                          uint8_t level );
+
+/**
+ * @brief Sets levels from text: comma separated name=level pairs, where level
+ * is none, error, warn, info or debug, or 0 to 4, and name is a
+ * LIBRARY_LOG_NAME or "*". Pairs are applied in order.
+ *
+ * @param[in] pLevels The text, not NUL-terminated.
+ * @param[in] length The length of @a pLevels.
+ *
+ * @return false, with no level changed, if a pair is malformed.
+ */
+bool LogControl_Apply( const char * pLevels,
+                       size_t length );
+
+/**
+ * @brief Takes a token from the bucket of a call site.
+ *
+ * @param[in] pLimit The bucket of the call site.
+ * @param[out] pSuppressed The messages suppressed since the last one
+ * allowed, when this one is.
+ *
+ * @return true if the message is to be written.
+ */
+bool LogControl_RateLimit( LogRateLimit_t * pLimit,
+                           uint32_t * pSuppressed );
+
+#endif /* ifndef LOG_CONTROL_H_ */
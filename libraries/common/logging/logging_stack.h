@@ -41,6 +41,9 @@
 #include <stdint.h>
 #include "esp_log.h"
 
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
 #define EXTRACT_ARGS( ... ) __VA_ARGS__
 #define STRIP_PARENS( X )   X
 #define REMOVE_PARENS( X )  STRIP_PARENS( EXTRACT_ARGS X )
@@ -81,6 +84,93 @@
     #define SdkLog( string )    printf string
 #endif
 
+/**
+ * @brief The backend of #LogInfo and #LogDebug.
+ *
+ * With CONFIG_LOGGING_DEFERRED, set when the logging component is part of the
+ * build, info and debug messages are recorded with their arguments and
+ * written later by a task of low priority, see deferred_log.h. Errors and
+ * warnings are always written at once, so that they are out before a crash.
+ */
+#if CONFIG_LOGGING_DEFERRED
+    #include "deferred_log.h"
+    #define SdkLogInfo( message, ... )     DEFERRED_LOG( ESP_LOG_INFO, LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ )
+    #define SdkLogDebug( message, ... )    DEFERRED_LOG( ESP_LOG_DEBUG, LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ )
+#else
+    #define SdkLogInfo( message, ... )     ESP_LOGI( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ )
+    #define SdkLogDebug( message, ... )    ESP_LOGD( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ )
+#endif
+
+/**
+ * @brief Run time levels, see log_control.h.
+ *
+ * With CONFIG_LOGGING_RUNTIME_LEVELS, the messages up to
+ * #LOGGING_STACK_COMPILED_LEVEL are compiled in, and each is written only if
+ * the run time level of LIBRARY_LOG_NAME allows it, one load and compare.
+ * Without it, the compiled level is LIBRARY_LOG_LEVEL and no check is added.
+ */
+#if CONFIG_LOGGING_RUNTIME_LEVELS
+    #include "log_control.h"
+
+    #if ( defined( LIBRARY_LOG_LEVEL ) && ( LIBRARY_LOG_LEVEL > LOG_CONTROL_CEILING ) )
+        #define LOGGING_STACK_COMPILED_LEVEL    LIBRARY_LOG_LEVEL
+    #else
+        #define LOGGING_STACK_COMPILED_LEVEL    LOG_CONTROL_CEILING
+    #endif
+
+    /* The level of LIBRARY_LOG_NAME in this file, registered before app_main. */
+    static LogModule_t loggingStackModule = { LIBRARY_LOG_NAME, LIBRARY_LOG_LEVEL, NULL };
+
+    static void __attribute__( ( constructor ) ) loggingStackRegister( void )
+    {
+        LogControl_Register( &loggingStackModule );
+    }
+
+    #define LOGGING_STACK_WRITE( logLevel, ... )       \
+    do                                                 \
+    {                                                  \
+        if( loggingStackModule.level >= ( logLevel ) ) \
+        {                                              \
+            __VA_ARGS__;                               \
+        }                                              \
+    } while( 0 )
+#else
+    #define LOGGING_STACK_COMPILED_LEVEL            LIBRARY_LOG_LEVEL
+    #define LOGGING_STACK_WRITE( logLevel, ... )    __VA_ARGS__
+#endif
+
+/**
+ * @brief Writes a message through @a log, a logging macro, at most
+ * CONFIG_LOGGING_RATE_LIMIT_BURST times in a burst and then
+ * CONFIG_LOGGING_RATE_LIMIT_PER_MINUTE times a minute, for messages that can
+ * repeat in a loop. Each call site has its own limit, and the first message
+ * written after others were suppressed is preceded by their count.
+ *
+ * Without the logging component in the build, every message is written.
+ */
+#ifdef CONFIG_LOGGING_RATE_LIMIT_BURST
+    #include "log_control.h"
+
+    #define LogRateLimited( log, message )                                              \
+    do                                                                                  \
+    {                                                                                   \
+        static LogRateLimit_t rateLimit;                                                \
+        uint32_t suppressed = 0U;                                                       \
+                                                                                        \
+        if( LogControl_RateLimit( &rateLimit, &suppressed ) == true )                   \
+        {                                                                               \
+            if( suppressed > 0U )                                                       \
+            {                                                                           \
+                log( ( "%u similar messages suppressed.", ( unsigned ) suppressed ) );  \
+            }                                                                           \
+                                                                                        \
+            log( message );                                                             \
+        }                                                                               \
+    } while( 0 )
+#else
+    #define LogRateLimited( log, message )    log( message )
+#endif
+
 /**
  * Disable definition of logging interface macros when generating doxygen output,
  * to avoid conflict with documentation of macros at the end of the file.
@@ -94,42 +184,42 @@
     ( LIBRARY_LOG_LEVEL != LOG_DEBUG ) )
     #error "Please define LIBRARY_LOG_LEVEL as either LOG_NONE, LOG_ERROR, LOG_WARN, LOG_INFO, or LOG_DEBUG."
 #else
-    #if LIBRARY_LOG_LEVEL == LOG_DEBUG
+    #if LOGGING_STACK_COMPILED_LEVEL == LOG_DEBUG
         /* All log level messages will logged. */
-        #define LogError( message, ... )    ESP_LOGE(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
-        #define LogWarn( message, ... )     ESP_LOGW(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
-        #define LogInfo( message, ... )     ESP_LOGI(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
-        #define LogDebug( message, ... )    ESP_LOGD(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
+        #define LogError( message, ... )    LOGGING_STACK_WRITE( LOG_ERROR, ESP_LOGE( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
+        #define LogWarn( message, ... )     LOGGING_STACK_WRITE( LOG_WARN, ESP_LOGW( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
+        #define LogInfo( message, ... )     LOGGING_STACK_WRITE( LOG_INFO, SdkLogInfo( message, ##__VA_ARGS__ ) );
+        #define LogDebug( message, ... )    LOGGING_STACK_WRITE( LOG_DEBUG, SdkLogDebug( message, ##__VA_ARGS__ ) );
 
-    #elif LIBRARY_LOG_LEVEL == LOG_INFO
+    #elif LOGGING_STACK_COMPILED_LEVEL == LOG_INFO
         /* Only INFO, WARNING and ERROR messages will be logged. */
-        #define LogError( message, ... )    ESP_LOGE(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
-        #define LogWarn( message, ... )     ESP_LOGW(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
-        #define LogInfo( message, ... )     ESP_LOGI(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
+        #define LogError( message, ... )    LOGGING_STACK_WRITE( LOG_ERROR, ESP_LOGE( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
+        #define LogWarn( message, ... )     LOGGING_STACK_WRITE( LOG_WARN, ESP_LOGW( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
+        #define LogInfo( message, ... )     LOGGING_STACK_WRITE( LOG_INFO, SdkLogInfo( message, ##__VA_ARGS__ ) );
         #define LogDebug( message, ... )
 
-    #elif LIBRARY_LOG_LEVEL == LOG_WARN
+    #elif LOGGING_STACK_COMPILED_LEVEL == LOG_WARN
         /* Only WARNING and ERROR messages will be logged.*/
-        #define LogError( message, ... )    ESP_LOGE(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
-        #define LogWarn( message, ... )     ESP_LOGW(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
+        #define LogError( message, ... )    LOGGING_STACK_WRITE( LOG_ERROR, ESP_LOGE( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
+        #define LogWarn( message, ... )     LOGGING_STACK_WRITE( LOG_WARN, ESP_LOGW( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
         #define LogInfo( message, ... )
         #define LogDebug( message, ... )
 
-    #elif LIBRARY_LOG_LEVEL == LOG_ERROR
+    #elif LOGGING_STACK_COMPILED_LEVEL == LOG_ERROR
         /* Only ERROR messages will be logged. */
-        #define LogError( message, ... )    ESP_LOGE(LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__);
+        #define LogError( message, ... )    LOGGING_STACK_WRITE( LOG_ERROR, ESP_LOGE( LIBRARY_LOG_NAME, REMOVE_PARENS( message ), ##__VA_ARGS__ ) );
         #define LogWarn( message, ... )
         #define LogInfo( message, ... )
         #define LogDebug( message, ... )
 
-    #else /* if LIBRARY_LOG_LEVEL == LOG_ERROR */
+    #else /* if LOGGING_STACK_COMPILED_LEVEL == LOG_ERROR */
 
         #define LogError( message, ... )
         #define LogWarn( message, ... )
         #define LogInfo( message, ... )
         #define LogDebug( message, ... )
 
-    #endif /* if LIBRARY_LOG_LEVEL == LOG_ERROR */
+    #endif /* if LOGGING_STACK_COMPILED_LEVEL == LOG_ERROR */
 #endif /* if !defined( LIBRARY_LOG_LEVEL ) || ( ( LIBRARY_LOG_LEVEL != LOG_NONE ) && ( LIBRARY_LOG_LEVEL != LOG_ERROR ) && ( LIBRARY_LOG_LEVEL != LOG_WARN ) && ( LIBRARY_LOG_LEVEL != LOG_INFO ) && ( LIBRARY_LOG_LEVEL != LOG_DEBUG ) ) */
 
 #endif /* ifndef LOGGING_STACK_H */
\ No newline at end of file
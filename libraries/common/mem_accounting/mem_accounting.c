@@ -0,0 +1,290 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mem_accounting.c
+ * @brief Implementation of the memory accounting.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_heap_caps.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the memory accounting. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Mem Accounting"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "mem_accounting.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Marks the header of an allocation, to catch memory freed with the
+ * wrong function.
+ */
+#define HEADER_MAGIC           0xACC7U
+
+/**
+ * @brief The stack of the report task, in bytes.
+ */
+#define REPORT_STACK_SIZE      3072U
+
+/**
+ * @brief The priority of the report task.
+ */
+#define REPORT_PRIORITY        ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief The header in front of each allocation. Its 8 bytes keep the
+ * alignment of the heap.
+ */
+typedef struct AllocationHeader
+{
+    uint32_t size;
+    uint16_t component;
+    uint16_t magic;
+} AllocationHeader_t;
+
+/**
+ * @brief The heap use of each component, updated with relaxed atomics.
+ */
+static MemAccountingStats_t componentStats[ MemComponentCount ];
+
+/**
+ * @brief The names of the components in the report.
+ */
+static const char * const componentNames[ MemComponentCount ] = { "OTA", "PKCS #11", "Crypto" };
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Raises the peak of a component to @a current, if it is above.
+ */
+static void raisePeak( MemAccountingStats_t * pStats,
+                       size_t current );
+
+/**
+ * @brief Logs the stack high-water mark of every task.
+ */
+static void reportStacks( void );
+
+/**
+ * @brief The task logging the report every #MEM_ACCOUNTING_DUMP_INTERVAL_S.
+ */
+static void reportTask( void * pParameters );
+
+/*-----------------------------------------------------------*/
+
+static void raisePeak( MemAccountingStats_t * pStats,
+                       size_t current )
+{
+    size_t peak = __atomic_load_n( &pStats->peakBytes, __ATOMIC_RELAXED );
+
+    while( ( current > peak ) &&
+           ( __atomic_compare_exchange_n( &pStats->peakBytes, &peak, current, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED ) == false ) )
+    {
+        /* The peak was raised by another task, and is checked again. */
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void reportStacks( void )
+{
+    #if ( configUSE_TRACE_FACILITY == 1 )
+        UBaseType_t taskCount = uxTaskGetNumberOfTasks() + 2U;
+        TaskStatus_t * pTasks = pvPortMalloc( taskCount * sizeof( TaskStatus_t ) );
+        UBaseType_t i;
+
+        if( pTasks == NULL )
+        {
+            LogWarn( ( "Not enough heap to list the tasks." ) );
+        }
+        else
+        {
+            taskCount = uxTaskGetSystemState( pTasks, taskCount, NULL );
+
+            for( i = 0U; i < taskCount; i++ )
+            {
+                /* The high-water mark is in bytes on ESP-IDF. */
+                LogInfo( ( "Task %-16s stack unused %6u bytes.",
+                           pTasks[ i ].pcTaskName,
+                           ( unsigned ) pTasks[ i ].usStackHighWaterMark ) );
+            }
+
+            vPortFree( pTasks );
+        }
+    #else /* if ( configUSE_TRACE_FACILITY == 1 ) */
+        LogInfo( ( "Task %-16s stack unused %6u bytes.",
+                   pcTaskGetName( NULL ),
+                   ( unsigned ) uxTaskGetStackHighWaterMark( NULL ) ) );
+        LogInfo( ( "Enable CONFIG_FREERTOS_USE_TRACE_FACILITY for the other tasks." ) );
+    #endif /* if ( configUSE_TRACE_FACILITY == 1 ) */
+}
+
+/*-----------------------------------------------------------*/
+
+static void reportTask( void * pParameters )
+{
+    ( void ) pParameters;
+
+    for( ; ; )
+    {
+        vTaskDelay( ( TickType_t ) MEM_ACCOUNTING_DUMP_INTERVAL_S * configTICK_RATE_HZ );
+        MemAccounting_Report();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void * MemAccounting_Malloc( MemComponent_t component,
+                             size_t size )
+{
+    MemAccountingStats_t * pStats = NULL;
+    AllocationHeader_t * pHeader = NULL;
+    size_t current = 0U;
+
+    assert( component < MemComponentCount );
+
+    pStats = &componentStats[ component ];
+
+    if( size <= ( UINT32_MAX - sizeof( AllocationHeader_t ) ) )
+    {
+        pHeader = pvPortMalloc( sizeof( AllocationHeader_t ) + size );
+    }
+
+    if( pHeader == NULL )
+    {
+        __atomic_add_fetch( &pStats->failures, 1U, __ATOMIC_RELAXED );
+    }
+    else
+    {
+        pHeader->size = ( uint32_t ) size;
+        pHeader->component = ( uint16_t ) component;
+        pHeader->magic = HEADER_MAGIC;
+
+        __atomic_add_fetch( &pStats->allocations, 1U, __ATOMIC_RELAXED );
+        current = __atomic_add_fetch( &pStats->currentBytes, size, __ATOMIC_RELAXED );
+        raisePeak( pStats, current );
+    }
+
+    return ( pHeader != NULL ) ? ( void * ) ( pHeader + 1 ) : NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void MemAccounting_Free( MemComponent_t component,
+                         void * ptr )
+{
+    AllocationHeader_t * pHeader = NULL;
+
+    if( ptr != NULL )
+    {
+        pHeader = ( ( AllocationHeader_t * ) ptr ) - 1;
+
+        /* Memory from pvPortMalloc, or from another component. */
+        assert( pHeader->magic == HEADER_MAGIC );
+        assert( pHeader->component == ( uint16_t ) component );
+        ( void ) component;
+
+        __atomic_sub_fetch( &componentStats[ pHeader->component ].currentBytes,
+                            ( size_t ) pHeader->size, __ATOMIC_RELAXED );
+
+        pHeader->magic = 0U;
+        vPortFree( pHeader );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void MemAccounting_Get( MemComponent_t component,
+                        MemAccountingStats_t * pStats )
+{
+    assert( ( component < MemComponentCount ) && ( pStats != NULL ) );
+
+    pStats->currentBytes = __atomic_load_n( &componentStats[ component ].currentBytes, __ATOMIC_RELAXED );
+    pStats->peakBytes = __atomic_load_n( &componentStats[ component ].peakBytes, __ATOMIC_RELAXED );
+    pStats->allocations = __atomic_load_n( &componentStats[ component ].allocations, __ATOMIC_RELAXED );
+    pStats->failures = __atomic_load_n( &componentStats[ component ].failures, __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+void MemAccounting_Report( void )
+{
+    MemAccountingStats_t stats;
+    uint32_t i;
+
+    LogInfo( ( "Heap free %u bytes, lowest %u bytes.",
+               ( unsigned ) heap_caps_get_free_size( MALLOC_CAP_DEFAULT ),
+               ( unsigned ) heap_caps_get_minimum_free_size( MALLOC_CAP_DEFAULT ) ) );
+
+    for( i = 0U; i < ( uint32_t ) MemComponentCount; i++ )
+    {
+        MemAccounting_Get( ( MemComponent_t ) i, &stats );
+        LogInfo( ( "Heap of %-8s current %7u bytes, peak %7u bytes, %u allocations, %u failed.",
+                   componentNames[ i ],
+                   ( unsigned ) stats.currentBytes,
+                   ( unsigned ) stats.peakBytes,
+                   ( unsigned ) stats.allocations,
+                   ( unsigned ) stats.failures ) );
+    }
+
+    reportStacks();
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MemAccounting_Init( void )
+{
+    BaseType_t status = pdPASS;
+
+    if( MEM_ACCOUNTING_DUMP_INTERVAL_S > 0 )
+    {
+        status = xTaskCreate( reportTask, "MemReport", REPORT_STACK_SIZE, NULL, REPORT_PRIORITY, NULL );
+
+        if( status != pdPASS )
+        {
+            LogError( ( "Failed to create the memory report task." ) );
+        }
+    }
+
+    return status;
+}
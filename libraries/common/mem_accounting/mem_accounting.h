@@ -0,0 +1,142 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mem_accounting.h
+ * @brief Heap use per component, and task stack high-water marks.
+ *
+ * A component allocates with MEM_ACCOUNTING_MALLOC and frees with
+ * MEM_ACCOUNTING_FREE, giving its #MemComponent_t. A header in front of each
+ * allocation keeps its size and component, so that the free is accounted to
+ * the right one, and the current and peak bytes of each component are kept
+ * with relaxed atomics, without a lock. Memory allocated with the macros
+ * must be freed with them, and the other way around.
+ *
+ * With MEM_ACCOUNTING_ENABLED set to 0, the macros are pvPortMalloc and
+ * vPortFree.
+ */
+
+#ifndef MEM_ACCOUNTING_H_
+#define MEM_ACCOUNTING_H_
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether heap use is accounted.
+ */
+#ifndef MEM_ACCOUNTING_ENABLED
+    #if CONFIG_MEM_ACCOUNTING_ENABLE
+        #define MEM_ACCOUNTING_ENABLED    1
+    #else
+        #define MEM_ACCOUNTING_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief How often #MemAccounting_Init has the report logged, 0 for never.
+ */
+#ifndef MEM_ACCOUNTING_DUMP_INTERVAL_S
+    #ifdef CONFIG_MEM_ACCOUNTING_DUMP_INTERVAL_S
+        #define MEM_ACCOUNTING_DUMP_INTERVAL_S    CONFIG_MEM_ACCOUNTING_DUMP_INTERVAL_S
+    #else
+        #define MEM_ACCOUNTING_DUMP_INTERVAL_S    0
+    #endif
+#endif
+
+/**
+ * @brief The components whose heap use is accounted.
+ */
+typedef enum MemComponent
+{
+    MemComponentOta,    /**< The OTA agent, through Malloc_FreeRTOS. */
+    MemComponentPkcs11, /**< The PKCS #11 PAL and its object cache. */
+    MemComponentCrypto, /**< The signature verification of iot_crypto. */
+    MemComponentCount
+} MemComponent_t;
+
+/**
+ * @brief The heap use of a component.
+ */
+typedef struct MemAccountingStats
+{
+    size_t currentBytes; /**< Allocated and not freed, without the headers. */
+    size_t peakBytes;    /**< The most allocated at once. */
+    uint32_t allocations;
+    uint32_t failures;   /**< Allocations the heap couldn't satisfy. */
+} MemAccountingStats_t;
+
+#if MEM_ACCOUNTING_ENABLED
+    #define MEM_ACCOUNTING_MALLOC( component, size )    MemAccounting_Malloc( ( component ), ( size ) )
+    #define MEM_ACCOUNTING_FREE( component, ptr )       MemAccounting_Free( ( component ), ( ptr ) )
+#else
+    #define MEM_ACCOUNTING_MALLOC( component, size )    pvPortMalloc( size )
+    #define MEM_ACCOUNTING_FREE( component, ptr )       vPortFree( ptr )
+#endif
+
+/**
+ * @brief Allocates @a size bytes from the FreeRTOS heap for @a component.
+ *
+ * @return The memory, or NULL if the heap is exhausted.
+ */
+void * MemAccounting_Malloc( MemComponent_t component,
+                             size_t size );
+
+/**
+ * @brief Frees memory from #MemAccounting_Malloc. NULL is ignored.
+ *
+ * @param[in] component The component that allocated @a ptr, checked against
+ * the one recorded.
+ * @param[in] ptr The memory.
+ */
+void MemAccounting_Free( MemComponent_t component,
+                         void * ptr );
+
+/**
+ * @brief Reads the heap use of a component.
+ */
+void MemAccounting_Get( MemComponent_t component,
+                        MemAccountingStats_t * pStats );
+
+/**
+ * @brief Logs the heap use of every component, the free and minimum free
+ * heap, and the stack high-water mark of every task, which needs
+ * CONFIG_FREERTOS_USE_TRACE_FACILITY.
+ */
+void MemAccounting_Report( void );
+
+/**
+ * @brief Starts the task logging the report every
+ * #MEM_ACCOUNTING_DUMP_INTERVAL_S, if it isn't 0.
+ *
+ * @return pdPASS, or pdFAIL if the task couldn't be created.
+ */
+BaseType_t MemAccounting_Init( void );
+
+#endif /* ifndef MEM_ACCOUNTING_H_ */
@@ -0,0 +1,131 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mem_placement.h
+ * @brief Where large buffers go on modules with PSRAM.
+ *
+ * Buffers are in one of two classes. Network buffers are read and written on
+ * every packet and stay in internal RAM unless
+ * CONFIG_MEM_PLACEMENT_NETWORK_PSRAM is set. Bulk buffers, which file data
+ * is only copied through, go to PSRAM when CONFIG_MEM_PLACEMENT_BULK_PSRAM is
+ * set. Static buffers are placed with the MEM_PLACEMENT_*_ATTR attributes,
+ * and heap buffers are allocated with #MemPlacement_Malloc.
+ */
+
+#ifndef MEM_PLACEMENT_H_
+#define MEM_PLACEMENT_H_
+
+/* Standard includes. */
+#include <stddef.h>
+
+/* ESP-IDF includes. */
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether bulk buffers are placed in PSRAM.
+ */
+#ifndef MEM_PLACEMENT_BULK_PSRAM
+    #if CONFIG_MEM_PLACEMENT_BULK_PSRAM
+        #define MEM_PLACEMENT_BULK_PSRAM    1
+    #else
+        #define MEM_PLACEMENT_BULK_PSRAM    0
+    #endif
+#endif
+
+/**
+ * @brief Whether network buffers are placed in PSRAM.
+ */
+#ifndef MEM_PLACEMENT_NETWORK_PSRAM
+    #if CONFIG_MEM_PLACEMENT_NETWORK_PSRAM
+        #define MEM_PLACEMENT_NETWORK_PSRAM    1
+    #else
+        #define MEM_PLACEMENT_NETWORK_PSRAM    0
+    #endif
+#endif
+
+/**
+ * @brief Attributes of static buffers of each class. EXT_RAM_ATTR is empty
+ * unless CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY is set, and only applies
+ * to buffers without an initializer.
+ */
+#if MEM_PLACEMENT_BULK_PSRAM
+    #define MEM_PLACEMENT_BULK_ATTR    EXT_RAM_ATTR
+#else
+    #define MEM_PLACEMENT_BULK_ATTR
+#endif
+
+#if MEM_PLACEMENT_NETWORK_PSRAM
+    #define MEM_PLACEMENT_NETWORK_ATTR    EXT_RAM_ATTR
+#else
+    #define MEM_PLACEMENT_NETWORK_ATTR
+#endif
+
+/**
+ * @brief The class of a buffer.
+ */
+typedef enum MemPlacement
+{
+    MemPlacementNetwork, /**< Accessed on every packet. */
+    MemPlacementBulk     /**< File data copied through. */
+} MemPlacement_t;
+
+/**
+ * @brief Allocates a buffer of a class from PSRAM if the class is placed
+ * there, falling back to internal RAM, or from internal RAM.
+ *
+ * @return The buffer, to be freed with #MemPlacement_Free, or NULL.
+ */
+static inline void * MemPlacement_Malloc( MemPlacement_t placement,
+                                          size_t size )
+{
+    void * ptr = NULL;
+
+    if( ( ( placement == MemPlacementBulk ) && ( MEM_PLACEMENT_BULK_PSRAM != 0 ) ) ||
+        ( ( placement == MemPlacementNetwork ) && ( MEM_PLACEMENT_NETWORK_PSRAM != 0 ) ) )
+    {
+        ptr = heap_caps_malloc_prefer( size, 2,
+                                       MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+                                       MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT );
+    }
+    else
+    {
+        ptr = heap_caps_malloc( size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT );
+    }
+
+    return ptr;
+}
+
+/**
+ * @brief Frees a buffer from #MemPlacement_Malloc. NULL is ignored.
+ */
+static inline void MemPlacement_Free( void * ptr )
+{
+    heap_caps_free( ptr );
+}
+
+#endif /* ifndef MEM_PLACEMENT_H_ */
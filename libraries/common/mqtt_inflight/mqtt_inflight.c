@@ -0,0 +1,291 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_inflight.c
+ * @brief Implementation of the table of publishes waiting for a PUBACK.
+ *
+ * A slot is free when its packet identifier is MQTT_PACKET_ID_INVALID. A
+ * removal shifts the entries of the probe run behind the freed slot back into
+ * it, so a lookup stops at the first free slot without tombstones filling the
+ * table as publishes come and go.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "mqtt_inflight.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The slot a packet identifier hashes to.
+ */
+#define HOME_SLOT( pInflight, packetId )    ( ( size_t ) ( packetId ) & ( ( pInflight )->capacity - 1U ) )
+
+/**
+ * @brief The slot after @a index, wrapping at the end of the table.
+ */
+#define NEXT_SLOT( pInflight, index )       ( ( ( index ) + 1U ) & ( ( pInflight )->capacity - 1U ) )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The slot holding @a packetId, or the free slot that ends its probe
+ * run.
+ */
+static size_t findSlot( const MqttInflight_t * pInflight,
+                        uint16_t packetId );
+
+/*-----------------------------------------------------------*/
+
+static size_t findSlot( const MqttInflight_t * pInflight,
+                        uint16_t packetId )
+{
+    size_t index = HOME_SLOT( pInflight, packetId );
+
+    /* Terminates as long as the table keeps a free slot. */
+    while( ( pInflight->pEntries[ index ].packetId != MQTT_PACKET_ID_INVALID ) &&
+           ( pInflight->pEntries[ index ].packetId != packetId ) )
+    {
+        index = NEXT_SLOT( pInflight, index );
+    }
+
+    return index;
+}
+
+/*-----------------------------------------------------------*/
+
+MqttInflightEntry_t * MqttInflight_Add( MqttInflight_t * pInflight,
+                                        uint16_t packetId )
+{
+    MqttInflightEntry_t * pEntry = NULL;
+    size_t index;
+
+    assert( pInflight != NULL );
+    assert( ( pInflight->capacity >= 2U ) &&
+            ( ( pInflight->capacity & ( pInflight->capacity - 1U ) ) == 0U ) );
+    assert( packetId != MQTT_PACKET_ID_INVALID );
+
+    /* One slot stays free to end every probe run. */
+    if( pInflight->count < ( pInflight->capacity - 1U ) )
+    {
+        index = findSlot( pInflight, packetId );
+
+        if( pInflight->pEntries[ index ].packetId == MQTT_PACKET_ID_INVALID )
+        {
+            pEntry = &( pInflight->pEntries[ index ] );
+            ( void ) memset( pEntry, 0x00, sizeof( *pEntry ) );
+            pEntry->packetId = packetId;
+            pEntry->sequence = pInflight->nextSequence++;
+            pInflight->count++;
+        }
+    }
+
+    return pEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+MqttInflightEntry_t * MqttInflight_Find( MqttInflight_t * pInflight,
+                                         uint16_t packetId )
+{
+    MqttInflightEntry_t * pEntry = NULL;
+    size_t index;
+
+    assert( pInflight != NULL );
+
+    if( packetId != MQTT_PACKET_ID_INVALID )
+    {
+        index = findSlot( pInflight, packetId );
+
+        if( pInflight->pEntries[ index ].packetId == packetId )
+        {
+            pEntry = &( pInflight->pEntries[ index ] );
+        }
+    }
+
+    return pEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttInflight_Remove( MqttInflight_t * pInflight,
+                          uint16_t packetId )
+{
+    MqttInflightEntry_t * pEntry = MqttInflight_Find( pInflight, packetId );
+    size_t freed;
+    size_t index;
+    size_t home;
+
+    if( pEntry != NULL )
+    {
+        freed = ( size_t ) ( pEntry - pInflight->pEntries );
+        index = NEXT_SLOT( pInflight, freed );
+
+        while( pInflight->pEntries[ index ].packetId != MQTT_PACKET_ID_INVALID )
+        {
+            home = HOME_SLOT( pInflight, pInflight->pEntries[ index ].packetId );
+
+            /* The entry moves back unless its home lies cyclically after the
+             * freed slot, up to the entry itself. */
+            if( ( ( index - home ) & ( pInflight->capacity - 1U ) ) >=
+                ( ( index - freed ) & ( pInflight->capacity - 1U ) ) )
+            {
+                pInflight->pEntries[ freed ] = pInflight->pEntries[ index ];
+                freed = index;
+            }
+
+            index = NEXT_SLOT( pInflight, index );
+        }
+
+        ( void ) memset( &( pInflight->pEntries[ freed ] ), 0x00, sizeof( MqttInflightEntry_t ) );
+        pInflight->count--;
+    }
+
+    return ( pEntry != NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttInflight_Acknowledge( MqttInflight_t * pInflight,
+                               uint16_t packetId )
+{
+    bool acknowledged = MqttInflight_Remove( pInflight, packetId );
+
+    if( ( acknowledged == true ) && ( pInflight->window < pInflight->maxWindow ) )
+    {
+        pInflight->window++;
+    }
+
+    return acknowledged;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttInflight_WindowOpen( const MqttInflight_t * pInflight )
+{
+    assert( pInflight != NULL );
+
+    return ( pInflight->count < pInflight->window ) &&
+           ( pInflight->count < ( pInflight->capacity - 1U ) );
+}
+
+/*-----------------------------------------------------------*/
+
+MqttInflightEntry_t * MqttInflight_CheckTimeout( MqttInflight_t * pInflight,
+                                                 uint32_t nowMs,
+                                                 uint32_t timeoutMs )
+{
+    MqttInflightEntry_t * pLongest = NULL;
+    size_t i;
+
+    assert( pInflight != NULL );
+
+    /* The publish sent the longest ago, which isn't the oldest once a timeout
+     * restarted the wait of the oldest. */
+    for( i = 0U; i < pInflight->capacity; i++ )
+    {
+        if( ( pInflight->pEntries[ i ].packetId != MQTT_PACKET_ID_INVALID ) &&
+            ( ( pLongest == NULL ) ||
+              ( ( nowMs - pInflight->pEntries[ i ].sentTimeMs ) > ( nowMs - pLongest->sentTimeMs ) ) ) )
+        {
+            pLongest = &( pInflight->pEntries[ i ] );
+        }
+    }
+
+    if( ( pLongest != NULL ) && ( ( nowMs - pLongest->sentTimeMs ) >= timeoutMs ) )
+    {
+        pInflight->window = ( pInflight->window > 1U ) ? ( pInflight->window / 2U ) : 1U;
+        pLongest->sentTimeMs = nowMs;
+    }
+    else
+    {
+        pLongest = NULL;
+    }
+
+    return pLongest;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t MqttInflight_Window( const MqttInflight_t * pInflight )
+{
+    assert( pInflight != NULL );
+
+    return pInflight->window;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttInflight_Clear( MqttInflight_t * pInflight )
+{
+    assert( pInflight != NULL );
+
+    ( void ) memset( pInflight->pEntries, 0x00, pInflight->capacity * sizeof( MqttInflightEntry_t ) );
+    pInflight->count = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+MqttInflightEntry_t * MqttInflight_Next( MqttInflight_t * pInflight,
+                                         const MqttInflightEntry_t * pPrevious )
+{
+    MqttInflightEntry_t * pNext = NULL;
+    uint32_t base;
+    uint32_t age;
+    size_t i;
+
+    assert( pInflight != NULL );
+
+    /* Sequences are compared by their distance from a base, so they order
+     * correctly across a wrap. From the next sequence to be handed out, every
+     * entry lies behind; from the previous entry, only the newer ones lie
+     * closer than the next sequence. */
+    base = ( pPrevious == NULL ) ? pInflight->nextSequence : pPrevious->sequence;
+
+    /* The table is small, and only walked to resend. */
+    for( i = 0U; i < pInflight->capacity; i++ )
+    {
+        age = pInflight->pEntries[ i ].sequence - base;
+
+        if( ( pInflight->pEntries[ i ].packetId != MQTT_PACKET_ID_INVALID ) &&
+            ( ( pPrevious == NULL ) || ( ( age != 0U ) && ( age < ( pInflight->nextSequence - base ) ) ) ) &&
+            ( ( pNext == NULL ) || ( age < ( pNext->sequence - base ) ) ) )
+        {
+            pNext = &( pInflight->pEntries[ i ] );
+        }
+    }
+
+    return pNext;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t MqttInflight_Count( const MqttInflight_t * pInflight )
+{
+    assert( pInflight != NULL );
+
+    return pInflight->count;
+}
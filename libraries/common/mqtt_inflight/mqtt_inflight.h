@@ -0,0 +1,237 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_inflight.h
+ * @brief Track the QoS 1 publishes waiting for a PUBACK, by packet identifier.
+ *
+ * The publishes are kept in an open-addressed table the caller provides,
+ * indexed by packet identifier with linear probing. The MQTT library hands
+ * out packet identifiers in sequence, so a window of publishes fills
+ * consecutive slots and finding the publish a PUBACK acknowledges takes one
+ * probe. An entry holds the publish info in place, with references to the
+ * topic and payload of the caller, which must stay valid until the publish is
+ * removed. Entries also carry the order they were added in, so publishes are
+ * resent in the order they were first sent.
+ *
+ * The table also keeps a window: the number of publishes allowed in flight.
+ * Each PUBACK opens it by one up to its maximum, and a PUBACK that takes longer
+ * than a timeout halves it.
+ */
+
+#ifndef MQTT_INFLIGHT_H_
+#define MQTT_INFLIGHT_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The most QoS 1 publishes the demo helpers keep in flight.
+ */
+#ifndef MQTT_INFLIGHT_WINDOW
+    #define MQTT_INFLIGHT_WINDOW    CONFIG_MQTT_INFLIGHT_WINDOW
+#endif
+
+/**
+ * @brief How long a publish waits for its PUBACK before the window shrinks.
+ */
+#ifndef MQTT_INFLIGHT_ACK_TIMEOUT_MS
+    #define MQTT_INFLIGHT_ACK_TIMEOUT_MS    CONFIG_MQTT_INFLIGHT_ACK_TIMEOUT_MS
+#endif
+
+/**
+ * @brief Size of the buffer the publishes of a resend are collected in, or 0
+ * to send them one by one.
+ */
+#ifndef MQTT_INFLIGHT_RESEND_BUFFER_SIZE
+    #define MQTT_INFLIGHT_RESEND_BUFFER_SIZE    CONFIG_MQTT_INFLIGHT_RESEND_BUFFER_SIZE
+#endif
+
+/**
+ * @brief The smallest table, a power of two, with a free slot beyond
+ * @a window publishes, for windows of up to 255.
+ */
+#define MQTT_INFLIGHT_TABLE_SIZE( window ) \
+    ( ( ( window ) < 2U ) ? 2U :           \
+      ( ( window ) < 4U ) ? 4U :           \
+      ( ( window ) < 8U ) ? 8U :           \
+      ( ( window ) < 16U ) ? 16U :         \
+      ( ( window ) < 32U ) ? 32U :         \
+      ( ( window ) < 64U ) ? 64U :         \
+      ( ( window ) < 128U ) ? 128U : 256U )
+
+/**
+ * @brief A publish waiting for its PUBACK.
+ */
+typedef struct MqttInflightEntry
+{
+    uint16_t packetId;             /**< MQTT_PACKET_ID_INVALID for a free slot. */
+    uint32_t sequence;             /**< The order the entry was added in. */
+    uint32_t sentTimeMs;           /**< When the publish was last sent, set by the caller. */
+    MQTTPublishInfo_t publishInfo; /**< The publish, referencing the topic and payload of the caller. */
+} MqttInflightEntry_t;
+
+/**
+ * @brief The table of publishes waiting for a PUBACK.
+ *
+ * The fields are private to this module.
+ */
+typedef struct MqttInflight
+{
+    MqttInflightEntry_t * pEntries;
+    size_t capacity;
+    size_t count;
+    uint32_t nextSequence;
+    size_t window;
+    size_t maxWindow;
+} MqttInflight_t;
+
+/**
+ * @brief Initializer for a static #MqttInflight_t over an array of entries,
+ * whose length must be a power of two, with a window of at most @a maxWindow
+ * publishes. A zeroed array is an empty table.
+ */
+#define MQTT_INFLIGHT_INITIALIZER( entries, maxWindow )                  \
+    { ( entries ), sizeof( entries ) / sizeof( ( entries )[ 0 ] ), 0U, 0U, \
+      ( maxWindow ), ( maxWindow ) }
+
+/**
+ * @brief Adds a publish.
+ *
+ * @param[in] pInflight The table.
+ * @param[in] packetId The packet identifier the publish is sent with.
+ *
+ * @return The entry, with #MqttInflightEntry_t.publishInfo zeroed for the
+ * caller to fill in, or NULL if the table is full or already holds
+ * @a packetId.
+ */
+MqttInflightEntry_t * MqttInflight_Add( MqttInflight_t * pInflight,
+                                        uint16_t packetId );
+
+/**
+ * @brief Finds the publish sent with a packet identifier.
+ *
+ * @param[in] pInflight The table.
+ * @param[in] packetId The packet identifier.
+ *
+ * @return The entry, or NULL if no publish waits with @a packetId.
+ */
+MqttInflightEntry_t * MqttInflight_Find( MqttInflight_t * pInflight,
+                                         uint16_t packetId );
+
+/**
+ * @brief Removes the publish sent with a packet identifier, such as when its
+ * PUBACK arrives. Entries returned earlier may move.
+ *
+ * @param[in] pInflight The table.
+ * @param[in] packetId The packet identifier.
+ *
+ * @return false if no publish waited with @a packetId.
+ */
+bool MqttInflight_Remove( MqttInflight_t * pInflight,
+                          uint16_t packetId );
+
+/**
+ * @brief Removes the publish a PUBACK acknowledges and opens the window by one
+ * publish, up to its maximum.
+ *
+ * @param[in] pInflight The table.
+ * @param[in] packetId The packet identifier of the PUBACK.
+ *
+ * @return false if no publish waited with @a packetId.
+ */
+bool MqttInflight_Acknowledge( MqttInflight_t * pInflight,
+                               uint16_t packetId );
+
+/**
+ * @brief Whether another publish may be sent, with fewer publishes in flight
+ * than the window and a free slot.
+ *
+ * @param[in] pInflight The table.
+ *
+ * @return true if the window is open.
+ */
+bool MqttInflight_WindowOpen( const MqttInflight_t * pInflight );
+
+/**
+ * @brief Checks whether the publish sent the longest ago has waited too long
+ * for its PUBACK. If it has, the window is halved, down to one publish, and
+ * the wait of that publish restarts so a late PUBACK shrinks the window once.
+ *
+ * @param[in] pInflight The table.
+ * @param[in] nowMs The current time, on the clock of
+ * #MqttInflightEntry_t.sentTimeMs.
+ * @param[in] timeoutMs How long a publish may wait for its PUBACK.
+ *
+ * @return The publish that timed out, or NULL.
+ */
+MqttInflightEntry_t * MqttInflight_CheckTimeout( MqttInflight_t * pInflight,
+                                                 uint32_t nowMs,
+                                                 uint32_t timeoutMs );
+
+/**
+ * @brief The number of publishes allowed in flight.
+ *
+ * @param[in] pInflight The table.
+ *
+ * @return The window.
+ */
+size_t MqttInflight_Window( const MqttInflight_t * pInflight );
+
+/**
+ * @brief Removes every publish.
+ *
+ * @param[in] pInflight The table.
+ */
+void MqttInflight_Clear( MqttInflight_t * pInflight );
+
+/**
+ * @brief Walks the publishes in the order they were added.
+ *
+ * @param[in] pInflight The table.
+ * @param[in] pPrevious The entry returned by the last call, or NULL for the
+ * oldest publish. The table must not change between calls.
+ *
+ * @return The next entry, or NULL after the newest.
+ */
+MqttInflightEntry_t * MqttInflight_Next( MqttInflight_t * pInflight,
+                                         const MqttInflightEntry_t * pPrevious );
+
+/**
+ * @brief The number of publishes waiting for a PUBACK.
+ *
+ * @param[in] pInflight The table.
+ *
+ * @return The number of entries.
+ */
+size_t MqttInflight_Count( const MqttInflight_t * pInflight );
+
+#endif /* ifndef MQTT_INFLIGHT_H_ */
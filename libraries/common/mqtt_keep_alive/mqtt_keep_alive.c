@@ -0,0 +1,298 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_keep_alive.c
+ * @brief Implementation of the keep-alive interval search and the early
+ * PINGREQ.
+ *
+ * The learned state of a network is one 32-bit NVS value: the interval that
+ * held in the upper half and the one that failed in the lower half.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* ESP-IDF includes. */
+#include "esp_rom_crc.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the keep-alive. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Keep-Alive"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "mqtt_keep_alive.h"
+
+/* Energy estimates of operations. */
+#include "energy_meter.h"
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttKeepAlive_PingIfDue( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint32_t intervalMs = 0U;
+
+    assert( pContext != NULL );
+
+    intervalMs = ( uint32_t ) pContext->keepAliveIntervalSec * 1000U;
+
+    if( ( MQTT_KEEP_ALIVE_EARLY_PING_PERCENT > 0 ) &&
+        ( intervalMs > 0U ) &&
+        ( pContext->waitingForPingResp == false ) &&
+        ( ( pContext->getTime() - pContext->lastPacketTime ) >=
+          ( ( intervalMs / 100U ) * ( uint32_t ) MQTT_KEEP_ALIVE_EARLY_PING_PERCENT ) ) )
+    {
+        ENERGY_METER_BEGIN( pingEnergy, EnergyOpKeepAlive );
+
+        status = MQTT_Ping( pContext );
+
+        ENERGY_METER_END( pingEnergy, 0U );
+
+        if( status != MQTTSuccess )
+        {
+            LogWarn( ( "Failed to send an early PINGREQ: %s.", MQTT_Status_strerror( status ) ) );
+        }
+    }
+
+    return status;
+}
+
+#if MQTT_KEEP_ALIVE_ADAPTIVE
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether @a seconds can be a learned interval. 0 means none.
+ */
+    static bool validInterval( uint32_t seconds );
+
+/**
+ * @brief Writes the learned state to NVS.
+ */
+    static void saveState( const MqttKeepAlive_t * pKeepAlive );
+
+/*-----------------------------------------------------------*/
+
+    static bool validInterval( uint32_t seconds )
+    {
+        return ( seconds == 0U ) ||
+               ( ( seconds >= MQTT_KEEP_ALIVE_MIN_SECONDS ) && ( seconds <= MQTT_KEEP_ALIVE_MAX_SECONDS ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void saveState( const MqttKeepAlive_t * pKeepAlive )
+    {
+        nvs_handle_t handle;
+        esp_err_t err = ESP_OK;
+
+        err = nvs_open( MQTT_KEEP_ALIVE_NVS_NAMESPACE, NVS_READWRITE, &handle );
+
+        if( err == ESP_OK )
+        {
+            err = nvs_set_u32( handle, pKeepAlive->key,
+                               ( ( uint32_t ) pKeepAlive->heldSeconds << 16 ) | pKeepAlive->failedSeconds );
+
+            if( err == ESP_OK )
+            {
+                err = nvs_commit( handle );
+            }
+
+            nvs_close( handle );
+        }
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Failed to save the keep-alive state %s to NVS: %s.",
+                        pKeepAlive->key, esp_err_to_name( err ) ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttKeepAlive_Init( MqttKeepAlive_t * pKeepAlive )
+    {
+        wifi_ap_record_t apInfo;
+        nvs_handle_t handle;
+        uint32_t crc = 0U;
+        uint32_t value = 0U;
+        bool loaded = false;
+
+        assert( pKeepAlive != NULL );
+
+        ( void ) memset( pKeepAlive, 0x00, sizeof( *pKeepAlive ) );
+
+        /* Off Wi-Fi, all connections share the key of an empty SSID. */
+        if( esp_wifi_sta_get_ap_info( &apInfo ) == ESP_OK )
+        {
+            crc = esp_rom_crc32_le( 0U, apInfo.ssid, strnlen( ( const char * ) apInfo.ssid, sizeof( apInfo.ssid ) ) );
+        }
+
+        ( void ) snprintf( pKeepAlive->key, sizeof( pKeepAlive->key ), "k%08lx", ( unsigned long ) crc );
+
+        if( nvs_open( MQTT_KEEP_ALIVE_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK )
+        {
+            loaded = ( nvs_get_u32( handle, pKeepAlive->key, &value ) == ESP_OK );
+            nvs_close( handle );
+        }
+
+        if( loaded == false )
+        {
+            /* Nothing was learned about this network yet. */
+        }
+        else if( ( validInterval( value >> 16 ) == false ) ||
+                 ( validInterval( value & 0xFFFFU ) == false ) ||
+                 ( ( ( value & 0xFFFFU ) != 0U ) && ( ( value >> 16 ) >= ( value & 0xFFFFU ) ) ) )
+        {
+            LogWarn( ( "Ignoring the keep-alive state %s, it is out of the configured range.",
+                       pKeepAlive->key ) );
+        }
+        else
+        {
+            pKeepAlive->heldSeconds = ( uint16_t ) ( value >> 16 );
+            pKeepAlive->failedSeconds = ( uint16_t ) ( value & 0xFFFFU );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    uint16_t MqttKeepAlive_Next( MqttKeepAlive_t * pKeepAlive )
+    {
+        uint32_t next = MQTT_KEEP_ALIVE_INITIAL_SECONDS;
+        uint32_t lower = 0U;
+
+        assert( pKeepAlive != NULL );
+
+        if( pKeepAlive->failedSeconds != 0U )
+        {
+            lower = ( pKeepAlive->heldSeconds != 0U ) ? pKeepAlive->heldSeconds : MQTT_KEEP_ALIVE_MIN_SECONDS;
+
+            /* Bisect, until the bounds are close enough to keep what held. */
+            next = ( pKeepAlive->failedSeconds <= ( lower + MQTT_KEEP_ALIVE_RESOLUTION_SECONDS ) ) ?
+                   lower : ( lower + ( ( pKeepAlive->failedSeconds - lower ) / 2U ) );
+        }
+        else if( pKeepAlive->heldSeconds != 0U )
+        {
+            next = ( uint32_t ) pKeepAlive->heldSeconds * 2U;
+
+            if( next > MQTT_KEEP_ALIVE_MAX_SECONDS )
+            {
+                next = MQTT_KEEP_ALIVE_MAX_SECONDS;
+            }
+        }
+        else
+        {
+            /* A new network. */
+        }
+
+        pKeepAlive->currentSeconds = ( uint16_t ) next;
+
+        LogInfo( ( "Keep-alive interval %u s, held %u s, failed %u s.",
+                   ( unsigned ) pKeepAlive->currentSeconds,
+                   ( unsigned ) pKeepAlive->heldSeconds,
+                   ( unsigned ) pKeepAlive->failedSeconds ) );
+
+        return pKeepAlive->currentSeconds;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttKeepAlive_ConnectionEnded( MqttKeepAlive_t * pKeepAlive,
+                                        const MQTTContext_t * pContext,
+                                        MQTTStatus_t status,
+                                        uint32_t connectedMs )
+    {
+        uint16_t held = 0U;
+        uint16_t failed = 0U;
+        bool pinged = false;
+        bool lost = false;
+
+        assert( ( pKeepAlive != NULL ) && ( pContext != NULL ) );
+
+        held = pKeepAlive->heldSeconds;
+        failed = pKeepAlive->failedSeconds;
+
+        /* The time of the last PINGREQ isn't reset by a CONNECT, so it
+         * counts only if it falls within this connection. */
+        pinged = ( pContext->getTime() - pContext->pingReqSendTimeMs ) < connectedMs;
+        lost = ( status != MQTTSuccess ) &&
+               ( ( status == MQTTKeepAliveTimeout ) || ( pContext->waitingForPingResp == true ) );
+
+        if( pKeepAlive->currentSeconds == 0U )
+        {
+            /* Not connected with an interval from #MqttKeepAlive_Next. */
+        }
+        else if( lost == true )
+        {
+            if( ( failed == 0U ) || ( pKeepAlive->currentSeconds < failed ) )
+            {
+                failed = pKeepAlive->currentSeconds;
+            }
+
+            /* What held before doesn't anymore, so the network changed. */
+            if( held >= failed )
+            {
+                held = ( ( failed / 2U ) >= MQTT_KEEP_ALIVE_MIN_SECONDS ) ? ( failed / 2U ) : 0U;
+            }
+
+            LogWarn( ( "Lost a PINGREQ with a keep-alive interval of %u s.",
+                       ( unsigned ) pKeepAlive->currentSeconds ) );
+        }
+        else if( ( pinged == true ) && ( pKeepAlive->currentSeconds > held ) )
+        {
+            held = pKeepAlive->currentSeconds;
+
+            if( ( failed != 0U ) && ( failed <= held ) )
+            {
+                failed = 0U;
+            }
+        }
+        else
+        {
+            /* Nothing learned. */
+        }
+
+        if( ( held != pKeepAlive->heldSeconds ) || ( failed != pKeepAlive->failedSeconds ) )
+        {
+            pKeepAlive->heldSeconds = held;
+            pKeepAlive->failedSeconds = failed;
+            saveState( pKeepAlive );
+        }
+
+        pKeepAlive->currentSeconds = 0U;
+    }
+
+#endif /* if MQTT_KEEP_ALIVE_ADAPTIVE */
@@ -0,0 +1,188 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_keep_alive.h
+ * @brief Learn the MQTT keep-alive interval of each network, and send the
+ * PINGREQ while the radio is awake anyway.
+ *
+ * A NAT drops the mapping of a connection left idle for long enough, after
+ * which the next PINGREQ is lost and the client reconnects. The interval
+ * used for each CONNECT comes from a search over the connections to the
+ * same network: it doubles while the PINGREQs of a connection are
+ * answered, and once a PINGREQ is lost, bisects between the longest
+ * interval that held and the shortest that didn't. What was learned is kept
+ * in NVS under a CRC of the SSID of the access point.
+ *
+ * The functions are not thread safe and are called from the task that owns
+ * the MQTT context.
+ */
+
+#ifndef MQTT_KEEP_ALIVE_H_
+#define MQTT_KEEP_ALIVE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the keep-alive interval is learned.
+ */
+#ifndef MQTT_KEEP_ALIVE_ADAPTIVE
+    #define MQTT_KEEP_ALIVE_ADAPTIVE    CONFIG_MQTT_KEEP_ALIVE_ADAPTIVE
+#endif
+
+/**
+ * @brief The share of the interval after which a packet received triggers
+ * the PINGREQ, in percent. 0 to leave it to the MQTT library.
+ */
+#ifndef MQTT_KEEP_ALIVE_EARLY_PING_PERCENT
+    #define MQTT_KEEP_ALIVE_EARLY_PING_PERCENT    CONFIG_MQTT_KEEP_ALIVE_EARLY_PING_PERCENT
+#endif
+
+/**
+ * @brief Sends the PINGREQ now if @a pContext sent nothing for
+ * #MQTT_KEEP_ALIVE_EARLY_PING_PERCENT of its keep-alive interval.
+ *
+ * Called when a packet was just received, so that the PINGREQ goes out with
+ * the radio already awake instead of waking it when the interval ends. The
+ * MQTT library then handles the PINGRESP as for its own PINGREQ.
+ *
+ * @param[in] pContext The MQTT context, connected.
+ *
+ * @return MQTTSuccess, or the status of MQTT_Ping if it failed.
+ */
+MQTTStatus_t MqttKeepAlive_PingIfDue( MQTTContext_t * pContext );
+
+#if MQTT_KEEP_ALIVE_ADAPTIVE
+
+/**
+ * @brief The shortest interval, in seconds.
+ */
+    #ifndef MQTT_KEEP_ALIVE_MIN_SECONDS
+        #define MQTT_KEEP_ALIVE_MIN_SECONDS    CONFIG_MQTT_KEEP_ALIVE_MIN_SECONDS
+    #endif
+
+/**
+ * @brief The longest interval, in seconds.
+ */
+    #ifndef MQTT_KEEP_ALIVE_MAX_SECONDS
+        #define MQTT_KEEP_ALIVE_MAX_SECONDS    CONFIG_MQTT_KEEP_ALIVE_MAX_SECONDS
+    #endif
+
+/**
+ * @brief The interval on a network nothing was learned about, in seconds.
+ */
+    #ifndef MQTT_KEEP_ALIVE_INITIAL_SECONDS
+        #define MQTT_KEEP_ALIVE_INITIAL_SECONDS    CONFIG_MQTT_KEEP_ALIVE_INITIAL_SECONDS
+    #endif
+
+/**
+ * @brief How close the bounds of the search get before it ends, in seconds.
+ */
+    #ifndef MQTT_KEEP_ALIVE_RESOLUTION_SECONDS
+        #define MQTT_KEEP_ALIVE_RESOLUTION_SECONDS    CONFIG_MQTT_KEEP_ALIVE_RESOLUTION_SECONDS
+    #endif
+
+/**
+ * @brief The NVS namespace of the learned intervals.
+ */
+    #ifndef MQTT_KEEP_ALIVE_NVS_NAMESPACE
+        #define MQTT_KEEP_ALIVE_NVS_NAMESPACE    CONFIG_MQTT_KEEP_ALIVE_NVS_NAMESPACE
+    #endif
+
+    #if ( MQTT_KEEP_ALIVE_INITIAL_SECONDS < MQTT_KEEP_ALIVE_MIN_SECONDS ) || ( MQTT_KEEP_ALIVE_INITIAL_SECONDS > MQTT_KEEP_ALIVE_MAX_SECONDS )
+        #error "The initial keep-alive interval must be between the shortest and the longest."
+    #endif
+
+/**
+ * @brief The length of an NVS key, with the terminator.
+ */
+    #define MQTT_KEEP_ALIVE_KEY_SIZE    ( 16U )
+
+/**
+ * @brief What was learned about the network in use.
+ *
+ * The fields are private to this module.
+ */
+typedef struct MqttKeepAlive
+{
+    /* The NVS key, from a CRC of the SSID. */
+    char key[ MQTT_KEEP_ALIVE_KEY_SIZE ];
+
+    /* The longest interval a connection survived while idle, or 0. */
+    uint16_t heldSeconds;
+
+    /* The shortest interval that lost a PINGREQ, or 0. */
+    uint16_t failedSeconds;
+
+    /* The interval of the current connection. */
+    uint16_t currentSeconds;
+} MqttKeepAlive_t;
+
+/**
+ * @brief Loads what was learned about the Wi-Fi network the station is
+ * connected to. Called again after joining another network.
+ *
+ * @param[out] pKeepAlive The keep-alive state to initialize.
+ */
+void MqttKeepAlive_Init( MqttKeepAlive_t * pKeepAlive );
+
+/**
+ * @brief The interval for the next CONNECT, in seconds.
+ *
+ * @param[in] pKeepAlive The keep-alive state.
+ *
+ * @return The value for the keepAliveSeconds of the connect information.
+ */
+uint16_t MqttKeepAlive_Next( MqttKeepAlive_t * pKeepAlive );
+
+/**
+ * @brief Learns from the end of a connection opened with the interval of
+ * the last #MqttKeepAlive_Next, and saves the result to NVS if it changed.
+ *
+ * The interval failed if the connection ended on a PINGREQ left without a
+ * PINGRESP. It held if a PINGREQ sent during the connection was answered:
+ * a connection that always has traffic tells nothing about the NAT, and
+ * the search stays where it is.
+ *
+ * @param[in] pKeepAlive The keep-alive state.
+ * @param[in] pContext The MQTT context of the connection, before it is
+ * reconnected.
+ * @param[in] status The status the connection ended with.
+ * @param[in] connectedMs How long the connection was up, in milliseconds.
+ */
+void MqttKeepAlive_ConnectionEnded( MqttKeepAlive_t * pKeepAlive,
+                                    const MQTTContext_t * pContext,
+                                    MQTTStatus_t status,
+                                    uint32_t connectedMs );
+
+#endif /* if MQTT_KEEP_ALIVE_ADAPTIVE */
+
+#endif /* ifndef MQTT_KEEP_ALIVE_H_ */
@@ -0,0 +1,1525 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_session.c
+ * @brief Implementation of the MQTT session of the demos.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the MQTT session. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "MQTT Session"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "mqtt_session.h"
+
+/* Clock for timer. */
+#include "clock.h"
+
+/* Outgoing publishes waiting for a PUBACK. */
+#include "mqtt_inflight.h"
+
+/* Reconnect policy, with hardware random numbers for the jitter. */
+#include "reconnect_policy.h"
+
+/* MQTT session kept across deep sleep. */
+#include "mqtt_session_retain.h"
+
+/* Publishes kept in flash while disconnected. */
+#include "publish_store.h"
+
+/* Shared buffer arena. */
+#include "buffer_arena.h"
+
+/* Performance metrics. */
+#include "perf_metrics.h"
+
+/* Compression of large payloads. */
+#include "payload_codec.h"
+
+/* Energy estimates of operations. */
+#include "energy_meter.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the table of outgoing publishes, with a slot free beyond the
+ * #MQTT_INFLIGHT_WINDOW publishes in flight.
+ */
+#define MAX_OUTGOING_PUBLISHES    MQTT_INFLIGHT_TABLE_SIZE( MQTT_INFLIGHT_WINDOW )
+
+/**
+ * @brief Invalid packet identifier for the MQTT packets. Zero is always an
+ * invalid packet identifier as per MQTT 3.1.1 spec.
+ */
+#define MQTT_PACKET_ID_INVALID    ( ( uint16_t ) 0U )
+
+/**
+ * @brief How long the process loop of the current session runs between checks
+ * on the TLS connect of a handover.
+ */
+#define HANDOVER_POLL_MS          ( 100U )
+
+/**
+ * @brief What the session connected with.
+ */
+static MqttSessionConfig_t sessionConfig;
+
+/**
+ * @brief Whether the CONNECT was accepted, so a DISCONNECT is sent by
+ * #MqttSession_Disconnect even after intermediate failures.
+ */
+static bool sessionEstablished = false;
+
+/**
+ * @brief Table of the outgoing publish messages, by packet id. These stored
+ * outgoing publish messages are kept until a successful ack is received.
+ */
+static MqttInflightEntry_t outgoingPublishEntries[ MAX_OUTGOING_PUBLISHES ] = { 0 };
+static MqttInflight_t outgoingPublishes = MQTT_INFLIGHT_INITIALIZER( outgoingPublishEntries, MQTT_INFLIGHT_WINDOW );
+
+#if ( MQTT_INFLIGHT_RESEND_BUFFER_SIZE > 0 )
+
+/**
+ * @brief Where the duplicate publishes of a resend are collected, so they
+ * share TLS records.
+ */
+    static uint8_t resendBuffer[ MQTT_INFLIGHT_RESEND_BUFFER_SIZE ];
+#endif
+
+/**
+ * @brief Duplicate publishes of the last resend still waiting for a PUBACK,
+ * and when that resend started, to measure how long a reconnect takes to
+ * recover the session.
+ */
+static size_t resendPending = 0U;
+static uint32_t resendStartTimeMs = 0U;
+
+/**
+ * @brief The packet identifier of the SUBSCRIBE or UNSUBSCRIBE waiting for
+ * its acknowledgement, and whether its SUBACK refused a topic filter.
+ */
+static uint16_t pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+static bool pendingAckRefused = false;
+
+/**
+ * @brief Where the return code of each topic filter of the pending SUBSCRIBE
+ * is written, if the caller asked for them.
+ */
+static MQTTSubAckStatus_t * pPendingAckCodes = NULL;
+static size_t pendingAckCodeCount = 0U;
+
+#if MQTT_SESSION_RETAIN
+
+/**
+ * @brief The topic filters of a SUBSCRIBE that the resumed session doesn't
+ * hold yet, where each was in the caller's list, and their return codes.
+ */
+    static MQTTSubscribeInfo_t subscribeList[ MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS ];
+    static size_t subscribeListIndex[ MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS ];
+    static MQTTSubAckStatus_t subscribeListCodes[ MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS ];
+#endif
+
+#if PAYLOAD_CODEC_ENABLED
+
+/**
+ * @brief The compressed payload of each slot of #outgoingPublishEntries,
+ * kept like the slot until its PUBACK, and the search tables of the
+ * compressor.
+ */
+    static uint8_t encodedPayloads[ MAX_OUTGOING_PUBLISHES ][ PAYLOAD_CODEC_MAX_SIZE ];
+    static PayloadCodecWorkspace_t codecWorkspace;
+
+/**
+ * @brief Where a compressed incoming payload is expanded, until the callback
+ * of the application returns.
+ */
+    static uint8_t decodedPayload[ PAYLOAD_CODEC_MAX_SIZE ];
+#endif
+
+/**
+ * @brief The ALPN protocols offered, a NULL-terminated list.
+ */
+static const char * alpnProtocols[ 2 ] = { NULL, NULL };
+
+/**
+ * @brief Static buffer for TLS Context Semaphore.
+ */
+static StaticSemaphore_t tlsContextSemaphoreBuffer;
+
+/**
+ * @brief The session a handover switches to, its ALPN protocols and its
+ * TLS context semaphore.
+ */
+static MqttSessionConfig_t handoverConfig;
+static const char * handoverAlpnProtocols[ 2 ] = { NULL, NULL };
+static StaticSemaphore_t handoverSemaphoreBuffer;
+
+/**
+ * @brief Whether a handover was started, and the result of its TLS connect,
+ * written by the connect task once it completes.
+ */
+static bool handoverStarted = false;
+static bool handoverConnectDone = false;
+static TlsTransportStatus_t handoverConnectStatus = TLS_TRANSPORT_SUCCESS;
+
+/**
+ * @brief The metrics of the session.
+ */
+PERF_METRICS_COUNTER( connectAttemptsMetric, "mqtt_connect_attempts" );
+PERF_METRICS_COUNTER( sessionsResumedMetric, "mqtt_sessions_resumed" );
+PERF_METRICS_COUNTER( publishesMetric, "mqtt_publishes" );
+PERF_METRICS_COUNTER( publishesResentMetric, "mqtt_publishes_resent" );
+PERF_METRICS_COUNTER( pubackTimeoutsMetric, "mqtt_puback_timeouts" );
+PERF_METRICS_HISTOGRAM( pubackLatencyMetric, "mqtt_puback_ms", 50U, 100U, 250U, 500U, 1000U, 2500U );
+#if PAYLOAD_CODEC_ENABLED
+    PERF_METRICS_COUNTER( payloadBytesSavedMetric, "mqtt_payload_bytes_saved" );
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sets the broker, ALPN protocols and TLS context semaphore of the
+ * network context of a session.
+ *
+ * @param[in] pConfig The session.
+ * @param[in] pAlpnProtocols Where the NULL-terminated ALPN list is kept.
+ * @param[in] pSemaphoreBuffer The semaphore, if the context has none yet.
+ */
+static void initNetworkContext( const MqttSessionConfig_t * pConfig,
+                                const char ** pAlpnProtocols,
+                                StaticSemaphore_t * pSemaphoreBuffer );
+
+/**
+ * @brief Connects the TLS session, retrying with the reconnect policy.
+ *
+ * @return false once the attempts are exhausted.
+ */
+static bool connectWithRetries( void );
+
+/**
+ * @brief Sends the CONNECT of #sessionConfig over its connected TLS session,
+ * then resends the publishes in flight and drains the publish store.
+ *
+ * @param[out] pSessionPresent Whether the broker resumed the session.
+ *
+ * @return true once the session is connected, the resend is sent and the
+ * publish store is drained. #sessionEstablished is set if the CONNECT was
+ * accepted, even if the rest failed.
+ */
+static bool startSession( bool * pSessionPresent );
+
+/**
+ * @brief Completion callback of the TLS connect of a handover.
+ */
+static void handoverConnected( NetworkContext_t * pNetworkContext,
+                               TlsTransportStatus_t status,
+                               void * pContext );
+
+/**
+ * @brief Closes the session a handover switched away from.
+ *
+ * @param[in] pConfig The session.
+ * @param[in] established Whether its CONNECT was accepted.
+ */
+static void closeSession( const MqttSessionConfig_t * pConfig,
+                          bool established );
+
+#if PAYLOAD_CODEC_ENABLED
+
+/**
+ * @brief Expands a compressed incoming payload into #decodedPayload, so the
+ * application parses it as it was published.
+ *
+ * @return false if the payload is compressed and can't be expanded.
+ */
+    static bool expandPayload( MQTTPublishInfo_t * pPublishInfo );
+#endif
+
+/**
+ * @brief The event callback registered with the MQTT library. It handles the
+ * acknowledgements and passes the incoming publishes to the application.
+ */
+static void eventCallback( MQTTContext_t * pMqttContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo );
+
+/**
+ * @brief Drops the publish a PUBACK acknowledges.
+ *
+ * @param[in] packetId Packet identifier of the PUBACK.
+ */
+static void acknowledgePublish( uint16_t packetId );
+
+/**
+ * @brief Drops every publish in flight, as when the broker starts a clean
+ * session.
+ */
+static void cleanupOutgoingPublishes( void );
+
+/**
+ * @brief Resends the publishes in flight, in the order they were first sent,
+ * when the broker resumes the session.
+ *
+ * @return false if a duplicate PUBLISH couldn't be sent.
+ */
+static bool handlePublishResend( void );
+
+/**
+ * @brief Fails if the publish sent the longest ago has waited too long for its
+ * PUBACK, and runs one iteration of the process loop otherwise.
+ *
+ * @param[in] pWhat What the caller waits for, for the log.
+ *
+ * @return false if a PUBACK timed out or the process loop failed.
+ */
+static bool processWhileInflight( const char * pWhat );
+
+/**
+ * @brief Runs the process loop until the SUBSCRIBE or UNSUBSCRIBE sent with
+ * @a packetId is acknowledged.
+ *
+ * @return false if the process loop failed or the acknowledgement didn't
+ * arrive in #MQTT_SESSION_ACK_TIMEOUT_MS.
+ */
+static bool waitForAck( uint16_t packetId );
+
+#if MQTT_SESSION_RETAIN
+
+/**
+ * @brief Copies the publishes retained across deep sleep into the
+ * #outgoingPublishes table, so they are resent with the others.
+ */
+    static void restoreRetainedPublishes( void );
+#endif
+
+#if PUBLISH_STORE
+
+/**
+ * @brief Publish callback of the publish store, sending a stored publish
+ * with #MqttSession_Publish.
+ */
+    static bool publishStoredMessage( const char * pTopic,
+                                      uint16_t topicLength,
+                                      const uint8_t * pPayload,
+                                      size_t payloadLength,
+                                      void * pContext );
+
+/**
+ * @brief Publishes everything the application stored while disconnected,
+ * oldest first, running the process loop whenever every drain slot is
+ * waiting for a PUBACK.
+ *
+ * @return false if a publish, the process loop or a PUBACK failed.
+ */
+    static bool drainStoredPublishes( void );
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void initNetworkContext( const MqttSessionConfig_t * pConfig,
+                                const char ** pAlpnProtocols,
+                                StaticSemaphore_t * pSemaphoreBuffer )
+{
+    NetworkContext_t * pNetworkContext = pConfig->pNetworkContext;
+
+    pNetworkContext->pcHostname = pConfig->pHostName;
+    pNetworkContext->xPort = pConfig->port;
+    pNetworkContext->pxTls = NULL;
+    pNetworkContext->disableSni = 0;
+
+    if( pNetworkContext->xTlsContextSemaphore == NULL )
+    {
+        pNetworkContext->xTlsContextSemaphore = xSemaphoreCreateMutexStatic( pSemaphoreBuffer );
+    }
+
+    /* Please see more details about the ALPN protocol for the AWS IoT MQTT
+     * endpoint in the link below.
+     * https://aws.amazon.com/blogs/iot/mqtt-with-tls-client-authentication-on-port-443-why-it-is-useful-and-how-it-works/
+     */
+    pAlpnProtocols[ 0 ] = pConfig->pAlpnProtocol;
+    pAlpnProtocols[ 1 ] = NULL;
+    pNetworkContext->pAlpnProtos = ( pConfig->pAlpnProtocol != NULL ) ? pAlpnProtocols : NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool connectWithRetries( void )
+{
+    NetworkContext_t * pNetworkContext = sessionConfig.pNetworkContext;
+    TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
+    ReconnectPolicy_t reconnectPolicy;
+    uint32_t nextRetryBackOff = 0U;
+    bool retry = true;
+
+    initNetworkContext( &sessionConfig, alpnProtocols, &tlsContextSemaphoreBuffer );
+
+    ReconnectPolicy_Start( &reconnectPolicy,
+                           MQTT_SESSION_RETRY_BASE_MS,
+                           MQTT_SESSION_RETRY_MAX_MS,
+                           MQTT_SESSION_CONNECT_ATTEMPTS );
+
+    do
+    {
+        LogInfo( ( "Establishing a TLS session to %s:%u.",
+                   sessionConfig.pHostName,
+                   ( unsigned ) sessionConfig.port ) );
+        PERF_METRICS_ADD( connectAttemptsMetric, 1U );
+        tlsStatus = xTlsConnect( pNetworkContext );
+
+        if( tlsStatus != TLS_TRANSPORT_SUCCESS )
+        {
+            /* A refused handshake waits longer. */
+            retry = ReconnectPolicy_NextDelay( &reconnectPolicy,
+                                               ( tlsStatus == TLS_TRANSPORT_HANDSHAKE_FAILED ) ?
+                                               ReconnectFailureRefused : ReconnectFailureNetwork,
+                                               &nextRetryBackOff );
+
+            if( retry == false )
+            {
+                LogError( ( "Connection to the broker failed, all attempts exhausted." ) );
+            }
+            else
+            {
+                LogWarn( ( "Connection to the broker failed. Retrying connection "
+                           "after %u ms backoff.",
+                           ( unsigned ) nextRetryBackOff ) );
+                Clock_SleepMs( nextRetryBackOff );
+            }
+        }
+    } while( ( tlsStatus != TLS_TRANSPORT_SUCCESS ) && ( retry == true ) );
+
+    return ( tlsStatus == TLS_TRANSPORT_SUCCESS );
+}
+
+/*-----------------------------------------------------------*/
+
+#if PAYLOAD_CODEC_ENABLED
+
+    static bool expandPayload( MQTTPublishInfo_t * pPublishInfo )
+    {
+        bool status = true;
+        size_t decodedLength = 0U;
+
+        if( PayloadCodec_IsEncoded( pPublishInfo->pPayload, pPublishInfo->payloadLength ) == true )
+        {
+            status = PayloadCodec_Decode( pPublishInfo->pPayload,
+                                          pPublishInfo->payloadLength,
+                                          decodedPayload,
+                                          sizeof( decodedPayload ),
+                                          &decodedLength );
+
+            if( status == false )
+            {
+                LogError( ( "Dropped the compressed publish on topic %.*s.",
+                            pPublishInfo->topicNameLength,
+                            pPublishInfo->pTopicName ) );
+            }
+            else
+            {
+                LogDebug( ( "Expanded the publish on topic %.*s from %u to %u bytes.",
+                            pPublishInfo->topicNameLength,
+                            pPublishInfo->pTopicName,
+                            ( unsigned ) pPublishInfo->payloadLength,
+                            ( unsigned ) decodedLength ) );
+                pPublishInfo->pPayload = decodedPayload;
+                pPublishInfo->payloadLength = decodedLength;
+            }
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if PAYLOAD_CODEC_ENABLED */
+
+static void eventCallback( MQTTContext_t * pMqttContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo )
+{
+    uint16_t packetIdentifier = pDeserializedInfo->packetIdentifier;
+    uint8_t * pCodes = NULL;
+    size_t codeCount = 0U;
+    size_t i;
+
+    bool deliver = true;
+
+    assert( pMqttContext == sessionConfig.pMqttContext );
+
+    /* The lower 4 bits of the publish packet type are the dup, QoS, and
+     * retain flags. */
+    if( ( pPacketInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+    {
+        #if PAYLOAD_CODEC_ENABLED
+            deliver = expandPayload( pDeserializedInfo->pPublishInfo );
+        #endif
+
+        if( ( deliver == true ) && ( sessionConfig.publishCallback != NULL ) )
+        {
+            sessionConfig.publishCallback( pMqttContext, pPacketInfo, pDeserializedInfo );
+        }
+    }
+    else
+    {
+        switch( pPacketInfo->type )
+        {
+            case MQTT_PACKET_TYPE_SUBACK:
+                LogInfo( ( "SUBACK received for packet id %u.", packetIdentifier ) );
+
+                if( ( packetIdentifier == pendingAckPacketId ) &&
+                    ( MQTT_GetSubAckStatusCodes( pPacketInfo, &pCodes, &codeCount ) == MQTTSuccess ) )
+                {
+                    for( i = 0U; i < codeCount; i++ )
+                    {
+                        if( ( pPendingAckCodes != NULL ) && ( i < pendingAckCodeCount ) )
+                        {
+                            pPendingAckCodes[ i ] = ( MQTTSubAckStatus_t ) pCodes[ i ];
+                        }
+
+                        if( pCodes[ i ] == ( uint8_t ) MQTTSubAckFailure )
+                        {
+                            LogError( ( "The broker refused topic filter %u of the SUBSCRIBE.",
+                                        ( unsigned ) i ) );
+                            pendingAckRefused = true;
+                        }
+                    }
+                }
+
+                if( packetIdentifier == pendingAckPacketId )
+                {
+                    pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+                }
+
+                break;
+
+            case MQTT_PACKET_TYPE_UNSUBACK:
+                LogInfo( ( "UNSUBACK received for packet id %u.", packetIdentifier ) );
+
+                if( packetIdentifier == pendingAckPacketId )
+                {
+                    pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+                }
+
+                break;
+
+            case MQTT_PACKET_TYPE_PINGRESP:
+
+                /* Nothing to be done from application as library handles
+                 * PINGRESP. */
+                LogWarn( ( "PINGRESP should not be handled by the application "
+                           "callback when using MQTT_ProcessLoop." ) );
+                break;
+
+            case MQTT_PACKET_TYPE_PUBACK:
+                LogDebug( ( "PUBACK received for packet id %u.", packetIdentifier ) );
+                acknowledgePublish( packetIdentifier );
+                break;
+
+            /* Any other packet type is invalid. */
+            default:
+                LogError( ( "Unknown packet type received:(%02x).",
+                            pPacketInfo->type ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void acknowledgePublish( uint16_t packetId )
+{
+    const MqttInflightEntry_t * pEntry = MqttInflight_Find( &outgoingPublishes, packetId );
+
+    assert( packetId != MQTT_PACKET_ID_INVALID );
+
+    #if MQTT_SESSION_RETAIN
+        MqttSessionRetain_RemovePublish( packetId );
+    #endif
+
+    if( pEntry != NULL )
+    {
+        PERF_METRICS_OBSERVE( pubackLatencyMetric, Clock_GetTimeMs() - pEntry->sentTimeMs );
+
+        #if PUBLISH_STORE
+            /* Frees the slot of a publish drained from the store. */
+            ( void ) PublishStore_Release( pEntry->publishInfo.pPayload );
+        #endif
+
+        if( ( pEntry->publishInfo.dup == true ) && ( resendPending > 0U ) )
+        {
+            resendPending--;
+
+            if( resendPending == 0U )
+            {
+                LogInfo( ( "Every resent publish acknowledged %u ms after the resend started.",
+                           ( unsigned ) ( Clock_GetTimeMs() - resendStartTimeMs ) ) );
+            }
+        }
+    }
+
+    if( MqttInflight_Acknowledge( &outgoingPublishes, packetId ) == true )
+    {
+        LogDebug( ( "Cleaned up outgoing publish packet with packet id %u.",
+                    packetId ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void cleanupOutgoingPublishes( void )
+{
+    MqttInflight_Clear( &outgoingPublishes );
+    resendPending = 0U;
+
+    #if PUBLISH_STORE
+        /* Drained publishes go out again on the next drain. */
+        PublishStore_Rewind();
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+#if MQTT_SESSION_RETAIN
+
+    static void restoreRetainedPublishes( void )
+    {
+        MQTTPublishInfo_t publishInfo;
+        MqttInflightEntry_t * pEntry = NULL;
+        uint16_t packetId = MQTT_PACKET_ID_INVALID;
+        size_t retainedIndex = 0U;
+
+        for( ; retainedIndex < MQTT_SESSION_RETAIN_MAX_PUBLISHES; retainedIndex++ )
+        {
+            if( MqttSessionRetain_GetPublish( retainedIndex, &packetId, &publishInfo ) == false )
+            {
+                continue;
+            }
+
+            /* NULL if a reconnect on the same boot already holds the publish. */
+            pEntry = MqttInflight_Add( &outgoingPublishes, packetId );
+
+            if( pEntry != NULL )
+            {
+                pEntry->publishInfo = publishInfo;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if MQTT_SESSION_RETAIN */
+
+static bool handlePublishResend( void )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MqttInflightEntry_t * pEntry = NULL;
+    NetworkContext_t * pNetworkContext = sessionConfig.pNetworkContext;
+    size_t resentCount = 0U;
+    int32_t tlsStatus = 0;
+
+    resendStartTimeMs = Clock_GetTimeMs();
+
+    #if ( MQTT_INFLIGHT_RESEND_BUFFER_SIZE > 0 )
+        /* Collect the publishes and write them out together, instead of
+         * writing every packet as its own record. */
+        pNetworkContext->pucCorkBuffer = resendBuffer;
+        pNetworkContext->uxCorkBufferSize = sizeof( resendBuffer );
+        vTlsTransportCork( pNetworkContext );
+    #endif
+
+    pEntry = MqttInflight_Next( &outgoingPublishes, NULL );
+
+    while( pEntry != NULL )
+    {
+        pEntry->publishInfo.dup = true;
+        pEntry->sentTimeMs = Clock_GetTimeMs();
+
+        mqttStatus = MQTT_Publish( sessionConfig.pMqttContext,
+                                   &pEntry->publishInfo,
+                                   pEntry->packetId );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Sending duplicate PUBLISH for packet id %u "
+                        "failed with status %s.",
+                        pEntry->packetId,
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            returnStatus = false;
+            break;
+        }
+
+        LogDebug( ( "Sent duplicate PUBLISH with packet id %u.",
+                    pEntry->packetId ) );
+        resentCount++;
+        pEntry = MqttInflight_Next( &outgoingPublishes, pEntry );
+    }
+
+    /* Write out what was collected even after a failure, so a later
+     * connection doesn't find data left in the buffer. */
+    tlsStatus = lTlsTransportUncork( pNetworkContext );
+
+    if( tlsStatus != 0 )
+    {
+        LogError( ( "Writing the resent publishes failed with esp-tls error %d.",
+                    ( int ) tlsStatus ) );
+        returnStatus = false;
+    }
+
+    resendPending = resentCount;
+    PERF_METRICS_ADD( publishesResentMetric, ( uint32_t ) resentCount );
+
+    if( resentCount > 0U )
+    {
+        LogInfo( ( "Resent %u publishes in %u ms.",
+                   ( unsigned ) resentCount,
+                   ( unsigned ) ( Clock_GetTimeMs() - resendStartTimeMs ) ) );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool processWhileInflight( const char * pWhat )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MqttInflightEntry_t * pEntry = NULL;
+
+    pEntry = MqttInflight_CheckTimeout( &outgoingPublishes,
+                                        Clock_GetTimeMs(),
+                                        MQTT_INFLIGHT_ACK_TIMEOUT_MS );
+
+    if( pEntry != NULL )
+    {
+        PERF_METRICS_ADD( pubackTimeoutsMetric, 1U );
+        LogError( ( "No PUBACK for packet id %u in %u ms while waiting for %s, "
+                    "allowing %u publishes in flight.",
+                    pEntry->packetId,
+                    ( unsigned ) MQTT_INFLIGHT_ACK_TIMEOUT_MS,
+                    pWhat,
+                    ( unsigned ) MqttInflight_Window( &outgoingPublishes ) ) );
+        returnStatus = false;
+    }
+    else
+    {
+        /* A single iteration, which returns once the next packet is in or
+         * the transport receive times out. */
+        mqttStatus = MQTT_ProcessLoop( sessionConfig.pMqttContext, 0U );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "MQTT_ProcessLoop returned with status = %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            returnStatus = false;
+        }
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool waitForAck( uint16_t packetId )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    uint32_t startTimeMs = Clock_GetTimeMs();
+
+    while( ( returnStatus == true ) && ( pendingAckPacketId == packetId ) )
+    {
+        if( ( Clock_GetTimeMs() - startTimeMs ) >= MQTT_SESSION_ACK_TIMEOUT_MS )
+        {
+            LogError( ( "No acknowledgement for packet id %u in %u ms.",
+                        packetId,
+                        ( unsigned ) MQTT_SESSION_ACK_TIMEOUT_MS ) );
+            returnStatus = false;
+        }
+        else
+        {
+            mqttStatus = MQTT_ProcessLoop( sessionConfig.pMqttContext, 0U );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                LogError( ( "MQTT_ProcessLoop returned with status = %s.",
+                            MQTT_Status_strerror( mqttStatus ) ) );
+                returnStatus = false;
+            }
+        }
+    }
+
+    /* A late acknowledgement is ignored. */
+    pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+#if PUBLISH_STORE
+
+    static bool publishStoredMessage( const char * pTopic,
+                                      uint16_t topicLength,
+                                      const uint8_t * pPayload,
+                                      size_t payloadLength,
+                                      void * pContext )
+    {
+        ( void ) pContext;
+
+        return MqttSession_Publish( pTopic, topicLength, pPayload, payloadLength );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool drainStoredPublishes( void )
+    {
+        bool returnStatus = true;
+        size_t drained = 0U;
+
+        while( ( returnStatus == true ) && ( PublishStore_IsDrained() == false ) )
+        {
+            if( PublishStore_Drain( publishStoredMessage, NULL, &drained ) == false )
+            {
+                returnStatus = false;
+            }
+            else if( drained > 0U )
+            {
+                LogInfo( ( "Published %u stored publishes.", ( unsigned ) drained ) );
+            }
+            else
+            {
+                /* Every drain slot waits for a PUBACK. */
+                returnStatus = processWhileInflight( "a drain slot" );
+            }
+        }
+
+        return returnStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if PUBLISH_STORE */
+
+static bool startSession( bool * pSessionPresent )
+{
+    bool returnStatus = false;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTConnectInfo_t connectInfo;
+    TransportInterface_t transport;
+    MQTTFixedBuffer_t networkBuffer;
+    bool sessionPresent = false;
+
+    sessionEstablished = false;
+    pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+
+    ( void ) memset( sessionConfig.pMqttContext, 0x00, sizeof( MQTTContext_t ) );
+
+    #if MQTT_SESSION_RETAIN
+        ( void ) MqttSessionRetain_Init( sessionConfig.pHostName,
+                                         ( uint16_t ) strlen( sessionConfig.pHostName ),
+                                         sessionConfig.pClientIdentifier,
+                                         sessionConfig.clientIdentifierLength );
+    #endif
+
+    #if PUBLISH_STORE
+        ( void ) PublishStore_Init();
+    #endif
+
+    transport.pNetworkContext = sessionConfig.pNetworkContext;
+    transport.send = espTlsTransportSend;
+    transport.recv = espTlsTransportRecv;
+
+    networkBuffer = sessionConfig.networkBuffer;
+
+    #if BUFFER_ARENA_ENABLED
+        if( networkBuffer.pBuffer == NULL )
+        {
+            networkBuffer.pBuffer = BufferArena_Alloc( BufferArenaOwnerMqtt, networkBuffer.size );
+        }
+    #endif
+
+    if( networkBuffer.pBuffer == NULL )
+    {
+        LogError( ( "No network buffer available for the MQTT context." ) );
+    }
+    else
+    {
+        mqttStatus = MQTT_Init( sessionConfig.pMqttContext,
+                                &transport,
+                                Clock_GetTimeMs,
+                                eventCallback,
+                                &networkBuffer );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "MQTT init failed with status %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+        }
+        else
+        {
+            #if MQTT_SESSION_RETAIN
+                /* Carry on from the packet identifiers used before deep sleep. */
+                MqttSessionRetain_RestoreContext( sessionConfig.pMqttContext );
+            #endif
+
+            ( void ) memset( &connectInfo, 0x00, sizeof( connectInfo ) );
+            connectInfo.cleanSession = sessionConfig.cleanSession;
+            connectInfo.pClientIdentifier = sessionConfig.pClientIdentifier;
+            connectInfo.clientIdentifierLength = sessionConfig.clientIdentifierLength;
+            connectInfo.keepAliveSeconds = sessionConfig.keepAliveSeconds;
+            connectInfo.pUserName = sessionConfig.pUserName;
+            connectInfo.userNameLength = sessionConfig.userNameLength;
+            connectInfo.pPassword = sessionConfig.pPassword;
+            connectInfo.passwordLength = sessionConfig.passwordLength;
+
+            mqttStatus = MQTT_Connect( sessionConfig.pMqttContext,
+                                       &connectInfo,
+                                       NULL,
+                                       MQTT_SESSION_CONNACK_TIMEOUT_MS,
+                                       &sessionPresent );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                LogError( ( "Connection with MQTT broker failed with status %s.",
+                            MQTT_Status_strerror( mqttStatus ) ) );
+            }
+            else
+            {
+                LogInfo( ( "MQTT connection successfully established with broker." ) );
+                sessionEstablished = true;
+                returnStatus = true;
+            }
+        }
+    }
+
+    if( returnStatus == true )
+    {
+        if( sessionPresent == true )
+        {
+            LogInfo( ( "An MQTT session with broker is re-established. "
+                       "Resending unacked publishes." ) );
+            PERF_METRICS_ADD( sessionsResumedMetric, 1U );
+
+            #if MQTT_SESSION_RETAIN
+                restoreRetainedPublishes();
+            #endif
+
+            returnStatus = handlePublishResend();
+        }
+        else
+        {
+            LogInfo( ( "A clean MQTT connection is established."
+                       " Cleaning up all the stored outgoing publishes." ) );
+            cleanupOutgoingPublishes();
+
+            #if MQTT_SESSION_RETAIN
+                /* The broker holds no subscriptions or publishes either. */
+                MqttSessionRetain_Reset();
+            #endif
+        }
+    }
+
+    #if PUBLISH_STORE
+        if( returnStatus == true )
+        {
+            /* Send what was stored while disconnected, after the resent publishes. */
+            returnStatus = drainStoredPublishes();
+        }
+    #endif
+
+    #if BUFFER_ARENA_ENABLED
+        /* Without a session, MqttSession_Disconnect doesn't use the buffer. */
+        if( ( sessionEstablished == false ) && ( sessionConfig.networkBuffer.pBuffer == NULL ) )
+        {
+            ( void ) BufferArena_Free( BufferArenaOwnerMqtt, sessionConfig.pMqttContext->networkBuffer.pBuffer );
+            sessionConfig.pMqttContext->networkBuffer.pBuffer = NULL;
+        }
+    #endif
+
+    *pSessionPresent = sessionPresent;
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void handoverConnected( NetworkContext_t * pNetworkContext,
+                               TlsTransportStatus_t status,
+                               void * pContext )
+{
+    ( void ) pNetworkContext;
+    ( void ) pContext;
+
+    handoverConnectStatus = status;
+    __atomic_store_n( &handoverConnectDone, true, __ATOMIC_RELEASE );
+}
+
+/*-----------------------------------------------------------*/
+
+static void closeSession( const MqttSessionConfig_t * pConfig,
+                          bool established )
+{
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    if( established == true )
+    {
+        /* With the same client identifier, the broker has already closed
+         * this connection for the new one, so the DISCONNECT may not go out. */
+        mqttStatus = MQTT_Disconnect( pConfig->pMqttContext );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogDebug( ( "DISCONNECT of the previous session not sent: %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+        }
+    }
+
+    ( void ) xTlsDisconnect( pConfig->pNetworkContext );
+
+    #if BUFFER_ARENA_ENABLED
+        if( pConfig->networkBuffer.pBuffer == NULL )
+        {
+            ( void ) BufferArena_Free( BufferArenaOwnerMqtt, pConfig->pMqttContext->networkBuffer.pBuffer );
+            pConfig->pMqttContext->networkBuffer.pBuffer = NULL;
+        }
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_Connect( const MqttSessionConfig_t * pConfig,
+                          bool * pSessionPresent )
+{
+    bool returnStatus = false;
+    bool sessionPresent = false;
+
+    assert( pConfig != NULL );
+    assert( ( pConfig->pMqttContext != NULL ) && ( pConfig->pNetworkContext != NULL ) );
+    assert( pConfig->pHostName != NULL );
+
+    PERF_METRICS_REGISTER( connectAttemptsMetric );
+    PERF_METRICS_REGISTER( sessionsResumedMetric );
+    PERF_METRICS_REGISTER( publishesMetric );
+    PERF_METRICS_REGISTER( publishesResentMetric );
+    PERF_METRICS_REGISTER( pubackTimeoutsMetric );
+    PERF_METRICS_REGISTER( pubackLatencyMetric );
+    #if PAYLOAD_CODEC_ENABLED
+        PERF_METRICS_REGISTER( payloadBytesSavedMetric );
+    #endif
+
+    #if BUFFER_ARENA_ENABLED
+        /* Return a buffer left by an attempt that wasn't disconnected. */
+        if( ( sessionConfig.pMqttContext != NULL ) && ( sessionConfig.networkBuffer.pBuffer == NULL ) )
+        {
+            ( void ) BufferArena_Free( BufferArenaOwnerMqtt, sessionConfig.pMqttContext->networkBuffer.pBuffer );
+            sessionConfig.pMqttContext->networkBuffer.pBuffer = NULL;
+        }
+    #endif
+
+    sessionConfig = *pConfig;
+    sessionEstablished = false;
+
+    if( connectWithRetries() == false )
+    {
+        LogError( ( "Failed to connect to MQTT broker %s.", sessionConfig.pHostName ) );
+    }
+    else
+    {
+        returnStatus = startSession( &sessionPresent );
+    }
+
+    if( pSessionPresent != NULL )
+    {
+        *pSessionPresent = sessionPresent;
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_HandoverStart( const MqttSessionConfig_t * pConfig )
+{
+    TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
+
+    assert( pConfig != NULL );
+    assert( ( pConfig->pMqttContext != NULL ) && ( pConfig->pNetworkContext != NULL ) );
+    assert( pConfig->pHostName != NULL );
+    assert( ( pConfig->pMqttContext != sessionConfig.pMqttContext ) &&
+            ( pConfig->pNetworkContext != sessionConfig.pNetworkContext ) );
+    assert( handoverStarted == false );
+
+    handoverConfig = *pConfig;
+    initNetworkContext( &handoverConfig, handoverAlpnProtocols, &handoverSemaphoreBuffer );
+
+    handoverConnectDone = false;
+    PERF_METRICS_ADD( connectAttemptsMetric, 1U );
+    LogInfo( ( "Establishing the TLS session to hand over to in the background." ) );
+    tlsStatus = xTlsConnectAsync( handoverConfig.pNetworkContext, handoverConnected, NULL );
+
+    if( tlsStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        LogError( ( "Failed to start the TLS connect of the handover: %d.", ( int ) tlsStatus ) );
+    }
+    else
+    {
+        handoverStarted = true;
+    }
+
+    return handoverStarted;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_HandoverFinish( bool * pSessionPresent )
+{
+    bool returnStatus = false;
+    bool sessionPresent = false;
+    bool previousEstablished = sessionEstablished;
+    bool previousAlive = sessionEstablished;
+    MqttSessionConfig_t previousConfig = sessionConfig;
+
+    assert( handoverStarted == true );
+
+    /* Keep the current session serviced until the new TLS session is up. */
+    while( __atomic_load_n( &handoverConnectDone, __ATOMIC_ACQUIRE ) == false )
+    {
+        if( previousAlive == true )
+        {
+            previousAlive = MqttSession_ProcessLoop( HANDOVER_POLL_MS );
+        }
+        else
+        {
+            Clock_SleepMs( HANDOVER_POLL_MS );
+        }
+    }
+
+    handoverStarted = false;
+
+    if( handoverConnectStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        LogError( ( "TLS connect of the handover failed: %d. Keeping the current session.",
+                    ( int ) handoverConnectStatus ) );
+        ( void ) xTlsDisconnect( handoverConfig.pNetworkContext );
+    }
+    else
+    {
+        sessionConfig = handoverConfig;
+        returnStatus = startSession( &sessionPresent );
+
+        if( sessionEstablished == true )
+        {
+            /* Traffic goes to the new session from here on. */
+            closeSession( &previousConfig, previousEstablished );
+        }
+        else
+        {
+            LogError( ( "CONNECT of the handover failed. Keeping the current session." ) );
+            ( void ) xTlsDisconnect( handoverConfig.pNetworkContext );
+            sessionConfig = previousConfig;
+            sessionEstablished = previousEstablished;
+        }
+    }
+
+    if( pSessionPresent != NULL )
+    {
+        *pSessionPresent = sessionPresent;
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_Disconnect( void )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    if( sessionEstablished == true )
+    {
+        #if MQTT_SESSION_RETAIN
+            /* The broker keeps the session, so keep our side of it for the
+             * next wake from deep sleep. */
+            MqttSessionRetain_Save( sessionConfig.pMqttContext );
+        #endif
+
+        mqttStatus = MQTT_Disconnect( sessionConfig.pMqttContext );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Sending MQTT DISCONNECT failed with status %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            returnStatus = false;
+        }
+
+        sessionEstablished = false;
+    }
+
+    if( sessionConfig.pNetworkContext != NULL )
+    {
+        /* End TLS session, then close TCP connection. */
+        ( void ) xTlsDisconnect( sessionConfig.pNetworkContext );
+    }
+
+    #if BUFFER_ARENA_ENABLED
+        if( ( sessionConfig.pMqttContext != NULL ) && ( sessionConfig.networkBuffer.pBuffer == NULL ) )
+        {
+            ( void ) BufferArena_Free( BufferArenaOwnerMqtt, sessionConfig.pMqttContext->networkBuffer.pBuffer );
+            sessionConfig.pMqttContext->networkBuffer.pBuffer = NULL;
+        }
+    #endif
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_Subscribe( const MQTTSubscribeInfo_t * pSubscriptions,
+                            size_t count,
+                            MQTTSubAckStatus_t * pSubAckCodes )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    const MQTTSubscribeInfo_t * pSendList = pSubscriptions;
+    MQTTSubAckStatus_t * pSendCodes = pSubAckCodes;
+    size_t sendCount = count;
+    size_t i;
+
+    assert( ( pSubscriptions != NULL ) && ( count > 0U ) );
+
+    for( i = 0U; ( i < count ) && ( pSubAckCodes != NULL ); i++ )
+    {
+        pSubAckCodes[ i ] = MQTTSubAckFailure;
+    }
+
+    #if MQTT_SESSION_RETAIN
+        /* A list longer than the retained subscriptions is sent whole. */
+        if( count <= MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS )
+        {
+            sendCount = 0U;
+
+            for( i = 0U; i < count; i++ )
+            {
+                if( MqttSessionRetain_IsSubscribed( pSubscriptions[ i ].pTopicFilter,
+                                                    pSubscriptions[ i ].topicFilterLength ) == true )
+                {
+                    LogInfo( ( "Topic %.*s is already subscribed in the resumed session.",
+                               pSubscriptions[ i ].topicFilterLength,
+                               pSubscriptions[ i ].pTopicFilter ) );
+
+                    if( pSubAckCodes != NULL )
+                    {
+                        pSubAckCodes[ i ] = ( MQTTSubAckStatus_t ) pSubscriptions[ i ].qos;
+                    }
+                }
+                else
+                {
+                    subscribeList[ sendCount ] = pSubscriptions[ i ];
+                    subscribeListIndex[ sendCount ] = i;
+                    subscribeListCodes[ sendCount ] = MQTTSubAckFailure;
+                    sendCount++;
+                }
+            }
+
+            pSendList = subscribeList;
+            pSendCodes = subscribeListCodes;
+        }
+    #endif /* if MQTT_SESSION_RETAIN */
+
+    if( sendCount > 0U )
+    {
+        packetId = MQTT_GetPacketId( sessionConfig.pMqttContext );
+        pendingAckPacketId = packetId;
+        pendingAckRefused = false;
+        pPendingAckCodes = pSendCodes;
+        pendingAckCodeCount = sendCount;
+
+        mqttStatus = MQTT_Subscribe( sessionConfig.pMqttContext,
+                                     pSendList,
+                                     sendCount,
+                                     packetId );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Failed to send SUBSCRIBE packet to broker with error = %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+            returnStatus = false;
+        }
+        else
+        {
+            for( i = 0U; i < sendCount; i++ )
+            {
+                LogInfo( ( "SUBSCRIBE topic %.*s to broker.",
+                           pSendList[ i ].topicFilterLength,
+                           pSendList[ i ].pTopicFilter ) );
+            }
+
+            /* Publishes arriving before the SUBACK go to the application. */
+            returnStatus = ( waitForAck( packetId ) == true ) && ( pendingAckRefused == false );
+        }
+
+        /* A SUBACK arriving after a timeout must not write to the caller's codes. */
+        pPendingAckCodes = NULL;
+        pendingAckCodeCount = 0U;
+    }
+
+    #if MQTT_SESSION_RETAIN
+        if( pSendList == subscribeList )
+        {
+            /* Each filter the broker granted is remembered, even if the
+             * broker refused another filter of the list. */
+            for( i = 0U; i < sendCount; i++ )
+            {
+                if( subscribeListCodes[ i ] != MQTTSubAckFailure )
+                {
+                    MqttSessionRetain_AddSubscription( subscribeList[ i ].pTopicFilter,
+                                                       subscribeList[ i ].topicFilterLength,
+                                                       subscribeList[ i ].qos );
+                }
+
+                if( pSubAckCodes != NULL )
+                {
+                    pSubAckCodes[ subscribeListIndex[ i ] ] = subscribeListCodes[ i ];
+                }
+            }
+        }
+        else
+        {
+            for( i = 0U; ( i < count ) && ( returnStatus == true ); i++ )
+            {
+                MqttSessionRetain_AddSubscription( pSubscriptions[ i ].pTopicFilter,
+                                                   pSubscriptions[ i ].topicFilterLength,
+                                                   pSubscriptions[ i ].qos );
+            }
+        }
+    #endif /* if MQTT_SESSION_RETAIN */
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_Unsubscribe( const MQTTSubscribeInfo_t * pSubscriptions,
+                              size_t count )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    size_t i;
+
+    assert( ( pSubscriptions != NULL ) && ( count > 0U ) );
+
+    packetId = MQTT_GetPacketId( sessionConfig.pMqttContext );
+    pendingAckPacketId = packetId;
+
+    mqttStatus = MQTT_Unsubscribe( sessionConfig.pMqttContext,
+                                   pSubscriptions,
+                                   count,
+                                   packetId );
+
+    if( mqttStatus != MQTTSuccess )
+    {
+        LogError( ( "Failed to send UNSUBSCRIBE packet to broker with error = %s.",
+                    MQTT_Status_strerror( mqttStatus ) ) );
+        pendingAckPacketId = MQTT_PACKET_ID_INVALID;
+        returnStatus = false;
+    }
+    else
+    {
+        for( i = 0U; i < count; i++ )
+        {
+            LogInfo( ( "UNSUBSCRIBE sent topic %.*s to broker.",
+                       pSubscriptions[ i ].topicFilterLength,
+                       pSubscriptions[ i ].pTopicFilter ) );
+
+            #if MQTT_SESSION_RETAIN
+                MqttSessionRetain_RemoveSubscription( pSubscriptions[ i ].pTopicFilter,
+                                                      pSubscriptions[ i ].topicFilterLength );
+            #endif
+        }
+
+        returnStatus = waitForAck( packetId );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_Publish( const char * pTopic,
+                          uint16_t topicLength,
+                          const void * pPayload,
+                          size_t payloadLength )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MqttInflightEntry_t * pEntry = NULL;
+
+    #if PAYLOAD_CODEC_ENABLED
+        uint8_t * pEncodedPayload = NULL;
+        size_t encodedLength = 0U;
+    #endif
+
+    assert( ( pTopic != NULL ) && ( topicLength > 0U ) );
+
+    /* Wait for the window to let another publish out. */
+    while( ( returnStatus == true ) &&
+           ( MqttInflight_WindowOpen( &outgoingPublishes ) == false ) )
+    {
+        returnStatus = processWhileInflight( "the publish window" );
+    }
+
+    if( returnStatus == true )
+    {
+        /* The publish is kept until its PUBACK, to be resent if the
+         * connection breaks before. */
+        pEntry = MqttInflight_Add( &outgoingPublishes, MQTT_GetPacketId( sessionConfig.pMqttContext ) );
+
+        if( pEntry == NULL )
+        {
+            LogError( ( "Unable to find a free spot for outgoing PUBLISH message." ) );
+            returnStatus = false;
+        }
+    }
+
+    if( returnStatus == true )
+    {
+        LogDebug( ( "Published payload: %.*s", ( int ) payloadLength, ( const char * ) pPayload ) );
+
+        /* The entry references the topic and payload without copying them. */
+        pEntry->publishInfo.qos = MQTTQoS1;
+        pEntry->publishInfo.pTopicName = pTopic;
+        pEntry->publishInfo.topicNameLength = topicLength;
+        pEntry->publishInfo.pPayload = pPayload;
+        pEntry->publishInfo.payloadLength = payloadLength;
+        pEntry->sentTimeMs = Clock_GetTimeMs();
+
+        #if PAYLOAD_CODEC_ENABLED
+            /* The compressed payload is kept in the slot of the entry, and
+             * resent from there. */
+            pEncodedPayload = encodedPayloads[ pEntry - outgoingPublishEntries ];
+
+            if( ( PayloadCodec_ShouldEncode( pTopic, topicLength, payloadLength ) == true ) &&
+                ( PayloadCodec_Encode( &codecWorkspace, pPayload, payloadLength,
+                                       pEncodedPayload, PAYLOAD_CODEC_MAX_SIZE,
+                                       &encodedLength ) == true ) )
+            {
+                LogDebug( ( "Compressed the payload from %u to %u bytes.",
+                            ( unsigned ) payloadLength,
+                            ( unsigned ) encodedLength ) );
+                PERF_METRICS_ADD( payloadBytesSavedMetric, ( uint32_t ) ( payloadLength - encodedLength ) );
+                pEntry->publishInfo.pPayload = pEncodedPayload;
+                pEntry->publishInfo.payloadLength = encodedLength;
+            }
+        #endif /* if PAYLOAD_CODEC_ENABLED */
+
+        #if MQTT_SESSION_RETAIN
+            /* Kept until the PUBACK, so it can be resent after deep sleep. */
+            ( void ) MqttSessionRetain_AddPublish( pEntry->packetId,
+                                                   &pEntry->publishInfo );
+        #endif
+
+        ENERGY_METER_BEGIN( publishEnergy, EnergyOpPublish );
+
+        mqttStatus = MQTT_Publish( sessionConfig.pMqttContext,
+                                   &pEntry->publishInfo,
+                                   pEntry->packetId );
+
+        ENERGY_METER_END( publishEnergy, pEntry->publishInfo.payloadLength );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+
+            #if MQTT_SESSION_RETAIN
+                MqttSessionRetain_RemovePublish( pEntry->packetId );
+            #endif
+
+            ( void ) MqttInflight_Remove( &outgoingPublishes, pEntry->packetId );
+            returnStatus = false;
+        }
+        else
+        {
+            LogInfo( ( "PUBLISH sent for topic %.*s to broker with packet ID %u.",
+                       topicLength,
+                       pTopic,
+                       pEntry->packetId ) );
+            PERF_METRICS_ADD( publishesMetric, 1U );
+
+            #if ( MQTT_INFLIGHT_WINDOW == 1 )
+                /* With a window of one publish, the process loop receives the
+                 * PUBACK and any response, such as the echo of a publish to a
+                 * topic subscribed to. A larger window leaves the process loop
+                 * to the caller, so the next publish goes out without waiting
+                 * for a round trip. The publish is sent either way, and is
+                 * resent on the next connection if this loop failed. */
+                mqttStatus = MQTT_ProcessLoop( sessionConfig.pMqttContext,
+                                               MQTT_SESSION_PROCESS_LOOP_TIMEOUT_MS );
+
+                if( mqttStatus != MQTTSuccess )
+                {
+                    LogWarn( ( "MQTT_ProcessLoop returned with status = %s.",
+                               MQTT_Status_strerror( mqttStatus ) ) );
+                }
+            #endif
+        }
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSession_ProcessLoop( uint32_t timeoutMs )
+{
+    bool returnStatus = true;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    mqttStatus = MQTT_ProcessLoop( sessionConfig.pMqttContext, timeoutMs );
+
+    if( mqttStatus != MQTTSuccess )
+    {
+        LogError( ( "MQTT_ProcessLoop returned with status = %s.",
+                    MQTT_Status_strerror( mqttStatus ) ) );
+        returnStatus = false;
+    }
+
+    return returnStatus;
+}
@@ -0,0 +1,276 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_session.h
+ * @brief The MQTT session of the demos: one connection to the broker over
+ * the ESP-TLS transport, with its QoS 1 publishes tracked until their PUBACK.
+ *
+ * The session connects with the reconnect policy, resends the publishes in
+ * flight when the broker resumes the session, and waits for the SUBACK or
+ * UNSUBACK of each subscribe and unsubscribe, so a subscription is in place
+ * when the call returns. A list of topic filters is subscribed with one
+ * SUBSCRIBE packet and one round trip.
+ *
+ * The optional components are used as configured: the session is retained
+ * across deep sleep with MQTT_SESSION_RETAIN, what the application stored
+ * while disconnected is published after the resend with PUBLISH_STORE, the
+ * network buffer is borrowed from the buffer arena with BUFFER_ARENA_ENABLED
+ * when the caller doesn't provide one, and large payloads are compressed on
+ * the way out and expanded on the way in with PAYLOAD_CODEC_ENABLED. The
+ * connects, resends, PUBACK timeouts and PUBACK latency are kept as
+ * performance metrics.
+ *
+ * There is one session, owned by the task that connects it. The functions
+ * are not thread safe. A handover brings up the next session, on its own
+ * MQTT and network contexts, while the current one is still in use, and then
+ * switches to it.
+ */
+
+#ifndef MQTT_SESSION_H_
+#define MQTT_SESSION_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* ESP-TLS transport. */
+#include "network_transport.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief How many times a session tries to connect, or 0 to keep trying.
+ */
+#ifndef MQTT_SESSION_CONNECT_ATTEMPTS
+    #define MQTT_SESSION_CONNECT_ATTEMPTS    CONFIG_MQTT_SESSION_CONNECT_ATTEMPTS
+#endif
+
+/**
+ * @brief The shortest and longest delay between connection attempts.
+ */
+#ifndef MQTT_SESSION_RETRY_BASE_MS
+    #define MQTT_SESSION_RETRY_BASE_MS    CONFIG_MQTT_SESSION_RETRY_BASE_MS
+#endif
+#ifndef MQTT_SESSION_RETRY_MAX_MS
+    #define MQTT_SESSION_RETRY_MAX_MS    CONFIG_MQTT_SESSION_RETRY_MAX_MS
+#endif
+
+/**
+ * @brief How long the CONNECT waits for its CONNACK.
+ */
+#ifndef MQTT_SESSION_CONNACK_TIMEOUT_MS
+    #define MQTT_SESSION_CONNACK_TIMEOUT_MS    CONFIG_MQTT_SESSION_CONNACK_TIMEOUT_MS
+#endif
+
+/**
+ * @brief How long a subscribe or an unsubscribe waits for its acknowledgement.
+ */
+#ifndef MQTT_SESSION_ACK_TIMEOUT_MS
+    #define MQTT_SESSION_ACK_TIMEOUT_MS    CONFIG_MQTT_SESSION_ACK_TIMEOUT_MS
+#endif
+
+/**
+ * @brief How long the process loop runs by default.
+ */
+#ifndef MQTT_SESSION_PROCESS_LOOP_TIMEOUT_MS
+    #define MQTT_SESSION_PROCESS_LOOP_TIMEOUT_MS    CONFIG_MQTT_SESSION_PROCESS_LOOP_TIMEOUT_MS
+#endif
+
+/**
+ * @brief What a session connects with.
+ *
+ * The strings and buffers must stay valid until the session is disconnected.
+ */
+typedef struct MqttSessionConfig
+{
+    MQTTContext_t * pMqttContext;       /**< Where the MQTT context is kept. */
+
+    /**
+     * The network context, with the credentials of the TLS session set by
+     * the caller. The session sets the host, port and ALPN protocols.
+     */
+    NetworkContext_t * pNetworkContext;
+
+    /**
+     * The network buffer of the MQTT context. With a NULL buffer, one of
+     * #MqttSessionConfig_t.networkBuffer.size bytes is borrowed from the
+     * buffer arena until the session is disconnected.
+     */
+    MQTTFixedBuffer_t networkBuffer;
+
+    const char * pHostName;             /**< The broker. */
+    uint16_t port;                      /**< Port of the broker. */
+    const char * pAlpnProtocol;         /**< ALPN protocol offered, or NULL. */
+
+    const char * pClientIdentifier;     /**< Identifies the client to the broker. */
+    uint16_t clientIdentifierLength;    /**< Length of #MqttSessionConfig_t.pClientIdentifier. */
+    const char * pUserName;             /**< User name, such as the AWS IoT metrics string, or NULL. */
+    uint16_t userNameLength;            /**< Length of #MqttSessionConfig_t.pUserName. */
+    const char * pPassword;             /**< Password, or NULL. */
+    uint16_t passwordLength;            /**< Length of #MqttSessionConfig_t.pPassword. */
+    uint16_t keepAliveSeconds;          /**< Keep-alive interval of the connection. */
+
+    /**
+     * Whether the broker discards the session it holds for the client. With
+     * false, the publishes in flight are resent when the broker resumes it.
+     */
+    bool cleanSession;
+
+    /**
+     * Receives the incoming publishes. The session handles the
+     * acknowledgements itself.
+     */
+    MQTTEventCallback_t publishCallback;
+} MqttSessionConfig_t;
+
+/**
+ * @brief Connects to the broker, retrying with the reconnect policy until the
+ * TLS session is up, and sends the CONNECT.
+ *
+ * If the broker resumes the session, the publishes still waiting for a PUBACK
+ * are resent in the order they were first sent; otherwise they are dropped.
+ * The publish store is drained after the resend.
+ *
+ * @param[in] pConfig What to connect with. It is copied.
+ * @param[out] pSessionPresent Whether the broker resumed the session. May be
+ * NULL.
+ *
+ * @return true once the session is connected, the resend is sent and the
+ * publish store is drained.
+ */
+bool MqttSession_Connect( const MqttSessionConfig_t * pConfig,
+                          bool * pSessionPresent );
+
+/**
+ * @brief Sends the DISCONNECT if the CONNECT was accepted, then closes the
+ * TLS session. The publishes in flight are kept for the next connect.
+ *
+ * @return false if the DISCONNECT couldn't be sent.
+ */
+bool MqttSession_Disconnect( void );
+
+/**
+ * @brief Starts the TLS connect of the session to hand over to, in the
+ * background, and returns straight away. The current session stays in use
+ * until #MqttSession_HandoverFinish.
+ *
+ * The new session must have its own MQTT context, network context and
+ * network buffer, with the credentials of its TLS session set.
+ *
+ * @param[in] pConfig What to connect with. It is copied.
+ *
+ * @return false if the connect couldn't be started.
+ */
+bool MqttSession_HandoverStart( const MqttSessionConfig_t * pConfig );
+
+/**
+ * @brief Waits for the TLS connect started by #MqttSession_HandoverStart,
+ * running the process loop of the current session meanwhile, then sends the
+ * CONNECT of the new session. Once it is accepted, the session functions
+ * use the new session and the previous one is disconnected.
+ *
+ * The publishes in flight are resent as by #MqttSession_Connect; those of
+ * the previous session are dropped if the broker starts a clean session.
+ * If the TLS connect or the CONNECT fails, the previous session is kept.
+ *
+ * @param[out] pSessionPresent Whether the broker resumed the session. May be
+ * NULL.
+ *
+ * @return true once the new session is connected, the resend is sent and
+ * the publish store is drained. After false, #MqttSession_Disconnect closes
+ * whichever session is in use.
+ */
+bool MqttSession_HandoverFinish( bool * pSessionPresent );
+
+/**
+ * @brief Subscribes to a list of topic filters with one SUBSCRIBE, and runs
+ * the process loop until its SUBACK arrives.
+ *
+ * With #MQTT_SESSION_RETAIN, the topic filters the resumed session already
+ * holds aren't sent, and their return code is their QoS. No SUBSCRIBE is sent
+ * if it holds all of them.
+ *
+ * @param[in] pSubscriptions The topic filters and their QoS.
+ * @param[in] count The number of topic filters.
+ * @param[out] pSubAckCodes Where the SUBACK return code of each topic filter
+ * is written, or NULL. Filters without a return code are #MQTTSubAckFailure.
+ *
+ * @return false if the SUBSCRIBE couldn't be sent, the SUBACK didn't arrive
+ * in #MQTT_SESSION_ACK_TIMEOUT_MS or the broker refused a topic filter.
+ */
+bool MqttSession_Subscribe( const MQTTSubscribeInfo_t * pSubscriptions,
+                            size_t count,
+                            MQTTSubAckStatus_t * pSubAckCodes );
+
+/**
+ * @brief Unsubscribes from a list of topic filters with one UNSUBSCRIBE, and
+ * runs the process loop until its UNSUBACK arrives.
+ *
+ * @param[in] pSubscriptions The topic filters.
+ * @param[in] count The number of topic filters.
+ *
+ * @return false if the UNSUBSCRIBE couldn't be sent or the UNSUBACK didn't
+ * arrive in #MQTT_SESSION_ACK_TIMEOUT_MS.
+ */
+bool MqttSession_Unsubscribe( const MQTTSubscribeInfo_t * pSubscriptions,
+                              size_t count );
+
+/**
+ * @brief Publishes at QoS 1, once fewer than #MQTT_INFLIGHT_WINDOW publishes
+ * wait for a PUBACK. The publish references the topic and payload, which
+ * must stay valid until its PUBACK arrives.
+ *
+ * With a window of one publish, the process loop then runs for
+ * #MQTT_SESSION_PROCESS_LOOP_TIMEOUT_MS to receive the PUBACK and any
+ * response; with a larger one, the caller runs it.
+ *
+ * @param[in] pTopic The topic.
+ * @param[in] topicLength Length of @a pTopic.
+ * @param[in] pPayload The payload.
+ * @param[in] payloadLength Length of @a pPayload.
+ *
+ * @return false if a PUBACK timed out while waiting for the window, the
+ * process loop failed or the PUBLISH couldn't be sent.
+ */
+bool MqttSession_Publish( const char * pTopic,
+                          uint16_t topicLength,
+                          const void * pPayload,
+                          size_t payloadLength );
+
+/**
+ * @brief Runs the process loop, receiving publishes and acknowledgements and
+ * sending a PINGREQ when the keep-alive interval is due.
+ *
+ * @param[in] timeoutMs How long to run.
+ *
+ * @return false if the process loop failed.
+ */
+bool MqttSession_ProcessLoop( uint32_t timeoutMs );
+
+#endif /* ifndef MQTT_SESSION_H_ */
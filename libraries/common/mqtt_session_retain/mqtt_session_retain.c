@@ -0,0 +1,569 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_session_retain.c
+ * @brief Implementation of the MQTT session kept across deep sleep.
+ *
+ * Publishes and subscriptions are written to RTC memory as they change, so
+ * saving before sleep only records the packet identifier and marks the state
+ * valid. A reset other than a wake from deep sleep leaves the state in RTC
+ * memory but not valid, and the first #MqttSessionRetain_Init drops it.
+ *
+ * With #MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS, the subscriptions are also
+ * written to NVS each time they change, which is rare next to publishes, and
+ * the first #MqttSessionRetain_Init after such a reset reads them back.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* ESP-IDF includes. */
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "nvs.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the session retention. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "MQTT Session Retain"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "mqtt_session_retain.h"
+
+#if MQTT_SESSION_RETAIN
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Marks RTC memory holding a session, and its layout.
+ */
+    #define RETAINED_SESSION_MAGIC    ( 0x4D515352UL )
+
+/**
+ * @brief A QoS 1 publish waiting for its PUBACK.
+ */
+    typedef struct RetainedPublish
+    {
+        uint16_t packetId; /* MQTT_PACKET_ID_INVALID for a free slot. */
+        uint8_t qos;
+        bool retain;
+        uint16_t topicNameLength;
+        uint16_t payloadLength;
+
+        /* The topic name followed by the payload. */
+        uint8_t data[ MQTT_SESSION_RETAIN_PUBLISH_SIZE ];
+    } RetainedPublish_t;
+
+/**
+ * @brief A topic filter subscribed in the session.
+ */
+    typedef struct RetainedSubscription
+    {
+        uint16_t topicFilterLength; /* 0 for a free slot. */
+        uint8_t qos;
+        char topicFilter[ MQTT_SESSION_RETAIN_TOPIC_FILTER_SIZE ];
+    } RetainedSubscription_t;
+
+/**
+ * @brief Everything kept across deep sleep.
+ */
+    typedef struct RetainedSession
+    {
+        uint32_t magic;
+        uint32_t sessionHash; /* The endpoint and client identifier. */
+        uint16_t nextPacketId;
+        bool saved;
+        RetainedPublish_t publishes[ MQTT_SESSION_RETAIN_MAX_PUBLISHES ];
+        RetainedSubscription_t subscriptions[ MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS ];
+    } RetainedSession_t;
+
+/**
+ * @brief The session, in RTC slow memory.
+ */
+    static RTC_DATA_ATTR RetainedSession_t retainedSession;
+
+    #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+
+/**
+ * @brief The NVS key of the subscriptions.
+ */
+        #define SUBSCRIPTIONS_NVS_KEY    "subscriptions"
+
+/**
+ * @brief The subscriptions as written to NVS.
+ */
+        typedef struct StoredSubscriptions
+        {
+            uint32_t magic;
+            uint32_t sessionHash;
+            RetainedSubscription_t subscriptions[ MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS ];
+        } StoredSubscriptions_t;
+    #endif
+
+/**
+ * @brief Whether #MqttSessionRetain_Init has checked the state since boot.
+ */
+    static bool initialized = false;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief FNV-1a over the endpoint and client identifier.
+ */
+    static uint32_t sessionHash( const char * pBrokerEndpoint,
+                                 uint16_t brokerEndpointLength,
+                                 const char * pClientIdentifier,
+                                 uint16_t clientIdentifierLength );
+
+/**
+ * @brief The slot of a subscribed topic filter, or NULL.
+ */
+    static RetainedSubscription_t * findSubscription( const char * pTopicFilter,
+                                                      uint16_t topicFilterLength );
+
+    #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+
+/**
+ * @brief Writes the subscriptions to NVS.
+ */
+        static void saveSubscriptions( void );
+
+/**
+ * @brief Reads the subscriptions of the session with the hash @a hash from
+ * NVS.
+ *
+ * @return The number of subscriptions read.
+ */
+        static size_t loadSubscriptions( uint32_t hash );
+    #endif
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t sessionHash( const char * pBrokerEndpoint,
+                                 uint16_t brokerEndpointLength,
+                                 const char * pClientIdentifier,
+                                 uint16_t clientIdentifierLength )
+    {
+        uint32_t hash = 2166136261UL;
+        uint16_t i;
+
+        for( i = 0; i < brokerEndpointLength; i++ )
+        {
+            hash = ( hash ^ ( uint8_t ) pBrokerEndpoint[ i ] ) * 16777619UL;
+        }
+
+        /* A separator, so bytes moved from one string to the other change the hash. */
+        hash *= 16777619UL;
+
+        for( i = 0; i < clientIdentifierLength; i++ )
+        {
+            hash = ( hash ^ ( uint8_t ) pClientIdentifier[ i ] ) * 16777619UL;
+        }
+
+        return hash;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static RetainedSubscription_t * findSubscription( const char * pTopicFilter,
+                                                      uint16_t topicFilterLength )
+    {
+        RetainedSubscription_t * pSubscription = NULL;
+        size_t i;
+
+        for( i = 0; i < MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS; i++ )
+        {
+            if( ( retainedSession.subscriptions[ i ].topicFilterLength == topicFilterLength ) &&
+                ( memcmp( retainedSession.subscriptions[ i ].topicFilter, pTopicFilter, topicFilterLength ) == 0 ) )
+            {
+                pSubscription = &retainedSession.subscriptions[ i ];
+                break;
+            }
+        }
+
+        return pSubscription;
+    }
+
+/*-----------------------------------------------------------*/
+
+    #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+
+        static void saveSubscriptions( void )
+        {
+            StoredSubscriptions_t stored;
+            nvs_handle_t handle;
+            esp_err_t err = ESP_OK;
+
+            stored.magic = RETAINED_SESSION_MAGIC;
+            stored.sessionHash = retainedSession.sessionHash;
+            ( void ) memcpy( stored.subscriptions, retainedSession.subscriptions, sizeof( stored.subscriptions ) );
+
+            err = nvs_open( MQTT_SESSION_RETAIN_NVS_NAMESPACE, NVS_READWRITE, &handle );
+
+            if( err == ESP_OK )
+            {
+                err = nvs_set_blob( handle, SUBSCRIPTIONS_NVS_KEY, &stored, sizeof( stored ) );
+
+                if( err == ESP_OK )
+                {
+                    err = nvs_commit( handle );
+                }
+
+                nvs_close( handle );
+            }
+
+            if( err != ESP_OK )
+            {
+                LogError( ( "Failed to save the subscriptions to NVS: %s.", esp_err_to_name( err ) ) );
+            }
+        }
+
+/*-----------------------------------------------------------*/
+
+        static size_t loadSubscriptions( uint32_t hash )
+        {
+            StoredSubscriptions_t stored;
+            nvs_handle_t handle;
+            size_t length = sizeof( stored );
+            size_t count = 0U;
+            size_t i;
+            bool loaded = false;
+
+            if( nvs_open( MQTT_SESSION_RETAIN_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK )
+            {
+                /* A blob of another size was written with another configuration. */
+                loaded = ( nvs_get_blob( handle, SUBSCRIPTIONS_NVS_KEY, &stored, &length ) == ESP_OK ) &&
+                         ( length == sizeof( stored ) ) &&
+                         ( stored.magic == RETAINED_SESSION_MAGIC ) &&
+                         ( stored.sessionHash == hash );
+                nvs_close( handle );
+            }
+
+            for( i = 0; ( i < MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS ) && ( loaded == true ); i++ )
+            {
+                if( stored.subscriptions[ i ].topicFilterLength <= MQTT_SESSION_RETAIN_TOPIC_FILTER_SIZE )
+                {
+                    retainedSession.subscriptions[ i ] = stored.subscriptions[ i ];
+                    count += ( stored.subscriptions[ i ].topicFilterLength > 0U ) ? 1U : 0U;
+                }
+            }
+
+            return count;
+        }
+
+    #endif /* if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS */
+
+/*-----------------------------------------------------------*/
+
+    bool MqttSessionRetain_Init( const char * pBrokerEndpoint,
+                                 uint16_t brokerEndpointLength,
+                                 const char * pClientIdentifier,
+                                 uint16_t clientIdentifierLength )
+    {
+        uint32_t hash = sessionHash( pBrokerEndpoint, brokerEndpointLength,
+                                     pClientIdentifier, clientIdentifierLength );
+        bool kept = false;
+
+        if( initialized == false )
+        {
+            kept = ( esp_reset_reason() == ESP_RST_DEEPSLEEP ) &&
+                   ( retainedSession.magic == RETAINED_SESSION_MAGIC ) &&
+                   ( retainedSession.sessionHash == hash ) &&
+                   ( retainedSession.saved == true );
+
+            if( kept == true )
+            {
+                LogInfo( ( "Resuming the MQTT session retained across deep sleep." ) );
+            }
+        }
+        else
+        {
+            /* A reconnect on the same boot keeps the state it built. */
+            kept = ( retainedSession.sessionHash == hash );
+        }
+
+        if( kept == false )
+        {
+            ( void ) memset( &retainedSession, 0x00, sizeof( retainedSession ) );
+            retainedSession.magic = RETAINED_SESSION_MAGIC;
+            retainedSession.sessionHash = hash;
+
+            #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+                /* The broker may still hold the session of the last boot. The
+                 * CONNACK tells, and drops these if it doesn't. */
+                if( initialized == false )
+                {
+                    size_t restored = loadSubscriptions( hash );
+
+                    if( restored > 0U )
+                    {
+                        LogInfo( ( "Restored %u subscriptions of the MQTT session from NVS.",
+                                   ( unsigned ) restored ) );
+                    }
+                }
+            #endif
+        }
+
+        /* Valid again only once saved before the next sleep. */
+        retainedSession.saved = false;
+        initialized = true;
+
+        return kept;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttSessionRetain_RestoreContext( MQTTContext_t * pContext )
+    {
+        assert( pContext != NULL );
+
+        if( retainedSession.nextPacketId != MQTT_PACKET_ID_INVALID )
+        {
+            pContext->nextPacketId = retainedSession.nextPacketId;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttSessionRetain_Reset( void )
+    {
+        #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+            size_t i;
+            bool subscribed = false;
+
+            for( i = 0; i < MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS; i++ )
+            {
+                subscribed = subscribed || ( retainedSession.subscriptions[ i ].topicFilterLength > 0U );
+            }
+        #endif
+
+        ( void ) memset( retainedSession.publishes, 0x00, sizeof( retainedSession.publishes ) );
+        ( void ) memset( retainedSession.subscriptions, 0x00, sizeof( retainedSession.subscriptions ) );
+
+        #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+            /* Only written when there was something to drop, for the flash. */
+            if( subscribed == true )
+            {
+                saveSubscriptions();
+            }
+        #endif
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttSessionRetain_Save( const MQTTContext_t * pContext )
+    {
+        assert( pContext != NULL );
+        assert( initialized == true );
+
+        retainedSession.nextPacketId = pContext->nextPacketId;
+        retainedSession.saved = true;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool MqttSessionRetain_AddPublish( uint16_t packetId,
+                                       const MQTTPublishInfo_t * pPublishInfo )
+    {
+        RetainedPublish_t * pPublish = NULL;
+        size_t i;
+
+        assert( pPublishInfo != NULL );
+        assert( packetId != MQTT_PACKET_ID_INVALID );
+
+        for( i = 0; i < MQTT_SESSION_RETAIN_MAX_PUBLISHES; i++ )
+        {
+            if( retainedSession.publishes[ i ].packetId == MQTT_PACKET_ID_INVALID )
+            {
+                pPublish = &retainedSession.publishes[ i ];
+                break;
+            }
+        }
+
+        if( pPublish == NULL )
+        {
+            LogWarn( ( "No free slot to retain the publish with packet ID %u.", packetId ) );
+        }
+        else if( ( ( size_t ) pPublishInfo->topicNameLength + pPublishInfo->payloadLength ) >
+                 sizeof( pPublish->data ) )
+        {
+            LogWarn( ( "Publish with packet ID %u doesn't fit in %u bytes of RTC memory.",
+                       packetId, ( unsigned ) sizeof( pPublish->data ) ) );
+            pPublish = NULL;
+        }
+        else
+        {
+            ( void ) memcpy( pPublish->data, pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
+            ( void ) memcpy( &pPublish->data[ pPublishInfo->topicNameLength ],
+                             pPublishInfo->pPayload, pPublishInfo->payloadLength );
+            pPublish->qos = ( uint8_t ) pPublishInfo->qos;
+            pPublish->retain = pPublishInfo->retain;
+            pPublish->topicNameLength = pPublishInfo->topicNameLength;
+            pPublish->payloadLength = ( uint16_t ) pPublishInfo->payloadLength;
+
+            /* Set last, so a slot is never in use before it is complete. */
+            pPublish->packetId = packetId;
+        }
+
+        return ( pPublish != NULL );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttSessionRetain_RemovePublish( uint16_t packetId )
+    {
+        size_t i;
+
+        for( i = 0; i < MQTT_SESSION_RETAIN_MAX_PUBLISHES; i++ )
+        {
+            if( retainedSession.publishes[ i ].packetId == packetId )
+            {
+                retainedSession.publishes[ i ].packetId = MQTT_PACKET_ID_INVALID;
+                break;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool MqttSessionRetain_GetPublish( size_t index,
+                                       uint16_t * pPacketId,
+                                       MQTTPublishInfo_t * pPublishInfo )
+    {
+        const RetainedPublish_t * pPublish = NULL;
+        bool found = false;
+
+        assert( index < MQTT_SESSION_RETAIN_MAX_PUBLISHES );
+        assert( pPacketId != NULL );
+        assert( pPublishInfo != NULL );
+
+        pPublish = &retainedSession.publishes[ index ];
+
+        if( pPublish->packetId != MQTT_PACKET_ID_INVALID )
+        {
+            ( void ) memset( pPublishInfo, 0x00, sizeof( MQTTPublishInfo_t ) );
+            pPublishInfo->qos = ( MQTTQoS_t ) pPublish->qos;
+            pPublishInfo->retain = pPublish->retain;
+            pPublishInfo->pTopicName = ( const char * ) pPublish->data;
+            pPublishInfo->topicNameLength = pPublish->topicNameLength;
+            pPublishInfo->pPayload = &pPublish->data[ pPublish->topicNameLength ];
+            pPublishInfo->payloadLength = pPublish->payloadLength;
+            *pPacketId = pPublish->packetId;
+            found = true;
+        }
+
+        return found;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttSessionRetain_AddSubscription( const char * pTopicFilter,
+                                            uint16_t topicFilterLength,
+                                            MQTTQoS_t qos )
+    {
+        RetainedSubscription_t * pSubscription = NULL;
+        size_t i;
+
+        assert( pTopicFilter != NULL );
+
+        if( ( topicFilterLength == 0U ) || ( topicFilterLength > MQTT_SESSION_RETAIN_TOPIC_FILTER_SIZE ) )
+        {
+            /* Subscribed again after every wake. */
+        }
+        else if( ( pSubscription = findSubscription( pTopicFilter, topicFilterLength ) ) != NULL )
+        {
+            #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+                if( pSubscription->qos != ( uint8_t ) qos )
+                {
+                    pSubscription->qos = ( uint8_t ) qos;
+                    saveSubscriptions();
+                }
+            #else
+                pSubscription->qos = ( uint8_t ) qos;
+            #endif
+        }
+        else
+        {
+            for( i = 0; i < MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS; i++ )
+            {
+                if( retainedSession.subscriptions[ i ].topicFilterLength == 0U )
+                {
+                    pSubscription = &retainedSession.subscriptions[ i ];
+                    ( void ) memcpy( pSubscription->topicFilter, pTopicFilter, topicFilterLength );
+                    pSubscription->qos = ( uint8_t ) qos;
+                    pSubscription->topicFilterLength = topicFilterLength;
+                    break;
+                }
+            }
+
+            if( pSubscription == NULL )
+            {
+                LogWarn( ( "No free slot to retain the subscription to %.*s.",
+                           topicFilterLength, pTopicFilter ) );
+            }
+
+            #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+                else
+                {
+                    saveSubscriptions();
+                }
+            #endif
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void MqttSessionRetain_RemoveSubscription( const char * pTopicFilter,
+                                               uint16_t topicFilterLength )
+    {
+        RetainedSubscription_t * pSubscription = findSubscription( pTopicFilter, topicFilterLength );
+
+        if( pSubscription != NULL )
+        {
+            pSubscription->topicFilterLength = 0U;
+
+            #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+                saveSubscriptions();
+            #endif
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool MqttSessionRetain_IsSubscribed( const char * pTopicFilter,
+                                         uint16_t topicFilterLength )
+    {
+        return ( topicFilterLength > 0U ) &&
+               ( findSubscription( pTopicFilter, topicFilterLength ) != NULL );
+    }
+
+#endif /* if MQTT_SESSION_RETAIN */
@@ -0,0 +1,223 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file mqtt_session_retain.h
+ * @brief Keep the client side of a persistent MQTT session across deep sleep.
+ *
+ * The broker keeps a session for a client that connects without a clean
+ * session: its subscriptions and the QoS 1 messages in flight. Everything the
+ * client must hold to resume that session after deep sleep lives in RTC slow
+ * memory: the next packet identifier, the QoS 1 publishes not yet
+ * acknowledged, copied with their topic and payload, and the topic filters
+ * subscribed. The TLS session ticket is kept by the transport when
+ * CONFIG_CORE_MQTT_TRANSPORT_SESSION_RTC_RETAIN is enabled.
+ *
+ * The state is kept only when the device wakes from deep sleep, for the same
+ * endpoint and client identifier, and only if #MqttSessionRetain_Save ran
+ * before the device went to sleep. With
+ * #MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS, the subscriptions are also restored
+ * from NVS after any other reset. The functions are not thread safe and are
+ * called from the task that owns the MQTT context.
+ */
+
+#ifndef MQTT_SESSION_RETAIN_H_
+#define MQTT_SESSION_RETAIN_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the MQTT session is retained across deep sleep.
+ */
+#ifndef MQTT_SESSION_RETAIN
+    #define MQTT_SESSION_RETAIN    CONFIG_MQTT_SESSION_RETAIN
+#endif
+
+#if MQTT_SESSION_RETAIN
+
+/**
+ * @brief The number of unacknowledged publishes retained.
+ */
+    #ifndef MQTT_SESSION_RETAIN_MAX_PUBLISHES
+        #define MQTT_SESSION_RETAIN_MAX_PUBLISHES    CONFIG_MQTT_SESSION_RETAIN_MAX_PUBLISHES
+    #endif
+
+/**
+ * @brief The bytes of topic name and payload retained for each publish.
+ */
+    #ifndef MQTT_SESSION_RETAIN_PUBLISH_SIZE
+        #define MQTT_SESSION_RETAIN_PUBLISH_SIZE    CONFIG_MQTT_SESSION_RETAIN_PUBLISH_SIZE
+    #endif
+
+/**
+ * @brief The number of subscribed topic filters retained.
+ */
+    #ifndef MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS
+        #define MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS    CONFIG_MQTT_SESSION_RETAIN_MAX_SUBSCRIPTIONS
+    #endif
+
+/**
+ * @brief The longest topic filter retained.
+ */
+    #ifndef MQTT_SESSION_RETAIN_TOPIC_FILTER_SIZE
+        #define MQTT_SESSION_RETAIN_TOPIC_FILTER_SIZE    CONFIG_MQTT_SESSION_RETAIN_TOPIC_FILTER_SIZE
+    #endif
+
+/**
+ * @brief Whether the subscriptions are also kept in NVS, for a session
+ * resumed after a reset that loses RTC memory.
+ */
+    #ifndef MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+        #define MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS    CONFIG_MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+    #endif
+
+    #if MQTT_SESSION_RETAIN_SUBSCRIPTIONS_NVS
+
+/**
+ * @brief The NVS namespace of the retained subscriptions.
+ */
+        #ifndef MQTT_SESSION_RETAIN_NVS_NAMESPACE
+            #define MQTT_SESSION_RETAIN_NVS_NAMESPACE    CONFIG_MQTT_SESSION_RETAIN_NVS_NAMESPACE
+        #endif
+    #endif
+
+/**
+ * @brief Keeps the retained state if the device woke from deep sleep with
+ * state saved for this endpoint and client identifier, and drops it
+ * otherwise, keeping only the subscriptions found in NVS for them. Only the
+ * first call after boot checks; later calls, such as on a reconnect, keep the
+ * state as it is.
+ *
+ * @param[in] pBrokerEndpoint The host name of the broker.
+ * @param[in] brokerEndpointLength The length of @a pBrokerEndpoint.
+ * @param[in] pClientIdentifier The client identifier of the session.
+ * @param[in] clientIdentifierLength The length of @a pClientIdentifier.
+ *
+ * @return true if state from before deep sleep was kept.
+ */
+bool MqttSessionRetain_Init( const char * pBrokerEndpoint,
+                             uint16_t brokerEndpointLength,
+                             const char * pClientIdentifier,
+                             uint16_t clientIdentifierLength );
+
+/**
+ * @brief Continues the packet identifiers of the retained session, to be
+ * called after MQTT_Init, so a new packet never reuses the identifier of a
+ * publish the broker still holds.
+ *
+ * @param[in] pContext The initialized MQTT context.
+ */
+void MqttSessionRetain_RestoreContext( MQTTContext_t * pContext );
+
+/**
+ * @brief Drops the retained publishes and subscriptions, to be called when the
+ * CONNACK reports that the broker has no session.
+ */
+void MqttSessionRetain_Reset( void );
+
+/**
+ * @brief Records the state that isn't tracked as it changes and marks the
+ * retained state valid for the next wake. Call before DISCONNECT and deep
+ * sleep.
+ *
+ * @param[in] pContext The connected MQTT context.
+ */
+void MqttSessionRetain_Save( const MQTTContext_t * pContext );
+
+/**
+ * @brief Copies a QoS 1 publish into RTC memory until it is acknowledged.
+ *
+ * @param[in] packetId The packet identifier the publish is sent with.
+ * @param[in] pPublishInfo The publish.
+ *
+ * @return false if no slot was free or the topic and payload don't fit, in
+ * which case the publish isn't resent after waking.
+ */
+bool MqttSessionRetain_AddPublish( uint16_t packetId,
+                                   const MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Drops a retained publish once it is acknowledged or given up.
+ *
+ * @param[in] packetId The packet identifier of the publish.
+ */
+void MqttSessionRetain_RemovePublish( uint16_t packetId );
+
+/**
+ * @brief Gets a retained publish, to be resent once the session is resumed.
+ *
+ * @param[in] index The slot, from 0 to #MQTT_SESSION_RETAIN_MAX_PUBLISHES - 1.
+ * @param[out] pPacketId The packet identifier of the publish.
+ * @param[out] pPublishInfo The publish. Its topic name and payload point into
+ * RTC memory and stay valid until the publish is removed.
+ *
+ * @return false if the slot holds no publish.
+ */
+bool MqttSessionRetain_GetPublish( size_t index,
+                                   uint16_t * pPacketId,
+                                   MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Records a topic filter the broker accepted a subscription to.
+ *
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ * @param[in] qos The QoS of the subscription.
+ */
+void MqttSessionRetain_AddSubscription( const char * pTopicFilter,
+                                        uint16_t topicFilterLength,
+                                        MQTTQoS_t qos );
+
+/**
+ * @brief Forgets a topic filter once it is unsubscribed.
+ *
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ */
+void MqttSessionRetain_RemoveSubscription( const char * pTopicFilter,
+                                           uint16_t topicFilterLength );
+
+/**
+ * @brief Whether the session already holds a subscription to a topic filter,
+ * so the SUBSCRIBE can be skipped.
+ *
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ *
+ * @return true if the filter is subscribed in the retained session.
+ */
+bool MqttSessionRetain_IsSubscribed( const char * pTopicFilter,
+                                     uint16_t topicFilterLength );
+
+#endif /* if MQTT_SESSION_RETAIN */
+
+#endif /* ifndef MQTT_SESSION_RETAIN_H_ */
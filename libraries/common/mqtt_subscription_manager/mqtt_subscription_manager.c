@@ -0,0 +1,1160 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202103.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mqtt_subscription_manager.c
+ * @brief Implementation of the API of a subscription manager for handling subscription callbacks
+ * to topic filters in MQTT operations.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/* Include header for the subscription manager. */
+#include "mqtt_subscription_manager.h"
+
+/* Include trace spans. */
+#include "trace_span.h"
+
+#if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+    /* FreeRTOS includes. */
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/queue.h"
+    #include "freertos/semphr.h"
+    #include "freertos/task.h"
+
+    #define WORKER_COUNT          CONFIG_MQTT_SUBSCRIPTION_MANAGER_WORKER_COUNT
+    #define WORKER_STACK_SIZE     CONFIG_MQTT_SUBSCRIPTION_MANAGER_WORKER_STACK_SIZE
+    #define WORKER_PRIORITY       CONFIG_MQTT_SUBSCRIPTION_MANAGER_WORKER_PRIORITY
+    #define WORKER_CORE           CONFIG_MQTT_SUBSCRIPTION_MANAGER_WORKER_CORE
+    #define BUFFER_COUNT          CONFIG_MQTT_SUBSCRIPTION_MANAGER_BUFFER_COUNT
+    #define BUFFER_SIZE           CONFIG_MQTT_SUBSCRIPTION_MANAGER_BUFFER_SIZE
+    #define OVERFLOW_BLOCK        CONFIG_MQTT_SUBSCRIPTION_MANAGER_OVERFLOW_BLOCK
+    #define OVERFLOW_INLINE       CONFIG_MQTT_SUBSCRIPTION_MANAGER_OVERFLOW_INLINE
+
+    #if OVERFLOW_BLOCK
+        #define BLOCK_TIMEOUT_MS    CONFIG_MQTT_SUBSCRIPTION_MANAGER_BLOCK_TIMEOUT_MS
+    #endif
+
+    #if WORKER_CORE < 0
+        #define WORKER_AFFINITY    tskNO_AFFINITY
+    #else
+        #define WORKER_AFFINITY    WORKER_CORE
+    #endif
+#endif /* if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH */
+
+/**
+ * @brief The most callbacks collected for one message when matching and
+ * invoking are separated.
+ */
+#ifndef MAX_MATCHED_CALLBACKS
+    #define MAX_MATCHED_CALLBACKS    MAX_SUBSCRIPTION_CALLBACK_RECORDS
+#endif
+
+/**
+ * @brief Callbacks matched for one message, copied out of the trie so they can
+ * be invoked without holding the registry lock.
+ */
+typedef struct MatchedCallbacks
+{
+    size_t count;
+    SubscriptionManagerRecord_t records[ MAX_MATCHED_CALLBACKS ];
+} MatchedCallbacks_t;
+
+/**
+ * @brief The internal node pool used when #SubscriptionManager_Init is not called.
+ */
+static SubscriptionManagerNode_t defaultNodePool[ MAX_SUBSCRIPTION_TRIE_NODES ];
+
+/**
+ * @brief The internal record pool used when #SubscriptionManager_Init is not called.
+ */
+static SubscriptionManagerRecord_t defaultRecordPool[ MAX_SUBSCRIPTION_CALLBACK_RECORDS ];
+
+/**
+ * @brief The root of the topic trie. It stands for the empty prefix and is not
+ * taken from the node pool.
+ */
+static SubscriptionManagerNode_t rootNode = { 0 };
+
+/**
+ * @brief Free nodes of the pool, linked through pNextSibling.
+ */
+static SubscriptionManagerNode_t * pFreeNodes = NULL;
+
+/**
+ * @brief Free records of the pool, linked through pNext.
+ */
+static SubscriptionManagerRecord_t * pFreeRecords = NULL;
+
+/**
+ * @brief Whether a node pool has been set up.
+ */
+static bool isInitialized = false;
+
+#if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+
+/**
+ * @brief A copy of an incoming PUBLISH waiting for a worker task.
+ */
+    typedef struct DeferredPublish
+    {
+        MQTTContext_t * pContext;
+        MQTTPublishInfo_t publishInfo;
+        uint8_t data[ BUFFER_SIZE ]; /* Topic name followed by payload. */
+    } DeferredPublish_t;
+
+/**
+ * @brief Buffers for deferred messages.
+ */
+    static DeferredPublish_t deferredPublishes[ BUFFER_COUNT ];
+
+/**
+ * @brief Free buffers, as pointers into #deferredPublishes.
+ */
+    static QueueHandle_t freeBufferQueue = NULL;
+
+/**
+ * @brief Buffers waiting for a worker task.
+ */
+    static QueueHandle_t dispatchQueue = NULL;
+
+/**
+ * @brief Serializes changes to the trie with the tasks reading it. Created
+ * with the worker tasks; until then only one task may use the registry.
+ */
+    static SemaphoreHandle_t registryMutex = NULL;
+
+/**
+ * @brief Whether the worker tasks are running.
+ */
+    static bool workersStarted = false;
+
+/**
+ * @brief Counters of the deferred dispatch path.
+ */
+    static SubscriptionManagerDispatchStats_t dispatchStats = { 0 };
+
+#endif /* if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take the registry lock, if there is one.
+ */
+static void lockRegistry( void );
+
+/**
+ * @brief Release the registry lock, if there is one.
+ */
+static void unlockRegistry( void );
+
+/**
+ * @brief Reset the trie and link the nodes and records of the pools into the
+ * free lists.
+ *
+ * @param[in] pNodePool The nodes to build the topic trie from.
+ * @param[in] nodeCount The number of nodes in @a pNodePool.
+ * @param[in] pRecordPool The records to hold the registered callbacks.
+ * @param[in] recordCount The number of records in @a pRecordPool.
+ */
+static void resetPools( SubscriptionManagerNode_t * pNodePool,
+                        size_t nodeCount,
+                        SubscriptionManagerRecord_t * pRecordPool,
+                        size_t recordCount );
+
+/**
+ * @brief Set up the internal pools if the application has not provided its own.
+ */
+static void initializeDefaultPool( void );
+
+/**
+ * @brief Find the end of the topic level starting at @a levelStart.
+ *
+ * @param[in] pString The topic name or topic filter.
+ * @param[in] stringLength The length of @a pString.
+ * @param[in] levelStart The offset of the first character of the level.
+ *
+ * @return The offset of the '/' ending the level, or @a stringLength.
+ */
+static size_t findLevelEnd( const char * pString,
+                            size_t stringLength,
+                            size_t levelStart );
+
+/**
+ * @brief Check that wildcards in a topic filter occupy whole levels and that
+ * a multi-level wildcard is only used as the last level.
+ *
+ * @param[in] pTopicFilter The topic filter to check.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ *
+ * @return true if the topic filter is valid; false otherwise.
+ */
+static bool isValidTopicFilter( const char * pTopicFilter,
+                                uint16_t topicFilterLength );
+
+/**
+ * @brief Find the literal child of a node for a topic level.
+ *
+ * @param[in] pNode The parent node.
+ * @param[in] pLevel The topic level to look for.
+ * @param[in] levelLength The length of @a pLevel.
+ *
+ * @return The child node, or NULL if there is none.
+ */
+static SubscriptionManagerNode_t * findLiteralChild( const SubscriptionManagerNode_t * pNode,
+                                                     const char * pLevel,
+                                                     size_t levelLength );
+
+/**
+ * @brief Find the node for a topic filter in the trie.
+ *
+ * @param[in] pTopicFilter The topic filter to look for.
+ * @param[in] topicFilterLength The length of @a pTopicFilter.
+ *
+ * @return The node the topic filter ends at, or NULL if the trie has no such node.
+ */
+static SubscriptionManagerNode_t * findNode( const char * pTopicFilter,
+                                             uint16_t topicFilterLength );
+
+/**
+ * @brief Check whether a node has no callbacks and no children.
+ *
+ * @param[in] pNode The node to check.
+ *
+ * @return true if the node is unused; false otherwise.
+ */
+static bool isUnusedNode( const SubscriptionManagerNode_t * pNode );
+
+/**
+ * @brief Return nodes that no longer lead to a callback to the pool, starting
+ * at @a pNode and moving towards the root.
+ *
+ * @param[in] pNode The deepest node to consider.
+ *
+ * @return The deepest node of the branch that is still in use.
+ */
+static SubscriptionManagerNode_t * pruneBranch( SubscriptionManagerNode_t * pNode );
+
+/**
+ * @brief Re-point the nodes from @a pNode to the root at a topic filter that
+ * is still registered, after callbacks below them have been removed.
+ *
+ * @param[in] pNode The deepest node to consider.
+ */
+static void rebindBranch( SubscriptionManagerNode_t * pNode );
+
+/**
+ * @brief Invoke the callbacks of a node, if it has any, or add them to
+ * @a pMatches.
+ *
+ * @param[in] pNode The node whose topic filter matched.
+ * @param[in] pContext The context associated with the MQTT connection.
+ * @param[in] pPublishInfo The incoming PUBLISH message information.
+ * @param[in,out] pMatches Where to collect the callbacks, or NULL to invoke
+ * them right away.
+ */
+static void invokeCallback( const SubscriptionManagerNode_t * pNode,
+                            MQTTContext_t * pContext,
+                            MQTTPublishInfo_t * pPublishInfo,
+                            MatchedCallbacks_t * pMatches );
+
+/**
+ * @brief Match the topic name, from the level starting at @a levelStart,
+ * against the subtree below @a pNode and invoke the matching callbacks.
+ *
+ * @param[in] pNode The node that matched the topic levels before @a levelStart.
+ * @param[in] levelStart The offset of the next topic level in the topic name,
+ * or an offset past the end of the topic name if all levels have been matched.
+ * @param[in] pContext The context associated with the MQTT connection.
+ * @param[in] pPublishInfo The incoming PUBLISH message information.
+ * @param[in,out] pMatches Where to collect the callbacks, or NULL to invoke
+ * them right away.
+ */
+static void dispatchFromNode( const SubscriptionManagerNode_t * pNode,
+                              size_t levelStart,
+                              MQTTContext_t * pContext,
+                              MQTTPublishInfo_t * pPublishInfo,
+                              MatchedCallbacks_t * pMatches );
+
+#if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+
+/**
+ * @brief Match a message against the trie under the registry lock, then
+ * invoke the matching callbacks without holding it.
+ *
+ * @param[in] pContext The context associated with the MQTT connection.
+ * @param[in] pPublishInfo The incoming PUBLISH message information.
+ */
+    static void dispatchCollected( MQTTContext_t * pContext,
+                                   MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Copy a message into a free buffer and queue it for the worker tasks.
+ *
+ * @param[in] pContext The context associated with the MQTT connection.
+ * @param[in] pPublishInfo The incoming PUBLISH message information.
+ *
+ * @return true if the message was queued or dropped; false if it has to be
+ * dispatched inline.
+ */
+    static bool deferPublish( MQTTContext_t * pContext,
+                              const MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Raise @p pHighWater to @p value if it is lower.
+ *
+ * @param[in] pHighWater Counter shared between tasks.
+ * @param[in] value New sample.
+ */
+    static void updateHighWater( uint32_t * pHighWater,
+                                 uint32_t value );
+
+/**
+ * @brief Task that runs the callbacks of deferred messages.
+ *
+ * @param[in] pParameters Unused.
+ */
+    static void dispatchWorkerTask( void * pParameters );
+
+#endif /* if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH */
+
+/*-----------------------------------------------------------*/
+
+static void lockRegistry( void )
+{
+    #if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+        if( registryMutex != NULL )
+        {
+            ( void ) xSemaphoreTake( registryMutex, portMAX_DELAY );
+        }
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+static void unlockRegistry( void )
+{
+    #if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+        if( registryMutex != NULL )
+        {
+            ( void ) xSemaphoreGive( registryMutex );
+        }
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+static void resetPools( SubscriptionManagerNode_t * pNodePool,
+                        size_t nodeCount,
+                        SubscriptionManagerRecord_t * pRecordPool,
+                        size_t recordCount )
+{
+    size_t index = 0u;
+
+    ( void ) memset( &rootNode, 0x00, sizeof( rootNode ) );
+    pFreeNodes = NULL;
+    pFreeRecords = NULL;
+
+    /* Link all nodes into the free list. */
+    for( index = nodeCount; index > 0u; index-- )
+    {
+        ( void ) memset( &pNodePool[ index - 1u ], 0x00, sizeof( SubscriptionManagerNode_t ) );
+        pNodePool[ index - 1u ].pNextSibling = pFreeNodes;
+        pFreeNodes = &pNodePool[ index - 1u ];
+    }
+
+    for( index = recordCount; index > 0u; index-- )
+    {
+        ( void ) memset( &pRecordPool[ index - 1u ], 0x00, sizeof( SubscriptionManagerRecord_t ) );
+        pRecordPool[ index - 1u ].pNext = pFreeRecords;
+        pFreeRecords = &pRecordPool[ index - 1u ];
+    }
+
+    isInitialized = true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void initializeDefaultPool( void )
+{
+    if( isInitialized == false )
+    {
+        resetPools( defaultNodePool,
+                    MAX_SUBSCRIPTION_TRIE_NODES,
+                    defaultRecordPool,
+                    MAX_SUBSCRIPTION_CALLBACK_RECORDS );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t findLevelEnd( const char * pString,
+                            size_t stringLength,
+                            size_t levelStart )
+{
+    size_t levelEnd = levelStart;
+
+    while( ( levelEnd < stringLength ) && ( pString[ levelEnd ] != '/' ) )
+    {
+        levelEnd++;
+    }
+
+    return levelEnd;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool isValidTopicFilter( const char * pTopicFilter,
+                                uint16_t topicFilterLength )
+{
+    bool isValid = true;
+    size_t levelStart = 0u;
+    size_t levelEnd = 0u;
+    size_t index = 0u;
+
+    while( ( isValid == true ) && ( levelStart <= topicFilterLength ) )
+    {
+        levelEnd = findLevelEnd( pTopicFilter, topicFilterLength, levelStart );
+
+        for( index = levelStart; index < levelEnd; index++ )
+        {
+            if( ( pTopicFilter[ index ] == '+' ) || ( pTopicFilter[ index ] == '#' ) )
+            {
+                /* A wildcard must be the only character of its level, and the
+                 * multi-level wildcard must also be the last level. */
+                if( ( ( levelEnd - levelStart ) != 1u ) ||
+                    ( ( pTopicFilter[ index ] == '#' ) && ( levelEnd != topicFilterLength ) ) )
+                {
+                    isValid = false;
+                }
+            }
+        }
+
+        levelStart = levelEnd + 1u;
+    }
+
+    return isValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static SubscriptionManagerNode_t * findLiteralChild( const SubscriptionManagerNode_t * pNode,
+                                                     const char * pLevel,
+                                                     size_t levelLength )
+{
+    SubscriptionManagerNode_t * pChild = pNode->pFirstChild;
+
+    while( ( pChild != NULL ) &&
+           ( ( pChild->levelLength != levelLength ) ||
+             ( memcmp( &pChild->pTopicFilter[ pChild->levelOffset ], pLevel, levelLength ) != 0 ) ) )
+    {
+        pChild = pChild->pNextSibling;
+    }
+
+    return pChild;
+}
+
+/*-----------------------------------------------------------*/
+
+static SubscriptionManagerNode_t * findNode( const char * pTopicFilter,
+                                             uint16_t topicFilterLength )
+{
+    SubscriptionManagerNode_t * pNode = &rootNode;
+    size_t levelStart = 0u;
+    size_t levelEnd = 0u;
+
+    while( ( pNode != NULL ) && ( levelStart <= topicFilterLength ) )
+    {
+        levelEnd = findLevelEnd( pTopicFilter, topicFilterLength, levelStart );
+
+        if( ( ( levelEnd - levelStart ) == 1u ) && ( pTopicFilter[ levelStart ] == '+' ) )
+        {
+            pNode = pNode->pPlusChild;
+        }
+        else if( ( ( levelEnd - levelStart ) == 1u ) && ( pTopicFilter[ levelStart ] == '#' ) )
+        {
+            pNode = pNode->pHashChild;
+        }
+        else
+        {
+            pNode = findLiteralChild( pNode, &pTopicFilter[ levelStart ], levelEnd - levelStart );
+        }
+
+        levelStart = levelEnd + 1u;
+    }
+
+    return pNode;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool isUnusedNode( const SubscriptionManagerNode_t * pNode )
+{
+    return ( pNode->pRecords == NULL ) &&
+           ( pNode->pFirstChild == NULL ) &&
+           ( pNode->pPlusChild == NULL ) &&
+           ( pNode->pHashChild == NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static SubscriptionManagerNode_t * pruneBranch( SubscriptionManagerNode_t * pNode )
+{
+    SubscriptionManagerNode_t * pParent = NULL;
+    SubscriptionManagerNode_t ** ppLink = NULL;
+
+    while( ( pNode != &rootNode ) && ( isUnusedNode( pNode ) == true ) )
+    {
+        pParent = pNode->pParent;
+
+        /* Unlink the node from its parent. */
+        if( pParent->pPlusChild == pNode )
+        {
+            pParent->pPlusChild = NULL;
+        }
+        else if( pParent->pHashChild == pNode )
+        {
+            pParent->pHashChild = NULL;
+        }
+        else
+        {
+            ppLink = &pParent->pFirstChild;
+
+            while( *ppLink != pNode )
+            {
+                ppLink = &( *ppLink )->pNextSibling;
+            }
+
+            *ppLink = pNode->pNextSibling;
+        }
+
+        /* Return the node to the pool. */
+        ( void ) memset( pNode, 0x00, sizeof( SubscriptionManagerNode_t ) );
+        pNode->pNextSibling = pFreeNodes;
+        pFreeNodes = pNode;
+
+        pNode = pParent;
+    }
+
+    return pNode;
+}
+
+/*-----------------------------------------------------------*/
+
+static void rebindBranch( SubscriptionManagerNode_t * pNode )
+{
+    const SubscriptionManagerNode_t * pTerminal = NULL;
+
+    while( pNode != &rootNode )
+    {
+        /* Every leaf of the trie has a callback, so following any path down
+         * from the node reaches a registered topic filter passing through it. */
+        pTerminal = pNode;
+
+        while( pTerminal->pRecords == NULL )
+        {
+            if( pTerminal->pFirstChild != NULL )
+            {
+                pTerminal = pTerminal->pFirstChild;
+            }
+            else if( pTerminal->pPlusChild != NULL )
+            {
+                pTerminal = pTerminal->pPlusChild;
+            }
+            else
+            {
+                pTerminal = pTerminal->pHashChild;
+            }
+
+            assert( pTerminal != NULL );
+        }
+
+        /* All topic filters passing through a node share the prefix up to it,
+         * so the level is found at the same offset in the other filter. */
+        pNode->pTopicFilter = pTerminal->pRecords->pTopicFilter;
+
+        pNode = pNode->pParent;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void invokeCallback( const SubscriptionManagerNode_t * pNode,
+                            MQTTContext_t * pContext,
+                            MQTTPublishInfo_t * pPublishInfo,
+                            MatchedCallbacks_t * pMatches )
+{
+    const SubscriptionManagerRecord_t * pRecord = NULL;
+
+    if( pNode != NULL )
+    {
+        for( pRecord = pNode->pRecords; pRecord != NULL; pRecord = pRecord->pNext )
+        {
+            /* The topic filter ends with the level of the node. */
+            LogInfo( ( "Invoking subscription callback of matching topic filter: "
+                       "TopicFilter=%.*s, TopicName=%.*s",
+                       pNode->levelOffset + pNode->levelLength,
+                       pRecord->pTopicFilter,
+                       pPublishInfo->topicNameLength,
+                       pPublishInfo->pTopicName ) );
+
+            if( pMatches == NULL )
+            {
+                pRecord->callback( pContext, pPublishInfo, pRecord->pUserContext );
+            }
+            else if( pMatches->count < MAX_MATCHED_CALLBACKS )
+            {
+                pMatches->records[ pMatches->count ] = *pRecord;
+                pMatches->count++;
+            }
+            else
+            {
+                LogWarn( ( "Skipping subscription callback: More than %u callbacks match: TopicName=%.*s",
+                           MAX_MATCHED_CALLBACKS,
+                           pPublishInfo->topicNameLength,
+                           pPublishInfo->pTopicName ) );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void dispatchFromNode( const SubscriptionManagerNode_t * pNode,
+                              size_t levelStart,
+                              MQTTContext_t * pContext,
+                              MQTTPublishInfo_t * pPublishInfo,
+                              MatchedCallbacks_t * pMatches )
+{
+    const SubscriptionManagerNode_t * pChild = NULL;
+    const char * pTopicName = pPublishInfo->pTopicName;
+    size_t topicNameLength = pPublishInfo->topicNameLength;
+    size_t levelEnd = 0u;
+    bool allowWildcards = true;
+
+    /* Wildcards at the first level must not match topic names starting with '$'. */
+    if( ( levelStart == 0u ) && ( topicNameLength > 0u ) && ( pTopicName[ 0 ] == '$' ) )
+    {
+        allowWildcards = false;
+    }
+
+    /* A '#' level also matches its parent level, so "a/#" matches "a" as well
+     * as any topic below it. */
+    if( allowWildcards == true )
+    {
+        invokeCallback( pNode->pHashChild, pContext, pPublishInfo, pMatches );
+    }
+
+    if( levelStart > topicNameLength )
+    {
+        /* All levels of the topic name have been matched. */
+        invokeCallback( pNode, pContext, pPublishInfo, pMatches );
+    }
+    else
+    {
+        levelEnd = findLevelEnd( pTopicName, topicNameLength, levelStart );
+
+        pChild = findLiteralChild( pNode, &pTopicName[ levelStart ], levelEnd - levelStart );
+
+        if( pChild != NULL )
+        {
+            dispatchFromNode( pChild, levelEnd + 1u, pContext, pPublishInfo, pMatches );
+        }
+
+        if( ( allowWildcards == true ) && ( pNode->pPlusChild != NULL ) )
+        {
+            dispatchFromNode( pNode->pPlusChild, levelEnd + 1u, pContext, pPublishInfo, pMatches );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void SubscriptionManager_Init( SubscriptionManagerNode_t * pNodePool,
+                               size_t nodeCount,
+                               SubscriptionManagerRecord_t * pRecordPool,
+                               size_t recordCount )
+{
+    assert( ( pNodePool != NULL ) || ( nodeCount == 0u ) );
+    assert( ( pRecordPool != NULL ) || ( recordCount == 0u ) );
+
+    lockRegistry();
+    resetPools( pNodePool, nodeCount, pRecordPool, recordCount );
+    unlockRegistry();
+}
+
+/*-----------------------------------------------------------*/
+
+void SubscriptionManager_DispatchHandler( MQTTContext_t * pContext,
+                                          MQTTPublishInfo_t * pPublishInfo )
+{
+    TRACE_SPAN_SCOPE( "SubscriptionManager_DispatchHandler" );
+
+    assert( pPublishInfo != NULL );
+    assert( pContext != NULL );
+
+    #if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+        if( ( __atomic_load_n( &workersStarted, __ATOMIC_ACQUIRE ) == false ) ||
+            ( deferPublish( pContext, pPublishInfo ) == false ) )
+        {
+            __atomic_add_fetch( &dispatchStats.inlined, 1U, __ATOMIC_RELAXED );
+            dispatchCollected( pContext, pPublishInfo );
+        }
+    #else
+        /* Walk the topic trie one level of the topic name at a time, and invoke
+         * the callbacks of the matching topic filters. */
+        dispatchFromNode( &rootNode, 0u, pContext, pPublishInfo, NULL );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+SubscriptionManagerStatus_t SubscriptionManager_RegisterCallback( const char * pTopicFilter,
+                                                                  uint16_t topicFilterLength,
+                                                                  SubscriptionManagerCallback_t callback,
+                                                                  void * pUserContext )
+{
+    assert( pTopicFilter != NULL );
+    assert( topicFilterLength != 0 );
+    assert( callback != NULL );
+
+    SubscriptionManagerStatus_t returnStatus = SUBSCRIPTION_MANAGER_SUCCESS;
+    SubscriptionManagerNode_t * pNode = &rootNode;
+    SubscriptionManagerNode_t * pChild = NULL;
+    SubscriptionManagerNode_t ** ppLink = NULL;
+    SubscriptionManagerRecord_t * pRecord = NULL;
+    SubscriptionManagerRecord_t ** ppRecordLink = NULL;
+    size_t levelStart = 0u;
+    size_t levelEnd = 0u;
+
+    lockRegistry();
+    initializeDefaultPool();
+
+    if( isValidTopicFilter( pTopicFilter, topicFilterLength ) == false )
+    {
+        LogError( ( "Failed to register callback: Invalid topic filter: TopicFilter=%.*s",
+                    topicFilterLength,
+                    pTopicFilter ) );
+
+        returnStatus = SUBSCRIPTION_MANAGER_INVALID_FILTER;
+    }
+    else if( pFreeRecords == NULL )
+    {
+        LogError( ( "Unable to register callback: Callback record pool is exhausted: TopicFilter=%.*s, MaxRecords=%u",
+                    topicFilterLength,
+                    pTopicFilter,
+                    MAX_SUBSCRIPTION_CALLBACK_RECORDS ) );
+
+        returnStatus = SUBSCRIPTION_MANAGER_REGISTRY_FULL;
+    }
+
+    /* Walk down the trie one level of the topic filter at a time, adding the
+     * nodes for levels that are not shared with a registered topic filter. */
+    while( ( returnStatus == SUBSCRIPTION_MANAGER_SUCCESS ) && ( levelStart <= topicFilterLength ) )
+    {
+        levelEnd = findLevelEnd( pTopicFilter, topicFilterLength, levelStart );
+
+        if( ( ( levelEnd - levelStart ) == 1u ) && ( pTopicFilter[ levelStart ] == '+' ) )
+        {
+            ppLink = &pNode->pPlusChild;
+            pChild = *ppLink;
+        }
+        else if( ( ( levelEnd - levelStart ) == 1u ) && ( pTopicFilter[ levelStart ] == '#' ) )
+        {
+            ppLink = &pNode->pHashChild;
+            pChild = *ppLink;
+        }
+        else
+        {
+            ppLink = &pNode->pFirstChild;
+            pChild = findLiteralChild( pNode, &pTopicFilter[ levelStart ], levelEnd - levelStart );
+        }
+
+        if( ( pChild == NULL ) && ( pFreeNodes == NULL ) )
+        {
+            LogError( ( "Unable to register callback: Node pool is exhausted: TopicFilter=%.*s",
+                        topicFilterLength,
+                        pTopicFilter ) );
+
+            /* Give back the nodes already added for this topic filter. */
+            ( void ) pruneBranch( pNode );
+
+            returnStatus = SUBSCRIPTION_MANAGER_REGISTRY_FULL;
+        }
+        else
+        {
+            if( pChild == NULL )
+            {
+                pChild = pFreeNodes;
+                pFreeNodes = pChild->pNextSibling;
+
+                pChild->pTopicFilter = pTopicFilter;
+                pChild->levelOffset = ( uint16_t ) levelStart;
+                pChild->levelLength = ( uint16_t ) ( levelEnd - levelStart );
+                pChild->pParent = pNode;
+
+                /* Literal children are pushed to the front of the sibling list;
+                 * wildcard children are the only one of their kind. */
+                pChild->pNextSibling = ( ppLink == &pNode->pFirstChild ) ? pNode->pFirstChild : NULL;
+                *ppLink = pChild;
+            }
+
+            pNode = pChild;
+            levelStart = levelEnd + 1u;
+        }
+    }
+
+    if( returnStatus == SUBSCRIPTION_MANAGER_SUCCESS )
+    {
+        /* Look for the same registration, and for the end of the record list
+         * so that callbacks are invoked in the order of registration. */
+        ppRecordLink = &pNode->pRecords;
+
+        while( ( *ppRecordLink != NULL ) &&
+               ( ( ( *ppRecordLink )->callback != callback ) ||
+                 ( ( *ppRecordLink )->pUserContext != pUserContext ) ) )
+        {
+            ppRecordLink = &( *ppRecordLink )->pNext;
+        }
+
+        if( *ppRecordLink != NULL )
+        {
+            /* The record for the topic filter already exists. */
+            LogError( ( "Failed to register callback: Record for topic filter already exists: TopicFilter=%.*s",
+                        topicFilterLength,
+                        pTopicFilter ) );
+
+            returnStatus = SUBSCRIPTION_MANAGER_RECORD_EXISTS;
+        }
+    }
+
+    if( returnStatus == SUBSCRIPTION_MANAGER_SUCCESS )
+    {
+        pRecord = pFreeRecords;
+        pFreeRecords = pRecord->pNext;
+
+        pRecord->pTopicFilter = pTopicFilter;
+        pRecord->callback = callback;
+        pRecord->pUserContext = pUserContext;
+        pRecord->pNext = NULL;
+        *ppRecordLink = pRecord;
+
+        LogDebug( ( "Added callback to registry: TopicFilter=%.*s",
+                    topicFilterLength,
+                    pTopicFilter ) );
+    }
+
+    unlockRegistry();
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void SubscriptionManager_RemoveCallback( const char * pTopicFilter,
+                                         uint16_t topicFilterLength,
+                                         SubscriptionManagerCallback_t callback,
+                                         void * pUserContext )
+{
+    assert( pTopicFilter != NULL );
+    assert( topicFilterLength != 0 );
+
+    SubscriptionManagerNode_t * pNode = NULL;
+    SubscriptionManagerRecord_t ** ppRecordLink = NULL;
+    SubscriptionManagerRecord_t * pRecord = NULL;
+    bool recordRemoved = false;
+
+    lockRegistry();
+    initializeDefaultPool();
+
+    pNode = findNode( pTopicFilter, topicFilterLength );
+    ppRecordLink = ( pNode != NULL ) ? &pNode->pRecords : NULL;
+
+    /* Return the matching records to the pool. */
+    while( ( ppRecordLink != NULL ) && ( *ppRecordLink != NULL ) )
+    {
+        pRecord = *ppRecordLink;
+
+        if( ( callback == NULL ) ||
+            ( ( pRecord->callback == callback ) && ( pRecord->pUserContext == pUserContext ) ) )
+        {
+            *ppRecordLink = pRecord->pNext;
+
+            ( void ) memset( pRecord, 0x00, sizeof( SubscriptionManagerRecord_t ) );
+            pRecord->pNext = pFreeRecords;
+            pFreeRecords = pRecord;
+
+            recordRemoved = true;
+        }
+        else
+        {
+            ppRecordLink = &pRecord->pNext;
+        }
+    }
+
+    if( recordRemoved == true )
+    {
+        /* Free the nodes that no longer lead to a callback, then make sure the
+         * remaining ones no longer refer to the memory of a removed topic filter. */
+        pNode = pruneBranch( pNode );
+        rebindBranch( pNode );
+    }
+
+    unlockRegistry();
+
+    if( recordRemoved == true )
+    {
+        LogDebug( ( "Deleted callback record for topic filter: TopicFilter=%.*s",
+                    topicFilterLength,
+                    pTopicFilter ) );
+    }
+    else
+    {
+        LogWarn( ( "Attempted to remove callback for un-registered topic filter: TopicFilter=%.*s",
+                   topicFilterLength,
+                   pTopicFilter ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+
+    static void dispatchCollected( MQTTContext_t * pContext,
+                                   MQTTPublishInfo_t * pPublishInfo )
+    {
+        MatchedCallbacks_t matches;
+        size_t index = 0u;
+
+        matches.count = 0u;
+
+        /* Copy the matching callbacks out under the lock, so a slow callback
+         * does not hold up registrations or the other workers. */
+        lockRegistry();
+        dispatchFromNode( &rootNode, 0u, pContext, pPublishInfo, &matches );
+        unlockRegistry();
+
+        for( index = 0u; index < matches.count; index++ )
+        {
+            matches.records[ index ].callback( pContext,
+                                               pPublishInfo,
+                                               matches.records[ index ].pUserContext );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool deferPublish( MQTTContext_t * pContext,
+                              const MQTTPublishInfo_t * pPublishInfo )
+    {
+        DeferredPublish_t * pDeferred = NULL;
+        TickType_t waitTicks = 0U;
+        bool handled = false;
+
+        #if OVERFLOW_BLOCK
+            waitTicks = ( BLOCK_TIMEOUT_MS == 0 ) ? portMAX_DELAY : pdMS_TO_TICKS( BLOCK_TIMEOUT_MS );
+        #endif
+
+        if( ( ( size_t ) pPublishInfo->topicNameLength + pPublishInfo->payloadLength ) > BUFFER_SIZE )
+        {
+            /* The message does not fit a buffer, so it can only be dispatched inline. */
+            LogDebug( ( "Dispatching oversized message inline: TopicName=%.*s, PayloadLength=%u",
+                        pPublishInfo->topicNameLength,
+                        pPublishInfo->pTopicName,
+                        ( unsigned int ) pPublishInfo->payloadLength ) );
+        }
+        else if( xQueueReceive( freeBufferQueue, &pDeferred, waitTicks ) == pdTRUE )
+        {
+            pDeferred->pContext = pContext;
+            pDeferred->publishInfo = *pPublishInfo;
+            ( void ) memcpy( pDeferred->data, pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
+            pDeferred->publishInfo.pTopicName = ( const char * ) pDeferred->data;
+            pDeferred->publishInfo.pPayload = NULL;
+
+            if( pPublishInfo->payloadLength > 0U )
+            {
+                ( void ) memcpy( &pDeferred->data[ pPublishInfo->topicNameLength ],
+                                 pPublishInfo->pPayload,
+                                 pPublishInfo->payloadLength );
+                pDeferred->publishInfo.pPayload = &pDeferred->data[ pPublishInfo->topicNameLength ];
+            }
+
+            /* The dispatch queue holds every buffer, so this cannot fail. */
+            ( void ) xQueueSendToBack( dispatchQueue, &pDeferred, 0U );
+
+            __atomic_add_fetch( &dispatchStats.deferred, 1U, __ATOMIC_RELAXED );
+            updateHighWater( &dispatchStats.queueHighWater,
+                             ( uint32_t ) uxQueueMessagesWaiting( dispatchQueue ) );
+            handled = true;
+        }
+        else
+        {
+            #if OVERFLOW_INLINE
+                /* Fall back to the process loop task, which slows the receive
+                 * path down until the workers catch up. */
+            #else
+                LogWarn( ( "Dropping message: All deferred dispatch buffers are in use: TopicName=%.*s",
+                           pPublishInfo->topicNameLength,
+                           pPublishInfo->pTopicName ) );
+
+                __atomic_add_fetch( &dispatchStats.dropped, 1U, __ATOMIC_RELAXED );
+                handled = true;
+            #endif
+        }
+
+        return handled;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void updateHighWater( uint32_t * pHighWater,
+                                 uint32_t value )
+    {
+        uint32_t current = __atomic_load_n( pHighWater, __ATOMIC_RELAXED );
+
+        while( ( value > current ) &&
+               !__atomic_compare_exchange_n( pHighWater, &current, value, true,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            /* current was reloaded by the failed exchange. */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void dispatchWorkerTask( void * pParameters )
+    {
+        DeferredPublish_t * pDeferred = NULL;
+
+        ( void ) pParameters;
+
+        for( ; ; )
+        {
+            if( xQueueReceive( dispatchQueue, &pDeferred, portMAX_DELAY ) == pdTRUE )
+            {
+                dispatchCollected( pDeferred->pContext, &pDeferred->publishInfo );
+
+                ( void ) xQueueSendToBack( freeBufferQueue, &pDeferred, 0U );
+                __atomic_add_fetch( &dispatchStats.dispatched, 1U, __ATOMIC_RELAXED );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool SubscriptionManager_StartDispatchWorkers( void )
+    {
+        static StaticSemaphore_t registryMutexBuffer;
+        static StaticQueue_t freeBufferQueueBuffer;
+        static StaticQueue_t dispatchQueueBuffer;
+        static uint8_t freeBufferQueueStorage[ BUFFER_COUNT * sizeof( DeferredPublish_t * ) ];
+        static uint8_t dispatchQueueStorage[ BUFFER_COUNT * sizeof( DeferredPublish_t * ) ];
+        DeferredPublish_t * pDeferred = NULL;
+        size_t index = 0u;
+        size_t workersCreated = 0u;
+        char workerName[ configMAX_TASK_NAME_LEN ];
+
+        if( workersStarted == false )
+        {
+            registryMutex = xSemaphoreCreateMutexStatic( &registryMutexBuffer );
+            freeBufferQueue = xQueueCreateStatic( BUFFER_COUNT,
+                                                  sizeof( DeferredPublish_t * ),
+                                                  freeBufferQueueStorage,
+                                                  &freeBufferQueueBuffer );
+            dispatchQueue = xQueueCreateStatic( BUFFER_COUNT,
+                                                sizeof( DeferredPublish_t * ),
+                                                dispatchQueueStorage,
+                                                &dispatchQueueBuffer );
+            configASSERT( ( registryMutex != NULL ) && ( freeBufferQueue != NULL ) && ( dispatchQueue != NULL ) );
+
+            for( index = 0u; index < BUFFER_COUNT; index++ )
+            {
+                pDeferred = &deferredPublishes[ index ];
+                ( void ) xQueueSendToBack( freeBufferQueue, &pDeferred, 0U );
+            }
+
+            for( index = 0u; index < WORKER_COUNT; index++ )
+            {
+                ( void ) snprintf( workerName, sizeof( workerName ), "SubMgrWorker%u", ( unsigned int ) index );
+
+                if( xTaskCreatePinnedToCore( dispatchWorkerTask,
+                                             workerName,
+                                             WORKER_STACK_SIZE,
+                                             NULL,
+                                             WORKER_PRIORITY,
+                                             NULL,
+                                             WORKER_AFFINITY ) == pdPASS )
+                {
+                    workersCreated++;
+                }
+            }
+
+            if( workersCreated > 0u )
+            {
+                __atomic_store_n( &workersStarted, true, __ATOMIC_RELEASE );
+            }
+            else
+            {
+                LogError( ( "Unable to create subscription dispatch worker tasks." ) );
+            }
+        }
+
+        return workersStarted;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool SubscriptionManager_GetDispatchStats( SubscriptionManagerDispatchStats_t * pStats )
+    {
+        bool statsRead = false;
+
+        if( pStats != NULL )
+        {
+            pStats->deferred = __atomic_load_n( &dispatchStats.deferred, __ATOMIC_RELAXED );
+            pStats->dispatched = __atomic_load_n( &dispatchStats.dispatched, __ATOMIC_RELAXED );
+            pStats->dropped = __atomic_load_n( &dispatchStats.dropped, __ATOMIC_RELAXED );
+            pStats->inlined = __atomic_load_n( &dispatchStats.inlined, __ATOMIC_RELAXED );
+            pStats->queueDepth = ( dispatchQueue != NULL ) ?
+                                 ( uint32_t ) uxQueueMessagesWaiting( dispatchQueue ) : 0U;
+            pStats->queueHighWater = __atomic_load_n( &dispatchStats.queueHighWater, __ATOMIC_RELAXED );
+            statsRead = true;
+        }
+
+        return statsRead;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void SubscriptionManager_ResetDispatchStats( void )
+    {
+        __atomic_store_n( &dispatchStats.deferred, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &dispatchStats.dispatched, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &dispatchStats.dropped, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &dispatchStats.inlined, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &dispatchStats.queueHighWater, 0U, __ATOMIC_RELAXED );
+    }
+
+#endif /* if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH */
+/*-----------------------------------------------------------*/
@@ -0,0 +1,303 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mqtt_subscription_manager.h
+ * @brief The API of a subscription manager for handling subscription callbacks
+ * to topic filters in MQTT operations.
+ */
+
+#ifndef MQTT_SUBSCRIPTION_MANAGER_H_
+#define MQTT_SUBSCRIPTION_MANAGER_H_
+
+/**************************************************/
+/******* DO NOT CHANGE the following order ********/
+/**************************************************/
+
+/* Logging related header files are required to be included in the following order:
+ * 1. Include the header file "logging_levels.h".
+ * 2. Define LIBRARY_LOG_NAME and  LIBRARY_LOG_LEVEL.
+ * 3. Include the header file "logging_stack.h".
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the Subscription Manager module. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Subscription Manager"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_DEBUG
+#endif
+
+#include "logging_stack.h"
+
+/************ End of logging configuration ****************/
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The number of topic trie nodes in the internal pool.
+ */
+#ifndef MAX_SUBSCRIPTION_TRIE_NODES
+    #define MAX_SUBSCRIPTION_TRIE_NODES    CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_NODES
+#endif
+
+/**
+ * @brief The number of callback records in the internal pool.
+ */
+#ifndef MAX_SUBSCRIPTION_CALLBACK_RECORDS
+    #define MAX_SUBSCRIPTION_CALLBACK_RECORDS    CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_CALLBACKS
+#endif
+
+/**
+ * @brief Whether callbacks can be deferred to worker tasks.
+ */
+#define SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH    CONFIG_MQTT_SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+
+/* Enumeration type for return status value from Subscription Manager API. */
+typedef enum SubscriptionManagerStatus
+{
+    /**
+     * @brief Success return value from Subscription Manager API.
+     */
+    SUBSCRIPTION_MANAGER_SUCCESS = 1,
+
+    /**
+     * @brief Failure return value due to the node or callback record pool
+     * being exhausted.
+     */
+    SUBSCRIPTION_MANAGER_REGISTRY_FULL = 2,
+
+    /**
+     * @brief Failure return value due to the same callback and user context
+     * being already registered for the requested topic filter.
+     */
+    SUBSCRIPTION_MANAGER_RECORD_EXISTS = 3,
+
+    /**
+     * @brief Failure return value due to a malformed topic filter, such as a
+     * wildcard that does not occupy a whole topic level or a multi-level
+     * wildcard that is not the last level.
+     */
+    SUBSCRIPTION_MANAGER_INVALID_FILTER = 4
+} SubscriptionManagerStatus_t;
+
+
+/**
+ * @brief Callback type to be registered for a topic filter with the subscription manager.
+ *
+ * For incoming PUBLISH messages received on topics that match the registered topic filter,
+ * the callback would be invoked by the subscription manager.
+ *
+ * @param[in] pContext The context associated with the MQTT connection.
+ * @param[in] pPublishInfo The incoming PUBLISH message information.
+ * @param[in] pUserContext The user context passed on registration.
+ */
+typedef void (* SubscriptionManagerCallback_t )( MQTTContext_t * pContext,
+                                                 MQTTPublishInfo_t * pPublishInfo,
+                                                 void * pUserContext );
+
+/**
+ * @brief A callback registered for a topic filter.
+ *
+ * The application only allocates these and hands them to
+ * #SubscriptionManager_Init; the fields are private to the subscription manager.
+ */
+typedef struct SubscriptionManagerRecord
+{
+    /* The topic filter the callback was registered with. */
+    const char * pTopicFilter;
+    SubscriptionManagerCallback_t callback;
+    void * pUserContext;
+
+    /* Next record of the same topic filter, or next free record. */
+    struct SubscriptionManagerRecord * pNext;
+} SubscriptionManagerRecord_t;
+
+/**
+ * @brief A node of the topic trie used by the subscription manager.
+ *
+ * Each node stands for one level of one or more registered topic filters.
+ * The application only allocates these, either statically or from its own
+ * memory, and hands them to #SubscriptionManager_Init; the fields are private
+ * to the subscription manager.
+ */
+typedef struct SubscriptionManagerNode
+{
+    /* A registered topic filter that passes through this node. The level this
+     * node stands for is read from it at levelOffset. */
+    const char * pTopicFilter;
+    uint16_t levelOffset;
+    uint16_t levelLength;
+
+    /* Callbacks of the topic filter ending at this node. */
+    SubscriptionManagerRecord_t * pRecords;
+
+    struct SubscriptionManagerNode * pParent;
+    struct SubscriptionManagerNode * pFirstChild;  /* Children with a literal level. */
+    struct SubscriptionManagerNode * pPlusChild;   /* Child for the '+' level, if any. */
+    struct SubscriptionManagerNode * pHashChild;   /* Child for the '#' level, if any. */
+    struct SubscriptionManagerNode * pNextSibling; /* Next literal child, or next free node. */
+} SubscriptionManagerNode_t;
+
+/**
+ * @brief Resets the subscription manager to use caller-provided pools of trie
+ * nodes and callback records.
+ *
+ * A registered topic filter takes one node per topic level that it does not
+ * share with another registered filter, so `a/b/#` and `a/b/c` together take
+ * four nodes. Each registered callback takes one record. Any previously
+ * registered callbacks are dropped.
+ *
+ * If this is never called, the subscription manager uses internal pools of
+ * MAX_SUBSCRIPTION_TRIE_NODES nodes and MAX_SUBSCRIPTION_CALLBACK_RECORDS
+ * records, sized in Kconfig.
+ *
+ * @param[in] pNodePool The nodes to build the topic trie from.
+ * @param[in] nodeCount The number of nodes in @a pNodePool.
+ * @param[in] pRecordPool The records to hold the registered callbacks.
+ * @param[in] recordCount The number of records in @a pRecordPool.
+ *
+ * @note The memory of both pools must stay valid while the subscription
+ * manager is in use.
+ */
+void SubscriptionManager_Init( SubscriptionManagerNode_t * pNodePool,
+                               size_t nodeCount,
+                               SubscriptionManagerRecord_t * pRecordPool,
+                               size_t recordCount );
+
+/**
+ * @brief Dispatches the incoming PUBLISH message to the callbacks that have their
+ * registered topic filters matching the incoming PUBLISH topic name. The dispatch
+ * handler will invoke all these callbacks with matching topic filters.
+ *
+ * The topic name is matched one level at a time against the topic trie, so the
+ * cost depends on the number of levels in the topic rather than the number of
+ * registered topic filters.
+ *
+ * Once #SubscriptionManager_StartDispatchWorkers has been called, the message
+ * is instead copied and the callbacks are invoked later on a worker task.
+ *
+ * @param[in] pContext The context associated with the MQTT connection.
+ * @param[in] pPublishInfo The incoming PUBLISH message information.
+ */
+void SubscriptionManager_DispatchHandler( MQTTContext_t * pContext,
+                                          MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Utility to register a callback for a topic filter in the subscription manager.
+ *
+ * The callback will be invoked when an incoming PUBLISH message is received on
+ * a topic that matches the topic filter, @a pTopicFilter. The subscription manager
+ * accepts wildcard topic filters.
+ *
+ * @param[in] pTopicFilter The topic filter to register the callback for.
+ * @param[in] topicFilterLength The length of the topic filter string.
+ * @param[in] callback The callback to be registered for the topic filter.
+ * @param[in] pUserContext The user context to pass to @a callback.
+ *
+ * @note Several callbacks may be registered for the same topic filter; they are
+ * invoked in the order of registration. The same callback may be registered
+ * more than once for a topic filter with different user contexts.
+ * @note The passed topic filter, @a pTopicFilter, is saved in the registry.
+ * The application must not free or alter the content of the topic filter memory
+ * until the callback for the topic filter is removed from the subscription manager.
+ *
+ * @return Returns one of the following:
+ * - #SUBSCRIPTION_MANAGER_SUCCESS if registration of the callback is successful.
+ * - #SUBSCRIPTION_MANAGER_REGISTRY_FULL if the registration failed because the
+ * node or callback record pool is exhausted.
+ * - #SUBSCRIPTION_MANAGER_RECORD_EXISTS, if the callback is already registered
+ * with the same user context for the requested topic filter.
+ * - #SUBSCRIPTION_MANAGER_INVALID_FILTER if the topic filter is malformed.
+ */
+SubscriptionManagerStatus_t SubscriptionManager_RegisterCallback( const char * pTopicFilter,
+                                                                  uint16_t topicFilterLength,
+                                                                  SubscriptionManagerCallback_t callback,
+                                                                  void * pUserContext );
+
+/**
+ * @brief Utility to remove a callback registered for a topic filter from the
+ * subscription manager.
+ *
+ * @param[in] pTopicFilter The topic filter to remove the callback from.
+ * @param[in] topicFilterLength The length of the topic filter string.
+ * @param[in] callback The callback to remove, or NULL to remove all callbacks
+ * of the topic filter.
+ * @param[in] pUserContext The user context the callback was registered with.
+ * Ignored if @a callback is NULL.
+ */
+void SubscriptionManager_RemoveCallback( const char * pTopicFilter,
+                                         uint16_t topicFilterLength,
+                                         SubscriptionManagerCallback_t callback,
+                                         void * pUserContext );
+
+#if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH
+
+/**
+ * @brief Counters of the deferred dispatch path.
+ */
+typedef struct SubscriptionManagerDispatchStats
+{
+    uint32_t deferred;       /**< @brief Messages handed to the worker tasks. */
+    uint32_t dispatched;     /**< @brief Deferred messages whose callbacks have run. */
+    uint32_t dropped;        /**< @brief Messages dropped because no buffer was free. */
+    uint32_t inlined;        /**< @brief Messages dispatched on the process loop task. */
+    uint32_t queueDepth;     /**< @brief Messages waiting for a worker right now. */
+    uint32_t queueHighWater; /**< @brief Most messages that have waited for a worker at once. */
+} SubscriptionManagerDispatchStats_t;
+
+/**
+ * @brief Create the worker tasks that run deferred callbacks.
+ *
+ * From then on, #SubscriptionManager_DispatchHandler copies messages into a
+ * pooled buffer and returns without invoking callbacks. Call this before
+ * other tasks start using the subscription manager.
+ *
+ * @return true if the workers are running; false if their resources could not
+ * be created, in which case callbacks keep being invoked inline.
+ */
+bool SubscriptionManager_StartDispatchWorkers( void );
+
+/**
+ * @brief Read the counters of the deferred dispatch path.
+ *
+ * @param[out] pStats Where to store the counters.
+ *
+ * @return true if the statistics were read; false if @a pStats is NULL.
+ */
+bool SubscriptionManager_GetDispatchStats( SubscriptionManagerDispatchStats_t * pStats );
+
+/**
+ * @brief Reset the counters and high-water mark of the deferred dispatch path.
+ */
+void SubscriptionManager_ResetDispatchStats( void );
+
+#endif /* if SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH */
+
+#endif /* ifndef MQTT_SUBSCRIPTION_MANAGER_H_ */
@@ -0,0 +1,404 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file named_shadows.c
+ * @brief Implementation of the named shadow manager.
+ *
+ * A topic is split at the shadow name: the part before it is compared with
+ * the prefix of the filters, the name is looked up in the table, and the
+ * part after it is one of the eight suffixes.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the named shadow manager. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Named Shadows"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Include coreJSON. */
+#include "core_json.h"
+
+/* Include the shared subscription dispatcher. */
+#include "mqtt_subscription_manager.h"
+
+#include "named_shadows.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The parts of every filter before the shadow name.
+ */
+#define THING_PREFIX                "$aws/things/"
+#define THING_PREFIX_LENGTH         ( sizeof( THING_PREFIX ) - 1U )
+#define SHADOW_NAME_INFIX           "/shadow/name/"
+#define SHADOW_NAME_INFIX_LENGTH    ( sizeof( SHADOW_NAME_INFIX ) - 1U )
+
+/**
+ * @brief The key of the version of a delta or accepted update.
+ */
+#define VERSION_KEY            "version"
+#define VERSION_KEY_LENGTH     ( sizeof( VERSION_KEY ) - 1U )
+
+/**
+ * @brief A string literal and its length.
+ */
+#define LITERAL( string )    { string, sizeof( string ) - 1U }
+
+typedef struct Literal
+{
+    const char * pString;
+    uint16_t length;
+} Literal_t;
+
+/**
+ * @brief What follows the shadow name in each filter.
+ */
+static const Literal_t filterSuffixes[ NAMED_SHADOWS_FILTER_COUNT ] =
+{
+    LITERAL( "/update/+" ),
+    LITERAL( "/get/+" ),
+    LITERAL( "/delete/+" )
+};
+
+/**
+ * @brief What follows the shadow name in each topic, in the order of
+ * #NamedShadowTopic_t.
+ */
+static const Literal_t topicSuffixes[ NamedShadowTopicCount ] =
+{
+    LITERAL( "/update/delta" ),
+    LITERAL( "/update/accepted" ),
+    LITERAL( "/update/rejected" ),
+    LITERAL( "/update/documents" ),
+    LITERAL( "/get/accepted" ),
+    LITERAL( "/get/rejected" ),
+    LITERAL( "/delete/accepted" ),
+    LITERAL( "/delete/rejected" )
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Appends @a length bytes to the buffer at @a pOffset.
+ *
+ * @return false if they don't fit with a terminator.
+ */
+static bool append( char * pBuffer,
+                    size_t bufferLength,
+                    size_t * pOffset,
+                    const char * pData,
+                    size_t length );
+
+/**
+ * @brief Reads the version of a delta or accepted update.
+ *
+ * @return false if there is none.
+ */
+static bool parseVersion( const MQTTPublishInfo_t * pPublishInfo,
+                          uint32_t * pVersion );
+
+/**
+ * @brief The subscription manager callback of the filters.
+ */
+static void dispatchCallback( MQTTContext_t * pContext,
+                              MQTTPublishInfo_t * pPublishInfo,
+                              void * pUserContext );
+
+/*-----------------------------------------------------------*/
+
+static bool append( char * pBuffer,
+                    size_t bufferLength,
+                    size_t * pOffset,
+                    const char * pData,
+                    size_t length )
+{
+    bool status = ( *pOffset + length ) < bufferLength;
+
+    if( status == true )
+    {
+        ( void ) memcpy( &pBuffer[ *pOffset ], pData, length );
+        *pOffset += length;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool parseVersion( const MQTTPublishInfo_t * pPublishInfo,
+                          uint32_t * pVersion )
+{
+    char * pValue = NULL;
+    size_t valueLength = 0U;
+    char number[ sizeof( "4294967295" ) ];
+    bool status = false;
+
+    if( ( JSON_Search( ( char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength,
+                       VERSION_KEY, VERSION_KEY_LENGTH,
+                       &pValue, &valueLength ) == JSONSuccess ) &&
+        ( valueLength > 0U ) && ( valueLength < sizeof( number ) ) )
+    {
+        /* The value isn't terminated in the payload. */
+        ( void ) memcpy( number, pValue, valueLength );
+        number[ valueLength ] = '\0';
+        *pVersion = ( uint32_t ) strtoul( number, NULL, 10 );
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void dispatchCallback( MQTTContext_t * pContext,
+                              MQTTPublishInfo_t * pPublishInfo,
+                              void * pUserContext )
+{
+    ( void ) pContext;
+
+    ( void ) NamedShadows_Dispatch( ( NamedShadows_t * ) pUserContext, pPublishInfo );
+}
+
+/*-----------------------------------------------------------*/
+
+bool NamedShadows_Init( NamedShadows_t * pShadows,
+                        const char * pThingName,
+                        size_t thingNameLength,
+                        NamedShadow_t * pTable,
+                        size_t count )
+{
+    bool status = true;
+    size_t offset = 0U;
+    size_t i;
+
+    assert( pShadows != NULL );
+    assert( pThingName != NULL );
+    assert( ( pTable != NULL ) || ( count == 0U ) );
+
+    ( void ) memset( pShadows, 0x00, sizeof( *pShadows ) );
+    pShadows->pShadows = pTable;
+    pShadows->count = count;
+    pShadows->prefixLength = ( uint16_t ) ( THING_PREFIX_LENGTH + thingNameLength + SHADOW_NAME_INFIX_LENGTH );
+
+    for( i = 0; ( i < count ) && ( status == true ); i++ )
+    {
+        status = ( pTable[ i ].pName != NULL ) &&
+                 ( pTable[ i ].nameLength > 0U ) &&
+                 ( memchr( pTable[ i ].pName, '/', pTable[ i ].nameLength ) == NULL ) &&
+                 ( pTable[ i ].callback != NULL );
+        pTable[ i ].version = 0U;
+    }
+
+    for( i = 0; ( i < NAMED_SHADOWS_FILTER_COUNT ) && ( status == true ); i++ )
+    {
+        pShadows->offsets[ i ] = ( uint16_t ) offset;
+
+        status = append( pShadows->buffer, sizeof( pShadows->buffer ), &offset, THING_PREFIX, THING_PREFIX_LENGTH ) &&
+                 append( pShadows->buffer, sizeof( pShadows->buffer ), &offset, pThingName, thingNameLength ) &&
+                 append( pShadows->buffer, sizeof( pShadows->buffer ), &offset, SHADOW_NAME_INFIX, SHADOW_NAME_INFIX_LENGTH ) &&
+                 append( pShadows->buffer, sizeof( pShadows->buffer ), &offset, "+", 1U ) &&
+                 append( pShadows->buffer, sizeof( pShadows->buffer ), &offset,
+                         filterSuffixes[ i ].pString, filterSuffixes[ i ].length );
+
+        if( status == true )
+        {
+            pShadows->buffer[ offset ] = '\0';
+            pShadows->lengths[ i ] = ( uint16_t ) ( offset - pShadows->offsets[ i ] );
+            offset++;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * NamedShadows_GetFilter( const NamedShadows_t * pShadows,
+                                     size_t index,
+                                     uint16_t * pLength )
+{
+    assert( pShadows != NULL );
+    assert( index < NAMED_SHADOWS_FILTER_COUNT );
+
+    if( pLength != NULL )
+    {
+        *pLength = pShadows->lengths[ index ];
+    }
+
+    return &pShadows->buffer[ pShadows->offsets[ index ] ];
+}
+
+/*-----------------------------------------------------------*/
+
+bool NamedShadows_Register( NamedShadows_t * pShadows )
+{
+    bool status = true;
+    size_t i;
+
+    assert( pShadows != NULL );
+
+    for( i = 0; ( i < NAMED_SHADOWS_FILTER_COUNT ) && ( status == true ); i++ )
+    {
+        status = ( SubscriptionManager_RegisterCallback( &pShadows->buffer[ pShadows->offsets[ i ] ],
+                                                         pShadows->lengths[ i ],
+                                                         dispatchCallback,
+                                                         pShadows ) == SUBSCRIPTION_MANAGER_SUCCESS );
+    }
+
+    if( status == false )
+    {
+        LogError( ( "Failed to register %s.", &pShadows->buffer[ pShadows->offsets[ i - 1U ] ] ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t NamedShadows_GetTopic( const NamedShadows_t * pShadows,
+                                const NamedShadow_t * pShadow,
+                                const char * pOperation,
+                                char * pBuffer,
+                                size_t bufferLength )
+{
+    size_t offset = 0U;
+    bool status;
+
+    assert( ( pShadows != NULL ) && ( pShadow != NULL ) );
+    assert( ( pOperation != NULL ) && ( pBuffer != NULL ) );
+
+    /* The filters start with the prefix of the topic. */
+    status = append( pBuffer, bufferLength, &offset, pShadows->buffer, pShadows->prefixLength ) &&
+             append( pBuffer, bufferLength, &offset, pShadow->pName, pShadow->nameLength ) &&
+             append( pBuffer, bufferLength, &offset, "/", 1U ) &&
+             append( pBuffer, bufferLength, &offset, pOperation, strlen( pOperation ) );
+
+    if( status == true )
+    {
+        pBuffer[ offset ] = '\0';
+    }
+    else
+    {
+        offset = 0U;
+    }
+
+    return ( uint16_t ) offset;
+}
+
+/*-----------------------------------------------------------*/
+
+bool NamedShadows_Dispatch( NamedShadows_t * pShadows,
+                            MQTTPublishInfo_t * pPublishInfo )
+{
+    const char * pTopic;
+    const char * pName = NULL;
+    const char * pSuffix = NULL;
+    size_t nameLength = 0U;
+    size_t suffixLength = 0U;
+    NamedShadow_t * pShadow = NULL;
+    NamedShadowTopic_t topic = NamedShadowTopicCount;
+    uint32_t version = 0U;
+    bool hasVersion = false;
+    bool dispatched = false;
+    size_t i;
+
+    assert( ( pShadows != NULL ) && ( pPublishInfo != NULL ) );
+
+    pTopic = pPublishInfo->pTopicName;
+
+    /* Split the topic at the shadow name. */
+    if( ( pPublishInfo->topicNameLength > pShadows->prefixLength ) &&
+        ( memcmp( pTopic, pShadows->buffer, pShadows->prefixLength ) == 0 ) )
+    {
+        pName = &pTopic[ pShadows->prefixLength ];
+        pSuffix = memchr( pName, '/', pPublishInfo->topicNameLength - pShadows->prefixLength );
+    }
+
+    if( pSuffix != NULL )
+    {
+        nameLength = ( size_t ) ( pSuffix - pName );
+        suffixLength = pPublishInfo->topicNameLength - pShadows->prefixLength - nameLength;
+
+        for( i = 0; ( i < pShadows->count ) && ( pShadow == NULL ); i++ )
+        {
+            if( ( pShadows->pShadows[ i ].nameLength == nameLength ) &&
+                ( memcmp( pShadows->pShadows[ i ].pName, pName, nameLength ) == 0 ) )
+            {
+                pShadow = &pShadows->pShadows[ i ];
+            }
+        }
+
+        for( i = 0; ( i < NamedShadowTopicCount ) && ( topic == NamedShadowTopicCount ); i++ )
+        {
+            if( ( topicSuffixes[ i ].length == suffixLength ) &&
+                ( memcmp( topicSuffixes[ i ].pString, pSuffix, suffixLength ) == 0 ) )
+            {
+                topic = ( NamedShadowTopic_t ) i;
+            }
+        }
+    }
+
+    if( ( pShadow != NULL ) &&
+        ( ( topic == NamedShadowUpdateDelta ) || ( topic == NamedShadowUpdateAccepted ) ) )
+    {
+        hasVersion = parseVersion( pPublishInfo, &version );
+    }
+
+    if( ( pShadow == NULL ) || ( topic == NamedShadowTopicCount ) )
+    {
+        LogWarn( ( "Not a topic of a known named shadow: %.*s",
+                   ( int ) pPublishInfo->topicNameLength, pTopic ) );
+    }
+    else if( ( topic == NamedShadowUpdateDelta ) && ( hasVersion == true ) &&
+             ( ( int32_t ) ( version - pShadow->version ) <= 0 ) )
+    {
+        /* Deltas can arrive twice, and out of order. */
+        LogWarn( ( "Dropped a delta of shadow %.*s of version %u, the shadow is at %u already.",
+                   ( int ) pShadow->nameLength, pShadow->pName,
+                   ( unsigned ) version, ( unsigned ) pShadow->version ) );
+    }
+    else
+    {
+        if( ( hasVersion == true ) && ( ( int32_t ) ( version - pShadow->version ) > 0 ) )
+        {
+            pShadow->version = version;
+        }
+
+        pShadow->callback( pShadow, topic, pPublishInfo );
+        dispatched = true;
+    }
+
+    return dispatched;
+}
@@ -0,0 +1,214 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file named_shadows.h
+ * @brief Receive the messages of many named shadows of a thing on three
+ * subscriptions.
+ *
+ * Instead of subscribing to the response topics of every named shadow, the
+ * manager registers the wildcard topic filters
+ * `$aws/things/<thing>/shadow/name/+/update/+`, `.../+/get/+` and
+ * `.../+/delete/+` with the subscription manager, and hands each message to
+ * the callback of the shadow named in its topic. The number of subscriptions
+ * doesn't grow with the number of shadows. `/update` itself isn't matched,
+ * so the updates the device publishes don't come back to it.
+ *
+ * The manager keeps the newest document version seen of each shadow, from
+ * its deltas and accepted updates, and drops a delta that isn't newer, as
+ * deltas can arrive twice and out of order.
+ *
+ * The callbacks run on the task that dispatches the subscription manager.
+ */
+
+#ifndef NAMED_SHADOWS_H_
+#define NAMED_SHADOWS_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/**
+ * @brief The number of topic filters of the manager.
+ */
+#define NAMED_SHADOWS_FILTER_COUNT    ( 3U )
+
+/**
+ * @brief The size of the buffer the topic filters are built into: the three
+ * filters take 105 bytes plus three per byte of thing name, which fits thing
+ * names of up to 128 bytes, the longest AWS IoT allows.
+ */
+#define NAMED_SHADOWS_BUFFER_SIZE     ( 512U )
+
+/**
+ * @brief The topics a named shadow receives on.
+ */
+typedef enum NamedShadowTopic
+{
+    NamedShadowUpdateDelta = 0,
+    NamedShadowUpdateAccepted,
+    NamedShadowUpdateRejected,
+    NamedShadowUpdateDocuments,
+    NamedShadowGetAccepted,
+    NamedShadowGetRejected,
+    NamedShadowDeleteAccepted,
+    NamedShadowDeleteRejected,
+    NamedShadowTopicCount
+} NamedShadowTopic_t;
+
+/* Forward declaration of a shadow, for the callback. */
+struct NamedShadow;
+
+/**
+ * @brief Handles a message of a named shadow.
+ *
+ * @param[in] pShadow The shadow named in the topic of the message.
+ * @param[in] topic Which of its topics the message is on.
+ * @param[in] pPublishInfo The message.
+ */
+typedef void ( * NamedShadowCallback_t )( struct NamedShadow * pShadow,
+                                          NamedShadowTopic_t topic,
+                                          MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief A named shadow of the thing.
+ *
+ * Define the table with #NAMED_SHADOW, or set the first four fields. The
+ * fields after them are private to this module.
+ */
+typedef struct NamedShadow
+{
+    const char * pName;             /**< The shadow name, kept by the manager. */
+    uint16_t nameLength;            /**< The length of #pName. */
+    NamedShadowCallback_t callback; /**< Receives the messages of the shadow. */
+    void * pUserContext;            /**< For the application, not used by the manager. */
+
+    /* Newest version seen of the document, 0 before the first. */
+    uint32_t version;
+} NamedShadow_t;
+
+/**
+ * @brief Initializer of an entry of the table of shadows, for a string
+ * literal name.
+ */
+#define NAMED_SHADOW( name, shadowCallback, pContext ) \
+    { .pName = ( name ), .nameLength = sizeof( name ) - 1U, .callback = ( shadowCallback ), .pUserContext = ( pContext ) }
+
+/**
+ * @brief The named shadows of a thing.
+ *
+ * The fields are private to this module.
+ */
+typedef struct NamedShadows
+{
+    NamedShadow_t * pShadows;
+    size_t count;
+
+    /* The topic filters, NUL-terminated one after the other. */
+    char buffer[ NAMED_SHADOWS_BUFFER_SIZE ];
+    uint16_t offsets[ NAMED_SHADOWS_FILTER_COUNT ];
+    uint16_t lengths[ NAMED_SHADOWS_FILTER_COUNT ];
+
+    /* Length of "$aws/things/<thing>/shadow/name/", which every filter
+     * starts with. */
+    uint16_t prefixLength;
+} NamedShadows_t;
+
+/**
+ * @brief Builds the topic filters of the named shadows of a thing.
+ *
+ * @param[out] pShadows The manager to initialize.
+ * @param[in] pThingName The thing name.
+ * @param[in] thingNameLength The length of @a pThingName.
+ * @param[in] pTable The shadows, used in place, which must outlive the
+ * manager.
+ * @param[in] count The number of shadows.
+ *
+ * @return false if the thing name is too long, or a shadow has no name or
+ * callback, or a name with a '/'.
+ */
+bool NamedShadows_Init( NamedShadows_t * pShadows,
+                        const char * pThingName,
+                        size_t thingNameLength,
+                        NamedShadow_t * pTable,
+                        size_t count );
+
+/**
+ * @brief Gets a topic filter of the manager, to subscribe to.
+ *
+ * @param[in] pShadows The manager.
+ * @param[in] index The filter, below #NAMED_SHADOWS_FILTER_COUNT.
+ * @param[out] pLength The length of the filter, if not NULL.
+ *
+ * @return The filter, NUL-terminated.
+ */
+const char * NamedShadows_GetFilter( const NamedShadows_t * pShadows,
+                                     size_t index,
+                                     uint16_t * pLength );
+
+/**
+ * @brief Registers the topic filters of the manager with the subscription
+ * manager, before it dispatches.
+ *
+ * @param[in] pShadows The manager, which must outlive the registration.
+ *
+ * @return false if the subscription manager refused a filter.
+ */
+bool NamedShadows_Register( NamedShadows_t * pShadows );
+
+/**
+ * @brief Writes the topic of an operation of a shadow, such as "update" or
+ * "get", to publish to.
+ *
+ * @param[in] pShadows The manager.
+ * @param[in] pShadow A shadow of the manager.
+ * @param[in] pOperation The operation, NUL-terminated.
+ * @param[out] pBuffer Where the topic is written, NUL-terminated.
+ * @param[in] bufferLength The size of @a pBuffer.
+ *
+ * @return The length of the topic, or 0 if it doesn't fit.
+ */
+uint16_t NamedShadows_GetTopic( const NamedShadows_t * pShadows,
+                                const NamedShadow_t * pShadow,
+                                const char * pOperation,
+                                char * pBuffer,
+                                size_t bufferLength );
+
+/**
+ * @brief Hands a message to the shadow named in its topic. The subscription
+ * manager calls this for the filters of #NamedShadows_Register; it is public
+ * for an application dispatching messages itself.
+ *
+ * @param[in] pShadows The manager.
+ * @param[in] pPublishInfo The message.
+ *
+ * @return false if the topic isn't one of a shadow of the manager, or the
+ * message is a stale delta.
+ */
+bool NamedShadows_Dispatch( NamedShadows_t * pShadows,
+                            MQTTPublishInfo_t * pPublishInfo );
+
+#endif /* ifndef NAMED_SHADOWS_H_ */
@@ -0,0 +1,413 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/**
+ * @file ota_event_pool.c
+ * @brief Implementation of the OTA event buffer pool.
+ *
+ * The free buffers form a stack linked by index. Its head packs the index of
+ * the top buffer with a tag bumped on every update, and is only changed with
+ * compare-and-swap, so a task preempted in the middle of a get or free never
+ * makes another one fail. The free slabs of the zero-copy mode form a second
+ * stack of the same kind.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the OTA event pool. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "OTA Event Pool"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "ota_event_pool.h"
+
+/* Include the buffer placement policy. */
+#include "mem_placement.h"
+
+/* Include the shared buffer arena. */
+#include "buffer_arena.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Value of the index part of a free list head when the list is empty.
+ */
+#define FREE_LIST_EMPTY            ( 0U )
+
+/**
+ * @brief Mask of the index part of a free list head. The index is stored plus
+ * one, so that zero can mean an empty list.
+ */
+#define FREE_LIST_INDEX_MASK       ( 0x0000FFFFU )
+
+/**
+ * @brief Increment of the tag part of a free list head. The tag changes on
+ * every update, so a compare-and-swap fails if the head was popped and pushed
+ * back in between (the ABA problem).
+ */
+#define FREE_LIST_TAG_INCREMENT    ( 0x00010000U )
+
+#if !BUFFER_ARENA_ENABLED
+
+/**
+ * @brief The buffers of the pool. With the buffer arena, buffers are
+ * borrowed from it instead, and the OTA quota of the arena bounds them.
+ */
+    static OtaEventData_t eventBuffers[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ] MEM_PLACEMENT_BULK_ATTR;
+#endif
+
+/**
+ * @brief Head of the free list: the index plus one of the first free buffer
+ * in the low half, the tag in the high half.
+ */
+static uint32_t freeListHead = FREE_LIST_EMPTY;
+
+/**
+ * @brief For every free buffer, the index plus one of the next free buffer,
+ * or #FREE_LIST_EMPTY.
+ */
+static uint32_t freeListNext[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
+
+#if OTA_EVENT_POOL_ZERO_COPY
+
+/**
+ * @brief The slabs the MQTT network buffer is split into, or NULL until
+ * OtaEventPool_AttachSlabs is called.
+ */
+    static uint8_t * pSlabs = NULL;
+
+/**
+ * @brief Bytes of each slab, and bytes of the network buffer in a slab.
+ */
+    static size_t slabSize = 0U;
+    static size_t slabNetworkBufferSize = 0U;
+
+/**
+ * @brief Offset of the network buffer in the next slab, so that the payload
+ * of a packet with the same headers as the last one is word aligned.
+ */
+    static size_t slabSkew = 0U;
+
+/**
+ * @brief Free list of the slabs neither received into nor owned by the OTA agent.
+ */
+    static uint32_t slabListHead = FREE_LIST_EMPTY;
+    static uint32_t slabListNext[ OTA_EVENT_POOL_SLABS ];
+#endif /* OTA_EVENT_POOL_ZERO_COPY */
+
+/**
+ * @brief Counters reported by OtaEventPool_GetStats, updated with relaxed atomics.
+ */
+static OtaEventPoolStats_t poolStats;
+
+/*-----------------------------------------------------------*/
+
+#if !BUFFER_ARENA_ENABLED || OTA_EVENT_POOL_ZERO_COPY
+
+/**
+ * @brief Pop an entry off a free list without blocking.
+ *
+ * @param[in] pHead Head of the list.
+ * @param[in] pNext Links of the list.
+ *
+ * @return The index of the entry plus one, or #FREE_LIST_EMPTY.
+ */
+    static uint32_t popFree( uint32_t * pHead,
+                             uint32_t * pNext )
+    {
+        uint32_t head = __atomic_load_n( pHead, __ATOMIC_ACQUIRE );
+        uint32_t newHead;
+        uint32_t entry = FREE_LIST_EMPTY;
+
+        while( ( entry == FREE_LIST_EMPTY ) && ( ( head & FREE_LIST_INDEX_MASK ) != FREE_LIST_EMPTY ) )
+        {
+            /* The link may be stale if another task popped the head meanwhile,
+             * in which case the tag has changed and the exchange fails. */
+            newHead = ( ( head + FREE_LIST_TAG_INCREMENT ) & ~FREE_LIST_INDEX_MASK ) |
+                      __atomic_load_n( &pNext[ ( head & FREE_LIST_INDEX_MASK ) - 1U ], __ATOMIC_RELAXED );
+
+            if( __atomic_compare_exchange_n( pHead, &head, newHead, true,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+            {
+                entry = head & FREE_LIST_INDEX_MASK;
+            }
+        }
+
+        return entry;
+    }
+
+#endif /* if !BUFFER_ARENA_ENABLED || OTA_EVENT_POOL_ZERO_COPY */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Push an entry onto a free list.
+ *
+ * @param[in] pHead Head of the list.
+ * @param[in] pNext Links of the list.
+ * @param[in] index Index of the entry.
+ */
+static void pushFree( uint32_t * pHead,
+                      uint32_t * pNext,
+                      uint32_t index )
+{
+    uint32_t head = __atomic_load_n( pHead, __ATOMIC_RELAXED );
+    uint32_t newHead;
+
+    do
+    {
+        __atomic_store_n( &pNext[ index ], head & FREE_LIST_INDEX_MASK, __ATOMIC_RELAXED );
+        newHead = ( ( head + FREE_LIST_TAG_INCREMENT ) & ~FREE_LIST_INDEX_MASK ) | ( index + 1U );
+    } while( !__atomic_compare_exchange_n( pHead, &head, newHead, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Count a buffer handed out.
+ */
+static void recordGet( void )
+{
+    uint32_t inUse;
+    uint32_t highWater;
+
+    ( void ) __atomic_add_fetch( &poolStats.gets, 1U, __ATOMIC_RELAXED );
+    inUse = __atomic_add_fetch( &poolStats.inUse, 1U, __ATOMIC_RELAXED );
+    highWater = __atomic_load_n( &poolStats.highWater, __ATOMIC_RELAXED );
+
+    while( ( inUse > highWater ) &&
+           !__atomic_compare_exchange_n( &poolStats.highWater, &highWater, inUse, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {
+        /* highWater was reloaded by the failed exchange. */
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaEventPool_Init( void )
+{
+    uint32_t i;
+
+    #if !BUFFER_ARENA_ENABLED
+        memset( eventBuffers, 0x00, sizeof( eventBuffers ) );
+    #endif
+
+    for( i = 0U; i < otaconfigMAX_NUM_OTA_DATA_BUFFERS; i++ )
+    {
+        freeListNext[ i ] = ( i + 1U < otaconfigMAX_NUM_OTA_DATA_BUFFERS ) ? ( i + 2U ) : FREE_LIST_EMPTY;
+    }
+
+    memset( &poolStats, 0x00, sizeof( poolStats ) );
+    __atomic_store_n( &freeListHead, 1U, __ATOMIC_RELEASE );
+}
+
+/*-----------------------------------------------------------*/
+
+OtaEventData_t * OtaEventPool_Get( void )
+{
+    OtaEventData_t * pBuffer = NULL;
+
+    #if BUFFER_ARENA_ENABLED
+        pBuffer = BufferArena_Alloc( BufferArenaOwnerOta, sizeof( OtaEventData_t ) );
+    #else
+        uint32_t entry = popFree( &freeListHead, freeListNext );
+
+        if( entry != FREE_LIST_EMPTY )
+        {
+            pBuffer = &eventBuffers[ entry - 1U ];
+        }
+    #endif
+
+    if( pBuffer == NULL )
+    {
+        ( void ) __atomic_add_fetch( &poolStats.drops, 1U, __ATOMIC_RELAXED );
+    }
+    else
+    {
+        pBuffer->bufferUsed = true;
+        recordGet();
+    }
+
+    return pBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaEventPool_Free( OtaEventData_t * pBuffer )
+{
+    uint8_t * pBytes = ( uint8_t * ) pBuffer;
+    uint32_t index;
+    uint32_t * pHead = &freeListHead;
+    uint32_t * pNext = freeListNext;
+
+    #if BUFFER_ARENA_ENABLED
+        if( BufferArena_Contains( pBuffer ) )
+        {
+            /* The arena catches a buffer freed twice without touching it,
+             * as the slot may have been lent out again since. */
+            if( BufferArena_Free( BufferArenaOwnerOta, pBuffer ) == true )
+            {
+                ( void ) __atomic_sub_fetch( &poolStats.inUse, 1U, __ATOMIC_RELAXED );
+            }
+
+            return;
+        }
+    #else
+        if( ( pBuffer >= eventBuffers ) && ( pBuffer < &eventBuffers[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ] ) )
+        {
+            index = ( uint32_t ) ( pBuffer - eventBuffers );
+        }
+    #endif
+
+    #if OTA_EVENT_POOL_ZERO_COPY
+        else if( ( pSlabs != NULL ) && ( pBytes >= pSlabs ) && ( pBytes < pSlabs + ( slabSize * OTA_EVENT_POOL_SLABS ) ) )
+        {
+            index = ( uint32_t ) ( ( size_t ) ( pBytes - pSlabs ) / slabSize );
+            pHead = &slabListHead;
+            pNext = slabListNext;
+        }
+    #endif
+    else
+    {
+        LogError( ( "Buffer %p is not from the OTA event pool.", ( void * ) pBytes ) );
+        return;
+    }
+
+    if( !__atomic_exchange_n( &pBuffer->bufferUsed, false, __ATOMIC_RELAXED ) )
+    {
+        LogError( ( "OTA event buffer %p freed twice.", ( void * ) pBytes ) );
+    }
+    else
+    {
+        ( void ) __atomic_sub_fetch( &poolStats.inUse, 1U, __ATOMIC_RELAXED );
+
+        pushFree( pHead, pNext, index );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if OTA_EVENT_POOL_ZERO_COPY
+
+    void OtaEventPool_AttachSlabs( MQTTContext_t * pContext,
+                                   uint8_t * pSlabStorage,
+                                   size_t networkBufferSize )
+    {
+        uint32_t i;
+
+        assert( ( ( uintptr_t ) pSlabStorage & 3U ) == 0U );
+
+        pSlabs = pSlabStorage;
+        slabSize = OTA_EVENT_POOL_SLAB_SIZE( networkBufferSize );
+        slabNetworkBufferSize = networkBufferSize;
+        slabSkew = 0U;
+
+        /* The first slab is received into, the others are free. */
+        for( i = 1U; i < OTA_EVENT_POOL_SLABS; i++ )
+        {
+            slabListNext[ i ] = ( i + 1U < OTA_EVENT_POOL_SLABS ) ? ( i + 2U ) : FREE_LIST_EMPTY;
+        }
+
+        __atomic_store_n( &slabListHead, 2U, __ATOMIC_RELEASE );
+
+        pContext->networkBuffer.pBuffer = pSlabs;
+        pContext->networkBuffer.size = slabNetworkBufferSize;
+    }
+
+/*-----------------------------------------------------------*/
+
+    OtaEventData_t * OtaEventPool_TakePayload( MQTTContext_t * pContext,
+                                               const MQTTPublishInfo_t * pPublishInfo )
+    {
+        uint8_t * pPayload = ( uint8_t * ) pPublishInfo->pPayload;
+        uint8_t * pBuffer = pContext->networkBuffer.pBuffer;
+        OtaEventData_t * pEvent = NULL;
+        uint32_t entry;
+        size_t offset;
+
+        /* A payload not in the network buffer was copied already, for example
+         * for deferred dispatch, and is copied again by the caller. */
+        if( ( pSlabs == NULL ) || ( pPayload < pBuffer ) || ( pPayload >= pBuffer + pContext->networkBuffer.size ) ||
+            ( pPublishInfo->payloadLength > sizeof( pEvent->data ) ) )
+        {
+            return NULL;
+        }
+
+        offset = ( size_t ) ( pPayload - pBuffer );
+        slabSkew = ( 4U - ( offset & 3U ) ) & 3U;
+
+        /* The event fields behind the data are accessed as words. */
+        if( ( ( uintptr_t ) pPayload & 3U ) != 0U )
+        {
+            /* The caller copies this payload, so the slab can be shifted for the next one. */
+            pContext->networkBuffer.pBuffer = pSlabs + ( ( ( size_t ) ( pBuffer - pSlabs ) / slabSize ) * slabSize ) + slabSkew;
+        }
+        else
+        {
+            entry = popFree( &slabListHead, slabListNext );
+
+            if( entry != FREE_LIST_EMPTY )
+            {
+                /* The slab holding the payload now belongs to the OTA agent
+                 * until the event is freed, and the next packet is received
+                 * into the free slab. coreMQTT reads one packet at a time, so
+                 * nothing else of the old slab is used after this callback. */
+                pEvent = ( OtaEventData_t * ) pPayload;
+                pEvent->dataLength = ( uint32_t ) pPublishInfo->payloadLength;
+                pEvent->bufferUsed = true;
+
+                pContext->networkBuffer.pBuffer = pSlabs + ( ( entry - 1U ) * slabSize ) + slabSkew;
+                pContext->networkBuffer.size = slabNetworkBufferSize;
+
+                ( void ) __atomic_add_fetch( &poolStats.zeroCopy, 1U, __ATOMIC_RELAXED );
+                recordGet();
+            }
+        }
+
+        return pEvent;
+    }
+
+#endif /* OTA_EVENT_POOL_ZERO_COPY */
+
+/*-----------------------------------------------------------*/
+
+void OtaEventPool_GetStats( OtaEventPoolStats_t * pStats )
+{
+    pStats->gets = __atomic_load_n( &poolStats.gets, __ATOMIC_RELAXED );
+    pStats->drops = __atomic_load_n( &poolStats.drops, __ATOMIC_RELAXED );
+    pStats->inUse = __atomic_load_n( &poolStats.inUse, __ATOMIC_RELAXED );
+    pStats->highWater = __atomic_load_n( &poolStats.highWater, __ATOMIC_RELAXED );
+    pStats->zeroCopy = __atomic_load_n( &poolStats.zeroCopy, __ATOMIC_RELAXED );
+}
@@ -0,0 +1,149 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_event_pool.h
+ * @brief A lock-free pool of the OTA event buffers that carry job documents
+ * and file blocks from the network callbacks to the OTA agent.
+ *
+ * With CONFIG_BUFFER_ARENA_ENABLE, the buffers are borrowed from the shared
+ * buffer arena while they are in use, rather than kept in the pool.
+ */
+
+#ifndef OTA_EVENT_POOL_H_
+#define OTA_EVENT_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include OTA library, for OtaEventData_t and otaconfigMAX_NUM_OTA_DATA_BUFFERS. */
+#include "ota.h"
+#include "ota_config.h"
+
+/* Include MQTT library, for the zero-copy mode. */
+#include "core_mqtt.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether received MQTT payloads can be handed to the OTA agent in place.
+ */
+#define OTA_EVENT_POOL_ZERO_COPY    CONFIG_OTA_EVENT_POOL_ZERO_COPY
+
+#if OTA_EVENT_POOL_ZERO_COPY
+
+/**
+ * @brief The number of slabs the MQTT network buffer is split into.
+ */
+    #define OTA_EVENT_POOL_SLABS    CONFIG_OTA_EVENT_POOL_SLABS
+
+/**
+ * @brief Bytes of a slab for an MQTT network buffer of networkBufferSize
+ * bytes. Behind the network buffer, a slab has room for the fields of an
+ * event that follow the data, and for shifting the buffer so that the
+ * payload is word aligned.
+ */
+    #define OTA_EVENT_POOL_SLAB_SIZE( networkBufferSize ) \
+    ( ( ( networkBufferSize ) + sizeof( OtaEventData_t ) + 7U ) & ~( ( size_t ) 3U ) )
+#endif
+
+/**
+ * @brief Counters of the pool, as returned by OtaEventPool_GetStats.
+ */
+typedef struct OtaEventPoolStats
+{
+    uint32_t gets;      /**< @brief Buffers handed out. */
+    uint32_t drops;     /**< @brief Calls to OtaEventPool_Get that found every buffer in use. */
+    uint32_t inUse;     /**< @brief Buffers handed out and not freed yet. */
+    uint32_t highWater; /**< @brief The most buffers that were in use at once. */
+    uint32_t zeroCopy;  /**< @brief Payloads handed over in place by OtaEventPool_TakePayload. */
+} OtaEventPoolStats_t;
+
+/**
+ * @brief Put every buffer of the pool in the free list and clear the counters.
+ *
+ * Must be called before the OTA agent starts, while no buffer is in use.
+ */
+void OtaEventPool_Init( void );
+
+/**
+ * @brief Take a buffer from the pool without blocking.
+ *
+ * Tasks and callbacks taking and freeing buffers concurrently never make
+ * each other fail, so this only returns NULL when every buffer is in use.
+ *
+ * @return The buffer, or NULL if the pool is empty, or with the buffer
+ * arena, if the OTA quota of the arena is used up or no slot is free.
+ */
+OtaEventData_t * OtaEventPool_Get( void );
+
+/**
+ * @brief Return a buffer taken with OtaEventPool_Get or
+ * OtaEventPool_TakePayload to the pool.
+ *
+ * @param[in] pBuffer The buffer.
+ */
+void OtaEventPool_Free( OtaEventData_t * pBuffer );
+
+#if OTA_EVENT_POOL_ZERO_COPY
+
+/**
+ * @brief Receive MQTT packets into slabs that can be handed to the OTA agent.
+ *
+ * Replaces the network buffer of the MQTT context given to MQTT_Init.
+ *
+ * @param[in] pContext The MQTT context.
+ * @param[in] pSlabStorage #OTA_EVENT_POOL_SLABS slabs of
+ * #OTA_EVENT_POOL_SLAB_SIZE( networkBufferSize ) bytes, word aligned.
+ * @param[in] networkBufferSize The size of the network buffer in each slab.
+ */
+    void OtaEventPool_AttachSlabs( MQTTContext_t * pContext,
+                                   uint8_t * pSlabStorage,
+                                   size_t networkBufferSize );
+
+/**
+ * @brief Turn a received payload into an OTA event without copying it.
+ *
+ * Must be called from the MQTT event callback. The slab holding the payload
+ * is taken out of the MQTT context, which receives the next packet into a
+ * free slab, and is returned with OtaEventPool_Free.
+ *
+ * @param[in] pContext The MQTT context the payload was received with.
+ * @param[in] pPublishInfo The received PUBLISH.
+ *
+ * @return The event holding the payload, or NULL if the payload has to be
+ * copied into a buffer from OtaEventPool_Get: it isn't in a slab or isn't
+ * word aligned, or no slab is free.
+ */
+    OtaEventData_t * OtaEventPool_TakePayload( MQTTContext_t * pContext,
+                                               const MQTTPublishInfo_t * pPublishInfo );
+#endif /* OTA_EVENT_POOL_ZERO_COPY */
+
+/**
+ * @brief Read the counters of the pool.
+ *
+ * @param[out] pStats Where to copy the counters.
+ */
+void OtaEventPool_GetStats( OtaEventPoolStats_t * pStats );
+
+#endif /* ifndef OTA_EVENT_POOL_H_ */
@@ -0,0 +1,525 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_peer_server.c
+ * @brief Implementation of the OTA peer server.
+ *
+ * The requests are answered by the handler of an esp_http_server instance.
+ * The status line and headers of a response are written by the handler, so
+ * that the body can be sent with a Content-Length a mapped window of flash at
+ * a time, without copying it: httpd_resp_send needs the whole body in one
+ * buffer and httpd_resp_send_chunk always uses chunked encoding.
+ *
+ * The length of the image is that of the ESP application image at the start
+ * of the running partition, which is the file the OTA job signed. It is read
+ * from the image headers on the first request and kept, as the running
+ * partition only changes with a reboot.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the OTA peer server. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "OTA Peer Server"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* ESP-IDF includes. */
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+#include "esp_image_format.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+
+#include "ota_peer_server.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The length of the longest Range header taken.
+ */
+#define RANGE_HEADER_LENGTH        ( 64U )
+
+/**
+ * @brief The length of the longest status line and headers of a response.
+ */
+#define RESPONSE_HEADER_LENGTH     ( 192U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The part of the image a request asks for.
+ */
+typedef enum RangeResult
+{
+    RangeWhole,        /**< @brief No Range header, or one that is not understood: send the whole image. */
+    RangeSatisfiable,  /**< @brief Send the range. */
+    RangeUnsatisfiable /**< @brief The range starts past the end of the image. */
+} RangeResult_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The running HTTP server, or NULL.
+ */
+static httpd_handle_t serverHandle = NULL;
+
+/**
+ * @brief The length of the running image, or 0 until it has been read.
+ */
+static uint32_t imageLength = 0U;
+
+/**
+ * @brief The counters of the server.
+ */
+static OtaPeerServerStats_t serverStats;
+
+/**
+ * @brief Guards serverStats, which is read from other tasks.
+ */
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add to a counter of the server.
+ */
+#define STATS_ADD( field, n )                 \
+    do {                                      \
+        portENTER_CRITICAL( &statsLock );     \
+        serverStats.field += ( n );           \
+        portEXIT_CRITICAL( &statsLock );      \
+    } while( 0 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Get the running partition and the length of its image, if the image
+ * can be served to peers.
+ *
+ * @param[out] ppPartition The running partition.
+ * @param[out] pLength The length of its image.
+ *
+ * @return true if the image is in an OTA app partition and was accepted.
+ */
+static bool servableImage( const esp_partition_t ** ppPartition,
+                           uint32_t * pLength )
+{
+    const esp_partition_t * pRunning = esp_ota_get_running_partition();
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+    bool servable = false;
+
+    if( ( pRunning == NULL ) ||
+        ( pRunning->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MIN ) ||
+        ( pRunning->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MAX ) )
+    {
+        LogDebug( ( "The running image was not installed by OTA." ) );
+    }
+    else if( esp_ota_get_state_partition( pRunning, &state ) != ESP_OK )
+    {
+        LogError( ( "Failed to read the OTA state of partition %s.", pRunning->label ) );
+    }
+    /* Without rollback an installed image stays undefined; with it, the image
+     * is only valid once it has passed its self-test. */
+    else if( ( state != ESP_OTA_IMG_VALID ) && ( state != ESP_OTA_IMG_UNDEFINED ) )
+    {
+        LogDebug( ( "The running image is not accepted yet: state=%d.", ( int ) state ) );
+    }
+    else
+    {
+        if( imageLength == 0U )
+        {
+            const esp_partition_pos_t position =
+            {
+                .offset = pRunning->address,
+                .size   = pRunning->size
+            };
+            esp_image_metadata_t metadata;
+
+            if( ( esp_image_get_metadata( &position, &metadata ) == ESP_OK ) &&
+                ( metadata.image_len > 0U ) && ( metadata.image_len <= pRunning->size ) )
+            {
+                imageLength = metadata.image_len;
+                LogInfo( ( "Serving the image of %u bytes in partition %s.",
+                           ( unsigned ) imageLength, pRunning->label ) );
+            }
+            else
+            {
+                LogError( ( "Failed to read the image headers of partition %s.", pRunning->label ) );
+            }
+        }
+
+        *ppPartition = pRunning;
+        *pLength = imageLength;
+        servable = ( imageLength > 0U );
+    }
+
+    return servable;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the range of the image a request asks for, from its Range
+ * header. Only a single range in bytes is understood, as the OTA agent asks.
+ *
+ * @param[in] pRequest The request.
+ * @param[in] length The length of the image.
+ * @param[out] pFirst The first byte to send.
+ * @param[out] pLast The last byte to send.
+ *
+ * @return Whether to send the range, the whole image, or neither.
+ */
+static RangeResult_t requestedRange( httpd_req_t * pRequest,
+                                     uint32_t length,
+                                     uint32_t * pFirst,
+                                     uint32_t * pLast )
+{
+    char range[ RANGE_HEADER_LENGTH ];
+    const char * pSpec = NULL;
+    char * pEnd = NULL;
+    unsigned long first = 0UL;
+    unsigned long last = length - 1U;
+    RangeResult_t result = RangeWhole;
+
+    if( ( httpd_req_get_hdr_value_str( pRequest, "Range", range, sizeof( range ) ) == ESP_OK ) &&
+        ( strncmp( range, "bytes=", 6 ) == 0 ) && ( strchr( range, ',' ) == NULL ) )
+    {
+        pSpec = &range[ 6 ];
+
+        if( *pSpec == '-' )
+        {
+            /* The last n bytes. */
+            unsigned long suffix = strtoul( pSpec + 1, &pEnd, 10 );
+
+            if( ( pEnd != pSpec + 1 ) && ( *pEnd == '\0' ) )
+            {
+                result = ( suffix == 0UL ) ? RangeUnsatisfiable : RangeSatisfiable;
+                first = ( suffix < length ) ? ( length - suffix ) : 0UL;
+            }
+        }
+        else
+        {
+            first = strtoul( pSpec, &pEnd, 10 );
+
+            if( ( pEnd != pSpec ) && ( *pEnd == '-' ) )
+            {
+                /* The last byte may be left out, up to the end of the image. */
+                pSpec = pEnd + 1;
+                pEnd = ( char * ) pSpec;
+
+                if( *pSpec != '\0' )
+                {
+                    last = strtoul( pSpec, &pEnd, 10 );
+                }
+
+                if( *pEnd != '\0' )
+                {
+                    /* Not a range in bytes, which is ignored. */
+                }
+                else if( first >= length )
+                {
+                    result = RangeUnsatisfiable;
+                }
+                else if( last >= first )
+                {
+                    result = RangeSatisfiable;
+                    last = ( last < length ) ? last : ( length - 1U );
+                }
+                else
+                {
+                    /* An invalid range, which is ignored. */
+                }
+            }
+        }
+    }
+
+    if( result == RangeWhole )
+    {
+        first = 0UL;
+        last = length - 1U;
+    }
+
+    *pFirst = ( uint32_t ) first;
+    *pLast = ( uint32_t ) last;
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Send all of a buffer on the socket of a request.
+ *
+ * @return true if every byte was sent.
+ */
+static bool sendAll( httpd_req_t * pRequest,
+                     const char * pBuffer,
+                     size_t length )
+{
+    size_t sent = 0U;
+    int bytes = 0;
+
+    while( ( sent < length ) && ( bytes >= 0 ) )
+    {
+        bytes = httpd_send( pRequest, &pBuffer[ sent ], length - sent );
+
+        if( bytes > 0 )
+        {
+            sent += ( size_t ) bytes;
+        }
+        else
+        {
+            /* A peer that stops reading for the send timeout of the server
+             * is given up on, as one that closed the connection. */
+            bytes = -1;
+        }
+    }
+
+    return sent == length;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Send bytes first to last of the image in a partition, a mapped
+ * window at a time.
+ *
+ * @return true if every byte was sent.
+ */
+static bool sendImage( httpd_req_t * pRequest,
+                       const esp_partition_t * pPartition,
+                       uint32_t first,
+                       uint32_t last )
+{
+    uint32_t offset = first;
+    bool success = true;
+
+    while( success && ( offset <= last ) )
+    {
+        uint32_t window = last - offset + 1U;
+        const void * pWindow = NULL;
+        spi_flash_mmap_handle_t mapHandle;
+        esp_err_t err;
+
+        if( window > OTA_PEER_SERVER_MMAP_WINDOW )
+        {
+            window = OTA_PEER_SERVER_MMAP_WINDOW;
+        }
+
+        err = esp_partition_mmap( pPartition, offset, window, SPI_FLASH_MMAP_DATA,
+                                  &pWindow, &mapHandle );
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Failed to map %u bytes at offset %u of partition %s: %s.",
+                        ( unsigned ) window, ( unsigned ) offset, pPartition->label,
+                        esp_err_to_name( err ) ) );
+            success = false;
+        }
+        else
+        {
+            success = sendAll( pRequest, pWindow, window );
+            spi_flash_munmap( mapHandle );
+
+            if( success )
+            {
+                STATS_ADD( bytesSent, window );
+                offset += window;
+            }
+        }
+    }
+
+    return success;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Answer a request for the image.
+ */
+static esp_err_t imageGetHandler( httpd_req_t * pRequest )
+{
+    const esp_partition_t * pPartition = NULL;
+    const esp_app_desc_t * pAppDesc = esp_ota_get_app_description();
+    const char * pVersion = &pRequest->uri[ sizeof( OTA_PEER_SERVER_PATH_PREFIX ) - 1U ];
+    size_t versionLength = strcspn( pVersion, "?" );
+    uint32_t length = 0U;
+    uint32_t first = 0U;
+    uint32_t last = 0U;
+    char header[ RESPONSE_HEADER_LENGTH ];
+    int headerLength = 0;
+    RangeResult_t range;
+    esp_err_t ret = ESP_OK;
+
+    STATS_ADD( requests, 1U );
+
+    if( ( versionLength != strlen( pAppDesc->version ) ) ||
+        ( strncmp( pVersion, pAppDesc->version, versionLength ) != 0 ) ||
+        !servableImage( &pPartition, &length ) )
+    {
+        LogDebug( ( "Refused a request for %s.", pRequest->uri ) );
+        STATS_ADD( refused, 1U );
+        ret = httpd_resp_send_err( pRequest, HTTPD_404_NOT_FOUND, NULL );
+    }
+    else
+    {
+        range = requestedRange( pRequest, length, &first, &last );
+
+        if( range == RangeUnsatisfiable )
+        {
+            headerLength = snprintf( header, sizeof( header ),
+                                     "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                                     "Content-Range: bytes */%u\r\n"
+                                     "Content-Length: 0\r\n\r\n",
+                                     ( unsigned ) length );
+        }
+        else if( range == RangeSatisfiable )
+        {
+            headerLength = snprintf( header, sizeof( header ),
+                                     "HTTP/1.1 206 Partial Content\r\n"
+                                     "Content-Type: application/octet-stream\r\n"
+                                     "Content-Range: bytes %u-%u/%u\r\n"
+                                     "Content-Length: %u\r\n\r\n",
+                                     ( unsigned ) first, ( unsigned ) last, ( unsigned ) length,
+                                     ( unsigned ) ( last - first + 1U ) );
+        }
+        else
+        {
+            headerLength = snprintf( header, sizeof( header ),
+                                     "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: application/octet-stream\r\n"
+                                     "Accept-Ranges: bytes\r\n"
+                                     "Content-Length: %u\r\n\r\n",
+                                     ( unsigned ) length );
+        }
+
+        if( !sendAll( pRequest, header, ( size_t ) headerLength ) ||
+            ( ( range != RangeUnsatisfiable ) && !sendImage( pRequest, pPartition, first, last ) ) )
+        {
+            LogWarn( ( "Failed to send bytes %u-%u of the image to a peer.",
+                       ( unsigned ) first, ( unsigned ) last ) );
+            STATS_ADD( failures, 1U );
+
+            /* The server closes the connection, as the response is cut short. */
+            ret = ESP_FAIL;
+        }
+        else
+        {
+            STATS_ADD( served, 1U );
+        }
+    }
+
+    return ret;
+}
+
+/*-----------------------------------------------------------*/
+
+esp_err_t OtaPeerServer_Start( void )
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    const httpd_uri_t imageUri =
+    {
+        .uri      = OTA_PEER_SERVER_PATH_PREFIX "*",
+        .method   = HTTP_GET,
+        .handler  = imageGetHandler,
+        .user_ctx = NULL
+    };
+    esp_err_t err = ESP_OK;
+
+    if( serverHandle != NULL )
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        config.server_port = OTA_PEER_SERVER_PORT;
+        config.max_open_sockets = OTA_PEER_SERVER_MAX_CLIENTS;
+        config.max_uri_handlers = 1;
+        config.uri_match_fn = httpd_uri_match_wildcard;
+
+        /* A peer that went away must not keep a newer one out. */
+        config.lru_purge_enable = true;
+
+        err = httpd_start( &serverHandle, &config );
+
+        if( err == ESP_OK )
+        {
+            err = httpd_register_uri_handler( serverHandle, &imageUri );
+
+            if( err != ESP_OK )
+            {
+                ( void ) httpd_stop( serverHandle );
+                serverHandle = NULL;
+            }
+        }
+
+        if( err == ESP_OK )
+        {
+            LogInfo( ( "Serving the running image on port %d at %s%s.",
+                       OTA_PEER_SERVER_PORT, OTA_PEER_SERVER_PATH_PREFIX,
+                       esp_ota_get_app_description()->version ) );
+        }
+        else
+        {
+            LogError( ( "Failed to start the OTA peer server: %s.", esp_err_to_name( err ) ) );
+        }
+    }
+
+    return err;
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaPeerServer_Stop( void )
+{
+    if( serverHandle != NULL )
+    {
+        ( void ) httpd_stop( serverHandle );
+        serverHandle = NULL;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaPeerServer_GetStats( OtaPeerServerStats_t * pStats )
+{
+    portENTER_CRITICAL( &statsLock );
+    *pStats = serverStats;
+    portEXIT_CRITICAL( &statsLock );
+}
+
+/*-----------------------------------------------------------*/
@@ -0,0 +1,104 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_peer_server.h
+ * @brief Serve the running firmware image to other devices on the local
+ * network, so that they take an OTA update from a peer instead of the cloud.
+ *
+ * The image is served over plain HTTP at OTA_PEER_SERVER_PATH_PREFIX followed
+ * by the version of the running application, read straight from its app
+ * partition through the flash cache, with support for the Range requests the
+ * OTA agent fetches blocks with. It is only served once it has been accepted
+ * after its self-test, and only under its own version, so a job document can
+ * point at a peer known to run the version the job installs. The peer is not
+ * trusted: the devices downloading the image check the signature of the job
+ * document before booting it, as for an image from the cloud.
+ */
+
+#ifndef OTA_PEER_SERVER_H_
+#define OTA_PEER_SERVER_H_
+
+#include <stdint.h>
+
+/* Include ESP-IDF error codes. */
+#include "esp_err.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The TCP port the image is served on.
+ */
+#define OTA_PEER_SERVER_PORT           CONFIG_OTA_PEER_SERVER_PORT
+
+/**
+ * @brief The most peers downloading the image at once.
+ */
+#define OTA_PEER_SERVER_MAX_CLIENTS    CONFIG_OTA_PEER_SERVER_MAX_CLIENTS
+
+/**
+ * @brief The most of the image mapped into the address space at once, in
+ * bytes. A response is sent a window at a time.
+ */
+#define OTA_PEER_SERVER_MMAP_WINDOW    CONFIG_OTA_PEER_SERVER_MMAP_WINDOW
+
+/**
+ * @brief The path of the image, followed by the application version.
+ */
+#define OTA_PEER_SERVER_PATH_PREFIX    "/ota/"
+
+/**
+ * @brief Counters of the server, as returned by OtaPeerServer_GetStats.
+ */
+typedef struct OtaPeerServerStats
+{
+    uint32_t requests;  /**< @brief Requests for the image. */
+    uint32_t served;    /**< @brief Responses sent in full. */
+    uint32_t refused;   /**< @brief Requests for another version, or while the image is not accepted. */
+    uint32_t failures;  /**< @brief Responses cut short by a flash or socket error. */
+    uint64_t bytesSent; /**< @brief Bytes of the image sent. */
+} OtaPeerServerStats_t;
+
+/**
+ * @brief Start serving the running image.
+ *
+ * Requests are answered from a task of the HTTP server, one at a time. Until
+ * the running image is accepted, or if it isn't in an OTA app partition,
+ * requests are refused with 404 Not Found.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the server is already running, or
+ * the error of the HTTP server.
+ */
+esp_err_t OtaPeerServer_Start( void );
+
+/**
+ * @brief Stop serving the image and close the connections of the peers.
+ */
+void OtaPeerServer_Stop( void );
+
+/**
+ * @brief Copy the counters of the server into pStats.
+ */
+void OtaPeerServer_GetStats( OtaPeerServerStats_t * pStats );
+
+#endif /* ifndef OTA_PEER_SERVER_H_ */
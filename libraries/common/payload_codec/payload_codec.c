@@ -0,0 +1,577 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file payload_codec.c
+ * @brief Implementation of the payload codec.
+ *
+ * The compressor finds the longest repeat at each position through hash
+ * chains of the positions starting with the same 2 bytes, walking at most
+ * #MAX_CHAIN_STEPS of them, so its time grows with the payload and not with
+ * the window.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the payload codec. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Payload Codec"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "payload_codec.h"
+
+#if ( PAYLOAD_CODEC_WINDOW_BITS < 8 ) || ( PAYLOAD_CODEC_WINDOW_BITS > 12 )
+    #error "PAYLOAD_CODEC_WINDOW_BITS must be between 8 and 12."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The first 2 bytes of a compressed payload.
+ */
+#define MARKER_0                   0x00U
+#define MARKER_1                   0xC0U
+
+/**
+ * @brief The version of #dictionary, in the header.
+ */
+#define DICTIONARY_VERSION         1U
+
+/**
+ * @brief The bits of the length of a repeat, and its shortest and longest
+ * length. A repeat of 2 bytes takes fewer bits than 2 literals.
+ */
+#define LENGTH_BITS                5U
+#define MIN_MATCH                  2U
+#define MAX_MATCH                  ( MIN_MATCH + ( 1U << LENGTH_BITS ) - 1U )
+
+/**
+ * @brief The most positions of a hash chain compared at each position.
+ */
+#define MAX_CHAIN_STEPS            32U
+
+/**
+ * @brief The window of the compressor.
+ */
+#define WINDOW_SIZE                ( 1U << PAYLOAD_CODEC_WINDOW_BITS )
+
+/**
+ * @brief The hash chain of the 2 bytes starting with @a a.
+ */
+#define HASH( a, b )               ( ( ( ( uint32_t ) ( a ) << 2 ) ^ ( uint32_t ) ( b ) ) & ( PAYLOAD_CODEC_HASH_SIZE - 1U ) )
+
+/**
+ * @brief The reserved topics, left alone unless #PAYLOAD_CODEC_AWS_TOPICS.
+ */
+#define AWS_TOPIC_PREFIX           "$aws/"
+#define AWS_TOPIC_PREFIX_LENGTH    ( sizeof( AWS_TOPIC_PREFIX ) - 1U )
+
+/**
+ * @brief What the window holds before the first byte of a payload: the keys
+ * and values repeated by the shadow and job documents. Changing it changes
+ * #DICTIONARY_VERSION, since the other side must use the same one.
+ */
+static const char dictionary[] =
+    "{\"state\":{\"reported\":{\"desired\":{\"delta\":{\"metadata\":{"
+    "\"timestamp\":\"version\":\"clientToken\":\"execution\":{\"jobId\":\""
+    "\"status\":\"QUEUED\",\"IN_PROGRESS\",\"SUCCEEDED\",\"FAILED\","
+    "\"statusDetails\":{\"jobDocument\":{\"queuedAt\":\"lastUpdatedAt\":"
+    "\"versionNumber\":\"executionNumber\":true,\"false,\"null,\"}}}";
+
+/**
+ * @brief The bytes of #dictionary, without its terminator.
+ */
+#define DICTIONARY_LENGTH          ( sizeof( dictionary ) - 1U )
+
+/* Positions in the dictionary and the payload must fit in the chains. */
+#if ( PAYLOAD_CODEC_MAX_SIZE > 32768 )
+    #error "PAYLOAD_CODEC_MAX_SIZE must be at most 32768."
+#endif
+
+/**
+ * @brief Writes a stream of bits, most significant first.
+ */
+typedef struct BitWriter
+{
+    uint8_t * pBuffer;
+    size_t length;
+    size_t index;
+    uint8_t mask;
+    bool full;
+} BitWriter_t;
+
+/**
+ * @brief Reads a stream of bits, most significant first.
+ */
+typedef struct BitReader
+{
+    const uint8_t * pBuffer;
+    size_t length;
+    size_t index;
+    uint8_t mask;
+} BitReader_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes the @a count lower bits of @a value. Sets
+ * #BitWriter_t.full once a bit doesn't fit.
+ */
+static void writeBits( BitWriter_t * pWriter,
+                       uint32_t value,
+                       uint32_t count );
+
+/**
+ * @brief Reads @a count bits into @a pValue.
+ *
+ * @return false if the stream ends first.
+ */
+static bool readBits( BitReader_t * pReader,
+                      uint32_t count,
+                      uint32_t * pValue );
+
+/**
+ * @brief The byte at a position of the dictionary followed by the payload.
+ */
+static uint8_t windowByte( const uint8_t * pPayload,
+                           size_t position );
+
+/**
+ * @brief Adds a position to its hash chain, if a byte follows it.
+ */
+static void insertPosition( PayloadCodecWorkspace_t * pWorkspace,
+                            const uint8_t * pPayload,
+                            size_t position,
+                            size_t end );
+
+/**
+ * @brief Finds the longest repeat of the bytes at @a position.
+ *
+ * @return Its length, or 0 if there isn't one of #MIN_MATCH bytes.
+ */
+static size_t findMatch( const PayloadCodecWorkspace_t * pWorkspace,
+                         const uint8_t * pPayload,
+                         size_t position,
+                         size_t end,
+                         size_t * pDistance );
+
+/*-----------------------------------------------------------*/
+
+static void writeBits( BitWriter_t * pWriter,
+                       uint32_t value,
+                       uint32_t count )
+{
+    uint32_t bit = ( count > 0U ) ? ( 1UL << ( count - 1U ) ) : 0U;
+
+    for( ; ( bit != 0U ) && ( pWriter->full == false ); bit >>= 1 )
+    {
+        if( pWriter->index >= pWriter->length )
+        {
+            pWriter->full = true;
+        }
+        else
+        {
+            if( pWriter->mask == 0x80U )
+            {
+                pWriter->pBuffer[ pWriter->index ] = 0U;
+            }
+
+            if( ( value & bit ) != 0U )
+            {
+                pWriter->pBuffer[ pWriter->index ] |= pWriter->mask;
+            }
+
+            pWriter->mask >>= 1;
+
+            if( pWriter->mask == 0U )
+            {
+                pWriter->mask = 0x80U;
+                pWriter->index++;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool readBits( BitReader_t * pReader,
+                      uint32_t count,
+                      uint32_t * pValue )
+{
+    bool status = true;
+    uint32_t i;
+
+    *pValue = 0U;
+
+    for( i = 0U; ( i < count ) && ( status == true ); i++ )
+    {
+        if( pReader->index >= pReader->length )
+        {
+            status = false;
+        }
+        else
+        {
+            *pValue = ( *pValue << 1 ) |
+                      ( ( ( pReader->pBuffer[ pReader->index ] & pReader->mask ) != 0U ) ? 1U : 0U );
+            pReader->mask >>= 1;
+
+            if( pReader->mask == 0U )
+            {
+                pReader->mask = 0x80U;
+                pReader->index++;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint8_t windowByte( const uint8_t * pPayload,
+                           size_t position )
+{
+    return ( position < DICTIONARY_LENGTH ) ? ( uint8_t ) dictionary[ position ] :
+           pPayload[ position - DICTIONARY_LENGTH ];
+}
+
+/*-----------------------------------------------------------*/
+
+static void insertPosition( PayloadCodecWorkspace_t * pWorkspace,
+                            const uint8_t * pPayload,
+                            size_t position,
+                            size_t end )
+{
+    uint32_t hash;
+
+    if( ( position + 1U ) < end )
+    {
+        hash = HASH( windowByte( pPayload, position ), windowByte( pPayload, position + 1U ) );
+
+        /* Chains hold positions plus 1, so that 0 ends them. */
+        pWorkspace->prev[ position & ( WINDOW_SIZE - 1U ) ] = pWorkspace->head[ hash ];
+        pWorkspace->head[ hash ] = ( uint16_t ) ( position + 1U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t findMatch( const PayloadCodecWorkspace_t * pWorkspace,
+                         const uint8_t * pPayload,
+                         size_t position,
+                         size_t end,
+                         size_t * pDistance )
+{
+    size_t bestLength = 0U;
+    size_t longest = end - position;
+    size_t candidate = 0U;
+    size_t length = 0U;
+    uint32_t steps;
+
+    if( longest > MAX_MATCH )
+    {
+        longest = MAX_MATCH;
+    }
+
+    if( longest >= MIN_MATCH )
+    {
+        candidate = pWorkspace->head[ HASH( windowByte( pPayload, position ),
+                                            windowByte( pPayload, position + 1U ) ) ];
+
+        for( steps = 0U; ( steps < MAX_CHAIN_STEPS ) && ( candidate != 0U ); steps++ )
+        {
+            candidate--;
+
+            /* Beyond the window, the chain was overwritten by newer positions. */
+            if( ( position - candidate ) > WINDOW_SIZE )
+            {
+                break;
+            }
+
+            for( length = 0U;
+                 ( length < longest ) &&
+                 ( windowByte( pPayload, candidate + length ) == windowByte( pPayload, position + length ) );
+                 length++ )
+            {
+            }
+
+            if( length > bestLength )
+            {
+                bestLength = length;
+                *pDistance = position - candidate;
+
+                if( length == longest )
+                {
+                    break;
+                }
+            }
+
+            /* A link to a position at or after this one is stale. */
+            if( ( size_t ) pWorkspace->prev[ candidate & ( WINDOW_SIZE - 1U ) ] > candidate )
+            {
+                break;
+            }
+
+            candidate = pWorkspace->prev[ candidate & ( WINDOW_SIZE - 1U ) ];
+        }
+    }
+
+    return ( bestLength >= MIN_MATCH ) ? bestLength : 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+bool PayloadCodec_ShouldEncode( const char * pTopic,
+                                uint16_t topicLength,
+                                size_t payloadLength )
+{
+    bool reserved = ( topicLength >= AWS_TOPIC_PREFIX_LENGTH ) &&
+                    ( memcmp( pTopic, AWS_TOPIC_PREFIX, AWS_TOPIC_PREFIX_LENGTH ) == 0 );
+
+    #if PAYLOAD_CODEC_AWS_TOPICS
+        reserved = false;
+    #endif
+
+    return ( reserved == false ) &&
+           ( payloadLength >= PAYLOAD_CODEC_THRESHOLD ) &&
+           ( payloadLength <= PAYLOAD_CODEC_MAX_SIZE );
+}
+
+/*-----------------------------------------------------------*/
+
+bool PayloadCodec_Encode( PayloadCodecWorkspace_t * pWorkspace,
+                          const uint8_t * pPayload,
+                          size_t payloadLength,
+                          uint8_t * pBuffer,
+                          size_t bufferLength,
+                          size_t * pEncodedLength )
+{
+    BitWriter_t writer = { 0 };
+    size_t end = DICTIONARY_LENGTH + payloadLength;
+    size_t position = 0U;
+    size_t length = 0U;
+    size_t distance = 0U;
+    size_t i;
+
+    assert( ( pWorkspace != NULL ) && ( pPayload != NULL ) && ( pBuffer != NULL ) );
+    assert( payloadLength <= PAYLOAD_CODEC_MAX_SIZE );
+
+    /* A payload that doesn't get smaller is sent as it is. */
+    if( bufferLength >= payloadLength )
+    {
+        bufferLength = ( payloadLength > 0U ) ? ( payloadLength - 1U ) : 0U;
+    }
+
+    if( bufferLength > PAYLOAD_CODEC_HEADER_SIZE )
+    {
+        pBuffer[ 0 ] = MARKER_0;
+        pBuffer[ 1 ] = MARKER_1;
+        pBuffer[ 2 ] = ( uint8_t ) ( ( DICTIONARY_VERSION << 4 ) | PAYLOAD_CODEC_WINDOW_BITS );
+        pBuffer[ 3 ] = ( uint8_t ) ( payloadLength >> 24 );
+        pBuffer[ 4 ] = ( uint8_t ) ( payloadLength >> 16 );
+        pBuffer[ 5 ] = ( uint8_t ) ( payloadLength >> 8 );
+        pBuffer[ 6 ] = ( uint8_t ) payloadLength;
+
+        writer.pBuffer = &pBuffer[ PAYLOAD_CODEC_HEADER_SIZE ];
+        writer.length = bufferLength - PAYLOAD_CODEC_HEADER_SIZE;
+        writer.mask = 0x80U;
+
+        ( void ) memset( pWorkspace->head, 0x00, sizeof( pWorkspace->head ) );
+
+        for( position = 0U; position < DICTIONARY_LENGTH; position++ )
+        {
+            insertPosition( pWorkspace, pPayload, position, end );
+        }
+
+        while( ( position < end ) && ( writer.full == false ) )
+        {
+            length = findMatch( pWorkspace, pPayload, position, end, &distance );
+
+            if( length == 0U )
+            {
+                writeBits( &writer, 1U, 1U );
+                writeBits( &writer, windowByte( pPayload, position ), 8U );
+                length = 1U;
+            }
+            else
+            {
+                writeBits( &writer, 0U, 1U );
+                writeBits( &writer, ( uint32_t ) ( distance - 1U ), PAYLOAD_CODEC_WINDOW_BITS );
+                writeBits( &writer, ( uint32_t ) ( length - MIN_MATCH ), LENGTH_BITS );
+            }
+
+            for( i = 0U; i < length; i++ )
+            {
+                insertPosition( pWorkspace, pPayload, position + i, end );
+            }
+
+            position += length;
+        }
+    }
+
+    if( ( writer.pBuffer == NULL ) || ( position != end ) )
+    {
+        writer.full = true;
+    }
+    else if( writer.full == false )
+    {
+        /* A byte partly written is sent too. */
+        *pEncodedLength = PAYLOAD_CODEC_HEADER_SIZE + writer.index + ( ( writer.mask == 0x80U ) ? 0U : 1U );
+    }
+    else
+    {
+        /* The payload doesn't get smaller. */
+    }
+
+    return ( writer.full == false );
+}
+
+/*-----------------------------------------------------------*/
+
+bool PayloadCodec_IsEncoded( const uint8_t * pPayload,
+                             size_t payloadLength )
+{
+    return ( pPayload != NULL ) &&
+           ( payloadLength >= PAYLOAD_CODEC_HEADER_SIZE ) &&
+           ( pPayload[ 0 ] == MARKER_0 ) &&
+           ( pPayload[ 1 ] == MARKER_1 );
+}
+
+/*-----------------------------------------------------------*/
+
+bool PayloadCodec_Decode( const uint8_t * pPayload,
+                          size_t payloadLength,
+                          uint8_t * pBuffer,
+                          size_t bufferLength,
+                          size_t * pDecodedLength )
+{
+    bool status = PayloadCodec_IsEncoded( pPayload, payloadLength );
+    BitReader_t reader = { 0 };
+    uint32_t windowBits = 0U;
+    uint32_t flag = 0U;
+    uint32_t value = 0U;
+    uint32_t length = 0U;
+    size_t distance = 0U;
+    size_t decodedLength = 0U;
+    size_t written = 0U;
+
+    assert( ( pBuffer != NULL ) && ( pDecodedLength != NULL ) );
+
+    if( status == true )
+    {
+        windowBits = pPayload[ 2 ] & 0x0FU;
+        decodedLength = ( ( size_t ) pPayload[ 3 ] << 24 ) | ( ( size_t ) pPayload[ 4 ] << 16 ) |
+                        ( ( size_t ) pPayload[ 5 ] << 8 ) | ( size_t ) pPayload[ 6 ];
+
+        if( ( ( uint32_t ) pPayload[ 2 ] >> 4 ) != DICTIONARY_VERSION )
+        {
+            LogError( ( "Compressed payload with unknown dictionary %u.",
+                        ( unsigned ) ( pPayload[ 2 ] >> 4 ) ) );
+            status = false;
+        }
+        else if( ( windowBits < 8U ) || ( windowBits > 12U ) )
+        {
+            LogError( ( "Compressed payload with a window of %u bits.", ( unsigned ) windowBits ) );
+            status = false;
+        }
+        else if( decodedLength > bufferLength )
+        {
+            LogError( ( "Compressed payload of %u bytes doesn't fit in a buffer of %u bytes.",
+                        ( unsigned ) decodedLength,
+                        ( unsigned ) bufferLength ) );
+            status = false;
+        }
+        else
+        {
+            reader.pBuffer = &pPayload[ PAYLOAD_CODEC_HEADER_SIZE ];
+            reader.length = payloadLength - PAYLOAD_CODEC_HEADER_SIZE;
+            reader.mask = 0x80U;
+        }
+    }
+
+    while( ( status == true ) && ( written < decodedLength ) )
+    {
+        status = readBits( &reader, 1U, &flag );
+
+        if( ( status == true ) && ( flag == 1U ) )
+        {
+            status = readBits( &reader, 8U, &value );
+
+            if( status == true )
+            {
+                pBuffer[ written++ ] = ( uint8_t ) value;
+            }
+        }
+        else if( status == true )
+        {
+            status = readBits( &reader, windowBits, &value ) &&
+                     readBits( &reader, LENGTH_BITS, &length );
+            distance = ( size_t ) value + 1U;
+            length += MIN_MATCH;
+
+            if( ( status == true ) &&
+                ( ( distance > ( DICTIONARY_LENGTH + written ) ) ||
+                  ( length > ( decodedLength - written ) ) ) )
+            {
+                status = false;
+            }
+
+            /* Byte by byte, since a repeat may overlap what it writes. */
+            for( ; ( status == true ) && ( length > 0U ); length-- )
+            {
+                pBuffer[ written ] = ( distance > written ) ?
+                                     ( uint8_t ) dictionary[ DICTIONARY_LENGTH + written - distance ] :
+                                     pBuffer[ written - distance ];
+                written++;
+            }
+        }
+        else
+        {
+            /* The stream ended before the payload. */
+        }
+    }
+
+    if( ( status == false ) && ( reader.pBuffer != NULL ) )
+    {
+        LogError( ( "Compressed payload is corrupt after %u of %u bytes.",
+                    ( unsigned ) written,
+                    ( unsigned ) decodedLength ) );
+    }
+
+    if( status == true )
+    {
+        *pDecodedLength = decodedLength;
+    }
+
+    return status;
+}
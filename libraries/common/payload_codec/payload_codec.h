@@ -0,0 +1,172 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file payload_codec.h
+ * @brief Compress MQTT payloads with LZSS, and expand them again.
+ *
+ * A compressed payload is a 7-byte header followed by a bit stream, most
+ * significant bit first:
+ *
+ * - byte 0 is 0x00 and byte 1 is 0xC0, which no JSON or UTF-8 text starts
+ *   with;
+ * - byte 2 is the dictionary version in the upper 4 bits, and the window
+ *   bits W in the lower 4;
+ * - bytes 3 to 6 are the length of the expanded payload, big-endian.
+ *
+ * In the stream, a 1 bit is followed by a literal byte, and a 0 bit by a
+ * repeat: W bits of its distance minus 1, and 5 bits of its length minus 2.
+ * The stream ends when the expanded length is reached. A repeat may reach
+ * back into the dictionary, which stands in the window before the first
+ * byte of the payload.
+ */
+
+#ifndef PAYLOAD_CODEC_H_
+#define PAYLOAD_CODEC_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the MQTT session compresses its payloads.
+ */
+#ifndef PAYLOAD_CODEC_ENABLED
+    #if CONFIG_PAYLOAD_CODEC_ENABLE
+        #define PAYLOAD_CODEC_ENABLED    1
+    #else
+        #define PAYLOAD_CODEC_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief The smallest and largest payloads compressed.
+ */
+#ifndef PAYLOAD_CODEC_THRESHOLD
+    #define PAYLOAD_CODEC_THRESHOLD    CONFIG_PAYLOAD_CODEC_THRESHOLD
+#endif
+#ifndef PAYLOAD_CODEC_MAX_SIZE
+    #define PAYLOAD_CODEC_MAX_SIZE    CONFIG_PAYLOAD_CODEC_MAX_SIZE
+#endif
+
+/**
+ * @brief How far back the compressor looks for a repeat, as a power of two.
+ */
+#ifndef PAYLOAD_CODEC_WINDOW_BITS
+    #define PAYLOAD_CODEC_WINDOW_BITS    CONFIG_PAYLOAD_CODEC_WINDOW_BITS
+#endif
+
+/**
+ * @brief Whether publishes to topics starting with "$aws/" are compressed.
+ */
+#ifndef PAYLOAD_CODEC_AWS_TOPICS
+    #define PAYLOAD_CODEC_AWS_TOPICS    CONFIG_PAYLOAD_CODEC_AWS_TOPICS
+#endif
+
+/**
+ * @brief The bytes of the header of a compressed payload.
+ */
+#define PAYLOAD_CODEC_HEADER_SIZE    7U
+
+/**
+ * @brief The number of heads of the hash chains of the compressor.
+ */
+#define PAYLOAD_CODEC_HASH_SIZE      1024U
+
+/**
+ * @brief The search tables of the compressor, provided by the caller so that
+ * tasks compressing at the same time don't share them.
+ *
+ * The fields are private to this module.
+ */
+typedef struct PayloadCodecWorkspace
+{
+    uint16_t head[ PAYLOAD_CODEC_HASH_SIZE ];
+    uint16_t prev[ 1U << PAYLOAD_CODEC_WINDOW_BITS ];
+} PayloadCodecWorkspace_t;
+
+/**
+ * @brief Whether a publish is worth compressing: its size is within the
+ * threshold and #PAYLOAD_CODEC_MAX_SIZE, and its topic isn't reserved.
+ *
+ * @param[in] pTopic The topic.
+ * @param[in] topicLength Length of @a pTopic.
+ * @param[in] payloadLength Length of the payload.
+ */
+bool PayloadCodec_ShouldEncode( const char * pTopic,
+                                uint16_t topicLength,
+                                size_t payloadLength );
+
+/**
+ * @brief Compresses a payload.
+ *
+ * @param[in] pWorkspace The search tables, overwritten.
+ * @param[in] pPayload The payload.
+ * @param[in] payloadLength Length of @a pPayload, at most
+ * #PAYLOAD_CODEC_MAX_SIZE.
+ * @param[out] pBuffer Where the compressed payload is written.
+ * @param[in] bufferLength Size of @a pBuffer.
+ * @param[out] pEncodedLength Length of the compressed payload.
+ *
+ * @return false if the compressed payload wouldn't be smaller than
+ * @a payloadLength, or wouldn't fit in @a pBuffer. The payload should then
+ * be sent as it is.
+ */
+bool PayloadCodec_Encode( PayloadCodecWorkspace_t * pWorkspace,
+                          const uint8_t * pPayload,
+                          size_t payloadLength,
+                          uint8_t * pBuffer,
+                          size_t bufferLength,
+                          size_t * pEncodedLength );
+
+/**
+ * @brief Whether a payload starts with the marker of a compressed payload.
+ */
+bool PayloadCodec_IsEncoded( const uint8_t * pPayload,
+                             size_t payloadLength );
+
+/**
+ * @brief Expands a compressed payload. The buffer is the window, so no other
+ * memory is used.
+ *
+ * @param[in] pPayload The compressed payload, header included.
+ * @param[in] payloadLength Length of @a pPayload.
+ * @param[out] pBuffer Where the payload is expanded.
+ * @param[in] bufferLength Size of @a pBuffer.
+ * @param[out] pDecodedLength Length of the expanded payload.
+ *
+ * @return false if the header is unknown, the expanded payload doesn't fit
+ * in @a pBuffer, or the stream is truncated or reaches before the
+ * dictionary.
+ */
+bool PayloadCodec_Decode( const uint8_t * pPayload,
+                          size_t payloadLength,
+                          uint8_t * pBuffer,
+                          size_t bufferLength,
+                          size_t * pDecodedLength );
+
+#endif /* ifndef PAYLOAD_CODEC_H_ */
@@ -0,0 +1,206 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file perf_metrics.c
+ * @brief Implementation of the performance metrics registry.
+ *
+ * The registry is a list linked through the metrics, pushed to with a
+ * compare-and-swap, so that registering takes no lock and no storage of its
+ * own. Metrics are never removed, so the exporter walks the list without a
+ * lock either.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+
+#include "perf_metrics.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The index of the live value of @a bucket in pValues.
+ */
+#define LIVE( pMetric, bucket )         ( bucket )
+
+/**
+ * @brief The index of the snapshot of @a bucket in pValues.
+ */
+#define SNAPSHOT( pMetric, bucket )     ( ( pMetric )->bucketCount + ( bucket ) )
+
+/**
+ * @brief The index of the committed snapshot of @a bucket in pValues.
+ */
+#define COMMITTED( pMetric, bucket )    ( ( 2U * ( pMetric )->bucketCount ) + ( bucket ) )
+
+/**
+ * @brief The metric registered last, the head of the registry.
+ */
+static PerfMetric_t * registryHead = NULL;
+
+/**
+ * @brief The head of the registry when the snapshot was taken. Metrics
+ * registered since are only iterated from the next snapshot.
+ */
+static PerfMetric_t * snapshotHead = NULL;
+
+/*-----------------------------------------------------------*/
+
+void PerfMetrics_Register( PerfMetric_t * pMetric )
+{
+    PerfMetric_t * pHead = NULL;
+
+    assert( pMetric != NULL );
+
+    if( __atomic_exchange_n( &pMetric->registered, true, __ATOMIC_RELAXED ) == false )
+    {
+        pHead = __atomic_load_n( &registryHead, __ATOMIC_RELAXED );
+
+        do
+        {
+            pMetric->pNext = pHead;
+        } while( !__atomic_compare_exchange_n( &registryHead, &pHead, pMetric, true,
+                                               __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void PerfMetrics_Add( PerfMetric_t * pMetric,
+                      uint32_t amount )
+{
+    assert( ( pMetric != NULL ) && ( pMetric->type == PerfMetricCounter ) );
+
+    ( void ) __atomic_add_fetch( &pMetric->pValues[ LIVE( pMetric, 0U ) ], amount, __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+void PerfMetrics_Set( PerfMetric_t * pMetric,
+                      uint32_t value )
+{
+    assert( ( pMetric != NULL ) && ( pMetric->type == PerfMetricGauge ) );
+
+    __atomic_store_n( &pMetric->pValues[ LIVE( pMetric, 0U ) ], value, __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+void PerfMetrics_Observe( PerfMetric_t * pMetric,
+                          uint32_t value )
+{
+    size_t bucket = 0U;
+
+    assert( ( pMetric != NULL ) && ( pMetric->type == PerfMetricHistogram ) );
+
+    /* Histograms have a handful of buckets, so a linear search is enough. */
+    while( ( bucket < ( pMetric->bucketCount - 1U ) ) && ( value > pMetric->pBounds[ bucket ] ) )
+    {
+        bucket++;
+    }
+
+    ( void ) __atomic_add_fetch( &pMetric->pValues[ LIVE( pMetric, bucket ) ], 1U, __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t PerfMetrics_Snapshot( void )
+{
+    PerfMetric_t * pMetric = NULL;
+    size_t count = 0U;
+    size_t bucket;
+
+    snapshotHead = __atomic_load_n( &registryHead, __ATOMIC_ACQUIRE );
+
+    for( pMetric = snapshotHead; pMetric != NULL; pMetric = pMetric->pNext )
+    {
+        for( bucket = 0U; bucket < pMetric->bucketCount; bucket++ )
+        {
+            pMetric->pValues[ SNAPSHOT( pMetric, bucket ) ] =
+                __atomic_load_n( &pMetric->pValues[ LIVE( pMetric, bucket ) ], __ATOMIC_RELAXED );
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+/*-----------------------------------------------------------*/
+
+const PerfMetric_t * PerfMetrics_Next( const PerfMetric_t * pPrevious )
+{
+    return ( pPrevious == NULL ) ? snapshotHead : pPrevious->pNext;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t PerfMetrics_Delta( const PerfMetric_t * pMetric,
+                            size_t bucket )
+{
+    uint32_t value;
+
+    assert( ( pMetric != NULL ) && ( bucket < pMetric->bucketCount ) );
+
+    value = pMetric->pValues[ SNAPSHOT( pMetric, bucket ) ];
+
+    /* Unsigned subtraction, so a counter that wrapped still gives its delta. */
+    if( pMetric->type != PerfMetricGauge )
+    {
+        value -= pMetric->pValues[ COMMITTED( pMetric, bucket ) ];
+    }
+
+    return value;
+}
+
+/*-----------------------------------------------------------*/
+
+void PerfMetrics_Commit( void )
+{
+    PerfMetric_t * pMetric = NULL;
+    size_t bucket;
+
+    for( pMetric = snapshotHead; pMetric != NULL; pMetric = pMetric->pNext )
+    {
+        for( bucket = 0U; bucket < pMetric->bucketCount; bucket++ )
+        {
+            pMetric->pValues[ COMMITTED( pMetric, bucket ) ] = pMetric->pValues[ SNAPSHOT( pMetric, bucket ) ];
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+const PerfMetric_t * PerfMetrics_NextRegistered( const PerfMetric_t * pPrevious )
+{
+    return ( pPrevious == NULL ) ? __atomic_load_n( &registryHead, __ATOMIC_ACQUIRE ) : pPrevious->pNext;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t PerfMetrics_Total( const PerfMetric_t * pMetric,
+                            size_t bucket )
+{
+    assert( ( pMetric != NULL ) && ( bucket < pMetric->bucketCount ) );
+
+    return __atomic_load_n( &pMetric->pValues[ LIVE( pMetric, bucket ) ], __ATOMIC_RELAXED );
+}
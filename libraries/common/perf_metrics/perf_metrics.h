@@ -0,0 +1,241 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file perf_metrics.h
+ * @brief A registry of named performance counters, gauges and histograms,
+ * exported as Device Defender custom metrics.
+ *
+ * A component defines its metrics at file scope with the
+ * PERF_METRICS_COUNTER, PERF_METRICS_GAUGE and PERF_METRICS_HISTOGRAM macros,
+ * which allocate their storage statically, registers them once with
+ * PERF_METRICS_REGISTER, and updates them with PERF_METRICS_ADD,
+ * PERF_METRICS_SET and PERF_METRICS_OBSERVE from any task. Updates are single
+ * relaxed atomic operations, so they don't take a lock.
+ *
+ * The exporter takes a snapshot with #PerfMetrics_Snapshot, reads what
+ * changed since the last committed snapshot with #PerfMetrics_Delta, and
+ * commits with #PerfMetrics_Commit once the report is sent. Counters and
+ * histogram buckets are reported as deltas, gauges as their last value. A
+ * report that isn't sent leaves its deltas to the next one.
+ *
+ * Other readers, such as a soak report, walk the registry with
+ * #PerfMetrics_NextRegistered and read the totals since boot with
+ * #PerfMetrics_Total, which leaves the snapshot to the exporter.
+ *
+ * With PERF_METRICS_ENABLED set to 0, the macros expand to nothing: no
+ * storage is allocated, and their arguments aren't evaluated, so they must
+ * not have side effects.
+ */
+
+#ifndef PERF_METRICS_H_
+#define PERF_METRICS_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+/**
+ * @brief Whether metrics are kept and exported.
+ */
+#ifndef PERF_METRICS_ENABLED
+    #if CONFIG_PERF_METRICS_ENABLE
+        #define PERF_METRICS_ENABLED    1
+    #else
+        #define PERF_METRICS_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief The kind of a metric.
+ */
+typedef enum PerfMetricType
+{
+    PerfMetricCounter,  /**< A count that only goes up, such as bytes sent. */
+    PerfMetricGauge,    /**< A level, such as the high-water mark of a pool. */
+    PerfMetricHistogram /**< Counts of values in buckets, such as latencies. */
+} PerfMetricType_t;
+
+/**
+ * @brief A metric and its storage.
+ *
+ * The fields are private to this module. Use the macros to define one.
+ */
+typedef struct PerfMetric
+{
+    const char * pName;
+    PerfMetricType_t type;
+
+    /* For each of the bucketCount values: the live value, then the value in
+     * the snapshot, then the value in the last snapshot committed. */
+    uint32_t * pValues;
+
+    /* The inclusive upper bounds of the buckets but the last, in increasing
+     * order, for a histogram. */
+    const uint32_t * pBounds;
+    size_t bucketCount;
+
+    struct PerfMetric * pNext;
+    bool registered;
+} PerfMetric_t;
+
+#if PERF_METRICS_ENABLED
+
+/**
+ * @brief Defines a metric with storage for @a buckets values.
+ */
+    #define PERF_METRICS_DEFINE_( metric, name, metricType, bounds, buckets )        \
+    static uint32_t metric ## Values[ 3U * ( buckets ) ];                            \
+    static PerfMetric_t metric =                                                     \
+    {                                                                                \
+        .pName = ( name ), .type = ( metricType ), .pValues = metric ## Values,      \
+        .pBounds = ( bounds ), .bucketCount = ( buckets ), .pNext = NULL,            \
+        .registered = false                                                          \
+    }
+
+/**
+ * @brief Defines the counter @a metric, exported as @a name.
+ */
+    #define PERF_METRICS_COUNTER( metric, name ) \
+    PERF_METRICS_DEFINE_( metric, name, PerfMetricCounter, NULL, 1U )
+
+/**
+ * @brief Defines the gauge @a metric, exported as @a name.
+ */
+    #define PERF_METRICS_GAUGE( metric, name ) \
+    PERF_METRICS_DEFINE_( metric, name, PerfMetricGauge, NULL, 1U )
+
+/**
+ * @brief Defines the histogram @a metric, exported as @a name, with the
+ * bucket upper bounds given after the name. Values above the last bound go
+ * into one more bucket.
+ */
+    #define PERF_METRICS_HISTOGRAM( metric, name, ... )                         \
+    static const uint32_t metric ## Bounds[] = { __VA_ARGS__ };                 \
+    PERF_METRICS_DEFINE_( metric, name, PerfMetricHistogram, metric ## Bounds,  \
+                          ( sizeof( metric ## Bounds ) / sizeof( metric ## Bounds[ 0 ] ) ) + 1U )
+
+    #define PERF_METRICS_REGISTER( metric )           PerfMetrics_Register( &( metric ) )
+    #define PERF_METRICS_ADD( metric, amount )        PerfMetrics_Add( &( metric ), ( amount ) )
+    #define PERF_METRICS_SET( metric, value )         PerfMetrics_Set( &( metric ), ( value ) )
+    #define PERF_METRICS_OBSERVE( metric, value )     PerfMetrics_Observe( &( metric ), ( value ) )
+
+#else /* if PERF_METRICS_ENABLED */
+
+    /* A declaration, so that the definitions can end with a semicolon. */
+    #define PERF_METRICS_COUNTER( metric, name )           extern int metric ## Disabled
+    #define PERF_METRICS_GAUGE( metric, name )             extern int metric ## Disabled
+    #define PERF_METRICS_HISTOGRAM( metric, name, ... )    extern int metric ## Disabled
+
+    #define PERF_METRICS_REGISTER( metric )                do {} while( 0 )
+    #define PERF_METRICS_ADD( metric, amount )             do {} while( 0 )
+    #define PERF_METRICS_SET( metric, value )              do {} while( 0 )
+    #define PERF_METRICS_OBSERVE( metric, value )          do {} while( 0 )
+
+#endif /* if PERF_METRICS_ENABLED */
+
+/**
+ * @brief Adds a metric to the registry. Registering it again does nothing.
+ *
+ * @param[in] pMetric The metric, which must live as long as the program.
+ */
+void PerfMetrics_Register( PerfMetric_t * pMetric );
+
+/**
+ * @brief Adds @a amount to a counter.
+ */
+void PerfMetrics_Add( PerfMetric_t * pMetric,
+                      uint32_t amount );
+
+/**
+ * @brief Sets a gauge to @a value.
+ */
+void PerfMetrics_Set( PerfMetric_t * pMetric,
+                      uint32_t value );
+
+/**
+ * @brief Counts @a value in the bucket of a histogram it falls into.
+ */
+void PerfMetrics_Observe( PerfMetric_t * pMetric,
+                          uint32_t value );
+
+/**
+ * @brief Copies the live values of every registered metric into the
+ * snapshot. To be called by the exporter only.
+ *
+ * @return The number of metrics in the snapshot.
+ */
+size_t PerfMetrics_Snapshot( void );
+
+/**
+ * @brief Iterates over the metrics of the snapshot.
+ *
+ * @param[in] pPrevious The metric returned last, or NULL to start.
+ *
+ * @return The next metric, or NULL after the last.
+ */
+const PerfMetric_t * PerfMetrics_Next( const PerfMetric_t * pPrevious );
+
+/**
+ * @brief The value of a metric in the snapshot: how much a counter or a
+ * bucket of a histogram went up since the last snapshot committed, or the
+ * value of a gauge.
+ *
+ * @param[in] pMetric The metric.
+ * @param[in] bucket The bucket of a histogram, less than its bucketCount,
+ * or 0.
+ */
+uint32_t PerfMetrics_Delta( const PerfMetric_t * pMetric,
+                            size_t bucket );
+
+/**
+ * @brief Makes the snapshot the base of the next deltas, once it is sent.
+ */
+void PerfMetrics_Commit( void );
+
+/**
+ * @brief Iterates over every registered metric, outside of the snapshot.
+ *
+ * @param[in] pPrevious The metric returned last, or NULL to start.
+ *
+ * @return The next metric, or NULL after the last.
+ */
+const PerfMetric_t * PerfMetrics_NextRegistered( const PerfMetric_t * pPrevious );
+
+/**
+ * @brief The live value of a metric: the total of a counter or a bucket of
+ * a histogram since boot, or the value of a gauge.
+ *
+ * @param[in] pMetric The metric.
+ * @param[in] bucket The bucket of a histogram, less than its bucketCount,
+ * or 0.
+ */
+uint32_t PerfMetrics_Total( const PerfMetric_t * pMetric,
+                            size_t bucket );
+
+#endif /* ifndef PERF_METRICS_H_ */
@@ -53,6 +53,26 @@ uint32_t Clock_GetTimeMs( void );
  */
 void Clock_SleepMs( uint32_t sleepTimeMs );
 
+/**
+ * @brief The high resolution timer query function.
+ *
+ * Unlike #Clock_GetTimeMs, the time doesn't wrap, so timestamps can be kept
+ * and compared directly.
+ *
+ * @return Monotonic time in microseconds, from an unspecified start.
+ */
+uint64_t Clock_GetTimeUs( void );
+
+/**
+ * @brief Microsecond sleep function.
+ *
+ * Sleeps for at least @a sleepTimeUs. Where the scheduler counts in ticks,
+ * the part shorter than a tick is waited out busy.
+ *
+ * @param[in] sleepTimeUs microseconds to sleep.
+ */
+void Clock_SleepUs( uint64_t sleepTimeUs );
+
 /* *INDENT-OFF* */
 #ifdef __cplusplus
     }
@@ -34,5 +34,35 @@ uint32_t Clock_GetTimeMs( void )
 
 void Clock_SleepMs( uint32_t sleepTimeMs )
 {
-    vTaskDelay( sleepTimeMs/portTICK_PERIOD_MS );
+    /* Round up, so that a sleep is never shorter than requested, the way it
+     * is on POSIX. */
+    vTaskDelay( ( TickType_t ) ( ( sleepTimeMs / portTICK_PERIOD_MS ) +
+                                 ( ( ( sleepTimeMs % portTICK_PERIOD_MS ) != 0U ) ? 1U : 0U ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t Clock_GetTimeUs( void )
+{
+    /* esp_timer_get_time counts microseconds since boot in 64 bits. */
+    return ( uint64_t ) esp_timer_get_time();
+}
+
+/*-----------------------------------------------------------*/
+
+void Clock_SleepUs( uint64_t sleepTimeUs )
+{
+    uint64_t deadlineUs = Clock_GetTimeUs() + sleepTimeUs;
+    uint64_t tickUs = ( uint64_t ) portTICK_PERIOD_MS * 1000U;
+
+    /* Block for the whole ticks, then spin for the rest, which a tick count
+     * can't express. */
+    if( sleepTimeUs >= tickUs )
+    {
+        vTaskDelay( ( TickType_t ) ( sleepTimeUs / tickUs ) );
+    }
+
+    while( Clock_GetTimeUs() < deadlineUs )
+    {
+    }
 }
\ No newline at end of file
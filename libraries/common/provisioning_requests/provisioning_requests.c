@@ -0,0 +1,325 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file provisioning_requests.c
+ * @brief Implementation of the fleet provisioning request table.
+ *
+ * Each slot of the table owns one bit of an event group. Completing a request
+ * sets its bit, and the task waiting on the request waits for that bit alone,
+ * so any number of tasks can wait on their own requests.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the provisioning requests. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Provisioning Requests"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "provisioning_requests.h"
+
+/* Event groups keep 8 bits of a 32-bit tick type for themselves. */
+#if ( PROVISIONING_REQUESTS_MAX_PENDING > 24 )
+    #error "PROVISIONING_REQUESTS_MAX_PENDING must be at most 24."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The event group bit of the request in @a index.
+ */
+#define REQUEST_BIT( index )    ( ( EventBits_t ) 1U << ( index ) )
+
+/**
+ * @brief The requests, pending or free.
+ */
+static ProvisioningRequest_t requests[ PROVISIONING_REQUESTS_MAX_PENDING ];
+
+/**
+ * @brief The sequence number of the next request started.
+ */
+static uint32_t nextSequence = 0U;
+
+/**
+ * @brief Guards the table, shared by the tasks starting and waiting on
+ * requests and the task running the process loop.
+ */
+static SemaphoreHandle_t requestsMutex = NULL;
+static StaticSemaphore_t requestsMutexBuffer;
+
+/**
+ * @brief Where a task learns that its request is complete.
+ */
+static EventGroupHandle_t requestEvents = NULL;
+static StaticEventGroup_t requestEventsBuffer;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The index of a request in #requests.
+ */
+static size_t requestIndex( const ProvisioningRequest_t * pRequest );
+
+/**
+ * @brief Moves a request out of the pending state and wakes its task. Must be
+ * called with #requestsMutex taken.
+ */
+static void completeRequest( ProvisioningRequest_t * pRequest,
+                             ProvisioningRequestStatus_t status );
+
+/*-----------------------------------------------------------*/
+
+static size_t requestIndex( const ProvisioningRequest_t * pRequest )
+{
+    assert( ( pRequest >= &requests[ 0 ] ) &&
+            ( pRequest < &requests[ PROVISIONING_REQUESTS_MAX_PENDING ] ) );
+
+    return ( size_t ) ( pRequest - &requests[ 0 ] );
+}
+
+/*-----------------------------------------------------------*/
+
+static void completeRequest( ProvisioningRequest_t * pRequest,
+                             ProvisioningRequestStatus_t status )
+{
+    pRequest->status = status;
+    ( void ) xEventGroupSetBits( requestEvents, REQUEST_BIT( requestIndex( pRequest ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void ProvisioningRequests_Init( void )
+{
+    if( requestsMutex == NULL )
+    {
+        requestsMutex = xSemaphoreCreateMutexStatic( &requestsMutexBuffer );
+        requestEvents = xEventGroupCreateStatic( &requestEventsBuffer );
+    }
+
+    ( void ) memset( requests, 0x00, sizeof( requests ) );
+}
+
+/*-----------------------------------------------------------*/
+
+ProvisioningRequest_t * ProvisioningRequest_Start( FleetProvisioningTopic_t acceptedTopic,
+                                                   FleetProvisioningTopic_t rejectedTopic,
+                                                   uint8_t * pBuffer,
+                                                   size_t bufferLength,
+                                                   uint32_t timeoutMs )
+{
+    ProvisioningRequest_t * pRequest = NULL;
+    size_t i;
+
+    assert( requestsMutex != NULL );
+    assert( pBuffer != NULL );
+
+    ( void ) xSemaphoreTake( requestsMutex, portMAX_DELAY );
+
+    for( i = 0; i < PROVISIONING_REQUESTS_MAX_PENDING; i++ )
+    {
+        if( requests[ i ].inUse == false )
+        {
+            pRequest = &requests[ i ];
+            break;
+        }
+    }
+
+    if( pRequest != NULL )
+    {
+        pRequest->acceptedTopic = acceptedTopic;
+        pRequest->rejectedTopic = rejectedTopic;
+        pRequest->pBuffer = pBuffer;
+        pRequest->bufferLength = bufferLength;
+        pRequest->payloadLength = 0U;
+        pRequest->startTick = xTaskGetTickCount();
+        pRequest->timeoutTicks = pdMS_TO_TICKS( timeoutMs );
+        pRequest->sequence = nextSequence++;
+        pRequest->status = ProvisioningRequestPending;
+        pRequest->inUse = true;
+
+        /* Drop a wakeup left by a response to the previous request in this slot. */
+        ( void ) xEventGroupClearBits( requestEvents, REQUEST_BIT( i ) );
+    }
+
+    ( void ) xSemaphoreGive( requestsMutex );
+
+    if( pRequest == NULL )
+    {
+        LogError( ( "All %u provisioning request slots are in use.",
+                    ( unsigned ) PROVISIONING_REQUESTS_MAX_PENDING ) );
+    }
+
+    return pRequest;
+}
+
+/*-----------------------------------------------------------*/
+
+ProvisioningRequestStatus_t ProvisioningRequest_Wait( ProvisioningRequest_t * pRequest,
+                                                      ProvisioningRequestPump_t pump,
+                                                      size_t * pPayloadLength )
+{
+    ProvisioningRequestStatus_t status = ProvisioningRequestPending;
+    EventBits_t bit = REQUEST_BIT( requestIndex( pRequest ) );
+    TickType_t elapsed = 0U;
+    TickType_t remaining = 0U;
+    uint32_t sliceMs = 0U;
+    uint32_t timeoutMs = 0U;
+    bool pumpStatus = true;
+
+    assert( pRequest->inUse == true );
+
+    for( ; ; )
+    {
+        elapsed = xTaskGetTickCount() - pRequest->startTick;
+        remaining = ( elapsed < pRequest->timeoutTicks ) ? ( pRequest->timeoutTicks - elapsed ) : 0U;
+
+        /* Without a pump, sleep until the process loop task completes the request. */
+        if( ( xEventGroupWaitBits( requestEvents, bit, pdTRUE, pdFALSE,
+                                   ( pump == NULL ) ? remaining : 0U ) & bit ) != 0U )
+        {
+            break;
+        }
+
+        if( ( remaining == 0U ) || ( pumpStatus == false ) )
+        {
+            break;
+        }
+
+        if( pump != NULL )
+        {
+            sliceMs = ( uint32_t ) ( remaining * portTICK_PERIOD_MS );
+
+            if( sliceMs > PROVISIONING_REQUESTS_PUMP_SLICE_MS )
+            {
+                sliceMs = PROVISIONING_REQUESTS_PUMP_SLICE_MS;
+            }
+
+            pumpStatus = pump( sliceMs );
+        }
+    }
+
+    ( void ) xSemaphoreTake( requestsMutex, portMAX_DELAY );
+
+    /* The status is set under the lock, so it is final even if the bit was
+     * set after the last check. */
+    status = pRequest->status;
+
+    if( status == ProvisioningRequestPending )
+    {
+        status = ( pumpStatus == false ) ? ProvisioningRequestFailed : ProvisioningRequestTimedOut;
+    }
+
+    if( pPayloadLength != NULL )
+    {
+        *pPayloadLength = pRequest->payloadLength;
+    }
+
+    timeoutMs = ( uint32_t ) ( pRequest->timeoutTicks * portTICK_PERIOD_MS );
+    pRequest->inUse = false;
+
+    ( void ) xSemaphoreGive( requestsMutex );
+
+    if( status == ProvisioningRequestTimedOut )
+    {
+        LogError( ( "Timed out after %u ms waiting for a fleet provisioning response.",
+                    ( unsigned ) timeoutMs ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void ProvisioningRequest_Cancel( ProvisioningRequest_t * pRequest )
+{
+    ( void ) requestIndex( pRequest );
+
+    ( void ) xSemaphoreTake( requestsMutex, portMAX_DELAY );
+    pRequest->inUse = false;
+    ( void ) xSemaphoreGive( requestsMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+bool ProvisioningRequests_HandleResponse( FleetProvisioningTopic_t topic,
+                                          const MQTTPublishInfo_t * pPublishInfo )
+{
+    ProvisioningRequest_t * pRequest = NULL;
+    size_t i;
+
+    assert( pPublishInfo != NULL );
+
+    ( void ) xSemaphoreTake( requestsMutex, portMAX_DELAY );
+
+    for( i = 0; i < PROVISIONING_REQUESTS_MAX_PENDING; i++ )
+    {
+        if( ( requests[ i ].inUse == true ) &&
+            ( requests[ i ].status == ProvisioningRequestPending ) &&
+            ( ( requests[ i ].acceptedTopic == topic ) || ( requests[ i ].rejectedTopic == topic ) ) &&
+            ( ( pRequest == NULL ) || ( ( int32_t ) ( requests[ i ].sequence - pRequest->sequence ) < 0 ) ) )
+        {
+            pRequest = &requests[ i ];
+        }
+    }
+
+    if( pRequest == NULL )
+    {
+        /* Late response to a request that timed out or was cancelled. */
+    }
+    else if( pPublishInfo->payloadLength > pRequest->bufferLength )
+    {
+        LogError( ( "Fleet provisioning response of %u bytes doesn't fit in a buffer of %u bytes.",
+                    ( unsigned ) pPublishInfo->payloadLength,
+                    ( unsigned ) pRequest->bufferLength ) );
+        completeRequest( pRequest, ProvisioningRequestFailed );
+    }
+    else
+    {
+        /* Copy the payload out of the MQTT library's buffer, which is reused
+         * for the next packet. */
+        ( void ) memcpy( pRequest->pBuffer, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+        pRequest->payloadLength = pPublishInfo->payloadLength;
+        completeRequest( pRequest, ( topic == pRequest->acceptedTopic ) ?
+                         ProvisioningRequestAccepted : ProvisioningRequestRejected );
+    }
+
+    ( void ) xSemaphoreGive( requestsMutex );
+
+    return ( pRequest != NULL );
+}
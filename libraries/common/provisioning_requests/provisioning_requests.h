@@ -0,0 +1,180 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file provisioning_requests.h
+ * @brief Match fleet provisioning responses to the requests waiting for them.
+ *
+ * A request is started with the accepted and rejected topics its response
+ * arrives on and a deadline, before it is published. The MQTT publish
+ * callback hands every fleet provisioning message to
+ * #ProvisioningRequests_HandleResponse, which copies the payload for the
+ * oldest request waiting on that topic and wakes its task. The task returns
+ * from #ProvisioningRequest_Wait as soon as the response is in, instead of
+ * after a fixed number of process loops.
+ */
+
+#ifndef PROVISIONING_REQUESTS_H_
+#define PROVISIONING_REQUESTS_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/* Include Fleet Provisioning library. */
+#include "fleet_provisioning.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The number of requests that can wait for a response at once.
+ */
+#ifndef PROVISIONING_REQUESTS_MAX_PENDING
+    #define PROVISIONING_REQUESTS_MAX_PENDING    CONFIG_PROVISIONING_REQUESTS_MAX_PENDING
+#endif
+
+/**
+ * @brief The longest #ProvisioningRequest_Wait runs the process loop before
+ * checking its request again.
+ */
+#ifndef PROVISIONING_REQUESTS_PUMP_SLICE_MS
+    #define PROVISIONING_REQUESTS_PUMP_SLICE_MS    CONFIG_PROVISIONING_REQUESTS_PUMP_SLICE_MS
+#endif
+
+/**
+ * @brief Outcome of a fleet provisioning request.
+ */
+typedef enum ProvisioningRequestStatus
+{
+    ProvisioningRequestPending,   /**< No response yet. */
+    ProvisioningRequestAccepted,  /**< The response arrived on the accepted topic. */
+    ProvisioningRequestRejected,  /**< The response arrived on the rejected topic. */
+    ProvisioningRequestTimedOut,  /**< The deadline passed without a response. */
+    ProvisioningRequestFailed     /**< The process loop failed, or the response didn't fit. */
+} ProvisioningRequestStatus_t;
+
+/**
+ * @brief Runs the MQTT process loop for at most @a timeoutMs milliseconds.
+ *
+ * @return false if the loop failed, in which case the wait is given up.
+ */
+typedef bool (* ProvisioningRequestPump_t )( uint32_t timeoutMs );
+
+/**
+ * @brief A request waiting for its response.
+ *
+ * The fields are private to this module.
+ */
+typedef struct ProvisioningRequest
+{
+    FleetProvisioningTopic_t acceptedTopic;
+    FleetProvisioningTopic_t rejectedTopic;
+
+    /* Where the payload of the response is copied, accepted or rejected. */
+    uint8_t * pBuffer;
+    size_t bufferLength;
+    size_t payloadLength;
+
+    /* Deadline, as a tick count relative to startTick so it survives a wrap. */
+    TickType_t startTick;
+    TickType_t timeoutTicks;
+
+    /* Order of the start calls, so the oldest request on a topic is answered first. */
+    uint32_t sequence;
+    ProvisioningRequestStatus_t status;
+    bool inUse;
+} ProvisioningRequest_t;
+
+/**
+ * @brief Creates the event group and lock of the module. Must be called once
+ * before any other function.
+ */
+void ProvisioningRequests_Init( void );
+
+/**
+ * @brief Registers a request, before it is published so that a response
+ * arriving in the process loop of the publish isn't missed.
+ *
+ * @param[in] acceptedTopic The topic of an accepted response.
+ * @param[in] rejectedTopic The topic of a rejected response.
+ * @param[out] pBuffer The buffer the response payload is copied into. It
+ * can be the buffer the request was serialized into.
+ * @param[in] bufferLength The size of @a pBuffer.
+ * @param[in] timeoutMs How long to wait for the response, counted from now.
+ *
+ * @return The request, or NULL if #PROVISIONING_REQUESTS_MAX_PENDING requests
+ * are already pending.
+ */
+ProvisioningRequest_t * ProvisioningRequest_Start( FleetProvisioningTopic_t acceptedTopic,
+                                                   FleetProvisioningTopic_t rejectedTopic,
+                                                   uint8_t * pBuffer,
+                                                   size_t bufferLength,
+                                                   uint32_t timeoutMs );
+
+/**
+ * @brief Waits until the response to a request arrives or its deadline
+ * passes, then releases the request.
+ *
+ * @param[in] pRequest A request returned by #ProvisioningRequest_Start.
+ * @param[in] pump The process loop to run while waiting, in slices of at most
+ * #PROVISIONING_REQUESTS_PUMP_SLICE_MS, when the calling task is the one that
+ * receives from the MQTT connection. NULL if another task runs the process
+ * loop, in which case the calling task blocks until it is woken.
+ * @param[out] pPayloadLength The length of the payload copied into the
+ * buffer of the request, for an accepted or rejected response. Can be NULL.
+ *
+ * @return The outcome of the request.
+ */
+ProvisioningRequestStatus_t ProvisioningRequest_Wait( ProvisioningRequest_t * pRequest,
+                                                      ProvisioningRequestPump_t pump,
+                                                      size_t * pPayloadLength );
+
+/**
+ * @brief Releases a request without waiting, such as when it couldn't be
+ * published. A response arriving later is ignored.
+ *
+ * @param[in] pRequest A request returned by #ProvisioningRequest_Start.
+ */
+void ProvisioningRequest_Cancel( ProvisioningRequest_t * pRequest );
+
+/**
+ * @brief Completes the oldest pending request waiting on @a topic, to be
+ * called from the MQTT publish callback with the topic found by
+ * FleetProvisioning_MatchTopic.
+ *
+ * @param[in] topic The fleet provisioning topic of the message.
+ * @param[in] pPublishInfo The incoming PUBLISH message.
+ *
+ * @return true if a pending request took the message.
+ */
+bool ProvisioningRequests_HandleResponse( FleetProvisioningTopic_t topic,
+                                          const MQTTPublishInfo_t * pPublishInfo );
+
+#endif /* ifndef PROVISIONING_REQUESTS_H_ */
@@ -0,0 +1,228 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file provisioning_timer.c
+ * @brief Implementation of the provisioning phase timer.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the provisioning timer. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Provisioning Timer"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "provisioning_timer.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The version of the record, for whoever aggregates it.
+ */
+#define RECORD_VERSION    1
+
+/**
+ * @brief The times of a phase.
+ */
+typedef struct PhaseTimes
+{
+    uint32_t beginMs;   /* When the current run began. */
+    uint32_t totalMs;   /* Time of the ended runs. */
+    uint16_t runs;      /* Ended runs. */
+    bool running;
+} PhaseTimes_t;
+
+/**
+ * @brief The keys of the phases in the record, in the order of
+ * #ProvisioningPhase_t.
+ */
+static const char * const phaseKeys[ ProvisioningPhaseCount ] =
+{
+    "wifi",
+    "claim",
+    "keygen",
+    "create",
+    "register",
+    "store",
+    "connect"
+};
+
+static PhaseTimes_t phases[ ProvisioningPhaseCount ];
+
+/**
+ * @brief When provisioning started, and how long it took once finished.
+ */
+static uint32_t startMs = 0U;
+static uint32_t totalMs = 0U;
+
+static bool started = false;
+static bool finished = false;
+
+/**
+ * @brief Append to the record in @a pBuffer with snprintf.
+ *
+ * @return false if the record doesn't fit.
+ */
+static bool appendToRecord( char * pBuffer,
+                            size_t bufferLength,
+                            size_t * pLength,
+                            const char * pFormat,
+                            ... );
+
+/*-----------------------------------------------------------*/
+
+static bool appendToRecord( char * pBuffer,
+                            size_t bufferLength,
+                            size_t * pLength,
+                            const char * pFormat,
+                            ... )
+{
+    va_list args;
+    int written = 0;
+
+    va_start( args, pFormat );
+    written = vsnprintf( &pBuffer[ *pLength ], bufferLength - *pLength, pFormat, args );
+    va_end( args );
+
+    if( ( written >= 0 ) && ( ( size_t ) written < ( bufferLength - *pLength ) ) )
+    {
+        *pLength += ( size_t ) written;
+    }
+    else
+    {
+        written = -1;
+    }
+
+    return( written >= 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+void ProvisioningTimer_Start( void )
+{
+    ( void ) memset( phases, 0x00, sizeof( phases ) );
+    startMs = Clock_GetTimeMs();
+    totalMs = 0U;
+    started = true;
+    finished = false;
+}
+
+/*-----------------------------------------------------------*/
+
+void ProvisioningTimer_BeginPhase( ProvisioningPhase_t phase )
+{
+    assert( phase < ProvisioningPhaseCount );
+
+    if( ( started == true ) && ( finished == false ) )
+    {
+        phases[ phase ].beginMs = Clock_GetTimeMs();
+        phases[ phase ].running = true;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void ProvisioningTimer_EndPhase( ProvisioningPhase_t phase )
+{
+    assert( phase < ProvisioningPhaseCount );
+
+    if( phases[ phase ].running == true )
+    {
+        /* Unsigned subtraction is right across a wrap of the clock. */
+        phases[ phase ].totalMs += Clock_GetTimeMs() - phases[ phase ].beginMs;
+        phases[ phase ].runs++;
+        phases[ phase ].running = false;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void ProvisioningTimer_Finish( void )
+{
+    char record[ PROVISIONING_TIMER_RECORD_LENGTH ];
+
+    if( ( started == true ) && ( finished == false ) )
+    {
+        totalMs = Clock_GetTimeMs() - startMs;
+        finished = true;
+
+        if( ProvisioningTimer_GetRecord( record, sizeof( record ) ) > 0U )
+        {
+            LogInfo( ( "Provisioning timing: %s", record ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t ProvisioningTimer_GetRecord( char * pBuffer,
+                                    size_t bufferLength )
+{
+    size_t length = 0U;
+    unsigned retries = 0U;
+    bool status = finished;
+    size_t i;
+
+    assert( pBuffer != NULL );
+
+    if( status == true )
+    {
+        status = appendToRecord( pBuffer, bufferLength, &length,
+                                 "{\"v\":%d,\"total\":%u",
+                                 RECORD_VERSION, ( unsigned ) totalMs );
+    }
+
+    for( i = 0; ( status == true ) && ( i < ProvisioningPhaseCount ); i++ )
+    {
+        if( phases[ i ].runs > 0U )
+        {
+            status = appendToRecord( pBuffer, bufferLength, &length, ",\"%s\":%u",
+                                     phaseKeys[ i ], ( unsigned ) phases[ i ].totalMs );
+
+            /* Every run of a phase after the first is a retry. */
+            retries += phases[ i ].runs - 1U;
+        }
+    }
+
+    if( status == true )
+    {
+        status = appendToRecord( pBuffer, bufferLength, &length, ",\"retries\":%u}", retries );
+    }
+
+    return ( status == true ) ? length : 0U;
+}
@@ -0,0 +1,124 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file provisioning_timer.h
+ * @brief Time the phases of provisioning by claim, from boot to the first
+ * connection with the provisioned certificate.
+ *
+ * A phase can run more than once when the demo retries, in which case its
+ * times are added up and its runs counted. Once provisioning is over, the
+ * phases are written as one compact JSON record, such as
+ * {"v":1,"total":5210,"wifi":1830,"claim":1460,"create":620,...},
+ * which is logged and can be published so that time to provision can be
+ * aggregated across devices. Phases that didn't run are left out.
+ */
+
+#ifndef PROVISIONING_TIMER_H_
+#define PROVISIONING_TIMER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the record is published on the first connection with the
+ * provisioned certificate.
+ */
+#ifndef PROVISIONING_TIMER_PUBLISH
+    #define PROVISIONING_TIMER_PUBLISH    CONFIG_PROVISIONING_TIMER_PUBLISH
+#endif
+
+#if PROVISIONING_TIMER_PUBLISH
+
+/**
+ * @brief The topic the record is published on.
+ */
+    #define PROVISIONING_TIMER_TOPIC    CONFIG_PROVISIONING_TIMER_TOPIC
+#endif
+
+/**
+ * @brief Size of a buffer that holds any record.
+ */
+#define PROVISIONING_TIMER_RECORD_LENGTH    256U
+
+/**
+ * @brief The phases of provisioning by claim.
+ */
+typedef enum ProvisioningPhase
+{
+    ProvisioningPhaseWifi,              /**< Bringing up the network. */
+    ProvisioningPhaseClaimConnect,      /**< TLS and MQTT connection with the claim certificate. */
+    ProvisioningPhaseKeyGeneration,     /**< Generating the device key pair and CSR on the device. */
+    ProvisioningPhaseCreateCertificate, /**< CreateKeysAndCertificate or CreateCertificateFromCsr. */
+    ProvisioningPhaseRegisterThing,     /**< RegisterThing. */
+    ProvisioningPhaseStore,             /**< Storing the provisioned credentials. */
+    ProvisioningPhaseDeviceConnect,     /**< Connection with the provisioned certificate. */
+    ProvisioningPhaseCount
+} ProvisioningPhase_t;
+
+/**
+ * @brief Start timing provisioning, clearing the times of the phases. To be
+ * called as early as possible after boot.
+ */
+void ProvisioningTimer_Start( void );
+
+/**
+ * @brief Note the start of a run of a phase.
+ *
+ * @param[in] phase The phase.
+ */
+void ProvisioningTimer_BeginPhase( ProvisioningPhase_t phase );
+
+/**
+ * @brief Add the time since the matching #ProvisioningTimer_BeginPhase to
+ * the phase. Does nothing if the phase wasn't begun.
+ *
+ * @param[in] phase The phase.
+ */
+void ProvisioningTimer_EndPhase( ProvisioningPhase_t phase );
+
+/**
+ * @brief Stop timing provisioning once connected with the provisioned
+ * certificate, and log the record. Only the first call after
+ * #ProvisioningTimer_Start has an effect.
+ */
+void ProvisioningTimer_Finish( void );
+
+/**
+ * @brief Write the record of the finished provisioning.
+ *
+ * @param[out] pBuffer The buffer to write the record to, of at least
+ * #PROVISIONING_TIMER_RECORD_LENGTH bytes to hold any record.
+ * @param[in] bufferLength The size of @a pBuffer.
+ *
+ * @return The length of the null-terminated record, or 0 if provisioning
+ * isn't finished or the record doesn't fit.
+ */
+size_t ProvisioningTimer_GetRecord( char * pBuffer,
+                                    size_t bufferLength );
+
+#endif /* ifndef PROVISIONING_TIMER_H_ */
@@ -0,0 +1,523 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file publish_shedding.c
+ * @brief Implementation of the shedding of QoS 0 publishes.
+ *
+ * The admitted publishes not yet taken by the agent are kept in a list of
+ * their tickets, oldest first, which is short as it never holds more than
+ * the queue of the agent. The list, the rules and the congestion state are
+ * guarded by a spinlock, held only for a walk of the list.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the shedding. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Publish Shedding"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "perf_metrics.h"
+
+#include "publish_shedding.h"
+
+#if PUBLISH_SHEDDING_ENABLED
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The weight of a new write time in the moving average, as a shift:
+ * 1/8, as for the smoothed round trip time of TCP.
+ */
+    #define SEND_AVERAGE_SHIFT    ( 3U )
+
+/**
+ * @brief The rule of the topics that match no prefix, at index 0.
+ */
+    #define DEFAULT_RULE          ( 0U )
+
+/**
+ * @brief The policy of a topic prefix, and the publishes it has queued.
+ */
+    typedef struct SheddingRule
+    {
+        const char * pTopicPrefix;
+        size_t topicPrefixLength;
+        PublishSheddingPolicy_t policy;
+        uint32_t parameter;
+        uint32_t sampleCount; /**< Publishes seen since congestion began, for sampling. */
+        size_t queued;        /**< Admitted publishes queued and not shed. */
+    } SheddingRule_t;
+
+/**
+ * @brief The rules, the default one first.
+ */
+    static SheddingRule_t rules[ PUBLISH_SHEDDING_MAX_RULES + 1U ] =
+    {
+        {
+            .pTopicPrefix = "",
+            .topicPrefixLength = 0U,
+            .policy = PUBLISH_SHEDDING_DEFAULT_POLICY,
+            .parameter = PUBLISH_SHEDDING_DEFAULT_PARAMETER
+        }
+    };
+    static size_t ruleCount = 1U;
+
+/**
+ * @brief The tickets of the queued publishes, oldest first.
+ */
+    static PublishSheddingTicket_t * pQueuedHead = NULL;
+    static PublishSheddingTicket_t * pQueuedTail = NULL;
+
+/**
+ * @brief The moving average of the write time, and the bulk commands queued
+ * as seen at the last admission, less the publishes taken since.
+ */
+    static uint32_t sendAverageUs = 0U;
+    static size_t queueDepth = 0U;
+
+/**
+ * @brief Whether the link is congested.
+ */
+    static bool congested = false;
+
+    static portMUX_TYPE sheddingLock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Publishes shed by each policy, and the times the link became congested. */
+    PERF_METRICS_COUNTER( dropOldestMetric, "shed_drop_oldest" );
+    PERF_METRICS_COUNTER( sampleMetric, "shed_sample" );
+    PERF_METRICS_COUNTER( coalesceMetric, "shed_coalesce" );
+    PERF_METRICS_COUNTER( congestionMetric, "congestion_episodes" );
+    PERF_METRICS_GAUGE( sendAverageMetric, "send_average_us" );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The 32-bit FNV-1a hash of a topic.
+ */
+    static uint32_t topicHash( const char * pTopicName,
+                               uint16_t topicNameLength );
+
+/**
+ * @brief The rule with the longest prefix of a topic.
+ */
+    static uint8_t findRule( const char * pTopicName,
+                             uint16_t topicNameLength );
+
+/**
+ * @brief Enters or leaves the congested state. Called with the lock held.
+ *
+ * @return true if the state changed.
+ */
+    static bool updateCongestion( void );
+
+/**
+ * @brief Logs and counts a change of the congested state.
+ */
+    static void reportCongestion( bool nowCongested );
+
+/**
+ * @brief Marks the oldest queued publish of a rule as shed. Called with the
+ * lock held.
+ */
+    static void dropOldest( uint8_t rule );
+
+/**
+ * @brief Marks the queued publishes of a topic as shed. Called with the lock
+ * held.
+ *
+ * @return The publishes marked.
+ */
+    static uint32_t coalesce( const PublishSheddingTicket_t * pTicket );
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t topicHash( const char * pTopicName,
+                               uint16_t topicNameLength )
+    {
+        uint32_t hash = 2166136261UL;
+        uint16_t i;
+
+        for( i = 0U; i < topicNameLength; i++ )
+        {
+            hash ^= ( uint8_t ) pTopicName[ i ];
+            hash *= 16777619UL;
+        }
+
+        return hash;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static uint8_t findRule( const char * pTopicName,
+                             uint16_t topicNameLength )
+    {
+        uint8_t rule = DEFAULT_RULE;
+        size_t i;
+
+        for( i = DEFAULT_RULE + 1U; i < ruleCount; i++ )
+        {
+            if( ( rules[ i ].topicPrefixLength <= topicNameLength ) &&
+                ( rules[ i ].topicPrefixLength > rules[ rule ].topicPrefixLength ) &&
+                ( memcmp( rules[ i ].pTopicPrefix, pTopicName, rules[ i ].topicPrefixLength ) == 0 ) )
+            {
+                rule = ( uint8_t ) i;
+            }
+        }
+
+        return rule;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool updateCongestion( void )
+    {
+        bool wasCongested = congested;
+        size_t i;
+
+        if( congested == false )
+        {
+            congested = ( sendAverageUs >= PUBLISH_SHEDDING_SEND_LATENCY_US ) ||
+                        ( queueDepth >= PUBLISH_SHEDDING_QUEUE_DEPTH );
+        }
+        else
+        {
+            congested = ( sendAverageUs >= ( PUBLISH_SHEDDING_SEND_LATENCY_US / 2U ) ) ||
+                        ( queueDepth >= ( ( PUBLISH_SHEDDING_QUEUE_DEPTH + 1U ) / 2U ) );
+        }
+
+        if( ( congested == true ) && ( wasCongested == false ) )
+        {
+            /* Each episode sends the first publish of a sampled rule. */
+            for( i = 0U; i < ruleCount; i++ )
+            {
+                rules[ i ].sampleCount = 0U;
+            }
+        }
+
+        return congested != wasCongested;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void reportCongestion( bool nowCongested )
+    {
+        if( nowCongested == true )
+        {
+            PERF_METRICS_REGISTER( congestionMetric );
+            PERF_METRICS_ADD( congestionMetric, 1U );
+            LogWarn( ( "The uplink is congested, shedding QoS 0 publishes." ) );
+        }
+        else
+        {
+            LogInfo( ( "The uplink is no longer congested." ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void dropOldest( uint8_t rule )
+    {
+        PublishSheddingTicket_t * pTicket = pQueuedHead;
+
+        while( ( pTicket != NULL ) && ( ( pTicket->rule != rule ) || ( pTicket->shed == true ) ) )
+        {
+            pTicket = pTicket->pNext;
+        }
+
+        if( pTicket != NULL )
+        {
+            pTicket->shed = true;
+            rules[ rule ].queued--;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t coalesce( const PublishSheddingTicket_t * pTicket )
+    {
+        PublishSheddingTicket_t * pQueued;
+        uint32_t count = 0U;
+
+        for( pQueued = pQueuedHead; pQueued != NULL; pQueued = pQueued->pNext )
+        {
+            if( ( pQueued->shed == false ) &&
+                ( pQueued->topicHash == pTicket->topicHash ) &&
+                ( pQueued->topicNameLength == pTicket->topicNameLength ) )
+            {
+                pQueued->shed = true;
+                rules[ pQueued->rule ].queued--;
+                count++;
+            }
+        }
+
+        return count;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool PublishShedding_AddRule( const char * pTopicPrefix,
+                                  PublishSheddingPolicy_t policy,
+                                  uint32_t parameter )
+    {
+        bool added = false;
+
+        assert( pTopicPrefix != NULL );
+
+        if( ruleCount < ( PUBLISH_SHEDDING_MAX_RULES + 1U ) )
+        {
+            rules[ ruleCount ].pTopicPrefix = pTopicPrefix;
+            rules[ ruleCount ].topicPrefixLength = strlen( pTopicPrefix );
+            rules[ ruleCount ].policy = policy;
+            rules[ ruleCount ].parameter = ( parameter > 0U ) ? parameter : 1U;
+            ruleCount++;
+            added = true;
+        }
+        else
+        {
+            LogError( ( "No room for the rule of %s: all %u rules are in use.",
+                        pTopicPrefix, ( unsigned ) PUBLISH_SHEDDING_MAX_RULES ) );
+        }
+
+        return added;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool PublishShedding_Admit( PublishSheddingTicket_t * pTicket,
+                                const char * pTopicName,
+                                uint16_t topicNameLength,
+                                size_t queuedCommands )
+    {
+        SheddingRule_t * pRule;
+        bool admitted = true;
+        bool changed = false;
+        bool nowCongested = false;
+        uint32_t dropped = 0U;
+        uint32_t coalesced = 0U;
+
+        assert( ( pTicket != NULL ) && ( pTopicName != NULL ) );
+
+        pTicket->pNext = NULL;
+        pTicket->topicHash = topicHash( pTopicName, topicNameLength );
+        pTicket->topicNameLength = topicNameLength;
+        pTicket->rule = findRule( pTopicName, topicNameLength );
+        pTicket->shed = false;
+        pRule = &rules[ pTicket->rule ];
+
+        taskENTER_CRITICAL( &sheddingLock );
+
+        queueDepth = queuedCommands;
+        changed = updateCongestion();
+        nowCongested = congested;
+
+        if( congested == true )
+        {
+            switch( pRule->policy )
+            {
+                case PublishSheddingDropOldest:
+
+                    while( ( pRule->queued > 0U ) && ( pRule->queued >= pRule->parameter ) )
+                    {
+                        dropOldest( pTicket->rule );
+                        dropped++;
+                    }
+
+                    break;
+
+                case PublishSheddingSample:
+                    admitted = ( ( pRule->sampleCount % pRule->parameter ) == 0U );
+                    pRule->sampleCount++;
+                    break;
+
+                case PublishSheddingCoalesce:
+                    coalesced = coalesce( pTicket );
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        if( admitted == true )
+        {
+            if( pQueuedTail == NULL )
+            {
+                pQueuedHead = pTicket;
+            }
+            else
+            {
+                pQueuedTail->pNext = pTicket;
+            }
+
+            pQueuedTail = pTicket;
+            pRule->queued++;
+        }
+
+        taskEXIT_CRITICAL( &sheddingLock );
+
+        if( changed == true )
+        {
+            reportCongestion( nowCongested );
+        }
+
+        if( dropped > 0U )
+        {
+            PERF_METRICS_REGISTER( dropOldestMetric );
+            PERF_METRICS_ADD( dropOldestMetric, dropped );
+        }
+
+        if( coalesced > 0U )
+        {
+            PERF_METRICS_REGISTER( coalesceMetric );
+            PERF_METRICS_ADD( coalesceMetric, coalesced );
+        }
+
+        if( admitted == false )
+        {
+            PERF_METRICS_REGISTER( sampleMetric );
+            PERF_METRICS_ADD( sampleMetric, 1U );
+        }
+
+        return admitted;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool PublishShedding_Dequeued( PublishSheddingTicket_t * pTicket )
+    {
+        PublishSheddingTicket_t * pPrevious = NULL;
+        PublishSheddingTicket_t * pQueued;
+        bool changed = false;
+        bool nowCongested = false;
+
+        assert( pTicket != NULL );
+
+        taskENTER_CRITICAL( &sheddingLock );
+
+        for( pQueued = pQueuedHead; ( pQueued != NULL ) && ( pQueued != pTicket ); pQueued = pQueued->pNext )
+        {
+            pPrevious = pQueued;
+        }
+
+        assert( pQueued != NULL );
+
+        if( pQueued != NULL )
+        {
+            if( pPrevious == NULL )
+            {
+                pQueuedHead = pTicket->pNext;
+            }
+            else
+            {
+                pPrevious->pNext = pTicket->pNext;
+            }
+
+            if( pQueuedTail == pTicket )
+            {
+                pQueuedTail = pPrevious;
+            }
+
+            if( pTicket->shed == false )
+            {
+                rules[ pTicket->rule ].queued--;
+            }
+
+            pTicket->pNext = NULL;
+        }
+
+        /* No new admission may come to see the queue drain. */
+        if( queueDepth > 0U )
+        {
+            queueDepth--;
+        }
+
+        changed = updateCongestion();
+        nowCongested = congested;
+
+        taskEXIT_CRITICAL( &sheddingLock );
+
+        if( changed == true )
+        {
+            reportCongestion( nowCongested );
+        }
+
+        return pTicket->shed == false;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void PublishShedding_RecordSend( uint32_t durationUs )
+    {
+        bool changed = false;
+        bool nowCongested = false;
+
+        taskENTER_CRITICAL( &sheddingLock );
+
+        sendAverageUs = sendAverageUs - ( sendAverageUs >> SEND_AVERAGE_SHIFT ) +
+                        ( durationUs >> SEND_AVERAGE_SHIFT );
+        changed = updateCongestion();
+        nowCongested = congested;
+
+        taskEXIT_CRITICAL( &sheddingLock );
+
+        /* Only the agent task writes the average. */
+        PERF_METRICS_REGISTER( sendAverageMetric );
+        PERF_METRICS_SET( sendAverageMetric, sendAverageUs );
+
+        if( changed == true )
+        {
+            reportCongestion( nowCongested );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool PublishShedding_IsCongested( void )
+    {
+        bool isCongested;
+
+        taskENTER_CRITICAL( &sheddingLock );
+        isCongested = congested;
+        taskEXIT_CRITICAL( &sheddingLock );
+
+        return isCongested;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if PUBLISH_SHEDDING_ENABLED */
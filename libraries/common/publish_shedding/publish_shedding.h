@@ -0,0 +1,203 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file publish_shedding.h
+ * @brief Shed QoS 0 publishes while the uplink is congested, so that control
+ * traffic doesn't queue behind stale telemetry.
+ *
+ * The link is congested while the moving average of the time the transport
+ * takes to write, fed with #PublishShedding_RecordSend, or the number of
+ * bulk commands queued for the agent, given to #PublishShedding_Admit, is
+ * high. Each leaves the congested state only at half its threshold, so the
+ * state doesn't flap.
+ *
+ * While congested, each QoS 0 publish is handled by the policy of the
+ * longest topic prefix added with #PublishShedding_AddRule, or by the policy
+ * set in menuconfig:
+ *
+ * - keep: never shed.
+ * - drop oldest: keep at most the parameter of the rule queued, shedding the
+ *   oldest queued publish of the rule for a new one.
+ * - sample: send one publish of the rule in the parameter, shedding the
+ *   others before they are queued.
+ * - coalesce: keep only the newest queued publish of each topic.
+ *
+ * A publish is admitted with a ticket before it is queued, and the ticket is
+ * handed back with #PublishShedding_Dequeued when the agent takes the
+ * publish from its queue. A publish shed while queued is marked on its
+ * ticket, and is completed by the agent without being sent. The functions
+ * may be called from any task; the rules are added before publishing.
+ *
+ * Shed publishes are counted in the performance metrics, by policy, as are
+ * the episodes of congestion.
+ */
+
+#ifndef PUBLISH_SHEDDING_H_
+#define PUBLISH_SHEDDING_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether QoS 0 publishes are shed while the uplink is congested.
+ */
+#ifndef PUBLISH_SHEDDING_ENABLED
+    #if CONFIG_PUBLISH_SHEDDING_ENABLE
+        #define PUBLISH_SHEDDING_ENABLED    1
+    #else
+        #define PUBLISH_SHEDDING_ENABLED    0
+    #endif
+#endif
+
+#if PUBLISH_SHEDDING_ENABLED
+
+/**
+ * @brief The average write time of a congested link, in microseconds.
+ */
+    #ifndef PUBLISH_SHEDDING_SEND_LATENCY_US
+        #define PUBLISH_SHEDDING_SEND_LATENCY_US    ( ( uint32_t ) CONFIG_PUBLISH_SHEDDING_SEND_LATENCY_MS * 1000U )
+    #endif
+
+/**
+ * @brief The queued bulk commands of a congested link.
+ */
+    #ifndef PUBLISH_SHEDDING_QUEUE_DEPTH
+        #define PUBLISH_SHEDDING_QUEUE_DEPTH    CONFIG_PUBLISH_SHEDDING_QUEUE_DEPTH
+    #endif
+
+/**
+ * @brief The most rules added with #PublishShedding_AddRule.
+ */
+    #ifndef PUBLISH_SHEDDING_MAX_RULES
+        #define PUBLISH_SHEDDING_MAX_RULES    CONFIG_PUBLISH_SHEDDING_MAX_RULES
+    #endif
+
+/**
+ * @brief The policy of the topics without a rule, and its parameter.
+ */
+    #ifndef PUBLISH_SHEDDING_DEFAULT_POLICY
+        #if CONFIG_PUBLISH_SHEDDING_DEFAULT_KEEP
+            #define PUBLISH_SHEDDING_DEFAULT_POLICY    PublishSheddingKeep
+        #elif CONFIG_PUBLISH_SHEDDING_DEFAULT_SAMPLE
+            #define PUBLISH_SHEDDING_DEFAULT_POLICY    PublishSheddingSample
+        #elif CONFIG_PUBLISH_SHEDDING_DEFAULT_COALESCE
+            #define PUBLISH_SHEDDING_DEFAULT_POLICY    PublishSheddingCoalesce
+        #else
+            #define PUBLISH_SHEDDING_DEFAULT_POLICY    PublishSheddingDropOldest
+        #endif
+    #endif
+
+    #ifndef PUBLISH_SHEDDING_DEFAULT_PARAMETER
+        #define PUBLISH_SHEDDING_DEFAULT_PARAMETER    CONFIG_PUBLISH_SHEDDING_DEFAULT_PARAMETER
+    #endif
+
+/**
+ * @brief What is done with the QoS 0 publishes of a topic while the link is
+ * congested.
+ */
+typedef enum PublishSheddingPolicy
+{
+    PublishSheddingKeep,       /**< Never shed. */
+    PublishSheddingDropOldest, /**< Keep the newest publishes queued, as many as the parameter. */
+    PublishSheddingSample,     /**< Send one publish in the parameter. */
+    PublishSheddingCoalesce    /**< Keep the newest queued publish of each topic. */
+} PublishSheddingPolicy_t;
+
+/**
+ * @brief The ticket of an admitted publish, owned by its publisher until it
+ * is handed back. The fields are private to this module.
+ */
+typedef struct PublishSheddingTicket
+{
+    struct PublishSheddingTicket * pNext;
+    uint32_t topicHash;
+    uint16_t topicNameLength;
+    uint8_t rule;
+    bool shed;
+} PublishSheddingTicket_t;
+
+/**
+ * @brief Sets the policy of the topics starting with @a pTopicPrefix. The
+ * longest matching prefix applies. Not thread safe; add the rules before
+ * publishing.
+ *
+ * @param[in] pTopicPrefix The prefix, which is not copied.
+ * @param[in] policy The policy.
+ * @param[in] parameter The publishes kept queued when dropping the oldest,
+ * or one in how many is sent when sampling, at least 1. Ignored by the
+ * other policies.
+ *
+ * @return false if all PUBLISH_SHEDDING_MAX_RULES rules are in use.
+ */
+bool PublishShedding_AddRule( const char * pTopicPrefix,
+                              PublishSheddingPolicy_t policy,
+                              uint32_t parameter );
+
+/**
+ * @brief Decides whether a QoS 0 publish is queued, and sheds publishes
+ * queued before it by the policy of its topic.
+ *
+ * @param[out] pTicket The ticket of the publish, handed back with
+ * #PublishShedding_Dequeued if the publish is admitted.
+ * @param[in] pTopicName The topic of the publish.
+ * @param[in] topicNameLength The length of @a pTopicName.
+ * @param[in] queuedCommands The bulk commands queued for the agent.
+ *
+ * @return true if the publish is to be queued, or false if it is shed.
+ */
+bool PublishShedding_Admit( PublishSheddingTicket_t * pTicket,
+                            const char * pTopicName,
+                            uint16_t topicNameLength,
+                            size_t queuedCommands );
+
+/**
+ * @brief Hands back the ticket of an admitted publish, once the agent took
+ * it from its queue, or once queueing it failed.
+ *
+ * @param[in] pTicket The ticket given to #PublishShedding_Admit.
+ *
+ * @return true if the publish is to be sent, or false if it was shed while
+ * queued.
+ */
+bool PublishShedding_Dequeued( PublishSheddingTicket_t * pTicket );
+
+/**
+ * @brief Feeds the moving average of the write time of the transport.
+ *
+ * @param[in] durationUs The time a write took, in microseconds.
+ */
+void PublishShedding_RecordSend( uint32_t durationUs );
+
+/**
+ * @brief Whether the link is congested.
+ */
+bool PublishShedding_IsCongested( void );
+
+#endif /* if PUBLISH_SHEDDING_ENABLED */
+
+#endif /* ifndef PUBLISH_SHEDDING_H_ */
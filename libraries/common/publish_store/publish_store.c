@@ -0,0 +1,759 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file publish_store.c
+ * @brief Implementation of the flash log of publishes.
+ *
+ * The partition is a ring of sectors, each starting with a header carrying
+ * an increasing sequence number, so the newest sector is found after a
+ * reset. Records are appended to the newest sector and never cross a
+ * sector; when it is full, the next sector in the ring is erased and opened,
+ * unless it still holds a publish not yet acknowledged. After a reset,
+ * appending starts in a fresh sector, since the end of the last one may hold
+ * a record cut short.
+ *
+ * A record is a header, the topic name and the payload. Its state word is
+ * left erased when the record is written and cleared once the publish is
+ * acknowledged, which flash allows without an erase. RAM only holds three
+ * positions in the log: where the next record is written, the oldest record
+ * not acknowledged, and the next record to drain.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+/* ESP-IDF includes. */
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_spi_flash.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the publish store. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Publish Store"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "publish_store.h"
+
+#if PUBLISH_STORE
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The unit in which the partition is erased.
+ */
+    #define STORE_SECTOR_SIZE         ( ( uint32_t ) SPI_FLASH_SEC_SIZE )
+
+/**
+ * @brief Marks a sector header and a record header as written.
+ */
+    #define SECTOR_MAGIC              ( 0x50535452U ) /* "PSTR" */
+    #define RECORD_MAGIC              ( 0x5052U )     /* "PR" */
+
+/**
+ * @brief The state word of a record before and after its PUBACK.
+ */
+    #define RECORD_PENDING            ( 0xFFFFFFFFU )
+    #define RECORD_CONSUMED           ( 0x00000000U )
+
+/**
+ * @brief Records start on a word boundary.
+ */
+    #define RECORD_ALIGN( length )    ( ( ( length ) + 3U ) & ~( ( uint32_t ) 3U ) )
+
+/**
+ * @brief The bytes of a record read at a time to check it without a slot.
+ */
+    #define CHECK_CHUNK_SIZE          ( 64U )
+
+/**
+ * @brief The header at the start of every sector in use.
+ */
+typedef struct SectorHeader
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t crc; /* Of the magic and sequence. */
+    uint32_t reserved;
+} SectorHeader_t;
+
+/**
+ * @brief The header of a record, written after its topic and payload.
+ */
+typedef struct RecordHeader
+{
+    uint16_t magic;
+    uint16_t topicLength;
+    uint16_t payloadLength;
+    uint16_t reserved;
+    uint32_t crc;   /* Of the fields above, the topic and the payload. */
+    uint32_t state; /* Not covered by the CRC, cleared on the PUBACK. */
+} RecordHeader_t;
+
+/**
+ * @brief A place in the log.
+ */
+typedef struct StorePosition
+{
+    uint32_t sector;
+    uint32_t offset;
+} StorePosition_t;
+
+/**
+ * @brief A publish read from the log, waiting for its PUBACK.
+ */
+typedef struct DrainSlot
+{
+    bool inUse;
+    StorePosition_t position;
+    uint8_t data[ PUBLISH_STORE_MAX_PUBLISH_SIZE + 1U ];
+} DrainSlot_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The partition holding the log, NULL until initialized.
+ */
+static const esp_partition_t * pPartition = NULL;
+
+/**
+ * @brief The number of sectors in the partition.
+ */
+static uint32_t sectorCount = 0U;
+
+/**
+ * @brief Where the next record is written, and the sequence number of its
+ * sector. An offset of #STORE_SECTOR_SIZE means the next record opens a new
+ * sector.
+ */
+static StorePosition_t head;
+static uint32_t headSequence = 0U;
+
+/**
+ * @brief The oldest record not acknowledged, or #head if there is none.
+ */
+static StorePosition_t tail;
+
+/**
+ * @brief The next record to drain.
+ */
+static StorePosition_t readPosition;
+
+/**
+ * @brief The records not acknowledged, drained or not.
+ */
+static size_t pendingCount = 0U;
+
+/**
+ * @brief The publishes drained and waiting for their PUBACK.
+ */
+static DrainSlot_t slots[ PUBLISH_STORE_DRAIN_SLOTS ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The offset of a position in the partition.
+ */
+static uint32_t partitionOffset( const StorePosition_t * pPosition );
+
+/**
+ * @brief Whether two positions are the same.
+ */
+static bool samePosition( const StorePosition_t * pFirst,
+                          const StorePosition_t * pSecond );
+
+/**
+ * @brief Whether a sector starts with a valid header, and its sequence.
+ */
+static bool readSectorHeader( uint32_t sector,
+                              uint32_t * pSequence );
+
+/**
+ * @brief Moves @a pPosition to the first valid record at or after it, before
+ * #head. The rest of a sector is skipped at the first record that is erased,
+ * out of bounds or fails its CRC.
+ *
+ * @param[in,out] pPosition Where to start, then the record found, or #head.
+ * @param[out] pHeader The header of the record found.
+ * @param[out] pData Where the topic and payload are read, of
+ * #PUBLISH_STORE_MAX_PUBLISH_SIZE bytes. NULL to only check them.
+ *
+ * @return false if no record is left before #head.
+ */
+static bool findRecord( StorePosition_t * pPosition,
+                        RecordHeader_t * pHeader,
+                        uint8_t * pData );
+
+/**
+ * @brief The position after a record.
+ */
+static void skipRecord( StorePosition_t * pPosition,
+                        const RecordHeader_t * pHeader );
+
+/**
+ * @brief The CRC of a record header, without its topic and payload.
+ */
+static uint32_t headerCrc( const RecordHeader_t * pHeader );
+
+/**
+ * @brief Erases the sector after #head and makes it the newest.
+ *
+ * @return false if that sector still holds a record not acknowledged, or the
+ * flash operation failed.
+ */
+static bool openSector( void );
+
+/**
+ * @brief Moves #tail from the record just acknowledged to the oldest record
+ * not acknowledged after it.
+ */
+static void advanceTail( void );
+
+/**
+ * @brief Finds the newest sector and the records not acknowledged, once the
+ * partition is found.
+ */
+static void loadLog( void );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t partitionOffset( const StorePosition_t * pPosition )
+{
+    return ( pPosition->sector * STORE_SECTOR_SIZE ) + pPosition->offset;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool samePosition( const StorePosition_t * pFirst,
+                          const StorePosition_t * pSecond )
+{
+    return ( pFirst->sector == pSecond->sector ) && ( pFirst->offset == pSecond->offset );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool readSectorHeader( uint32_t sector,
+                              uint32_t * pSequence )
+{
+    SectorHeader_t header;
+    bool valid = false;
+
+    if( esp_partition_read( pPartition, sector * STORE_SECTOR_SIZE, &header, sizeof( header ) ) == ESP_OK )
+    {
+        valid = ( header.magic == SECTOR_MAGIC ) &&
+                ( header.crc == esp_rom_crc32_le( 0U, ( const uint8_t * ) &header,
+                                                  offsetof( SectorHeader_t, crc ) ) );
+    }
+
+    if( valid == true )
+    {
+        *pSequence = header.sequence;
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t headerCrc( const RecordHeader_t * pHeader )
+{
+    return esp_rom_crc32_le( 0U, ( const uint8_t * ) pHeader, offsetof( RecordHeader_t, crc ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void skipRecord( StorePosition_t * pPosition,
+                        const RecordHeader_t * pHeader )
+{
+    pPosition->offset += ( uint32_t ) sizeof( RecordHeader_t ) +
+                         RECORD_ALIGN( ( uint32_t ) pHeader->topicLength + pHeader->payloadLength );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool findRecord( StorePosition_t * pPosition,
+                        RecordHeader_t * pHeader,
+                        uint8_t * pData )
+{
+    bool found = false;
+    bool valid = false;
+    uint8_t chunk[ CHECK_CHUNK_SIZE ];
+    uint32_t dataLength = 0U;
+    uint32_t dataOffset = 0U;
+    uint32_t readLength = 0U;
+    uint32_t crc = 0U;
+
+    while( ( found == false ) && ( samePosition( pPosition, &head ) == false ) )
+    {
+        valid = ( ( pPosition->offset + sizeof( RecordHeader_t ) ) <= STORE_SECTOR_SIZE ) &&
+                ( esp_partition_read( pPartition, partitionOffset( pPosition ),
+                                      pHeader, sizeof( RecordHeader_t ) ) == ESP_OK ) &&
+                ( pHeader->magic == RECORD_MAGIC );
+
+        if( valid == true )
+        {
+            dataLength = ( uint32_t ) pHeader->topicLength + pHeader->payloadLength;
+            valid = ( dataLength <= PUBLISH_STORE_MAX_PUBLISH_SIZE ) &&
+                    ( ( pPosition->offset + sizeof( RecordHeader_t ) + dataLength ) <= STORE_SECTOR_SIZE );
+        }
+
+        if( valid == true )
+        {
+            crc = headerCrc( pHeader );
+            dataOffset = 0U;
+
+            /* Check the data read into the slot, or a chunk at a time. */
+            while( ( valid == true ) && ( dataOffset < dataLength ) )
+            {
+                readLength = ( pData != NULL ) ? dataLength : CHECK_CHUNK_SIZE;
+
+                if( readLength > ( dataLength - dataOffset ) )
+                {
+                    readLength = dataLength - dataOffset;
+                }
+
+                valid = ( esp_partition_read( pPartition,
+                                              partitionOffset( pPosition ) + sizeof( RecordHeader_t ) + dataOffset,
+                                              ( pData != NULL ) ? &pData[ dataOffset ] : chunk,
+                                              readLength ) == ESP_OK );
+                crc = esp_rom_crc32_le( crc, ( pData != NULL ) ? &pData[ dataOffset ] : chunk, readLength );
+                dataOffset += readLength;
+            }
+
+            valid = ( valid == true ) && ( crc == pHeader->crc );
+        }
+
+        if( valid == true )
+        {
+            found = true;
+        }
+        else if( pPosition->sector == head.sector )
+        {
+            /* Nothing but erased or broken flash is left before the head. */
+            *pPosition = head;
+        }
+        else
+        {
+            pPosition->sector = ( pPosition->sector + 1U ) % sectorCount;
+            pPosition->offset = sizeof( SectorHeader_t );
+        }
+    }
+
+    return found;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool openSector( void )
+{
+    bool status = true;
+    uint32_t nextSector = ( head.sector + 1U ) % sectorCount;
+    SectorHeader_t header;
+
+    if( ( pendingCount > 0U ) && ( tail.sector == nextSector ) )
+    {
+        LogWarn( ( "The publish store is full of %u publishes not acknowledged.",
+                   ( unsigned ) pendingCount ) );
+        status = false;
+    }
+
+    if( status == true )
+    {
+        status = ( esp_partition_erase_range( pPartition, nextSector * STORE_SECTOR_SIZE,
+                                              STORE_SECTOR_SIZE ) == ESP_OK );
+    }
+
+    if( status == true )
+    {
+        ( void ) memset( &header, 0xFF, sizeof( header ) );
+        header.magic = SECTOR_MAGIC;
+        header.sequence = headSequence + 1U;
+        header.crc = esp_rom_crc32_le( 0U, ( const uint8_t * ) &header, offsetof( SectorHeader_t, crc ) );
+
+        status = ( esp_partition_write( pPartition, nextSector * STORE_SECTOR_SIZE,
+                                        &header, sizeof( header ) ) == ESP_OK );
+    }
+
+    if( status == true )
+    {
+        /* With nothing pending, the tail and the drain sit at the head and
+         * follow it into the new sector. */
+        if( pendingCount == 0U )
+        {
+            tail.sector = nextSector;
+            tail.offset = sizeof( SectorHeader_t );
+            readPosition = tail;
+        }
+
+        head.sector = nextSector;
+        head.offset = sizeof( SectorHeader_t );
+        headSequence++;
+    }
+    else if( pendingCount > 0U )
+    {
+        /* Full, already logged. */
+    }
+    else
+    {
+        LogError( ( "Failed to open sector %u of the publish store.", ( unsigned ) nextSector ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void advanceTail( void )
+{
+    RecordHeader_t header;
+    bool found = findRecord( &tail, &header, NULL );
+
+    /* The record at the tail counts as acknowledged even if clearing its
+     * state word failed. */
+    while( found == true )
+    {
+        skipRecord( &tail, &header );
+        found = findRecord( &tail, &header, NULL );
+
+        if( ( found == true ) && ( header.state == RECORD_PENDING ) )
+        {
+            break;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void loadLog( void )
+{
+    bool found = false;
+    uint32_t sector = 0U;
+    uint32_t sequence = 0U;
+    StorePosition_t position;
+    RecordHeader_t header;
+
+    sectorCount = pPartition->size / STORE_SECTOR_SIZE;
+    headSequence = 0U;
+
+    /* The newest sector in use holds the last record written. */
+    for( sector = 0U; sector < sectorCount; sector++ )
+    {
+        if( ( readSectorHeader( sector, &sequence ) == true ) &&
+            ( ( found == false ) || ( ( int32_t ) ( sequence - headSequence ) > 0 ) ) )
+        {
+            head.sector = sector;
+            headSequence = sequence;
+            found = true;
+        }
+    }
+
+    if( found == false )
+    {
+        head.sector = sectorCount - 1U;
+    }
+
+    /* Start appending in a fresh sector. */
+    head.offset = STORE_SECTOR_SIZE;
+    tail = head;
+    pendingCount = 0U;
+    ( void ) memset( slots, 0x00, sizeof( slots ) );
+
+    /* Walk the ring from the oldest sector, which follows the newest. */
+    position.sector = ( head.sector + 1U ) % sectorCount;
+    position.offset = sizeof( SectorHeader_t );
+
+    while( findRecord( &position, &header, NULL ) == true )
+    {
+        if( header.state == RECORD_PENDING )
+        {
+            if( pendingCount == 0U )
+            {
+                tail = position;
+            }
+
+            pendingCount++;
+        }
+
+        skipRecord( &position, &header );
+    }
+
+    readPosition = tail;
+}
+
+/*-----------------------------------------------------------*/
+
+bool PublishStore_Init( void )
+{
+    bool status = true;
+
+    if( pPartition == NULL )
+    {
+        pPartition = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                               PUBLISH_STORE_PARTITION_LABEL );
+
+        if( ( pPartition == NULL ) || ( ( pPartition->size / STORE_SECTOR_SIZE ) < 2U ) )
+        {
+            LogError( ( "No data partition %s of at least two sectors for the publish store.",
+                        PUBLISH_STORE_PARTITION_LABEL ) );
+            pPartition = NULL;
+            status = false;
+        }
+        else
+        {
+            loadLog();
+            LogInfo( ( "The publish store holds %u publishes not acknowledged.",
+                       ( unsigned ) pendingCount ) );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool PublishStore_Append( const char * pTopic,
+                          uint16_t topicLength,
+                          const void * pPayload,
+                          size_t payloadLength )
+{
+    bool status = true;
+    RecordHeader_t header;
+    uint32_t recordLength = 0U;
+    uint32_t offset = 0U;
+
+    assert( ( pTopic != NULL ) && ( topicLength > 0U ) );
+    assert( ( pPayload != NULL ) || ( payloadLength == 0U ) );
+
+    if( pPartition == NULL )
+    {
+        LogError( ( "The publish store isn't initialized." ) );
+        status = false;
+    }
+    else if( ( ( size_t ) topicLength + payloadLength ) > PUBLISH_STORE_MAX_PUBLISH_SIZE )
+    {
+        LogError( ( "A publish of %u bytes doesn't fit in the publish store.",
+                    ( unsigned ) ( topicLength + payloadLength ) ) );
+        status = false;
+    }
+    else
+    {
+        recordLength = ( uint32_t ) sizeof( RecordHeader_t ) +
+                       RECORD_ALIGN( ( uint32_t ) topicLength + ( uint32_t ) payloadLength );
+
+        if( ( head.offset + recordLength ) > STORE_SECTOR_SIZE )
+        {
+            status = openSector();
+        }
+    }
+
+    if( status == true )
+    {
+        ( void ) memset( &header, 0xFF, sizeof( header ) );
+        header.magic = RECORD_MAGIC;
+        header.topicLength = topicLength;
+        header.payloadLength = ( uint16_t ) payloadLength;
+        header.crc = headerCrc( &header );
+        header.crc = esp_rom_crc32_le( header.crc, ( const uint8_t * ) pTopic, topicLength );
+        header.crc = esp_rom_crc32_le( header.crc, ( const uint8_t * ) pPayload, payloadLength );
+        header.state = RECORD_PENDING;
+
+        /* The header goes last, so a record cut short has none. */
+        offset = partitionOffset( &head );
+        status = ( esp_partition_write( pPartition, offset + sizeof( header ),
+                                        pTopic, topicLength ) == ESP_OK ) &&
+                 ( ( payloadLength == 0U ) ||
+                   ( esp_partition_write( pPartition, offset + sizeof( header ) + topicLength,
+                                          pPayload, payloadLength ) == ESP_OK ) ) &&
+                 ( esp_partition_write( pPartition, offset, &header, sizeof( header ) ) == ESP_OK );
+
+        if( status == true )
+        {
+            head.offset += recordLength;
+            pendingCount++;
+        }
+        else
+        {
+            /* The sector may hold part of the record, so leave it. */
+            LogError( ( "Failed to write a publish to the publish store." ) );
+            head.offset = STORE_SECTOR_SIZE;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool PublishStore_Drain( PublishStorePublish_t publish,
+                         void * pContext,
+                         size_t * pDrained )
+{
+    bool status = true;
+    size_t drained = 0U;
+    size_t slotIndex = 0U;
+    DrainSlot_t * pSlot = NULL;
+    RecordHeader_t header;
+
+    assert( publish != NULL );
+
+    while( ( status == true ) && ( pPartition != NULL ) )
+    {
+        for( pSlot = NULL, slotIndex = 0U; slotIndex < PUBLISH_STORE_DRAIN_SLOTS; slotIndex++ )
+        {
+            if( slots[ slotIndex ].inUse == false )
+            {
+                pSlot = &slots[ slotIndex ];
+                break;
+            }
+        }
+
+        if( ( pSlot == NULL ) || ( findRecord( &readPosition, &header, pSlot->data ) == false ) )
+        {
+            break;
+        }
+
+        pSlot->position = readPosition;
+        pSlot->data[ header.topicLength + header.payloadLength ] = 0U;
+        skipRecord( &readPosition, &header );
+
+        /* Acknowledged before a rewind. */
+        if( header.state != RECORD_PENDING )
+        {
+            continue;
+        }
+
+        pSlot->inUse = true;
+
+        if( publish( ( const char * ) pSlot->data, header.topicLength,
+                     &( pSlot->data[ header.topicLength ] ), header.payloadLength,
+                     pContext ) == true )
+        {
+            drained++;
+        }
+        else
+        {
+            /* Hand it out again next time. */
+            pSlot->inUse = false;
+            readPosition = pSlot->position;
+            status = false;
+        }
+    }
+
+    if( pDrained != NULL )
+    {
+        *pDrained = drained;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool PublishStore_IsDrained( void )
+{
+    StorePosition_t position = readPosition;
+    RecordHeader_t header;
+    bool found = ( pPartition != NULL ) && ( findRecord( &position, &header, NULL ) == true );
+
+    while( ( found == true ) && ( header.state != RECORD_PENDING ) )
+    {
+        skipRecord( &position, &header );
+        found = findRecord( &position, &header, NULL );
+    }
+
+    return ( found == false );
+}
+
+/*-----------------------------------------------------------*/
+
+bool PublishStore_Release( const void * pPayload )
+{
+    const uint8_t * pByte = ( const uint8_t * ) pPayload;
+    DrainSlot_t * pSlot = NULL;
+    size_t slotIndex = 0U;
+    uint32_t consumed = RECORD_CONSUMED;
+
+    for( slotIndex = 0U; slotIndex < PUBLISH_STORE_DRAIN_SLOTS; slotIndex++ )
+    {
+        if( ( slots[ slotIndex ].inUse == true ) && ( pByte >= slots[ slotIndex ].data ) &&
+            ( pByte <= &( slots[ slotIndex ].data[ PUBLISH_STORE_MAX_PUBLISH_SIZE ] ) ) )
+        {
+            pSlot = &slots[ slotIndex ];
+            break;
+        }
+    }
+
+    if( pSlot != NULL )
+    {
+        if( esp_partition_write( pPartition,
+                                 partitionOffset( &( pSlot->position ) ) + offsetof( RecordHeader_t, state ),
+                                 &consumed, sizeof( consumed ) ) != ESP_OK )
+        {
+            /* Sent again after a reset. */
+            LogWarn( ( "Failed to mark a stored publish acknowledged." ) );
+        }
+
+        pSlot->inUse = false;
+
+        /* A publish whose state stayed pending is counted again on a rewind. */
+        if( pendingCount > 0U )
+        {
+            pendingCount--;
+        }
+
+        if( samePosition( &( pSlot->position ), &tail ) == true )
+        {
+            advanceTail();
+        }
+    }
+
+    return ( pSlot != NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void PublishStore_Rewind( void )
+{
+    size_t slotIndex = 0U;
+
+    for( slotIndex = 0U; slotIndex < PUBLISH_STORE_DRAIN_SLOTS; slotIndex++ )
+    {
+        slots[ slotIndex ].inUse = false;
+    }
+
+    readPosition = tail;
+}
+
+/*-----------------------------------------------------------*/
+
+#endif /* if PUBLISH_STORE */
@@ -0,0 +1,165 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file publish_store.h
+ * @brief Keep publishes in flash until the broker acknowledges them.
+ *
+ * Publishes that can't be sent while the connection is down are appended to
+ * a log in a dedicated data partition. Once a session is back, the log is
+ * drained oldest first: each publish is read into one of
+ * #PUBLISH_STORE_DRAIN_SLOTS RAM slots and handed to a publish callback,
+ * and it stays in flash until #PublishStore_Release is called with its
+ * payload on the PUBACK. RAM use is bounded by the slots, whatever the
+ * length of the outage.
+ *
+ * Records are written whole before their header, so a reset while writing
+ * leaves no record, and are marked consumed in place after the PUBACK, so a
+ * reset before that sends the publish again. The functions are not thread
+ * safe and are called from the task that owns the MQTT context.
+ */
+
+#ifndef PUBLISH_STORE_H_
+#define PUBLISH_STORE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether publishes are kept in flash while disconnected.
+ */
+#ifndef PUBLISH_STORE
+    #define PUBLISH_STORE    CONFIG_PUBLISH_STORE
+#endif
+
+#if PUBLISH_STORE
+
+/**
+ * @brief The label of the data partition holding the log.
+ */
+    #ifndef PUBLISH_STORE_PARTITION_LABEL
+        #define PUBLISH_STORE_PARTITION_LABEL    CONFIG_PUBLISH_STORE_PARTITION_LABEL
+    #endif
+
+/**
+ * @brief The largest topic name and payload stored, together.
+ */
+    #ifndef PUBLISH_STORE_MAX_PUBLISH_SIZE
+        #define PUBLISH_STORE_MAX_PUBLISH_SIZE    CONFIG_PUBLISH_STORE_MAX_PUBLISH_SIZE
+    #endif
+
+/**
+ * @brief The number of stored publishes waiting for a PUBACK at once.
+ */
+    #ifndef PUBLISH_STORE_DRAIN_SLOTS
+        #define PUBLISH_STORE_DRAIN_SLOTS    CONFIG_PUBLISH_STORE_DRAIN_SLOTS
+    #endif
+
+/**
+ * @brief Publishes a stored message.
+ *
+ * The topic and payload stay valid until the payload is passed to
+ * #PublishStore_Release or the store is rewound, so a QoS 1 publish can
+ * reference them until its PUBACK. The payload is followed by a NUL.
+ *
+ * @return false if the message wasn't sent, in which case it is handed out
+ * again by the next drain.
+ */
+typedef bool (* PublishStorePublish_t )( const char * pTopic,
+                                         uint16_t topicLength,
+                                         const uint8_t * pPayload,
+                                         size_t payloadLength,
+                                         void * pContext );
+
+/**
+ * @brief Finds the partition and the publishes stored before the last reset.
+ * Only the first call after boot reads the partition; later calls, such as on
+ * a reconnect, keep the state as it is.
+ *
+ * @return false if the partition is missing or smaller than two sectors.
+ */
+bool PublishStore_Init( void );
+
+/**
+ * @brief Appends a publish to the log.
+ *
+ * @param[in] pTopic The topic name.
+ * @param[in] topicLength The length of @a pTopic.
+ * @param[in] pPayload The payload.
+ * @param[in] payloadLength The length of @a pPayload.
+ *
+ * @return false if the store isn't initialized, the publish is larger than
+ * #PUBLISH_STORE_MAX_PUBLISH_SIZE, the partition is full of publishes not
+ * yet acknowledged, or the flash write failed.
+ */
+bool PublishStore_Append( const char * pTopic,
+                          uint16_t topicLength,
+                          const void * pPayload,
+                          size_t payloadLength );
+
+/**
+ * @brief Hands stored publishes to @a publish, oldest first, until every
+ * slot is waiting for a PUBACK or the log is drained.
+ *
+ * @param[in] publish Publishes each message.
+ * @param[in] pContext Passed to @a publish.
+ * @param[out] pDrained The number of publishes handed out. Can be NULL.
+ *
+ * @return false if @a publish failed.
+ */
+bool PublishStore_Drain( PublishStorePublish_t publish,
+                         void * pContext,
+                         size_t * pDrained );
+
+/**
+ * @brief Whether every stored publish not acknowledged has been handed to a
+ * publish callback since the last rewind.
+ */
+bool PublishStore_IsDrained( void );
+
+/**
+ * @brief Drops a publish from the log once it is acknowledged, freeing its
+ * slot.
+ *
+ * @param[in] pPayload The payload passed to the publish callback. Payloads
+ * that don't belong to the store, and NULL, are ignored.
+ *
+ * @return true if the payload belonged to the store.
+ */
+bool PublishStore_Release( const void * pPayload );
+
+/**
+ * @brief Frees every slot without dropping its publish from the log, so the
+ * next drain starts again from the oldest publish not acknowledged. Call when
+ * the publishes in flight are given up, such as on a clean session.
+ */
+void PublishStore_Rewind( void );
+
+#endif /* if PUBLISH_STORE */
+
+#endif /* ifndef PUBLISH_STORE_H_ */
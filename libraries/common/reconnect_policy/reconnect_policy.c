@@ -0,0 +1,184 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file reconnect_policy.c
+ * @brief Implementation of the reconnect policy.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+
+/* ESP-IDF includes. */
+#include "esp_random.h"
+#include "esp_system.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the reconnect policy. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Reconnect Policy"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "reconnect_policy.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether the spread of the first connect of this boot was drawn.
+ */
+static bool bootSpreadDrawn = false;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A random number in [@a low, @a high].
+ */
+static uint32_t randomBetween( uint32_t low,
+                               uint32_t high );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t randomBetween( uint32_t low,
+                               uint32_t high )
+{
+    uint32_t span = high - low;
+
+    return ( span == UINT32_MAX ) ? esp_random() : ( low + ( esp_random() % ( span + 1U ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void ReconnectPolicy_Init( ReconnectPolicy_t * pPolicy,
+                           uint32_t baseMs,
+                           uint32_t maxMs,
+                           uint32_t maxAttempts )
+{
+    assert( ( pPolicy != NULL ) && ( baseMs <= maxMs ) );
+
+    pPolicy->baseMs = baseMs;
+    pPolicy->maxMs = maxMs;
+    pPolicy->maxAttempts = maxAttempts;
+    pPolicy->attempts = 0U;
+    pPolicy->delayMs = baseMs;
+}
+
+/*-----------------------------------------------------------*/
+
+void ReconnectPolicy_Start( ReconnectPolicy_t * pPolicy,
+                            uint32_t baseMs,
+                            uint32_t maxMs,
+                            uint32_t maxAttempts )
+{
+    uint32_t spreadMs = ReconnectPolicy_SpreadDelayMs( false );
+
+    ReconnectPolicy_Init( pPolicy, baseMs, maxMs, maxAttempts );
+
+    if( spreadMs > 0U )
+    {
+        vTaskDelay( pdMS_TO_TICKS( spreadMs ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool ReconnectPolicy_NextDelay( ReconnectPolicy_t * pPolicy,
+                                ReconnectFailure_t failure,
+                                uint32_t * pDelayMs )
+{
+    uint32_t high = 0U;
+    uint32_t delayMs = 0U;
+    bool status = false;
+
+    assert( ( pPolicy != NULL ) && ( pDelayMs != NULL ) );
+
+    if( ( pPolicy->maxAttempts == RECONNECT_POLICY_RETRY_FOREVER ) ||
+        ( pPolicy->attempts < pPolicy->maxAttempts ) )
+    {
+        pPolicy->attempts++;
+
+        /* Decorrelated jitter: between the base and three times the last
+         * delay. */
+        high = ( pPolicy->delayMs > ( UINT32_MAX / 3U ) ) ? UINT32_MAX : ( pPolicy->delayMs * 3U );
+        delayMs = randomBetween( pPolicy->baseMs, ( high > pPolicy->baseMs ) ? high : pPolicy->baseMs );
+
+        if( delayMs > pPolicy->maxMs )
+        {
+            delayMs = pPolicy->maxMs;
+        }
+
+        if( ( failure == ReconnectFailureRefused ) && ( delayMs < RECONNECT_POLICY_REFUSED_DELAY_MS ) )
+        {
+            /* Jittered too, so that the devices refused together don't come
+             * back together. */
+            delayMs = randomBetween( RECONNECT_POLICY_REFUSED_DELAY_MS,
+                                     RECONNECT_POLICY_REFUSED_DELAY_MS + ( RECONNECT_POLICY_REFUSED_DELAY_MS / 2U ) );
+            LogInfo( ( "The server refused the connection, backing off %u ms.", ( unsigned ) delayMs ) );
+        }
+
+        pPolicy->delayMs = delayMs;
+        *pDelayMs = delayMs;
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ReconnectPolicy_SpreadDelayMs( bool connectionLost )
+{
+    esp_reset_reason_t resetReason = ESP_RST_UNKNOWN;
+    uint32_t delayMs = 0U;
+    bool spread = connectionLost;
+
+    if( ( connectionLost == false ) && ( bootSpreadDrawn == false ) )
+    {
+        bootSpreadDrawn = true;
+        resetReason = esp_reset_reason();
+
+        /* A whole fleet resets together on a power cut, not on a crash or
+         * an update. */
+        spread = ( resetReason == ESP_RST_POWERON ) || ( resetReason == ESP_RST_BROWNOUT );
+    }
+
+    if( ( spread == true ) && ( RECONNECT_POLICY_SPREAD_WINDOW_MS > 0 ) )
+    {
+        delayMs = randomBetween( 0U, RECONNECT_POLICY_SPREAD_WINDOW_MS - 1U );
+        LogInfo( ( "Spreading the connect over %u ms, waiting %u ms.",
+                   ( unsigned ) RECONNECT_POLICY_SPREAD_WINDOW_MS,
+                   ( unsigned ) delayMs ) );
+    }
+
+    return delayMs;
+}
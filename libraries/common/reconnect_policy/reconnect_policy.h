@@ -0,0 +1,150 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file reconnect_policy.h
+ * @brief Backoff between connection attempts, with decorrelated jitter from
+ * the hardware random number generator.
+ *
+ * Each delay is drawn between the base delay and three times the previous
+ * delay, and capped. Unlike an exponential backoff whose jitter comes from
+ * rand(), two devices that boot at the same moment draw different delays,
+ * since esp_random() doesn't start from a fixed seed, and their delays
+ * drift further apart with each attempt. A refused connection waits at
+ * least #RECONNECT_POLICY_REFUSED_DELAY_MS, and the first connect after a
+ * power cut or a lost connection is spread over
+ * #RECONNECT_POLICY_SPREAD_WINDOW_MS.
+ */
+
+#ifndef RECONNECT_POLICY_H_
+#define RECONNECT_POLICY_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The shortest delay after a refused connection, in milliseconds.
+ */
+#ifndef RECONNECT_POLICY_REFUSED_DELAY_MS
+    #define RECONNECT_POLICY_REFUSED_DELAY_MS    CONFIG_RECONNECT_POLICY_REFUSED_DELAY_MS
+#endif
+
+/**
+ * @brief The window of the first connect after a power cut or a lost
+ * connection, in milliseconds.
+ */
+#ifndef RECONNECT_POLICY_SPREAD_WINDOW_MS
+    #define RECONNECT_POLICY_SPREAD_WINDOW_MS    CONFIG_RECONNECT_POLICY_SPREAD_WINDOW_MS
+#endif
+
+/**
+ * @brief The attempts of a policy that never gives up.
+ */
+#define RECONNECT_POLICY_RETRY_FOREVER    ( 0U )
+
+/**
+ * @brief Why a connection attempt failed.
+ */
+typedef enum ReconnectFailure
+{
+    ReconnectFailureNetwork, /**< The server couldn't be reached or the attempt timed out. */
+    ReconnectFailureRefused  /**< The server refused the TLS handshake or the CONNECT. */
+} ReconnectFailure_t;
+
+/**
+ * @brief The backoff of a sequence of attempts.
+ *
+ * The fields are private to this module.
+ */
+typedef struct ReconnectPolicy
+{
+    uint32_t baseMs;
+    uint32_t maxMs;
+    uint32_t maxAttempts;
+    uint32_t attempts;
+    uint32_t delayMs; /* The last delay, from which the next is drawn. */
+} ReconnectPolicy_t;
+
+/**
+ * @brief Starts a sequence of attempts, and again once one succeeded.
+ *
+ * @param[out] pPolicy The policy to initialize.
+ * @param[in] baseMs The shortest delay, in milliseconds.
+ * @param[in] maxMs The longest delay, in milliseconds, except after a
+ * refused connection.
+ * @param[in] maxAttempts The failed attempts after which to give up, or
+ * #RECONNECT_POLICY_RETRY_FOREVER.
+ */
+void ReconnectPolicy_Init( ReconnectPolicy_t * pPolicy,
+                           uint32_t baseMs,
+                           uint32_t maxMs,
+                           uint32_t maxAttempts );
+
+/**
+ * @brief Starts the first sequence of attempts of a connection, after
+ * waiting for #ReconnectPolicy_SpreadDelayMs so that devices powered up
+ * together don't all connect at once.
+ *
+ * @param[out] pPolicy The policy to initialize.
+ * @param[in] baseMs The shortest delay, in milliseconds.
+ * @param[in] maxMs The longest delay, in milliseconds, except after a
+ * refused connection.
+ * @param[in] maxAttempts The failed attempts after which to give up, or
+ * #RECONNECT_POLICY_RETRY_FOREVER.
+ */
+void ReconnectPolicy_Start( ReconnectPolicy_t * pPolicy,
+                            uint32_t baseMs,
+                            uint32_t maxMs,
+                            uint32_t maxAttempts );
+
+/**
+ * @brief The delay before the attempt following a failed one.
+ *
+ * @param[in] pPolicy The policy.
+ * @param[in] failure Why the attempt failed.
+ * @param[out] pDelayMs The delay, in milliseconds.
+ *
+ * @return false if the attempts are exhausted, in which case @a pDelayMs
+ * isn't set.
+ */
+bool ReconnectPolicy_NextDelay( ReconnectPolicy_t * pPolicy,
+                                ReconnectFailure_t failure,
+                                uint32_t * pDelayMs );
+
+/**
+ * @brief The delay before the first connect, spread over
+ * #RECONNECT_POLICY_SPREAD_WINDOW_MS.
+ *
+ * @param[in] connectionLost true after losing a connection that was up.
+ * Otherwise the delay is drawn for the first call after a power-on or
+ * brownout reset, and is 0 after any other reset and on later calls.
+ *
+ * @return The delay, in milliseconds.
+ */
+uint32_t ReconnectPolicy_SpreadDelayMs( bool connectionLost );
+
+#endif /* ifndef RECONNECT_POLICY_H_ */
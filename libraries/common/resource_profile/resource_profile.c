@@ -0,0 +1,129 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file resource_profile.c
+ * @brief Checks that the sizes of the build fit together, and logs them.
+ *
+ * Each check only applies when the components it is about are in the build.
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the resource profile. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Resource Profile"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "resource_profile.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The most bytes the OTA streaming service sends for one request.
+ */
+#define STREAM_RESPONSE_MAX_BYTES    ( 128L * 1024L )
+
+/**
+ * @brief The bytes of MQTT and CBOR headers around an OTA file block.
+ */
+#define BLOCK_HEADER_BYTES           128L
+
+/* coreMQTT tracks each QoS 1 publish in flight in its state array. */
+#if defined( CONFIG_MQTT_INFLIGHT_WINDOW ) && defined( CONFIG_MQTT_STATE_ARRAY_MAX_COUNT )
+    #if ( CONFIG_MQTT_INFLIGHT_WINDOW > CONFIG_MQTT_STATE_ARRAY_MAX_COUNT )
+        #error "CONFIG_MQTT_INFLIGHT_WINDOW publishes in flight don't fit in CONFIG_MQTT_STATE_ARRAY_MAX_COUNT."
+    #endif
+#endif
+
+#ifdef CONFIG_LOG2_FILE_BLOCK_SIZE
+
+/**
+ * @brief The bytes of an OTA file block.
+ */
+    #define FILE_BLOCK_BYTES    ( 1L << CONFIG_LOG2_FILE_BLOCK_SIZE )
+
+    #if ( CONFIG_MAX_NUM_BLOCKS_REQUEST * FILE_BLOCK_BYTES > STREAM_RESPONSE_MAX_BYTES )
+        #error "CONFIG_MAX_NUM_BLOCKS_REQUEST blocks are more than the 128 KB the streaming service sends per request."
+    #endif
+
+    #if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+        #if ( CONFIG_OTA_BLOCK_WINDOW_MAX * FILE_BLOCK_BYTES > STREAM_RESPONSE_MAX_BYTES )
+            #error "CONFIG_OTA_BLOCK_WINDOW_MAX blocks are more than the 128 KB the streaming service sends per request."
+        #endif
+
+        #if ( CONFIG_OTA_BLOCK_WINDOW_MIN > CONFIG_OTA_BLOCK_WINDOW_MAX )
+            #error "CONFIG_OTA_BLOCK_WINDOW_MIN must not be above CONFIG_OTA_BLOCK_WINDOW_MAX."
+        #endif
+    #endif
+
+    /* The OTA demos borrow their network buffer, and the OTA events, from
+     * the large slots of the arena. */
+    #if CONFIG_BUFFER_ARENA_ENABLE
+        #if ( CONFIG_BUFFER_ARENA_LARGE_SIZE < FILE_BLOCK_BYTES + BLOCK_HEADER_BYTES )
+            #error "CONFIG_BUFFER_ARENA_LARGE_SIZE must hold an OTA file block and 128 bytes of headers."
+        #endif
+
+        #if ( CONFIG_BUFFER_ARENA_QUOTA_OTA > 0 ) && ( CONFIG_BUFFER_ARENA_QUOTA_OTA < CONFIG_BUFFER_ARENA_LARGE_SIZE )
+            #error "CONFIG_BUFFER_ARENA_QUOTA_OTA must allow at least one large slot for OTA events."
+        #endif
+    #endif
+#endif /* ifdef CONFIG_LOG2_FILE_BLOCK_SIZE */
+
+/*-----------------------------------------------------------*/
+
+void ResourceProfile_Log( void )
+{
+    LogInfo( ( "Resource profile %s.", RESOURCE_PROFILE_NAME ) );
+
+    #ifdef CONFIG_MQTT_NETWORK_BUFFER_SIZE
+        LogInfo( ( "MQTT network buffer %d bytes.", CONFIG_MQTT_NETWORK_BUFFER_SIZE ) );
+    #endif
+
+    #ifdef CONFIG_MQTT_STATE_ARRAY_MAX_COUNT
+        LogInfo( ( "MQTT state array of %d publishes.", CONFIG_MQTT_STATE_ARRAY_MAX_COUNT ) );
+    #endif
+
+    #ifdef CONFIG_MQTT_INFLIGHT_WINDOW
+        LogInfo( ( "%d QoS 1 publishes in flight.", CONFIG_MQTT_INFLIGHT_WINDOW ) );
+    #endif
+
+    #ifdef CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_CALLBACKS
+        LogInfo( ( "Subscription manager of %d nodes and %d callbacks.",
+                   CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_NODES,
+                   CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_CALLBACKS ) );
+    #endif
+
+    #ifdef CONFIG_LOG2_FILE_BLOCK_SIZE
+        LogInfo( ( "OTA file blocks of %ld bytes, %d per request, %d data buffers.",
+                   FILE_BLOCK_BYTES,
+                   CONFIG_MAX_NUM_BLOCKS_REQUEST,
+                   CONFIG_MAX_NUM_OTA_DATA_BUFFERS ) );
+    #endif
+}
@@ -0,0 +1,63 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file resource_profile.h
+ * @brief The resource profile the build was configured with.
+ *
+ * The profiles are the sdkconfig.tiny, sdkconfig.balanced and
+ * sdkconfig.throughput defaults files of this component. Each sets the MQTT
+ * network buffer, the publishes in flight, the subscription pools and the OTA
+ * block size, window and buffers together. Building the component checks
+ * that the sizes of the build fit together, whether they come from a profile
+ * or not.
+ */
+
+#ifndef RESOURCE_PROFILE_H_
+#define RESOURCE_PROFILE_H_
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The name of the profile.
+ */
+#ifndef RESOURCE_PROFILE_NAME
+    #if CONFIG_RESOURCE_PROFILE_TINY
+        #define RESOURCE_PROFILE_NAME    "tiny"
+    #elif CONFIG_RESOURCE_PROFILE_BALANCED
+        #define RESOURCE_PROFILE_NAME    "balanced"
+    #elif CONFIG_RESOURCE_PROFILE_THROUGHPUT
+        #define RESOURCE_PROFILE_NAME    "throughput"
+    #else
+        #define RESOURCE_PROFILE_NAME    "custom"
+    #endif
+#endif
+
+/**
+ * @brief Logs the profile and the sizes it sets that are in the build, to
+ * tell apart the logs and measurements of builds with different profiles.
+ */
+void ResourceProfile_Log( void );
+
+#endif /* ifndef RESOURCE_PROFILE_H_ */
@@ -0,0 +1,328 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_cache.c
+ * @brief Implementation of the NVS cache of the acknowledged shadow state.
+ *
+ * An entry is one blob: a header, one record per field and a CRC of both.
+ * NVS replaces a blob only once the new one is written, so a reset while
+ * saving leaves the previous entry.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* ESP-IDF includes. */
+#include "esp_rom_crc.h"
+#include "nvs.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the shadow cache. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Shadow Cache"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "shadow_cache.h"
+
+#if SHADOW_CACHE
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Marks an entry of this layout of the blob.
+ */
+    #define CACHE_MAGIC    ( 0x53484331U )
+
+/**
+ * @brief The start of an entry.
+ */
+    typedef struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t layoutCrc; /* Of the keys and types of the fields. */
+        uint32_t version;
+        uint32_t fieldCount;
+    } CacheHeader_t;
+
+/**
+ * @brief What the shadow acknowledged of a field.
+ */
+    typedef struct CacheField
+    {
+        ShadowValue_t reported;
+        uint32_t isReported;
+    } CacheField_t;
+
+/**
+ * @brief An entry, of which the fields beyond the field count and the CRC
+ * that follows them are written.
+ */
+    typedef struct CacheEntry
+    {
+        CacheHeader_t header;
+        CacheField_t fields[ SHADOW_CACHE_MAX_FIELDS ];
+        uint32_t crc;
+    } CacheEntry_t;
+
+/**
+ * @brief The entry being saved or restored, static to keep it off the stack.
+ */
+    static CacheEntry_t entry;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The CRC of the keys and types of the fields of a state.
+ */
+    static uint32_t layoutCrc( const ShadowState_t * pState );
+
+/**
+ * @brief The length of the blob of an entry of @a fieldCount fields, without
+ * its CRC.
+ */
+    static size_t entryLength( size_t fieldCount );
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t layoutCrc( const ShadowState_t * pState )
+    {
+        uint32_t crc = 0U;
+        uint8_t type = 0U;
+        size_t i;
+
+        for( i = 0; i < pState->fieldCount; i++ )
+        {
+            type = ( uint8_t ) pState->pFields[ i ].type;
+
+            /* The terminator keeps "ab" + "c" apart from "a" + "bc". */
+            crc = esp_rom_crc32_le( crc, ( const uint8_t * ) pState->pFields[ i ].pKey,
+                                    strlen( pState->pFields[ i ].pKey ) + 1U );
+            crc = esp_rom_crc32_le( crc, &type, 1U );
+        }
+
+        return crc;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static size_t entryLength( size_t fieldCount )
+    {
+        return offsetof( CacheEntry_t, fields ) + ( fieldCount * sizeof( CacheField_t ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void ShadowCache_Init( ShadowCache_t * pCache,
+                           const char * pThingName,
+                           size_t thingNameLength,
+                           const char * pShadowName,
+                           size_t shadowNameLength )
+    {
+        uint32_t crc = 0U;
+
+        assert( pCache != NULL );
+        assert( pThingName != NULL );
+
+        crc = esp_rom_crc32_le( 0U, ( const uint8_t * ) pThingName, thingNameLength );
+
+        if( pShadowName != NULL )
+        {
+            crc = esp_rom_crc32_le( crc, ( const uint8_t * ) "/", 1U );
+            crc = esp_rom_crc32_le( crc, ( const uint8_t * ) pShadowName, shadowNameLength );
+        }
+
+        ( void ) memset( pCache, 0x00, sizeof( *pCache ) );
+        ( void ) snprintf( pCache->key, sizeof( pCache->key ), "s%08lx", ( unsigned long ) crc );
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool ShadowCache_Restore( ShadowCache_t * pCache,
+                              ShadowState_t * pState )
+    {
+        nvs_handle_t handle;
+        size_t length = sizeof( entry );
+        size_t expectedLength = 0U;
+        bool status = false;
+        size_t i;
+
+        assert( ( pCache != NULL ) && ( pState != NULL ) );
+
+        expectedLength = entryLength( pState->fieldCount );
+
+        if( pState->fieldCount > SHADOW_CACHE_MAX_FIELDS )
+        {
+            LogError( ( "A state of %u fields doesn't fit in the cache of %u fields.",
+                        ( unsigned ) pState->fieldCount, ( unsigned ) SHADOW_CACHE_MAX_FIELDS ) );
+        }
+        else if( nvs_open( SHADOW_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK )
+        {
+            status = ( nvs_get_blob( handle, pCache->key, &entry, &length ) == ESP_OK ) &&
+                     ( length == ( expectedLength + sizeof( entry.crc ) ) );
+            nvs_close( handle );
+        }
+        else
+        {
+            /* Nothing was saved yet. */
+        }
+
+        if( status == true )
+        {
+            /* The CRC was written right after the last field. */
+            ( void ) memcpy( &entry.crc, &( ( const uint8_t * ) &entry )[ expectedLength ], sizeof( entry.crc ) );
+
+            status = ( entry.crc == esp_rom_crc32_le( 0U, ( const uint8_t * ) &entry, expectedLength ) ) &&
+                     ( entry.header.magic == CACHE_MAGIC ) &&
+                     ( entry.header.fieldCount == pState->fieldCount ) &&
+                     ( entry.header.layoutCrc == layoutCrc( pState ) );
+
+            if( status == false )
+            {
+                LogWarn( ( "Ignoring the cached shadow state %s, it is damaged or for other fields.",
+                           pCache->key ) );
+            }
+        }
+
+        if( status == true )
+        {
+            for( i = 0; i < pState->fieldCount; i++ )
+            {
+                pState->pFields[ i ].reported = entry.fields[ i ].reported;
+                pState->pFields[ i ].isReported = ( entry.fields[ i ].isReported != 0U );
+            }
+
+            pState->version = entry.header.version;
+            pState->latestVersion = entry.header.version;
+
+            pCache->storedCrc = entry.crc;
+            pCache->stored = true;
+
+            LogInfo( ( "Restored the shadow state at version %u.", ( unsigned ) entry.header.version ) );
+        }
+
+        return status;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool ShadowCache_Save( ShadowCache_t * pCache,
+                           const ShadowState_t * pState )
+    {
+        nvs_handle_t handle;
+        size_t length = 0U;
+        bool empty = true;
+        bool status = true;
+        esp_err_t err = ESP_OK;
+        const ShadowField_t * pField = NULL;
+        size_t i;
+
+        assert( ( pCache != NULL ) && ( pState != NULL ) );
+        assert( pState->fieldCount <= SHADOW_CACHE_MAX_FIELDS );
+
+        ( void ) memset( &entry, 0x00, sizeof( entry ) );
+        entry.header.magic = CACHE_MAGIC;
+        entry.header.layoutCrc = layoutCrc( pState );
+        entry.header.version = pState->version;
+        entry.header.fieldCount = ( uint32_t ) pState->fieldCount;
+        empty = ( pState->version == 0U );
+
+        for( i = 0; i < pState->fieldCount; i++ )
+        {
+            pField = &pState->pFields[ i ];
+
+            if( pField->isReported == true )
+            {
+                entry.fields[ i ].isReported = 1U;
+                empty = false;
+
+                /* Only the bytes of the value are copied, so that what a
+                 * longer string left after the terminator doesn't change the
+                 * CRC. */
+                if( pField->type == ShadowFieldInteger )
+                {
+                    entry.fields[ i ].reported.integer = pField->reported.integer;
+                }
+                else if( pField->type == ShadowFieldBoolean )
+                {
+                    entry.fields[ i ].reported.boolean = pField->reported.boolean;
+                }
+                else
+                {
+                    ( void ) strcpy( entry.fields[ i ].reported.string, pField->reported.string );
+                }
+            }
+        }
+
+        length = entryLength( pState->fieldCount );
+        entry.crc = esp_rom_crc32_le( 0U, ( const uint8_t * ) &entry, length );
+        ( void ) memcpy( &( ( uint8_t * ) &entry )[ length ], &entry.crc, sizeof( entry.crc ) );
+
+        if( ( empty == true ) ? ( pCache->stored == false ) :
+            ( ( pCache->stored == true ) && ( pCache->storedCrc == entry.crc ) ) )
+        {
+            /* NVS already holds this state. */
+        }
+        else if( nvs_open( SHADOW_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle ) != ESP_OK )
+        {
+            status = false;
+        }
+        else
+        {
+            err = ( empty == true ) ? nvs_erase_key( handle, pCache->key ) :
+                  nvs_set_blob( handle, pCache->key, &entry, length + sizeof( entry.crc ) );
+
+            if( ( err == ESP_OK ) || ( err == ESP_ERR_NVS_NOT_FOUND ) )
+            {
+                err = nvs_commit( handle );
+            }
+
+            nvs_close( handle );
+
+            status = ( err == ESP_OK );
+
+            if( status == true )
+            {
+                pCache->storedCrc = entry.crc;
+                pCache->stored = ( empty == false );
+            }
+        }
+
+        if( status == false )
+        {
+            LogError( ( "Failed to save the shadow state %s to NVS.", pCache->key ) );
+        }
+
+        return status;
+    }
+
+#endif /* if SHADOW_CACHE */
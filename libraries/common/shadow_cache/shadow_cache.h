@@ -0,0 +1,145 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_cache.h
+ * @brief Keep what a Device Shadow acknowledged of the reported state in NVS.
+ *
+ * The cache holds, for one thing and shadow name, the document version and
+ * the value of every field the shadow acknowledged, with a CRC over the
+ * entry and over the keys and types of the table of fields. An entry written
+ * for another table, or damaged, is not restored. After
+ * #ShadowCache_Restore the state compares the current values with what the
+ * shadow had before the reboot, so that only the changes are reported, and
+ * #ShadowState_HandleDocuments can carry on from the cached version.
+ *
+ * The current values of the fields aren't saved; the application sets them
+ * again after boot. The functions are not thread safe and are called from
+ * the task that owns the MQTT context.
+ */
+
+#ifndef SHADOW_CACHE_H_
+#define SHADOW_CACHE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include the shadow reported state. */
+#include "shadow_state.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the acknowledged shadow state is kept in NVS.
+ */
+#ifndef SHADOW_CACHE
+    #define SHADOW_CACHE    CONFIG_SHADOW_CACHE
+#endif
+
+#if SHADOW_CACHE
+
+/**
+ * @brief The NVS namespace of the entries.
+ */
+    #ifndef SHADOW_CACHE_NVS_NAMESPACE
+        #define SHADOW_CACHE_NVS_NAMESPACE    CONFIG_SHADOW_CACHE_NVS_NAMESPACE
+    #endif
+
+/**
+ * @brief The most fields a cached state can have.
+ */
+    #ifndef SHADOW_CACHE_MAX_FIELDS
+        #define SHADOW_CACHE_MAX_FIELDS    CONFIG_SHADOW_CACHE_MAX_FIELDS
+    #endif
+
+/**
+ * @brief The length of an NVS key, with the terminator.
+ */
+    #define SHADOW_CACHE_KEY_SIZE    ( 16U )
+
+/**
+ * @brief The cache entry of one shadow.
+ *
+ * The fields are private to this module.
+ */
+typedef struct ShadowCache
+{
+    /* The NVS key, from a CRC of the thing and shadow names. */
+    char key[ SHADOW_CACHE_KEY_SIZE ];
+
+    /* CRC of the entry in NVS, if stored, so an unchanged state isn't
+     * written again. */
+    uint32_t storedCrc;
+    bool stored;
+} ShadowCache_t;
+
+/**
+ * @brief Names the entry of a shadow.
+ *
+ * @param[out] pCache The cache to initialize.
+ * @param[in] pThingName The thing name.
+ * @param[in] thingNameLength The length of @a pThingName.
+ * @param[in] pShadowName The shadow name, or NULL for the classic shadow.
+ * @param[in] shadowNameLength The length of @a pShadowName.
+ */
+void ShadowCache_Init( ShadowCache_t * pCache,
+                       const char * pThingName,
+                       size_t thingNameLength,
+                       const char * pShadowName,
+                       size_t shadowNameLength );
+
+/**
+ * @brief Restores the acknowledged values and version of a state just
+ * initialized with #ShadowState_Init, from the entry of the shadow.
+ *
+ * @param[in] pCache The cache.
+ * @param[in,out] pState The state.
+ *
+ * @return true if an entry for the table of fields of @a pState was
+ * restored. Otherwise the state is left as it was.
+ */
+bool ShadowCache_Restore( ShadowCache_t * pCache,
+                          ShadowState_t * pState );
+
+/**
+ * @brief Writes what the shadow acknowledged if it changed since the last
+ * save or restore. A state with no version and nothing acknowledged, such as
+ * after #ShadowState_Reset, erases the entry instead.
+ *
+ * Cheap when nothing changed, so it can be called after every shadow
+ * message is handled.
+ *
+ * @param[in] pCache The cache.
+ * @param[in] pState The state.
+ *
+ * @return false if NVS couldn't be written.
+ */
+bool ShadowCache_Save( ShadowCache_t * pCache,
+                       const ShadowState_t * pState );
+
+#endif /* if SHADOW_CACHE */
+
+#endif /* ifndef SHADOW_CACHE_H_ */
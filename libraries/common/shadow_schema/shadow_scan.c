@@ -0,0 +1,690 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_scan.c
+ * @brief Implementation of the one-pass JSON reader of the generated shadow
+ * parsers.
+ *
+ * Members are taken in document order and a value is looked at once, either
+ * by a typed reader or by #ShadowScan_SkipValue. Skipping recurses into
+ * nested objects and arrays, which #SHADOW_SCAN_MAX_DEPTH bounds.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+#include "shadow_scan.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Moves past any whitespace and returns the next character, or NUL
+ * at the end of the document.
+ */
+static char peekToken( ShadowScan_t * pScan );
+
+/**
+ * @brief Moves past the literal @a pLiteral if the document continues with it.
+ */
+static bool matchLiteral( ShadowScan_t * pScan,
+                          const char * pLiteral );
+
+/**
+ * @brief Moves past a number, checking its syntax.
+ *
+ * @param[out] pIsInteger Whether the number has no fraction and no exponent.
+ */
+static bool skipNumber( ShadowScan_t * pScan,
+                        bool * pIsInteger );
+
+/**
+ * @brief Moves past a string, from its opening quote, checking its escapes.
+ *
+ * @param[out] pBuffer If not NULL, receives the decoded string.
+ * @param[in] bufferSize The size of @a pBuffer.
+ * @param[out] pFits Whether the decoded string fits in @a pBuffer with its
+ * NUL and needs no surrogate pair.
+ */
+static bool readString( ShadowScan_t * pScan,
+                        char * pBuffer,
+                        size_t bufferSize,
+                        bool * pFits );
+
+/**
+ * @brief Moves past a value, @a depth levels deep.
+ */
+static bool skipValue( ShadowScan_t * pScan,
+                       uint8_t depth );
+
+/*-----------------------------------------------------------*/
+
+static char peekToken( ShadowScan_t * pScan )
+{
+    char next = '\0';
+
+    while( pScan->offset < pScan->length )
+    {
+        next = pScan->pDocument[ pScan->offset ];
+
+        if( ( next != ' ' ) && ( next != '\t' ) && ( next != '\n' ) && ( next != '\r' ) )
+        {
+            break;
+        }
+
+        pScan->offset++;
+        next = '\0';
+    }
+
+    return next;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool matchLiteral( ShadowScan_t * pScan,
+                          const char * pLiteral )
+{
+    size_t literalLength = strlen( pLiteral );
+    bool matched = false;
+
+    if( ( ( pScan->length - pScan->offset ) >= literalLength ) &&
+        ( memcmp( &pScan->pDocument[ pScan->offset ], pLiteral, literalLength ) == 0 ) )
+    {
+        pScan->offset += literalLength;
+        matched = true;
+    }
+
+    return matched;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool skipNumber( ShadowScan_t * pScan,
+                        bool * pIsInteger )
+{
+    const char * pDocument = pScan->pDocument;
+    size_t i = pScan->offset;
+    size_t digitsStart;
+    bool valid = true;
+
+    *pIsInteger = true;
+
+    if( ( i < pScan->length ) && ( pDocument[ i ] == '-' ) )
+    {
+        i++;
+    }
+
+    digitsStart = i;
+
+    while( ( i < pScan->length ) && ( pDocument[ i ] >= '0' ) && ( pDocument[ i ] <= '9' ) )
+    {
+        i++;
+    }
+
+    /* At least one digit, and no leading zero. */
+    if( ( i == digitsStart ) || ( ( pDocument[ digitsStart ] == '0' ) && ( ( i - digitsStart ) > 1U ) ) )
+    {
+        valid = false;
+    }
+
+    if( valid && ( i < pScan->length ) && ( pDocument[ i ] == '.' ) )
+    {
+        *pIsInteger = false;
+        digitsStart = ++i;
+
+        while( ( i < pScan->length ) && ( pDocument[ i ] >= '0' ) && ( pDocument[ i ] <= '9' ) )
+        {
+            i++;
+        }
+
+        valid = ( i > digitsStart );
+    }
+
+    if( valid && ( i < pScan->length ) && ( ( pDocument[ i ] == 'e' ) || ( pDocument[ i ] == 'E' ) ) )
+    {
+        *pIsInteger = false;
+        i++;
+
+        if( ( i < pScan->length ) && ( ( pDocument[ i ] == '+' ) || ( pDocument[ i ] == '-' ) ) )
+        {
+            i++;
+        }
+
+        digitsStart = i;
+
+        while( ( i < pScan->length ) && ( pDocument[ i ] >= '0' ) && ( pDocument[ i ] <= '9' ) )
+        {
+            i++;
+        }
+
+        valid = ( i > digitsStart );
+    }
+
+    pScan->offset = i;
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool readString( ShadowScan_t * pScan,
+                        char * pBuffer,
+                        size_t bufferSize,
+                        bool * pFits )
+{
+    const char * pDocument = pScan->pDocument;
+    size_t i = pScan->offset + 1U;
+    size_t written = 0U;
+    bool valid = false;
+
+    *pFits = ( pBuffer != NULL ) && ( bufferSize > 0U );
+
+    while( i < pScan->length )
+    {
+        uint8_t c = ( uint8_t ) pDocument[ i++ ];
+        uint32_t codePoint = c;
+        size_t encodedLength = 1U;
+        char encoded[ 3 ];
+
+        if( c == ( uint8_t ) '"' )
+        {
+            valid = true;
+            break;
+        }
+
+        if( c < 0x20U )
+        {
+            break;
+        }
+
+        if( c == ( uint8_t ) '\\' )
+        {
+            if( i >= pScan->length )
+            {
+                break;
+            }
+
+            c = ( uint8_t ) pDocument[ i++ ];
+
+            switch( c )
+            {
+                case '"':
+                case '\\':
+                case '/':
+                    codePoint = c;
+                    break;
+
+                case 'b':
+                    codePoint = '\b';
+                    break;
+
+                case 'f':
+                    codePoint = '\f';
+                    break;
+
+                case 'n':
+                    codePoint = '\n';
+                    break;
+
+                case 'r':
+                    codePoint = '\r';
+                    break;
+
+                case 't':
+                    codePoint = '\t';
+                    break;
+
+                case 'u':
+                   {
+                       size_t digit;
+
+                       codePoint = 0U;
+
+                       for( digit = 0U; digit < 4U; digit++ )
+                       {
+                           char hex = ( i < pScan->length ) ? pDocument[ i ] : '\0';
+
+                           if( ( hex >= '0' ) && ( hex <= '9' ) )
+                           {
+                               codePoint = ( codePoint << 4 ) | ( uint32_t ) ( hex - '0' );
+                           }
+                           else if( ( hex >= 'a' ) && ( hex <= 'f' ) )
+                           {
+                               codePoint = ( codePoint << 4 ) | ( uint32_t ) ( hex - 'a' + 10 );
+                           }
+                           else if( ( hex >= 'A' ) && ( hex <= 'F' ) )
+                           {
+                               codePoint = ( codePoint << 4 ) | ( uint32_t ) ( hex - 'A' + 10 );
+                           }
+                           else
+                           {
+                               break;
+                           }
+
+                           i++;
+                       }
+
+                       if( digit < 4U )
+                       {
+                           c = 0U;
+                       }
+                   }
+                   break;
+
+                default:
+                    c = 0U;
+                    break;
+            }
+
+            if( c == 0U )
+            {
+                /* Not an escape JSON has. */
+                break;
+            }
+
+            /* Encoded back to UTF-8. A surrogate would take its pair to
+             * decode, and a NUL would cut the string short. */
+            if( ( codePoint == 0U ) || ( ( codePoint >= 0xD800U ) && ( codePoint <= 0xDFFFU ) ) )
+            {
+                *pFits = false;
+            }
+            else if( codePoint >= 0x800U )
+            {
+                encoded[ 0 ] = ( char ) ( 0xE0U | ( codePoint >> 12 ) );
+                encoded[ 1 ] = ( char ) ( 0x80U | ( ( codePoint >> 6 ) & 0x3FU ) );
+                encoded[ 2 ] = ( char ) ( 0x80U | ( codePoint & 0x3FU ) );
+                encodedLength = 3U;
+            }
+            else if( codePoint >= 0x80U )
+            {
+                encoded[ 0 ] = ( char ) ( 0xC0U | ( codePoint >> 6 ) );
+                encoded[ 1 ] = ( char ) ( 0x80U | ( codePoint & 0x3FU ) );
+                encodedLength = 2U;
+            }
+            else
+            {
+                encoded[ 0 ] = ( char ) codePoint;
+            }
+        }
+        else
+        {
+            encoded[ 0 ] = ( char ) c;
+        }
+
+        if( *pFits )
+        {
+            if( ( written + encodedLength ) < bufferSize )
+            {
+                ( void ) memcpy( &pBuffer[ written ], encoded, encodedLength );
+                written += encodedLength;
+            }
+            else
+            {
+                *pFits = false;
+            }
+        }
+    }
+
+    if( *pFits )
+    {
+        pBuffer[ written ] = '\0';
+    }
+
+    pScan->offset = i;
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool skipValue( ShadowScan_t * pScan,
+                       uint8_t depth )
+{
+    char next = peekToken( pScan );
+    bool valid = true;
+    bool isInteger;
+
+    switch( next )
+    {
+        case '{':
+        case '[':
+           {
+               char close = ( next == '{' ) ? '}' : ']';
+               bool first = true;
+
+               if( depth >= SHADOW_SCAN_MAX_DEPTH )
+               {
+                   valid = false;
+                   break;
+               }
+
+               pScan->offset++;
+
+               while( valid )
+               {
+                   next = peekToken( pScan );
+
+                   if( next == close )
+                   {
+                       pScan->offset++;
+                       break;
+                   }
+
+                   if( !first )
+                   {
+                       if( next != ',' )
+                       {
+                           valid = false;
+                           break;
+                       }
+
+                       pScan->offset++;
+                       next = peekToken( pScan );
+                   }
+
+                   if( close == '}' )
+                   {
+                       bool fits;
+
+                       valid = ( next == '"' ) &&
+                               readString( pScan, NULL, 0U, &fits ) &&
+                               ( peekToken( pScan ) == ':' );
+
+                       if( !valid )
+                       {
+                           break;
+                       }
+
+                       pScan->offset++;
+                   }
+
+                   valid = skipValue( pScan, depth + 1U );
+                   first = false;
+               }
+           }
+           break;
+
+        case '"':
+           {
+               bool fits;
+
+               valid = readString( pScan, NULL, 0U, &fits );
+           }
+           break;
+
+        case 't':
+            valid = matchLiteral( pScan, "true" );
+            break;
+
+        case 'f':
+            valid = matchLiteral( pScan, "false" );
+            break;
+
+        case 'n':
+            valid = matchLiteral( pScan, "null" );
+            break;
+
+        default:
+            valid = skipNumber( pScan, &isInteger );
+            break;
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+void ShadowScan_Init( ShadowScan_t * pScan,
+                      const char * pDocument,
+                      size_t documentLength )
+{
+    pScan->pDocument = pDocument;
+    pScan->length = documentLength;
+    pScan->offset = 0U;
+    pScan->depth = 0U;
+    pScan->hasMember = false;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_BeginObject( ShadowScan_t * pScan )
+{
+    ShadowScanStatus_t status = ShadowScanSuccess;
+
+    if( peekToken( pScan ) != '{' )
+    {
+        status = ShadowScan_SkipValue( pScan );
+
+        if( status == ShadowScanSuccess )
+        {
+            status = ShadowScanWrongType;
+        }
+    }
+    else if( pScan->depth >= SHADOW_SCAN_MAX_DEPTH )
+    {
+        status = ShadowScanIllegal;
+    }
+    else
+    {
+        pScan->offset++;
+        pScan->depth++;
+        pScan->hasMember = false;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_NextKey( ShadowScan_t * pScan,
+                                       const char ** ppKey,
+                                       size_t * pKeyLength )
+{
+    ShadowScanStatus_t status = ShadowScanIllegal;
+    char next = peekToken( pScan );
+    bool fits;
+
+    if( next == '}' )
+    {
+        pScan->offset++;
+        pScan->depth--;
+
+        /* The object was the value of a member of the one around it. */
+        pScan->hasMember = true;
+        status = ShadowScanEnd;
+    }
+    else
+    {
+        if( pScan->hasMember && ( next == ',' ) )
+        {
+            pScan->offset++;
+            next = peekToken( pScan );
+        }
+        else if( pScan->hasMember )
+        {
+            next = '\0';
+        }
+        else
+        {
+            /* The first member. */
+        }
+
+        if( next == '"' )
+        {
+            size_t keyStart = pScan->offset + 1U;
+
+            if( readString( pScan, NULL, 0U, &fits ) && ( peekToken( pScan ) == ':' ) )
+            {
+                *ppKey = &pScan->pDocument[ keyStart ];
+                *pKeyLength = pScan->offset - keyStart - 1U;
+                pScan->offset++;
+                pScan->hasMember = true;
+                status = ShadowScanSuccess;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_SkipValue( ShadowScan_t * pScan )
+{
+    return skipValue( pScan, pScan->depth ) ? ShadowScanSuccess : ShadowScanIllegal;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_Integer( ShadowScan_t * pScan,
+                                       int64_t minimum,
+                                       int64_t maximum,
+                                       int64_t * pValue )
+{
+    ShadowScanStatus_t status = ShadowScanWrongType;
+    char next = peekToken( pScan );
+    size_t start = pScan->offset;
+    bool isInteger;
+
+    if( ( next != '-' ) && ( ( next < '0' ) || ( next > '9' ) ) )
+    {
+        status = ( ShadowScan_SkipValue( pScan ) == ShadowScanSuccess ) ? ShadowScanWrongType : ShadowScanIllegal;
+    }
+    else if( !skipNumber( pScan, &isInteger ) )
+    {
+        status = ShadowScanIllegal;
+    }
+    else if( isInteger )
+    {
+        const char * pDigits = &pScan->pDocument[ start ];
+        bool negative = ( *pDigits == '-' );
+        uint64_t magnitude = 0U;
+        uint64_t limit;
+
+        if( negative )
+        {
+            pDigits++;
+            limit = ( minimum < 0 ) ? ( ( uint64_t ) ( -( minimum + 1 ) ) + 1U ) : 0U;
+        }
+        else
+        {
+            limit = ( maximum > 0 ) ? ( uint64_t ) maximum : 0U;
+        }
+
+        status = ShadowScanSuccess;
+
+        /* Digits past the limit stop the conversion before it overflows. */
+        while( pDigits < &pScan->pDocument[ pScan->offset ] )
+        {
+            uint64_t digit = ( uint64_t ) ( *pDigits++ - '0' );
+
+            if( ( digit > limit ) || ( magnitude > ( ( limit - digit ) / 10U ) ) )
+            {
+                status = ShadowScanWrongType;
+                break;
+            }
+
+            magnitude = ( magnitude * 10U ) + digit;
+        }
+
+        if( status == ShadowScanSuccess )
+        {
+            int64_t value = negative ? ( ( magnitude == 0U ) ? 0 : ( -( int64_t ) ( magnitude - 1U ) - 1 ) ) : ( int64_t ) magnitude;
+
+            if( ( value < minimum ) || ( value > maximum ) )
+            {
+                status = ShadowScanWrongType;
+            }
+            else
+            {
+                *pValue = value;
+            }
+        }
+    }
+    else
+    {
+        /* A fraction or an exponent. */
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_Boolean( ShadowScan_t * pScan,
+                                       bool * pValue )
+{
+    ShadowScanStatus_t status = ShadowScanSuccess;
+
+    ( void ) peekToken( pScan );
+
+    if( matchLiteral( pScan, "true" ) )
+    {
+        *pValue = true;
+    }
+    else if( matchLiteral( pScan, "false" ) )
+    {
+        *pValue = false;
+    }
+    else
+    {
+        status = ( ShadowScan_SkipValue( pScan ) == ShadowScanSuccess ) ? ShadowScanWrongType : ShadowScanIllegal;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_String( ShadowScan_t * pScan,
+                                      char * pBuffer,
+                                      size_t bufferSize )
+{
+    ShadowScanStatus_t status;
+    bool fits = false;
+
+    if( peekToken( pScan ) != '"' )
+    {
+        status = ( ShadowScan_SkipValue( pScan ) == ShadowScanSuccess ) ? ShadowScanWrongType : ShadowScanIllegal;
+    }
+    else if( !readString( pScan, pBuffer, bufferSize, &fits ) )
+    {
+        status = ShadowScanIllegal;
+    }
+    else
+    {
+        status = fits ? ShadowScanSuccess : ShadowScanWrongType;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowScanStatus_t ShadowScan_Finish( ShadowScan_t * pScan )
+{
+    return ( ( pScan->depth == 0U ) && ( peekToken( pScan ) == '\0' ) &&
+             ( pScan->offset == pScan->length ) ) ? ShadowScanSuccess : ShadowScanIllegal;
+}
+
+/*-----------------------------------------------------------*/
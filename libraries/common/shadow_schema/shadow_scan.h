@@ -0,0 +1,154 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_scan.h
+ * @brief Read a JSON document in one pass, a member at a time, for the
+ * parsers that shadow_schema_gen.py generates from a shadow state schema.
+ *
+ * A parser opens an object with #ShadowScan_BeginObject, takes its keys in
+ * document order with #ShadowScan_NextKey, and for each key either reads the
+ * value with the reader of the type the schema gives it or skips it with
+ * #ShadowScan_SkipValue. The document is validated as it is read, so no
+ * separate JSON_Validate pass is needed, and every byte is looked at once
+ * whatever the number of fields of the schema.
+ *
+ * Keys are returned as they appear in the document, without decoding
+ * escapes. A value of another type than asked for, or one that doesn't fit,
+ * is skipped and reported as #ShadowScanWrongType, so a parser can ignore it
+ * and go on.
+ */
+
+#ifndef SHADOW_SCAN_H_
+#define SHADOW_SCAN_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The deepest nesting of objects and arrays accepted.
+ */
+#ifndef SHADOW_SCAN_MAX_DEPTH
+    #define SHADOW_SCAN_MAX_DEPTH    ( 16U )
+#endif
+
+/**
+ * @brief Return codes of the scan functions.
+ */
+typedef enum ShadowScanStatus
+{
+    ShadowScanSuccess,   /**< A key or value was read. */
+    ShadowScanEnd,       /**< The object has no more members. */
+    ShadowScanWrongType, /**< The value was skipped: it isn't of the type asked for, or doesn't fit. */
+    ShadowScanIllegal    /**< The document isn't valid JSON, or is nested too deep. */
+} ShadowScanStatus_t;
+
+/**
+ * @brief A document being read.
+ *
+ * The fields are private to this module.
+ */
+typedef struct ShadowScan
+{
+    const char * pDocument;
+    size_t length;
+    size_t offset;
+    uint8_t depth;
+
+    /* Whether the innermost open object has a member yet, so the next one
+     * is preceded by a comma. */
+    bool hasMember;
+} ShadowScan_t;
+
+/**
+ * @brief Starts reading a document.
+ */
+void ShadowScan_Init( ShadowScan_t * pScan,
+                      const char * pDocument,
+                      size_t documentLength );
+
+/**
+ * @brief Opens the object that is the next value.
+ *
+ * @return #ShadowScanSuccess; #ShadowScanWrongType if the value, skipped,
+ * isn't an object; or #ShadowScanIllegal.
+ */
+ShadowScanStatus_t ShadowScan_BeginObject( ShadowScan_t * pScan );
+
+/**
+ * @brief Reads the key of the next member of the innermost open object,
+ * leaving its value to be read or skipped. After the last member, closes the
+ * object.
+ *
+ * @param[in] pScan The scan.
+ * @param[out] ppKey The key, in the document, without its quotes.
+ * @param[out] pKeyLength The length of the key.
+ *
+ * @return #ShadowScanSuccess, #ShadowScanEnd once the object is closed, or
+ * #ShadowScanIllegal.
+ */
+ShadowScanStatus_t ShadowScan_NextKey( ShadowScan_t * pScan,
+                                       const char ** ppKey,
+                                       size_t * pKeyLength );
+
+/**
+ * @brief Skips the next value, whatever its type.
+ *
+ * @return #ShadowScanSuccess or #ShadowScanIllegal.
+ */
+ShadowScanStatus_t ShadowScan_SkipValue( ShadowScan_t * pScan );
+
+/**
+ * @brief Reads the next value as an integer between @a minimum and
+ * @a maximum. A number with a fraction or an exponent is of the wrong type.
+ */
+ShadowScanStatus_t ShadowScan_Integer( ShadowScan_t * pScan,
+                                       int64_t minimum,
+                                       int64_t maximum,
+                                       int64_t * pValue );
+
+/**
+ * @brief Reads the next value as true or false.
+ */
+ShadowScanStatus_t ShadowScan_Boolean( ShadowScan_t * pScan,
+                                       bool * pValue );
+
+/**
+ * @brief Reads the next value as a string, decoding its escapes, into a
+ * buffer of @a bufferSize bytes, NUL-terminated. A string that doesn't fit,
+ * or holds a surrogate pair or a NUL, is of the wrong type.
+ */
+ShadowScanStatus_t ShadowScan_String( ShadowScan_t * pScan,
+                                      char * pBuffer,
+                                      size_t bufferSize );
+
+/**
+ * @brief Checks that nothing but whitespace follows the top-level value.
+ *
+ * @return #ShadowScanSuccess or #ShadowScanIllegal.
+ */
+ShadowScanStatus_t ShadowScan_Finish( ShadowScan_t * pScan );
+
+#endif /* ifndef SHADOW_SCAN_H_ */
@@ -0,0 +1,36 @@
+# Generates a typed shadow state, a delta parser and a reported state
+# serializer from a shadow state schema, at build time. See
+# shadow_schema_gen.py for the schema.
+#
+# Include this file from the CMakeLists.txt of a component, after
+# idf_component_register, and call target_add_shadow_schema with the
+# component library:
+#
+#   target_add_shadow_schema(${COMPONENT_LIB} "device_shadow.json")
+#
+# device_shadow.c is built into the component and device_shadow.h can be
+# included from its sources. The component needs the shadow_schema and
+# json_writer components.
+
+set(SHADOW_SCHEMA_DIR "${CMAKE_CURRENT_LIST_DIR}")
+
+function(target_add_shadow_schema target schema_file)
+    idf_build_get_property(python PYTHON)
+
+    get_filename_component(schema_path "${schema_file}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_SOURCE_DIR}")
+    get_filename_component(schema_name "${schema_file}" NAME_WE)
+    set(output_dir "${CMAKE_CURRENT_BINARY_DIR}/shadow_schema")
+    set(outputs "${output_dir}/${schema_name}.c" "${output_dir}/${schema_name}.h")
+
+    file(MAKE_DIRECTORY "${output_dir}")
+
+    add_custom_command(OUTPUT ${outputs}
+        COMMAND ${python} "${SHADOW_SCHEMA_DIR}/shadow_schema_gen.py" "${schema_path}" "${output_dir}"
+        MAIN_DEPENDENCY "${schema_path}"
+        DEPENDS "${SHADOW_SCHEMA_DIR}/shadow_schema_gen.py"
+        COMMENT "Generating the ${schema_name} shadow parser"
+        VERBATIM)
+
+    target_sources(${target} PRIVATE "${output_dir}/${schema_name}.c")
+    target_include_directories(${target} PUBLIC "${output_dir}")
+endfunction()
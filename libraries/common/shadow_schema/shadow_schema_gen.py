@@ -0,0 +1,600 @@
+#!/usr/bin/env python
+#
+# Generates, from a shadow state schema, a C struct of the state, a parser of
+# delta documents into it and a serializer of reported state from it. Used by
+# shadow_schema.cmake at build time.
+#
+# The schema is a JSON object naming the state and listing its fields, in
+# order, with their types:
+#
+#   {
+#       "name": "DeviceShadow",
+#       "fields": {
+#           "powerOn": "uint32",
+#           "label": { "type": "string", "size": 32 },
+#           "config": { "type": "object", "fields": { "enabled": "bool" } }
+#       }
+#   }
+#
+# The types are bool, int32, uint32, int64, string, whose size is its longest
+# length in bytes, and object. The name is the prefix of the generated types,
+# functions and field masks; the generated files are named after the schema
+# file, so device_shadow.json gives device_shadow.h and device_shadow.c. A
+# state has at most 32 fields that aren't objects.
+
+import json
+import os
+import re
+import sys
+
+SCALAR_TYPES = {
+    'bool': 'bool',
+    'int32': 'int32_t',
+    'uint32': 'uint32_t',
+    'int64': 'int64_t',
+}
+
+MAX_FIELDS = 32
+IDENTIFIER = re.compile(r'^[A-Za-z_][A-Za-z0-9_]*$')
+
+
+class Field(object):
+    def __init__(self, key, kind, path, size=0, fields=None):
+        self.key = key
+        self.kind = kind
+        self.path = path
+        self.size = size
+        self.fields = fields or []
+        self.mask = None
+        self.type_name = None
+
+
+def snake_case(name):
+    name = re.sub(r'([a-z0-9])([A-Z])', r'\1_\2', name)
+    return re.sub(r'[^A-Za-z0-9]+', '_', name).strip('_').lower()
+
+
+def parse_fields(members, path):
+    if not isinstance(members, dict) or not members:
+        raise ValueError('{}: expected an object of fields'.format('.'.join(path) or 'fields'))
+
+    fields = []
+
+    for key, spec in members.items():
+        field_path = path + [key]
+        where = '.'.join(field_path)
+
+        if not IDENTIFIER.match(key):
+            raise ValueError('{}: keys must be C identifiers'.format(where))
+
+        if isinstance(spec, str):
+            spec = {'type': spec}
+
+        kind = spec.get('type')
+
+        if kind in SCALAR_TYPES:
+            fields.append(Field(key, kind, field_path))
+        elif kind == 'string':
+            size = spec.get('size')
+
+            if not isinstance(size, int) or size <= 0:
+                raise ValueError('{}: a string needs a positive size'.format(where))
+
+            fields.append(Field(key, kind, field_path, size=size))
+        elif kind == 'object':
+            fields.append(Field(key, kind, field_path,
+                                fields=parse_fields(spec.get('fields'), field_path)))
+        else:
+            raise ValueError('{}: unknown type {!r}'.format(where, kind))
+
+    return fields
+
+
+def leaves(fields):
+    for field in fields:
+        if field.kind == 'object':
+            for leaf in leaves(field.fields):
+                yield leaf
+        else:
+            yield field
+
+
+def objects(fields):
+    # Innermost first, as their types are declared before use.
+    for field in fields:
+        if field.kind == 'object':
+            for inner in objects(field.fields):
+                yield inner
+            yield field
+
+
+class Generator(object):
+    def __init__(self, schema, source_name, file_name):
+        name = schema.get('name')
+
+        if not isinstance(name, str) or not IDENTIFIER.match(name):
+            raise ValueError('name: expected a C identifier')
+
+        self.name = name
+        self.source_name = source_name
+        self.file_name = file_name
+        self.macro_prefix = snake_case(name).upper()
+        self.root = Field(None, 'object', [], fields=parse_fields(schema.get('fields'), []))
+        self.root.type_name = '{}State_t'.format(name)
+
+        all_leaves = list(leaves(self.root.fields))
+
+        if len(all_leaves) > MAX_FIELDS:
+            raise ValueError('{} fields, more than the {} a mask holds'.format(len(all_leaves), MAX_FIELDS))
+
+        for bit, leaf in enumerate(all_leaves):
+            leaf.mask = '{}_{}'.format(self.macro_prefix, '_'.join(snake_case(part).upper() for part in leaf.path))
+            leaf.bit = bit
+
+        for obj in objects(self.root.fields):
+            obj.type_name = '{}{}_t'.format(name, ''.join(part[0].upper() + part[1:] for part in obj.path))
+            obj.mask = '{}_{}_FIELDS'.format(self.macro_prefix, '_'.join(snake_case(part).upper() for part in obj.path))
+
+        self.all_leaves = all_leaves
+        self.kinds = set(leaf.kind for leaf in all_leaves)
+
+    def banner(self):
+        return ['/* Generated by shadow_schema_gen.py from {}. Do not edit. */'.format(self.source_name), '']
+
+    def leaf_bits(self, fields):
+        return sum(1 << leaf.bit for leaf in leaves(fields))
+
+    def header(self):
+        guard = '{}_H_'.format(re.sub(r'[^A-Za-z0-9]', '_', self.file_name).upper())
+        lines = self.banner()
+        lines += [
+            '#ifndef {}'.format(guard),
+            '#define {}'.format(guard),
+            '',
+            '/* Standard includes. */',
+            '#include <stdbool.h>',
+            '#include <stddef.h>',
+            '#include <stdint.h>',
+            '',
+            '/**',
+            ' * @brief Masks of the fields of #{}, for the fields a delta held'.format(self.root.type_name),
+            ' * and the fields to report.',
+            ' */',
+        ]
+
+        width = max([len(leaf.mask) for leaf in self.all_leaves] +
+                    [len(obj.mask) for obj in objects(self.root.fields)] +
+                    [len(self.macro_prefix) + len('_ALL_FIELDS')])
+
+        for leaf in self.all_leaves:
+            lines.append('#define {:<{}}    ( 1UL << {} )'.format(leaf.mask, width, leaf.bit))
+
+        for obj in objects(self.root.fields):
+            lines.append('#define {:<{}}    ( 0x{:X}UL )'.format(obj.mask, width, self.leaf_bits(obj.fields)))
+
+        lines.append('#define {:<{}}    ( 0x{:X}UL )'.format(self.macro_prefix + '_ALL_FIELDS', width,
+                                                           self.leaf_bits(self.root.fields)))
+        lines.append('')
+
+        for obj in list(objects(self.root.fields)) + [self.root]:
+            struct_name = obj.type_name[:-2]
+
+            if obj is self.root:
+                lines += ['/**', ' * @brief The state of the shadow.', ' */']
+            else:
+                lines += ['/**', ' * @brief The "{}" object of #{}.'.format('.'.join(obj.path), self.root.type_name), ' */']
+
+            lines.append('typedef struct {}'.format(struct_name))
+            lines.append('{')
+
+            for field in obj.fields:
+                if field.kind == 'object':
+                    lines.append('    {} {};'.format(field.type_name, field.key))
+                elif field.kind == 'string':
+                    lines.append('    char {}[ {} ];'.format(field.key, field.size + 1))
+                else:
+                    lines.append('    {} {};'.format(SCALAR_TYPES[field.kind], field.key))
+
+            lines.append('}} {};'.format(obj.type_name))
+            lines.append('')
+
+        lines += [
+            '/**',
+            ' * @brief Reads a delta document, from the update/delta topic, into the',
+            ' * fields of @a pState it holds.',
+            ' *',
+            ' * The document is read and validated in one pass. Keys not in the schema',
+            ' * and values of another type than the schema gives, or that don\'t fit, are',
+            ' * skipped.',
+            ' *',
+            ' * @param[in] pDocument The document.',
+            ' * @param[in] documentLength The length of @a pDocument.',
+            ' * @param[in,out] pState The state, whose fields in the delta are set.',
+            ' * It is left as it was if the document is invalid.',
+            ' * @param[out] pFields The masks of the fields set. Can be NULL.',
+            ' * @param[out] pVersion The version of the document, or 0 if it has none.',
+            ' * Can be NULL.',
+            ' *',
+            ' * @return false if the document isn\'t valid JSON.',
+            ' */',
+        ]
+        lines += self.signature_parse(';')
+        lines += [
+            '',
+            '/**',
+            ' * @brief Writes an update of the reported state holding the fields of',
+            ' * @a pState in @a fields, with @a clientToken as a string of six digits.',
+            ' *',
+            ' * @return The length of the document, without its NUL terminator, or 0 if',
+            ' * it doesn\'t fit in @a bufferLength bytes.',
+            ' */',
+        ]
+        lines += self.signature_serialize(';')
+        lines += ['', '#endif /* ifndef {} */'.format(guard)]
+
+        return '\n'.join(lines) + '\n'
+
+    def signature_parse(self, end):
+        name = '{}_ParseDelta( '.format(self.name)
+        pad = ' ' * (len('bool ') + len(name))
+
+        return [
+            'bool {}const char * pDocument,'.format(name),
+            '{}size_t documentLength,'.format(pad),
+            '{}{} * pState,'.format(pad, self.root.type_name),
+            '{}uint32_t * pFields,'.format(pad),
+            '{}uint32_t * pVersion ){}'.format(pad, end),
+        ]
+
+    def signature_serialize(self, end):
+        name = '{}_SerializeReported( '.format(self.name)
+        pad = ' ' * (len('size_t ') + len(name))
+
+        return [
+            'size_t {}const {} * pState,'.format(name, self.root.type_name),
+            '{}uint32_t fields,'.format(pad),
+            '{}uint32_t clientToken,'.format(pad),
+            '{}char * pBuffer,'.format(pad),
+            '{}size_t bufferLength ){}'.format(pad, end),
+        ]
+
+    def parse_function_name(self, obj):
+        if obj is self.root:
+            return 'parseState'
+
+        return 'parse' + ''.join(part[0].upper() + part[1:] for part in obj.path)
+
+    def read_statement(self, field):
+        target = '&pValue->{}'.format(field.key)
+
+        if field.kind == 'object':
+            return '{}( pScan, {}, pFields )'.format(self.parse_function_name(field), target)
+        if field.kind == 'bool':
+            return 'ShadowScan_Boolean( pScan, {} )'.format(target)
+        if field.kind == 'int32':
+            return 'readInt32( pScan, {} )'.format(target)
+        if field.kind == 'uint32':
+            return 'readUint32( pScan, {} )'.format(target)
+        if field.kind == 'int64':
+            return 'ShadowScan_Integer( pScan, INT64_MIN, INT64_MAX, {} )'.format(target)
+
+        return 'ShadowScan_String( pScan, pValue->{0}, sizeof( pValue->{0} ) )'.format(field.key)
+
+    def parse_function(self, obj):
+        name = self.parse_function_name(obj)
+        pad = ' ' * (len('static ShadowScanStatus_t ') + len(name) + 2)
+        by_length = {}
+
+        for field in obj.fields:
+            by_length.setdefault(len(field.key), []).append(field)
+
+        lines = [
+            'static ShadowScanStatus_t {}( ShadowScan_t * pScan,'.format(name),
+            '{}{} * pValue,'.format(pad, obj.type_name),
+            '{}uint32_t * pFields )'.format(pad),
+            '{',
+            '    ShadowScanStatus_t status = ShadowScan_BeginObject( pScan );',
+            '    const char * pKey = NULL;',
+            '    size_t keyLength = 0U;',
+            '',
+            '    while( status == ShadowScanSuccess )',
+            '    {',
+            '        uint32_t field = 0U;',
+            '',
+            '        status = ShadowScan_NextKey( pScan, &pKey, &keyLength );',
+            '',
+            '        if( status != ShadowScanSuccess )',
+            '        {',
+            '            break;',
+            '        }',
+            '',
+            '        /* The key is matched on its length first, then its bytes. */',
+            '        switch( keyLength )',
+            '        {',
+        ]
+
+        for length in sorted(by_length):
+            lines.append('            case {}U:'.format(length))
+
+            for index, field in enumerate(by_length[length]):
+                keyword = 'if' if index == 0 else 'else if'
+                lines += [
+                    '                {}( memcmp( pKey, "{}", {}U ) == 0 )'.format(keyword, field.key, length),
+                    '                {',
+                    '                    status = {};'.format(self.read_statement(field)),
+                ]
+
+                if field.kind != 'object':
+                    lines.append('                    field = {};'.format(field.mask))
+
+                lines.append('                }')
+
+            lines += [
+                '                else',
+                '                {',
+                '                    status = ShadowScan_SkipValue( pScan );',
+                '                }',
+                '',
+                '                break;',
+                '',
+            ]
+
+        lines += [
+            '            default:',
+            '                status = ShadowScan_SkipValue( pScan );',
+            '                break;',
+            '        }',
+            '',
+            '        /* A value of the wrong type was skipped. */',
+            '        if( status == ShadowScanWrongType )',
+            '        {',
+            '            status = ShadowScanSuccess;',
+            '        }',
+            '        else if( status == ShadowScanSuccess )',
+            '        {',
+            '            *pFields |= field;',
+            '        }',
+            '        else',
+            '        {',
+            '            /* Illegal. */',
+            '        }',
+            '    }',
+            '',
+            '    return ( status == ShadowScanEnd ) ? ShadowScanSuccess : status;',
+            '}',
+            '',
+            '/*-----------------------------------------------------------*/',
+            '',
+        ]
+
+        return lines
+
+    def source(self):
+        lines = self.banner()
+        lines += [
+            '/* Standard includes. */',
+            '#include <string.h>',
+            '',
+            '#include "shadow_scan.h"',
+            '#include "json_writer.h"',
+            '#include "{}.h"'.format(self.file_name),
+            '',
+            '/*-----------------------------------------------------------*/',
+            '',
+            'static ShadowScanStatus_t readUint32( ShadowScan_t * pScan,',
+            '                                      uint32_t * pValue )',
+            '{',
+            '    int64_t value = 0;',
+            '    ShadowScanStatus_t status = ShadowScan_Integer( pScan, 0, UINT32_MAX, &value );',
+            '',
+            '    if( status == ShadowScanSuccess )',
+            '    {',
+            '        *pValue = ( uint32_t ) value;',
+            '    }',
+            '',
+            '    return status;',
+            '}',
+            '',
+            '/*-----------------------------------------------------------*/',
+            '',
+        ]
+
+        if 'int32' in self.kinds:
+            lines += [
+                'static ShadowScanStatus_t readInt32( ShadowScan_t * pScan,',
+                '                                     int32_t * pValue )',
+                '{',
+                '    int64_t value = 0;',
+                '    ShadowScanStatus_t status = ShadowScan_Integer( pScan, INT32_MIN, INT32_MAX, &value );',
+                '',
+                '    if( status == ShadowScanSuccess )',
+                '    {',
+                '        *pValue = ( int32_t ) value;',
+                '    }',
+                '',
+                '    return status;',
+                '}',
+                '',
+                '/*-----------------------------------------------------------*/',
+                '',
+            ]
+
+        # A nested object is parsed by a function of its own, whose field
+        # masks are those of the whole state.
+        for obj in list(objects(self.root.fields)) + [self.root]:
+            lines += self.parse_function(obj)
+
+        lines += self.signature_parse('')
+        lines += [
+            '{',
+            '    ShadowScan_t scan;',
+            '    {} delta;'.format(self.root.type_name),
+            '    ShadowScanStatus_t status;',
+            '    const char * pKey = NULL;',
+            '    size_t keyLength = 0U;',
+            '    uint32_t fields = 0U;',
+            '    uint32_t version = 0U;',
+            '',
+            '    ( void ) memset( &delta, 0, sizeof( delta ) );',
+            '    ShadowScan_Init( &scan, pDocument, documentLength );',
+            '    status = ShadowScan_BeginObject( &scan );',
+            '',
+            '    while( status == ShadowScanSuccess )',
+            '    {',
+            '        status = ShadowScan_NextKey( &scan, &pKey, &keyLength );',
+            '',
+            '        if( status != ShadowScanSuccess )',
+            '        {',
+            '            break;',
+            '        }',
+            '',
+            '        if( ( keyLength == 5U ) && ( memcmp( pKey, "state", 5U ) == 0 ) )',
+            '        {',
+            '            status = parseState( &scan, &delta, &fields );',
+            '        }',
+            '        else if( ( keyLength == 7U ) && ( memcmp( pKey, "version", 7U ) == 0 ) )',
+            '        {',
+            '            status = readUint32( &scan, &version );',
+            '        }',
+            '        else',
+            '        {',
+            '            status = ShadowScan_SkipValue( &scan );',
+            '        }',
+            '',
+            '        if( status == ShadowScanWrongType )',
+            '        {',
+            '            status = ShadowScanSuccess;',
+            '        }',
+            '    }',
+            '',
+            '    if( status == ShadowScanEnd )',
+            '    {',
+            '        status = ShadowScan_Finish( &scan );',
+            '    }',
+            '',
+            '    if( status == ShadowScanSuccess )',
+            '    {',
+        ]
+
+        for leaf in self.all_leaves:
+            member = '.'.join(leaf.path)
+            lines += [
+                '        if( ( fields & {} ) != 0U )'.format(leaf.mask),
+                '        {',
+            ]
+
+            if leaf.kind == 'string':
+                lines.append('            ( void ) memcpy( pState->{0}, delta.{0}, sizeof( delta.{0} ) );'.format(member))
+            else:
+                lines.append('            pState->{0} = delta.{0};'.format(member))
+
+            lines += ['        }', '']
+
+        lines += [
+            '        if( pFields != NULL )',
+            '        {',
+            '            *pFields = fields;',
+            '        }',
+            '',
+            '        if( pVersion != NULL )',
+            '        {',
+            '            *pVersion = version;',
+            '        }',
+            '    }',
+            '',
+            '    return ( status == ShadowScanSuccess );',
+            '}',
+            '',
+            '/*-----------------------------------------------------------*/',
+            '',
+        ]
+
+        lines += self.signature_serialize('')
+        lines += [
+            '{',
+            '    JsonWriter_t writer;',
+            '    size_t length = 0U;',
+            '',
+            '    JsonWriter_Init( &writer, pBuffer, bufferLength );',
+            '    JsonWriter_BeginObject( &writer, NULL );',
+            '    JsonWriter_BeginObject( &writer, "state" );',
+            '    JsonWriter_BeginObject( &writer, "reported" );',
+            '',
+        ]
+        lines += self.serialize_fields(self.root.fields, 'pState->', 1)
+        lines += [
+            '    JsonWriter_EndObject( &writer );',
+            '    JsonWriter_EndObject( &writer );',
+            '    JsonWriter_AddToken( &writer, "clientToken", clientToken, 6U );',
+            '    JsonWriter_EndObject( &writer );',
+            '',
+            '    if( JsonWriter_Finish( &writer, &length ) == false )',
+            '    {',
+            '        length = 0U;',
+            '    }',
+            '',
+            '    return length;',
+            '}',
+            '',
+            '/*-----------------------------------------------------------*/',
+        ]
+
+        return '\n'.join(lines) + '\n'
+
+    def serialize_fields(self, fields, prefix, level):
+        indent = '    ' * level
+        lines = []
+
+        for field in fields:
+            value = prefix + field.key
+            lines += [
+                '{}if( ( fields & {} ) != 0U )'.format(indent, field.mask),
+                '{}{{'.format(indent),
+            ]
+
+            if field.kind == 'object':
+                lines.append('{}    JsonWriter_BeginObject( &writer, "{}" );'.format(indent, field.key))
+                lines.append('')
+                lines += self.serialize_fields(field.fields, value + '.', level + 1)
+                lines.append('{}    JsonWriter_EndObject( &writer );'.format(indent))
+            elif field.kind == 'bool':
+                lines.append('{}    JsonWriter_AddBoolean( &writer, "{}", {} );'.format(indent, field.key, value))
+            elif field.kind == 'uint32':
+                lines.append('{}    JsonWriter_AddUnsigned( &writer, "{}", {} );'.format(indent, field.key, value))
+            elif field.kind == 'string':
+                lines.append('{}    JsonWriter_AddString( &writer, "{}", {}, strlen( {} ) );'.format(
+                    indent, field.key, value, value))
+            else:
+                lines.append('{}    JsonWriter_AddInteger( &writer, "{}", {} );'.format(indent, field.key, value))
+
+            lines += ['{}}}'.format(indent), '']
+
+        return lines
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: {} <schema.json> <output directory>'.format(sys.argv[0]))
+
+    schema_path = sys.argv[1]
+    schema_name = os.path.basename(schema_path)
+
+    try:
+        with open(schema_path, 'r') as schema_file:
+            schema = json.load(schema_file)
+
+        generator = Generator(schema, schema_name, os.path.splitext(schema_name)[0])
+    except (ValueError, AttributeError) as error:
+        sys.exit('{}: {}'.format(schema_path, error))
+
+    base = os.path.join(sys.argv[2], generator.file_name)
+
+    with open(base + '.h', 'w') as header_file:
+        header_file.write(generator.header())
+
+    with open(base + '.c', 'w') as source_file:
+        source_file.write(generator.source())
+
+
+if __name__ == '__main__':
+    main()
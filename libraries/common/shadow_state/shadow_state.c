@@ -0,0 +1,919 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_state.c
+ * @brief Implementation of the delta reporting of a shadow reported state.
+ *
+ * An update in flight is answered by the response carrying its client
+ * token. Until then the values it sent are the baseline a field is compared
+ * with, so a change made in the meantime is seen as a new change and goes
+ * in the next update, while a field set back to what was sent is not.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the shadow state. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Shadow State"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Include coreJSON. */
+#include "core_json.h"
+
+/* Include the JSON writer the updates are built with. */
+#include "json_writer.h"
+
+#include "shadow_state.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The keys the responses of the shadow are searched for.
+ */
+#define CLIENT_TOKEN_KEY           "clientToken"
+#define CLIENT_TOKEN_KEY_LENGTH    ( sizeof( CLIENT_TOKEN_KEY ) - 1U )
+#define VERSION_KEY                "version"
+#define VERSION_KEY_LENGTH         ( sizeof( VERSION_KEY ) - 1U )
+#define CODE_KEY                   "code"
+#define CODE_KEY_LENGTH            ( sizeof( CODE_KEY ) - 1U )
+
+/**
+ * @brief Where the versions and reported state are in the documents.
+ */
+#define PREVIOUS_VERSION_KEY                 "previous.version"
+#define PREVIOUS_VERSION_KEY_LENGTH          ( sizeof( PREVIOUS_VERSION_KEY ) - 1U )
+#define CURRENT_VERSION_KEY                  "current.version"
+#define CURRENT_VERSION_KEY_LENGTH           ( sizeof( CURRENT_VERSION_KEY ) - 1U )
+#define CURRENT_REPORTED_KEY                 "current.state.reported"
+#define CURRENT_REPORTED_KEY_LENGTH          ( sizeof( CURRENT_REPORTED_KEY ) - 1U )
+#define REPORTED_KEY                         "state.reported"
+#define REPORTED_KEY_LENGTH                  ( sizeof( REPORTED_KEY ) - 1U )
+
+/**
+ * @brief The code of an `/update/rejected` message for a version conflict.
+ */
+#define VERSION_CONFLICT_CODE      ( 409U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether two values of a field are the same.
+ */
+static bool valuesEqual( ShadowFieldType_t type,
+                         const ShadowValue_t * pLeft,
+                         const ShadowValue_t * pRight );
+
+/**
+ * @brief Whether the current value of a field differs from the value the
+ * shadow knows, or will know once the update in flight is accepted.
+ */
+static bool fieldChanged( const ShadowField_t * pField );
+
+/**
+ * @brief Writes the current value of a field as a member of the reported
+ * object.
+ */
+static void writeValue( JsonWriter_t * pWriter,
+                        const ShadowField_t * pField );
+
+/**
+ * @brief Finds an unsigned integer, quoted or not, in a response.
+ *
+ * @return false if @a pKey is missing or isn't an unsigned integer.
+ */
+static bool searchUnsigned( const char * pPayload,
+                            size_t payloadLength,
+                            const char * pKey,
+                            size_t keyLength,
+                            uint32_t * pValue );
+
+/**
+ * @brief Whether a response carries the client token of the update in flight.
+ */
+static bool answersUpdate( const ShadowState_t * pState,
+                           const char * pPayload,
+                           size_t payloadLength );
+
+/**
+ * @brief Takes @a version as the version of the document if it is newer.
+ */
+static void observeVersion( ShadowState_t * pState,
+                            uint32_t version );
+
+/**
+ * @brief Parses a value found by JSON_Search, which strips the quotes of a
+ * string, as a value of @a type.
+ *
+ * @return false if it isn't one, or a string doesn't fit or holds an escape
+ * other than of a quote, a backslash or a slash.
+ */
+static bool parseValue( ShadowFieldType_t type,
+                        const char * pValue,
+                        size_t valueLength,
+                        ShadowValue_t * pOut );
+
+/**
+ * @brief Takes the values of the reported object of a document, found under
+ * @a pQuery, as acknowledged, and its version as the version of the document.
+ */
+static void applyDocument( ShadowState_t * pState,
+                           const char * pPayload,
+                           size_t payloadLength,
+                           const char * pQuery,
+                           size_t queryLength,
+                           uint32_t version );
+
+/*-----------------------------------------------------------*/
+
+static bool valuesEqual( ShadowFieldType_t type,
+                         const ShadowValue_t * pLeft,
+                         const ShadowValue_t * pRight )
+{
+    bool equal = false;
+
+    switch( type )
+    {
+        case ShadowFieldInteger:
+            equal = ( pLeft->integer == pRight->integer );
+            break;
+
+        case ShadowFieldBoolean:
+            equal = ( pLeft->boolean == pRight->boolean );
+            break;
+
+        default:
+            equal = ( strcmp( pLeft->string, pRight->string ) == 0 );
+            break;
+    }
+
+    return equal;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool fieldChanged( const ShadowField_t * pField )
+{
+    bool changed = false;
+
+    if( pField->hasValue == false )
+    {
+        /* Nothing to report. */
+    }
+    else if( pField->isSent == true )
+    {
+        changed = !valuesEqual( pField->type, &pField->value, &pField->sent );
+    }
+    else if( pField->isReported == true )
+    {
+        changed = !valuesEqual( pField->type, &pField->value, &pField->reported );
+    }
+    else
+    {
+        changed = true;
+    }
+
+    return changed;
+}
+
+/*-----------------------------------------------------------*/
+
+static void writeValue( JsonWriter_t * pWriter,
+                        const ShadowField_t * pField )
+{
+    switch( pField->type )
+    {
+        case ShadowFieldInteger:
+            JsonWriter_AddInteger( pWriter, pField->pKey, pField->value.integer );
+            break;
+
+        case ShadowFieldBoolean:
+            JsonWriter_AddBoolean( pWriter, pField->pKey, pField->value.boolean );
+            break;
+
+        default:
+            JsonWriter_AddString( pWriter, pField->pKey, pField->value.string,
+                                  strlen( pField->value.string ) );
+            break;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool searchUnsigned( const char * pPayload,
+                            size_t payloadLength,
+                            const char * pKey,
+                            size_t keyLength,
+                            uint32_t * pValue )
+{
+    char * pOutValue = NULL;
+    size_t outValueLength = 0U;
+    uint64_t value = 0U;
+    size_t i;
+    bool status = false;
+
+    if( JSON_Search( ( char * ) pPayload, payloadLength, pKey, keyLength,
+                     &pOutValue, &outValueLength ) == JSONSuccess )
+    {
+        status = ( outValueLength > 0U ) && ( outValueLength <= 10U );
+
+        for( i = 0; ( i < outValueLength ) && ( status == true ); i++ )
+        {
+            status = ( pOutValue[ i ] >= '0' ) && ( pOutValue[ i ] <= '9' );
+            value = ( value * 10U ) + ( uint64_t ) ( pOutValue[ i ] - '0' );
+        }
+
+        status = status && ( value <= UINT32_MAX );
+    }
+
+    if( status == true )
+    {
+        *pValue = ( uint32_t ) value;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool answersUpdate( const ShadowState_t * pState,
+                           const char * pPayload,
+                           size_t payloadLength )
+{
+    uint32_t clientToken = 0U;
+
+    return ( pState->updateInFlight == true ) &&
+           ( JSON_Validate( pPayload, payloadLength ) == JSONSuccess ) &&
+           ( searchUnsigned( pPayload, payloadLength, CLIENT_TOKEN_KEY, CLIENT_TOKEN_KEY_LENGTH,
+                             &clientToken ) == true ) &&
+           ( clientToken == pState->clientToken );
+}
+
+/*-----------------------------------------------------------*/
+
+static void observeVersion( ShadowState_t * pState,
+                            uint32_t version )
+{
+    if( ( pState->latestVersion == 0U ) ||
+        ( ( int32_t ) ( version - pState->latestVersion ) > 0 ) )
+    {
+        pState->latestVersion = version;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool parseValue( ShadowFieldType_t type,
+                        const char * pValue,
+                        size_t valueLength,
+                        ShadowValue_t * pOut )
+{
+    bool status = false;
+    bool negative = false;
+    uint64_t magnitude = 0U;
+    size_t i = 0U;
+    size_t length = 0U;
+
+    switch( type )
+    {
+        case ShadowFieldInteger:
+            negative = ( valueLength > 0U ) && ( pValue[ 0 ] == '-' );
+            i = ( negative == true ) ? 1U : 0U;
+            status = ( valueLength > i ) && ( ( valueLength - i ) <= 18U );
+
+            for( ; ( i < valueLength ) && ( status == true ); i++ )
+            {
+                status = ( pValue[ i ] >= '0' ) && ( pValue[ i ] <= '9' );
+                magnitude = ( magnitude * 10U ) + ( uint64_t ) ( pValue[ i ] - '0' );
+            }
+
+            if( status == true )
+            {
+                pOut->integer = ( negative == true ) ? -( int64_t ) magnitude : ( int64_t ) magnitude;
+            }
+
+            break;
+
+        case ShadowFieldBoolean:
+            if( ( valueLength == 4U ) && ( strncmp( pValue, "true", 4U ) == 0 ) )
+            {
+                pOut->boolean = true;
+                status = true;
+            }
+            else if( ( valueLength == 5U ) && ( strncmp( pValue, "false", 5U ) == 0 ) )
+            {
+                pOut->boolean = false;
+                status = true;
+            }
+            else
+            {
+                /* Not a boolean. */
+            }
+
+            break;
+
+        default:
+            status = true;
+
+            for( i = 0; ( i < valueLength ) && ( status == true ); i++ )
+            {
+                if( pValue[ i ] == '\\' )
+                {
+                    i++;
+                    status = ( i < valueLength ) &&
+                             ( ( pValue[ i ] == '"' ) || ( pValue[ i ] == '\\' ) || ( pValue[ i ] == '/' ) );
+                }
+
+                status = status && ( length < ( SHADOW_STATE_STRING_SIZE - 1U ) );
+
+                if( status == true )
+                {
+                    pOut->string[ length ] = pValue[ i ];
+                    length++;
+                }
+            }
+
+            if( status == true )
+            {
+                pOut->string[ length ] = '\0';
+            }
+
+            break;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void applyDocument( ShadowState_t * pState,
+                           const char * pPayload,
+                           size_t payloadLength,
+                           const char * pQuery,
+                           size_t queryLength,
+                           uint32_t version )
+{
+    char * pReported = NULL;
+    size_t reportedLength = 0U;
+    char * pValue = NULL;
+    size_t valueLength = 0U;
+    ShadowField_t * pField = NULL;
+    ShadowValue_t value;
+    size_t i;
+
+    /* A document without reported state has no field reported. */
+    if( JSON_Search( ( char * ) pPayload, payloadLength, pQuery, queryLength,
+                     &pReported, &reportedLength ) != JSONSuccess )
+    {
+        reportedLength = 0U;
+    }
+
+    for( i = 0; i < pState->fieldCount; i++ )
+    {
+        pField = &pState->pFields[ i ];
+
+        if( ( reportedLength > 0U ) &&
+            ( JSON_Search( pReported, reportedLength, pField->pKey, strlen( pField->pKey ),
+                           &pValue, &valueLength ) == JSONSuccess ) &&
+            ( parseValue( pField->type, pValue, valueLength, &value ) == true ) )
+        {
+            pField->reported = value;
+            pField->isReported = true;
+        }
+        else
+        {
+            pField->isReported = false;
+        }
+    }
+
+    pState->version = version;
+    observeVersion( pState, version );
+}
+
+/*-----------------------------------------------------------*/
+
+void ShadowState_Init( ShadowState_t * pState,
+                       ShadowField_t * pFields,
+                       size_t fieldCount )
+{
+    size_t i;
+
+    assert( pState != NULL );
+    assert( ( pFields != NULL ) || ( fieldCount == 0U ) );
+
+    ( void ) memset( pState, 0x00, sizeof( *pState ) );
+    pState->pFields = pFields;
+    pState->fieldCount = fieldCount;
+
+    for( i = 0; i < fieldCount; i++ )
+    {
+        assert( pFields[ i ].pKey != NULL );
+
+        pFields[ i ].hasValue = false;
+        pFields[ i ].isReported = false;
+        pFields[ i ].isSent = false;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_SetInteger( ShadowState_t * pState,
+                             size_t index,
+                             int64_t value )
+{
+    bool status = false;
+
+    assert( ( pState != NULL ) && ( index < pState->fieldCount ) );
+
+    if( pState->pFields[ index ].type == ShadowFieldInteger )
+    {
+        pState->pFields[ index ].value.integer = value;
+        pState->pFields[ index ].hasValue = true;
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_SetBoolean( ShadowState_t * pState,
+                             size_t index,
+                             bool value )
+{
+    bool status = false;
+
+    assert( ( pState != NULL ) && ( index < pState->fieldCount ) );
+
+    if( pState->pFields[ index ].type == ShadowFieldBoolean )
+    {
+        pState->pFields[ index ].value.boolean = value;
+        pState->pFields[ index ].hasValue = true;
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_SetString( ShadowState_t * pState,
+                            size_t index,
+                            const char * pValue )
+{
+    bool status = false;
+    size_t length = 0U;
+
+    assert( ( pState != NULL ) && ( index < pState->fieldCount ) );
+    assert( pValue != NULL );
+
+    length = strlen( pValue );
+
+    if( ( pState->pFields[ index ].type == ShadowFieldString ) &&
+        ( length < SHADOW_STATE_STRING_SIZE ) )
+    {
+        ( void ) memcpy( pState->pFields[ index ].value.string, pValue, length + 1U );
+        pState->pFields[ index ].hasValue = true;
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_HasChanges( const ShadowState_t * pState )
+{
+    bool changed = false;
+    size_t i;
+
+    assert( pState != NULL );
+
+    for( i = 0; ( i < pState->fieldCount ) && ( changed == false ); i++ )
+    {
+        changed = fieldChanged( &pState->pFields[ i ] );
+    }
+
+    return changed;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t ShadowState_BuildUpdate( ShadowState_t * pState,
+                                uint32_t clientToken,
+                                char * pBuffer,
+                                size_t bufferLength )
+{
+    JsonWriter_t writer;
+    size_t length = 0U;
+    size_t changedCount = 0U;
+    bool status = false;
+    ShadowField_t * pField = NULL;
+    size_t i;
+
+    assert( pState != NULL );
+    assert( ( pBuffer != NULL ) && ( bufferLength > 0U ) );
+
+    if( pState->updateInFlight == false )
+    {
+        JsonWriter_Init( &writer, pBuffer, bufferLength );
+        JsonWriter_BeginObject( &writer, NULL );
+        JsonWriter_BeginObject( &writer, "state" );
+        JsonWriter_BeginObject( &writer, "reported" );
+
+        for( i = 0; i < pState->fieldCount; i++ )
+        {
+            pField = &pState->pFields[ i ];
+
+            if( fieldChanged( pField ) == true )
+            {
+                writeValue( &writer, pField );
+                changedCount++;
+            }
+        }
+
+        JsonWriter_EndObject( &writer );
+        JsonWriter_EndObject( &writer );
+
+        #if SHADOW_STATE_SEND_VERSION
+            if( pState->latestVersion != 0U )
+            {
+                /* The shadow rejects the update if another writer got in first. */
+                JsonWriter_AddUnsigned( &writer, VERSION_KEY, pState->latestVersion );
+            }
+        #endif
+
+        JsonWriter_AddToken( &writer, CLIENT_TOKEN_KEY, clientToken, 6U );
+        JsonWriter_EndObject( &writer );
+
+        status = JsonWriter_Finish( &writer, &length );
+
+        if( ( status == false ) && ( changedCount > 0U ) )
+        {
+            LogError( ( "The changed fields need an update buffer of %u bytes, it has %u.",
+                        ( unsigned ) ( length + 1U ), ( unsigned ) bufferLength ) );
+        }
+    }
+
+    if( ( status == true ) && ( changedCount > 0U ) )
+    {
+        /* Remember what was sent, the current values may change before the
+         * response arrives. */
+        for( i = 0; i < pState->fieldCount; i++ )
+        {
+            pField = &pState->pFields[ i ];
+
+            if( fieldChanged( pField ) == true )
+            {
+                pField->sent = pField->value;
+                pField->isSent = true;
+            }
+        }
+
+        pState->clientToken = clientToken;
+        pState->updateInFlight = true;
+        pState->timed = false;
+    }
+    else
+    {
+        length = 0U;
+    }
+
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_HandleAccepted( ShadowState_t * pState,
+                                 const char * pPayload,
+                                 size_t payloadLength )
+{
+    bool status = false;
+    uint32_t version = 0U;
+    ShadowField_t * pField = NULL;
+    size_t i;
+
+    assert( pState != NULL );
+    assert( pPayload != NULL );
+
+    if( answersUpdate( pState, pPayload, payloadLength ) == false )
+    {
+        /* Another update, or not a response at all. */
+    }
+    else if( searchUnsigned( pPayload, payloadLength, VERSION_KEY, VERSION_KEY_LENGTH, &version ) == false )
+    {
+        LogWarn( ( "No version in the response to update %06lu.", ( unsigned long ) pState->clientToken ) );
+    }
+    else if( ( int32_t ) ( version - pState->version ) <= 0 )
+    {
+        LogWarn( ( "Ignoring a response to update %06lu with version %u, the shadow is at %u already.",
+                   ( unsigned long ) pState->clientToken, ( unsigned ) version, ( unsigned ) pState->version ) );
+    }
+    else
+    {
+        for( i = 0; i < pState->fieldCount; i++ )
+        {
+            pField = &pState->pFields[ i ];
+
+            if( pField->isSent == true )
+            {
+                pField->reported = pField->sent;
+                pField->isReported = true;
+                pField->isSent = false;
+            }
+        }
+
+        pState->version = version;
+        observeVersion( pState, version );
+        pState->updateInFlight = false;
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_HandleRejected( ShadowState_t * pState,
+                                 const char * pPayload,
+                                 size_t payloadLength )
+{
+    bool status = false;
+    uint32_t code = 0U;
+
+    assert( pState != NULL );
+    assert( pPayload != NULL );
+
+    if( answersUpdate( pState, pPayload, payloadLength ) == true )
+    {
+        if( ( searchUnsigned( pPayload, payloadLength, CODE_KEY, CODE_KEY_LENGTH, &code ) == true ) &&
+            ( code == VERSION_CONFLICT_CODE ) )
+        {
+            LogWarn( ( "Update %06lu conflicts with version %u, reporting every field again.",
+                       ( unsigned long ) pState->clientToken, ( unsigned ) pState->latestVersion ) );
+
+            /* Whatever the other writer left replaces what was acknowledged. */
+            ShadowState_Reset( pState );
+        }
+        else
+        {
+            ShadowState_CancelUpdate( pState );
+        }
+
+        status = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowDocumentStatus_t ShadowState_HandleDocuments( ShadowState_t * pState,
+                                                    const char * pPayload,
+                                                    size_t payloadLength )
+{
+    ShadowDocumentStatus_t status = ShadowDocumentInvalid;
+    uint32_t currentVersion = 0U;
+    uint32_t previousVersion = 0U;
+
+    assert( pState != NULL );
+    assert( pPayload != NULL );
+
+    if( ( JSON_Validate( pPayload, payloadLength ) != JSONSuccess ) ||
+        ( searchUnsigned( pPayload, payloadLength, CURRENT_VERSION_KEY, CURRENT_VERSION_KEY_LENGTH,
+                          &currentVersion ) == false ) )
+    {
+        LogWarn( ( "Ignoring an /update/documents message without a current version." ) );
+    }
+    else if( answersUpdate( pState, pPayload, payloadLength ) == true )
+    {
+        /* /update/accepted takes the values that were sent. */
+        status = ShadowDocumentStale;
+    }
+    else if( ( pState->version != 0U ) && ( ( int32_t ) ( currentVersion - pState->version ) <= 0 ) )
+    {
+        status = ShadowDocumentStale;
+    }
+    else
+    {
+        /* The document that creates the shadow has no previous version. */
+        if( searchUnsigned( pPayload, payloadLength, PREVIOUS_VERSION_KEY, PREVIOUS_VERSION_KEY_LENGTH,
+                            &previousVersion ) == false )
+        {
+            previousVersion = 0U;
+        }
+
+        if( previousVersion == pState->version )
+        {
+            applyDocument( pState, pPayload, payloadLength,
+                           CURRENT_REPORTED_KEY, CURRENT_REPORTED_KEY_LENGTH, currentVersion );
+            status = ShadowDocumentApplied;
+        }
+        else
+        {
+            LogWarn( ( "The shadow went from version %u to %u, %u is the last one known.",
+                       ( unsigned ) previousVersion, ( unsigned ) currentVersion, ( unsigned ) pState->version ) );
+            observeVersion( pState, currentVersion );
+            status = ShadowDocumentDiverged;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ShadowState_HandleGetAccepted( ShadowState_t * pState,
+                                    const char * pPayload,
+                                    size_t payloadLength )
+{
+    bool status = false;
+    uint32_t version = 0U;
+
+    assert( pState != NULL );
+    assert( pPayload != NULL );
+
+    if( ( JSON_Validate( pPayload, payloadLength ) == JSONSuccess ) &&
+        ( searchUnsigned( pPayload, payloadLength, VERSION_KEY, VERSION_KEY_LENGTH, &version ) == true ) )
+    {
+        applyDocument( pState, pPayload, payloadLength, REPORTED_KEY, REPORTED_KEY_LENGTH, version );
+        status = true;
+    }
+    else
+    {
+        LogWarn( ( "Ignoring a /get/accepted message without a version." ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void ShadowState_Reset( ShadowState_t * pState )
+{
+    size_t i;
+
+    assert( pState != NULL );
+
+    for( i = 0; i < pState->fieldCount; i++ )
+    {
+        pState->pFields[ i ].isReported = false;
+        pState->pFields[ i ].isSent = false;
+    }
+
+    pState->version = 0U;
+    pState->latestVersion = 0U;
+    pState->updateInFlight = false;
+}
+
+/*-----------------------------------------------------------*/
+
+void ShadowState_CancelUpdate( ShadowState_t * pState )
+{
+    size_t i;
+
+    assert( pState != NULL );
+
+    for( i = 0; i < pState->fieldCount; i++ )
+    {
+        pState->pFields[ i ].isSent = false;
+    }
+
+    pState->updateInFlight = false;
+}
+
+/*-----------------------------------------------------------*/
+
+void ShadowState_HandleDelta( ShadowState_t * pState,
+                              const char * pPayload,
+                              size_t payloadLength )
+{
+    uint32_t version = 0U;
+
+    assert( pState != NULL );
+    assert( pPayload != NULL );
+
+    if( ( JSON_Validate( pPayload, payloadLength ) == JSONSuccess ) &&
+        ( searchUnsigned( pPayload, payloadLength, VERSION_KEY, VERSION_KEY_LENGTH, &version ) == true ) )
+    {
+        observeVersion( pState, version );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t ShadowState_Process( ShadowState_t * pState,
+                            uint32_t nowMs,
+                            uint32_t clientToken,
+                            char * pBuffer,
+                            size_t bufferLength )
+{
+    size_t length = 0U;
+
+    assert( pState != NULL );
+
+    if( ( pState->updateInFlight == true ) && ( pState->timed == true ) &&
+        ( ( nowMs - pState->sentMs ) >= SHADOW_STATE_RESPONSE_TIMEOUT_MS ) )
+    {
+        LogWarn( ( "No response to update %06lu after %u ms, sending its changes again.",
+                   ( unsigned long ) pState->clientToken, ( unsigned ) SHADOW_STATE_RESPONSE_TIMEOUT_MS ) );
+        ShadowState_CancelUpdate( pState );
+    }
+
+    /* The window opens with the first change the shadow doesn't have, even
+     * while an update is in flight, so a change held back by the update
+     * goes out as soon as it is answered. */
+    if( ShadowState_HasChanges( pState ) == false )
+    {
+        pState->changePending = false;
+    }
+    else if( pState->changePending == false )
+    {
+        pState->changePending = true;
+        pState->changeSinceMs = nowMs;
+    }
+
+    if( ( pState->updateInFlight == false ) && ( pState->changePending == true ) &&
+        ( ( nowMs - pState->changeSinceMs ) >= SHADOW_STATE_COALESCE_MS ) )
+    {
+        length = ShadowState_BuildUpdate( pState, clientToken, pBuffer, bufferLength );
+
+        if( length > 0U )
+        {
+            pState->sentMs = nowMs;
+            pState->timed = true;
+            pState->changePending = false;
+        }
+    }
+
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ShadowState_TimeToDeadline( const ShadowState_t * pState,
+                                     uint32_t nowMs )
+{
+    uint32_t remainingMs = UINT32_MAX;
+    uint32_t elapsedMs = 0U;
+
+    assert( pState != NULL );
+
+    if( ( pState->updateInFlight == true ) && ( pState->timed == true ) )
+    {
+        elapsedMs = nowMs - pState->sentMs;
+        remainingMs = ( elapsedMs < SHADOW_STATE_RESPONSE_TIMEOUT_MS ) ?
+                      ( SHADOW_STATE_RESPONSE_TIMEOUT_MS - elapsedMs ) : 0U;
+    }
+    else if( pState->updateInFlight == true )
+    {
+        /* Only the response ends an update sent by ShadowState_BuildUpdate. */
+    }
+    else if( pState->changePending == true )
+    {
+        elapsedMs = nowMs - pState->changeSinceMs;
+        remainingMs = ( elapsedMs < SHADOW_STATE_COALESCE_MS ) ?
+                      ( SHADOW_STATE_COALESCE_MS - elapsedMs ) : 0U;
+    }
+    else if( ShadowState_HasChanges( pState ) == true )
+    {
+        /* Set since the last call to ShadowState_Process, which opens the window. */
+        remainingMs = SHADOW_STATE_COALESCE_MS;
+    }
+    else
+    {
+        /* Nothing waiting. */
+    }
+
+    return remainingMs;
+}
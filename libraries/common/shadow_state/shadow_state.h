@@ -0,0 +1,361 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file shadow_state.h
+ * @brief Report only the changes of the reported state to a Device Shadow.
+ *
+ * The reported state is a table of fields the application defines once, each
+ * with a JSON key and a type. The application sets the current value of a
+ * field whenever it likes; #ShadowState_BuildUpdate then writes an update
+ * document holding just the fields that differ from what the shadow last
+ * acknowledged. The values of an update are taken as reported once
+ * `/update/accepted` answers it with its client token and a version newer
+ * than the last one seen, so a duplicate or late response isn't applied
+ * twice. A field changed again while its update is in flight is reported by
+ * the next update.
+ *
+ * #ShadowState_Process schedules the updates: it holds a change for a
+ * coalescing window so that a burst of changes goes out as one update, keeps
+ * at most one update in flight, and folds the changes made meanwhile into
+ * the next one. An update rejected with a version conflict is rebased, by
+ * reporting every field again on top of the document the other writer left.
+ *
+ * What the shadow acknowledged follows the document between updates too:
+ * #ShadowState_HandleDocuments applies an `/update/documents` message that
+ * continues from the known version, and #ShadowState_HandleGetAccepted takes
+ * a whole document when the chain of versions is broken. Together with the
+ * shadow_cache component, which keeps that baseline in NVS, a device that
+ * reconnects or reboots reports only what changed instead of the whole
+ * state.
+ *
+ * The functions are not thread safe and are called from the task that owns
+ * the MQTT context.
+ */
+
+#ifndef SHADOW_STATE_H_
+#define SHADOW_STATE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Size of a string value, with the terminator.
+ */
+#ifndef SHADOW_STATE_STRING_SIZE
+    #define SHADOW_STATE_STRING_SIZE    CONFIG_SHADOW_STATE_STRING_SIZE
+#endif
+
+/**
+ * @brief How long #ShadowState_Process holds a change for others to join it.
+ */
+#ifndef SHADOW_STATE_COALESCE_MS
+    #define SHADOW_STATE_COALESCE_MS    CONFIG_SHADOW_STATE_COALESCE_MS
+#endif
+
+/**
+ * @brief How long #ShadowState_Process waits for the response to an update.
+ */
+#ifndef SHADOW_STATE_RESPONSE_TIMEOUT_MS
+    #define SHADOW_STATE_RESPONSE_TIMEOUT_MS    CONFIG_SHADOW_STATE_RESPONSE_TIMEOUT_MS
+#endif
+
+/**
+ * @brief Whether updates carry the version they expect the document at.
+ */
+#ifndef SHADOW_STATE_SEND_VERSION
+    #define SHADOW_STATE_SEND_VERSION    CONFIG_SHADOW_STATE_SEND_VERSION
+#endif
+
+/**
+ * @brief The JSON type of a field.
+ */
+typedef enum ShadowFieldType
+{
+    ShadowFieldInteger, /**< A JSON number without a fraction. */
+    ShadowFieldBoolean, /**< true or false. */
+    ShadowFieldString   /**< A string of up to #SHADOW_STATE_STRING_SIZE - 1 bytes. */
+} ShadowFieldType_t;
+
+/**
+ * @brief What #ShadowState_HandleDocuments made of a message.
+ */
+typedef enum ShadowDocumentStatus
+{
+    ShadowDocumentApplied,  /**< The reported state of the new document was taken. */
+    ShadowDocumentStale,    /**< The document is known already, or answers the update in flight. */
+    ShadowDocumentDiverged, /**< The document doesn't continue from the known version. */
+    ShadowDocumentInvalid   /**< Not a JSON document with a version. */
+} ShadowDocumentStatus_t;
+
+/**
+ * @brief A value of a field, of the type of the field.
+ */
+typedef union ShadowValue
+{
+    int64_t integer;
+    bool boolean;
+    char string[ SHADOW_STATE_STRING_SIZE ];
+} ShadowValue_t;
+
+/**
+ * @brief A field of the reported state.
+ *
+ * Define the table with #SHADOW_FIELD. The fields after the type are private
+ * to this module and to the shadow_cache component, which persists them.
+ */
+typedef struct ShadowField
+{
+    const char * pKey;      /**< The JSON key, NUL-terminated. */
+    ShadowFieldType_t type; /**< The type of the values. */
+
+    ShadowValue_t value;    /* The current value, if hasValue. */
+    ShadowValue_t reported; /* Acknowledged by the shadow, if isReported. */
+    ShadowValue_t sent;     /* In the update in flight, if isSent. */
+    bool hasValue;
+    bool isReported;
+    bool isSent;
+} ShadowField_t;
+
+/**
+ * @brief Initializer of an entry of the table of fields.
+ */
+#define SHADOW_FIELD( key, fieldType )    { .pKey = ( key ), .type = ( fieldType ) }
+
+/**
+ * @brief The reported state of a shadow.
+ *
+ * The fields are private to this module and to the shadow_cache component.
+ */
+typedef struct ShadowState
+{
+    ShadowField_t * pFields;
+    size_t fieldCount;
+
+    /* Version of the last update accepted, 0 before the first one. */
+    uint32_t version;
+
+    /* Newest version of the document seen in any response or delta, which
+     * updates are sent with. 0 when unknown. */
+    uint32_t latestVersion;
+
+    /* Client token of the update in flight, if updateInFlight. */
+    uint32_t clientToken;
+    bool updateInFlight;
+
+    /* When #ShadowState_Process sent the update in flight, if timed. */
+    uint32_t sentMs;
+    bool timed;
+
+    /* When #ShadowState_Process first saw the changes not sent yet. */
+    uint32_t changeSinceMs;
+    bool changePending;
+} ShadowState_t;
+
+/**
+ * @brief Starts tracking a table of fields, none of them set or reported.
+ *
+ * @param[out] pState The state to initialize.
+ * @param[in] pFields The fields, defined with #SHADOW_FIELD. The table is
+ * used in place and must outlive the state.
+ * @param[in] fieldCount The number of fields.
+ */
+void ShadowState_Init( ShadowState_t * pState,
+                       ShadowField_t * pFields,
+                       size_t fieldCount );
+
+/**
+ * @brief Sets the current value of an integer field.
+ *
+ * @return false if the field isn't an integer.
+ */
+bool ShadowState_SetInteger( ShadowState_t * pState,
+                             size_t index,
+                             int64_t value );
+
+/**
+ * @brief Sets the current value of a boolean field.
+ *
+ * @return false if the field isn't a boolean.
+ */
+bool ShadowState_SetBoolean( ShadowState_t * pState,
+                             size_t index,
+                             bool value );
+
+/**
+ * @brief Sets the current value of a string field from a NUL-terminated
+ * string, copied.
+ *
+ * @return false if the field isn't a string or the value is too long.
+ */
+bool ShadowState_SetString( ShadowState_t * pState,
+                            size_t index,
+                            const char * pValue );
+
+/**
+ * @brief Whether a field has a value the shadow hasn't been sent yet.
+ */
+bool ShadowState_HasChanges( const ShadowState_t * pState );
+
+/**
+ * @brief Writes an update document reporting the fields whose value differs
+ * from what the shadow last acknowledged, and marks it in flight.
+ *
+ * The document is
+ * `{"state":{"reported":{...}},"version":<version>,"clientToken":"<clientToken>"}`,
+ * with the client token printed as in the demos, six digits at least. The
+ * version is left out when it is unknown or #SHADOW_STATE_SEND_VERSION is
+ * off. The update is sent at once and doesn't time out; use
+ * #ShadowState_Process to schedule updates instead.
+ *
+ * @param[in] pState The state.
+ * @param[in] clientToken The client token of the update.
+ * @param[out] pBuffer Where the document is written, NUL-terminated.
+ * @param[in] bufferLength The size of @a pBuffer.
+ *
+ * @return The length of the document, or 0 if nothing changed, an update is
+ * already in flight or the document doesn't fit.
+ */
+size_t ShadowState_BuildUpdate( ShadowState_t * pState,
+                                uint32_t clientToken,
+                                char * pBuffer,
+                                size_t bufferLength );
+
+/**
+ * @brief Sends the changes of the reported state when they are due: once the
+ * first of them has waited #SHADOW_STATE_COALESCE_MS and no update is in
+ * flight. Gives up on an update that had no response within
+ * #SHADOW_STATE_RESPONSE_TIMEOUT_MS, so that its changes are sent again.
+ *
+ * Call it after setting fields and from the loop that runs the MQTT process
+ * loop, at least by #ShadowState_TimeToDeadline. The arguments are those of
+ * #ShadowState_BuildUpdate, plus the current time.
+ *
+ * @return The length of the update to publish, or 0 if none is due. If the
+ * publish fails, call #ShadowState_CancelUpdate.
+ */
+size_t ShadowState_Process( ShadowState_t * pState,
+                            uint32_t nowMs,
+                            uint32_t clientToken,
+                            char * pBuffer,
+                            size_t bufferLength );
+
+/**
+ * @brief How long until #ShadowState_Process has something to do.
+ *
+ * @return Milliseconds, 0 if it is due now, or UINT32_MAX if nothing is
+ * waiting.
+ */
+uint32_t ShadowState_TimeToDeadline( const ShadowState_t * pState,
+                                     uint32_t nowMs );
+
+/**
+ * @brief Gives up on the update in flight, such as when it couldn't be
+ * published. Its changes are sent again by the next update.
+ */
+void ShadowState_CancelUpdate( ShadowState_t * pState );
+
+/**
+ * @brief Takes the version of an `/update/delta` message as the version the
+ * document is at, so that the next update doesn't conflict with the desired
+ * state change behind the delta.
+ */
+void ShadowState_HandleDelta( ShadowState_t * pState,
+                              const char * pPayload,
+                              size_t payloadLength );
+
+/**
+ * @brief Takes the values of the update in flight as reported, if an
+ * `/update/accepted` message answers it.
+ *
+ * @param[in] pState The state.
+ * @param[in] pPayload The payload of the message.
+ * @param[in] payloadLength The length of @a pPayload.
+ *
+ * @return true if the message carries the client token of the update in
+ * flight and a version newer than the last one accepted.
+ */
+bool ShadowState_HandleAccepted( ShadowState_t * pState,
+                                 const char * pPayload,
+                                 size_t payloadLength );
+
+/**
+ * @brief Gives up on the update in flight if an `/update/rejected` message
+ * answers it. Its fields are sent again by the next update. On a version
+ * conflict, code 409, the update is rebased: what the shadow acknowledged
+ * before is forgotten, so the next update reports every field that is set,
+ * without a version.
+ *
+ * @return true if the message carries the client token of the update in
+ * flight.
+ */
+bool ShadowState_HandleRejected( ShadowState_t * pState,
+                                 const char * pPayload,
+                                 size_t payloadLength );
+
+/**
+ * @brief Follows the reported state of the document from an
+ * `/update/documents` message, so that the next update doesn't send again
+ * what another writer or an earlier update already reported.
+ *
+ * The message is applied only if its previous version is the version last
+ * known. A later version means updates were missed, such as while the device
+ * was offline or its cache was saved; fetch the whole document with `/get`
+ * and pass it to #ShadowState_HandleGetAccepted. The document of the update
+ * in flight is left to #ShadowState_HandleAccepted.
+ *
+ * @param[in] pState The state.
+ * @param[in] pPayload The payload of the message.
+ * @param[in] payloadLength The length of @a pPayload.
+ *
+ * @return What was made of the message.
+ */
+ShadowDocumentStatus_t ShadowState_HandleDocuments( ShadowState_t * pState,
+                                                    const char * pPayload,
+                                                    size_t payloadLength );
+
+/**
+ * @brief Takes the reported state and version of a whole document from a
+ * `/get/accepted` message as what the shadow acknowledged. Fields missing
+ * from the document, or with a value of another type, are reported again by
+ * the next update.
+ *
+ * @return false if the message isn't a JSON document with a version.
+ */
+bool ShadowState_HandleGetAccepted( ShadowState_t * pState,
+                                    const char * pPayload,
+                                    size_t payloadLength );
+
+/**
+ * @brief Forgets what the shadow acknowledged, keeping the current values,
+ * so the next update reports every field that is set. Call it when the
+ * shadow document is deleted, or its responses may have been lost.
+ */
+void ShadowState_Reset( ShadowState_t * pState );
+
+#endif /* ifndef SHADOW_STATE_H_ */
@@ -0,0 +1,599 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file task_layout_benchmark.c
+ * @brief Measures how the task layout profiles share the cores.
+ *
+ * Each run models an OTA download over MQTT with one task per role:
+ * - the network task decrypts each block of the image with AES, as mbedTLS
+ *   does for the TLS records it arrives in;
+ * - the agent task hands the blocks on to the OTA task, and serializes and
+ *   encrypts the publishes of the application task first, as the control
+ *   lane of the MQTT agent does;
+ * - the OTA task hashes each block, as the signature check does;
+ * - the flash writer task writes each block to the update partition;
+ * - the application task publishes every #BENCHMARK_PUBLISH_PERIOD_MS and
+ *   times each publish until the agent has sent it.
+ *
+ * The throughput is that of the whole image through the four stages, and the
+ * partition is erased before each run, outside of the measured time.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/sha256.h"
+
+/* Header include. */
+#include "task_layout.h"
+#include "task_layout_benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Bytes of a block of the test image.
+ */
+#define BENCHMARK_BLOCK_SIZE           ( 4096U )
+
+/**
+ * @brief Bytes of the test image written in a run.
+ */
+#define BENCHMARK_IMAGE_SIZE           ( 256U * 1024U )
+
+/**
+ * @brief Blocks of the test image.
+ */
+#define BENCHMARK_BLOCKS               ( BENCHMARK_IMAGE_SIZE / BENCHMARK_BLOCK_SIZE )
+
+/**
+ * @brief Block buffers cycled through the stages, as in the OTA event pool.
+ */
+#define BENCHMARK_BUFFERS              ( 4U )
+
+/**
+ * @brief Period of the publishes of the application task.
+ */
+#define BENCHMARK_PUBLISH_PERIOD_MS    ( 20U )
+
+/**
+ * @brief Bytes of a publish, serialized and encrypted by the agent task.
+ */
+#define BENCHMARK_PUBLISH_SIZE         ( 256U )
+
+/**
+ * @brief Longest time a run may take before it is reported as failed.
+ */
+#define BENCHMARK_RUN_TIMEOUT_MS       ( 60000U )
+
+/**
+ * @brief Tasks of a run.
+ */
+#define BENCHMARK_TASKS                ( 5U )
+
+/**
+ * @brief Event group bit that starts the tasks of a run.
+ */
+#define BENCHMARK_START_BIT            ( 1U << 0 )
+
+/**
+ * @brief Bytes per second, in KB, of @a bytes processed in @a us microseconds.
+ */
+#define BENCHMARK_KBPS( bytes, us ) \
+    ( ( unsigned ) ( ( us ) > 0 ? ( ( ( uint64_t ) ( bytes ) * 1000000U ) / ( ( uint64_t ) ( us ) * 1024U ) ) : 0U ) )
+
+/**
+ * @brief A block on its way to the update partition.
+ */
+typedef struct BenchmarkBlock
+{
+    uint32_t index;
+    uint8_t data[ BENCHMARK_BLOCK_SIZE ];
+} BenchmarkBlock_t;
+
+/**
+ * @brief What a run measured.
+ */
+typedef struct BenchmarkRun
+{
+    int64_t startUs;
+    int64_t endUs;
+    uint32_t publishes;
+    int64_t latencySumUs;
+    int64_t latencyMaxUs;
+    esp_err_t flashError;
+} BenchmarkRun_t;
+
+static const char * TAG = "TaskLayoutBenchmark";
+
+static const char * const profileNames[ TaskLayoutProfileCount ] =
+{
+    "default", "split", "single core", "custom"
+};
+
+/**
+ * @brief The partition the blocks are written to.
+ */
+static const esp_partition_t * pPartition = NULL;
+
+/**
+ * @brief The stages of the pipeline, and the free blocks.
+ */
+static QueueHandle_t freeQueue = NULL;
+static QueueHandle_t bulkQueue = NULL;
+static QueueHandle_t controlQueue = NULL;
+static QueueHandle_t otaQueue = NULL;
+static QueueHandle_t writerQueue = NULL;
+
+/**
+ * @brief Given for each command queued to the agent task.
+ */
+static SemaphoreHandle_t agentWork = NULL;
+
+/**
+ * @brief Given by each task when it exits.
+ */
+static SemaphoreHandle_t doneSemaphore = NULL;
+
+/**
+ * @brief Given by the flash writer once the image is written.
+ */
+static SemaphoreHandle_t imageWritten = NULL;
+
+/**
+ * @brief Starts the tasks of a run at the same time.
+ */
+static EventGroupHandle_t startEvent = NULL;
+
+/**
+ * @brief Set to stop the application task, then the agent task.
+ */
+static volatile bool stopApp = false;
+static volatile bool stopAgent = false;
+
+/**
+ * @brief The measurements of the current run.
+ */
+static BenchmarkRun_t run;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Encrypts or decrypts @a length bytes in place with AES-128 in CTR
+ * mode, like a TLS record.
+ */
+static void cryptRecord( mbedtls_aes_context * pAes,
+                         uint8_t * pData,
+                         size_t length );
+
+/**
+ * @brief The tasks of a run.
+ */
+static void networkTask( void * pParameters );
+static void agentTask( void * pParameters );
+static void otaTask( void * pParameters );
+static void writerTask( void * pParameters );
+static void appTask( void * pParameters );
+
+/**
+ * @brief Runs the model with the tasks of @a profile. A run that doesn't end
+ * within #BENCHMARK_RUN_TIMEOUT_MS is waited for, and reported with
+ * ESP_ERR_TIMEOUT.
+ *
+ * @return false if the buffers or the tasks couldn't be created. Tasks
+ * created before the failure may still be running.
+ */
+static bool runProfile( TaskLayoutProfile_t profile );
+
+/*-----------------------------------------------------------*/
+
+static void cryptRecord( mbedtls_aes_context * pAes,
+                         uint8_t * pData,
+                         size_t length )
+{
+    uint8_t nonceCounter[ 16 ] = { 0 };
+    uint8_t streamBlock[ 16 ];
+    size_t offset = 0U;
+
+    ( void ) mbedtls_aes_crypt_ctr( pAes, length, &offset, nonceCounter, streamBlock, pData, pData );
+}
+
+/*-----------------------------------------------------------*/
+
+static void networkTask( void * pParameters )
+{
+    static const uint8_t key[ 16 ] = { 0 };
+    mbedtls_aes_context aes;
+    BenchmarkBlock_t * pBlock;
+    uint32_t i;
+    uint32_t j;
+
+    ( void ) pParameters;
+
+    mbedtls_aes_init( &aes );
+    ( void ) mbedtls_aes_setkey_enc( &aes, key, 128 );
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+
+    for( i = 0U; i < BENCHMARK_BLOCKS; i++ )
+    {
+        ( void ) xQueueReceive( freeQueue, &pBlock, portMAX_DELAY );
+
+        for( j = 0U; j < BENCHMARK_BLOCK_SIZE; j++ )
+        {
+            pBlock->data[ j ] = ( uint8_t ) ( ( i + j ) * 31U );
+        }
+
+        cryptRecord( &aes, pBlock->data, BENCHMARK_BLOCK_SIZE );
+        pBlock->index = i;
+
+        ( void ) xQueueSend( bulkQueue, &pBlock, portMAX_DELAY );
+        ( void ) xSemaphoreGive( agentWork );
+    }
+
+    mbedtls_aes_free( &aes );
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void agentTask( void * pParameters )
+{
+    static const uint8_t key[ 16 ] = { 1 };
+    static uint8_t record[ BENCHMARK_PUBLISH_SIZE ];
+    mbedtls_aes_context aes;
+    BenchmarkBlock_t * pBlock;
+    TaskHandle_t publisher;
+
+    ( void ) pParameters;
+
+    mbedtls_aes_init( &aes );
+    ( void ) mbedtls_aes_setkey_enc( &aes, key, 128 );
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+
+    while( stopAgent == false )
+    {
+        if( xSemaphoreTake( agentWork, pdMS_TO_TICKS( 10U ) ) == pdTRUE )
+        {
+            /* Publishes go before the blocks, as in the control lane. */
+            if( xQueueReceive( controlQueue, &publisher, 0U ) == pdTRUE )
+            {
+                ( void ) memset( record, 0x5A, sizeof( record ) );
+                cryptRecord( &aes, record, sizeof( record ) );
+                ( void ) xTaskNotifyGive( publisher );
+            }
+            else if( xQueueReceive( bulkQueue, &pBlock, 0U ) == pdTRUE )
+            {
+                ( void ) xQueueSend( otaQueue, &pBlock, portMAX_DELAY );
+            }
+        }
+    }
+
+    mbedtls_aes_free( &aes );
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void otaTask( void * pParameters )
+{
+    mbedtls_sha256_context sha;
+    BenchmarkBlock_t * pBlock;
+    uint8_t digest[ 32 ];
+    uint32_t i;
+
+    ( void ) pParameters;
+
+    mbedtls_sha256_init( &sha );
+    ( void ) mbedtls_sha256_starts_ret( &sha, 0 );
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+
+    for( i = 0U; i < BENCHMARK_BLOCKS; i++ )
+    {
+        ( void ) xQueueReceive( otaQueue, &pBlock, portMAX_DELAY );
+        ( void ) mbedtls_sha256_update_ret( &sha, pBlock->data, BENCHMARK_BLOCK_SIZE );
+        ( void ) xQueueSend( writerQueue, &pBlock, portMAX_DELAY );
+    }
+
+    ( void ) mbedtls_sha256_finish_ret( &sha, digest );
+    mbedtls_sha256_free( &sha );
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void writerTask( void * pParameters )
+{
+    BenchmarkBlock_t * pBlock;
+    esp_err_t ret;
+    uint32_t i;
+
+    ( void ) pParameters;
+
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+
+    for( i = 0U; i < BENCHMARK_BLOCKS; i++ )
+    {
+        ( void ) xQueueReceive( writerQueue, &pBlock, portMAX_DELAY );
+        ret = esp_partition_write( pPartition, pBlock->index * BENCHMARK_BLOCK_SIZE,
+                                   pBlock->data, BENCHMARK_BLOCK_SIZE );
+
+        if( ( ret != ESP_OK ) && ( run.flashError == ESP_OK ) )
+        {
+            run.flashError = ret;
+        }
+
+        ( void ) xQueueSend( freeQueue, &pBlock, portMAX_DELAY );
+    }
+
+    run.endUs = esp_timer_get_time();
+    ( void ) xSemaphoreGive( imageWritten );
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void appTask( void * pParameters )
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    TickType_t lastWake;
+    int64_t startUs;
+    int64_t latencyUs;
+
+    ( void ) pParameters;
+
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+    lastWake = xTaskGetTickCount();
+
+    while( stopApp == false )
+    {
+        vTaskDelayUntil( &lastWake, pdMS_TO_TICKS( BENCHMARK_PUBLISH_PERIOD_MS ) );
+
+        startUs = esp_timer_get_time();
+        ( void ) xQueueSend( controlQueue, &self, portMAX_DELAY );
+        ( void ) xSemaphoreGive( agentWork );
+
+        /* The agent task runs until this task is done, so the notification
+         * always comes. */
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+        latencyUs = esp_timer_get_time() - startUs;
+
+        run.publishes++;
+        run.latencySumUs += latencyUs;
+
+        if( latencyUs > run.latencyMaxUs )
+        {
+            run.latencyMaxUs = latencyUs;
+        }
+    }
+
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool runProfile( TaskLayoutProfile_t profile )
+{
+    static const struct
+    {
+        TaskFunction_t taskCode;
+        const char * pName;
+        TaskLayoutRole_t role;
+    } tasks[ BENCHMARK_TASKS ] =
+    {
+        { networkTask, "BenchNetwork", TaskLayoutNetwork     },
+        { agentTask,   "BenchAgent",   TaskLayoutAgent       },
+        { otaTask,     "BenchOta",     TaskLayoutOta         },
+        { writerTask,  "BenchWriter",  TaskLayoutFlashWriter },
+        { appTask,     "BenchApp",     TaskLayoutApp         }
+    };
+    BenchmarkBlock_t * pBlocks = heap_caps_malloc( BENCHMARK_BUFFERS * sizeof( BenchmarkBlock_t ),
+                                                   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT );
+    BenchmarkBlock_t * pBlock;
+    TaskLayoutEntry_t entry;
+    uint32_t created = 0U;
+    bool status = ( pBlocks != NULL );
+    uint32_t i;
+
+    ( void ) memset( &run, 0x00, sizeof( run ) );
+    run.flashError = esp_partition_erase_range( pPartition, 0, BENCHMARK_IMAGE_SIZE );
+    stopApp = false;
+    stopAgent = false;
+    ( void ) xEventGroupClearBits( startEvent, BENCHMARK_START_BIT );
+
+    for( i = 0U; ( i < BENCHMARK_BUFFERS ) && ( status == true ); i++ )
+    {
+        pBlock = &pBlocks[ i ];
+        ( void ) xQueueSend( freeQueue, &pBlock, 0U );
+    }
+
+    for( i = 0U; ( i < BENCHMARK_TASKS ) && ( status == true ); i++ )
+    {
+        entry = TaskLayout_Get( profile, tasks[ i ].role );
+
+        if( xTaskCreatePinnedToCore( tasks[ i ].taskCode, tasks[ i ].pName, entry.stackSize, NULL,
+                                     entry.priority, NULL, entry.core ) == pdPASS )
+        {
+            created++;
+        }
+        else
+        {
+            status = false;
+        }
+    }
+
+    if( status == true )
+    {
+        run.startUs = esp_timer_get_time();
+        ( void ) xEventGroupSetBits( startEvent, BENCHMARK_START_BIT );
+
+        if( ( xSemaphoreTake( imageWritten, pdMS_TO_TICKS( BENCHMARK_RUN_TIMEOUT_MS ) ) == pdFALSE ) &&
+            ( run.flashError == ESP_OK ) )
+        {
+            run.flashError = ESP_ERR_TIMEOUT;
+        }
+    }
+
+    /* A task that failed to start leaves the others waiting for the start
+     * bit, so they are started anyway and stopped as soon as they can. */
+    ( void ) xEventGroupSetBits( startEvent, BENCHMARK_START_BIT );
+    stopApp = true;
+
+    if( pBlocks == NULL )
+    {
+        ESP_LOGE( TAG, "%s: no memory for %u blocks.", profileNames[ profile ], ( unsigned ) BENCHMARK_BUFFERS );
+    }
+    else if( created == BENCHMARK_TASKS )
+    {
+        /* Every task exits once the image is written and the others are
+         * stopped. The agent task outlives the application task, which
+         * waits for its last publish. */
+        for( i = 0U; i < ( BENCHMARK_TASKS - 1U ); i++ )
+        {
+            ( void ) xSemaphoreTake( doneSemaphore, portMAX_DELAY );
+        }
+
+        stopAgent = true;
+        ( void ) xSemaphoreTake( doneSemaphore, portMAX_DELAY );
+        ( void ) xQueueReset( freeQueue );
+        heap_caps_free( pBlocks );
+    }
+    else
+    {
+        /* Tasks that can't finish would use the blocks; leak them. */
+        ESP_LOGE( TAG, "%s: only %u of %u tasks created.", profileNames[ profile ],
+                  ( unsigned ) created, ( unsigned ) BENCHMARK_TASKS );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void TaskLayout_RunBenchmark( void )
+{
+    TaskLayoutProfile_t profile;
+    TaskLayoutEntry_t entry;
+    uint32_t role;
+
+    pPartition = esp_ota_get_next_update_partition( NULL );
+
+    if( pPartition == NULL )
+    {
+        ESP_LOGE( TAG, "No update partition to write to." );
+    }
+    else if( pPartition->size < BENCHMARK_IMAGE_SIZE )
+    {
+        ESP_LOGE( TAG, "The update partition is smaller than the %u byte test image.",
+                  ( unsigned ) BENCHMARK_IMAGE_SIZE );
+    }
+    else
+    {
+        freeQueue = xQueueCreate( BENCHMARK_BUFFERS, sizeof( BenchmarkBlock_t * ) );
+        bulkQueue = xQueueCreate( BENCHMARK_BUFFERS, sizeof( BenchmarkBlock_t * ) );
+        controlQueue = xQueueCreate( 1U, sizeof( TaskHandle_t ) );
+        otaQueue = xQueueCreate( BENCHMARK_BUFFERS, sizeof( BenchmarkBlock_t * ) );
+        writerQueue = xQueueCreate( BENCHMARK_BUFFERS, sizeof( BenchmarkBlock_t * ) );
+        agentWork = xSemaphoreCreateCounting( BENCHMARK_BUFFERS + 1U, 0U );
+        doneSemaphore = xSemaphoreCreateCounting( BENCHMARK_TASKS, 0U );
+        imageWritten = xSemaphoreCreateBinary();
+        startEvent = xEventGroupCreate();
+        configASSERT( ( freeQueue != NULL ) && ( bulkQueue != NULL ) && ( controlQueue != NULL ) &&
+                      ( otaQueue != NULL ) && ( writerQueue != NULL ) && ( agentWork != NULL ) &&
+                      ( doneSemaphore != NULL ) && ( imageWritten != NULL ) && ( startEvent != NULL ) );
+
+        ESP_LOGI( TAG, "Running on %d core(s): %u bytes in blocks of %u bytes to partition %s, "
+                  "a publish every %u ms.",
+                  portNUM_PROCESSORS, ( unsigned ) BENCHMARK_IMAGE_SIZE, ( unsigned ) BENCHMARK_BLOCK_SIZE,
+                  pPartition->label, ( unsigned ) BENCHMARK_PUBLISH_PERIOD_MS );
+
+        for( profile = TaskLayoutProfileDefault; profile < TaskLayoutProfileCount; profile++ )
+        {
+            if( ( ( profile == TaskLayoutProfileSplit ) && ( portNUM_PROCESSORS < 2 ) ) ||
+                ( ( profile == TaskLayoutProfileCustom ) && ( TASK_LAYOUT_PROFILE != TaskLayoutProfileCustom ) ) )
+            {
+                continue;
+            }
+
+            for( role = 0U; role < ( uint32_t ) TaskLayoutRoleCount; role++ )
+            {
+                entry = TaskLayout_Get( profile, ( TaskLayoutRole_t ) role );
+                ESP_LOGD( TAG, "%s: role %u on core %d at priority %u.", profileNames[ profile ],
+                          ( unsigned ) role, ( entry.core == tskNO_AFFINITY ) ? -1 : ( int ) entry.core,
+                          ( unsigned ) entry.priority );
+            }
+
+            if( runProfile( profile ) == false )
+            {
+                /* The tasks left may still use the queues, which are kept. */
+                ESP_LOGE( TAG, "Stopping the benchmark." );
+                break;
+            }
+            else if( run.flashError != ESP_OK )
+            {
+                ESP_LOGE( TAG, "%s: %s.", profileNames[ profile ], esp_err_to_name( run.flashError ) );
+            }
+            else
+            {
+                ESP_LOGI( TAG, "%s: OTA %u KB/s, publish latency average %u us, max %u us over %u publishes.",
+                          profileNames[ profile ],
+                          BENCHMARK_KBPS( BENCHMARK_IMAGE_SIZE, run.endUs - run.startUs ),
+                          ( unsigned ) ( ( run.publishes > 0U ) ? ( run.latencySumUs / run.publishes ) : 0 ),
+                          ( unsigned ) run.latencyMaxUs,
+                          ( unsigned ) run.publishes );
+            }
+        }
+
+        if( profile == TaskLayoutProfileCount )
+        {
+            vEventGroupDelete( startEvent );
+            vSemaphoreDelete( imageWritten );
+            vSemaphoreDelete( doneSemaphore );
+            vSemaphoreDelete( agentWork );
+            vQueueDelete( writerQueue );
+            vQueueDelete( otaQueue );
+            vQueueDelete( controlQueue );
+            vQueueDelete( bulkQueue );
+            vQueueDelete( freeQueue );
+        }
+    }
+}
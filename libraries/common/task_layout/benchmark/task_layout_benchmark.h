@@ -0,0 +1,43 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file task_layout_benchmark.h
+ * @brief OTA throughput and publish latency with the tasks of each task
+ * layout profile.
+ */
+
+#ifndef TASK_LAYOUT_BENCHMARK_H_
+#define TASK_LAYOUT_BENCHMARK_H_
+
+/**
+ * @brief Run a local model of an OTA download next to periodic publishes,
+ * once with the tasks of each profile, and log the OTA throughput and the
+ * publish latency of each.
+ *
+ * The update partition is erased, so this must not run while an OTA update
+ * is in progress.
+ */
+void TaskLayout_RunBenchmark( void );
+
+#endif /* ifndef TASK_LAYOUT_BENCHMARK_H_ */
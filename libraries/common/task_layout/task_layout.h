@@ -0,0 +1,227 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/**
+ * @file task_layout.h
+ * @brief The core, priority and stack of each kind of task, from one profile.
+ *
+ * Tasks are created for a role rather than with their own settings: the
+ * network tasks run TLS handshakes and the process loops of single-connection
+ * demos, the agent task owns a shared MQTT connection, and the OTA agent, the
+ * flash writer and the application tasks follow. The profile chosen in
+ * menuconfig gives the settings of every role, and the benchmark reads the
+ * other profiles to compare them.
+ */
+
+#ifndef TASK_LAYOUT_H_
+#define TASK_LAYOUT_H_
+
+/* Standard includes. */
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief The profile chosen in menuconfig, as a number the preprocessor can
+ * test. It matches #TaskLayoutProfile_t.
+ */
+#ifndef TASK_LAYOUT_PROFILE_ID
+    #if CONFIG_TASK_LAYOUT_PROFILE_SPLIT
+        #define TASK_LAYOUT_PROFILE_ID    1
+    #elif CONFIG_TASK_LAYOUT_PROFILE_SINGLE_CORE
+        #define TASK_LAYOUT_PROFILE_ID    2
+    #elif CONFIG_TASK_LAYOUT_PROFILE_CUSTOM
+        #define TASK_LAYOUT_PROFILE_ID    3
+    #else
+        #define TASK_LAYOUT_PROFILE_ID    0
+    #endif
+#endif
+
+/**
+ * @brief Whether the transport and the OTA PAL take the settings of their
+ * tasks from the profile. They keep their own in the default profile, and
+ * when this component isn't in the build.
+ */
+#define TASK_LAYOUT_ENABLED    ( TASK_LAYOUT_PROFILE_ID != 0 )
+
+/**
+ * @brief The profile chosen in menuconfig.
+ */
+#define TASK_LAYOUT_PROFILE    ( ( TaskLayoutProfile_t ) TASK_LAYOUT_PROFILE_ID )
+
+/**
+ * @brief Stack sizes of the roles, in bytes. The same in every profile.
+ */
+#ifndef TASK_LAYOUT_NETWORK_STACK_SIZE
+    #ifdef CONFIG_TASK_LAYOUT_NETWORK_STACK_SIZE
+        #define TASK_LAYOUT_NETWORK_STACK_SIZE         CONFIG_TASK_LAYOUT_NETWORK_STACK_SIZE
+        #define TASK_LAYOUT_AGENT_STACK_SIZE           CONFIG_TASK_LAYOUT_AGENT_STACK_SIZE
+        #define TASK_LAYOUT_OTA_STACK_SIZE             CONFIG_TASK_LAYOUT_OTA_STACK_SIZE
+        #define TASK_LAYOUT_FLASH_WRITER_STACK_SIZE    CONFIG_TASK_LAYOUT_FLASH_WRITER_STACK_SIZE
+        #define TASK_LAYOUT_APP_STACK_SIZE             CONFIG_TASK_LAYOUT_APP_STACK_SIZE
+    #else
+        #define TASK_LAYOUT_NETWORK_STACK_SIZE         8192
+        #define TASK_LAYOUT_AGENT_STACK_SIZE           6144
+        #define TASK_LAYOUT_OTA_STACK_SIZE             6144
+        #define TASK_LAYOUT_FLASH_WRITER_STACK_SIZE    3072
+        #define TASK_LAYOUT_APP_STACK_SIZE             4096
+    #endif
+#endif
+
+/**
+ * @brief The kinds of tasks.
+ */
+typedef enum TaskLayoutRole
+{
+    TaskLayoutNetwork,     /**< TLS handshakes and dedicated process loops. */
+    TaskLayoutAgent,       /**< The MQTT agent task. */
+    TaskLayoutOta,         /**< The OTA agent task. */
+    TaskLayoutFlashWriter, /**< The OTA PAL flash writer task. */
+    TaskLayoutApp,         /**< Services and workers of the demos. */
+    TaskLayoutRoleCount
+} TaskLayoutRole_t;
+
+/**
+ * @brief The profiles, in the order of the menuconfig choice.
+ */
+typedef enum TaskLayoutProfile
+{
+    TaskLayoutProfileDefault,
+    TaskLayoutProfileSplit,
+    TaskLayoutProfileSingleCore,
+    TaskLayoutProfileCustom,
+    TaskLayoutProfileCount
+} TaskLayoutProfile_t;
+
+/**
+ * @brief The settings of a task.
+ */
+typedef struct TaskLayoutEntry
+{
+    uint32_t stackSize;   /**< In bytes. */
+    UBaseType_t priority;
+    BaseType_t core;      /**< A core, or tskNO_AFFINITY. */
+} TaskLayoutEntry_t;
+
+/**
+ * @brief The settings of a role in a profile. A core the chip doesn't have is
+ * replaced by tskNO_AFFINITY, and the custom profile is the default one
+ * unless it was chosen in menuconfig.
+ */
+static inline TaskLayoutEntry_t TaskLayout_Get( TaskLayoutProfile_t profile,
+                                                TaskLayoutRole_t role )
+{
+    /* The agent is above the handshakes so that the keep-alives of one
+     * connection aren't held up by the handshake of another, and the flash
+     * writer above the OTA agent so the ring of blocks drains. */
+    static const struct
+    {
+        UBaseType_t priority;
+        BaseType_t splitCore;
+    } roles[ TaskLayoutRoleCount ] =
+    {
+        { 5U, 0 }, /* Network */
+        { 6U, 0 }, /* Agent */
+        { 4U, 1 }, /* OTA */
+        { 5U, 1 }, /* Flash writer */
+        { 3U, 1 }  /* Application */
+    };
+    static const uint32_t stackSizes[ TaskLayoutRoleCount ] =
+    {
+        TASK_LAYOUT_NETWORK_STACK_SIZE,
+        TASK_LAYOUT_AGENT_STACK_SIZE,
+        TASK_LAYOUT_OTA_STACK_SIZE,
+        TASK_LAYOUT_FLASH_WRITER_STACK_SIZE,
+        TASK_LAYOUT_APP_STACK_SIZE
+    };
+
+    #if CONFIG_TASK_LAYOUT_PROFILE_CUSTOM
+        static const TaskLayoutEntry_t custom[ TaskLayoutRoleCount ] =
+        {
+            { 0U, CONFIG_TASK_LAYOUT_CUSTOM_NETWORK_PRIORITY,      CONFIG_TASK_LAYOUT_CUSTOM_NETWORK_CORE      },
+            { 0U, CONFIG_TASK_LAYOUT_CUSTOM_AGENT_PRIORITY,        CONFIG_TASK_LAYOUT_CUSTOM_AGENT_CORE        },
+            { 0U, CONFIG_TASK_LAYOUT_CUSTOM_OTA_PRIORITY,          CONFIG_TASK_LAYOUT_CUSTOM_OTA_CORE          },
+            { 0U, CONFIG_TASK_LAYOUT_CUSTOM_FLASH_WRITER_PRIORITY, CONFIG_TASK_LAYOUT_CUSTOM_FLASH_WRITER_CORE },
+            { 0U, CONFIG_TASK_LAYOUT_CUSTOM_APP_PRIORITY,          CONFIG_TASK_LAYOUT_CUSTOM_APP_CORE          }
+        };
+    #endif
+    TaskLayoutEntry_t entry = { stackSizes[ role ], 5U, tskNO_AFFINITY };
+
+    configASSERT( role < TaskLayoutRoleCount );
+
+    switch( profile )
+    {
+        case TaskLayoutProfileSplit:
+            entry.priority = roles[ role ].priority;
+            entry.core = roles[ role ].splitCore;
+            break;
+
+        case TaskLayoutProfileSingleCore:
+            entry.priority = roles[ role ].priority;
+            entry.core = 0;
+            break;
+
+        #if CONFIG_TASK_LAYOUT_PROFILE_CUSTOM
+            case TaskLayoutProfileCustom:
+                entry.priority = custom[ role ].priority;
+                entry.core = ( custom[ role ].core < 0 ) ? tskNO_AFFINITY : custom[ role ].core;
+                break;
+        #endif
+
+        default:
+            break;
+    }
+
+    if( ( entry.core != tskNO_AFFINITY ) && ( entry.core >= portNUM_PROCESSORS ) )
+    {
+        entry.core = tskNO_AFFINITY;
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Creates a task with the settings of its role in the profile chosen
+ * in menuconfig.
+ *
+ * @return pdPASS, or the error of xTaskCreatePinnedToCore.
+ */
+static inline BaseType_t TaskLayout_CreateTask( TaskLayoutRole_t role,
+                                                TaskFunction_t taskCode,
+                                                const char * pName,
+                                                void * pParameters,
+                                                TaskHandle_t * pHandle )
+{
+    TaskLayoutEntry_t entry = TaskLayout_Get( TASK_LAYOUT_PROFILE, role );
+
+    return xTaskCreatePinnedToCore( taskCode, pName, entry.stackSize, pParameters,
+                                    entry.priority, pHandle, entry.core );
+}
+
+#endif /* ifndef TASK_LAYOUT_H_ */
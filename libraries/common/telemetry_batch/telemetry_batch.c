@@ -0,0 +1,383 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file telemetry_batch.c
+ * @brief Implementation of the telemetry batches.
+ *
+ * The buffer always holds the opening byte of the array followed by the
+ * samples, and one byte is kept free for the closing byte, which is only
+ * written when the batch is published. A sample is appended as it is, so a
+ * CBOR batch is never re-encoded.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* TinyCBOR library for CBOR encoding and decoding operations. */
+#include "cbor.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the telemetry batches. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Telemetry Batch"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "telemetry_batch.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The longest reading encoded by #TelemetryBatch_AddReading, a JSON
+ * array of a 20-digit timestamp and a 17-digit double with its exponent.
+ */
+#define READING_BUFFER_SIZE    ( 64U )
+
+/**
+ * @brief The bytes opening and closing a batch, and separating its samples.
+ */
+#define JSON_ARRAY_OPEN         ( ( uint8_t ) '[' )
+#define JSON_ARRAY_CLOSE        ( ( uint8_t ) ']' )
+#define JSON_SEPARATOR          ( ( uint8_t ) ',' )
+#define CBOR_ARRAY_OPEN         ( ( uint8_t ) 0x9FU ) /* Array of indefinite length. */
+#define CBOR_ARRAY_CLOSE        ( ( uint8_t ) 0xFFU ) /* Break. */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Empties a batch, leaving the opening byte of the array.
+ */
+static void resetBatch( TelemetryBatch_t * pBatch );
+
+/**
+ * @brief The bytes a sample takes in a batch, with its separator and the
+ * closing byte of the array.
+ */
+static size_t sampleSpace( const TelemetryBatch_t * pBatch,
+                           size_t sampleLength );
+
+/**
+ * @brief Encodes a reading in the format of a batch.
+ *
+ * @return The length of the reading, or 0 if it couldn't be encoded.
+ */
+static size_t encodeReading( TelemetryBatchFormat_t format,
+                             uint64_t timestampMs,
+                             double value,
+                             uint8_t * pBuffer,
+                             size_t bufferLength );
+
+/*-----------------------------------------------------------*/
+
+static void resetBatch( TelemetryBatch_t * pBatch )
+{
+    pBatch->config.pBuffer[ 0 ] = ( pBatch->config.format == TelemetryBatchCbor ) ?
+                                  CBOR_ARRAY_OPEN : JSON_ARRAY_OPEN;
+    pBatch->length = 1U;
+    pBatch->sampleCount = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t sampleSpace( const TelemetryBatch_t * pBatch,
+                           size_t sampleLength )
+{
+    size_t separatorLength = 0U;
+
+    /* CBOR items follow each other without a separator. */
+    if( ( pBatch->config.format == TelemetryBatchJson ) && ( pBatch->sampleCount > 0U ) )
+    {
+        separatorLength = 1U;
+    }
+
+    return separatorLength + sampleLength + 1U;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t encodeReading( TelemetryBatchFormat_t format,
+                             uint64_t timestampMs,
+                             double value,
+                             uint8_t * pBuffer,
+                             size_t bufferLength )
+{
+    size_t length = 0U;
+    int written = 0;
+    CborEncoder encoder;
+    CborEncoder reading;
+    CborError cborRet = CborNoError;
+
+    if( format == TelemetryBatchCbor )
+    {
+        cbor_encoder_init( &encoder, pBuffer, bufferLength, 0 );
+        cborRet = cbor_encoder_create_array( &encoder, &reading, 2 );
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_uint( &reading, timestampMs );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encode_double( &reading, value );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            cborRet = cbor_encoder_close_container( &encoder, &reading );
+        }
+
+        if( cborRet == CborNoError )
+        {
+            length = cbor_encoder_get_buffer_size( &encoder, pBuffer );
+        }
+        else
+        {
+            LogError( ( "Failed to encode a reading: %s.", cbor_error_string( cborRet ) ) );
+        }
+    }
+    else
+    {
+        written = snprintf( ( char * ) pBuffer, bufferLength, "[%" PRIu64 ",%.17g]",
+                            timestampMs, value );
+
+        if( ( written > 0 ) && ( ( size_t ) written < bufferLength ) )
+        {
+            length = ( size_t ) written;
+        }
+        else
+        {
+            LogError( ( "Failed to encode a reading." ) );
+        }
+    }
+
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+bool TelemetryBatch_Init( TelemetryBatch_t * pBatch,
+                          const TelemetryBatchConfig_t * pConfig )
+{
+    bool status = true;
+
+    assert( pBatch != NULL );
+    assert( pConfig != NULL );
+
+    if( ( pConfig->pTopic == NULL ) || ( pConfig->topicLength == 0U ) ||
+        ( pConfig->pBuffer == NULL ) || ( pConfig->publish == NULL ) )
+    {
+        LogError( ( "A telemetry batch needs a topic, a buffer and a publish callback." ) );
+        status = false;
+    }
+    else if( pConfig->bufferLength < 3U )
+    {
+        /* The array must hold at least a one-byte sample. */
+        LogError( ( "A telemetry batch buffer of %u bytes is too small.",
+                    ( unsigned ) pConfig->bufferLength ) );
+        status = false;
+    }
+    else
+    {
+        pBatch->config = *pConfig;
+        pBatch->firstSampleMs = 0U;
+        resetBatch( pBatch );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool TelemetryBatch_Add( TelemetryBatch_t * pBatch,
+                         const uint8_t * pSample,
+                         size_t sampleLength,
+                         uint32_t nowMs )
+{
+    bool status = true;
+
+    assert( pBatch != NULL );
+    assert( ( pSample != NULL ) && ( sampleLength > 0U ) );
+
+    /* Measured as the first sample, which has no separator. */
+    if( ( 1U + sampleLength + 1U ) > pBatch->config.bufferLength )
+    {
+        LogError( ( "A sample of %u bytes doesn't fit in a batch of %u bytes for %.*s.",
+                    ( unsigned ) sampleLength,
+                    ( unsigned ) pBatch->config.bufferLength,
+                    pBatch->config.topicLength,
+                    pBatch->config.pTopic ) );
+        status = false;
+    }
+    else if( ( pBatch->length + sampleSpace( pBatch, sampleLength ) ) > pBatch->config.bufferLength )
+    {
+        status = TelemetryBatch_Flush( pBatch );
+    }
+    else
+    {
+        /* Room for the sample. */
+    }
+
+    if( status == true )
+    {
+        if( ( pBatch->config.format == TelemetryBatchJson ) && ( pBatch->sampleCount > 0U ) )
+        {
+            pBatch->config.pBuffer[ pBatch->length ] = JSON_SEPARATOR;
+            pBatch->length++;
+        }
+
+        ( void ) memcpy( &( pBatch->config.pBuffer[ pBatch->length ] ), pSample, sampleLength );
+        pBatch->length += sampleLength;
+
+        if( pBatch->sampleCount == 0U )
+        {
+            pBatch->firstSampleMs = nowMs;
+        }
+
+        pBatch->sampleCount++;
+
+        if( ( pBatch->config.flushBytes > 0U ) &&
+            ( ( pBatch->length + 1U ) >= pBatch->config.flushBytes ) )
+        {
+            status = TelemetryBatch_Flush( pBatch );
+        }
+        else
+        {
+            status = TelemetryBatch_Process( pBatch, nowMs );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool TelemetryBatch_AddReading( TelemetryBatch_t * pBatch,
+                                uint64_t timestampMs,
+                                double value,
+                                uint32_t nowMs )
+{
+    bool status = false;
+    uint8_t reading[ READING_BUFFER_SIZE ];
+    size_t readingLength = 0U;
+
+    assert( pBatch != NULL );
+
+    readingLength = encodeReading( pBatch->config.format, timestampMs, value,
+                                   reading, sizeof( reading ) );
+
+    if( readingLength > 0U )
+    {
+        status = TelemetryBatch_Add( pBatch, reading, readingLength, nowMs );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool TelemetryBatch_Process( TelemetryBatch_t * pBatch,
+                             uint32_t nowMs )
+{
+    bool status = true;
+
+    assert( pBatch != NULL );
+
+    if( TelemetryBatch_TimeToDeadline( pBatch, nowMs ) == 0U )
+    {
+        status = TelemetryBatch_Flush( pBatch );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t TelemetryBatch_TimeToDeadline( const TelemetryBatch_t * pBatch,
+                                        uint32_t nowMs )
+{
+    uint32_t remainingMs = UINT32_MAX;
+    uint32_t ageMs = 0U;
+
+    assert( pBatch != NULL );
+
+    if( ( pBatch->sampleCount > 0U ) && ( pBatch->config.maxAgeMs > 0U ) )
+    {
+        /* Unsigned difference, so the age survives a wrap of the clock. */
+        ageMs = nowMs - pBatch->firstSampleMs;
+        remainingMs = ( ageMs < pBatch->config.maxAgeMs ) ? ( pBatch->config.maxAgeMs - ageMs ) : 0U;
+    }
+
+    return remainingMs;
+}
+
+/*-----------------------------------------------------------*/
+
+bool TelemetryBatch_Flush( TelemetryBatch_t * pBatch )
+{
+    bool status = true;
+
+    assert( pBatch != NULL );
+
+    if( pBatch->sampleCount > 0U )
+    {
+        pBatch->config.pBuffer[ pBatch->length ] = ( pBatch->config.format == TelemetryBatchCbor ) ?
+                                                   CBOR_ARRAY_CLOSE : JSON_ARRAY_CLOSE;
+
+        status = pBatch->config.publish( pBatch->config.pTopic,
+                                         pBatch->config.topicLength,
+                                         pBatch->config.pBuffer,
+                                         pBatch->length + 1U,
+                                         pBatch->config.qos,
+                                         pBatch->config.pPublishContext );
+
+        if( status == true )
+        {
+            LogDebug( ( "Published %u samples in %u bytes to %.*s.",
+                        ( unsigned ) pBatch->sampleCount,
+                        ( unsigned ) ( pBatch->length + 1U ),
+                        pBatch->config.topicLength,
+                        pBatch->config.pTopic ) );
+            resetBatch( pBatch );
+        }
+        else
+        {
+            LogError( ( "Failed to publish %u samples to %.*s.",
+                        ( unsigned ) pBatch->sampleCount,
+                        pBatch->config.topicLength,
+                        pBatch->config.pTopic ) );
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,194 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file telemetry_batch.h
+ * @brief Collect small telemetry samples for a topic and publish them as one
+ * message.
+ *
+ * Every sample published on its own costs a fixed header, the topic name and
+ * a TLS record. A batch appends the samples for one topic to a buffer, as a
+ * JSON array or an indefinite-length CBOR array, and publishes the buffer
+ * when it reaches a size, when its oldest sample reaches an age, or when it
+ * is flushed. The publish itself is left to a callback, such as the
+ * PublishToTopic of the demo helpers.
+ *
+ * The functions are not thread safe and are called from the task that owns
+ * the MQTT context.
+ */
+
+#ifndef TELEMETRY_BATCH_H_
+#define TELEMETRY_BATCH_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include MQTT library. */
+#include "core_mqtt.h"
+
+/**
+ * @brief The encoding of a batch, and of the samples added to it.
+ */
+typedef enum TelemetryBatchFormat
+{
+    TelemetryBatchJson, /**< A JSON array of JSON values. */
+    TelemetryBatchCbor  /**< An indefinite-length CBOR array of CBOR items. */
+} TelemetryBatchFormat_t;
+
+/**
+ * @brief Publishes a batch.
+ *
+ * The payload is reused for the next batch once the callback returns, so a
+ * QoS 1 publish that keeps pointing at it until its PUBACK, as the demo
+ * helpers do with more than one publish in flight, must copy it first.
+ *
+ * @return false if the batch wasn't published, in which case it is kept and
+ * published again on the next flush.
+ */
+typedef bool (* TelemetryBatchPublish_t )( const char * pTopic,
+                                           uint16_t topicLength,
+                                           const uint8_t * pPayload,
+                                           size_t payloadLength,
+                                           MQTTQoS_t qos,
+                                           void * pContext );
+
+/**
+ * @brief Where and when the samples of a topic are published.
+ */
+typedef struct TelemetryBatchConfig
+{
+    const char * pTopic;
+    uint16_t topicLength;
+
+    /* Holds the batch being collected. Its size bounds the payload. */
+    uint8_t * pBuffer;
+    size_t bufferLength;
+
+    TelemetryBatchFormat_t format;
+    MQTTQoS_t qos;
+
+    /* Publish once the payload is this long. 0 publishes when the next
+     * sample doesn't fit. */
+    size_t flushBytes;
+
+    /* Publish once the oldest sample waited this long. 0 publishes only on
+     * size or flush. */
+    uint32_t maxAgeMs;
+
+    TelemetryBatchPublish_t publish;
+    void * pPublishContext;
+} TelemetryBatchConfig_t;
+
+/**
+ * @brief A batch being collected.
+ *
+ * The fields are private to this module.
+ */
+typedef struct TelemetryBatch
+{
+    TelemetryBatchConfig_t config;
+
+    /* Bytes in the buffer, without the byte closing the array. */
+    size_t length;
+    size_t sampleCount;
+
+    /* When the oldest sample was added. */
+    uint32_t firstSampleMs;
+} TelemetryBatch_t;
+
+/**
+ * @brief Starts an empty batch.
+ *
+ * @param[out] pBatch The batch.
+ * @param[in] pConfig Its topic, buffer and thresholds. The topic and buffer
+ * must outlive the batch.
+ *
+ * @return false if the configuration has no topic, buffer or publish
+ * callback, or if the buffer is too small for a sample.
+ */
+bool TelemetryBatch_Init( TelemetryBatch_t * pBatch,
+                          const TelemetryBatchConfig_t * pConfig );
+
+/**
+ * @brief Adds an encoded sample, publishing the batch first if the sample
+ * doesn't fit and afterwards if a threshold is reached.
+ *
+ * @param[in] pBatch The batch.
+ * @param[in] pSample A JSON value, or a single CBOR item, in the format of the
+ * batch.
+ * @param[in] sampleLength The length of @a pSample.
+ * @param[in] nowMs The current time in milliseconds, for the age threshold.
+ *
+ * @return false if the sample can't fit in an empty batch, or if a publish
+ * failed. The sample is dropped unless it was added before the publish.
+ */
+bool TelemetryBatch_Add( TelemetryBatch_t * pBatch,
+                         const uint8_t * pSample,
+                         size_t sampleLength,
+                         uint32_t nowMs );
+
+/**
+ * @brief Adds a reading as a [ timestamp, value ] array encoded in the format
+ * of the batch. See #TelemetryBatch_Add.
+ *
+ * @param[in] pBatch The batch.
+ * @param[in] timestampMs The time of the reading, in the units the consumer
+ * of the topic expects.
+ * @param[in] value The value read.
+ * @param[in] nowMs The current time in milliseconds, for the age threshold.
+ */
+bool TelemetryBatch_AddReading( TelemetryBatch_t * pBatch,
+                                uint64_t timestampMs,
+                                double value,
+                                uint32_t nowMs );
+
+/**
+ * @brief Publishes the batch if its oldest sample reached the age threshold.
+ * Call from the loop that runs the MQTT process loop.
+ *
+ * @return false if a publish failed.
+ */
+bool TelemetryBatch_Process( TelemetryBatch_t * pBatch,
+                             uint32_t nowMs );
+
+/**
+ * @brief How long until the age threshold publishes the batch, to bound
+ * the time the caller waits for incoming packets.
+ *
+ * @return The milliseconds left, 0 if the batch is due, or UINT32_MAX if the
+ * batch is empty or has no age threshold.
+ */
+uint32_t TelemetryBatch_TimeToDeadline( const TelemetryBatch_t * pBatch,
+                                        uint32_t nowMs );
+
+/**
+ * @brief Publishes the samples collected so far, such as before going to
+ * sleep. Does nothing for an empty batch.
+ *
+ * @return false if the publish failed.
+ */
+bool TelemetryBatch_Flush( TelemetryBatch_t * pBatch );
+
+#endif /* ifndef TELEMETRY_BATCH_H_ */
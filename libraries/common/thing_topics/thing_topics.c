@@ -0,0 +1,327 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file thing_topics.c
+ * @brief Implementation of the topic table of a thing.
+ *
+ * The suffixes of the topics are string literals with their lengths taken at
+ * compile time. The hash seed is searched for once, when the table is built:
+ * with 22 topics in 128 slots, about one seed in six leaves no two topics in
+ * the same slot.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "thing_topics.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The part of every topic before the thing name.
+ */
+#define THING_PREFIX             "$aws/things/"
+#define THING_PREFIX_LENGTH      ( sizeof( THING_PREFIX ) - 1U )
+
+/**
+ * @brief What comes between the thing name and the suffix of the shadow
+ * topics, for the classic shadow and around the name of a named shadow.
+ */
+#define CLASSIC_SHADOW           "/shadow/"
+#define CLASSIC_SHADOW_LENGTH    ( sizeof( CLASSIC_SHADOW ) - 1U )
+#define NAMED_SHADOW             "/shadow/name/"
+#define NAMED_SHADOW_LENGTH      ( sizeof( NAMED_SHADOW ) - 1U )
+
+/**
+ * @brief What comes between the thing name and the suffix of the jobs topics.
+ */
+#define JOBS                     "/jobs/"
+#define JOBS_LENGTH              ( sizeof( JOBS ) - 1U )
+
+/**
+ * @brief The most seeds tried before giving up on a perfect hash.
+ */
+#define MAX_SEEDS                ( 4096U )
+
+/**
+ * @brief The suffix of a topic and whether it is a shadow topic.
+ */
+#define SHADOW_SUFFIX( suffix )    { suffix, sizeof( suffix ) - 1U, true }
+#define JOBS_SUFFIX( suffix )      { suffix, sizeof( suffix ) - 1U, false }
+
+typedef struct TopicSuffix
+{
+    const char * pSuffix;
+    uint16_t length;
+    bool isShadow;
+} TopicSuffix_t;
+
+/**
+ * @brief The suffix of each topic, in the order of #ThingTopic_t.
+ */
+static const TopicSuffix_t suffixes[ ThingTopicCount ] =
+{
+    SHADOW_SUFFIX( "update" ),
+    SHADOW_SUFFIX( "update/accepted" ),
+    SHADOW_SUFFIX( "update/rejected" ),
+    SHADOW_SUFFIX( "update/delta" ),
+    SHADOW_SUFFIX( "update/documents" ),
+    SHADOW_SUFFIX( "get" ),
+    SHADOW_SUFFIX( "get/accepted" ),
+    SHADOW_SUFFIX( "get/rejected" ),
+    SHADOW_SUFFIX( "delete" ),
+    SHADOW_SUFFIX( "delete/accepted" ),
+    SHADOW_SUFFIX( "delete/rejected" ),
+    JOBS_SUFFIX( "notify" ),
+    JOBS_SUFFIX( "notify-next" ),
+    JOBS_SUFFIX( "get" ),
+    JOBS_SUFFIX( "get/accepted" ),
+    JOBS_SUFFIX( "get/rejected" ),
+    JOBS_SUFFIX( "start-next" ),
+    JOBS_SUFFIX( "start-next/accepted" ),
+    JOBS_SUFFIX( "start-next/rejected" ),
+    JOBS_SUFFIX( "$next/get" ),
+    JOBS_SUFFIX( "$next/get/accepted" ),
+    JOBS_SUFFIX( "$next/get/rejected" )
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief FNV-1a of @a length bytes mixed with @a seed, reduced to a slot.
+ */
+static size_t hashSlot( uint32_t seed,
+                        const char * pData,
+                        size_t length );
+
+/**
+ * @brief Appends @a length bytes to the topic being built at @a pOffset.
+ *
+ * @return false if they don't fit, leaving room for the terminator.
+ */
+static bool append( ThingTopics_t * pTopics,
+                    size_t * pOffset,
+                    const char * pData,
+                    size_t length );
+
+/**
+ * @brief Fills the slots of the hash with @a seed.
+ *
+ * @return false if two topics land in the same slot.
+ */
+static bool tryHashSeed( ThingTopics_t * pTopics,
+                         uint32_t seed );
+
+/*-----------------------------------------------------------*/
+
+static size_t hashSlot( uint32_t seed,
+                        const char * pData,
+                        size_t length )
+{
+    uint32_t hash = 2166136261U ^ seed;
+    size_t i;
+
+    for( i = 0; i < length; i++ )
+    {
+        hash ^= ( uint8_t ) pData[ i ];
+        hash *= 16777619U;
+    }
+
+    /* Fold the high bits in, the low bits of FNV alone mix poorly. */
+    return ( size_t ) ( ( hash ^ ( hash >> 15 ) ) & ( THING_TOPICS_HASH_SLOTS - 1U ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool append( ThingTopics_t * pTopics,
+                    size_t * pOffset,
+                    const char * pData,
+                    size_t length )
+{
+    bool status = ( *pOffset + length ) < sizeof( pTopics->buffer );
+
+    if( status == true )
+    {
+        ( void ) memcpy( &pTopics->buffer[ *pOffset ], pData, length );
+        *pOffset += length;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool tryHashSeed( ThingTopics_t * pTopics,
+                         uint32_t seed )
+{
+    bool status = true;
+    size_t slot;
+    size_t i;
+
+    ( void ) memset( pTopics->slots, 0x00, sizeof( pTopics->slots ) );
+
+    for( i = 0; ( i < ThingTopicCount ) && ( status == true ); i++ )
+    {
+        slot = hashSlot( seed,
+                         &pTopics->buffer[ pTopics->offsets[ i ] + pTopics->prefixLength ],
+                         pTopics->lengths[ i ] - pTopics->prefixLength );
+
+        if( pTopics->slots[ slot ] != 0U )
+        {
+            status = false;
+        }
+        else
+        {
+            pTopics->slots[ slot ] = ( uint8_t ) ( i + 1U );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ThingTopics_Init( ThingTopics_t * pTopics,
+                       const char * pThingName,
+                       size_t thingNameLength,
+                       const char * pShadowName,
+                       size_t shadowNameLength )
+{
+    bool status = true;
+    size_t offset = 0U;
+    size_t start = 0U;
+    uint32_t seed = 0U;
+    size_t i;
+
+    assert( pTopics != NULL );
+    assert( pThingName != NULL );
+
+    ( void ) memset( pTopics, 0x00, sizeof( *pTopics ) );
+    pTopics->prefixLength = ( uint16_t ) ( THING_PREFIX_LENGTH + thingNameLength + 1U );
+
+    for( i = 0; ( i < ThingTopicCount ) && ( status == true ); i++ )
+    {
+        start = offset;
+
+        status = append( pTopics, &offset, THING_PREFIX, THING_PREFIX_LENGTH ) &&
+                 append( pTopics, &offset, pThingName, thingNameLength );
+
+        if( status == false )
+        {
+            /* The thing name doesn't fit. */
+        }
+        else if( suffixes[ i ].isShadow == false )
+        {
+            status = append( pTopics, &offset, JOBS, JOBS_LENGTH );
+        }
+        else if( pShadowName == NULL )
+        {
+            status = append( pTopics, &offset, CLASSIC_SHADOW, CLASSIC_SHADOW_LENGTH );
+        }
+        else
+        {
+            status = append( pTopics, &offset, NAMED_SHADOW, NAMED_SHADOW_LENGTH ) &&
+                     append( pTopics, &offset, pShadowName, shadowNameLength ) &&
+                     append( pTopics, &offset, "/", 1U );
+        }
+
+        status = status && append( pTopics, &offset, suffixes[ i ].pSuffix, suffixes[ i ].length );
+
+        if( status == true )
+        {
+            pTopics->buffer[ offset ] = '\0';
+            pTopics->offsets[ i ] = ( uint16_t ) start;
+            pTopics->lengths[ i ] = ( uint16_t ) ( offset - start );
+            offset++;
+        }
+    }
+
+    while( ( status == true ) && ( tryHashSeed( pTopics, seed ) == false ) )
+    {
+        seed++;
+
+        /* Practically unreachable, as most seeds work. */
+        status = ( seed < MAX_SEEDS );
+    }
+
+    pTopics->seed = seed;
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * ThingTopics_Get( const ThingTopics_t * pTopics,
+                              ThingTopic_t topic,
+                              uint16_t * pLength )
+{
+    assert( pTopics != NULL );
+    assert( topic < ThingTopicCount );
+
+    if( pLength != NULL )
+    {
+        *pLength = pTopics->lengths[ topic ];
+    }
+
+    return &pTopics->buffer[ pTopics->offsets[ topic ] ];
+}
+
+/*-----------------------------------------------------------*/
+
+ThingTopic_t ThingTopics_Classify( const ThingTopics_t * pTopics,
+                                   const char * pTopic,
+                                   uint16_t topicLength )
+{
+    ThingTopic_t topic = ThingTopicNone;
+    size_t prefixLength;
+    size_t slot;
+    uint8_t entry = 0U;
+
+    assert( pTopics != NULL );
+    assert( pTopic != NULL );
+
+    prefixLength = pTopics->prefixLength;
+
+    /* Every topic of the table starts with the prefix of the first one. */
+    if( ( topicLength > prefixLength ) &&
+        ( memcmp( pTopic, pTopics->buffer, prefixLength ) == 0 ) )
+    {
+        slot = hashSlot( pTopics->seed, &pTopic[ prefixLength ], topicLength - prefixLength );
+        entry = pTopics->slots[ slot ];
+    }
+
+    /* The hash is only perfect for the topics of the table, so check the one
+     * in the slot. */
+    if( ( entry != 0U ) &&
+        ( pTopics->lengths[ entry - 1U ] == topicLength ) &&
+        ( memcmp( &pTopic[ prefixLength ],
+                  &pTopics->buffer[ pTopics->offsets[ entry - 1U ] + prefixLength ],
+                  topicLength - prefixLength ) == 0 ) )
+    {
+        topic = ( ThingTopic_t ) ( entry - 1U );
+    }
+
+    return topic;
+}
@@ -0,0 +1,159 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file thing_topics.h
+ * @brief The Device Shadow and Jobs topics of a thing, built once.
+ *
+ * #ThingTopics_Init builds every topic of the table into one buffer as soon
+ * as the thing name is known, at start-up or once fleet provisioning has
+ * named the device, and keeps the length of each. Publishing and subscribing
+ * then use the prebuilt strings instead of formatting them.
+ *
+ * Incoming topics are classified with a perfect hash of the part after
+ * `$aws/things/<thingName>/`, searched for when the table is built. Checking
+ * the common prefix, hashing the rest and comparing it with the one topic in
+ * its slot replaces matching the topic against every filter in turn.
+ */
+
+#ifndef THING_TOPICS_H_
+#define THING_TOPICS_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Size of the buffer the topics of a thing are built into.
+ */
+#ifndef THING_TOPICS_BUFFER_SIZE
+    #define THING_TOPICS_BUFFER_SIZE    CONFIG_THING_TOPICS_BUFFER_SIZE
+#endif
+
+/**
+ * @brief Slots of the perfect hash, a power of two.
+ */
+#define THING_TOPICS_HASH_SLOTS    ( 128U )
+
+/**
+ * @brief The topics of the table.
+ */
+typedef enum ThingTopic
+{
+    ThingTopicShadowUpdate = 0,
+    ThingTopicShadowUpdateAccepted,
+    ThingTopicShadowUpdateRejected,
+    ThingTopicShadowUpdateDelta,
+    ThingTopicShadowUpdateDocuments,
+    ThingTopicShadowGet,
+    ThingTopicShadowGetAccepted,
+    ThingTopicShadowGetRejected,
+    ThingTopicShadowDelete,
+    ThingTopicShadowDeleteAccepted,
+    ThingTopicShadowDeleteRejected,
+    ThingTopicJobsNotify,
+    ThingTopicJobsNotifyNext,
+    ThingTopicJobsGet,
+    ThingTopicJobsGetAccepted,
+    ThingTopicJobsGetRejected,
+    ThingTopicJobsStartNext,
+    ThingTopicJobsStartNextAccepted,
+    ThingTopicJobsStartNextRejected,
+    ThingTopicJobsNextGet,
+    ThingTopicJobsNextGetAccepted,
+    ThingTopicJobsNextGetRejected,
+    ThingTopicCount,                 /**< The number of topics. */
+    ThingTopicNone = ThingTopicCount /**< Not a topic of the table. */
+} ThingTopic_t;
+
+/**
+ * @brief The topics of a thing.
+ *
+ * The fields are private to this module.
+ */
+typedef struct ThingTopics
+{
+    /* Every topic, NUL-terminated, starting with `$aws/things/<thingName>/`. */
+    char buffer[ THING_TOPICS_BUFFER_SIZE ];
+    uint16_t offsets[ ThingTopicCount ];
+    uint16_t lengths[ ThingTopicCount ];
+
+    /* Length of `$aws/things/<thingName>/`. */
+    uint16_t prefixLength;
+
+    /* Seed of the perfect hash, and the topic in each slot plus one, or 0. */
+    uint32_t seed;
+    uint8_t slots[ THING_TOPICS_HASH_SLOTS ];
+} ThingTopics_t;
+
+/**
+ * @brief Builds the topics of a thing and the hash that classifies them.
+ *
+ * @param[out] pTopics The table to build.
+ * @param[in] pThingName The thing name, without a terminator.
+ * @param[in] thingNameLength The length of @a pThingName.
+ * @param[in] pShadowName The name of the shadow the shadow topics are for, or
+ * NULL for the classic shadow.
+ * @param[in] shadowNameLength The length of @a pShadowName.
+ *
+ * @return false if the topics don't fit in #THING_TOPICS_BUFFER_SIZE bytes.
+ */
+bool ThingTopics_Init( ThingTopics_t * pTopics,
+                       const char * pThingName,
+                       size_t thingNameLength,
+                       const char * pShadowName,
+                       size_t shadowNameLength );
+
+/**
+ * @brief A topic of the table.
+ *
+ * @param[in] pTopics A table built by #ThingTopics_Init.
+ * @param[in] topic The topic, not #ThingTopicNone.
+ * @param[out] pLength The length of the topic, without the terminator. Can
+ * be NULL.
+ *
+ * @return The NUL-terminated topic, valid as long as the table.
+ */
+const char * ThingTopics_Get( const ThingTopics_t * pTopics,
+                              ThingTopic_t topic,
+                              uint16_t * pLength );
+
+/**
+ * @brief Finds which topic of the table an incoming topic is.
+ *
+ * @param[in] pTopics A table built by #ThingTopics_Init.
+ * @param[in] pTopic The topic of an incoming PUBLISH, not NUL-terminated.
+ * @param[in] topicLength The length of @a pTopic.
+ *
+ * @return The topic, or #ThingTopicNone if it isn't in the table, which
+ * includes the topics of other things and of a single job.
+ */
+ThingTopic_t ThingTopics_Classify( const ThingTopics_t * pTopics,
+                                   const char * pTopic,
+                                   uint16_t topicLength );
+
+#endif /* ifndef THING_TOPICS_H_ */
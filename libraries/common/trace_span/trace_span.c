@@ -0,0 +1,254 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file trace_span.c
+ * @brief Implementation of the trace span ring.
+ *
+ * Each slot has a sequence number, odd while a span is written into it and
+ * even once it is complete: 2 * ( n + 1 ) for the n-th span recorded. A
+ * reader knows the number the slot of each of the latest spans must have,
+ * and takes a copy only if the slot has it both before and after copying.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the trace spans. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Trace Span"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "trace_span.h"
+
+#if ( ( TRACE_SPAN_RECORDS & ( TRACE_SPAN_RECORDS - 1 ) ) != 0 )
+    #error "TRACE_SPAN_RECORDS must be a power of two."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The longest JSON event of a span, for a name of up to 64 characters.
+ */
+#define JSON_EVENT_MAX_LENGTH    160U
+
+/**
+ * @brief A slot of the ring.
+ */
+typedef struct TraceSpanSlot
+{
+    uint32_t sequence;
+    TraceSpanRecord_t record;
+} TraceSpanSlot_t;
+
+/**
+ * @brief The latest spans recorded.
+ */
+static TraceSpanSlot_t slots[ TRACE_SPAN_RECORDS ];
+
+/**
+ * @brief The number of spans recorded, whose low bits are the next slot.
+ */
+static uint32_t spanCount = 0U;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copies the @a n-th span recorded.
+ *
+ * @return false if the slot holds another span, or is being written.
+ */
+static bool readSpan( uint32_t n,
+                      TraceSpanRecord_t * pRecord );
+
+/*-----------------------------------------------------------*/
+
+static bool readSpan( uint32_t n,
+                      TraceSpanRecord_t * pRecord )
+{
+    TraceSpanSlot_t * pSlot = &slots[ n & ( TRACE_SPAN_RECORDS - 1U ) ];
+    uint32_t expected = 2U * ( n + 1U );
+    bool read = false;
+
+    if( __atomic_load_n( &pSlot->sequence, __ATOMIC_ACQUIRE ) == expected )
+    {
+        ( void ) memcpy( pRecord, &pSlot->record, sizeof( *pRecord ) );
+
+        /* The copy must be done before the sequence is checked again. */
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        read = ( __atomic_load_n( &pSlot->sequence, __ATOMIC_RELAXED ) == expected );
+    }
+
+    return read;
+}
+
+/*-----------------------------------------------------------*/
+
+TraceSpan_t TraceSpan_Begin( const char * pName )
+{
+    TraceSpan_t span;
+
+    span.pName = pName;
+    span.portId = TraceSpan_PortBegin( pName );
+    span.startUs = Clock_GetTimeUs();
+
+    return span;
+}
+
+/*-----------------------------------------------------------*/
+
+void TraceSpan_End( TraceSpan_t * pSpan )
+{
+    uint64_t endUs = Clock_GetTimeUs();
+    uint32_t n = 0U;
+    uint32_t threadId = 0U;
+    uint16_t core = 0U;
+    TraceSpanSlot_t * pSlot = NULL;
+
+    assert( pSpan != NULL );
+
+    TraceSpan_PortEnd( pSpan->portId );
+    threadId = TraceSpan_PortThread( &core );
+
+    n = __atomic_fetch_add( &spanCount, 1U, __ATOMIC_RELAXED );
+    pSlot = &slots[ n & ( TRACE_SPAN_RECORDS - 1U ) ];
+
+    __atomic_store_n( &pSlot->sequence, ( 2U * n ) + 1U, __ATOMIC_RELAXED );
+
+    /* Readers must see the odd sequence before any of the new record. */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    pSlot->record.pName = pSpan->pName;
+    pSlot->record.startUs = pSpan->startUs;
+    pSlot->record.durationUs = ( uint32_t ) ( endUs - pSpan->startUs );
+    pSlot->record.threadId = threadId;
+    pSlot->record.core = core;
+
+    __atomic_store_n( &pSlot->sequence, 2U * ( n + 1U ), __ATOMIC_RELEASE );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t TraceSpan_Read( TraceSpanRecord_t * pRecords,
+                       size_t maxRecords )
+{
+    uint32_t end = __atomic_load_n( &spanCount, __ATOMIC_ACQUIRE );
+    uint32_t n = 0U;
+    size_t count = 0U;
+
+    assert( ( pRecords != NULL ) || ( maxRecords == 0U ) );
+
+    if( maxRecords > TRACE_SPAN_RECORDS )
+    {
+        maxRecords = TRACE_SPAN_RECORDS;
+    }
+
+    /* Start from the oldest span that can still be in the ring. */
+    n = ( end > maxRecords ) ? ( end - ( uint32_t ) maxRecords ) : 0U;
+
+    for( ; n != end; n++ )
+    {
+        if( readSpan( n, &pRecords[ count ] ) == true )
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/*-----------------------------------------------------------*/
+
+void TraceSpan_Dump( void )
+{
+    uint32_t end = __atomic_load_n( &spanCount, __ATOMIC_ACQUIRE );
+    uint32_t n = ( end > TRACE_SPAN_RECORDS ) ? ( end - TRACE_SPAN_RECORDS ) : 0U;
+    TraceSpanRecord_t record;
+
+    LogInfo( ( "Latest spans of %u recorded:", ( unsigned ) end ) );
+
+    for( ; n != end; n++ )
+    {
+        if( readSpan( n, &record ) == true )
+        {
+            LogInfo( ( "%s: start %llu us, %u us, core %u, thread 0x%08x.", record.pName,
+                       ( unsigned long long ) record.startUs, ( unsigned ) record.durationUs,
+                       ( unsigned ) record.core, ( unsigned ) record.threadId ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t TraceSpan_ExportJson( TraceSpanWriter_t writer,
+                             void * pContext )
+{
+    static const char header[] = "{\"traceEvents\":[";
+    static const char footer[] = "\n]}\n";
+    uint32_t end = __atomic_load_n( &spanCount, __ATOMIC_ACQUIRE );
+    uint32_t n = ( end > TRACE_SPAN_RECORDS ) ? ( end - TRACE_SPAN_RECORDS ) : 0U;
+    TraceSpanRecord_t record;
+    char event[ JSON_EVENT_MAX_LENGTH ];
+    int length = 0;
+    size_t count = 0U;
+
+    assert( writer != NULL );
+
+    writer( header, sizeof( header ) - 1U, pContext );
+
+    for( ; n != end; n++ )
+    {
+        if( readSpan( n, &record ) == true )
+        {
+            /* A complete event, with the names written as they are. */
+            length = snprintf( event, sizeof( event ),
+                               "%s\n{\"name\":\"%.64s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,\"pid\":%u,\"tid\":%u}",
+                               ( count > 0U ) ? "," : "", record.pName,
+                               ( unsigned long long ) record.startUs, ( unsigned ) record.durationUs,
+                               ( unsigned ) record.core, ( unsigned ) record.threadId );
+
+            if( ( length > 0 ) && ( ( size_t ) length < sizeof( event ) ) )
+            {
+                writer( event, ( size_t ) length, pContext );
+                count++;
+            }
+        }
+    }
+
+    writer( footer, sizeof( footer ) - 1U, pContext );
+
+    return count;
+}
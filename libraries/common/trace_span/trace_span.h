@@ -0,0 +1,200 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file trace_span.h
+ * @brief Record the start and duration of spans of code, in microseconds,
+ * into a ring of the latest spans.
+ *
+ * A span covering the rest of a block is opened with TRACE_SPAN_SCOPE, and is
+ * recorded when the block is left by any path. A span that isn't a block is
+ * opened with TRACE_SPAN_BEGIN and recorded with TRACE_SPAN_END. Recording
+ * takes no lock: each span claims the next slot of the ring with one atomic
+ * increment, overwriting the oldest, so spans can be recorded from any task.
+ *
+ * The names of spans must be string literals, or live as long as the ring.
+ *
+ * Each span also records the core and the thread it ran on, from the port:
+ * trace_span_esp.c, which also sends the spans to SEGGER SystemView as they
+ * happen when CONFIG_TRACE_SPAN_SYSTEMVIEW is set, or trace_span_posix.c.
+ * #TraceSpan_ExportJson writes the ring in the JSON trace event format, which
+ * Perfetto and chrome://tracing open, so the spans of all the components can
+ * be seen on one timeline.
+ *
+ * With TRACE_SPAN_ENABLED set to 0, the macros expand to nothing, and their
+ * arguments aren't evaluated. On ESP-IDF it follows
+ * CONFIG_TRACE_SPAN_ENABLE; other builds define it.
+ */
+
+#ifndef TRACE_SPAN_H_
+#define TRACE_SPAN_H_
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Include ESP-IDF configuration. */
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+/**
+ * @brief Whether spans are recorded.
+ */
+#ifndef TRACE_SPAN_ENABLED
+    #if CONFIG_TRACE_SPAN_ENABLE
+        #define TRACE_SPAN_ENABLED    1
+    #else
+        #define TRACE_SPAN_ENABLED    0
+    #endif
+#endif
+
+/**
+ * @brief The number of the latest spans kept, a power of two.
+ */
+#ifndef TRACE_SPAN_RECORDS
+    #ifdef CONFIG_TRACE_SPAN_RECORDS
+        #define TRACE_SPAN_RECORDS    CONFIG_TRACE_SPAN_RECORDS
+    #else
+        #define TRACE_SPAN_RECORDS    8
+    #endif
+#endif
+
+/**
+ * @brief A span that is open.
+ */
+typedef struct TraceSpan
+{
+    const char * pName;
+    uint64_t startUs;
+    uint32_t portId;
+} TraceSpan_t;
+
+/**
+ * @brief A span recorded in the ring.
+ */
+typedef struct TraceSpanRecord
+{
+    const char * pName;  /**< The name given when the span was opened. */
+    uint64_t startUs;    /**< The time the span was opened, from Clock_GetTimeUs. */
+    uint32_t durationUs; /**< The time it was open. */
+    uint32_t threadId;   /**< The task or thread that recorded it. */
+    uint16_t core;       /**< The core it was recorded on. */
+} TraceSpanRecord_t;
+
+/**
+ * @brief Receives the JSON written by #TraceSpan_ExportJson, in pieces.
+ */
+typedef void (* TraceSpanWriter_t )( const char * pData,
+                                     size_t length,
+                                     void * pContext );
+
+#if TRACE_SPAN_ENABLED
+
+    #define TRACE_SPAN_CONCAT_( a, b )    a ## b
+    #define TRACE_SPAN_VAR_( line )       TRACE_SPAN_CONCAT_( traceSpan, line )
+
+/**
+ * @brief Opens a span named @a name, recorded when the enclosing block is
+ * left.
+ */
+    #define TRACE_SPAN_SCOPE( name )                                \
+    TraceSpan_t TRACE_SPAN_VAR_( __LINE__ )                         \
+    __attribute__( ( cleanup( TraceSpan_End ) ) ) = TraceSpan_Begin( name )
+
+/**
+ * @brief Opens the span @a span named @a name, to be recorded by
+ * TRACE_SPAN_END in the same block.
+ */
+    #define TRACE_SPAN_BEGIN( span, name )    TraceSpan_t span = TraceSpan_Begin( name )
+    #define TRACE_SPAN_END( span )            TraceSpan_End( &( span ) )
+
+#else /* if TRACE_SPAN_ENABLED */
+
+    /* Declarations, so that the spans can open before the declarations of
+     * a block. */
+    #define TRACE_SPAN_SCOPE( name )          extern int traceSpanDisabled __attribute__( ( unused ) )
+    #define TRACE_SPAN_BEGIN( span, name )    extern int span ## Disabled __attribute__( ( unused ) )
+    #define TRACE_SPAN_END( span )            do {} while( 0 )
+
+#endif /* if TRACE_SPAN_ENABLED */
+
+/**
+ * @brief Opens a span.
+ *
+ * @param[in] pName The name of the span.
+ *
+ * @return The span, to pass to #TraceSpan_End.
+ */
+TraceSpan_t TraceSpan_Begin( const char * pName );
+
+/**
+ * @brief Records a span in the ring, with the time since it was opened.
+ *
+ * @param[in] pSpan A span returned by #TraceSpan_Begin.
+ */
+void TraceSpan_End( TraceSpan_t * pSpan );
+
+/**
+ * @brief Copies the latest spans recorded, oldest first. A span that is being
+ * overwritten while it is read is left out.
+ *
+ * @param[out] pRecords Where to copy the spans.
+ * @param[in] maxRecords The number of spans that fit in @a pRecords.
+ *
+ * @return The number of spans copied.
+ */
+size_t TraceSpan_Read( TraceSpanRecord_t * pRecords,
+                       size_t maxRecords );
+
+/**
+ * @brief Logs the latest spans recorded, oldest first.
+ */
+void TraceSpan_Dump( void );
+
+/**
+ * @brief Writes the latest spans recorded, oldest first, as a JSON trace
+ * event file: a complete event per span, with the core as the process and the
+ * task or thread as the thread. Names are written as they are, so they must
+ * not need escaping, and are cut at 64 characters.
+ *
+ * @param[in] writer Called with each piece of the JSON, in order.
+ * @param[in] pContext Passed to @a writer.
+ *
+ * @return The number of spans written.
+ */
+size_t TraceSpan_ExportJson( TraceSpanWriter_t writer,
+                             void * pContext );
+
+/**
+ * @brief The port functions, called by trace_span.c.
+ *
+ * #TraceSpan_PortBegin is called when a span opens and returns an ID for the
+ * live exporter, passed back to #TraceSpan_PortEnd when it is recorded.
+ * #TraceSpan_PortThread gives the task or thread, and the core, recording a
+ * span.
+ */
+uint32_t TraceSpan_PortBegin( const char * pName );
+void TraceSpan_PortEnd( uint32_t portId );
+uint32_t TraceSpan_PortThread( uint16_t * pCore );
+
+#endif /* ifndef TRACE_SPAN_H_ */
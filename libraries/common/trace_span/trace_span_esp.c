@@ -0,0 +1,150 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file trace_span_esp.c
+ * @brief The ESP-IDF port of the trace spans.
+ *
+ * With CONFIG_TRACE_SPAN_SYSTEMVIEW, each span is also sent to SEGGER
+ * SystemView, through the application tracing of ESP-IDF, as a user event
+ * that starts when the span opens and stops when it is recorded. SystemView
+ * numbers user events, so each name is given a number the first time it is
+ * seen, and the pair is printed to the host.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "trace_span.h"
+
+#if CONFIG_TRACE_SPAN_SYSTEMVIEW
+    /* Include SEGGER SystemView, from the app_trace component. */
+    #include "SEGGER_SYSVIEW.h"
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if CONFIG_TRACE_SPAN_SYSTEMVIEW
+
+/**
+ * @brief The most names given a SystemView number. Spans with more names
+ * share the last number.
+ */
+    #define SYSTEMVIEW_MAX_NAMES    32U
+
+/**
+ * @brief The names given a SystemView number, which is their index.
+ */
+    static const char * systemViewNames[ SYSTEMVIEW_MAX_NAMES ];
+
+/**
+ * @brief The SystemView number of a name, given the first free one if it has
+ * none.
+ */
+    static uint32_t systemViewId( const char * pName );
+
+#endif /* if CONFIG_TRACE_SPAN_SYSTEMVIEW */
+
+/*-----------------------------------------------------------*/
+
+#if CONFIG_TRACE_SPAN_SYSTEMVIEW
+
+    static uint32_t systemViewId( const char * pName )
+    {
+        const char * pFound = NULL;
+        const char * pFree = NULL;
+        uint32_t id = 0U;
+        bool done = false;
+
+        while( ( done == false ) && ( id < SYSTEMVIEW_MAX_NAMES ) )
+        {
+            pFound = __atomic_load_n( &systemViewNames[ id ], __ATOMIC_ACQUIRE );
+
+            if( pFound == pName )
+            {
+                done = true;
+            }
+            else if( pFound != NULL )
+            {
+                id++;
+            }
+            else
+            {
+                /* Claim the free slot, or look at it again if another task
+                 * just did. */
+                pFree = NULL;
+
+                if( __atomic_compare_exchange_n( &systemViewNames[ id ], &pFree, pName, false,
+                                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) == true )
+                {
+                    SEGGER_SYSVIEW_PrintfHost( "Trace span %u: %s", ( unsigned ) id, pName );
+                    done = true;
+                }
+            }
+        }
+
+        return ( done == true ) ? id : ( SYSTEMVIEW_MAX_NAMES - 1U );
+    }
+
+#endif /* if CONFIG_TRACE_SPAN_SYSTEMVIEW */
+
+/*-----------------------------------------------------------*/
+
+uint32_t TraceSpan_PortBegin( const char * pName )
+{
+    uint32_t portId = 0U;
+
+    #if CONFIG_TRACE_SPAN_SYSTEMVIEW
+        portId = systemViewId( pName );
+        SEGGER_SYSVIEW_OnUserStart( ( unsigned ) portId );
+    #else
+        ( void ) pName;
+    #endif
+
+    return portId;
+}
+
+/*-----------------------------------------------------------*/
+
+void TraceSpan_PortEnd( uint32_t portId )
+{
+    #if CONFIG_TRACE_SPAN_SYSTEMVIEW
+        SEGGER_SYSVIEW_OnUserStop( ( unsigned ) portId );
+    #else
+        ( void ) portId;
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t TraceSpan_PortThread( uint16_t * pCore )
+{
+    *pCore = ( uint16_t ) xPortGetCoreID();
+
+    /* The task handle, which is unique while the task lives. */
+    return ( uint32_t ) ( uintptr_t ) xTaskGetCurrentTaskHandle();
+}
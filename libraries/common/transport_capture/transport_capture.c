@@ -0,0 +1,308 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file transport_capture.c
+ * @brief Implementation of the transport capture.
+ *
+ * Records are appended to the buffer under a mutex, as the send and receive
+ * functions of a connection may be called from different tasks, and the
+ * buffer is handed to the writer under the same mutex when the next record
+ * doesn't fit.
+ */
+
+/* Standard includes. */
+#include <pthread.h>
+#include <string.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the transport capture. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Transport Capture"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* Platform clock include. */
+#include "clock.h"
+
+#include "transport_capture.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Guards the state of the capture.
+ */
+static pthread_mutex_t captureMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief The functions of the wrapped transport.
+ */
+static TransportRecv_t wrappedRecv = NULL;
+static TransportSend_t wrappedSend = NULL;
+
+/**
+ * @brief The buffer, its writer, and whether records are being written.
+ */
+static uint8_t * pCaptureBuffer = NULL;
+static size_t captureBufferSize = 0U;
+static size_t captureBufferUsed = 0U;
+static TransportCaptureWriter_t captureWriter = NULL;
+static void * pCaptureWriterContext = NULL;
+static bool capturing = false;
+
+/**
+ * @brief The time of the last record, and the time spent in the writer, which
+ * is taken out of the times recorded.
+ */
+static uint64_t lastRecordUs = 0U;
+static uint64_t pausedUs = 0U;
+
+/**
+ * @brief Counters of the capture.
+ */
+static TransportCaptureStats_t captureStats;
+
+/*-----------------------------------------------------------*/
+
+static void putUint32( uint8_t * pBytes,
+                       uint32_t value )
+{
+    pBytes[ 0 ] = ( uint8_t ) value;
+    pBytes[ 1 ] = ( uint8_t ) ( value >> 8 );
+    pBytes[ 2 ] = ( uint8_t ) ( value >> 16 );
+    pBytes[ 3 ] = ( uint8_t ) ( value >> 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called with the mutex held. */
+static void flushBuffer( void )
+{
+    uint64_t startUs = 0U, elapsedUs = 0U;
+    bool written = false;
+
+    if( captureBufferUsed > 0U )
+    {
+        startUs = Clock_GetTimeUs();
+        written = captureWriter( pCaptureBuffer, captureBufferUsed, pCaptureWriterContext );
+        elapsedUs = Clock_GetTimeUs() - startUs;
+
+        pausedUs += elapsedUs;
+        captureStats.writeUs += elapsedUs;
+
+        if( written == true )
+        {
+            captureStats.bytesWritten += captureBufferUsed;
+        }
+        else
+        {
+            LogError( ( "The writer failed; the capture ends after %lu records.",
+                        ( unsigned long ) captureStats.records ) );
+            capturing = false;
+        }
+
+        captureBufferUsed = 0U;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void appendRecord( TransportCaptureRecordType_t type,
+                          int32_t result,
+                          const void * pData,
+                          size_t dataLength )
+{
+    size_t recordSize = TRANSPORT_CAPTURE_RECORD_HEADER_SIZE + dataLength;
+    uint8_t * pRecord = NULL;
+    uint64_t nowUs = 0U, deltaUs = 0U;
+
+    ( void ) pthread_mutex_lock( &captureMutex );
+
+    if( ( capturing == true ) && ( recordSize > ( captureBufferSize - captureBufferUsed ) ) )
+    {
+        flushBuffer();
+    }
+
+    if( capturing == false )
+    {
+        /* Not started, or stopped. */
+    }
+    else if( recordSize > captureBufferSize )
+    {
+        captureStats.dropped++;
+    }
+    else
+    {
+        nowUs = Clock_GetTimeUs() - pausedUs;
+        deltaUs = nowUs - lastRecordUs;
+        lastRecordUs = nowUs;
+
+        pRecord = &pCaptureBuffer[ captureBufferUsed ];
+        putUint32( pRecord, ( deltaUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) deltaUs );
+        putUint32( &pRecord[ 4 ], ( uint32_t ) result );
+        pRecord[ 8 ] = ( uint8_t ) type;
+
+        if( dataLength > 0U )
+        {
+            ( void ) memcpy( &pRecord[ TRANSPORT_CAPTURE_RECORD_HEADER_SIZE ], pData, dataLength );
+        }
+
+        captureBufferUsed += recordSize;
+        captureStats.records++;
+    }
+
+    ( void ) pthread_mutex_unlock( &captureMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t captureRecv( NetworkContext_t * pNetworkContext,
+                            void * pBuffer,
+                            size_t bytesToRecv )
+{
+    int32_t result = wrappedRecv( pNetworkContext, pBuffer, bytesToRecv );
+
+    /* Nothing to replay in a receive that found nothing. */
+    if( result != 0 )
+    {
+        appendRecord( TransportCaptureRecv, result, pBuffer, ( result > 0 ) ? ( size_t ) result : 0U );
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t captureSend( NetworkContext_t * pNetworkContext,
+                            const void * pBuffer,
+                            size_t bytesToSend )
+{
+    int32_t result = wrappedSend( pNetworkContext, pBuffer, bytesToSend );
+
+    appendRecord( TransportCaptureSend, result, pBuffer,
+                  ( ( TRANSPORT_CAPTURE_SEND_DATA != 0 ) && ( result > 0 ) ) ? ( size_t ) result : 0U );
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+bool TransportCapture_Start( uint8_t * pBuffer,
+                             size_t bufferSize,
+                             TransportCaptureWriter_t writer,
+                             void * pContext )
+{
+    bool started = false;
+
+    ( void ) pthread_mutex_lock( &captureMutex );
+
+    if( ( capturing == false ) && ( pBuffer != NULL ) && ( writer != NULL ) &&
+        ( bufferSize >= ( TRANSPORT_CAPTURE_HEADER_SIZE + TRANSPORT_CAPTURE_RECORD_HEADER_SIZE ) ) )
+    {
+        pCaptureBuffer = pBuffer;
+        captureBufferSize = bufferSize;
+        captureWriter = writer;
+        pCaptureWriterContext = pContext;
+        ( void ) memset( &captureStats, 0, sizeof( captureStats ) );
+
+        ( void ) memcpy( pCaptureBuffer, TRANSPORT_CAPTURE_MAGIC, 4U );
+        pCaptureBuffer[ 4 ] = TRANSPORT_CAPTURE_VERSION;
+        pCaptureBuffer[ 5 ] = ( TRANSPORT_CAPTURE_SEND_DATA != 0 ) ? TRANSPORT_CAPTURE_FLAG_SEND_DATA : 0U;
+        pCaptureBuffer[ 6 ] = 0U;
+        pCaptureBuffer[ 7 ] = 0U;
+        captureBufferUsed = TRANSPORT_CAPTURE_HEADER_SIZE;
+
+        lastRecordUs = Clock_GetTimeUs();
+        pausedUs = 0U;
+        capturing = true;
+        started = true;
+    }
+
+    ( void ) pthread_mutex_unlock( &captureMutex );
+
+    return started;
+}
+
+/*-----------------------------------------------------------*/
+
+void TransportCapture_Wrap( TransportInterface_t * pTransport )
+{
+    if( pTransport->recv != captureRecv )
+    {
+        wrappedRecv = pTransport->recv;
+        pTransport->recv = captureRecv;
+    }
+
+    if( pTransport->send != captureSend )
+    {
+        wrappedSend = pTransport->send;
+        pTransport->send = captureSend;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void TransportCapture_MarkConnect( void )
+{
+    appendRecord( TransportCaptureConnect, 0, NULL, 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+void TransportCapture_Stop( void )
+{
+    appendRecord( TransportCaptureEnd, 0, NULL, 0U );
+
+    ( void ) pthread_mutex_lock( &captureMutex );
+
+    if( capturing == true )
+    {
+        flushBuffer();
+
+        LogInfo( ( "Captured %lu records, %llu bytes; %lu dropped, %llu us spent writing.",
+                   ( unsigned long ) captureStats.records,
+                   ( unsigned long long ) captureStats.bytesWritten,
+                   ( unsigned long ) captureStats.dropped,
+                   ( unsigned long long ) captureStats.writeUs ) );
+    }
+
+    capturing = false;
+
+    ( void ) pthread_mutex_unlock( &captureMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+void TransportCapture_GetStats( TransportCaptureStats_t * pStats )
+{
+    ( void ) pthread_mutex_lock( &captureMutex );
+    *pStats = captureStats;
+    ( void ) pthread_mutex_unlock( &captureMutex );
+}
+
+/*-----------------------------------------------------------*/
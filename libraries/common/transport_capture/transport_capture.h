@@ -0,0 +1,187 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file transport_capture.h
+ * @brief Record the sends and receives of a connection at the transport
+ * interface, with their times, so that a session from the field can be
+ * replayed into the same code, such as by transport_replay_posix.c.
+ *
+ * #TransportCapture_Wrap replaces the send and receive functions of a
+ * transport interface with ones that call them and record what they returned:
+ * the bytes received, the bytes sent if CONFIG_TRANSPORT_CAPTURE_SEND_DATA is
+ * set, and every error. Receives that return nothing are not recorded, so a
+ * connection polled while idle only takes room for the data it moved.
+ * Records are assembled in a RAM buffer, handed to a writer whenever it fills,
+ * and the time spent writing is left out of the times recorded, so a slow
+ * writer doesn't show up as network latency in the replay.
+ *
+ * One transport is captured at a time, from any number of tasks. A capture is
+ * a sequence of bytes, all fields little-endian:
+ *
+ * - The header: the magic "TCAP", the version, flags, and 2 reserved bytes.
+ * - Records, each of a header of #TRANSPORT_CAPTURE_RECORD_HEADER_SIZE bytes:
+ *   the microseconds since the previous record (saturating at UINT32_MAX),
+ *   what the call returned, as an int32_t, and the type. A receive, or a send
+ *   with #TRANSPORT_CAPTURE_FLAG_SEND_DATA, that moved data is followed by
+ *   that data.
+ *
+ * A type byte of 0xFF, erased flash, or the end of the data, ends a capture.
+ * transport_capture_esp.c writes to a flash partition or a UART.
+ */
+
+#ifndef TRANSPORT_CAPTURE_H_
+#define TRANSPORT_CAPTURE_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Transport interface include. */
+#include "transport_interface.h"
+
+/* Include ESP-IDF configuration. */
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+/**
+ * @brief The magic and version at the start of a capture.
+ */
+#define TRANSPORT_CAPTURE_MAGIC                 "TCAP"
+#define TRANSPORT_CAPTURE_VERSION               1U
+
+/**
+ * @brief The size of the header of a capture and of a record.
+ */
+#define TRANSPORT_CAPTURE_HEADER_SIZE           8U
+#define TRANSPORT_CAPTURE_RECORD_HEADER_SIZE    9U
+
+/**
+ * @brief Set in the flags of the header when sends carry their data.
+ */
+#define TRANSPORT_CAPTURE_FLAG_SEND_DATA        0x01U
+
+/**
+ * @brief Whether sends are recorded with their data, rather than only their
+ * length.
+ */
+#ifndef TRANSPORT_CAPTURE_SEND_DATA
+    #ifdef CONFIG_TRANSPORT_CAPTURE_SEND_DATA
+        #define TRANSPORT_CAPTURE_SEND_DATA    CONFIG_TRANSPORT_CAPTURE_SEND_DATA
+    #else
+        #define TRANSPORT_CAPTURE_SEND_DATA    0
+    #endif
+#endif
+
+/**
+ * @brief The types of records.
+ */
+typedef enum TransportCaptureRecordType
+{
+    TransportCaptureConnect = 1, /**< A connection was established; the records until the next one are of it. */
+    TransportCaptureSend = 2,    /**< A call to the send function. */
+    TransportCaptureRecv = 3,    /**< A call to the receive function that returned data or an error. */
+    TransportCaptureEnd = 0xFF   /**< The end of the capture. */
+} TransportCaptureRecordType_t;
+
+/**
+ * @brief Writes a piece of a capture; returns false if it could not, which
+ * ends the capture.
+ */
+typedef bool (* TransportCaptureWriter_t )( const uint8_t * pData,
+                                            size_t length,
+                                            void * pContext );
+
+/**
+ * @brief Counters of the capture, as returned by #TransportCapture_GetStats.
+ */
+typedef struct TransportCaptureStats
+{
+    uint32_t records;      /**< @brief Records written. */
+    uint32_t dropped;      /**< @brief Records lost to a failed writer or one too large for the buffer. */
+    uint64_t bytesWritten; /**< @brief Bytes handed to the writer. */
+    uint64_t writeUs;      /**< @brief Time spent in the writer, left out of the record times. */
+} TransportCaptureStats_t;
+
+/**
+ * @brief Start a capture, writing its header.
+ *
+ * @param[in] pBuffer The buffer records are assembled in. A record larger than
+ * the buffer is dropped, so it should hold the largest receive.
+ * @param[in] bufferSize The size of @a pBuffer.
+ * @param[in] writer Called with the buffer whenever it is full, and by
+ * #TransportCapture_Stop.
+ * @param[in] pContext Passed to @a writer.
+ *
+ * @return true if the capture started; false if one is running, or the
+ * buffer is too small for the header.
+ */
+bool TransportCapture_Start( uint8_t * pBuffer,
+                             size_t bufferSize,
+                             TransportCaptureWriter_t writer,
+                             void * pContext );
+
+/**
+ * @brief Route the sends and receives of a transport interface through the
+ * capture. Wrapping an interface that is already wrapped leaves it as it is.
+ *
+ * The functions keep calling the original ones once the capture is stopped.
+ *
+ * @param[in,out] pTransport The interface, before it is given to its user.
+ */
+void TransportCapture_Wrap( TransportInterface_t * pTransport );
+
+/**
+ * @brief Mark the start of a connection, so the replay can tell the records
+ * of a reconnect from those of the connection before.
+ */
+void TransportCapture_MarkConnect( void );
+
+/**
+ * @brief Write the records still in the buffer and an end record, and stop
+ * recording.
+ */
+void TransportCapture_Stop( void );
+
+/**
+ * @brief Copy the counters of the capture into @a pStats.
+ */
+void TransportCapture_GetStats( TransportCaptureStats_t * pStats );
+
+#ifdef ESP_PLATFORM
+
+/**
+ * @brief Start a capture to the sink chosen in menuconfig, with a buffer of
+ * CONFIG_TRANSPORT_CAPTURE_BUFFER_SIZE bytes: the flash partition labeled
+ * CONFIG_TRANSPORT_CAPTURE_PARTITION_LABEL, erased ahead of the writes, or
+ * the UART CONFIG_TRANSPORT_CAPTURE_UART_PORT, whose driver the application
+ * installs.
+ *
+ * @return true if the capture started.
+ */
+    bool TransportCapture_StartConfigured( void );
+
+#endif /* ifdef ESP_PLATFORM */
+
+#endif /* ifndef TRANSPORT_CAPTURE_H_ */
@@ -0,0 +1,163 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file transport_capture_esp.c
+ * @brief The writers of the transport capture on ESP-IDF: a flash partition
+ * or a UART.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the transport capture. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Transport Capture"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/* ESP-IDF includes. */
+#include "driver/uart.h"
+#include "esp_partition.h"
+
+#include "transport_capture.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The unit in which the partition is erased.
+ */
+#define CAPTURE_SECTOR_SIZE    4096U
+
+/*-----------------------------------------------------------*/
+
+#if CONFIG_TRANSPORT_CAPTURE
+
+/**
+ * @brief The buffer records are assembled in.
+ */
+    static uint8_t captureBuffer[ CONFIG_TRANSPORT_CAPTURE_BUFFER_SIZE ];
+
+#endif
+
+#if CONFIG_TRANSPORT_CAPTURE_SINK_PARTITION
+
+/**
+ * @brief The partition written, the offset of the next write, and the end of
+ * the part erased so far.
+ */
+    static const esp_partition_t * pCapturePartition = NULL;
+    static size_t writeOffset = 0U;
+    static size_t erasedEnd = 0U;
+
+/*-----------------------------------------------------------*/
+
+    static bool writePartition( const uint8_t * pData,
+                                size_t length,
+                                void * pContext )
+    {
+        size_t eraseEnd = 0U;
+        bool status = ( writeOffset + length ) <= pCapturePartition->size;
+
+        ( void ) pContext;
+
+        if( status == false )
+        {
+            LogWarn( ( "The capture partition is full." ) );
+        }
+        else if( ( writeOffset + length ) > erasedEnd )
+        {
+            /* Erase only what the write needs, so that starting a capture
+             * doesn't wait for the whole partition. */
+            eraseEnd = ( ( writeOffset + length + CAPTURE_SECTOR_SIZE - 1U ) / CAPTURE_SECTOR_SIZE ) * CAPTURE_SECTOR_SIZE;
+            eraseEnd = ( eraseEnd < pCapturePartition->size ) ? eraseEnd : pCapturePartition->size;
+            status = ( esp_partition_erase_range( pCapturePartition, erasedEnd, eraseEnd - erasedEnd ) == ESP_OK );
+            erasedEnd = eraseEnd;
+        }
+
+        if( status == true )
+        {
+            status = ( esp_partition_write( pCapturePartition, writeOffset, pData, length ) == ESP_OK );
+            writeOffset += length;
+        }
+
+        return status;
+    }
+
+#endif /* if CONFIG_TRANSPORT_CAPTURE_SINK_PARTITION */
+
+/*-----------------------------------------------------------*/
+
+#if CONFIG_TRANSPORT_CAPTURE_SINK_UART
+
+    static bool writeUart( const uint8_t * pData,
+                           size_t length,
+                           void * pContext )
+    {
+        ( void ) pContext;
+
+        return uart_write_bytes( CONFIG_TRANSPORT_CAPTURE_UART_PORT, pData, length ) == ( int ) length;
+    }
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+bool TransportCapture_StartConfigured( void )
+{
+    bool started = false;
+
+    #if CONFIG_TRANSPORT_CAPTURE_SINK_PARTITION
+        pCapturePartition = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                      CONFIG_TRANSPORT_CAPTURE_PARTITION_LABEL );
+        writeOffset = 0U;
+        erasedEnd = 0U;
+
+        if( pCapturePartition == NULL )
+        {
+            LogError( ( "No data partition %s for the capture.", CONFIG_TRANSPORT_CAPTURE_PARTITION_LABEL ) );
+        }
+        else
+        {
+            started = TransportCapture_Start( captureBuffer, sizeof( captureBuffer ), writePartition, NULL );
+        }
+    #elif CONFIG_TRANSPORT_CAPTURE_SINK_UART
+        started = TransportCapture_Start( captureBuffer, sizeof( captureBuffer ), writeUart, NULL );
+    #endif
+
+    if( started == true )
+    {
+        LogInfo( ( "Capturing the transport." ) );
+    }
+
+    return started;
+}
+
+/*-----------------------------------------------------------*/
@@ -0,0 +1,747 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file wifi_fast_connect.c
+ * @brief Implementation of the Wi-Fi station that connects from a cache.
+ *
+ * Everything the connection state depends on is changed on the default event
+ * loop: the Wi-Fi and IP events, and the events this module posts to itself
+ * for an expired lease and for #WifiFastConnect_Invalidate, so none of it
+ * needs a lock. The cache in RTC memory is trusted only after a wake from
+ * deep sleep; after any other reset the access point and PMK are read back
+ * from NVS and the lease is dropped, since the clock it was timed on restarted.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <sys/time.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/* ESP-IDF includes. */
+#include "esp_attr.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+/* mbedTLS includes. */
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the Wi-Fi fast connect. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Wi-Fi Fast Connect"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "wifi_fast_connect.h"
+
+#if WIFI_FAST_CONNECT_ENABLED
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Marks a valid cache, and its layout.
+ */
+    #define CACHE_MAGIC            ( 0x57464331UL )
+
+/**
+ * @brief The NVS key of the cache.
+ */
+    #define CACHE_NVS_KEY          "cache"
+
+/**
+ * @brief Length of a WPA2 PMK.
+ */
+    #define PMK_LENGTH             32U
+
+/**
+ * @brief PBKDF2 rounds of the WPA2 PMK.
+ */
+    #define PMK_ROUNDS             4096U
+
+/**
+ * @brief Set in #readyEvents while the station is associated and has an
+ * address.
+ */
+    #define READY_BIT              ( 1U << 0 )
+
+/**
+ * @brief The events this module posts to itself.
+ */
+    ESP_EVENT_DEFINE_BASE( WIFI_FAST_CONNECT_EVENT );
+
+    enum
+    {
+        FastConnectEventLeaseExpired, /**< A reused lease reached #WIFI_FAST_CONNECT_LEASE_REUSE_S. */
+        FastConnectEventInvalidate    /**< #WifiFastConnect_Invalidate was called. */
+    };
+
+/**
+ * @brief The access point of the last connection, and the PMK.
+ */
+    typedef struct FastConnectCache
+    {
+        uint32_t magic;
+        uint32_t credentialHash; /* The SSID and passphrase. */
+        bool pmkValid;
+        bool accessPointValid;
+        uint8_t channel;
+        uint8_t bssid[ 6 ];
+        uint8_t pmk[ PMK_LENGTH ];
+    } FastConnectCache_t;
+
+/**
+ * @brief The address DHCP assigned last.
+ */
+    typedef struct FastConnectLease
+    {
+        bool valid;
+        uint32_t credentialHash;
+        esp_netif_ip_info_t ipInfo;
+        esp_netif_dns_info_t dnsInfo;
+        int64_t obtainedS; /* On the RTC clock, which keeps running in deep sleep. */
+    } FastConnectLease_t;
+
+/**
+ * @brief The cache and lease, in RTC slow memory.
+ */
+    static RTC_DATA_ATTR FastConnectCache_t rtcCache;
+    static RTC_DATA_ATTR FastConnectLease_t rtcLease;
+
+/**
+ * @brief The cache as last read from or written to NVS, so it is only written
+ * when it changes.
+ */
+    static FastConnectCache_t nvsCache;
+
+/**
+ * @brief The station.
+ */
+    static esp_netif_t * pStationNetif = NULL;
+
+/**
+ * @brief The SSID and the passphrase, or the PMK in hex, of every attempt.
+ */
+    static wifi_config_t baseConfig;
+
+    static EventGroupHandle_t readyEvents = NULL;
+    static StaticEventGroup_t readyEventsBuffer;
+    static WifiFastConnectReadyCallback_t readyCallback = NULL;
+    static esp_timer_handle_t leaseTimer = NULL;
+
+/**
+ * @brief The state of the attempt in progress, changed on the event loop.
+ */
+    static bool fastAttempt = false;   /* Associating with the cached access point. */
+    static bool leaseReused = false;   /* The address is the cached lease, not from DHCP. */
+    static bool associated = false;
+    static bool addressAssigned = false;
+    static bool attemptConnected = false;
+    static bool readyNotified = false;
+    static int64_t attemptStartUs = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief FNV-1a over the SSID and passphrase.
+ */
+    static uint32_t credentialHash( const char * pSsid,
+                                    const char * pPassword );
+
+/**
+ * @brief The current time on the RTC clock, in seconds.
+ */
+    static int64_t rtcSeconds( void );
+
+/**
+ * @brief Derive the WPA2 PMK of a network.
+ */
+    static bool derivePmk( const char * pSsid,
+                           const char * pPassword,
+                           uint8_t * pPmk );
+
+/**
+ * @brief Read the cache from NVS into #nvsCache.
+ */
+    static void loadCache( uint32_t hash );
+
+/**
+ * @brief Write #rtcCache to NVS if it differs from what NVS holds.
+ */
+    static void saveCache( void );
+
+/**
+ * @brief Whether the cached lease may still be used.
+ */
+    static bool leaseUsable( void );
+
+/**
+ * @brief Configure the cached lease as a static address, and time it out.
+ */
+    static void reuseLease( void );
+
+/**
+ * @brief Go back to DHCP from a reused lease.
+ */
+    static void restoreDhcp( void );
+
+/**
+ * @brief Start associating, with the cached access point if @a fast and there
+ * is one, or after a scan of every channel otherwise.
+ */
+    static void startAttempt( bool fast );
+
+/**
+ * @brief Signal readiness once the station is associated and has an address.
+ */
+    static void updateReady( void );
+
+    static void leaseTimerCallback( void * pArgument );
+
+    static void eventHandler( void * pArgument,
+                              esp_event_base_t eventBase,
+                              int32_t eventId,
+                              void * pEventData );
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t credentialHash( const char * pSsid,
+                                    const char * pPassword )
+    {
+        uint32_t hash = 2166136261UL;
+        size_t i;
+
+        for( i = 0; pSsid[ i ] != '\0'; i++ )
+        {
+            hash = ( hash ^ ( uint8_t ) pSsid[ i ] ) * 16777619UL;
+        }
+
+        /* The separator keeps "ab" + "c" apart from "a" + "bc". */
+        hash = ( hash ^ 0U ) * 16777619UL;
+
+        for( i = 0; pPassword[ i ] != '\0'; i++ )
+        {
+            hash = ( hash ^ ( uint8_t ) pPassword[ i ] ) * 16777619UL;
+        }
+
+        return hash;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int64_t rtcSeconds( void )
+    {
+        struct timeval now;
+
+        ( void ) gettimeofday( &now, NULL );
+
+        return ( int64_t ) now.tv_sec;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool derivePmk( const char * pSsid,
+                           const char * pPassword,
+                           uint8_t * pPmk )
+    {
+        mbedtls_md_context_t context;
+        int ret;
+
+        mbedtls_md_init( &context );
+        ret = mbedtls_md_setup( &context, mbedtls_md_info_from_type( MBEDTLS_MD_SHA1 ), 1 );
+
+        if( ret == 0 )
+        {
+            ret = mbedtls_pkcs5_pbkdf2_hmac( &context,
+                                             ( const unsigned char * ) pPassword, strlen( pPassword ),
+                                             ( const unsigned char * ) pSsid, strlen( pSsid ),
+                                             PMK_ROUNDS, PMK_LENGTH, pPmk );
+        }
+
+        mbedtls_md_free( &context );
+
+        if( ret != 0 )
+        {
+            LogError( ( "Failed to derive the PMK: mbedTLS error -0x%x.", ( unsigned ) -ret ) );
+        }
+
+        return ( ret == 0 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void loadCache( uint32_t hash )
+    {
+        nvs_handle_t handle;
+        size_t length = sizeof( nvsCache );
+        bool loaded = false;
+
+        if( nvs_open( WIFI_FAST_CONNECT_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK )
+        {
+            /* A blob of another size was written by another version. */
+            loaded = ( nvs_get_blob( handle, CACHE_NVS_KEY, &nvsCache, &length ) == ESP_OK ) &&
+                     ( length == sizeof( nvsCache ) ) &&
+                     ( nvsCache.magic == CACHE_MAGIC ) &&
+                     ( nvsCache.credentialHash == hash );
+            nvs_close( handle );
+        }
+
+        if( loaded == false )
+        {
+            ( void ) memset( &nvsCache, 0x00, sizeof( nvsCache ) );
+            nvsCache.magic = CACHE_MAGIC;
+            nvsCache.credentialHash = hash;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void saveCache( void )
+    {
+        nvs_handle_t handle;
+        esp_err_t err;
+
+        if( memcmp( &rtcCache, &nvsCache, sizeof( rtcCache ) ) != 0 )
+        {
+            err = nvs_open( WIFI_FAST_CONNECT_NVS_NAMESPACE, NVS_READWRITE, &handle );
+
+            if( err == ESP_OK )
+            {
+                err = nvs_set_blob( handle, CACHE_NVS_KEY, &rtcCache, sizeof( rtcCache ) );
+
+                if( err == ESP_OK )
+                {
+                    err = nvs_commit( handle );
+                }
+
+                nvs_close( handle );
+            }
+
+            if( err == ESP_OK )
+            {
+                nvsCache = rtcCache;
+            }
+            else
+            {
+                LogError( ( "Failed to save the access point to NVS: %s.", esp_err_to_name( err ) ) );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool leaseUsable( void )
+    {
+        int64_t ageS = rtcSeconds() - rtcLease.obtainedS;
+
+        /* A clock set backwards, or forwards by SNTP, only ever drops the lease. */
+        return ( rtcLease.valid == true ) &&
+               ( rtcLease.credentialHash == rtcCache.credentialHash ) &&
+               ( ageS >= 0 ) &&
+               ( ageS < WIFI_FAST_CONNECT_LEASE_REUSE_S );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void reuseLease( void )
+    {
+        int64_t remainingS = WIFI_FAST_CONNECT_LEASE_REUSE_S - ( rtcSeconds() - rtcLease.obtainedS );
+        esp_err_t err = esp_netif_dhcpc_stop( pStationNetif );
+
+        if( ( err == ESP_OK ) || ( err == ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED ) )
+        {
+            err = esp_netif_set_ip_info( pStationNetif, &rtcLease.ipInfo );
+        }
+
+        if( err == ESP_OK )
+        {
+            ( void ) esp_netif_set_dns_info( pStationNetif, ESP_NETIF_DNS_MAIN, &rtcLease.dnsInfo );
+            leaseReused = true;
+            addressAssigned = true;
+
+            ( void ) esp_timer_stop( leaseTimer );
+            ( void ) esp_timer_start_once( leaseTimer, ( uint64_t ) remainingS * 1000000U );
+        }
+        else
+        {
+            LogWarn( ( "Failed to configure the cached lease: %s.", esp_err_to_name( err ) ) );
+            restoreDhcp();
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void restoreDhcp( void )
+    {
+        esp_err_t err;
+
+        ( void ) esp_timer_stop( leaseTimer );
+        leaseReused = false;
+        addressAssigned = false;
+
+        err = esp_netif_dhcpc_start( pStationNetif );
+
+        if( ( err != ESP_OK ) && ( err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED ) )
+        {
+            LogError( ( "Failed to start the DHCP client: %s.", esp_err_to_name( err ) ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void startAttempt( bool fast )
+    {
+        wifi_config_t config = baseConfig;
+        esp_err_t err;
+
+        fastAttempt = ( fast == true ) && ( rtcCache.accessPointValid == true );
+        attemptConnected = false;
+
+        if( fastAttempt == true )
+        {
+            /* Probes the one channel for the one access point. */
+            config.sta.scan_method = WIFI_FAST_SCAN;
+            config.sta.bssid_set = true;
+            ( void ) memcpy( config.sta.bssid, rtcCache.bssid, sizeof( config.sta.bssid ) );
+            config.sta.channel = rtcCache.channel;
+        }
+        else
+        {
+            config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+            config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+        }
+
+        if( ( fastAttempt == true ) && ( leaseUsable() == true ) )
+        {
+            reuseLease();
+        }
+        else if( ( leaseReused == true ) || ( addressAssigned == false ) )
+        {
+            restoreDhcp();
+        }
+
+        attemptStartUs = esp_timer_get_time();
+        err = esp_wifi_set_config( WIFI_IF_STA, &config );
+
+        if( err == ESP_OK )
+        {
+            err = esp_wifi_connect();
+        }
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Failed to start associating: %s.", esp_err_to_name( err ) ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void updateReady( void )
+    {
+        if( ( associated == true ) && ( addressAssigned == true ) && ( attemptConnected == false ) )
+        {
+            attemptConnected = true;
+            ( void ) xEventGroupSetBits( readyEvents, READY_BIT );
+
+            LogInfo( ( "Connected in %u ms, %s association, %s.",
+                       ( unsigned ) ( ( esp_timer_get_time() - attemptStartUs ) / 1000 ),
+                       ( fastAttempt == true ) ? "fast" : "scanned",
+                       ( leaseReused == true ) ? "reused lease" : "DHCP" ) );
+
+            if( ( readyNotified == false ) && ( readyCallback != NULL ) )
+            {
+                readyNotified = true;
+                readyCallback();
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void leaseTimerCallback( void * pArgument )
+    {
+        ( void ) pArgument;
+
+        /* Handled on the event loop, with the rest of the state. */
+        ( void ) esp_event_post( WIFI_FAST_CONNECT_EVENT, FastConnectEventLeaseExpired, NULL, 0, 0 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void eventHandler( void * pArgument,
+                              esp_event_base_t eventBase,
+                              int32_t eventId,
+                              void * pEventData )
+    {
+        ( void ) pArgument;
+
+        if( ( eventBase == WIFI_EVENT ) && ( eventId == WIFI_EVENT_STA_START ) )
+        {
+            startAttempt( true );
+        }
+        else if( ( eventBase == WIFI_EVENT ) && ( eventId == WIFI_EVENT_STA_CONNECTED ) )
+        {
+            const wifi_event_sta_connected_t * pConnected = pEventData;
+
+            associated = true;
+            rtcCache.accessPointValid = true;
+            rtcCache.channel = pConnected->channel;
+            ( void ) memcpy( rtcCache.bssid, pConnected->bssid, sizeof( rtcCache.bssid ) );
+            updateReady();
+        }
+        else if( ( eventBase == WIFI_EVENT ) && ( eventId == WIFI_EVENT_STA_DISCONNECTED ) )
+        {
+            const wifi_event_sta_disconnected_t * pDisconnected = pEventData;
+
+            associated = false;
+            ( void ) xEventGroupClearBits( readyEvents, READY_BIT );
+
+            if( ( fastAttempt == true ) && ( attemptConnected == false ) )
+            {
+                /* The access point moved, changed channel or is gone. */
+                LogWarn( ( "Fast association failed, reason %u, scanning.", ( unsigned ) pDisconnected->reason ) );
+                rtcCache.accessPointValid = false;
+                startAttempt( false );
+            }
+            else
+            {
+                LogWarn( ( "Disconnected, reason %u, reconnecting.", ( unsigned ) pDisconnected->reason ) );
+                startAttempt( true );
+            }
+        }
+        else if( ( eventBase == IP_EVENT ) && ( eventId == IP_EVENT_STA_GOT_IP ) )
+        {
+            const ip_event_got_ip_t * pGotIp = pEventData;
+
+            addressAssigned = true;
+            updateReady();
+
+            /* Written once the connection is ready, so it doesn't wait on flash. */
+            if( leaseReused == false )
+            {
+                rtcLease.valid = true;
+                rtcLease.credentialHash = rtcCache.credentialHash;
+                rtcLease.ipInfo = pGotIp->ip_info;
+                ( void ) esp_netif_get_dns_info( pStationNetif, ESP_NETIF_DNS_MAIN, &rtcLease.dnsInfo );
+                rtcLease.obtainedS = rtcSeconds();
+            }
+
+            saveCache();
+        }
+        else if( ( eventBase == IP_EVENT ) && ( eventId == IP_EVENT_STA_LOST_IP ) )
+        {
+            addressAssigned = false;
+            ( void ) xEventGroupClearBits( readyEvents, READY_BIT );
+        }
+        else if( ( eventBase == WIFI_FAST_CONNECT_EVENT ) && ( eventId == FastConnectEventLeaseExpired ) )
+        {
+            if( leaseReused == true )
+            {
+                /* Renewing drops the address, and the connections on it, until
+                 * DHCP assigns one again. */
+                LogInfo( ( "The reused lease is %u s old, renewing it with DHCP.",
+                           ( unsigned ) WIFI_FAST_CONNECT_LEASE_REUSE_S ) );
+                rtcLease.valid = false;
+                ( void ) xEventGroupClearBits( readyEvents, READY_BIT );
+                attemptConnected = false;
+                attemptStartUs = esp_timer_get_time();
+                restoreDhcp();
+            }
+        }
+        else if( ( eventBase == WIFI_FAST_CONNECT_EVENT ) && ( eventId == FastConnectEventInvalidate ) )
+        {
+            rtcCache.accessPointValid = false;
+            rtcLease.valid = false;
+            saveCache();
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    esp_err_t WifiFastConnect_Start( const char * pSsid,
+                                     const char * pPassword,
+                                     WifiFastConnectReadyCallback_t callback )
+    {
+        wifi_init_config_t initConfig = WIFI_INIT_CONFIG_DEFAULT();
+        const esp_timer_create_args_t timerArgs =
+        {
+            .callback = leaseTimerCallback,
+            .name     = "wifi_lease"
+        };
+        uint32_t hash;
+        bool wokeFromSleep = ( esp_reset_reason() == ESP_RST_DEEPSLEEP );
+        esp_err_t err = ESP_OK;
+        size_t i;
+
+        if( ( pSsid == NULL ) || ( pPassword == NULL ) ||
+            ( strlen( pSsid ) > sizeof( baseConfig.sta.ssid ) ) ||
+            ( strlen( pPassword ) > sizeof( baseConfig.sta.password ) ) )
+        {
+            err = ESP_ERR_INVALID_ARG;
+        }
+        else if( readyEvents != NULL )
+        {
+            err = ESP_ERR_INVALID_STATE;
+        }
+
+        if( err == ESP_OK )
+        {
+            hash = credentialHash( pSsid, pPassword );
+            loadCache( hash );
+
+            if( ( wokeFromSleep == false ) ||
+                ( rtcCache.magic != CACHE_MAGIC ) ||
+                ( rtcCache.credentialHash != hash ) )
+            {
+                rtcCache = nvsCache;
+            }
+
+            /* The RTC clock restarts on any reset but a wake from deep sleep. */
+            if( wokeFromSleep == false )
+            {
+                ( void ) memset( &rtcLease, 0x00, sizeof( rtcLease ) );
+            }
+
+            ( void ) memset( &baseConfig, 0x00, sizeof( baseConfig ) );
+            ( void ) memcpy( baseConfig.sta.ssid, pSsid, strlen( pSsid ) );
+
+            #if WIFI_FAST_CONNECT_CACHE_PMK
+                /* Derived here rather than by the driver, which would derive it
+                 * again on every connect. */
+                if( ( pPassword[ 0 ] != '\0' ) && ( rtcCache.pmkValid == false ) )
+                {
+                    rtcCache.pmkValid = derivePmk( pSsid, pPassword, rtcCache.pmk );
+                }
+            #endif
+
+            if( rtcCache.pmkValid == true )
+            {
+                /* The driver takes 64 hex digits as the PMK itself. */
+                for( i = 0; i < PMK_LENGTH; i++ )
+                {
+                    baseConfig.sta.password[ 2U * i ] = "0123456789abcdef"[ rtcCache.pmk[ i ] >> 4 ];
+                    baseConfig.sta.password[ ( 2U * i ) + 1U ] = "0123456789abcdef"[ rtcCache.pmk[ i ] & 0x0FU ];
+                }
+            }
+            else
+            {
+                ( void ) memcpy( baseConfig.sta.password, pPassword, strlen( pPassword ) );
+            }
+
+            readyCallback = callback;
+            readyEvents = xEventGroupCreateStatic( &readyEventsBuffer );
+            pStationNetif = esp_netif_create_default_wifi_sta();
+            err = esp_timer_create( &timerArgs, &leaseTimer );
+        }
+
+        if( err == ESP_OK )
+        {
+            err = esp_wifi_init( &initConfig );
+        }
+
+        if( err == ESP_OK )
+        {
+            /* The driver would otherwise write its configuration to flash on every
+             * attempt. */
+            err = esp_wifi_set_storage( WIFI_STORAGE_RAM );
+        }
+
+        if( err == ESP_OK )
+        {
+            err = esp_event_handler_register( WIFI_EVENT, ESP_EVENT_ANY_ID, eventHandler, NULL );
+        }
+
+        if( err == ESP_OK )
+        {
+            err = esp_event_handler_register( IP_EVENT, ESP_EVENT_ANY_ID, eventHandler, NULL );
+        }
+
+        if( err == ESP_OK )
+        {
+            err = esp_event_handler_register( WIFI_FAST_CONNECT_EVENT, ESP_EVENT_ANY_ID, eventHandler, NULL );
+        }
+
+        if( err == ESP_OK )
+        {
+            err = esp_wifi_set_mode( WIFI_MODE_STA );
+        }
+
+        if( err == ESP_OK )
+        {
+            LogInfo( ( "Connecting to %s, %s.", pSsid,
+                       ( rtcCache.accessPointValid == true ) ? "cached access point" : "scanning" ) );
+            err = esp_wifi_start();
+        }
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Failed to start the Wi-Fi station: %s.", esp_err_to_name( err ) ) );
+        }
+
+        return err;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool WifiFastConnect_WaitReady( void )
+    {
+        bool ready = true;
+
+        /* Without the station, the connect goes ahead as it would have. */
+        if( readyEvents != NULL )
+        {
+            ready = ( xEventGroupWaitBits( readyEvents, READY_BIT, pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS( WIFI_FAST_CONNECT_READY_TIMEOUT_MS ) ) & READY_BIT ) != 0U;
+        }
+
+        if( ready == false )
+        {
+            LogWarn( ( "No address after %u ms.", ( unsigned ) WIFI_FAST_CONNECT_READY_TIMEOUT_MS ) );
+        }
+
+        return ready;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void WifiFastConnect_Invalidate( void )
+    {
+        ( void ) esp_event_post( WIFI_FAST_CONNECT_EVENT, FastConnectEventInvalidate, NULL, 0, portMAX_DELAY );
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if WIFI_FAST_CONNECT_ENABLED */
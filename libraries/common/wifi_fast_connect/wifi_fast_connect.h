@@ -0,0 +1,135 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file wifi_fast_connect.h
+ * @brief Bring up the Wi-Fi station from what the last connection learned.
+ *
+ * A full connect scans every channel for the access point, derives the PMK
+ * from the passphrase with 4096 rounds of PBKDF2 and runs DHCP, which takes
+ * seconds before the first byte goes to the broker. Once connected, the BSSID
+ * and channel of the access point and the PMK are kept in RTC memory and in
+ * NVS, and the DHCP lease in RTC memory. The next connect associates with that
+ * access point directly, on its channel and with the PMK, and, after a wake
+ * from deep sleep or on a reconnect, configures the leased address without a
+ * DHCP exchange while the lease is younger than
+ * #WIFI_FAST_CONNECT_LEASE_REUSE_S. A failed fast association falls back to a
+ * full scan and DHCP.
+ *
+ * #WifiFastConnect_Start returns at once. Pass #WifiFastConnect_WaitReady to
+ * vTlsTransportSetNetworkWait() so a TLS connect started meanwhile waits for
+ * the address and begins its handshake as soon as there is one.
+ */
+
+#ifndef WIFI_FAST_CONNECT_H_
+#define WIFI_FAST_CONNECT_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+
+/* ESP-IDF includes. */
+#include "esp_err.h"
+
+/* Include ESP-IDF configuration. */
+#include "sdkconfig.h"
+
+/**
+ * @brief Whether the Wi-Fi station connects from the cache.
+ */
+#ifndef WIFI_FAST_CONNECT_ENABLED
+    #define WIFI_FAST_CONNECT_ENABLED    CONFIG_WIFI_FAST_CONNECT_ENABLE
+#endif
+
+#if WIFI_FAST_CONNECT_ENABLED
+
+/**
+ * @brief How long a DHCP lease is reused after it was obtained, in seconds.
+ */
+    #ifndef WIFI_FAST_CONNECT_LEASE_REUSE_S
+        #define WIFI_FAST_CONNECT_LEASE_REUSE_S    CONFIG_WIFI_FAST_CONNECT_LEASE_REUSE_S
+    #endif
+
+/**
+ * @brief How long #WifiFastConnect_WaitReady waits for an address, in
+ * milliseconds.
+ */
+    #ifndef WIFI_FAST_CONNECT_READY_TIMEOUT_MS
+        #define WIFI_FAST_CONNECT_READY_TIMEOUT_MS    CONFIG_WIFI_FAST_CONNECT_READY_TIMEOUT_MS
+    #endif
+
+/**
+ * @brief Whether the PMK is derived once and kept, instead of the passphrase
+ * being handed to the Wi-Fi driver on every connect. WPA2-Personal only.
+ */
+    #ifndef WIFI_FAST_CONNECT_CACHE_PMK
+        #define WIFI_FAST_CONNECT_CACHE_PMK    CONFIG_WIFI_FAST_CONNECT_CACHE_PMK
+    #endif
+
+/**
+ * @brief The NVS namespace of the cached access point.
+ */
+    #ifndef WIFI_FAST_CONNECT_NVS_NAMESPACE
+        #define WIFI_FAST_CONNECT_NVS_NAMESPACE    CONFIG_WIFI_FAST_CONNECT_NVS_NAMESPACE
+    #endif
+
+/**
+ * @brief Called from the default event loop the first time the station has
+ * an address.
+ */
+    typedef void ( * WifiFastConnectReadyCallback_t )( void );
+
+/**
+ * @brief Create the Wi-Fi station and start connecting it in the background.
+ *
+ * NVS, the TCP/IP stack and the default event loop must be initialized. The
+ * station reconnects by itself whenever the connection drops.
+ *
+ * @param[in] pSsid The SSID of the network.
+ * @param[in] pPassword The passphrase of the network, empty for an open one.
+ * @param[in] readyCallback Called once the station first has an address, or
+ * NULL.
+ *
+ * @return ESP_OK if the station was started, or the error of the Wi-Fi driver.
+ */
+    esp_err_t WifiFastConnect_Start( const char * pSsid,
+                                     const char * pPassword,
+                                     WifiFastConnectReadyCallback_t readyCallback );
+
+/**
+ * @brief Wait until the station has an address, for up to
+ * #WIFI_FAST_CONNECT_READY_TIMEOUT_MS.
+ *
+ * @return true if the station has an address.
+ */
+    bool WifiFastConnect_WaitReady( void );
+
+/**
+ * @brief Forget the cached access point and lease, in RTC memory and in NVS,
+ * so the next connect scans and runs DHCP. Call it when a connection over a
+ * fast connect keeps failing, such as when the broker can't be reached with
+ * the reused address.
+ */
+    void WifiFastConnect_Invalidate( void );
+
+#endif /* if WIFI_FAST_CONNECT_ENABLED */
+
+#endif /* ifndef WIFI_FAST_CONNECT_H_ */
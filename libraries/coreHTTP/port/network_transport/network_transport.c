@@ -1,115 +1,1284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/select.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_tls.h"
 #include "network_transport.h"
+#include "trace_span.h"
+#include "task_layout.h"
 #include "sdkconfig.h"
 
-TlsTransportStatus_t xTlsConnect( NetworkContext_t* pxNetworkContext )
+#define TRANSPORT_USE_SECURE_ELEMENT    CONFIG_CORE_HTTP_USE_SECURE_ELEMENT
+#define TRANSPORT_USE_DS_PERIPHERAL     CONFIG_CORE_HTTP_USE_DS_PERIPHERAL
+#define TRANSPORT_RECV_WAIT_MS          CONFIG_CORE_HTTP_TRANSPORT_RECV_WAIT_MS
+#define TRANSPORT_SESSION_RESUMPTION    CONFIG_CORE_HTTP_TRANSPORT_SESSION_RESUMPTION
+#define TRANSPORT_SESSION_RTC_RETAIN    CONFIG_CORE_HTTP_TRANSPORT_SESSION_RTC_RETAIN
+#define TRANSPORT_SESSION_RTC_SIZE      CONFIG_CORE_HTTP_TRANSPORT_SESSION_RTC_SIZE
+#define TRANSPORT_CREDENTIAL_CACHE      CONFIG_CORE_HTTP_TRANSPORT_CREDENTIAL_CACHE
+#define TRANSPORT_CREDENTIAL_CACHE_SIZE CONFIG_CORE_HTTP_TRANSPORT_CREDENTIAL_CACHE_SIZE
+#define TRANSPORT_WRITEV_BUFFER_SIZE    CONFIG_CORE_HTTP_TRANSPORT_WRITEV_BUFFER_SIZE
+#define TRANSPORT_CONNECT_TIMEOUT_MS    CONFIG_CORE_HTTP_TRANSPORT_CONNECT_TIMEOUT_MS
+#define TRANSPORT_DYNAMIC_BUFFERS       CONFIG_CORE_HTTP_TRANSPORT_TLS_BUFFERS_DYNAMIC
+
+/* The task layout profile replaces the settings of the connect task. */
+#if TASK_LAYOUT_ENABLED
+#define TRANSPORT_ASYNC_STACK_SIZE      ( TaskLayout_Get( TASK_LAYOUT_PROFILE, TaskLayoutNetwork ).stackSize )
+#define TRANSPORT_ASYNC_PRIORITY        ( TaskLayout_Get( TASK_LAYOUT_PROFILE, TaskLayoutNetwork ).priority )
+#define TRANSPORT_ASYNC_CORE            ( TaskLayout_Get( TASK_LAYOUT_PROFILE, TaskLayoutNetwork ).core )
+#else
+#define TRANSPORT_ASYNC_STACK_SIZE      CONFIG_CORE_HTTP_TRANSPORT_ASYNC_CONNECT_STACK_SIZE
+#define TRANSPORT_ASYNC_PRIORITY        CONFIG_CORE_HTTP_TRANSPORT_ASYNC_CONNECT_PRIORITY
+#define TRANSPORT_ASYNC_CORE            tskNO_AFFINITY
+#endif
+
+/* How often a non-blocking handshake is stepped. */
+#define TRANSPORT_ASYNC_POLL_MS         10
+
+#if TRANSPORT_SESSION_RESUMPTION
+#include "mbedtls/ssl.h"
+#if TRANSPORT_SESSION_RTC_RETAIN
+#include "esp_attr.h"
+#endif
+
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE( member ) member
+#endif
+
+#endif
+
+#if TRANSPORT_CREDENTIAL_CACHE
+#include "mbedtls/pem.h"
+#endif
+
+#if TRANSPORT_DYNAMIC_BUFFERS
+#include "mbedtls/ssl.h"
+
+/* The profile selects it, unless its dependencies are not met. */
+#if !CONFIG_MBEDTLS_DYNAMIC_BUFFER
+#error "Dynamic TLS record buffers need CONFIG_MBEDTLS_DYNAMIC_BUFFER."
+#endif
+#endif
+
+static const char *TAG = "tls_transport";
+
+/* Bucket upper bounds in microseconds; the last bucket is unbounded. */
+static const uint32_t ulHistogramBoundsUs[ TLS_TRANSPORT_HISTOGRAM_BUCKETS - 1 ] =
+{
+    100, 1000, 10000, 100000, 1000000
+};
+
+static void prvHistogramRecord( TlsTransportHistogram_t* pxHistogram, int64_t llDurationUs )
+{
+    uint32_t ulDurationUs = ( llDurationUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) llDurationUs;
+    size_t i = 0;
+
+    while (i < TLS_TRANSPORT_HISTOGRAM_BUCKETS - 1 && ulDurationUs >= ulHistogramBoundsUs[i])
+    {
+        i++;
+    }
+
+    pxHistogram->ulBuckets[i]++;
+    pxHistogram->ullTotalUs += ulDurationUs;
+    if (ulDurationUs > pxHistogram->ulMaxUs)
+    {
+        pxHistogram->ulMaxUs = ulDurationUs;
+    }
+}
+
+/* Take an I/O lock, recording how long the caller waited for it. */
+static void prvLockTake( NetworkContext_t* pxNetworkContext, SemaphoreHandle_t xLock,
+    TlsTransportHistogram_t* pxWaitHistogram )
+{
+    int64_t llStart = ( pxNetworkContext->pxMetrics != NULL ) ? esp_timer_get_time() : 0;
+
+    xSemaphoreTake(xLock, portMAX_DELAY);
+
+    if (pxNetworkContext->pxMetrics != NULL)
+    {
+        prvHistogramRecord(pxWaitHistogram, esp_timer_get_time() - llStart);
+    }
+}
+
+#define prvSendLockTake( pxCtx ) \
+    prvLockTake(( pxCtx ), ( pxCtx )->xTlsSendSemaphore, \
+        ( pxCtx )->pxMetrics ? &( pxCtx )->pxMetrics->xSendLockWait : NULL)
+#define prvRecvLockTake( pxCtx ) \
+    prvLockTake(( pxCtx ), ( pxCtx )->xTlsRecvSemaphore, \
+        ( pxCtx )->pxMetrics ? &( pxCtx )->pxMetrics->xRecvLockWait : NULL)
+
+static int32_t prvMeteredWrite( NetworkContext_t* pxNetworkContext, esp_tls_t* pxTls,
+    const void* pvData, size_t uxDataLen )
+{
+    TlsTransportMetrics_t* pxMetrics = pxNetworkContext->pxMetrics;
+    int64_t llStart = ( pxMetrics != NULL ) ? esp_timer_get_time() : 0;
+    int32_t lRet = esp_tls_conn_write(pxTls, pvData, uxDataLen);
+
+#if TRANSPORT_DYNAMIC_BUFFERS
+    /* Record buffers are allocated per record, so a connection can run out
+     * of heap long after the handshake. */
+    if (lRet == MBEDTLS_ERR_SSL_ALLOC_FAILED)
+    {
+        ESP_LOGE(TAG, "No heap for a TLS record to send.");
+    }
+#endif
+
+    if (pxMetrics != NULL)
+    {
+        prvHistogramRecord(&pxMetrics->xSendLatency, esp_timer_get_time() - llStart);
+        pxMetrics->ulSendCalls++;
+        if (lRet > 0)
+        {
+            pxMetrics->ullBytesSent += lRet;
+        }
+        else if (lRet == ESP_TLS_ERR_SSL_WANT_WRITE || lRet == ESP_TLS_ERR_SSL_WANT_READ)
+        {
+            pxMetrics->ulSendWantCount++;
+        }
+        else
+        {
+            pxMetrics->ulSendErrors++;
+        }
+    }
+
+    return lRet;
+}
+
+static int32_t prvMeteredRead( NetworkContext_t* pxNetworkContext, esp_tls_t* pxTls,
+    void* pvData, size_t uxDataLen )
+{
+    TlsTransportMetrics_t* pxMetrics = pxNetworkContext->pxMetrics;
+    int64_t llStart = ( pxMetrics != NULL ) ? esp_timer_get_time() : 0;
+    int32_t lRet = esp_tls_conn_read(pxTls, pvData, uxDataLen);
+
+#if TRANSPORT_DYNAMIC_BUFFERS
+    /* Record buffers are allocated per record, so a connection can run out
+     * of heap long after the handshake. */
+    if (lRet == MBEDTLS_ERR_SSL_ALLOC_FAILED)
+    {
+        ESP_LOGE(TAG, "No heap for a TLS record to receive.");
+    }
+#endif
+
+    if (pxMetrics != NULL)
+    {
+        prvHistogramRecord(&pxMetrics->xRecvLatency, esp_timer_get_time() - llStart);
+        pxMetrics->ulRecvCalls++;
+        if (lRet > 0)
+        {
+            pxMetrics->ullBytesReceived += lRet;
+        }
+        else if (lRet == ESP_TLS_ERR_SSL_WANT_WRITE || lRet == ESP_TLS_ERR_SSL_WANT_READ)
+        {
+            pxMetrics->ulRecvWantCount++;
+        }
+        else
+        {
+            pxMetrics->ulRecvErrors++;
+        }
+    }
+
+    return lRet;
+}
+
+static void prvHistogramLog( const char* pcName, const TlsTransportHistogram_t* pxHistogram )
+{
+    const uint32_t* b = pxHistogram->ulBuckets;
+
+    ESP_LOGI(TAG, "%s: <100us %u, <1ms %u, <10ms %u, <100ms %u, <1s %u, >=1s %u, max %uus, total %llums",
+        pcName, (unsigned) b[0], (unsigned) b[1], (unsigned) b[2], (unsigned) b[3],
+        (unsigned) b[4], (unsigned) b[5], (unsigned) pxHistogram->ulMaxUs,
+        (unsigned long long) ( pxHistogram->ullTotalUs / 1000 ));
+}
+
+void vTlsTransportMetricsGet( const NetworkContext_t* pxNetworkContext,
+    TlsTransportMetrics_t* pxMetricsOut )
+{
+    if (pxNetworkContext->pxMetrics != NULL)
+    {
+        memcpy(pxMetricsOut, pxNetworkContext->pxMetrics, sizeof(TlsTransportMetrics_t));
+    }
+    else
+    {
+        memset(pxMetricsOut, 0, sizeof(TlsTransportMetrics_t));
+    }
+}
+
+void vTlsTransportMetricsReset( NetworkContext_t* pxNetworkContext )
+{
+    if (pxNetworkContext->pxMetrics != NULL)
+    {
+        memset(pxNetworkContext->pxMetrics, 0, sizeof(TlsTransportMetrics_t));
+    }
+}
+
+void vTlsTransportMetricsDump( const NetworkContext_t* pxNetworkContext )
+{
+    const TlsTransportMetrics_t* pxMetrics = pxNetworkContext->pxMetrics;
+
+    if (pxMetrics == NULL)
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "%s:%d sent %llu bytes in %u calls (%u would block, %u errors)",
+        pxNetworkContext->pcHostname, pxNetworkContext->xPort,
+        (unsigned long long) pxMetrics->ullBytesSent, (unsigned) pxMetrics->ulSendCalls,
+        (unsigned) pxMetrics->ulSendWantCount, (unsigned) pxMetrics->ulSendErrors);
+    ESP_LOGI(TAG, "%s:%d received %llu bytes in %u calls (%u would block, %u errors)",
+        pxNetworkContext->pcHostname, pxNetworkContext->xPort,
+        (unsigned long long) pxMetrics->ullBytesReceived, (unsigned) pxMetrics->ulRecvCalls,
+        (unsigned) pxMetrics->ulRecvWantCount, (unsigned) pxMetrics->ulRecvErrors);
+    ESP_LOGI(TAG, "Handshakes: %u failed", (unsigned) pxMetrics->ulHandshakeFailures);
+    prvHistogramLog("Send latency", &pxMetrics->xSendLatency);
+    prvHistogramLog("Recv latency", &pxMetrics->xRecvLatency);
+    prvHistogramLog("Send lock wait", &pxMetrics->xSendLockWait);
+    prvHistogramLog("Recv lock wait", &pxMetrics->xRecvLockWait);
+    prvHistogramLog("Handshake", &pxMetrics->xHandshake);
+}
+
+/* Create the I/O lock the first time a context is connected. mbedTLS 2.x does
+ * not support concurrent mbedtls_ssl_read() and mbedtls_ssl_write() on one
+ * context (both may touch the record layer and the session state), so sends
+ * and receives share a single lock. It is only released around the select()
+ * wait for incoming data. */
+static void prvInitIoLocks( NetworkContext_t* pxNetworkContext )
+{
+    if (pxNetworkContext->xTlsSendSemaphore == NULL)
+    {
+        pxNetworkContext->xTlsSendSemaphore =
+            xSemaphoreCreateMutexStatic(&pxNetworkContext->xTlsSendSemaphoreBuffer);
+    }
+
+    pxNetworkContext->xTlsRecvSemaphore = pxNetworkContext->xTlsSendSemaphore;
+}
+
+/* Take the I/O lock so that no send or receive can be using pxTls. */
+static void prvTakeIoLocks( NetworkContext_t* pxNetworkContext )
+{
+    xSemaphoreTake(pxNetworkContext->xTlsSendSemaphore, portMAX_DELAY);
+}
+
+static void prvGiveIoLocks( NetworkContext_t* pxNetworkContext )
+{
+    xSemaphoreGive(pxNetworkContext->xTlsSendSemaphore);
+}
+
+/* Wait, without holding any lock, until the socket has data to read.
+ * Returns 1 if readable, 0 on timeout and -1 on error. */
+static int prvWaitForReadable( int xSockFd )
+{
+    fd_set xReadSet;
+    struct timeval xTimeout = {
+        .tv_sec = TRANSPORT_RECV_WAIT_MS / 1000,
+        .tv_usec = ( TRANSPORT_RECV_WAIT_MS % 1000 ) * 1000,
+    };
+
+    FD_ZERO(&xReadSet);
+    FD_SET(xSockFd, &xReadSet);
+
+    int xRet = select(xSockFd + 1, &xReadSet, NULL, NULL, &xTimeout);
+    if (xRet < 0)
+    {
+        return -1;
+    }
+
+    return ( xRet > 0 ) ? 1 : 0;
+}
+
+#if TRANSPORT_SESSION_RESUMPTION
+
+#if TRANSPORT_SESSION_RTC_RETAIN
+/* Serialised session kept across deep sleep. Tagged with the endpoint so a
+ * session is never offered to a different server. */
+typedef struct RtcSession
+{
+    uint32_t ulEndpointHash;
+    uint32_t ulLength;
+    uint8_t ucData[ TRANSPORT_SESSION_RTC_SIZE ];
+} RtcSession_t;
+
+static RTC_DATA_ATTR RtcSession_t xRtcSession;
+
+static uint32_t prvEndpointHash( const NetworkContext_t* pxNetworkContext )
+{
+    /* FNV-1a over the host name followed by the port. */
+    uint32_t ulHash = 2166136261U;
+    const char* pcHost = pxNetworkContext->pcHostname;
+
+    while (*pcHost != '\0')
+    {
+        ulHash = ( ulHash ^ ( uint8_t ) *pcHost++ ) * 16777619U;
+    }
+
+    return ( ulHash ^ ( uint32_t ) pxNetworkContext->xPort ) * 16777619U;
+}
+
+static void prvRtcSessionSave( const NetworkContext_t* pxNetworkContext )
+{
+    size_t uxLength = 0;
+
+    xRtcSession.ulLength = 0;
+    if (mbedtls_ssl_session_save(&pxNetworkContext->pxTlsSession->saved_session,
+            xRtcSession.ucData, sizeof(xRtcSession.ucData), &uxLength) == 0)
+    {
+        xRtcSession.ulEndpointHash = prvEndpointHash(pxNetworkContext);
+        xRtcSession.ulLength = uxLength;
+    }
+    else
+    {
+        ESP_LOGW(TAG, "TLS session does not fit in %d bytes of RTC memory.",
+            TRANSPORT_SESSION_RTC_SIZE);
+    }
+}
+
+static void prvRtcSessionRestore( NetworkContext_t* pxNetworkContext )
+{
+    if (xRtcSession.ulLength == 0 ||
+        xRtcSession.ulEndpointHash != prvEndpointHash(pxNetworkContext))
+    {
+        return;
+    }
+
+    esp_tls_client_session_t* pxSession = calloc(1, sizeof(esp_tls_client_session_t));
+    if (pxSession == NULL)
+    {
+        return;
+    }
+
+    mbedtls_ssl_session_init(&pxSession->saved_session);
+    if (mbedtls_ssl_session_load(&pxSession->saved_session,
+            xRtcSession.ucData, xRtcSession.ulLength) == 0)
+    {
+        pxNetworkContext->pxTlsSession = pxSession;
+    }
+    else
+    {
+        esp_tls_free_client_session(pxSession);
+        xRtcSession.ulLength = 0;
+    }
+}
+#endif /* TRANSPORT_SESSION_RTC_RETAIN */
+
+/* With session tickets the client sends a random session ID, and the server
+ * echoes it back only when it accepts the ticket. */
+static bool prvSessionWasResumed( const esp_tls_client_session_t* pxOffered,
+    const esp_tls_client_session_t* pxNegotiated )
+{
+    const mbedtls_ssl_session* pxOld = &pxOffered->saved_session;
+    const mbedtls_ssl_session* pxNew = &pxNegotiated->saved_session;
+
+    return pxOld->MBEDTLS_PRIVATE(id_len) != 0 &&
+        pxOld->MBEDTLS_PRIVATE(id_len) == pxNew->MBEDTLS_PRIVATE(id_len) &&
+        memcmp(pxOld->MBEDTLS_PRIVATE(id), pxNew->MBEDTLS_PRIVATE(id),
+            pxOld->MBEDTLS_PRIVATE(id_len)) == 0;
+}
+
+/* Replace the cached session with the one just negotiated on pxTls. */
+static void prvSessionUpdate( NetworkContext_t* pxNetworkContext, esp_tls_t* pxTls )
+{
+    esp_tls_client_session_t* pxNegotiated = esp_tls_get_client_session(pxTls);
+
+    if (pxNetworkContext->pxTlsSession != NULL && pxNegotiated != NULL &&
+        prvSessionWasResumed(pxNetworkContext->pxTlsSession, pxNegotiated))
+    {
+        pxNetworkContext->ulResumedHandshakeCount++;
+    }
+    else
+    {
+        pxNetworkContext->ulFullHandshakeCount++;
+    }
+
+    ESP_LOGD(TAG, "TLS handshakes: %u full, %u resumed.",
+        (unsigned) pxNetworkContext->ulFullHandshakeCount,
+        (unsigned) pxNetworkContext->ulResumedHandshakeCount);
+
+    if (pxNetworkContext->pxTlsSession != NULL)
+    {
+        esp_tls_free_client_session(pxNetworkContext->pxTlsSession);
+    }
+    pxNetworkContext->pxTlsSession = pxNegotiated;
+
+#if TRANSPORT_SESSION_RTC_RETAIN
+    if (pxNegotiated != NULL)
+    {
+        prvRtcSessionSave(pxNetworkContext);
+    }
+#endif
+}
+
+#endif /* TRANSPORT_SESSION_RESUMPTION */
+
+void vTlsSessionClear( NetworkContext_t* pxNetworkContext )
+{
+#if TRANSPORT_SESSION_RESUMPTION
+    xSemaphoreTake(pxNetworkContext->xTlsContextSemaphore, portMAX_DELAY);
+    if (pxNetworkContext->pxTlsSession != NULL)
+    {
+        esp_tls_free_client_session(pxNetworkContext->pxTlsSession);
+        pxNetworkContext->pxTlsSession = NULL;
+    }
+#if TRANSPORT_SESSION_RTC_RETAIN
+    xRtcSession.ulLength = 0;
+#endif
+    xSemaphoreGive(pxNetworkContext->xTlsContextSemaphore);
+#else
+    ( void ) pxNetworkContext;
+#endif
+}
+
+#if TRANSPORT_CREDENTIAL_CACHE
+
+/* A PEM credential converted once to the buffer handed to esp-tls. Entries
+ * are keyed on the application's PEM pointer and reference counted so an
+ * invalidation never frees a buffer that a handshake in progress uses. */
+typedef struct CachedCredential
+{
+    const char* pcPem;
+    const unsigned char* pucData;
+    size_t uxLength;
+    unsigned char* pucDer;
+    uint32_t ulRefCount;
+    bool xStale;
+} CachedCredential_t;
+
+static CachedCredential_t xCredentialCache[ TRANSPORT_CREDENTIAL_CACHE_SIZE ];
+
+/* The root CA parsed into the esp-tls global CA store, so it is X.509 parsed
+ * once instead of on every handshake. */
+static const char* pcGlobalCaPem;
+static uint32_t ulGlobalCaRefCount;
+static bool xGlobalCaStale;
+
+static SemaphoreHandle_t xCredentialCacheLock;
+static StaticSemaphore_t xCredentialCacheLockBuffer;
+
+/* Create the lock the first time the cache is used. A constructor would run
+ * before the scheduler is started, when no FreeRTOS object may be created. */
+static SemaphoreHandle_t prvCredentialCacheLock( void )
+{
+    /* 0 before, 1 while a task creates the lock, 2 once it is created. */
+    static uint32_t ulLockInitState;
+    uint32_t ulExpected = 0;
+
+    if (__atomic_load_n(&ulLockInitState, __ATOMIC_ACQUIRE) == 2)
+    {
+        return xCredentialCacheLock;
+    }
+
+    if (__atomic_compare_exchange_n(&ulLockInitState, &ulExpected, 1, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        xCredentialCacheLock = xSemaphoreCreateMutexStatic(&xCredentialCacheLockBuffer);
+        __atomic_store_n(&ulLockInitState, 2, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        while (__atomic_load_n(&ulLockInitState, __ATOMIC_ACQUIRE) != 2)
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    return xCredentialCacheLock;
+}
+
+/* Convert a single-object PEM buffer to DER. Chains and encrypted keys are
+ * left as PEM, where esp-tls handles them as before. */
+static void prvConvertToDer( CachedCredential_t* pxEntry )
+{
+    static const char cBegin[] = "-----BEGIN ";
+    char cHeader[ 64 ];
+    char cFooter[ 64 ];
+    const char* pcLabel = strstr(pxEntry->pcPem, cBegin);
+    const char* pcLabelEnd = ( pcLabel != NULL ) ? strstr(pcLabel + sizeof(cBegin) - 1, "-----") : NULL;
+
+    if (pcLabelEnd == NULL || strstr(pcLabelEnd, cBegin) != NULL)
+    {
+        return;
+    }
+
+    int xLabelLen = ( int ) ( pcLabelEnd - ( pcLabel + sizeof(cBegin) - 1 ) );
+    snprintf(cHeader, sizeof(cHeader), "-----BEGIN %.*s-----", xLabelLen, pcLabel + sizeof(cBegin) - 1);
+    snprintf(cFooter, sizeof(cFooter), "-----END %.*s-----", xLabelLen, pcLabel + sizeof(cBegin) - 1);
+
+    mbedtls_pem_context xPem;
+    size_t uxUsed = 0;
+    const unsigned char* pucDer;
+    size_t uxDerLen;
+
+    mbedtls_pem_init(&xPem);
+    if (mbedtls_pem_read_buffer(&xPem, cHeader, cFooter,
+            ( const unsigned char* ) pxEntry->pcPem, NULL, 0, &uxUsed) == 0 &&
+        ( pucDer = mbedtls_pem_get_buffer(&xPem, &uxDerLen) ) != NULL &&
+        ( pxEntry->pucDer = malloc(uxDerLen) ) != NULL)
+    {
+        memcpy(pxEntry->pucDer, pucDer, uxDerLen);
+        pxEntry->pucData = pxEntry->pucDer;
+        pxEntry->uxLength = uxDerLen;
+    }
+    mbedtls_pem_free(&xPem);
+}
+
+/* Look up or create the cache entry for pcPem. Returns NULL if the credential
+ * is absent or the cache is full, in which case the PEM is used directly. */
+static CachedCredential_t* prvCredentialAcquire( const char* pcPem )
+{
+    CachedCredential_t* pxEntry = NULL;
+    CachedCredential_t* pxFree = NULL;
+
+    if (pcPem == NULL)
+    {
+        return NULL;
+    }
+
+    xSemaphoreTake(prvCredentialCacheLock(), portMAX_DELAY);
+    for (int i = 0; i < TRANSPORT_CREDENTIAL_CACHE_SIZE; i++)
+    {
+        if (xCredentialCache[i].pcPem == pcPem && !xCredentialCache[i].xStale)
+        {
+            pxEntry = &xCredentialCache[i];
+            break;
+        }
+        if (xCredentialCache[i].pcPem == NULL && pxFree == NULL)
+        {
+            pxFree = &xCredentialCache[i];
+        }
+    }
+
+    if (pxEntry == NULL && pxFree != NULL)
+    {
+        pxEntry = pxFree;
+        pxEntry->pcPem = pcPem;
+        pxEntry->pucData = ( const unsigned char* ) pcPem;
+        pxEntry->uxLength = strlen(pcPem) + 1;
+        pxEntry->pucDer = NULL;
+        pxEntry->xStale = false;
+        prvConvertToDer(pxEntry);
+        ESP_LOGD(TAG, "Cached credential %p as %s.", pcPem,
+            ( pxEntry->pucDer != NULL ) ? "DER" : "PEM");
+    }
+
+    if (pxEntry != NULL)
+    {
+        pxEntry->ulRefCount++;
+    }
+    xSemaphoreGive(xCredentialCacheLock);
+
+    return pxEntry;
+}
+
+static void prvCredentialRelease( CachedCredential_t* pxEntry )
+{
+    if (pxEntry == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(prvCredentialCacheLock(), portMAX_DELAY);
+    if (--pxEntry->ulRefCount == 0 && pxEntry->xStale)
+    {
+        free(pxEntry->pucDer);
+        memset(pxEntry, 0, sizeof(*pxEntry));
+    }
+    xSemaphoreGive(xCredentialCacheLock);
+}
+
+/* Use the global CA store for pcPem if it holds, or can be made to hold,
+ * that CA. Returns true if the caller must release it after the handshake. */
+static bool prvGlobalCaAcquire( const char* pcPem, size_t uxLength )
+{
+    bool xAcquired = false;
+
+    xSemaphoreTake(prvCredentialCacheLock(), portMAX_DELAY);
+    if (xGlobalCaStale && ulGlobalCaRefCount == 0 && pcGlobalCaPem != NULL)
+    {
+        esp_tls_free_global_ca_store();
+        pcGlobalCaPem = NULL;
+        xGlobalCaStale = false;
+    }
+
+    if (pcGlobalCaPem == NULL && !xGlobalCaStale &&
+        esp_tls_set_global_ca_store(( const unsigned char* ) pcPem, uxLength) == ESP_OK)
+    {
+        pcGlobalCaPem = pcPem;
+    }
+
+    if (pcGlobalCaPem == pcPem && !xGlobalCaStale)
+    {
+        ulGlobalCaRefCount++;
+        xAcquired = true;
+    }
+    xSemaphoreGive(xCredentialCacheLock);
+
+    return xAcquired;
+}
+
+static void prvGlobalCaRelease( void )
+{
+    xSemaphoreTake(prvCredentialCacheLock(), portMAX_DELAY);
+    if (--ulGlobalCaRefCount == 0 && xGlobalCaStale)
+    {
+        esp_tls_free_global_ca_store();
+        pcGlobalCaPem = NULL;
+        xGlobalCaStale = false;
+    }
+    xSemaphoreGive(xCredentialCacheLock);
+}
+
+#endif /* TRANSPORT_CREDENTIAL_CACHE */
+
+void vTlsCredentialCacheInvalidate( void )
+{
+#if TRANSPORT_CREDENTIAL_CACHE
+    xSemaphoreTake(prvCredentialCacheLock(), portMAX_DELAY);
+    for (int i = 0; i < TRANSPORT_CREDENTIAL_CACHE_SIZE; i++)
+    {
+        CachedCredential_t* pxEntry = &xCredentialCache[i];
+
+        if (pxEntry->pcPem == NULL)
+        {
+            continue;
+        }
+        if (pxEntry->ulRefCount == 0)
+        {
+            free(pxEntry->pucDer);
+            memset(pxEntry, 0, sizeof(*pxEntry));
+        }
+        else
+        {
+            pxEntry->xStale = true;
+        }
+    }
+
+    if (pcGlobalCaPem != NULL)
+    {
+        if (ulGlobalCaRefCount == 0)
+        {
+            esp_tls_free_global_ca_store();
+            pcGlobalCaPem = NULL;
+        }
+        else
+        {
+            xGlobalCaStale = true;
+        }
+    }
+    xSemaphoreGive(xCredentialCacheLock);
+#endif
+}
+
+/* The length esp-tls expects for a credential: the DER length if one is
+ * set, or the PEM string and its terminator. */
+static size_t prvCredentialLength( const char* pcCredential, size_t uxDerLength )
+{
+    return ( uxDerLength != 0 ) ? uxDerLength : strlen( pcCredential ) + 1;
+}
+
+/* Step a non-blocking handshake until it completes, fails or times out, then
+ * put the socket back into blocking mode so reads and writes behave as they
+ * do after a synchronous connect. */
+static int prvHandshakeNonBlocking( NetworkContext_t* pxNetworkContext,
+    const esp_tls_cfg_t* pxConfig, esp_tls_t* pxTls )
+{
+    TickType_t xStart = xTaskGetTickCount();
+    int xRet;
+
+    while ((xRet = esp_tls_conn_new_async( pxNetworkContext->pcHostname,
+            strlen( pxNetworkContext->pcHostname ),
+            pxNetworkContext->xPort,
+            pxConfig, pxTls)) == 0)
+    {
+        if (( xTaskGetTickCount() - xStart ) >= pdMS_TO_TICKS( pxConfig->timeout_ms ))
+        {
+            return -1;
+        }
+        vTaskDelay(pdMS_TO_TICKS( TRANSPORT_ASYNC_POLL_MS ));
+    }
+
+    int xSockFd = -1;
+    if (xRet > 0 && esp_tls_get_conn_sockfd(pxTls, &xSockFd) == ESP_OK)
+    {
+        fcntl(xSockFd, F_SETFL, fcntl(xSockFd, F_GETFL, 0) & ~O_NONBLOCK);
+    }
+
+    return xRet;
+}
+
+static TlsTransportStatus_t prvTlsConnect( NetworkContext_t* pxNetworkContext, bool xNonBlocking )
 {
     TlsTransportStatus_t xRet = TLS_TRANSPORT_SUCCESS;
 
+    /* A plain TCP connection takes none of the credentials, which may be NULL. */
+    bool xTls = !pxNetworkContext->xPlainTcp;
+
     esp_tls_cfg_t xEspTlsConfig = {
-        .cacert_buf = (const unsigned char*) ( pxNetworkContext->pcServerRootCAPem ),
-        .cacert_bytes = strlen( pxNetworkContext->pcServerRootCAPem ) + 1,
-        .clientcert_buf = (const unsigned char*) ( pxNetworkContext->pcClientCertPem ),
-        .clientcert_bytes = strlen( pxNetworkContext->pcClientCertPem ) + 1,
         .skip_common_name = pxNetworkContext->disableSni,
         .alpn_protos = pxNetworkContext->pAlpnProtos,
-#if CONFIG_CORE_HTTP_USE_SECURE_ELEMENT
+#if TRANSPORT_USE_SECURE_ELEMENT
         .use_secure_element = true,
-#elif CONFIG_CORE_HTTP_USE_DS_PERIPHERAL
+#elif TRANSPORT_USE_DS_PERIPHERAL
         .ds_data = pxNetworkContext->ds_data,
 #else
         .use_secure_element = false,
         .ds_data = NULL,
-        .clientkey_buf = ( const unsigned char* )( pxNetworkContext->pcClientKeyPem ),
-        .clientkey_bytes = strlen( pxNetworkContext->pcClientKeyPem ) + 1,
 #endif
-        .timeout_ms = 3000,
+        .timeout_ms = ( pxNetworkContext->ulConnectTimeoutMs != 0 ) ?
+            ( int ) pxNetworkContext->ulConnectTimeoutMs : TRANSPORT_CONNECT_TIMEOUT_MS,
+        .non_block = xNonBlocking,
+        .is_plain_tcp = !xTls,
     };
 
-    esp_tls_t* pxTls = esp_tls_init();
+#if TRANSPORT_CREDENTIAL_CACHE
+    /* DER credentials are already in the form the cache would convert to. */
+    CachedCredential_t* pxCaEntry = NULL;
+    CachedCredential_t* pxCertEntry = ( xTls && pxNetworkContext->uxClientCertLength == 0 ) ?
+        prvCredentialAcquire(pxNetworkContext->pcClientCertPem) : NULL;
+    bool xUseGlobalCa = xTls && prvGlobalCaAcquire(pxNetworkContext->pcServerRootCAPem,
+        prvCredentialLength(pxNetworkContext->pcServerRootCAPem, pxNetworkContext->uxServerRootCALength));
+
+    if (xUseGlobalCa)
+    {
+        xEspTlsConfig.use_global_ca_store = true;
+    }
+    else if (xTls && pxNetworkContext->uxServerRootCALength == 0 &&
+        ( pxCaEntry = prvCredentialAcquire(pxNetworkContext->pcServerRootCAPem) ) != NULL)
+    {
+        xEspTlsConfig.cacert_buf = pxCaEntry->pucData;
+        xEspTlsConfig.cacert_bytes = pxCaEntry->uxLength;
+    }
+    else
+#endif
+    if (xTls)
+    {
+        xEspTlsConfig.cacert_buf = (const unsigned char*) ( pxNetworkContext->pcServerRootCAPem );
+        xEspTlsConfig.cacert_bytes = prvCredentialLength( pxNetworkContext->pcServerRootCAPem,
+            pxNetworkContext->uxServerRootCALength );
+    }
+
+#if TRANSPORT_CREDENTIAL_CACHE
+    if (pxCertEntry != NULL)
+    {
+        xEspTlsConfig.clientcert_buf = pxCertEntry->pucData;
+        xEspTlsConfig.clientcert_bytes = pxCertEntry->uxLength;
+    }
+    else
+#endif
+    if (xTls && pxNetworkContext->pcClientCertPem != NULL)
+    {
+        xEspTlsConfig.clientcert_buf = (const unsigned char*) ( pxNetworkContext->pcClientCertPem );
+        xEspTlsConfig.clientcert_bytes = prvCredentialLength( pxNetworkContext->pcClientCertPem,
+            pxNetworkContext->uxClientCertLength );
+    }
+
+#if !TRANSPORT_USE_SECURE_ELEMENT && !TRANSPORT_USE_DS_PERIPHERAL
+#if TRANSPORT_CREDENTIAL_CACHE
+    CachedCredential_t* pxKeyEntry = ( xTls && pxNetworkContext->uxClientKeyLength == 0 ) ?
+        prvCredentialAcquire(pxNetworkContext->pcClientKeyPem) : NULL;
+
+    if (pxKeyEntry != NULL)
+    {
+        xEspTlsConfig.clientkey_buf = pxKeyEntry->pucData;
+        xEspTlsConfig.clientkey_bytes = pxKeyEntry->uxLength;
+    }
+    else
+#endif
+    if (xTls && pxNetworkContext->pcClientKeyPem != NULL)
+    {
+        xEspTlsConfig.clientkey_buf = ( const unsigned char* )( pxNetworkContext->pcClientKeyPem );
+        xEspTlsConfig.clientkey_bytes = prvCredentialLength( pxNetworkContext->pcClientKeyPem,
+            pxNetworkContext->uxClientKeyLength );
+    }
+#endif
 
     xSemaphoreTake(pxNetworkContext->xTlsContextSemaphore, portMAX_DELAY);
-    pxNetworkContext->pxTls = pxTls;
+    prvInitIoLocks(pxNetworkContext);
+
+#if TRANSPORT_SESSION_RESUMPTION
+#if TRANSPORT_SESSION_RTC_RETAIN
+    if (pxNetworkContext->pxTlsSession == NULL)
+    {
+        prvRtcSessionRestore(pxNetworkContext);
+    }
+#endif
+    xEspTlsConfig.client_session = pxNetworkContext->pxTlsSession;
+#endif
+
+    int64_t llHandshakeStart = esp_timer_get_time();
+    esp_tls_t* pxTls = esp_tls_init();
+
+    if (pxTls == NULL)
+    {
+        xRet = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+    }
+    else if (( xNonBlocking ?
+            prvHandshakeNonBlocking(pxNetworkContext, &xEspTlsConfig, pxTls) :
+            esp_tls_conn_new_sync( pxNetworkContext->pcHostname,
+                strlen( pxNetworkContext->pcHostname ),
+                pxNetworkContext->xPort,
+                &xEspTlsConfig, pxTls) ) <= 0)
+    {
+        /* A server refusing the handshake, as when it throttles connections,
+         * is told apart from a host that can't be reached. */
+        esp_tls_error_handle_t pxError = NULL;
+        xRet = ( esp_tls_get_error_handle(pxTls, &pxError) == ESP_OK && pxError != NULL &&
+            pxError->last_error == ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED ) ?
+            TLS_TRANSPORT_HANDSHAKE_FAILED : TLS_TRANSPORT_CONNECT_FAILURE;
+        esp_tls_conn_destroy(pxTls);
+        pxTls = NULL;
+    }
+#if TRANSPORT_SESSION_RESUMPTION
+    else if (xTls)
+    {
+        prvSessionUpdate(pxNetworkContext, pxTls);
+    }
+
+    /* A stale or corrupt session must not keep failing every reconnect. */
+    if (pxTls == NULL && pxNetworkContext->pxTlsSession != NULL)
+    {
+        esp_tls_free_client_session(pxNetworkContext->pxTlsSession);
+        pxNetworkContext->pxTlsSession = NULL;
+#if TRANSPORT_SESSION_RTC_RETAIN
+        xRtcSession.ulLength = 0;
+#endif
+    }
+#else
+    else
+    {
+        pxNetworkContext->ulFullHandshakeCount++;
+    }
+#endif
 
-    if (esp_tls_conn_new_sync( pxNetworkContext->pcHostname, 
-            strlen( pxNetworkContext->pcHostname ), 
-            pxNetworkContext->xPort, 
-            &xEspTlsConfig, pxTls) <= 0)
+    if (pxNetworkContext->pxMetrics != NULL)
     {
-        if (pxNetworkContext->pxTls)
+        if (pxTls != NULL)
+        {
+            prvHistogramRecord(&pxNetworkContext->pxMetrics->xHandshake,
+                esp_timer_get_time() - llHandshakeStart);
+        }
+        else
         {
-            esp_tls_conn_destroy(pxNetworkContext->pxTls);
-            pxNetworkContext->pxTls = NULL;
+            pxNetworkContext->pxMetrics->ulHandshakeFailures++;
         }
-        xRet = TLS_TRANSPORT_CONNECT_FAILURE;
     }
 
+#if TRANSPORT_CREDENTIAL_CACHE
+    /* esp-tls has parsed its copies by now, so the buffers can be released. */
+    if (xUseGlobalCa)
+    {
+        prvGlobalCaRelease();
+    }
+    prvCredentialRelease(pxCaEntry);
+    prvCredentialRelease(pxCertEntry);
+#if !TRANSPORT_USE_SECURE_ELEMENT && !TRANSPORT_USE_DS_PERIPHERAL
+    prvCredentialRelease(pxKeyEntry);
+#endif
+#endif
+
+    /* Publish the session only once the handshake is complete. */
+    prvTakeIoLocks(pxNetworkContext);
+    pxNetworkContext->pxTls = pxTls;
+    pxNetworkContext->ulConnectionGeneration++;
+    prvGiveIoLocks(pxNetworkContext);
+
     xSemaphoreGive(pxNetworkContext->xTlsContextSemaphore);
 
     return xRet;
 }
 
+TlsTransportStatus_t xTlsConnect( NetworkContext_t* pxNetworkContext )
+{
+    return prvTlsConnect(pxNetworkContext, false);
+}
+
+typedef struct AsyncConnectRequest
+{
+    NetworkContext_t* pxNetworkContext;
+    TlsConnectCallback_t xCallback;
+    void* pvUserContext;
+    TaskHandle_t xNotifyTask;
+} AsyncConnectRequest_t;
+
+static void prvAsyncConnectTask( void* pvParameters )
+{
+    AsyncConnectRequest_t* pxRequest = pvParameters;
+    TlsTransportStatus_t xStatus = prvTlsConnect(pxRequest->pxNetworkContext, true);
+
+    if (pxRequest->xCallback != NULL)
+    {
+        pxRequest->xCallback(pxRequest->pxNetworkContext, xStatus, pxRequest->pvUserContext);
+    }
+    else
+    {
+        xTaskNotify(pxRequest->xNotifyTask, ( uint32_t ) xStatus, eSetValueWithOverwrite);
+    }
+
+    vPortFree(pxRequest);
+    vTaskDelete(NULL);
+}
+
+TlsTransportStatus_t xTlsConnectAsync( NetworkContext_t* pxNetworkContext,
+    TlsConnectCallback_t xCallback, void* pvUserContext )
+{
+    if (pxNetworkContext == NULL)
+    {
+        return TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+
+    AsyncConnectRequest_t* pxRequest = pvPortMalloc(sizeof(AsyncConnectRequest_t));
+    if (pxRequest == NULL)
+    {
+        return TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+    }
+
+    pxRequest->pxNetworkContext = pxNetworkContext;
+    pxRequest->xCallback = xCallback;
+    pxRequest->pvUserContext = pvUserContext;
+    pxRequest->xNotifyTask = xTaskGetCurrentTaskHandle();
+
+    if (xTaskCreatePinnedToCore(prvAsyncConnectTask, "tls_connect", TRANSPORT_ASYNC_STACK_SIZE,
+            pxRequest, TRANSPORT_ASYNC_PRIORITY, NULL, TRANSPORT_ASYNC_CORE) != pdPASS)
+    {
+        vPortFree(pxRequest);
+        return TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+    }
+
+    return TLS_TRANSPORT_SUCCESS;
+}
+
 TlsTransportStatus_t xTlsDisconnect( NetworkContext_t* pxNetworkContext )
 {
     BaseType_t xRet = TLS_TRANSPORT_SUCCESS;
 
     xSemaphoreTake(pxNetworkContext->xTlsContextSemaphore, portMAX_DELAY);
-    if (pxNetworkContext->pxTls != NULL && 
+    prvInitIoLocks(pxNetworkContext);
+    prvTakeIoLocks(pxNetworkContext);
+    if (pxNetworkContext->pxTls != NULL &&
         esp_tls_conn_destroy(pxNetworkContext->pxTls) < 0)
     {
         xRet = TLS_TRANSPORT_DISCONNECT_FAILURE;
     }
     pxNetworkContext->pxTls = NULL;
+    pxNetworkContext->ulConnectionGeneration++;
+    pxNetworkContext->uxCorkedBytes = 0;
+    pxNetworkContext->xCorked = false;
+    prvGiveIoLocks(pxNetworkContext);
     xSemaphoreGive(pxNetworkContext->xTlsContextSemaphore);
 
     return xRet;
 }
 
+/* Write all of pucData, returning the number of bytes written. A short count
+ * means the session would block or failed; lLastRet then holds the result of
+ * the failing write. */
+static size_t prvWriteAll( NetworkContext_t* pxNetworkContext, esp_tls_t* pxTls,
+    const uint8_t* pucData, size_t uxLen, int32_t* plLastRet )
+{
+    size_t uxSent = 0;
+
+    while (uxSent < uxLen)
+    {
+        *plLastRet = prvMeteredWrite(pxNetworkContext, pxTls, pucData + uxSent, uxLen - uxSent);
+        if (*plLastRet <= 0)
+        {
+            break;
+        }
+        uxSent += *plLastRet;
+    }
+
+    return uxSent;
+}
+
+/* Write out the cork buffer. Called with the send lock held. Bytes that
+ * could not be written stay at the start of the buffer. Returns 0 once the
+ * buffer is empty, otherwise the result of the failing write. */
+static int32_t prvCorkFlush( NetworkContext_t* pxNetworkContext, esp_tls_t* pxTls )
+{
+    int32_t lLastRet = 0;
+    size_t uxSent = 0;
+
+    if (pxNetworkContext->uxCorkedBytes > 0)
+    {
+        uxSent = prvWriteAll(pxNetworkContext, pxTls, pxNetworkContext->pucCorkBuffer,
+            pxNetworkContext->uxCorkedBytes, &lLastRet);
+        memmove(pxNetworkContext->pucCorkBuffer, pxNetworkContext->pucCorkBuffer + uxSent,
+            pxNetworkContext->uxCorkedBytes - uxSent);
+        pxNetworkContext->uxCorkedBytes -= uxSent;
+    }
+
+    return ( pxNetworkContext->uxCorkedBytes == 0 ) ? 0 : lLastRet;
+}
+
+/* Accept data into the cork buffer, flushing it first if the data does not
+ * fit. Called with the send lock held. Data larger than the whole buffer is
+ * written directly once the buffer is empty, preserving the byte order. */
+static int32_t prvCorkedWrite( NetworkContext_t* pxNetworkContext, esp_tls_t* pxTls,
+    const void* pvData, size_t uxDataLen )
+{
+    int32_t lRet = 0;
+
+    if (pxNetworkContext->uxCorkedBytes + uxDataLen > pxNetworkContext->uxCorkBufferSize)
+    {
+        lRet = prvCorkFlush(pxNetworkContext, pxTls);
+    }
+
+    if (lRet < 0 && lRet != ESP_TLS_ERR_SSL_WANT_WRITE && lRet != ESP_TLS_ERR_SSL_WANT_READ)
+    {
+        return lRet;
+    }
+
+    if (pxNetworkContext->uxCorkedBytes + uxDataLen <= pxNetworkContext->uxCorkBufferSize)
+    {
+        memcpy(pxNetworkContext->pucCorkBuffer + pxNetworkContext->uxCorkedBytes, pvData, uxDataLen);
+        pxNetworkContext->uxCorkedBytes += uxDataLen;
+        return ( int32_t ) uxDataLen;
+    }
+
+    if (pxNetworkContext->uxCorkedBytes > 0)
+    {
+        return ESP_TLS_ERR_SSL_WANT_WRITE; /* The buffer did not drain. */
+    }
+
+    return prvMeteredWrite(pxNetworkContext, pxTls, pvData, uxDataLen);
+}
+
+void vTlsTransportCork( NetworkContext_t* pxNetworkContext )
+{
+    if (pxNetworkContext != NULL && pxNetworkContext->xTlsSendSemaphore != NULL &&
+        pxNetworkContext->pucCorkBuffer != NULL && pxNetworkContext->uxCorkBufferSize > 0)
+    {
+        prvSendLockTake(pxNetworkContext);
+        pxNetworkContext->xCorked = true;
+        xSemaphoreGive(pxNetworkContext->xTlsSendSemaphore);
+    }
+}
+
+int32_t lTlsTransportUncork( NetworkContext_t* pxNetworkContext )
+{
+    int32_t lRet = 0;
+
+    if (pxNetworkContext != NULL && pxNetworkContext->xTlsSendSemaphore != NULL)
+    {
+        prvSendLockTake(pxNetworkContext);
+        /* Every send was reported as complete, so wait out WANT_WRITE. */
+        do
+        {
+            lRet = ( pxNetworkContext->pxTls != NULL ) ?
+                prvCorkFlush(pxNetworkContext, pxNetworkContext->pxTls) : 0;
+        } while (lRet == ESP_TLS_ERR_SSL_WANT_WRITE || lRet == ESP_TLS_ERR_SSL_WANT_READ);
+
+        if (lRet != 0)
+        {
+            ESP_LOGE(TAG, "Failed to flush %u corked bytes, error %ld.",
+                ( unsigned ) pxNetworkContext->uxCorkedBytes, ( long ) lRet);
+            lRet = ( lRet > 0 ) ? -1 : lRet;
+        }
+        pxNetworkContext->uxCorkedBytes = 0;
+        pxNetworkContext->xCorked = false;
+        xSemaphoreGive(pxNetworkContext->xTlsSendSemaphore);
+    }
+
+    return lRet;
+}
+
 int32_t espTlsTransportSend(NetworkContext_t* pxNetworkContext,
     const void* pvData, size_t uxDataLen)
 {
+    TRACE_SPAN_SCOPE( "espTlsTransportSend" );
+
     if (pvData == NULL || uxDataLen == 0)
     {
         return -1;
     }
 
-    int32_t lBytesSent = 0;
+    int32_t lBytesSent = -1;
 
-    if(pxNetworkContext != NULL && pxNetworkContext->pxTls != NULL)
+    if(pxNetworkContext != NULL && pxNetworkContext->xTlsSendSemaphore != NULL)
     {
-        xSemaphoreTake(pxNetworkContext->xTlsContextSemaphore, portMAX_DELAY);
-        lBytesSent = esp_tls_conn_write(pxNetworkContext->pxTls, pvData, uxDataLen);
-        xSemaphoreGive(pxNetworkContext->xTlsContextSemaphore);
+        prvSendLockTake(pxNetworkContext);
+        if (pxNetworkContext->pxTls != NULL)
+        {
+            lBytesSent = pxNetworkContext->xCorked ?
+                prvCorkedWrite(pxNetworkContext, pxNetworkContext->pxTls, pvData, uxDataLen) :
+                prvMeteredWrite(pxNetworkContext, pxNetworkContext->pxTls, pvData, uxDataLen);
+        }
+        xSemaphoreGive(pxNetworkContext->xTlsSendSemaphore);
     }
-    else
+
+    if (lBytesSent == ESP_TLS_ERR_SSL_WANT_WRITE || lBytesSent == ESP_TLS_ERR_SSL_WANT_READ)
     {
-        lBytesSent = -1;
+        lBytesSent = 0;
     }
 
     return lBytesSent;
 }
 
+int32_t espTlsTransportWritev(NetworkContext_t* pxNetworkContext,
+    TlsTransportOutVector_t* pxIoVec, size_t uxIoVecCount)
+{
+    TRACE_SPAN_SCOPE( "espTlsTransportWritev" );
+
+    if (pxIoVec == NULL || uxIoVecCount == 0)
+    {
+        return -1;
+    }
+    if (pxNetworkContext == NULL || pxNetworkContext->xTlsSendSemaphore == NULL)
+    {
+        return -1;
+    }
+
+    uint8_t ucStaging[ TRANSPORT_WRITEV_BUFFER_SIZE ];
+    size_t uxStaged = 0;
+    size_t uxTotalSent = 0;
+    int32_t lLastRet = 0;
+    bool xShort = false;
+
+    prvSendLockTake(pxNetworkContext);
+    esp_tls_t* pxTls = pxNetworkContext->pxTls;
+
+    /* While corked, the cork buffer does the packing. */
+    for (size_t i = 0; pxTls != NULL && pxNetworkContext->xCorked && i < uxIoVecCount && !xShort; i++)
+    {
+        lLastRet = prvCorkedWrite(pxNetworkContext, pxTls, pxIoVec[i].iov_base, pxIoVec[i].iov_len);
+        if (lLastRet > 0)
+        {
+            uxTotalSent += lLastRet;
+        }
+        xShort = ( lLastRet < ( int32_t ) pxIoVec[i].iov_len );
+    }
+
+    for (size_t i = 0; pxTls != NULL && !pxNetworkContext->xCorked && i < uxIoVecCount && !xShort; i++)
+    {
+        const uint8_t* pucBase = pxIoVec[i].iov_base;
+        size_t uxLen = pxIoVec[i].iov_len;
+
+        if (uxStaged + uxLen > sizeof(ucStaging) && uxStaged > 0)
+        {
+            size_t uxSent = prvWriteAll(pxNetworkContext, pxTls, ucStaging, uxStaged, &lLastRet);
+
+            uxTotalSent += uxSent;
+            xShort = ( uxSent < uxStaged );
+            uxStaged = 0;
+        }
+
+        if (xShort)
+        {
+            break;
+        }
+
+        if (uxLen > sizeof(ucStaging))
+        {
+            size_t uxSent = prvWriteAll(pxNetworkContext, pxTls, pucBase, uxLen, &lLastRet);
+
+            uxTotalSent += uxSent;
+            xShort = ( uxSent < uxLen );
+        }
+        else
+        {
+            memcpy(ucStaging + uxStaged, pucBase, uxLen);
+            uxStaged += uxLen;
+        }
+    }
+
+    if (pxTls != NULL && !xShort && uxStaged > 0)
+    {
+        uxTotalSent += prvWriteAll(pxNetworkContext, pxTls, ucStaging, uxStaged, &lLastRet);
+    }
+    xSemaphoreGive(pxNetworkContext->xTlsSendSemaphore);
+
+    if (pxTls == NULL)
+    {
+        return -1;
+    }
+
+    /* Report an error only if nothing at all went out. */
+    if (uxTotalSent == 0 && lLastRet < 0 &&
+        lLastRet != ESP_TLS_ERR_SSL_WANT_WRITE && lLastRet != ESP_TLS_ERR_SSL_WANT_READ)
+    {
+        return lLastRet;
+    }
+
+    return ( int32_t ) uxTotalSent;
+}
+
 int32_t espTlsTransportRecv(NetworkContext_t* pxNetworkContext,
     void* pvData, size_t uxDataLen)
 {
+    TRACE_SPAN_SCOPE( "espTlsTransportRecv" );
+
     if (pvData == NULL || uxDataLen == 0)
     {
         return -1;
     }
+    if (pxNetworkContext == NULL || pxNetworkContext->xTlsRecvSemaphore == NULL)
+    {
+        return -1; /* pxNetworkContext uninitialised */
+    }
+
     int32_t lBytesRead = 0;
-    if(pxNetworkContext != NULL && pxNetworkContext->pxTls != NULL)
+    int xSockFd = -1;
+
+    /* Only hold the lock long enough to check for already decrypted data and
+     * fetch the socket. Waiting for the peer happens with the lock released,
+     * so a sender sharing the lock is not stalled by an idle connection. */
+    prvRecvLockTake(pxNetworkContext);
+    esp_tls_t* pxTls = pxNetworkContext->pxTls;
+    uint32_t ulGeneration = pxNetworkContext->ulConnectionGeneration;
+    if (pxTls == NULL)
     {
-        xSemaphoreTake(pxNetworkContext->xTlsContextSemaphore, portMAX_DELAY);
-        lBytesRead = esp_tls_conn_read(pxNetworkContext->pxTls, pvData, uxDataLen);
-        xSemaphoreGive(pxNetworkContext->xTlsContextSemaphore);
+        lBytesRead = -1; /* pxTls uninitialised */
     }
-    else
+    else if (esp_tls_get_bytes_avail(pxTls) > 0)
     {
-        return -1; /* pxNetworkContext or pxTls uninitialised */
+        lBytesRead = prvMeteredRead(pxNetworkContext, pxTls, pvData, uxDataLen);
     }
+    else if (esp_tls_get_conn_sockfd(pxTls, &xSockFd) != ESP_OK)
+    {
+        lBytesRead = -1;
+    }
+    xSemaphoreGive(pxNetworkContext->xTlsRecvSemaphore);
+
+    if (xSockFd >= 0)
+    {
+        /* The peer may be waiting for corked data before it answers. */
+        if (pxNetworkContext->xCorked)
+        {
+            prvSendLockTake(pxNetworkContext);
+            if (pxNetworkContext->ulConnectionGeneration == ulGeneration)
+            {
+                ( void ) prvCorkFlush(pxNetworkContext, pxTls);
+            }
+            xSemaphoreGive(pxNetworkContext->xTlsSendSemaphore);
+        }
+
+        int xReadable = prvWaitForReadable(xSockFd);
+
+        if (xReadable < 0)
+        {
+            return -1;
+        }
+        if (xReadable == 0)
+        {
+            return 0;
+        }
+
+        prvRecvLockTake(pxNetworkContext);
+        /* Compare the generation rather than the pointer: a reconnect while
+         * waiting may hand back an esp_tls_t at the same address. */
+        if (pxNetworkContext->ulConnectionGeneration != ulGeneration)
+        {
+            lBytesRead = -1; /* Disconnected while waiting. */
+        }
+        else
+        {
+            lBytesRead = prvMeteredRead(pxNetworkContext, pxTls, pvData, uxDataLen);
+        }
+        xSemaphoreGive(pxNetworkContext->xTlsRecvSemaphore);
+    }
+
     if (lBytesRead == ESP_TLS_ERR_SSL_WANT_WRITE  || lBytesRead == ESP_TLS_ERR_SSL_WANT_READ) {
         return 0;
     }
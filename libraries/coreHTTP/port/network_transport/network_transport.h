@@ -19,15 +19,102 @@ typedef enum TlsTransportStatus
     TLS_TRANSPORT_DISCONNECT_FAILURE = -8   /**< Failed to disconnect from server. */
 } TlsTransportStatus_t;
 
+/**
+ * @brief One buffer of a vectored send.
+ *
+ * Layout-compatible with TransportOutVector_t, which transport_interface.h
+ * provides from coreMQTT v2.0 on.
+ */
+typedef struct TlsTransportOutVector
+{
+    const void * iov_base; /**< @brief Start of the buffer. */
+    size_t iov_len;        /**< @brief Length of the buffer in bytes. */
+} TlsTransportOutVector_t;
+
+/**
+ * @brief Number of buckets in a #TlsTransportHistogram_t. Bucket upper bounds
+ * are 100us, 1ms, 10ms, 100ms and 1s; the last bucket holds everything slower.
+ */
+#define TLS_TRANSPORT_HISTOGRAM_BUCKETS    6
+
+/**
+ * @brief Fixed-bucket duration histogram.
+ */
+typedef struct TlsTransportHistogram
+{
+    uint32_t ulBuckets[ TLS_TRANSPORT_HISTOGRAM_BUCKETS ];
+    uint64_t ullTotalUs; /**< @brief Sum of all recorded durations. */
+    uint32_t ulMaxUs;    /**< @brief Longest recorded duration. */
+} TlsTransportHistogram_t;
+
+/**
+ * @brief Per-connection transport counters.
+ *
+ * Latencies cover only the esp-tls read or write call itself, not the time
+ * spent waiting for the socket to become readable. Counters are updated
+ * without atomics, so they are exact only with a single sender and a single
+ * receiver per context.
+ */
+typedef struct TlsTransportMetrics
+{
+    uint64_t ullBytesSent;
+    uint64_t ullBytesReceived;
+    uint32_t ulSendCalls;
+    uint32_t ulRecvCalls;
+    uint32_t ulSendWantCount;  /**< @brief Writes that returned WANT_READ or WANT_WRITE. */
+    uint32_t ulRecvWantCount;  /**< @brief Reads that returned WANT_READ or WANT_WRITE. */
+    uint32_t ulSendErrors;
+    uint32_t ulRecvErrors;
+    uint32_t ulHandshakeFailures;
+    TlsTransportHistogram_t xSendLatency;
+    TlsTransportHistogram_t xRecvLatency;
+    TlsTransportHistogram_t xSendLockWait;
+    TlsTransportHistogram_t xRecvLockWait;
+    TlsTransportHistogram_t xHandshake; /**< @brief Duration of successful connects. */
+} TlsTransportMetrics_t;
+
 struct NetworkContext
 {
-    SemaphoreHandle_t xTlsContextSemaphore;
+    SemaphoreHandle_t xTlsContextSemaphore; /**< @brief Serialises connect and disconnect. */
     esp_tls_t* pxTls;
+
+    /**
+    * @brief Lock guarding the TLS session for sends and receives.
+    *
+    * Created by #xTlsConnect on first use, so the context must be
+    * zero-initialised. xTlsRecvSemaphore is the same mutex as
+    * xTlsSendSemaphore, since mbedTLS does not allow a read and a write on
+    * one session at the same time. The lock is not held while waiting for
+    * data to arrive on the socket.
+    */
+    SemaphoreHandle_t xTlsSendSemaphore;
+    SemaphoreHandle_t xTlsRecvSemaphore;
+    StaticSemaphore_t xTlsSendSemaphoreBuffer;
+
+    /**
+    * @brief Incremented under the I/O lock on every connect and disconnect.
+    *
+    * A receive that waits with the lock released compares this after the
+    * wait to detect that the session it started on has gone.
+    */
+    uint32_t ulConnectionGeneration;
+
     const char *pcHostname;          /**< @brief Server host name. */
     int xPort;                       /**< @brief Server port in host-order. */
     const char *pcServerRootCAPem;   /**< @brief String representing a trusted server root certificate. */
     const char *pcClientCertPem;     /**< @brief String representing the client certificate. */
     const char *pcClientKeyPem;      /**< @brief String representing the client certificate's private key. */
+
+    /**
+    * @brief Lengths of the credentials above when they are DER. Zero means
+    * the credential is a NUL-terminated PEM string, whose length is found
+    * with strlen on every connect. DER credentials are handed to esp-tls as
+    * they are, without a base64 decode or a copy in the credential cache.
+    */
+    size_t uxServerRootCALength;
+    size_t uxClientCertLength;
+    size_t uxClientKeyLength;
+
     bool use_secure_element;         /**< @brief Boolean representing the use of secure element
                                                  for the TLS connection. */
     void *ds_data;                   /**< @brief Pointer for digital signature peripheral context */
@@ -46,15 +133,151 @@ struct NetworkContext
     * @brief Disable server name indication (SNI) for a TLS session.
     */
     BaseType_t disableSni;
+
+    /**
+    * @brief Connect over plain TCP, without TLS. The credentials, ALPN
+    * protocols and session are then ignored and may be left NULL.
+    *
+    * For servers on the local network whose content is authenticated by the
+    * application, such as a signed OTA image served by a peer device.
+    */
+    bool xPlainTcp;
+
+    /**
+    * @brief TLS session saved from the last successful handshake.
+    *
+    * Only used when session resumption is enabled in menuconfig. It is
+    * offered to the server on the next #xTlsConnect so that the ECDHE and
+    * client certificate signature steps can be skipped.
+    */
+    struct esp_tls_client_session * pxTlsSession;
+    uint32_t ulFullHandshakeCount;    /**< @brief Connects that performed a full handshake. */
+    uint32_t ulResumedHandshakeCount; /**< @brief Connects that resumed a cached session. */
+
+    /**
+    * @brief Upper bound on DNS lookup, TCP connect and TLS handshake, in
+    * milliseconds. Zero selects the timeout configured in menuconfig.
+    */
+    uint32_t ulConnectTimeoutMs;
+
+    /**
+    * @brief Optional metrics storage. Instrumentation is off while NULL;
+    * point it at a zero-initialised #TlsTransportMetrics_t to enable it.
+    */
+    TlsTransportMetrics_t * pxMetrics;
+
+    /**
+    * @brief Optional buffer in which sends are collected while the context
+    * is corked with #vTlsTransportCork. Corking has no effect while NULL.
+    * The buffer is owned by the caller and must outlive the connection.
+    */
+    uint8_t * pucCorkBuffer;
+    size_t uxCorkBufferSize;
+    size_t uxCorkedBytes; /**< @brief Bytes waiting in pucCorkBuffer. */
+    bool xCorked;         /**< @brief Set between vTlsTransportCork and lTlsTransportUncork. */
 };
 
+/**
+ * @brief Completion callback for #xTlsConnectAsync, called from the connect
+ * task once the connection is established or has failed.
+ */
+typedef void ( * TlsConnectCallback_t )( NetworkContext_t* pxNetworkContext,
+    TlsTransportStatus_t xStatus, void* pvUserContext );
+
 TlsTransportStatus_t xTlsConnect(NetworkContext_t* pxNetworkContext );
 
+/**
+ * @brief Start connecting in the background using the non-blocking esp-tls
+ * connect, and return immediately.
+ *
+ * On completion @p xCallback is called with the result. If @p xCallback is
+ * NULL, the task that called this function is instead sent a task
+ * notification whose value is the #TlsTransportStatus_t result, which can be
+ * collected with xTaskNotifyWait(). The context must not be used for I/O
+ * until the connect has completed.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS if the connect was started.
+ */
+TlsTransportStatus_t xTlsConnectAsync( NetworkContext_t* pxNetworkContext,
+    TlsConnectCallback_t xCallback, void* pvUserContext );
+
 TlsTransportStatus_t xTlsDisconnect( NetworkContext_t* pxNetworkContext );
 
+/**
+ * @brief Drop the cached TLS session of a context, including any copy
+ * retained in RTC memory, so the next connect performs a full handshake.
+ */
+void vTlsSessionClear( NetworkContext_t* pxNetworkContext );
+
+/**
+ * @brief Forget every credential parsed by the transport credential cache.
+ *
+ * Call this after new credentials are written into a buffer that was
+ * previously used for a connection, for example when fleet provisioning
+ * installs a new certificate. Connections already established are not
+ * affected; buffers in use by a handshake in progress are released once
+ * it completes.
+ */
+void vTlsCredentialCacheInvalidate( void );
+
+/**
+ * @brief Copy the metrics of a context into @p pxMetricsOut. The output is
+ * zeroed if the context has no metrics storage.
+ */
+void vTlsTransportMetricsGet( const NetworkContext_t* pxNetworkContext,
+    TlsTransportMetrics_t* pxMetricsOut );
+
+/**
+ * @brief Zero the metrics of a context.
+ */
+void vTlsTransportMetricsReset( NetworkContext_t* pxNetworkContext );
+
+/**
+ * @brief Log the metrics of a context at info level.
+ */
+void vTlsTransportMetricsDump( const NetworkContext_t* pxNetworkContext );
+
+/**
+ * @brief Start collecting sends in the cork buffer of the context instead
+ * of writing each one as its own TLS record.
+ *
+ * Sends are accepted into the buffer and written out when it fills up, when
+ * a receive has to wait for the peer, and on #lTlsTransportUncork. Use it
+ * around a burst of small MQTT packets, such as a batch of publishes, so they
+ * share TLS records. No-op if the context has no cork buffer.
+ */
+void vTlsTransportCork( NetworkContext_t* pxNetworkContext );
+
+/**
+ * @brief Write out everything collected since #vTlsTransportCork and go back
+ * to writing every send directly.
+ *
+ * @return 0 on success, or the negative esp-tls error of the failing write.
+ * Data accepted while corked is lost on error, so the connection should be
+ * treated as broken.
+ */
+int32_t lTlsTransportUncork( NetworkContext_t* pxNetworkContext );
+
 int32_t espTlsTransportSend( NetworkContext_t* pxNetworkContext,
     const void* pvData, size_t uxDataLen );
 
+/**
+ * @brief Send several buffers as one unit, packing small buffers into as
+ * few TLS records as possible.
+ *
+ * Buffers are copied into a stack staging area, sized in menuconfig, that
+ * is flushed with a single record; buffers larger than that are
+ * written directly. No other send is interleaved with the vector.
+ *
+ * To use it with a transport interface that has a writev member, set
+ * `transport.writev = ( TransportWritev_t ) espTlsTransportWritev`.
+ *
+ * @return Number of bytes sent, which may be less than the total on a
+ * partial write, or a negative value on error.
+ */
+int32_t espTlsTransportWritev( NetworkContext_t* pxNetworkContext,
+    TlsTransportOutVector_t* pxIoVec, size_t uxIoVecCount );
+
 int32_t espTlsTransportRecv( NetworkContext_t* pxNetworkContext,
     void* pvData, size_t uxDataLen );
 
@@ -0,0 +1,231 @@
+/*
+ * ThirdEye
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+/**
+ * @file command_pool_benchmark.c
+ * @brief Measures get/release throughput of the command pool.
+ *
+ * Every producer task obtains a command structure and releases it again in a
+ * tight loop until the run ends, the way a telemetry task does for each
+ * PUBLISH. Producers are pinned round-robin to the cores, so with two or more
+ * producers on a dual-core ESP32 the pool is used from both cores at once.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Kernel includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+/* Header include. */
+#include "command_pool_benchmark.h"
+#include "freertos_command_pool.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Duration of one run.
+ */
+#define BENCHMARK_RUN_TIME_MS         ( 2000U )
+
+/**
+ * @brief Largest number of producer tasks in a run.
+ */
+#define BENCHMARK_MAX_PRODUCERS       ( 4U )
+
+/**
+ * @brief Stack size of a producer task.
+ */
+#define BENCHMARK_TASK_STACK_SIZE     ( 2048U )
+
+/**
+ * @brief Priority of the producer tasks.
+ */
+#define BENCHMARK_TASK_PRIORITY       ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief Block time passed to Agent_GetCommand(). The pool holds more
+ * structures than there are producers, so the call never blocks.
+ */
+#define BENCHMARK_GET_BLOCK_TIME_MS   ( 0U )
+
+/**
+ * @brief Event group bit that starts the producers.
+ */
+#define BENCHMARK_START_BIT           ( 1U << 0 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief State of one producer task.
+ */
+typedef struct BenchmarkProducer
+{
+    uint32_t operations; /**< @brief Completed get/release pairs. */
+    uint32_t failures;   /**< @brief Calls that returned no structure or failed to release. */
+} BenchmarkProducer_t;
+
+/*-----------------------------------------------------------*/
+
+static const char * TAG = "CommandPoolBenchmark";
+
+#if CONFIG_MQTT_AGENT_LOCK_FREE_COMMAND_POOL
+    static const char * poolName = "lock-free";
+#else
+    static const char * poolName = "queue";
+#endif
+
+/**
+ * @brief Producer state of the current run.
+ */
+static BenchmarkProducer_t producers[ BENCHMARK_MAX_PRODUCERS ];
+
+/**
+ * @brief Event group used to start every producer at the same time.
+ */
+static EventGroupHandle_t startEvent = NULL;
+
+/**
+ * @brief Semaphore each producer gives when it has finished.
+ */
+static SemaphoreHandle_t doneSemaphore = NULL;
+
+/**
+ * @brief Set by the benchmark task when the run time is over.
+ */
+static volatile bool stopRun = false;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Task obtaining and releasing command structures until #stopRun is set.
+ *
+ * @param[in] pParameters The #BenchmarkProducer_t of the task.
+ */
+static void producerTask( void * pParameters )
+{
+    BenchmarkProducer_t * pProducer = ( BenchmarkProducer_t * ) pParameters;
+    MQTTAgentCommand_t * pCommand;
+
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+
+    while( !stopRun )
+    {
+        pCommand = Agent_GetCommand( BENCHMARK_GET_BLOCK_TIME_MS );
+
+        if( ( pCommand != NULL ) && Agent_ReleaseCommand( pCommand ) )
+        {
+            pProducer->operations++;
+        }
+        else
+        {
+            pProducer->failures++;
+        }
+    }
+
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run the benchmark with the given number of producers and log the
+ * throughput.
+ *
+ * @param[in] producerCount Number of producer tasks.
+ */
+static void runBenchmark( uint32_t producerCount )
+{
+    uint32_t i;
+    uint32_t totalOperations = 0U;
+    uint32_t totalFailures = 0U;
+    int64_t startUs;
+    int64_t elapsedUs;
+    BaseType_t created;
+
+    stopRun = false;
+    ( void ) xEventGroupClearBits( startEvent, BENCHMARK_START_BIT );
+
+    for( i = 0U; i < producerCount; i++ )
+    {
+        producers[ i ].operations = 0U;
+        producers[ i ].failures = 0U;
+        created = xTaskCreatePinnedToCore( producerTask,
+                                           "PoolProducer",
+                                           BENCHMARK_TASK_STACK_SIZE,
+                                           &producers[ i ],
+                                           BENCHMARK_TASK_PRIORITY,
+                                           NULL,
+                                           ( BaseType_t ) ( i % portNUM_PROCESSORS ) );
+        configASSERT( created == pdPASS );
+    }
+
+    startUs = esp_timer_get_time();
+    ( void ) xEventGroupSetBits( startEvent, BENCHMARK_START_BIT );
+    vTaskDelay( pdMS_TO_TICKS( BENCHMARK_RUN_TIME_MS ) );
+    stopRun = true;
+
+    for( i = 0U; i < producerCount; i++ )
+    {
+        ( void ) xSemaphoreTake( doneSemaphore, portMAX_DELAY );
+    }
+
+    elapsedUs = esp_timer_get_time() - startUs;
+
+    for( i = 0U; i < producerCount; i++ )
+    {
+        totalOperations += producers[ i ].operations;
+        totalFailures += producers[ i ].failures;
+    }
+
+    ESP_LOGI( TAG, "%u producer(s): %u get/release pairs in %lld us, %llu pairs/s, %u failures.",
+              ( unsigned ) producerCount,
+              ( unsigned ) totalOperations,
+              ( long long ) elapsedUs,
+              ( unsigned long long ) ( ( uint64_t ) totalOperations * 1000000ULL / ( uint64_t ) elapsedUs ),
+              ( unsigned ) totalFailures );
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_RunCommandPoolBenchmark( void )
+{
+    static const uint32_t producerCounts[] = { 1U, 2U, 4U };
+    uint32_t i;
+
+    startEvent = xEventGroupCreate();
+    doneSemaphore = xSemaphoreCreateCounting( BENCHMARK_MAX_PRODUCERS, 0U );
+    configASSERT( ( startEvent != NULL ) && ( doneSemaphore != NULL ) );
+
+    ESP_LOGI( TAG, "Running on %d core(s), %s pool.",
+              portNUM_PROCESSORS,
+              poolName );
+
+    for( i = 0U; i < ( sizeof( producerCounts ) / sizeof( producerCounts[ 0 ] ) ); i++ )
+    {
+        runBenchmark( producerCounts[ i ] );
+    }
+
+    vSemaphoreDelete( doneSemaphore );
+    vEventGroupDelete( startEvent );
+    doneSemaphore = NULL;
+    startEvent = NULL;
+}
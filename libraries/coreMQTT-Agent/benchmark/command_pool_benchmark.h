@@ -0,0 +1,30 @@
+/*
+ * ThirdEye
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+/**
+ * @file command_pool_benchmark.h
+ * @brief Throughput benchmark of the command pool.
+ */
+#ifndef COMMAND_POOL_BENCHMARK_H
+#define COMMAND_POOL_BENCHMARK_H
+
+/**
+ * @brief Measure Agent_GetCommand() and Agent_ReleaseCommand() throughput with
+ * 1, 2 and 4 producer tasks, spread over the available cores, and log the
+ * result of every run.
+ *
+ * The pool must be initialized with Agent_InitializePool() and must not be in
+ * use by an MQTT agent while the benchmark runs.
+ */
+void Agent_RunCommandPoolBenchmark( void );
+
+#endif /* COMMAND_POOL_BENCHMARK_H */
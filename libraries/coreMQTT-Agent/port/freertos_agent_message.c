@@ -24,9 +24,193 @@
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
 
+#include "sdkconfig.h"
+
 /* Header include. */
 #include "freertos_agent_message.h"
 #include "core_mqtt_agent_message_interface.h"
+#include "core_mqtt_agent.h"
+
+/*-----------------------------------------------------------*/
+
+#define AGENT_COMMAND_STATS    CONFIG_MQTT_AGENT_COMMAND_STATS
+
+/**
+ * @brief Control commands received in a row before a pending bulk command is
+ * received. Zero gives the control lane strict priority.
+ */
+#define CONTROL_LANE_BURST     CONFIG_MQTT_AGENT_CONTROL_LANE_BURST
+
+/*-----------------------------------------------------------*/
+
+#if AGENT_COMMAND_STATS
+
+/**
+ * @brief Raise @p pHighWater to @p value if it is lower.
+ *
+ * @param[in] pHighWater Counter shared between tasks.
+ * @param[in] value New sample.
+ */
+    static void updateHighWater( uint32_t * pHighWater,
+                                 uint32_t value )
+    {
+        uint32_t current = __atomic_load_n( pHighWater, __ATOMIC_RELAXED );
+
+        while( ( value > current ) &&
+               !__atomic_compare_exchange_n( pHighWater, &current, value, true,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            /* current was reloaded by the failed exchange. */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of commands queued in a context.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ *
+ * @return Commands queued in every lane.
+ */
+    static uint32_t queuedCommands( const MQTTAgentMessageContext_t * pMsgCtx )
+    {
+        uint32_t count = ( uint32_t ) uxQueueMessagesWaiting( pMsgCtx->queue );
+
+        if( pMsgCtx->bulkQueue != NULL )
+        {
+            count += ( uint32_t ) uxQueueMessagesWaiting( pMsgCtx->bulkQueue );
+        }
+
+        return count;
+    }
+#endif /* AGENT_COMMAND_STATS */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take a command out of a two-lane context, once
+ * #MQTTAgentMessageContext.pendingCommands guarantees that one is queued.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[out] pReceivedCommand Where to write the command.
+ *
+ * @return pdPASS if a command was received.
+ */
+static BaseType_t receiveFromLanes( MQTTAgentMessageContext_t * pMsgCtx,
+                                    MQTTAgentCommand_t ** pReceivedCommand )
+{
+    BaseType_t queueStatus = pdFAIL;
+
+    #if CONTROL_LANE_BURST > 0
+        /* Let one bulk command through after a full burst of control commands. */
+        if( pMsgCtx->controlStreak >= ( uint32_t ) CONTROL_LANE_BURST )
+        {
+            queueStatus = xQueueReceive( pMsgCtx->bulkQueue, pReceivedCommand, 0U );
+        }
+    #endif
+
+    if( queueStatus == pdPASS )
+    {
+        pMsgCtx->controlStreak = 0U;
+    }
+    else
+    {
+        queueStatus = xQueueReceive( pMsgCtx->queue, pReceivedCommand, 0U );
+
+        if( queueStatus == pdPASS )
+        {
+            pMsgCtx->controlStreak++;
+        }
+        else
+        {
+            queueStatus = xQueueReceive( pMsgCtx->bulkQueue, pReceivedCommand, 0U );
+            pMsgCtx->controlStreak = 0U;
+        }
+    }
+
+    /* Commands are queued before they are counted, so one must be there. */
+    configASSERT( queueStatus == pdPASS );
+
+    return queueStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Receive one command from a single-lane or two-lane context.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[out] pReceivedCommand Where to write the command.
+ * @param[in] blockTicks Time to wait for a command.
+ *
+ * @return pdPASS if a command was received.
+ */
+static BaseType_t receiveOne( MQTTAgentMessageContext_t * pMsgCtx,
+                              MQTTAgentCommand_t ** pReceivedCommand,
+                              TickType_t blockTicks )
+{
+    BaseType_t queueStatus = pdFAIL;
+
+    if( pMsgCtx->bulkQueue == NULL )
+    {
+        queueStatus = xQueueReceive( pMsgCtx->queue, pReceivedCommand, blockTicks );
+    }
+    else if( xSemaphoreTake( pMsgCtx->pendingCommands, blockTicks ) == pdPASS )
+    {
+        queueStatus = receiveFromLanes( pMsgCtx, pReceivedCommand );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return queueStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_MessageInitLanes( MQTTAgentMessageContext_t * pMsgCtx,
+                             QueueHandle_t controlQueue,
+                             QueueHandle_t bulkQueue,
+                             AgentMessageLaneSelector_t laneSelector )
+{
+    UBaseType_t capacity;
+
+    configASSERT( ( pMsgCtx != NULL ) && ( controlQueue != NULL ) && ( bulkQueue != NULL ) );
+    configASSERT( ( uxQueueMessagesWaiting( controlQueue ) == 0U ) &&
+                  ( uxQueueMessagesWaiting( bulkQueue ) == 0U ) );
+
+    capacity = uxQueueSpacesAvailable( controlQueue ) + uxQueueSpacesAvailable( bulkQueue );
+
+    pMsgCtx->queue = controlQueue;
+    pMsgCtx->bulkQueue = bulkQueue;
+    pMsgCtx->laneSelector = ( laneSelector != NULL ) ? laneSelector : Agent_MessageDefaultLane;
+    pMsgCtx->controlStreak = 0U;
+    pMsgCtx->pendingCommands = xSemaphoreCreateCountingStatic( capacity, 0U,
+                                                               &pMsgCtx->pendingCommandsBuffer );
+    configASSERT( pMsgCtx->pendingCommands );
+}
+
+/*-----------------------------------------------------------*/
+
+AgentMessageLane_t Agent_MessageDefaultLane( const MQTTAgentCommand_t * pCommand )
+{
+    AgentMessageLane_t lane = AGENT_MESSAGE_LANE_CONTROL;
+    const MQTTPublishInfo_t * pPublishInfo;
+
+    if( ( pCommand != NULL ) && ( pCommand->commandType == PUBLISH ) )
+    {
+        pPublishInfo = ( const MQTTPublishInfo_t * ) pCommand->pArgs;
+
+        if( ( pPublishInfo != NULL ) && ( pPublishInfo->qos == MQTTQoS0 ) )
+        {
+            lane = AGENT_MESSAGE_LANE_BULK;
+        }
+    }
+
+    return lane;
+}
 
 /*-----------------------------------------------------------*/
 
@@ -35,10 +219,37 @@ bool Agent_MessageSend( MQTTAgentMessageContext_t * pMsgCtx,
                         uint32_t blockTimeMs )
 {
     BaseType_t queueStatus = pdFAIL;
+    QueueHandle_t queue;
 
     if( ( pMsgCtx != NULL ) && ( pCommandToSend != NULL ) )
     {
-        queueStatus = xQueueSendToBack( pMsgCtx->queue, pCommandToSend, pdMS_TO_TICKS( blockTimeMs ) );
+        queue = pMsgCtx->queue;
+
+        if( ( pMsgCtx->bulkQueue != NULL ) &&
+            ( pMsgCtx->laneSelector( *pCommandToSend ) == AGENT_MESSAGE_LANE_BULK ) )
+        {
+            queue = pMsgCtx->bulkQueue;
+        }
+
+        queueStatus = xQueueSendToBack( queue, pCommandToSend, pdMS_TO_TICKS( blockTimeMs ) );
+
+        if( ( queueStatus == pdPASS ) && ( pMsgCtx->bulkQueue != NULL ) )
+        {
+            ( void ) xSemaphoreGive( pMsgCtx->pendingCommands );
+        }
+
+        #if AGENT_COMMAND_STATS
+            ( void ) __atomic_add_fetch( &pMsgCtx->stats.sendCalls, 1U, __ATOMIC_RELAXED );
+
+            if( queueStatus == pdPASS )
+            {
+                updateHighWater( &pMsgCtx->stats.depthHighWater, queuedCommands( pMsgCtx ) );
+            }
+            else
+            {
+                ( void ) __atomic_add_fetch( &pMsgCtx->stats.sendTimeouts, 1U, __ATOMIC_RELAXED );
+            }
+        #endif
     }
 
     return ( queueStatus == pdPASS ) ? true : false;
@@ -54,8 +265,139 @@ bool Agent_MessageReceive( MQTTAgentMessageContext_t * pMsgCtx,
 
     if( ( pMsgCtx != NULL ) && ( pReceivedCommand != NULL ) )
     {
-        queueStatus = xQueueReceive( pMsgCtx->queue, pReceivedCommand, pdMS_TO_TICKS( blockTimeMs ) );
+        if( !pMsgCtx->batching )
+        {
+            queueStatus = receiveOne( pMsgCtx, pReceivedCommand, pdMS_TO_TICKS( blockTimeMs ) );
+        }
+        else if( pMsgCtx->batchNext < pMsgCtx->batchCount )
+        {
+            /* Serve the rest of the batch without touching the queues. */
+            *pReceivedCommand = pMsgCtx->batch[ pMsgCtx->batchNext++ ];
+            queueStatus = pdPASS;
+
+            #if AGENT_COMMAND_STATS
+                ( void ) __atomic_add_fetch( &pMsgCtx->stats.batchedReceives, 1U, __ATOMIC_RELAXED );
+            #endif
+        }
+        else
+        {
+            /* The agent asks for the next command only once it has processed
+             * the previous one, so the whole batch has been handled. */
+            if( ( pMsgCtx->batchCount > 1U ) && ( pMsgCtx->batchEnd != NULL ) )
+            {
+                pMsgCtx->batchEnd( pMsgCtx->pBatchContext );
+            }
+
+            pMsgCtx->batchCount = ( uint32_t ) Agent_MessageReceiveBatch( pMsgCtx,
+                                                                           pMsgCtx->batch,
+                                                                           AGENT_MESSAGE_BATCH_SIZE,
+                                                                           blockTimeMs );
+            pMsgCtx->batchNext = 0U;
+
+            if( pMsgCtx->batchCount > 0U )
+            {
+                *pReceivedCommand = pMsgCtx->batch[ pMsgCtx->batchNext++ ];
+                queueStatus = pdPASS;
+            }
+
+            if( ( pMsgCtx->batchCount > 1U ) && ( pMsgCtx->batchBegin != NULL ) )
+            {
+                pMsgCtx->batchBegin( pMsgCtx->pBatchContext );
+            }
+        }
+
+        #if AGENT_COMMAND_STATS
+            if( queueStatus != pdPASS )
+            {
+                ( void ) __atomic_add_fetch( &pMsgCtx->stats.receiveTimeouts, 1U, __ATOMIC_RELAXED );
+            }
+        #endif
     }
 
     return ( queueStatus == pdPASS ) ? true : false;
 }
+
+/*-----------------------------------------------------------*/
+
+size_t Agent_MessageReceiveBatch( MQTTAgentMessageContext_t * pMsgCtx,
+                                  MQTTAgentCommand_t ** pReceivedCommands,
+                                  size_t maxCommands,
+                                  uint32_t blockTimeMs )
+{
+    size_t received = 0U;
+
+    if( ( pMsgCtx != NULL ) && ( pReceivedCommands != NULL ) && ( maxCommands > 0U ) &&
+        ( receiveOne( pMsgCtx, &pReceivedCommands[ 0 ], pdMS_TO_TICKS( blockTimeMs ) ) == pdPASS ) )
+    {
+        received = 1U;
+
+        /* Drain whatever else is already queued, without blocking. */
+        while( ( received < maxCommands ) &&
+               ( receiveOne( pMsgCtx, &pReceivedCommands[ received ], 0U ) == pdPASS ) )
+        {
+            received++;
+        }
+    }
+
+    return received;
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_MessageEnableBatching( MQTTAgentMessageContext_t * pMsgCtx,
+                                  AgentMessageBatchCallback_t batchBegin,
+                                  AgentMessageBatchCallback_t batchEnd,
+                                  void * pBatchContext )
+{
+    configASSERT( pMsgCtx != NULL );
+
+    pMsgCtx->batchBegin = batchBegin;
+    pMsgCtx->batchEnd = batchEnd;
+    pMsgCtx->pBatchContext = pBatchContext;
+    pMsgCtx->batchCount = 0U;
+    pMsgCtx->batchNext = 0U;
+    pMsgCtx->batching = ( AGENT_MESSAGE_BATCH_SIZE > 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+bool Agent_MessageGetStats( const MQTTAgentMessageContext_t * pMsgCtx,
+                            AgentMessageStats_t * pStats )
+{
+    bool statsWritten = false;
+
+    #if AGENT_COMMAND_STATS
+        if( ( pMsgCtx != NULL ) && ( pStats != NULL ) )
+        {
+            pStats->sendCalls = __atomic_load_n( &pMsgCtx->stats.sendCalls, __ATOMIC_RELAXED );
+            pStats->sendTimeouts = __atomic_load_n( &pMsgCtx->stats.sendTimeouts, __ATOMIC_RELAXED );
+            pStats->receiveTimeouts = __atomic_load_n( &pMsgCtx->stats.receiveTimeouts, __ATOMIC_RELAXED );
+            pStats->depthHighWater = __atomic_load_n( &pMsgCtx->stats.depthHighWater, __ATOMIC_RELAXED );
+            pStats->batchedReceives = __atomic_load_n( &pMsgCtx->stats.batchedReceives, __ATOMIC_RELAXED );
+            statsWritten = true;
+        }
+    #else
+        ( void ) pMsgCtx;
+        ( void ) pStats;
+    #endif
+
+    return statsWritten;
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_MessageResetStats( MQTTAgentMessageContext_t * pMsgCtx )
+{
+    #if AGENT_COMMAND_STATS
+        if( pMsgCtx != NULL )
+        {
+            __atomic_store_n( &pMsgCtx->stats.sendCalls, 0U, __ATOMIC_RELAXED );
+            __atomic_store_n( &pMsgCtx->stats.sendTimeouts, 0U, __ATOMIC_RELAXED );
+            __atomic_store_n( &pMsgCtx->stats.receiveTimeouts, 0U, __ATOMIC_RELAXED );
+            __atomic_store_n( &pMsgCtx->stats.batchedReceives, 0U, __ATOMIC_RELAXED );
+            __atomic_store_n( &pMsgCtx->stats.depthHighWater, queuedCommands( pMsgCtx ), __ATOMIC_RELAXED );
+        }
+    #else
+        ( void ) pMsgCtx;
+    #endif
+}
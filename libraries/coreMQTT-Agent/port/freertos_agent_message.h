@@ -24,21 +24,159 @@
 /* FreeRTOS includes. */
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "sdkconfig.h"
 
 /* Include MQTT agent messaging interface. */
 #include "core_mqtt_agent_message_interface.h"
 
+/**
+ * @brief Largest number of commands drained from a batching context per
+ * wake-up of the agent.
+ */
+#define AGENT_MESSAGE_BATCH_SIZE    CONFIG_MQTT_AGENT_RECEIVE_BATCH_SIZE
+
+/**
+ * @brief Queue counters, kept when MQTT_AGENT_COMMAND_STATS is enabled in
+ * menuconfig.
+ */
+typedef struct AgentMessageStats
+{
+    uint32_t sendCalls;       /**< @brief Calls to Agent_MessageSend(). */
+    uint32_t sendTimeouts;    /**< @brief Sends that failed because the queue stayed full. */
+    uint32_t receiveTimeouts; /**< @brief Receives that returned without a message. */
+    uint32_t depthHighWater;  /**< @brief Most messages in the queue since the last reset. */
+    uint32_t batchedReceives; /**< @brief Receives served from a drained batch without a queue call. */
+} AgentMessageStats_t;
+
+/**
+ * @brief Lanes of a message context set up with Agent_MessageInitLanes().
+ */
+typedef enum AgentMessageLane
+{
+    AGENT_MESSAGE_LANE_CONTROL = 0, /**< @brief Served first by the agent. */
+    AGENT_MESSAGE_LANE_BULK         /**< @brief Served when no control command is pending. */
+} AgentMessageLane_t;
+
+/**
+ * @brief Pick the lane of a command.
+ *
+ * @param[in] pCommand The command being sent. Its pCmdContext is the
+ * application context passed to the agent API, so applications can tag
+ * individual commands through it.
+ *
+ * @return The lane to queue @p pCommand in.
+ */
+typedef AgentMessageLane_t ( * AgentMessageLaneSelector_t )( const MQTTAgentCommand_t * pCommand );
+
+/**
+ * @brief Called by the agent task around a batch of more than one command,
+ * for example to cork and uncork the transport.
+ *
+ * @param[in] pBatchContext The context given to Agent_MessageEnableBatching().
+ */
+typedef void ( * AgentMessageBatchCallback_t )( void * pBatchContext );
+
 /**
  * @ingroup mqtt_agent_struct_types
  * @brief Context with which tasks may deliver messages to the agent.
+ *
+ * A context with only @p queue set has a single FIFO lane. After
+ * Agent_MessageInitLanes(), @p queue is the control lane and @p bulkQueue the
+ * bulk lane.
  */
 struct MQTTAgentMessageContext
 {
     QueueHandle_t queue;
+    QueueHandle_t bulkQueue;                 /**< @brief Bulk lane, or NULL for a single-lane context. */
+    AgentMessageLaneSelector_t laneSelector; /**< @brief Lane selector of a multi-lane context. */
+    SemaphoreHandle_t pendingCommands;       /**< @brief Counts commands queued in either lane. */
+    StaticSemaphore_t pendingCommandsBuffer; /**< @brief Storage of #MQTTAgentMessageContext.pendingCommands. */
+    uint32_t controlStreak;                  /**< @brief Control commands received since the last bulk command. */
+    bool batching;                           /**< @brief Set by Agent_MessageEnableBatching(). */
+    MQTTAgentCommand_t * batch[ AGENT_MESSAGE_BATCH_SIZE ]; /**< @brief Commands drained but not yet handed out. */
+    uint32_t batchCount;                     /**< @brief Commands in #MQTTAgentMessageContext.batch. */
+    uint32_t batchNext;                      /**< @brief Next command of the batch to hand out. */
+    AgentMessageBatchCallback_t batchBegin;  /**< @brief Called when a batch of several commands is drained. */
+    AgentMessageBatchCallback_t batchEnd;    /**< @brief Called once every command of that batch was processed. */
+    void * pBatchContext;                    /**< @brief Passed to the batch callbacks. */
+    AgentMessageStats_t stats;               /**< @brief Updated only when MQTT_AGENT_COMMAND_STATS is enabled. */
 };
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Turn a context into a two-lane context. Not thread safe; call it
+ * before the context is handed to the agent.
+ *
+ * The agent receives control commands before bulk commands. With
+ * MQTT_AGENT_CONTROL_LANE_BURST set to a non-zero value, a pending bulk
+ * command is received after that many control commands in a row, so bulk
+ * traffic cannot starve.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[in] controlQueue Empty queue of `MQTTAgentCommand_t *` for the
+ * control lane.
+ * @param[in] bulkQueue Empty queue of `MQTTAgentCommand_t *` for the bulk lane.
+ * @param[in] laneSelector Lane selector, or NULL for
+ * Agent_MessageDefaultLane().
+ */
+void Agent_MessageInitLanes( MQTTAgentMessageContext_t * pMsgCtx,
+                             QueueHandle_t controlQueue,
+                             QueueHandle_t bulkQueue,
+                             AgentMessageLaneSelector_t laneSelector );
+
+/**
+ * @brief Default lane selector: QoS 0 publishes go to the bulk lane, and
+ * everything else, including PINGREQ and QoS 1 and 2 publishes, to the
+ * control lane.
+ *
+ * @param[in] pCommand The command being sent.
+ *
+ * @return The lane of @p pCommand.
+ */
+AgentMessageLane_t Agent_MessageDefaultLane( const MQTTAgentCommand_t * pCommand );
+
+/**
+ * @brief Let Agent_MessageReceive() drain up to
+ * MQTT_AGENT_RECEIVE_BATCH_SIZE queued commands per wake-up and hand them out
+ * one per call. Only for contexts with a single receiving task, such as the
+ * agent command queue. Not thread safe; call it before the context is handed
+ * to the agent.
+ *
+ * When a wake-up drains more than one command, @p batchBegin is called before
+ * the first command is returned, and @p batchEnd on the next receive after
+ * the last one, before the agent blocks again. Pointing them at
+ * vTlsTransportCork() and lTlsTransportUncork() lets several publishes share
+ * TLS records.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[in] batchBegin Callback at the start of a batch, or NULL.
+ * @param[in] batchEnd Callback at the end of a batch, or NULL.
+ * @param[in] pBatchContext Passed to both callbacks.
+ */
+void Agent_MessageEnableBatching( MQTTAgentMessageContext_t * pMsgCtx,
+                                  AgentMessageBatchCallback_t batchBegin,
+                                  AgentMessageBatchCallback_t batchEnd,
+                                  void * pBatchContext );
+
+/**
+ * @brief Wait for a command, then take every other queued command without
+ * blocking, up to @p maxCommands. Lane priorities apply to every command.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[out] pReceivedCommands Array of @p maxCommands entries.
+ * @param[in] maxCommands Most commands to receive.
+ * @param[in] blockTimeMs Time to wait for the first command.
+ *
+ * @return Number of commands written to @p pReceivedCommands.
+ */
+size_t Agent_MessageReceiveBatch( MQTTAgentMessageContext_t * pMsgCtx,
+                                  MQTTAgentCommand_t ** pReceivedCommands,
+                                  size_t maxCommands,
+                                  uint32_t blockTimeMs );
+
 /**
  * @brief Send a message to the specified context.
  * Must be thread safe.
@@ -67,4 +205,23 @@ bool Agent_MessageReceive( MQTTAgentMessageContext_t * pMsgCtx,
                            MQTTAgentCommand_t ** pReceivedCommand,
                            uint32_t blockTimeMs );
 
+/**
+ * @brief Copy the counters of a context.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[out] pStats Where to write the counters.
+ *
+ * @return `true` if MQTT_AGENT_COMMAND_STATS is enabled and @p pStats was
+ * written, else `false`.
+ */
+bool Agent_MessageGetStats( const MQTTAgentMessageContext_t * pMsgCtx,
+                            AgentMessageStats_t * pStats );
+
+/**
+ * @brief Reset the counters of a context.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ */
+void Agent_MessageResetStats( MQTTAgentMessageContext_t * pMsgCtx );
+
 #endif /* FREERTOS_AGENT_MESSAGE_H */
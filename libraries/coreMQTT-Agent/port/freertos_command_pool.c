@@ -22,6 +22,10 @@
 /* Kernel includes. */
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_timer.h"
+#include "sdkconfig.h"
 
 /* Header include. */
 #include "freertos_command_pool.h"
@@ -34,6 +38,30 @@
 
 #define MQTT_COMMAND_CONTEXTS_POOL_SIZE     ( 10 )
 
+#define COMMAND_POOL_LOCK_FREE    CONFIG_MQTT_AGENT_LOCK_FREE_COMMAND_POOL
+#define COMMAND_POOL_STATS        CONFIG_MQTT_AGENT_COMMAND_STATS
+
+#if COMMAND_POOL_LOCK_FREE
+
+/**
+ * @brief Value of the index part of #freeListHead when the free list is empty.
+ */
+    #define FREE_LIST_EMPTY           ( 0U )
+
+/**
+ * @brief Mask of the index part of #freeListHead. The index is stored plus
+ * one, so that zero can mean an empty list.
+ */
+    #define FREE_LIST_INDEX_MASK      ( 0x0000FFFFU )
+
+/**
+ * @brief Increment of the tag part of #freeListHead. The tag changes on every
+ * update, so a compare-and-swap fails if the head was popped and pushed back
+ * in between (the ABA problem).
+ */
+    #define FREE_LIST_TAG_INCREMENT   ( 0x00010000U )
+#endif /* COMMAND_POOL_LOCK_FREE */
+
 /**
  * @brief The pool of command structures used to hold information on commands (such
  * as PUBLISH or SUBSCRIBE) between the command being created by an API call and
@@ -41,21 +69,359 @@
  */
 static MQTTAgentCommand_t commandStructurePool[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
 
+#if COMMAND_POOL_LOCK_FREE
+
+/**
+ * @brief Head of the free list of command structures. The low half holds the
+ * index of the first free structure plus one, the high half a tag bumped on
+ * every update. Updated with compare-and-swap only, so obtaining and releasing
+ * a structure does not enter a critical section.
+ */
+    static uint32_t freeListHead = FREE_LIST_EMPTY;
+
+/**
+ * @brief For every free structure, the index plus one of the next free
+ * structure, or #FREE_LIST_EMPTY.
+ */
+    static uint32_t freeListNext[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/**
+ * @brief Set for every structure handed out by Agent_GetCommand(). Releasing a
+ * structure twice would link it into the free list twice, creating a cycle,
+ * so a release of a structure that is not in use is refused.
+ */
+    static bool commandInUse[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/**
+ * @brief Number of tasks blocked in Agent_GetCommand() waiting for a structure.
+ */
+    static uint32_t waitingTasks = 0U;
+
+/**
+ * @brief Semaphore given on release while tasks are waiting. Only used once
+ * the pool has run empty, so the common path stays free of kernel calls.
+ */
+    static SemaphoreHandle_t releaseSemaphore = NULL;
+#else /* if COMMAND_POOL_LOCK_FREE */
+
 /**
  * @brief The message context used to guard the pool of MQTTAgentCommand_t structures.
  * For FreeRTOS, this is implemented with a queue. Structures may be
  * obtained by receiving a pointer from the queue, and returned by
  * sending the pointer back into it.
  */
-static MQTTAgentMessageContext_t commandStructMessageCtx;
+    static MQTTAgentMessageContext_t commandStructMessageCtx;
+#endif /* if COMMAND_POOL_LOCK_FREE */
 
 /**
  * @brief Initialization status of the queue.
  */
 static volatile uint8_t initStatus = QUEUE_NOT_INITIALIZED;
 
+#if COMMAND_POOL_STATS
+
+/**
+ * @brief Counters reported by Agent_GetPoolStats(). Updated with relaxed
+ * atomics from every task using the pool.
+ */
+    static AgentCommandPoolStats_t poolStats;
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if COMMAND_POOL_STATS
+
+/**
+ * @brief Lower @p pLowWater to @p value if it is higher.
+ *
+ * @param[in] pLowWater Counter shared between tasks.
+ * @param[in] value New sample.
+ */
+    static void updateLowWater( uint32_t * pLowWater,
+                                uint32_t value )
+    {
+        uint32_t current = __atomic_load_n( pLowWater, __ATOMIC_RELAXED );
+
+        while( ( value < current ) &&
+               !__atomic_compare_exchange_n( pLowWater, &current, value, true,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            /* current was reloaded by the failed exchange. */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Record the outcome and duration of an Agent_GetCommand() call.
+ *
+ * @param[in] startUs esp_timer time at which the call started.
+ * @param[in] pCommand The structure handed out, or NULL on timeout.
+ */
+    static void recordGetCommand( int64_t startUs,
+                                  const MQTTAgentCommand_t * pCommand )
+    {
+        uint32_t waitUs = ( uint32_t ) ( esp_timer_get_time() - startUs );
+        uint32_t bucket = 0U;
+        uint32_t bound = 100U;
+        uint32_t maxWaitUs;
+
+        while( ( bucket < ( AGENT_POOL_WAIT_BUCKETS - 1U ) ) && ( waitUs >= bound ) )
+        {
+            bucket++;
+            bound *= 10U;
+        }
+
+        ( void ) __atomic_add_fetch( &poolStats.getCalls, 1U, __ATOMIC_RELAXED );
+        ( void ) __atomic_add_fetch( &poolStats.waitHistogram[ bucket ], 1U, __ATOMIC_RELAXED );
+
+        maxWaitUs = __atomic_load_n( &poolStats.maxWaitUs, __ATOMIC_RELAXED );
+
+        while( ( waitUs > maxWaitUs ) &&
+               !__atomic_compare_exchange_n( &poolStats.maxWaitUs, &maxWaitUs, waitUs, true,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            /* maxWaitUs was reloaded by the failed exchange. */
+        }
+
+        if( pCommand == NULL )
+        {
+            ( void ) __atomic_add_fetch( &poolStats.timeouts, 1U, __ATOMIC_RELAXED );
+        }
+        else
+        {
+            updateLowWater( &poolStats.minFreeCommands,
+                            __atomic_sub_fetch( &poolStats.freeCommands, 1U, __ATOMIC_RELAXED ) );
+        }
+    }
+#endif /* COMMAND_POOL_STATS */
+
+/*-----------------------------------------------------------*/
+
+#if COMMAND_POOL_LOCK_FREE
+
+/**
+ * @brief Pop a structure off the free list without blocking.
+ *
+ * @return The structure, or NULL if the pool is empty.
+ */
+    static MQTTAgentCommand_t * popFreeCommand( void )
+    {
+        uint32_t head = __atomic_load_n( &freeListHead, __ATOMIC_ACQUIRE );
+        uint32_t newHead;
+        uint32_t index;
+        MQTTAgentCommand_t * pCommand = NULL;
+        bool popped = false;
+
+        while( ( popped == false ) && ( ( head & FREE_LIST_INDEX_MASK ) != FREE_LIST_EMPTY ) )
+        {
+            index = ( head & FREE_LIST_INDEX_MASK ) - 1U;
+
+            /* The link may be stale if another task popped the head meanwhile,
+             * in which case the tag has changed and the exchange fails. */
+            newHead = ( ( head + FREE_LIST_TAG_INCREMENT ) & ~FREE_LIST_INDEX_MASK ) |
+                      __atomic_load_n( &freeListNext[ index ], __ATOMIC_RELAXED );
+
+            popped = __atomic_compare_exchange_n( &freeListHead, &head, newHead, true,
+                                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+
+            if( popped )
+            {
+                __atomic_store_n( &commandInUse[ index ], true, __ATOMIC_RELAXED );
+                pCommand = &commandStructurePool[ index ];
+            }
+        }
+
+        return pCommand;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Push a structure onto the free list.
+ *
+ * @param[in] index Index of the structure in #commandStructurePool.
+ */
+    static void pushFreeCommand( uint32_t index )
+    {
+        uint32_t head = __atomic_load_n( &freeListHead, __ATOMIC_RELAXED );
+        uint32_t newHead;
+
+        do
+        {
+            __atomic_store_n( &freeListNext[ index ], head & FREE_LIST_INDEX_MASK, __ATOMIC_RELAXED );
+            newHead = ( ( head + FREE_LIST_TAG_INCREMENT ) & ~FREE_LIST_INDEX_MASK ) | ( index + 1U );
+        } while( !__atomic_compare_exchange_n( &freeListHead, &head, newHead, true,
+                                                __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+
+        /* Wake a task blocked on an empty pool. A surplus give only makes a
+         * waiter retry the pop. */
+        if( __atomic_load_n( &waitingTasks, __ATOMIC_ACQUIRE ) > 0U )
+        {
+            ( void ) xSemaphoreGive( releaseSemaphore );
+        }
+    }
+
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Wait for a structure to be released into an empty pool.
+ *
+ * @param[in] blockTimeMs Maximum time to wait.
+ *
+ * @return The structure, or NULL if none was released in time.
+ */
+    static MQTTAgentCommand_t * waitForFreeCommand( uint32_t blockTimeMs )
+    {
+        MQTTAgentCommand_t * pCommand = NULL;
+        TickType_t remainingTicks = pdMS_TO_TICKS( blockTimeMs );
+        TickType_t startTicks = xTaskGetTickCount();
+        TickType_t elapsedTicks;
+        bool timedOut = false;
+
+        ( void ) __atomic_add_fetch( &waitingTasks, 1U, __ATOMIC_ACQ_REL );
+
+        /* Pop again after registering as a waiter, so a release between the
+         * first pop and the registration is not missed. */
+        pCommand = popFreeCommand();
+
+        while( ( pCommand == NULL ) && ( timedOut == false ) )
+        {
+            timedOut = ( xSemaphoreTake( releaseSemaphore, remainingTicks ) != pdTRUE );
+            pCommand = popFreeCommand();
+
+            elapsedTicks = xTaskGetTickCount() - startTicks;
+
+            if( elapsedTicks >= pdMS_TO_TICKS( blockTimeMs ) )
+            {
+                timedOut = true;
+            }
+            else
+            {
+                remainingTicks = pdMS_TO_TICKS( blockTimeMs ) - elapsedTicks;
+            }
+        }
+
+        ( void ) __atomic_sub_fetch( &waitingTasks, 1U, __ATOMIC_ACQ_REL );
+
+        return pCommand;
+    }
+#endif /* COMMAND_POOL_LOCK_FREE */
+
+/*-----------------------------------------------------------*/
+
+#if COMMAND_POOL_LOCK_FREE
+
+    void Agent_InitializePool( void )
+    {
+        uint32_t i;
+        static StaticSemaphore_t staticSemaphoreStructure;
+
+        if( initStatus == QUEUE_NOT_INITIALIZED )
+        {
+            memset( ( void * ) commandStructurePool, 0x00, sizeof( commandStructurePool ) );
+            memset( ( void * ) commandInUse, 0x00, sizeof( commandInUse ) );
+            releaseSemaphore = xSemaphoreCreateCountingStatic( MQTT_COMMAND_CONTEXTS_POOL_SIZE,
+                                                               0U,
+                                                               &staticSemaphoreStructure );
+            configASSERT( releaseSemaphore );
+
+            /* Chain every structure into the free list. */
+            for( i = 0U; i < MQTT_COMMAND_CONTEXTS_POOL_SIZE; i++ )
+            {
+                freeListNext[ i ] = ( i + 1U < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ? ( i + 2U ) : FREE_LIST_EMPTY;
+            }
+
+            waitingTasks = 0U;
+            __atomic_store_n( &freeListHead, 1U, __ATOMIC_RELEASE );
+
+            #if COMMAND_POOL_STATS
+                Agent_ResetPoolStats();
+            #endif
+
+            initStatus = QUEUE_INITIALIZED;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs )
+    {
+        MQTTAgentCommand_t * structToUse = NULL;
+
+        #if COMMAND_POOL_STATS
+            int64_t startUs = esp_timer_get_time();
+        #endif
+
+        /* Check the pool has been initialized. */
+        configASSERT( initStatus == QUEUE_INITIALIZED );
+
+        structToUse = popFreeCommand();
+
+        if( ( structToUse == NULL ) && ( blockTimeMs > 0U ) )
+        {
+            structToUse = waitForFreeCommand( blockTimeMs );
+        }
+
+        #if COMMAND_POOL_STATS
+            recordGetCommand( startUs, structToUse );
+        #endif
+
+        if( structToUse == NULL )
+        {
+            LogError( ( "No command structure available." ) );
+        }
+        else
+        {
+            LogDebug( ( "Removed Command Context %d from pool",
+                        ( int ) ( structToUse - commandStructurePool ) ) );
+        }
+
+        return structToUse;
+    }
+
+/*-----------------------------------------------------------*/
+
+    bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
+    {
+        bool structReturned = false;
+        bool wasInUse;
+        uint32_t index;
+
+        configASSERT( initStatus == QUEUE_INITIALIZED );
+
+        /* See if the structure being returned is actually from the pool. */
+        if( ( pCommandToRelease >= commandStructurePool ) &&
+            ( pCommandToRelease < ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+        {
+            index = ( uint32_t ) ( pCommandToRelease - commandStructurePool );
+
+            /* Only one of two racing releases of a structure sees it in use. */
+            wasInUse = __atomic_exchange_n( &commandInUse[ index ], false, __ATOMIC_ACQ_REL );
+            configASSERT( wasInUse );
+
+            if( wasInUse )
+            {
+                #if COMMAND_POOL_STATS
+                    ( void ) __atomic_add_fetch( &poolStats.freeCommands, 1U, __ATOMIC_RELAXED );
+                #endif
+
+                pushFreeCommand( index );
+                structReturned = true;
+
+                LogDebug( ( "Returned Command Context %d to pool", ( int ) index ) );
+            }
+            else
+            {
+                LogError( ( "Command Context %d released twice.", ( int ) index ) );
+            }
+        }
+
+        return structReturned;
+    }
+
+#else /* if COMMAND_POOL_LOCK_FREE */
+
 void Agent_InitializePool( void )
 {
     size_t i;
@@ -83,6 +449,10 @@ void Agent_InitializePool( void )
             configASSERT( commandAdded );
         }
 
+        #if COMMAND_POOL_STATS
+            Agent_ResetPoolStats();
+        #endif
+
         initStatus = QUEUE_INITIALIZED;
     }
 }
@@ -94,16 +464,26 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs )
     MQTTAgentCommand_t * structToUse = NULL;
     bool structRetrieved = false;
 
+    #if COMMAND_POOL_STATS
+        int64_t startUs = esp_timer_get_time();
+    #endif
+
     /* Check queue has been created. */
     configASSERT( initStatus == QUEUE_INITIALIZED );
 
     /* Retrieve a struct from the queue. */
     structRetrieved = Agent_MessageReceive( &commandStructMessageCtx, &( structToUse ), blockTimeMs );
 
+    #if COMMAND_POOL_STATS
+        recordGetCommand( startUs, structToUse );
+    #endif
+
     if( !structRetrieved )
     {
         LogError( ( "No command structure available." ) );
-    } else {
+    }
+    else
+    {
         LogDebug( ( "Removed Command Context %d from pool",
                     ( int ) ( structToUse - commandStructurePool ) ) );
     }
@@ -123,6 +503,10 @@ bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
     if( ( pCommandToRelease >= commandStructurePool ) &&
         ( pCommandToRelease < ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
     {
+        #if COMMAND_POOL_STATS
+            ( void ) __atomic_add_fetch( &poolStats.freeCommands, 1U, __ATOMIC_RELAXED );
+        #endif
+
         structReturned = Agent_MessageSend( &commandStructMessageCtx, &pCommandToRelease, 0U );
 
         /* The send should not fail as the queue was created to hold every command
@@ -134,3 +518,64 @@ bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
 
     return structReturned;
 }
+
+#endif /* if COMMAND_POOL_LOCK_FREE */
+
+/*-----------------------------------------------------------*/
+
+bool Agent_GetPoolStats( AgentCommandPoolStats_t * pStats )
+{
+    bool statsWritten = false;
+
+    #if COMMAND_POOL_STATS
+        size_t i;
+
+        if( pStats != NULL )
+        {
+            pStats->poolSize = MQTT_COMMAND_CONTEXTS_POOL_SIZE;
+            pStats->freeCommands = __atomic_load_n( &poolStats.freeCommands, __ATOMIC_RELAXED );
+            pStats->minFreeCommands = __atomic_load_n( &poolStats.minFreeCommands, __ATOMIC_RELAXED );
+            pStats->getCalls = __atomic_load_n( &poolStats.getCalls, __ATOMIC_RELAXED );
+            pStats->timeouts = __atomic_load_n( &poolStats.timeouts, __ATOMIC_RELAXED );
+            pStats->maxWaitUs = __atomic_load_n( &poolStats.maxWaitUs, __ATOMIC_RELAXED );
+
+            for( i = 0; i < AGENT_POOL_WAIT_BUCKETS; i++ )
+            {
+                pStats->waitHistogram[ i ] = __atomic_load_n( &poolStats.waitHistogram[ i ], __ATOMIC_RELAXED );
+            }
+
+            statsWritten = true;
+        }
+    #else
+        ( void ) pStats;
+    #endif
+
+    return statsWritten;
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_ResetPoolStats( void )
+{
+    #if COMMAND_POOL_STATS
+        size_t i;
+        uint32_t freeCommands;
+
+        /* Before the pool is initialized every structure counts as free. */
+        if( initStatus == QUEUE_NOT_INITIALIZED )
+        {
+            __atomic_store_n( &poolStats.freeCommands, MQTT_COMMAND_CONTEXTS_POOL_SIZE, __ATOMIC_RELAXED );
+        }
+
+        freeCommands = __atomic_load_n( &poolStats.freeCommands, __ATOMIC_RELAXED );
+        __atomic_store_n( &poolStats.minFreeCommands, freeCommands, __ATOMIC_RELAXED );
+        __atomic_store_n( &poolStats.getCalls, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &poolStats.timeouts, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &poolStats.maxWaitUs, 0U, __ATOMIC_RELAXED );
+
+        for( i = 0; i < AGENT_POOL_WAIT_BUCKETS; i++ )
+        {
+            __atomic_store_n( &poolStats.waitHistogram[ i ], 0U, __ATOMIC_RELAXED );
+        }
+    #endif
+}
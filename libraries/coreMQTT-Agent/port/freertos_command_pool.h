@@ -20,6 +20,33 @@
 /* MQTT agent includes. */
 #include "core_mqtt_agent.h"
 
+/**
+ * @brief Number of buckets in #AgentCommandPoolStats_t.waitHistogram. Bucket
+ * upper bounds are 100us, 1ms, 10ms, 100ms and 1s; the last bucket holds
+ * everything slower.
+ */
+#define AGENT_POOL_WAIT_BUCKETS    6
+
+/**
+ * @brief Command pool counters, kept when MQTT_AGENT_COMMAND_STATS is enabled
+ * in menuconfig.
+ */
+typedef struct AgentCommandPoolStats
+{
+    uint32_t poolSize;        /**< @brief Number of structures in the pool. */
+    uint32_t freeCommands;    /**< @brief Structures currently free. */
+    uint32_t minFreeCommands; /**< @brief Fewest structures free since the last reset. */
+    uint32_t getCalls;        /**< @brief Calls to Agent_GetCommand(). */
+    uint32_t timeouts;        /**< @brief Calls to Agent_GetCommand() that returned NULL. */
+    uint32_t maxWaitUs;       /**< @brief Longest time spent in Agent_GetCommand(). */
+
+    /**
+     * @brief Histogram of the time spent in Agent_GetCommand(), including
+     * calls that timed out.
+     */
+    uint32_t waitHistogram[ AGENT_POOL_WAIT_BUCKETS ];
+} AgentCommandPoolStats_t;
+
 /**
  * @brief Initialize the common task pool. Not thread safe.
  */
@@ -66,4 +93,20 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs );
  */
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
 
+/**
+ * @brief Copy the command pool counters.
+ *
+ * @param[out] pStats Where to write the counters.
+ *
+ * @return true if MQTT_AGENT_COMMAND_STATS is enabled and @p pStats was
+ * written, otherwise false.
+ */
+bool Agent_GetPoolStats( AgentCommandPoolStats_t * pStats );
+
+/**
+ * @brief Reset the command pool counters. The minimum of free structures
+ * restarts from the current number of free structures.
+ */
+void Agent_ResetPoolStats( void );
+
 #endif /* FREERTOS_COMMAND_POOL_H */
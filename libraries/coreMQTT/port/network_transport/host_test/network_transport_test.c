@@ -0,0 +1,446 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file network_transport_test.c
+ * @brief Host test of the locking in the esp-tls transport.
+ *
+ * esp-tls is replaced by a session over a socket pair that counts the calls
+ * made into it while another call is still in progress, and the calls made
+ * on a session that was already destroyed. mbedTLS allows neither.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "network_transport.h"
+
+/* Bytes sent and echoed back in the concurrency test. */
+#define ECHO_TOTAL_BYTES        ( 256U * 1024U )
+
+/* Size of each send in the concurrency test. */
+#define SEND_CHUNK_BYTES        64U
+
+/* How long the sessions are cycled under load, in milliseconds. */
+#define RECONNECT_RUN_MS        1000U
+
+/* Time for a receive to get into its select() wait, in microseconds. */
+#define RECV_PARK_US            100000U
+
+#define CHECK( xCondition )                                                  \
+    do {                                                                     \
+        if( !( xCondition ) )                                                \
+        {                                                                    \
+            fprintf( stderr, "%s:%d: %s\n", __FILE__, __LINE__, #xCondition ); \
+            lFailures++;                                                     \
+        }                                                                    \
+    } while( 0 )
+
+static int lFailures;
+
+/* The transport side and the peer side of the socket pair. Destroying a
+ * session keeps the socket, as a new connection would likely get the same
+ * descriptor number back. */
+static int lLocalFd = -1;
+static int lPeerFd = -1;
+
+/* Every session is handed out at the same address, as a heap allocator may
+ * do for a disconnect followed by a connect. */
+static esp_tls_t xSession;
+
+static atomic_int lCallsInProgress;
+static atomic_int lOverlappingCalls;
+static atomic_int lCallsOnDestroyedSession;
+static atomic_bool xStop;
+
+static NetworkContext_t xContext;
+
+/*-----------------------------------------------------------*/
+
+static void prvSessionEnter( esp_tls_t * pxTls )
+{
+    if( !pxTls->connected )
+    {
+        atomic_fetch_add( &lCallsOnDestroyedSession, 1 );
+    }
+
+    if( atomic_fetch_add( &lCallsInProgress, 1 ) != 0 )
+    {
+        atomic_fetch_add( &lOverlappingCalls, 1 );
+    }
+
+    /* Widen the window in which another call could overlap. */
+    usleep( 20 );
+}
+
+static void prvSessionLeave( void )
+{
+    atomic_fetch_sub( &lCallsInProgress, 1 );
+}
+
+esp_tls_t * esp_tls_init( void )
+{
+    memset( &xSession, 0, sizeof( xSession ) );
+    xSession.sockfd = -1;
+    return &xSession;
+}
+
+int esp_tls_conn_new_sync( const char * hostname,
+                           int hostlen,
+                           int port,
+                           const esp_tls_cfg_t * cfg,
+                           esp_tls_t * tls )
+{
+    ( void ) hostname;
+    ( void ) hostlen;
+    ( void ) port;
+    ( void ) cfg;
+
+    tls->sockfd = lLocalFd;
+    tls->connected = true;
+    return 1;
+}
+
+int esp_tls_conn_new_async( const char * hostname,
+                            int hostlen,
+                            int port,
+                            const esp_tls_cfg_t * cfg,
+                            esp_tls_t * tls )
+{
+    return esp_tls_conn_new_sync( hostname, hostlen, port, cfg, tls );
+}
+
+int esp_tls_conn_destroy( esp_tls_t * tls )
+{
+    tls->connected = false;
+    return 0;
+}
+
+ssize_t esp_tls_conn_write( esp_tls_t * tls,
+                            const void * data,
+                            size_t datalen )
+{
+    prvSessionEnter( tls );
+    ssize_t lRet = write( tls->sockfd, data, datalen );
+
+    if( ( lRet < 0 ) && ( errno == EAGAIN ) )
+    {
+        lRet = ESP_TLS_ERR_SSL_WANT_WRITE;
+    }
+
+    prvSessionLeave();
+    return lRet;
+}
+
+ssize_t esp_tls_conn_read( esp_tls_t * tls,
+                           void * data,
+                           size_t datalen )
+{
+    prvSessionEnter( tls );
+    ssize_t lRet = read( tls->sockfd, data, datalen );
+
+    if( ( lRet < 0 ) && ( errno == EAGAIN ) )
+    {
+        lRet = ESP_TLS_ERR_SSL_WANT_READ;
+    }
+
+    prvSessionLeave();
+    return lRet;
+}
+
+ssize_t esp_tls_get_bytes_avail( esp_tls_t * tls )
+{
+    prvSessionEnter( tls );
+    prvSessionLeave();
+    return 0;
+}
+
+esp_err_t esp_tls_get_conn_sockfd( esp_tls_t * tls,
+                                   int * sockfd )
+{
+    *sockfd = tls->sockfd;
+    return ESP_OK;
+}
+
+esp_err_t esp_tls_get_error_handle( esp_tls_t * tls,
+                                    esp_tls_error_handle_t * error_handle )
+{
+    ( void ) tls;
+    ( void ) error_handle;
+    return ESP_FAIL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSetUp( void )
+{
+    int lFds[ 2 ];
+
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, lFds ) != 0 )
+    {
+        perror( "socketpair" );
+        exit( 1 );
+    }
+
+    lLocalFd = lFds[ 0 ];
+    lPeerFd = lFds[ 1 ];
+    fcntl( lLocalFd, F_SETFL, fcntl( lLocalFd, F_GETFL ) | O_NONBLOCK );
+
+    atomic_store( &lOverlappingCalls, 0 );
+    atomic_store( &lCallsOnDestroyedSession, 0 );
+    atomic_store( &xStop, false );
+
+    memset( &xContext, 0, sizeof( xContext ) );
+    xContext.xTlsContextSemaphore = xSemaphoreCreateMutex();
+    xContext.pcHostname = "localhost";
+    xContext.xPort = 8883;
+    xContext.pcServerRootCAPem = "root CA";
+    xContext.pcClientCertPem = "certificate";
+    xContext.pcClientKeyPem = "private key";
+}
+
+static void prvTearDown( void )
+{
+    ( void ) xTlsDisconnect( &xContext );
+    close( lLocalFd );
+    close( lPeerFd );
+}
+
+/* Send the peer back everything it receives until told to stop. */
+static void * prvEchoThread( void * pvArg )
+{
+    uint8_t ucBuffer[ 512 ];
+    struct pollfd xPoll = { .fd = lPeerFd, .events = POLLIN };
+
+    ( void ) pvArg;
+
+    while( !atomic_load( &xStop ) )
+    {
+        if( poll( &xPoll, 1, 10 ) <= 0 )
+        {
+            continue;
+        }
+
+        ssize_t lRead = read( lPeerFd, ucBuffer, sizeof( ucBuffer ) );
+
+        /* The receiver stops reading once the test ends, so never block on
+         * a full socket. */
+        for( ssize_t lWritten = 0; lRead > 0 && lWritten < lRead && !atomic_load( &xStop ); )
+        {
+            ssize_t lRet = send( lPeerFd, ucBuffer + lWritten, ( size_t ) ( lRead - lWritten ), MSG_DONTWAIT );
+
+            if( lRet > 0 )
+            {
+                lWritten += lRet;
+            }
+            else if( errno == EAGAIN )
+            {
+                usleep( 100 );
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void * prvSendThread( void * pvArg )
+{
+    uint8_t ucChunk[ SEND_CHUNK_BYTES ];
+    size_t uxSent = 0;
+
+    ( void ) pvArg;
+
+    while( uxSent < ECHO_TOTAL_BYTES && !atomic_load( &xStop ) )
+    {
+        for( size_t i = 0; i < sizeof( ucChunk ); i++ )
+        {
+            ucChunk[ i ] = ( uint8_t ) ( uxSent + i );
+        }
+
+        int32_t lRet = espTlsTransportSend( &xContext, ucChunk, sizeof( ucChunk ) );
+
+        if( lRet > 0 )
+        {
+            uxSent += ( size_t ) lRet;
+        }
+        else
+        {
+            /* Back off as coreMQTT does, so the receiver can drain. */
+            usleep( 100 );
+        }
+    }
+
+    return NULL;
+}
+
+static void * prvRecvThread( void * pvArg )
+{
+    size_t * puxReceived = pvArg;
+    uint8_t ucBuffer[ 100 ];
+
+    while( *puxReceived < ECHO_TOTAL_BYTES && !atomic_load( &xStop ) )
+    {
+        int32_t lRet = espTlsTransportRecv( &xContext, ucBuffer, sizeof( ucBuffer ) );
+
+        for( int32_t i = 0; i < lRet; i++ )
+        {
+            if( ucBuffer[ i ] != ( uint8_t ) ( *puxReceived + ( size_t ) i ) )
+            {
+                fprintf( stderr, "Corrupt byte at offset %zu\n", *puxReceived + ( size_t ) i );
+                lFailures++;
+                return NULL;
+            }
+        }
+
+        if( lRet > 0 )
+        {
+            *puxReceived += ( size_t ) lRet;
+        }
+    }
+
+    return NULL;
+}
+
+/* Whatever the other direction is doing, a receive must find the data it
+ * started on and no partial session call may overlap another. */
+static void testSendAndRecvConcurrently( void )
+{
+    pthread_t xEcho, xSender, xReceiver;
+    size_t uxReceived = 0;
+
+    prvSetUp();
+    CHECK( xTlsConnect( &xContext ) == TLS_TRANSPORT_SUCCESS );
+
+    pthread_create( &xEcho, NULL, prvEchoThread, NULL );
+    pthread_create( &xReceiver, NULL, prvRecvThread, &uxReceived );
+    pthread_create( &xSender, NULL, prvSendThread, NULL );
+
+    pthread_join( xSender, NULL );
+    pthread_join( xReceiver, NULL );
+    atomic_store( &xStop, true );
+    pthread_join( xEcho, NULL );
+
+    CHECK( uxReceived == ECHO_TOTAL_BYTES );
+    CHECK( atomic_load( &lOverlappingCalls ) == 0 );
+    CHECK( atomic_load( &lCallsOnDestroyedSession ) == 0 );
+
+    prvTearDown();
+}
+
+static void * prvRecvOnceThread( void * pvArg )
+{
+    uint8_t ucByte;
+
+    *( int32_t * ) pvArg = espTlsTransportRecv( &xContext, &ucByte, 1 );
+    return NULL;
+}
+
+/* A receive waiting for data while the connection is replaced must not read
+ * from the new session, even though it has the same address. */
+static void testRecvAcrossReconnectFails( void )
+{
+    pthread_t xReceiver;
+    int32_t lRet = 0;
+    uint8_t ucByte = 0x5A;
+
+    prvSetUp();
+    CHECK( xTlsConnect( &xContext ) == TLS_TRANSPORT_SUCCESS );
+
+    pthread_create( &xReceiver, NULL, prvRecvOnceThread, &lRet );
+    usleep( RECV_PARK_US );
+
+    CHECK( xTlsDisconnect( &xContext ) == TLS_TRANSPORT_SUCCESS );
+    CHECK( xTlsConnect( &xContext ) == TLS_TRANSPORT_SUCCESS );
+    CHECK( xContext.pxTls == &xSession );
+    CHECK( write( lPeerFd, &ucByte, 1 ) == 1 );
+
+    pthread_join( xReceiver, NULL );
+
+    CHECK( lRet == -1 );
+
+    prvTearDown();
+}
+
+static void * prvReconnectThread( void * pvArg )
+{
+    ( void ) pvArg;
+
+    while( !atomic_load( &xStop ) )
+    {
+        ( void ) xTlsDisconnect( &xContext );
+        usleep( 100 );
+        ( void ) xTlsConnect( &xContext );
+        usleep( 1000 );
+    }
+
+    return NULL;
+}
+
+/* Sessions destroyed and created under a sender and a receiver are never
+ * used after they are destroyed. */
+static void testSendAndRecvWithReconnects( void )
+{
+    pthread_t xEcho, xSender, xReceiver, xReconnect;
+    size_t uxReceived = 0;
+
+    prvSetUp();
+    CHECK( xTlsConnect( &xContext ) == TLS_TRANSPORT_SUCCESS );
+
+    pthread_create( &xEcho, NULL, prvEchoThread, NULL );
+    pthread_create( &xReceiver, NULL, prvRecvThread, &uxReceived );
+    pthread_create( &xSender, NULL, prvSendThread, NULL );
+    pthread_create( &xReconnect, NULL, prvReconnectThread, NULL );
+
+    usleep( RECONNECT_RUN_MS * 1000U );
+    atomic_store( &xStop, true );
+
+    pthread_join( xReconnect, NULL );
+    pthread_join( xSender, NULL );
+    pthread_join( xReceiver, NULL );
+    pthread_join( xEcho, NULL );
+
+    CHECK( atomic_load( &lOverlappingCalls ) == 0 );
+    CHECK( atomic_load( &lCallsOnDestroyedSession ) == 0 );
+
+    prvTearDown();
+}
+
+int main( void )
+{
+    testSendAndRecvConcurrently();
+    testRecvAcrossReconnectFails();
+    testSendAndRecvWithReconnects();
+
+    printf( "%s\n", ( lFailures == 0 ) ? "OK" : "FAIL" );
+    return ( lFailures == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file esp_tls.h
+ * @brief Host stand-in for the esp-tls API used by the TLS transport.
+ *
+ * The functions are implemented by the test, which runs the session over a
+ * socket pair and checks how the transport calls into it.
+ */
+
+#ifndef ESP_TLS_H_
+#define ESP_TLS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                                  0
+#define ESP_FAIL                                -1
+#define ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED    0x8010
+
+#define ESP_TLS_ERR_SSL_WANT_READ               -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE              -0x6880
+
+typedef struct esp_tls_last_error
+{
+    esp_err_t last_error;
+} esp_tls_last_error_t;
+
+typedef esp_tls_last_error_t * esp_tls_error_handle_t;
+
+typedef struct esp_tls
+{
+    int sockfd;
+    bool connected;
+} esp_tls_t;
+
+typedef struct esp_tls_cfg
+{
+    const char ** alpn_protos;
+    const unsigned char * cacert_buf;
+    unsigned int cacert_bytes;
+    const unsigned char * clientcert_buf;
+    unsigned int clientcert_bytes;
+    const unsigned char * clientkey_buf;
+    unsigned int clientkey_bytes;
+    bool non_block;
+    bool use_secure_element;
+    void * ds_data;
+    int timeout_ms;
+    bool use_global_ca_store;
+    bool skip_common_name;
+    bool is_plain_tcp;
+} esp_tls_cfg_t;
+
+esp_tls_t * esp_tls_init( void );
+int esp_tls_conn_new_sync( const char * hostname,
+                           int hostlen,
+                           int port,
+                           const esp_tls_cfg_t * cfg,
+                           esp_tls_t * tls );
+int esp_tls_conn_new_async( const char * hostname,
+                            int hostlen,
+                            int port,
+                            const esp_tls_cfg_t * cfg,
+                            esp_tls_t * tls );
+int esp_tls_conn_destroy( esp_tls_t * tls );
+ssize_t esp_tls_conn_write( esp_tls_t * tls,
+                            const void * data,
+                            size_t datalen );
+ssize_t esp_tls_conn_read( esp_tls_t * tls,
+                           void * data,
+                           size_t datalen );
+ssize_t esp_tls_get_bytes_avail( esp_tls_t * tls );
+esp_err_t esp_tls_get_conn_sockfd( esp_tls_t * tls,
+                                   int * sockfd );
+esp_err_t esp_tls_get_error_handle( esp_tls_t * tls,
+                                    esp_tls_error_handle_t * error_handle );
+
+#endif /* ifndef ESP_TLS_H_ */
@@ -0,0 +1,61 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file semphr.h
+ * @brief Host stand-in for FreeRTOS mutexes, backed by pthread mutexes.
+ */
+
+#ifndef SEMPHR_H_
+#define SEMPHR_H_
+
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef pthread_mutex_t StaticSemaphore_t;
+typedef pthread_mutex_t * SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutexStatic( StaticSemaphore_t * pxBuffer )
+{
+    pthread_mutex_init( pxBuffer, NULL );
+    return pxBuffer;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+    return xSemaphoreCreateMutexStatic( malloc( sizeof( StaticSemaphore_t ) ) );
+}
+
+static inline BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                                         TickType_t xTicksToWait )
+{
+    ( void ) xTicksToWait;
+    return ( pthread_mutex_lock( xSemaphore ) == 0 ) ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    return ( pthread_mutex_unlock( xSemaphore ) == 0 ) ? pdTRUE : pdFALSE;
+}
+
+#endif /* ifndef SEMPHR_H_ */
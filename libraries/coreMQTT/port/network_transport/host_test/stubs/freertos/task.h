@@ -0,0 +1,94 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file task.h
+ * @brief Host stand-in for the FreeRTOS task functions used by the TLS
+ * transport. Only the synchronous connect is exercised on the host.
+ */
+
+#ifndef TASK_H_
+#define TASK_H_
+
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef void * TaskHandle_t;
+typedef void ( * TaskFunction_t )( void * );
+
+typedef enum
+{
+    eSetValueWithOverwrite
+} eNotifyAction;
+
+#define tskNO_AFFINITY    0x7FFFFFFF
+
+static inline void vTaskDelay( TickType_t xTicks )
+{
+    usleep( xTicks * 1000U );
+}
+
+static inline TickType_t xTaskGetTickCount( void )
+{
+    return 0;
+}
+
+static inline TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return NULL;
+}
+
+static inline BaseType_t xTaskCreatePinnedToCore( TaskFunction_t pxTaskCode,
+                                                  const char * pcName,
+                                                  uint32_t ulStackDepth,
+                                                  void * pvParameters,
+                                                  UBaseType_t uxPriority,
+                                                  TaskHandle_t * pxCreatedTask,
+                                                  BaseType_t xCoreID )
+{
+    ( void ) pxTaskCode;
+    ( void ) pcName;
+    ( void ) ulStackDepth;
+    ( void ) pvParameters;
+    ( void ) uxPriority;
+    ( void ) pxCreatedTask;
+    ( void ) xCoreID;
+    return pdFAIL;
+}
+
+static inline BaseType_t xTaskNotify( TaskHandle_t xTask,
+                                      uint32_t ulValue,
+                                      eNotifyAction eAction )
+{
+    ( void ) xTask;
+    ( void ) ulValue;
+    ( void ) eAction;
+    return pdPASS;
+}
+
+static inline void vTaskDelete( TaskHandle_t xTask )
+{
+    ( void ) xTask;
+}
+
+#endif /* ifndef TASK_H_ */
@@ -0,0 +1,46 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file sdkconfig.h
+ * @brief Configuration of the TLS transports for the host test: defaults,
+ * with a long receive wait so a receive is reliably parked in select().
+ */
+
+#ifndef SDKCONFIG_H_
+#define SDKCONFIG_H_
+
+#define CONFIG_CORE_MQTT_TRANSPORT_RECV_WAIT_MS                 500
+#define CONFIG_CORE_MQTT_TRANSPORT_CREDENTIAL_CACHE_SIZE        4
+#define CONFIG_CORE_MQTT_TRANSPORT_WRITEV_BUFFER_SIZE           512
+#define CONFIG_CORE_MQTT_TRANSPORT_CONNECT_TIMEOUT_MS           10000
+#define CONFIG_CORE_MQTT_TRANSPORT_ASYNC_CONNECT_STACK_SIZE     4096
+#define CONFIG_CORE_MQTT_TRANSPORT_ASYNC_CONNECT_PRIORITY       5
+
+#define CONFIG_CORE_HTTP_TRANSPORT_RECV_WAIT_MS                 500
+#define CONFIG_CORE_HTTP_TRANSPORT_CREDENTIAL_CACHE_SIZE        4
+#define CONFIG_CORE_HTTP_TRANSPORT_WRITEV_BUFFER_SIZE           512
+#define CONFIG_CORE_HTTP_TRANSPORT_CONNECT_TIMEOUT_MS           10000
+#define CONFIG_CORE_HTTP_TRANSPORT_ASYNC_CONNECT_STACK_SIZE     4096
+#define CONFIG_CORE_HTTP_TRANSPORT_ASYNC_CONNECT_PRIORITY       5
+
+#endif /* ifndef SDKCONFIG_H_ */
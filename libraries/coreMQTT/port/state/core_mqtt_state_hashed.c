@@ -0,0 +1,806 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_state_hashed.c
+ * @brief The state records of coreMQTT kept as tables hashed by packet
+ * identifier, built instead of core_mqtt_state.c when
+ * CONFIG_CORE_MQTT_STATE_RECORDS_HASHED is set.
+ *
+ * The library searches its record arrays for every acknowledgement and every
+ * incoming QoS 1 or 2 publish, which costs a pass over the array per packet
+ * once hundreds of publishes are in flight. This file implements the same
+ * functions over the same arrays of the MQTT context, which the application
+ * allocates, but uses each one as an open-addressed table: a record lives at
+ * its packet identifier modulo MQTT_STATE_ARRAY_MAX_COUNT, or in the first free
+ * slot after it. A removal shifts the records of the probe run behind the freed
+ * slot back into it, so a zeroed array is an empty table, as the library
+ * expects when it clears the records of a new session, and a lookup stops at
+ * the first free slot. A table about twice as large as the window keeps probe
+ * runs short.
+ *
+ * Records don't move as their state changes, so the slot order says nothing
+ * about the order publishes were sent in. The library hands out packet
+ * identifiers in sequence, so the publishes and PUBRELs to resend after a
+ * reconnect are walked from the identifier furthest behind the next one of the
+ * context to the newest.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "core_mqtt_state.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of slots in each table.
+ */
+#define STATE_TABLE_SIZE          ( ( size_t ) MQTT_STATE_ARRAY_MAX_COUNT )
+
+/**
+ * @brief Returned by #findSlot when the table is full and doesn't hold the
+ * packet identifier.
+ */
+#define STATE_TABLE_FULL          STATE_TABLE_SIZE
+
+/**
+ * @brief The number of packet identifiers the library cycles through,
+ * skipping #MQTT_PACKET_ID_INVALID.
+ */
+#define PACKET_ID_COUNT           65535U
+
+/**
+ * @brief The slot a packet identifier hashes to.
+ */
+#define HOME_SLOT( packetId )     ( ( size_t ) ( packetId ) % STATE_TABLE_SIZE )
+
+/**
+ * @brief The slot after @a index, wrapping at the end of the table.
+ */
+#define NEXT_SLOT( index )        ( ( ( index ) + 1U ) % STATE_TABLE_SIZE )
+
+/**
+ * @brief The states of outgoing publishes that are resent after a reconnect.
+ */
+#define PUBLISH_RESEND_STATES     ( ( 1U << MQTTPubAckPending ) | ( 1U << MQTTPubRecPending ) )
+
+/**
+ * @brief The states of outgoing publishes whose PUBREL is resent after a
+ * reconnect.
+ */
+#define PUBREL_RESEND_STATES      ( ( 1U << MQTTPubRelSend ) | ( 1U << MQTTPubCompPending ) )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The slot holding @a packetId, the free slot that ends its probe run,
+ * or #STATE_TABLE_FULL.
+ */
+static size_t findSlot( const MQTTPubAckInfo_t * pRecords,
+                        uint16_t packetId );
+
+/**
+ * @brief Adds a record, failing with #MQTTStateCollision if the table already
+ * holds @a packetId and with #MQTTNoMemory if it is full.
+ */
+static MQTTStatus_t addRecord( MQTTPubAckInfo_t * pRecords,
+                               uint16_t packetId,
+                               MQTTQoS_t qos,
+                               MQTTPublishState_t publishState );
+
+/**
+ * @brief Frees the slot at @a index and shifts the rest of its probe run back.
+ */
+static void removeRecord( MQTTPubAckInfo_t * pRecords,
+                          size_t index );
+
+/**
+ * @brief How many identifiers ago the library handed out @a packetId, from 1
+ * for the last one up to #PACKET_ID_COUNT.
+ */
+static uint32_t packetIdAge( uint16_t nextPacketId,
+                             uint16_t packetId );
+
+/**
+ * @brief The oldest outgoing record in one of @a searchStates that is younger
+ * than the record the cursor last returned.
+ */
+static uint16_t stateSelect( const MQTTContext_t * pMqttContext,
+                             uint32_t searchStates,
+                             MQTTStateCursor_t * pCursor );
+
+static bool validateTransitionPublish( MQTTPublishState_t currentState,
+                                       MQTTPublishState_t newState,
+                                       MQTTStateOperation_t opType,
+                                       MQTTQoS_t qos );
+
+static bool validateTransitionAck( MQTTPublishState_t currentState,
+                                   MQTTPublishState_t newState );
+
+static bool isPublishOutgoing( MQTTPubAckType_t packetType,
+                               MQTTStateOperation_t opType );
+
+/*-----------------------------------------------------------*/
+
+static size_t findSlot( const MQTTPubAckInfo_t * pRecords,
+                        uint16_t packetId )
+{
+    size_t index = HOME_SLOT( packetId );
+    size_t probes = 0U;
+
+    while( ( probes < STATE_TABLE_SIZE ) &&
+           ( pRecords[ index ].packetId != MQTT_PACKET_ID_INVALID ) &&
+           ( pRecords[ index ].packetId != packetId ) )
+    {
+        index = NEXT_SLOT( index );
+        probes++;
+    }
+
+    return ( probes < STATE_TABLE_SIZE ) ? index : STATE_TABLE_FULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t addRecord( MQTTPubAckInfo_t * pRecords,
+                               uint16_t packetId,
+                               MQTTQoS_t qos,
+                               MQTTPublishState_t publishState )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t index;
+
+    assert( packetId != MQTT_PACKET_ID_INVALID );
+    assert( qos != MQTTQoS0 );
+
+    index = findSlot( pRecords, packetId );
+
+    if( index == STATE_TABLE_FULL )
+    {
+        LogError( ( "No memory available to store the record for packet ID %hu.",
+                    ( unsigned short ) packetId ) );
+        status = MQTTNoMemory;
+    }
+    else if( pRecords[ index ].packetId == packetId )
+    {
+        LogError( ( "Collision detected for packet ID %hu.",
+                    ( unsigned short ) packetId ) );
+        status = MQTTStateCollision;
+    }
+    else
+    {
+        pRecords[ index ].packetId = packetId;
+        pRecords[ index ].qos = qos;
+        pRecords[ index ].publishState = publishState;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void removeRecord( MQTTPubAckInfo_t * pRecords,
+                          size_t index )
+{
+    size_t freed = index;
+    size_t next = NEXT_SLOT( index );
+    size_t home;
+
+    ( void ) memset( &( pRecords[ freed ] ), 0x00, sizeof( MQTTPubAckInfo_t ) );
+
+    /* Ends at the freed slot at the latest, even in a full table. */
+    while( pRecords[ next ].packetId != MQTT_PACKET_ID_INVALID )
+    {
+        home = HOME_SLOT( pRecords[ next ].packetId );
+
+        /* The record moves back unless its home lies cyclically after the
+         * freed slot, up to the record itself. */
+        if( ( ( next + STATE_TABLE_SIZE - home ) % STATE_TABLE_SIZE ) >=
+            ( ( next + STATE_TABLE_SIZE - freed ) % STATE_TABLE_SIZE ) )
+        {
+            pRecords[ freed ] = pRecords[ next ];
+            ( void ) memset( &( pRecords[ next ] ), 0x00, sizeof( MQTTPubAckInfo_t ) );
+            freed = next;
+        }
+
+        next = NEXT_SLOT( next );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t packetIdAge( uint16_t nextPacketId,
+                             uint16_t packetId )
+{
+    return ( ( ( uint32_t ) nextPacketId + PACKET_ID_COUNT - packetId - 1U ) % PACKET_ID_COUNT ) + 1U;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t stateSelect( const MQTTContext_t * pMqttContext,
+                             uint32_t searchStates,
+                             MQTTStateCursor_t * pCursor )
+{
+    const MQTTPubAckInfo_t * pRecords = pMqttContext->outgoingPublishRecords;
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    uint32_t bound;
+    uint32_t age;
+    uint32_t oldest = 0U;
+    size_t index;
+
+    /* The cursor holds PACKET_ID_COUNT + 1 less the age of the record it
+     * last returned, so MQTT_STATE_CURSOR_INITIALIZER admits every age. */
+    bound = ( *pCursor <= PACKET_ID_COUNT ) ? ( PACKET_ID_COUNT + 1U - ( uint32_t ) *pCursor ) : 0U;
+
+    for( index = 0U; index < STATE_TABLE_SIZE; index++ )
+    {
+        if( ( pRecords[ index ].packetId != MQTT_PACKET_ID_INVALID ) &&
+            ( ( searchStates & ( 1U << pRecords[ index ].publishState ) ) != 0U ) )
+        {
+            age = packetIdAge( pMqttContext->nextPacketId, pRecords[ index ].packetId );
+
+            if( ( age < bound ) && ( age > oldest ) )
+            {
+                oldest = age;
+                packetId = pRecords[ index ].packetId;
+            }
+        }
+    }
+
+    *pCursor = ( MQTTStateCursor_t ) ( PACKET_ID_COUNT + 1U - oldest );
+
+    return packetId;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool validateTransitionPublish( MQTTPublishState_t currentState,
+                                       MQTTPublishState_t newState,
+                                       MQTTStateOperation_t opType,
+                                       MQTTQoS_t qos )
+{
+    bool isValid = false;
+
+    switch( currentState )
+    {
+        case MQTTStateNull:
+
+            /* Transitions from null occur when storing a new entry into the
+             * record. */
+            if( opType == MQTT_RECEIVE )
+            {
+                isValid = ( newState == MQTTPubAckSend ) || ( newState == MQTTPubRecSend );
+            }
+
+            break;
+
+        case MQTTPublishSend:
+
+            /* Outgoing publish. All such publishes start in this state due to
+             * the reserve operation. */
+            switch( qos )
+            {
+                case MQTTQoS1:
+                    isValid = newState == MQTTPubAckPending;
+                    break;
+
+                case MQTTQoS2:
+                    isValid = newState == MQTTPubRecPending;
+                    break;
+
+                case MQTTQoS0:
+                default:
+                    /* QoS 0 is checked before calling this function. */
+                    break;
+            }
+
+            break;
+
+        /* Publishes resent when a session is reestablished stay in their
+         * state. */
+        case MQTTPubAckPending:
+            isValid = newState == MQTTPubAckPending;
+            break;
+
+        case MQTTPubRecPending:
+            isValid = newState == MQTTPubRecPending;
+            break;
+
+        default:
+            /* For a PUBLISH, we should not start from any other state. */
+            break;
+    }
+
+    return isValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool validateTransitionAck( MQTTPublishState_t currentState,
+                                   MQTTPublishState_t newState )
+{
+    bool isValid = false;
+
+    switch( currentState )
+    {
+        case MQTTPubAckSend:
+        /* Incoming publish, QoS 1. */
+        case MQTTPubAckPending:
+            /* Outgoing publish, QoS 1. */
+            isValid = newState == MQTTPublishDone;
+            break;
+
+        case MQTTPubRecSend:
+            /* Incoming publish, QoS 2. */
+            isValid = newState == MQTTPubRelPending;
+            break;
+
+        case MQTTPubRelPending:
+
+            /* Incoming publish, QoS 2. A duplicate publish received after a
+             * reconnect sends its PUBREC again and keeps the state. */
+            isValid = ( newState == MQTTPubCompSend ) || ( newState == MQTTPubRelPending );
+            break;
+
+        case MQTTPubCompSend:
+
+            /* Incoming publish, QoS 2. A duplicate PUBREL received before the
+             * PUBCOMP went out keeps the state. */
+            isValid = ( newState == MQTTPublishDone ) || ( newState == MQTTPubCompSend );
+            break;
+
+        case MQTTPubRecPending:
+            /* Outgoing publish, QoS 2. */
+            isValid = newState == MQTTPubRelSend;
+            break;
+
+        case MQTTPubRelSend:
+            /* Outgoing publish, QoS 2. */
+            isValid = newState == MQTTPubCompPending;
+            break;
+
+        case MQTTPubCompPending:
+
+            /* Outgoing publish, QoS 2. A PUBREL resent after a reconnect keeps
+             * the state. */
+            isValid = ( newState == MQTTPublishDone ) || ( newState == MQTTPubCompPending );
+            break;
+
+        case MQTTPublishDone:
+        /* Done state should delete the record. */
+        case MQTTPublishSend:
+        /* If an ack was sent/received we shouldn't have been in this state. */
+        case MQTTStateNull:
+        /* If an ack was sent/received the record should exist. */
+        default:
+            break;
+    }
+
+    return isValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool isPublishOutgoing( MQTTPubAckType_t packetType,
+                               MQTTStateOperation_t opType )
+{
+    bool isOutgoing = false;
+
+    switch( packetType )
+    {
+        case MQTTPuback:
+        case MQTTPubrec:
+        case MQTTPubcomp:
+            isOutgoing = opType == MQTT_RECEIVE;
+            break;
+
+        case MQTTPubrel:
+            isOutgoing = opType == MQTT_SEND;
+            break;
+
+        default:
+            /* No other ack type. */
+            break;
+    }
+
+    return isOutgoing;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_ReserveState( MQTTContext_t * pMqttContext,
+                                uint16_t packetId,
+                                MQTTQoS_t qos )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( qos == MQTTQoS0 )
+    {
+        status = MQTTSuccess;
+    }
+    else if( ( packetId == MQTT_PACKET_ID_INVALID ) || ( pMqttContext == NULL ) )
+    {
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* Collisions are detected when adding the record. */
+        status = addRecord( pMqttContext->outgoingPublishRecords,
+                            packetId,
+                            qos,
+                            MQTTPublishSend );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTPublishState_t MQTT_CalculateStatePublish( MQTTStateOperation_t opType,
+                                               MQTTQoS_t qos )
+{
+    MQTTPublishState_t calculatedState = MQTTStateNull;
+
+    switch( qos )
+    {
+        case MQTTQoS0:
+            calculatedState = MQTTPublishDone;
+            break;
+
+        case MQTTQoS1:
+            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubAckPending : MQTTPubAckSend;
+            break;
+
+        case MQTTQoS2:
+            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubRecPending : MQTTPubRecSend;
+            break;
+
+        default:
+            break;
+    }
+
+    return calculatedState;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_UpdateStatePublish( MQTTContext_t * pMqttContext,
+                                      uint16_t packetId,
+                                      MQTTStateOperation_t opType,
+                                      MQTTQoS_t qos,
+                                      MQTTPublishState_t * pNewState )
+{
+    MQTTPublishState_t newState = MQTTStateNull;
+    MQTTPublishState_t currentState = MQTTStateNull;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTPubAckInfo_t * pRecords = NULL;
+    size_t index = STATE_TABLE_FULL;
+
+    if( ( pMqttContext == NULL ) || ( pNewState == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pMqttContext=%p, pNewState=%p",
+                    ( void * ) pMqttContext,
+                    ( void * ) pNewState ) );
+        mqttStatus = MQTTBadParameter;
+    }
+    else if( qos == MQTTQoS0 )
+    {
+        /* QoS 0 publish. Do nothing. */
+        *pNewState = MQTTPublishDone;
+    }
+    else if( packetId == MQTT_PACKET_ID_INVALID )
+    {
+        /* Publishes > QoS 0 need a valid packet ID. */
+        mqttStatus = MQTTBadParameter;
+    }
+    else if( opType == MQTT_SEND )
+    {
+        pRecords = pMqttContext->outgoingPublishRecords;
+        index = findSlot( pRecords, packetId );
+
+        if( ( index == STATE_TABLE_FULL ) || ( pRecords[ index ].packetId != packetId ) )
+        {
+            LogError( ( "No entry found for packet ID %hu.", ( unsigned short ) packetId ) );
+            mqttStatus = MQTTBadParameter;
+        }
+        else if( pRecords[ index ].qos != qos )
+        {
+            LogError( ( "QoS passed = %d, record QoS = %d",
+                        ( int ) qos,
+                        ( int ) pRecords[ index ].qos ) );
+            mqttStatus = MQTTBadParameter;
+        }
+        else
+        {
+            currentState = pRecords[ index ].publishState;
+        }
+    }
+    else
+    {
+        /* The record starts from the transient null state, updated below.
+         * A duplicate publish returns #MQTTStateCollision. */
+        pRecords = pMqttContext->incomingPublishRecords;
+        mqttStatus = addRecord( pRecords, packetId, qos, MQTTStateNull );
+
+        if( mqttStatus == MQTTSuccess )
+        {
+            index = findSlot( pRecords, packetId );
+        }
+    }
+
+    if( ( mqttStatus == MQTTSuccess ) && ( pRecords != NULL ) )
+    {
+        newState = MQTT_CalculateStatePublish( opType, qos );
+
+        if( validateTransitionPublish( currentState, newState, opType, qos ) == true )
+        {
+            pRecords[ index ].publishState = newState;
+            *pNewState = newState;
+        }
+        else
+        {
+            LogError( ( "Invalid transition from state %s to state %s.",
+                        MQTT_State_strerror( currentState ),
+                        MQTT_State_strerror( newState ) ) );
+            mqttStatus = MQTTIllegalState;
+        }
+    }
+
+    return mqttStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTPublishState_t MQTT_CalculateStateAck( MQTTPubAckType_t packetType,
+                                           MQTTStateOperation_t opType,
+                                           MQTTQoS_t qos )
+{
+    MQTTPublishState_t calculatedState = MQTTStateNull;
+    /* There are more QoS 2 cases than QoS 1, so initialize to that. */
+    bool qosValid = qos == MQTTQoS2;
+
+    switch( packetType )
+    {
+        case MQTTPuback:
+            qosValid = qos == MQTTQoS1;
+            calculatedState = MQTTPublishDone;
+            break;
+
+        case MQTTPubrec:
+
+            /* Incoming publish: sending a PUBREC waits for the PUBREL.
+             * Outgoing publish: receiving a PUBREC sends the PUBREL. */
+            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubRelPending : MQTTPubRelSend;
+            break;
+
+        case MQTTPubrel:
+
+            /* Incoming publish: receiving a PUBREL sends the PUBCOMP.
+             * Outgoing publish: sending a PUBREL waits for the PUBCOMP. */
+            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubCompPending : MQTTPubCompSend;
+            break;
+
+        case MQTTPubcomp:
+            calculatedState = MQTTPublishDone;
+            break;
+
+        default:
+            /* No other ack type. */
+            break;
+    }
+
+    if( qosValid == false )
+    {
+        calculatedState = MQTTStateNull;
+    }
+
+    return calculatedState;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_UpdateStateAck( MQTTContext_t * pMqttContext,
+                                  uint16_t packetId,
+                                  MQTTPubAckType_t packetType,
+                                  MQTTStateOperation_t opType,
+                                  MQTTPublishState_t * pNewState )
+{
+    MQTTPublishState_t newState = MQTTStateNull;
+    MQTTPublishState_t currentState = MQTTStateNull;
+    MQTTStatus_t status = MQTTBadParameter;
+    MQTTPubAckInfo_t * pRecords = NULL;
+    size_t index = STATE_TABLE_FULL;
+
+    if( ( pMqttContext == NULL ) || ( pNewState == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pMqttContext=%p, pNewState=%p.",
+                    ( void * ) pMqttContext,
+                    ( void * ) pNewState ) );
+    }
+    else if( packetId == MQTT_PACKET_ID_INVALID )
+    {
+        LogError( ( "Packet ID must be nonzero." ) );
+    }
+    else if( packetType > MQTTPubcomp )
+    {
+        LogError( ( "Invalid packet type %u.", ( unsigned int ) packetType ) );
+    }
+    else
+    {
+        pRecords = ( isPublishOutgoing( packetType, opType ) == true ) ?
+                   pMqttContext->outgoingPublishRecords :
+                   pMqttContext->incomingPublishRecords;
+        index = findSlot( pRecords, packetId );
+
+        if( ( index == STATE_TABLE_FULL ) || ( pRecords[ index ].packetId != packetId ) )
+        {
+            LogError( ( "No matching record found for publish: PacketId=%hu.",
+                        ( unsigned short ) packetId ) );
+        }
+        else
+        {
+            currentState = pRecords[ index ].publishState;
+            newState = MQTT_CalculateStateAck( packetType, opType, pRecords[ index ].qos );
+
+            if( validateTransitionAck( currentState, newState ) == true )
+            {
+                /* The record stays in its slot through the states of a QoS 2
+                 * exchange, as the resend order comes from the packet ID. */
+                if( newState == MQTTPublishDone )
+                {
+                    removeRecord( pRecords, index );
+                }
+                else
+                {
+                    pRecords[ index ].publishState = newState;
+                }
+
+                *pNewState = newState;
+                status = MQTTSuccess;
+            }
+            else
+            {
+                LogError( ( "Invalid transition from state %s to state %s.",
+                            MQTT_State_strerror( currentState ),
+                            MQTT_State_strerror( newState ) ) );
+                status = MQTTIllegalState;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t MQTT_PubrelToResend( const MQTTContext_t * pMqttContext,
+                              MQTTStateCursor_t * pCursor,
+                              MQTTPublishState_t * pState )
+{
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+
+    if( ( pMqttContext == NULL ) || ( pCursor == NULL ) || ( pState == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL pMqttContext=%p, pCursor=%p"
+                    " pState=%p.",
+                    ( void * ) pMqttContext,
+                    ( void * ) pCursor,
+                    ( void * ) pState ) );
+    }
+    else
+    {
+        packetId = stateSelect( pMqttContext, PUBREL_RESEND_STATES, pCursor );
+
+        /* The state needs to be in #MQTTPubRelSend for sending PUBREL. */
+        if( packetId != MQTT_PACKET_ID_INVALID )
+        {
+            *pState = MQTTPubRelSend;
+        }
+    }
+
+    return packetId;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t MQTT_PublishToResend( const MQTTContext_t * pMqttContext,
+                               MQTTStateCursor_t * pCursor )
+{
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+
+    if( ( pMqttContext == NULL ) || ( pCursor == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL pMqttContext=%p, pCursor=%p",
+                    ( void * ) pMqttContext,
+                    ( void * ) pCursor ) );
+    }
+    else
+    {
+        packetId = stateSelect( pMqttContext, PUBLISH_RESEND_STATES, pCursor );
+    }
+
+    return packetId;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * MQTT_State_strerror( MQTTPublishState_t state )
+{
+    const char * str = NULL;
+
+    switch( state )
+    {
+        case MQTTStateNull:
+            str = "MQTTStateNull";
+            break;
+
+        case MQTTPublishSend:
+            str = "MQTTPublishSend";
+            break;
+
+        case MQTTPubAckSend:
+            str = "MQTTPubAckSend";
+            break;
+
+        case MQTTPubRecSend:
+            str = "MQTTPubRecSend";
+            break;
+
+        case MQTTPubRelSend:
+            str = "MQTTPubRelSend";
+            break;
+
+        case MQTTPubCompSend:
+            str = "MQTTPubCompSend";
+            break;
+
+        case MQTTPubAckPending:
+            str = "MQTTPubAckPending";
+            break;
+
+        case MQTTPubRelPending:
+            str = "MQTTPubRelPending";
+            break;
+
+        case MQTTPubRecPending:
+            str = "MQTTPubRecPending";
+            break;
+
+        case MQTTPubCompPending:
+            str = "MQTTPubCompPending";
+            break;
+
+        case MQTTPublishDone:
+            str = "MQTTPublishDone";
+            break;
+
+        default:
+            /* Invalid state received. */
+            str = "Invalid MQTT State";
+            break;
+    }
+
+    return str;
+}
+
+/*-----------------------------------------------------------*/
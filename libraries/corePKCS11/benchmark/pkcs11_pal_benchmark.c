@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file pkcs11_pal_benchmark.c
+ * @brief Measures find, get and sign throughput of the PKCS #11 PAL when
+ * several tasks use the device credentials at once.
+ *
+ * Every worker task runs one workload in a loop until the run ends:
+ * - find looks up the device certificate with PKCS11_PAL_FindObject(), as
+ *   C_FindObjects does;
+ * - get reads the certificate with PKCS11_PAL_GetObjectValue(), as a TLS
+ *   connection does when it loads its credentials;
+ * - sign calls C_SignInit() and C_Sign() with the device private key, as a
+ *   mutual TLS handshake does, in a session of its own.
+ *
+ * Workers are pinned round-robin to the cores, so with two or more workers on
+ * a dual-core ESP32 the PAL is used from both cores at once.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+/* PKCS #11 includes. */
+#include "core_pkcs11.h"
+#include "core_pkcs11_config.h"
+#include "core_pkcs11_pal.h"
+#include "core_pkcs11_pal_stats.h"
+
+/* Header include. */
+#include "pkcs11_pal_benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Duration of one run.
+ */
+#define BENCHMARK_RUN_TIME_MS        ( 2000U )
+
+/**
+ * @brief Largest number of worker tasks in a run.
+ */
+#define BENCHMARK_MAX_WORKERS        ( 4U )
+
+/**
+ * @brief Stack size of a worker task, enough for an mbedTLS signature.
+ */
+#define BENCHMARK_TASK_STACK_SIZE    ( 6144U )
+
+/**
+ * @brief Priority of the worker tasks.
+ */
+#define BENCHMARK_TASK_PRIORITY      ( tskIDLE_PRIORITY + 1U )
+
+/**
+ * @brief Size of the buffers for data to sign and signatures, that of an
+ * RSA-2048 signature.
+ */
+#define BENCHMARK_SIGNATURE_LENGTH   ( 256U )
+
+/**
+ * @brief Event group bit that starts the workers.
+ */
+#define BENCHMARK_START_BIT          ( 1U << 0 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief What a worker does in its loop.
+ */
+typedef enum BenchmarkWorkload
+{
+    WORKLOAD_FIND = 0,
+    WORKLOAD_GET,
+    WORKLOAD_SIGN,
+    WORKLOAD_COUNT
+} BenchmarkWorkload_t;
+
+/**
+ * @brief Workloads of the workers of one run.
+ */
+typedef struct BenchmarkRun
+{
+    uint32_t workerCount;                                   /**< @brief Number of worker tasks. */
+    BenchmarkWorkload_t workloads[ BENCHMARK_MAX_WORKERS ]; /**< @brief Workload of each worker. */
+} BenchmarkRun_t;
+
+/**
+ * @brief State of one worker task.
+ */
+typedef struct BenchmarkWorker
+{
+    BenchmarkWorkload_t workload; /**< @brief What the worker does. */
+    uint32_t operations;          /**< @brief Completed operations. */
+    uint32_t failures;            /**< @brief Operations that failed. */
+} BenchmarkWorker_t;
+
+/*-----------------------------------------------------------*/
+
+static const char * TAG = "PalBenchmark";
+
+static const char * workloadNames[ WORKLOAD_COUNT ] = { "find", "get", "sign" };
+
+#if CONFIG_CORE_PKCS_SHARED_READS
+    static const char * readMode = "shared";
+#else
+    static const char * readMode = "exclusive";
+#endif
+
+/**
+ * @brief Runs, from one worker without contention to mixes of readers and
+ * signers on every core.
+ */
+static const BenchmarkRun_t benchmarkRuns[] =
+{
+    { 1U, { WORKLOAD_FIND } },
+    { 1U, { WORKLOAD_GET } },
+    { 1U, { WORKLOAD_SIGN } },
+    { 2U, { WORKLOAD_FIND, WORKLOAD_FIND } },
+    { 2U, { WORKLOAD_GET,  WORKLOAD_GET } },
+    { 4U, { WORKLOAD_FIND, WORKLOAD_GET, WORKLOAD_FIND, WORKLOAD_GET } },
+    { 4U, { WORKLOAD_SIGN, WORKLOAD_GET, WORKLOAD_FIND, WORKLOAD_GET } },
+    { 4U, { WORKLOAD_SIGN, WORKLOAD_SIGN, WORKLOAD_GET, WORKLOAD_FIND } },
+};
+
+/**
+ * @brief Worker state of the current run.
+ */
+static BenchmarkWorker_t workers[ BENCHMARK_MAX_WORKERS ];
+
+/**
+ * @brief Event group used to start every worker at the same time.
+ */
+static EventGroupHandle_t startEvent = NULL;
+
+/**
+ * @brief Semaphore each worker gives when it is ready and when it has finished.
+ */
+static SemaphoreHandle_t doneSemaphore = NULL;
+
+/**
+ * @brief Set by the benchmark task when the run time is over.
+ */
+static volatile bool stopRun = false;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Open a session and find the device private key and its mechanism.
+ *
+ * @param[out] pSession The session, to be closed with C_CloseSession().
+ * @param[out] pKey The private key.
+ * @param[out] pMechanism The signing mechanism for the key.
+ * @param[out] pDataLength Length of the data that the mechanism signs.
+ *
+ * @return CKR_OK on success.
+ */
+static CK_RV openSigningSession( CK_SESSION_HANDLE * pSession,
+                                 CK_OBJECT_HANDLE * pKey,
+                                 CK_MECHANISM_TYPE * pMechanism,
+                                 CK_ULONG * pDataLength )
+{
+    CK_RV ret;
+    CK_FUNCTION_LIST_PTR functionList = NULL;
+    CK_KEY_TYPE keyType = CKK_EC;
+    CK_ATTRIBUTE keyTypeTemplate = { CKA_KEY_TYPE, &keyType, sizeof( keyType ) };
+
+    ret = C_GetFunctionList( &functionList );
+
+    if( ret == CKR_OK )
+    {
+        ret = xInitializePkcs11Session( pSession );
+    }
+
+    if( ret == CKR_OK )
+    {
+        ret = xFindObjectWithLabelAndClass( *pSession,
+                                            pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
+                                            strlen( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS ),
+                                            CKO_PRIVATE_KEY,
+                                            pKey );
+
+        if( ( ret == CKR_OK ) && ( *pKey == CK_INVALID_HANDLE ) )
+        {
+            ret = CKR_OBJECT_HANDLE_INVALID;
+        }
+    }
+
+    if( ret == CKR_OK )
+    {
+        ret = functionList->C_GetAttributeValue( *pSession, *pKey, &keyTypeTemplate, 1 );
+    }
+
+    if( ret == CKR_OK )
+    {
+        if( keyType == CKK_RSA )
+        {
+            *pMechanism = CKM_RSA_PKCS;
+            *pDataLength = pkcs11RSA_SIGNATURE_INPUT_LENGTH;
+        }
+        else
+        {
+            *pMechanism = CKM_ECDSA;
+            *pDataLength = 32U;
+        }
+    }
+
+    return ret;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Task running the workload of its #BenchmarkWorker_t until #stopRun
+ * is set.
+ *
+ * @param[in] pParameters The #BenchmarkWorker_t of the task.
+ */
+static void workerTask( void * pParameters )
+{
+    BenchmarkWorker_t * pWorker = ( BenchmarkWorker_t * ) pParameters;
+    CK_FUNCTION_LIST_PTR functionList = NULL;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+    CK_MECHANISM mechanism = { 0 };
+    CK_OBJECT_HANDLE certificate;
+    CK_BYTE data[ BENCHMARK_SIGNATURE_LENGTH ] = { 0 };
+    CK_BYTE signature[ BENCHMARK_SIGNATURE_LENGTH ];
+    CK_ULONG dataLength = 0U;
+    CK_ULONG signatureLength;
+    CK_BYTE_PTR pValue;
+    CK_ULONG valueLength;
+    CK_BBOOL isPrivate;
+    CK_RV ret = CKR_OK;
+    bool ready = true;
+
+    /* Sessions are opened before the start, so the run only measures signing. */
+    if( pWorker->workload == WORKLOAD_SIGN )
+    {
+        ready = ( C_GetFunctionList( &functionList ) == CKR_OK ) &&
+                ( openSigningSession( &session, &key, &mechanism.mechanism, &dataLength ) == CKR_OK );
+    }
+
+    ( void ) xSemaphoreGive( doneSemaphore );
+    ( void ) xEventGroupWaitBits( startEvent, BENCHMARK_START_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+
+    while( ready && !stopRun )
+    {
+        switch( pWorker->workload )
+        {
+            case WORKLOAD_FIND:
+                certificate = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                                     strlen( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) );
+                ret = ( certificate != CK_INVALID_HANDLE ) ? CKR_OK : CKR_OBJECT_HANDLE_INVALID;
+                break;
+
+            case WORKLOAD_GET:
+                certificate = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                                     strlen( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) );
+                ret = PKCS11_PAL_GetObjectValue( certificate, &pValue, &valueLength, &isPrivate );
+
+                if( ret == CKR_OK )
+                {
+                    PKCS11_PAL_GetObjectValueCleanup( pValue, valueLength );
+                }
+
+                break;
+
+            case WORKLOAD_SIGN:
+            default:
+                ret = functionList->C_SignInit( session, &mechanism, key );
+
+                if( ret == CKR_OK )
+                {
+                    signatureLength = sizeof( signature );
+                    ret = functionList->C_Sign( session, data, dataLength, signature, &signatureLength );
+                }
+
+                break;
+        }
+
+        if( ret == CKR_OK )
+        {
+            pWorker->operations++;
+        }
+        else
+        {
+            pWorker->failures++;
+        }
+    }
+
+    if( !ready )
+    {
+        pWorker->failures++;
+    }
+
+    if( session != CK_INVALID_HANDLE )
+    {
+        ( void ) functionList->C_CloseSession( session );
+    }
+
+    ( void ) xSemaphoreGive( doneSemaphore );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Log the waits for the PAL lock in one mode during a run.
+ */
+static void logLockWaits( const char * pMode,
+                          const PKCS11PalLockWaits_t * pWaits )
+{
+    ESP_LOGI( TAG, "  %s lock: %u acquisitions, %llu us mean wait, %u us max wait.",
+              pMode,
+              ( unsigned ) pWaits->ulAcquisitions,
+              ( unsigned long long ) ( ( pWaits->ulAcquisitions > 0U ) ?
+                                       ( pWaits->ullTotalWaitUs / pWaits->ulAcquisitions ) : 0U ),
+              ( unsigned ) pWaits->ulMaxWaitUs );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run the workloads of one run and log their throughput.
+ *
+ * @param[in] pRun The workloads of the run.
+ */
+static void runBenchmark( const BenchmarkRun_t * pRun )
+{
+    uint32_t i;
+    uint32_t operations[ WORKLOAD_COUNT ] = { 0U };
+    uint32_t failures[ WORKLOAD_COUNT ] = { 0U };
+    uint32_t workerCount[ WORKLOAD_COUNT ] = { 0U };
+    PKCS11PalLockStats_t lockStats;
+    int64_t startUs;
+    int64_t elapsedUs;
+    BaseType_t created;
+
+    stopRun = false;
+    ( void ) xEventGroupClearBits( startEvent, BENCHMARK_START_BIT );
+
+    for( i = 0U; i < pRun->workerCount; i++ )
+    {
+        workers[ i ].workload = pRun->workloads[ i ];
+        workers[ i ].operations = 0U;
+        workers[ i ].failures = 0U;
+        created = xTaskCreatePinnedToCore( workerTask,
+                                           "PalWorker",
+                                           BENCHMARK_TASK_STACK_SIZE,
+                                           &workers[ i ],
+                                           BENCHMARK_TASK_PRIORITY,
+                                           NULL,
+                                           ( BaseType_t ) ( i % portNUM_PROCESSORS ) );
+        configASSERT( created == pdPASS );
+    }
+
+    for( i = 0U; i < pRun->workerCount; i++ )
+    {
+        ( void ) xSemaphoreTake( doneSemaphore, portMAX_DELAY );
+    }
+
+    PKCS11_PAL_ResetLockStats();
+    startUs = esp_timer_get_time();
+    ( void ) xEventGroupSetBits( startEvent, BENCHMARK_START_BIT );
+    vTaskDelay( pdMS_TO_TICKS( BENCHMARK_RUN_TIME_MS ) );
+    stopRun = true;
+
+    for( i = 0U; i < pRun->workerCount; i++ )
+    {
+        ( void ) xSemaphoreTake( doneSemaphore, portMAX_DELAY );
+    }
+
+    elapsedUs = esp_timer_get_time() - startUs;
+
+    for( i = 0U; i < pRun->workerCount; i++ )
+    {
+        operations[ workers[ i ].workload ] += workers[ i ].operations;
+        failures[ workers[ i ].workload ] += workers[ i ].failures;
+        workerCount[ workers[ i ].workload ]++;
+    }
+
+    ESP_LOGI( TAG, "%u worker(s) for %lld us:", ( unsigned ) pRun->workerCount, ( long long ) elapsedUs );
+
+    for( i = 0U; i < WORKLOAD_COUNT; i++ )
+    {
+        if( workerCount[ i ] > 0U )
+        {
+            ESP_LOGI( TAG, "  %u %s: %llu ops/s, %u failures.",
+                      ( unsigned ) workerCount[ i ],
+                      workloadNames[ i ],
+                      ( unsigned long long ) ( ( uint64_t ) operations[ i ] * 1000000ULL / ( uint64_t ) elapsedUs ),
+                      ( unsigned ) failures[ i ] );
+        }
+    }
+
+    if( PKCS11_PAL_GetLockStats( &lockStats ) )
+    {
+        logLockWaits( "exclusive", &lockStats.xExclusive );
+        logLockWaits( "shared", &lockStats.xShared );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void PKCS11_PAL_RunBenchmark( void )
+{
+    uint32_t i;
+
+    startEvent = xEventGroupCreate();
+    doneSemaphore = xSemaphoreCreateCounting( BENCHMARK_MAX_WORKERS, 0U );
+    configASSERT( ( startEvent != NULL ) && ( doneSemaphore != NULL ) );
+
+    ESP_LOGI( TAG, "Running on %d core(s), %s reads.",
+              portNUM_PROCESSORS,
+              readMode );
+
+    for( i = 0U; i < ( sizeof( benchmarkRuns ) / sizeof( benchmarkRuns[ 0 ] ) ); i++ )
+    {
+        runBenchmark( &benchmarkRuns[ i ] );
+    }
+
+    vSemaphoreDelete( doneSemaphore );
+    vEventGroupDelete( startEvent );
+    doneSemaphore = NULL;
+    startEvent = NULL;
+}
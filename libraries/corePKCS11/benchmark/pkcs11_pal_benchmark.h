@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file pkcs11_pal_benchmark.h
+ * @brief Contention benchmark of the NVS PKCS #11 PAL.
+ */
+
+#ifndef PKCS11_PAL_BENCHMARK_H_
+#define PKCS11_PAL_BENCHMARK_H_
+
+/**
+ * @brief Run find, get and sign workloads on up to four tasks, spread over
+ * the available cores, and log the throughput of every workload and the
+ * waits for the PAL lock.
+ *
+ * The device certificate and private key must be provisioned. Other tasks
+ * using PKCS #11 while the benchmark runs skew the results.
+ */
+void PKCS11_PAL_RunBenchmark( void );
+
+#endif /* ifndef PKCS11_PAL_BENCHMARK_H_ */
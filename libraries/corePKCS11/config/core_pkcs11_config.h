@@ -217,6 +217,21 @@
  */
 #define pkcs11configLABEL_JITP_CERTIFICATE                 ( "JITP Cert" )
 
+/**
+ * @brief The PKCS #11 label for the fleet provisioning claim certificate.
+ *
+ * Used to connect to AWS IoT Core until the device certificate
+ * (pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS) has been provisioned.
+ */
+#define pkcs11configLABEL_CLAIM_CERTIFICATE                ( "Claim Cert" )
+
+/**
+ * @brief The PKCS #11 label for the fleet provisioning claim private key.
+ *
+ * Private key corresponding to pkcs11configLABEL_CLAIM_CERTIFICATE.
+ */
+#define pkcs11configLABEL_CLAIM_PRIVATE_KEY                ( "Claim Key" )
+
 /**
  * @brief The PKCS #11 label for the AWS Trusted Root Certificate.
  *
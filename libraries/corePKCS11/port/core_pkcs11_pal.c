@@ -28,14 +28,22 @@
 #include "core_pkcs11.h"
 #include "core_pkcs11_pal.h"
 #include "core_pkcs11_config.h"
+#include "core_pkcs11_pal_transaction.h"
+#include "core_pkcs11_pal_stats.h"
+#include "trace_span.h"
+#include "mem_accounting.h"
 
 /* C runtime includes. */
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include <stddef.h>
 
 #include "esp_log.h"
 #include "esp_flash_encrypt.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "mbedtls/platform_util.h"
 
 #define NVS_PART_NAME                             pkcs11configSTORAGE_PARTITION
 #define NAMESPACE                                 pkcs11configSTORAGE_NS
@@ -45,6 +53,15 @@ static const char *TAG = "PKCS11";
 #define pkcs11palFILE_NAME_KEY                   "P11_Key"
 #define pkcs11palFILE_CODE_SIGN_PUBLIC_KEY       "P11_CSK"
 #define pkcs11palFILE_JITP_CERTIFICATE           "P11_JITP"
+#define pkcs11palFILE_CLAIM_CERTIFICATE          "P11_ClaimCert"
+#define pkcs11palFILE_CLAIM_KEY                  "P11_ClaimKey"
+
+/* Objects with other labels are stored under "P11_" and the label hash in hex. */
+#define pkcs11palFILE_PREFIX_EXTRA               "P11_"
+
+/* Files whose current copy is the one with this suffix, see pal_banks_t. */
+#define pkcs11palFILE_NAME_BANKS                 "P11_Banks"
+#define pkcs11palFILE_SUFFIX_ALT                 "~"
 
 enum eObjectHandles
 {
@@ -53,26 +70,278 @@ enum eObjectHandles
     eAwsDevicePublicKey,
     eAwsDeviceCertificate,
     eAwsCodeSigningKey,
-    eAwsJITPCertificate
+    eAwsJITPCertificate,
+    eAwsClaimCertificate,
+    eAwsClaimPrivateKey,
+    eFirstExtraHandle   /* Handles of objects with other labels follow. */
+};
+
+#define OBJECT_CACHE                              CONFIG_CORE_PKCS_OBJECT_CACHE
+#define OBJECT_CACHE_PRIVATE                      CONFIG_CORE_PKCS_OBJECT_CACHE_PRIVATE
+#define EXTRA_OBJECTS                             CONFIG_CORE_PKCS_EXTRA_OBJECTS
+#define SHARED_READS                              CONFIG_CORE_PKCS_SHARED_READS
+#define LOCK_STATS                                CONFIG_CORE_PKCS_LOCK_STATS
+
+#define BUILTIN_OBJECTS                           ( eFirstExtraHandle - 1 )
+#define BUILTIN_FILES                             6
+#define PAL_OBJECTS                               ( BUILTIN_OBJECTS + EXTRA_OBJECTS )
+#define PAL_FILES                                 ( BUILTIN_FILES + EXTRA_OBJECTS )
+
+/* Open addressed hash index of the objects by label, at most half full. */
+#define INDEX_SIZE                                ( ( PAL_OBJECTS <= 8 ) ? 16 : ( PAL_OBJECTS <= 16 ) ? 32 : \
+                                                    ( PAL_OBJECTS <= 32 ) ? 64 : 128 )
+
+typedef enum
+{
+    FILE_UNKNOWN = 0, /* Not read or written since boot. */
+    FILE_ABSENT,
+    FILE_STORED,
+    FILE_DESTROYED    /* Overwritten with zeros by PKCS11_PAL_DestroyObject. */
+} pal_file_state_t;
+
+/* What is known of a file in NVS, so objects can be found without reading them. */
+typedef struct
+{
+    char name[NVS_KEY_NAME_MAX_SIZE];
+    bool is_private;
+    bool privacy_from_data; /* is_private is worked out from what is stored. */
+    pal_file_state_t state;
+#if OBJECT_CACHE
+    uint8_t *data;      /* Copy of the file, or NULL. */
+    size_t size;
+#endif
+} pal_file_t;
+
+/* A label and the file its object is stored in. The device key pair shares a file. */
+typedef struct
+{
+    const char *label;  /* NULL for an extra object not in use. */
+    size_t label_len;
+    bool is_private;    /* For built-in objects, extra objects take it from their file. */
+    pal_file_t *file;
+} pal_object_t;
+
+static pal_file_t pal_files[PAL_FILES] = {
+    { .name = pkcs11palFILE_NAME_CLIENT_CERTIFICATE, .is_private = false },
+    { .name = pkcs11palFILE_NAME_KEY,                .is_private = true  },
+    { .name = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY,    .is_private = false },
+    { .name = pkcs11palFILE_JITP_CERTIFICATE,        .is_private = false },
+    { .name = pkcs11palFILE_CLAIM_CERTIFICATE,       .is_private = false },
+    { .name = pkcs11palFILE_CLAIM_KEY,               .is_private = true  },
+};
+
+/* In handle order, so the object of handle h is pal_objects[h - 1]. */
+static pal_object_t pal_objects[PAL_OBJECTS] = {
+    { pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS, 0, true,  &pal_files[1] },
+    { pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,  0, false, &pal_files[1] },
+    { pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS, 0, false, &pal_files[0] },
+    { pkcs11configLABEL_CODE_VERIFICATION_KEY,      0, false, &pal_files[2] },
+    { pkcs11configLABEL_JITP_CERTIFICATE,           0, false, &pal_files[3] },
+    { pkcs11configLABEL_CLAIM_CERTIFICATE,          0, false, &pal_files[4] },
+    { pkcs11configLABEL_CLAIM_PRIVATE_KEY,          0, true,  &pal_files[5] },
 };
 
+static char extra_labels[EXTRA_OBJECTS][pkcs11configMAX_LABEL_LENGTH + 1];
+
+/* Index in pal_objects plus one of the object whose label hashes to each
+ * slot or the slots probed after it, 0 for an empty slot. */
+static uint8_t pal_index[INDEX_SIZE];
+
+/* Each file has two copies in NVS, under its name and with
+ * pkcs11palFILE_SUFFIX_ALT appended. A transaction writes the copies not in
+ * use and then this record, in one NVS entry, naming the files whose current
+ * copy is the suffixed one. */
+typedef struct
+{
+    uint32_t generation;    /* Transactions committed. */
+    uint32_t count;
+    char names[PAL_FILES][NVS_KEY_NAME_MAX_SIZE];
+} pal_banks_t;
+
+#define BANKS_SIZE( count )    ( offsetof( pal_banks_t, names ) + ( count ) * NVS_KEY_NAME_MAX_SIZE )
+
+static pal_banks_t pal_banks;
+
+/* The task with a transaction open, or NULL, and the files it staged. */
+static TaskHandle_t txn_owner;
+static pal_file_t *txn_files[PAL_FILES];
+static size_t txn_count;
+
+/* Guards the NVS partition initialization, pal_nvs, the objects and their
+ * files. Taken through pal_lock() to change them, pal_lock_shared() to read. */
 static StaticSemaphore_t pkcs_pal_lock_buffer;
 static SemaphoreHandle_t pkcs_pal_lock;
 
+#if SHARED_READS || LOCK_STATS
+static portMUX_TYPE pal_lock_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+#if SHARED_READS
+/* Tasks holding the lock shared. A new reader takes pkcs_pal_lock to
+ * count itself, so a writer holding it keeps readers out, and waits on
+ * pal_readers_done until those already in have left. */
+static uint32_t pal_readers;
+static bool pal_writer_waiting;
+static StaticSemaphore_t pal_readers_done_buffer;
+static SemaphoreHandle_t pal_readers_done;
+#endif
+
+#if LOCK_STATS
+static PKCS11PalLockStats_t pal_lock_stats;
+#endif
+
+/* Handle of NAMESPACE, kept open once the partition is initialized. */
+static nvs_handle pal_nvs;
+static bool pal_nvs_open;
+
 /*-----------------------------------------------------------*/
 
-static void __attribute__((constructor)) pkcs_pal_lock_init (void)
+static uint32_t label_hash(const char *label, size_t len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)label[i]) * 16777619U;
+    }
+    return hash;
+}
+
+static void index_pal_object(size_t object)
 {
-    pkcs_pal_lock = xSemaphoreCreateMutexStatic(&pkcs_pal_lock_buffer);
+    pal_object_t *obj = &pal_objects[object];
+    size_t slot = label_hash(obj->label, obj->label_len) & (INDEX_SIZE - 1);
+
+    while (pal_index[slot] != 0) {
+        slot = (slot + 1) & (INDEX_SIZE - 1);
+    }
+    pal_index[slot] = object + 1;
 }
 
+/* Creates the lock, indexes the built-in objects and sets up the crypto
+ * library the first time the PAL is used, rather than in a constructor that
+ * delays every boot, including those that never touch a credential. */
+static void pal_init(void)
+{
+    /* 0 before, 1 while a task sets the PAL up, 2 once it is set up. */
+    static uint32_t pal_init_state;
+    uint32_t expected = 0;
+
+    if (__atomic_load_n(&pal_init_state, __ATOMIC_ACQUIRE) == 2) {
+        return;
+    }
+
+    if (__atomic_compare_exchange_n(&pal_init_state, &expected, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        pkcs_pal_lock = xSemaphoreCreateMutexStatic(&pkcs_pal_lock_buffer);
+#if SHARED_READS
+        pal_readers_done = xSemaphoreCreateBinaryStatic(&pal_readers_done_buffer);
+#endif
+
+        for (size_t i = 0; i < BUILTIN_OBJECTS; i++) {
+            pal_objects[i].label_len = strlen(pal_objects[i].label);
+            index_pal_object(i);
+        }
+
+        CRYPTO_Init();
+        __atomic_store_n(&pal_init_state, 2, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&pal_init_state, __ATOMIC_ACQUIRE) != 2) {
+            vTaskDelay(1);
+        }
+    }
+}
+
+#if LOCK_STATS
+static void count_lock_wait(PKCS11PalLockWaits_t *waits, int64_t start_us)
+{
+    uint32_t wait_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    portENTER_CRITICAL(&pal_lock_mux);
+    waits->ulAcquisitions++;
+    waits->ullTotalWaitUs += wait_us;
+    if (wait_us > waits->ulMaxWaitUs) {
+        waits->ulMaxWaitUs = wait_us;
+    }
+    portEXIT_CRITICAL(&pal_lock_mux);
+}
+#endif
+
+static void pal_lock(void)
+{
+#if LOCK_STATS
+    int64_t start_us = esp_timer_get_time();
+#endif
+
+    pal_init();
+    xSemaphoreTake(pkcs_pal_lock, portMAX_DELAY);
+#if SHARED_READS
+    portENTER_CRITICAL(&pal_lock_mux);
+    pal_writer_waiting = pal_readers > 0;
+    bool wait = pal_writer_waiting;
+    portEXIT_CRITICAL(&pal_lock_mux);
+    if (wait) {
+        xSemaphoreTake(pal_readers_done, portMAX_DELAY);
+    }
+#endif
+#if LOCK_STATS
+    count_lock_wait(&pal_lock_stats.xExclusive, start_us);
+#endif
+}
+
+static void pal_unlock(void)
+{
+    xSemaphoreGive(pkcs_pal_lock);
+}
+
+/* Only find_pal_object(), pal_object_of_handle(), file_key() and
+ * read_pal_file_shared() may be called with the lock shared. */
+static void pal_lock_shared(void)
+{
+#if SHARED_READS
+#if LOCK_STATS
+    int64_t start_us = esp_timer_get_time();
+#endif
+
+    pal_init();
+    xSemaphoreTake(pkcs_pal_lock, portMAX_DELAY);
+    portENTER_CRITICAL(&pal_lock_mux);
+    pal_readers++;
+    portEXIT_CRITICAL(&pal_lock_mux);
+    xSemaphoreGive(pkcs_pal_lock);
+#if LOCK_STATS
+    count_lock_wait(&pal_lock_stats.xShared, start_us);
+#endif
+#else
+    pal_lock();
+#endif
+}
+
+static void pal_unlock_shared(void)
+{
+#if SHARED_READS
+    bool last;
+
+    portENTER_CRITICAL(&pal_lock_mux);
+    last = --pal_readers == 0 && pal_writer_waiting;
+    if (last) {
+        pal_writer_waiting = false;
+    }
+    portEXIT_CRITICAL(&pal_lock_mux);
+    if (last) {
+        xSemaphoreGive(pal_readers_done);
+    }
+#else
+    pal_unlock();
+#endif
+}
+
+/* Called with pkcs_pal_lock held. */
 static void initialize_nvs_partition()
 {
     static bool nvs_inited;
 
-    xSemaphoreTake(pkcs_pal_lock, portMAX_DELAY);
     if (nvs_inited == true) {
-        xSemaphoreGive(pkcs_pal_lock);
         return;
     }
 
@@ -115,66 +384,329 @@ static void initialize_nvs_partition()
     }
 #endif // CONFIG_NVS_ENCRYPTION
     nvs_inited = true;
-    xSemaphoreGive(pkcs_pal_lock);
 
     return;
 }
 
-/* Converts a label to its respective filename and handle. */
-void prvLabelToFilenameHandle( uint8_t * pcLabel,
-                               char ** pcFileName,
-                               CK_OBJECT_HANDLE_PTR pHandle )
+/* Opens the namespace the first time it is needed. Called with pkcs_pal_lock held. */
+static esp_err_t open_pal_nvs(void)
 {
-    if( pcLabel != NULL )
-    {
-        /* Translate from the PKCS#11 label to local storage file name. */
-        if( 0 == memcmp( pcLabel,
-                         pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
-                         strlen( (char*)pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_CLIENT_CERTIFICATE;
-            *pHandle = eAwsDeviceCertificate;
+    if (pal_nvs_open) {
+        return ESP_OK;
+    }
+
+    initialize_nvs_partition();
+    esp_err_t err = nvs_open_from_partition(NVS_PART_NAME, NAMESPACE, NVS_READWRITE, &pal_nvs);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "failed nvs open %d", err);
+        return err;
+    }
+
+    size_t size = sizeof(pal_banks);
+    err = nvs_get_blob(pal_nvs, pkcs11palFILE_NAME_BANKS, &pal_banks, &size);
+    if (err == ESP_OK && (size < BANKS_SIZE(0) || pal_banks.count > PAL_FILES ||
+                          size != BANKS_SIZE(pal_banks.count))) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (err != ESP_OK) {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGE(TAG, "failed nvs get banks %d", err);
         }
-        else if( 0 == memcmp( pcLabel,
-                              pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
-                              strlen( (char*)pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_KEY;
-            *pHandle = eAwsDevicePrivateKey;
+        memset(&pal_banks, 0, sizeof(pal_banks));
+    }
+    pal_nvs_open = true;
+    return ESP_OK;
+}
+
+static int banks_find(const pal_banks_t *banks, const char *name)
+{
+    for (uint32_t i = 0; i < banks->count; i++) {
+        if (strcmp(banks->names[i], name) == 0) {
+            return i;
         }
-        else if( 0 == memcmp( pcLabel,
-                              pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,
-                              strlen( (char*)pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_KEY;
-            *pHandle = eAwsDevicePublicKey;
+    }
+    return -1;
+}
+
+/* The NVS key of the current copy of a file, or of the other copy. Called
+ * with the lock held, shared or not, once NVS is open. */
+static void file_key(const pal_file_t *file, bool other, char key[NVS_KEY_NAME_MAX_SIZE])
+{
+    bool alt = banks_find(&pal_banks, file->name) >= 0;
+
+    strcpy(key, file->name);
+    if (alt != other) {
+        strcat(key, pkcs11palFILE_SUFFIX_ALT);
+    }
+}
+
+/* Length of a label without the terminator some callers count in it. */
+static size_t label_length(const char *label, size_t len)
+{
+    while (len > 0 && label[len - 1] == '\0') {
+        len--;
+    }
+    return len;
+}
+
+/* Called with the lock held, shared or not. */
+static pal_object_t *find_pal_object(const char *label, size_t len)
+{
+    size_t slot = label_hash(label, len) & (INDEX_SIZE - 1);
+
+    while (pal_index[slot] != 0) {
+        pal_object_t *obj = &pal_objects[pal_index[slot] - 1];
+        if (obj->label_len == len && memcmp(obj->label, label, len) == 0) {
+            return obj;
         }
-        else if( 0 == memcmp( pcLabel,
-                              pkcs11configLABEL_CODE_VERIFICATION_KEY,
-                              strlen( (char*)pkcs11configLABEL_CODE_VERIFICATION_KEY ) ) )
-        {
-            *pcFileName = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY;
-            *pHandle = eAwsCodeSigningKey;
+        slot = (slot + 1) & (INDEX_SIZE - 1);
+    }
+    return NULL;
+}
+
+static pal_object_t *pal_object_of_handle(CK_OBJECT_HANDLE handle)
+{
+    if (handle == eInvalidHandle || handle > PAL_OBJECTS || pal_objects[handle - 1].label == NULL) {
+        return NULL;
+    }
+    return &pal_objects[handle - 1];
+}
+
+static bool object_is_private(const pal_object_t *obj)
+{
+    /* Public and private key are stored together in same file. */
+    return obj->file->privacy_from_data ? obj->file->is_private : obj->is_private;
+}
+
+static CK_OBJECT_HANDLE pal_object_handle(const pal_object_t *obj)
+{
+    return (CK_OBJECT_HANDLE)(obj - pal_objects) + 1;
+}
+
+/* The file an object with a label not in pal_objects is stored in. */
+static void extra_file_name(char *name, const char *label, size_t len)
+{
+    snprintf(name, NVS_KEY_NAME_MAX_SIZE, pkcs11palFILE_PREFIX_EXTRA "%08" PRIx32, label_hash(label, len));
+}
+
+/* Gives a label not in pal_objects one of the extra objects, which keeps it
+ * until reboot. Called with pkcs_pal_lock held. */
+static pal_object_t *add_pal_object(const char *label, size_t len)
+{
+    char name[NVS_KEY_NAME_MAX_SIZE];
+
+    if (len == 0 || len > pkcs11configMAX_LABEL_LENGTH) {
+        ESP_LOGE(TAG, "Label of %d bytes can't be stored", len);
+        return NULL;
+    }
+
+    extra_file_name(name, label, len);
+    for (size_t i = BUILTIN_OBJECTS; i < PAL_OBJECTS; i++) {
+        pal_object_t *obj = &pal_objects[i];
+
+        if (obj->label != NULL && strcmp(obj->file->name, name) == 0) {
+            /* Another label with the same hash is stored in that file. */
+            ESP_LOGE(TAG, "Label %.*s collides with %s", len, label, obj->label);
+            return NULL;
         }
-        else if( 0 == memcmp( pcLabel,
-                              pkcs11configLABEL_JITP_CERTIFICATE,
-                              strlen( (char*)pkcs11configLABEL_JITP_CERTIFICATE ) ) )
-        {
-            *pcFileName = pkcs11palFILE_JITP_CERTIFICATE;
-            *pHandle = eAwsJITPCertificate;
+        if (obj->label == NULL) {
+            char *copy = extra_labels[i - BUILTIN_OBJECTS];
+
+            memcpy(copy, label, len);
+            copy[len] = '\0';
+            obj->label = copy;
+            obj->label_len = len;
+            obj->file = &pal_files[i - BUILTIN_OBJECTS + BUILTIN_FILES];
+            strcpy(obj->file->name, name);
+            obj->file->is_private = true;
+            obj->file->privacy_from_data = true;
+            index_pal_object(i);
+            return obj;
         }
-        else
-        {
-            *pcFileName = NULL;
-            *pHandle = eInvalidHandle;
+    }
+
+    ESP_LOGE(TAG, "No room for object %.*s, see CONFIG_CORE_PKCS_EXTRA_OBJECTS", len, label);
+    return NULL;
+}
+
+/* DER private keys (PKCS #1, SEC 1 and PKCS #8) open with a version INTEGER,
+ * certificates and public keys with a SEQUENCE. Anything else is kept private. */
+static bool der_is_private(const uint8_t *data, size_t size)
+{
+    size_t offset = 2;
+
+    if (size < 3 || data[0] != 0x30) {
+        return true;
+    }
+    if (data[1] & 0x80) {
+        offset += data[1] & 0x7F;
+    }
+    return offset >= size || data[offset] != 0x30;
+}
+
+/* Called with pkcs_pal_lock held whenever the file in NVS changes or may have. */
+static void forget_pal_file(pal_file_t *file, pal_file_state_t state)
+{
+    if (file == NULL) {
+        return;
+    }
+    file->state = state;
+#if OBJECT_CACHE
+    if (file->data != NULL) {
+        mbedtls_platform_zeroize(file->data, file->size);
+        MEM_ACCOUNTING_FREE(MemComponentPkcs11, file->data);
+        file->data = NULL;
+    }
+#endif
+}
+
+#if OBJECT_CACHE
+static bool file_cacheable(const pal_file_t *file)
+{
+#if OBJECT_CACHE_PRIVATE
+    return true;
+#else
+    return !file->is_private;
+#endif
+}
+
+static CK_RV copy_cached_file(const pal_file_t *file, uint8_t **data, size_t *size)
+{
+    uint8_t *buf = MEM_ACCOUNTING_MALLOC(MemComponentPkcs11, file->size);
+
+    if (buf == NULL) {
+        ESP_LOGE(TAG, "malloc failed");
+        return CKR_HOST_MEMORY;
+    }
+    memcpy(buf, file->data, file->size);
+    *data = buf;
+    *size = file->size;
+    return CKR_OK;
+}
+#endif
+
+/* Reads the current copy of a file from NVS into a new buffer. Sets *absent
+ * if NVS holds nothing for it. */
+static CK_RV fetch_pal_file(const pal_file_t *file, uint8_t **data, size_t *size, bool *absent)
+{
+    uint8_t *buf = NULL;
+    size_t required_size = 0;
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    file_key(file, false, key);
+    esp_err_t err = nvs_get_blob(pal_nvs, key, NULL, &required_size);
+    if (err != ESP_OK || required_size == 0) {
+        ESP_LOGE(TAG, "failed nvs get file size %d %d", err, required_size);
+        *absent = err == ESP_ERR_NVS_NOT_FOUND || err == ESP_OK;
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
+
+    buf = MEM_ACCOUNTING_MALLOC(MemComponentPkcs11, required_size);
+    if (buf == NULL) {
+        ESP_LOGE(TAG, "malloc failed");
+        return CKR_HOST_MEMORY;
+    }
+
+    err = nvs_get_blob(pal_nvs, key, buf, &required_size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "failed nvs get file %d", err);
+        MEM_ACCOUNTING_FREE(MemComponentPkcs11, buf);
+        return CKR_FUNCTION_FAILED;
+    }
+    *data = buf;
+    *size = required_size;
+    return CKR_OK;
+}
+
+/* Reads a file into a new buffer, from the cache if it holds the file. Called
+ * with pkcs_pal_lock held. */
+static CK_RV read_pal_file(pal_file_t *file, uint8_t **data, size_t *size)
+{
+    CK_RV ret = CKR_OK;
+    uint8_t *buf = NULL;
+    size_t required_size = 0;
+    bool absent = false;
+
+    if (file->state == FILE_ABSENT) {
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
+
+#if OBJECT_CACHE
+    if (file->data != NULL) {
+        return copy_cached_file(file, data, size);
+    }
+#endif
+
+    ESP_LOGD(TAG, "Reading file %s", file->name);
+    if (open_pal_nvs() != ESP_OK) {
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
+
+    ret = fetch_pal_file(file, &buf, &required_size, &absent);
+    if (absent) {
+        file->state = FILE_ABSENT;
+    }
+    if (ret != CKR_OK) {
+        return ret;
+    }
+
+    /* Zeroed out object means it has been destroyed. */
+    file->state = buf[0] == 0x00 ? FILE_DESTROYED : FILE_STORED;
+    if (file->privacy_from_data && file->state == FILE_STORED) {
+        file->is_private = der_is_private(buf, required_size);
+    }
+#if OBJECT_CACHE
+    if (file_cacheable(file)) {
+        file->data = MEM_ACCOUNTING_MALLOC(MemComponentPkcs11, required_size);
+        if (file->data != NULL) {
+            memcpy(file->data, buf, required_size);
+            file->size = required_size;
         }
     }
+#endif
+    *data = buf;
+    *size = required_size;
+    return ret;
+}
+
+/* Reads a file without changing what is known of it, so that several tasks
+ * can read it with the lock shared. Fails unless the file is known to be stored and
+ * read_pal_file() would not have copied it into the cache, in which case the
+ * caller takes the lock exclusively and calls read_pal_file(). */
+static CK_RV read_pal_file_shared(const pal_file_t *file, uint8_t **data, size_t *size)
+{
+    bool absent = false;
+
+    if (file->state != FILE_STORED || !pal_nvs_open) {
+        return CKR_FUNCTION_FAILED;
+    }
+#if OBJECT_CACHE
+    if (file->data != NULL) {
+        return copy_cached_file(file, data, size);
+    }
+    if (file_cacheable(file)) {
+        return CKR_FUNCTION_FAILED;
+    }
+#endif
+    return fetch_pal_file(file, data, size, &absent);
 }
 
 CK_RV PKCS11_PAL_Initialize( void )
 {
-    CRYPTO_Init();
-    return CKR_OK;
+    TRACE_SPAN_SCOPE( "PKCS11_PAL_Initialize" );
+
+    CK_RV xResult = CKR_OK;
+
+    pal_lock();
+
+    if( open_pal_nvs() != ESP_OK )
+    {
+        xResult = CKR_FUNCTION_FAILED;
+    }
+
+    pal_unlock();
+
+    return xResult;
 }
 
 /**
@@ -192,33 +724,67 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
                                         CK_BYTE_PTR pucData,
                                         CK_ULONG ulDataSize )
 {
-    initialize_nvs_partition();
+    TRACE_SPAN_SCOPE( "PKCS11_PAL_SaveObject" );
 
-    CK_OBJECT_HANDLE xHandle = eInvalidHandle;
-    char * pcFileName = NULL;
+    pal_object_t *obj;
+    pal_file_t *file;
+
+    size_t label_len = label_length(pxLabel->pValue, pxLabel->ulValueLen);
 
-    /* Translate from the PKCS#11 label to local storage file name. */
-    prvLabelToFilenameHandle( pxLabel->pValue,
-                              &pcFileName,
-                              &xHandle );
+    pal_lock();
+    obj = find_pal_object(pxLabel->pValue, label_len);
+    if (obj == NULL) {
+        obj = add_pal_object(pxLabel->pValue, label_len);
+    }
+    if (obj == NULL) {
+        pal_unlock();
+        return eInvalidHandle;
+    }
+    file = obj->file;
 
-    ESP_LOGD(TAG, "Writing file %s, %d bytes", ( char * ) pcFileName, ( uint32_t ) ulDataSize);
-    nvs_handle handle;
-    esp_err_t err = nvs_open_from_partition(NVS_PART_NAME, NAMESPACE, NVS_READWRITE, &handle);
+    ESP_LOGD(TAG, "Writing file %s, %d bytes", file->name, ( uint32_t ) ulDataSize);
+    esp_err_t err = open_pal_nvs();
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "failed nvs open %d", err);
+        pal_unlock();
         return eInvalidHandle;
     }
 
-    err = nvs_set_blob(handle, pcFileName, ( char * ) pucData, ( uint32_t ) ulDataSize);
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    bool staged = txn_owner != NULL && txn_owner == xTaskGetCurrentTaskHandle();
+    file_key(file, staged, key);
+
+    err = nvs_set_blob(pal_nvs, key, ( char * ) pucData, ( uint32_t ) ulDataSize);
+    if (err == ESP_OK && staged) {
+        /* Made current, and committed, by PKCS11_PAL_CommitTransaction. */
+        size_t i = 0;
+        while (i < txn_count && txn_files[i] != file) {
+            i++;
+        }
+        if (i == txn_count) {
+            txn_files[txn_count++] = file;
+        }
+        pal_unlock();
+        return pal_object_handle(obj);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(pal_nvs);
+    }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "failed nvs set blob %d", err);
-        nvs_close(handle);
+        if (!staged) {
+            forget_pal_file(file, FILE_UNKNOWN);
+        }
+        pal_unlock();
         return eInvalidHandle;
     }
 
-    nvs_close(handle);
-    return xHandle;
+    forget_pal_file(file, ulDataSize == 0 ? FILE_ABSENT :
+                          pucData[0] == 0x00 ? FILE_DESTROYED : FILE_STORED);
+    if (file->privacy_from_data && file->state == FILE_STORED) {
+        file->is_private = der_is_private(pucData, ulDataSize);
+    }
+    pal_unlock();
+    return pal_object_handle(obj);
 }
 
 /**
@@ -237,49 +803,85 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 CK_OBJECT_HANDLE PKCS11_PAL_FindObject( CK_BYTE_PTR pxLabel,
                                         CK_ULONG usLength )
 {
+    TRACE_SPAN_SCOPE( "PKCS11_PAL_FindObject" );
+
     CK_OBJECT_HANDLE xHandle = eInvalidHandle;
-    char * pcFileName = NULL;
-    CK_BYTE_PTR pxObject = NULL;
-    CK_BBOOL xIsPrivate = ( CK_BBOOL ) CK_TRUE;
-    CK_ULONG ulObjectLength = sizeof( CK_BYTE );
-    CK_RV xResult = CKR_OK;
-    initialize_nvs_partition();
+    pal_object_t * pxObject = NULL;
+    pal_file_t xExtraFile = { .is_private = true, .privacy_from_data = true };
+    pal_file_t * pxFile = NULL;
+    uint8_t * pucData = NULL;
+    size_t xDataSize = 0;
+    bool xKnown;
 
-    /* Translate from the PKCS#11 label to local storage file name. */
-    prvLabelToFilenameHandle( pxLabel,
-                              &pcFileName,
-                              &xHandle );
+    usLength = label_length( ( const char * ) pxLabel, usLength );
 
-    if( pcFileName != NULL )
-    {
-        ESP_LOGD( TAG, "Finding file %s", pcFileName );
-        nvs_handle handle;
-        esp_err_t err = nvs_open_from_partition(NVS_PART_NAME, NAMESPACE, NVS_READONLY, &handle);
-        if (err != ESP_OK) {
-            /* This can happen if namespace doesn't exist yet, so no files stored */
-            ESP_LOGD(TAG, "failed nvs open %d", err);
-            return eInvalidHandle;
-        }
+    /* Objects already looked up are found with the lock shared. */
+    pal_lock_shared();
 
-        size_t required_size = 0;
-        err = nvs_get_blob(handle, pcFileName, NULL, &required_size);
-        if (err != ESP_OK || required_size == 0) {
-            ESP_LOGE(TAG, "failed nvs get file size %d %d", err, required_size);
-            xHandle = eInvalidHandle;
-        }
-        nvs_close(handle);
+    pxObject = find_pal_object( ( const char * ) pxLabel, usLength );
+    xKnown = ( pxObject != NULL ) && ( pxObject->file->state != FILE_UNKNOWN );
+
+    if( xKnown && ( pxObject->file->state == FILE_STORED ) )
+    {
+        xHandle = pal_object_handle( pxObject );
     }
-    if( xHandle != eInvalidHandle )
+
+    pal_unlock_shared();
+
+    if( !xKnown )
     {
-        xResult = PKCS11_PAL_GetObjectValue( xHandle, &pxObject, &ulObjectLength, &xIsPrivate );
+        pal_lock();
+
+        pxObject = find_pal_object( ( const char * ) pxLabel, usLength );
 
-        /* Zeroed out object means it has been destroyed. */
-        if( ( xResult != CKR_OK ) || ( pxObject[ 0 ] == 0x00 ) )
+        if( pxObject != NULL )
         {
-            xHandle = eInvalidHandle;
+            pxFile = pxObject->file;
+        }
+        else if( ( usLength > 0 ) && ( usLength <= pkcs11configMAX_LABEL_LENGTH ) )
+        {
+            /* An object with another label only takes an extra object once it is found stored. */
+            extra_file_name( xExtraFile.name, ( const char * ) pxLabel, usLength );
+            pxFile = &xExtraFile;
         }
 
-        PKCS11_PAL_GetObjectValueCleanup( pxObject, ulObjectLength );
+        if( pxFile != NULL )
+        {
+            ESP_LOGD( TAG, "Finding file %s", pxFile->name );
+
+            /* The file is only read the first time, to learn whether it is stored. */
+            if( ( pxFile->state == FILE_UNKNOWN ) &&
+                ( read_pal_file( pxFile, &pucData, &xDataSize ) == CKR_OK ) )
+            {
+                mbedtls_platform_zeroize( pucData, xDataSize );
+                MEM_ACCOUNTING_FREE( MemComponentPkcs11, pucData );
+            }
+
+            if( ( pxFile == &xExtraFile ) && ( xExtraFile.state == FILE_STORED ) )
+            {
+                pxObject = add_pal_object( ( const char * ) pxLabel, usLength );
+
+                if( pxObject != NULL )
+                {
+                    *pxObject->file = xExtraFile;
+                }
+                else
+                {
+                    forget_pal_file( &xExtraFile, FILE_UNKNOWN );
+                }
+            }
+            else if( pxFile == &xExtraFile )
+            {
+                forget_pal_file( &xExtraFile, FILE_UNKNOWN );
+            }
+
+            if( ( pxObject != NULL ) && ( pxObject->file->state == FILE_STORED ) )
+            {
+                xHandle = pal_object_handle( pxObject );
+            }
+        }
+
+        pal_unlock();
     }
 
     return xHandle;
@@ -315,81 +917,37 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
                                       CK_ULONG_PTR pulDataSize,
                                       CK_BBOOL * pIsPrivate )
 {
-    initialize_nvs_partition();
+    TRACE_SPAN_SCOPE( "PKCS11_PAL_GetObjectValue" );
 
-    char * pcFileName = NULL;
     CK_RV ulReturn = CKR_OK;
+    size_t size = 0;
 
-    if( xHandle == eAwsDeviceCertificate )
-    {
-        pcFileName = pkcs11palFILE_NAME_CLIENT_CERTIFICATE;
-        *pIsPrivate = CK_FALSE;
+    /* Objects known to be stored are read with the lock shared. */
+    pal_lock_shared();
+    pal_object_t *obj = pal_object_of_handle(xHandle);
+    bool done = obj != NULL && read_pal_file_shared(obj->file, ppucData, &size) == CKR_OK;
+    if (done) {
+        *pulDataSize = size;
+        *pIsPrivate = object_is_private(obj) ? CK_TRUE : CK_FALSE;
     }
-    else if( xHandle == eAwsDevicePrivateKey )
-    {
-        pcFileName = pkcs11palFILE_NAME_KEY;
-        *pIsPrivate = CK_TRUE;
-    }
-    else if( xHandle == eAwsDevicePublicKey )
-    {
-        /* Public and private key are stored together in same file. */
-        pcFileName = pkcs11palFILE_NAME_KEY;
-        *pIsPrivate = CK_FALSE;
+    pal_unlock_shared();
+    if (done) {
+        return CKR_OK;
     }
-    else if( xHandle == eAwsCodeSigningKey )
-    {
-        pcFileName = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY;
-        *pIsPrivate = CK_FALSE;
-    }
-    else if( xHandle == eAwsJITPCertificate )
-    {
-        pcFileName = pkcs11palFILE_JITP_CERTIFICATE;
-        *pIsPrivate = CK_FALSE;
-    }
-    else
-    {
+
+    pal_lock();
+    obj = pal_object_of_handle(xHandle);
+    if (obj == NULL) {
         ulReturn = CKR_OBJECT_HANDLE_INVALID;
+    } else {
+        ulReturn = read_pal_file(obj->file, ppucData, &size);
     }
 
-    if (ulReturn == CKR_OK)
-    {
-        ESP_LOGD(TAG, "Reading file %s", pcFileName);
-        nvs_handle handle;
-        esp_err_t err = nvs_open_from_partition(NVS_PART_NAME, NAMESPACE, NVS_READONLY, &handle);
-        if (err != ESP_OK) {
-            /* This can happen if namespace doesn't exist yet, so no files stored */
-            ESP_LOGD(TAG, "failed nvs open %d", err);
-            return CKR_OBJECT_HANDLE_INVALID;
-        }
-
-        size_t required_size = 0;
-        err = nvs_get_blob(handle, pcFileName, NULL, &required_size);
-        if (err != ESP_OK || required_size == 0) {
-            ESP_LOGE(TAG, "failed nvs get file size %d %d", err, required_size);
-            ulReturn = CKR_OBJECT_HANDLE_INVALID;
-            goto done;
-        }
-
-        uint8_t *data = pvPortMalloc(required_size);
-        if (data == NULL) {
-            ESP_LOGE(TAG, "malloc failed");
-            ulReturn = CKR_HOST_MEMORY;
-            goto done;
-        }
-        *ppucData = data;
-
-        err = nvs_get_blob(handle, pcFileName, data, &required_size);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "failed nvs get file %d", err);
-            vPortFree(data);
-            ulReturn = CKR_FUNCTION_FAILED;
-            goto done;
-        }
-
-        *pulDataSize = required_size;
-done:
-        nvs_close(handle);
+    if (ulReturn == CKR_OK) {
+        *pulDataSize = size;
+        *pIsPrivate = object_is_private(obj) ? CK_TRUE : CK_FALSE;
     }
+    pal_unlock();
 
     return ulReturn;
 }
@@ -410,7 +968,7 @@ void PKCS11_PAL_GetObjectValueCleanup( CK_BYTE_PTR pucData,
 
     if( pucData != NULL )
     {
-        vPortFree( pucData );
+        MEM_ACCOUNTING_FREE( MemComponentPkcs11, pucData );
     }
 }
 
@@ -418,35 +976,21 @@ void PKCS11_PAL_GetObjectValueCleanup( CK_BYTE_PTR pucData,
 void prvHandleToLabel( char ** pcLabel,
                        CK_OBJECT_HANDLE xHandle )
 {
+    pal_object_t * pxObject;
+
     if( pcLabel != NULL )
     {
-        switch( xHandle )
-        {
-            case eAwsDeviceCertificate:
-                *pcLabel = ( char * ) pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS;
-                break;
-
-            case eAwsDevicePrivateKey:
-                *pcLabel = ( char * ) pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS;
-                break;
-
-            case eAwsDevicePublicKey:
-                *pcLabel = ( char * ) pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS;
-                break;
-
-            case eAwsCodeSigningKey:
-                *pcLabel = ( char * ) pkcs11configLABEL_CODE_VERIFICATION_KEY;
-                break;
-
-            default:
-                *pcLabel = NULL;
-                break;
-        }
+        pal_lock_shared();
+        pxObject = pal_object_of_handle( xHandle );
+        *pcLabel = ( pxObject != NULL ) ? ( char * ) pxObject->label : NULL;
+        pal_unlock_shared();
     }
 }
 
 CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
 {
+    TRACE_SPAN_SCOPE( "PKCS11_PAL_DestroyObject" );
+
     CK_RV xResult = CKR_OK;
     CK_BYTE_PTR pxZeroedData = NULL;
     CK_BYTE_PTR pxObject = NULL;
@@ -474,7 +1018,7 @@ CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
     if( xResult == CKR_OK )
     {
         /* Some ports return a pointer to memory for which using memset directly won't work. */
-        pxZeroedData = pvPortMalloc( ulObjectLength * sizeof( CK_BYTE ) );
+        pxZeroedData = MEM_ACCOUNTING_MALLOC( MemComponentPkcs11, ulObjectLength * sizeof( CK_BYTE ) );
 
         if( NULL != pxZeroedData )
         {
@@ -489,7 +1033,7 @@ CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
                 xResult = CKR_GENERAL_ERROR;
             }
 
-            vPortFree( pxZeroedData );
+            MEM_ACCOUNTING_FREE( MemComponentPkcs11, pxZeroedData );
         }
         else
         {
@@ -501,3 +1045,188 @@ CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
 
     return xResult;
 }
+
+/*-----------------------------------------------------------*/
+
+/* Erases the copies staged by the transaction and ends it. Called with pkcs_pal_lock held. */
+static void end_transaction(bool erase_staged)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    for (size_t i = 0; erase_staged && i < txn_count; i++) {
+        file_key(txn_files[i], true, key);
+        nvs_erase_key(pal_nvs, key);
+    }
+    txn_owner = NULL;
+    txn_count = 0;
+}
+
+CK_RV PKCS11_PAL_BeginTransaction( void )
+{
+    CK_RV xResult = CKR_OK;
+
+    pal_lock();
+
+    if( txn_owner != NULL )
+    {
+        xResult = CKR_OPERATION_ACTIVE;
+    }
+    else if( open_pal_nvs() != ESP_OK )
+    {
+        xResult = CKR_FUNCTION_FAILED;
+    }
+    else
+    {
+        txn_owner = xTaskGetCurrentTaskHandle();
+        txn_count = 0;
+    }
+
+    pal_unlock();
+
+    return xResult;
+}
+
+CK_RV PKCS11_PAL_CommitTransaction( uint32_t * pulGeneration )
+{
+    TRACE_SPAN_SCOPE( "PKCS11_PAL_CommitTransaction" );
+
+    CK_RV xResult = CKR_OK;
+    pal_banks_t * pxBanks = NULL;
+    char key[ NVS_KEY_NAME_MAX_SIZE ];
+    esp_err_t err;
+    int index;
+
+    pal_lock();
+
+    if( ( txn_owner == NULL ) || ( txn_owner != xTaskGetCurrentTaskHandle() ) )
+    {
+        xResult = CKR_OPERATION_NOT_INITIALIZED;
+    }
+    else
+    {
+        pxBanks = MEM_ACCOUNTING_MALLOC( MemComponentPkcs11, sizeof( pal_banks_t ) );
+
+        if( pxBanks == NULL )
+        {
+            xResult = CKR_HOST_MEMORY;
+            end_transaction( true );
+        }
+    }
+
+    if( pxBanks != NULL )
+    {
+        /* Every staged file switches to its other copy. */
+        memcpy( pxBanks, &pal_banks, sizeof( pal_banks_t ) );
+        pxBanks->generation++;
+
+        for( size_t i = 0; i < txn_count; i++ )
+        {
+            index = banks_find( pxBanks, txn_files[ i ]->name );
+
+            if( index >= 0 )
+            {
+                pxBanks->count--;
+                memmove( pxBanks->names[ index ], pxBanks->names[ index + 1 ],
+                         ( pxBanks->count - index ) * NVS_KEY_NAME_MAX_SIZE );
+            }
+            else
+            {
+                strcpy( pxBanks->names[ pxBanks->count++ ], txn_files[ i ]->name );
+            }
+        }
+
+        err = nvs_set_blob( pal_nvs, pkcs11palFILE_NAME_BANKS, pxBanks, BANKS_SIZE( pxBanks->count ) );
+
+        if( err == ESP_OK )
+        {
+            err = nvs_commit( pal_nvs );
+        }
+
+        if( err != ESP_OK )
+        {
+            ESP_LOGE( TAG, "failed nvs set banks %d", err );
+            xResult = CKR_FUNCTION_FAILED;
+            end_transaction( true );
+        }
+        else
+        {
+            /* What each file was is now the other copy, which isn't needed any more. */
+            memcpy( &pal_banks, pxBanks, sizeof( pal_banks_t ) );
+
+            for( size_t i = 0; i < txn_count; i++ )
+            {
+                file_key( txn_files[ i ], true, key );
+                nvs_erase_key( pal_nvs, key );
+                forget_pal_file( txn_files[ i ], FILE_UNKNOWN );
+            }
+
+            ESP_LOGI( TAG, "Committed %d objects, generation %u", txn_count, pal_banks.generation );
+            end_transaction( false );
+
+            if( pulGeneration != NULL )
+            {
+                *pulGeneration = pal_banks.generation;
+            }
+        }
+
+        MEM_ACCOUNTING_FREE( MemComponentPkcs11, pxBanks );
+    }
+
+    pal_unlock();
+
+    return xResult;
+}
+
+void PKCS11_PAL_AbortTransaction( void )
+{
+    pal_lock();
+
+    if( ( txn_owner != NULL ) && ( txn_owner == xTaskGetCurrentTaskHandle() ) )
+    {
+        end_transaction( true );
+    }
+
+    pal_unlock();
+}
+
+uint32_t PKCS11_PAL_GetGeneration( void )
+{
+    uint32_t ulGeneration = 0;
+
+    pal_lock();
+
+    if( open_pal_nvs() == ESP_OK )
+    {
+        ulGeneration = pal_banks.generation;
+    }
+
+    pal_unlock();
+
+    return ulGeneration;
+}
+
+/*-----------------------------------------------------------*/
+
+bool PKCS11_PAL_GetLockStats( PKCS11PalLockStats_t * pxStats )
+{
+#if LOCK_STATS
+    portENTER_CRITICAL( &pal_lock_mux );
+    *pxStats = pal_lock_stats;
+    portEXIT_CRITICAL( &pal_lock_mux );
+
+    return true;
+#else
+    ( void ) pxStats;
+
+    return false;
+#endif
+}
+
+void PKCS11_PAL_ResetLockStats( void )
+{
+#if LOCK_STATS
+    portENTER_CRITICAL( &pal_lock_mux );
+    memset( &pal_lock_stats, 0, sizeof( pal_lock_stats ) );
+    portEXIT_CRITICAL( &pal_lock_mux );
+#endif
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file core_pkcs11_pal_stats.h
+ * @brief Waits for the lock of the NVS PKCS #11 PAL, kept when
+ * CORE_PKCS_LOCK_STATS is enabled in menuconfig.
+ */
+
+#ifndef CORE_PKCS11_PAL_STATS_H_
+#define CORE_PKCS11_PAL_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Acquisitions of the PAL lock in one mode.
+ */
+typedef struct PKCS11PalLockWaits
+{
+    uint32_t ulAcquisitions; /**< @brief Times the lock was taken. */
+    uint32_t ulMaxWaitUs;    /**< @brief Longest wait for the lock. */
+    uint64_t ullTotalWaitUs; /**< @brief Sum of the waits for the lock. */
+} PKCS11PalLockWaits_t;
+
+/**
+ * @brief PAL lock counters since boot or the last reset.
+ */
+typedef struct PKCS11PalLockStats
+{
+    /**
+     * @brief Saves, deletions, transactions and first lookups of objects.
+     * Without CORE_PKCS_SHARED_READS, every use of the PAL.
+     */
+    PKCS11PalLockWaits_t xExclusive;
+
+    /**
+     * @brief Lookups and reads of known objects, with CORE_PKCS_SHARED_READS.
+     */
+    PKCS11PalLockWaits_t xShared;
+} PKCS11PalLockStats_t;
+
+/**
+ * @brief Copy the PAL lock counters.
+ *
+ * @param[out] pxStats Where to write the counters.
+ *
+ * @return true, or false if CORE_PKCS_LOCK_STATS is disabled.
+ */
+bool PKCS11_PAL_GetLockStats( PKCS11PalLockStats_t * pxStats );
+
+/**
+ * @brief Zero the PAL lock counters.
+ */
+void PKCS11_PAL_ResetLockStats( void );
+
+#endif /* ifndef CORE_PKCS11_PAL_STATS_H_ */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_pkcs11_pal_transaction.h
+ * @brief Replace several objects of the NVS PKCS #11 PAL at once, such as a
+ * certificate and its private key received from fleet provisioning.
+ *
+ * Each object has two copies in NVS. Objects saved in a transaction are
+ * written over the copy not in use, and a single record naming the copies
+ * in use is written when the transaction is committed. After a reset the
+ * device finds either all the objects of the transaction or none of them.
+ */
+
+#ifndef CORE_PKCS11_PAL_TRANSACTION_H_
+#define CORE_PKCS11_PAL_TRANSACTION_H_
+
+#include <stdint.h>
+#include "core_pkcs11.h"
+
+/**
+ * @brief Start a transaction for the calling task.
+ *
+ * Until the transaction is committed or aborted, objects saved by this task,
+ * including through C_CreateObject and C_DestroyObject, are only staged. The
+ * task and every other one keep reading the objects as they were before.
+ *
+ * @return CKR_OK, CKR_OPERATION_ACTIVE if a transaction is already open, or
+ * CKR_FUNCTION_FAILED if NVS can't be opened.
+ */
+CK_RV PKCS11_PAL_BeginTransaction( void );
+
+/**
+ * @brief Make the objects staged by the calling task current, with one NVS
+ * commit.
+ *
+ * @param[out] pulGeneration The generation of the stored objects, one more
+ * than before the transaction. Can be NULL.
+ *
+ * @return CKR_OK, CKR_OPERATION_NOT_INITIALIZED if the task has no
+ * transaction open, or CKR_FUNCTION_FAILED if the record couldn't be written,
+ * in which case the transaction is aborted.
+ */
+CK_RV PKCS11_PAL_CommitTransaction( uint32_t * pulGeneration );
+
+/**
+ * @brief Drop the objects staged by the calling task.
+ */
+void PKCS11_PAL_AbortTransaction( void );
+
+/**
+ * @brief The number of transactions committed on this device, 0 if there
+ * were none.
+ */
+uint32_t PKCS11_PAL_GetGeneration( void );
+
+#endif /* ifndef CORE_PKCS11_PAL_TRANSACTION_H_ */
@@ -26,6 +26,7 @@
 /* FreeRTOS includes. */
 #include "freertos/FreeRTOS.h"
 #include "iot_crypto.h"
+#include "mem_accounting.h"
 
 /* mbedTLS includes. */
 
@@ -57,6 +58,7 @@ typedef struct SignatureVerificationState
 {
     BaseType_t xAsymmetricAlgorithm;
     BaseType_t xHashAlgorithm;
+    BaseType_t xStaticallyAllocated; /* pdTRUE if the caller provided the memory. */
     mbedtls_sha1_context xSHA1Context;
     mbedtls_sha256_context xSHA256Context;
 } SignatureVerificationState_t, * SignatureVerificationStatePtr_t;
@@ -176,6 +178,42 @@ typedef struct SignatureVerificationState
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Verifies a cryptographic signature using the public key of the
+ * signer, hash algorithm, and the hash of the data that was signed.
+ */
+static BaseType_t prvVerifySignatureWithKey( mbedtls_pk_context * pxSignerKey,
+                                             BaseType_t xHashAlgorithm,
+                                             uint8_t * pucHash,
+                                             size_t xHashLength,
+                                             uint8_t * pucSignature,
+                                             size_t xSignatureLength )
+{
+    BaseType_t xResult = pdTRUE;
+    mbedtls_md_type_t xMbedHashAlg = MBEDTLS_MD_SHA256;
+
+    /*
+     * Map the hash algorithm
+     */
+    if( cryptoHASH_ALGORITHM_SHA1 == xHashAlgorithm )
+    {
+        xMbedHashAlg = MBEDTLS_MD_SHA1;
+    }
+
+    if( 0 != mbedtls_pk_verify(
+            pxSignerKey,
+            xMbedHashAlg,
+            pucHash,
+            xHashLength,
+            pucSignature,
+            xSignatureLength ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    return xResult;
+}
+
 /**
  * @brief Verifies a cryptographic signature based on the signer
  * certificate, hash algorithm, and the data that was signed.
@@ -190,19 +228,9 @@ static BaseType_t prvVerifySignature( char * pcSignerCertificate,
 {
     BaseType_t xResult = pdTRUE;
     mbedtls_x509_crt xCertCtx;
-    mbedtls_md_type_t xMbedHashAlg = MBEDTLS_MD_SHA256;
-
 
     memset( &xCertCtx, 0, sizeof( mbedtls_x509_crt ) );
 
-    /*
-     * Map the hash algorithm
-     */
-    if( cryptoHASH_ALGORITHM_SHA1 == xHashAlgorithm )
-    {
-        xMbedHashAlg = MBEDTLS_MD_SHA1;
-    }
-
     /*
      * Decode and create a certificate context
      */
@@ -219,16 +247,12 @@ static BaseType_t prvVerifySignature( char * pcSignerCertificate,
      */
     if( pdTRUE == xResult )
     {
-        if( 0 != mbedtls_pk_verify(
-                &xCertCtx.pk,
-                xMbedHashAlg,
-                pucHash,
-                xHashLength,
-                pucSignature,
-                xSignatureLength ) )
-        {
-            xResult = pdFALSE;
-        }
+        xResult = prvVerifySignatureWithKey( &xCertCtx.pk,
+                                             xHashAlgorithm,
+                                             pucHash,
+                                             xHashLength,
+                                             pucSignature,
+                                             xSignatureLength );
     }
 
     /*
@@ -239,6 +263,32 @@ static BaseType_t prvVerifySignature( char * pcSignerCertificate,
     return xResult;
 }
 
+/**
+ * @brief Finishes the hash of a signature verification context.
+ *
+ * @param[out] pucHash Buffer of cryptoSHA256_DIGEST_BYTES for the result.
+ *
+ * @return The length of the hash.
+ */
+static size_t prvFinishHash( SignatureVerificationStatePtr_t pxCtx,
+                             uint8_t * pucHash )
+{
+    size_t xHashLength;
+
+    if( cryptoHASH_ALGORITHM_SHA1 == pxCtx->xHashAlgorithm )
+    {
+        ( void ) mbedtls_sha1_finish_ret( &pxCtx->xSHA1Context, pucHash );
+        xHashLength = cryptoSHA1_DIGEST_BYTES;
+    }
+    else
+    {
+        ( void ) mbedtls_sha256_finish_ret( &pxCtx->xSHA256Context, pucHash );
+        xHashLength = cryptoSHA256_DIGEST_BYTES;
+    }
+
+    return xHashLength;
+}
+
 /*
  * Interface routines
  */
@@ -257,6 +307,59 @@ void CRYPTO_ConfigureThreading( void )
      */
 }
 
+/**
+ * @brief Initializes a signature verification context.
+ */
+static void prvSignatureVerificationInit( SignatureVerificationStatePtr_t pxCtx,
+                                          BaseType_t xAsymmetricAlgorithm,
+                                          BaseType_t xHashAlgorithm,
+                                          BaseType_t xStaticallyAllocated )
+{
+    /*
+     * Store the algorithm identifiers
+     */
+    pxCtx->xAsymmetricAlgorithm = xAsymmetricAlgorithm;
+    pxCtx->xHashAlgorithm = xHashAlgorithm;
+    pxCtx->xStaticallyAllocated = xStaticallyAllocated;
+
+    /*
+     * Initialize the requested hash type
+     */
+    if( cryptoHASH_ALGORITHM_SHA1 == pxCtx->xHashAlgorithm )
+    {
+        mbedtls_sha1_init( &pxCtx->xSHA1Context );
+        ( void ) mbedtls_sha1_starts_ret( &pxCtx->xSHA1Context );
+    }
+    else
+    {
+        mbedtls_sha256_init( &pxCtx->xSHA256Context );
+        ( void ) mbedtls_sha256_starts_ret( &pxCtx->xSHA256Context, 0 );
+    }
+}
+
+/**
+ * @brief Ends a signature verification context, freeing it unless the caller
+ * provided the memory.
+ */
+static void prvSignatureVerificationFree( SignatureVerificationStatePtr_t pxCtx )
+{
+    /* Releases the SHA engine if the hash holds it, as it does when the
+     * verification is abandoned before the hash is finished. */
+    if( cryptoHASH_ALGORITHM_SHA1 == pxCtx->xHashAlgorithm )
+    {
+        mbedtls_sha1_free( &pxCtx->xSHA1Context );
+    }
+    else
+    {
+        mbedtls_sha256_free( &pxCtx->xSHA256Context );
+    }
+
+    if( pdTRUE != pxCtx->xStaticallyAllocated )
+    {
+        MEM_ACCOUNTING_FREE( MemComponentCrypto, pxCtx );
+    }
+}
+
 /**
  * @brief Creates signature verification context.
  */
@@ -270,8 +373,8 @@ BaseType_t CRYPTO_SignatureVerificationStart( void ** ppvContext,
     /*
      * Allocate the context
      */
-    if( NULL == ( pxCtx = ( SignatureVerificationStatePtr_t ) pvPortMalloc(
-                      sizeof( *pxCtx ) ) ) ) /*lint !e9087 Allow casting void* to other types. */
+    if( NULL == ( pxCtx = ( SignatureVerificationStatePtr_t ) MEM_ACCOUNTING_MALLOC(
+                      MemComponentCrypto, sizeof( *pxCtx ) ) ) ) /*lint !e9087 Allow casting void* to other types. */
     {
         xResult = pdFALSE;
     }
@@ -279,26 +382,31 @@ BaseType_t CRYPTO_SignatureVerificationStart( void ** ppvContext,
     if( pdTRUE == xResult )
     {
         *ppvContext = pxCtx;
+        prvSignatureVerificationInit( pxCtx, xAsymmetricAlgorithm, xHashAlgorithm, pdFALSE );
+    }
 
-        /*
-         * Store the algorithm identifiers
-         */
-        pxCtx->xAsymmetricAlgorithm = xAsymmetricAlgorithm;
-        pxCtx->xHashAlgorithm = xHashAlgorithm;
+    return xResult;
+}
 
-        /*
-         * Initialize the requested hash type
-         */
-        if( cryptoHASH_ALGORITHM_SHA1 == pxCtx->xHashAlgorithm )
-        {
-            mbedtls_sha1_init( &pxCtx->xSHA1Context );
-            ( void ) mbedtls_sha1_starts_ret( &pxCtx->xSHA1Context );
-        }
-        else
-        {
-            mbedtls_sha256_init( &pxCtx->xSHA256Context );
-            ( void ) mbedtls_sha256_starts_ret( &pxCtx->xSHA256Context, 0 );
-        }
+/**
+ * @brief Creates signature verification context in memory provided by the caller.
+ */
+BaseType_t CRYPTO_SignatureVerificationStartStatic( void ** ppvContext,
+                                                    StaticSignatureVerificationState_t * pxBuffer,
+                                                    BaseType_t xAsymmetricAlgorithm,
+                                                    BaseType_t xHashAlgorithm )
+{
+    BaseType_t xResult = pdFALSE;
+    SignatureVerificationState_t * pxCtx = ( SignatureVerificationStatePtr_t ) pxBuffer;
+
+    /* The public structure must match the private one. */
+    configASSERT( sizeof( StaticSignatureVerificationState_t ) == sizeof( SignatureVerificationState_t ) );
+
+    if( pxCtx != NULL )
+    {
+        *ppvContext = pxCtx;
+        prvSignatureVerificationInit( pxCtx, xAsymmetricAlgorithm, xHashAlgorithm, pdTRUE );
+        xResult = pdTRUE;
     }
 
     return xResult;
@@ -342,7 +450,6 @@ BaseType_t CRYPTO_SignatureVerificationFinal( void * pvContext,
     {
         SignatureVerificationStatePtr_t pxCtx = ( SignatureVerificationStatePtr_t ) pvContext; /*lint !e9087 Allow casting void* to other types. */
         uint8_t ucSHA1or256[ cryptoSHA256_DIGEST_BYTES ];                                      /* Reserve enough space for the larger of SHA1 or SHA256 results. */
-        uint8_t * pucHash = NULL;
         size_t xHashLength = 0;
 
         if( ( pcSignerCertificate != NULL ) &&
@@ -353,18 +460,7 @@ BaseType_t CRYPTO_SignatureVerificationFinal( void * pvContext,
             /*
              * Finish the hash
              */
-            if( cryptoHASH_ALGORITHM_SHA1 == pxCtx->xHashAlgorithm )
-            {
-                ( void ) mbedtls_sha1_finish_ret( &pxCtx->xSHA1Context, ucSHA1or256 );
-                pucHash = ucSHA1or256;
-                xHashLength = cryptoSHA1_DIGEST_BYTES;
-            }
-            else
-            {
-                ( void ) mbedtls_sha256_finish_ret( &pxCtx->xSHA256Context, ucSHA1or256 );
-                pucHash = ucSHA1or256;
-                xHashLength = cryptoSHA256_DIGEST_BYTES;
-            }
+            xHashLength = prvFinishHash( pxCtx, ucSHA1or256 );
 
             /*
              * Verify the signature
@@ -372,7 +468,7 @@ BaseType_t CRYPTO_SignatureVerificationFinal( void * pvContext,
             xResult = prvVerifySignature( pcSignerCertificate,
                                           xSignerCertificateLength,
                                           pxCtx->xHashAlgorithm,
-                                          pucHash,
+                                          ucSHA1or256,
                                           xHashLength,
                                           pucSignature,
                                           xSignatureLength );
@@ -385,8 +481,78 @@ BaseType_t CRYPTO_SignatureVerificationFinal( void * pvContext,
         /*
          * Clean-up
          */
-        vPortFree( pxCtx );
+        prvSignatureVerificationFree( pxCtx );
+    }
+
+    return xResult;
+}
+
+/**
+ * @brief Extracts the public key of a signer certificate.
+ */
+BaseType_t CRYPTO_ParseSignerCertificate( mbedtls_pk_context * pxSignerKey,
+                                          const char * pcSignerCertificate,
+                                          size_t xSignerCertificateLength )
+{
+    BaseType_t xResult = pdTRUE;
+    mbedtls_x509_crt xCertCtx;
+
+    mbedtls_x509_crt_init( &xCertCtx );
+    mbedtls_pk_init( pxSignerKey );
+
+    if( 0 != mbedtls_x509_crt_parse(
+            &xCertCtx, ( const unsigned char * ) pcSignerCertificate, xSignerCertificateLength ) )
+    {
+        xResult = pdFALSE;
+    }
+    else
+    {
+        /* Keep only the key, the rest of the certificate isn't needed to verify signatures. */
+        *pxSignerKey = xCertCtx.pk;
+        mbedtls_pk_init( &xCertCtx.pk );
+    }
+
+    mbedtls_x509_crt_free( &xCertCtx );
+
+    return xResult;
+}
+
+/**
+ * @brief Performs signature verification on a cryptographic hash with a
+ * parsed public key.
+ */
+BaseType_t CRYPTO_SignatureVerificationFinalWithKey( void * pvContext,
+                                                     mbedtls_pk_context * pxSignerKey,
+                                                     uint8_t * pucSignature,
+                                                     size_t xSignatureLength )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( pvContext != NULL )
+    {
+        SignatureVerificationStatePtr_t pxCtx = ( SignatureVerificationStatePtr_t ) pvContext; /*lint !e9087 Allow casting void* to other types. */
+        uint8_t ucSHA1or256[ cryptoSHA256_DIGEST_BYTES ];                                      /* Reserve enough space for the larger of SHA1 or SHA256 results. */
+        size_t xHashLength = 0;
+
+        if( ( pxSignerKey != NULL ) &&
+            ( pucSignature != NULL ) &&
+            ( xSignatureLength > 0UL ) )
+        {
+            xHashLength = prvFinishHash( pxCtx, ucSHA1or256 );
+
+            xResult = prvVerifySignatureWithKey( pxSignerKey,
+                                                 pxCtx->xHashAlgorithm,
+                                                 ucSHA1or256,
+                                                 xHashLength,
+                                                 pucSignature,
+                                                 xSignatureLength );
+        }
+
+        /*
+         * Clean-up
+         */
+        prvSignatureVerificationFree( pxCtx );
     }
 
     return xResult;
-}
\ No newline at end of file
+}
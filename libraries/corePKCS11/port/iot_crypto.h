@@ -27,6 +27,9 @@
 #define __AWS_CRYPTO__H__
 
 #include "freertos/FreeRTOS.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/sha256.h"
 
 /**
  * @brief Commonly used buffer sizes for storing cryptographic hash computation
@@ -70,6 +73,40 @@ BaseType_t CRYPTO_SignatureVerificationStart( void ** ppvContext,
                                               BaseType_t xAsymmetricAlgorithm,
                                               BaseType_t xHashAlgorithm );
 
+/**
+ * @brief Storage for a signature verification context, for
+ * CRYPTO_SignatureVerificationStartStatic.
+ *
+ * The members are not to be used; the structure only has the size and
+ * alignment of the context.
+ */
+typedef struct StaticSignatureVerificationState
+{
+    BaseType_t xDummy1[ 3 ];
+    mbedtls_sha1_context xDummy2;
+    mbedtls_sha256_context xDummy3;
+} StaticSignatureVerificationState_t;
+
+/**
+ * @brief Initializes digital signature verification in memory provided by the
+ * caller, so that verification doesn't allocate from the heap.
+ *
+ * The context is ended with CRYPTO_SignatureVerificationFinal or
+ * CRYPTO_SignatureVerificationFinalWithKey as usual, after which pxBuffer can
+ * be reused.
+ *
+ * @param[out] ppvContext Opaque context structure, pointing into pxBuffer.
+ * @param[in] pxBuffer Storage for the context, valid until the verification ends.
+ * @param[in] xAsymmetricAlgorithm Cryptographic public key cryptosystem.
+ * @param[in] xHashAlgorithm Cryptographic hash algorithm that was used for signing.
+ *
+ * @return pdTRUE if initialization succeeds, or pdFALSE otherwise.
+ */
+BaseType_t CRYPTO_SignatureVerificationStartStatic( void ** ppvContext,
+                                                    StaticSignatureVerificationState_t * pxBuffer,
+                                                    BaseType_t xAsymmetricAlgorithm,
+                                                    BaseType_t xHashAlgorithm );
+
 /**
  * @brief Updates a cryptographic hash computation with the specified byte array.
  *
@@ -100,4 +137,37 @@ BaseType_t CRYPTO_SignatureVerificationFinal( void * pvContext,
                                               uint8_t * pucSignature,
                                               size_t xSignatureLength );
 
+/**
+ * @brief Extracts the public key of a signer certificate, so that signatures
+ * can be verified with CRYPTO_SignatureVerificationFinalWithKey without
+ * parsing the certificate each time.
+ *
+ * @param[out] pxSignerKey Public key, to be freed with mbedtls_pk_free.
+ * @param[in] pcSignerCertificate Base64 and DER encoded X.509 certificate of the
+ * signer.
+ * @param[in] xSignerCertificateLength Length in bytes of the certificate,
+ * including the terminating zero of a PEM certificate.
+ *
+ * @return pdTRUE if the certificate was parsed, or pdFALSE otherwise.
+ */
+BaseType_t CRYPTO_ParseSignerCertificate( mbedtls_pk_context * pxSignerKey,
+                                          const char * pcSignerCertificate,
+                                          size_t xSignerCertificateLength );
+
+/**
+ * @brief Verifies a digital signature computation using a public key returned
+ * by CRYPTO_ParseSignerCertificate.
+ *
+ * @param[in] pvContext Opaque context structure.
+ * @param[in] pxSignerKey Public key of the signer.
+ * @param[in] pucSignature Digital signature result to verify.
+ * @param[in] xSignatureLength in bytes of digital signature result.
+ *
+ * @return pdTRUE if the signature is correct or pdFALSE if the signature is invalid.
+ */
+BaseType_t CRYPTO_SignatureVerificationFinalWithKey( void * pvContext,
+                                                     mbedtls_pk_context * pxSignerKey,
+                                                     uint8_t * pucSignature,
+                                                     size_t xSignatureLength );
+
 #endif /* ifndef __AWS_CRYPTO__H__ */
\ No newline at end of file
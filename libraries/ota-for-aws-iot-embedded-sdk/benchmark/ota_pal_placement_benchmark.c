@@ -0,0 +1,229 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file ota_pal_placement_benchmark.c
+ * @brief Measures what placing the OTA buffers in PSRAM costs the PAL.
+ *
+ * Each run goes through the work the PAL does for every file block, with
+ * all of its buffers in one kind of memory:
+ * - copy moves the block from the event buffer it was received into to a
+ *   staging buffer, as the pipeline and the sector coalescing do;
+ * - hash feeds the block to SHA-256, as the streamed verification does;
+ * - write stores the block in the update partition. Flash writes from PSRAM
+ *   go through a bounce buffer in internal RAM, so this is where the
+ *   difference usually is.
+ *
+ * The partition is erased before each run, outside of the measured time.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "freertos/FreeRTOS.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+
+/* OTA includes. */
+#include "ota_config.h"
+
+/* Header include. */
+#include "ota_pal_placement_benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Bytes of the test image written in a run.
+ */
+#define BENCHMARK_IMAGE_SIZE        ( 256U * 1024U )
+
+/**
+ * @brief Event and staging buffers cycled through, as in the PAL pipeline.
+ */
+#define BENCHMARK_BUFFERS           ( 4U )
+
+/**
+ * @brief Blocks of the test image.
+ */
+#define BENCHMARK_BLOCKS            ( BENCHMARK_IMAGE_SIZE / otaconfigFILE_BLOCK_SIZE )
+
+/**
+ * @brief Bytes per second, in KB, of @a bytes processed in @a us microseconds.
+ */
+#define BENCHMARK_KBPS( bytes, us ) \
+    ( ( unsigned ) ( ( us ) > 0 ? ( ( ( uint64_t ) ( bytes ) * 1000000U ) / ( ( uint64_t ) ( us ) * 1024U ) ) : 0U ) )
+
+/**
+ * @brief The time spent in each step of a run.
+ */
+typedef struct BenchmarkRun
+{
+    int64_t copyUs;
+    int64_t hashUs;
+    int64_t writeUs;
+} BenchmarkRun_t;
+
+static const char * TAG = "OtaPalBenchmark";
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Write the test image through buffers allocated with @a caps.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the buffers couldn't be allocated, or the
+ * error of the flash.
+ */
+static esp_err_t runPlacement( const esp_partition_t * pPartition,
+                               uint32_t caps,
+                               BenchmarkRun_t * pRun );
+
+/*-----------------------------------------------------------*/
+
+static esp_err_t runPlacement( const esp_partition_t * pPartition,
+                               uint32_t caps,
+                               BenchmarkRun_t * pRun )
+{
+    uint8_t * pEvents = heap_caps_malloc( BENCHMARK_BUFFERS * otaconfigFILE_BLOCK_SIZE, caps );
+    uint8_t * pStaging = heap_caps_malloc( BENCHMARK_BUFFERS * otaconfigFILE_BLOCK_SIZE, caps );
+    mbedtls_sha256_context sha;
+    esp_err_t ret = ESP_OK;
+    uint8_t * pEvent;
+    uint8_t * pBlock;
+    uint8_t digest[ 32 ];
+    int64_t start;
+    uint32_t i;
+
+    ( void ) memset( pRun, 0x00, sizeof( *pRun ) );
+
+    if( ( pEvents == NULL ) || ( pStaging == NULL ) )
+    {
+        ret = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        for( i = 0; i < ( BENCHMARK_BUFFERS * otaconfigFILE_BLOCK_SIZE ); i++ )
+        {
+            pEvents[ i ] = ( uint8_t ) ( i * 31U );
+        }
+
+        ret = esp_partition_erase_range( pPartition, 0, BENCHMARK_IMAGE_SIZE );
+    }
+
+    if( ret == ESP_OK )
+    {
+        mbedtls_sha256_init( &sha );
+        ( void ) mbedtls_sha256_starts_ret( &sha, 0 );
+
+        for( i = 0; ( i < BENCHMARK_BLOCKS ) && ( ret == ESP_OK ); i++ )
+        {
+            pEvent = &pEvents[ ( i % BENCHMARK_BUFFERS ) * otaconfigFILE_BLOCK_SIZE ];
+            pBlock = &pStaging[ ( i % BENCHMARK_BUFFERS ) * otaconfigFILE_BLOCK_SIZE ];
+
+            start = esp_timer_get_time();
+            ( void ) memcpy( pBlock, pEvent, otaconfigFILE_BLOCK_SIZE );
+            pRun->copyUs += esp_timer_get_time() - start;
+
+            start = esp_timer_get_time();
+            ( void ) mbedtls_sha256_update_ret( &sha, pBlock, otaconfigFILE_BLOCK_SIZE );
+            pRun->hashUs += esp_timer_get_time() - start;
+
+            start = esp_timer_get_time();
+            ret = esp_partition_write( pPartition, i * otaconfigFILE_BLOCK_SIZE, pBlock, otaconfigFILE_BLOCK_SIZE );
+            pRun->writeUs += esp_timer_get_time() - start;
+        }
+
+        ( void ) mbedtls_sha256_finish_ret( &sha, digest );
+        mbedtls_sha256_free( &sha );
+    }
+
+    heap_caps_free( pEvents );
+    heap_caps_free( pStaging );
+
+    return ret;
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaPal_RunPlacementBenchmark( void )
+{
+    static const struct
+    {
+        const char * pName;
+        uint32_t caps;
+    } placements[] =
+    {
+        { "internal RAM", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+        { "PSRAM",        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT   }
+    };
+    const esp_partition_t * pPartition = esp_ota_get_next_update_partition( NULL );
+    BenchmarkRun_t run;
+    esp_err_t ret;
+    size_t i;
+
+    if( pPartition == NULL )
+    {
+        ESP_LOGE( TAG, "No update partition to write to." );
+    }
+    else if( pPartition->size < BENCHMARK_IMAGE_SIZE )
+    {
+        ESP_LOGE( TAG, "The update partition is smaller than the %u byte test image.",
+                  ( unsigned ) BENCHMARK_IMAGE_SIZE );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "Writing %u bytes in blocks of %u bytes to partition %s.",
+                  ( unsigned ) BENCHMARK_IMAGE_SIZE, ( unsigned ) otaconfigFILE_BLOCK_SIZE,
+                  pPartition->label );
+
+        for( i = 0; i < ( sizeof( placements ) / sizeof( placements[ 0 ] ) ); i++ )
+        {
+            ret = runPlacement( pPartition, placements[ i ].caps, &run );
+
+            if( ret == ESP_ERR_NO_MEM )
+            {
+                ESP_LOGW( TAG, "%s: no memory for %u buffers.", placements[ i ].pName,
+                          ( unsigned ) ( 2U * BENCHMARK_BUFFERS ) );
+            }
+            else if( ret != ESP_OK )
+            {
+                ESP_LOGE( TAG, "%s: flash error %s.", placements[ i ].pName, esp_err_to_name( ret ) );
+            }
+            else
+            {
+                ESP_LOGI( TAG, "%s: copy %u KB/s, hash %u KB/s, write %u KB/s, total %u KB/s.",
+                          placements[ i ].pName,
+                          BENCHMARK_KBPS( BENCHMARK_IMAGE_SIZE, run.copyUs ),
+                          BENCHMARK_KBPS( BENCHMARK_IMAGE_SIZE, run.hashUs ),
+                          BENCHMARK_KBPS( BENCHMARK_IMAGE_SIZE, run.writeUs ),
+                          BENCHMARK_KBPS( BENCHMARK_IMAGE_SIZE, run.copyUs + run.hashUs + run.writeUs ) );
+            }
+        }
+    }
+}
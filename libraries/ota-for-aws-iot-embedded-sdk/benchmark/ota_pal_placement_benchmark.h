@@ -0,0 +1,43 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file ota_pal_placement_benchmark.h
+ * @brief Throughput of the OTA PAL write path with its buffers in internal
+ * RAM and in PSRAM.
+ */
+
+#ifndef OTA_PAL_PLACEMENT_BENCHMARK_H_
+#define OTA_PAL_PLACEMENT_BENCHMARK_H_
+
+/**
+ * @brief Write a test image to the update partition through buffers in
+ * internal RAM, then through buffers in PSRAM, and log the throughput of
+ * the copy, hash and flash write of each.
+ *
+ * The update partition is erased, so this must not run while an OTA update
+ * is in progress.
+ */
+void OtaPal_RunPlacementBenchmark( void );
+
+#endif /* ifndef OTA_PAL_PLACEMENT_BENCHMARK_H_ */
@@ -135,8 +135,15 @@
  *  how many data blocks response is expected for each data requests.
  *  @note This must be set larger than zero.
  *
+ *  With CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW the number is taken from the request
+ *  window each time a request is made.
  */
-#define otaconfigMAX_NUM_BLOCKS_REQUEST         CONFIG_MAX_NUM_BLOCKS_REQUEST
+#if CONFIG_OTA_ADAPTIVE_BLOCK_WINDOW
+    #include "ota_request_window.h"
+    #define otaconfigMAX_NUM_BLOCKS_REQUEST     ( OtaRequestWindow_Get() )
+#else
+    #define otaconfigMAX_NUM_BLOCKS_REQUEST     CONFIG_MAX_NUM_BLOCKS_REQUEST
+#endif
 
 /**
  * @brief The maximum number of requests allowed to send without a response before we abort.
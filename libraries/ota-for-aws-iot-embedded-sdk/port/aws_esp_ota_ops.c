@@ -43,18 +43,37 @@ typedef esp_ota_select_entry_t ota_select;
 
 const static char *TAG = "esp_ota_ops";
 
+/* Both otadata entries as last read from or written to flash, so that
+ * polling the boot flags doesn't map and read the partition every time. */
+static struct {
+    bool valid;
+    const esp_partition_t *partition;
+    ota_select entries[2];
+} s_otadata_cache;
+
+static portMUX_TYPE s_otadata_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
 static bool ota_select_valid(const ota_select *s)
 {
     return bootloader_common_ota_select_valid(s);
 }
 
-static const esp_partition_t *_esp_get_otadata_partition(uint32_t *offset, ota_select *entry, bool active_part)
+static const esp_partition_t *_esp_read_otadata(ota_select s_ota_select[2])
 {
     esp_err_t ret;
     const esp_partition_t *find_partition = NULL;
     spi_flash_mmap_handle_t ota_data_map;
     const void *result = NULL;
-    ota_select s_ota_select[2];
+
+    portENTER_CRITICAL(&s_otadata_cache_lock);
+    if (s_otadata_cache.valid) {
+        find_partition = s_otadata_cache.partition;
+        memcpy(s_ota_select, s_otadata_cache.entries, sizeof(s_otadata_cache.entries));
+    }
+    portEXIT_CRITICAL(&s_otadata_cache_lock);
+    if (find_partition != NULL) {
+        return find_partition;
+    }
 
     find_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, NULL);
     if (find_partition != NULL) {
@@ -62,11 +81,38 @@ static const esp_partition_t *_esp_get_otadata_partition(uint32_t *offset, ota_s
         if (ret != ESP_OK) {
             ESP_LOGW(TAG, "mmap failed %d", ret);
             return NULL;
-        } else {
-            memcpy(&s_ota_select[0], result, sizeof(ota_select));
-            memcpy(&s_ota_select[1], result + SPI_FLASH_SEC_SIZE, sizeof(ota_select));
-            spi_flash_munmap(ota_data_map);
         }
+        memcpy(&s_ota_select[0], result, sizeof(ota_select));
+        memcpy(&s_ota_select[1], result + SPI_FLASH_SEC_SIZE, sizeof(ota_select));
+        spi_flash_munmap(ota_data_map);
+
+        portENTER_CRITICAL(&s_otadata_cache_lock);
+        s_otadata_cache.partition = find_partition;
+        memcpy(s_otadata_cache.entries, s_ota_select, sizeof(s_otadata_cache.entries));
+        s_otadata_cache.valid = true;
+        portEXIT_CRITICAL(&s_otadata_cache_lock);
+    } else {
+        ESP_LOGE(TAG, "no otadata partition found");
+    }
+    return find_partition;
+}
+
+static void _esp_update_otadata_cache(uint32_t offset, const ota_select *entry)
+{
+    portENTER_CRITICAL(&s_otadata_cache_lock);
+    if (s_otadata_cache.valid) {
+        memcpy(&s_otadata_cache.entries[offset / SPI_FLASH_SEC_SIZE], entry, sizeof(ota_select));
+    }
+    portEXIT_CRITICAL(&s_otadata_cache_lock);
+}
+
+static const esp_partition_t *_esp_get_otadata_partition(uint32_t *offset, ota_select *entry, bool active_part)
+{
+    const esp_partition_t *find_partition = NULL;
+    ota_select s_ota_select[2];
+
+    find_partition = _esp_read_otadata(s_ota_select);
+    if (find_partition != NULL) {
         uint32_t gen_0_seq = ota_select_valid(&s_ota_select[0]) ? s_ota_select[0].ota_seq : 0;
         uint32_t gen_1_seq = ota_select_valid(&s_ota_select[1]) ? s_ota_select[1].ota_seq : 0;
         if (gen_0_seq == 0 && gen_1_seq == 0) {
@@ -84,8 +130,6 @@ static const esp_partition_t *_esp_get_otadata_partition(uint32_t *offset, ota_s
             ESP_LOGI(TAG, "[1] aflags/seq:0x%x/0x%x, pflags/seq:0x%x/0x%x",
                             s_ota_select[1].ota_state, gen_1_seq, s_ota_select[0].ota_state, gen_0_seq);
         }
-    } else {
-        ESP_LOGE(TAG, "no otadata partition found");
     }
     return find_partition;
 }
@@ -108,16 +152,23 @@ esp_err_t aws_esp_ota_set_boot_flags(uint32_t flags, bool active_part)
     if (part == NULL) {
         return ESP_FAIL;
     }
-    entry.ota_state = flags;
-    esp_err_t ret = esp_partition_erase_range(part, offset, SPI_FLASH_SEC_SIZE);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "failed to erase partition %d %d", offset, ret);
-        return ret;
-    }
-    ret = esp_partition_write(part, offset, &entry, sizeof(ota_select));
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "failed to write partition %d %d", offset, ret);
-        return ret;
+    esp_err_t ret = ESP_OK;
+    /* Setting the flags already stored costs a sector erase for nothing. */
+    if (entry.ota_state != flags) {
+        entry.ota_state = flags;
+        ret = esp_partition_erase_range(part, offset, SPI_FLASH_SEC_SIZE);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to erase partition %d %d", offset, ret);
+            aws_esp_ota_invalidate_boot_flags();
+            return ret;
+        }
+        ret = esp_partition_write(part, offset, &entry, sizeof(ota_select));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to write partition %d %d", offset, ret);
+            aws_esp_ota_invalidate_boot_flags();
+            return ret;
+        }
+        _esp_update_otadata_cache(offset, &entry);
     }
 #ifdef CONFIG_APP_ANTI_ROLLBACK
     if (flags == ESP_OTA_IMG_VALID) {
@@ -141,4 +192,11 @@ esp_err_t aws_esp_ota_get_boot_flags(uint32_t *flags, bool active_part)
     }
     *flags = entry.ota_state;
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+void aws_esp_ota_invalidate_boot_flags(void)
+{
+    portENTER_CRITICAL(&s_otadata_cache_lock);
+    s_otadata_cache.valid = false;
+    portEXIT_CRITICAL(&s_otadata_cache_lock);
+}
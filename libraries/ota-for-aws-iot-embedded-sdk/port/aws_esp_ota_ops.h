@@ -33,6 +33,9 @@ esp_err_t aws_esp_ota_set_boot_flags(uint32_t flags, bool active_part);
 /* Get firmware image flags, `active_part` if true then gets current running firmware flags, else passive (non-executing) firmware flags */
 esp_err_t aws_esp_ota_get_boot_flags(uint32_t *flags, bool active_part);
 
+/* Drop the copy of otadata kept in RAM, after otadata was written other than through `aws_esp_ota_set_boot_flags` (e.g. `esp_ota_set_boot_partition`) */
+void aws_esp_ota_invalidate_boot_flags(void);
+
 #ifdef __cplusplus
 }
 #endif
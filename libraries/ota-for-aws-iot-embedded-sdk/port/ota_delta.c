@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_delta.c
+ * @brief Streaming decoder for detools sequential patches.
+ *
+ * A patch starts with a header byte holding the patch type and compression,
+ * and the size of the new image. It is followed by the size of an optional
+ * data format patch, then by chunks of
+ *  - a diff: bytes added to the old image starting at the current offset,
+ *  - an extra: bytes copied to the new image as they are,
+ *  - an adjustment: a signed step of the offset into the old image,
+ * until the new image is complete. Sizes are little endian base 128 numbers.
+ * Apart from the size in the header they are signed, the first byte holding
+ * the sign in bit 6 and only 6 bits of the value.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "ota_delta.h"
+
+#define PATCH_TYPE_SEQUENTIAL    0U
+#define COMPRESSION_NONE         0U
+
+/* Longest size field that fits in 32 bits. */
+#define MAX_VARINT_SHIFT         28U
+
+static void start_varint( ota_delta_t * delta,
+                          ota_delta_state_t state )
+{
+    delta->state = state;
+    delta->varint = 0;
+    delta->varint_shift = 0;
+    delta->varint_negative = false;
+}
+
+/* Start the next diff, extra and adjustment, or stop once the new image is complete. */
+static void start_chunk( ota_delta_t * delta )
+{
+    if( delta->to_offset == delta->to_size )
+    {
+        delta->state = OTA_DELTA_DONE;
+    }
+    else
+    {
+        start_varint( delta, OTA_DELTA_DIFF_SIZE );
+    }
+}
+
+/* Add a byte to a size field. Returns true once the field is complete. */
+static bool parse_varint( ota_delta_t * delta,
+                          uint8_t byte,
+                          esp_err_t * ret )
+{
+    if( delta->varint_shift > MAX_VARINT_SHIFT )
+    {
+        *ret = ESP_ERR_INVALID_ARG;
+    }
+    else if( ( delta->state != OTA_DELTA_TO_SIZE ) && ( delta->varint_shift == 0 ) )
+    {
+        delta->varint_negative = ( byte & 0x40U ) != 0;
+        delta->varint = byte & 0x3FU;
+        delta->varint_shift = 6;
+    }
+    else
+    {
+        delta->varint |= ( uint32_t ) ( byte & 0x7FU ) << delta->varint_shift;
+        delta->varint_shift += 7;
+    }
+
+    return ( *ret == ESP_OK ) && ( ( byte & 0x80U ) == 0 );
+}
+
+/* Act on a complete size field. */
+static esp_err_t end_varint( ota_delta_t * delta )
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t value = delta->varint;
+
+    /* Only the offset into the old image can step backwards. */
+    if( delta->varint_negative && ( delta->state != OTA_DELTA_ADJUSTMENT ) )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch( delta->state )
+    {
+        case OTA_DELTA_TO_SIZE:
+            delta->to_size = value;
+            start_varint( delta, OTA_DELTA_DFPATCH_SIZE );
+            break;
+
+        case OTA_DELTA_DFPATCH_SIZE:
+
+            /* Data format patches only help images of some architectures, and are not created by default. */
+            if( value != 0 )
+            {
+                ret = ESP_ERR_NOT_SUPPORTED;
+            }
+            else
+            {
+                start_chunk( delta );
+            }
+
+            break;
+
+        case OTA_DELTA_DIFF_SIZE:
+        case OTA_DELTA_EXTRA_SIZE:
+
+            if( value > delta->to_size - delta->to_offset )
+            {
+                ret = ESP_ERR_INVALID_ARG;
+            }
+            else if( value != 0 )
+            {
+                delta->chunk_left = value;
+                delta->state = ( delta->state == OTA_DELTA_DIFF_SIZE ) ? OTA_DELTA_DIFF_DATA : OTA_DELTA_EXTRA_DATA;
+            }
+            else
+            {
+                start_varint( delta, ( delta->state == OTA_DELTA_DIFF_SIZE ) ? OTA_DELTA_EXTRA_SIZE : OTA_DELTA_ADJUSTMENT );
+            }
+
+            break;
+
+        case OTA_DELTA_ADJUSTMENT:
+
+            if( delta->varint_negative && ( value > delta->from_offset ) )
+            {
+                ret = ESP_ERR_INVALID_ARG;
+            }
+            else
+            {
+                delta->from_offset = delta->varint_negative ? delta->from_offset - value : delta->from_offset + value;
+                start_chunk( delta );
+            }
+
+            break;
+
+        default:
+            ret = ESP_ERR_INVALID_STATE;
+            break;
+    }
+
+    return ret;
+}
+
+/* The byte of the old image at the current offset. */
+static esp_err_t read_from( ota_delta_t * delta,
+                            uint8_t * byte )
+{
+    esp_err_t ret = ESP_OK;
+
+    if( delta->from_offset >= delta->from_size )
+    {
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    else if( ( delta->from_offset < delta->from_buf_offset ) ||
+             ( delta->from_offset >= delta->from_buf_offset + delta->from_buf_len ) )
+    {
+        delta->from_buf_offset = delta->from_offset;
+        delta->from_buf_len = MIN( ( uint32_t ) OTA_DELTA_FROM_BUF_SIZE, delta->from_size - delta->from_offset );
+        ret = delta->read( delta->ctx, delta->from_buf_offset, delta->from_buf, delta->from_buf_len );
+
+        if( ret != ESP_OK )
+        {
+            delta->from_buf_len = 0;
+        }
+    }
+
+    if( ret == ESP_OK )
+    {
+        *byte = delta->from_buf[ delta->from_offset - delta->from_buf_offset ];
+    }
+
+    return ret;
+}
+
+/* Append a byte to the new image, writing the buffer out when it is full. */
+static esp_err_t write_to( ota_delta_t * delta,
+                           uint8_t byte )
+{
+    esp_err_t ret = ESP_OK;
+
+    delta->out_buf[ delta->out_len++ ] = byte;
+    delta->to_offset++;
+
+    if( delta->out_len == OTA_DELTA_OUT_BUF_SIZE )
+    {
+        ret = delta->write( delta->ctx, delta->out_buf, delta->out_len );
+        delta->out_len = 0;
+    }
+
+    return ret;
+}
+
+void ota_delta_init( ota_delta_t * delta,
+                     uint32_t from_size,
+                     ota_delta_read_t read,
+                     ota_delta_write_t write,
+                     void * ctx )
+{
+    memset( delta, 0, sizeof( *delta ) );
+    delta->state = OTA_DELTA_HEADER;
+    delta->from_size = from_size;
+    delta->read = read;
+    delta->write = write;
+    delta->ctx = ctx;
+}
+
+esp_err_t ota_delta_process( ota_delta_t * delta,
+                             const uint8_t * data,
+                             uint32_t len )
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t byte;
+    uint8_t from;
+
+    while( ( ret == ESP_OK ) && ( len > 0 ) )
+    {
+        byte = *data++;
+        len--;
+
+        switch( delta->state )
+        {
+            case OTA_DELTA_HEADER:
+
+                if( ( ( ( byte >> 4 ) & 0x7U ) != PATCH_TYPE_SEQUENTIAL ) || ( ( byte & 0xFU ) != COMPRESSION_NONE ) )
+                {
+                    ret = ESP_ERR_NOT_SUPPORTED;
+                }
+                else
+                {
+                    start_varint( delta, OTA_DELTA_TO_SIZE );
+                }
+
+                break;
+
+            case OTA_DELTA_TO_SIZE:
+            case OTA_DELTA_DFPATCH_SIZE:
+            case OTA_DELTA_DIFF_SIZE:
+            case OTA_DELTA_EXTRA_SIZE:
+            case OTA_DELTA_ADJUSTMENT:
+
+                if( parse_varint( delta, byte, &ret ) )
+                {
+                    ret = end_varint( delta );
+                }
+
+                break;
+
+            case OTA_DELTA_DIFF_DATA:
+                ret = read_from( delta, &from );
+
+                if( ret == ESP_OK )
+                {
+                    delta->from_offset++;
+                    ret = write_to( delta, ( uint8_t ) ( from + byte ) );
+                }
+
+                if( ( ret == ESP_OK ) && ( --delta->chunk_left == 0 ) )
+                {
+                    start_varint( delta, OTA_DELTA_EXTRA_SIZE );
+                }
+
+                break;
+
+            case OTA_DELTA_EXTRA_DATA:
+                ret = write_to( delta, byte );
+
+                if( ( ret == ESP_OK ) && ( --delta->chunk_left == 0 ) )
+                {
+                    start_varint( delta, OTA_DELTA_ADJUSTMENT );
+                }
+
+                break;
+
+            case OTA_DELTA_DONE:
+                /* Nothing follows the last chunk. */
+                ret = ESP_ERR_INVALID_ARG;
+                break;
+
+            default:
+                ret = ESP_ERR_INVALID_STATE;
+                break;
+        }
+    }
+
+    if( ret != ESP_OK )
+    {
+        delta->state = OTA_DELTA_FAILED;
+    }
+
+    return ret;
+}
+
+esp_err_t ota_delta_finish( ota_delta_t * delta )
+{
+    esp_err_t ret = ESP_OK;
+
+    if( delta->state != OTA_DELTA_DONE )
+    {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    else if( delta->out_len > 0 )
+    {
+        ret = delta->write( delta->ctx, delta->out_buf, delta->out_len );
+        delta->out_len = 0;
+    }
+
+    return ret;
+}
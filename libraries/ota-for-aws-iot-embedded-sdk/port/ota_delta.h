@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_delta.h
+ * @brief Streaming decoder for detools sequential patches, used by the OTA PAL
+ * to rebuild a new image from the running one.
+ *
+ * Only uncompressed patches without a data format part are supported, as
+ * created by `detools create_patch --compression none`.
+ */
+
+#ifndef OTA_DELTA_H_
+#define OTA_DELTA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/* Bytes of the image being rebuilt collected before each write. */
+#define OTA_DELTA_OUT_BUF_SIZE     4096
+
+/* Bytes of the running image read at once. */
+#define OTA_DELTA_FROM_BUF_SIZE    256
+
+/**
+ * @brief Read len bytes at offset of the image the patch applies to.
+ */
+typedef esp_err_t ( * ota_delta_read_t )( void * ctx,
+                                          uint32_t offset,
+                                          uint8_t * buf,
+                                          uint32_t len );
+
+/**
+ * @brief Append len bytes to the image being rebuilt.
+ */
+typedef esp_err_t ( * ota_delta_write_t )( void * ctx,
+                                           const uint8_t * data,
+                                           uint32_t len );
+
+typedef enum
+{
+    OTA_DELTA_HEADER,
+    OTA_DELTA_TO_SIZE,
+    OTA_DELTA_DFPATCH_SIZE,
+    OTA_DELTA_DIFF_SIZE,
+    OTA_DELTA_DIFF_DATA,
+    OTA_DELTA_EXTRA_SIZE,
+    OTA_DELTA_EXTRA_DATA,
+    OTA_DELTA_ADJUSTMENT,
+    OTA_DELTA_DONE,
+    OTA_DELTA_FAILED
+} ota_delta_state_t;
+
+typedef struct
+{
+    ota_delta_state_t state;
+    ota_delta_read_t read;
+    ota_delta_write_t write;
+    void * ctx;
+
+    uint32_t from_size;   /* Size of the image the patch applies to. */
+    uint32_t from_offset; /* Next byte of that image used by a diff. */
+    uint32_t to_size;     /* Size of the rebuilt image, once the header is parsed. */
+    uint32_t to_offset;   /* Bytes of the rebuilt image produced so far. */
+    uint32_t chunk_left;  /* Bytes left in the current diff or extra chunk. */
+
+    uint32_t varint;      /* Size field being parsed. */
+    uint8_t varint_shift;
+    bool varint_negative;
+
+    uint32_t from_buf_offset; /* Image offset of from_buf, valid for from_buf_len bytes. */
+    uint32_t from_buf_len;
+    uint8_t from_buf[ OTA_DELTA_FROM_BUF_SIZE ];
+
+    uint32_t out_len;
+    uint8_t out_buf[ OTA_DELTA_OUT_BUF_SIZE ];
+} ota_delta_t;
+
+/**
+ * @brief Prepare to apply a patch against an image of from_size bytes.
+ */
+void ota_delta_init( ota_delta_t * delta,
+                     uint32_t from_size,
+                     ota_delta_read_t read,
+                     ota_delta_write_t write,
+                     void * ctx );
+
+/**
+ * @brief Apply the next len bytes of the patch.
+ *
+ * The patch has to be fed in order. The rebuilt image is written out through
+ * the write callback in chunks of up to OTA_DELTA_OUT_BUF_SIZE bytes.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED for a patch type or compression that
+ * can't be applied, ESP_ERR_INVALID_ARG for a malformed patch, or the error
+ * of a callback.
+ */
+esp_err_t ota_delta_process( ota_delta_t * delta,
+                             const uint8_t * data,
+                             uint32_t len );
+
+/**
+ * @brief Write out what is left of the rebuilt image once the whole patch has
+ * been processed.
+ *
+ * @return ESP_OK if the image is complete, ESP_ERR_INVALID_SIZE if the patch
+ * ended early, or the error of the write callback.
+ */
+esp_err_t ota_delta_finish( ota_delta_t * delta );
+
+/**
+ * @brief Whether the header has been parsed, so to_size is known.
+ */
+static inline bool ota_delta_to_size_known( const ota_delta_t * delta )
+{
+    return ( delta->state > OTA_DELTA_TO_SIZE ) && ( delta->state != OTA_DELTA_FAILED );
+}
+
+#endif /* OTA_DELTA_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_inflate.c
+ * @brief Streaming zlib decoder on top of the inflater in the ROM.
+ *
+ * The window doubles as the output buffer. The inflater writes into it up to
+ * its end and then wraps around, so each call leaves a contiguous run of the
+ * image to write out before it is overwritten.
+ */
+
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "ota_inflate.h"
+
+#if CONFIG_IDF_TARGET_ESP32
+    #include "esp32/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32S2
+    #include "esp32s2/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32S3
+    #include "esp32s3/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C3
+    #include "esp32c3/rom/miniz.h"
+#endif
+
+struct ota_inflate
+{
+    tinfl_decompressor decompressor;
+    tinfl_status status;
+    ota_inflate_write_t write;
+    void * ctx;
+    size_t window_offset; /* Where the inflater writes next. */
+    uint8_t window[ TINFL_LZ_DICT_SIZE ];
+};
+
+ota_inflate_t * ota_inflate_create( ota_inflate_write_t write,
+                                    void * ctx )
+{
+    ota_inflate_t * inflate = heap_caps_malloc( sizeof( *inflate ), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT );
+
+    if( inflate != NULL )
+    {
+        tinfl_init( &inflate->decompressor );
+        inflate->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+        inflate->write = write;
+        inflate->ctx = ctx;
+        inflate->window_offset = 0;
+    }
+
+    return inflate;
+}
+
+esp_err_t ota_inflate_process( ota_inflate_t * inflate,
+                               const uint8_t * data,
+                               uint32_t len )
+{
+    esp_err_t ret = ESP_OK;
+    size_t in_len;
+    size_t out_len;
+
+    /* A full window can hold back output after all of the input is used. */
+    while( ( ret == ESP_OK ) && ( ( len > 0 ) || ( inflate->status == TINFL_STATUS_HAS_MORE_OUTPUT ) ) )
+    {
+        if( inflate->status == TINFL_STATUS_DONE )
+        {
+            /* Nothing follows the end of the stream. */
+            ret = ESP_ERR_INVALID_ARG;
+            break;
+        }
+
+        in_len = len;
+        out_len = TINFL_LZ_DICT_SIZE - inflate->window_offset;
+        inflate->status = tinfl_decompress( &inflate->decompressor, data, &in_len, inflate->window,
+                                            inflate->window + inflate->window_offset, &out_len,
+                                            TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT );
+        data += in_len;
+        len -= in_len;
+
+        if( inflate->status < TINFL_STATUS_DONE )
+        {
+            ret = ESP_ERR_INVALID_ARG;
+        }
+        else if( out_len > 0 )
+        {
+            ret = inflate->write( inflate->ctx, inflate->window + inflate->window_offset, out_len );
+            inflate->window_offset = ( inflate->window_offset + out_len ) & ( TINFL_LZ_DICT_SIZE - 1 );
+        }
+    }
+
+    return ret;
+}
+
+esp_err_t ota_inflate_finish( ota_inflate_t * inflate )
+{
+    return ( inflate->status == TINFL_STATUS_DONE ) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+void ota_inflate_delete( ota_inflate_t * inflate )
+{
+    free( inflate );
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_inflate.h
+ * @brief Streaming zlib decoder used by the OTA PAL to write compressed
+ * images to flash uncompressed.
+ *
+ * The decoder runs the inflater in the ROM and keeps its 32 KiB window in
+ * internal RAM. Images are compressed as zlib streams, for example with
+ * `python -c "import sys, zlib; sys.stdout.buffer.write(zlib.compress(sys.stdin.buffer.read(), 9))"`.
+ */
+
+#ifndef OTA_INFLATE_H_
+#define OTA_INFLATE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Append len bytes to the image being inflated.
+ */
+typedef esp_err_t ( * ota_inflate_write_t )( void * ctx,
+                                             const uint8_t * data,
+                                             uint32_t len );
+
+typedef struct ota_inflate ota_inflate_t;
+
+/**
+ * @brief Allocate a decoder in internal RAM.
+ *
+ * @return The decoder, or NULL if there is not enough memory.
+ */
+ota_inflate_t * ota_inflate_create( ota_inflate_write_t write,
+                                    void * ctx );
+
+/**
+ * @brief Inflate the next len bytes of the stream.
+ *
+ * The stream has to be fed in order. The image is written out through the
+ * write callback in chunks of up to the size of the window.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a corrupt stream or data after its
+ * end, or the error of the write callback.
+ */
+esp_err_t ota_inflate_process( ota_inflate_t * inflate,
+                               const uint8_t * data,
+                               uint32_t len );
+
+/**
+ * @brief Check the whole stream has been inflated.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the stream ended early.
+ */
+esp_err_t ota_inflate_finish( ota_inflate_t * inflate );
+
+void ota_inflate_delete( ota_inflate_t * inflate );
+
+#endif /* OTA_INFLATE_H_ */
@@ -30,26 +30,70 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
+
+/* ESP-IDF includes. */
+#include "esp_timer.h"
+#include "sdkconfig.h"
 
 /* OTA OS POSIX Interface Includes.*/
 #include "ota_os_freertos.h"
+#include "mem_accounting.h"
 
 /* OTA Library include. */
 #include "ota.h"
 #include "ota_private.h"
 
+#if CONFIG_OTA_PAL_CHUNK_VERIFY
+    #include "ota_pal.h"
+#endif
+
 /* OTA Event queue attributes.*/
-#define MAX_MESSAGES    20
-#define MAX_MSG_SIZE    sizeof( OtaEventMsg_t )
+#define MAX_MESSAGES    CONFIG_OTA_EVENT_QUEUE_LENGTH
+#define MAX_MSG_SIZE    sizeof( OtaQueuedEvent_t )
+
+#define OTA_EVENT_STATS          CONFIG_OTA_EVENT_STATS
+#define OTA_EVENT_TASK_NOTIFY    CONFIG_OTA_EVENT_TASK_NOTIFY
+
+/* An event, with the time it was sent when the statistics are kept. */
+typedef struct OtaQueuedEvent
+{
+    OtaEventMsg_t msg;
+    int64_t sentUs;
+} OtaQueuedEvent_t;
+
+#if OTA_EVENT_TASK_NOTIFY
+
+/* Ring of the events not yet received, guarded by eventsLock. */
+    static OtaQueuedEvent_t events[ MAX_MESSAGES ];
+    static uint32_t eventsHead;
+    static uint32_t eventsCount;
+    static portMUX_TYPE eventsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/* The OTA agent task while it waits for an event, to be notified by the
+ * next sender. */
+    static TaskHandle_t waitingTask;
+#else
 
-/* Array containing pointer to the OTA event structures used to send events to the OTA task. */
-static OtaEventMsg_t queueData[ MAX_MESSAGES * MAX_MSG_SIZE ];
+/* Storage of the queue items. */
+    static uint8_t queueData[ MAX_MESSAGES * MAX_MSG_SIZE ];
 
 /* The queue control structure.  .*/
-static StaticQueue_t staticQueue;
+    static StaticQueue_t staticQueue;
 
 /* The queue control handle.  .*/
-static QueueHandle_t otaEventQueue;
+    static QueueHandle_t otaEventQueue;
+
+/* Events drained from the queue on the last wake-up of the OTA agent, handed
+ * out one per receive. Only touched by the OTA agent task. */
+    static OtaQueuedEvent_t batch[ MAX_MESSAGES ];
+    static uint32_t batchCount;
+    static uint32_t batchNext;
+#endif /* if OTA_EVENT_TASK_NOTIFY */
+
+#if OTA_EVENT_STATS
+    static OtaEventStats_t eventStats;
+#endif
 
 /* OTA App Timer callback.*/
 static OtaTimerCallback_t otaTimerCallback;
@@ -62,30 +106,116 @@ static void requestTimerCallback( TimerHandle_t T );
 static void selfTestTimerCallback( TimerHandle_t T );
 void ( * timerCallback[ OtaNumOfTimers ] )( TimerHandle_t T ) = { requestTimerCallback, selfTestTimerCallback };
 
-OtaOsStatus_t OtaInitEvent_FreeRTOS( OtaEventContext_t * pEventCtx )
-{
-    OtaOsStatus_t otaOsStatus = OtaOsSuccess;
+#if OTA_EVENT_STATS
 
-    ( void ) pEventCtx;
+/* Raise *pHighWater to value if it is lower. */
+    static void updateHighWater( uint32_t * pHighWater,
+                                 uint32_t value )
+    {
+        uint32_t current = __atomic_load_n( pHighWater, __ATOMIC_RELAXED );
 
-    otaEventQueue = xQueueCreateStatic( ( UBaseType_t ) MAX_MESSAGES,
-                                        ( UBaseType_t ) MAX_MSG_SIZE,
-                                        ( uint8_t * ) queueData,
-                                        &staticQueue );
+        while( ( value > current ) &&
+               !__atomic_compare_exchange_n( pHighWater, &current, value, true,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            /* current was reloaded by the failed exchange. */
+        }
+    }
+
+/* Count a send, and the depth it left the queue at. */
+    static void recordSend( bool sent,
+                            uint32_t depth )
+    {
+        if( sent )
+        {
+            ( void ) __atomic_add_fetch( &eventStats.sent, 1U, __ATOMIC_RELAXED );
+            updateHighWater( &eventStats.depthHighWater, depth );
+        }
+        else
+        {
+            ( void ) __atomic_add_fetch( &eventStats.sendFailures, 1U, __ATOMIC_RELAXED );
+        }
+    }
 
-    if( otaEventQueue == NULL )
+/* Count an event handed to the OTA agent and the time it was pending. */
+    static void recordReceive( const OtaQueuedEvent_t * pEvent,
+                               bool waited )
     {
-        otaOsStatus = OtaOsEventQueueCreateFailed;
+        uint32_t latencyUs = ( uint32_t ) ( esp_timer_get_time() - pEvent->sentUs );
+        uint32_t bucket = 0U;
+        uint32_t boundUs = 100U;
 
-        LogError( ( "Failed to create OTA Event Queue: "
-                    "xQueueCreateStatic returned error: "
-                    "OtaOsStatus_t=%i ",
-                    otaOsStatus ) );
+        while( ( bucket < ( OTA_EVENT_LATENCY_BUCKETS - 1U ) ) && ( latencyUs > boundUs ) )
+        {
+            bucket++;
+            boundUs *= 10U;
+        }
+
+        ( void ) __atomic_add_fetch( &eventStats.received, 1U, __ATOMIC_RELAXED );
+        ( void ) __atomic_add_fetch( waited ? &eventStats.waits : &eventStats.batchedReceives, 1U, __ATOMIC_RELAXED );
+        ( void ) __atomic_add_fetch( &eventStats.latencyHistogram[ bucket ], 1U, __ATOMIC_RELAXED );
+        updateHighWater( &eventStats.maxLatencyUs, latencyUs );
     }
-    else
+
+/* Number of events sent and not yet received by the OTA agent. */
+    static uint32_t pendingEvents( void )
     {
-        LogDebug( ( "OTA Event Queue created." ) );
+        uint32_t pending = 0U;
+
+        #if OTA_EVENT_TASK_NOTIFY
+            taskENTER_CRITICAL( &eventsLock );
+            pending = eventsCount;
+            taskEXIT_CRITICAL( &eventsLock );
+        #else
+            if( otaEventQueue != NULL )
+            {
+                pending = ( uint32_t ) uxQueueMessagesWaiting( otaEventQueue ) +
+                          ( __atomic_load_n( &batchCount, __ATOMIC_RELAXED ) -
+                            __atomic_load_n( &batchNext, __ATOMIC_RELAXED ) );
+            }
+        #endif
+
+        return pending;
     }
+#endif /* if OTA_EVENT_STATS */
+
+OtaOsStatus_t OtaInitEvent_FreeRTOS( OtaEventContext_t * pEventCtx )
+{
+    OtaOsStatus_t otaOsStatus = OtaOsSuccess;
+
+    ( void ) pEventCtx;
+
+    #if OTA_EVENT_TASK_NOTIFY
+        taskENTER_CRITICAL( &eventsLock );
+        eventsHead = 0U;
+        eventsCount = 0U;
+        waitingTask = NULL;
+        taskEXIT_CRITICAL( &eventsLock );
+
+        LogDebug( ( "OTA Event ring created." ) );
+    #else
+        batchCount = 0U;
+        batchNext = 0U;
+
+        otaEventQueue = xQueueCreateStatic( ( UBaseType_t ) MAX_MESSAGES,
+                                            ( UBaseType_t ) MAX_MSG_SIZE,
+                                            queueData,
+                                            &staticQueue );
+
+        if( otaEventQueue == NULL )
+        {
+            otaOsStatus = OtaOsEventQueueCreateFailed;
+
+            LogError( ( "Failed to create OTA Event Queue: "
+                        "xQueueCreateStatic returned error: "
+                        "OtaOsStatus_t=%i ",
+                        otaOsStatus ) );
+        }
+        else
+        {
+            LogDebug( ( "OTA Event Queue created." ) );
+        }
+    #endif /* if OTA_EVENT_TASK_NOTIFY */
 
     return otaOsStatus;
 }
@@ -96,12 +226,52 @@ OtaOsStatus_t OtaSendEvent_FreeRTOS( OtaEventContext_t * pEventCtx,
 {
     OtaOsStatus_t otaOsStatus = OtaOsSuccess;
     BaseType_t retVal = pdFALSE;
+    OtaQueuedEvent_t event;
+
+    #if OTA_EVENT_TASK_NOTIFY
+        TaskHandle_t taskToNotify = NULL;
+    #endif
 
     ( void ) pEventCtx;
     ( void ) timeout;
 
-    /* Send the event to OTA event queue.*/
-    retVal = xQueueSendToBack( otaEventQueue, pEventMsg, ( TickType_t ) 0 );
+    ( void ) memcpy( &event.msg, pEventMsg, sizeof( OtaEventMsg_t ) );
+
+    #if OTA_EVENT_STATS
+        event.sentUs = esp_timer_get_time();
+    #else
+        event.sentUs = 0;
+    #endif
+
+    #if OTA_EVENT_TASK_NOTIFY
+        taskENTER_CRITICAL( &eventsLock );
+
+        if( eventsCount < MAX_MESSAGES )
+        {
+            events[ ( eventsHead + eventsCount ) % MAX_MESSAGES ] = event;
+            eventsCount++;
+            retVal = pdTRUE;
+
+            /* Only a waiting agent needs waking; one already running takes
+             * this event with the others before it waits again. */
+            taskToNotify = waitingTask;
+            waitingTask = NULL;
+        }
+
+        taskEXIT_CRITICAL( &eventsLock );
+
+        if( taskToNotify != NULL )
+        {
+            ( void ) xTaskNotifyGive( taskToNotify );
+        }
+    #else
+        /* Send the event to OTA event queue.*/
+        retVal = xQueueSendToBack( otaEventQueue, &event, ( TickType_t ) 0 );
+    #endif /* if OTA_EVENT_TASK_NOTIFY */
+
+    #if OTA_EVENT_STATS
+        recordSend( retVal == pdTRUE, pendingEvents() );
+    #endif
 
     if( retVal == pdTRUE )
     {
@@ -126,20 +296,90 @@ OtaOsStatus_t OtaReceiveEvent_FreeRTOS( OtaEventContext_t * pEventCtx,
 {
     OtaOsStatus_t otaOsStatus = OtaOsSuccess;
     BaseType_t retVal = pdFALSE;
-
-    /* Temp buffer.*/
-    uint8_t buff[ sizeof( OtaEventMsg_t ) ];
+    OtaQueuedEvent_t event;
+    bool waited = false;
 
     ( void ) pEventCtx;
     ( void ) timeout;
 
-    retVal = xQueueReceive( otaEventQueue, &buff, portMAX_DELAY );
+    #if CONFIG_OTA_PAL_CHUNK_VERIFY
+        /* The agent is done with the previous event, so blocks the PAL
+         * rejected while it was handled can be requested again. */
+        otaPal_RequeueRejectedBlocks();
+    #endif
+
+    #if OTA_EVENT_TASK_NOTIFY
+        while( retVal == pdFALSE )
+        {
+            taskENTER_CRITICAL( &eventsLock );
+
+            if( eventsCount > 0U )
+            {
+                event = events[ eventsHead ];
+                eventsHead = ( eventsHead + 1U ) % MAX_MESSAGES;
+                eventsCount--;
+                retVal = pdTRUE;
+            }
+            else
+            {
+                waitingTask = xTaskGetCurrentTaskHandle();
+            }
+
+            taskEXIT_CRITICAL( &eventsLock );
+
+            if( retVal == pdFALSE )
+            {
+                /* A notification from anywhere else only makes the ring be
+                 * checked again. */
+                ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+                waited = true;
+            }
+        }
+    #else /* if OTA_EVENT_TASK_NOTIFY */
+        if( batchNext == batchCount )
+        {
+            /* Wait for an event, then drain the ones sent with it, so that a
+             * burst of blocks is handed out without a queue call each. */
+            retVal = xQueueReceive( otaEventQueue, &batch[ 0 ], portMAX_DELAY );
+
+            if( retVal == pdTRUE )
+            {
+                uint32_t count = 1U;
+
+                while( ( count < MAX_MESSAGES ) &&
+                       ( xQueueReceive( otaEventQueue, &batch[ count ], 0 ) == pdTRUE ) )
+                {
+                    count++;
+                }
+
+                __atomic_store_n( &batchNext, 0U, __ATOMIC_RELAXED );
+                __atomic_store_n( &batchCount, count, __ATOMIC_RELAXED );
+                waited = true;
+            }
+        }
+        else
+        {
+            retVal = pdTRUE;
+        }
+
+        if( retVal == pdTRUE )
+        {
+            event = batch[ batchNext ];
+            __atomic_store_n( &batchNext, batchNext + 1U, __ATOMIC_RELAXED );
+        }
+    #endif /* if OTA_EVENT_TASK_NOTIFY */
 
     if( retVal == pdTRUE )
     {
         /* copy the data from local buffer.*/
-        memcpy( pEventMsg, buff, MAX_MSG_SIZE );
+        ( void ) memcpy( pEventMsg, &event.msg, sizeof( OtaEventMsg_t ) );
         LogDebug( ( "OTA Event received" ) );
+
+        #if OTA_EVENT_STATS
+            recordReceive( &event, waited );
+        #else
+            ( void ) waited;
+        #endif
     }
     else
     {
@@ -160,17 +400,78 @@ OtaOsStatus_t OtaDeinitEvent_FreeRTOS( OtaEventContext_t * pEventCtx )
 
     ( void ) pEventCtx;
 
-    /* Remove the event queue.*/
-    if( otaEventQueue != NULL )
-    {
-        vQueueDelete( otaEventQueue );
+    #if OTA_EVENT_TASK_NOTIFY
+        taskENTER_CRITICAL( &eventsLock );
+        eventsCount = 0U;
+        taskEXIT_CRITICAL( &eventsLock );
 
-        LogDebug( ( "OTA Event Queue Deleted." ) );
-    }
+        LogDebug( ( "OTA Event ring emptied." ) );
+    #else
+        /* Remove the event queue.*/
+        if( otaEventQueue != NULL )
+        {
+            vQueueDelete( otaEventQueue );
+            otaEventQueue = NULL;
+
+            LogDebug( ( "OTA Event Queue Deleted." ) );
+        }
+    #endif
 
     return otaOsStatus;
 }
 
+bool OtaGetEventStats_FreeRTOS( OtaEventStats_t * pStats )
+{
+    bool statsWritten = false;
+
+    #if OTA_EVENT_STATS
+        uint32_t i;
+
+        if( pStats != NULL )
+        {
+            pStats->sent = __atomic_load_n( &eventStats.sent, __ATOMIC_RELAXED );
+            pStats->sendFailures = __atomic_load_n( &eventStats.sendFailures, __ATOMIC_RELAXED );
+            pStats->received = __atomic_load_n( &eventStats.received, __ATOMIC_RELAXED );
+            pStats->waits = __atomic_load_n( &eventStats.waits, __ATOMIC_RELAXED );
+            pStats->batchedReceives = __atomic_load_n( &eventStats.batchedReceives, __ATOMIC_RELAXED );
+            pStats->depth = pendingEvents();
+            pStats->depthHighWater = __atomic_load_n( &eventStats.depthHighWater, __ATOMIC_RELAXED );
+            pStats->maxLatencyUs = __atomic_load_n( &eventStats.maxLatencyUs, __ATOMIC_RELAXED );
+
+            for( i = 0U; i < OTA_EVENT_LATENCY_BUCKETS; i++ )
+            {
+                pStats->latencyHistogram[ i ] = __atomic_load_n( &eventStats.latencyHistogram[ i ], __ATOMIC_RELAXED );
+            }
+
+            statsWritten = true;
+        }
+    #else
+        ( void ) pStats;
+    #endif /* if OTA_EVENT_STATS */
+
+    return statsWritten;
+}
+
+void OtaResetEventStats_FreeRTOS( void )
+{
+    #if OTA_EVENT_STATS
+        uint32_t i;
+
+        __atomic_store_n( &eventStats.sent, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &eventStats.sendFailures, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &eventStats.received, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &eventStats.waits, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &eventStats.batchedReceives, 0U, __ATOMIC_RELAXED );
+        __atomic_store_n( &eventStats.depthHighWater, pendingEvents(), __ATOMIC_RELAXED );
+        __atomic_store_n( &eventStats.maxLatencyUs, 0U, __ATOMIC_RELAXED );
+
+        for( i = 0U; i < OTA_EVENT_LATENCY_BUCKETS; i++ )
+        {
+            __atomic_store_n( &eventStats.latencyHistogram[ i ], 0U, __ATOMIC_RELAXED );
+        }
+    #endif /* if OTA_EVENT_STATS */
+}
+
 static void selfTestTimerCallback( TimerHandle_t T )
 {
     ( void ) T;
@@ -350,10 +651,10 @@ OtaOsStatus_t OtaDeleteTimer_FreeRTOS( OtaTimerId_t otaTimerId )
 
 void * Malloc_FreeRTOS( size_t size )
 {
-    return pvPortMalloc( size );
+    return MEM_ACCOUNTING_MALLOC( MemComponentOta, size );
 }
 
 void Free_FreeRTOS( void * ptr )
 {
-    vPortFree( ptr );
+    MEM_ACCOUNTING_FREE( MemComponentOta, ptr );
 }
@@ -30,12 +30,42 @@
 #define _OTA_OS_FREERTOS_H_
 
 /* Standard library include. */
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
 /* OTA library interface include. */
 #include "ota_os_interface.h"
 
+/**
+ * @brief Number of buckets in #OtaEventStats_t.latencyHistogram. Bucket
+ * upper bounds are 100us, 1ms, 10ms, 100ms and 1s; the last bucket holds
+ * everything slower.
+ */
+#define OTA_EVENT_LATENCY_BUCKETS    6U
+
+/**
+ * @brief OTA event counters, kept when OTA_EVENT_STATS is enabled in
+ * menuconfig.
+ */
+typedef struct OtaEventStats
+{
+    uint32_t sent;            /**< @brief Events sent to the OTA agent. */
+    uint32_t sendFailures;    /**< @brief Events dropped because the queue was full. */
+    uint32_t received;        /**< @brief Events handed to the OTA agent. */
+    uint32_t waits;           /**< @brief Receives that blocked the OTA agent until an event was sent. */
+    uint32_t batchedReceives; /**< @brief Receives served from the events pending without blocking. */
+    uint32_t depth;           /**< @brief Events pending when the counters were read. */
+    uint32_t depthHighWater;  /**< @brief Most events pending since the last reset. */
+    uint32_t maxLatencyUs;    /**< @brief Longest time an event was pending. */
+
+    /**
+     * @brief Histogram of the time from sending an event to handing it to
+     * the OTA agent.
+     */
+    uint32_t latencyHistogram[ OTA_EVENT_LATENCY_BUCKETS ];
+} OtaEventStats_t;
+
 /**
  * @brief Initialize the OTA events.
  *
@@ -68,6 +98,8 @@ OtaOsStatus_t OtaSendEvent_FreeRTOS( OtaEventContext_t * pEventCtx,
  * @brief Receive an OTA event.
  *
  * This function receives next event from the pending OTA events on FreeRTOS platforms.
+ * Each time the OTA agent has to wait, every event pending when it wakes is
+ * taken at once, and the following calls return them without blocking.
  *
  * @param[pEventCtx]     Pointer to the OTA event context.
  *
@@ -93,6 +125,20 @@ OtaOsStatus_t OtaReceiveEvent_FreeRTOS( OtaEventContext_t * pEventCtx,
  */
 OtaOsStatus_t OtaDeinitEvent_FreeRTOS( OtaEventContext_t * pEventCtx );
 
+/**
+ * @brief Copy the OTA event counters.
+ *
+ * @param[pStats]        Where to write the counters.
+ *
+ * @return               true if OTA_EVENT_STATS is enabled and pStats was written, else false.
+ */
+bool OtaGetEventStats_FreeRTOS( OtaEventStats_t * pStats );
+
+/**
+ * @brief Reset the OTA event counters.
+ */
+void OtaResetEventStats_FreeRTOS( void );
+
 
 /**
  * @brief Start timer.
@@ -24,12 +24,17 @@
 #include <sys/param.h>
 #include "ota.h"
 #include "ota_pal.h"
+#include "trace_span.h"
+#include "energy_meter.h"
+#include "mem_placement.h"
+#include "task_layout.h"
 #include "ota_interface_private.h"
 #include "ota_config.h"
 
 #include "iot_crypto.h"
 #include "core_pkcs11.h"
 #include "esp_system.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "soc/rtc_cntl_reg.h"
 #include "hal/wdt_hal.h"
@@ -39,11 +44,18 @@
 #include "esp_image_format.h"
 #include "esp_ota_ops.h"
 #include "aws_esp_ota_ops.h"
+#include "ota_delta.h"
+#include "ota_inflate.h"
 #include "mbedtls/asn1.h"
 #include "mbedtls/bignum.h"
 #include "mbedtls/base64.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #define OTA_HALF_SECOND_DELAY    pdMS_TO_TICKS( 500UL )
 #define ECDSA_INTEGER_LEN        32
@@ -61,6 +73,185 @@
  */
 #define ECDSA_SIG_SIZE    80
 
+#define OTA_PAL_COALESCE_WRITES    CONFIG_OTA_PAL_COALESCE_WRITES
+#define OTA_PAL_STREAM_VERIFY      CONFIG_OTA_PAL_STREAM_VERIFY
+#define OTA_PAL_PIPELINE           CONFIG_OTA_PAL_PIPELINE
+#define OTA_PAL_BACKGROUND_ERASE   CONFIG_OTA_PAL_BACKGROUND_ERASE
+#define OTA_PAL_RESUME             CONFIG_OTA_PAL_RESUME
+#define OTA_PAL_DELTA              CONFIG_OTA_PAL_DELTA
+#define OTA_PAL_COMPRESSED         CONFIG_OTA_PAL_COMPRESSED
+#define OTA_PAL_STAGED             ( OTA_PAL_DELTA || OTA_PAL_COMPRESSED )
+#define OTA_PAL_FAST_COMMIT        CONFIG_OTA_PAL_FAST_COMMIT
+#define OTA_PAL_CHUNK_VERIFY       CONFIG_OTA_PAL_CHUNK_VERIFY
+#define OTA_PAL_SLICED_VERIFY      CONFIG_OTA_PAL_SLICED_VERIFY
+
+/* Largest flash write, and erase rounded up to whole sectors, done at once.
+ * Zero leaves them whole. */
+#define FLASH_CHUNK_SIZE           CONFIG_OTA_PAL_FLASH_CHUNK_SIZE
+#define FLASH_ERASE_CHUNK_SIZE     \
+    ( ( FLASH_CHUNK_SIZE + SPI_FLASH_SEC_SIZE - 1U ) & ~( ( uint32_t ) SPI_FLASH_SEC_SIZE - 1U ) )
+
+/* Encrypted flash is written in 16-byte units. */
+#if ( FLASH_CHUNK_SIZE % 16 ) != 0
+    #error "OTA_PAL_FLASH_CHUNK_SIZE must be a multiple of 16."
+#endif
+
+#if OTA_PAL_COALESCE_WRITES
+    #define COALESCE_SECTORS             CONFIG_OTA_PAL_COALESCE_SECTORS
+    #define COALESCE_BLOCKS_PER_SECTOR   ( SPI_FLASH_SEC_SIZE / otaconfigFILE_BLOCK_SIZE )
+    #define COALESCE_SLOT_FREE           UINT32_MAX
+
+/* Blocks are tracked with one bit each in a 32-bit map, and a sector must hold
+ * at least two blocks for coalescing to save flash writes. */
+    #define COALESCE_SUPPORTED                                 \
+    ( ( otaconfigFILE_BLOCK_SIZE * 2U <= SPI_FLASH_SEC_SIZE ) && \
+      ( COALESCE_BLOCKS_PER_SECTOR <= 32U ) )
+
+/* A flash sector of the image being assembled from blocks. */
+    typedef struct
+    {
+        uint32_t sector_offset; /* Offset of the sector in the image, or COALESCE_SLOT_FREE. */
+        uint32_t filled_map;    /* Bit n is set once block n of the sector has been received. */
+        uint32_t last_use;      /* Slot clock value when a block was last stored. */
+        uint8_t data[ SPI_FLASH_SEC_SIZE ];
+    } ota_sector_buf_t;
+#endif /* if OTA_PAL_COALESCE_WRITES */
+
+#if OTA_PAL_PIPELINE
+    #define PIPELINE_BUFFERS     CONFIG_OTA_PAL_PIPELINE_BUFFERS
+    #if TASK_LAYOUT_ENABLED
+
+/* The task layout profile replaces the settings of the writer task. */
+        #define WRITER_STACK_SIZE    ( TaskLayout_Get( TASK_LAYOUT_PROFILE, TaskLayoutFlashWriter ).stackSize )
+        #define WRITER_PRIORITY      ( TaskLayout_Get( TASK_LAYOUT_PROFILE, TaskLayoutFlashWriter ).priority )
+        #define WRITER_CORE          ( TaskLayout_Get( TASK_LAYOUT_PROFILE, TaskLayoutFlashWriter ).core )
+    #else
+        #define WRITER_STACK_SIZE    CONFIG_OTA_PAL_WRITER_STACK_SIZE
+        #define WRITER_PRIORITY      CONFIG_OTA_PAL_WRITER_PRIORITY
+        #define WRITER_CORE          CONFIG_OTA_PAL_WRITER_CORE
+    #endif
+
+/* A block waiting in the ring for the flash writer task. */
+    typedef struct
+    {
+        uint32_t offset;
+        uint32_t size;
+    #if OTA_PAL_CHUNK_VERIFY
+        const uint8_t * hash; /* Hash in the manifest the writer task checks the block against, or NULL. */
+        bool mismatch;        /* The block didn't match its hash, so the writer task didn't write it. */
+    #endif
+        uint8_t data[ otaconfigFILE_BLOCK_SIZE ];
+    } ota_pipeline_block_t;
+#endif /* if OTA_PAL_PIPELINE */
+
+#if OTA_PAL_BACKGROUND_ERASE
+    #define ERASE_TASK_STACK_SIZE    CONFIG_OTA_PAL_ERASE_TASK_STACK_SIZE
+    #define ERASE_TASK_PRIORITY      CONFIG_OTA_PAL_ERASE_TASK_PRIORITY
+
+/* Aligned ranges of this size are erased with the faster block erase,
+ * unless that is longer than the flash chunk size allows. */
+    #define ERASE_BLOCK_SIZE         ( 64U * 1024U )
+    #define ERASE_BLOCK_ALLOWED      ( ( FLASH_CHUNK_SIZE == 0 ) || ( FLASH_ERASE_CHUNK_SIZE >= ERASE_BLOCK_SIZE ) )
+#endif
+
+#if OTA_PAL_RESUME
+    #define RESUME_NVS_NAMESPACE     "ota_pal"
+    #define RESUME_NVS_KEY           "resume"
+    #define RESUME_CHECKPOINT_MS     CONFIG_OTA_PAL_RESUME_CHECKPOINT_MS
+
+/* Checkpoint of a download kept in NVS, followed by a bitmap with bit n set
+ * once block n of the file is in flash. */
+    typedef struct
+    {
+        uint8_t job_hash[ 32 ];     /* SHA-256 of the job name, file and signature. */
+        uint32_t partition_address;
+        uint32_t file_size;
+        uint32_t erased_len;        /* Bytes at the start of the partition known to be erased. */
+    } ota_resume_header_t;
+#endif /* if OTA_PAL_RESUME */
+
+#if OTA_PAL_DELTA
+    #define DELTA_FILE_TYPE         CONFIG_OTA_PAL_DELTA_FILE_TYPE
+#endif
+#if OTA_PAL_COMPRESSED
+    #define COMPRESSED_FILE_TYPE    CONFIG_OTA_PAL_COMPRESSED_FILE_TYPE
+#endif
+
+#if OTA_PAL_CHUNK_VERIFY
+    #define CHUNKED_FILE_TYPE          CONFIG_OTA_PAL_CHUNK_VERIFY_FILE_TYPE
+    #define CHUNK_MAX_MISMATCHES       CONFIG_OTA_PAL_CHUNK_VERIFY_MAX_MISMATCHES
+    #define CHUNK_MANIFEST_MAGIC       0x314D434FUL /* "OCM1" */
+    #define CHUNK_HASH_SIZE            32U
+
+    #if ( OTA_PAL_DELTA && ( CHUNKED_FILE_TYPE == DELTA_FILE_TYPE ) ) || \
+    ( OTA_PAL_COMPRESSED && ( CHUNKED_FILE_TYPE == COMPRESSED_FILE_TYPE ) )
+        #error "OTA_PAL_CHUNK_VERIFY_FILE_TYPE must differ from the file types of patches and compressed images."
+    #endif
+
+/* Start of a manifest file, little-endian, followed by the SHA-256 of each
+ * block of the image and padding up to manifest_size. The image follows the
+ * manifest, so its blocks are blocks of the file too. The signature of the
+ * job is of the first manifest_size bytes of the file. */
+    typedef struct
+    {
+        uint32_t magic;
+        uint32_t image_size;
+        uint32_t block_size;    /* Bytes of the image per hash, the block size of the OTA agent. */
+        uint32_t manifest_size; /* Bytes of the file before the image, a whole number of blocks. */
+        uint8_t boot_sig[ 64 ]; /* Raw ECDSA signature of the image, written after it for the bootloader. */
+    } ota_chunk_manifest_header_t;
+
+/* A manifest file being received. */
+    typedef struct
+    {
+        OtaFileContext_t * file;       /* Whose bitmap rejected blocks are put back in. */
+        uint8_t * manifest;            /* manifest_size bytes once the first block has arrived, or NULL. */
+        uint32_t manifest_size;
+        uint32_t manifest_blocks_left; /* Blocks of the manifest not stored yet. */
+        bool manifest_verified;        /* The signature of the job matched the manifest. */
+        uint32_t blocks_left;          /* Blocks of the image not written yet. */
+        uint32_t mismatches;           /* Blocks requested again because they failed their check. */
+        uint32_t rejected_count;       /* Bits set in rejected_map. */
+        uint8_t rejected_map[];        /* Bit n is set while block n of the file is to be requested again. */
+    } ota_chunked_file_t;
+#endif /* if OTA_PAL_CHUNK_VERIFY */
+
+#if OTA_PAL_SLICED_VERIFY
+    #define VERIFY_SLICE_SIZE     CONFIG_OTA_PAL_VERIFY_SLICE_SIZE
+    #define VERIFY_SLICE_TICKS    pdMS_TO_TICKS( CONFIG_OTA_PAL_VERIFY_SLICE_MS )
+
+/* Percent of the image hashed between progress logs. */
+    #define VERIFY_LOG_PERCENT    25U
+
+    static otaPal_VerifyProgress_t verify_progress_cb;
+#endif
+
+#if OTA_PAL_FAST_COMMIT
+    #define FAST_COMMIT_MAGIC    0x46434D54UL
+
+/* Set to FAST_COMMIT_MAGIC xor the address of the running partition once the
+ * image is committed by otaPal_FastCommit, until the job status has been set.
+ * Kept over software resets, so the self test can still finish after one. */
+    static RTC_NOINIT_ATTR uint32_t fast_commit_marker;
+#endif
+
+#if OTA_PAL_STAGED
+
+/* A file that has to be decoded into the image: a patch against the running
+ * firmware or a compressed image. It is stored at the end of the update
+ * partition as it arrives and decoded in order into the start. */
+    typedef struct
+    {
+        uint32_t file_type;
+        void * decoder;                            /* ota_delta_t or ota_inflate_t, by file_type. */
+        uint32_t staging_offset;                   /* Partition offset the file is stored at. */
+        uint32_t applied_len;                      /* Bytes at the start of the file fed to the decoder. */
+        uint32_t written_len;                      /* Bytes of the decoded image in the partition. */
+        uint8_t block[ otaconfigFILE_BLOCK_SIZE ]; /* A stored block of the file read back. */
+        uint8_t rx_map[];                          /* Bit n is set once block n of the file is stored. */
+    } ota_staged_file_t;
+#endif /* if OTA_PAL_STAGED */
+
 typedef struct
 {
     const esp_partition_t * update_partition;
@@ -68,6 +259,42 @@ typedef struct
     esp_ota_handle_t update_handle;
     uint32_t data_write_len;
     bool valid_image;
+#if OTA_PAL_COALESCE_WRITES
+    ota_sector_buf_t * sector_bufs; /* COALESCE_SECTORS buffers, or NULL to write blocks directly. */
+    uint32_t sector_buf_clock;
+#endif
+#if OTA_PAL_STREAM_VERIFY
+    void * sig_verify_ctx; /* Signature hash of the image written so far, or NULL. */
+    uint32_t hashed_len;   /* Bytes at the start of the image already hashed. */
+#endif
+#if OTA_PAL_PIPELINE
+    ota_pipeline_block_t * pipeline_blocks; /* PIPELINE_BUFFERS blocks, or NULL to write from the caller. */
+    esp_err_t pipeline_err;                 /* First write error seen by the flash writer task. */
+#endif
+#if OTA_PAL_BACKGROUND_ERASE
+    bool erase_running;    /* The erase task has been started for this file. */
+    uint32_t erase_end;    /* Bytes at the start of the partition the file needs erased. */
+    uint32_t erased_len;   /* Bytes erased so far, updated by the erase task. */
+    bool erase_stop;       /* Asks the erase task to give up. */
+    esp_err_t erase_err;
+    uint32_t erase_waits;  /* Writes that had to wait for the erase task. */
+#endif
+#if OTA_PAL_RESUME
+    ota_resume_header_t * resume_record; /* Checkpoint of the file being received, or NULL. */
+    uint32_t resume_record_len;          /* Size of the header and the bitmap after it. */
+    uint32_t resume_erased_len;          /* Erased bytes, when no erase task is running. */
+    TickType_t resume_saved_at;
+    bool resume_dirty;                   /* Blocks were written since the last checkpoint. */
+#endif
+#if OTA_PAL_STAGED
+    ota_staged_file_t * staged; /* File being decoded, or NULL when the file is the image itself. */
+#endif
+#if OTA_PAL_CHUNK_VERIFY
+    ota_chunked_file_t * chunked; /* Manifest file being received, or NULL. */
+#endif
+#if ENERGY_METER_ENABLED
+    EnergyScope_t energy; /* The file being received, from its creation to its close. */
+#endif
 } esp_ota_context_t;
 
 typedef struct
@@ -82,6 +309,33 @@ static const char * TAG = "ota_pal";
 
 static char * codeSigningCertificatePEM = NULL;
 
+/* Public key of codeSigningCertificatePEM, parsed once when it is set. */
+static mbedtls_pk_context codeSigningKey;
+static bool codeSigningKeyValid = false;
+
+/* Memory of the signature verification context. Only one image is verified at
+ * a time, so the heap isn't needed at the end of a download, when it is most
+ * fragmented. */
+static StaticSignatureVerificationState_t sig_verify_buf;
+
+#if OTA_PAL_PIPELINE
+    /* Blocks ready to be filled, and blocks waiting to be written. */
+    static QueueHandle_t pipeline_free_queue;
+    static QueueHandle_t pipeline_write_queue;
+    static StaticQueue_t pipeline_free_queue_buf;
+    static StaticQueue_t pipeline_write_queue_buf;
+    static uint8_t pipeline_free_queue_storage[ PIPELINE_BUFFERS * sizeof( ota_pipeline_block_t * ) ];
+    static uint8_t pipeline_write_queue_storage[ PIPELINE_BUFFERS * sizeof( ota_pipeline_block_t * ) ];
+#endif
+
+#if OTA_PAL_BACKGROUND_ERASE
+    /* Given by the erase task after each erased range and when it exits. */
+    static SemaphoreHandle_t erase_progress;
+    static StaticSemaphore_t erase_progress_buf;
+    static SemaphoreHandle_t erase_done;
+    static StaticSemaphore_t erase_done_buf;
+#endif
+
 /* Specify the OTA signature algorithm we support on this platform. */
 const char OTA_JsonFileSignatureKey[ OTA_FILE_SIG_KEY_STR_MAX_LENGTH ] = "sig-sha256-ecdsa";
 
@@ -92,6 +346,9 @@ static CK_RV prvGetCertificateHandle( CK_FUNCTION_LIST_PTR pxFunctionList,
 static CK_RV prvGetCertificate( const char * pcLabelName,
                                 uint8_t ** ppucData,
                                 uint32_t * pulDataSize );
+static const esp_partition_t * get_running_firmware( void );
+static BaseType_t signature_final( void * pvSigVerifyContext,
+                                   const OtaFileContext_t * pFileContext );
 
 static OtaPalMainStatus_t asn1_to_raw_ecdsa( uint8_t * signature,
                                              uint16_t sig_len,
@@ -103,56 +360,1518 @@ static OtaPalMainStatus_t asn1_to_raw_ecdsa( uint8_t * signature,
     mbedtls_mpi r = { 0 };
     mbedtls_mpi s = { 0 };
 
-    if( out_signature == NULL )
+    if( out_signature == NULL )
+    {
+        LogError( ( "ASN1 invalid argument !" ) );
+        goto cleanup;
+    }
+
+    mbedtls_mpi_init( &r );
+    mbedtls_mpi_init( &s );
+
+    if( ( ret = mbedtls_asn1_get_tag( &signature, end, &len,
+                                      MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
+    {
+        LogError( ( "Bad Input Signature" ) );
+        goto cleanup;
+    }
+
+    if( signature + len != end )
+    {
+        LogError( ( "Incorrect ASN1 Signature Length" ) );
+        goto cleanup;
+    }
+
+    if( ( ( ret = mbedtls_asn1_get_mpi( &signature, end, &r ) ) != 0 ) ||
+        ( ( ret = mbedtls_asn1_get_mpi( &signature, end, &s ) ) != 0 ) )
+    {
+        LogError( ( "ASN1 parsing failed" ) );
+        goto cleanup;
+    }
+
+    ret = mbedtls_mpi_write_binary( &r, out_signature, ECDSA_INTEGER_LEN );
+    ret = mbedtls_mpi_write_binary( &s, out_signature + ECDSA_INTEGER_LEN, ECDSA_INTEGER_LEN );
+
+cleanup:
+    mbedtls_mpi_free( &r );
+    mbedtls_mpi_free( &s );
+
+    if( ret == 0 )
+    {
+        return OtaPalSuccess;
+    }
+    else
+    {
+        return OtaPalBadSignerCert;
+    }
+}
+
+/* Write to the update partition in pieces of at most FLASH_CHUNK_SIZE. The
+ * flash cache is disabled while a piece is programmed, which stalls every
+ * task running from flash on both cores, the network tasks among them, so
+ * they get to run between the pieces. */
+static esp_err_t ota_program( const uint8_t * data,
+                              uint32_t size,
+                              uint32_t offset )
+{
+#if FLASH_CHUNK_SIZE > 0
+    esp_err_t ret = ESP_OK;
+    uint32_t done = 0;
+    uint32_t len;
+
+    while( ( ret == ESP_OK ) && ( done < size ) )
+    {
+        if( done > 0 )
+        {
+            taskYIELD();
+        }
+
+        len = MIN( size - done, ( uint32_t ) FLASH_CHUNK_SIZE );
+        ret = esp_ota_write_with_offset( ota_ctx.update_handle, &data[ done ], len, offset + done );
+        done += len;
+    }
+
+    return ret;
+#else
+    return esp_ota_write_with_offset( ota_ctx.update_handle, data, size, offset );
+#endif
+}
+
+/* Erase part of a partition in pieces of at most FLASH_ERASE_CHUNK_SIZE,
+ * for the same reason as ota_program. */
+static esp_err_t ota_erase( const esp_partition_t * partition,
+                            uint32_t offset,
+                            uint32_t size )
+{
+#if FLASH_CHUNK_SIZE > 0
+    esp_err_t ret = ESP_OK;
+    uint32_t done = 0;
+    uint32_t len;
+
+    while( ( ret == ESP_OK ) && ( done < size ) )
+    {
+        if( done > 0 )
+        {
+            taskYIELD();
+        }
+
+        len = MIN( size - done, ( uint32_t ) FLASH_ERASE_CHUNK_SIZE );
+        ret = esp_partition_erase_range( partition, offset + done, len );
+        done += len;
+    }
+
+    return ret;
+#else
+    return esp_partition_erase_range( partition, offset, size );
+#endif
+}
+
+/* Bytes at the start of the partition the file and its signature trailer
+ * will be written to, rounded up to a whole sector. */
+static uint32_t ota_erase_end( const OtaFileContext_t * pFileContext )
+{
+    uint32_t end = pFileContext->fileSize + ECDSA_SIG_SIZE;
+
+#if OTA_PAL_STAGED
+    if( ota_ctx.staged != NULL )
+    {
+        /* The size of the decoded image is not known yet, so all of the partition below the file is used. */
+        return ota_ctx.staged->staging_offset;
+    }
+#endif
+
+    return MIN( ( end + SPI_FLASH_SEC_SIZE - 1U ) & ~( ( uint32_t ) SPI_FLASH_SEC_SIZE - 1U ),
+                ota_ctx.update_partition->size );
+}
+
+#if OTA_PAL_STREAM_VERIFY
+
+/* Start hashing the image as it is written. The whole image is read back
+ * from flash when the file is closed if this fails. */
+    static void stream_verify_start( void )
+    {
+        ota_ctx.hashed_len = 0;
+
+        if( CRYPTO_SignatureVerificationStartStatic( &ota_ctx.sig_verify_ctx, &sig_verify_buf, cryptoASYMMETRIC_ALGORITHM_ECDSA,
+                                                     cryptoHASH_ALGORITHM_SHA256 ) == pdFALSE )
+        {
+            LogWarn( ( "Signature verification start failed, the image will be hashed on close" ) );
+            ota_ctx.sig_verify_ctx = NULL;
+        }
+    }
+
+/* Release the hash of an image that is not going to be verified. */
+    static void stream_verify_stop( void )
+    {
+        if( ota_ctx.sig_verify_ctx != NULL )
+        {
+            /* Called with only the context, this just ends it. */
+            ( void ) CRYPTO_SignatureVerificationFinal( ota_ctx.sig_verify_ctx, NULL, 0, NULL, 0 );
+            ota_ctx.sig_verify_ctx = NULL;
+        }
+    }
+
+#endif /* if OTA_PAL_STREAM_VERIFY */
+
+#if OTA_PAL_BACKGROUND_ERASE
+
+/* Erase the sectors the file needs, in order, publishing the progress for
+ * the writes waiting on it. The first range is a single sector so the first
+ * block can be written as soon as possible. */
+    static void erase_task( void * pvParameters )
+    {
+        uint32_t offset = ota_ctx.erased_len;
+        uint32_t len;
+        esp_err_t ret = ESP_OK;
+        TickType_t start = xTaskGetTickCount();
+
+        ( void ) pvParameters;
+
+        while( ( ret == ESP_OK ) && ( offset < ota_ctx.erase_end ) &&
+               !__atomic_load_n( &ota_ctx.erase_stop, __ATOMIC_RELAXED ) )
+        {
+            len = ( ERASE_BLOCK_ALLOWED && ( offset != 0 ) && ( ( offset % ERASE_BLOCK_SIZE ) == 0 ) &&
+                    ( ota_ctx.erase_end - offset >= ERASE_BLOCK_SIZE ) ) ? ERASE_BLOCK_SIZE : SPI_FLASH_SEC_SIZE;
+            ret = esp_partition_erase_range( ota_ctx.update_partition, offset, len );
+
+            if( ret == ESP_OK )
+            {
+                offset += len;
+                __atomic_store_n( &ota_ctx.erased_len, offset, __ATOMIC_RELEASE );
+            }
+            else
+            {
+                LogError( ( "Erase of the update partition failed at the offset %d (%d)", offset, ret ) );
+                ota_ctx.erase_err = ret;
+            }
+
+            ( void ) xSemaphoreGive( erase_progress );
+        }
+
+        LogInfo( ( "Erased %u bytes of the update partition in %u ms, %u writes waited",
+                   offset, ( unsigned ) ( ( xTaskGetTickCount() - start ) * portTICK_PERIOD_MS ),
+                   ota_ctx.erase_waits ) );
+
+        ( void ) xSemaphoreGive( erase_done );
+        vTaskDelete( NULL );
+    }
+
+/* Start erasing the sectors the file and its signature will be written to,
+ * from start on. Returns false if the task could not be started. */
+    static bool erase_start( const OtaFileContext_t * pFileContext,
+                             uint32_t start )
+    {
+        if( erase_progress == NULL )
+        {
+            erase_progress = xSemaphoreCreateBinaryStatic( &erase_progress_buf );
+            erase_done = xSemaphoreCreateBinaryStatic( &erase_done_buf );
+        }
+
+        ota_ctx.erase_end = ota_erase_end( pFileContext );
+        ota_ctx.erased_len = start;
+        ota_ctx.erase_stop = false;
+        ota_ctx.erase_err = ESP_OK;
+        ota_ctx.erase_waits = 0;
+        ( void ) xSemaphoreTake( erase_progress, 0 );
+
+        ota_ctx.erase_running = ( xTaskCreate( erase_task, "ota_erase", ERASE_TASK_STACK_SIZE, NULL,
+                                               ERASE_TASK_PRIORITY, NULL ) == pdPASS );
+
+        return ota_ctx.erase_running;
+    }
+
+/* Wait for the erase task to exit, asking it to stop early if the file is
+ * being dropped. */
+    static esp_err_t erase_finish( bool stop )
+    {
+        if( ota_ctx.erase_running )
+        {
+            __atomic_store_n( &ota_ctx.erase_stop, stop, __ATOMIC_RELAXED );
+            ( void ) xSemaphoreTake( erase_done, portMAX_DELAY );
+            ota_ctx.erase_running = false;
+        }
+
+        return ota_ctx.erase_err;
+    }
+
+/* Wait until the partition is erased up to end. */
+    static esp_err_t erase_wait( uint32_t end )
+    {
+        if( ota_ctx.erase_running && ( __atomic_load_n( &ota_ctx.erased_len, __ATOMIC_ACQUIRE ) < end ) )
+        {
+            ota_ctx.erase_waits++;
+
+            while( ( ota_ctx.erase_err == ESP_OK ) &&
+                   ( __atomic_load_n( &ota_ctx.erased_len, __ATOMIC_ACQUIRE ) < MIN( end, ota_ctx.erase_end ) ) )
+            {
+                ( void ) xSemaphoreTake( erase_progress, portMAX_DELAY );
+            }
+        }
+
+        return ota_ctx.erase_err;
+    }
+
+#endif /* if OTA_PAL_BACKGROUND_ERASE */
+
+#if OTA_PAL_RESUME
+
+/* Number of blocks in the file. */
+    static uint32_t resume_block_count( const OtaFileContext_t * pFileContext )
+    {
+        return ( pFileContext->fileSize + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE;
+    }
+
+/* Hash of what identifies the download: the job, the file and its signature. */
+    static void resume_job_hash( const OtaFileContext_t * pFileContext,
+                                 uint8_t * hash )
+    {
+        mbedtls_sha256_context sha;
+
+        mbedtls_sha256_init( &sha );
+        ( void ) mbedtls_sha256_starts_ret( &sha, 0 );
+
+        if( pFileContext->pJobName != NULL )
+        {
+            ( void ) mbedtls_sha256_update_ret( &sha, pFileContext->pJobName,
+                                                strlen( ( const char * ) pFileContext->pJobName ) );
+        }
+
+        ( void ) mbedtls_sha256_update_ret( &sha, ( const uint8_t * ) &pFileContext->fileSize,
+                                            sizeof( pFileContext->fileSize ) );
+        ( void ) mbedtls_sha256_update_ret( &sha, ( const uint8_t * ) &pFileContext->serverFileID,
+                                            sizeof( pFileContext->serverFileID ) );
+
+        if( pFileContext->pSignature != NULL )
+        {
+            ( void ) mbedtls_sha256_update_ret( &sha, pFileContext->pSignature->data,
+                                                pFileContext->pSignature->size );
+        }
+
+        ( void ) mbedtls_sha256_finish_ret( &sha, hash );
+        mbedtls_sha256_free( &sha );
+    }
+
+/* Forget the checkpoint kept in NVS. */
+    static void resume_clear( void )
+    {
+        nvs_handle_t handle;
+
+        if( nvs_open( RESUME_NVS_NAMESPACE, NVS_READWRITE, &handle ) == ESP_OK )
+        {
+            if( nvs_erase_key( handle, RESUME_NVS_KEY ) == ESP_OK )
+            {
+                ( void ) nvs_commit( handle );
+            }
+
+            nvs_close( handle );
+        }
+    }
+
+/* Write the checkpoint of the file being received to NVS. */
+    static void resume_save( void )
+    {
+        nvs_handle_t handle;
+        esp_err_t ret;
+
+    #if OTA_PAL_BACKGROUND_ERASE
+        if( ota_ctx.erase_running )
+        {
+            ota_ctx.resume_record->erased_len = __atomic_load_n( &ota_ctx.erased_len, __ATOMIC_ACQUIRE );
+        }
+        else
+    #endif
+        {
+            ota_ctx.resume_record->erased_len = ota_ctx.resume_erased_len;
+        }
+
+        ret = nvs_open( RESUME_NVS_NAMESPACE, NVS_READWRITE, &handle );
+
+        if( ret == ESP_OK )
+        {
+            ret = nvs_set_blob( handle, RESUME_NVS_KEY, ota_ctx.resume_record, ota_ctx.resume_record_len );
+
+            if( ret == ESP_OK )
+            {
+                ret = nvs_commit( handle );
+            }
+
+            nvs_close( handle );
+        }
+
+        if( ret != ESP_OK )
+        {
+            LogWarn( ( "Failed to save the OTA checkpoint (%d)", ret ) );
+        }
+
+        ota_ctx.resume_saved_at = xTaskGetTickCount();
+        ota_ctx.resume_dirty = false;
+    }
+
+/* Set up the checkpoint of the file about to be received, and load the one
+ * kept in NVS if it is for the same download to the same partition. Returns
+ * true, with the length of the partition already erased, if the download
+ * can be resumed. */
+    static bool resume_start( const OtaFileContext_t * pFileContext,
+                              const esp_partition_t * partition,
+                              uint32_t * erased_len )
+    {
+        nvs_handle_t handle;
+        size_t len;
+        bool resumed = false;
+        ota_resume_header_t * saved;
+
+        ota_ctx.resume_saved_at = xTaskGetTickCount();
+        ota_ctx.resume_dirty = false;
+        ota_ctx.resume_record_len = sizeof( ota_resume_header_t ) + ( ( resume_block_count( pFileContext ) + 7U ) / 8U );
+        ota_ctx.resume_record = calloc( 1, ota_ctx.resume_record_len );
+
+        if( ota_ctx.resume_record == NULL )
+        {
+            LogWarn( ( "No memory for the OTA checkpoint, the download can't be resumed" ) );
+        }
+        else
+        {
+            resume_job_hash( pFileContext, ota_ctx.resume_record->job_hash );
+            ota_ctx.resume_record->partition_address = partition->address;
+            ota_ctx.resume_record->file_size = pFileContext->fileSize;
+
+            saved = malloc( ota_ctx.resume_record_len );
+
+            if( ( saved != NULL ) && ( nvs_open( RESUME_NVS_NAMESPACE, NVS_READONLY, &handle ) == ESP_OK ) )
+            {
+                len = ota_ctx.resume_record_len;
+
+                if( ( nvs_get_blob( handle, RESUME_NVS_KEY, saved, &len ) == ESP_OK ) &&
+                    ( len == ota_ctx.resume_record_len ) &&
+                    ( memcmp( saved->job_hash, ota_ctx.resume_record->job_hash, sizeof( saved->job_hash ) ) == 0 ) &&
+                    ( saved->partition_address == partition->address ) &&
+                    ( saved->file_size == pFileContext->fileSize ) )
+                {
+                    memcpy( ota_ctx.resume_record, saved, len );
+                    *erased_len = saved->erased_len;
+                    resumed = true;
+                }
+
+                nvs_close( handle );
+            }
+
+            free( saved );
+        }
+
+        if( !resumed )
+        {
+            /* The partition is about to be erased, so an older checkpoint is no longer valid. */
+            resume_clear();
+        }
+
+        return resumed;
+    }
+
+/* Mark the blocks restored from the checkpoint as received in the OTA
+ * agent's bitmap so they are not requested again. The last block is always
+ * requested, so the agent still closes the file once it arrives. */
+    static void resume_apply( OtaFileContext_t * pFileContext )
+    {
+        uint8_t * bitmap = ( uint8_t * ) &ota_ctx.resume_record[ 1 ];
+        uint32_t blocks = resume_block_count( pFileContext );
+        uint32_t restored = 0;
+        uint32_t block;
+
+        for( block = 0; ( pFileContext->pRxBlockBitmap != NULL ) && ( block + 1U < blocks ); block++ )
+        {
+            if( ( ( bitmap[ block / 8U ] & ( 1U << ( block % 8U ) ) ) != 0 ) &&
+                ( ( pFileContext->pRxBlockBitmap[ block / 8U ] & ( 1U << ( block % 8U ) ) ) != 0 ) &&
+                ( pFileContext->blocksRemaining > 1U ) )
+            {
+                pFileContext->pRxBlockBitmap[ block / 8U ] &= ( uint8_t ) ~( 1U << ( block % 8U ) );
+                pFileContext->blocksRemaining--;
+                ota_ctx.data_write_len += otaconfigFILE_BLOCK_SIZE;
+                restored++;
+            }
+        }
+
+        LogInfo( ( "Resuming the OTA download with %u of %u blocks already written", restored, blocks ) );
+    }
+
+/* Record the blocks programmed by a flash write, and save the checkpoint if
+ * the last one is old enough. */
+    static void resume_mark( const OtaFileContext_t * pFileContext,
+                             uint32_t offset,
+                             uint32_t size )
+    {
+        uint8_t * bitmap;
+        uint32_t block = ( offset + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE;
+        uint32_t end = offset + size;
+
+        if( ( ota_ctx.resume_record == NULL ) || ( pFileContext == NULL ) )
+        {
+            return;
+        }
+
+        bitmap = ( uint8_t * ) &ota_ctx.resume_record[ 1 ];
+
+        /* Only blocks written in full count, the last block of the file may be short. */
+        while( ( block < resume_block_count( pFileContext ) ) &&
+               ( ( ( block + 1U ) * otaconfigFILE_BLOCK_SIZE <= end ) || ( end >= pFileContext->fileSize ) ) )
+        {
+            bitmap[ block / 8U ] |= ( uint8_t ) ( 1U << ( block % 8U ) );
+            ota_ctx.resume_dirty = true;
+            block++;
+        }
+
+        if( ota_ctx.resume_dirty &&
+            ( ( xTaskGetTickCount() - ota_ctx.resume_saved_at ) >= pdMS_TO_TICKS( RESUME_CHECKPOINT_MS ) ) )
+        {
+            resume_save();
+        }
+    }
+
+/* Drop the checkpoint of the file, leaving what is kept in NVS as it is. */
+    static void resume_stop( void )
+    {
+        free( ota_ctx.resume_record );
+        ota_ctx.resume_record = NULL;
+    }
+
+#endif /* if OTA_PAL_RESUME */
+
+/* Program image data into the update partition, hashing it when it extends
+ * the part of the image hashed so far and recording it for the checkpoint. */
+static esp_err_t ota_flash_write( const uint8_t * data,
+                                  uint32_t size,
+                                  uint32_t offset )
+{
+    ENERGY_METER_BEGIN( energy, EnergyOpFlashWrite );
+
+#if OTA_PAL_BACKGROUND_ERASE
+    esp_err_t ret = erase_wait( offset + size );
+
+    if( ret == ESP_OK )
+    {
+        ret = ota_program( data, size, offset );
+    }
+#else
+    esp_err_t ret = ota_program( data, size, offset );
+#endif
+
+    ENERGY_METER_END( energy, size );
+
+#if OTA_PAL_STREAM_VERIFY
+    if( ( ret == ESP_OK ) && ( ota_ctx.sig_verify_ctx != NULL ) &&
+        ( offset <= ota_ctx.hashed_len ) && ( offset + size > ota_ctx.hashed_len ) )
+    {
+        CRYPTO_SignatureVerificationUpdate( ota_ctx.sig_verify_ctx, &data[ ota_ctx.hashed_len - offset ],
+                                            offset + size - ota_ctx.hashed_len );
+        ota_ctx.hashed_len = offset + size;
+    }
+#endif
+#if OTA_PAL_RESUME
+    if( ret == ESP_OK )
+    {
+        resume_mark( ota_ctx.cur_ota, offset, size );
+    }
+#endif
+
+    return ret;
+}
+
+#if OTA_PAL_COALESCE_WRITES
+
+/* Bytes of the image that fall in the sector at sector_offset. */
+    static uint32_t coalesce_sector_len( const OtaFileContext_t * pFileContext,
+                                         uint32_t sector_offset )
+    {
+        return MIN( ( uint32_t ) SPI_FLASH_SEC_SIZE, pFileContext->fileSize - sector_offset );
+    }
+
+/* Map with a bit set for every block of the sector at sector_offset. */
+    static uint32_t coalesce_full_map( const OtaFileContext_t * pFileContext,
+                                       uint32_t sector_offset )
+    {
+        uint32_t blocks = ( coalesce_sector_len( pFileContext, sector_offset ) + otaconfigFILE_BLOCK_SIZE - 1U ) /
+                          otaconfigFILE_BLOCK_SIZE;
+
+        return ( blocks >= 32U ) ? UINT32_MAX : ( ( 1UL << blocks ) - 1U );
+    }
+
+/* Allocate the sector buffers. Blocks are written directly if this fails. */
+    static void coalesce_start( void )
+    {
+        uint32_t i;
+
+        ota_ctx.sector_buf_clock = 0;
+        ota_ctx.sector_bufs = NULL;
+
+        if( COALESCE_SUPPORTED )
+        {
+            ota_ctx.sector_bufs = MemPlacement_Malloc( MemPlacementBulk, COALESCE_SECTORS * sizeof( ota_sector_buf_t ) );
+
+            if( ota_ctx.sector_bufs == NULL )
+            {
+                LogWarn( ( "No memory for OTA sector buffers, writing blocks directly" ) );
+            }
+            else
+            {
+                for( i = 0; i < COALESCE_SECTORS; i++ )
+                {
+                    ota_ctx.sector_bufs[ i ].sector_offset = COALESCE_SLOT_FREE;
+                    ota_ctx.sector_bufs[ i ].filled_map = 0;
+                }
+            }
+        }
+    }
+
+/* Drop the sector buffers without writing them. */
+    static void coalesce_stop( void )
+    {
+        MemPlacement_Free( ota_ctx.sector_bufs );
+        ota_ctx.sector_bufs = NULL;
+    }
+
+/* Write the runs of received blocks held by a slot, then free the slot. A
+ * complete sector goes out as a single write. */
+    static esp_err_t coalesce_flush_slot( const OtaFileContext_t * pFileContext,
+                                          ota_sector_buf_t * slot )
+    {
+        esp_err_t ret = ESP_OK;
+        uint32_t sector_len = coalesce_sector_len( pFileContext, slot->sector_offset );
+        uint32_t block = 0;
+        uint32_t run_start, run_end;
+
+        while( ( ret == ESP_OK ) && ( block < COALESCE_BLOCKS_PER_SECTOR ) )
+        {
+            if( ( slot->filled_map & ( 1UL << block ) ) == 0 )
+            {
+                block++;
+                continue;
+            }
+
+            run_start = block * otaconfigFILE_BLOCK_SIZE;
+
+            while( ( block < COALESCE_BLOCKS_PER_SECTOR ) && ( ( slot->filled_map & ( 1UL << block ) ) != 0 ) )
+            {
+                block++;
+            }
+
+            run_end = MIN( block * otaconfigFILE_BLOCK_SIZE, sector_len );
+            ret = ota_flash_write( &slot->data[ run_start ], run_end - run_start,
+                                   slot->sector_offset + run_start );
+        }
+
+        if( ret != ESP_OK )
+        {
+            LogError( ( "Couldn't flash sector at the offset %d", slot->sector_offset ) );
+        }
+
+        slot->sector_offset = COALESCE_SLOT_FREE;
+        slot->filled_map = 0;
+
+        return ret;
+    }
+
+/* Write every slot still holding blocks. */
+    static esp_err_t coalesce_flush_all( const OtaFileContext_t * pFileContext )
+    {
+        esp_err_t ret = ESP_OK;
+        uint32_t i;
+
+        for( i = 0; ( ota_ctx.sector_bufs != NULL ) && ( i < COALESCE_SECTORS ); i++ )
+        {
+            if( ( ota_ctx.sector_bufs[ i ].sector_offset != COALESCE_SLOT_FREE ) && ( ret == ESP_OK ) )
+            {
+                ret = coalesce_flush_slot( pFileContext, &ota_ctx.sector_bufs[ i ] );
+            }
+        }
+
+        return ret;
+    }
+
+/* Whether a block can be stored in a sector buffer: it must be a whole,
+ * aligned file block, or the last block of the file. */
+    static bool coalesce_applies( const OtaFileContext_t * pFileContext,
+                                  uint32_t offset,
+                                  uint32_t size )
+    {
+        return ( ota_ctx.sector_bufs != NULL ) &&
+               ( ( offset % otaconfigFILE_BLOCK_SIZE ) == 0 ) &&
+               ( size <= otaconfigFILE_BLOCK_SIZE ) &&
+               ( ( size == otaconfigFILE_BLOCK_SIZE ) || ( offset + size == pFileContext->fileSize ) );
+    }
+
+/* Store a block in the buffer of its sector, and write the sector out once
+ * all of its blocks are present. */
+    static esp_err_t coalesce_write( const OtaFileContext_t * pFileContext,
+                                     uint32_t offset,
+                                     const uint8_t * data,
+                                     uint32_t size )
+    {
+        esp_err_t ret = ESP_OK;
+        uint32_t sector_offset = offset & ~( ( uint32_t ) SPI_FLASH_SEC_SIZE - 1U );
+        ota_sector_buf_t * slot = NULL;
+        ota_sector_buf_t * free_slot = NULL;
+        ota_sector_buf_t * oldest_slot = &ota_ctx.sector_bufs[ 0 ];
+        uint32_t i;
+
+        for( i = 0; ( slot == NULL ) && ( i < COALESCE_SECTORS ); i++ )
+        {
+            ota_sector_buf_t * candidate = &ota_ctx.sector_bufs[ i ];
+
+            if( candidate->sector_offset == sector_offset )
+            {
+                slot = candidate;
+            }
+            else if( candidate->sector_offset == COALESCE_SLOT_FREE )
+            {
+                free_slot = ( free_slot == NULL ) ? candidate : free_slot;
+            }
+            else if( candidate->last_use < oldest_slot->last_use )
+            {
+                oldest_slot = candidate;
+            }
+        }
+
+        if( slot == NULL )
+        {
+            if( free_slot == NULL )
+            {
+                /* Evict the sector written to least recently. */
+                ret = coalesce_flush_slot( pFileContext, oldest_slot );
+                free_slot = oldest_slot;
+            }
+
+            slot = free_slot;
+            slot->sector_offset = sector_offset;
+            slot->filled_map = 0;
+        }
+
+        if( ret == ESP_OK )
+        {
+            memcpy( &slot->data[ offset - sector_offset ], data, size );
+            slot->filled_map |= 1UL << ( ( offset - sector_offset ) / otaconfigFILE_BLOCK_SIZE );
+            slot->last_use = ++ota_ctx.sector_buf_clock;
+
+            if( slot->filled_map == coalesce_full_map( pFileContext, sector_offset ) )
+            {
+                ret = coalesce_flush_slot( pFileContext, slot );
+            }
+        }
+
+        return ret;
+    }
+
+#endif /* if OTA_PAL_COALESCE_WRITES */
+
+#if OTA_PAL_STAGED
+
+/* Whether the file has to be decoded into the image. */
+    static bool is_staged_file( const OtaFileContext_t * pFileContext )
+    {
+        bool staged = false;
+
+    #if OTA_PAL_DELTA
+        staged = staged || ( pFileContext->fileType == DELTA_FILE_TYPE );
+    #endif
+    #if OTA_PAL_COMPRESSED
+        staged = staged || ( pFileContext->fileType == COMPRESSED_FILE_TYPE );
+    #endif
+
+        return staged;
+    }
+
+    #if OTA_PAL_DELTA
+
+/* Read the running firmware for the patch decoder. */
+        static esp_err_t delta_read_from( void * ctx,
+                                          uint32_t offset,
+                                          uint8_t * buf,
+                                          uint32_t len )
+        {
+            return esp_partition_read( ( const esp_partition_t * ) ctx, offset, buf, len );
+        }
+    #endif
+
+/* Append to the image decoded at the start of the update partition. */
+    static esp_err_t staged_write_to( void * ctx,
+                                      const uint8_t * data,
+                                      uint32_t len )
+    {
+        esp_err_t ret = ESP_ERR_INVALID_SIZE;
+
+        ( void ) ctx;
+
+        /* The image and its signature have to fit below the stored file. */
+        if( ota_ctx.staged->written_len + len + ECDSA_SIG_SIZE <= ota_ctx.staged->staging_offset )
+        {
+            ret = ota_flash_write( data, len, ota_ctx.staged->written_len );
+        }
+        else
+        {
+            LogError( ( "The decoded image doesn't fit in the update partition" ) );
+        }
+
+        if( ret == ESP_OK )
+        {
+            ota_ctx.staged->written_len += len;
+        }
+
+        return ret;
+    }
+
+    static void staged_free( ota_staged_file_t * staged )
+    {
+        if( staged != NULL )
+        {
+    #if OTA_PAL_COMPRESSED
+            if( ( staged->file_type == COMPRESSED_FILE_TYPE ) && ( staged->decoder != NULL ) )
+            {
+                ota_inflate_delete( staged->decoder );
+            }
+            else
+    #endif
+            {
+                free( staged->decoder );
+            }
+
+            free( staged );
+        }
+    }
+
+    static void staged_stop( void )
+    {
+        staged_free( ota_ctx.staged );
+        ota_ctx.staged = NULL;
+    }
+
+/* Set up receiving a file to decode. It is stored at the end of the update partition. */
+    static OtaPalMainStatus_t staged_start( const OtaFileContext_t * pFileContext )
+    {
+        uint32_t blocks = ( pFileContext->fileSize + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE;
+        ota_staged_file_t * staged;
+
+        if( pFileContext->fileSize + SPI_FLASH_SEC_SIZE > ota_ctx.update_partition->size )
+        {
+            LogError( ( "File of %u bytes leaves no room for the image", pFileContext->fileSize ) );
+            return OtaPalRxFileTooLarge;
+        }
+
+        staged = calloc( 1, sizeof( ota_staged_file_t ) + ( ( blocks + 7U ) / 8U ) );
+
+        if( staged == NULL )
+        {
+            LogError( ( "No memory to decode the file" ) );
+            return OtaPalOutOfMemory;
+        }
+
+        ota_ctx.staged = staged;
+        staged->file_type = pFileContext->fileType;
+        staged->staging_offset = ( ota_ctx.update_partition->size - pFileContext->fileSize ) &
+                                 ~( ( uint32_t ) SPI_FLASH_SEC_SIZE - 1U );
+
+    #if OTA_PAL_DELTA
+        if( staged->file_type == DELTA_FILE_TYPE )
+        {
+            const esp_partition_t * running = get_running_firmware();
+
+            staged->decoder = malloc( sizeof( ota_delta_t ) );
+
+            if( staged->decoder != NULL )
+            {
+                ota_delta_init( staged->decoder, running->size, delta_read_from, staged_write_to, ( void * ) running );
+                LogInfo( ( "Receiving a %u byte patch against the partition %s", pFileContext->fileSize, running->label ) );
+            }
+        }
+    #endif
+    #if OTA_PAL_COMPRESSED
+        if( staged->file_type == COMPRESSED_FILE_TYPE )
+        {
+            staged->decoder = ota_inflate_create( staged_write_to, NULL );
+
+            if( staged->decoder != NULL )
+            {
+                LogInfo( ( "Receiving a %u byte compressed image", pFileContext->fileSize ) );
+            }
+        }
+    #endif
+
+        if( staged->decoder == NULL )
+        {
+            LogError( ( "No memory to decode the file" ) );
+            staged_stop();
+            return OtaPalOutOfMemory;
+        }
+
+        return OtaPalSuccess;
+    }
+
+    static esp_err_t staged_process( const uint8_t * data,
+                                     uint32_t len )
+    {
+    #if OTA_PAL_COMPRESSED
+        if( ota_ctx.staged->file_type == COMPRESSED_FILE_TYPE )
+        {
+            return ota_inflate_process( ota_ctx.staged->decoder, data, len );
+        }
+    #endif
+    #if OTA_PAL_DELTA
+        return ota_delta_process( ota_ctx.staged->decoder, data, len );
+    #else
+        return ESP_ERR_INVALID_STATE;
+    #endif
+    }
+
+/* Store a block of the file, then decode the file as far as its stored
+ * blocks are contiguous. The block just received is decoded from RAM. */
+    static esp_err_t staged_write( const OtaFileContext_t * pFileContext,
+                                   uint32_t offset,
+                                   const uint8_t * data,
+                                   uint32_t size )
+    {
+        ota_staged_file_t * staged = ota_ctx.staged;
+        uint32_t block = offset / otaconfigFILE_BLOCK_SIZE;
+        uint32_t len;
+        esp_err_t ret;
+
+        if( ( ( offset % otaconfigFILE_BLOCK_SIZE ) != 0 ) || ( size > otaconfigFILE_BLOCK_SIZE ) ||
+            ( offset + size > pFileContext->fileSize ) )
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        ret = ota_program( data, size, staged->staging_offset + offset );
+
+        if( ret == ESP_OK )
+        {
+            staged->rx_map[ block / 8U ] |= ( uint8_t ) ( 1U << ( block % 8U ) );
+        }
+
+        while( ( ret == ESP_OK ) && ( staged->applied_len < pFileContext->fileSize ) )
+        {
+            block = staged->applied_len / otaconfigFILE_BLOCK_SIZE;
+            len = MIN( otaconfigFILE_BLOCK_SIZE, pFileContext->fileSize - staged->applied_len );
+
+            if( ( staged->rx_map[ block / 8U ] & ( 1U << ( block % 8U ) ) ) == 0 )
+            {
+                break;
+            }
+
+            if( staged->applied_len == offset )
+            {
+                ret = staged_process( data, len );
+            }
+            else
+            {
+                ret = esp_partition_read( ota_ctx.update_partition, staged->staging_offset + staged->applied_len,
+                                          staged->block, len );
+
+                if( ret == ESP_OK )
+                {
+                    ret = staged_process( staged->block, len );
+                }
+            }
+
+            if( ret == ESP_OK )
+            {
+                staged->applied_len += len;
+            }
+            else
+            {
+                LogError( ( "Couldn't decode the file at the offset %u (%d)", staged->applied_len, ret ) );
+            }
+        }
+
+        return ret;
+    }
+
+/* Complete the decoded image once the whole file has been fed to the decoder. */
+    static esp_err_t staged_finish( const OtaFileContext_t * pFileContext )
+    {
+        esp_err_t ret = ESP_ERR_INVALID_SIZE;
+
+        if( ota_ctx.staged->applied_len == pFileContext->fileSize )
+        {
+    #if OTA_PAL_COMPRESSED
+            if( ota_ctx.staged->file_type == COMPRESSED_FILE_TYPE )
+            {
+                ret = ota_inflate_finish( ota_ctx.staged->decoder );
+            }
+            else
+    #endif
+            {
+    #if OTA_PAL_DELTA
+                ret = ota_delta_finish( ota_ctx.staged->decoder );
+    #endif
+            }
+        }
+
+        if( ret == ESP_OK )
+        {
+            /* From here on the file is the decoded image. */
+            ota_ctx.data_write_len = ota_ctx.staged->written_len;
+            LogInfo( ( "Decoded a %u byte image", ota_ctx.data_write_len ) );
+        }
+        else
+        {
+            LogError( ( "The file is incomplete (%d)", ret ) );
+        }
+
+        staged_stop();
+
+        return ret;
+    }
+
+#endif /* if OTA_PAL_STAGED */
+
+#if OTA_PAL_CHUNK_VERIFY
+
+/* Whether the file is a manifest followed by the image. */
+    static bool is_chunked_file( const OtaFileContext_t * pFileContext )
+    {
+        return pFileContext->fileType == CHUNKED_FILE_TYPE;
+    }
+
+    static void chunked_free( ota_chunked_file_t * chunked )
+    {
+        if( chunked != NULL )
+        {
+            MemPlacement_Free( chunked->manifest );
+            free( chunked );
+        }
+    }
+
+    static void chunked_stop( void )
+    {
+        chunked_free( ota_ctx.chunked );
+        ota_ctx.chunked = NULL;
+    }
+
+/* Set up receiving a manifest file. The manifest is allocated once its first
+ * block gives its size. */
+    static OtaPalMainStatus_t chunked_start( OtaFileContext_t * pFileContext )
+    {
+        uint32_t blocks = ( pFileContext->fileSize + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE;
+        ota_chunked_file_t * chunked = calloc( 1, sizeof( ota_chunked_file_t ) + ( ( blocks + 7U ) / 8U ) );
+
+        if( chunked == NULL )
+        {
+            LogError( ( "No memory to verify the file" ) );
+            return OtaPalOutOfMemory;
+        }
+
+        chunked->file = pFileContext;
+        ota_ctx.chunked = chunked;
+
+        return OtaPalSuccess;
+    }
+
+/* Have a block of the file requested again. The OTA agent counts the block
+ * being written as received when otaPal_WriteBlock returns, so it is added
+ * back to the blocks remaining here, and to the bitmap of the agent by
+ * otaPal_RequeueRejectedBlocks once the agent is done with it. */
+    static void chunked_reject( uint32_t block )
+    {
+        ota_chunked_file_t * chunked = ota_ctx.chunked;
+        uint8_t bit = ( uint8_t ) ( 1U << ( block % 8U ) );
+
+        if( ( chunked->rejected_map[ block / 8U ] & bit ) == 0U )
+        {
+            chunked->rejected_map[ block / 8U ] |= bit;
+            chunked->rejected_count++;
+            chunked->file->blocksRemaining++;
+        }
+    }
+
+/* Check the header in the first block of the file against the file and the
+ * block size, and allocate the manifest. */
+    static bool chunked_load_header( const uint8_t * data,
+                                     uint32_t size )
+    {
+        ota_chunked_file_t * chunked = ota_ctx.chunked;
+        const uint32_t file_size = chunked->file->fileSize;
+        ota_chunk_manifest_header_t header;
+        uint32_t hashes_size;
+
+        if( size < sizeof( header ) )
+        {
+            LogError( ( "First block of %u bytes is too short for the manifest header", size ) );
+            return false;
+        }
+
+        memcpy( &header, data, sizeof( header ) );
+        hashes_size = ( ( header.image_size + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE ) * CHUNK_HASH_SIZE;
+
+        if( ( header.magic != CHUNK_MANIFEST_MAGIC ) || ( header.block_size != otaconfigFILE_BLOCK_SIZE ) ||
+            ( header.image_size == 0U ) || ( header.image_size >= file_size ) ||
+            ( header.manifest_size != file_size - header.image_size ) ||
+            ( ( header.manifest_size % otaconfigFILE_BLOCK_SIZE ) != 0U ) ||
+            ( header.manifest_size < sizeof( header ) + hashes_size ) )
+        {
+            LogError( ( "Bad manifest header: magic 0x%08x, block size %u, image %u bytes, manifest %u bytes",
+                        header.magic, header.block_size, header.image_size, header.manifest_size ) );
+            return false;
+        }
+
+        chunked->manifest = MemPlacement_Malloc( MemPlacementBulk, header.manifest_size );
+
+        if( chunked->manifest == NULL )
+        {
+            LogError( ( "No memory for a manifest of %u bytes", header.manifest_size ) );
+            return false;
+        }
+
+        memcpy( chunked->manifest, data, size );
+        chunked->manifest_size = header.manifest_size;
+        chunked->manifest_blocks_left = ( header.manifest_size / otaconfigFILE_BLOCK_SIZE ) - 1U;
+        chunked->blocks_left = hashes_size / CHUNK_HASH_SIZE;
+
+        return true;
+    }
+
+/* Check the stored manifest against the signature of the job. If it does not
+ * match, the whole manifest is requested again. */
+    static void chunked_verify_manifest( void )
+    {
+        ota_chunked_file_t * chunked = ota_ctx.chunked;
+        void * pvSigVerifyContext;
+        BaseType_t verified = pdFALSE;
+        uint32_t block;
+
+        if( chunked->file->pSignature == NULL )
+        {
+            LogError( ( "Image Signature not found" ) );
+        }
+        else if( CRYPTO_SignatureVerificationStartStatic( &pvSigVerifyContext, &sig_verify_buf, cryptoASYMMETRIC_ALGORITHM_ECDSA,
+                                                          cryptoHASH_ALGORITHM_SHA256 ) == pdFALSE )
+        {
+            LogError( ( "Signature verification start failed" ) );
+        }
+        else
+        {
+            CRYPTO_SignatureVerificationUpdate( pvSigVerifyContext, chunked->manifest, chunked->manifest_size );
+            verified = signature_final( pvSigVerifyContext, chunked->file );
+        }
+
+        if( verified == pdTRUE )
+        {
+            LogInfo( ( "Manifest of %u blocks verified", chunked->blocks_left ) );
+            chunked->manifest_verified = true;
+        }
+        else
+        {
+            LogWarn( ( "Manifest signature verification failed, requesting it again" ) );
+            chunked->mismatches++;
+
+            for( block = 0; block < chunked->manifest_size / otaconfigFILE_BLOCK_SIZE; block++ )
+            {
+                chunked_reject( block );
+            }
+
+            MemPlacement_Free( chunked->manifest );
+            chunked->manifest = NULL;
+        }
+    }
+
+/* Check a block of a manifest file as it arrives. Blocks of the manifest are
+ * stored, and a block of the image that matches its hash is given back with
+ * its offset in the image to be written. Any other block is requested again,
+ * and size is set to 0 so nothing is written: blocks that can't be checked
+ * because the manifest isn't verified yet, and blocks that fail their check.
+ * If hash isn't NULL, a block of the image is given back unhashed and *hash
+ * is set to the hash it has to match, for the flash writer task to check.
+ * Returns ESP_ERR_INVALID_CRC once more blocks failed than allowed. */
+    static esp_err_t chunked_check( uint32_t * offset,
+                                    const uint8_t * data,
+                                    uint32_t * size,
+                                    const uint8_t ** hash )
+    {
+        ota_chunked_file_t * chunked = ota_ctx.chunked;
+        const ota_chunk_manifest_header_t * header;
+        uint32_t block = *offset / otaconfigFILE_BLOCK_SIZE;
+        uint32_t manifest_blocks = chunked->manifest_size / otaconfigFILE_BLOCK_SIZE;
+        uint32_t image_block;
+        const uint8_t * expected;
+        uint8_t digest[ CHUNK_HASH_SIZE ];
+
+        if( chunked->manifest == NULL )
+        {
+            /* The size of the manifest is only known from its first block. */
+            if( block != 0U )
+            {
+                chunked_reject( block );
+            }
+            else if( !chunked_load_header( data, *size ) )
+            {
+                chunked->mismatches++;
+                chunked_reject( block );
+            }
+            else if( chunked->manifest_blocks_left == 0U )
+            {
+                chunked_verify_manifest();
+            }
+
+            *size = 0U;
+        }
+        else if( block < manifest_blocks )
+        {
+            memcpy( &chunked->manifest[ *offset ], data, *size );
+            chunked->manifest_blocks_left--;
+
+            if( chunked->manifest_blocks_left == 0U )
+            {
+                chunked_verify_manifest();
+            }
+
+            *size = 0U;
+        }
+        else if( !chunked->manifest_verified )
+        {
+            chunked_reject( block );
+            *size = 0U;
+        }
+        else
+        {
+            header = ( const ota_chunk_manifest_header_t * ) chunked->manifest;
+            image_block = block - manifest_blocks;
+            expected = &chunked->manifest[ sizeof( *header ) + ( image_block * CHUNK_HASH_SIZE ) ];
+
+            if( ( *size == MIN( ( uint32_t ) otaconfigFILE_BLOCK_SIZE, header->image_size - ( image_block * otaconfigFILE_BLOCK_SIZE ) ) ) &&
+                ( ( hash != NULL ) ||
+                  ( ( mbedtls_sha256_ret( data, *size, digest, 0 ) == 0 ) && ( memcmp( digest, expected, CHUNK_HASH_SIZE ) == 0 ) ) ) )
+            {
+                *offset = image_block * otaconfigFILE_BLOCK_SIZE;
+
+                if( hash != NULL )
+                {
+                    /* Hashed by the flash writer task, and counted by pipeline_collect. */
+                    *hash = expected;
+                }
+                else
+                {
+                    chunked->blocks_left--;
+                }
+            }
+            else
+            {
+                LogWarn( ( "Block %u of the image does not match the manifest, requesting it again", image_block ) );
+                chunked->mismatches++;
+                chunked_reject( block );
+                *size = 0U;
+            }
+        }
+
+        if( chunked->mismatches > CHUNK_MAX_MISMATCHES )
+        {
+            LogError( ( "%u blocks failed their check, giving up", chunked->mismatches ) );
+            return ESP_ERR_INVALID_CRC;
+        }
+
+        return ESP_OK;
+    }
+
+/* Put the rejected blocks back in the bitmap of the OTA agent. */
+    void otaPal_RequeueRejectedBlocks( void )
+    {
+        ota_chunked_file_t * chunked = ota_ctx.chunked;
+        uint32_t bytes;
+        uint32_t i;
+
+        if( ( chunked != NULL ) && ( chunked->rejected_count > 0U ) && ( chunked->file->pRxBlockBitmap != NULL ) )
+        {
+            bytes = ( ( ( chunked->file->fileSize + otaconfigFILE_BLOCK_SIZE - 1U ) / otaconfigFILE_BLOCK_SIZE ) + 7U ) / 8U;
+
+            for( i = 0; i < bytes; i++ )
+            {
+                chunked->file->pRxBlockBitmap[ i ] |= chunked->rejected_map[ i ];
+                chunked->rejected_map[ i ] = 0U;
+            }
+
+            chunked->rejected_count = 0U;
+        }
+    }
+
+#endif /* if OTA_PAL_CHUNK_VERIFY */
+
+/* Write a block of the image to the update partition. */
+static esp_err_t ota_write( const OtaFileContext_t * pFileContext,
+                            uint32_t offset,
+                            const uint8_t * data,
+                            uint32_t size )
+{
+#if OTA_PAL_STAGED
+    if( ota_ctx.staged != NULL )
+    {
+        return staged_write( pFileContext, offset, data, size );
+    }
+#endif
+
+#if OTA_PAL_COALESCE_WRITES
+    if( coalesce_applies( pFileContext, offset, size ) )
+    {
+        return coalesce_write( pFileContext, offset, data, size );
+    }
+#else
+    ( void ) pFileContext;
+#endif
+
+    return ota_flash_write( data, size, offset );
+}
+
+#if OTA_PAL_PIPELINE
+
+/* Write the queued blocks to flash. After a failed write the remaining
+ * blocks of the file are dropped, and the error is returned to the OTA agent
+ * by its next write or by closing the file. A block of a manifest file is
+ * hashed here first, so the hashing runs on the core of this task, and is
+ * left unwritten if it doesn't match. */
+    static void pipeline_writer_task( void * pvParameters )
+    {
+        ota_pipeline_block_t * block;
+        esp_err_t ret;
+
+    #if OTA_PAL_CHUNK_VERIFY
+        uint8_t digest[ CHUNK_HASH_SIZE ];
+    #endif
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            if( xQueueReceive( pipeline_write_queue, &block, portMAX_DELAY ) == pdTRUE )
+            {
+            #if OTA_PAL_CHUNK_VERIFY
+                /* pipeline_collect has a block that doesn't match requested again. */
+                block->mismatch = ( block->hash != NULL ) &&
+                                  ( ( mbedtls_sha256_ret( block->data, block->size, digest, 0 ) != 0 ) ||
+                                    ( memcmp( digest, block->hash, CHUNK_HASH_SIZE ) != 0 ) );
+
+                if( ( ota_ctx.pipeline_err == ESP_OK ) && !block->mismatch )
+            #else
+                if( ota_ctx.pipeline_err == ESP_OK )
+            #endif
+                {
+                    ret = ota_write( ota_ctx.cur_ota, block->offset, block->data, block->size );
+
+                    if( ret != ESP_OK )
+                    {
+                        LogError( ( "Couldn't flash at the offset %d", block->offset ) );
+                        ota_ctx.pipeline_err = ret;
+                    }
+                }
+
+                ( void ) xQueueSendToBack( pipeline_free_queue, &block, 0 );
+            }
+        }
+    }
+
+/* Create the queues and the flash writer task the first time a file is
+ * received. They are kept for later updates. */
+    static bool pipeline_init( void )
+    {
+        static bool initialized = false;
+        BaseType_t core = WRITER_CORE;
+
+        if( !initialized )
+        {
+            pipeline_free_queue = xQueueCreateStatic( PIPELINE_BUFFERS, sizeof( ota_pipeline_block_t * ),
+                                                      pipeline_free_queue_storage, &pipeline_free_queue_buf );
+            pipeline_write_queue = xQueueCreateStatic( PIPELINE_BUFFERS, sizeof( ota_pipeline_block_t * ),
+                                                       pipeline_write_queue_storage, &pipeline_write_queue_buf );
+
+            if( core < 0 )
+            {
+                core = ( portNUM_PROCESSORS > 1 ) ? ( xPortGetCoreID() == 0 ? 1 : 0 ) : tskNO_AFFINITY;
+            }
+
+            if( xTaskCreatePinnedToCore( pipeline_writer_task, "ota_flash_wr", WRITER_STACK_SIZE, NULL,
+                                         WRITER_PRIORITY, NULL, core ) == pdPASS )
+            {
+                initialized = true;
+            }
+            else
+            {
+                LogWarn( ( "Failed to create the OTA flash writer task" ) );
+            }
+        }
+
+        return initialized;
+    }
+
+/* Allocate the ring of blocks. Blocks are written by the caller if this fails. */
+    static void pipeline_start( void )
+    {
+        uint32_t i;
+        ota_pipeline_block_t * block;
+
+        ota_ctx.pipeline_err = ESP_OK;
+        ota_ctx.pipeline_blocks = NULL;
+
+        if( pipeline_init() )
+        {
+            ota_ctx.pipeline_blocks = MemPlacement_Malloc( MemPlacementBulk, PIPELINE_BUFFERS * sizeof( ota_pipeline_block_t ) );
+
+            if( ota_ctx.pipeline_blocks == NULL )
+            {
+                LogWarn( ( "No memory for OTA pipeline buffers, writing blocks directly" ) );
+            }
+            else
+            {
+                for( i = 0; i < PIPELINE_BUFFERS; i++ )
+                {
+                    block = &ota_ctx.pipeline_blocks[ i ];
+                #if OTA_PAL_CHUNK_VERIFY
+                    block->hash = NULL;
+                    block->mismatch = false;
+                #endif
+                    ( void ) xQueueSendToBack( pipeline_free_queue, &block, 0 );
+                }
+            }
+        }
+    }
+
+/* Count a block the flash writer task has checked against the manifest,
+ * once it is back in the free queue, and have it requested again if it
+ * didn't match. This runs in the OTA agent task, like chunked_check. */
+    static void pipeline_collect( ota_pipeline_block_t * block )
     {
-        LogError( ( "ASN1 invalid argument !" ) );
-        goto cleanup;
-    }
+    #if OTA_PAL_CHUNK_VERIFY
+        ota_chunked_file_t * chunked = ota_ctx.chunked;
 
-    mbedtls_mpi_init( &r );
-    mbedtls_mpi_init( &s );
+        if( block->hash != NULL )
+        {
+            if( block->mismatch )
+            {
+                LogWarn( ( "Block %u of the image does not match the manifest, requesting it again",
+                           block->offset / otaconfigFILE_BLOCK_SIZE ) );
+                chunked->mismatches++;
+                chunked_reject( ( chunked->manifest_size + block->offset ) / otaconfigFILE_BLOCK_SIZE );
+                ota_ctx.data_write_len -= block->size;
+            }
+            else
+            {
+                chunked->blocks_left--;
+            }
 
-    if( ( ret = mbedtls_asn1_get_tag( &signature, end, &len,
-                                      MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
-    {
-        LogError( ( "Bad Input Signature" ) );
-        goto cleanup;
+            block->hash = NULL;
+            block->mismatch = false;
+        }
+    #else /* if OTA_PAL_CHUNK_VERIFY */
+        ( void ) block;
+    #endif /* if OTA_PAL_CHUNK_VERIFY */
     }
 
-    if( signature + len != end )
+/* Wait for the flash writer task to write every queued block. */
+    static esp_err_t pipeline_drain( void )
     {
-        LogError( ( "Incorrect ASN1 Signature Length" ) );
-        goto cleanup;
+        ota_pipeline_block_t * blocks[ PIPELINE_BUFFERS ];
+        uint32_t i;
+
+        if( ota_ctx.pipeline_blocks != NULL )
+        {
+            /* Each block goes back to the free queue once it has been written. */
+            for( i = 0; i < PIPELINE_BUFFERS; i++ )
+            {
+                ( void ) xQueueReceive( pipeline_free_queue, &blocks[ i ], portMAX_DELAY );
+                pipeline_collect( blocks[ i ] );
+            }
+
+            for( i = 0; i < PIPELINE_BUFFERS; i++ )
+            {
+                ( void ) xQueueSendToBack( pipeline_free_queue, &blocks[ i ], 0 );
+            }
+        }
+
+        return ota_ctx.pipeline_err;
     }
 
-    if( ( ( ret = mbedtls_asn1_get_mpi( &signature, end, &r ) ) != 0 ) ||
-        ( ( ret = mbedtls_asn1_get_mpi( &signature, end, &s ) ) != 0 ) )
+/* Wait for the queued blocks to be written and free the ring. */
+    static esp_err_t pipeline_stop( void )
     {
-        LogError( ( "ASN1 parsing failed" ) );
-        goto cleanup;
-    }
+        ota_pipeline_block_t * block;
+        esp_err_t ret = pipeline_drain();
 
-    ret = mbedtls_mpi_write_binary( &r, out_signature, ECDSA_INTEGER_LEN );
-    ret = mbedtls_mpi_write_binary( &s, out_signature + ECDSA_INTEGER_LEN, ECDSA_INTEGER_LEN );
+        if( ota_ctx.pipeline_blocks != NULL )
+        {
+            while( xQueueReceive( pipeline_free_queue, &block, 0 ) == pdTRUE )
+            {
+            }
 
-cleanup:
-    mbedtls_mpi_free( &r );
-    mbedtls_mpi_free( &s );
+            MemPlacement_Free( ota_ctx.pipeline_blocks );
+            ota_ctx.pipeline_blocks = NULL;
+        }
 
-    if( ret == 0 )
-    {
-        return OtaPalSuccess;
+        return ret;
     }
-    else
+
+/* Queue a block for the flash writer task, waiting for a free buffer when
+ * the ring is full. If hash isn't NULL, the writer task only writes the
+ * block if it matches the hash. That is only asked for when the ring is
+ * allocated and the block fits a buffer. */
+    static esp_err_t pipeline_write( const OtaFileContext_t * pFileContext,
+                                     uint32_t offset,
+                                     const uint8_t * data,
+                                     uint32_t size,
+                                     const uint8_t * hash )
     {
-        return OtaPalBadSignerCert;
+        ota_pipeline_block_t * block;
+
+        if( ( ota_ctx.pipeline_blocks == NULL ) || ( size > otaconfigFILE_BLOCK_SIZE ) )
+        {
+            esp_err_t ret = pipeline_drain();
+
+            return ( ret == ESP_OK ) ? ota_write( pFileContext, offset, data, size ) : ret;
+        }
+
+        ( void ) xQueueReceive( pipeline_free_queue, &block, portMAX_DELAY );
+        pipeline_collect( block );
+
+        if( ota_ctx.pipeline_err != ESP_OK )
+        {
+            ( void ) xQueueSendToBack( pipeline_free_queue, &block, 0 );
+            return ota_ctx.pipeline_err;
+        }
+
+        block->offset = offset;
+        block->size = size;
+    #if OTA_PAL_CHUNK_VERIFY
+        block->hash = hash;
+    #else
+        ( void ) hash;
+    #endif
+        memcpy( block->data, data, size );
+        ( void ) xQueueSendToBack( pipeline_write_queue, &block, 0 );
+
+        return ESP_OK;
     }
-}
+
+#endif /* if OTA_PAL_PIPELINE */
 
 static void _esp_ota_ctx_clear( esp_ota_context_t * ota_ctx )
 {
     if( ota_ctx != NULL )
     {
+#if OTA_PAL_PIPELINE
+        ( void ) pipeline_stop();
+#endif
+#if OTA_PAL_BACKGROUND_ERASE
+        ( void ) erase_finish( true );
+#endif
+#if OTA_PAL_COALESCE_WRITES
+        free( ota_ctx->sector_bufs );
+#endif
+#if OTA_PAL_RESUME
+        free( ota_ctx->resume_record );
+#endif
+#if OTA_PAL_STAGED
+        staged_free( ota_ctx->staged );
+#endif
+#if OTA_PAL_CHUNK_VERIFY
+        chunked_free( ota_ctx->chunked );
+#endif
+#if OTA_PAL_STREAM_VERIFY
+        if( ota_ctx->sig_verify_ctx != NULL )
+        {
+            ( void ) CRYPTO_SignatureVerificationFinal( ota_ctx->sig_verify_ctx, NULL, 0, NULL, 0 );
+        }
+#endif
         memset( ota_ctx, 0, sizeof( esp_ota_context_t ) );
     }
 }
@@ -169,8 +1888,38 @@ static void _esp_ota_ctx_close( OtaFileContext_t * pFileContext )
         pFileContext->pFile = 0;
     }
 
+#if OTA_PAL_PIPELINE
+    ( void ) pipeline_stop();
+#endif
+#if OTA_PAL_BACKGROUND_ERASE
+    ( void ) erase_finish( true );
+#endif
+
+#if ENERGY_METER_ENABLED
+    if( ota_ctx.cur_ota != NULL )
+    {
+        ( void ) EnergyMeter_End( &ota_ctx.energy, ota_ctx.data_write_len );
+    }
+#endif
+
     /*memset(&ota_ctx, 0, sizeof(esp_ota_context_t)); */
     ota_ctx.cur_ota = 0;
+
+#if OTA_PAL_COALESCE_WRITES
+    coalesce_stop();
+#endif
+#if OTA_PAL_STREAM_VERIFY
+    stream_verify_stop();
+#endif
+#if OTA_PAL_RESUME
+    resume_stop();
+#endif
+#if OTA_PAL_STAGED
+    staged_stop();
+#endif
+#if OTA_PAL_CHUNK_VERIFY
+    chunked_stop();
+#endif
 }
 
 /* Abort receiving the specified OTA update by closing the file. */
@@ -211,22 +1960,154 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pFileContext )
                update_partition->subtype, update_partition->address ) );
 
     esp_ota_handle_t update_handle;
-    esp_err_t err = esp_ota_begin( update_partition, OTA_SIZE_UNKNOWN, &update_handle );
+    uint32_t erased_len = 0;
+#if OTA_PAL_BACKGROUND_ERASE
+    /* Nothing is erased here, the erase task started below clears the sectors ahead of the writes. */
+    size_t image_size = OTA_WITH_SEQUENTIAL_WRITES;
+#else
+    size_t image_size = OTA_SIZE_UNKNOWN;
+#endif
+#if OTA_PAL_RESUME
+    bool resumed = false;
+
+    #if OTA_PAL_STAGED
+        if( is_staged_file( pFileContext ) )
+        {
+            /* The decoder state isn't saved, so the file is downloaded again after a reset. */
+            resume_clear();
+            ota_ctx.resume_record = NULL;
+        }
+        else
+    #endif
+    #if OTA_PAL_CHUNK_VERIFY
+        if( is_chunked_file( pFileContext ) )
+        {
+            /* Neither is the manifest. */
+            resume_clear();
+            ota_ctx.resume_record = NULL;
+        }
+        else
+    #endif
+    if( resume_start( pFileContext, update_partition, &erased_len ) )
+    {
+        /* The partition still holds blocks of this file, so it must not be erased. */
+        resumed = true;
+        image_size = OTA_WITH_SEQUENTIAL_WRITES;
+    }
+#endif
+    esp_err_t err = esp_ota_begin( update_partition, image_size, &update_handle );
 
     if( err != ESP_OK )
     {
         LogError( ( "esp_ota_begin failed (%d)", err ) );
+#if OTA_PAL_RESUME
+        resume_stop();
+#endif
         return OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
     }
 
     ota_ctx.cur_ota = pFileContext;
     ota_ctx.update_partition = update_partition;
     ota_ctx.update_handle = update_handle;
+#if ENERGY_METER_ENABLED
+    ota_ctx.energy = EnergyMeter_Begin( EnergyOpOta );
+#endif
 
     pFileContext->pFile = ( uint8_t * ) &ota_ctx;
     ota_ctx.data_write_len = 0;
     ota_ctx.valid_image = false;
 
+    if( image_size == OTA_SIZE_UNKNOWN )
+    {
+        /* esp_ota_begin erased the whole partition. */
+        erased_len = update_partition->size;
+    }
+
+#if OTA_PAL_STAGED
+    if( is_staged_file( pFileContext ) )
+    {
+        OtaPalMainStatus_t mainErr = staged_start( pFileContext );
+
+        if( mainErr != OtaPalSuccess )
+        {
+            _esp_ota_ctx_close( pFileContext );
+            return OTA_PAL_COMBINE_ERR( mainErr, 0 );
+        }
+
+        if( erased_len < update_partition->size )
+        {
+            /* The file is stored from its first block on, so the end of the partition is erased now. */
+            err = ota_erase( update_partition, ota_ctx.staged->staging_offset,
+                             update_partition->size - ota_ctx.staged->staging_offset );
+
+            if( err != ESP_OK )
+            {
+                LogError( ( "Erase of the update partition failed (%d)", err ) );
+                _esp_ota_ctx_close( pFileContext );
+                return OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+            }
+        }
+    }
+#endif
+#if OTA_PAL_CHUNK_VERIFY
+    if( is_chunked_file( pFileContext ) )
+    {
+        OtaPalMainStatus_t mainErr = chunked_start( pFileContext );
+
+        if( mainErr != OtaPalSuccess )
+        {
+            _esp_ota_ctx_close( pFileContext );
+            return OTA_PAL_COMBINE_ERR( mainErr, 0 );
+        }
+    }
+#endif
+
+#if OTA_PAL_BACKGROUND_ERASE
+    ota_ctx.erase_running = false;
+
+    if( ( erased_len < ota_erase_end( pFileContext ) ) && !erase_start( pFileContext, erased_len ) )
+#else
+    if( erased_len < ota_erase_end( pFileContext ) )
+#endif
+    {
+        /* Erase what the file needs before the first block instead. */
+        LogWarn( ( "Erasing the update partition from the offset %u", erased_len ) );
+        err = ota_erase( update_partition, erased_len, ota_erase_end( pFileContext ) - erased_len );
+
+        if( err != ESP_OK )
+        {
+            LogError( ( "Erase of the update partition failed (%d)", err ) );
+            _esp_ota_ctx_close( pFileContext );
+            return OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+        }
+
+        erased_len = ota_erase_end( pFileContext );
+    }
+
+#if OTA_PAL_RESUME
+    ota_ctx.resume_erased_len = erased_len;
+
+    if( resumed )
+    {
+        resume_apply( pFileContext );
+    }
+#endif
+#if OTA_PAL_COALESCE_WRITES
+    coalesce_start();
+#endif
+#if OTA_PAL_STREAM_VERIFY
+    stream_verify_stop();
+
+    #if OTA_PAL_CHUNK_VERIFY
+        /* The image of a manifest file is checked block by block instead. */
+        if( ota_ctx.chunked == NULL )
+    #endif
+    stream_verify_start();
+#endif
+#if OTA_PAL_PIPELINE
+    pipeline_start();
+#endif
+
     LogInfo( ( "esp_ota_begin succeeded" ) );
 
     return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
@@ -394,38 +2275,142 @@ uint8_t * otaPal_ReadAndAssumeCertificate( const uint8_t * const pucCertName,
     return pucSignerCert;
 }
 
+#if OTA_PAL_SLICED_VERIFY
+
+void otaPal_SetVerifyProgressCallback( otaPal_VerifyProgress_t xCallback )
+{
+    verify_progress_cb = xCallback;
+}
+
+/* Hash a mapped part of the image in slices of VERIFY_SLICE_SIZE. Tasks of
+ * the agent's priority get the CPU between slices, and once the hashing has
+ * run for VERIFY_SLICE_TICKS it sleeps a tick so that lower priority tasks,
+ * the idle task among them, run as well. */
+static void verify_hash_sliced( void * pvSigVerifyContext,
+                                const uint8_t * buf,
+                                uint32_t len,
+                                uint32_t hashed,
+                                TickType_t * run_start )
+{
+    uint32_t total = ota_ctx.data_write_len;
+    uint32_t done = 0;
+    uint32_t slice;
+
+    while( done < len )
+    {
+        slice = MIN( len - done, ( uint32_t ) VERIFY_SLICE_SIZE );
+        CRYPTO_SignatureVerificationUpdate( pvSigVerifyContext, &buf[ done ], slice );
+        done += slice;
+
+        if( verify_progress_cb != NULL )
+        {
+            verify_progress_cb( hashed + done, total );
+        }
+
+        /* Log each time the hashed share crosses a multiple of VERIFY_LOG_PERCENT. */
+        if( ( ( uint64_t ) ( hashed + done ) * 100U / total / VERIFY_LOG_PERCENT ) !=
+            ( ( uint64_t ) ( hashed + done - slice ) * 100U / total / VERIFY_LOG_PERCENT ) )
+        {
+            LogInfo( ( "Signature check hashed %u of %u bytes", hashed + done, total ) );
+        }
+
+        if( ( xTaskGetTickCount() - *run_start ) >= VERIFY_SLICE_TICKS )
+        {
+            vTaskDelay( 1 );
+            *run_start = xTaskGetTickCount();
+        }
+        else
+        {
+            taskYIELD();
+        }
+    }
+}
+
+#endif /* if OTA_PAL_SLICED_VERIFY */
+
+/* Finish a signature verification against the signature of the file, with
+ * the key of the code signing certificate. */
+static BaseType_t signature_final( void * pvSigVerifyContext,
+                                   const OtaFileContext_t * pFileContext )
+{
+    BaseType_t verified;
+
+    if( codeSigningKeyValid )
+    {
+        verified = CRYPTO_SignatureVerificationFinalWithKey( pvSigVerifyContext, &codeSigningKey,
+                                                             pFileContext->pSignature->data, pFileContext->pSignature->size );
+    }
+    else if( codeSigningCertificatePEM != NULL )
+    {
+        verified = CRYPTO_SignatureVerificationFinal( pvSigVerifyContext, codeSigningCertificatePEM, strlen( codeSigningCertificatePEM ) + 1,
+                                                      pFileContext->pSignature->data, pFileContext->pSignature->size );
+    }
+    else
+    {
+        LogError( ( "Cert read failed" ) );
+        ( void ) CRYPTO_SignatureVerificationFinal( pvSigVerifyContext, NULL, 0, NULL, 0 );
+        verified = pdFALSE;
+    }
+
+    return verified;
+}
+
 /* Verify the signature of the specified file. */
 OtaPalStatus_t otaPal_CheckFileSignature( OtaFileContext_t * const pFileContext )
 {
+    TRACE_SPAN_SCOPE( "otaPal_CheckFileSignature" );
+
     OtaPalStatus_t result;
-    uint32_t ulSignerCertSize;
     void * pvSigVerifyContext;
-    uint8_t * pucSignerCert = 0;
     static spi_flash_mmap_handle_t ota_data_map;
     uint32_t mmu_free_pages_count, len, flash_offset = 0;
+#if OTA_PAL_SLICED_VERIFY
+    TickType_t run_start = xTaskGetTickCount();
+#endif
+
+#if OTA_PAL_CHUNK_VERIFY
+    if( ota_ctx.chunked != NULL )
+    {
+        /* The manifest was checked against the signature, and every block of the image against the manifest. */
+        if( ota_ctx.chunked->manifest_verified && ( ota_ctx.chunked->blocks_left == 0U ) )
+        {
+            LogInfo( ( "Image verified against its manifest, %u blocks requested again", ota_ctx.chunked->mismatches ) );
+            return OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
+        }
 
+        LogError( ( "Manifest %s, %u blocks of the image not verified",
+                    ota_ctx.chunked->manifest_verified ? "verified" : "not verified", ota_ctx.chunked->blocks_left ) );
+        return OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
+    }
+#endif
+#if OTA_PAL_STREAM_VERIFY
+    if( ota_ctx.sig_verify_ctx != NULL )
+    {
+        /* Only the part of the image not hashed while it was written has to be read back. */
+        pvSigVerifyContext = ota_ctx.sig_verify_ctx;
+        ota_ctx.sig_verify_ctx = NULL;
+        flash_offset = MIN( ota_ctx.hashed_len, ota_ctx.data_write_len );
+        LogInfo( ( "Hashed %u bytes of the image while writing", flash_offset ) );
+    }
+    else
+#endif
     /* Verify an ECDSA-SHA256 signature. */
-    if( CRYPTO_SignatureVerificationStart( &pvSigVerifyContext, cryptoASYMMETRIC_ALGORITHM_ECDSA,
-                                           cryptoHASH_ALGORITHM_SHA256 ) == pdFALSE )
+    if( CRYPTO_SignatureVerificationStartStatic( &pvSigVerifyContext, &sig_verify_buf, cryptoASYMMETRIC_ALGORITHM_ECDSA,
+                                                 cryptoHASH_ALGORITHM_SHA256 ) == pdFALSE )
     {
         LogError( ( "Signature verification start failed" ) );
         return OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
     }
 
-    pucSignerCert = (uint8_t *)codeSigningCertificatePEM;
-
-    if( pucSignerCert == NULL )
+    if( codeSigningCertificatePEM == NULL )
     {
         LogError( ( "Cert read failed" ) );
+        ( void ) CRYPTO_SignatureVerificationFinal( pvSigVerifyContext, NULL, 0, NULL, 0 );
         return OTA_PAL_COMBINE_ERR( OtaPalBadSignerCert, 0 );
     }
-    else
-    {
-        ulSignerCertSize = strlen(codeSigningCertificatePEM) + 1;
-    }
 
     mmu_free_pages_count = spi_flash_mmap_get_free_pages( SPI_FLASH_MMAP_DATA );
-    len = ota_ctx.data_write_len;
+    len = ota_ctx.data_write_len - flash_offset;
 
     while( len > 0 )
     {
@@ -443,17 +2428,21 @@ OtaPalStatus_t otaPal_CheckFileSignature( OtaFileContext_t * const pFileContext
         {
             LogError( ( "Partition mmap failed %d", ret ) );
             result = OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
+            ( void ) CRYPTO_SignatureVerificationFinal( pvSigVerifyContext, NULL, 0, NULL, 0 );
             goto end;
         }
 
+#if OTA_PAL_SLICED_VERIFY
+        verify_hash_sliced( pvSigVerifyContext, buf, partial_image_len, flash_offset, &run_start );
+#else
         CRYPTO_SignatureVerificationUpdate( pvSigVerifyContext, buf, partial_image_len );
+#endif
         spi_flash_munmap( ota_data_map );
         flash_offset += partial_image_len;
         len -= partial_image_len;
     }
 
-    if( CRYPTO_SignatureVerificationFinal( pvSigVerifyContext, ( char * ) pucSignerCert, ulSignerCertSize,
-                                           pFileContext->pSignature->data, pFileContext->pSignature->size ) == pdFALSE )
+    if( signature_final( pvSigVerifyContext, pFileContext ) == pdFALSE )
     {
         LogError( ( "Signature verification failed." ) );
         result = OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
@@ -490,14 +2479,44 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pFileContext )
         LogError( ( "No data written to partition" ) );
         mainErr = OtaPalSignatureCheckFailed;
     }
+#if OTA_PAL_PIPELINE
+    else if( pipeline_stop() != ESP_OK )
+    {
+        mainErr = OtaPalFileClose;
+    }
+#endif
+#if OTA_PAL_BACKGROUND_ERASE
+    else if( erase_finish( false ) != ESP_OK )
+    {
+        mainErr = OtaPalFileClose;
+    }
+#endif
+#if OTA_PAL_STAGED
+    else if( ( ota_ctx.staged != NULL ) && ( staged_finish( pFileContext ) != ESP_OK ) )
+    {
+        mainErr = OtaPalFileClose;
+    }
+#endif
+#if OTA_PAL_COALESCE_WRITES
+    else if( coalesce_flush_all( pFileContext ) != ESP_OK )
+    {
+        coalesce_stop();
+        mainErr = OtaPalFileClose;
+    }
+#endif
     else
     {
+#if OTA_PAL_COALESCE_WRITES
+        /* Every block is in flash now, so the buffers are no longer needed. */
+        coalesce_stop();
+#endif
+
         /* Verify the file signature, close the file and return the signature verification result. */
         mainErr = OTA_PAL_MAIN_ERR( otaPal_CheckFileSignature( pFileContext ) );
 
         if( mainErr != OtaPalSuccess )
         {
-            esp_partition_erase_range( ota_ctx.update_partition, 0, ota_ctx.update_partition->size );
+            ( void ) ota_erase( ota_ctx.update_partition, 0, ota_ctx.update_partition->size );
         }
         else
         {
@@ -508,6 +2527,15 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pFileContext )
             {
                 memset( sec_boot_sig->sec_ver, 0x00, sizeof( sec_boot_sig->sec_ver ) );
                 memset( sec_boot_sig->pad, 0xFF, sizeof( sec_boot_sig->pad ) );
+#if OTA_PAL_CHUNK_VERIFY
+                if( ota_ctx.chunked != NULL )
+                {
+                    /* The signature of the job is of the manifest, the one for the bootloader of the image. */
+                    memcpy( sec_boot_sig->raw_ecdsa_sig, ( ( const ota_chunk_manifest_header_t * ) ota_ctx.chunked->manifest )->boot_sig,
+                            sizeof( sec_boot_sig->raw_ecdsa_sig ) );
+                }
+                else
+#endif
                 mainErr = asn1_to_raw_ecdsa( pFileContext->pSignature->data, pFileContext->pSignature->size, sec_boot_sig->raw_ecdsa_sig );
 
                 if( mainErr == OtaPalSuccess )
@@ -532,6 +2560,15 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pFileContext )
         }
     }
 
+#if OTA_PAL_RESUME
+    /* The file has been either accepted or rejected, so there is nothing left to resume. */
+    resume_clear();
+    resume_stop();
+#endif
+#if OTA_PAL_CHUNK_VERIFY
+    chunked_stop();
+#endif
+
     return OTA_PAL_COMBINE_ERR( mainErr, 0 );
 }
 
@@ -554,16 +2591,19 @@ OtaPalStatus_t otaPal_ActivateNewImage( OtaFileContext_t * const pFileContext )
         if( esp_ota_end( ota_ctx.update_handle ) != ESP_OK )
         {
             LogError( ( "esp_ota_end failed!" ) );
-            esp_partition_erase_range( ota_ctx.update_partition, 0, ota_ctx.update_partition->size );
+            ( void ) ota_erase( ota_ctx.update_partition, 0, ota_ctx.update_partition->size );
             otaPal_ResetDevice( pFileContext );
         }
 
         esp_err_t err = esp_ota_set_boot_partition( ota_ctx.update_partition );
 
+        /* The new boot partition was selected by writing otadata. */
+        aws_esp_ota_invalidate_boot_flags();
+
         if( err != ESP_OK )
         {
             LogError( ( "esp_ota_set_boot_partition failed (%d)!", err ) );
-            esp_partition_erase_range( ota_ctx.update_partition, 0, ota_ctx.update_partition->size );
+            ( void ) ota_erase( ota_ctx.update_partition, 0, ota_ctx.update_partition->size );
             _esp_ota_ctx_clear( &ota_ctx );
         }
 
@@ -581,9 +2621,38 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pFileContext,
                            uint8_t * const pacData,
                            uint32_t iBlockSize )
 {
+    TRACE_SPAN_SCOPE( "otaPal_WriteBlock" );
+
     if( _esp_ota_ctx_validate( pFileContext ) )
     {
-        esp_err_t ret = esp_ota_write_with_offset( ota_ctx.update_handle, pacData, iBlockSize, iOffset );
+        uint32_t offset = iOffset;
+        uint32_t size = iBlockSize;
+        esp_err_t ret = ESP_OK;
+#if OTA_PAL_PIPELINE
+        const uint8_t * hash = NULL;
+#endif
+
+#if OTA_PAL_CHUNK_VERIFY
+        if( ota_ctx.chunked != NULL )
+        {
+            /* Only blocks of the image that match the manifest are written, at their offset in the image.
+             * With the ring of the pipeline, the flash writer task hashes them on the other core. */
+    #if OTA_PAL_PIPELINE
+            ret = chunked_check( &offset, pacData, &size, ( ota_ctx.pipeline_blocks != NULL ) ? &hash : NULL );
+    #else
+            ret = chunked_check( &offset, pacData, &size, NULL );
+    #endif
+        }
+
+        if( ( ret == ESP_OK ) && ( size > 0U ) )
+#endif
+        {
+#if OTA_PAL_PIPELINE
+            ret = pipeline_write( pFileContext, offset, pacData, size, hash );
+#else
+            ret = ota_write( pFileContext, offset, pacData, size );
+#endif
+        }
 
         if( ret != ESP_OK )
         {
@@ -591,7 +2660,25 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pFileContext,
             return -1;
         }
 
-        ota_ctx.data_write_len += iBlockSize;
+        ota_ctx.data_write_len += size;
+
+#if OTA_PAL_CHUNK_VERIFY && OTA_PAL_PIPELINE
+        if( ( ota_ctx.chunked != NULL ) && ( pFileContext->blocksRemaining <= 1U ) )
+        {
+            /* The agent closes the file once it counts this block, so a block still being
+             * hashed by the writer task that doesn't match has to be requested again now. */
+            if( pipeline_drain() != ESP_OK )
+            {
+                return -1;
+            }
+
+            if( ota_ctx.chunked->mismatches > CHUNK_MAX_MISMATCHES )
+            {
+                LogError( ( "%u blocks failed their check, giving up", ota_ctx.chunked->mismatches ) );
+                return -1;
+            }
+        }
+#endif
     }
     else
     {
@@ -602,6 +2689,22 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pFileContext,
     return iBlockSize;
 }
 
+#if OTA_PAL_FAST_COMMIT
+
+    static uint32_t fast_commit_marker_value( void )
+    {
+        const esp_partition_t * running = esp_ota_get_running_partition();
+
+        return FAST_COMMIT_MAGIC ^ ( ( running != NULL ) ? running->address : 0U );
+    }
+
+    static bool fast_commit_pending( void )
+    {
+        return fast_commit_marker == fast_commit_marker_value();
+    }
+
+#endif /* if OTA_PAL_FAST_COMMIT */
+
 OtaPalImageState_t otaPal_GetPlatformImageState( OtaFileContext_t * const pFileContext )
 {
     OtaPalImageState_t eImageState = OtaPalImageStateUnknown;
@@ -625,6 +2728,14 @@ OtaPalImageState_t otaPal_GetPlatformImageState( OtaFileContext_t * const pFileC
             LogError( ( "Failed to get ota flags %d", ret ) );
             return eImageState;
         }
+
+#if OTA_PAL_FAST_COMMIT
+        /* The agent rejects an image that is valid when the job says it is in self test. */
+        if( ( ota_flags == ESP_OTA_IMG_VALID ) && fast_commit_pending() )
+        {
+            ota_flags = ESP_OTA_IMG_PENDING_VERIFY;
+        }
+#endif
     }
 
     switch( ota_flags )
@@ -657,6 +2768,50 @@ static void disable_rtc_wdt()
     wdt_hal_write_protect_enable(&rtc_wdt_ctx);
 }
 
+#if OTA_PAL_FAST_COMMIT
+
+    esp_err_t otaPal_FastCommit( otaPal_HealthCheck_t healthCheck )
+    {
+        uint32_t ota_flags;
+        esp_err_t ret = aws_esp_ota_get_boot_flags( &ota_flags, true );
+
+        if( ret != ESP_OK )
+        {
+            LogError( ( "Failed to get ota flags %d", ret ) );
+        }
+        else if( ota_flags != ESP_OTA_IMG_PENDING_VERIFY )
+        {
+            LogInfo( ( "Image not in self test mode %d, nothing to commit", ota_flags ) );
+            ret = ESP_ERR_INVALID_STATE;
+        }
+        else if( ( healthCheck == NULL ) || !healthCheck() )
+        {
+            LogWarn( ( "Health check failed, image left in self test" ) );
+            ret = ESP_FAIL;
+        }
+        else
+        {
+            /* Set the marker first, so a reset after the commit still reports the self test. */
+            fast_commit_marker = fast_commit_marker_value();
+            ret = aws_esp_ota_set_boot_flags( ESP_OTA_IMG_VALID, true );
+
+            if( ret != ESP_OK )
+            {
+                LogError( ( "Failed to set ota flags %d", ret ) );
+                fast_commit_marker = 0;
+            }
+            else
+            {
+                LogInfo( ( "Health check passed, image committed ahead of the job status" ) );
+                disable_rtc_wdt();
+            }
+        }
+
+        return ret;
+    }
+
+#endif /* if OTA_PAL_FAST_COMMIT */
+
 OtaPalStatus_t otaPal_SetPlatformImageState( OtaFileContext_t * const pFileContext,
                                              OtaImageState_t eState )
 {
@@ -722,6 +2877,25 @@ OtaPalStatus_t otaPal_SetPlatformImageState( OtaFileContext_t * const pFileConte
                 disable_rtc_wdt();
             }
         }
+#if OTA_PAL_FAST_COMMIT
+        else if( ( ota_flags == ESP_OTA_IMG_VALID ) && fast_commit_pending() )
+        {
+            /* Committed by otaPal_FastCommit, only a rejected image needs its flags written.
+             * The bootloader then starts the previous image after the next reset. */
+            fast_commit_marker = 0;
+
+            if( state != ESP_OTA_IMG_VALID )
+            {
+                ret = aws_esp_ota_set_boot_flags( state, true );
+
+                if( ret != ESP_OK )
+                {
+                    LogError( ( "Failed to set ota flags %d", ret ) );
+                    return OTA_PAL_COMBINE_ERR( OtaPalCommitFailed, 0 );
+                }
+            }
+        }
+#endif
         else
         {
             LogWarn( ( "Image not in self test mode %d", ota_flags ) );
@@ -772,7 +2946,10 @@ esp_err_t otaPal_EraseLastBootPartition(void)
 {
     const esp_partition_t *cur_app = get_running_firmware();
     ESP_LOGI(TAG, "Current running firmware is: %s",cur_app->label);
-    return(esp_ota_erase_last_boot_app_partition());
+    esp_err_t ret = esp_ota_erase_last_boot_app_partition();
+    /* Erasing the partition also erases its otadata entry. */
+    aws_esp_ota_invalidate_boot_flags();
+    return ret;
 }
 
 bool otaPal_SetCodeSigningCertificate(const char * pcCodeSigningCertificatePEM)
@@ -795,5 +2972,22 @@ bool otaPal_SetCodeSigningCertificate(const char * pcCodeSigningCertificatePEM)
         strcpy(codeSigningCertificatePEM, pcCodeSigningCertificatePEM);
     }
 
+    if(codeSigningKeyValid)
+    {
+        mbedtls_pk_free(&codeSigningKey);
+        codeSigningKeyValid = false;
+    }
+
+    /* Without the parsed key the certificate is parsed again for each verification. */
+    if(xRet && CRYPTO_ParseSignerCertificate(&codeSigningKey, codeSigningCertificatePEM,
+                                             strlen(codeSigningCertificatePEM) + 1) == pdTRUE)
+    {
+        codeSigningKeyValid = true;
+    }
+    else if(xRet)
+    {
+        ESP_LOGW(TAG, "Failed to parse the code signing certificate");
+    }
+
     return xRet;
 }
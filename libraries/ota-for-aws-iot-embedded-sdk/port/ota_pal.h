@@ -33,6 +33,7 @@
 
 #include "ota.h"
 #include "esp_err.h"
+#include "sdkconfig.h"
 
 /**
  * @brief Abort an OTA transfer.
@@ -228,4 +229,65 @@ esp_err_t otaPal_EraseLastBootPartition(void);
  */
 bool otaPal_SetCodeSigningCertificate(const char * pcCodeSigningCertificatePEM);
 
+#if CONFIG_OTA_PAL_FAST_COMMIT
+
+/**
+ * @brief Application check that the new image works, run before it is committed.
+ *
+ * @return true if the image can be committed.
+ */
+typedef bool ( * otaPal_HealthCheck_t )( void );
+
+/**
+ * @brief Commit an image in self test as soon as healthCheck passes.
+ *
+ * Call before OTA_Init. The image is marked valid and the RTC watchdog is
+ * stopped, but the OTA agent still sees it in self test until the job status
+ * is set, so the job is reported as usual. An image rejected by the job is
+ * rolled back on the next reset.
+ *
+ * @return
+ *        - ESP_OK:                 The image is committed.
+ *        - ESP_ERR_INVALID_STATE:  The running image is not in self test.
+ *        - ESP_FAIL:               The health check failed, the image is left in self test.
+ *        - Otherwise the error writing the boot flags.
+ */
+esp_err_t otaPal_FastCommit( otaPal_HealthCheck_t healthCheck );
+
+#endif /* if CONFIG_OTA_PAL_FAST_COMMIT */
+
+#if CONFIG_OTA_PAL_SLICED_VERIFY
+
+/**
+ * @brief Called as the image is hashed for its signature check.
+ *
+ * @param[in] ulHashed Bytes of the image hashed so far, including those
+ * hashed while it was written.
+ * @param[in] ulTotal Bytes of the image.
+ */
+typedef void ( * otaPal_VerifyProgress_t )( uint32_t ulHashed,
+                                            uint32_t ulTotal );
+
+/**
+ * @brief Set the function called after every slice hashed by
+ * otaPal_CheckFileSignature, from the OTA agent task. NULL stops the calls.
+ */
+void otaPal_SetVerifyProgressCallback( otaPal_VerifyProgress_t xCallback );
+
+#endif /* if CONFIG_OTA_PAL_SLICED_VERIFY */
+
+#if CONFIG_OTA_PAL_CHUNK_VERIFY
+
+/**
+ * @brief Mark the blocks of a manifest file rejected by otaPal_WriteBlock as
+ * missing again in the bitmap of the OTA agent, so that they are requested.
+ *
+ * The agent clears the bit of a block once otaPal_WriteBlock returns, so a
+ * block that fails its check can only be put back afterwards. The OTA OS port
+ * calls this from the agent task before handing it each event.
+ */
+void otaPal_RequeueRejectedBlocks( void );
+
+#endif /* if CONFIG_OTA_PAL_CHUNK_VERIFY */
+
 #endif /* ifndef OTA_PAL_H_ */
\ No newline at end of file
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_request_window.c
+ * @brief Adapts the number of blocks asked for in each OTA stream request.
+ *
+ * A request and the blocks it asks for make a round. The window doubles after
+ * each complete round until the first loss, a request re-sent before its
+ * round completed, which halves it. From then on it grows by one block per
+ * complete round. A round whose first block took more than twice the lowest
+ * time seen doesn't grow the window, as blocks are then queueing on the way.
+ */
+
+#include <stdbool.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "ota_request_window.h"
+
+#define WINDOW_MIN        CONFIG_OTA_BLOCK_WINDOW_MIN
+#define WINDOW_MAX        MAX( CONFIG_OTA_BLOCK_WINDOW_MAX, WINDOW_MIN )
+#define WINDOW_INITIAL    MIN( MAX( CONFIG_MAX_NUM_BLOCKS_REQUEST, WINDOW_MIN ), WINDOW_MAX )
+
+/* Weight of a new sample in the smoothed round trip time, as a shift. */
+#define SRTT_SHIFT        3U
+
+static portMUX_TYPE windowLock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t window = WINDOW_INITIAL;
+static bool slowStart = true;
+
+static bool roundOpen;
+static uint32_t roundRequested;
+static uint32_t roundReceived;
+static int64_t roundSentUs;
+static uint32_t roundRttMs;
+
+static uint32_t srttMs;
+static uint32_t minRttMs = UINT32_MAX;
+static uint32_t rounds;
+static uint32_t losses;
+
+uint32_t OtaRequestWindow_Get( void )
+{
+    return __atomic_load_n( &window, __ATOMIC_RELAXED );
+}
+
+void OtaRequestWindow_RequestSent( void )
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL( &windowLock );
+
+    if( roundOpen && ( roundReceived < roundRequested ) )
+    {
+        slowStart = false;
+        losses++;
+        __atomic_store_n( &window, MAX( window / 2U, ( uint32_t ) WINDOW_MIN ), __ATOMIC_RELAXED );
+    }
+
+    roundOpen = true;
+    roundRequested = window;
+    roundReceived = 0;
+    roundSentUs = now;
+
+    taskEXIT_CRITICAL( &windowLock );
+}
+
+/* Time the first block of the round took to arrive. Called with the lock held. */
+static void roundRtt( int64_t now )
+{
+    roundRttMs = ( uint32_t ) ( ( now - roundSentUs ) / 1000 );
+    minRttMs = MIN( minRttMs, roundRttMs );
+    srttMs = ( srttMs == 0U ) ? roundRttMs : srttMs - ( srttMs >> SRTT_SHIFT ) + ( roundRttMs >> SRTT_SHIFT );
+}
+
+void OtaRequestWindow_BlockReceived( void )
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t next;
+
+    taskENTER_CRITICAL( &windowLock );
+
+    if( roundOpen )
+    {
+        if( roundReceived++ == 0 )
+        {
+            roundRtt( now );
+        }
+
+        if( roundReceived == roundRequested )
+        {
+            roundOpen = false;
+            rounds++;
+
+            if( roundRttMs <= 2U * minRttMs )
+            {
+                next = slowStart ? window * 2U : window + 1U;
+                __atomic_store_n( &window, MIN( next, ( uint32_t ) WINDOW_MAX ), __ATOMIC_RELAXED );
+            }
+        }
+    }
+
+    taskEXIT_CRITICAL( &windowLock );
+}
+
+void OtaRequestWindow_GetStats( OtaRequestWindowStats_t * pStats )
+{
+    taskENTER_CRITICAL( &windowLock );
+
+    pStats->window = window;
+    pStats->srttMs = srttMs;
+    pStats->minRttMs = ( minRttMs == UINT32_MAX ) ? 0U : minRttMs;
+    pStats->rounds = rounds;
+    pStats->losses = losses;
+
+    taskEXIT_CRITICAL( &windowLock );
+}
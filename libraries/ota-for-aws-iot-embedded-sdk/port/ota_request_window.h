@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_request_window.h
+ * @brief Number of blocks asked for in each OTA stream request, adapted to
+ * the time blocks take to arrive and to requests re-sent with blocks missing.
+ *
+ * The transport calls OtaRequestWindow_RequestSent() as it publishes a block
+ * request and OtaRequestWindow_BlockReceived() for each block that arrives.
+ * The OTA agent reads the window through otaconfigMAX_NUM_BLOCKS_REQUEST.
+ */
+
+#ifndef OTA_REQUEST_WINDOW_H_
+#define OTA_REQUEST_WINDOW_H_
+
+#include <stdint.h>
+
+typedef struct OtaRequestWindowStats
+{
+    uint32_t window;   /* Blocks asked for in the next request. */
+    uint32_t srttMs;   /* Smoothed time from a request to its first block. */
+    uint32_t minRttMs; /* Lowest time from a request to its first block. */
+    uint32_t rounds;   /* Requests whose blocks all arrived. */
+    uint32_t losses;   /* Requests re-sent before all their blocks arrived. */
+} OtaRequestWindowStats_t;
+
+/**
+ * @brief Number of blocks to ask for in the next request.
+ */
+uint32_t OtaRequestWindow_Get( void );
+
+/**
+ * @brief Record a block request being sent.
+ *
+ * A request sent before all blocks of the previous one arrived means those
+ * blocks were lost, and shrinks the window.
+ */
+void OtaRequestWindow_RequestSent( void );
+
+/**
+ * @brief Record a block of the stream arriving.
+ *
+ * The last block of a request grows the window, unless blocks take much
+ * longer to arrive than they did at best.
+ */
+void OtaRequestWindow_BlockReceived( void );
+
+/**
+ * @brief Copy out the current window and what it was adapted from.
+ */
+void OtaRequestWindow_GetStats( OtaRequestWindowStats_t * pStats );
+
+#endif /* OTA_REQUEST_WINDOW_H_ */
@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+#
+# Builds an OTA file for OTA_PAL_CHUNK_VERIFY: a manifest of the SHA-256 of
+# every block of a firmware image, followed by the image. The manifest is also
+# written on its own, to be signed with the code signing key, for example with
+# `openssl dgst -sha256 -sign key.pem manifest.bin | base64`, and the OTA file
+# uploaded as a custom signed file with that signature.
+#
+# The manifest starts with this header, little-endian, then holds the hashes
+# and is padded with 0xFF to a whole number of blocks:
+#
+#   uint32 magic          "OCM1"
+#   uint32 image_size
+#   uint32 block_size     the block size of the OTA agent on the device
+#   uint32 manifest_size
+#   uint8  boot_sig[64]   raw ECDSA signature of the image, written after it
+#                         for the bootloader
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = 0x314D434F
+HEADER = struct.Struct('<IIII64s')
+HASH_SIZE = 32
+
+
+def der_to_raw_ecdsa(der):
+    # SEQUENCE { INTEGER r, INTEGER s } with short lengths, as for P-256.
+    if len(der) < 8 or der[0] != 0x30 or der[1] != len(der) - 2:
+        raise ValueError('not a DER encoded ECDSA signature')
+
+    raw = b''
+    pos = 2
+
+    for _ in range(2):
+        if der[pos] != 0x02:
+            raise ValueError('not a DER encoded ECDSA signature')
+
+        length = der[pos + 1]
+        integer = der[pos + 2:pos + 2 + length].lstrip(b'\x00')
+
+        if len(integer) > 32:
+            raise ValueError('signature integer longer than 32 bytes')
+
+        raw += integer.rjust(32, b'\x00')
+        pos += 2 + length
+
+    return raw
+
+
+def build_manifest(image, block_size, boot_sig):
+    hashes = b''.join(hashlib.sha256(image[offset:offset + block_size]).digest()
+                      for offset in range(0, len(image), block_size))
+    manifest_size = HEADER.size + len(hashes)
+    manifest_size = (manifest_size + block_size - 1) // block_size * block_size
+    header = HEADER.pack(MAGIC, len(image), block_size, manifest_size, boot_sig)
+
+    return (header + hashes).ljust(manifest_size, b'\xff')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build an OTA file verified block by block against a manifest.')
+    parser.add_argument('image', help='firmware image')
+    parser.add_argument('output', help='OTA file to write')
+    parser.add_argument('manifest', help='manifest to write, to be signed')
+    parser.add_argument('--block-size', type=int, default=4096,
+                        help='OTA block size, 2 to the power of LOG2_FILE_BLOCK_SIZE (default 4096)')
+    parser.add_argument('--boot-sig', metavar='DER',
+                        help='DER ECDSA signature of the image, for the bootloader')
+    args = parser.parse_args()
+
+    if args.block_size <= 0 or args.block_size & (args.block_size - 1):
+        sys.exit('block size must be a power of two')
+
+    with open(args.image, 'rb') as image_file:
+        image = image_file.read()
+
+    if not image:
+        sys.exit('{} is empty'.format(args.image))
+
+    boot_sig = bytes(64)
+
+    if args.boot_sig:
+        with open(args.boot_sig, 'rb') as sig_file:
+            try:
+                boot_sig = der_to_raw_ecdsa(bytearray(sig_file.read()))
+            except (ValueError, IndexError) as error:
+                sys.exit('{}: {}'.format(args.boot_sig, error))
+
+    manifest = build_manifest(image, args.block_size, boot_sig)
+
+    with open(args.manifest, 'wb') as manifest_file:
+        manifest_file.write(manifest)
+
+    with open(args.output, 'wb') as output_file:
+        output_file.write(manifest + image)
+
+    print('{} blocks, manifest of {} bytes'.format(
+        (len(image) + args.block_size - 1) // args.block_size, len(manifest)))
+
+
+if __name__ == '__main__':
+    main()
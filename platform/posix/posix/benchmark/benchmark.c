@@ -0,0 +1,258 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file benchmark.c
+ * @brief Implementation of the benchmark harness.
+ */
+
+/* Standard includes. */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <limits.h>
+#include <unistd.h>
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Most operations per timed call, so that the count fits in 32 bits
+ * with room to double.
+ */
+#define MAX_ITERATIONS    ( 1U << 30 )
+
+/**
+ * @brief Most timed calls of a benchmark.
+ */
+#define MAX_SAMPLES       101U
+
+/**
+ * @brief The working directory before #Benchmark_EnterTempDir.
+ */
+static char previousDirectory[ PATH_MAX ];
+
+/*-----------------------------------------------------------*/
+
+static int compareDoubles( const void * pLeft,
+                           const void * pRight )
+{
+    double left = *( const double * ) pLeft;
+    double right = *( const double * ) pRight;
+
+    return ( left > right ) - ( left < right );
+}
+/*-----------------------------------------------------------*/
+
+static int timeCall( const Benchmark_t * pBenchmark,
+                     uint32_t iterations,
+                     uint64_t * pElapsedNs )
+{
+    uint64_t startNs = Benchmark_NowNs();
+    int status = pBenchmark->run( iterations );
+
+    *pElapsedNs = Benchmark_NowNs() - startNs;
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+uint64_t Benchmark_NowNs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000000U ) + ( uint64_t ) now.tv_nsec;
+}
+/*-----------------------------------------------------------*/
+
+int Benchmark_EnterTempDir( char * pDirectory )
+{
+    int status = -1;
+
+    if( ( getcwd( previousDirectory, sizeof( previousDirectory ) ) != NULL ) &&
+        ( mkdtemp( pDirectory ) != NULL ) )
+    {
+        if( chdir( pDirectory ) == 0 )
+        {
+            status = 0;
+        }
+        else
+        {
+            ( void ) rmdir( pDirectory );
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+void Benchmark_LeaveTempDir( const char * pDirectory )
+{
+    if( chdir( previousDirectory ) == 0 )
+    {
+        ( void ) rmdir( pDirectory );
+    }
+}
+/*-----------------------------------------------------------*/
+
+int Benchmark_Run( const Benchmark_t * pBenchmark,
+                   uint32_t samples,
+                   BenchmarkResult_t * pResult )
+{
+    double perOpNs[ MAX_SAMPLES ];
+    uint64_t elapsedNs = 0U;
+    uint32_t iterations = 1U;
+    uint32_t i;
+    int status = 0;
+
+    ( void ) memset( pResult, 0, sizeof( BenchmarkResult_t ) );
+    pResult->pBenchmark = pBenchmark;
+
+    if( samples > MAX_SAMPLES )
+    {
+        samples = MAX_SAMPLES;
+    }
+    else if( samples == 0U )
+    {
+        samples = 1U;
+    }
+
+    if( pBenchmark->setup != NULL )
+    {
+        status = pBenchmark->setup();
+    }
+
+    /* Find how many operations last a sample. The calls made on the way warm
+     * up the code and data of the operation. */
+    while( status == 0 )
+    {
+        status = timeCall( pBenchmark, iterations, &elapsedNs );
+
+        if( ( elapsedNs >= BENCHMARK_MIN_SAMPLE_NS ) || ( iterations >= MAX_ITERATIONS ) )
+        {
+            break;
+        }
+
+        /* Aim a little past the minimum from the last call, rather than only
+         * doubling, to get there in few calls. */
+        if( elapsedNs > ( BENCHMARK_MIN_SAMPLE_NS / 64U ) )
+        {
+            iterations = ( uint32_t ) ( ( ( uint64_t ) iterations * BENCHMARK_MIN_SAMPLE_NS * 5U ) / ( elapsedNs * 4U ) ) + 1U;
+        }
+        else
+        {
+            iterations *= 2U;
+        }
+
+        if( iterations > MAX_ITERATIONS )
+        {
+            iterations = MAX_ITERATIONS;
+        }
+    }
+
+    for( i = 0U; ( i < samples ) && ( status == 0 ); i++ )
+    {
+        status = timeCall( pBenchmark, iterations, &elapsedNs );
+        perOpNs[ i ] = ( double ) elapsedNs / ( double ) iterations;
+    }
+
+    if( pBenchmark->teardown != NULL )
+    {
+        pBenchmark->teardown();
+    }
+
+    if( status == 0 )
+    {
+        qsort( perOpNs, samples, sizeof( double ), compareDoubles );
+
+        pResult->iterations = iterations;
+        pResult->samples = samples;
+        pResult->medianNs = perOpNs[ samples / 2U ];
+        pResult->minNs = perOpNs[ 0 ];
+        pResult->maxNs = perOpNs[ samples - 1U ];
+    }
+
+    return ( status == 0 ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+void Benchmark_PrintHeader( void )
+{
+    printf( "%-40s %10s %12s %12s %12s %10s\n",
+            "benchmark", "ops/call", "median ns", "min ns", "max ns", "MB/s" );
+}
+/*-----------------------------------------------------------*/
+
+void Benchmark_Print( const BenchmarkResult_t * pResult )
+{
+    const Benchmark_t * pBenchmark = pResult->pBenchmark;
+
+    printf( "%-40s %10u %12.1f %12.1f %12.1f ",
+            pBenchmark->pName,
+            pResult->iterations,
+            pResult->medianNs,
+            pResult->minNs,
+            pResult->maxNs );
+
+    if( pBenchmark->bytesPerOp > 0U )
+    {
+        printf( "%10.1f\n", ( ( double ) pBenchmark->bytesPerOp * 1000.0 ) /
+                ( pResult->medianNs * 1.048576 ) );
+    }
+    else
+    {
+        printf( "%10s\n", "-" );
+    }
+}
+/*-----------------------------------------------------------*/
+
+void Benchmark_WriteJson( FILE * pFile,
+                          const BenchmarkResult_t * pResults,
+                          size_t count )
+{
+    size_t i;
+
+    fprintf( pFile, "{\n  \"benchmarks\": [" );
+
+    for( i = 0U; i < count; i++ )
+    {
+        fprintf( pFile,
+                 "%s\n    { \"name\": \"%s\", \"bytes_per_op\": %zu, \"iterations\": %u, "
+                 "\"samples\": %u, \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f }",
+                 ( i == 0U ) ? "" : ",",
+                 pResults[ i ].pBenchmark->pName,
+                 pResults[ i ].pBenchmark->bytesPerOp,
+                 pResults[ i ].iterations,
+                 pResults[ i ].samples,
+                 pResults[ i ].medianNs,
+                 pResults[ i ].minNs,
+                 pResults[ i ].maxNs );
+    }
+
+    fprintf( pFile, "\n  ]\n}\n" );
+}
+/*-----------------------------------------------------------*/
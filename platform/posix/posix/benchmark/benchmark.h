@@ -0,0 +1,169 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file benchmark.h
+ * @brief Harness of the micro-benchmark suite of the POSIX build.
+ *
+ * A benchmark runs its operation a given number of times per call. The
+ * harness grows that number until one call lasts #BENCHMARK_MIN_SAMPLE_NS,
+ * which also warms the caches and the branch predictors, then times a number
+ * of such calls and reports the median time per operation, which is what runs
+ * are compared on.
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Shortest duration of one timed call of a benchmark.
+ */
+#define BENCHMARK_MIN_SAMPLE_NS    ( 20U * 1000U * 1000U )
+
+/**
+ * @brief Timed calls of every benchmark when none is given on the command
+ * line.
+ */
+#define BENCHMARK_DEFAULT_SAMPLES  9U
+
+/**
+ * @brief A benchmarked operation.
+ */
+typedef struct Benchmark
+{
+    const char * pName;                   /**< @brief "<area>/<case>", unique in the suite. */
+    size_t bytesPerOp;                    /**< @brief Bytes one operation processes, or 0 to not report a throughput. */
+    int ( * setup )( void );              /**< @brief Prepares the state of #run, or NULL. Returns 0 on success. */
+    int ( * run )( uint32_t iterations ); /**< @brief Runs the operation @a iterations times. Returns 0 if all of them gave the expected result. */
+    void ( * teardown )( void );          /**< @brief Releases what #setup took, or NULL. */
+} Benchmark_t;
+
+/**
+ * @brief Timings of one benchmark.
+ */
+typedef struct BenchmarkResult
+{
+    const Benchmark_t * pBenchmark; /**< @brief The benchmark timed. */
+    uint32_t iterations;            /**< @brief Operations per timed call. */
+    uint32_t samples;               /**< @brief Timed calls. */
+    double medianNs;                /**< @brief Median time per operation. */
+    double minNs;                   /**< @brief Fastest time per operation. */
+    double maxNs;                   /**< @brief Slowest time per operation. */
+} BenchmarkResult_t;
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return The time in nanoseconds.
+ */
+uint64_t Benchmark_NowNs( void );
+
+/**
+ * @brief Creates a temporary directory and makes it the working directory,
+ * for the PALs that keep their files there.
+ *
+ * @param[in,out] pDirectory A mkdtemp template, replaced by the directory.
+ *
+ * @return 0 on success; -1 otherwise.
+ */
+int Benchmark_EnterTempDir( char * pDirectory );
+
+/**
+ * @brief Restores the working directory #Benchmark_EnterTempDir left and
+ * removes the temporary directory, which must be empty by then.
+ *
+ * @param[in] pDirectory The temporary directory.
+ */
+void Benchmark_LeaveTempDir( const char * pDirectory );
+
+/**
+ * @brief Sets up, times and tears down a benchmark.
+ *
+ * @param[in] pBenchmark The benchmark.
+ * @param[in] samples The number of timed calls.
+ * @param[out] pResult The timings.
+ *
+ * @return 0 on success; -1 if the setup failed or an operation gave a wrong
+ * result, which fails the suite rather than reporting a meaningless time.
+ */
+int Benchmark_Run( const Benchmark_t * pBenchmark,
+                   uint32_t samples,
+                   BenchmarkResult_t * pResult );
+
+/**
+ * @brief Prints the header of the table #Benchmark_Print adds rows to.
+ */
+void Benchmark_PrintHeader( void );
+
+/**
+ * @brief Prints the timings of a benchmark as a row of the table.
+ *
+ * @param[in] pResult The timings.
+ */
+void Benchmark_Print( const BenchmarkResult_t * pResult );
+
+/**
+ * @brief Writes the timings of the suite as JSON, for
+ * compare_benchmarks.py.
+ *
+ * @param[in] pFile The file to write to.
+ * @param[in] pResults The timings.
+ * @param[in] count The number of @a pResults.
+ */
+void Benchmark_WriteJson( FILE * pFile,
+                          const BenchmarkResult_t * pResults,
+                          size_t count );
+
+/*
+ * The benchmarks of the suite, one group per file.
+ */
+extern const Benchmark_t topicMatchTrieBenchmark;
+extern const Benchmark_t topicMatchLinearBenchmark;
+extern const Benchmark_t provisioningCsrRequestBenchmark;
+extern const Benchmark_t provisioningKeyCertResponseBenchmark;
+extern const Benchmark_t provisioningJsonCsrRequestBenchmark;
+extern const Benchmark_t provisioningJsonKeyCertResponseBenchmark;
+extern const Benchmark_t jsonSearchShadowBenchmark;
+extern const Benchmark_t jsonSearchJobBenchmark;
+extern const Benchmark_t jsonIndexJobBenchmark;
+extern const Benchmark_t otaPalWriteBenchmark;
+extern const Benchmark_t otaPalReceiveBenchmark;
+extern const Benchmark_t pkcs11PalReadBenchmark;
+extern const Benchmark_t pkcs11PalFindBenchmark;
+extern const Benchmark_t transportSendBenchmark;
+extern const Benchmark_t transportRecvBenchmark;
+extern const Benchmark_t mqttReplayBenchmark;
+
+/**
+ * @brief Sets the capture #mqttReplayBenchmark replays; it is skipped without
+ * one.
+ *
+ * @param[in] pPath The capture file.
+ */
+void MqttReplayBenchmark_SetCapture( const char * pPath );
+
+#endif /* ifndef BENCHMARK_H_ */
@@ -0,0 +1,190 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file benchmark_main.c
+ * @brief Micro-benchmarks of the hot paths of the shared libraries, built for
+ * POSIX: topic matching in the subscription manager, the CBOR and JSON
+ * payloads of fleet provisioning, coreJSON searches, the OTA PAL write and
+ * verify paths, PKCS #11 PAL object reads, and transport sends and receives
+ * over the loopback interface, and the replay through coreMQTT of a session
+ * captured on a device, given with -r.
+ *
+ * Every benchmark checks the results of its operations, so a change that
+ * breaks one fails the suite instead of making it faster. The JSON written
+ * with -j is compared with a baseline by compare_benchmarks.py, which fails
+ * when a median got slower than the threshold allows.
+ *
+ * Run on an idle machine with a fixed CPU frequency for comparable numbers;
+ * a single run on a shared CI runner varies by several percent.
+ *
+ * Usage: posix_benchmarks [-f <name filter>] [-n <samples>] [-j <JSON file>] [-l]
+ *        [-r <capture>]
+ *
+ * -f runs the benchmarks whose name contains the filter, and -l lists the
+ * benchmarks instead of running them.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <unistd.h>
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The benchmarks of the suite, in the order they are run.
+ */
+static const Benchmark_t * const benchmarks[] =
+{
+    &topicMatchTrieBenchmark,
+    &topicMatchLinearBenchmark,
+    &provisioningCsrRequestBenchmark,
+    &provisioningKeyCertResponseBenchmark,
+    &provisioningJsonCsrRequestBenchmark,
+    &provisioningJsonKeyCertResponseBenchmark,
+    &jsonSearchShadowBenchmark,
+    &jsonSearchJobBenchmark,
+    &jsonIndexJobBenchmark,
+    &otaPalWriteBenchmark,
+    &otaPalReceiveBenchmark,
+    &pkcs11PalReadBenchmark,
+    &pkcs11PalFindBenchmark,
+    &transportSendBenchmark,
+    &transportRecvBenchmark,
+    &mqttReplayBenchmark
+};
+
+/**
+ * @brief The number of #benchmarks.
+ */
+#define BENCHMARK_COUNT    ( sizeof( benchmarks ) / sizeof( benchmarks[ 0 ] ) )
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    BenchmarkResult_t results[ BENCHMARK_COUNT ];
+    const char * pFilter = NULL;
+    const char * pJsonPath = NULL;
+    uint32_t samples = BENCHMARK_DEFAULT_SAMPLES;
+    size_t resultCount = 0U;
+    size_t i;
+    const char * pCapturePath = NULL;
+    bool list = false;
+    FILE * pJsonFile = NULL;
+    int option = 0;
+    int status = EXIT_SUCCESS;
+
+    while( ( option = getopt( argc, argv, "f:n:j:lr:" ) ) != -1 )
+    {
+        switch( option )
+        {
+            case 'f':
+                pFilter = optarg;
+                break;
+
+            case 'n':
+                samples = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'j':
+                pJsonPath = optarg;
+                break;
+
+            case 'l':
+                list = true;
+                break;
+
+            case 'r':
+                pCapturePath = optarg;
+                break;
+
+            default:
+                fprintf( stderr, "Usage: %s [-f <name filter>] [-n <samples>] [-j <JSON file>] [-l] [-r <capture>]\n", argv[ 0 ] );
+
+                return EXIT_FAILURE;
+        }
+    }
+
+    MqttReplayBenchmark_SetCapture( pCapturePath );
+
+    if( list == false )
+    {
+        Benchmark_PrintHeader();
+    }
+
+    for( i = 0U; i < BENCHMARK_COUNT; i++ )
+    {
+        if( ( pFilter != NULL ) && ( strstr( benchmarks[ i ]->pName, pFilter ) == NULL ) )
+        {
+            continue;
+        }
+
+        /* There is nothing to replay without a capture. */
+        if( ( benchmarks[ i ] == &mqttReplayBenchmark ) && ( pCapturePath == NULL ) && ( list == false ) )
+        {
+            continue;
+        }
+
+        if( list == true )
+        {
+            printf( "%s\n", benchmarks[ i ]->pName );
+        }
+        else if( Benchmark_Run( benchmarks[ i ], samples, &results[ resultCount ] ) == 0 )
+        {
+            Benchmark_Print( &results[ resultCount ] );
+            resultCount++;
+        }
+        else
+        {
+            fprintf( stderr, "Benchmark %s failed.\n", benchmarks[ i ]->pName );
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if( ( pJsonPath != NULL ) && ( list == false ) )
+    {
+        pJsonFile = fopen( pJsonPath, "w" );
+
+        if( pJsonFile == NULL )
+        {
+            fprintf( stderr, "Failed to open %s.\n", pJsonPath );
+            status = EXIT_FAILURE;
+        }
+        else
+        {
+            Benchmark_WriteJson( pJsonFile, results, resultCount );
+            ( void ) fclose( pJsonFile );
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,57 @@
+#!/usr/bin/env python
+#
+# Compares two JSON reports of posix_benchmarks and fails if a median time per
+# operation grew by more than the threshold. Benchmarks in only one of the
+# reports are listed, but don't fail the comparison.
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as report:
+        return {b['name']: b for b in json.load(report)['benchmarks']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two posix_benchmarks reports.')
+    parser.add_argument('baseline', help='report of the reference run')
+    parser.add_argument('current', help='report of the run checked')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='percent by which a median may grow (default: 10)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = []
+
+    print('{:<40} {:>12} {:>12} {:>8}'.format('benchmark', 'baseline ns', 'current ns', 'change'))
+
+    for name in sorted(set(baseline) | set(current)):
+        if name not in current:
+            print('{:<40} {:>12.1f} {:>12} {:>8}'.format(name, baseline[name]['median_ns'], '-', 'removed'))
+            continue
+
+        if name not in baseline:
+            print('{:<40} {:>12} {:>12.1f} {:>8}'.format(name, '-', current[name]['median_ns'], 'new'))
+            continue
+
+        before = baseline[name]['median_ns']
+        after = current[name]['median_ns']
+        change = 100.0 * (after - before) / before if before > 0 else 0.0
+        flag = ''
+
+        if change > args.threshold:
+            regressions.append(name)
+            flag = '  REGRESSION'
+
+        print('{:<40} {:>12.1f} {:>12.1f} {:>+7.1f}%{}'.format(name, before, after, change, flag))
+
+    if regressions:
+        sys.exit('{} benchmark(s) slower by more than {}%: {}'.format(
+            len(regressions), args.threshold, ', '.join(regressions)))
+
+
+if __name__ == '__main__':
+    main()
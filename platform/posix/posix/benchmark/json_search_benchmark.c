@@ -0,0 +1,211 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file json_search_benchmark.c
+ * @brief Benchmarks of reading the keys of the JSON documents the demos
+ * handle.
+ *
+ * "json_search/shadow_delta" validates a shadow delta and reads its version
+ * and desired settings with JSON_Search, as the shadow demo does.
+ * "json_search/job" validates a job execution from notify-next and reads
+ * the keys the jobs demo reads; the job document lists update steps ahead of
+ * them, so every search has to get past them. "json_index/job" reads the
+ * same keys from a JSON token index built once per document, the alternative
+ * to JSON_Search for handlers reading many keys.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* JSON includes. */
+#include "core_json.h"
+#include "json_index.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Tokens of the index of the job, two per key and value.
+ */
+#define JOB_TOKEN_COUNT    128U
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A shadow delta, as received on $aws/things/<thing>/shadow/update/delta.
+ */
+static char shadowDelta[] =
+    "{\"version\":1827,\"timestamp\":1700000000,"
+    "\"state\":{\"powerOn\":1,\"mode\":\"eco\",\"targetTemperature\":21.5,"
+    "\"schedule\":{\"weekday\":[\"06:30\",\"22:00\"],\"weekend\":[\"08:00\",\"23:30\"]}},"
+    "\"metadata\":{\"powerOn\":{\"timestamp\":1700000000},\"mode\":{\"timestamp\":1700000000},"
+    "\"targetTemperature\":{\"timestamp\":1700000000},"
+    "\"schedule\":{\"weekday\":[{\"timestamp\":1700000000},{\"timestamp\":1700000000}],"
+    "\"weekend\":[{\"timestamp\":1700000000},{\"timestamp\":1700000000}]}},"
+    "\"clientToken\":\"bench-thing-000042\"}";
+
+/**
+ * @brief The keys of the shadow delta read.
+ */
+static const char * const shadowKeys[] =
+{
+    "version",
+    "state.powerOn",
+    "state.mode",
+    "state.targetTemperature",
+    "state.schedule.weekday[1]"
+};
+
+/**
+ * @brief A job execution, as received on $aws/things/<thing>/jobs/notify-next.
+ */
+static char jobExecution[] =
+    "{\"timestamp\":1700000000,\"execution\":{\"jobId\":\"firmware-update-0042\","
+    "\"status\":\"QUEUED\",\"queuedAt\":1700000000,\"lastUpdatedAt\":1700000000,"
+    "\"versionNumber\":1,\"executionNumber\":1,\"jobDocument\":{"
+    "\"steps\":[{\"name\":\"download\",\"timeoutS\":600,\"retries\":3},"
+    "{\"name\":\"verify\",\"timeoutS\":60,\"retries\":1},"
+    "{\"name\":\"stage\",\"timeoutS\":120,\"retries\":1},"
+    "{\"name\":\"reboot\",\"timeoutS\":30,\"retries\":0},"
+    "{\"name\":\"selftest\",\"timeoutS\":300,\"retries\":0}],"
+    "\"action\":\"publish\",\"message\":\"Update staged, rebooting.\","
+    "\"topic\":\"fleet/bench-thing/status\"}}}";
+
+/**
+ * @brief The keys of the job execution read.
+ */
+static const char * const jobKeys[] =
+{
+    "execution.jobId",
+    "execution.jobDocument.action",
+    "execution.jobDocument.message",
+    "execution.jobDocument.topic"
+};
+
+/**
+ * @brief The tokens of the index of the job.
+ */
+static JsonIndexToken_t jobTokens[ JOB_TOKEN_COUNT ];
+
+/*-----------------------------------------------------------*/
+
+static int searchKeys( char * pDocument,
+                       size_t documentLength,
+                       const char * const * pKeys,
+                       size_t keyCount,
+                       uint32_t iterations )
+{
+    char * pValue = NULL;
+    size_t valueLength = 0U;
+    uint32_t i;
+    size_t j;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        if( JSON_Validate( pDocument, documentLength ) != JSONSuccess )
+        {
+            status = -1;
+        }
+
+        for( j = 0U; ( j < keyCount ) && ( status == 0 ); j++ )
+        {
+            if( JSON_Search( pDocument, documentLength, pKeys[ j ], strlen( pKeys[ j ] ),
+                             &pValue, &valueLength ) != JSONSuccess )
+            {
+                status = -1;
+            }
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int runShadowDelta( uint32_t iterations )
+{
+    return searchKeys( shadowDelta, sizeof( shadowDelta ) - 1U, shadowKeys,
+                       sizeof( shadowKeys ) / sizeof( shadowKeys[ 0 ] ), iterations );
+}
+/*-----------------------------------------------------------*/
+
+static int runJob( uint32_t iterations )
+{
+    return searchKeys( jobExecution, sizeof( jobExecution ) - 1U, jobKeys,
+                       sizeof( jobKeys ) / sizeof( jobKeys[ 0 ] ), iterations );
+}
+/*-----------------------------------------------------------*/
+
+static int runJobIndex( uint32_t iterations )
+{
+    JsonIndex_t index;
+    const char * pValue = NULL;
+    size_t valueLength = 0U;
+    uint32_t i;
+    size_t j;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        if( JsonIndex_Build( &index, jobExecution, sizeof( jobExecution ) - 1U,
+                             jobTokens, JOB_TOKEN_COUNT ) != JsonIndexSuccess )
+        {
+            status = -1;
+        }
+
+        for( j = 0U; ( j < ( sizeof( jobKeys ) / sizeof( jobKeys[ 0 ] ) ) ) && ( status == 0 ); j++ )
+        {
+            if( JsonIndex_Search( &index, jobKeys[ j ], strlen( jobKeys[ j ] ),
+                                  &pValue, &valueLength, NULL ) != JsonIndexSuccess )
+            {
+                status = -1;
+            }
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t jsonSearchShadowBenchmark =
+{
+    .pName      = "json_search/shadow_delta",
+    .bytesPerOp = sizeof( shadowDelta ) - 1U,
+    .run        = runShadowDelta
+};
+
+const Benchmark_t jsonSearchJobBenchmark =
+{
+    .pName      = "json_search/job",
+    .bytesPerOp = sizeof( jobExecution ) - 1U,
+    .run        = runJob
+};
+
+const Benchmark_t jsonIndexJobBenchmark =
+{
+    .pName      = "json_index/job",
+    .bytesPerOp = sizeof( jobExecution ) - 1U,
+    .run        = runJobIndex
+};
+/*-----------------------------------------------------------*/
@@ -0,0 +1,202 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mqtt_replay_benchmark.c
+ * @brief Benchmark of receiving a session captured on a device through
+ * coreMQTT, given with -r.
+ *
+ * Each operation replays every connection of the capture with
+ * transport_replay_posix.c, as fast as it is received: MQTT_Connect takes the
+ * CONNACK the device got, and MQTT_ProcessLoop the rest, until the records of
+ * the connection run out. The clock given to coreMQTT stands still, so no
+ * keep-alive is sent and the work done only depends on the capture. Every
+ * operation must receive as many publishes as the first.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <string.h>
+
+#include "core_mqtt.h"
+
+/* Transport includes. */
+#include "transport_replay_posix.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the network buffer, enough for an OTA block of 8 KB.
+ */
+#define NETWORK_BUFFER_SIZE    ( 16U * 1024U )
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    ReplayParams_t * pParams;
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The capture given with -r.
+ */
+static const char * pCapturePath = NULL;
+
+/**
+ * @brief The replay and its network context.
+ */
+static ReplayParams_t replayParams;
+static NetworkContext_t networkContext = { &replayParams };
+
+/**
+ * @brief The MQTT context and its network buffer.
+ */
+static MQTTContext_t mqttContext;
+static uint8_t networkBuffer[ NETWORK_BUFFER_SIZE ];
+
+/**
+ * @brief Publishes received in the current operation, and in the first.
+ */
+static uint32_t publishCount = 0U;
+static uint32_t expectedPublishCount = 0U;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t stoppedClock( void )
+{
+    return 0U;
+}
+/*-----------------------------------------------------------*/
+
+static void eventCallback( MQTTContext_t * pContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo )
+{
+    ( void ) pContext;
+    ( void ) pDeserializedInfo;
+
+    if( ( pPacketInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+    {
+        publishCount++;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int replayCapture( void )
+{
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { networkBuffer, sizeof( networkBuffer ) };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTStatus_t status = MQTTSuccess;
+    bool sessionPresent = false;
+
+    transport.pNetworkContext = &networkContext;
+    transport.send = TransportReplay_Send;
+    transport.recv = TransportReplay_Recv;
+
+    connectInfo.cleanSession = true;
+    connectInfo.pClientIdentifier = "replay";
+    connectInfo.clientIdentifierLength = ( uint16_t ) strlen( connectInfo.pClientIdentifier );
+
+    publishCount = 0U;
+    TransportReplay_Rewind( &replayParams );
+
+    while( TransportReplay_Connect( &networkContext ) == TRANSPORT_REPLAY_SUCCESS )
+    {
+        status = MQTT_Init( &mqttContext, &transport, stoppedClock, eventCallback, &fixedBuffer );
+
+        if( status == MQTTSuccess )
+        {
+            /* A connection the broker refused has nothing more to replay. */
+            status = MQTT_Connect( &mqttContext, &connectInfo, NULL, 0U, &sessionPresent );
+        }
+
+        while( status == MQTTSuccess )
+        {
+            status = MQTT_ProcessLoop( &mqttContext, 0U );
+        }
+    }
+
+    return ( replayParams.stats.connections > 0U ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+static int setupReplay( void )
+{
+    int status = -1;
+
+    if( ( pCapturePath != NULL ) &&
+        ( TransportReplay_Open( &replayParams, pCapturePath, 0U, 0U ) == TRANSPORT_REPLAY_SUCCESS ) )
+    {
+        status = replayCapture();
+        expectedPublishCount = publishCount;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int runReplay( uint32_t iterations )
+{
+    int status = 0;
+    uint32_t i;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        status = replayCapture();
+
+        if( publishCount != expectedPublishCount )
+        {
+            status = -1;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void teardownReplay( void )
+{
+    TransportReplay_Close( &replayParams );
+}
+/*-----------------------------------------------------------*/
+
+void MqttReplayBenchmark_SetCapture( const char * pPath )
+{
+    pCapturePath = pPath;
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t mqttReplayBenchmark =
+{
+    .pName      = "mqtt/replay",
+    .bytesPerOp = 0U,
+    .setup      = setupReplay,
+    .run        = runReplay,
+    .teardown   = teardownReplay
+};
+/*-----------------------------------------------------------*/
@@ -0,0 +1,298 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_pal_write_benchmark.c
+ * @brief Benchmarks of the write and verify paths of the POSIX OTA PAL.
+ *
+ * "ota_pal/write_4k" writes blocks of the size the demos request in order,
+ * which is where the PAL digests the image as it is received.
+ * "ota_pal/receive_1m" receives a whole signed image: it creates the file,
+ * writes it in order and closes it, which checks the ECDSA signature of the
+ * image. ota_pal_benchmark covers the other block sizes and orders.
+ *
+ * The files are written in a temporary directory, which is the working
+ * directory while the benchmarks run, as #otaPal_CloseFile stores the image
+ * state there.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <unistd.h>
+
+/* OpenSSL includes. */
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "ota.h"
+#include "ota_pal_posix.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the blocks written, that of otaconfigLOG2_FILE_BLOCK_SIZE.
+ */
+#define BLOCK_SIZE               4096U
+
+/**
+ * @brief Size of the image received by "ota_pal/receive_1m".
+ */
+#define IMAGE_SIZE               ( 1024U * 1024U )
+
+/**
+ * @brief Names of the received image and of the signer certificate in the
+ * temporary directory.
+ */
+#define IMAGE_FILE_NAME          "ota_pal_write_benchmark.bin"
+#define CERT_FILE_NAME           "ota_pal_write_benchmark.crt"
+
+/**
+ * @brief Name of the file #otaPal_SetPlatformImageState writes in the working
+ * directory.
+ */
+#define IMAGE_STATE_FILE_NAME    "PlatformImageState.txt"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The temporary directory the files are in.
+ */
+static char directory[] = "/tmp/ota_pal_write_benchmark_XXXXXX";
+
+/**
+ * @brief The image, and its ECDSA-SHA256 signature.
+ */
+static uint8_t * pImage;
+static Sig256_t signature;
+
+/*-----------------------------------------------------------*/
+
+static int signImage( void )
+{
+    EVP_PKEY_CTX * pKeyContext = NULL;
+    EVP_PKEY * pKey = NULL;
+    EVP_MD_CTX * pSignContext = NULL;
+    X509 * pCertificate = NULL;
+    FILE * pCertFile = NULL;
+    size_t signatureLength = sizeof( signature.data );
+    int status = 0;
+
+    /* Generate a P-256 key, the key type of sig-sha256-ecdsa. */
+    pKeyContext = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, NULL );
+
+    if( ( pKeyContext != NULL ) &&
+        ( EVP_PKEY_keygen_init( pKeyContext ) == 1 ) &&
+        ( EVP_PKEY_CTX_set_ec_paramgen_curve_nid( pKeyContext, NID_X9_62_prime256v1 ) == 1 ) &&
+        ( EVP_PKEY_keygen( pKeyContext, &pKey ) == 1 ) )
+    {
+        pSignContext = EVP_MD_CTX_new();
+    }
+
+    if( ( pSignContext != NULL ) &&
+        ( EVP_DigestSignInit( pSignContext, NULL, EVP_sha256(), NULL, pKey ) == 1 ) &&
+        ( EVP_DigestSign( pSignContext, signature.data, &signatureLength, pImage, IMAGE_SIZE ) == 1 ) )
+    {
+        signature.size = ( uint16_t ) signatureLength;
+        pCertificate = X509_new();
+    }
+
+    /* The PAL only takes the public key from the signer certificate, so a
+     * self-signed one is enough. */
+    if( pCertificate != NULL )
+    {
+        ( void ) ASN1_INTEGER_set( X509_get_serialNumber( pCertificate ), 1 );
+        ( void ) X509_gmtime_adj( X509_getm_notBefore( pCertificate ), -60L );
+        ( void ) X509_gmtime_adj( X509_getm_notAfter( pCertificate ), 3600L );
+        ( void ) X509_set_pubkey( pCertificate, pKey );
+        ( void ) X509_set_issuer_name( pCertificate, X509_get_subject_name( pCertificate ) );
+
+        if( X509_sign( pCertificate, pKey, EVP_sha256() ) > 0 )
+        {
+            pCertFile = fopen( CERT_FILE_NAME, "w" );
+        }
+    }
+
+    if( pCertFile != NULL )
+    {
+        status = PEM_write_X509( pCertFile, pCertificate );
+        ( void ) fclose( pCertFile );
+    }
+
+    X509_free( pCertificate );
+    EVP_MD_CTX_free( pSignContext );
+    EVP_PKEY_free( pKey );
+    EVP_PKEY_CTX_free( pKeyContext );
+
+    return ( status == 1 ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+static void initFileContext( OtaFileContext_t * pFileContext,
+                             uint32_t fileSize )
+{
+    ( void ) memset( pFileContext, 0, sizeof( OtaFileContext_t ) );
+
+    pFileContext->pFilePath = ( uint8_t * ) IMAGE_FILE_NAME;
+    pFileContext->pCertFilepath = ( uint8_t * ) CERT_FILE_NAME;
+    pFileContext->fileSize = fileSize;
+    pFileContext->pSignature = &signature;
+}
+/*-----------------------------------------------------------*/
+
+static int writeBlocks( OtaFileContext_t * pFileContext,
+                        uint32_t blockCount )
+{
+    uint32_t offset = 0U;
+    uint32_t i;
+    int status = 0;
+
+    for( i = 0U; ( i < blockCount ) && ( status == 0 ); i++ )
+    {
+        /* Past the end of the image, the image is written again at the next
+         * offset, so every block is in order. */
+        if( otaPal_WriteBlock( pFileContext, offset, &pImage[ offset % IMAGE_SIZE ],
+                               BLOCK_SIZE ) != ( int16_t ) BLOCK_SIZE )
+        {
+            status = -1;
+        }
+
+        offset += BLOCK_SIZE;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int setupOtaPal( void )
+{
+    uint32_t i;
+    int status = -1;
+
+    pImage = malloc( IMAGE_SIZE );
+
+    if( pImage != NULL )
+    {
+        srand( 1U );
+
+        for( i = 0U; i < IMAGE_SIZE; i++ )
+        {
+            pImage[ i ] = ( uint8_t ) rand();
+        }
+
+        ( void ) strcpy( directory, "/tmp/ota_pal_write_benchmark_XXXXXX" );
+        status = Benchmark_EnterTempDir( directory );
+    }
+
+    if( status == 0 )
+    {
+        status = signImage();
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void teardownOtaPal( void )
+{
+    ( void ) unlink( IMAGE_FILE_NAME );
+    ( void ) unlink( CERT_FILE_NAME );
+    ( void ) unlink( IMAGE_STATE_FILE_NAME );
+    Benchmark_LeaveTempDir( directory );
+
+    free( pImage );
+    pImage = NULL;
+}
+/*-----------------------------------------------------------*/
+
+static int runWrite( uint32_t iterations )
+{
+    OtaFileContext_t fileContext;
+    int status = -1;
+
+    initFileContext( &fileContext, iterations * BLOCK_SIZE );
+
+    if( OTA_PAL_MAIN_ERR( otaPal_CreateFileForRx( &fileContext ) ) == OtaPalSuccess )
+    {
+        status = writeBlocks( &fileContext, iterations );
+        ( void ) otaPal_Abort( &fileContext );
+    }
+
+    ( void ) unlink( IMAGE_FILE_NAME );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int runReceive( uint32_t iterations )
+{
+    OtaFileContext_t fileContext;
+    uint32_t i;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        initFileContext( &fileContext, IMAGE_SIZE );
+        status = -1;
+
+        if( OTA_PAL_MAIN_ERR( otaPal_CreateFileForRx( &fileContext ) ) == OtaPalSuccess )
+        {
+            if( writeBlocks( &fileContext, IMAGE_SIZE / BLOCK_SIZE ) != 0 )
+            {
+                ( void ) otaPal_Abort( &fileContext );
+            }
+            else if( OTA_PAL_MAIN_ERR( otaPal_CloseFile( &fileContext ) ) == OtaPalSuccess )
+            {
+                /* The signature of the file checked out. */
+                status = 0;
+            }
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t otaPalWriteBenchmark =
+{
+    .pName      = "ota_pal/write_4k",
+    .bytesPerOp = BLOCK_SIZE,
+    .setup      = setupOtaPal,
+    .run        = runWrite,
+    .teardown   = teardownOtaPal
+};
+
+const Benchmark_t otaPalReceiveBenchmark =
+{
+    .pName      = "ota_pal/receive_1m",
+    .bytesPerOp = IMAGE_SIZE,
+    .setup      = setupOtaPal,
+    .run        = runReceive,
+    .teardown   = teardownOtaPal
+};
+/*-----------------------------------------------------------*/
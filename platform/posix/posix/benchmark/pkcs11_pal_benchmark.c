@@ -0,0 +1,201 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file pkcs11_pal_benchmark.c
+ * @brief Benchmarks of reading objects through the PKCS #11 PAL.
+ *
+ * The POSIX build of corePKCS11 keeps each object in a file of the working
+ * directory, which stands in for the NVS partition of the ESP32 PAL, so the
+ * benchmarks run in a temporary directory holding a device certificate and
+ * key of RSA-2048 size. "pkcs11_pal/find" looks the certificate up by label,
+ * as C_FindObjects does, and "pkcs11_pal/read_cert" reads its value, as
+ * C_GetAttributeValue does for every TLS handshake. The ESP32 PAL, with its
+ * object cache, is measured on the device by the corePKCS11 benchmark.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <unistd.h>
+
+/* corePKCS11 includes. */
+#include "core_pkcs11.h"
+#include "core_pkcs11_config.h"
+#include "core_pkcs11_pal.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sizes of the objects, as PEM RSA-2048 ones.
+ */
+#define CERTIFICATE_LENGTH    1220U
+#define PRIVATE_KEY_LENGTH    1680U
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The temporary directory the object files are in.
+ */
+static char directory[ 64 ];
+
+/**
+ * @brief The contents of the objects.
+ */
+static uint8_t certificate[ CERTIFICATE_LENGTH ];
+static uint8_t privateKey[ PRIVATE_KEY_LENGTH ];
+
+/**
+ * @brief The handle of the certificate.
+ */
+static CK_OBJECT_HANDLE certificateHandle = CK_INVALID_HANDLE;
+
+/*-----------------------------------------------------------*/
+
+static CK_OBJECT_HANDLE saveObject( const char * pLabel,
+                                    uint8_t * pData,
+                                    size_t length )
+{
+    CK_ATTRIBUTE label;
+
+    label.type = CKA_LABEL;
+    label.pValue = ( CK_VOID_PTR ) pLabel;
+    label.ulValueLen = ( CK_ULONG ) strlen( pLabel );
+
+    return PKCS11_PAL_SaveObject( &label, pData, ( CK_ULONG ) length );
+}
+/*-----------------------------------------------------------*/
+
+static int setupPal( void )
+{
+    uint32_t i;
+    int status = -1;
+
+    for( i = 0U; i < CERTIFICATE_LENGTH; i++ )
+    {
+        certificate[ i ] = ( uint8_t ) ( 'A' + ( i % 26U ) );
+    }
+
+    for( i = 0U; i < PRIVATE_KEY_LENGTH; i++ )
+    {
+        privateKey[ i ] = ( uint8_t ) ( 'a' + ( i % 26U ) );
+    }
+
+    ( void ) strcpy( directory, "/tmp/pkcs11_pal_benchmark_XXXXXX" );
+
+    if( ( Benchmark_EnterTempDir( directory ) == 0 ) &&
+        ( PKCS11_PAL_Initialize() == CKR_OK ) )
+    {
+        certificateHandle = saveObject( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                        certificate, CERTIFICATE_LENGTH );
+
+        if( ( certificateHandle != CK_INVALID_HANDLE ) &&
+            ( saveObject( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
+                          privateKey, PRIVATE_KEY_LENGTH ) != CK_INVALID_HANDLE ) )
+        {
+            status = 0;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void teardownPal( void )
+{
+    /* The PAL removes the files of destroyed objects. */
+    ( void ) PKCS11_PAL_DestroyObject( certificateHandle );
+    ( void ) PKCS11_PAL_DestroyObject( PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
+                                                              ( CK_ULONG ) strlen( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS ) ) );
+    Benchmark_LeaveTempDir( directory );
+
+    certificateHandle = CK_INVALID_HANDLE;
+}
+/*-----------------------------------------------------------*/
+
+static int runFind( uint32_t iterations )
+{
+    uint32_t i;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        if( PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                   ( CK_ULONG ) strlen( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) ) != certificateHandle )
+        {
+            status = -1;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int runRead( uint32_t iterations )
+{
+    CK_BYTE_PTR pData = NULL;
+    CK_ULONG length = 0U;
+    CK_BBOOL isPrivate = CK_TRUE;
+    uint32_t i;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        if( ( PKCS11_PAL_GetObjectValue( certificateHandle, &pData, &length, &isPrivate ) != CKR_OK ) ||
+            ( length != CERTIFICATE_LENGTH ) ||
+            ( isPrivate != CK_FALSE ) )
+        {
+            status = -1;
+        }
+
+        if( pData != NULL )
+        {
+            PKCS11_PAL_GetObjectValueCleanup( pData, length );
+            pData = NULL;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t pkcs11PalFindBenchmark =
+{
+    .pName    = "pkcs11_pal/find",
+    .setup    = setupPal,
+    .run      = runFind,
+    .teardown = teardownPal
+};
+
+const Benchmark_t pkcs11PalReadBenchmark =
+{
+    .pName      = "pkcs11_pal/read_cert",
+    .bytesPerOp = CERTIFICATE_LENGTH,
+    .setup      = setupPal,
+    .run        = runRead,
+    .teardown   = teardownPal
+};
+/*-----------------------------------------------------------*/
@@ -0,0 +1,279 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file provisioning_payload_benchmark.c
+ * @brief Benchmarks of the CBOR and JSON payloads of fleet provisioning,
+ * built and parsed by the serializer of the demos.
+ *
+ * "provisioning_<format>/csr_request" serializes a CreateCertificateFromCsr
+ * request with a CSR the size of a P-256 one. "provisioning_<format>/
+ * key_cert_response" parses a CreateKeysAndCertificate accepted response
+ * with a certificate and private key the size of RSA-2048 ones, as AWS IoT
+ * returns them. The parser terminates the fields in place, so each operation
+ * first copies the response into the receive buffer, as the MQTT callback
+ * does.
+ *
+ * Both formats process the same fields, so their throughputs compare the
+ * CPU each takes. The bytes each payload takes on air are logged by the
+ * on-target benchmark of the serializer.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* tinyCBOR library for encoding the response. */
+#include "cbor.h"
+
+/* JSON writer for encoding the response. */
+#include "json_writer.h"
+
+#include "fleet_provisioning_serializer.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Length of the CSR in the request, as a PEM P-256 CSR.
+ */
+#define CSR_LENGTH                     480U
+
+/**
+ * @brief Lengths of the fields of the response.
+ */
+#define CERTIFICATE_ID_LENGTH          64U
+#define CERTIFICATE_PEM_LENGTH         1220U
+#define PRIVATE_KEY_LENGTH             1680U
+#define OWNERSHIP_TOKEN_LENGTH         460U
+
+/**
+ * @brief Size of the payload buffers, with room for all fields and the CBOR
+ * headers or the JSON escapes of the newlines.
+ */
+#define PAYLOAD_BUFFER_LENGTH          4096U
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The CSR of the request.
+ */
+static char csr[ CSR_LENGTH + 1U ];
+
+/**
+ * @brief The fields of the response, in one buffer.
+ */
+static char responseFields[ CERTIFICATE_ID_LENGTH + CERTIFICATE_PEM_LENGTH +
+                            PRIVATE_KEY_LENGTH + OWNERSHIP_TOKEN_LENGTH ];
+
+/**
+ * @brief The encoded responses, and their lengths.
+ */
+static uint8_t cborResponse[ PAYLOAD_BUFFER_LENGTH ];
+static size_t cborResponseLength;
+static uint8_t jsonResponse[ PAYLOAD_BUFFER_LENGTH ];
+static size_t jsonResponseLength;
+
+/**
+ * @brief Where requests are built and responses are copied to be parsed.
+ */
+static uint8_t payloadBuffer[ PAYLOAD_BUFFER_LENGTH ];
+
+/*-----------------------------------------------------------*/
+
+static void fillPem( char * pBuffer,
+                     size_t length,
+                     const char * pLabel )
+{
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t header = ( size_t ) snprintf( pBuffer, length, "-----BEGIN %s-----\n", pLabel );
+    size_t i;
+
+    /* Base64 lines of 64 characters, as the PEM encoders write them. */
+    for( i = header; i < length; i++ )
+    {
+        pBuffer[ i ] = ( ( ( i - header ) % 65U ) == 64U ) ? '\n' : base64[ ( i * 7U ) % 64U ];
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int runCsrRequest( const ProvisioningPayloadFormat_t * pFormat,
+                          uint32_t iterations )
+{
+    size_t length = 0U;
+    uint32_t i;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        if( ( pFormat->generateCsrRequest( payloadBuffer, sizeof( payloadBuffer ),
+                                           csr, CSR_LENGTH, &length ) == false ) ||
+            ( length <= CSR_LENGTH ) )
+        {
+            status = -1;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int runKeyCertResponse( const ProvisioningPayloadFormat_t * pFormat,
+                               const uint8_t * pResponse,
+                               size_t responseLength,
+                               uint32_t iterations )
+{
+    ProvisioningResponse_t fields;
+    uint32_t i;
+    int status = 0;
+
+    for( i = 0U; ( i < iterations ) && ( status == 0 ); i++ )
+    {
+        ( void ) memcpy( payloadBuffer, pResponse, responseLength );
+
+        if( ( pFormat->parseResponse( payloadBuffer, responseLength, sizeof( payloadBuffer ), &fields ) == false ) ||
+            ( fields.certificateOwnershipToken.pString == NULL ) ||
+            ( fields.privateKey.length != PRIVATE_KEY_LENGTH ) )
+        {
+            status = -1;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int setupCsrRequest( void )
+{
+    fillPem( csr, CSR_LENGTH, "CERTIFICATE REQUEST" );
+    csr[ CSR_LENGTH ] = '\0';
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+static int runCborCsrRequest( uint32_t iterations )
+{
+    return runCsrRequest( &provisioningPayloadCbor, iterations );
+}
+/*-----------------------------------------------------------*/
+
+static int runJsonCsrRequest( uint32_t iterations )
+{
+    return runCsrRequest( &provisioningPayloadJson, iterations );
+}
+/*-----------------------------------------------------------*/
+
+static int setupKeyCertResponse( void )
+{
+    CborEncoder encoder, map;
+    JsonWriter_t writer;
+    char * pCertificateId = responseFields;
+    char * pCertificatePem = pCertificateId + CERTIFICATE_ID_LENGTH;
+    char * pPrivateKey = pCertificatePem + CERTIFICATE_PEM_LENGTH;
+    char * pOwnershipToken = pPrivateKey + PRIVATE_KEY_LENGTH;
+    CborError error = CborNoError;
+    bool written;
+    size_t i;
+
+    for( i = 0U; i < CERTIFICATE_ID_LENGTH; i++ )
+    {
+        pCertificateId[ i ] = "0123456789abcdef"[ ( i * 5U ) % 16U ];
+    }
+
+    fillPem( pCertificatePem, CERTIFICATE_PEM_LENGTH, "CERTIFICATE" );
+    fillPem( pPrivateKey, PRIVATE_KEY_LENGTH, "RSA PRIVATE KEY" );
+    fillPem( pOwnershipToken, OWNERSHIP_TOKEN_LENGTH, "TOKEN" );
+
+    cbor_encoder_init( &encoder, cborResponse, sizeof( cborResponse ), 0 );
+
+    error |= cbor_encoder_create_map( &encoder, &map, 4 );
+    error |= cbor_encode_text_stringz( &map, "certificateId" );
+    error |= cbor_encode_text_string( &map, pCertificateId, CERTIFICATE_ID_LENGTH );
+    error |= cbor_encode_text_stringz( &map, "certificatePem" );
+    error |= cbor_encode_text_string( &map, pCertificatePem, CERTIFICATE_PEM_LENGTH );
+    error |= cbor_encode_text_stringz( &map, "privateKey" );
+    error |= cbor_encode_text_string( &map, pPrivateKey, PRIVATE_KEY_LENGTH );
+    error |= cbor_encode_text_stringz( &map, "certificateOwnershipToken" );
+    error |= cbor_encode_text_string( &map, pOwnershipToken, OWNERSHIP_TOKEN_LENGTH );
+    error |= cbor_encoder_close_container( &encoder, &map );
+
+    cborResponseLength = cbor_encoder_get_buffer_size( &encoder, cborResponse );
+
+    JsonWriter_Init( &writer, ( char * ) jsonResponse, sizeof( jsonResponse ) );
+    JsonWriter_BeginObject( &writer, NULL );
+    JsonWriter_AddString( &writer, "certificateId", pCertificateId, CERTIFICATE_ID_LENGTH );
+    JsonWriter_AddString( &writer, "certificatePem", pCertificatePem, CERTIFICATE_PEM_LENGTH );
+    JsonWriter_AddString( &writer, "privateKey", pPrivateKey, PRIVATE_KEY_LENGTH );
+    JsonWriter_AddString( &writer, "certificateOwnershipToken", pOwnershipToken, OWNERSHIP_TOKEN_LENGTH );
+    JsonWriter_EndObject( &writer );
+    written = JsonWriter_Finish( &writer, &jsonResponseLength );
+
+    return ( ( error == CborNoError ) && ( written == true ) ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+static int runCborKeyCertResponse( uint32_t iterations )
+{
+    return runKeyCertResponse( &provisioningPayloadCbor, cborResponse, cborResponseLength, iterations );
+}
+/*-----------------------------------------------------------*/
+
+static int runJsonKeyCertResponse( uint32_t iterations )
+{
+    return runKeyCertResponse( &provisioningPayloadJson, jsonResponse, jsonResponseLength, iterations );
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t provisioningCsrRequestBenchmark =
+{
+    .pName      = "provisioning_cbor/csr_request",
+    .bytesPerOp = CSR_LENGTH,
+    .setup      = setupCsrRequest,
+    .run        = runCborCsrRequest
+};
+
+const Benchmark_t provisioningKeyCertResponseBenchmark =
+{
+    .pName      = "provisioning_cbor/key_cert_response",
+    .bytesPerOp = CERTIFICATE_ID_LENGTH + CERTIFICATE_PEM_LENGTH + PRIVATE_KEY_LENGTH + OWNERSHIP_TOKEN_LENGTH,
+    .setup      = setupKeyCertResponse,
+    .run        = runCborKeyCertResponse
+};
+
+const Benchmark_t provisioningJsonCsrRequestBenchmark =
+{
+    .pName      = "provisioning_json/csr_request",
+    .bytesPerOp = CSR_LENGTH,
+    .setup      = setupCsrRequest,
+    .run        = runJsonCsrRequest
+};
+
+const Benchmark_t provisioningJsonKeyCertResponseBenchmark =
+{
+    .pName      = "provisioning_json/key_cert_response",
+    .bytesPerOp = CERTIFICATE_ID_LENGTH + CERTIFICATE_PEM_LENGTH + PRIVATE_KEY_LENGTH + OWNERSHIP_TOKEN_LENGTH,
+    .setup      = setupKeyCertResponse,
+    .run        = runJsonKeyCertResponse
+};
+/*-----------------------------------------------------------*/
@@ -0,0 +1,46 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file sdkconfig.h
+ * @brief Stands in for the sdkconfig.h of ESP-IDF for the shared libraries
+ * built into the benchmarks and the fleet provisioning load generator, with
+ * the defaults of their Kconfig options.
+ */
+
+#ifndef SDKCONFIG_H_
+#define SDKCONFIG_H_
+
+/* mqtt_subscription_manager. Deferred dispatch needs FreeRTOS. */
+#define CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_NODES             16
+#define CONFIG_MQTT_SUBSCRIPTION_MANAGER_MAX_CALLBACKS         8
+#define CONFIG_MQTT_SUBSCRIPTION_MANAGER_DEFERRED_DISPATCH     0
+
+/* json_index. */
+#define CONFIG_JSON_INDEX_WORD_SCAN                            1
+
+/* fleet_provisioning_serializer. CBOR payloads, with the JSON ones built for
+ * the benchmarks; the load generator turns those off. */
+#define CONFIG_FLEET_PROV_SERIALIZER_BENCHMARK                 1
+#define CONFIG_FLEET_PROV_SERIALIZER_JSON_TOKENS               48
+
+#endif /* ifndef SDKCONFIG_H_ */
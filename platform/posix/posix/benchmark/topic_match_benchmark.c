@@ -0,0 +1,313 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file topic_match_benchmark.c
+ * @brief Benchmarks of matching the topic of an incoming PUBLISH against the
+ * subscribed topic filters.
+ *
+ * The filters are those of a device running the shadow, jobs, OTA and fleet
+ * provisioning demos, plus wildcard filters of its own commands and a
+ * filter per peer device it follows. The topics cycle through one of each
+ * kind, including one that matches nothing. "topic_match/trie" dispatches
+ * them with the subscription manager; "topic_match/linear" runs
+ * MQTT_MatchTopic against every filter, as the subscription manager did
+ * before the trie, and is the baseline the trie is measured against.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
+#include "core_mqtt.h"
+#include "mqtt_subscription_manager.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of peer devices with a filter each.
+ */
+#define PEER_COUNT               48U
+
+/**
+ * @brief Longest filter of a peer device.
+ */
+#define PEER_FILTER_LENGTH       32U
+
+/**
+ * @brief Trie nodes given to the subscription manager, enough for every
+ * level of every filter.
+ */
+#define TRIE_NODE_COUNT          256U
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The filters of the demos and of the commands of the device.
+ */
+static const char * const fixedFilters[] =
+{
+    "$aws/things/bench-thing/shadow/update/accepted",
+    "$aws/things/bench-thing/shadow/update/rejected",
+    "$aws/things/bench-thing/shadow/update/delta",
+    "$aws/things/bench-thing/shadow/get/accepted",
+    "$aws/things/bench-thing/shadow/get/rejected",
+    "$aws/things/bench-thing/jobs/notify-next",
+    "$aws/things/bench-thing/jobs/+/get/accepted",
+    "$aws/things/bench-thing/jobs/+/get/rejected",
+    "$aws/things/bench-thing/jobs/+/update/accepted",
+    "$aws/things/bench-thing/jobs/+/update/rejected",
+    "$aws/things/bench-thing/streams/+/data/cbor",
+    "$aws/things/bench-thing/streams/+/rejected/cbor",
+    "$aws/certificates/create/cbor/accepted",
+    "$aws/provisioning-templates/+/provision/cbor/accepted",
+    "fleet/bench-thing/commands/#",
+    "sensors/+/temperature",
+    "sensors/#"
+};
+
+/**
+ * @brief The number of #fixedFilters.
+ */
+#define FIXED_FILTER_COUNT       ( sizeof( fixedFilters ) / sizeof( fixedFilters[ 0 ] ) )
+
+/**
+ * @brief A topic received, with the number of filters it matches.
+ */
+typedef struct TopicCase
+{
+    const char * pTopic; /**< @brief The topic name. */
+    uint32_t matches;    /**< @brief The filters matching it. */
+} TopicCase_t;
+
+/**
+ * @brief The topics dispatched, in turn.
+ */
+static const TopicCase_t topics[] =
+{
+    { "$aws/things/bench-thing/shadow/update/delta",                      1U },
+    { "$aws/things/bench-thing/jobs/firmware-update-0042/get/accepted",   1U },
+    { "$aws/things/bench-thing/streams/AFR_OTA-05e9-4bb9-a1c5/data/cbor", 1U },
+    { "sensors/kitchen/temperature",                                      2U },
+    { "fleet/bench-thing/commands/reboot/now",                            1U },
+    { "devices/peer-0031/status",                                         1U },
+    { "telemetry/bench-thing/metrics",                                    0U }
+};
+
+/**
+ * @brief The number of #topics.
+ */
+#define TOPIC_COUNT              ( sizeof( topics ) / sizeof( topics[ 0 ] ) )
+
+/**
+ * @brief The filters of the peer devices, built by #setupFilters.
+ */
+static char peerFilters[ PEER_COUNT ][ PEER_FILTER_LENGTH ];
+
+/**
+ * @brief Every filter, in the order they are subscribed.
+ */
+static const char * filters[ FIXED_FILTER_COUNT + PEER_COUNT ];
+
+/**
+ * @brief The number of #filters.
+ */
+#define FILTER_COUNT             ( FIXED_FILTER_COUNT + PEER_COUNT )
+
+/**
+ * @brief The length of each of #filters, which the subscription manager
+ * also kept per record.
+ */
+static uint16_t filterLengths[ FILTER_COUNT ];
+
+/**
+ * @brief The incoming PUBLISH of each topic.
+ */
+static MQTTPublishInfo_t publishes[ TOPIC_COUNT ];
+
+/**
+ * @brief Pools of the subscription manager.
+ */
+static SubscriptionManagerNode_t trieNodes[ TRIE_NODE_COUNT ];
+static SubscriptionManagerRecord_t trieRecords[ FILTER_COUNT ];
+
+/**
+ * @brief The connection the publishes are dispatched for. The subscription
+ * manager only passes it to the callbacks.
+ */
+static MQTTContext_t mqttContext;
+
+/**
+ * @brief Callbacks invoked by the subscription manager.
+ */
+static uint32_t callbackCount;
+
+/*-----------------------------------------------------------*/
+
+static void countCallback( MQTTContext_t * pContext,
+                           MQTTPublishInfo_t * pPublishInfo,
+                           void * pUserContext )
+{
+    ( void ) pContext;
+    ( void ) pPublishInfo;
+    ( void ) pUserContext;
+
+    callbackCount++;
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t expectedMatches( uint32_t iterations )
+{
+    uint32_t total = 0U;
+    uint32_t i;
+
+    for( i = 0U; i < TOPIC_COUNT; i++ )
+    {
+        total += topics[ i ].matches * ( iterations / TOPIC_COUNT );
+
+        if( i < ( iterations % TOPIC_COUNT ) )
+        {
+            total += topics[ i ].matches;
+        }
+    }
+
+    return total;
+}
+/*-----------------------------------------------------------*/
+
+static int setupFilters( void )
+{
+    uint32_t i;
+
+    for( i = 0U; i < FIXED_FILTER_COUNT; i++ )
+    {
+        filters[ i ] = fixedFilters[ i ];
+    }
+
+    for( i = 0U; i < PEER_COUNT; i++ )
+    {
+        ( void ) snprintf( peerFilters[ i ], PEER_FILTER_LENGTH, "devices/peer-%04u/status", ( unsigned ) i );
+        filters[ FIXED_FILTER_COUNT + i ] = peerFilters[ i ];
+    }
+
+    for( i = 0U; i < FILTER_COUNT; i++ )
+    {
+        filterLengths[ i ] = ( uint16_t ) strlen( filters[ i ] );
+    }
+
+    for( i = 0U; i < TOPIC_COUNT; i++ )
+    {
+        ( void ) memset( &publishes[ i ], 0, sizeof( MQTTPublishInfo_t ) );
+        publishes[ i ].pTopicName = topics[ i ].pTopic;
+        publishes[ i ].topicNameLength = ( uint16_t ) strlen( topics[ i ].pTopic );
+    }
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+static int setupTrie( void )
+{
+    uint32_t i;
+    int status = setupFilters();
+
+    SubscriptionManager_Init( trieNodes, TRIE_NODE_COUNT, trieRecords, FILTER_COUNT );
+
+    for( i = 0U; ( i < FILTER_COUNT ) && ( status == 0 ); i++ )
+    {
+        if( SubscriptionManager_RegisterCallback( filters[ i ], filterLengths[ i ],
+                                                  countCallback, NULL ) != SUBSCRIPTION_MANAGER_SUCCESS )
+        {
+            status = -1;
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int runTrie( uint32_t iterations )
+{
+    uint32_t i;
+
+    callbackCount = 0U;
+
+    for( i = 0U; i < iterations; i++ )
+    {
+        SubscriptionManager_DispatchHandler( &mqttContext, &publishes[ i % TOPIC_COUNT ] );
+    }
+
+    return ( callbackCount == expectedMatches( iterations ) ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+static void teardownTrie( void )
+{
+    /* Drop the callbacks, which point at the pools of this file. */
+    SubscriptionManager_Init( trieNodes, TRIE_NODE_COUNT, trieRecords, FILTER_COUNT );
+}
+/*-----------------------------------------------------------*/
+
+static int runLinear( uint32_t iterations )
+{
+    const MQTTPublishInfo_t * pPublish = NULL;
+    uint32_t matches = 0U;
+    uint32_t i, j;
+    bool isMatch = false;
+
+    for( i = 0U; i < iterations; i++ )
+    {
+        pPublish = &publishes[ i % TOPIC_COUNT ];
+
+        for( j = 0U; j < FILTER_COUNT; j++ )
+        {
+            if( ( MQTT_MatchTopic( pPublish->pTopicName, pPublish->topicNameLength,
+                                   filters[ j ], filterLengths[ j ],
+                                   &isMatch ) == MQTTSuccess ) &&
+                ( isMatch == true ) )
+            {
+                matches++;
+            }
+        }
+    }
+
+    return ( matches == expectedMatches( iterations ) ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t topicMatchTrieBenchmark =
+{
+    .pName    = "topic_match/trie",
+    .setup    = setupTrie,
+    .run      = runTrie,
+    .teardown = teardownTrie
+};
+
+const Benchmark_t topicMatchLinearBenchmark =
+{
+    .pName = "topic_match/linear",
+    .setup = setupFilters,
+    .run   = runLinear
+};
+/*-----------------------------------------------------------*/
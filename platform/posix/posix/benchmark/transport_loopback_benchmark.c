@@ -0,0 +1,251 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file transport_loopback_benchmark.c
+ * @brief Benchmarks of sending and receiving through the plaintext transport
+ * over the loopback interface.
+ *
+ * A server thread accepts the connection of #Plaintext_Connect. For
+ * "transport/send_4k" it reads and drops everything the client sends; for
+ * "transport/recv_4k" it sends a stream until the client disconnects. Each
+ * operation moves 4 KB, the size of an OTA block, calling #Plaintext_Send or
+ * #Plaintext_Recv until all of it is through, the way coreMQTT does. The
+ * TLS record layer is measured by openssl_recv_benchmark.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* Transport includes. */
+#include "plaintext_posix.h"
+
+#include "benchmark.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Bytes moved per operation.
+ */
+#define CHUNK_SIZE            4096U
+
+/**
+ * @brief Send and receive timeouts of the client socket.
+ */
+#define TRANSPORT_TIMEOUT_MS  1000U
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    PlaintextParams_t * pParams;
+};
+
+/**
+ * @brief The loopback server of a benchmark.
+ */
+typedef struct LoopbackServer
+{
+    int listenSocket; /**< @brief Listening socket on the loopback interface. */
+    uint16_t port;    /**< @brief Port of #listenSocket in host-order. */
+    bool source;      /**< @brief Whether the server sends, rather than receives. */
+    pthread_t thread; /**< @brief The thread serving the connection. */
+} LoopbackServer_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The server and the client connection.
+ */
+static LoopbackServer_t server;
+static PlaintextParams_t plaintextParams;
+static NetworkContext_t networkContext = { &plaintextParams };
+
+/**
+ * @brief The data sent and received by the client.
+ */
+static uint8_t chunk[ CHUNK_SIZE ];
+
+/*-----------------------------------------------------------*/
+
+static void * serverTask( void * pParameters )
+{
+    static uint8_t buffer[ CHUNK_SIZE ];
+    LoopbackServer_t * pServer = pParameters;
+    int clientSocket = accept( pServer->listenSocket, NULL, NULL );
+    ssize_t result = 1;
+
+    if( clientSocket >= 0 )
+    {
+        ( void ) memset( buffer, 0x5A, sizeof( buffer ) );
+
+        /* Serve until the client disconnects. MSG_NOSIGNAL turns the
+         * SIGPIPE of a send past the disconnect into an error. */
+        while( result > 0 )
+        {
+            result = ( pServer->source == true ) ?
+                     send( clientSocket, buffer, sizeof( buffer ), MSG_NOSIGNAL ) :
+                     recv( clientSocket, buffer, sizeof( buffer ), 0 );
+        }
+
+        ( void ) close( clientSocket );
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static int startServer( bool source )
+{
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof( address );
+    ServerInfo_t serverInfo = { 0 };
+    int status = -1;
+
+    ( void ) memset( &address, 0, sizeof( address ) );
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    address.sin_port = 0;
+
+    server.source = source;
+    server.listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+
+    if( ( server.listenSocket >= 0 ) &&
+        ( bind( server.listenSocket, ( struct sockaddr * ) &address, sizeof( address ) ) == 0 ) &&
+        ( listen( server.listenSocket, 1 ) == 0 ) &&
+        ( getsockname( server.listenSocket, ( struct sockaddr * ) &address, &addressLength ) == 0 ) &&
+        ( pthread_create( &server.thread, NULL, serverTask, &server ) == 0 ) )
+    {
+        server.port = ntohs( address.sin_port );
+        serverInfo.pHostName = "127.0.0.1";
+        serverInfo.hostNameLength = strlen( serverInfo.pHostName );
+        serverInfo.port = server.port;
+
+        if( Plaintext_Connect( &networkContext, &serverInfo,
+                               TRANSPORT_TIMEOUT_MS, TRANSPORT_TIMEOUT_MS ) == SOCKETS_SUCCESS )
+        {
+            status = 0;
+        }
+        else
+        {
+            /* Unblock the accept of the server thread. */
+            ( void ) shutdown( server.listenSocket, SHUT_RDWR );
+            ( void ) pthread_join( server.thread, NULL );
+        }
+    }
+
+    if( ( status != 0 ) && ( server.listenSocket >= 0 ) )
+    {
+        ( void ) close( server.listenSocket );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int setupSend( void )
+{
+    ( void ) memset( chunk, 0xA5, sizeof( chunk ) );
+
+    return startServer( false );
+}
+/*-----------------------------------------------------------*/
+
+static int setupRecv( void )
+{
+    return startServer( true );
+}
+/*-----------------------------------------------------------*/
+
+static void teardownServer( void )
+{
+    ( void ) Plaintext_Disconnect( &networkContext );
+    ( void ) pthread_join( server.thread, NULL );
+    ( void ) close( server.listenSocket );
+}
+/*-----------------------------------------------------------*/
+
+static int runSend( uint32_t iterations )
+{
+    size_t sent = 0U;
+    int32_t result = 0;
+    uint32_t i;
+
+    for( i = 0U; ( i < iterations ) && ( result >= 0 ); i++ )
+    {
+        /* A full socket buffer sends 0 bytes, and the send is retried. */
+        for( sent = 0U; ( sent < CHUNK_SIZE ) && ( result >= 0 ); sent += ( size_t ) result )
+        {
+            result = Plaintext_Send( &networkContext, &chunk[ sent ], CHUNK_SIZE - sent );
+        }
+    }
+
+    return ( result >= 0 ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+static int runRecv( uint32_t iterations )
+{
+    size_t received = 0U;
+    int32_t result = 0;
+    uint32_t i;
+
+    for( i = 0U; ( i < iterations ) && ( result >= 0 ); i++ )
+    {
+        for( received = 0U; ( received < CHUNK_SIZE ) && ( result >= 0 ); received += ( size_t ) result )
+        {
+            result = Plaintext_Recv( &networkContext, &chunk[ received ], CHUNK_SIZE - received );
+        }
+    }
+
+    /* The server only sends 0x5A. */
+    return ( ( result >= 0 ) && ( chunk[ 0 ] == 0x5AU ) && ( chunk[ CHUNK_SIZE - 1U ] == 0x5AU ) ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+const Benchmark_t transportSendBenchmark =
+{
+    .pName      = "transport/send_4k",
+    .bytesPerOp = CHUNK_SIZE,
+    .setup      = setupSend,
+    .run        = runSend,
+    .teardown   = teardownServer
+};
+
+const Benchmark_t transportRecvBenchmark =
+{
+    .pName      = "transport/recv_4k",
+    .bytesPerOp = CHUNK_SIZE,
+    .setup      = setupRecv,
+    .run        = runRecv,
+    .teardown   = teardownServer
+};
+/*-----------------------------------------------------------*/
@@ -40,6 +40,8 @@
  */
 #define NANOSECONDS_PER_MILLISECOND    ( 1000000L )    /**< @brief Nanoseconds per millisecond. */
 #define MILLISECONDS_PER_SECOND        ( 1000L )       /**< @brief Milliseconds per second. */
+#define NANOSECONDS_PER_MICROSECOND    ( 1000L )       /**< @brief Nanoseconds per microsecond. */
+#define MICROSECONDS_PER_SECOND        ( 1000000L )    /**< @brief Microseconds per second. */
 
 /*-----------------------------------------------------------*/
 
@@ -75,3 +77,31 @@ void Clock_SleepMs( uint32_t sleepTimeMs )
     /* High resolution sleep. */
     ( void ) nanosleep( &sleepTime, NULL );
 }
+
+/*-----------------------------------------------------------*/
+
+uint64_t Clock_GetTimeUs( void )
+{
+    struct timespec timeSpec;
+
+    /* Get the MONOTONIC time. */
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &timeSpec );
+
+    /* Calculate the microseconds from timespec, in 64 bits so it doesn't wrap. */
+    return ( ( uint64_t ) timeSpec.tv_sec * ( uint64_t ) MICROSECONDS_PER_SECOND )
+           + ( ( uint64_t ) timeSpec.tv_nsec / ( uint64_t ) NANOSECONDS_PER_MICROSECOND );
+}
+
+/*-----------------------------------------------------------*/
+
+void Clock_SleepUs( uint64_t sleepTimeUs )
+{
+    /* Convert parameter to timespec. */
+    struct timespec sleepTime = { 0 };
+
+    sleepTime.tv_sec = ( time_t ) ( sleepTimeUs / ( uint64_t ) MICROSECONDS_PER_SECOND );
+    sleepTime.tv_nsec = ( long ) ( sleepTimeUs % ( uint64_t ) MICROSECONDS_PER_SECOND ) * NANOSECONDS_PER_MICROSECOND;
+
+    /* High resolution sleep. */
+    ( void ) nanosleep( &sleepTime, NULL );
+}
@@ -0,0 +1,124 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file energy_meter_posix.c
+ * @brief The POSIX port of the energy meter.
+ *
+ * The CPU time of a thread is its CPU-time clock. An external power monitor
+ * can be read by naming, in the ENERGY_METER_MONITOR environment variable, a
+ * file that holds the energy it measured, in microjoules, as a decimal
+ * counter: the powercap files of Linux, such as
+ * /sys/class/powercap/intel-rapl:0/energy_uj, or a file that the logger of
+ * a bench power monitor rewrites. The file is read again at the start and at
+ * the end of each operation, which is then given the difference in place of
+ * the estimate.
+ */
+
+/* Standard includes. */
+#include <stdlib.h>
+
+/* POSIX includes. */
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "energy_meter.h"
+
+/**
+ * @brief The environment variable naming the file of the monitor.
+ */
+#define MONITOR_ENVIRONMENT_VARIABLE    "ENERGY_METER_MONITOR"
+
+/**
+ * @brief The file of the monitor, or -1 if there is none.
+ */
+static int monitorFd = -1;
+
+/**
+ * @brief Opens the file of the monitor once.
+ */
+static pthread_once_t monitorOnce = PTHREAD_ONCE_INIT;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Opens the file named by #MONITOR_ENVIRONMENT_VARIABLE, if any.
+ */
+static void openMonitor( void );
+
+/*-----------------------------------------------------------*/
+
+static void openMonitor( void )
+{
+    const char * pPath = getenv( MONITOR_ENVIRONMENT_VARIABLE );
+
+    if( ( pPath != NULL ) && ( pPath[ 0 ] != '\0' ) )
+    {
+        monitorFd = open( pPath, O_RDONLY | O_CLOEXEC );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool EnergyMeter_PortCpuTimeUs( uint32_t * pTimeUs )
+{
+    struct timespec cpuTime;
+    bool known = false;
+
+    if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cpuTime ) == 0 )
+    {
+        *pTimeUs = ( uint32_t ) ( ( ( uint64_t ) cpuTime.tv_sec * 1000000U ) +
+                                  ( ( uint64_t ) cpuTime.tv_nsec / 1000U ) );
+        known = true;
+    }
+
+    return known;
+}
+
+/*-----------------------------------------------------------*/
+
+bool EnergyMeter_PortEnergyUj( uint64_t * pEnergyUj )
+{
+    char counter[ 32 ];
+    char * pEnd = NULL;
+    ssize_t length = -1;
+    bool known = false;
+
+    ( void ) pthread_once( &monitorOnce, openMonitor );
+
+    if( monitorFd >= 0 )
+    {
+        /* pread, so that threads don't share a file offset. */
+        length = pread( monitorFd, counter, sizeof( counter ) - 1U, 0 );
+    }
+
+    if( length > 0 )
+    {
+        counter[ length ] = '\0';
+        *pEnergyUj = strtoull( counter, &pEnd, 10 );
+        known = ( pEnd != counter );
+    }
+
+    return known;
+}
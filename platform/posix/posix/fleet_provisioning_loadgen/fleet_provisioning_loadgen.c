@@ -0,0 +1,1542 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fleet_provisioning_loadgen.c
+ * @brief Load generator for fleet provisioning by claim, simulating many
+ * devices provisioning against an AWS IoT endpoint at once.
+ *
+ * Every simulated device connects with the claim credentials, subscribes to
+ * the CBOR accepted and rejected topics of CreateKeysAndCertificate and
+ * RegisterThing, calls both APIs the way the fleet_prov_simple demos do, and
+ * disconnects once its Thing is registered. Devices arrive at a fixed rate,
+ * and at most a given number of them are in flight; a device due while all
+ * slots are busy waits for a slot, which is reported as the "queue" phase.
+ *
+ * All connections run on one thread over the epoll reactor of the transport.
+ * MQTT packets are built and parsed with the coreMQTT serializer API, so no
+ * call waits for the broker: a device moves to its next step when its
+ * response is dispatched. The latency of every phase is recorded in a
+ * log-linear histogram, with a precision of 1/8 of the value, and every
+ * device ends with one outcome. Rejected requests are also counted by the
+ * statusCode of the rejection, such as 429 when the account is throttled.
+ *
+ * Usage: fleet_provisioning_loadgen -e <endpoint> -r <root CA> -c <claim cert>
+ *        -k <claim key> -t <template name> [-p <port>] [-n <devices>]
+ *        [-a <arrivals per second, 0 for all at once>] [-m <max in flight>]
+ *        [-w <response timeout ms>] [-s <serial prefix>] [-R]
+ *
+ * -R shares one SSL context between the devices, which also resumes the TLS
+ * session of the first one; real devices do a full handshake each.
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <unistd.h>
+#include <sys/resource.h>
+
+/* Transport includes. */
+#include "openssl_posix.h"
+#include "transport_reactor_posix.h"
+
+/* MQTT serializer include. */
+#include "core_mqtt_serializer.h"
+
+/* Fleet Provisioning library include. */
+#include "fleet_provisioning.h"
+
+/* CBOR includes. */
+#include "cbor.h"
+#include "fleet_provisioning_serializer.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief MQTT port used when none is given on the command line.
+ */
+#define DEFAULT_PORT                     8883U
+
+/**
+ * @brief Number of devices simulated when no count is given.
+ */
+#define DEFAULT_DEVICE_COUNT             100U
+
+/**
+ * @brief Devices arriving per second when no rate is given.
+ */
+#define DEFAULT_ARRIVAL_RATE             10.0
+
+/**
+ * @brief Devices in flight at once when no limit is given.
+ */
+#define DEFAULT_MAX_IN_FLIGHT            1000U
+
+/**
+ * @brief Limit for the connect and for each response, when none is given.
+ */
+#define DEFAULT_RESPONSE_TIMEOUT_MS      10000U
+
+/**
+ * @brief Prefix of the serial numbers and client identifiers of the devices,
+ * followed by the index of the device.
+ */
+#define DEFAULT_SERIAL_PREFIX            "loadgen-"
+
+/**
+ * @brief ALPN protocol of MQTT over port 443.
+ */
+#define AWS_IOT_MQTT_ALPN                "\x0ex-amzn-mqtt-ca"
+#define AWS_IOT_MQTT_ALPN_LENGTH         ( ( uint32_t ) ( sizeof( AWS_IOT_MQTT_ALPN ) - 1U ) )
+
+/**
+ * @brief Size of the read-ahead buffer of each connection.
+ */
+#define READ_AHEAD_BUFFER_SIZE           4096U
+
+/**
+ * @brief Size of the buffer assembling received packets. It must hold a
+ * CreateKeysAndCertificate response, with its certificate and private key.
+ */
+#define RECEIVE_BUFFER_SIZE              8192U
+
+/**
+ * @brief Size of the buffer for the packets sent, without their payload.
+ */
+#define SEND_BUFFER_SIZE                 1024U
+
+/**
+ * @brief Size of the buffer for the RegisterThing request payload.
+ */
+#define PAYLOAD_BUFFER_SIZE              1024U
+
+/**
+ * @brief Size of the buffers for the RegisterThing topics.
+ */
+#define TOPIC_BUFFER_SIZE                256U
+
+/**
+ * @brief Size of the buffer for the serial number of a device.
+ */
+#define SERIAL_BUFFER_SIZE               64U
+
+/**
+ * @brief Send timeout of the established connections.
+ */
+#define TRANSPORT_SEND_TIMEOUT_MS        1000U
+
+/**
+ * @brief Receive timeout of the established connections. The socket is only
+ * read once it is readable, so this only bounds how long the reactor thread
+ * waits for the rest of a partly received TLS record, or for the close notify
+ * of the broker.
+ */
+#define TRANSPORT_RECV_TIMEOUT_MS        50U
+
+/**
+ * @brief Keep-alive interval sent in the CONNECT packets.
+ */
+#define MQTT_KEEP_ALIVE_INTERVAL_S       60U
+
+/**
+ * @brief Packet identifiers of the packets sent by each device.
+ */
+#define SUBSCRIBE_PACKET_ID              1U
+#define CREATE_KEYS_PACKET_ID            2U
+#define REGISTER_THING_PACKET_ID         3U
+
+/**
+ * @brief Longest wait of the reactor, so that arrivals and response
+ * deadlines are handled on time.
+ */
+#define DISPATCH_TIMEOUT_MS              10U
+
+/**
+ * @brief Interval between two scans for devices past their deadline.
+ */
+#define DEADLINE_SCAN_INTERVAL_US        50000U
+
+/**
+ * @brief Distinct rejection statusCode values counted per API. Further
+ * values are counted together.
+ */
+#define MAX_STATUS_CODES                 8U
+
+/**
+ * @brief Each power of two of a histogram is split in 2^HISTOGRAM_SUB_BUCKET_BITS
+ * buckets.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS        3U
+#define HISTOGRAM_SUB_BUCKETS            ( 1U << HISTOGRAM_SUB_BUCKET_BITS )
+
+/**
+ * @brief Number of buckets of a histogram, covering values up to 2^36 us.
+ * Longer values are counted in the last bucket.
+ */
+#define HISTOGRAM_BUCKET_COUNT           ( ( 36U - HISTOGRAM_SUB_BUCKET_BITS + 1U ) * HISTOGRAM_SUB_BUCKETS )
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    OpensslParams_t * pParams;
+};
+
+/**
+ * @brief The phases of a device. A device waits for the end of one phase at
+ * a time; #PHASE_QUEUE and #PHASE_TOTAL are only recorded.
+ */
+typedef enum LoadgenPhase
+{
+    PHASE_QUEUE = 0,  /**< @brief From the arrival of the device until a slot is free. */
+    PHASE_TLS,        /**< @brief DNS lookup, TCP connect and TLS handshake. */
+    PHASE_CONNACK,    /**< @brief From the CONNECT packet until the CONNACK. */
+    PHASE_SUBACK,     /**< @brief From the SUBSCRIBE packet until the SUBACK. */
+    PHASE_CREATE,     /**< @brief From the CreateKeysAndCertificate request until its response. */
+    PHASE_REGISTER,   /**< @brief From the RegisterThing request until its response. */
+    PHASE_TOTAL,      /**< @brief From the arrival of the device until its Thing is registered. */
+    PHASE_COUNT
+} LoadgenPhase_t;
+
+/**
+ * @brief How a device ended.
+ */
+typedef enum LoadgenOutcome
+{
+    OUTCOME_PROVISIONED = 0,
+    OUTCOME_DNS_FAILURE,
+    OUTCOME_CONNECT_FAILURE,
+    OUTCOME_HANDSHAKE_FAILURE,
+    OUTCOME_CONNECT_TIMEOUT,
+    OUTCOME_CONNACK_REFUSED,
+    OUTCOME_SUBACK_REFUSED,
+    OUTCOME_CREATE_REJECTED,
+    OUTCOME_REGISTER_REJECTED,
+    OUTCOME_RESPONSE_TIMEOUT,
+    OUTCOME_TRANSPORT_ERROR,
+    OUTCOME_PROTOCOL_ERROR,
+    OUTCOME_COUNT
+} LoadgenOutcome_t;
+
+/**
+ * @brief The fleet provisioning APIs whose rejections are counted.
+ */
+typedef enum LoadgenApi
+{
+    API_CREATE_KEYS = 0,
+    API_REGISTER_THING,
+    API_COUNT
+} LoadgenApi_t;
+
+/**
+ * @brief Log-linear latency histogram, in microseconds.
+ */
+typedef struct Histogram
+{
+    uint64_t counts[ HISTOGRAM_BUCKET_COUNT ];
+    uint64_t count;  /**< @brief Number of values recorded. */
+    uint64_t sumUs;  /**< @brief Sum of the values, for the mean. */
+    uint64_t maxUs;  /**< @brief Largest value, reported exactly. */
+} Histogram_t;
+
+/**
+ * @brief Rejections of one API, by statusCode.
+ */
+typedef struct Rejections
+{
+    int64_t statusCodes[ MAX_STATUS_CODES ];
+    uint64_t counts[ MAX_STATUS_CODES ];
+    uint32_t statusCodeCount; /**< @brief Used entries of #statusCodes. */
+    uint64_t otherCount;      /**< @brief Rejections without a statusCode, or with one past #MAX_STATUS_CODES. */
+} Rejections_t;
+
+/**
+ * @brief Command line parameters.
+ */
+typedef struct LoadgenConfig
+{
+    const char * pEndpoint;
+    uint16_t port;
+    const char * pRootCaPath;
+    const char * pClaimCertPath;
+    const char * pClaimKeyPath;
+    const char * pTemplateName;
+    const char * pSerialPrefix;
+    uint32_t deviceCount;
+    double arrivalRate;
+    uint32_t maxInFlight;
+    uint32_t responseTimeoutMs;
+    bool reuseSslContext;
+} LoadgenConfig_t;
+
+/**
+ * @brief A slot for a device in flight, reused by the next device once the
+ * current one has ended.
+ */
+typedef struct Device
+{
+    bool inUse;
+    uint32_t index;          /**< @brief Index of the device, in arrival order. */
+    LoadgenPhase_t phase;    /**< @brief Phase whose end the device waits for. */
+    uint64_t arrivalUs;      /**< @brief Scheduled arrival of the device. */
+    uint64_t phaseStartUs;   /**< @brief Start of #phase. */
+    uint64_t deadlineUs;     /**< @brief Time at which #phase times out; 0 while the reactor owns the timeout. */
+    NetworkContext_t networkContext;
+    OpensslParams_t opensslParams;
+    ReactorConnection_t connection;
+    size_t receivedLength;   /**< @brief Bytes of #receiveBuffer not yet parsed as packets. */
+    char serial[ SERIAL_BUFFER_SIZE ];
+    size_t serialLength;
+    uint8_t readAheadBuffer[ READ_AHEAD_BUFFER_SIZE ];
+    uint8_t receiveBuffer[ RECEIVE_BUFFER_SIZE ];
+
+    /* The payload of a response, copied out of #receiveBuffer as parsing it
+     * writes a terminator after its last field. */
+    uint8_t responseBuffer[ RECEIVE_BUFFER_SIZE + 1U ];
+    uint8_t sendBuffer[ SEND_BUFFER_SIZE ];
+    uint8_t payloadBuffer[ PAYLOAD_BUFFER_SIZE ];
+} Device_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Names of the phases, for the report.
+ */
+static const char * const phaseNames[ PHASE_COUNT ] =
+{
+    "queue", "tls", "connack", "suback", "create", "register", "total"
+};
+
+/**
+ * @brief Names of the outcomes, for the report.
+ */
+static const char * const outcomeNames[ OUTCOME_COUNT ] =
+{
+    "provisioned",       "dns failure",        "connect failure",
+    "handshake failure", "connect timeout",    "connack refused",
+    "suback refused",    "create rejected",    "register rejected",
+    "response timeout",  "transport error",    "protocol error"
+};
+
+/**
+ * @brief Names of the APIs, for the report.
+ */
+static const char * const apiNames[ API_COUNT ] =
+{
+    "CreateKeysAndCertificate", "RegisterThing"
+};
+
+/**
+ * @brief Command line parameters.
+ */
+static LoadgenConfig_t config;
+
+/**
+ * @brief The reactor running every connection.
+ */
+static Reactor_t reactor;
+
+/**
+ * @brief Server and claim credentials, shared by every connection.
+ */
+static ServerInfo_t serverInfo;
+static OpensslCredentials_t claimCredentials;
+
+/**
+ * @brief RegisterThing topics of the template.
+ */
+static char registerPublishTopic[ TOPIC_BUFFER_SIZE ];
+static uint16_t registerPublishTopicLength = 0U;
+static char registerAcceptedTopic[ TOPIC_BUFFER_SIZE ];
+static uint16_t registerAcceptedTopicLength = 0U;
+static char registerRejectedTopic[ TOPIC_BUFFER_SIZE ];
+static uint16_t registerRejectedTopicLength = 0U;
+
+/**
+ * @brief The device slots, and a stack of the free ones.
+ */
+static Device_t * pDevices = NULL;
+static Device_t ** ppFreeDevices = NULL;
+static uint32_t freeDeviceCount = 0U;
+
+/**
+ * @brief Results of the run.
+ */
+static Histogram_t histograms[ PHASE_COUNT ];
+static uint64_t phaseTimeouts[ PHASE_COUNT ];
+static uint64_t outcomes[ OUTCOME_COUNT ];
+static Rejections_t rejections[ API_COUNT ];
+static uint32_t peakInFlight = 0U;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Monotonic time in microseconds.
+ */
+static uint64_t nowUs( void );
+
+/**
+ * @brief Bucket of a value in a histogram.
+ */
+static uint32_t histogramBucket( uint64_t valueUs );
+
+/**
+ * @brief Middle of the values counted in a bucket.
+ */
+static uint64_t histogramBucketValue( uint32_t bucket );
+
+/**
+ * @brief Add a value to a histogram.
+ */
+static void histogramRecord( Histogram_t * pHistogram,
+                             uint64_t valueUs );
+
+/**
+ * @brief Estimate a percentile of the values of a histogram.
+ *
+ * @return The percentile in microseconds, or 0 for an empty histogram.
+ */
+static uint64_t histogramPercentile( const Histogram_t * pHistogram,
+                                     uint32_t percentile );
+
+/**
+ * @brief Count a rejected request by the statusCode of its payload.
+ */
+static void countRejection( LoadgenApi_t api,
+                            const uint8_t * pPayload,
+                            size_t payloadLength );
+
+/**
+ * @brief Record the end of the current phase of a device and start the next.
+ */
+static void nextPhase( Device_t * pDevice,
+                       LoadgenPhase_t phase );
+
+/**
+ * @brief Close the connection of a device, record its outcome and free its
+ * slot.
+ */
+static void finishDevice( Device_t * pDevice,
+                          LoadgenOutcome_t outcome );
+
+/**
+ * @brief Send a whole buffer on the connection of a device.
+ *
+ * @return true if every byte was sent.
+ */
+static bool sendAll( Device_t * pDevice,
+                     const uint8_t * pData,
+                     size_t length );
+
+/**
+ * @brief Send the CONNECT packet of a device.
+ */
+static bool sendConnect( Device_t * pDevice );
+
+/**
+ * @brief Subscribe to the accepted and rejected topics of both APIs.
+ */
+static bool sendSubscribe( Device_t * pDevice );
+
+/**
+ * @brief Send a QoS 1 PUBLISH packet, without copying its payload into the
+ * send buffer.
+ */
+static bool sendPublish( Device_t * pDevice,
+                         const char * pTopic,
+                         uint16_t topicLength,
+                         const uint8_t * pPayload,
+                         size_t payloadLength,
+                         uint16_t packetId );
+
+/**
+ * @brief Handle a response to the CreateKeysAndCertificate or RegisterThing
+ * API.
+ */
+static void handleProvisioningResponse( Device_t * pDevice,
+                                        FleetProvisioningTopic_t topic,
+                                        const MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Handle a received MQTT packet.
+ */
+static void handlePacket( Device_t * pDevice,
+                          MQTTPacketInfo_t * pPacketInfo );
+
+/**
+ * @brief Handle the complete packets at the start of the receive buffer of a
+ * device, and keep the rest for the next read.
+ *
+ * @return false if the device ended.
+ */
+static bool processPackets( Device_t * pDevice );
+
+/**
+ * @brief Reactor callback of a finished connect.
+ */
+static void connectCallback( ReactorConnection_t * pConnection,
+                             ReactorStatus_t status,
+                             void * pUserContext );
+
+/**
+ * @brief Reactor callback of a readable connection. Reads everything the
+ * connection has without blocking, so the thread serves the next one.
+ */
+static void receiveCallback( ReactorConnection_t * pConnection,
+                             void * pUserContext );
+
+/**
+ * @brief Start the connect of the device of index @p index in a free slot.
+ */
+static void startDevice( uint32_t index,
+                         uint64_t arrivalUs );
+
+/**
+ * @brief End the devices whose response is past its deadline.
+ */
+static void expireDevices( uint64_t timeUs );
+
+/**
+ * @brief Run every device until it has ended.
+ *
+ * @return 0 on success, -1 if the reactor failed.
+ */
+static int runLoad( void );
+
+/**
+ * @brief Print the outcomes, latency histograms and rejections.
+ */
+static void printReport( double elapsedS );
+
+/**
+ * @brief Read the command line into #config.
+ *
+ * @return 0 on success, -1 if a required parameter is missing or invalid.
+ */
+static int parseArguments( int argc,
+                           char ** argv );
+
+/*-----------------------------------------------------------*/
+
+static uint64_t nowUs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000U ) + ( ( uint64_t ) now.tv_nsec / 1000U );
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t histogramBucket( uint64_t valueUs )
+{
+    uint32_t bucket = ( uint32_t ) valueUs;
+    uint32_t magnitude = 0U;
+
+    if( valueUs >= HISTOGRAM_SUB_BUCKETS )
+    {
+        /* The power of two of the value selects a group of buckets, and the
+         * bits below its top bit the bucket in the group. */
+        magnitude = 63U - ( uint32_t ) __builtin_clzll( valueUs );
+        bucket = ( ( magnitude - HISTOGRAM_SUB_BUCKET_BITS + 1U ) * HISTOGRAM_SUB_BUCKETS ) +
+                 ( uint32_t ) ( ( valueUs >> ( magnitude - HISTOGRAM_SUB_BUCKET_BITS ) ) & ( HISTOGRAM_SUB_BUCKETS - 1U ) );
+    }
+
+    return ( bucket < HISTOGRAM_BUCKET_COUNT ) ? bucket : ( HISTOGRAM_BUCKET_COUNT - 1U );
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t histogramBucketValue( uint32_t bucket )
+{
+    uint64_t value = bucket;
+    uint32_t shift = 0U;
+
+    if( bucket >= HISTOGRAM_SUB_BUCKETS )
+    {
+        shift = ( bucket / HISTOGRAM_SUB_BUCKETS ) - 1U;
+        value = ( ( uint64_t ) HISTOGRAM_SUB_BUCKETS + ( bucket % HISTOGRAM_SUB_BUCKETS ) ) << shift;
+        value += ( ( uint64_t ) 1U << shift ) / 2U;
+    }
+
+    return value;
+}
+/*-----------------------------------------------------------*/
+
+static void histogramRecord( Histogram_t * pHistogram,
+                             uint64_t valueUs )
+{
+    pHistogram->counts[ histogramBucket( valueUs ) ]++;
+    pHistogram->count++;
+    pHistogram->sumUs += valueUs;
+
+    if( valueUs > pHistogram->maxUs )
+    {
+        pHistogram->maxUs = valueUs;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t histogramPercentile( const Histogram_t * pHistogram,
+                                     uint32_t percentile )
+{
+    uint64_t rank = ( ( pHistogram->count * percentile ) + 99U ) / 100U;
+    uint64_t seen = 0U;
+    uint64_t value = 0U;
+    uint32_t bucket;
+
+    for( bucket = 0U; ( bucket < HISTOGRAM_BUCKET_COUNT ) && ( pHistogram->count > 0U ); bucket++ )
+    {
+        seen += pHistogram->counts[ bucket ];
+
+        if( ( seen >= rank ) && ( seen > 0U ) )
+        {
+            value = histogramBucketValue( bucket );
+            break;
+        }
+    }
+
+    return ( value < pHistogram->maxUs ) ? value : pHistogram->maxUs;
+}
+/*-----------------------------------------------------------*/
+
+static void countRejection( LoadgenApi_t api,
+                            const uint8_t * pPayload,
+                            size_t payloadLength )
+{
+    Rejections_t * pRejections = &rejections[ api ];
+    CborParser parser;
+    CborValue map, value;
+    int statusCode = 0;
+    bool found = false;
+    uint32_t i;
+
+    if( ( cbor_parser_init( pPayload, payloadLength, 0, &parser, &map ) == CborNoError ) &&
+        cbor_value_is_map( &map ) &&
+        ( cbor_value_map_find_value( &map, "statusCode", &value ) == CborNoError ) &&
+        cbor_value_is_integer( &value ) &&
+        ( cbor_value_get_int( &value, &statusCode ) == CborNoError ) )
+    {
+        for( i = 0U; ( i < pRejections->statusCodeCount ) && ( found == false ); i++ )
+        {
+            if( pRejections->statusCodes[ i ] == ( int64_t ) statusCode )
+            {
+                pRejections->counts[ i ]++;
+                found = true;
+            }
+        }
+
+        if( ( found == false ) && ( pRejections->statusCodeCount < MAX_STATUS_CODES ) )
+        {
+            pRejections->statusCodes[ pRejections->statusCodeCount ] = ( int64_t ) statusCode;
+            pRejections->counts[ pRejections->statusCodeCount ] = 1U;
+            pRejections->statusCodeCount++;
+            found = true;
+        }
+    }
+
+    if( found == false )
+    {
+        pRejections->otherCount++;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void nextPhase( Device_t * pDevice,
+                       LoadgenPhase_t phase )
+{
+    uint64_t timeUs = nowUs();
+
+    histogramRecord( &histograms[ pDevice->phase ], timeUs - pDevice->phaseStartUs );
+
+    pDevice->phase = phase;
+    pDevice->phaseStartUs = timeUs;
+    pDevice->deadlineUs = timeUs + ( ( uint64_t ) config.responseTimeoutMs * 1000U );
+}
+/*-----------------------------------------------------------*/
+
+static void finishDevice( Device_t * pDevice,
+                          LoadgenOutcome_t outcome )
+{
+    if( pDevice->connection.state == REACTOR_STATE_READY )
+    {
+        /* Reactor_Remove leaves an established connection open. */
+        ( void ) Reactor_Remove( &reactor, &pDevice->connection );
+        ( void ) Openssl_Disconnect( &pDevice->networkContext );
+    }
+    else
+    {
+        /* Aborts a connect still in progress; does nothing on a failed one. */
+        ( void ) Reactor_Remove( &reactor, &pDevice->connection );
+    }
+
+    if( outcome == OUTCOME_PROVISIONED )
+    {
+        histogramRecord( &histograms[ PHASE_TOTAL ], nowUs() - pDevice->arrivalUs );
+    }
+
+    outcomes[ outcome ]++;
+    pDevice->inUse = false;
+    ppFreeDevices[ freeDeviceCount ] = pDevice;
+    freeDeviceCount++;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendAll( Device_t * pDevice,
+                     const uint8_t * pData,
+                     size_t length )
+{
+    size_t sent = 0U;
+    int32_t status = 0;
+
+    /* Openssl_Send returns 0 while the socket buffer is full. */
+    while( ( sent < length ) && ( status >= 0 ) )
+    {
+        status = Openssl_Send( &pDevice->networkContext, &pData[ sent ], length - sent );
+
+        if( status > 0 )
+        {
+            sent += ( size_t ) status;
+        }
+    }
+
+    return ( sent == length );
+}
+/*-----------------------------------------------------------*/
+
+static bool sendConnect( Device_t * pDevice )
+{
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U;
+    bool status = false;
+
+    connectInfo.cleanSession = true;
+    connectInfo.keepAliveIntervalSec = MQTT_KEEP_ALIVE_INTERVAL_S;
+    connectInfo.pClientIdentifier = pDevice->serial;
+    connectInfo.clientIdentifierLength = ( uint16_t ) pDevice->serialLength;
+
+    fixedBuffer.pBuffer = pDevice->sendBuffer;
+    fixedBuffer.size = sizeof( pDevice->sendBuffer );
+
+    if( ( MQTT_GetConnectPacketSize( &connectInfo, NULL, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( packetSize <= fixedBuffer.size ) &&
+        ( MQTT_SerializeConnect( &connectInfo, NULL, remainingLength, &fixedBuffer ) == MQTTSuccess ) )
+    {
+        status = sendAll( pDevice, pDevice->sendBuffer, packetSize );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendSubscribe( Device_t * pDevice )
+{
+    MQTTSubscribeInfo_t subscriptions[ 4 ];
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U;
+    size_t i;
+    bool status = false;
+
+    subscriptions[ 0 ].pTopicFilter = FP_CBOR_CREATE_KEYS_ACCEPTED_TOPIC;
+    subscriptions[ 0 ].topicFilterLength = FP_CBOR_CREATE_KEYS_ACCEPTED_LENGTH;
+    subscriptions[ 1 ].pTopicFilter = FP_CBOR_CREATE_KEYS_REJECTED_TOPIC;
+    subscriptions[ 1 ].topicFilterLength = FP_CBOR_CREATE_KEYS_REJECTED_LENGTH;
+    subscriptions[ 2 ].pTopicFilter = registerAcceptedTopic;
+    subscriptions[ 2 ].topicFilterLength = registerAcceptedTopicLength;
+    subscriptions[ 3 ].pTopicFilter = registerRejectedTopic;
+    subscriptions[ 3 ].topicFilterLength = registerRejectedTopicLength;
+
+    for( i = 0U; i < 4U; i++ )
+    {
+        subscriptions[ i ].qos = MQTTQoS1;
+    }
+
+    fixedBuffer.pBuffer = pDevice->sendBuffer;
+    fixedBuffer.size = sizeof( pDevice->sendBuffer );
+
+    if( ( MQTT_GetSubscribePacketSize( subscriptions, 4U, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( packetSize <= fixedBuffer.size ) &&
+        ( MQTT_SerializeSubscribe( subscriptions, 4U, SUBSCRIBE_PACKET_ID, remainingLength, &fixedBuffer ) == MQTTSuccess ) )
+    {
+        status = sendAll( pDevice, pDevice->sendBuffer, packetSize );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendPublish( Device_t * pDevice,
+                         const char * pTopic,
+                         uint16_t topicLength,
+                         const uint8_t * pPayload,
+                         size_t payloadLength,
+                         uint16_t packetId )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U, headerSize = 0U;
+    bool status = false;
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.pTopicName = pTopic;
+    publishInfo.topicNameLength = topicLength;
+    publishInfo.pPayload = pPayload;
+    publishInfo.payloadLength = payloadLength;
+
+    fixedBuffer.pBuffer = pDevice->sendBuffer;
+    fixedBuffer.size = sizeof( pDevice->sendBuffer );
+
+    if( ( MQTT_GetPublishPacketSize( &publishInfo, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( MQTT_SerializePublishHeader( &publishInfo, packetId, remainingLength, &fixedBuffer, &headerSize ) == MQTTSuccess ) )
+    {
+        status = sendAll( pDevice, pDevice->sendBuffer, headerSize );
+
+        if( ( status == true ) && ( payloadLength > 0U ) )
+        {
+            status = sendAll( pDevice, pPayload, payloadLength );
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void handleProvisioningResponse( Device_t * pDevice,
+                                        FleetProvisioningTopic_t topic,
+                                        const MQTTPublishInfo_t * pPublishInfo )
+{
+    ProvisioningResponse_t fields;
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t requestLength = 0U, disconnectSize = 0U;
+
+    /* Parsing writes a terminator after the last field, which could be the
+     * first byte of the next packet in the receive buffer. */
+    ( void ) memcpy( pDevice->responseBuffer, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+
+    if( ( pDevice->phase == PHASE_CREATE ) && ( topic == FleetProvCborCreateKeysAndCertAccepted ) )
+    {
+        if( parseKeyCertResponse( pDevice->responseBuffer,
+                                  pPublishInfo->payloadLength,
+                                  sizeof( pDevice->responseBuffer ),
+                                  &fields ) &&
+            generateRegisterThingRequest( pDevice->payloadBuffer,
+                                          sizeof( pDevice->payloadBuffer ),
+                                          fields.certificateOwnershipToken.pString,
+                                          fields.certificateOwnershipToken.length,
+                                          pDevice->serial,
+                                          pDevice->serialLength,
+                                          &requestLength ) )
+        {
+            nextPhase( pDevice, PHASE_REGISTER );
+
+            if( sendPublish( pDevice, registerPublishTopic, registerPublishTopicLength,
+                             pDevice->payloadBuffer, requestLength, REGISTER_THING_PACKET_ID ) == false )
+            {
+                finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+            }
+        }
+        else
+        {
+            finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+        }
+    }
+    else if( ( pDevice->phase == PHASE_CREATE ) && ( topic == FleetProvCborCreateKeysAndCertRejected ) )
+    {
+        countRejection( API_CREATE_KEYS, pDevice->responseBuffer, pPublishInfo->payloadLength );
+        finishDevice( pDevice, OUTCOME_CREATE_REJECTED );
+    }
+    else if( ( pDevice->phase == PHASE_REGISTER ) && ( topic == FleetProvCborRegisterThingAccepted ) )
+    {
+        if( parseRegisterThingResponse( pDevice->responseBuffer,
+                                        pPublishInfo->payloadLength,
+                                        sizeof( pDevice->responseBuffer ),
+                                        &fields ) )
+        {
+            histogramRecord( &histograms[ PHASE_REGISTER ], nowUs() - pDevice->phaseStartUs );
+
+            /* A missing DISCONNECT doesn't undo the registration. */
+            fixedBuffer.pBuffer = pDevice->sendBuffer;
+            fixedBuffer.size = sizeof( pDevice->sendBuffer );
+
+            if( ( MQTT_GetDisconnectPacketSize( &disconnectSize ) == MQTTSuccess ) &&
+                ( MQTT_SerializeDisconnect( &fixedBuffer ) == MQTTSuccess ) )
+            {
+                ( void ) sendAll( pDevice, pDevice->sendBuffer, disconnectSize );
+            }
+
+            finishDevice( pDevice, OUTCOME_PROVISIONED );
+        }
+        else
+        {
+            finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+        }
+    }
+    else if( ( pDevice->phase == PHASE_REGISTER ) && ( topic == FleetProvCborRegisterThingRejected ) )
+    {
+        countRejection( API_REGISTER_THING, pDevice->responseBuffer, pPublishInfo->payloadLength );
+        finishDevice( pDevice, OUTCOME_REGISTER_REJECTED );
+    }
+    else
+    {
+        /* A response to no request of this device. */
+        finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handlePacket( Device_t * pDevice,
+                          MQTTPacketInfo_t * pPacketInfo )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    FleetProvisioningTopic_t topic = FleetProvisioningInvalidTopic;
+    uint16_t packetId = 0U;
+    bool sessionPresent = false;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    switch( pPacketInfo->type & 0xF0U )
+    {
+        case MQTT_PACKET_TYPE_CONNACK:
+            mqttStatus = MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent );
+
+            if( ( pDevice->phase == PHASE_CONNACK ) && ( mqttStatus == MQTTSuccess ) )
+            {
+                nextPhase( pDevice, PHASE_SUBACK );
+
+                if( sendSubscribe( pDevice ) == false )
+                {
+                    finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+                }
+            }
+            else
+            {
+                finishDevice( pDevice, ( mqttStatus == MQTTServerRefused ) ?
+                              OUTCOME_CONNACK_REFUSED : OUTCOME_PROTOCOL_ERROR );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_SUBACK:
+            mqttStatus = MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent );
+
+            if( ( pDevice->phase == PHASE_SUBACK ) && ( mqttStatus == MQTTSuccess ) )
+            {
+                nextPhase( pDevice, PHASE_CREATE );
+
+                /* CreateKeysAndCertificate takes an empty request. */
+                if( sendPublish( pDevice, FP_CBOR_CREATE_KEYS_PUBLISH_TOPIC, FP_CBOR_CREATE_KEYS_PUBLISH_LENGTH,
+                                 NULL, 0U, CREATE_KEYS_PACKET_ID ) == false )
+                {
+                    finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+                }
+            }
+            else
+            {
+                finishDevice( pDevice, ( mqttStatus == MQTTServerRefused ) ?
+                              OUTCOME_SUBACK_REFUSED : OUTCOME_PROTOCOL_ERROR );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PUBLISH:
+            mqttStatus = MQTT_DeserializePublish( pPacketInfo, &packetId, &publishInfo );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+            }
+            else
+            {
+                if( publishInfo.qos != MQTTQoS0 )
+                {
+                    fixedBuffer.pBuffer = pDevice->sendBuffer;
+                    fixedBuffer.size = MQTT_PUBLISH_ACK_PACKET_SIZE;
+
+                    if( ( MQTT_SerializeAck( &fixedBuffer, MQTT_PACKET_TYPE_PUBACK, packetId ) != MQTTSuccess ) ||
+                        ( sendAll( pDevice, pDevice->sendBuffer, MQTT_PUBLISH_ACK_PACKET_SIZE ) == false ) )
+                    {
+                        mqttStatus = MQTTSendFailed;
+                    }
+                }
+
+                if( mqttStatus != MQTTSuccess )
+                {
+                    finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+                }
+                else if( FleetProvisioning_MatchTopic( publishInfo.pTopicName,
+                                                       publishInfo.topicNameLength,
+                                                       &topic ) == FleetProvisioningSuccess )
+                {
+                    handleProvisioningResponse( pDevice, topic, &publishInfo );
+                }
+                else
+                {
+                    finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+                }
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PUBACK:
+        case MQTT_PACKET_TYPE_PINGRESP:
+            /* The response to a request is its acknowledgement. */
+            break;
+
+        default:
+            finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+            break;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool processPackets( Device_t * pDevice )
+{
+    MQTTPacketInfo_t packetInfo;
+    size_t offset = 0U, headerLength = 0U, remainingLength = 0U, multiplier = 1U;
+    bool complete = true;
+    uint8_t encodedByte = 0U;
+
+    while( ( pDevice->inUse == true ) && ( complete == true ) )
+    {
+        /* Decode the remaining length, at most four bytes after the type. */
+        headerLength = 1U;
+        remainingLength = 0U;
+        multiplier = 1U;
+
+        do
+        {
+            complete = ( offset + headerLength ) < pDevice->receivedLength;
+
+            if( complete == true )
+            {
+                encodedByte = pDevice->receiveBuffer[ offset + headerLength ];
+                remainingLength += ( size_t ) ( encodedByte & 0x7FU ) * multiplier;
+                multiplier *= 128U;
+                headerLength++;
+            }
+        } while( ( complete == true ) && ( ( encodedByte & 0x80U ) != 0U ) && ( headerLength <= 4U ) );
+
+        if( ( complete == true ) && ( ( encodedByte & 0x80U ) != 0U ) )
+        {
+            finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+        }
+        else if( ( complete == true ) && ( ( headerLength + remainingLength ) > sizeof( pDevice->receiveBuffer ) ) )
+        {
+            /* Larger than any response this generator asks for. */
+            finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+        }
+        else if( ( complete == true ) && ( ( offset + headerLength + remainingLength ) <= pDevice->receivedLength ) )
+        {
+            ( void ) memset( &packetInfo, 0, sizeof( packetInfo ) );
+            packetInfo.type = pDevice->receiveBuffer[ offset ];
+            packetInfo.pRemainingData = &pDevice->receiveBuffer[ offset + headerLength ];
+            packetInfo.remainingLength = remainingLength;
+            offset += headerLength + remainingLength;
+
+            handlePacket( pDevice, &packetInfo );
+        }
+        else
+        {
+            complete = false;
+        }
+    }
+
+    if( pDevice->inUse == true )
+    {
+        /* Keep the start of the next packet for the next read. */
+        ( void ) memmove( pDevice->receiveBuffer, &pDevice->receiveBuffer[ offset ], pDevice->receivedLength - offset );
+        pDevice->receivedLength -= offset;
+    }
+
+    return pDevice->inUse;
+}
+/*-----------------------------------------------------------*/
+
+static void connectCallback( ReactorConnection_t * pConnection,
+                             ReactorStatus_t status,
+                             void * pUserContext )
+{
+    Device_t * pDevice = ( Device_t * ) pUserContext;
+
+    ( void ) pConnection;
+
+    if( status == REACTOR_SUCCESS )
+    {
+        nextPhase( pDevice, PHASE_CONNACK );
+
+        if( sendConnect( pDevice ) == false )
+        {
+            finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+        }
+    }
+    else if( status == REACTOR_DNS_FAILURE )
+    {
+        finishDevice( pDevice, OUTCOME_DNS_FAILURE );
+    }
+    else if( status == REACTOR_CONNECT_FAILURE )
+    {
+        finishDevice( pDevice, OUTCOME_CONNECT_FAILURE );
+    }
+    else if( status == REACTOR_HANDSHAKE_FAILED )
+    {
+        finishDevice( pDevice, OUTCOME_HANDSHAKE_FAILURE );
+    }
+    else if( status == REACTOR_TIMEOUT )
+    {
+        phaseTimeouts[ PHASE_TLS ]++;
+        finishDevice( pDevice, OUTCOME_CONNECT_TIMEOUT );
+    }
+    else
+    {
+        finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void receiveCallback( ReactorConnection_t * pConnection,
+                             void * pUserContext )
+{
+    Device_t * pDevice = ( Device_t * ) pUserContext;
+    OpensslParams_t * pParams = &pDevice->opensslParams;
+    size_t space = 0U, request = 0U;
+    int32_t received = 1;
+
+    ( void ) pConnection;
+
+    while( ( pDevice->inUse == true ) && ( received > 0 ) )
+    {
+        space = sizeof( pDevice->receiveBuffer ) - pDevice->receivedLength;
+
+        /* Openssl_Recv only avoids blocking for one byte, which refills the
+         * read-ahead buffer from the readable socket; what it holds is then
+         * taken in one call. */
+        request = ( pParams->readAheadLength > 0U ) ? space : 1U;
+        received = Openssl_Recv( &pDevice->networkContext,
+                                 &pDevice->receiveBuffer[ pDevice->receivedLength ],
+                                 request );
+
+        if( received < 0 )
+        {
+            finishDevice( pDevice, OUTCOME_TRANSPORT_ERROR );
+        }
+        else if( received > 0 )
+        {
+            pDevice->receivedLength += ( size_t ) received;
+            ( void ) processPackets( pDevice );
+        }
+        else
+        {
+            /* Drained. */
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void startDevice( uint32_t index,
+                         uint64_t arrivalUs )
+{
+    Device_t * pDevice = NULL;
+    ReactorConnectInfo_t connectInfo = { 0 };
+    ReactorStatus_t status = REACTOR_SUCCESS;
+    uint64_t timeUs = nowUs();
+    int length = 0;
+
+    freeDeviceCount--;
+    pDevice = ppFreeDevices[ freeDeviceCount ];
+
+    pDevice->inUse = true;
+    pDevice->index = index;
+    pDevice->arrivalUs = arrivalUs;
+    pDevice->receivedLength = 0U;
+    histogramRecord( &histograms[ PHASE_QUEUE ], timeUs - arrivalUs );
+
+    /* The reactor owns the deadline of the connect. */
+    pDevice->phase = PHASE_TLS;
+    pDevice->phaseStartUs = timeUs;
+    pDevice->deadlineUs = 0U;
+
+    length = snprintf( pDevice->serial, sizeof( pDevice->serial ), "%s%" PRIu32, config.pSerialPrefix, index );
+    pDevice->serialLength = ( length > 0 ) ? ( size_t ) length : 0U;
+
+    ( void ) memset( &pDevice->opensslParams, 0, sizeof( pDevice->opensslParams ) );
+    pDevice->opensslParams.pReadAheadBuffer = pDevice->readAheadBuffer;
+    pDevice->opensslParams.readAheadBufferSize = sizeof( pDevice->readAheadBuffer );
+    pDevice->networkContext.pParams = &pDevice->opensslParams;
+
+    connectInfo.pServerInfo = &serverInfo;
+    connectInfo.pOpensslCredentials = &claimCredentials;
+    connectInfo.connectTimeoutMs = config.responseTimeoutMs;
+    connectInfo.sendTimeoutMs = TRANSPORT_SEND_TIMEOUT_MS;
+    connectInfo.recvTimeoutMs = TRANSPORT_RECV_TIMEOUT_MS;
+    connectInfo.connectCallback = connectCallback;
+    connectInfo.receiveCallback = receiveCallback;
+    connectInfo.pUserContext = pDevice;
+
+    if( ( length <= 0 ) || ( pDevice->serialLength >= sizeof( pDevice->serial ) ) )
+    {
+        /* The client identifier and serial would be cut. */
+        finishDevice( pDevice, OUTCOME_PROTOCOL_ERROR );
+    }
+    else
+    {
+        status = Reactor_Connect( &reactor, &pDevice->connection, &pDevice->networkContext, &connectInfo );
+
+        /* Failures to start the connect are reported like failed connects. */
+        if( status != REACTOR_SUCCESS )
+        {
+            connectCallback( &pDevice->connection, status, pDevice );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void expireDevices( uint64_t timeUs )
+{
+    uint32_t i;
+
+    for( i = 0U; i < config.maxInFlight; i++ )
+    {
+        if( ( pDevices[ i ].inUse == true ) &&
+            ( pDevices[ i ].deadlineUs != 0U ) &&
+            ( timeUs >= pDevices[ i ].deadlineUs ) )
+        {
+            phaseTimeouts[ pDevices[ i ].phase ]++;
+            finishDevice( &pDevices[ i ], OUTCOME_RESPONSE_TIMEOUT );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int runLoad( void )
+{
+    uint64_t startUs = nowUs();
+    uint64_t timeUs = startUs, arrivalUs = startUs, lastScanUs = startUs;
+    uint32_t nextIndex = 0U, inFlight = 0U, timeoutMs = 0U;
+    int result = 0;
+
+    while( ( result == 0 ) && ( ( nextIndex < config.deviceCount ) || ( freeDeviceCount < config.maxInFlight ) ) )
+    {
+        timeUs = nowUs();
+        timeoutMs = DISPATCH_TIMEOUT_MS;
+
+        while( nextIndex < config.deviceCount )
+        {
+            arrivalUs = startUs;
+
+            if( config.arrivalRate > 0.0 )
+            {
+                arrivalUs += ( uint64_t ) ( ( ( double ) nextIndex * 1000000.0 ) / config.arrivalRate );
+            }
+
+            if( arrivalUs > timeUs )
+            {
+                /* Wake up for the next arrival. */
+                if( ( ( arrivalUs - timeUs ) / 1000U ) < timeoutMs )
+                {
+                    timeoutMs = ( uint32_t ) ( ( arrivalUs - timeUs ) / 1000U );
+                }
+
+                break;
+            }
+            else if( freeDeviceCount == 0U )
+            {
+                /* The device waits for a slot, in the queue phase. */
+                break;
+            }
+            else
+            {
+                startDevice( nextIndex, arrivalUs );
+                nextIndex++;
+            }
+        }
+
+        inFlight = config.maxInFlight - freeDeviceCount;
+
+        if( inFlight > peakInFlight )
+        {
+            peakInFlight = inFlight;
+        }
+
+        if( Reactor_Dispatch( &reactor, timeoutMs ) != REACTOR_SUCCESS )
+        {
+            result = -1;
+        }
+
+        timeUs = nowUs();
+
+        if( ( timeUs - lastScanUs ) >= DEADLINE_SCAN_INTERVAL_US )
+        {
+            expireDevices( timeUs );
+            lastScanUs = timeUs;
+        }
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static void printReport( double elapsedS )
+{
+    const Histogram_t * pHistogram = NULL;
+    uint32_t i, j;
+
+    printf( "%u devices in %.1f s, %.1f provisioned/s, at most %u in flight.\n\n",
+            config.deviceCount,
+            elapsedS,
+            ( elapsedS > 0.0 ) ? ( ( double ) outcomes[ OUTCOME_PROVISIONED ] / elapsedS ) : 0.0,
+            peakInFlight );
+
+    printf( "%-18s %10s\n", "outcome", "devices" );
+
+    for( i = 0U; i < ( uint32_t ) OUTCOME_COUNT; i++ )
+    {
+        if( ( outcomes[ i ] > 0U ) || ( i == ( uint32_t ) OUTCOME_PROVISIONED ) )
+        {
+            printf( "%-18s %10" PRIu64 "\n", outcomeNames[ i ], outcomes[ i ] );
+        }
+    }
+
+    printf( "\n%-10s %8s %8s %10s %10s %10s %10s %10s\n",
+            "phase", "count", "timeouts", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms" );
+
+    for( i = 0U; i < ( uint32_t ) PHASE_COUNT; i++ )
+    {
+        pHistogram = &histograms[ i ];
+
+        printf( "%-10s %8" PRIu64 " %8" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                phaseNames[ i ],
+                pHistogram->count,
+                phaseTimeouts[ i ],
+                ( pHistogram->count > 0U ) ? ( ( double ) pHistogram->sumUs / ( double ) pHistogram->count / 1000.0 ) : 0.0,
+                ( double ) histogramPercentile( pHistogram, 50U ) / 1000.0,
+                ( double ) histogramPercentile( pHistogram, 90U ) / 1000.0,
+                ( double ) histogramPercentile( pHistogram, 99U ) / 1000.0,
+                ( double ) pHistogram->maxUs / 1000.0 );
+    }
+
+    for( i = 0U; i < ( uint32_t ) API_COUNT; i++ )
+    {
+        if( ( rejections[ i ].statusCodeCount > 0U ) || ( rejections[ i ].otherCount > 0U ) )
+        {
+            printf( "\n%s rejections by statusCode:\n", apiNames[ i ] );
+
+            for( j = 0U; j < rejections[ i ].statusCodeCount; j++ )
+            {
+                printf( "%10" PRId64 " %10" PRIu64 "\n", rejections[ i ].statusCodes[ j ], rejections[ i ].counts[ j ] );
+            }
+
+            if( rejections[ i ].otherCount > 0U )
+            {
+                printf( "%10s %10" PRIu64 "\n", "other", rejections[ i ].otherCount );
+            }
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int parseArguments( int argc,
+                           char ** argv )
+{
+    int option = 0;
+    int result = 0;
+
+    config.port = DEFAULT_PORT;
+    config.deviceCount = DEFAULT_DEVICE_COUNT;
+    config.arrivalRate = DEFAULT_ARRIVAL_RATE;
+    config.maxInFlight = DEFAULT_MAX_IN_FLIGHT;
+    config.responseTimeoutMs = DEFAULT_RESPONSE_TIMEOUT_MS;
+    config.pSerialPrefix = DEFAULT_SERIAL_PREFIX;
+
+    while( ( option = getopt( argc, argv, "e:p:r:c:k:t:n:a:m:w:s:R" ) ) != -1 )
+    {
+        switch( option )
+        {
+            case 'e':
+                config.pEndpoint = optarg;
+                break;
+
+            case 'p':
+                config.port = ( uint16_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'r':
+                config.pRootCaPath = optarg;
+                break;
+
+            case 'c':
+                config.pClaimCertPath = optarg;
+                break;
+
+            case 'k':
+                config.pClaimKeyPath = optarg;
+                break;
+
+            case 't':
+                config.pTemplateName = optarg;
+                break;
+
+            case 'n':
+                config.deviceCount = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'a':
+                config.arrivalRate = strtod( optarg, NULL );
+                break;
+
+            case 'm':
+                config.maxInFlight = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'w':
+                config.responseTimeoutMs = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 's':
+                config.pSerialPrefix = optarg;
+                break;
+
+            case 'R':
+                config.reuseSslContext = true;
+                break;
+
+            default:
+                result = -1;
+                break;
+        }
+    }
+
+    if( ( config.pEndpoint == NULL ) || ( config.pRootCaPath == NULL ) ||
+        ( config.pClaimCertPath == NULL ) || ( config.pClaimKeyPath == NULL ) ||
+        ( config.pTemplateName == NULL ) || ( config.maxInFlight == 0U ) ||
+        ( config.responseTimeoutMs == 0U ) || ( config.arrivalRate < 0.0 ) )
+    {
+        result = -1;
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    struct rlimit fileLimit;
+    uint64_t startUs = 0U;
+    uint32_t i;
+    int status = EXIT_FAILURE;
+
+    if( parseArguments( argc, argv ) != 0 )
+    {
+        fprintf( stderr,
+                 "Usage: %s -e <endpoint> -r <root CA> -c <claim cert> -k <claim key> -t <template name>\n"
+                 "       [-p <port>] [-n <devices>] [-a <arrivals per second, 0 for all at once>]\n"
+                 "       [-m <max in flight>] [-w <response timeout ms>] [-s <serial prefix>] [-R]\n",
+                 argv[ 0 ] );
+
+        return EXIT_FAILURE;
+    }
+
+    /* Every device in flight holds a socket. */
+    if( ( getrlimit( RLIMIT_NOFILE, &fileLimit ) == 0 ) && ( fileLimit.rlim_cur < fileLimit.rlim_max ) )
+    {
+        fileLimit.rlim_cur = fileLimit.rlim_max;
+        ( void ) setrlimit( RLIMIT_NOFILE, &fileLimit );
+    }
+
+    serverInfo.pHostName = config.pEndpoint;
+    serverInfo.hostNameLength = strlen( config.pEndpoint );
+    serverInfo.port = config.port;
+
+    claimCredentials.pRootCaPath = config.pRootCaPath;
+    claimCredentials.pClientCertPath = config.pClaimCertPath;
+    claimCredentials.pPrivateKeyPath = config.pClaimKeyPath;
+    claimCredentials.sniHostName = config.pEndpoint;
+    claimCredentials.reuseSslContext = config.reuseSslContext;
+
+    if( config.port == 443U )
+    {
+        claimCredentials.pAlpnProtos = AWS_IOT_MQTT_ALPN;
+        claimCredentials.alpnProtosLen = AWS_IOT_MQTT_ALPN_LENGTH;
+    }
+
+    pDevices = calloc( config.maxInFlight, sizeof( Device_t ) );
+    ppFreeDevices = calloc( config.maxInFlight, sizeof( Device_t * ) );
+
+    if( ( pDevices != NULL ) && ( ppFreeDevices != NULL ) )
+    {
+        for( i = 0U; i < config.maxInFlight; i++ )
+        {
+            ppFreeDevices[ config.maxInFlight - 1U - i ] = &pDevices[ i ];
+        }
+
+        freeDeviceCount = config.maxInFlight;
+    }
+
+    if( ( freeDeviceCount > 0U ) &&
+        ( FleetProvisioning_GetRegisterThingTopic( registerPublishTopic, sizeof( registerPublishTopic ),
+                                                   FleetProvisioningCbor, FleetProvisioningPublish,
+                                                   config.pTemplateName, ( uint16_t ) strlen( config.pTemplateName ),
+                                                   &registerPublishTopicLength ) == FleetProvisioningSuccess ) &&
+        ( FleetProvisioning_GetRegisterThingTopic( registerAcceptedTopic, sizeof( registerAcceptedTopic ),
+                                                   FleetProvisioningCbor, FleetProvisioningAccepted,
+                                                   config.pTemplateName, ( uint16_t ) strlen( config.pTemplateName ),
+                                                   &registerAcceptedTopicLength ) == FleetProvisioningSuccess ) &&
+        ( FleetProvisioning_GetRegisterThingTopic( registerRejectedTopic, sizeof( registerRejectedTopic ),
+                                                   FleetProvisioningCbor, FleetProvisioningRejected,
+                                                   config.pTemplateName, ( uint16_t ) strlen( config.pTemplateName ),
+                                                   &registerRejectedTopicLength ) == FleetProvisioningSuccess ) &&
+        ( Reactor_Init( &reactor ) == REACTOR_SUCCESS ) )
+    {
+        startUs = nowUs();
+
+        if( runLoad() == 0 )
+        {
+            printReport( ( double ) ( nowUs() - startUs ) / 1000000.0 );
+            status = EXIT_SUCCESS;
+        }
+
+        Reactor_Deinit( &reactor );
+    }
+
+    if( status != EXIT_SUCCESS )
+    {
+        fprintf( stderr, "Load generator failed.\n" );
+    }
+
+    if( config.reuseSslContext == true )
+    {
+        Openssl_ClearContextCache();
+    }
+
+    free( pDevices );
+    free( ppFreeDevices );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,2035 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mqtt_loadgen.c
+ * @brief Load generator for an MQTT broker, publishing from many connections
+ * at a fixed rate and measuring the latency of every message.
+ *
+ * Every connection connects, subscribes to a topic of its own and publishes
+ * to it for the given duration, at the given rate from a random offset. The
+ * payload starts with a stamp holding its send time, the index of the
+ * connection and a sequence number, so the broker delivering a message back
+ * to its publisher gives its end-to-end latency. Payload sizes are fixed, or
+ * drawn uniformly or log-uniformly from a range. With QoS 1 each connection
+ * has at most a window of publishes waiting for their PUBACK; a publish due
+ * while the window is full waits, and is counted as a stall. Once its
+ * duration is over, a connection waits for its last PUBACKs and messages,
+ * for at most the response timeout, and disconnects.
+ *
+ * Connections are spread over worker threads, each running its own epoll
+ * reactor of the transport. MQTT packets are built and parsed with the
+ * coreMQTT serializer API, so no call waits for the broker. Latencies are
+ * recorded in log-linear histograms, with a precision of 1/8 of the value,
+ * and merged once every worker has finished.
+ *
+ * Usage: mqtt_loadgen -e <endpoint> -r <root CA> -c <cert> -k <key>
+ *        [-p <port>] [-n <connections>] [-j <threads>]
+ *        [-C <connects per second, 0 for all at once>] [-d <duration s>]
+ *        [-f <publishes per second per connection>] [-q <QoS 0|1>]
+ *        [-w <QoS 1 window>] [-l <size>|<min>:<max>|<min>:<max>:log]
+ *        [-W <response timeout ms>] [-t <topic prefix>] [-i <client prefix>]
+ *        [-x] [-R] [-o <JSON report>]
+ *
+ * -x publishes without the loopback subscription, leaving only the PUBACK
+ * latency of QoS 1. -R shares one SSL context between the connections. -o
+ * writes the percentiles and the time per message in the format of the
+ * posix_benchmarks reports, for benchmark/compare_benchmarks.py.
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+/* Transport includes. */
+#include "openssl_posix.h"
+#include "transport_reactor_posix.h"
+
+/* MQTT serializer include. */
+#include "core_mqtt_serializer.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief MQTT port used when none is given on the command line.
+ */
+#define DEFAULT_PORT                   8883U
+
+/**
+ * @brief Number of connections when no count is given.
+ */
+#define DEFAULT_CONNECTION_COUNT       10U
+
+/**
+ * @brief Connects started per second when no rate is given.
+ */
+#define DEFAULT_CONNECT_RATE           50.0
+
+/**
+ * @brief Seconds each connection publishes for when no duration is given.
+ */
+#define DEFAULT_DURATION_S             30U
+
+/**
+ * @brief Publishes per second of each connection when no rate is given.
+ */
+#define DEFAULT_PUBLISH_RATE           1.0
+
+/**
+ * @brief Publishes of a connection waiting for their PUBACK, when no window
+ * is given.
+ */
+#define DEFAULT_WINDOW                 10U
+
+/**
+ * @brief Payload size when none is given.
+ */
+#define DEFAULT_PAYLOAD_SIZE           256U
+
+/**
+ * @brief Limit for the connect, for each response and for the final drain,
+ * when none is given.
+ */
+#define DEFAULT_RESPONSE_TIMEOUT_MS    10000U
+
+/**
+ * @brief Prefixes of the topics and client identifiers, followed by the
+ * client identifier and by the index of the connection.
+ */
+#define DEFAULT_TOPIC_PREFIX           "loadgen"
+#define DEFAULT_CLIENT_PREFIX          "mqtt-loadgen-"
+
+/**
+ * @brief ALPN protocol of MQTT over port 443.
+ */
+#define AWS_IOT_MQTT_ALPN              "\x0ex-amzn-mqtt-ca"
+#define AWS_IOT_MQTT_ALPN_LENGTH       ( ( uint32_t ) ( sizeof( AWS_IOT_MQTT_ALPN ) - 1U ) )
+
+/**
+ * @brief Size of the stamp at the start of every payload: the send time in
+ * microseconds, the index of the connection and a sequence number.
+ */
+#define STAMP_SIZE                     16U
+
+/**
+ * @brief Largest payload, also bounding the receive buffer of a connection.
+ */
+#define MAX_PAYLOAD_SIZE               131072U
+
+/**
+ * @brief Size of the read-ahead buffer of each connection.
+ */
+#define READ_AHEAD_BUFFER_SIZE         4096U
+
+/**
+ * @brief Size of the buffer for the packets sent, without the payload after
+ * the stamp.
+ */
+#define SEND_BUFFER_SIZE               512U
+
+/**
+ * @brief Size of the buffers for the client identifier and topic.
+ */
+#define CLIENT_ID_BUFFER_SIZE          64U
+#define TOPIC_BUFFER_SIZE              128U
+
+/**
+ * @brief Bytes of a received PUBLISH packet besides its payload.
+ */
+#define RECEIVE_OVERHEAD               ( 5U + 2U + TOPIC_BUFFER_SIZE + 2U )
+
+/**
+ * @brief Send timeout of the established connections.
+ */
+#define TRANSPORT_SEND_TIMEOUT_MS      1000U
+
+/**
+ * @brief Receive timeout of the established connections. The socket is only
+ * read once it is readable, so this only bounds how long a worker waits for
+ * the rest of a partly received TLS record.
+ */
+#define TRANSPORT_RECV_TIMEOUT_MS      50U
+
+/**
+ * @brief Keep-alive interval sent in the CONNECT packets. A connection idle
+ * for half of it sends a PINGREQ.
+ */
+#define MQTT_KEEP_ALIVE_INTERVAL_S     60U
+
+/**
+ * @brief Packet identifier of the SUBSCRIBE packet; publishes use the others.
+ */
+#define SUBSCRIBE_PACKET_ID            1U
+
+/**
+ * @brief Longest wait of a reactor, so that connects, publishes and deadlines
+ * are handled on time.
+ */
+#define DISPATCH_TIMEOUT_MS            10U
+
+/**
+ * @brief Most publishes of one connection sent in a row when it is behind
+ * its schedule, so that the others are served too.
+ */
+#define MAX_PUBLISH_BURST              16U
+
+/**
+ * @brief Each power of two of a histogram is split in 2^HISTOGRAM_SUB_BUCKET_BITS
+ * buckets.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS      3U
+#define HISTOGRAM_SUB_BUCKETS          ( 1U << HISTOGRAM_SUB_BUCKET_BITS )
+
+/**
+ * @brief Number of buckets of a histogram, covering values up to 2^36 us.
+ * Longer values are counted in the last bucket.
+ */
+#define HISTOGRAM_BUCKET_COUNT         ( ( 36U - HISTOGRAM_SUB_BUCKET_BITS + 1U ) * HISTOGRAM_SUB_BUCKETS )
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    OpensslParams_t * pParams;
+};
+
+/**
+ * @brief The phases of a connection.
+ */
+typedef enum LoadgenPhase
+{
+    PHASE_CONNECTING = 0, /**< @brief DNS lookup, TCP connect and TLS handshake. */
+    PHASE_CONNACK,        /**< @brief Waiting for the CONNACK. */
+    PHASE_SUBACK,         /**< @brief Waiting for the SUBACK of the loopback topic. */
+    PHASE_PUBLISH,        /**< @brief Publishing on schedule. */
+    PHASE_DRAIN           /**< @brief Waiting for the last PUBACKs and messages. */
+} LoadgenPhase_t;
+
+/**
+ * @brief The latencies recorded.
+ */
+typedef enum LoadgenLatency
+{
+    LATENCY_TLS = 0,  /**< @brief DNS lookup, TCP connect and TLS handshake. */
+    LATENCY_CONNACK,  /**< @brief From the CONNECT packet until the CONNACK. */
+    LATENCY_SUBACK,   /**< @brief From the SUBSCRIBE packet until the SUBACK. */
+    LATENCY_PUBACK,   /**< @brief From a QoS 1 publish until its PUBACK. */
+    LATENCY_LOOPBACK, /**< @brief From a publish until the broker delivers it back. */
+    LATENCY_COUNT
+} LoadgenLatency_t;
+
+/**
+ * @brief How a connection ended.
+ */
+typedef enum LoadgenOutcome
+{
+    OUTCOME_COMPLETED = 0,
+    OUTCOME_DNS_FAILURE,
+    OUTCOME_CONNECT_FAILURE,
+    OUTCOME_HANDSHAKE_FAILURE,
+    OUTCOME_CONNECT_TIMEOUT,
+    OUTCOME_CONNACK_REFUSED,
+    OUTCOME_SUBACK_REFUSED,
+    OUTCOME_RESPONSE_TIMEOUT,
+    OUTCOME_TRANSPORT_ERROR,
+    OUTCOME_PROTOCOL_ERROR,
+    OUTCOME_COUNT
+} LoadgenOutcome_t;
+
+/**
+ * @brief How payload sizes are drawn.
+ */
+typedef enum PayloadDistribution
+{
+    PAYLOAD_FIXED = 0,   /**< @brief Always the smallest size. */
+    PAYLOAD_UNIFORM,     /**< @brief Uniformly between the smallest and largest size. */
+    PAYLOAD_LOG_UNIFORM  /**< @brief Uniformly in the logarithm of the size, favouring small payloads. */
+} PayloadDistribution_t;
+
+/**
+ * @brief Log-linear latency histogram, in microseconds.
+ */
+typedef struct Histogram
+{
+    uint64_t counts[ HISTOGRAM_BUCKET_COUNT ];
+    uint64_t count;  /**< @brief Number of values recorded. */
+    uint64_t sumUs;  /**< @brief Sum of the values, for the mean. */
+    uint64_t maxUs;  /**< @brief Largest value, reported exactly. */
+} Histogram_t;
+
+/**
+ * @brief Results of a worker, merged into those of the run at the end.
+ */
+typedef struct LoadgenResults
+{
+    Histogram_t histograms[ LATENCY_COUNT ];
+    uint64_t outcomes[ OUTCOME_COUNT ];
+    uint64_t published;      /**< @brief PUBLISH packets sent. */
+    uint64_t publishedBytes; /**< @brief Payload bytes sent. */
+    uint64_t acked;          /**< @brief PUBACKs received for them. */
+    uint64_t received;       /**< @brief Messages delivered back. */
+    uint64_t receivedBytes;  /**< @brief Payload bytes delivered back. */
+    uint64_t windowStalls;   /**< @brief Publishes delayed by a full QoS 1 window. */
+    uint64_t unacked;        /**< @brief QoS 1 publishes without a PUBACK when their connection ended. */
+    uint64_t lost;           /**< @brief Publishes not delivered back when their connection ended. */
+    uint64_t unexpected;     /**< @brief Messages and PUBACKs that match no publish. */
+    uint64_t firstPublishUs; /**< @brief Time of the first publish; 0 before it. */
+    uint64_t lastPublishUs;  /**< @brief Time of the last publish. */
+} LoadgenResults_t;
+
+/**
+ * @brief Command line parameters.
+ */
+typedef struct LoadgenConfig
+{
+    const char * pEndpoint;
+    uint16_t port;
+    const char * pRootCaPath;
+    const char * pCertPath;
+    const char * pKeyPath;
+    const char * pTopicPrefix;
+    const char * pClientPrefix;
+    const char * pReportPath;
+    uint32_t connectionCount;
+    uint32_t threadCount;
+    double connectRate;
+    uint32_t durationS;
+    double publishRate;
+    MQTTQoS_t qos;
+    uint32_t window;
+    size_t payloadMin;
+    size_t payloadMax;
+    PayloadDistribution_t distribution;
+    uint32_t responseTimeoutMs;
+    bool loopback;
+    bool reuseSslContext;
+} LoadgenConfig_t;
+
+/**
+ * @brief A QoS 1 publish waiting for its PUBACK.
+ */
+typedef struct InFlight
+{
+    uint16_t packetId;
+    uint64_t sendUs;
+} InFlight_t;
+
+/* Forward declaration of a worker. */
+struct Worker;
+
+/**
+ * @brief A connection publishing load.
+ */
+typedef struct Connection
+{
+    bool active;              /**< @brief Started and not ended. */
+    uint32_t index;           /**< @brief Index of the connection in the run. */
+    struct Worker * pWorker;  /**< @brief Worker running the connection. */
+    LoadgenPhase_t phase;
+    uint64_t phaseStartUs;    /**< @brief Start of #phase. */
+    uint64_t deadlineUs;      /**< @brief Time at which #phase times out; 0 for none. */
+    uint64_t nextPublishUs;   /**< @brief Time the next publish is due. */
+    uint64_t publishEndUs;    /**< @brief End of the publish phase. */
+    uint64_t lastSendUs;      /**< @brief Time of the last packet sent, for the keep-alive. */
+    bool stalled;             /**< @brief The due publish waits for the window, and was counted. */
+    uint32_t sequence;        /**< @brief Sequence number of the next publish. */
+    uint64_t published;       /**< @brief Publishes sent. */
+    uint64_t received;        /**< @brief Publishes delivered back. */
+    uint16_t nextPacketId;
+    InFlight_t * pWindow;     /**< @brief QoS 1 publishes waiting for their PUBACK. */
+    uint32_t windowCount;     /**< @brief Used entries of #pWindow. */
+    NetworkContext_t networkContext;
+    OpensslParams_t opensslParams;
+    ReactorConnection_t connection;
+    char clientId[ CLIENT_ID_BUFFER_SIZE ];
+    size_t clientIdLength;
+    char topic[ TOPIC_BUFFER_SIZE ];
+    size_t topicLength;
+    size_t receivedLength;    /**< @brief Bytes of #pReceiveBuffer not yet parsed as packets. */
+    uint8_t * pReceiveBuffer; /**< @brief Of #receiveBufferSize bytes, holding the largest message. */
+    size_t receiveBufferSize;
+    uint8_t readAheadBuffer[ READ_AHEAD_BUFFER_SIZE ];
+    uint8_t sendBuffer[ SEND_BUFFER_SIZE ];
+} Connection_t;
+
+/**
+ * @brief A thread running a share of the connections on its own reactor.
+ */
+typedef struct Worker
+{
+    pthread_t thread;
+    bool running;                 /**< @brief #thread was created. */
+    uint32_t index;
+    Reactor_t reactor;
+    Connection_t * pConnections;  /**< @brief Connections index, index + threads, ... of the run. */
+    uint32_t connectionCount;
+    uint32_t startedCount;        /**< @brief Connections started, in order. */
+    uint32_t activeCount;         /**< @brief Connections started and not ended. */
+    uint64_t randomState;         /**< @brief State of the xorshift generator of the worker. */
+    LoadgenResults_t results;
+    int status;                   /**< @brief 0, or -1 if the reactor failed. */
+} Worker_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Names of the latencies, for the reports.
+ */
+static const char * const latencyNames[ LATENCY_COUNT ] =
+{
+    "tls", "connack", "suback", "puback", "loopback"
+};
+
+/**
+ * @brief Names of the outcomes, for the report.
+ */
+static const char * const outcomeNames[ OUTCOME_COUNT ] =
+{
+    "completed",         "dns failure",     "connect failure",
+    "handshake failure", "connect timeout", "connack refused",
+    "suback refused",    "response timeout", "transport error",
+    "protocol error"
+};
+
+/**
+ * @brief Command line parameters.
+ */
+static LoadgenConfig_t config;
+
+/**
+ * @brief Server and client credentials, shared by every connection.
+ */
+static ServerInfo_t serverInfo;
+static OpensslCredentials_t credentials;
+
+/**
+ * @brief Bytes sent after the stamp of every payload, shared by the workers.
+ */
+static uint8_t * pFiller = NULL;
+
+/**
+ * @brief Interval between the publishes of a connection.
+ */
+static uint64_t publishIntervalUs = 0U;
+
+/**
+ * @brief Time at which the run started, from which connects are paced.
+ */
+static uint64_t runStartUs = 0U;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Monotonic time in microseconds, the same for every thread.
+ */
+static uint64_t nowUs( void );
+
+/**
+ * @brief Next value of the random generator of a worker.
+ */
+static uint64_t nextRandom( Worker_t * pWorker );
+
+/**
+ * @brief Bucket of a value in a histogram.
+ */
+static uint32_t histogramBucket( uint64_t valueUs );
+
+/**
+ * @brief Middle of the values counted in a bucket.
+ */
+static uint64_t histogramBucketValue( uint32_t bucket );
+
+/**
+ * @brief Add a value to a histogram.
+ */
+static void histogramRecord( Histogram_t * pHistogram,
+                             uint64_t valueUs );
+
+/**
+ * @brief Add the values of a histogram to another.
+ */
+static void histogramMerge( Histogram_t * pTotal,
+                            const Histogram_t * pHistogram );
+
+/**
+ * @brief Estimate a percentile of the values of a histogram.
+ *
+ * @param[in] pHistogram The histogram.
+ * @param[in] permille The percentile, in tenths of a percent.
+ *
+ * @return The percentile in microseconds, or 0 for an empty histogram.
+ */
+static uint64_t histogramPercentile( const Histogram_t * pHistogram,
+                                     uint32_t permille );
+
+/**
+ * @brief Draw the size of the next payload.
+ */
+static size_t drawPayloadSize( Worker_t * pWorker );
+
+/**
+ * @brief Record the end of the current phase of a connection and start the
+ * next.
+ */
+static void nextPhase( Connection_t * pConnection,
+                       LoadgenLatency_t latency,
+                       LoadgenPhase_t phase );
+
+/**
+ * @brief Close a connection, count what it left unanswered and record its
+ * outcome.
+ */
+static void finishConnection( Connection_t * pConnection,
+                              LoadgenOutcome_t outcome );
+
+/**
+ * @brief Send a whole buffer on a connection.
+ *
+ * @return true if every byte was sent.
+ */
+static bool sendAll( Connection_t * pConnection,
+                     const uint8_t * pData,
+                     size_t length );
+
+/**
+ * @brief Send the CONNECT packet of a connection.
+ */
+static bool sendConnect( Connection_t * pConnection );
+
+/**
+ * @brief Subscribe a connection to its own topic.
+ */
+static bool sendSubscribe( Connection_t * pConnection );
+
+/**
+ * @brief Send the next publish of a connection: its header and stamp from the
+ * send buffer, then the shared filler.
+ */
+static bool sendPublish( Connection_t * pConnection );
+
+/**
+ * @brief Send a PINGREQ packet.
+ */
+static bool sendPingreq( Connection_t * pConnection );
+
+/**
+ * @brief Start the publish phase of a connection, at a random offset in the
+ * first interval so that the connections don't publish together.
+ */
+static void startPublishing( Connection_t * pConnection );
+
+/**
+ * @brief Disconnect a draining connection once nothing is left to wait for.
+ */
+static void checkDrained( Connection_t * pConnection );
+
+/**
+ * @brief Handle a message delivered back to its publisher.
+ */
+static void handleLoopback( Connection_t * pConnection,
+                            const MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Handle the PUBACK of a QoS 1 publish.
+ */
+static void handlePuback( Connection_t * pConnection,
+                          uint16_t packetId );
+
+/**
+ * @brief Handle a received MQTT packet.
+ */
+static void handlePacket( Connection_t * pConnection,
+                          MQTTPacketInfo_t * pPacketInfo );
+
+/**
+ * @brief Handle the complete packets at the start of the receive buffer of a
+ * connection, and keep the rest for the next read.
+ */
+static void processPackets( Connection_t * pConnection );
+
+/**
+ * @brief Reactor callback of a finished connect.
+ */
+static void connectCallback( ReactorConnection_t * pReactorConnection,
+                             ReactorStatus_t status,
+                             void * pUserContext );
+
+/**
+ * @brief Reactor callback of a readable connection. Reads everything the
+ * connection has without blocking, so the thread serves the next one.
+ */
+static void receiveCallback( ReactorConnection_t * pReactorConnection,
+                             void * pUserContext );
+
+/**
+ * @brief Start the connect of a connection.
+ */
+static void startConnection( Connection_t * pConnection );
+
+/**
+ * @brief Send the publishes and PINGREQs that are due, and end the phases
+ * past their deadline.
+ *
+ * @return The time until the next publish is due, at most
+ * #DISPATCH_TIMEOUT_MS.
+ */
+static uint32_t serviceConnections( Worker_t * pWorker,
+                                    uint64_t timeUs );
+
+/**
+ * @brief Thread of a worker: run its connections until each has ended.
+ */
+static void * runWorker( void * pArgument );
+
+/**
+ * @brief Print the outcomes, latencies and throughput of the run.
+ */
+static void printReport( const LoadgenResults_t * pResults,
+                         double elapsedS );
+
+/**
+ * @brief Write the percentiles and the time per message of the run as a
+ * posix_benchmarks report.
+ *
+ * @return 0 on success, -1 if the file could not be written.
+ */
+static int writeJsonReport( const LoadgenResults_t * pResults );
+
+/**
+ * @brief Read a payload size, range or distribution into #config.
+ *
+ * @return 0 on success, -1 if it is invalid.
+ */
+static int parsePayloadSizes( const char * pArgument );
+
+/**
+ * @brief Read the command line into #config.
+ *
+ * @return 0 on success, -1 if a required parameter is missing or invalid.
+ */
+static int parseArguments( int argc,
+                           char ** argv );
+
+/*-----------------------------------------------------------*/
+
+static uint64_t nowUs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000U ) + ( ( uint64_t ) now.tv_nsec / 1000U );
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t nextRandom( Worker_t * pWorker )
+{
+    uint64_t x = pWorker->randomState;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    pWorker->randomState = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t histogramBucket( uint64_t valueUs )
+{
+    uint32_t bucket = ( uint32_t ) valueUs;
+    uint32_t magnitude = 0U;
+
+    if( valueUs >= HISTOGRAM_SUB_BUCKETS )
+    {
+        /* The power of two of the value selects a group of buckets, and the
+         * bits below its top bit the bucket in the group. */
+        magnitude = 63U - ( uint32_t ) __builtin_clzll( valueUs );
+        bucket = ( ( magnitude - HISTOGRAM_SUB_BUCKET_BITS + 1U ) * HISTOGRAM_SUB_BUCKETS ) +
+                 ( uint32_t ) ( ( valueUs >> ( magnitude - HISTOGRAM_SUB_BUCKET_BITS ) ) & ( HISTOGRAM_SUB_BUCKETS - 1U ) );
+    }
+
+    return ( bucket < HISTOGRAM_BUCKET_COUNT ) ? bucket : ( HISTOGRAM_BUCKET_COUNT - 1U );
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t histogramBucketValue( uint32_t bucket )
+{
+    uint64_t value = bucket;
+    uint32_t shift = 0U;
+
+    if( bucket >= HISTOGRAM_SUB_BUCKETS )
+    {
+        shift = ( bucket / HISTOGRAM_SUB_BUCKETS ) - 1U;
+        value = ( ( uint64_t ) HISTOGRAM_SUB_BUCKETS + ( bucket % HISTOGRAM_SUB_BUCKETS ) ) << shift;
+        value += ( ( uint64_t ) 1U << shift ) / 2U;
+    }
+
+    return value;
+}
+/*-----------------------------------------------------------*/
+
+static void histogramRecord( Histogram_t * pHistogram,
+                             uint64_t valueUs )
+{
+    pHistogram->counts[ histogramBucket( valueUs ) ]++;
+    pHistogram->count++;
+    pHistogram->sumUs += valueUs;
+
+    if( valueUs > pHistogram->maxUs )
+    {
+        pHistogram->maxUs = valueUs;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void histogramMerge( Histogram_t * pTotal,
+                            const Histogram_t * pHistogram )
+{
+    uint32_t bucket;
+
+    for( bucket = 0U; bucket < HISTOGRAM_BUCKET_COUNT; bucket++ )
+    {
+        pTotal->counts[ bucket ] += pHistogram->counts[ bucket ];
+    }
+
+    pTotal->count += pHistogram->count;
+    pTotal->sumUs += pHistogram->sumUs;
+
+    if( pHistogram->maxUs > pTotal->maxUs )
+    {
+        pTotal->maxUs = pHistogram->maxUs;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t histogramPercentile( const Histogram_t * pHistogram,
+                                     uint32_t permille )
+{
+    uint64_t rank = ( ( pHistogram->count * permille ) + 999U ) / 1000U;
+    uint64_t seen = 0U;
+    uint64_t value = 0U;
+    uint32_t bucket;
+
+    for( bucket = 0U; ( bucket < HISTOGRAM_BUCKET_COUNT ) && ( pHistogram->count > 0U ); bucket++ )
+    {
+        seen += pHistogram->counts[ bucket ];
+
+        if( ( seen >= rank ) && ( seen > 0U ) )
+        {
+            value = histogramBucketValue( bucket );
+            break;
+        }
+    }
+
+    return ( value < pHistogram->maxUs ) ? value : pHistogram->maxUs;
+}
+/*-----------------------------------------------------------*/
+
+static size_t drawPayloadSize( Worker_t * pWorker )
+{
+    size_t size = config.payloadMin;
+    double fraction = 0.0;
+
+    if( config.distribution == PAYLOAD_UNIFORM )
+    {
+        size += ( size_t ) ( nextRandom( pWorker ) % ( config.payloadMax - config.payloadMin + 1U ) );
+    }
+    else if( config.distribution == PAYLOAD_LOG_UNIFORM )
+    {
+        /* 53 random bits give a fraction in [0, 1). */
+        fraction = ( double ) ( nextRandom( pWorker ) >> 11 ) / 9007199254740992.0;
+        size = ( size_t ) exp( log( ( double ) config.payloadMin ) +
+                               ( fraction * ( log( ( double ) config.payloadMax + 1.0 ) - log( ( double ) config.payloadMin ) ) ) );
+        size = ( size < config.payloadMin ) ? config.payloadMin : size;
+        size = ( size > config.payloadMax ) ? config.payloadMax : size;
+    }
+    else
+    {
+        /* Fixed size. */
+    }
+
+    return size;
+}
+/*-----------------------------------------------------------*/
+
+static void nextPhase( Connection_t * pConnection,
+                       LoadgenLatency_t latency,
+                       LoadgenPhase_t phase )
+{
+    uint64_t timeUs = nowUs();
+
+    histogramRecord( &pConnection->pWorker->results.histograms[ latency ], timeUs - pConnection->phaseStartUs );
+
+    pConnection->phase = phase;
+    pConnection->phaseStartUs = timeUs;
+    pConnection->deadlineUs = timeUs + ( ( uint64_t ) config.responseTimeoutMs * 1000U );
+}
+/*-----------------------------------------------------------*/
+
+static void finishConnection( Connection_t * pConnection,
+                              LoadgenOutcome_t outcome )
+{
+    LoadgenResults_t * pResults = &pConnection->pWorker->results;
+
+    if( pConnection->connection.state == REACTOR_STATE_READY )
+    {
+        /* Reactor_Remove leaves an established connection open. */
+        ( void ) Reactor_Remove( &pConnection->pWorker->reactor, &pConnection->connection );
+        ( void ) Openssl_Disconnect( &pConnection->networkContext );
+    }
+    else
+    {
+        /* Aborts a connect still in progress; does nothing on a failed one. */
+        ( void ) Reactor_Remove( &pConnection->pWorker->reactor, &pConnection->connection );
+    }
+
+    pResults->unacked += pConnection->windowCount;
+
+    if( ( config.loopback == true ) && ( pConnection->received < pConnection->published ) )
+    {
+        pResults->lost += pConnection->published - pConnection->received;
+    }
+
+    pResults->outcomes[ outcome ]++;
+    pConnection->active = false;
+    pConnection->pWorker->activeCount--;
+
+    free( pConnection->pReceiveBuffer );
+    pConnection->pReceiveBuffer = NULL;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendAll( Connection_t * pConnection,
+                     const uint8_t * pData,
+                     size_t length )
+{
+    size_t sent = 0U;
+    int32_t status = 0;
+
+    /* Openssl_Send returns 0 while the socket buffer is full. */
+    while( ( sent < length ) && ( status >= 0 ) )
+    {
+        status = Openssl_Send( &pConnection->networkContext, &pData[ sent ], length - sent );
+
+        if( status > 0 )
+        {
+            sent += ( size_t ) status;
+        }
+    }
+
+    pConnection->lastSendUs = nowUs();
+
+    return ( sent == length );
+}
+/*-----------------------------------------------------------*/
+
+static bool sendConnect( Connection_t * pConnection )
+{
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U;
+    bool status = false;
+
+    connectInfo.cleanSession = true;
+    connectInfo.keepAliveIntervalSec = MQTT_KEEP_ALIVE_INTERVAL_S;
+    connectInfo.pClientIdentifier = pConnection->clientId;
+    connectInfo.clientIdentifierLength = ( uint16_t ) pConnection->clientIdLength;
+
+    fixedBuffer.pBuffer = pConnection->sendBuffer;
+    fixedBuffer.size = sizeof( pConnection->sendBuffer );
+
+    if( ( MQTT_GetConnectPacketSize( &connectInfo, NULL, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( packetSize <= fixedBuffer.size ) &&
+        ( MQTT_SerializeConnect( &connectInfo, NULL, remainingLength, &fixedBuffer ) == MQTTSuccess ) )
+    {
+        status = sendAll( pConnection, pConnection->sendBuffer, packetSize );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendSubscribe( Connection_t * pConnection )
+{
+    MQTTSubscribeInfo_t subscription = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U;
+    bool status = false;
+
+    subscription.qos = config.qos;
+    subscription.pTopicFilter = pConnection->topic;
+    subscription.topicFilterLength = ( uint16_t ) pConnection->topicLength;
+
+    fixedBuffer.pBuffer = pConnection->sendBuffer;
+    fixedBuffer.size = sizeof( pConnection->sendBuffer );
+
+    if( ( MQTT_GetSubscribePacketSize( &subscription, 1U, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( packetSize <= fixedBuffer.size ) &&
+        ( MQTT_SerializeSubscribe( &subscription, 1U, SUBSCRIBE_PACKET_ID, remainingLength, &fixedBuffer ) == MQTTSuccess ) )
+    {
+        status = sendAll( pConnection, pConnection->sendBuffer, packetSize );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendPublish( Connection_t * pConnection )
+{
+    Worker_t * pWorker = pConnection->pWorker;
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U, headerSize = 0U;
+    size_t payloadLength = drawPayloadSize( pWorker );
+    uint16_t packetId = 0U;
+    uint64_t sendUs = 0U;
+    bool status = false;
+
+    if( config.qos == MQTTQoS1 )
+    {
+        /* Packet identifiers cycle through 2 to 65535; the window is far
+         * smaller, so none is reused while in flight. */
+        packetId = pConnection->nextPacketId;
+        pConnection->nextPacketId = ( packetId == UINT16_MAX ) ? ( SUBSCRIBE_PACKET_ID + 1U ) : ( uint16_t ) ( packetId + 1U );
+    }
+
+    publishInfo.qos = config.qos;
+    publishInfo.pTopicName = pConnection->topic;
+    publishInfo.topicNameLength = ( uint16_t ) pConnection->topicLength;
+    publishInfo.pPayload = pFiller;
+    publishInfo.payloadLength = payloadLength;
+
+    fixedBuffer.pBuffer = pConnection->sendBuffer;
+    fixedBuffer.size = sizeof( pConnection->sendBuffer ) - STAMP_SIZE;
+
+    if( ( MQTT_GetPublishPacketSize( &publishInfo, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( MQTT_SerializePublishHeader( &publishInfo, packetId, remainingLength, &fixedBuffer, &headerSize ) == MQTTSuccess ) )
+    {
+        /* The stamp follows the header in the send buffer; the rest of the
+         * payload is the filler after the size of the stamp. */
+        sendUs = nowUs();
+        ( void ) memcpy( &pConnection->sendBuffer[ headerSize ], &sendUs, sizeof( sendUs ) );
+        ( void ) memcpy( &pConnection->sendBuffer[ headerSize + 8U ], &pConnection->index, sizeof( pConnection->index ) );
+        ( void ) memcpy( &pConnection->sendBuffer[ headerSize + 12U ], &pConnection->sequence, sizeof( pConnection->sequence ) );
+
+        status = sendAll( pConnection, pConnection->sendBuffer, headerSize + STAMP_SIZE );
+
+        if( ( status == true ) && ( payloadLength > STAMP_SIZE ) )
+        {
+            status = sendAll( pConnection, &pFiller[ STAMP_SIZE ], payloadLength - STAMP_SIZE );
+        }
+    }
+
+    if( status == true )
+    {
+        if( config.qos == MQTTQoS1 )
+        {
+            pConnection->pWindow[ pConnection->windowCount ].packetId = packetId;
+            pConnection->pWindow[ pConnection->windowCount ].sendUs = sendUs;
+            pConnection->windowCount++;
+        }
+
+        pConnection->sequence++;
+        pConnection->published++;
+        pWorker->results.published++;
+        pWorker->results.publishedBytes += payloadLength;
+
+        if( pWorker->results.firstPublishUs == 0U )
+        {
+            pWorker->results.firstPublishUs = sendUs;
+        }
+
+        pWorker->results.lastPublishUs = sendUs;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendPingreq( Connection_t * pConnection )
+{
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t packetSize = 0U;
+    bool status = false;
+
+    fixedBuffer.pBuffer = pConnection->sendBuffer;
+    fixedBuffer.size = sizeof( pConnection->sendBuffer );
+
+    if( ( MQTT_GetPingreqPacketSize( &packetSize ) == MQTTSuccess ) &&
+        ( MQTT_SerializePingreq( &fixedBuffer ) == MQTTSuccess ) )
+    {
+        status = sendAll( pConnection, pConnection->sendBuffer, packetSize );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void startPublishing( Connection_t * pConnection )
+{
+    uint64_t timeUs = nowUs();
+
+    pConnection->phase = PHASE_PUBLISH;
+    pConnection->phaseStartUs = timeUs;
+    pConnection->deadlineUs = 0U;
+    pConnection->nextPublishUs = timeUs + ( nextRandom( pConnection->pWorker ) % publishIntervalUs );
+    pConnection->publishEndUs = pConnection->nextPublishUs + ( ( uint64_t ) config.durationS * 1000000U );
+}
+/*-----------------------------------------------------------*/
+
+static void checkDrained( Connection_t * pConnection )
+{
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t disconnectSize = 0U;
+
+    if( ( pConnection->phase == PHASE_DRAIN ) &&
+        ( pConnection->windowCount == 0U ) &&
+        ( ( config.loopback == false ) || ( pConnection->received >= pConnection->published ) ) )
+    {
+        /* A missing DISCONNECT doesn't change the results. */
+        fixedBuffer.pBuffer = pConnection->sendBuffer;
+        fixedBuffer.size = sizeof( pConnection->sendBuffer );
+
+        if( ( MQTT_GetDisconnectPacketSize( &disconnectSize ) == MQTTSuccess ) &&
+            ( MQTT_SerializeDisconnect( &fixedBuffer ) == MQTTSuccess ) )
+        {
+            ( void ) sendAll( pConnection, pConnection->sendBuffer, disconnectSize );
+        }
+
+        finishConnection( pConnection, OUTCOME_COMPLETED );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handleLoopback( Connection_t * pConnection,
+                            const MQTTPublishInfo_t * pPublishInfo )
+{
+    LoadgenResults_t * pResults = &pConnection->pWorker->results;
+    const uint8_t * pPayload = ( const uint8_t * ) pPublishInfo->pPayload;
+    uint64_t sendUs = 0U;
+    uint32_t index = 0U;
+
+    if( pPublishInfo->payloadLength >= STAMP_SIZE )
+    {
+        ( void ) memcpy( &sendUs, pPayload, sizeof( sendUs ) );
+        ( void ) memcpy( &index, &pPayload[ 8U ], sizeof( index ) );
+    }
+
+    /* Only this connection publishes to its topic; another message there is
+     * left from someone else. */
+    if( ( pPublishInfo->payloadLength >= STAMP_SIZE ) && ( index == pConnection->index ) )
+    {
+        histogramRecord( &pResults->histograms[ LATENCY_LOOPBACK ], nowUs() - sendUs );
+        pConnection->received++;
+        pResults->received++;
+        pResults->receivedBytes += pPublishInfo->payloadLength;
+    }
+    else
+    {
+        pResults->unexpected++;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handlePuback( Connection_t * pConnection,
+                          uint16_t packetId )
+{
+    LoadgenResults_t * pResults = &pConnection->pWorker->results;
+    uint32_t i;
+    bool found = false;
+
+    for( i = 0U; ( i < pConnection->windowCount ) && ( found == false ); i++ )
+    {
+        if( pConnection->pWindow[ i ].packetId == packetId )
+        {
+            histogramRecord( &pResults->histograms[ LATENCY_PUBACK ], nowUs() - pConnection->pWindow[ i ].sendUs );
+
+            /* The order of the window doesn't matter. */
+            pConnection->windowCount--;
+            pConnection->pWindow[ i ] = pConnection->pWindow[ pConnection->windowCount ];
+            pConnection->stalled = false;
+            pResults->acked++;
+            found = true;
+        }
+    }
+
+    if( found == false )
+    {
+        pResults->unexpected++;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handlePacket( Connection_t * pConnection,
+                          MQTTPacketInfo_t * pPacketInfo )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    uint16_t packetId = 0U;
+    bool sessionPresent = false;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    switch( pPacketInfo->type & 0xF0U )
+    {
+        case MQTT_PACKET_TYPE_CONNACK:
+            mqttStatus = MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent );
+
+            if( ( pConnection->phase == PHASE_CONNACK ) && ( mqttStatus == MQTTSuccess ) )
+            {
+                if( config.loopback == true )
+                {
+                    nextPhase( pConnection, LATENCY_CONNACK, PHASE_SUBACK );
+
+                    if( sendSubscribe( pConnection ) == false )
+                    {
+                        finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+                    }
+                }
+                else
+                {
+                    histogramRecord( &pConnection->pWorker->results.histograms[ LATENCY_CONNACK ],
+                                     nowUs() - pConnection->phaseStartUs );
+                    startPublishing( pConnection );
+                }
+            }
+            else
+            {
+                finishConnection( pConnection, ( mqttStatus == MQTTServerRefused ) ?
+                                  OUTCOME_CONNACK_REFUSED : OUTCOME_PROTOCOL_ERROR );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_SUBACK:
+            mqttStatus = MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent );
+
+            if( ( pConnection->phase == PHASE_SUBACK ) && ( mqttStatus == MQTTSuccess ) )
+            {
+                histogramRecord( &pConnection->pWorker->results.histograms[ LATENCY_SUBACK ],
+                                 nowUs() - pConnection->phaseStartUs );
+                startPublishing( pConnection );
+            }
+            else
+            {
+                finishConnection( pConnection, ( mqttStatus == MQTTServerRefused ) ?
+                                  OUTCOME_SUBACK_REFUSED : OUTCOME_PROTOCOL_ERROR );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PUBLISH:
+            mqttStatus = MQTT_DeserializePublish( pPacketInfo, &packetId, &publishInfo );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                finishConnection( pConnection, OUTCOME_PROTOCOL_ERROR );
+            }
+            else
+            {
+                if( publishInfo.qos != MQTTQoS0 )
+                {
+                    fixedBuffer.pBuffer = pConnection->sendBuffer;
+                    fixedBuffer.size = MQTT_PUBLISH_ACK_PACKET_SIZE;
+
+                    if( ( MQTT_SerializeAck( &fixedBuffer, MQTT_PACKET_TYPE_PUBACK, packetId ) != MQTTSuccess ) ||
+                        ( sendAll( pConnection, pConnection->sendBuffer, MQTT_PUBLISH_ACK_PACKET_SIZE ) == false ) )
+                    {
+                        mqttStatus = MQTTSendFailed;
+                    }
+                }
+
+                if( mqttStatus != MQTTSuccess )
+                {
+                    finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+                }
+                else
+                {
+                    handleLoopback( pConnection, &publishInfo );
+                    checkDrained( pConnection );
+                }
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PUBACK:
+            mqttStatus = MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent );
+
+            if( mqttStatus == MQTTSuccess )
+            {
+                handlePuback( pConnection, packetId );
+                checkDrained( pConnection );
+            }
+            else
+            {
+                finishConnection( pConnection, OUTCOME_PROTOCOL_ERROR );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PINGRESP:
+            break;
+
+        default:
+            finishConnection( pConnection, OUTCOME_PROTOCOL_ERROR );
+            break;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void processPackets( Connection_t * pConnection )
+{
+    MQTTPacketInfo_t packetInfo;
+    size_t offset = 0U, headerLength = 0U, remainingLength = 0U, multiplier = 1U;
+    bool complete = true;
+    uint8_t encodedByte = 0U;
+
+    while( ( pConnection->active == true ) && ( complete == true ) )
+    {
+        /* Decode the remaining length, at most four bytes after the type. */
+        headerLength = 1U;
+        remainingLength = 0U;
+        multiplier = 1U;
+
+        do
+        {
+            complete = ( offset + headerLength ) < pConnection->receivedLength;
+
+            if( complete == true )
+            {
+                encodedByte = pConnection->pReceiveBuffer[ offset + headerLength ];
+                remainingLength += ( size_t ) ( encodedByte & 0x7FU ) * multiplier;
+                multiplier *= 128U;
+                headerLength++;
+            }
+        } while( ( complete == true ) && ( ( encodedByte & 0x80U ) != 0U ) && ( headerLength <= 4U ) );
+
+        if( ( complete == true ) && ( ( encodedByte & 0x80U ) != 0U ) )
+        {
+            finishConnection( pConnection, OUTCOME_PROTOCOL_ERROR );
+        }
+        else if( ( complete == true ) && ( ( headerLength + remainingLength ) > pConnection->receiveBufferSize ) )
+        {
+            /* Larger than any message this generator publishes. */
+            finishConnection( pConnection, OUTCOME_PROTOCOL_ERROR );
+        }
+        else if( ( complete == true ) && ( ( offset + headerLength + remainingLength ) <= pConnection->receivedLength ) )
+        {
+            ( void ) memset( &packetInfo, 0, sizeof( packetInfo ) );
+            packetInfo.type = pConnection->pReceiveBuffer[ offset ];
+            packetInfo.pRemainingData = &pConnection->pReceiveBuffer[ offset + headerLength ];
+            packetInfo.remainingLength = remainingLength;
+            offset += headerLength + remainingLength;
+
+            handlePacket( pConnection, &packetInfo );
+        }
+        else
+        {
+            complete = false;
+        }
+    }
+
+    if( pConnection->active == true )
+    {
+        /* Keep the start of the next packet for the next read. */
+        ( void ) memmove( pConnection->pReceiveBuffer, &pConnection->pReceiveBuffer[ offset ], pConnection->receivedLength - offset );
+        pConnection->receivedLength -= offset;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void connectCallback( ReactorConnection_t * pReactorConnection,
+                             ReactorStatus_t status,
+                             void * pUserContext )
+{
+    Connection_t * pConnection = ( Connection_t * ) pUserContext;
+
+    ( void ) pReactorConnection;
+
+    if( status == REACTOR_SUCCESS )
+    {
+        nextPhase( pConnection, LATENCY_TLS, PHASE_CONNACK );
+
+        if( sendConnect( pConnection ) == false )
+        {
+            finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+        }
+    }
+    else if( status == REACTOR_DNS_FAILURE )
+    {
+        finishConnection( pConnection, OUTCOME_DNS_FAILURE );
+    }
+    else if( status == REACTOR_CONNECT_FAILURE )
+    {
+        finishConnection( pConnection, OUTCOME_CONNECT_FAILURE );
+    }
+    else if( status == REACTOR_HANDSHAKE_FAILED )
+    {
+        finishConnection( pConnection, OUTCOME_HANDSHAKE_FAILURE );
+    }
+    else if( status == REACTOR_TIMEOUT )
+    {
+        finishConnection( pConnection, OUTCOME_CONNECT_TIMEOUT );
+    }
+    else
+    {
+        finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void receiveCallback( ReactorConnection_t * pReactorConnection,
+                             void * pUserContext )
+{
+    Connection_t * pConnection = ( Connection_t * ) pUserContext;
+    OpensslParams_t * pParams = &pConnection->opensslParams;
+    size_t space = 0U, request = 0U;
+    int32_t received = 1;
+
+    ( void ) pReactorConnection;
+
+    while( ( pConnection->active == true ) && ( received > 0 ) )
+    {
+        space = pConnection->receiveBufferSize - pConnection->receivedLength;
+
+        /* Openssl_Recv only avoids blocking for one byte, which refills the
+         * read-ahead buffer from the readable socket; what it holds is then
+         * taken in one call. */
+        request = ( pParams->readAheadLength > 0U ) ? space : 1U;
+        received = Openssl_Recv( &pConnection->networkContext,
+                                 &pConnection->pReceiveBuffer[ pConnection->receivedLength ],
+                                 request );
+
+        if( received < 0 )
+        {
+            finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+        }
+        else if( received > 0 )
+        {
+            pConnection->receivedLength += ( size_t ) received;
+            processPackets( pConnection );
+        }
+        else
+        {
+            /* Drained. */
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void startConnection( Connection_t * pConnection )
+{
+    Worker_t * pWorker = pConnection->pWorker;
+    ReactorConnectInfo_t connectInfo = { 0 };
+    ReactorStatus_t status = REACTOR_SUCCESS;
+    int clientIdLength = 0, topicLength = 0;
+
+    pConnection->active = true;
+    pWorker->activeCount++;
+
+    /* The reactor owns the deadline of the connect. */
+    pConnection->phase = PHASE_CONNECTING;
+    pConnection->phaseStartUs = nowUs();
+    pConnection->deadlineUs = 0U;
+    pConnection->nextPacketId = SUBSCRIBE_PACKET_ID + 1U;
+    pConnection->receiveBufferSize = config.payloadMax + RECEIVE_OVERHEAD;
+    pConnection->pReceiveBuffer = malloc( pConnection->receiveBufferSize );
+
+    clientIdLength = snprintf( pConnection->clientId, sizeof( pConnection->clientId ),
+                               "%s%" PRIu32, config.pClientPrefix, pConnection->index );
+    pConnection->clientIdLength = ( clientIdLength > 0 ) ? ( size_t ) clientIdLength : 0U;
+    topicLength = snprintf( pConnection->topic, sizeof( pConnection->topic ),
+                            "%s/%s", config.pTopicPrefix, pConnection->clientId );
+    pConnection->topicLength = ( topicLength > 0 ) ? ( size_t ) topicLength : 0U;
+
+    ( void ) memset( &pConnection->opensslParams, 0, sizeof( pConnection->opensslParams ) );
+    pConnection->opensslParams.pReadAheadBuffer = pConnection->readAheadBuffer;
+    pConnection->opensslParams.readAheadBufferSize = sizeof( pConnection->readAheadBuffer );
+    pConnection->networkContext.pParams = &pConnection->opensslParams;
+
+    connectInfo.pServerInfo = &serverInfo;
+    connectInfo.pOpensslCredentials = &credentials;
+    connectInfo.connectTimeoutMs = config.responseTimeoutMs;
+    connectInfo.sendTimeoutMs = TRANSPORT_SEND_TIMEOUT_MS;
+    connectInfo.recvTimeoutMs = TRANSPORT_RECV_TIMEOUT_MS;
+    connectInfo.connectCallback = connectCallback;
+    connectInfo.receiveCallback = receiveCallback;
+    connectInfo.pUserContext = pConnection;
+
+    if( ( clientIdLength <= 0 ) || ( pConnection->clientIdLength >= sizeof( pConnection->clientId ) ) ||
+        ( topicLength <= 0 ) || ( pConnection->topicLength >= sizeof( pConnection->topic ) ) ||
+        ( pConnection->pReceiveBuffer == NULL ) )
+    {
+        /* The client identifier or topic would be cut. */
+        finishConnection( pConnection, OUTCOME_PROTOCOL_ERROR );
+    }
+    else
+    {
+        status = Reactor_Connect( &pWorker->reactor, &pConnection->connection, &pConnection->networkContext, &connectInfo );
+
+        /* Failures to start the connect are reported like failed connects. */
+        if( status != REACTOR_SUCCESS )
+        {
+            connectCallback( &pConnection->connection, status, pConnection );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t serviceConnections( Worker_t * pWorker,
+                                    uint64_t timeUs )
+{
+    Connection_t * pConnection = NULL;
+    uint64_t waitUs = ( uint64_t ) DISPATCH_TIMEOUT_MS * 1000U;
+    uint64_t keepAliveUs = ( uint64_t ) MQTT_KEEP_ALIVE_INTERVAL_S * 500000U;
+    uint64_t responseTimeoutUs = ( uint64_t ) config.responseTimeoutMs * 1000U;
+    uint32_t i, j, burst;
+
+    for( i = 0U; i < pWorker->startedCount; i++ )
+    {
+        pConnection = &pWorker->pConnections[ i ];
+
+        if( ( pConnection->active == true ) && ( pConnection->phase == PHASE_PUBLISH ) )
+        {
+            for( burst = 0U; ( burst < MAX_PUBLISH_BURST ) &&
+                 ( pConnection->active == true ) &&
+                 ( pConnection->nextPublishUs <= timeUs ) &&
+                 ( pConnection->nextPublishUs < pConnection->publishEndUs ); burst++ )
+            {
+                if( ( config.qos == MQTTQoS1 ) && ( pConnection->windowCount == config.window ) )
+                {
+                    /* The publish waits for a PUBACK. */
+                    if( pConnection->stalled == false )
+                    {
+                        pWorker->results.windowStalls++;
+                        pConnection->stalled = true;
+                    }
+
+                    break;
+                }
+                else if( sendPublish( pConnection ) == false )
+                {
+                    finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+                }
+                else
+                {
+                    pConnection->nextPublishUs += publishIntervalUs;
+                }
+            }
+
+            /* A publish still waiting for the window at the end is not sent. */
+            if( ( pConnection->active == true ) &&
+                ( ( pConnection->nextPublishUs >= pConnection->publishEndUs ) || ( timeUs >= pConnection->publishEndUs ) ) )
+            {
+                pConnection->phase = PHASE_DRAIN;
+                pConnection->phaseStartUs = timeUs;
+                pConnection->deadlineUs = timeUs + responseTimeoutUs;
+                checkDrained( pConnection );
+            }
+            else if( ( pConnection->active == true ) && ( pConnection->stalled == false ) )
+            {
+                /* Wake up for the next publish. */
+                if( pConnection->nextPublishUs <= timeUs )
+                {
+                    waitUs = 0U;
+                }
+                else if( ( pConnection->nextPublishUs - timeUs ) < waitUs )
+                {
+                    waitUs = pConnection->nextPublishUs - timeUs;
+                }
+            }
+            else
+            {
+                /* Ended, or waiting for a PUBACK. */
+            }
+        }
+
+        if( ( pConnection->active == true ) && ( pConnection->windowCount > 0U ) )
+        {
+            /* The oldest publish in the window is past its deadline. */
+            for( j = 0U; ( j < pConnection->windowCount ) && ( pConnection->active == true ); j++ )
+            {
+                if( ( timeUs - pConnection->pWindow[ j ].sendUs ) >= responseTimeoutUs )
+                {
+                    finishConnection( pConnection, OUTCOME_RESPONSE_TIMEOUT );
+                }
+            }
+        }
+
+        if( ( pConnection->active == true ) && ( pConnection->deadlineUs != 0U ) && ( timeUs >= pConnection->deadlineUs ) )
+        {
+            /* A drain ends with what was delivered; the rest is counted lost. */
+            finishConnection( pConnection, ( pConnection->phase == PHASE_DRAIN ) ?
+                              OUTCOME_COMPLETED : OUTCOME_RESPONSE_TIMEOUT );
+        }
+
+        if( ( pConnection->active == true ) && ( pConnection->phase >= PHASE_PUBLISH ) &&
+            ( ( timeUs - pConnection->lastSendUs ) >= keepAliveUs ) &&
+            ( sendPingreq( pConnection ) == false ) )
+        {
+            finishConnection( pConnection, OUTCOME_TRANSPORT_ERROR );
+        }
+    }
+
+    return ( uint32_t ) ( waitUs / 1000U );
+}
+/*-----------------------------------------------------------*/
+
+static void * runWorker( void * pArgument )
+{
+    Worker_t * pWorker = ( Worker_t * ) pArgument;
+    Connection_t * pConnection = NULL;
+    uint64_t timeUs = 0U, startUs = 0U;
+    uint32_t timeoutMs = 0U;
+
+    while( ( pWorker->status == 0 ) &&
+           ( ( pWorker->startedCount < pWorker->connectionCount ) || ( pWorker->activeCount > 0U ) ) )
+    {
+        timeUs = nowUs();
+        timeoutMs = serviceConnections( pWorker, timeUs );
+
+        while( pWorker->startedCount < pWorker->connectionCount )
+        {
+            pConnection = &pWorker->pConnections[ pWorker->startedCount ];
+            startUs = runStartUs;
+
+            if( config.connectRate > 0.0 )
+            {
+                startUs += ( uint64_t ) ( ( ( double ) pConnection->index * 1000000.0 ) / config.connectRate );
+            }
+
+            if( startUs > timeUs )
+            {
+                /* Wake up for the next connect. */
+                if( ( ( startUs - timeUs ) / 1000U ) < timeoutMs )
+                {
+                    timeoutMs = ( uint32_t ) ( ( startUs - timeUs ) / 1000U );
+                }
+
+                break;
+            }
+
+            pWorker->startedCount++;
+            startConnection( pConnection );
+        }
+
+        if( Reactor_Dispatch( &pWorker->reactor, timeoutMs ) != REACTOR_SUCCESS )
+        {
+            pWorker->status = -1;
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static void printReport( const LoadgenResults_t * pResults,
+                         double elapsedS )
+{
+    const Histogram_t * pHistogram = NULL;
+    double publishS = 0.0;
+    uint32_t i;
+
+    if( pResults->lastPublishUs > pResults->firstPublishUs )
+    {
+        publishS = ( double ) ( pResults->lastPublishUs - pResults->firstPublishUs ) / 1000000.0;
+    }
+
+    printf( "%u connections on %u threads in %.1f s, QoS %d, payloads of %zu to %zu bytes.\n\n",
+            config.connectionCount,
+            config.threadCount,
+            elapsedS,
+            ( int ) config.qos,
+            config.payloadMin,
+            config.payloadMax );
+
+    printf( "%-18s %10s\n", "outcome", "connections" );
+
+    for( i = 0U; i < ( uint32_t ) OUTCOME_COUNT; i++ )
+    {
+        if( ( pResults->outcomes[ i ] > 0U ) || ( i == ( uint32_t ) OUTCOME_COMPLETED ) )
+        {
+            printf( "%-18s %10" PRIu64 "\n", outcomeNames[ i ], pResults->outcomes[ i ] );
+        }
+    }
+
+    printf( "\n%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+            "latency", "count", "mean ms", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms" );
+
+    for( i = 0U; i < ( uint32_t ) LATENCY_COUNT; i++ )
+    {
+        pHistogram = &pResults->histograms[ i ];
+
+        printf( "%-10s %10" PRIu64 " %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                latencyNames[ i ],
+                pHistogram->count,
+                ( pHistogram->count > 0U ) ? ( ( double ) pHistogram->sumUs / ( double ) pHistogram->count / 1000.0 ) : 0.0,
+                ( double ) histogramPercentile( pHistogram, 500U ) / 1000.0,
+                ( double ) histogramPercentile( pHistogram, 900U ) / 1000.0,
+                ( double ) histogramPercentile( pHistogram, 990U ) / 1000.0,
+                ( double ) histogramPercentile( pHistogram, 999U ) / 1000.0,
+                ( double ) pHistogram->maxUs / 1000.0 );
+    }
+
+    printf( "\n%-10s %12s %12s %12s\n", "messages", "count", "per s", "MB/s" );
+    printf( "%-10s %12" PRIu64 " %12.1f %12.3f\n",
+            "published",
+            pResults->published,
+            ( publishS > 0.0 ) ? ( ( double ) pResults->published / publishS ) : 0.0,
+            ( publishS > 0.0 ) ? ( ( double ) pResults->publishedBytes / publishS / 1000000.0 ) : 0.0 );
+    printf( "%-10s %12" PRIu64 " %12.1f %12.3f\n",
+            "received",
+            pResults->received,
+            ( publishS > 0.0 ) ? ( ( double ) pResults->received / publishS ) : 0.0,
+            ( publishS > 0.0 ) ? ( ( double ) pResults->receivedBytes / publishS / 1000000.0 ) : 0.0 );
+
+    printf( "\nTarget %.1f publishes/s; %" PRIu64 " acked, %" PRIu64 " unacked, %" PRIu64 " lost, "
+            "%" PRIu64 " window stalls, %" PRIu64 " unexpected.\n",
+            config.publishRate * ( double ) config.connectionCount,
+            pResults->acked,
+            pResults->unacked,
+            pResults->lost,
+            pResults->windowStalls,
+            pResults->unexpected );
+}
+/*-----------------------------------------------------------*/
+
+static int writeJsonReport( const LoadgenResults_t * pResults )
+{
+    static const uint32_t permilles[] = { 500U, 990U, 999U };
+    static const char * const permilleNames[] = { "p50", "p99", "p99.9" };
+    const Histogram_t * pHistogram = NULL;
+    uint64_t publishNs = 0U;
+    FILE * pFile = fopen( config.pReportPath, "w" );
+    const char * pSeparator = "";
+    uint32_t i, j;
+    int result = -1;
+
+    if( pFile != NULL )
+    {
+        fprintf( pFile, "{\n  \"benchmarks\": [" );
+
+        /* A percentile is reported as the "median" time of its entry, so
+         * that compare_benchmarks.py flags its growth. */
+        for( i = 0U; i < ( uint32_t ) LATENCY_COUNT; i++ )
+        {
+            pHistogram = &pResults->histograms[ i ];
+
+            for( j = 0U; ( j < ( sizeof( permilles ) / sizeof( permilles[ 0 ] ) ) ) && ( pHistogram->count > 0U ); j++ )
+            {
+                fprintf( pFile,
+                         "%s\n    { \"name\": \"mqtt_loadgen/%s_%s\", \"samples\": %" PRIu64 ", \"median_ns\": %" PRIu64 ".0 }",
+                         pSeparator,
+                         latencyNames[ i ],
+                         permilleNames[ j ],
+                         pHistogram->count,
+                         histogramPercentile( pHistogram, permilles[ j ] ) * 1000U );
+                pSeparator = ",";
+            }
+        }
+
+        /* Throughput is reported as the time per message, which grows when
+         * it drops. */
+        if( pResults->lastPublishUs > pResults->firstPublishUs )
+        {
+            publishNs = ( pResults->lastPublishUs - pResults->firstPublishUs ) * 1000U;
+
+            if( pResults->published > 0U )
+            {
+                fprintf( pFile,
+                         "%s\n    { \"name\": \"mqtt_loadgen/publish\", \"samples\": %" PRIu64 ", \"median_ns\": %.3f }",
+                         pSeparator,
+                         pResults->published,
+                         ( double ) publishNs / ( double ) pResults->published );
+                pSeparator = ",";
+            }
+
+            if( pResults->received > 0U )
+            {
+                fprintf( pFile,
+                         "%s\n    { \"name\": \"mqtt_loadgen/receive\", \"samples\": %" PRIu64 ", \"median_ns\": %.3f }",
+                         pSeparator,
+                         pResults->received,
+                         ( double ) publishNs / ( double ) pResults->received );
+            }
+        }
+
+        fprintf( pFile, "\n  ]\n}\n" );
+        result = ( fclose( pFile ) == 0 ) ? 0 : -1;
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static int parsePayloadSizes( const char * pArgument )
+{
+    unsigned long minimum = 0UL, maximum = 0UL;
+    char distribution[ 4 ] = { 0 };
+    int fields = sscanf( pArgument, "%lu:%lu:%3s", &minimum, &maximum, distribution );
+    int result = 0;
+
+    if( fields == 1 )
+    {
+        config.payloadMin = ( size_t ) minimum;
+        config.payloadMax = ( size_t ) minimum;
+        config.distribution = PAYLOAD_FIXED;
+    }
+    else if( ( fields == 2 ) || ( ( fields == 3 ) && ( strcmp( distribution, "log" ) == 0 ) ) )
+    {
+        config.payloadMin = ( size_t ) minimum;
+        config.payloadMax = ( size_t ) maximum;
+        config.distribution = ( fields == 3 ) ? PAYLOAD_LOG_UNIFORM : PAYLOAD_UNIFORM;
+    }
+    else
+    {
+        result = -1;
+    }
+
+    if( ( config.payloadMin < STAMP_SIZE ) || ( config.payloadMax < config.payloadMin ) ||
+        ( config.payloadMax > MAX_PAYLOAD_SIZE ) )
+    {
+        result = -1;
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static int parseArguments( int argc,
+                           char ** argv )
+{
+    int option = 0;
+    int result = 0;
+
+    config.port = DEFAULT_PORT;
+    config.connectionCount = DEFAULT_CONNECTION_COUNT;
+    config.threadCount = 1U;
+    config.connectRate = DEFAULT_CONNECT_RATE;
+    config.durationS = DEFAULT_DURATION_S;
+    config.publishRate = DEFAULT_PUBLISH_RATE;
+    config.qos = MQTTQoS0;
+    config.window = DEFAULT_WINDOW;
+    config.payloadMin = DEFAULT_PAYLOAD_SIZE;
+    config.payloadMax = DEFAULT_PAYLOAD_SIZE;
+    config.distribution = PAYLOAD_FIXED;
+    config.responseTimeoutMs = DEFAULT_RESPONSE_TIMEOUT_MS;
+    config.pTopicPrefix = DEFAULT_TOPIC_PREFIX;
+    config.pClientPrefix = DEFAULT_CLIENT_PREFIX;
+    config.loopback = true;
+
+    while( ( option = getopt( argc, argv, "e:p:r:c:k:n:j:C:d:f:q:w:l:W:t:i:xRo:" ) ) != -1 )
+    {
+        switch( option )
+        {
+            case 'e':
+                config.pEndpoint = optarg;
+                break;
+
+            case 'p':
+                config.port = ( uint16_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'r':
+                config.pRootCaPath = optarg;
+                break;
+
+            case 'c':
+                config.pCertPath = optarg;
+                break;
+
+            case 'k':
+                config.pKeyPath = optarg;
+                break;
+
+            case 'n':
+                config.connectionCount = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'j':
+                config.threadCount = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'C':
+                config.connectRate = strtod( optarg, NULL );
+                break;
+
+            case 'd':
+                config.durationS = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'f':
+                config.publishRate = strtod( optarg, NULL );
+                break;
+
+            case 'q':
+                config.qos = ( strtoul( optarg, NULL, 10 ) == 1UL ) ? MQTTQoS1 : MQTTQoS0;
+                result = ( strtoul( optarg, NULL, 10 ) <= 1UL ) ? result : -1;
+                break;
+
+            case 'w':
+                config.window = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'l':
+                result = ( parsePayloadSizes( optarg ) == 0 ) ? result : -1;
+                break;
+
+            case 'W':
+                config.responseTimeoutMs = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 't':
+                config.pTopicPrefix = optarg;
+                break;
+
+            case 'i':
+                config.pClientPrefix = optarg;
+                break;
+
+            case 'x':
+                config.loopback = false;
+                break;
+
+            case 'R':
+                config.reuseSslContext = true;
+                break;
+
+            case 'o':
+                config.pReportPath = optarg;
+                break;
+
+            default:
+                result = -1;
+                break;
+        }
+    }
+
+    /* The window must leave packet identifiers unused while in flight. */
+    if( ( config.pEndpoint == NULL ) || ( config.pRootCaPath == NULL ) ||
+        ( config.pCertPath == NULL ) || ( config.pKeyPath == NULL ) ||
+        ( config.connectionCount == 0U ) || ( config.threadCount == 0U ) ||
+        ( config.connectRate < 0.0 ) || ( config.publishRate <= 0.0 ) ||
+        ( config.window == 0U ) || ( config.window > 1024U ) ||
+        ( config.responseTimeoutMs == 0U ) )
+    {
+        result = -1;
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    struct rlimit fileLimit;
+    Worker_t * pWorkers = NULL;
+    Connection_t * pConnections = NULL;
+    InFlight_t * pWindows = NULL;
+    LoadgenResults_t total;
+    uint32_t i, j, perWorker, started = 0U;
+    int status = EXIT_FAILURE;
+
+    if( parseArguments( argc, argv ) != 0 )
+    {
+        fprintf( stderr,
+                 "Usage: %s -e <endpoint> -r <root CA> -c <cert> -k <key> [-p <port>]\n"
+                 "       [-n <connections>] [-j <threads>] [-C <connects per second, 0 for all at once>]\n"
+                 "       [-d <duration s>] [-f <publishes per second per connection>] [-q <QoS 0|1>]\n"
+                 "       [-w <QoS 1 window>] [-l <size>|<min>:<max>|<min>:<max>:log]\n"
+                 "       [-W <response timeout ms>] [-t <topic prefix>] [-i <client prefix>]\n"
+                 "       [-x] [-R] [-o <JSON report>]\n",
+                 argv[ 0 ] );
+
+        return EXIT_FAILURE;
+    }
+
+    /* Every connection holds a socket. */
+    if( ( getrlimit( RLIMIT_NOFILE, &fileLimit ) == 0 ) && ( fileLimit.rlim_cur < fileLimit.rlim_max ) )
+    {
+        fileLimit.rlim_cur = fileLimit.rlim_max;
+        ( void ) setrlimit( RLIMIT_NOFILE, &fileLimit );
+    }
+
+    serverInfo.pHostName = config.pEndpoint;
+    serverInfo.hostNameLength = strlen( config.pEndpoint );
+    serverInfo.port = config.port;
+
+    credentials.pRootCaPath = config.pRootCaPath;
+    credentials.pClientCertPath = config.pCertPath;
+    credentials.pPrivateKeyPath = config.pKeyPath;
+    credentials.sniHostName = config.pEndpoint;
+    credentials.reuseSslContext = config.reuseSslContext;
+
+    if( config.port == 443U )
+    {
+        credentials.pAlpnProtos = AWS_IOT_MQTT_ALPN;
+        credentials.alpnProtosLen = AWS_IOT_MQTT_ALPN_LENGTH;
+    }
+
+    if( config.threadCount > config.connectionCount )
+    {
+        config.threadCount = config.connectionCount;
+    }
+
+    publishIntervalUs = ( uint64_t ) ( 1000000.0 / config.publishRate );
+    publishIntervalUs = ( publishIntervalUs > 0U ) ? publishIntervalUs : 1U;
+
+    pFiller = malloc( config.payloadMax );
+    pWorkers = calloc( config.threadCount, sizeof( Worker_t ) );
+    pConnections = calloc( config.connectionCount, sizeof( Connection_t ) );
+    pWindows = calloc( ( size_t ) config.connectionCount * config.window, sizeof( InFlight_t ) );
+    ( void ) memset( &total, 0, sizeof( total ) );
+
+    if( ( pFiller != NULL ) && ( pWorkers != NULL ) && ( pConnections != NULL ) && ( pWindows != NULL ) )
+    {
+        for( i = 0U; i < config.payloadMax; i++ )
+        {
+            pFiller[ i ] = ( uint8_t ) ( 'a' + ( i % 26U ) );
+        }
+
+        /* Worker i runs connections i, i + threads, ..., stored together so
+         * that each scans only its own. */
+        for( i = 0U; i < config.threadCount; i++ )
+        {
+            perWorker = ( config.connectionCount - i + config.threadCount - 1U ) / config.threadCount;
+            pWorkers[ i ].index = i;
+            pWorkers[ i ].pConnections = &pConnections[ started ];
+            pWorkers[ i ].connectionCount = perWorker;
+            pWorkers[ i ].randomState = 0x9E3779B97F4A7C15ULL * ( ( uint64_t ) i + 1U );
+
+            for( j = 0U; j < perWorker; j++ )
+            {
+                pConnections[ started + j ].index = i + ( j * config.threadCount );
+                pConnections[ started + j ].pWorker = &pWorkers[ i ];
+                pConnections[ started + j ].pWindow = &pWindows[ ( size_t ) ( started + j ) * config.window ];
+            }
+
+            started += perWorker;
+        }
+
+        status = EXIT_SUCCESS;
+        runStartUs = nowUs();
+
+        for( i = 0U; i < config.threadCount; i++ )
+        {
+            if( Reactor_Init( &pWorkers[ i ].reactor ) != REACTOR_SUCCESS )
+            {
+                pWorkers[ i ].status = -1;
+                status = EXIT_FAILURE;
+            }
+            else if( pthread_create( &pWorkers[ i ].thread, NULL, runWorker, &pWorkers[ i ] ) != 0 )
+            {
+                Reactor_Deinit( &pWorkers[ i ].reactor );
+                pWorkers[ i ].status = -1;
+                status = EXIT_FAILURE;
+            }
+            else
+            {
+                pWorkers[ i ].running = true;
+            }
+        }
+
+        for( i = 0U; i < config.threadCount; i++ )
+        {
+            if( pWorkers[ i ].running == true )
+            {
+                ( void ) pthread_join( pWorkers[ i ].thread, NULL );
+                Reactor_Deinit( &pWorkers[ i ].reactor );
+            }
+
+            status = ( pWorkers[ i ].status == 0 ) ? status : EXIT_FAILURE;
+
+            for( j = 0U; j < ( uint32_t ) LATENCY_COUNT; j++ )
+            {
+                histogramMerge( &total.histograms[ j ], &pWorkers[ i ].results.histograms[ j ] );
+            }
+
+            for( j = 0U; j < ( uint32_t ) OUTCOME_COUNT; j++ )
+            {
+                total.outcomes[ j ] += pWorkers[ i ].results.outcomes[ j ];
+            }
+
+            total.published += pWorkers[ i ].results.published;
+            total.publishedBytes += pWorkers[ i ].results.publishedBytes;
+            total.acked += pWorkers[ i ].results.acked;
+            total.received += pWorkers[ i ].results.received;
+            total.receivedBytes += pWorkers[ i ].results.receivedBytes;
+            total.windowStalls += pWorkers[ i ].results.windowStalls;
+            total.unacked += pWorkers[ i ].results.unacked;
+            total.lost += pWorkers[ i ].results.lost;
+            total.unexpected += pWorkers[ i ].results.unexpected;
+
+            if( ( pWorkers[ i ].results.firstPublishUs != 0U ) &&
+                ( ( total.firstPublishUs == 0U ) || ( pWorkers[ i ].results.firstPublishUs < total.firstPublishUs ) ) )
+            {
+                total.firstPublishUs = pWorkers[ i ].results.firstPublishUs;
+            }
+
+            if( pWorkers[ i ].results.lastPublishUs > total.lastPublishUs )
+            {
+                total.lastPublishUs = pWorkers[ i ].results.lastPublishUs;
+            }
+        }
+
+        if( status == EXIT_SUCCESS )
+        {
+            printReport( &total, ( double ) ( nowUs() - runStartUs ) / 1000000.0 );
+
+            if( ( config.pReportPath != NULL ) && ( writeJsonReport( &total ) != 0 ) )
+            {
+                fprintf( stderr, "Could not write %s.\n", config.pReportPath );
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    if( status != EXIT_SUCCESS )
+    {
+        fprintf( stderr, "Load generator failed.\n" );
+    }
+
+    if( config.reuseSslContext == true )
+    {
+        Openssl_ClearContextCache();
+    }
+
+    free( pFiller );
+    free( pWorkers );
+    free( pConnections );
+    free( pWindows );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,92 @@
+/*
+ * OTA PAL V2.0.1 for POSIX
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_config.h
+ * @brief OTA settings for the OTA PAL benchmark. Only the PAL is linked, so
+ * these merely have to satisfy the OTA headers.
+ */
+
+#ifndef _OTA_CONFIG_H_
+#define _OTA_CONFIG_H_
+
+/**
+ * @brief The number of words allocated to the stack for the OTA agent.
+ */
+#define otaconfigSTACK_SIZE                    10000U
+
+/**
+ * @brief Log base 2 of the size of the file data block message (excluding the header).
+ */
+#define otaconfigLOG2_FILE_BLOCK_SIZE          12UL
+
+/**
+ * @brief Milliseconds to wait for the self test phase to succeed before we force reset.
+ */
+#define otaconfigSELF_TEST_RESPONSE_WAIT_MS    16000U
+
+/**
+ * @brief Milliseconds to wait before requesting data blocks from the OTA service if nothing is happening.
+ */
+#define otaconfigFILE_REQUEST_WAIT_MS          10000U
+
+/**
+ * @brief The maximum allowed length of the thing name used by the OTA agent.
+ */
+#define otaconfigMAX_THINGNAME_LEN             64U
+
+/**
+ * @brief The maximum number of data blocks requested from OTA streaming service.
+ */
+#define otaconfigMAX_NUM_BLOCKS_REQUEST        1U
+
+/**
+ * @brief The maximum number of requests allowed to send without a response before we abort.
+ */
+#define otaconfigMAX_NUM_REQUEST_MOMENTUM      32U
+
+/**
+ * @brief The number of data buffers reserved by the OTA agent.
+ */
+#define otaconfigMAX_NUM_OTA_DATA_BUFFERS      1U
+
+/**
+ * @brief Allow update to same or lower version.
+ */
+#define otaconfigAllowDowngrade                0U
+
+/**
+ * @brief The protocol selected for OTA control operations.
+ */
+#define configENABLED_CONTROL_PROTOCOL         ( OTA_CONTROL_OVER_MQTT )
+
+/**
+ * @brief The protocol selected for OTA data operations.
+ */
+#define configENABLED_DATA_PROTOCOLS           ( OTA_DATA_OVER_MQTT )
+
+/**
+ * @brief The preferred protocol selected for OTA data operations.
+ */
+#define configOTA_PRIMARY_DATA_PROTOCOL        ( OTA_DATA_OVER_MQTT )
+
+#endif /* _OTA_CONFIG_H_ */
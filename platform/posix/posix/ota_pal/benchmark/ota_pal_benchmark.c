@@ -0,0 +1,655 @@
+/*
+ * OTA PAL V2.0.1 for POSIX
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_pal_benchmark.c
+ * @brief Measures the throughput of the POSIX OTA PAL when receiving an image.
+ *
+ * A synthetic image is signed with a generated P-256 key, then written
+ * through #otaPal_CreateFileForRx, #otaPal_WriteBlock and #otaPal_CloseFile
+ * for every block size, with the blocks in order, in reverse order and in a
+ * random order, which is how they arrive when the agent requests several at
+ * once or retries lost ones. The latency of every #otaPal_WriteBlock call is
+ * recorded; #otaPal_CloseFile is timed on its own as it reads the whole file
+ * back to check the signature. A close that fails the check fails the
+ * benchmark, so the written file is also known to match the image.
+ *
+ * The image is then received as several files at once, the way a gateway
+ * downloads the images of its devices: a pool of worker threads takes the
+ * files one after the other, each with its own file context, and the
+ * aggregate throughput is reported for each number of files.
+ *
+ * The files are created in a temporary directory, which is also the working
+ * directory, as #otaPal_CloseFile stores the image state there.
+ *
+ * When built with TRACE_SPANS, the spans of the last writes are written to
+ * the trace file given, in the JSON trace event format that Perfetto opens.
+ * When built with ENERGY_METER, the energy of the block writes is logged at
+ * the end, measured by the power monitor that ENERGY_METER_MONITOR names if
+ * it is set.
+ *
+ * Usage: ota_pal_benchmark [image size in MB] [trace file]
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <pthread.h>
+#include <unistd.h>
+
+/* OpenSSL includes. */
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "ota.h"
+#include "ota_pal_posix.h"
+#include "trace_span.h"
+#include "energy_meter.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the image in MB when no size is given on the command line.
+ */
+#define DEFAULT_IMAGE_SIZE_MB         4U
+
+/**
+ * @brief Name of the received image in the temporary directory.
+ */
+#define BENCHMARK_IMAGE_FILE_NAME     "ota_pal_benchmark.bin"
+
+/**
+ * @brief Name of the signer certificate in the temporary directory.
+ */
+#define BENCHMARK_CERT_FILE_NAME      "ota_pal_benchmark.crt"
+
+/**
+ * @brief Name of the file #otaPal_SetPlatformImageState writes in the working
+ * directory.
+ */
+#define BENCHMARK_IMAGE_STATE_FILE    "PlatformImageState.txt"
+
+/**
+ * @brief Seed of the image contents and of the random block order, so runs
+ * are comparable.
+ */
+#define BENCHMARK_SEED                1U
+
+/**
+ * @brief Number of block orders of each block size.
+ */
+#define BLOCK_ORDER_COUNT             3U
+
+/**
+ * @brief Block size files are received with at the same time.
+ */
+#define CONCURRENT_BLOCK_SIZE         4096U
+
+/**
+ * @brief Largest number of files received at the same time, which is also
+ * the number of worker threads.
+ */
+#define CONCURRENT_MAX_FILES          8U
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Block sizes the image is written with. #otaPal_WriteBlock returns
+ * the bytes written as an int16_t, which bounds the largest one.
+ */
+static const uint32_t blockSizes[] = { 256U, 1024U, 4096U, 16384U };
+
+/**
+ * @brief Order in which the blocks of the image are written.
+ */
+typedef enum BlockOrder
+{
+    BlockOrderSequential, /**< @brief From the first block to the last. */
+    BlockOrderReverse,    /**< @brief From the last block to the first. */
+    BlockOrderRandom      /**< @brief Shuffled with #BENCHMARK_SEED. */
+} BlockOrder_t;
+
+/**
+ * @brief Labels of #BlockOrder_t in the report.
+ */
+static const char * const blockOrderNames[ BLOCK_ORDER_COUNT ] = { "sequential", "reverse", "random" };
+
+/**
+ * @brief The signed image written by every run.
+ */
+typedef struct BenchmarkImage
+{
+    uint8_t * pData;      /**< @brief Contents of the image. */
+    uint32_t size;        /**< @brief Size of the image in bytes. */
+    Sig256_t signature;   /**< @brief ECDSA-SHA256 signature of #pData. */
+} BenchmarkImage_t;
+
+/**
+ * @brief Timings of one benchmark run.
+ */
+typedef struct BenchmarkResult
+{
+    uint32_t blocks;  /**< @brief Calls to #otaPal_WriteBlock. */
+    double createMs;  /**< @brief Duration of #otaPal_CreateFileForRx. */
+    double writeMs;   /**< @brief Duration of all the #otaPal_WriteBlock calls. */
+    double closeMs;   /**< @brief Duration of #otaPal_CloseFile, including the signature check. */
+    double p50Us;     /**< @brief Median #otaPal_WriteBlock latency. */
+    double p90Us;     /**< @brief 90th percentile #otaPal_WriteBlock latency. */
+    double p99Us;     /**< @brief 99th percentile #otaPal_WriteBlock latency. */
+    double maxUs;     /**< @brief Slowest #otaPal_WriteBlock call. */
+} BenchmarkResult_t;
+
+/**
+ * @brief The files received at the same time by the worker threads.
+ */
+typedef struct ConcurrentRun
+{
+    const BenchmarkImage_t * pImage; /**< @brief The image every file receives. */
+    uint32_t fileCount;              /**< @brief Number of files. */
+    uint32_t nextFile;               /**< @brief The next file a worker takes. */
+    uint32_t failures;               /**< @brief Files which failed to be received. */
+} ConcurrentRun_t;
+
+/*-----------------------------------------------------------*/
+
+static double nowMs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( double ) now.tv_sec * 1000.0 ) + ( ( double ) now.tv_nsec / 1000000.0 );
+}
+/*-----------------------------------------------------------*/
+
+static void writeTrace( const char * pData,
+                        size_t length,
+                        void * pContext )
+{
+    ( void ) fwrite( pData, 1U, length, ( FILE * ) pContext );
+}
+/*-----------------------------------------------------------*/
+
+static int compareDoubles( const void * pLeft,
+                           const void * pRight )
+{
+    double left = *( const double * ) pLeft;
+    double right = *( const double * ) pRight;
+
+    return ( left > right ) - ( left < right );
+}
+/*-----------------------------------------------------------*/
+
+static double percentile( const double * pSorted,
+                          uint32_t count,
+                          uint32_t percent )
+{
+    return pSorted[ ( ( uint64_t ) ( count - 1U ) * percent ) / 100U ];
+}
+/*-----------------------------------------------------------*/
+
+static int createSignedImage( BenchmarkImage_t * pImage,
+                              const char * pCertPath )
+{
+    EVP_PKEY_CTX * pKeyContext = NULL;
+    EVP_PKEY * pKey = NULL;
+    EVP_MD_CTX * pSignContext = NULL;
+    X509 * pCertificate = NULL;
+    FILE * pCertFile = NULL;
+    size_t signatureLength = sizeof( pImage->signature.data );
+    uint32_t i;
+    int status = 0;
+
+    srand( BENCHMARK_SEED );
+
+    for( i = 0U; i < pImage->size; i++ )
+    {
+        pImage->pData[ i ] = ( uint8_t ) rand();
+    }
+
+    /* Generate a P-256 key, the key type of sig-sha256-ecdsa. */
+    pKeyContext = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, NULL );
+
+    if( ( pKeyContext != NULL ) &&
+        ( EVP_PKEY_keygen_init( pKeyContext ) == 1 ) &&
+        ( EVP_PKEY_CTX_set_ec_paramgen_curve_nid( pKeyContext, NID_X9_62_prime256v1 ) == 1 ) &&
+        ( EVP_PKEY_keygen( pKeyContext, &pKey ) == 1 ) )
+    {
+        pSignContext = EVP_MD_CTX_new();
+    }
+
+    /* Sign the image the way the code signing service does. */
+    if( ( pSignContext != NULL ) &&
+        ( EVP_DigestSignInit( pSignContext, NULL, EVP_sha256(), NULL, pKey ) == 1 ) &&
+        ( EVP_DigestSign( pSignContext, pImage->signature.data, &signatureLength,
+                          pImage->pData, pImage->size ) == 1 ) )
+    {
+        pImage->signature.size = ( uint16_t ) signatureLength;
+        pCertificate = X509_new();
+    }
+
+    /* The PAL only takes the public key from the signer certificate, so a
+     * self-signed one is enough. */
+    if( pCertificate != NULL )
+    {
+        ( void ) ASN1_INTEGER_set( X509_get_serialNumber( pCertificate ), 1 );
+        ( void ) X509_gmtime_adj( X509_getm_notBefore( pCertificate ), -60L );
+        ( void ) X509_gmtime_adj( X509_getm_notAfter( pCertificate ), 3600L );
+        ( void ) X509_set_pubkey( pCertificate, pKey );
+        ( void ) X509_NAME_add_entry_by_txt( X509_get_subject_name( pCertificate ),
+                                             "CN", MBSTRING_ASC,
+                                             ( const unsigned char * ) "ota_pal_benchmark",
+                                             -1, -1, 0 );
+        ( void ) X509_set_issuer_name( pCertificate, X509_get_subject_name( pCertificate ) );
+
+        if( X509_sign( pCertificate, pKey, EVP_sha256() ) > 0 )
+        {
+            pCertFile = fopen( pCertPath, "w" );
+        }
+    }
+
+    if( pCertFile != NULL )
+    {
+        status = PEM_write_X509( pCertFile, pCertificate );
+        ( void ) fclose( pCertFile );
+    }
+
+    X509_free( pCertificate );
+    EVP_MD_CTX_free( pSignContext );
+    EVP_PKEY_free( pKey );
+    EVP_PKEY_CTX_free( pKeyContext );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void orderBlocks( uint32_t * pOrder,
+                         uint32_t blockCount,
+                         BlockOrder_t order )
+{
+    uint32_t i, j, swap;
+
+    for( i = 0U; i < blockCount; i++ )
+    {
+        pOrder[ i ] = ( order == BlockOrderReverse ) ? ( blockCount - 1U - i ) : i;
+    }
+
+    if( order == BlockOrderRandom )
+    {
+        srand( BENCHMARK_SEED );
+
+        /* Fisher-Yates shuffle. */
+        for( i = blockCount - 1U; i > 0U; i-- )
+        {
+            j = ( uint32_t ) rand() % ( i + 1U );
+            swap = pOrder[ i ];
+            pOrder[ i ] = pOrder[ j ];
+            pOrder[ j ] = swap;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int runBenchmark( BenchmarkImage_t * pImage,
+                         uint32_t blockSize,
+                         BlockOrder_t order,
+                         BenchmarkResult_t * pResult )
+{
+    OtaFileContext_t fileContext;
+    uint32_t blockCount = ( pImage->size + blockSize - 1U ) / blockSize;
+    uint32_t * pOrder = malloc( blockCount * sizeof( uint32_t ) );
+    double * pLatencies = malloc( blockCount * sizeof( double ) );
+    uint32_t i, offset, length;
+    double startMs = 0.0;
+    int16_t written = 0;
+    int result = -1;
+
+    ( void ) memset( pResult, 0, sizeof( BenchmarkResult_t ) );
+    ( void ) memset( &fileContext, 0, sizeof( fileContext ) );
+
+    fileContext.pFilePath = ( uint8_t * ) BENCHMARK_IMAGE_FILE_NAME;
+    fileContext.pCertFilepath = ( uint8_t * ) BENCHMARK_CERT_FILE_NAME;
+    fileContext.fileSize = pImage->size;
+    fileContext.pSignature = &pImage->signature;
+
+    if( ( pOrder == NULL ) || ( pLatencies == NULL ) )
+    {
+        free( pOrder );
+        free( pLatencies );
+
+        return -1;
+    }
+
+    orderBlocks( pOrder, blockCount, order );
+
+    startMs = nowMs();
+
+    if( OTA_PAL_MAIN_ERR( otaPal_CreateFileForRx( &fileContext ) ) == OtaPalSuccess )
+    {
+        pResult->createMs = nowMs() - startMs;
+
+        for( i = 0U; i < blockCount; i++ )
+        {
+            offset = pOrder[ i ] * blockSize;
+            length = ( ( pImage->size - offset ) < blockSize ) ? ( pImage->size - offset ) : blockSize;
+
+            startMs = nowMs();
+            written = otaPal_WriteBlock( &fileContext, offset, &pImage->pData[ offset ], length );
+            pLatencies[ i ] = ( nowMs() - startMs ) * 1000.0;
+            pResult->writeMs += pLatencies[ i ];
+
+            if( written != ( int16_t ) length )
+            {
+                break;
+            }
+        }
+
+        pResult->blocks = i;
+        pResult->writeMs /= 1000.0;
+
+        if( i == blockCount )
+        {
+            startMs = nowMs();
+
+            if( OTA_PAL_MAIN_ERR( otaPal_CloseFile( &fileContext ) ) == OtaPalSuccess )
+            {
+                result = 0;
+            }
+
+            pResult->closeMs = nowMs() - startMs;
+        }
+        else
+        {
+            ( void ) otaPal_Abort( &fileContext );
+        }
+    }
+
+    if( result == 0 )
+    {
+        qsort( pLatencies, blockCount, sizeof( double ), compareDoubles );
+        pResult->p50Us = percentile( pLatencies, blockCount, 50U );
+        pResult->p90Us = percentile( pLatencies, blockCount, 90U );
+        pResult->p99Us = percentile( pLatencies, blockCount, 99U );
+        pResult->maxUs = pLatencies[ blockCount - 1U ];
+    }
+
+    ( void ) unlink( BENCHMARK_IMAGE_FILE_NAME );
+    free( pOrder );
+    free( pLatencies );
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static int receiveFile( const BenchmarkImage_t * pImage,
+                        uint32_t file )
+{
+    OtaFileContext_t fileContext;
+    char fileName[ 64 ];
+    uint32_t offset, length;
+    int result = -1;
+
+    ( void ) snprintf( fileName, sizeof( fileName ), "ota_pal_benchmark_%u.bin", file );
+    ( void ) memset( &fileContext, 0, sizeof( fileContext ) );
+
+    fileContext.pFilePath = ( uint8_t * ) fileName;
+    fileContext.pCertFilepath = ( uint8_t * ) BENCHMARK_CERT_FILE_NAME;
+    fileContext.fileSize = pImage->size;
+    fileContext.pSignature = ( Sig256_t * ) &pImage->signature;
+
+    if( OTA_PAL_MAIN_ERR( otaPal_CreateFileForRx( &fileContext ) ) == OtaPalSuccess )
+    {
+        for( offset = 0U; offset < pImage->size; offset += length )
+        {
+            length = ( ( pImage->size - offset ) < CONCURRENT_BLOCK_SIZE ) ? ( pImage->size - offset ) : CONCURRENT_BLOCK_SIZE;
+
+            if( otaPal_WriteBlock( &fileContext, offset, &pImage->pData[ offset ], length ) != ( int16_t ) length )
+            {
+                break;
+            }
+        }
+
+        if( offset < pImage->size )
+        {
+            ( void ) otaPal_Abort( &fileContext );
+        }
+        else if( OTA_PAL_MAIN_ERR( otaPal_CloseFile( &fileContext ) ) == OtaPalSuccess )
+        {
+            result = 0;
+        }
+        else
+        {
+            /* The signature check failed. */
+        }
+    }
+
+    ( void ) unlink( fileName );
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static void * concurrentWorker( void * pArgument )
+{
+    ConcurrentRun_t * pRun = pArgument;
+    uint32_t file = 0U;
+
+    for( file = __atomic_fetch_add( &pRun->nextFile, 1U, __ATOMIC_RELAXED );
+         file < pRun->fileCount;
+         file = __atomic_fetch_add( &pRun->nextFile, 1U, __ATOMIC_RELAXED ) )
+    {
+        if( receiveFile( pRun->pImage, file ) != 0 )
+        {
+            ( void ) __atomic_fetch_add( &pRun->failures, 1U, __ATOMIC_RELAXED );
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static int runConcurrentBenchmark( const BenchmarkImage_t * pImage,
+                                   uint32_t fileCount,
+                                   uint32_t workerCount )
+{
+    ConcurrentRun_t run = { 0 };
+    pthread_t workers[ CONCURRENT_MAX_FILES ];
+    uint32_t started = 0U;
+    uint32_t i;
+    double startMs = 0.0;
+    double elapsedMs = 0.0;
+    double megabytes = 0.0;
+
+    run.pImage = pImage;
+    run.fileCount = fileCount;
+
+    startMs = nowMs();
+
+    for( started = 0U; started < workerCount; started++ )
+    {
+        if( pthread_create( &workers[ started ], NULL, concurrentWorker, &run ) != 0 )
+        {
+            break;
+        }
+    }
+
+    /* The workers started take all the files, even if some failed to start. */
+    if( started == 0U )
+    {
+        run.failures = fileCount;
+    }
+
+    for( i = 0U; i < started; i++ )
+    {
+        ( void ) pthread_join( workers[ i ], NULL );
+    }
+
+    elapsedMs = nowMs() - startMs;
+    megabytes = ( ( double ) pImage->size * fileCount ) / ( 1024.0 * 1024.0 );
+
+    printf( "%6u %8u %10.1f %10.1f %9.1f\n",
+            fileCount,
+            started,
+            megabytes / ( elapsedMs / 1000.0 ),
+            megabytes / ( elapsedMs / 1000.0 ) / fileCount,
+            elapsedMs );
+
+    return ( run.failures == 0U ) ? 0 : -1;
+}
+/*-----------------------------------------------------------*/
+
+static void printResult( uint32_t blockSize,
+                         BlockOrder_t order,
+                         uint32_t imageSize,
+                         const BenchmarkResult_t * pResult )
+{
+    double megabytes = ( double ) imageSize / ( 1024.0 * 1024.0 );
+
+    printf( "%-10s %6u %8u %10.1f %10.1f %8.2f %8.2f %8.2f %9.2f %9.2f\n",
+            blockOrderNames[ order ],
+            blockSize,
+            pResult->blocks,
+            megabytes / ( pResult->writeMs / 1000.0 ),
+            megabytes / ( ( pResult->createMs + pResult->writeMs + pResult->closeMs ) / 1000.0 ),
+            pResult->p50Us,
+            pResult->p90Us,
+            pResult->p99Us,
+            pResult->maxUs,
+            pResult->closeMs );
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    BenchmarkImage_t image = { 0 };
+    BenchmarkResult_t result;
+    char directory[] = "/tmp/ota_pal_benchmark_XXXXXX";
+    uint32_t imageSizeMb = DEFAULT_IMAGE_SIZE_MB;
+    size_t i;
+    uint32_t order;
+    uint32_t files;
+    FILE * pTraceFile = NULL;
+    int inDirectory = 0;
+    int status = EXIT_FAILURE;
+
+    if( argc > 1 )
+    {
+        imageSizeMb = ( uint32_t ) strtoul( argv[ 1 ], NULL, 10 );
+    }
+
+    /* Opened before moving to the temporary directory, which is removed. */
+    if( argc > 2 )
+    {
+        pTraceFile = fopen( argv[ 2 ], "w" );
+
+        if( pTraceFile == NULL )
+        {
+            fprintf( stderr, "Failed to open the trace file %s.\n", argv[ 2 ] );
+        }
+    }
+
+    image.size = imageSizeMb * 1024U * 1024U;
+    image.pData = malloc( image.size );
+
+    if( ( mkdtemp( directory ) != NULL ) && ( chdir( directory ) == 0 ) )
+    {
+        inDirectory = 1;
+    }
+
+    if( ( image.pData != NULL ) &&
+        ( image.size > 0U ) &&
+        ( inDirectory == 1 ) &&
+        ( createSignedImage( &image, BENCHMARK_CERT_FILE_NAME ) == 1 ) )
+    {
+        status = EXIT_SUCCESS;
+
+        printf( "%-10s %6s %8s %10s %10s %8s %8s %8s %9s %9s\n",
+                "order", "block", "blocks", "write MB/s", "total MB/s",
+                "p50 us", "p90 us", "p99 us", "max us", "close ms" );
+
+        for( i = 0U; ( i < ( sizeof( blockSizes ) / sizeof( blockSizes[ 0 ] ) ) ) && ( status == EXIT_SUCCESS ); i++ )
+        {
+            for( order = 0U; ( order < BLOCK_ORDER_COUNT ) && ( status == EXIT_SUCCESS ); order++ )
+            {
+                if( runBenchmark( &image, blockSizes[ i ], ( BlockOrder_t ) order, &result ) == 0 )
+                {
+                    printResult( blockSizes[ i ], ( BlockOrder_t ) order, image.size, &result );
+                }
+                else
+                {
+                    status = EXIT_FAILURE;
+                }
+            }
+        }
+
+        if( status == EXIT_SUCCESS )
+        {
+            printf( "\n%6s %8s %10s %10s %9s\n", "files", "workers", "total MB/s", "file MB/s", "total ms" );
+        }
+
+        for( files = 1U; ( files <= CONCURRENT_MAX_FILES ) && ( status == EXIT_SUCCESS ); files *= 2U )
+        {
+            if( runConcurrentBenchmark( &image, files, files ) != 0 )
+            {
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    if( status != EXIT_SUCCESS )
+    {
+        fprintf( stderr, "Benchmark failed.\n" );
+    }
+
+    if( pTraceFile != NULL )
+    {
+        printf( "Wrote %zu spans to %s.\n", TraceSpan_ExportJson( writeTrace, pTraceFile ), argv[ 2 ] );
+        ( void ) fclose( pTraceFile );
+    }
+
+    #if ENERGY_METER_ENABLED
+        EnergyMeter_Dump();
+    #endif
+
+    /* Only remove files from the temporary directory. */
+    if( inDirectory == 1 )
+    {
+        ( void ) unlink( BENCHMARK_CERT_FILE_NAME );
+        ( void ) unlink( BENCHMARK_IMAGE_STATE_FILE );
+
+        if( chdir( "/" ) == 0 )
+        {
+            ( void ) rmdir( directory );
+        }
+    }
+
+    free( image.pData );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
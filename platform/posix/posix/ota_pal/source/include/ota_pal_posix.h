@@ -143,6 +143,21 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const C,
                            uint8_t * const pcData,
                            uint32_t ulBlockSize );
 
+/**
+ * @brief Account for a block which the application wrote into the file of C
+ * itself, through fileno( C->pFile ), for example with Openssl_RecvToFile.
+ *
+ * The block is added to the digest checked by otaPal_CloseFile like a block
+ * written by otaPal_WriteBlock, by reading it back from the page cache.
+ *
+ * @param[in] C OTA file context information.
+ * @param[in] ulOffset Byte offset of the block from the beginning of the file.
+ * @param[in] ulBlockSize The number of bytes written.
+ */
+void otaPal_BlockWritten( OtaFileContext_t * const C,
+                          uint32_t ulOffset,
+                          uint32_t ulBlockSize );
+
 /**
  * @brief Activate the newest MCU image received via OTA.
  *
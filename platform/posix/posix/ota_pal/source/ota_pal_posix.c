@@ -31,9 +31,13 @@
 #include <assert.h>
 #include <libgen.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
 
 #include "ota.h"
 #include "ota_pal_posix.h"
+#include "trace_span.h"
+#include "energy_meter.h"
 
 #include <openssl/evp.h>
 #include <openssl/bio.h>
@@ -65,11 +69,72 @@ static const char signingcredentialSIGNING_CERTIFICATE_PEM[] = "Paste code signi
  */
 #define OTA_PLATFORM_IMAGE_STATE_FILE    "PlatformImageState.txt"
 
+/**
+ * @brief Number of blocks written ahead of the digest kept track of, counting
+ * adjacent blocks as one.
+ */
+#define OTA_PAL_POSIX_MAX_PENDING_RANGES    16U
+
+/**
+ * @brief Number of files received at the same time whose blocks are digested
+ * as they are written, such as the images a gateway downloads for its
+ * devices. The signature of any further file is checked by reading it back on
+ * close.
+ */
+#ifndef OTA_PAL_POSIX_MAX_FILES
+    #define OTA_PAL_POSIX_MAX_FILES    8U
+#endif
+
+/**
+ * @brief Directory the receive files with a relative path are created in,
+ * instead of the working directory, for example to keep the images staged
+ * for other devices apart from the image state of this one.
+ */
+/* #define OTA_PAL_POSIX_STAGING_DIR    "/var/lib/ota" */
+
 /**
  * @brief Specify the OTA signature algorithm we support on this platform.
  */
 const char OTA_JsonFileSignatureKey[ OTA_FILE_SIG_KEY_STR_MAX_LENGTH ] = "sig-sha256-ecdsa";
 
+/**
+ * @brief A range of the receive file, from offset up to but not including end.
+ */
+typedef struct OtaPalFileRange
+{
+    uint32_t offset;
+    uint32_t end;
+} OtaPalFileRange_t;
+
+/**
+ * @brief Signature verification of the file being received, fed with the
+ * blocks as they are written so otaPal_CloseFile doesn't read the file back.
+ *
+ * Blocks are digested in file order. A block written past the end of the
+ * digest is remembered, and read back from the file once the blocks before it
+ * have been written. If a block can't be digested in order, the digest is
+ * dropped and the signature is checked over the whole file on close.
+ */
+typedef struct OtaPalRxDigest
+{
+    FILE * pFile;                                                  /**< @brief The receive file the digest is for, NULL when unused. */
+    EVP_MD_CTX * pSigContext;                                      /**< @brief Verification context, NULL when there is no digest. */
+    uint32_t digestedSize;                                         /**< @brief Bytes from the start of the file in the digest. */
+    OtaPalFileRange_t pending[ OTA_PAL_POSIX_MAX_PENDING_RANGES ]; /**< @brief Ranges written past digestedSize, sorted and apart. */
+    size_t pendingCount;                                           /**< @brief Number of ranges in pending. */
+} OtaPalRxDigest_t;
+
+/**
+ * @brief Digests of the files being received, each used by the one thread
+ * driving the context of its file.
+ */
+static OtaPalRxDigest_t rxDigests[ OTA_PAL_POSIX_MAX_FILES ] = { 0 };
+
+/**
+ * @brief Mutex guarding the pFile of #rxDigests, which claims a digest.
+ */
+static pthread_mutex_t rxDigestsMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief Read the specified signer certificate from the filesystem into a local buffer. The allocated
  * memory becomes the property of the caller who is responsible for freeing it.
@@ -98,6 +163,53 @@ static OtaPalStatus_t otaPal_CheckFileSignature( OtaFileContext_t * const C );
 static OtaPalPathGenStatus_t getFilePathFromCWD( char * realFilePath,
                                                  const char * pFilePath );
 
+/**
+ * @brief Get the absolute path of a receive file from its relative path, in
+ * #OTA_PAL_POSIX_STAGING_DIR if defined or in the working directory.
+ *
+ * @param realFilePath Buffer to store the file path + file name.
+ * @param pFilePath Relative path of the receive file.
+ */
+static OtaPalPathGenStatus_t getRxFilePath( char * realFilePath,
+                                            const char * pFilePath );
+
+/**
+ * @brief Find the digest of a receive file.
+ *
+ * @return The digest, or NULL if the blocks of the file aren't digested.
+ */
+static OtaPalRxDigest_t * findRxDigest( const FILE * pFile );
+
+/**
+ * @brief Start the digest of a file just created for the blocks of C.
+ */
+static void startRxDigest( OtaFileContext_t * const C );
+
+/**
+ * @brief Add a written block to the digest, or drop the digest if the block
+ * can't be added in order. A NULL pData reads the block back from the file.
+ */
+static void updateRxDigest( OtaFileContext_t * const C,
+                            uint32_t offset,
+                            const uint8_t * pData,
+                            uint32_t length );
+
+/**
+ * @brief Free the digest of a receive file, if any.
+ */
+static void stopRxDigest( const FILE * pFile );
+
+/**
+ * @brief Free a digest and give its slot back.
+ */
+static void releaseRxDigest( OtaPalRxDigest_t * pDigest );
+
+/**
+ * @brief Whether every byte of the file of C is in its digest.
+ */
+static bool isRxDigestComplete( const OtaPalRxDigest_t * pDigest,
+                                OtaFileContext_t * const C );
+
 /*-----------------------------------------------------------*/
 
 static EVP_PKEY * Openssl_GetPkeyFromCertificate( uint8_t * pCertFilePath )
@@ -295,39 +407,61 @@ static OtaPalMainStatus_t Openssl_DigestVerify( EVP_MD_CTX * pSigContext,
 
 static OtaPalStatus_t otaPal_CheckFileSignature( OtaFileContext_t * const C )
 {
+    TRACE_SPAN_SCOPE( "otaPal_CheckFileSignature" );
+
     OtaPalMainStatus_t mainErr = OtaPalSignatureCheckFailed;
     EVP_PKEY * pPkey = NULL;
     EVP_MD_CTX * pSigContext = NULL;
+    OtaPalRxDigest_t * pDigest = NULL;
 
     assert( C != NULL );
 
-    /* Extract the signer cert from the file. */
-    pPkey = Openssl_GetPkeyFromCertificate( C->pCertFilepath );
-
-    /* Create a new signature context for verification purpose. */
-    pSigContext = EVP_MD_CTX_new();
+    pDigest = findRxDigest( C->pFile );
 
-    if( ( pPkey != NULL ) && ( pSigContext != NULL ) )
+    if( isRxDigestComplete( pDigest, C ) == true )
     {
-        /* Verify the signature. */
-        mainErr = Openssl_DigestVerify( pSigContext, pPkey, C->pFile, C->pSignature );
+        /* The whole file was digested while it was written. */
+        if( 1 == EVP_DigestVerifyFinal( pDigest->pSigContext,
+                                        C->pSignature->data,
+                                        C->pSignature->size ) )
+        {
+            mainErr = OtaPalSuccess;
+        }
+        else
+        {
+            LogError( ( "File signature check failed at FINAL" ) );
+        }
     }
     else
     {
-        if( pSigContext == NULL )
+        /* Extract the signer cert from the file. */
+        pPkey = Openssl_GetPkeyFromCertificate( C->pCertFilepath );
+
+        /* Create a new signature context for verification purpose. */
+        pSigContext = EVP_MD_CTX_new();
+
+        if( ( pPkey != NULL ) && ( pSigContext != NULL ) )
         {
-            LogError( ( "File signature check failed at NEW sig context." ) );
+            /* Verify the signature. */
+            mainErr = Openssl_DigestVerify( pSigContext, pPkey, C->pFile, C->pSignature );
         }
         else
         {
-            LogError( ( "File signature check failed at EXTRACT pkey from signer certificate." ) );
-            mainErr = OtaPalBadSignerCert;
+            if( pSigContext == NULL )
+            {
+                LogError( ( "File signature check failed at NEW sig context." ) );
+            }
+            else
+            {
+                LogError( ( "File signature check failed at EXTRACT pkey from signer certificate." ) );
+                mainErr = OtaPalBadSignerCert;
+            }
         }
-    }
 
-    /* Free up objects */
-    EVP_MD_CTX_free( pSigContext );
-    EVP_PKEY_free( pPkey );
+        /* Free up objects */
+        EVP_MD_CTX_free( pSigContext );
+        EVP_PKEY_free( pPkey );
+    }
 
     return OTA_PAL_COMBINE_ERR( mainErr, 0 );
 }
@@ -364,6 +498,276 @@ static OtaPalPathGenStatus_t getFilePathFromCWD( char * pCompleteFilePath,
     return status;
 }
 
+static OtaPalPathGenStatus_t getRxFilePath( char * pCompleteFilePath,
+                                            const char * pFileName )
+{
+    OtaPalPathGenStatus_t status = OtaPalFileGenSuccess;
+
+    #ifdef OTA_PAL_POSIX_STAGING_DIR
+        if( strlen( OTA_PAL_POSIX_STAGING_DIR ) + strlen( pFileName ) + 2U > OTA_FILE_PATH_LENGTH_MAX )
+        {
+            LogError( ( "Insufficient space to generate file path" ) );
+            status = OtaPalBufferInsufficient;
+        }
+        else
+        {
+            ( void ) snprintf( pCompleteFilePath, OTA_FILE_PATH_LENGTH_MAX, "%s/%s",
+                               OTA_PAL_POSIX_STAGING_DIR, pFileName );
+        }
+    #else
+        status = getFilePathFromCWD( pCompleteFilePath, pFileName );
+    #endif
+
+    return status;
+}
+
+static OtaPalRxDigest_t * findRxDigest( const FILE * pFile )
+{
+    OtaPalRxDigest_t * pDigest = NULL;
+    size_t i;
+
+    if( pFile != NULL )
+    {
+        ( void ) pthread_mutex_lock( &rxDigestsMutex );
+
+        for( i = 0U; ( i < OTA_PAL_POSIX_MAX_FILES ) && ( pDigest == NULL ); i++ )
+        {
+            if( rxDigests[ i ].pFile == pFile )
+            {
+                pDigest = &rxDigests[ i ];
+            }
+        }
+
+        ( void ) pthread_mutex_unlock( &rxDigestsMutex );
+    }
+
+    return pDigest;
+}
+
+static void startRxDigest( OtaFileContext_t * const C )
+{
+    EVP_PKEY * pPkey = NULL;
+    EVP_MD_CTX * pSigContext = NULL;
+    OtaPalRxDigest_t * pDigest = NULL;
+    size_t i;
+
+    /* A stream closed without the PAL may have left the address for this one. */
+    stopRxDigest( C->pFile );
+
+    /* The signer certificate and the signature come with the job, so they are
+     * known before the first block. Without them the check fails on close. */
+    if( ( C->pSignature != NULL ) && ( C->pCertFilepath != NULL ) )
+    {
+        pPkey = Openssl_GetPkeyFromCertificate( C->pCertFilepath );
+    }
+
+    if( pPkey != NULL )
+    {
+        pSigContext = EVP_MD_CTX_new();
+    }
+
+    if( ( pSigContext != NULL ) &&
+        ( 1 == EVP_DigestVerifyInit( pSigContext, NULL, EVP_sha256(), NULL, pPkey ) ) )
+    {
+        ( void ) pthread_mutex_lock( &rxDigestsMutex );
+
+        for( i = 0U; ( i < OTA_PAL_POSIX_MAX_FILES ) && ( pDigest == NULL ); i++ )
+        {
+            if( rxDigests[ i ].pFile == NULL )
+            {
+                pDigest = &rxDigests[ i ];
+                pDigest->pFile = C->pFile;
+            }
+        }
+
+        ( void ) pthread_mutex_unlock( &rxDigestsMutex );
+    }
+
+    if( pDigest != NULL )
+    {
+        pDigest->pSigContext = pSigContext;
+    }
+    else
+    {
+        if( pSigContext != NULL )
+        {
+            LogDebug( ( "All %u digests are in use, the file will be read back on close.",
+                        ( unsigned ) OTA_PAL_POSIX_MAX_FILES ) );
+        }
+
+        EVP_MD_CTX_free( pSigContext );
+    }
+
+    /* The verification context holds its own reference to the key. */
+    EVP_PKEY_free( pPkey );
+}
+
+static bool digestFileRange( OtaPalRxDigest_t * pDigest,
+                             FILE * pFile,
+                             uint32_t offset,
+                             uint32_t end )
+{
+    uint8_t buf[ OTA_PAL_POSIX_BUF_SIZE ];
+    ssize_t bytesRead = 0;
+    bool digested = true;
+
+    while( ( digested == true ) && ( offset < end ) )
+    {
+        bytesRead = pread( fileno( pFile ), buf, MIN( sizeof( buf ), ( size_t ) ( end - offset ) ), ( off_t ) offset );
+
+        if( ( bytesRead <= 0 ) ||
+            ( 1 != EVP_DigestUpdate( pDigest->pSigContext, buf, ( size_t ) bytesRead ) ) )
+        {
+            digested = false;
+        }
+        else
+        {
+            offset += ( uint32_t ) bytesRead;
+        }
+    }
+
+    return digested;
+}
+
+static bool addPendingRange( OtaPalRxDigest_t * pDigest,
+                             uint32_t offset,
+                             uint32_t end )
+{
+    size_t first = 0U;
+    size_t last = 0U;
+    bool added = true;
+
+    /* Skip the ranges ending before the new one. */
+    while( ( first < pDigest->pendingCount ) && ( pDigest->pending[ first ].end < offset ) )
+    {
+        first++;
+    }
+
+    /* Merge the ranges overlapping or touching the new one into it. */
+    last = first;
+
+    while( ( last < pDigest->pendingCount ) && ( pDigest->pending[ last ].offset <= end ) )
+    {
+        offset = MIN( offset, pDigest->pending[ last ].offset );
+        end = MAX( end, pDigest->pending[ last ].end );
+        last++;
+    }
+
+    if( last > first )
+    {
+        /* The new range replaces the ones merged into it. */
+        ( void ) memmove( &pDigest->pending[ first + 1U ], &pDigest->pending[ last ],
+                          ( pDigest->pendingCount - last ) * sizeof( OtaPalFileRange_t ) );
+        pDigest->pendingCount -= last - first - 1U;
+    }
+    else if( pDigest->pendingCount < OTA_PAL_POSIX_MAX_PENDING_RANGES )
+    {
+        ( void ) memmove( &pDigest->pending[ first + 1U ], &pDigest->pending[ first ],
+                          ( pDigest->pendingCount - first ) * sizeof( OtaPalFileRange_t ) );
+        pDigest->pendingCount++;
+    }
+    else
+    {
+        added = false;
+    }
+
+    if( added == true )
+    {
+        pDigest->pending[ first ].offset = offset;
+        pDigest->pending[ first ].end = end;
+    }
+
+    return added;
+}
+
+static void updateRxDigest( OtaFileContext_t * const C,
+                            uint32_t offset,
+                            const uint8_t * pData,
+                            uint32_t length )
+{
+    OtaPalRxDigest_t * pDigest = findRxDigest( C->pFile );
+    bool inOrder = true;
+
+    if( ( pDigest != NULL ) && ( pDigest->pSigContext != NULL ) )
+    {
+        if( offset < pDigest->digestedSize )
+        {
+            /* Part of the digest was written again. */
+            inOrder = false;
+        }
+        else if( offset > pDigest->digestedSize )
+        {
+            inOrder = addPendingRange( pDigest, offset, offset + length );
+        }
+        else
+        {
+            if( pData != NULL )
+            {
+                inOrder = ( 1 == EVP_DigestUpdate( pDigest->pSigContext, pData, length ) );
+            }
+            else
+            {
+                inOrder = digestFileRange( pDigest, C->pFile, offset, offset + length );
+            }
+
+            pDigest->digestedSize += length;
+
+            /* Catch up with the blocks written ahead, now in the file. */
+            while( ( inOrder == true ) &&
+                   ( pDigest->pendingCount > 0U ) &&
+                   ( pDigest->pending[ 0 ].offset <= pDigest->digestedSize ) )
+            {
+                if( pDigest->pending[ 0 ].end > pDigest->digestedSize )
+                {
+                    inOrder = digestFileRange( pDigest, C->pFile, pDigest->digestedSize, pDigest->pending[ 0 ].end );
+                    pDigest->digestedSize = pDigest->pending[ 0 ].end;
+                }
+
+                pDigest->pendingCount--;
+                ( void ) memmove( &pDigest->pending[ 0 ], &pDigest->pending[ 1 ],
+                                  pDigest->pendingCount * sizeof( OtaPalFileRange_t ) );
+            }
+        }
+
+        if( inOrder == false )
+        {
+            LogDebug( ( "Block at offset %u not digested in order, the file will be read back on close.", offset ) );
+            releaseRxDigest( pDigest );
+        }
+    }
+}
+
+static void stopRxDigest( const FILE * pFile )
+{
+    OtaPalRxDigest_t * pDigest = findRxDigest( pFile );
+
+    if( pDigest != NULL )
+    {
+        releaseRxDigest( pDigest );
+    }
+}
+
+static void releaseRxDigest( OtaPalRxDigest_t * pDigest )
+{
+    if( pDigest->pSigContext != NULL )
+    {
+        EVP_MD_CTX_free( pDigest->pSigContext );
+    }
+
+    ( void ) pthread_mutex_lock( &rxDigestsMutex );
+    ( void ) memset( pDigest, 0, sizeof( OtaPalRxDigest_t ) );
+    ( void ) pthread_mutex_unlock( &rxDigestsMutex );
+}
+
+static bool isRxDigestComplete( const OtaPalRxDigest_t * pDigest,
+                                OtaFileContext_t * const C )
+{
+    return ( pDigest != NULL ) &&
+           ( pDigest->pSigContext != NULL ) &&
+           ( pDigest->pendingCount == 0U ) &&
+           ( pDigest->digestedSize == C->fileSize );
+}
+
 /*-----------------------------------------------------------*/
 
 OtaPalStatus_t otaPal_Abort( OtaFileContext_t * const C )
@@ -375,6 +779,8 @@ OtaPalStatus_t otaPal_Abort( OtaFileContext_t * const C )
 
     if( NULL != C )
     {
+        stopRxDigest( C->pFile );
+
         /* Close the OTA update file if it's open. */
         if( NULL != C->pFile )
         {
@@ -422,7 +828,7 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const C )
         {
             if( C->pFilePath[ 0 ] != ( uint8_t ) '/' )
             {
-                status = getFilePathFromCWD( realFilePath, ( const char * ) C->pFilePath );
+                status = getRxFilePath( realFilePath, ( const char * ) C->pFilePath );
             }
             else
             {
@@ -439,6 +845,8 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const C )
                 {
                     result = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
                     LogInfo( ( "Receive file created." ) );
+
+                    startRxDigest( C );
                 }
                 else
                 {
@@ -490,6 +898,8 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const C )
             mainErr = OtaPalSignatureCheckFailed;
         }
 
+        stopRxDigest( C->pFile );
+
         /* Close the file. */
         /* POSIX port using standard library */
         /* coverity[misra_c_2012_rule_21_6_violation] */
@@ -534,38 +944,42 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const C,
                            uint8_t * const pcData,
                            uint32_t ulBlockSize )
 {
+    TRACE_SPAN_SCOPE( "otaPal_WriteBlock" );
+    ENERGY_METER_BEGIN( energy, EnergyOpFlashWrite );
+
     int32_t filerc = 0;
-    size_t writeSize = 0;
+    ssize_t writeSize = 0;
+    uint32_t bytesWritten = 0;
 
     if( C != NULL )
     {
-        /* POSIX port using standard library */
-        /* coverity[misra_c_2012_rule_21_6_violation] */
-        filerc = fseek( C->pFile, ( int64_t ) ulOffset, SEEK_SET );
-
-        if( 0 == filerc )
+        /* Write at the block offset, without seeking the stream or copying
+         * the block into its buffer. */
+        while( ( filerc == 0 ) && ( bytesWritten < ulBlockSize ) )
         {
-            /* POSIX port using standard library */
-            /* coverity[misra_c_2012_rule_21_6_violation] */
-            writeSize = fwrite( pcData, 1, ulBlockSize, C->pFile );
+            writeSize = pwrite( fileno( C->pFile ),
+                                &pcData[ bytesWritten ],
+                                ulBlockSize - bytesWritten,
+                                ( off_t ) ulOffset + bytesWritten );
 
-            if( writeSize != ulBlockSize )
+            if( writeSize > 0 )
+            {
+                bytesWritten += ( uint32_t ) writeSize;
+            }
+            else
             {
                 LogError( ( "Failed to write block to file: "
-                            "fwrite returned error: "
+                            "pwrite returned error: "
                             "errno=%d", errno ) );
 
                 filerc = -1;
             }
-            else
-            {
-                filerc = ( int32_t ) writeSize;
-            }
         }
-        else
+
+        if( filerc == 0 )
         {
-            LogError( ( "fseek failed. fseek returned errno = %d", errno ) );
-            filerc = -1;
+            updateRxDigest( C, ulOffset, pcData, ulBlockSize );
+            filerc = ( int32_t ) bytesWritten;
         }
     }
     else /* Invalid context or file pointer provided. */
@@ -574,9 +988,25 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const C,
         filerc = -1;
     }
 
+    ENERGY_METER_END( energy, bytesWritten );
+
     return ( int16_t ) filerc;
 }
 
+void otaPal_BlockWritten( OtaFileContext_t * const C,
+                          uint32_t ulOffset,
+                          uint32_t ulBlockSize )
+{
+    if( ( C != NULL ) && ( C->pFile != NULL ) )
+    {
+        updateRxDigest( C, ulOffset, NULL, ulBlockSize );
+    }
+    else
+    {
+        LogError( ( "Invalid context." ) );
+    }
+}
+
 /* Return no error. POSIX implementation simply does nothing on activate. */
 OtaPalStatus_t otaPal_ActivateNewImage( OtaFileContext_t * const C )
 {
@@ -51,6 +51,9 @@ extern size_t fread( void * ptr,
 
 extern int feof( FILE * __stream );
 
+/* Return the file descriptor of STREAM. */
+extern int fileno( _STDIO_FILE_TYPE * __stream );
+
 /* The "fseek" function needs to be mocked to test the OTA PAL. This function
  * can't be directly mocked because it's required by the coverage tools. To get
  * around this, the "fseek" function is defined as "fseek_alias" in the test
@@ -78,6 +78,7 @@ typedef enum
     fopen_fn,
     fclose_fn,
     feof_fn,
+    fileno_fn,
     fread_fn,
     fseek_alias_fn,
     fwrite_alias_fn,
@@ -310,6 +311,10 @@ static void OTA_PAL_FailSingleMock_stdio( MockFunctionNames_t funcToFail,
     const int feof_success = 1;
     const int feof_failure = 0;
     int feof_return;
+    /* fileno returns the file descriptor on success and -1 on failure. */
+    const int fileno_success = 3;
+    const int fileno_failure = -1;
+    int fileno_return;
     /* fseek returns a zero on success and a non-zero number on failure. */
     const int32_t fseek_success = 0;
     const int32_t fseek_failure = -1;
@@ -327,6 +332,9 @@ static void OTA_PAL_FailSingleMock_stdio( MockFunctionNames_t funcToFail,
     feof_return = ( funcToFail == feof_fn ) ? feof_failure : feof_success;
     feof_IgnoreAndReturn( feof_return );
 
+    fileno_return = ( funcToFail == fileno_fn ) ? fileno_failure : fileno_success;
+    fileno_IgnoreAndReturn( fileno_return );
+
     fseek_return = ( funcToFail == fseek_alias_fn ) ? fseek_failure : fseek_success;
     fseek_alias_IgnoreAndReturn( fseek_return );
 
@@ -470,6 +478,8 @@ void test_OTAPAL_CreateFileForRx_ValidFileHandle( void )
     OtaFileContext_t otaFileContext;
 
     otaFileContext.pFilePath = ( uint8_t * ) "placeholder_path";
+    /* Without a signature there is nothing to digest while writing. */
+    otaFileContext.pSignature = NULL;
 
     OTA_PAL_FailSingleMock_unistd( none_fn );
     fopen_ExpectAnyArgsAndReturn( &placeholder_file );
@@ -487,6 +497,9 @@ void test_OTAPAL_CreateFileForRx_PathTypes( void )
     FILE placeholder_file;
     OtaFileContext_t otaFileContext;
 
+    /* Without a signature there is nothing to digest while writing. */
+    otaFileContext.pSignature = NULL;
+
     /* Test for a leading forward slash in the path. */
     otaFileContext.pFilePath = ( uint8_t * ) "/placeholder_path";
     OTA_PAL_FailSingleMock_unistd( none_fn );
@@ -843,6 +856,182 @@ void test_OTAPAL_CloseFile_MaxBlockSize( void )
     TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( result ) );
 }
 
+/**
+ * @brief Create the receive file of pFileContext with a signer certificate,
+ * so the blocks are digested as they are written.
+ */
+static void OTA_PAL_CreateFileWithDigest( OtaFileContext_t * pFileContext,
+                                          FILE * pFile,
+                                          Sig256_t * pSignature,
+                                          uint32_t fileSize )
+{
+    pFileContext->pFilePath = ( uint8_t * ) "/placeholder_path";
+    pFileContext->pCertFilepath = ( uint8_t * ) "placeholder_cert";
+    pFileContext->pSignature = pSignature;
+    pFileContext->fileSize = fileSize;
+
+    OTA_PAL_FailSingleMock_openssl_BIO( none_fn );
+    OTA_PAL_FailSingleMock_openssl_X509( none_fn );
+    OTA_PAL_FailSingleMock_openssl_EVP( none_fn );
+    fopen_ExpectAnyArgsAndReturn( pFile );
+    fileno_IgnoreAndReturn( 3 );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( otaPal_CreateFileForRx( pFileContext ) ) );
+}
+
+/**
+ * @brief Expect otaPal_CloseFile to close the file and store the image state
+ * without reading the file back.
+ */
+static void OTA_PAL_ExpectCloseWithoutReadBack( FILE * pStateFile )
+{
+    fclose_ExpectAnyArgsAndReturn( 0 );
+    OTA_PAL_FailSingleMock_unistd( none_fn );
+    fopen_ExpectAnyArgsAndReturn( pStateFile );
+    fwrite_alias_ExpectAnyArgsAndReturn( 1 );
+    fclose_ExpectAnyArgsAndReturn( 0 );
+}
+
+/**
+ * @brief Test that otaPal_CloseFile checks the signature with the digest
+ * updated by otaPal_WriteBlock when the blocks are written in order.
+ */
+void test_OTAPAL_CloseFile_DigestedWhileWritten( void )
+{
+    OtaPalStatus_t result;
+    OtaFileContext_t otaFileContext;
+    Sig256_t dummySig;
+    FILE dummyFile;
+    FILE dummyStateFile;
+    uint8_t pData[] = { 0xAA, 0xBB };
+
+    OTA_PAL_CreateFileWithDigest( &otaFileContext, &dummyFile, &dummySig, sizeof( pData ) );
+
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 0, &pData[ 0 ], 1 ) );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 1, &pData[ 1 ], 1 ) );
+
+    /* fseek and fread have no expectations, so reading the file back fails the test. */
+    OTA_PAL_ExpectCloseWithoutReadBack( &dummyStateFile );
+    result = otaPal_CloseFile( &otaFileContext );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( result ) );
+}
+
+/**
+ * @brief Test that a block written ahead of the digest is read back from the
+ * file once the blocks before it are written.
+ */
+void test_OTAPAL_CloseFile_DigestedBlockWrittenAhead( void )
+{
+    OtaPalStatus_t result;
+    OtaFileContext_t otaFileContext;
+    Sig256_t dummySig;
+    FILE dummyFile;
+    FILE dummyStateFile;
+    uint8_t pData[] = { 0xAA, 0xBB };
+
+    OTA_PAL_CreateFileWithDigest( &otaFileContext, &dummyFile, &dummySig, sizeof( pData ) );
+
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 1, &pData[ 1 ], 1 ) );
+
+    /* Writing the first block lets the digest catch up with the second. */
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    pread_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 0, &pData[ 0 ], 1 ) );
+
+    OTA_PAL_ExpectCloseWithoutReadBack( &dummyStateFile );
+    result = otaPal_CloseFile( &otaFileContext );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( result ) );
+}
+
+/**
+ * @brief Test that a block written into the file by the application is read
+ * back into the digest, so that the signature is checked without reading the
+ * whole file on close.
+ */
+void test_OTAPAL_CloseFile_DigestedBlockWrittenInPlace( void )
+{
+    OtaPalStatus_t result;
+    OtaFileContext_t otaFileContext;
+    Sig256_t dummySig;
+    FILE dummyFile;
+    FILE dummyStateFile;
+
+    OTA_PAL_CreateFileWithDigest( &otaFileContext, &dummyFile, &dummySig, 2 );
+
+    pread_ExpectAnyArgsAndReturn( 2 );
+    otaPal_BlockWritten( &otaFileContext, 0, 2 );
+
+    OTA_PAL_ExpectCloseWithoutReadBack( &dummyStateFile );
+    result = otaPal_CloseFile( &otaFileContext );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( result ) );
+}
+
+/**
+ * @brief Test that the blocks of two files received at the same time are
+ * digested apart, so neither file is read back on close.
+ */
+void test_OTAPAL_CloseFile_ConcurrentFilesDigestedApart( void )
+{
+    OtaFileContext_t firstContext;
+    OtaFileContext_t secondContext;
+    Sig256_t firstSig;
+    Sig256_t secondSig;
+    FILE firstFile;
+    FILE secondFile;
+    FILE dummyStateFile;
+    uint8_t pData[] = { 0xAA, 0xBB };
+
+    OTA_PAL_CreateFileWithDigest( &firstContext, &firstFile, &firstSig, sizeof( pData ) );
+    OTA_PAL_CreateFileWithDigest( &secondContext, &secondFile, &secondSig, sizeof( pData ) );
+
+    /* Interleave the blocks of the two files, each in order. */
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &firstContext, 0, &pData[ 0 ], 1 ) );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &secondContext, 0, &pData[ 0 ], 1 ) );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &firstContext, 1, &pData[ 1 ], 1 ) );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &secondContext, 1, &pData[ 1 ], 1 ) );
+
+    OTA_PAL_ExpectCloseWithoutReadBack( &dummyStateFile );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( otaPal_CloseFile( &firstContext ) ) );
+    OTA_PAL_ExpectCloseWithoutReadBack( &dummyStateFile );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( otaPal_CloseFile( &secondContext ) ) );
+}
+
+/**
+ * @brief Test that otaPal_CloseFile reads the file back to check the
+ * signature when a block already in the digest is written again.
+ */
+void test_OTAPAL_CloseFile_RewrittenBlockReadBack( void )
+{
+    OtaPalStatus_t result;
+    OtaFileContext_t otaFileContext;
+    Sig256_t dummySig;
+    OtaImageState_t expectedImageState = OtaImageStateTesting;
+    FILE dummyFile;
+    uint8_t pData[] = { 0xAA, 0xBB };
+
+    OTA_PAL_CreateFileWithDigest( &otaFileContext, &dummyFile, &dummySig, sizeof( pData ) );
+
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 0, &pData[ 0 ], 1 ) );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 1, &pData[ 1 ], 1 ) );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    TEST_ASSERT_EQUAL_INT( 1, otaPal_WriteBlock( &otaFileContext, 0, &pData[ 0 ], 1 ) );
+
+    /* The file is rewound to be read back. */
+    OTA_PAL_FailSingleMock( fread_fn, &expectedImageState );
+    fseek_alias_StopIgnore();
+    fseek_alias_ExpectAnyArgsAndReturn( 0 );
+    result = otaPal_CloseFile( &otaFileContext );
+    TEST_ASSERT_EQUAL( OtaPalSuccess, OTA_PAL_MAIN_ERR( result ) );
+}
+
 /* ===================   OTA PAL WRITE BLOCK UNIT TESTS   =================== */
 
 /**
@@ -870,8 +1059,8 @@ void test_OTAPAL_WriteBlock_WriteSingleByte( void )
 
     /* TEST: Write a byte of data. */
     otaFileContext.pFilePath = ( uint8_t * ) "placeholder";
-    fseek_alias_ExpectAnyArgsAndReturn( 0 );
-    fwrite_alias_ExpectAnyArgsAndReturn( blockSize );
+    fileno_IgnoreAndReturn( 3 );
+    pwrite_ExpectAnyArgsAndReturn( blockSize );
     numBytesWritten = otaPal_WriteBlock( &otaFileContext, 0, &data, blockSize );
     TEST_ASSERT_EQUAL_INT( blockSize, numBytesWritten );
 }
@@ -888,51 +1077,67 @@ void test_OTAPAL_WriteBlock_WriteMultipleBytes( void )
     OtaFileContext_t otaFileContext;
 
     /* TEST: Write multiple bytes of data. */
+    fileno_IgnoreAndReturn( 3 );
+
     for( index = 0; index < ( sizeof( pData ) / sizeof( pData[ 0 ] ) ); index++ )
     {
-        fseek_alias_ExpectAnyArgsAndReturn( 0 );
-        fwrite_alias_ExpectAnyArgsAndReturn( blockSize );
+        pwrite_ExpectAnyArgsAndReturn( blockSize );
         numBytesWritten = otaPal_WriteBlock( &otaFileContext, index * blockSize, pData, blockSize );
         TEST_ASSERT_EQUAL_INT( blockSize, numBytesWritten );
     }
 }
 
+/**
+ * @brief Test that otaPal_WriteBlock writes the rest of a block after a short
+ * write.
+ */
+void test_OTAPAL_WriteBlock_PartialWrite( void )
+{
+    int16_t numBytesWritten;
+    uint8_t pData[] = { 0xAA, 0xBB };
+    uint32_t blockSize = sizeof( pData );
+    OtaFileContext_t validFileContext;
+
+    fileno_IgnoreAndReturn( 3 );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    pwrite_ExpectAnyArgsAndReturn( 1 );
+    numBytesWritten = otaPal_WriteBlock( &validFileContext, 0, pData, blockSize );
+    TEST_ASSERT_EQUAL_INT( blockSize, numBytesWritten );
+}
+
 /**
  * @brief Test that otaPal_WriteBlock will return correct result code.
  */
-void test_OTAPAL_WriteBlock_FseekError( void )
+void test_OTAPAL_WriteBlock_PwriteError( void )
 {
     int16_t numBytesWritten;
     uint8_t data = 0xAA;
     uint32_t blockSize = 1;
-    const int16_t fseek_error_num = 1; /* fseek returns a non-zero number on error. */
     OtaFileContext_t validFileContext;
+    const ssize_t pwriteErrorReturn = -1; /* pwrite returns -1 on error. */
+    const int16_t writeblockErrorReturn = -1;
 
-    /* TEST: Write a byte of data. */
-    fseek_alias_ExpectAnyArgsAndReturn( fseek_error_num );
+    fileno_IgnoreAndReturn( 3 );
+    pwrite_ExpectAnyArgsAndReturn( pwriteErrorReturn );
     numBytesWritten = otaPal_WriteBlock( &validFileContext, 0, &data, blockSize );
-    TEST_ASSERT_EQUAL_INT( -1, numBytesWritten );
+    TEST_ASSERT_EQUAL_INT( writeblockErrorReturn, numBytesWritten );
 }
 
 /**
- * @brief Test that otaPal_WriteBlock will return correct result code.
+ * @brief Test that otaPal_WriteBlock fails rather than retrying forever when
+ * pwrite writes nothing.
  */
-void test_OTAPAL_WriteBlock_FwriteError( void )
+void test_OTAPAL_WriteBlock_PwriteNothingWritten( void )
 {
     int16_t numBytesWritten;
     uint8_t data = 0xAA;
     uint32_t blockSize = 1;
     OtaFileContext_t validFileContext;
-    const int32_t fseekSuccessReturn = 0; /* fseek returns a zero on success. */
-    const size_t fwriteErrorReturn = 0;   /* fwrite returns a number less than the requested number of bytes to write on error. */
-    const int16_t writeblockErrorReturn = -1;
 
-    fseek_alias_ExpectAnyArgsAndReturn( fseekSuccessReturn );
-    fwrite_alias_ExpectAnyArgsAndReturn( fwriteErrorReturn );
-
-    /* fwrite returns a number less than the amount requested to write on error. */
+    fileno_IgnoreAndReturn( 3 );
+    pwrite_ExpectAnyArgsAndReturn( 0 );
     numBytesWritten = otaPal_WriteBlock( &validFileContext, 0, &data, blockSize );
-    TEST_ASSERT_EQUAL_INT( writeblockErrorReturn, numBytesWritten );
+    TEST_ASSERT_EQUAL_INT( -1, numBytesWritten );
 }
 
 /* ===============   OTA PAL ACTIVATE NEW IMAGE UNIT TESTS   ================ */
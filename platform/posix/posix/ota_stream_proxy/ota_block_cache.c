@@ -0,0 +1,301 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_block_cache.c
+ * @brief Implementation of the OTA block cache.
+ *
+ * Every block is one allocation holding the entry, the name of its stream and
+ * its data. Entries are chained by hash, and in a list from the most to the
+ * least recently used.
+ */
+
+/* Standard includes. */
+#include <stdlib.h>
+#include <string.h>
+
+#include "ota_block_cache.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief FNV-1a offset basis and prime.
+ */
+#define FNV_OFFSET_BASIS    ( 2166136261U )
+#define FNV_PRIME           ( 16777619U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A cached block.
+ */
+typedef struct OtaBlockEntry
+{
+    struct OtaBlockEntry * pNextInBucket;
+    struct OtaBlockEntry * pNewer;  /**< @brief Next in the use list, towards the newest. */
+    struct OtaBlockEntry * pOlder;  /**< @brief Next in the use list, towards the oldest. */
+    uint32_t hash;
+    OtaBlockKey_t key;              /**< @brief The stream name points after the entry. */
+    size_t length;                  /**< @brief Length of #pData. */
+    uint8_t * pData;                /**< @brief The block, after the stream name. */
+} OtaBlockEntry_t;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t hashBytes( uint32_t hash,
+                           const uint8_t * pBytes,
+                           size_t length )
+{
+    size_t i;
+
+    for( i = 0U; i < length; i++ )
+    {
+        hash = ( hash ^ pBytes[ i ] ) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool keysEqual( const OtaBlockKey_t * pA,
+                       const OtaBlockKey_t * pB )
+{
+    return ( pA->fileId == pB->fileId ) &&
+           ( pA->blockSize == pB->blockSize ) &&
+           ( pA->blockIndex == pB->blockIndex ) &&
+           ( pA->streamNameLength == pB->streamNameLength ) &&
+           ( memcmp( pA->pStreamName, pB->pStreamName, pA->streamNameLength ) == 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static void unlinkUse( OtaBlockCache_t * pCache,
+                       OtaBlockEntry_t * pEntry )
+{
+    if( pEntry->pNewer != NULL )
+    {
+        pEntry->pNewer->pOlder = pEntry->pOlder;
+    }
+    else
+    {
+        pCache->pNewest = pEntry->pOlder;
+    }
+
+    if( pEntry->pOlder != NULL )
+    {
+        pEntry->pOlder->pNewer = pEntry->pNewer;
+    }
+    else
+    {
+        pCache->pOldest = pEntry->pNewer;
+    }
+
+    pEntry->pNewer = NULL;
+    pEntry->pOlder = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void linkNewest( OtaBlockCache_t * pCache,
+                        OtaBlockEntry_t * pEntry )
+{
+    pEntry->pNewer = NULL;
+    pEntry->pOlder = pCache->pNewest;
+
+    if( pCache->pNewest != NULL )
+    {
+        pCache->pNewest->pNewer = pEntry;
+    }
+    else
+    {
+        pCache->pOldest = pEntry;
+    }
+
+    pCache->pNewest = pEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaBlockEntry_t ** findEntry( OtaBlockCache_t * pCache,
+                                     const OtaBlockKey_t * pKey,
+                                     uint32_t hash )
+{
+    OtaBlockEntry_t ** ppEntry = &pCache->ppBuckets[ hash & ( pCache->bucketCount - 1U ) ];
+
+    while( ( *ppEntry != NULL ) &&
+           ( ( ( *ppEntry )->hash != hash ) || !keysEqual( &( *ppEntry )->key, pKey ) ) )
+    {
+        ppEntry = &( *ppEntry )->pNextInBucket;
+    }
+
+    return ppEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+static void evictOldest( OtaBlockCache_t * pCache )
+{
+    OtaBlockEntry_t * pEntry = pCache->pOldest;
+    OtaBlockEntry_t ** ppEntry = findEntry( pCache, &pEntry->key, pEntry->hash );
+
+    *ppEntry = pEntry->pNextInBucket;
+    unlinkUse( pCache, pEntry );
+
+    pCache->stats.blocks--;
+    pCache->stats.bytes -= pEntry->length;
+    pCache->stats.evictions++;
+
+    free( pEntry );
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t OtaBlockCache_Hash( const OtaBlockKey_t * pKey )
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    hash = hashBytes( hash, ( const uint8_t * ) pKey->pStreamName, pKey->streamNameLength );
+    hash = hashBytes( hash, ( const uint8_t * ) &pKey->fileId, sizeof( pKey->fileId ) );
+    hash = hashBytes( hash, ( const uint8_t * ) &pKey->blockIndex, sizeof( pKey->blockIndex ) );
+
+    return hash;
+}
+
+/*-----------------------------------------------------------*/
+
+bool OtaBlockCache_Init( OtaBlockCache_t * pCache,
+                         size_t capacity,
+                         size_t bucketCount )
+{
+    size_t buckets = 1U;
+
+    while( buckets < bucketCount )
+    {
+        buckets <<= 1U;
+    }
+
+    ( void ) memset( pCache, 0, sizeof( *pCache ) );
+    pCache->ppBuckets = calloc( buckets, sizeof( OtaBlockEntry_t * ) );
+    pCache->bucketCount = buckets;
+    pCache->capacity = capacity;
+
+    return pCache->ppBuckets != NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaBlockCache_Deinit( OtaBlockCache_t * pCache )
+{
+    while( pCache->pOldest != NULL )
+    {
+        evictOldest( pCache );
+    }
+
+    free( pCache->ppBuckets );
+    pCache->ppBuckets = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+const uint8_t * OtaBlockCache_Get( OtaBlockCache_t * pCache,
+                                   const OtaBlockKey_t * pKey,
+                                   size_t * pLength )
+{
+    OtaBlockEntry_t * pEntry = *findEntry( pCache, pKey, OtaBlockCache_Hash( pKey ) );
+    const uint8_t * pData = NULL;
+
+    if( pEntry != NULL )
+    {
+        unlinkUse( pCache, pEntry );
+        linkNewest( pCache, pEntry );
+        pCache->stats.hits++;
+
+        *pLength = pEntry->length;
+        pData = pEntry->pData;
+    }
+    else
+    {
+        pCache->stats.misses++;
+    }
+
+    return pData;
+}
+
+/*-----------------------------------------------------------*/
+
+bool OtaBlockCache_Put( OtaBlockCache_t * pCache,
+                        const OtaBlockKey_t * pKey,
+                        const uint8_t * pData,
+                        size_t length )
+{
+    uint32_t hash = OtaBlockCache_Hash( pKey );
+    OtaBlockEntry_t ** ppEntry = findEntry( pCache, pKey, hash );
+    OtaBlockEntry_t * pEntry = *ppEntry;
+    char * pName = NULL;
+    bool held = ( pEntry != NULL );
+
+    if( !held && ( length <= pCache->capacity ) )
+    {
+        while( ( pCache->pOldest != NULL ) && ( ( pCache->stats.bytes + length ) > pCache->capacity ) )
+        {
+            evictOldest( pCache );
+        }
+
+        pEntry = malloc( sizeof( OtaBlockEntry_t ) + pKey->streamNameLength + length );
+
+        if( pEntry != NULL )
+        {
+            pName = ( char * ) &pEntry[ 1 ];
+            ( void ) memcpy( pName, pKey->pStreamName, pKey->streamNameLength );
+
+            pEntry->hash = hash;
+            pEntry->key = *pKey;
+            pEntry->key.pStreamName = pName;
+            pEntry->length = length;
+            pEntry->pData = ( uint8_t * ) &pName[ pKey->streamNameLength ];
+            ( void ) memcpy( pEntry->pData, pData, length );
+
+            /* Evictions may have changed the chain of the block. */
+            ppEntry = &pCache->ppBuckets[ hash & ( pCache->bucketCount - 1U ) ];
+            pEntry->pNextInBucket = *ppEntry;
+            *ppEntry = pEntry;
+            linkNewest( pCache, pEntry );
+
+            pCache->stats.blocks++;
+            pCache->stats.bytes += length;
+            held = true;
+        }
+    }
+
+    return held;
+}
+
+/*-----------------------------------------------------------*/
+
+void OtaBlockCache_GetStats( const OtaBlockCache_t * pCache,
+                             OtaBlockCacheStats_t * pStats )
+{
+    *pStats = pCache->stats;
+}
+
+/*-----------------------------------------------------------*/
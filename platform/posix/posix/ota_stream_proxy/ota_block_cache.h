@@ -0,0 +1,150 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OTA_BLOCK_CACHE_H_
+#define OTA_BLOCK_CACHE_H_
+
+/**
+ * @file ota_block_cache.h
+ * @brief Cache of the blocks of OTA streams, keyed by stream name, file,
+ * block size and block index, holding at most a given number of bytes.
+ *
+ * A block of a stream never changes once the stream is created, so a cached
+ * block is valid for every device reading the same stream. The block with the
+ * oldest use is evicted first. The cache is not thread-safe.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The identity of a block.
+ */
+typedef struct OtaBlockKey
+{
+    const char * pStreamName;  /**< @brief Name of the stream, not terminated. */
+    size_t streamNameLength;   /**< @brief Length of #pStreamName. */
+    uint32_t fileId;           /**< @brief File of the stream the block is in. */
+    uint32_t blockSize;        /**< @brief Block size the file is read in. */
+    uint32_t blockIndex;       /**< @brief Index of the block in the file. */
+} OtaBlockKey_t;
+
+/* Forward declaration of a cached block. */
+struct OtaBlockEntry;
+
+/**
+ * @brief Counters of a cache, as returned by OtaBlockCache_GetStats.
+ */
+typedef struct OtaBlockCacheStats
+{
+    size_t blocks;      /**< @brief Blocks held. */
+    size_t bytes;       /**< @brief Bytes of the blocks held. */
+    uint64_t hits;      /**< @brief Lookups that found their block. */
+    uint64_t misses;    /**< @brief Lookups that didn't. */
+    uint64_t evictions; /**< @brief Blocks evicted to make room. */
+} OtaBlockCacheStats_t;
+
+/**
+ * @brief A cache of blocks.
+ */
+typedef struct OtaBlockCache
+{
+    struct OtaBlockEntry ** ppBuckets;  /**< @brief Hash chains. */
+    size_t bucketCount;                 /**< @brief Number of chains, a power of two. */
+    struct OtaBlockEntry * pNewest;     /**< @brief Most recently used block. */
+    struct OtaBlockEntry * pOldest;     /**< @brief Least recently used block, evicted first. */
+    size_t capacity;                    /**< @brief Most bytes of blocks held. */
+    OtaBlockCacheStats_t stats;
+} OtaBlockCache_t;
+
+/**
+ * @brief Hash of the stream, file and index of a block. The block size is
+ * left out, so that a response, which only gives the size of its own block,
+ * can be matched to the request it answers.
+ *
+ * @param[in] pKey The block.
+ *
+ * @return The hash.
+ */
+uint32_t OtaBlockCache_Hash( const OtaBlockKey_t * pKey );
+
+/**
+ * @brief Set up an empty cache.
+ *
+ * @param[out] pCache The cache.
+ * @param[in] capacity The most bytes of blocks to hold.
+ * @param[in] bucketCount Hash chains, rounded up to a power of two; about
+ * the number of blocks expected to be held.
+ *
+ * @return true on success; false if the chains could not be allocated.
+ */
+bool OtaBlockCache_Init( OtaBlockCache_t * pCache,
+                         size_t capacity,
+                         size_t bucketCount );
+
+/**
+ * @brief Free every block and the chains of a cache.
+ *
+ * @param[in] pCache The cache.
+ */
+void OtaBlockCache_Deinit( OtaBlockCache_t * pCache );
+
+/**
+ * @brief Look up a block, making it the most recently used.
+ *
+ * @param[in] pCache The cache.
+ * @param[in] pKey The block.
+ * @param[out] pLength The length of the block.
+ *
+ * @return The data of the block, valid until the next call to
+ * OtaBlockCache_Put; NULL if the block is not held.
+ */
+const uint8_t * OtaBlockCache_Get( OtaBlockCache_t * pCache,
+                                   const OtaBlockKey_t * pKey,
+                                   size_t * pLength );
+
+/**
+ * @brief Copy a block into the cache, evicting the least recently used blocks
+ * to make room. A block already held is left as it is.
+ *
+ * @param[in] pCache The cache.
+ * @param[in] pKey The block.
+ * @param[in] pData The data of the block.
+ * @param[in] length The length of the block.
+ *
+ * @return true if the block is held; false if it is larger than the cache or
+ * could not be allocated.
+ */
+bool OtaBlockCache_Put( OtaBlockCache_t * pCache,
+                        const OtaBlockKey_t * pKey,
+                        const uint8_t * pData,
+                        size_t length );
+
+/**
+ * @brief Copy the counters of a cache into pStats.
+ */
+void OtaBlockCache_GetStats( const OtaBlockCache_t * pCache,
+                             OtaBlockCacheStats_t * pStats );
+
+#endif /* ifndef OTA_BLOCK_CACHE_H_ */
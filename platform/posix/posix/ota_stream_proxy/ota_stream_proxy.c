@@ -0,0 +1,1940 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ota_stream_proxy.c
+ * @brief Caching proxy of OTA MQTT streams for a gateway, serving the blocks
+ * of a stream to the devices behind it from one download.
+ *
+ * Devices connect to the proxy over MQTT on the local network and send it the
+ * requests the OTA agent publishes on $aws/things/<thing>/streams/<stream>/get/cbor.
+ * Every block requested is answered from the block cache if it is held, on
+ * the data topic of the stream of that device. The blocks that aren't held
+ * are asked for from AWS IoT over one MQTT connection of the gateway, on the
+ * stream topics of its own thing, and the device waits for them. A block
+ * already asked for by another device is not asked for again: the device is
+ * added to the waiters of the block, and all of them are sent the block when
+ * it arrives. A site-wide rollout thus downloads every block once, as long as
+ * the cache holds the file.
+ *
+ * The data messages of AWS IoT are cached and forwarded as they are, as they
+ * hold nothing specific to the device that asked: the file, the index, the
+ * size and the payload of the block. A block asked for that hasn't arrived
+ * after the response timeout is asked for again. A rejection of a request of
+ * the gateway is forwarded to every device waiting for a block of its stream.
+ *
+ * Only CBOR requests are proxied, and the MQTT server side is the subset the
+ * OTA agent uses: CONNECT, SUBSCRIBE and UNSUBSCRIBE are acknowledged without
+ * keeping a session, PUBLISH of QoS 0 or 1 is taken on the request topics,
+ * and everything is sent to the devices at QoS 0. A device still needs AWS
+ * IoT for its jobs; it sends the stream topics to the proxy, which it reaches
+ * without TLS, as the signature of the job document authenticates the file.
+ *
+ * All connections run on one thread over the epoll reactor of the transport.
+ * MQTT packets are built and parsed with the coreMQTT serializer API.
+ *
+ * Usage: ota_stream_proxy -e <endpoint> -r <root CA> -c <cert> -k <key>
+ *        -t <thing name> [-p <port>] [-l <listen port>] [-m <max devices>]
+ *        [-C <cache MB>] [-w <response timeout ms>] [-i <stats interval s>]
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration of the proxy. */
+#define LIBRARY_LOG_NAME     "OTA_STREAM_PROXY"
+#define LIBRARY_LOG_LEVEL    LOG_INFO
+
+#include "logging_stack.h"
+
+/* Transport includes. */
+#include "openssl_posix.h"
+#include "plaintext_posix.h"
+#include "transport_reactor_posix.h"
+
+/* MQTT serializer include. */
+#include "core_mqtt_serializer.h"
+
+/* CBOR include. */
+#include "cbor.h"
+
+#include "ota_block_cache.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief MQTT port of AWS IoT used when none is given on the command line.
+ */
+#define DEFAULT_PORT                    8883U
+
+/**
+ * @brief Port the devices connect to when none is given.
+ */
+#define DEFAULT_LISTEN_PORT             1883U
+
+/**
+ * @brief Devices connected at once when no limit is given.
+ */
+#define DEFAULT_MAX_DEVICES             256U
+
+/**
+ * @brief Size of the block cache when none is given, in megabytes.
+ */
+#define DEFAULT_CACHE_MB                64U
+
+/**
+ * @brief Time after which a block is asked for again, when none is given.
+ */
+#define DEFAULT_RESPONSE_TIMEOUT_MS     5000U
+
+/**
+ * @brief Interval of the statistics when none is given; 0 prints them only
+ * on exit.
+ */
+#define DEFAULT_STATS_INTERVAL_S        60U
+
+/**
+ * @brief ALPN protocol of MQTT over port 443.
+ */
+#define AWS_IOT_MQTT_ALPN               "\x0ex-amzn-mqtt-ca"
+#define AWS_IOT_MQTT_ALPN_LENGTH        ( ( uint32_t ) ( sizeof( AWS_IOT_MQTT_ALPN ) - 1U ) )
+
+/**
+ * @brief Client token of the requests of the gateway.
+ */
+#define CLIENT_TOKEN                    "proxy"
+
+/**
+ * @brief Topic levels of the stream topics.
+ */
+#define THINGS_PREFIX                   "$aws/things/"
+#define STREAMS_LEVEL                   "/streams/"
+#define GET_SUFFIX                      "/get/cbor"
+#define DATA_SUFFIX                     "/data/cbor"
+#define REJECTED_SUFFIX                 "/rejected/cbor"
+
+/**
+ * @brief Longest thing and stream names taken.
+ */
+#define MAX_THING_NAME_LENGTH           128U
+#define MAX_STREAM_NAME_LENGTH          128U
+
+/**
+ * @brief Size of the buffers of topics.
+ */
+#define TOPIC_BUFFER_SIZE               320U
+
+/**
+ * @brief Most blocks taken from one request, and the size of its bitmap.
+ */
+#define MAX_BLOCKS_PER_REQUEST          1024U
+#define MAX_BITMAP_SIZE                 ( MAX_BLOCKS_PER_REQUEST / 8U )
+
+/**
+ * @brief Size of the buffer assembling the packets of a device. The requests
+ * of the OTA agent are small.
+ */
+#define DEVICE_RECEIVE_BUFFER_SIZE      2048U
+
+/**
+ * @brief Size of the buffer assembling the packets from AWS IoT. It must hold
+ * a data message of the largest block size of 128 KB.
+ */
+#define UPSTREAM_RECEIVE_BUFFER_SIZE    ( ( 128U * 1024U ) + 1024U )
+
+/**
+ * @brief Size of the read-ahead buffer of the connection to AWS IoT.
+ */
+#define READ_AHEAD_BUFFER_SIZE          16384U
+
+/**
+ * @brief Size of the buffers for the packets sent, without their payload.
+ */
+#define SEND_BUFFER_SIZE                512U
+
+/**
+ * @brief Size of the buffer for the requests of the gateway.
+ */
+#define REQUEST_BUFFER_SIZE             ( MAX_BITMAP_SIZE + 128U )
+
+/**
+ * @brief Hash chains of the blocks being asked for.
+ */
+#define PENDING_BUCKETS                 1024U
+
+/**
+ * @brief Send and receive timeouts of the connections.
+ */
+#define TRANSPORT_SEND_TIMEOUT_MS       1000U
+#define TRANSPORT_RECV_TIMEOUT_MS       50U
+
+/**
+ * @brief Keep-alive interval sent in the CONNECT packet to AWS IoT.
+ */
+#define MQTT_KEEP_ALIVE_INTERVAL_S      60U
+
+/**
+ * @brief Packet identifier of the SUBSCRIBE sent to AWS IoT.
+ */
+#define SUBSCRIBE_PACKET_ID             1U
+
+/**
+ * @brief First and longest delay before reconnecting to AWS IoT.
+ */
+#define RECONNECT_DELAY_MIN_MS          1000U
+#define RECONNECT_DELAY_MAX_MS          60000U
+
+/**
+ * @brief Longest wait of the reactor, so that timeouts are handled on time.
+ */
+#define DISPATCH_TIMEOUT_MS             100U
+
+/**
+ * @brief Interval between two scans for blocks past their response timeout.
+ */
+#define PENDING_SCAN_INTERVAL_US        200000U
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. The devices
+ * point it at #PlaintextParams_t and the upstream at #OpensslParams_t. */
+struct NetworkContext
+{
+    void * pParams;
+};
+
+/**
+ * @brief Settings from the command line.
+ */
+typedef struct ProxyConfig
+{
+    const char * pEndpoint;
+    uint16_t port;
+    const char * pRootCaPath;
+    const char * pCertPath;
+    const char * pKeyPath;
+    const char * pThingName;
+    uint16_t listenPort;
+    uint32_t maxDevices;
+    uint32_t cacheMb;
+    uint32_t responseTimeoutMs;
+    uint32_t statsIntervalS;
+} ProxyConfig_t;
+
+/**
+ * @brief A slot for a connected device, reused by the next one once the
+ * device has disconnected.
+ */
+typedef struct Device
+{
+    bool inUse;
+    uint32_t generation;       /**< @brief Incremented when the slot is freed, so waiters of an old device are dropped. */
+    NetworkContext_t networkContext;
+    PlaintextParams_t plaintextParams;
+    ReactorConnection_t connection;
+    char address[ INET6_ADDRSTRLEN ];
+    char thingName[ MAX_THING_NAME_LENGTH ];
+    size_t thingNameLength;    /**< @brief Thing of the last request of the device, whose topics it is answered on. */
+    size_t receivedLength;     /**< @brief Bytes of #receiveBuffer not yet parsed as packets. */
+    uint8_t receiveBuffer[ DEVICE_RECEIVE_BUFFER_SIZE ];
+    uint8_t sendBuffer[ SEND_BUFFER_SIZE ];
+} Device_t;
+
+/**
+ * @brief A device waiting for a block.
+ */
+typedef struct Waiter
+{
+    struct Waiter * pNext;
+    Device_t * pDevice;
+    uint32_t generation;       /**< @brief Generation of #pDevice when it started waiting. */
+} Waiter_t;
+
+/**
+ * @brief A block asked for from AWS IoT and not received yet.
+ */
+typedef struct PendingBlock
+{
+    struct PendingBlock * pNextInBucket;
+    struct PendingBlock * pNext;  /**< @brief Next in the list of all pending blocks. */
+    uint32_t hash;
+    OtaBlockKey_t key;            /**< @brief The stream name points into #streamName. */
+    char streamName[ MAX_STREAM_NAME_LENGTH ];
+    uint64_t requestedUs;         /**< @brief When it was last asked for; 0 if not asked for yet. */
+    Waiter_t * pWaiters;
+} PendingBlock_t;
+
+/**
+ * @brief State of the connection to AWS IoT.
+ */
+typedef enum UpstreamState
+{
+    UPSTREAM_DISCONNECTED = 0, /**< @brief Waiting to reconnect. */
+    UPSTREAM_CONNECTING,       /**< @brief TCP connect and TLS handshake in progress. */
+    UPSTREAM_CONNACK,          /**< @brief Waiting for the CONNACK. */
+    UPSTREAM_SUBACK,           /**< @brief Waiting for the SUBACK of the stream topics. */
+    UPSTREAM_READY             /**< @brief Requests can be sent. */
+} UpstreamState_t;
+
+/**
+ * @brief The connection of the gateway to AWS IoT.
+ */
+typedef struct Upstream
+{
+    UpstreamState_t state;
+    bool connected;            /**< @brief The TLS session is up; its packets are handled. */
+    NetworkContext_t networkContext;
+    OpensslParams_t opensslParams;
+    ReactorConnection_t connection;
+    uint64_t reconnectAtUs;    /**< @brief When to reconnect while disconnected. */
+    uint32_t reconnectDelayMs; /**< @brief Delay before the next reconnect. */
+    uint64_t lastSendUs;       /**< @brief Last packet sent, for the keep-alive. */
+    size_t receivedLength;     /**< @brief Bytes of #receiveBuffer not yet parsed as packets. */
+    uint8_t readAheadBuffer[ READ_AHEAD_BUFFER_SIZE ];
+    uint8_t receiveBuffer[ UPSTREAM_RECEIVE_BUFFER_SIZE ];
+    uint8_t sendBuffer[ SEND_BUFFER_SIZE ];
+    uint8_t requestBuffer[ REQUEST_BUFFER_SIZE ];
+} Upstream_t;
+
+/**
+ * @brief Counters of the proxy, besides those of the cache.
+ */
+typedef struct ProxyStats
+{
+    uint64_t connects;         /**< @brief Devices connected. */
+    uint64_t requests;         /**< @brief Requests of the devices. */
+    uint64_t blocksRequested;  /**< @brief Blocks asked for by the devices. */
+    uint64_t blocksServed;     /**< @brief Blocks sent to the devices. */
+    uint64_t bytesServed;      /**< @brief Bytes of data messages sent to the devices. */
+    uint64_t coalesced;        /**< @brief Blocks asked for by a device while already asked for from AWS IoT. */
+    uint64_t upstreamRequests; /**< @brief Requests sent to AWS IoT. */
+    uint64_t upstreamBlocks;   /**< @brief Blocks received from AWS IoT. */
+    uint64_t upstreamBytes;    /**< @brief Bytes of data messages received from AWS IoT. */
+    uint64_t retries;          /**< @brief Blocks asked for again after the response timeout. */
+    uint64_t rejections;       /**< @brief Rejections of requests of the gateway. */
+    uint64_t upstreamConnects; /**< @brief Connections to AWS IoT established. */
+} ProxyStats_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Settings from the command line.
+ */
+static ProxyConfig_t config;
+
+/**
+ * @brief The reactor running every connection.
+ */
+static Reactor_t reactor;
+
+/**
+ * @brief The server and credentials of the connection to AWS IoT.
+ */
+static ServerInfo_t serverInfo;
+static OpensslCredentials_t credentials;
+
+/**
+ * @brief The topic filters of the data and rejected topics of the streams of
+ * the gateway, and the prefix of its stream topics.
+ */
+static char dataTopicFilter[ TOPIC_BUFFER_SIZE ];
+static uint16_t dataTopicFilterLength = 0U;
+static char rejectedTopicFilter[ TOPIC_BUFFER_SIZE ];
+static uint16_t rejectedTopicFilterLength = 0U;
+static char streamTopicPrefix[ TOPIC_BUFFER_SIZE ];
+static size_t streamTopicPrefixLength = 0U;
+
+/**
+ * @brief The listening socket and its registration with the reactor.
+ */
+static int32_t listenSocket = -1;
+static ReactorConnection_t listenConnection;
+
+/**
+ * @brief The slots of the devices.
+ */
+static Device_t * pDevices = NULL;
+
+/**
+ * @brief The connection to AWS IoT.
+ */
+static Upstream_t * pUpstream = NULL;
+
+/**
+ * @brief The blocks being asked for, by hash and in a list.
+ */
+static PendingBlock_t * pendingBuckets[ PENDING_BUCKETS ];
+static PendingBlock_t * pPendingHead = NULL;
+
+/**
+ * @brief The cache of the blocks received.
+ */
+static OtaBlockCache_t cache;
+
+/**
+ * @brief Counters of the proxy.
+ */
+static ProxyStats_t stats;
+
+/**
+ * @brief Set by SIGINT and SIGTERM to stop the proxy.
+ */
+static volatile sig_atomic_t stopRequested = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Monotonic time in microseconds.
+ */
+static uint64_t nowUs( void );
+
+/**
+ * @brief Send all of a buffer over a transport, waiting up to the send
+ * timeout for the socket to take more.
+ */
+static bool sendAll( TransportSend_t sendFunction,
+                     NetworkContext_t * pNetworkContext,
+                     const uint8_t * pData,
+                     size_t length );
+
+/**
+ * @brief Send a PUBLISH of QoS 0 to a device.
+ */
+static bool sendToDevice( Device_t * pDevice,
+                          const char * pTopic,
+                          size_t topicLength,
+                          const uint8_t * pPayload,
+                          size_t payloadLength );
+
+/**
+ * @brief Send a block to a device, on the data topic of its stream.
+ */
+static bool sendBlock( Device_t * pDevice,
+                       const OtaBlockKey_t * pKey,
+                       const uint8_t * pData,
+                       size_t length );
+
+/**
+ * @brief Close the connection of a device and free its slot.
+ */
+static void closeDevice( Device_t * pDevice );
+
+/**
+ * @brief Find the block being asked for with the stream, file and index of
+ * pKey; its block size is ignored if matchSize is false.
+ */
+static PendingBlock_t * findPending( const OtaBlockKey_t * pKey,
+                                     bool matchSize );
+
+/**
+ * @brief Free a pending block and its waiters, removing it from the chains.
+ */
+static void removePending( PendingBlock_t * pPending );
+
+/**
+ * @brief Ask AWS IoT for the blocks in pIndexes, all of the file of pKey.
+ */
+static void requestBlocks( const OtaBlockKey_t * pKey,
+                           const uint32_t * pIndexes,
+                           size_t count );
+
+/**
+ * @brief Answer a stream request of a device.
+ */
+static void handleDeviceRequest( Device_t * pDevice,
+                                 const char * pThingName,
+                                 size_t thingNameLength,
+                                 const char * pStreamName,
+                                 size_t streamNameLength,
+                                 const uint8_t * pPayload,
+                                 size_t payloadLength );
+
+/**
+ * @brief Handle a packet of a device.
+ */
+static void handleDevicePacket( Device_t * pDevice,
+                                MQTTPacketInfo_t * pPacketInfo );
+
+/**
+ * @brief Handle a data message or rejection from AWS IoT.
+ */
+static void handleUpstreamPublish( const MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Handle a packet from AWS IoT.
+ */
+static void handleUpstreamPacket( MQTTPacketInfo_t * pPacketInfo );
+
+/**
+ * @brief Parse the packets in a receive buffer, keeping the start of an
+ * incomplete one. Returns false on a malformed or oversized packet.
+ */
+static bool processPackets( uint8_t * pBuffer,
+                            size_t bufferSize,
+                            size_t * pReceivedLength,
+                            void ( * handlePacket )( void * pContext, MQTTPacketInfo_t * pPacketInfo ),
+                            void * pContext,
+                            const bool * pOpen );
+
+/**
+ * @brief Close the connection to AWS IoT and schedule a reconnect.
+ */
+static void disconnectUpstream( void );
+
+/**
+ * @brief Start connecting to AWS IoT.
+ */
+static void connectUpstream( void );
+
+/**
+ * @brief Ask again for the blocks past their response timeout, or not asked
+ * for while disconnected.
+ */
+static void retryPending( uint64_t timeUs );
+
+/**
+ * @brief Print the counters of the proxy and of the cache.
+ */
+static void printStats( void );
+
+/*-----------------------------------------------------------*/
+
+static uint64_t nowUs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000U ) + ( ( uint64_t ) now.tv_nsec / 1000U );
+}
+/*-----------------------------------------------------------*/
+
+static bool sendAll( TransportSend_t sendFunction,
+                     NetworkContext_t * pNetworkContext,
+                     const uint8_t * pData,
+                     size_t length )
+{
+    size_t sent = 0U;
+    int32_t status = 0;
+    uint64_t deadlineUs = nowUs() + ( TRANSPORT_SEND_TIMEOUT_MS * 1000U );
+
+    /* The send functions return 0 while the socket buffer is full. A device
+     * that stops reading for the send timeout is given up on. */
+    while( ( sent < length ) && ( status >= 0 ) && ( nowUs() < deadlineUs ) )
+    {
+        status = sendFunction( pNetworkContext, &pData[ sent ], length - sent );
+
+        if( status > 0 )
+        {
+            sent += ( size_t ) status;
+        }
+    }
+
+    return ( sent == length );
+}
+/*-----------------------------------------------------------*/
+
+static bool sendToDevice( Device_t * pDevice,
+                          const char * pTopic,
+                          size_t topicLength,
+                          const uint8_t * pPayload,
+                          size_t payloadLength )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U, headerSize = 0U;
+    bool status = false;
+
+    publishInfo.qos = MQTTQoS0;
+    publishInfo.pTopicName = pTopic;
+    publishInfo.topicNameLength = ( uint16_t ) topicLength;
+    publishInfo.pPayload = pPayload;
+    publishInfo.payloadLength = payloadLength;
+
+    fixedBuffer.pBuffer = pDevice->sendBuffer;
+    fixedBuffer.size = sizeof( pDevice->sendBuffer );
+
+    if( ( MQTT_GetPublishPacketSize( &publishInfo, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( MQTT_SerializePublishHeader( &publishInfo, 0U, remainingLength, &fixedBuffer, &headerSize ) == MQTTSuccess ) )
+    {
+        status = sendAll( Plaintext_Send, &pDevice->networkContext, pDevice->sendBuffer, headerSize );
+
+        if( ( status == true ) && ( payloadLength > 0U ) )
+        {
+            status = sendAll( Plaintext_Send, &pDevice->networkContext, pPayload, payloadLength );
+        }
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static bool sendBlock( Device_t * pDevice,
+                       const OtaBlockKey_t * pKey,
+                       const uint8_t * pData,
+                       size_t length )
+{
+    char topic[ TOPIC_BUFFER_SIZE ];
+    int topicLength = snprintf( topic, sizeof( topic ), THINGS_PREFIX "%.*s" STREAMS_LEVEL "%.*s" DATA_SUFFIX,
+                                ( int ) pDevice->thingNameLength, pDevice->thingName,
+                                ( int ) pKey->streamNameLength, pKey->pStreamName );
+    bool status = false;
+
+    if( ( topicLength > 0 ) && ( ( size_t ) topicLength < sizeof( topic ) ) )
+    {
+        status = sendToDevice( pDevice, topic, ( size_t ) topicLength, pData, length );
+    }
+
+    if( status == true )
+    {
+        stats.blocksServed++;
+        stats.bytesServed += length;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void closeDevice( Device_t * pDevice )
+{
+    LogDebug( ( "Device %s disconnected.", pDevice->address ) );
+
+    /* Reactor_Remove leaves an established connection open. */
+    ( void ) Reactor_Remove( &reactor, &pDevice->connection );
+    ( void ) Plaintext_Disconnect( &pDevice->networkContext );
+
+    /* The waiters of the device are dropped when their block arrives. */
+    pDevice->generation++;
+    pDevice->inUse = false;
+}
+/*-----------------------------------------------------------*/
+
+static PendingBlock_t * findPending( const OtaBlockKey_t * pKey,
+                                     bool matchSize )
+{
+    uint32_t hash = OtaBlockCache_Hash( pKey );
+    PendingBlock_t * pPending = pendingBuckets[ hash & ( PENDING_BUCKETS - 1U ) ];
+
+    while( ( pPending != NULL ) &&
+           ( ( pPending->hash != hash ) ||
+             ( pPending->key.fileId != pKey->fileId ) ||
+             ( pPending->key.blockIndex != pKey->blockIndex ) ||
+             ( matchSize && ( pPending->key.blockSize != pKey->blockSize ) ) ||
+             ( pPending->key.streamNameLength != pKey->streamNameLength ) ||
+             ( memcmp( pPending->key.pStreamName, pKey->pStreamName, pKey->streamNameLength ) != 0 ) ) )
+    {
+        pPending = pPending->pNextInBucket;
+    }
+
+    return pPending;
+}
+/*-----------------------------------------------------------*/
+
+static void removePending( PendingBlock_t * pPending )
+{
+    PendingBlock_t ** ppPending = &pendingBuckets[ pPending->hash & ( PENDING_BUCKETS - 1U ) ];
+    Waiter_t * pWaiter = NULL;
+
+    while( *ppPending != pPending )
+    {
+        ppPending = &( *ppPending )->pNextInBucket;
+    }
+
+    *ppPending = pPending->pNextInBucket;
+
+    for( ppPending = &pPendingHead; *ppPending != pPending; ppPending = &( *ppPending )->pNext )
+    {
+    }
+
+    *ppPending = pPending->pNext;
+
+    while( pPending->pWaiters != NULL )
+    {
+        pWaiter = pPending->pWaiters;
+        pPending->pWaiters = pWaiter->pNext;
+        free( pWaiter );
+    }
+
+    free( pPending );
+}
+/*-----------------------------------------------------------*/
+
+static void requestBlocks( const OtaBlockKey_t * pKey,
+                           const uint32_t * pIndexes,
+                           size_t count )
+{
+    CborEncoder encoder, mapEncoder;
+    uint8_t bitmap[ MAX_BITMAP_SIZE ] = { 0 };
+    char topic[ TOPIC_BUFFER_SIZE ];
+    uint32_t first = UINT32_MAX, last = 0U;
+    size_t i, bitmapSize = 0U, requestLength = 0U;
+    int topicLength = 0;
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U, headerSize = 0U;
+    CborError cborError = CborNoError;
+    bool status = false;
+
+    for( i = 0U; i < count; i++ )
+    {
+        first = ( pIndexes[ i ] < first ) ? pIndexes[ i ] : first;
+        last = ( pIndexes[ i ] > last ) ? pIndexes[ i ] : last;
+    }
+
+    /* The bitmap starts at the offset of the request, one bit per block, the
+     * first block in the lowest bit of the first byte. */
+    bitmapSize = ( ( last - first ) / 8U ) + 1U;
+
+    for( i = 0U; i < count; i++ )
+    {
+        bitmap[ ( pIndexes[ i ] - first ) / 8U ] |= ( uint8_t ) ( 1U << ( ( pIndexes[ i ] - first ) % 8U ) );
+    }
+
+    cbor_encoder_init( &encoder, pUpstream->requestBuffer, sizeof( pUpstream->requestBuffer ), 0 );
+    cborError |= cbor_encoder_create_map( &encoder, &mapEncoder, 6 );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, "c" );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, CLIENT_TOKEN );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, "f" );
+    cborError |= cbor_encode_uint( &mapEncoder, pKey->fileId );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, "l" );
+    cborError |= cbor_encode_uint( &mapEncoder, pKey->blockSize );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, "o" );
+    cborError |= cbor_encode_uint( &mapEncoder, first );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, "b" );
+    cborError |= cbor_encode_byte_string( &mapEncoder, bitmap, bitmapSize );
+    cborError |= cbor_encode_text_stringz( &mapEncoder, "n" );
+    cborError |= cbor_encode_uint( &mapEncoder, count );
+    cborError |= cbor_encoder_close_container_checked( &encoder, &mapEncoder );
+
+    requestLength = cbor_encoder_get_buffer_size( &encoder, pUpstream->requestBuffer );
+    topicLength = snprintf( topic, sizeof( topic ), "%.*s%.*s" GET_SUFFIX,
+                            ( int ) streamTopicPrefixLength, streamTopicPrefix,
+                            ( int ) pKey->streamNameLength, pKey->pStreamName );
+
+    publishInfo.qos = MQTTQoS0;
+    publishInfo.pTopicName = topic;
+    publishInfo.topicNameLength = ( uint16_t ) topicLength;
+    publishInfo.pPayload = pUpstream->requestBuffer;
+    publishInfo.payloadLength = requestLength;
+
+    fixedBuffer.pBuffer = pUpstream->sendBuffer;
+    fixedBuffer.size = sizeof( pUpstream->sendBuffer );
+
+    if( ( cborError == CborNoError ) && ( topicLength > 0 ) && ( ( size_t ) topicLength < sizeof( topic ) ) &&
+        ( MQTT_GetPublishPacketSize( &publishInfo, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+        ( MQTT_SerializePublishHeader( &publishInfo, 0U, remainingLength, &fixedBuffer, &headerSize ) == MQTTSuccess ) )
+    {
+        status = sendAll( Openssl_Send, &pUpstream->networkContext, pUpstream->sendBuffer, headerSize ) &&
+                 sendAll( Openssl_Send, &pUpstream->networkContext, pUpstream->requestBuffer, requestLength );
+
+        if( status == true )
+        {
+            pUpstream->lastSendUs = nowUs();
+            stats.upstreamRequests++;
+
+            LogDebug( ( "Asked for %u blocks of file %u of stream %.*s from block %u.",
+                        ( unsigned ) count, ( unsigned ) pKey->fileId,
+                        ( int ) pKey->streamNameLength, pKey->pStreamName, ( unsigned ) first ) );
+        }
+        else
+        {
+            disconnectUpstream();
+        }
+    }
+    else
+    {
+        LogError( ( "Failed to build the request for stream %.*s.",
+                    ( int ) pKey->streamNameLength, pKey->pStreamName ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handleDeviceRequest( Device_t * pDevice,
+                                 const char * pThingName,
+                                 size_t thingNameLength,
+                                 const char * pStreamName,
+                                 size_t streamNameLength,
+                                 const uint8_t * pPayload,
+                                 size_t payloadLength )
+{
+    CborParser parser;
+    CborValue map, value;
+    uint64_t fileId = 0U, blockSize = 0U, offset = 0U, blockCount = 0U;
+    uint8_t bitmap[ MAX_BITMAP_SIZE ];
+    size_t bitmapSize = 0U;
+    uint32_t missing[ MAX_BLOCKS_PER_REQUEST ];
+    size_t missingCount = 0U, found = 0U, length = 0U, bit = 0U;
+    OtaBlockKey_t key = { 0 };
+    PendingBlock_t * pPending = NULL;
+    Waiter_t * pWaiter = NULL;
+    const uint8_t * pData = NULL;
+    bool valid = false;
+    uint64_t timeUs = nowUs();
+
+    stats.requests++;
+
+    if( ( cbor_parser_init( pPayload, payloadLength, 0, &parser, &map ) == CborNoError ) &&
+        cbor_value_is_map( &map ) &&
+        ( cbor_value_map_find_value( &map, "f", &value ) == CborNoError ) &&
+        cbor_value_is_unsigned_integer( &value ) &&
+        ( cbor_value_get_uint64( &value, &fileId ) == CborNoError ) &&
+        ( cbor_value_map_find_value( &map, "l", &value ) == CborNoError ) &&
+        cbor_value_is_unsigned_integer( &value ) &&
+        ( cbor_value_get_uint64( &value, &blockSize ) == CborNoError ) &&
+        ( cbor_value_map_find_value( &map, "o", &value ) == CborNoError ) &&
+        cbor_value_is_unsigned_integer( &value ) &&
+        ( cbor_value_get_uint64( &value, &offset ) == CborNoError ) &&
+        ( cbor_value_map_find_value( &map, "n", &value ) == CborNoError ) &&
+        cbor_value_is_unsigned_integer( &value ) &&
+        ( cbor_value_get_uint64( &value, &blockCount ) == CborNoError ) &&
+        ( cbor_value_map_find_value( &map, "b", &value ) == CborNoError ) )
+    {
+        valid = ( fileId <= UINT32_MAX ) && ( blockSize > 0U ) && ( blockSize <= UINT32_MAX ) &&
+                ( offset <= UINT32_MAX ) && ( blockCount > 0U );
+
+        /* Without a bitmap, the blocks from the offset are asked for. */
+        if( valid && cbor_value_is_byte_string( &value ) )
+        {
+            bitmapSize = sizeof( bitmap );
+            valid = ( cbor_value_copy_byte_string( &value, bitmap, &bitmapSize, NULL ) == CborNoError );
+        }
+    }
+
+    if( ( valid == false ) || ( thingNameLength >= sizeof( pDevice->thingName ) ) ||
+        ( streamNameLength >= MAX_STREAM_NAME_LENGTH ) )
+    {
+        LogWarn( ( "Dropped a malformed request of device %s.", pDevice->address ) );
+    }
+    else
+    {
+        ( void ) memcpy( pDevice->thingName, pThingName, thingNameLength );
+        pDevice->thingNameLength = thingNameLength;
+
+        key.pStreamName = pStreamName;
+        key.streamNameLength = streamNameLength;
+        key.fileId = ( uint32_t ) fileId;
+        key.blockSize = ( uint32_t ) blockSize;
+
+        blockCount = ( blockCount < MAX_BLOCKS_PER_REQUEST ) ? blockCount : MAX_BLOCKS_PER_REQUEST;
+
+        for( bit = 0U; ( found < blockCount ) && ( pDevice->inUse == true ) &&
+             ( ( bitmapSize > 0U ) ? ( bit < ( bitmapSize * 8U ) ) : ( bit < blockCount ) ); bit++ )
+        {
+            if( ( bitmapSize > 0U ) && ( ( bitmap[ bit / 8U ] & ( 1U << ( bit % 8U ) ) ) == 0U ) )
+            {
+                continue;
+            }
+
+            found++;
+            stats.blocksRequested++;
+            key.blockIndex = ( uint32_t ) ( offset + bit );
+            pData = OtaBlockCache_Get( &cache, &key, &length );
+
+            if( pData != NULL )
+            {
+                if( sendBlock( pDevice, &key, pData, length ) == false )
+                {
+                    closeDevice( pDevice );
+                }
+
+                continue;
+            }
+
+            pPending = findPending( &key, true );
+
+            if( pPending != NULL )
+            {
+                stats.coalesced++;
+            }
+            else
+            {
+                pPending = calloc( 1U, sizeof( PendingBlock_t ) );
+
+                if( pPending != NULL )
+                {
+                    ( void ) memcpy( pPending->streamName, pStreamName, streamNameLength );
+                    pPending->key = key;
+                    pPending->key.pStreamName = pPending->streamName;
+                    pPending->hash = OtaBlockCache_Hash( &key );
+                    pPending->pNextInBucket = pendingBuckets[ pPending->hash & ( PENDING_BUCKETS - 1U ) ];
+                    pendingBuckets[ pPending->hash & ( PENDING_BUCKETS - 1U ) ] = pPending;
+                    pPending->pNext = pPendingHead;
+                    pPendingHead = pPending;
+
+                    if( pUpstream->state == UPSTREAM_READY )
+                    {
+                        pPending->requestedUs = timeUs;
+                        missing[ missingCount ] = key.blockIndex;
+                        missingCount++;
+                    }
+                }
+            }
+
+            pWaiter = ( pPending != NULL ) ? malloc( sizeof( Waiter_t ) ) : NULL;
+
+            if( pWaiter != NULL )
+            {
+                pWaiter->pDevice = pDevice;
+                pWaiter->generation = pDevice->generation;
+                pWaiter->pNext = pPending->pWaiters;
+                pPending->pWaiters = pWaiter;
+            }
+        }
+
+        if( missingCount > 0U )
+        {
+            requestBlocks( &key, missing, missingCount );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handleDevicePacket( Device_t * pDevice,
+                                MQTTPacketInfo_t * pPacketInfo )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    const char * pTopic = NULL;
+    const char * pThing = NULL;
+    const char * pStreams = NULL;
+    size_t topicLength = 0U, thingLength = 0U, i = 0U, filters = 0U, filterLength = 0U;
+    uint16_t packetId = 0U;
+    uint8_t * pResponse = pDevice->sendBuffer;
+    size_t responseLength = 0U;
+    bool status = true;
+
+    switch( pPacketInfo->type & 0xF0U )
+    {
+        case MQTT_PACKET_TYPE_CONNECT:
+            /* Accepted without a session. */
+            pResponse[ 0 ] = MQTT_PACKET_TYPE_CONNACK;
+            pResponse[ 1 ] = 2U;
+            pResponse[ 2 ] = 0U;
+            pResponse[ 3 ] = 0U;
+            responseLength = 4U;
+            stats.connects++;
+            break;
+
+        case MQTT_PACKET_TYPE_SUBSCRIBE & 0xF0U:
+            /* Every filter is granted QoS 0; what is sent to a device only
+             * depends on the requests of the device. */
+            for( i = 2U; ( i + 2U ) < pPacketInfo->remainingLength; i += 3U + filterLength )
+            {
+                filterLength = ( ( size_t ) pPacketInfo->pRemainingData[ i ] << 8 ) | pPacketInfo->pRemainingData[ i + 1U ];
+                filters++;
+            }
+
+            status = ( pPacketInfo->remainingLength >= 2U ) && ( i == pPacketInfo->remainingLength ) &&
+                     ( filters > 0U ) && ( ( filters + 2U ) < 128U ) && ( ( filters + 4U ) <= sizeof( pDevice->sendBuffer ) );
+
+            if( status == true )
+            {
+                pResponse[ 0 ] = MQTT_PACKET_TYPE_SUBACK;
+                pResponse[ 1 ] = ( uint8_t ) ( filters + 2U );
+                pResponse[ 2 ] = pPacketInfo->pRemainingData[ 0 ];
+                pResponse[ 3 ] = pPacketInfo->pRemainingData[ 1 ];
+                ( void ) memset( &pResponse[ 4 ], 0, filters );
+                responseLength = filters + 4U;
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_UNSUBSCRIBE & 0xF0U:
+            status = ( pPacketInfo->remainingLength >= 2U );
+
+            if( status == true )
+            {
+                pResponse[ 0 ] = MQTT_PACKET_TYPE_UNSUBACK;
+                pResponse[ 1 ] = 2U;
+                pResponse[ 2 ] = pPacketInfo->pRemainingData[ 0 ];
+                pResponse[ 3 ] = pPacketInfo->pRemainingData[ 1 ];
+                responseLength = 4U;
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PUBLISH:
+            status = ( MQTT_DeserializePublish( pPacketInfo, &packetId, &publishInfo ) == MQTTSuccess ) &&
+                     ( publishInfo.qos != MQTTQoS2 );
+
+            if( ( status == true ) && ( publishInfo.qos == MQTTQoS1 ) )
+            {
+                fixedBuffer.pBuffer = pDevice->sendBuffer;
+                fixedBuffer.size = MQTT_PUBLISH_ACK_PACKET_SIZE;
+                status = ( MQTT_SerializeAck( &fixedBuffer, MQTT_PACKET_TYPE_PUBACK, packetId ) == MQTTSuccess ) &&
+                         sendAll( Plaintext_Send, &pDevice->networkContext, pDevice->sendBuffer, MQTT_PUBLISH_ACK_PACKET_SIZE );
+            }
+
+            if( status == true )
+            {
+                /* $aws/things/<thing>/streams/<stream>/get/cbor */
+                pTopic = publishInfo.pTopicName;
+                topicLength = publishInfo.topicNameLength;
+                pThing = &pTopic[ sizeof( THINGS_PREFIX ) - 1U ];
+                /* A thing name has no '/', so the thing ends at the next one. */
+                pStreams = ( topicLength > sizeof( THINGS_PREFIX ) ) ?
+                           memchr( pThing, '/', topicLength - ( size_t ) ( pThing - pTopic ) ) : NULL;
+                thingLength = ( pStreams != NULL ) ? ( size_t ) ( pStreams - pThing ) : 0U;
+
+                if( ( pStreams != NULL ) && ( thingLength > 0U ) &&
+                    ( ( topicLength - ( size_t ) ( pStreams - pTopic ) ) >= ( sizeof( STREAMS_LEVEL ) - 1U ) ) &&
+                    ( memcmp( pStreams, STREAMS_LEVEL, sizeof( STREAMS_LEVEL ) - 1U ) == 0 ) &&
+                    ( strncmp( pTopic, THINGS_PREFIX, sizeof( THINGS_PREFIX ) - 1U ) == 0 ) &&
+                    ( topicLength > ( ( size_t ) ( pStreams - pTopic ) + ( sizeof( STREAMS_LEVEL ) - 1U ) + ( sizeof( GET_SUFFIX ) - 1U ) ) ) &&
+                    ( memcmp( &pTopic[ topicLength - ( sizeof( GET_SUFFIX ) - 1U ) ], GET_SUFFIX, sizeof( GET_SUFFIX ) - 1U ) == 0 ) )
+                {
+                    handleDeviceRequest( pDevice, pThing, thingLength,
+                                         &pStreams[ sizeof( STREAMS_LEVEL ) - 1U ],
+                                         topicLength - ( size_t ) ( pStreams - pTopic ) - ( sizeof( STREAMS_LEVEL ) - 1U ) - ( sizeof( GET_SUFFIX ) - 1U ),
+                                         publishInfo.pPayload, publishInfo.payloadLength );
+                }
+                else
+                {
+                    LogDebug( ( "Dropped a publish of device %s to %.*s.",
+                                pDevice->address, ( int ) topicLength, pTopic ) );
+                }
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PINGREQ:
+            pResponse[ 0 ] = MQTT_PACKET_TYPE_PINGRESP;
+            pResponse[ 1 ] = 0U;
+            responseLength = 2U;
+            break;
+
+        case MQTT_PACKET_TYPE_DISCONNECT:
+        default:
+            status = false;
+            break;
+    }
+
+    if( ( status == true ) && ( responseLength > 0U ) && ( pDevice->inUse == true ) )
+    {
+        status = sendAll( Plaintext_Send, &pDevice->networkContext, pResponse, responseLength );
+    }
+
+    if( ( status == false ) && ( pDevice->inUse == true ) )
+    {
+        closeDevice( pDevice );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handleUpstreamPublish( const MQTTPublishInfo_t * pPublishInfo )
+{
+    const char * pTopic = pPublishInfo->pTopicName;
+    size_t topicLength = pPublishInfo->topicNameLength;
+    const char * pStream = &pTopic[ streamTopicPrefixLength ];
+    size_t streamLength = 0U;
+    bool isData = false, isRejected = false;
+    CborParser parser;
+    CborValue map, value;
+    uint64_t fileId = 0U, blockIndex = 0U;
+    OtaBlockKey_t key = { 0 };
+    PendingBlock_t * pPending = NULL;
+    PendingBlock_t * pNext = NULL;
+    Waiter_t * pWaiter = NULL;
+    char topic[ TOPIC_BUFFER_SIZE ];
+    int deviceTopicLength = 0;
+
+    if( ( topicLength > streamTopicPrefixLength ) &&
+        ( memcmp( pTopic, streamTopicPrefix, streamTopicPrefixLength ) == 0 ) )
+    {
+        isData = ( topicLength > ( streamTopicPrefixLength + sizeof( DATA_SUFFIX ) - 1U ) ) &&
+                 ( memcmp( &pTopic[ topicLength - ( sizeof( DATA_SUFFIX ) - 1U ) ], DATA_SUFFIX, sizeof( DATA_SUFFIX ) - 1U ) == 0 );
+        isRejected = ( topicLength > ( streamTopicPrefixLength + sizeof( REJECTED_SUFFIX ) - 1U ) ) &&
+                     ( memcmp( &pTopic[ topicLength - ( sizeof( REJECTED_SUFFIX ) - 1U ) ], REJECTED_SUFFIX, sizeof( REJECTED_SUFFIX ) - 1U ) == 0 );
+        streamLength = topicLength - streamTopicPrefixLength -
+                       ( isData ? ( sizeof( DATA_SUFFIX ) - 1U ) : ( sizeof( REJECTED_SUFFIX ) - 1U ) );
+    }
+
+    key.pStreamName = pStream;
+    key.streamNameLength = streamLength;
+
+    if( isData &&
+        ( cbor_parser_init( pPublishInfo->pPayload, pPublishInfo->payloadLength, 0, &parser, &map ) == CborNoError ) &&
+        cbor_value_is_map( &map ) &&
+        ( cbor_value_map_find_value( &map, "f", &value ) == CborNoError ) &&
+        cbor_value_is_unsigned_integer( &value ) &&
+        ( cbor_value_get_uint64( &value, &fileId ) == CborNoError ) &&
+        ( cbor_value_map_find_value( &map, "i", &value ) == CborNoError ) &&
+        cbor_value_is_unsigned_integer( &value ) &&
+        ( cbor_value_get_uint64( &value, &blockIndex ) == CborNoError ) )
+    {
+        stats.upstreamBlocks++;
+        stats.upstreamBytes += pPublishInfo->payloadLength;
+
+        key.fileId = ( uint32_t ) fileId;
+        key.blockIndex = ( uint32_t ) blockIndex;
+
+        /* The block size asked for is that of the pending block, as the
+         * message gives the size of this block, less for the last one. */
+        pPending = findPending( &key, false );
+
+        if( pPending != NULL )
+        {
+            key.blockSize = pPending->key.blockSize;
+
+            if( OtaBlockCache_Put( &cache, &key, pPublishInfo->pPayload, pPublishInfo->payloadLength ) == false )
+            {
+                LogWarn( ( "Failed to cache block %u of stream %.*s.",
+                           ( unsigned ) key.blockIndex, ( int ) streamLength, pStream ) );
+            }
+
+            for( pWaiter = pPending->pWaiters; pWaiter != NULL; pWaiter = pWaiter->pNext )
+            {
+                if( ( pWaiter->pDevice->inUse == true ) && ( pWaiter->generation == pWaiter->pDevice->generation ) &&
+                    ( sendBlock( pWaiter->pDevice, &key, pPublishInfo->pPayload, pPublishInfo->payloadLength ) == false ) )
+                {
+                    closeDevice( pWaiter->pDevice );
+                }
+            }
+
+            removePending( pPending );
+        }
+    }
+    else if( isRejected )
+    {
+        stats.rejections++;
+        LogWarn( ( "A request for stream %.*s was rejected: %.*s",
+                   ( int ) streamLength, pStream,
+                   ( int ) pPublishInfo->payloadLength, ( const char * ) pPublishInfo->pPayload ) );
+
+        /* Every device waiting for a block of the stream is told, once for
+         * each of its blocks; the OTA agent asks again or gives up. */
+        for( pPending = pPendingHead; pPending != NULL; pPending = pNext )
+        {
+            pNext = pPending->pNext;
+
+            if( ( pPending->key.streamNameLength != streamLength ) ||
+                ( memcmp( pPending->key.pStreamName, pStream, streamLength ) != 0 ) )
+            {
+                continue;
+            }
+
+            for( pWaiter = pPending->pWaiters; pWaiter != NULL; pWaiter = pWaiter->pNext )
+            {
+                if( ( pWaiter->pDevice->inUse == true ) && ( pWaiter->generation == pWaiter->pDevice->generation ) )
+                {
+                    deviceTopicLength = snprintf( topic, sizeof( topic ), THINGS_PREFIX "%.*s" STREAMS_LEVEL "%.*s" REJECTED_SUFFIX,
+                                                  ( int ) pWaiter->pDevice->thingNameLength, pWaiter->pDevice->thingName,
+                                                  ( int ) streamLength, pStream );
+
+                    if( ( deviceTopicLength <= 0 ) || ( ( size_t ) deviceTopicLength >= sizeof( topic ) ) ||
+                        ( sendToDevice( pWaiter->pDevice, topic, ( size_t ) deviceTopicLength,
+                                        pPublishInfo->pPayload, pPublishInfo->payloadLength ) == false ) )
+                    {
+                        closeDevice( pWaiter->pDevice );
+                    }
+                }
+            }
+
+            removePending( pPending );
+        }
+    }
+    else
+    {
+        LogDebug( ( "Dropped a publish to %.*s.", ( int ) topicLength, pTopic ) );
+    }
+
+}
+/*-----------------------------------------------------------*/
+
+static void handleUpstreamPacket( MQTTPacketInfo_t * pPacketInfo )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    MQTTSubscribeInfo_t subscriptions[ 2 ];
+    size_t remainingLength = 0U, packetSize = 0U;
+    uint16_t packetId = 0U;
+    bool sessionPresent = false;
+    bool status = true;
+
+    switch( pPacketInfo->type & 0xF0U )
+    {
+        case MQTT_PACKET_TYPE_CONNACK:
+            status = ( pUpstream->state == UPSTREAM_CONNACK ) &&
+                     ( MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent ) == MQTTSuccess );
+
+            if( status == true )
+            {
+                ( void ) memset( subscriptions, 0, sizeof( subscriptions ) );
+                subscriptions[ 0 ].qos = MQTTQoS0;
+                subscriptions[ 0 ].pTopicFilter = dataTopicFilter;
+                subscriptions[ 0 ].topicFilterLength = dataTopicFilterLength;
+                subscriptions[ 1 ].qos = MQTTQoS0;
+                subscriptions[ 1 ].pTopicFilter = rejectedTopicFilter;
+                subscriptions[ 1 ].topicFilterLength = rejectedTopicFilterLength;
+
+                fixedBuffer.pBuffer = pUpstream->sendBuffer;
+                fixedBuffer.size = sizeof( pUpstream->sendBuffer );
+
+                status = ( MQTT_GetSubscribePacketSize( subscriptions, 2U, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+                         ( packetSize <= fixedBuffer.size ) &&
+                         ( MQTT_SerializeSubscribe( subscriptions, 2U, SUBSCRIBE_PACKET_ID, remainingLength, &fixedBuffer ) == MQTTSuccess ) &&
+                         sendAll( Openssl_Send, &pUpstream->networkContext, pUpstream->sendBuffer, packetSize );
+                pUpstream->state = UPSTREAM_SUBACK;
+                pUpstream->lastSendUs = nowUs();
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_SUBACK:
+            status = ( pUpstream->state == UPSTREAM_SUBACK ) &&
+                     ( MQTT_DeserializeAck( pPacketInfo, &packetId, &sessionPresent ) == MQTTSuccess );
+
+            if( status == true )
+            {
+                LogInfo( ( "Connected to %s as %s.", config.pEndpoint, config.pThingName ) );
+                pUpstream->state = UPSTREAM_READY;
+                pUpstream->reconnectDelayMs = RECONNECT_DELAY_MIN_MS;
+                stats.upstreamConnects++;
+
+                /* Ask for the blocks devices waited for while disconnected. */
+                retryPending( nowUs() );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PUBLISH:
+            /* Only subscribed at QoS 0. */
+            status = ( MQTT_DeserializePublish( pPacketInfo, &packetId, &publishInfo ) == MQTTSuccess ) &&
+                     ( publishInfo.qos == MQTTQoS0 );
+
+            if( status == true )
+            {
+                handleUpstreamPublish( &publishInfo );
+            }
+
+            break;
+
+        case MQTT_PACKET_TYPE_PINGRESP:
+            break;
+
+        default:
+            status = false;
+            break;
+    }
+
+    if( status == false )
+    {
+        LogError( ( "Unexpected packet 0x%02x from %s.", ( unsigned ) pPacketInfo->type, config.pEndpoint ) );
+        disconnectUpstream();
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool processPackets( uint8_t * pBuffer,
+                            size_t bufferSize,
+                            size_t * pReceivedLength,
+                            void ( * handlePacket )( void * pContext, MQTTPacketInfo_t * pPacketInfo ),
+                            void * pContext,
+                            const bool * pOpen )
+{
+    MQTTPacketInfo_t packetInfo;
+    size_t offset = 0U, headerLength = 0U, remainingLength = 0U, multiplier = 1U;
+    bool complete = true, valid = true;
+    uint8_t encodedByte = 0U;
+
+    while( ( *pOpen == true ) && ( complete == true ) && ( valid == true ) )
+    {
+        /* Decode the remaining length, at most four bytes after the type. */
+        headerLength = 1U;
+        remainingLength = 0U;
+        multiplier = 1U;
+
+        do
+        {
+            complete = ( offset + headerLength ) < *pReceivedLength;
+
+            if( complete == true )
+            {
+                encodedByte = pBuffer[ offset + headerLength ];
+                remainingLength += ( size_t ) ( encodedByte & 0x7FU ) * multiplier;
+                multiplier *= 128U;
+                headerLength++;
+            }
+        } while( ( complete == true ) && ( ( encodedByte & 0x80U ) != 0U ) && ( headerLength <= 4U ) );
+
+        if( ( complete == true ) &&
+            ( ( ( encodedByte & 0x80U ) != 0U ) || ( ( headerLength + remainingLength ) > bufferSize ) ) )
+        {
+            valid = false;
+        }
+        else if( ( complete == true ) && ( ( offset + headerLength + remainingLength ) <= *pReceivedLength ) )
+        {
+            ( void ) memset( &packetInfo, 0, sizeof( packetInfo ) );
+            packetInfo.type = pBuffer[ offset ];
+            packetInfo.pRemainingData = &pBuffer[ offset + headerLength ];
+            packetInfo.remainingLength = remainingLength;
+            offset += headerLength + remainingLength;
+
+            handlePacket( pContext, &packetInfo );
+        }
+        else
+        {
+            complete = false;
+        }
+    }
+
+    if( ( *pOpen == true ) && ( valid == true ) )
+    {
+        /* Keep the start of the next packet for the next read. */
+        ( void ) memmove( pBuffer, &pBuffer[ offset ], *pReceivedLength - offset );
+        *pReceivedLength -= offset;
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static void handleDevicePacketContext( void * pContext,
+                                       MQTTPacketInfo_t * pPacketInfo )
+{
+    handleDevicePacket( ( Device_t * ) pContext, pPacketInfo );
+}
+/*-----------------------------------------------------------*/
+
+static void handleUpstreamPacketContext( void * pContext,
+                                         MQTTPacketInfo_t * pPacketInfo )
+{
+    ( void ) pContext;
+    handleUpstreamPacket( pPacketInfo );
+}
+/*-----------------------------------------------------------*/
+
+static void deviceReceiveCallback( ReactorConnection_t * pConnection,
+                                   void * pUserContext )
+{
+    Device_t * pDevice = ( Device_t * ) pUserContext;
+    size_t space = sizeof( pDevice->receiveBuffer ) - pDevice->receivedLength;
+    int32_t received = -1;
+
+    ( void ) pConnection;
+
+    /* The socket is readable, so one read takes what has arrived; the reactor
+     * calls again while more is left. */
+    if( space > 0U )
+    {
+        received = Plaintext_Recv( &pDevice->networkContext,
+                                   &pDevice->receiveBuffer[ pDevice->receivedLength ],
+                                   space );
+    }
+
+    if( received <= 0 )
+    {
+        closeDevice( pDevice );
+    }
+    else
+    {
+        pDevice->receivedLength += ( size_t ) received;
+
+        if( ( processPackets( pDevice->receiveBuffer, sizeof( pDevice->receiveBuffer ), &pDevice->receivedLength,
+                              handleDevicePacketContext, pDevice, &pDevice->inUse ) == false ) &&
+            ( pDevice->inUse == true ) )
+        {
+            LogWarn( ( "Malformed or oversized packet from device %s.", pDevice->address ) );
+            closeDevice( pDevice );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void acceptCallback( ReactorConnection_t * pConnection,
+                            void * pUserContext )
+{
+    struct sockaddr_storage address;
+    socklen_t addressLength = sizeof( address );
+    struct timeval timeout;
+    Device_t * pDevice = NULL;
+    int32_t deviceSocket = -1;
+    uint32_t i;
+
+    ( void ) pConnection;
+    ( void ) pUserContext;
+
+    deviceSocket = accept( listenSocket, ( struct sockaddr * ) &address, &addressLength );
+
+    for( i = 0U; ( deviceSocket >= 0 ) && ( i < config.maxDevices ) && ( pDevice == NULL ); i++ )
+    {
+        if( pDevices[ i ].inUse == false )
+        {
+            pDevice = &pDevices[ i ];
+        }
+    }
+
+    if( ( deviceSocket >= 0 ) && ( pDevice == NULL ) )
+    {
+        LogWarn( ( "Refused a device: %u devices are connected.", ( unsigned ) config.maxDevices ) );
+        ( void ) close( deviceSocket );
+    }
+    else if( deviceSocket >= 0 )
+    {
+        timeout.tv_sec = TRANSPORT_SEND_TIMEOUT_MS / 1000U;
+        timeout.tv_usec = ( TRANSPORT_SEND_TIMEOUT_MS % 1000U ) * 1000U;
+        ( void ) setsockopt( deviceSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+        timeout.tv_sec = 0;
+        timeout.tv_usec = TRANSPORT_RECV_TIMEOUT_MS * 1000U;
+        ( void ) setsockopt( deviceSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+        pDevice->plaintextParams.socketDescriptor = deviceSocket;
+        pDevice->networkContext.pParams = &pDevice->plaintextParams;
+        pDevice->receivedLength = 0U;
+        pDevice->thingNameLength = 0U;
+
+        if( address.ss_family == AF_INET6 )
+        {
+            ( void ) inet_ntop( AF_INET6, &( ( struct sockaddr_in6 * ) &address )->sin6_addr,
+                                pDevice->address, sizeof( pDevice->address ) );
+        }
+        else
+        {
+            ( void ) inet_ntop( AF_INET, &( ( struct sockaddr_in * ) &address )->sin_addr,
+                                pDevice->address, sizeof( pDevice->address ) );
+        }
+
+        if( Reactor_Add( &reactor, &pDevice->connection, deviceSocket, NULL,
+                         deviceReceiveCallback, pDevice ) == REACTOR_SUCCESS )
+        {
+            pDevice->inUse = true;
+            LogDebug( ( "Device %s connected.", pDevice->address ) );
+        }
+        else
+        {
+            ( void ) close( deviceSocket );
+        }
+    }
+    else
+    {
+        /* The device went away before it was accepted. */
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void upstreamReceiveCallback( ReactorConnection_t * pConnection,
+                                     void * pUserContext )
+{
+    OpensslParams_t * pParams = &pUpstream->opensslParams;
+    size_t space = 0U, request = 0U;
+    int32_t received = 1;
+
+    ( void ) pConnection;
+    ( void ) pUserContext;
+
+    while( ( pUpstream->state >= UPSTREAM_CONNACK ) && ( received > 0 ) )
+    {
+        space = sizeof( pUpstream->receiveBuffer ) - pUpstream->receivedLength;
+
+        /* Openssl_Recv only avoids blocking for one byte, which refills the
+         * read-ahead buffer from the readable socket; what it holds is then
+         * taken in one call. */
+        request = ( pParams->readAheadLength > 0U ) ? space : 1U;
+        received = Openssl_Recv( &pUpstream->networkContext,
+                                 &pUpstream->receiveBuffer[ pUpstream->receivedLength ],
+                                 request );
+
+        if( received < 0 )
+        {
+            LogError( ( "Connection to %s lost.", config.pEndpoint ) );
+            disconnectUpstream();
+        }
+        else if( received > 0 )
+        {
+            pUpstream->receivedLength += ( size_t ) received;
+
+            if( processPackets( pUpstream->receiveBuffer, sizeof( pUpstream->receiveBuffer ), &pUpstream->receivedLength,
+                                handleUpstreamPacketContext, NULL, &pUpstream->connected ) == false )
+            {
+                LogError( ( "Malformed or oversized packet from %s.", config.pEndpoint ) );
+                disconnectUpstream();
+            }
+        }
+        else
+        {
+            /* Drained. */
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void upstreamConnectCallback( ReactorConnection_t * pConnection,
+                                     ReactorStatus_t status,
+                                     void * pUserContext )
+{
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t remainingLength = 0U, packetSize = 0U;
+
+    ( void ) pConnection;
+    ( void ) pUserContext;
+
+    connectInfo.cleanSession = true;
+    connectInfo.keepAliveIntervalSec = MQTT_KEEP_ALIVE_INTERVAL_S;
+    connectInfo.pClientIdentifier = config.pThingName;
+    connectInfo.clientIdentifierLength = ( uint16_t ) strlen( config.pThingName );
+
+    fixedBuffer.pBuffer = pUpstream->sendBuffer;
+    fixedBuffer.size = sizeof( pUpstream->sendBuffer );
+
+    if( status != REACTOR_SUCCESS )
+    {
+        LogError( ( "Failed to connect to %s: status=%d.", config.pEndpoint, ( int ) status ) );
+        pUpstream->state = UPSTREAM_DISCONNECTED;
+        pUpstream->reconnectAtUs = nowUs() + ( ( uint64_t ) pUpstream->reconnectDelayMs * 1000U );
+        pUpstream->reconnectDelayMs = ( pUpstream->reconnectDelayMs < ( RECONNECT_DELAY_MAX_MS / 2U ) ) ?
+                                      ( pUpstream->reconnectDelayMs * 2U ) : RECONNECT_DELAY_MAX_MS;
+    }
+    else if( ( MQTT_GetConnectPacketSize( &connectInfo, NULL, &remainingLength, &packetSize ) == MQTTSuccess ) &&
+             ( packetSize <= fixedBuffer.size ) &&
+             ( MQTT_SerializeConnect( &connectInfo, NULL, remainingLength, &fixedBuffer ) == MQTTSuccess ) &&
+             sendAll( Openssl_Send, &pUpstream->networkContext, pUpstream->sendBuffer, packetSize ) )
+    {
+        pUpstream->state = UPSTREAM_CONNACK;
+        pUpstream->connected = true;
+        pUpstream->receivedLength = 0U;
+        pUpstream->lastSendUs = nowUs();
+    }
+    else
+    {
+        /* disconnectUpstream only closes a connection past CONNECTING. */
+        pUpstream->state = UPSTREAM_CONNACK;
+        disconnectUpstream();
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void disconnectUpstream( void )
+{
+    PendingBlock_t * pPending = NULL;
+
+    if( pUpstream->state >= UPSTREAM_CONNACK )
+    {
+        ( void ) Reactor_Remove( &reactor, &pUpstream->connection );
+        ( void ) Openssl_Disconnect( &pUpstream->networkContext );
+    }
+
+    pUpstream->state = UPSTREAM_DISCONNECTED;
+    pUpstream->connected = false;
+    pUpstream->receivedLength = 0U;
+    pUpstream->reconnectAtUs = nowUs() + ( ( uint64_t ) pUpstream->reconnectDelayMs * 1000U );
+    pUpstream->reconnectDelayMs = ( pUpstream->reconnectDelayMs < ( RECONNECT_DELAY_MAX_MS / 2U ) ) ?
+                                  ( pUpstream->reconnectDelayMs * 2U ) : RECONNECT_DELAY_MAX_MS;
+
+    /* The requests in flight are lost with the subscription; the blocks are
+     * asked for again once reconnected. */
+    for( pPending = pPendingHead; pPending != NULL; pPending = pPending->pNext )
+    {
+        pPending->requestedUs = 0U;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void connectUpstream( void )
+{
+    ReactorConnectInfo_t connectInfo = { 0 };
+    ReactorStatus_t status = REACTOR_SUCCESS;
+
+    ( void ) memset( &pUpstream->opensslParams, 0, sizeof( pUpstream->opensslParams ) );
+    pUpstream->opensslParams.pReadAheadBuffer = pUpstream->readAheadBuffer;
+    pUpstream->opensslParams.readAheadBufferSize = sizeof( pUpstream->readAheadBuffer );
+    pUpstream->networkContext.pParams = &pUpstream->opensslParams;
+
+    connectInfo.pServerInfo = &serverInfo;
+    connectInfo.pOpensslCredentials = &credentials;
+    connectInfo.connectTimeoutMs = config.responseTimeoutMs;
+    connectInfo.sendTimeoutMs = TRANSPORT_SEND_TIMEOUT_MS;
+    connectInfo.recvTimeoutMs = TRANSPORT_RECV_TIMEOUT_MS;
+    connectInfo.connectCallback = upstreamConnectCallback;
+    connectInfo.receiveCallback = upstreamReceiveCallback;
+    connectInfo.pUserContext = NULL;
+
+    pUpstream->state = UPSTREAM_CONNECTING;
+    status = Reactor_Connect( &reactor, &pUpstream->connection, &pUpstream->networkContext, &connectInfo );
+
+    /* Failures to start the connect are handled like failed connects. */
+    if( status != REACTOR_SUCCESS )
+    {
+        upstreamConnectCallback( &pUpstream->connection, status, NULL );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void retryPending( uint64_t timeUs )
+{
+    PendingBlock_t * pPending = NULL;
+    uint32_t blockIndex = 0U;
+
+    /* Each block is asked for on its own, as blocks time out one by one. */
+    for( pPending = pPendingHead; ( pPending != NULL ) && ( pUpstream->state == UPSTREAM_READY ); pPending = pPending->pNext )
+    {
+        if( ( pPending->requestedUs == 0U ) ||
+            ( ( timeUs - pPending->requestedUs ) >= ( ( uint64_t ) config.responseTimeoutMs * 1000U ) ) )
+        {
+            if( pPending->requestedUs != 0U )
+            {
+                stats.retries++;
+            }
+
+            pPending->requestedUs = timeUs;
+            blockIndex = pPending->key.blockIndex;
+            requestBlocks( &pPending->key, &blockIndex, 1U );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void printStats( void )
+{
+    OtaBlockCacheStats_t cacheStats;
+    uint32_t i, connected = 0U;
+
+    OtaBlockCache_GetStats( &cache, &cacheStats );
+
+    for( i = 0U; i < config.maxDevices; i++ )
+    {
+        connected += ( pDevices[ i ].inUse == true ) ? 1U : 0U;
+    }
+
+    LogInfo( ( "Devices: %u connected, %" PRIu64 " connects, %" PRIu64 " requests for %" PRIu64 " blocks.",
+               ( unsigned ) connected, stats.connects, stats.requests, stats.blocksRequested ) );
+    LogInfo( ( "Served %" PRIu64 " blocks, %" PRIu64 " bytes: %" PRIu64 " from the cache, %" PRIu64 " joined a fetch in flight.",
+               stats.blocksServed, stats.bytesServed, cacheStats.hits, stats.coalesced ) );
+    LogInfo( ( "Upstream: %" PRIu64 " connects, %" PRIu64 " requests, %" PRIu64 " blocks, %" PRIu64 " bytes, %" PRIu64 " retries, %" PRIu64 " rejections.",
+               stats.upstreamConnects, stats.upstreamRequests, stats.upstreamBlocks, stats.upstreamBytes,
+               stats.retries, stats.rejections ) );
+    LogInfo( ( "Cache: %zu blocks, %zu bytes, %" PRIu64 " evictions.",
+               cacheStats.blocks, cacheStats.bytes, cacheStats.evictions ) );
+}
+/*-----------------------------------------------------------*/
+
+static void onSignal( int signalNumber )
+{
+    ( void ) signalNumber;
+    stopRequested = 1;
+}
+/*-----------------------------------------------------------*/
+
+static int runProxy( void )
+{
+    uint64_t timeUs = nowUs(), lastScanUs = timeUs, lastStatsUs = timeUs;
+    uint64_t keepAliveUs = ( ( uint64_t ) MQTT_KEEP_ALIVE_INTERVAL_S * 1000000U ) / 2U;
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    size_t packetSize = 0U;
+    int result = 0;
+
+    connectUpstream();
+
+    while( ( result == 0 ) && ( stopRequested == 0 ) )
+    {
+        if( Reactor_Dispatch( &reactor, DISPATCH_TIMEOUT_MS ) != REACTOR_SUCCESS )
+        {
+            result = -1;
+        }
+
+        timeUs = nowUs();
+
+        if( ( pUpstream->state == UPSTREAM_DISCONNECTED ) && ( timeUs >= pUpstream->reconnectAtUs ) )
+        {
+            connectUpstream();
+        }
+
+        if( ( pUpstream->state == UPSTREAM_READY ) && ( ( timeUs - pUpstream->lastSendUs ) >= keepAliveUs ) )
+        {
+            fixedBuffer.pBuffer = pUpstream->sendBuffer;
+            fixedBuffer.size = sizeof( pUpstream->sendBuffer );
+
+            if( ( MQTT_GetPingreqPacketSize( &packetSize ) == MQTTSuccess ) &&
+                ( MQTT_SerializePingreq( &fixedBuffer ) == MQTTSuccess ) &&
+                sendAll( Openssl_Send, &pUpstream->networkContext, pUpstream->sendBuffer, packetSize ) )
+            {
+                pUpstream->lastSendUs = timeUs;
+            }
+            else
+            {
+                disconnectUpstream();
+            }
+        }
+
+        if( ( timeUs - lastScanUs ) >= PENDING_SCAN_INTERVAL_US )
+        {
+            retryPending( timeUs );
+            lastScanUs = timeUs;
+        }
+
+        if( ( config.statsIntervalS > 0U ) &&
+            ( ( timeUs - lastStatsUs ) >= ( ( uint64_t ) config.statsIntervalS * 1000000U ) ) )
+        {
+            printStats();
+            lastStatsUs = timeUs;
+        }
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static int parseArguments( int argc,
+                           char ** argv )
+{
+    int option = 0;
+    int result = 0;
+
+    config.port = DEFAULT_PORT;
+    config.listenPort = DEFAULT_LISTEN_PORT;
+    config.maxDevices = DEFAULT_MAX_DEVICES;
+    config.cacheMb = DEFAULT_CACHE_MB;
+    config.responseTimeoutMs = DEFAULT_RESPONSE_TIMEOUT_MS;
+    config.statsIntervalS = DEFAULT_STATS_INTERVAL_S;
+
+    while( ( option = getopt( argc, argv, "e:p:r:c:k:t:l:m:C:w:i:" ) ) != -1 )
+    {
+        switch( option )
+        {
+            case 'e':
+                config.pEndpoint = optarg;
+                break;
+
+            case 'p':
+                config.port = ( uint16_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'r':
+                config.pRootCaPath = optarg;
+                break;
+
+            case 'c':
+                config.pCertPath = optarg;
+                break;
+
+            case 'k':
+                config.pKeyPath = optarg;
+                break;
+
+            case 't':
+                config.pThingName = optarg;
+                break;
+
+            case 'l':
+                config.listenPort = ( uint16_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'm':
+                config.maxDevices = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'C':
+                config.cacheMb = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'w':
+                config.responseTimeoutMs = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            case 'i':
+                config.statsIntervalS = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                break;
+
+            default:
+                result = -1;
+                break;
+        }
+    }
+
+    if( ( config.pEndpoint == NULL ) || ( config.pRootCaPath == NULL ) ||
+        ( config.pCertPath == NULL ) || ( config.pKeyPath == NULL ) ||
+        ( config.pThingName == NULL ) || ( strlen( config.pThingName ) >= MAX_THING_NAME_LENGTH ) ||
+        ( config.maxDevices == 0U ) || ( config.cacheMb == 0U ) || ( config.responseTimeoutMs == 0U ) )
+    {
+        result = -1;
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t openListenSocket( void )
+{
+    struct sockaddr_in address = { 0 };
+    int32_t fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    int enable = 1;
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port = htons( config.listenPort );
+
+    if( ( fd >= 0 ) &&
+        ( ( setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof( enable ) ) != 0 ) ||
+          ( bind( fd, ( struct sockaddr * ) &address, sizeof( address ) ) != 0 ) ||
+          ( listen( fd, SOMAXCONN ) != 0 ) ) )
+    {
+        LogError( ( "Failed to listen on port %u.", ( unsigned ) config.listenPort ) );
+        ( void ) close( fd );
+        fd = -1;
+    }
+
+    return fd;
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    struct rlimit fileLimit;
+    struct sigaction action;
+    int length = 0;
+    uint32_t i;
+    int status = EXIT_FAILURE;
+
+    if( parseArguments( argc, argv ) != 0 )
+    {
+        fprintf( stderr,
+                 "Usage: %s -e <endpoint> -r <root CA> -c <cert> -k <key> -t <thing name>\n"
+                 "       [-p <port>] [-l <listen port>] [-m <max devices>] [-C <cache MB>]\n"
+                 "       [-w <response timeout ms>] [-i <stats interval s, 0 for on exit only>]\n",
+                 argv[ 0 ] );
+
+        return EXIT_FAILURE;
+    }
+
+    /* Every device connected holds a socket. */
+    if( ( getrlimit( RLIMIT_NOFILE, &fileLimit ) == 0 ) && ( fileLimit.rlim_cur < fileLimit.rlim_max ) )
+    {
+        fileLimit.rlim_cur = fileLimit.rlim_max;
+        ( void ) setrlimit( RLIMIT_NOFILE, &fileLimit );
+    }
+
+    /* A device that goes away while it is sent a block must not end the proxy. */
+    ( void ) signal( SIGPIPE, SIG_IGN );
+
+    ( void ) memset( &action, 0, sizeof( action ) );
+    action.sa_handler = onSignal;
+    ( void ) sigaction( SIGINT, &action, NULL );
+    ( void ) sigaction( SIGTERM, &action, NULL );
+
+    serverInfo.pHostName = config.pEndpoint;
+    serverInfo.hostNameLength = strlen( config.pEndpoint );
+    serverInfo.port = config.port;
+
+    credentials.pRootCaPath = config.pRootCaPath;
+    credentials.pClientCertPath = config.pCertPath;
+    credentials.pPrivateKeyPath = config.pKeyPath;
+    credentials.sniHostName = config.pEndpoint;
+
+    if( config.port == 443U )
+    {
+        credentials.pAlpnProtos = AWS_IOT_MQTT_ALPN;
+        credentials.alpnProtosLen = AWS_IOT_MQTT_ALPN_LENGTH;
+    }
+
+    length = snprintf( streamTopicPrefix, sizeof( streamTopicPrefix ), THINGS_PREFIX "%s" STREAMS_LEVEL, config.pThingName );
+    streamTopicPrefixLength = ( size_t ) length;
+    length = snprintf( dataTopicFilter, sizeof( dataTopicFilter ), "%s+" DATA_SUFFIX, streamTopicPrefix );
+    dataTopicFilterLength = ( uint16_t ) length;
+    length = snprintf( rejectedTopicFilter, sizeof( rejectedTopicFilter ), "%s+" REJECTED_SUFFIX, streamTopicPrefix );
+    rejectedTopicFilterLength = ( uint16_t ) length;
+
+    pDevices = calloc( config.maxDevices, sizeof( Device_t ) );
+    pUpstream = calloc( 1U, sizeof( Upstream_t ) );
+
+    if( ( pDevices != NULL ) && ( pUpstream != NULL ) &&
+        OtaBlockCache_Init( &cache, ( size_t ) config.cacheMb * 1024U * 1024U, 4096U ) )
+    {
+        pUpstream->reconnectDelayMs = RECONNECT_DELAY_MIN_MS;
+        listenSocket = openListenSocket();
+
+        if( ( listenSocket >= 0 ) &&
+            ( Reactor_Init( &reactor ) == REACTOR_SUCCESS ) )
+        {
+            if( Reactor_Add( &reactor, &listenConnection, listenSocket, NULL, acceptCallback, NULL ) == REACTOR_SUCCESS )
+            {
+                LogInfo( ( "Serving OTA streams on port %u.", ( unsigned ) config.listenPort ) );
+
+                if( runProxy() == 0 )
+                {
+                    status = EXIT_SUCCESS;
+                }
+
+                ( void ) Reactor_Remove( &reactor, &listenConnection );
+            }
+
+            printStats();
+
+            for( i = 0U; i < config.maxDevices; i++ )
+            {
+                if( pDevices[ i ].inUse == true )
+                {
+                    closeDevice( &pDevices[ i ] );
+                }
+            }
+
+            if( pUpstream->state == UPSTREAM_CONNECTING )
+            {
+                ( void ) Reactor_Remove( &reactor, &pUpstream->connection );
+            }
+            else
+            {
+                disconnectUpstream();
+            }
+
+            Reactor_Deinit( &reactor );
+        }
+
+        if( listenSocket >= 0 )
+        {
+            ( void ) close( listenSocket );
+        }
+    }
+
+    while( pPendingHead != NULL )
+    {
+        removePending( pPendingHead );
+    }
+
+    OtaBlockCache_Deinit( &cache );
+    free( pDevices );
+    free( pUpstream );
+
+    if( status != EXIT_SUCCESS )
+    {
+        fprintf( stderr, "OTA stream proxy failed.\n" );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
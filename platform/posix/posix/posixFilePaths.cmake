@@ -13,13 +13,32 @@ set( SOCKETS_SOURCES
 set( PLAINTEXT_TRANSPORT_SOURCES
      ${CMAKE_CURRENT_LIST_DIR}/transport/src/plaintext_posix.c )
 
+# Transport metrics source files, shared by the TLS transports.
+set( TRANSPORT_METRICS_SOURCES
+     ${CMAKE_CURRENT_LIST_DIR}/transport/src/transport_metrics.c )
+
 # OpenSSL transport source files.
 set( OPENSSL_TRANSPORT_SOURCES
-     ${CMAKE_CURRENT_LIST_DIR}/transport/src/openssl_posix.c )
+     ${CMAKE_CURRENT_LIST_DIR}/transport/src/openssl_posix.c
+     ${TRANSPORT_METRICS_SOURCES} )
+
+# Transport reactor source files, driving OpenSSL connections on epoll.
+set( TRANSPORT_REACTOR_SOURCES
+     ${CMAKE_CURRENT_LIST_DIR}/transport/src/transport_reactor_posix.c )
+
+# Replay transport source files, playing back a transport capture.
+set( TRANSPORT_REPLAY_SOURCES
+     ${CMAKE_CURRENT_LIST_DIR}/transport/src/transport_replay_posix.c )
+
+# Impairment transport source files, wrapping another transport in a bad
+# network.
+set( TRANSPORT_IMPAIR_SOURCES
+     ${CMAKE_CURRENT_LIST_DIR}/transport/src/transport_impair_posix.c )
 
 # MbedTLS transport source files.
 set( MBEDTLS_PKCS11_TRANSPORT_SOURCES
-     ${CMAKE_CURRENT_LIST_DIR}/transport/src/mbedtls_pkcs11_posix.c )
+     ${CMAKE_CURRENT_LIST_DIR}/transport/src/mbedtls_pkcs11_posix.c
+     ${TRANSPORT_METRICS_SOURCES} )
 
 # Transport Public Include directories.
 set( COMMON_TRANSPORT_INCLUDE_PUBLIC_DIRS
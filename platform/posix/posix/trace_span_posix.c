@@ -0,0 +1,69 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file trace_span_posix.c
+ * @brief The POSIX port of the trace spans, in trace_span.h.
+ *
+ * Spans are only recorded in the ring, to be written as JSON with
+ * #TraceSpan_ExportJson and opened in Perfetto.
+ */
+
+/* Enable the GNU extensions of sched.h, for sched_getcpu. */
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
+/* POSIX includes. */
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace_span.h"
+
+/*-----------------------------------------------------------*/
+
+uint32_t TraceSpan_PortBegin( const char * pName )
+{
+    ( void ) pName;
+
+    return 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+void TraceSpan_PortEnd( uint32_t portId )
+{
+    ( void ) portId;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t TraceSpan_PortThread( uint16_t * pCore )
+{
+    int core = sched_getcpu();
+
+    *pCore = ( core >= 0 ) ? ( uint16_t ) core : 0U;
+
+    /* The thread ID, which is what Perfetto shows for the process. */
+    return ( uint32_t ) syscall( SYS_gettid );
+}
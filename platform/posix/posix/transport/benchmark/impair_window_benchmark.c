@@ -0,0 +1,361 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file impair_window_benchmark.c
+ * @brief Measures how the number of blocks requested ahead speeds up a
+ * download over a bad network, as the OTA agent requests file blocks or
+ * coreMQTT keeps QoS 1 publishes in flight.
+ *
+ * A server thread on the loopback interface answers each 4-byte request with
+ * a block of 4 KB. The client keeps a window of requests outstanding through
+ * transport_impair_posix.c, wrapped around the plaintext transport with the
+ * profile of a scenario file, and downloads the same blocks with windows of
+ * 1, 2, 4 and 8. A reset connection is connected again, and the blocks it
+ * lost requested again. The seed of the scenario makes every run see the
+ * same network.
+ *
+ * Usage: impair_window_benchmark <scenario file> [block count]
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* Transport includes. */
+#include "plaintext_posix.h"
+#include "transport_impair_posix.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of blocks downloaded when no count is given on the command
+ * line.
+ */
+#define DEFAULT_BLOCK_COUNT     16U
+
+/**
+ * @brief Size of a block, that of an OTA block.
+ */
+#define BLOCK_SIZE              4096U
+
+/**
+ * @brief Size of a request, and of the index before each block.
+ */
+#define INDEX_SIZE              4U
+
+/**
+ * @brief Send and receive timeout of the client socket, and the longest a
+ * receive of the impairment transport waits.
+ */
+#define TRANSPORT_TIMEOUT_MS    1000U
+
+/**
+ * @brief The windows measured.
+ */
+static const uint32_t windows[] = { 1U, 2U, 4U, 8U };
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. This one
+ * holds the parameters of either transport, which both keep a pointer to
+ * their parameters only. */
+struct NetworkContext
+{
+    void * pParams;
+};
+
+/**
+ * @brief Outcome of downloading the blocks with one window.
+ */
+typedef struct WindowResult
+{
+    double elapsedMs;             /**< @brief Time to download every block. */
+    uint32_t connections;         /**< @brief Connections made, the first and those after a reset. */
+    TransportImpairStats_t stats; /**< @brief Counters of the impairments. */
+} WindowResult_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The client connection, and the impairments around it.
+ */
+static PlaintextParams_t plaintextParams;
+static NetworkContext_t plaintextContext = { &plaintextParams };
+static ImpairParams_t impairParams;
+static NetworkContext_t impairContext = { &impairParams };
+
+/*-----------------------------------------------------------*/
+
+static double nowMs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( double ) now.tv_sec * 1000.0 ) + ( ( double ) now.tv_nsec / 1000000.0 );
+}
+/*-----------------------------------------------------------*/
+
+static void * serverTask( void * pParameters )
+{
+    static uint8_t block[ INDEX_SIZE + BLOCK_SIZE ];
+    int listenSocket = *( int * ) pParameters;
+    int clientSocket = -1;
+    ssize_t result = 1;
+
+    ( void ) memset( block, 0x5A, sizeof( block ) );
+
+    /* A connection per reset, until the listening socket is shut down. */
+    while( ( clientSocket = accept( listenSocket, NULL, NULL ) ) >= 0 )
+    {
+        result = 1;
+
+        /* Answer each request with the block it names. MSG_NOSIGNAL turns
+         * the SIGPIPE of a send past the disconnect into an error. */
+        while( result > 0 )
+        {
+            result = recv( clientSocket, block, INDEX_SIZE, MSG_WAITALL );
+
+            if( result == ( ssize_t ) INDEX_SIZE )
+            {
+                result = send( clientSocket, block, sizeof( block ), MSG_NOSIGNAL );
+            }
+        }
+
+        ( void ) close( clientSocket );
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static int connectImpaired( uint16_t port,
+                            WindowResult_t * pResult )
+{
+    ServerInfo_t serverInfo = { 0 };
+    int status = -1;
+
+    serverInfo.pHostName = "127.0.0.1";
+    serverInfo.hostNameLength = strlen( serverInfo.pHostName );
+    serverInfo.port = port;
+
+    if( ( Plaintext_Connect( &plaintextContext, &serverInfo,
+                             TRANSPORT_TIMEOUT_MS, TRANSPORT_TIMEOUT_MS ) == SOCKETS_SUCCESS ) &&
+        ( TransportImpair_Start( &impairContext ) == TRANSPORT_IMPAIR_SUCCESS ) )
+    {
+        pResult->connections++;
+        status = 0;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t sendRequest( uint32_t index )
+{
+    uint8_t request[ INDEX_SIZE ];
+    size_t sent = 0U;
+    int32_t status = 0;
+
+    ( void ) memcpy( request, &index, sizeof( request ) );
+
+    /* The queue of the sends returns 0 while it is full. */
+    while( ( sent < sizeof( request ) ) && ( status >= 0 ) )
+    {
+        status = TransportImpair_Send( &impairContext, &request[ sent ], sizeof( request ) - sent );
+
+        if( status > 0 )
+        {
+            sent += ( size_t ) status;
+        }
+        else if( status == 0 )
+        {
+            status = TransportImpair_Pump( &impairContext );
+            ( void ) usleep( 1000U );
+        }
+    }
+
+    return ( status < 0 ) ? -1 : 0;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t recvBlock( uint8_t * pBlock )
+{
+    size_t received = 0U;
+    int32_t status = 0;
+
+    while( ( received < ( INDEX_SIZE + BLOCK_SIZE ) ) && ( status >= 0 ) )
+    {
+        status = TransportImpair_Recv( &impairContext, &pBlock[ received ],
+                                       ( INDEX_SIZE + BLOCK_SIZE ) - received );
+
+        if( status > 0 )
+        {
+            received += ( size_t ) status;
+        }
+    }
+
+    return ( status < 0 ) ? -1 : 0;
+}
+/*-----------------------------------------------------------*/
+
+static int runWindow( uint16_t port,
+                      const TransportImpairProfile_t * pProfile,
+                      uint32_t window,
+                      uint32_t blockCount,
+                      WindowResult_t * pResult )
+{
+    static uint8_t block[ INDEX_SIZE + BLOCK_SIZE ];
+    TransportInterface_t plaintext = { 0 };
+    uint32_t requested = 0U;
+    uint32_t received = 0U;
+    double startMs = 0.0;
+    int status = 0;
+
+    ( void ) memset( pResult, 0, sizeof( WindowResult_t ) );
+
+    plaintext.pNetworkContext = &plaintextContext;
+    plaintext.send = Plaintext_Send;
+    plaintext.recv = Plaintext_Recv;
+
+    /* Every window starts from the seed, so they all see the same network. */
+    ( void ) TransportImpair_Init( &impairParams, pProfile, &plaintext, TRANSPORT_TIMEOUT_MS );
+
+    startMs = nowMs();
+    status = connectImpaired( port, pResult );
+
+    while( ( status == 0 ) && ( received < blockCount ) )
+    {
+        while( ( status == 0 ) && ( requested < blockCount ) && ( ( requested - received ) < window ) )
+        {
+            status = sendRequest( requested );
+            requested += ( status == 0 ) ? 1U : 0U;
+        }
+
+        if( status == 0 )
+        {
+            status = recvBlock( block );
+            received += ( status == 0 ) ? 1U : 0U;
+        }
+
+        /* The blocks in flight are lost with the connection. */
+        if( ( status != 0 ) && ( impairParams.reset == true ) )
+        {
+            ( void ) Plaintext_Disconnect( &plaintextContext );
+            requested = received;
+            status = connectImpaired( port, pResult );
+        }
+    }
+
+    pResult->elapsedMs = nowMs() - startMs;
+    pResult->stats = impairParams.stats;
+    ( void ) Plaintext_Disconnect( &plaintextContext );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    TransportImpairProfile_t profile = { 0 };
+    WindowResult_t result = { 0 };
+    struct sockaddr_in address = { 0 };
+    socklen_t addressLength = sizeof( address );
+    pthread_t serverThread;
+    uint32_t blockCount = DEFAULT_BLOCK_COUNT;
+    int listenSocket = -1;
+    int status = EXIT_FAILURE;
+    size_t i;
+
+    if( argc < 2 )
+    {
+        fprintf( stderr, "Usage: %s <scenario file> [block count]\n", argv[ 0 ] );
+
+        return EXIT_FAILURE;
+    }
+
+    blockCount = ( argc > 2 ) ? ( uint32_t ) strtoul( argv[ 2 ], NULL, 10 ) : DEFAULT_BLOCK_COUNT;
+    listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    address.sin_port = 0;
+
+    if( ( TransportImpair_LoadScenario( &profile, argv[ 1 ] ) == TRANSPORT_IMPAIR_SUCCESS ) &&
+        ( blockCount > 0U ) &&
+        ( listenSocket >= 0 ) &&
+        ( bind( listenSocket, ( struct sockaddr * ) &address, sizeof( address ) ) == 0 ) &&
+        ( listen( listenSocket, 1 ) == 0 ) &&
+        ( getsockname( listenSocket, ( struct sockaddr * ) &address, &addressLength ) == 0 ) &&
+        ( pthread_create( &serverThread, NULL, serverTask, &listenSocket ) == 0 ) )
+    {
+        printf( "%-8s %8s %10s %8s %8s %12s\n",
+                "window", "blocks", "KB/s", "resets", "lost", "queued ms" );
+        status = EXIT_SUCCESS;
+
+        for( i = 0U; ( i < ( sizeof( windows ) / sizeof( windows[ 0 ] ) ) ) && ( status == EXIT_SUCCESS ); i++ )
+        {
+            if( runWindow( ntohs( address.sin_port ), &profile, windows[ i ], blockCount, &result ) != 0 )
+            {
+                status = EXIT_FAILURE;
+            }
+            else
+            {
+                printf( "%-8u %8u %10.1f %8u %8u %12.1f\n",
+                        windows[ i ],
+                        blockCount,
+                        ( ( double ) blockCount * ( BLOCK_SIZE / 1024.0 ) * 1000.0 ) / result.elapsedMs,
+                        result.stats.resets,
+                        result.stats.segmentsLost,
+                        ( result.stats.chunks > 0U ) ?
+                        ( ( double ) result.stats.queuedUs / 1000.0 ) / ( double ) result.stats.chunks : 0.0 );
+            }
+        }
+
+        /* Unblock the accept of the server thread. */
+        ( void ) shutdown( listenSocket, SHUT_RDWR );
+        ( void ) pthread_join( serverThread, NULL );
+    }
+
+    if( status != EXIT_SUCCESS )
+    {
+        fprintf( stderr, "Benchmark failed.\n" );
+    }
+
+    if( listenSocket >= 0 )
+    {
+        ( void ) close( listenSocket );
+    }
+
+    return status;
+}
@@ -0,0 +1,535 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file openssl_recv_benchmark.c
+ * @brief Measures the syscalls #Openssl_Recv issues per received MQTT packet,
+ * with and without the read-ahead buffer of #OpensslParams_t.
+ *
+ * A server thread on the loopback interface streams MQTT PUBLISH packets,
+ * one TLS record each, while the client reads them the way coreMQTT does:
+ * one byte for the packet type, one byte at a time for the remaining length,
+ * then the rest of the packet. `poll` calls are counted by linking with
+ * `-Wl,--wrap=poll`, and socket reads through a callback on the read BIO of
+ * the client. Polls that find the socket empty are reported separately, as
+ * they depend on how far the reader is ahead of the server rather than on
+ * the packets themselves.
+ *
+ * Usage: openssl_recv_benchmark [packet count]
+ */
+
+/* Standard includes. */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* OpenSSL includes. */
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "openssl_posix.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Host name of the benchmark server; also the subject of its
+ * certificate.
+ */
+#define BENCHMARK_HOST_NAME           "localhost"
+
+/**
+ * @brief Number of packets streamed when no count is given on the command line.
+ */
+#define DEFAULT_PACKET_COUNT          20000U
+
+/**
+ * @brief Topic of the streamed PUBLISH packets.
+ */
+#define BENCHMARK_TOPIC               "benchmark/telemetry"
+
+/**
+ * @brief Payload length of the streamed PUBLISH packets.
+ */
+#define BENCHMARK_PAYLOAD_LENGTH      64U
+
+/**
+ * @brief Size of the read-ahead buffer for the second run.
+ */
+#define READ_AHEAD_BUFFER_SIZE        4096U
+
+/**
+ * @brief Send and receive timeout of the client socket.
+ */
+#define TRANSPORT_TIMEOUT_MS          5000U
+
+/**
+ * @brief Size of the buffer holding one received packet.
+ */
+#define PACKET_BUFFER_SIZE            256U
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    OpensslParams_t * pParams;
+};
+
+/**
+ * @brief State shared with the server thread.
+ */
+typedef struct BenchmarkServer
+{
+    SSL_CTX * pSslContext;  /**< @brief Server context holding the generated certificate. */
+    int listenSocket;       /**< @brief Listening socket on the loopback interface. */
+    uint16_t port;          /**< @brief Port of #listenSocket in host-order. */
+    uint32_t packetCount;   /**< @brief Number of packets to stream per connection. */
+} BenchmarkServer_t;
+
+/**
+ * @brief Counters of one benchmark run.
+ */
+typedef struct BenchmarkResult
+{
+    uint64_t polls;       /**< @brief poll calls issued by the transport which found data. */
+    uint64_t idlePolls;   /**< @brief poll calls issued while the socket was still empty. */
+    uint64_t socketReads; /**< @brief read calls issued by OpenSSL on the socket. */
+    uint64_t recvCalls;   /**< @brief Calls to #Openssl_Recv. */
+    uint32_t packets;     /**< @brief Packets fully received. */
+    double elapsedMs;     /**< @brief Wall-clock duration of the receive loop. */
+} BenchmarkResult_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of poll calls which found data since the last reset.
+ */
+static uint64_t pollCount = 0U;
+
+/**
+ * @brief Number of poll calls which found no data since the last reset.
+ */
+static uint64_t idlePollCount = 0U;
+
+/**
+ * @brief Number of socket reads on the client since the last reset.
+ */
+static uint64_t socketReadCount = 0U;
+
+/* The real poll, reached through the linker's --wrap option. */
+int __real_poll( struct pollfd * fds,
+                 nfds_t nfds,
+                 int timeout );
+
+/* Counting wrapper installed with -Wl,--wrap=poll. */
+int __wrap_poll( struct pollfd * fds,
+                 nfds_t nfds,
+                 int timeout );
+
+/*-----------------------------------------------------------*/
+
+int __wrap_poll( struct pollfd * fds,
+                 nfds_t nfds,
+                 int timeout )
+{
+    int status = __real_poll( fds, nfds, timeout );
+
+    /* A poll that finds no data only means the reader is ahead of the
+     * server; it is counted apart from the per-packet cost. */
+    if( status == 0 )
+    {
+        idlePollCount++;
+    }
+    else
+    {
+        pollCount++;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static long countSocketReads( BIO * pBio,
+                              int oper,
+                              const char * pArgp,
+                              size_t len,
+                              int argi,
+                              long argl,
+                              int ret,
+                              size_t * pProcessed )
+{
+    ( void ) pBio;
+    ( void ) pArgp;
+    ( void ) len;
+    ( void ) argi;
+    ( void ) argl;
+    ( void ) pProcessed;
+
+    /* Every BIO_read on a socket BIO is one read(2) call. */
+    if( oper == ( BIO_CB_READ | BIO_CB_RETURN ) )
+    {
+        socketReadCount++;
+    }
+
+    return ( long ) ret;
+}
+/*-----------------------------------------------------------*/
+
+static double nowMs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( double ) now.tv_sec * 1000.0 ) + ( ( double ) now.tv_nsec / 1000000.0 );
+}
+/*-----------------------------------------------------------*/
+
+static size_t buildPublishPacket( uint8_t * pPacket )
+{
+    size_t topicLength = strlen( BENCHMARK_TOPIC );
+    size_t remainingLength = 2U + topicLength + BENCHMARK_PAYLOAD_LENGTH;
+    size_t index = 0U;
+
+    /* QoS 0 PUBLISH with a one-byte remaining length. */
+    pPacket[ index++ ] = 0x30U;
+    pPacket[ index++ ] = ( uint8_t ) remainingLength;
+    pPacket[ index++ ] = ( uint8_t ) ( topicLength >> 8 );
+    pPacket[ index++ ] = ( uint8_t ) topicLength;
+    ( void ) memcpy( &pPacket[ index ], BENCHMARK_TOPIC, topicLength );
+    index += topicLength;
+    ( void ) memset( &pPacket[ index ], 0xA5, BENCHMARK_PAYLOAD_LENGTH );
+    index += BENCHMARK_PAYLOAD_LENGTH;
+
+    return index;
+}
+/*-----------------------------------------------------------*/
+
+static int createCredentials( SSL_CTX * pServerContext,
+                              const char * pRootCaPath )
+{
+    EVP_PKEY_CTX * pKeyContext = NULL;
+    EVP_PKEY * pKey = NULL;
+    X509 * pCertificate = NULL;
+    X509_EXTENSION * pExtension = NULL;
+    FILE * pRootCaFile = NULL;
+    int status = 0;
+
+    /* Generate a P-256 key. */
+    pKeyContext = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, NULL );
+
+    if( ( pKeyContext != NULL ) &&
+        ( EVP_PKEY_keygen_init( pKeyContext ) == 1 ) &&
+        ( EVP_PKEY_CTX_set_ec_paramgen_curve_nid( pKeyContext, NID_X9_62_prime256v1 ) == 1 ) &&
+        ( EVP_PKEY_keygen( pKeyContext, &pKey ) == 1 ) )
+    {
+        pCertificate = X509_new();
+    }
+
+    /* Self-sign a certificate for the benchmark host. The client trusts it
+     * directly as its root CA. */
+    if( pCertificate != NULL )
+    {
+        ( void ) ASN1_INTEGER_set( X509_get_serialNumber( pCertificate ), 1 );
+        ( void ) X509_gmtime_adj( X509_getm_notBefore( pCertificate ), -60L );
+        ( void ) X509_gmtime_adj( X509_getm_notAfter( pCertificate ), 3600L );
+        ( void ) X509_set_pubkey( pCertificate, pKey );
+        ( void ) X509_NAME_add_entry_by_txt( X509_get_subject_name( pCertificate ),
+                                             "CN", MBSTRING_ASC,
+                                             ( const unsigned char * ) BENCHMARK_HOST_NAME,
+                                             -1, -1, 0 );
+        ( void ) X509_set_issuer_name( pCertificate, X509_get_subject_name( pCertificate ) );
+        pExtension = X509V3_EXT_conf_nid( NULL, NULL, NID_subject_alt_name,
+                                          "DNS:" BENCHMARK_HOST_NAME );
+
+        if( ( pExtension != NULL ) &&
+            ( X509_add_ext( pCertificate, pExtension, -1 ) == 1 ) &&
+            ( X509_sign( pCertificate, pKey, EVP_sha256() ) > 0 ) &&
+            ( SSL_CTX_use_certificate( pServerContext, pCertificate ) == 1 ) &&
+            ( SSL_CTX_use_PrivateKey( pServerContext, pKey ) == 1 ) )
+        {
+            pRootCaFile = fopen( pRootCaPath, "w" );
+        }
+    }
+
+    if( pRootCaFile != NULL )
+    {
+        status = PEM_write_X509( pRootCaFile, pCertificate );
+        ( void ) fclose( pRootCaFile );
+    }
+
+    X509_EXTENSION_free( pExtension );
+    X509_free( pCertificate );
+    EVP_PKEY_free( pKey );
+    EVP_PKEY_CTX_free( pKeyContext );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static void * serverTask( void * pArgument )
+{
+    BenchmarkServer_t * pServer = ( BenchmarkServer_t * ) pArgument;
+    uint8_t packet[ PACKET_BUFFER_SIZE ];
+    size_t packetLength = buildPublishPacket( packet );
+    SSL * pSsl = NULL;
+    int clientSocket = -1;
+    uint32_t i;
+
+    clientSocket = accept( pServer->listenSocket, NULL, NULL );
+
+    if( clientSocket >= 0 )
+    {
+        pSsl = SSL_new( pServer->pSslContext );
+    }
+
+    if( ( pSsl != NULL ) &&
+        ( SSL_set_fd( pSsl, clientSocket ) == 1 ) &&
+        ( SSL_accept( pSsl ) == 1 ) )
+    {
+        /* Like a broker, write every packet as its own record. */
+        for( i = 0U; i < pServer->packetCount; i++ )
+        {
+            if( SSL_write( pSsl, packet, ( int ) packetLength ) <= 0 )
+            {
+                break;
+            }
+        }
+
+        ( void ) SSL_shutdown( pSsl );
+    }
+
+    SSL_free( pSsl );
+
+    if( clientSocket >= 0 )
+    {
+        ( void ) close( clientSocket );
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t recvExact( NetworkContext_t * pNetworkContext,
+                          uint8_t * pBuffer,
+                          size_t bytesToRecv,
+                          BenchmarkResult_t * pResult )
+{
+    size_t bytesReceived = 0U;
+    int32_t status = 0;
+
+    while( ( bytesReceived < bytesToRecv ) && ( status >= 0 ) )
+    {
+        status = Openssl_Recv( pNetworkContext,
+                               &pBuffer[ bytesReceived ],
+                               bytesToRecv - bytesReceived );
+        pResult->recvCalls++;
+
+        if( status > 0 )
+        {
+            bytesReceived += ( size_t ) status;
+        }
+    }
+
+    return ( status < 0 ) ? -1 : ( int32_t ) bytesReceived;
+}
+/*-----------------------------------------------------------*/
+
+static int runBenchmark( BenchmarkServer_t * pServer,
+                         const char * pRootCaPath,
+                         uint8_t * pReadAheadBuffer,
+                         size_t readAheadBufferSize,
+                         BenchmarkResult_t * pResult )
+{
+    NetworkContext_t networkContext = { 0 };
+    OpensslParams_t opensslParams = { 0 };
+    OpensslCredentials_t opensslCredentials = { 0 };
+    ServerInfo_t serverInfo = { 0 };
+    pthread_t serverThread;
+    uint8_t packet[ PACKET_BUFFER_SIZE ];
+    size_t remainingLength = 0U, multiplier = 1U;
+    double startMs = 0.0;
+    int32_t status = 0;
+    int result = -1;
+
+    ( void ) memset( pResult, 0, sizeof( BenchmarkResult_t ) );
+
+    if( pthread_create( &serverThread, NULL, serverTask, pServer ) != 0 )
+    {
+        return -1;
+    }
+
+    serverInfo.pHostName = BENCHMARK_HOST_NAME;
+    serverInfo.hostNameLength = strlen( BENCHMARK_HOST_NAME );
+    serverInfo.port = pServer->port;
+    opensslCredentials.pRootCaPath = pRootCaPath;
+    opensslParams.pReadAheadBuffer = pReadAheadBuffer;
+    opensslParams.readAheadBufferSize = readAheadBufferSize;
+    networkContext.pParams = &opensslParams;
+
+    if( Openssl_Connect( &networkContext, &serverInfo, &opensslCredentials,
+                         TRANSPORT_TIMEOUT_MS, TRANSPORT_TIMEOUT_MS ) == OPENSSL_SUCCESS )
+    {
+        BIO_set_callback_ex( SSL_get_rbio( opensslParams.pSsl ), countSocketReads );
+        pollCount = 0U;
+        idlePollCount = 0U;
+        socketReadCount = 0U;
+        startMs = nowMs();
+
+        while( pResult->packets < pServer->packetCount )
+        {
+            /* Packet type, then a variable-length remaining length. */
+            status = recvExact( &networkContext, packet, 1U, pResult );
+
+            remainingLength = 0U;
+            multiplier = 1U;
+
+            do
+            {
+                if( status > 0 )
+                {
+                    status = recvExact( &networkContext, &packet[ 1 ], 1U, pResult );
+                    remainingLength += ( size_t ) ( packet[ 1 ] & 0x7FU ) * multiplier;
+                    multiplier *= 128U;
+                }
+            } while( ( status > 0 ) && ( ( packet[ 1 ] & 0x80U ) != 0U ) );
+
+            if( ( status > 0 ) && ( remainingLength <= sizeof( packet ) ) )
+            {
+                status = recvExact( &networkContext, packet, remainingLength, pResult );
+            }
+
+            if( status <= 0 )
+            {
+                break;
+            }
+
+            pResult->packets++;
+        }
+
+        pResult->elapsedMs = nowMs() - startMs;
+        pResult->polls = pollCount;
+        pResult->idlePolls = idlePollCount;
+        pResult->socketReads = socketReadCount;
+        result = ( pResult->packets == pServer->packetCount ) ? 0 : -1;
+
+        ( void ) Openssl_Disconnect( &networkContext );
+    }
+
+    ( void ) pthread_join( serverThread, NULL );
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static void printResult( const char * pLabel,
+                         const BenchmarkResult_t * pResult )
+{
+    double packets = ( pResult->packets > 0U ) ? ( double ) pResult->packets : 1.0;
+
+    printf( "%-12s %8u %10.3f %10.3f %10.3f %10.3f %10" PRIu64 " %10.1f\n",
+            pLabel,
+            pResult->packets,
+            ( double ) pResult->polls / packets,
+            ( double ) pResult->socketReads / packets,
+            ( double ) ( pResult->polls + pResult->socketReads ) / packets,
+            ( double ) pResult->recvCalls / packets,
+            pResult->idlePolls,
+            pResult->elapsedMs );
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    BenchmarkServer_t server = { 0 };
+    BenchmarkResult_t baseline, readAhead;
+    struct sockaddr_in address = { 0 };
+    socklen_t addressLength = sizeof( address );
+    static uint8_t readAheadBuffer[ READ_AHEAD_BUFFER_SIZE ];
+    char rootCaPath[] = "/tmp/openssl_recv_benchmark_XXXXXX";
+    int rootCaFd = -1;
+    int status = EXIT_FAILURE;
+
+    server.packetCount = ( argc > 1 ) ? ( uint32_t ) strtoul( argv[ 1 ], NULL, 10 ) : DEFAULT_PACKET_COUNT;
+    server.pSslContext = SSL_CTX_new( TLS_server_method() );
+    server.listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+    rootCaFd = mkstemp( rootCaPath );
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    address.sin_port = 0;
+
+    if( ( server.pSslContext != NULL ) &&
+        ( rootCaFd >= 0 ) &&
+        ( createCredentials( server.pSslContext, rootCaPath ) == 1 ) &&
+        ( server.listenSocket >= 0 ) &&
+        ( bind( server.listenSocket, ( struct sockaddr * ) &address, sizeof( address ) ) == 0 ) &&
+        ( listen( server.listenSocket, 1 ) == 0 ) &&
+        ( getsockname( server.listenSocket, ( struct sockaddr * ) &address, &addressLength ) == 0 ) )
+    {
+        server.port = ntohs( address.sin_port );
+
+        if( ( runBenchmark( &server, rootCaPath, NULL, 0U, &baseline ) == 0 ) &&
+            ( runBenchmark( &server, rootCaPath, readAheadBuffer, sizeof( readAheadBuffer ), &readAhead ) == 0 ) )
+        {
+            printf( "%-12s %8s %10s %10s %10s %10s %10s %10s\n",
+                    "mode", "packets", "poll/pkt", "read/pkt", "sys/pkt", "recv/pkt", "idle-poll", "ms" );
+            printResult( "baseline", &baseline );
+            printResult( "read-ahead", &readAhead );
+            status = EXIT_SUCCESS;
+        }
+    }
+
+    if( status != EXIT_SUCCESS )
+    {
+        fprintf( stderr, "Benchmark failed.\n" );
+    }
+
+    if( rootCaFd >= 0 )
+    {
+        ( void ) close( rootCaFd );
+        ( void ) unlink( rootCaPath );
+    }
+
+    if( server.listenSocket >= 0 )
+    {
+        ( void ) close( server.listenSocket );
+    }
+
+    SSL_CTX_free( server.pSslContext );
+
+    return status;
+}
+/*-----------------------------------------------------------*/
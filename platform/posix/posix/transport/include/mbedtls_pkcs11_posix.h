@@ -78,6 +78,9 @@
 /* PKCS #11 includes. */
 #include "core_pkcs11.h"
 
+/* Transport metrics include. */
+#include "transport_metrics.h"
+
 /**
  * @brief Debug logging level to use for MbedTLS.
  *
@@ -111,6 +114,8 @@ typedef struct MbedtlsPkcs11Context
     CK_SESSION_HANDLE p11Session;          /**< @brief PKCS #11 session. */
     CK_OBJECT_HANDLE p11PrivateKey;        /**< @brief PKCS #11 handle for the private key to use for client authentication. */
     CK_KEY_TYPE keyType;                   /**< @brief PKCS #11 key type corresponding to #p11PrivateKey. */
+
+    TransportMetrics_t * pMetrics; /**< @brief Optional metrics storage; instrumentation is off while NULL. */
 } MbedtlsPkcs11Context_t;
 
 /**
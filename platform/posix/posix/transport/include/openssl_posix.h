@@ -55,6 +55,10 @@
 #endif
 /* *INDENT-ON* */
 
+/* Standard includes. */
+#include <stdbool.h>
+#include <sys/types.h>
+
 /* OpenSSL include. */
 #include <openssl/ssl.h>
 
@@ -64,6 +68,46 @@
 /* Socket include. */
 #include "sockets_posix.h"
 
+/* Transport metrics include. */
+#include "transport_metrics.h"
+
+/**
+ * @brief Storage of a connection that may send TLS 1.3 early data, see
+ * #OpensslCredentials_t.allowEarlyData.
+ */
+typedef struct OpensslEarlyData
+{
+    /**
+     * @brief Copy of the bytes sent as early data, which are sent again as
+     * normal data if the server rejects them. Its size also bounds the early
+     * data of a connection.
+     *
+     * @note The buffer must stay valid while the connection is open.
+     */
+    uint8_t * pBuffer;
+    size_t bufferSize; /**< @brief Size of #pBuffer in bytes. */
+    size_t length;     /**< @brief Number of bytes sent as early data. */
+
+    /**
+     * @brief Optional QoS 0 PUBLISH packet, serialized by the application,
+     * sent as early data right after the MQTT CONNECT packet. Packets may
+     * follow CONNECT without waiting for CONNACK.
+     *
+     * @note Set to NULL once sent. If it is still set after MQTT_Connect
+     * returns, early data was not used and the application publishes the
+     * message normally.
+     */
+    const uint8_t * pFirstPublish;
+    size_t firstPublishLength; /**< @brief Length of #pFirstPublish in bytes. */
+
+    /* State of the connection, managed by the transport. */
+    bool handshakePending;     /**< @brief The handshake is completed by the first receive or by a packet not sent early. */
+    uint8_t packetType;        /**< @brief First byte of the MQTT packet being sent as early data. */
+    size_t packetRemaining;    /**< @brief Bytes of that packet not sent yet. */
+    size_t maxLength;          /**< @brief Early data allowed by both the session and #bufferSize. */
+    uint64_t handshakeStartUs; /**< @brief Start of the connect, for #TransportMetrics_RecordHandshake. */
+} OpensslEarlyData_t;
+
 /**
  * @brief Parameters for the transport-interface
  * implementation that uses OpenSSL and POSIX sockets.
@@ -75,6 +119,27 @@ typedef struct OpensslParams
 {
     int32_t socketDescriptor;
     SSL * pSsl;
+    TransportMetrics_t * pMetrics; /**< @brief Optional metrics storage; instrumentation is off while NULL. */
+
+    /**
+     * @brief Optional buffer that #Openssl_Recv fills from the TLS session in
+     * large chunks, so that small reads such as the fixed header of an MQTT
+     * packet are served without a poll or SSL_read call. Set to NULL to
+     * disable read-ahead.
+     *
+     * @note The buffer must stay valid while the connection is open.
+     * Reads of at least #readAheadBufferSize bytes bypass it.
+     */
+    uint8_t * pReadAheadBuffer;
+    size_t readAheadBufferSize; /**< @brief Size of #pReadAheadBuffer in bytes. */
+    size_t readAheadOffset;     /**< @brief Offset of the first unconsumed byte in #pReadAheadBuffer. */
+    size_t readAheadLength;     /**< @brief Number of unconsumed bytes in #pReadAheadBuffer. */
+
+    /**
+     * @brief Storage for early data; required by
+     * #OpensslCredentials_t.allowEarlyData and unused otherwise.
+     */
+    OpensslEarlyData_t * pEarlyData;
 } OpensslParams_t;
 
 /**
@@ -89,7 +154,9 @@ typedef enum OpensslStatus
     OPENSSL_HANDSHAKE_FAILED,    /**< Performing TLS handshake with server failed. */
     OPENSSL_API_ERROR,           /**< A call to a system API resulted in an internal error. */
     OPENSSL_DNS_FAILURE,         /**< Resolving hostname of the server failed. */
-    OPENSSL_CONNECT_FAILURE      /**< Initial connection to the server failed. */
+    OPENSSL_CONNECT_FAILURE,     /**< Initial connection to the server failed. */
+    OPENSSL_HANDSHAKE_WANT_READ, /**< Non-blocking handshake waits for the socket to become readable. */
+    OPENSSL_HANDSHAKE_WANT_WRITE /**< Non-blocking handshake waits for the socket to become writable. */
 } OpensslStatus_t;
 
 /**
@@ -138,6 +205,59 @@ typedef struct OpensslCredentials
     const char * pRootCaPath;     /**< @brief Filepath string to the trusted server root CA. */
     const char * pClientCertPath; /**< @brief Filepath string to the client certificate. */
     const char * pPrivateKeyPath; /**< @brief Filepath string to the client certificate's private key. */
+
+    /**
+     * @brief Share one SSL_CTX between connections that use the same
+     * credential paths and server, instead of reloading the credentials
+     * from disk on every connect.
+     *
+     * Shared contexts also keep the last TLS session of the server so later
+     * connections can resume it with an abbreviated handshake.
+     *
+     * @note The credential files are only read by the first connection.
+     * Call #Openssl_ClearContextCache after replacing them.
+     */
+    bool reuseSslContext;
+
+    /**
+     * @brief Send the first MQTT packets of a resumed TLS 1.3 session as
+     * early data (0-RTT), so that CONNECT reaches the broker one round trip
+     * sooner.
+     *
+     * #Openssl_Connect then returns once the ClientHello can be sent, and the
+     * handshake completes on the first #Openssl_Recv. Early data is only used
+     * when #reuseSslContext holds a session whose server allows it; other
+     * connections perform a full handshake as usual.
+     *
+     * Early data is not protected against replay: an attacker can send it to
+     * the server again, and the server may act on every copy. Therefore only
+     * MQTT CONNECT and QoS 0 PUBLISH packets are sent early, and only while
+     * they fit in #OpensslEarlyData_t.pBuffer. Any other packet first
+     * completes the handshake. A replayed CONNECT can make the broker close
+     * the live connection of the same client, and a replayed PUBLISH is
+     * delivered again, so only set this flag when duplicate messages on the
+     * early topics are harmless.
+     *
+     * @note Requires #reuseSslContext and #OpensslParams_t.pEarlyData.
+     * #Openssl_HandshakeStart ignores this flag.
+     */
+    bool allowEarlyData;
+
+    /**
+     * @brief Let OpenSSL move the record layer into the kernel (kTLS) after
+     * the handshake, so that #Openssl_RecvToFile can splice decrypted data
+     * from the socket into a file without copying it through user space.
+     *
+     * The kernel decides which ciphers and directions it offloads; the
+     * connection works the same either way. Offload is never enabled with
+     * #maxFragmentLength. #OpensslParams_t.pReadAheadBuffer no longer turns
+     * on the read-ahead of OpenSSL while this is set, since OpenSSL can't
+     * hand records it already read to the kernel.
+     *
+     * @note Requires OpenSSL 3.0 or later built with kTLS, and the tls
+     * kernel module.
+     */
+    bool enableKernelTls;
 } OpensslCredentials_t;
 
 /**
@@ -161,6 +281,41 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * pNetworkContext,
                                  uint32_t sendTimeoutMs,
                                  uint32_t recvTimeoutMs );
 
+/**
+ * @brief Prepares a TLS session on a TCP socket that is already connected,
+ * without performing the handshake.
+ *
+ * This is the first step of a non-blocking connect: the caller sets
+ * #OpensslParams_t.socketDescriptor, then calls #Openssl_HandshakeContinue
+ * each time the socket is ready until it stops returning
+ * #OPENSSL_HANDSHAKE_WANT_READ or #OPENSSL_HANDSHAKE_WANT_WRITE.
+ *
+ * @param[in] pNetworkContext Network context whose parameters hold the socket.
+ * @param[in] pServerInfo Server connection info, used for hostname verification.
+ * @param[in] pOpensslCredentials Credentials for the TLS connection.
+ *
+ * @return #OPENSSL_SUCCESS on success;
+ * #OPENSSL_INVALID_PARAMETER, #OPENSSL_INVALID_CREDENTIALS, #OPENSSL_API_ERROR on failure.
+ */
+OpensslStatus_t Openssl_HandshakeStart( NetworkContext_t * pNetworkContext,
+                                        const ServerInfo_t * pServerInfo,
+                                        const OpensslCredentials_t * pOpensslCredentials );
+
+/**
+ * @brief Advances a handshake started with #Openssl_HandshakeStart.
+ *
+ * @param[in] pNetworkContext Network context passed to #Openssl_HandshakeStart.
+ *
+ * @note After a failure the caller must still close the connection with
+ * #Openssl_Disconnect.
+ *
+ * @return #OPENSSL_SUCCESS once the handshake and peer verification have
+ * completed; #OPENSSL_HANDSHAKE_WANT_READ or #OPENSSL_HANDSHAKE_WANT_WRITE
+ * while the socket is not ready; #OPENSSL_INVALID_PARAMETER or
+ * #OPENSSL_HANDSHAKE_FAILED on failure.
+ */
+OpensslStatus_t Openssl_HandshakeContinue( NetworkContext_t * pNetworkContext );
+
 /**
  * @brief Closes a TLS session on top of a TCP connection using the OpenSSL API.
  *
@@ -171,6 +326,15 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * pNetworkContext,
  */
 OpensslStatus_t Openssl_Disconnect( const NetworkContext_t * pNetworkContext );
 
+/**
+ * @brief Releases every SSL_CTX shared through
+ * #OpensslCredentials_t.reuseSslContext.
+ *
+ * Established connections keep their context alive until they are closed.
+ * The next connect reloads the credentials from disk.
+ */
+void Openssl_ClearContextCache( void );
+
 /**
  * @brief Receives data over an established TLS session using the OpenSSL API.
  *
@@ -188,6 +352,30 @@ int32_t Openssl_Recv( NetworkContext_t * pNetworkContext,
                       void * pBuffer,
                       size_t bytesToRecv );
 
+/**
+ * @brief Receives data over an established TLS session straight into a file,
+ * for bulk downloads such as OTA images.
+ *
+ * With #OpensslCredentials_t.enableKernelTls and a kernel that took over
+ * decryption, the data is spliced from the socket into the file through a
+ * pipe. Otherwise, and for data OpenSSL already decrypted, each chunk of
+ * #OPENSSL_RECV_TO_FILE_CHUNK_SIZE bytes goes through one buffer on the stack.
+ *
+ * @param[in] pNetworkContext The network context created using Openssl_Connect API.
+ * @param[in] fileDescriptor File to write to, for example the OTA image
+ * opened by otaPal_CreateFileForRx. Its offset is not changed.
+ * @param[in] offset Offset in the file of the first byte received.
+ * @param[in] bytesToRecv Number of bytes requested from the network.
+ *
+ * @return Number of bytes written to the file, which may be less than
+ * @p bytesToRecv if the receive timeout expires; zero if no data arrived;
+ * negative value on failure.
+ */
+int32_t Openssl_RecvToFile( NetworkContext_t * pNetworkContext,
+                            int32_t fileDescriptor,
+                            off_t offset,
+                            size_t bytesToRecv );
+
 /**
  * @brief Sends data over an established TLS session using the OpenSSL API.
  *
@@ -107,6 +107,55 @@ SocketStatus_t Sockets_Connect( int32_t * pTcpSocket,
  */
 SocketStatus_t Sockets_Disconnect( int32_t tcpSocket );
 
+/**
+ * @brief Set the send and receive timeouts of a connected socket.
+ *
+ * @param[in] tcpSocket The socket descriptor.
+ * @param[in] sendTimeoutMs Timeout for transport send.
+ * @param[in] recvTimeoutMs Timeout for transport recv.
+ *
+ * @note A timeout of 0 means infinite timeout.
+ *
+ * @return #SOCKETS_SUCCESS if successful;
+ * #SOCKETS_API_ERROR, #SOCKETS_INSUFFICIENT_MEMORY, #SOCKETS_INVALID_PARAMETER on error.
+ */
+SocketStatus_t Sockets_SetTimeouts( int32_t tcpSocket,
+                                    uint32_t sendTimeoutMs,
+                                    uint32_t recvTimeoutMs );
+
+/**
+ * @brief Cache the addresses resolved by #Sockets_Connect.
+ *
+ * Connects to a cached host name skip the DNS lookup until the entry is
+ * @p ttlMs old, or until a connect fails on every cached address. The cache
+ * is shared by all connections of the process.
+ *
+ * @note getaddrinfo does not report the TTL of the DNS records, so the
+ * same lifetime applies to every host name.
+ *
+ * @param[in] ttlMs Lifetime of a cached result. 0, the default, disables the
+ * cache and clears it.
+ */
+void Sockets_SetDnsCacheTtl( uint32_t ttlMs );
+
+/**
+ * @brief Drop every cached DNS result, for example after a server failover.
+ */
+void Sockets_ClearDnsCache( void );
+
+/**
+ * @brief Race connects to the resolved addresses, as described in RFC 8305.
+ *
+ * When enabled, #Sockets_Connect alternates between the address families,
+ * starting with the preferred one, and starts the next attempt alongside the previous ones if they have not
+ * completed within @p attemptDelayMs, or as soon as one fails. The first
+ * address to accept the connection is used.
+ *
+ * @param[in] attemptDelayMs Delay between attempts; RFC 8305 recommends
+ * 250 ms. 0, the default, tries the addresses one after the other.
+ */
+void Sockets_SetConnectAttemptDelay( uint32_t attemptDelayMs );
+
 /* *INDENT-OFF* */
 #ifdef __cplusplus
     }
@@ -0,0 +1,280 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRANSPORT_IMPAIR_POSIX_H_
+#define TRANSPORT_IMPAIR_POSIX_H_
+
+/**
+ * @file transport_impair_posix.h
+ *
+ * @brief A transport interface wrapped around another, such as the plaintext
+ * or the OpenSSL transport, that makes the network look like a bad one: it
+ * adds latency and jitter, caps the bandwidth of each direction, delays the
+ * segments it drops as TCP would retransmit them, and resets the connection
+ * now and then. coreMQTT or coreHTTP run over it unchanged, so that the
+ * backoff, keep-alive and windowing logic can be measured under the same bad
+ * network, run after run.
+ *
+ * The bytes of each direction go through a queue, each chunk due once it has
+ * crossed the link: after the chunks before it at the bandwidth of the
+ * direction, plus the latency, a random jitter and the retransmissions of
+ * its lost segments. Chunks are never reordered, so a late one holds up the
+ * ones behind it, as on a TCP connection. Sends are taken into the queue,
+ * and return 0 once it is full, as a socket with a full buffer does; the
+ * chunks due are passed to the wrapped transport by every call, and by
+ * #TransportImpair_Pump for a caller with nothing to send or receive. A
+ * receive returns the bytes due, and waits up to its wait time for the next
+ * chunk.
+ *
+ * The randomness comes from the seed of the profile, so a scenario behaves
+ * the same in every run that makes the same calls. Profiles are read from
+ * scenario files of `key = value` lines, such as those in `scenarios/`.
+ */
+
+/**************************************************/
+/******* DO NOT CHANGE the following order ********/
+/**************************************************/
+
+/* Logging related header files are required to be included in the following order:
+ * 1. Include the header file "logging_levels.h".
+ * 2. Define LIBRARY_LOG_NAME and  LIBRARY_LOG_LEVEL.
+ * 3. Include the header file "logging_stack.h".
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the impairment transport. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Transport_Impair"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_ERROR
+#endif
+
+#include "logging_stack.h"
+
+/************ End of logging configuration ****************/
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Transport includes. */
+#include "transport_interface.h"
+
+/**
+ * @brief The bytes each direction holds while they cross the link, as the
+ * socket buffers of a connection would.
+ */
+#ifndef TRANSPORT_IMPAIR_QUEUE_SIZE
+    #define TRANSPORT_IMPAIR_QUEUE_SIZE    ( 64U * 1024U )
+#endif
+
+/**
+ * @brief The chunks each direction holds.
+ */
+#ifndef TRANSPORT_IMPAIR_MAX_CHUNKS
+    #define TRANSPORT_IMPAIR_MAX_CHUNKS    256U
+#endif
+
+/**
+ * @brief The size of the segments lost one by one.
+ */
+#define TRANSPORT_IMPAIR_SEGMENT_SIZE      1460U
+
+/**
+ * @brief Return status of the impairment transport functions.
+ */
+typedef enum TransportImpairStatus
+{
+    TRANSPORT_IMPAIR_SUCCESS = 0,       /**< Function successfully completed. */
+    TRANSPORT_IMPAIR_INVALID_PARAMETER, /**< At least one parameter was invalid. */
+    TRANSPORT_IMPAIR_FILE_ERROR,        /**< The scenario could not be read. */
+    TRANSPORT_IMPAIR_INVALID_SCENARIO   /**< The scenario has a line that isn't a known key and a value. */
+} TransportImpairStatus_t;
+
+/**
+ * @brief How bad the network is. Zero values leave out that impairment.
+ */
+typedef struct TransportImpairProfile
+{
+    uint32_t latencyMs;       /**< @brief One-way delay of each direction. */
+    uint32_t jitterMs;        /**< @brief Most random delay added to the latency. */
+    uint32_t upKbps;          /**< @brief Bandwidth of the sends, in kilobits per second. */
+    uint32_t downKbps;        /**< @brief Bandwidth of the receives. */
+    double lossPercent;       /**< @brief Chance of losing each segment, in percent. */
+    uint32_t retransmitMs;    /**< @brief Delay of a lost segment, doubled each time it is lost again. */
+    uint32_t resetIntervalS;  /**< @brief Mean time between connection resets. */
+    uint64_t seed;            /**< @brief Seed of the random impairments. */
+} TransportImpairProfile_t;
+
+/**
+ * @brief Counters of the impairments, reset by #TransportImpair_Init.
+ */
+typedef struct TransportImpairStats
+{
+    uint64_t bytesSent;      /**< @brief Bytes passed to the wrapped transport. */
+    uint64_t bytesReceived;  /**< @brief Bytes returned by the receives. */
+    uint32_t segmentsLost;   /**< @brief Segments lost, counting each retransmission lost. */
+    uint32_t resets;         /**< @brief Connections reset. */
+    uint64_t queuedUs;       /**< @brief Total time the chunks spent in the queues. */
+    uint32_t chunks;         /**< @brief Chunks that crossed the link. */
+} TransportImpairStats_t;
+
+/**
+ * @brief A chunk of bytes crossing the link.
+ */
+typedef struct TransportImpairChunk
+{
+    uint64_t queuedUs; /**< @brief When it was queued. */
+    uint64_t dueUs;    /**< @brief When it has crossed the link. */
+    size_t length;     /**< @brief Its bytes not yet passed on. */
+} TransportImpairChunk_t;
+
+/**
+ * @brief The queue of one direction.
+ */
+typedef struct TransportImpairQueue
+{
+    uint8_t buffer[ TRANSPORT_IMPAIR_QUEUE_SIZE ];
+    size_t head;   /**< @brief Offset of the first byte queued. */
+    size_t length; /**< @brief Bytes queued. */
+    TransportImpairChunk_t chunks[ TRANSPORT_IMPAIR_MAX_CHUNKS ];
+    size_t firstChunk;
+    size_t chunkCount;
+    uint32_t kbps;       /**< @brief Bandwidth of the direction. */
+    uint64_t linkFreeUs; /**< @brief When the link is done with the chunks queued. */
+    uint64_t lastDueUs;  /**< @brief When the last chunk queued is due. */
+} TransportImpairQueue_t;
+
+/**
+ * @brief Parameters of the impairment transport, pointed to by its network
+ * context. Large, for the queues: keep it out of small stacks.
+ */
+typedef struct ImpairParams
+{
+    TransportInterface_t inner;       /**< @brief The wrapped transport, with its network context. */
+    TransportImpairProfile_t profile; /**< @brief The impairments. */
+    uint32_t recvWaitMs;              /**< @brief The longest a receive waits for a chunk. */
+    uint64_t random;                  /**< @brief State of the random numbers. */
+    uint64_t resetAtUs;               /**< @brief When the connection is reset; 0 for never. */
+    bool reset;                       /**< @brief The connection was reset. */
+    TransportImpairQueue_t up;        /**< @brief The sends. */
+    TransportImpairQueue_t down;      /**< @brief The receives. */
+    TransportImpairStats_t stats;
+} ImpairParams_t;
+
+/**
+ * @brief Read a profile from a scenario file: lines of `key = value`, with
+ * `#` starting a comment. The keys are latency_ms, jitter_ms, up_kbps,
+ * down_kbps, loss_percent, retransmit_ms, reset_interval_s and seed; the
+ * keys left out are 0.
+ *
+ * @param[out] pProfile The profile to fill.
+ * @param[in] pPath The scenario file.
+ *
+ * @return #TRANSPORT_IMPAIR_SUCCESS, #TRANSPORT_IMPAIR_INVALID_PARAMETER,
+ * #TRANSPORT_IMPAIR_FILE_ERROR or #TRANSPORT_IMPAIR_INVALID_SCENARIO.
+ */
+TransportImpairStatus_t TransportImpair_LoadScenario( TransportImpairProfile_t * pProfile,
+                                                      const char * pPath );
+
+/**
+ * @brief Set up the impairments of a transport and reset their counters.
+ *
+ * @param[out] pParams The parameters to set up.
+ * @param[in] pProfile The impairments, copied.
+ * @param[in] pInner The wrapped transport, copied; its network context must
+ * outlive the parameters.
+ * @param[in] recvWaitMs The longest a receive waits for a chunk to be due.
+ *
+ * @return #TRANSPORT_IMPAIR_SUCCESS or #TRANSPORT_IMPAIR_INVALID_PARAMETER.
+ */
+TransportImpairStatus_t TransportImpair_Init( ImpairParams_t * pParams,
+                                              const TransportImpairProfile_t * pProfile,
+                                              const TransportInterface_t * pInner,
+                                              uint32_t recvWaitMs );
+
+/**
+ * @brief Start impairing a connection, once the wrapped transport is
+ * connected: empties the queues and draws the time of the next reset.
+ *
+ * @param[in] pNetworkContext The network context pointing to the parameters.
+ *
+ * @return #TRANSPORT_IMPAIR_SUCCESS or #TRANSPORT_IMPAIR_INVALID_PARAMETER.
+ */
+TransportImpairStatus_t TransportImpair_Start( NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Pass the sends that crossed the link to the wrapped transport.
+ *
+ * @param[in] pNetworkContext The network context.
+ *
+ * @return The bytes queued to send, or -1 if the connection failed or was
+ * reset.
+ */
+int32_t TransportImpair_Pump( NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Receives the bytes that crossed the link.
+ *
+ * @param[in] pNetworkContext The network context.
+ * @param[out] pBuffer Buffer to receive bytes into.
+ * @param[in] bytesToRecv Number of bytes to receive.
+ *
+ * @return Number of bytes received; 0 if none is due within the wait time, or
+ * for a receive of one byte, none is due now; -1 if the connection failed or
+ * was reset.
+ */
+int32_t TransportImpair_Recv( NetworkContext_t * pNetworkContext,
+                              void * pBuffer,
+                              size_t bytesToRecv );
+
+/**
+ * @brief Queues bytes to cross the link.
+ *
+ * @param[in] pNetworkContext The network context.
+ * @param[in] pBuffer Buffer containing the bytes to send.
+ * @param[in] bytesToSend Number of bytes to send.
+ *
+ * @return Number of bytes queued, 0 if the queue is full, or -1 if the
+ * connection failed or was reset.
+ */
+int32_t TransportImpair_Send( NetworkContext_t * pNetworkContext,
+                              const void * pBuffer,
+                              size_t bytesToSend );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef TRANSPORT_IMPAIR_POSIX_H_ */
@@ -0,0 +1,182 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRANSPORT_METRICS_H_
+#define TRANSPORT_METRICS_H_
+
+/**
+ * @file transport_metrics.h
+ *
+ * @brief Optional per-connection instrumentation shared by the POSIX TLS
+ * transport implementations.
+ *
+ * A transport records into a #TransportMetrics_t only when the application
+ * has attached one to its parameters; every function here is a no-op when
+ * passed NULL, so call sites need no checks of their own.
+ */
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Number of buckets in a #TransportHistogram_t.
+ *
+ * Bucket upper bounds are 100us, 1ms, 10ms, 100ms and 1s; the last bucket
+ * holds everything slower.
+ */
+#define TRANSPORT_METRICS_HISTOGRAM_BUCKETS    6
+
+/**
+ * @brief Fixed-bucket duration histogram.
+ */
+typedef struct TransportHistogram
+{
+    uint32_t buckets[ TRANSPORT_METRICS_HISTOGRAM_BUCKETS ]; /**< @brief Sample count per bucket. */
+    uint64_t totalUs;                                        /**< @brief Sum of all recorded durations. */
+    uint32_t maxUs;                                          /**< @brief Longest recorded duration. */
+} TransportHistogram_t;
+
+/**
+ * @brief Counters and latency histograms for one connection.
+ */
+typedef struct TransportMetrics
+{
+    uint64_t bytesSent;             /**< @brief Application bytes written. */
+    uint64_t bytesReceived;         /**< @brief Application bytes read. */
+    uint32_t sendCalls;             /**< @brief Calls to the transport send function. */
+    uint32_t recvCalls;             /**< @brief Calls to the transport receive function. */
+    uint32_t sendWantCount;         /**< @brief Sends that would have blocked. */
+    uint32_t recvWantCount;         /**< @brief Receives that would have blocked. */
+    uint32_t sendErrors;            /**< @brief Sends that failed. */
+    uint32_t recvErrors;            /**< @brief Receives that failed. */
+    uint32_t handshakeFailures;     /**< @brief Connects that failed. */
+    TransportHistogram_t sendLatency; /**< @brief Duration of send calls. */
+    TransportHistogram_t recvLatency; /**< @brief Duration of receive calls. */
+    TransportHistogram_t handshake;   /**< @brief Duration of successful connects. */
+} TransportMetrics_t;
+
+/**
+ * @brief Outcome of a single send or receive, for #TransportMetrics_RecordSend
+ * and #TransportMetrics_RecordRecv.
+ */
+typedef enum TransportMetricsResult
+{
+    TRANSPORT_METRICS_OK = 0,     /**< Data was transferred. */
+    TRANSPORT_METRICS_WOULD_BLOCK, /**< Nothing was transferred, the call can be retried. */
+    TRANSPORT_METRICS_ERROR       /**< The call failed. */
+} TransportMetricsResult_t;
+
+/**
+ * @brief Classify a transport interface return value.
+ *
+ * @param[in] transportStatus Value returned by a transport send or receive
+ * function: bytes transferred, zero to retry, or negative on failure.
+ *
+ * @return The matching #TransportMetricsResult_t.
+ */
+TransportMetricsResult_t TransportMetrics_ResultOf( int32_t transportStatus );
+
+/**
+ * @brief Start timing an operation.
+ *
+ * @param[in] pMetrics Metrics to record into, or NULL.
+ *
+ * @return The current monotonic time in microseconds, or 0 if @p pMetrics is NULL.
+ */
+uint64_t TransportMetrics_Start( const TransportMetrics_t * pMetrics );
+
+/**
+ * @brief Add one duration to a histogram.
+ *
+ * @param[in] pHistogram Histogram to update.
+ * @param[in] durationUs Duration in microseconds.
+ */
+void TransportMetrics_RecordDuration( TransportHistogram_t * pHistogram,
+                                      uint64_t durationUs );
+
+/**
+ * @brief Record the outcome of a send call.
+ *
+ * @param[in] pMetrics Metrics to record into, or NULL.
+ * @param[in] result Outcome of the call.
+ * @param[in] bytes Bytes transferred when @p result is #TRANSPORT_METRICS_OK.
+ * @param[in] startUs Value returned by #TransportMetrics_Start.
+ */
+void TransportMetrics_RecordSend( TransportMetrics_t * pMetrics,
+                                  TransportMetricsResult_t result,
+                                  size_t bytes,
+                                  uint64_t startUs );
+
+/**
+ * @brief Record the outcome of a receive call.
+ *
+ * @param[in] pMetrics Metrics to record into, or NULL.
+ * @param[in] result Outcome of the call.
+ * @param[in] bytes Bytes transferred when @p result is #TRANSPORT_METRICS_OK.
+ * @param[in] startUs Value returned by #TransportMetrics_Start.
+ */
+void TransportMetrics_RecordRecv( TransportMetrics_t * pMetrics,
+                                  TransportMetricsResult_t result,
+                                  size_t bytes,
+                                  uint64_t startUs );
+
+/**
+ * @brief Record the outcome of a connect, from TCP connect to the end of the
+ * TLS handshake.
+ *
+ * @param[in] pMetrics Metrics to record into, or NULL.
+ * @param[in] success Whether the connection was established.
+ * @param[in] startUs Value returned by #TransportMetrics_Start.
+ */
+void TransportMetrics_RecordHandshake( TransportMetrics_t * pMetrics,
+                                       bool success,
+                                       uint64_t startUs );
+
+/**
+ * @brief Zero all counters and histograms.
+ *
+ * @param[in] pMetrics Metrics to reset, or NULL.
+ */
+void TransportMetrics_Reset( TransportMetrics_t * pMetrics );
+
+/**
+ * @brief Log all counters and histograms at info level.
+ *
+ * @param[in] pMetrics Metrics to log, or NULL.
+ */
+void TransportMetrics_Log( const TransportMetrics_t * pMetrics );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef TRANSPORT_METRICS_H_ */
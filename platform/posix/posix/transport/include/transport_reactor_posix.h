@@ -0,0 +1,305 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRANSPORT_REACTOR_POSIX_H_
+#define TRANSPORT_REACTOR_POSIX_H_
+
+/**
+ * @file transport_reactor_posix.h
+ * @brief Single-threaded epoll reactor driving many transport connections.
+ *
+ * The reactor performs the TCP connect and the TLS handshake of its
+ * connections without blocking, then reports each connection that has data
+ * to read through a callback. The callback typically runs the coreMQTT
+ * process loop of the connection with a zero timeout:
+ *
+ * @code{c}
+ * static void onReceive( ReactorConnection_t * pConnection,
+ *                        void * pUserContext )
+ * {
+ *     ( void ) MQTT_ProcessLoop( ( MQTTContext_t * ) pUserContext, 0U );
+ * }
+ * @endcode
+ *
+ * Established connections use the regular blocking transport functions,
+ * for example #Openssl_Send and #Openssl_Recv.
+ */
+
+/**************************************************/
+/******* DO NOT CHANGE the following order ********/
+/**************************************************/
+
+/* Logging related header files are required to be included in the following order:
+ * 1. Include the header file "logging_levels.h".
+ * 2. Define LIBRARY_LOG_NAME and  LIBRARY_LOG_LEVEL.
+ * 3. Include the header file "logging_stack.h".
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the transport reactor. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Transport_Reactor"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_ERROR
+#endif
+
+#include "logging_stack.h"
+
+/************ End of logging configuration ****************/
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/* POSIX includes. */
+#include <netdb.h>
+
+/* Transport includes. */
+#include "openssl_posix.h"
+
+/**
+ * @brief Maximum number of epoll events handled by one call to
+ * #Reactor_Dispatch.
+ */
+#ifndef REACTOR_MAX_EVENTS
+    #define REACTOR_MAX_EVENTS    64
+#endif
+
+/**
+ * @brief Return status of the reactor functions and connect callbacks.
+ */
+typedef enum ReactorStatus
+{
+    REACTOR_SUCCESS = 0,       /**< Function successfully completed. */
+    REACTOR_INVALID_PARAMETER, /**< At least one parameter was invalid. */
+    REACTOR_API_ERROR,         /**< A call to a system API resulted in an internal error. */
+    REACTOR_DNS_FAILURE,       /**< Resolving hostname of the server failed. */
+    REACTOR_CONNECT_FAILURE,   /**< No resolved address of the server accepted the connection. */
+    REACTOR_HANDSHAKE_FAILED,  /**< Setting up or performing the TLS handshake failed. */
+    REACTOR_TIMEOUT            /**< The connect did not complete within its timeout. */
+} ReactorStatus_t;
+
+/**
+ * @brief Lifecycle of a #ReactorConnection_t.
+ */
+typedef enum ReactorState
+{
+    REACTOR_STATE_IDLE = 0,    /**< Not registered with a reactor. */
+    REACTOR_STATE_CONNECTING,  /**< Waiting for the TCP connect to complete. */
+    REACTOR_STATE_HANDSHAKING, /**< Waiting for the socket during the TLS handshake. */
+    REACTOR_STATE_READY        /**< Registered for receive notifications. */
+} ReactorState_t;
+
+/* Forward declaration for the callbacks. */
+struct ReactorConnection;
+
+/**
+ * @brief Called once a connect started with #Reactor_Connect has finished.
+ *
+ * @param[in] pConnection The connection.
+ * @param[in] status #REACTOR_SUCCESS if the connection is ready; otherwise the
+ * reason of the failure. A failed connection has already been closed.
+ * @param[in] pUserContext #ReactorConnectInfo_t.pUserContext.
+ */
+typedef void ( * ReactorConnectCallback_t )( struct ReactorConnection * pConnection,
+                                             ReactorStatus_t status,
+                                             void * pUserContext );
+
+/**
+ * @brief Called when a ready connection has data to read or was closed by
+ * the peer, in which case the next receive returns an error.
+ *
+ * @param[in] pConnection The connection.
+ * @param[in] pUserContext User context of the connection.
+ */
+typedef void ( * ReactorReceiveCallback_t )( struct ReactorConnection * pConnection,
+                                             void * pUserContext );
+
+/**
+ * @brief Parameters of #Reactor_Connect.
+ *
+ * @note The server info and credentials must stay valid until the connect
+ * callback has been called.
+ */
+typedef struct ReactorConnectInfo
+{
+    const ServerInfo_t * pServerInfo;                 /**< @brief Server to connect to. */
+    const OpensslCredentials_t * pOpensslCredentials; /**< @brief Credentials for the TLS session. */
+    uint32_t connectTimeoutMs;                        /**< @brief Limit for the TCP connect and TLS handshake; 0 waits forever. */
+    uint32_t sendTimeoutMs;                           /**< @brief Send timeout of the established connection. */
+    uint32_t recvTimeoutMs;                           /**< @brief Receive timeout of the established connection. */
+    ReactorConnectCallback_t connectCallback;         /**< @brief Called when the connect has finished. */
+    ReactorReceiveCallback_t receiveCallback;         /**< @brief Called when data is ready to be read. */
+    void * pUserContext;                              /**< @brief Passed to both callbacks. */
+} ReactorConnectInfo_t;
+
+/**
+ * @brief A connection driven by a reactor.
+ *
+ * @note The application owns the memory of each connection. It must stay
+ * valid and must not be modified while the connection is registered with a
+ * reactor, including until #Reactor_Dispatch returns when the connection is
+ * removed from one of its callbacks.
+ */
+typedef struct ReactorConnection
+{
+    ReactorState_t state;                     /**< @brief Current state of the connection. */
+    int32_t socketDescriptor;                 /**< @brief Socket watched by the reactor. */
+    OpensslParams_t * pOpensslParams;         /**< @brief TLS parameters whose buffered data is also dispatched; NULL for plaintext. */
+    NetworkContext_t * pNetworkContext;       /**< @brief OpenSSL network context being connected, or NULL. */
+    ReactorConnectInfo_t connectInfo;         /**< @brief Copy of the parameters of #Reactor_Connect. */
+    struct addrinfo * pAddresses;             /**< @brief Resolved server addresses while connecting. */
+    struct addrinfo * pNextAddress;           /**< @brief Address to try if the current attempt fails. */
+    uint64_t deadlineMs;                      /**< @brief Monotonic time at which the connect fails; 0 for none. */
+    struct ReactorConnection * pNextPending;  /**< @brief Next connection in the pending-connect list. */
+} ReactorConnection_t;
+
+/**
+ * @brief An epoll instance with the connections registered to it.
+ */
+typedef struct Reactor
+{
+    int32_t epollDescriptor;               /**< @brief The epoll instance. */
+    int32_t wakeDescriptor;                /**< @brief eventfd used by #Reactor_Wakeup. */
+    ReactorConnection_t * pPendingHead;    /**< @brief Connections whose connect has not finished. */
+} Reactor_t;
+
+/**
+ * @brief Create the epoll instance of a reactor.
+ *
+ * @param[out] pReactor Reactor to initialize.
+ *
+ * @return #REACTOR_SUCCESS on success; #REACTOR_INVALID_PARAMETER or
+ * #REACTOR_API_ERROR on failure.
+ */
+ReactorStatus_t Reactor_Init( Reactor_t * pReactor );
+
+/**
+ * @brief Release the epoll instance of a reactor.
+ *
+ * @note Connections are not closed; remove them first.
+ *
+ * @param[in] pReactor Reactor to release.
+ */
+void Reactor_Deinit( Reactor_t * pReactor );
+
+/**
+ * @brief Start a non-blocking TCP connect and TLS handshake.
+ *
+ * @p pNetworkContext must point to #OpensslParams_t as for #Openssl_Connect.
+ * Resolved addresses are tried in order. The connect callback is called from
+ * #Reactor_Dispatch once the handshake has completed or failed. On success
+ * the socket is switched back to blocking mode with the send and receive
+ * timeouts of @p pConnectInfo, and the connection is registered for receive
+ * notifications.
+ *
+ * @note Name resolution is performed synchronously.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection Connection memory owned by the application.
+ * @param[in] pNetworkContext OpenSSL network context to connect.
+ * @param[in] pConnectInfo Connect parameters, copied into @p pConnection.
+ *
+ * @return #REACTOR_SUCCESS if the connect is in progress; otherwise it failed
+ * before starting and no callback is called.
+ */
+ReactorStatus_t Reactor_Connect( Reactor_t * pReactor,
+                                 ReactorConnection_t * pConnection,
+                                 NetworkContext_t * pNetworkContext,
+                                 const ReactorConnectInfo_t * pConnectInfo );
+
+/**
+ * @brief Register an established connection for receive notifications.
+ *
+ * Works for any transport built on a socket, for example a plaintext
+ * connection or one made with #Openssl_Connect.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection Connection memory owned by the application.
+ * @param[in] socketDescriptor Socket of the connection.
+ * @param[in] pOpensslParams OpenSSL parameters of the connection, or NULL
+ * for plaintext. Data buffered by the TLS session is dispatched as well.
+ * @param[in] receiveCallback Called when data is ready to be read.
+ * @param[in] pUserContext Passed to @p receiveCallback.
+ *
+ * @return #REACTOR_SUCCESS on success; #REACTOR_INVALID_PARAMETER or
+ * #REACTOR_API_ERROR on failure.
+ */
+ReactorStatus_t Reactor_Add( Reactor_t * pReactor,
+                             ReactorConnection_t * pConnection,
+                             int32_t socketDescriptor,
+                             OpensslParams_t * pOpensslParams,
+                             ReactorReceiveCallback_t receiveCallback,
+                             void * pUserContext );
+
+/**
+ * @brief Stop watching a connection.
+ *
+ * A connect in progress is abandoned without calling its callback and its
+ * socket is closed. An established connection is left open; close it with
+ * the disconnect function of its transport.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection to remove.
+ *
+ * @return #REACTOR_SUCCESS on success; #REACTOR_INVALID_PARAMETER on failure.
+ */
+ReactorStatus_t Reactor_Remove( Reactor_t * pReactor,
+                                ReactorConnection_t * pConnection );
+
+/**
+ * @brief Wait for events and run the callbacks of the ready connections.
+ *
+ * Connections that time out while connecting are failed with
+ * #REACTOR_TIMEOUT.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] timeoutMs Maximum time to wait for an event; 0 returns at once.
+ *
+ * @return #REACTOR_SUCCESS on success; #REACTOR_INVALID_PARAMETER or
+ * #REACTOR_API_ERROR on failure.
+ */
+ReactorStatus_t Reactor_Dispatch( Reactor_t * pReactor,
+                                  uint32_t timeoutMs );
+
+/**
+ * @brief Interrupt a #Reactor_Dispatch that is waiting in another thread.
+ *
+ * @param[in] pReactor The reactor.
+ *
+ * @return #REACTOR_SUCCESS on success; #REACTOR_INVALID_PARAMETER or
+ * #REACTOR_API_ERROR on failure.
+ */
+ReactorStatus_t Reactor_Wakeup( Reactor_t * pReactor );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef TRANSPORT_REACTOR_POSIX_H_ */
@@ -0,0 +1,211 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRANSPORT_REPLAY_POSIX_H_
+#define TRANSPORT_REPLAY_POSIX_H_
+
+/**
+ * @file transport_replay_posix.h
+ *
+ * @brief A transport interface that plays back a capture of
+ * transport_capture.h, so that a session recorded on a device runs through
+ * the same MQTT, parsing and OTA code on POSIX, as often as needed.
+ *
+ * The receives of a connection are served the bytes the device received, in
+ * order, and each record only once its time, counted from
+ * #TransportReplay_Connect and divided by the speed, has come; a receive
+ * before it waits for up to the receive timeout and returns 0, as a socket
+ * would. A speed of 0 serves every record at once, which makes a capture a
+ * benchmark of the code it is replayed into. The errors the device received
+ * are returned at the same point, and the end of the records of a connection
+ * fails the next receive, as a closed connection does.
+ *
+ * Sends are taken whole. When the capture holds the data sent, they are
+ * compared with it, and the sends that differ, such as a CONNECT with a new
+ * client identifier, are counted in #TransportReplayStats_t.
+ */
+
+/**************************************************/
+/******* DO NOT CHANGE the following order ********/
+/**************************************************/
+
+/* Logging related header files are required to be included in the following order:
+ * 1. Include the header file "logging_levels.h".
+ * 2. Define LIBRARY_LOG_NAME and  LIBRARY_LOG_LEVEL.
+ * 3. Include the header file "logging_stack.h".
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the replay transport. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Transport_Replay"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_ERROR
+#endif
+
+#include "logging_stack.h"
+
+/************ End of logging configuration ****************/
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Transport includes. */
+#include "transport_interface.h"
+
+/**
+ * @brief Return status of the replay transport functions.
+ */
+typedef enum TransportReplayStatus
+{
+    TRANSPORT_REPLAY_SUCCESS = 0,       /**< Function successfully completed. */
+    TRANSPORT_REPLAY_INVALID_PARAMETER, /**< At least one parameter was invalid. */
+    TRANSPORT_REPLAY_FILE_ERROR,        /**< The capture could not be read. */
+    TRANSPORT_REPLAY_INVALID_CAPTURE,   /**< The file is not a capture of a known version. */
+    TRANSPORT_REPLAY_NO_CONNECTION      /**< The capture holds no more connections. */
+} TransportReplayStatus_t;
+
+/**
+ * @brief Counters of a replay, reset by #TransportReplay_Rewind.
+ */
+typedef struct TransportReplayStats
+{
+    uint32_t connections;    /**< @brief Connections started. */
+    uint32_t recvCalls;      /**< @brief Receives that returned data. */
+    uint64_t bytesReceived;  /**< @brief Bytes returned by the receives. */
+    uint32_t sendCalls;      /**< @brief Sends. */
+    uint64_t bytesSent;      /**< @brief Bytes sent. */
+    uint32_t sendMismatches; /**< @brief Sends that differed from the capture, or went past its sends. */
+} TransportReplayStats_t;
+
+/**
+ * @brief Parameters of the replay transport, pointed to by the network
+ * context.
+ */
+typedef struct ReplayParams
+{
+    uint8_t * pCapture;          /**< @brief The capture, read into memory. */
+    size_t captureLength;        /**< @brief The length of #pCapture. */
+    bool sendData;               /**< @brief The capture holds the data sent. */
+    uint32_t speed;              /**< @brief Times faster than the device; 0 to not wait. */
+    uint32_t recvTimeoutMs;      /**< @brief The longest a receive waits for a record. */
+    size_t connectionStart;      /**< @brief Offset of the first record after the next connect. */
+    size_t recvOffset;           /**< @brief Offset of the next record for the receives. */
+    size_t recvConsumed;         /**< @brief Bytes of the data of that record already received. */
+    uint64_t recvTimeUs;         /**< @brief Capture time of that record, from the connect. */
+    size_t sendOffset;           /**< @brief Offset of the next record for the sends. */
+    size_t sendConsumed;         /**< @brief Bytes of that record already sent. */
+    uint64_t startUs;            /**< @brief Monotonic time of the connect. */
+    TransportReplayStats_t stats;
+} ReplayParams_t;
+
+/**
+ * @brief Read a capture into memory and position the replay before its
+ * first connection.
+ *
+ * @param[out] pParams The parameters to set up.
+ * @param[in] pPath The capture file.
+ * @param[in] speed Times faster than the device to play the records; 0 to
+ * play them as fast as they are received.
+ * @param[in] recvTimeoutMs The longest a receive waits for a record.
+ *
+ * @return #TRANSPORT_REPLAY_SUCCESS, #TRANSPORT_REPLAY_INVALID_PARAMETER,
+ * #TRANSPORT_REPLAY_FILE_ERROR or #TRANSPORT_REPLAY_INVALID_CAPTURE.
+ */
+TransportReplayStatus_t TransportReplay_Open( ReplayParams_t * pParams,
+                                              const char * pPath,
+                                              uint32_t speed,
+                                              uint32_t recvTimeoutMs );
+
+/**
+ * @brief Start replaying the next connection of the capture, in place of
+ * connecting the transport. A capture with no connection mark is one
+ * connection.
+ *
+ * @param[in] pNetworkContext The network context pointing to the parameters.
+ *
+ * @return #TRANSPORT_REPLAY_SUCCESS, #TRANSPORT_REPLAY_INVALID_PARAMETER or
+ * #TRANSPORT_REPLAY_NO_CONNECTION.
+ */
+TransportReplayStatus_t TransportReplay_Connect( NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Position the replay before the first connection again and reset its
+ * counters.
+ *
+ * @param[in] pParams The parameters of the replay.
+ */
+void TransportReplay_Rewind( ReplayParams_t * pParams );
+
+/**
+ * @brief Release the capture read by #TransportReplay_Open.
+ *
+ * @param[in] pParams The parameters of the replay.
+ */
+void TransportReplay_Close( ReplayParams_t * pParams );
+
+/**
+ * @brief Receives the data the device received, at the time it did.
+ *
+ * @param[in] pNetworkContext The network context.
+ * @param[out] pBuffer Buffer to receive bytes into.
+ * @param[in] bytesToRecv Number of bytes to receive.
+ *
+ * @return Number of bytes received; 0 if the next record isn't due within the
+ * receive timeout; the error the device received, or -1 past the records of
+ * the connection.
+ */
+int32_t TransportReplay_Recv( NetworkContext_t * pNetworkContext,
+                              void * pBuffer,
+                              size_t bytesToRecv );
+
+/**
+ * @brief Takes the data sent and compares it with the capture.
+ *
+ * @param[in] pNetworkContext The network context.
+ * @param[in] pBuffer Buffer containing the bytes to send.
+ * @param[in] bytesToSend Number of bytes to send.
+ *
+ * @return @a bytesToSend.
+ */
+int32_t TransportReplay_Send( NetworkContext_t * pNetworkContext,
+                              const void * pBuffer,
+                              size_t bytesToSend );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef TRANSPORT_REPLAY_POSIX_H_ */
@@ -772,6 +772,7 @@ MbedtlsPkcs11Status_t Mbedtls_Pkcs11_Connect( NetworkContext_t * pNetworkContext
     MbedtlsPkcs11Status_t returnStatus = MBEDTLS_PKCS11_SUCCESS;
     int32_t mbedtlsError = 0;
     char portStr[ 6 ] = { 0 };
+    uint64_t startUs = 0U;
 
     if( ( pNetworkContext == NULL ) ||
         ( pNetworkContext->pParams == NULL ) ||
@@ -792,6 +793,7 @@ MbedtlsPkcs11Status_t Mbedtls_Pkcs11_Connect( NetworkContext_t * pNetworkContext
     {
         snprintf( portStr, sizeof( portStr ), "%u", port );
         pMbedtlsPkcs11Context = pNetworkContext->pParams;
+        startUs = TransportMetrics_Start( pMbedtlsPkcs11Context->pMetrics );
 
         /* Configure MbedTLS. */
         returnStatus = configureMbedtls( pMbedtlsPkcs11Context, pHostName, pMbedtlsPkcs11Credentials, recvTimeoutMs );
@@ -830,6 +832,13 @@ MbedtlsPkcs11Status_t Mbedtls_Pkcs11_Connect( NetworkContext_t * pNetworkContext
         }
     }
 
+    if( pMbedtlsPkcs11Context != NULL )
+    {
+        TransportMetrics_RecordHandshake( pMbedtlsPkcs11Context->pMetrics,
+                                          returnStatus == MBEDTLS_PKCS11_SUCCESS,
+                                          startUs );
+    }
+
     /* Clean up on failure. */
     if( returnStatus != MBEDTLS_PKCS11_SUCCESS )
     {
@@ -889,10 +898,12 @@ int32_t Mbedtls_Pkcs11_Recv( NetworkContext_t * pNetworkContext,
 {
     MbedtlsPkcs11Context_t * pMbedtlsPkcs11Context = NULL;
     int32_t tlsStatus = 0;
+    uint64_t startUs = 0U;
 
     assert( ( pNetworkContext != NULL ) && ( pNetworkContext->pParams != NULL ) );
 
     pMbedtlsPkcs11Context = pNetworkContext->pParams;
+    startUs = TransportMetrics_Start( pMbedtlsPkcs11Context->pMetrics );
     tlsStatus = ( int32_t ) mbedtls_ssl_read( &( pMbedtlsPkcs11Context->context ),
                                               pBuffer,
                                               bytesToRecv );
@@ -921,6 +932,11 @@ int32_t Mbedtls_Pkcs11_Recv( NetworkContext_t * pNetworkContext,
         /* Empty else marker. */
     }
 
+    TransportMetrics_RecordRecv( pMbedtlsPkcs11Context->pMetrics,
+                                 TransportMetrics_ResultOf( tlsStatus ),
+                                 ( tlsStatus > 0 ) ? ( size_t ) tlsStatus : 0U,
+                                 startUs );
+
     return tlsStatus;
 }
 
@@ -932,10 +948,12 @@ int32_t Mbedtls_Pkcs11_Send( NetworkContext_t * pNetworkContext,
 {
     MbedtlsPkcs11Context_t * pMbedtlsPkcs11Context = NULL;
     int32_t tlsStatus = 0;
+    uint64_t startUs = 0U;
 
     assert( ( pNetworkContext != NULL ) && ( pNetworkContext->pParams != NULL ) );
 
     pMbedtlsPkcs11Context = pNetworkContext->pParams;
+    startUs = TransportMetrics_Start( pMbedtlsPkcs11Context->pMetrics );
     tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pMbedtlsPkcs11Context->context ),
                                                pBuffer,
                                                bytesToSend );
@@ -964,6 +982,11 @@ int32_t Mbedtls_Pkcs11_Send( NetworkContext_t * pNetworkContext,
         /* Empty else marker. */
     }
 
+    TransportMetrics_RecordSend( pMbedtlsPkcs11Context->pMetrics,
+                                 TransportMetrics_ResultOf( tlsStatus ),
+                                 ( tlsStatus > 0 ) ? ( size_t ) tlsStatus : 0U,
+                                 startUs );
+
     return tlsStatus;
 }
 /*-----------------------------------------------------------*/
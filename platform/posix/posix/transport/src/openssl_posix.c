@@ -21,13 +21,22 @@
  * SOFTWARE.
  */
 
+/* Enable the GNU extensions of fcntl.h and unistd.h, for splice and pipe2. */
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
 /* Standard includes. */
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* POSIX socket includes. */
+#include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <pthread.h>
 
 /* Transport interface include. */
 #include "transport_interface.h"
@@ -52,6 +61,39 @@
  */
 #define CLIENT_KEY_LABEL     "client's key"
 
+/**
+ * @brief Number of SSL_CTX objects shared through
+ * #OpensslCredentials_t.reuseSslContext. The least recently used context is
+ * evicted once the cache is full.
+ */
+#ifndef OPENSSL_CONTEXT_CACHE_SIZE
+    #define OPENSSL_CONTEXT_CACHE_SIZE    8U
+#endif
+
+/**
+ * @brief Largest chunk moved by one splice or SSL_read call of
+ * #Openssl_RecvToFile, which is also the size of its stack buffer.
+ */
+#ifndef OPENSSL_RECV_TO_FILE_CHUNK_SIZE
+    #define OPENSSL_RECV_TO_FILE_CHUNK_SIZE    16384U
+#endif
+
+/**
+ * @brief First byte of an MQTT CONNECT packet.
+ */
+#define EARLY_DATA_CONNECT          0x10U
+
+/**
+ * @brief First byte of an MQTT PUBLISH packet with QoS 0, once masked with
+ * #EARLY_DATA_PUBLISH_MASK to ignore the DUP and RETAIN flags.
+ */
+#define EARLY_DATA_PUBLISH_QOS0     0x30U
+
+/**
+ * @brief Mask of the packet type and QoS bits of a PUBLISH first byte.
+ */
+#define EARLY_DATA_PUBLISH_MASK     0xF6U
+
 /*-----------------------------------------------------------*/
 
 /* Each compilation unit must define the NetworkContext struct. */
@@ -60,6 +102,39 @@ struct NetworkContext
     OpensslParams_t * pParams;
 };
 
+/**
+ * @brief A shared SSL_CTX together with the credentials and server it was
+ * created for.
+ */
+typedef struct ContextCacheEntry
+{
+    SSL_CTX * pSslContext;  /**< @brief Cache reference to the context; NULL when the slot is free. */
+    SSL_SESSION * pSession; /**< @brief Last session negotiated with the server, or NULL. */
+    char * pRootCaPath;     /**< @brief Copy of #OpensslCredentials_t.pRootCaPath. */
+    char * pClientCertPath; /**< @brief Copy of #OpensslCredentials_t.pClientCertPath. */
+    char * pPrivateKeyPath; /**< @brief Copy of #OpensslCredentials_t.pPrivateKeyPath. */
+    char * pHostName;       /**< @brief NULL-terminated copy of #ServerInfo_t.pHostName. */
+    uint16_t port;          /**< @brief Server port in host-order. */
+    uint64_t lastUsed;      /**< @brief Value of #contextCacheClock at the last lookup. */
+} ContextCacheEntry_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Contexts shared between connections, guarded by #contextCacheMutex.
+ */
+static ContextCacheEntry_t contextCache[ OPENSSL_CONTEXT_CACHE_SIZE ];
+
+/**
+ * @brief Monotonic lookup counter used to pick the least recently used entry.
+ */
+static uint64_t contextCacheClock = 0U;
+
+/**
+ * @brief Mutex guarding #contextCache and #contextCacheClock.
+ */
+static pthread_mutex_t contextCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -151,6 +226,45 @@ static void setOptionalConfigurations( SSL * pSsl,
  */
 static OpensslStatus_t convertToOpensslStatus( SocketStatus_t socketStatus );
 
+/**
+ * @brief Set up hostname verification, the socket and the optional TLS
+ * configurations of a new SSL object before its handshake.
+ *
+ * @param[in] pServerInfo Server connection info.
+ * @param[in] pOpensslParams Parameters holding the SSL object and socket.
+ * @param[in] pOpensslCredentials TLS credentials containing configurations.
+ *
+ * @return #OPENSSL_SUCCESS or #OPENSSL_API_ERROR.
+ */
+static OpensslStatus_t prepareHandshake( const ServerInfo_t * pServerInfo,
+                                         OpensslParams_t * pOpensslParams,
+                                         const OpensslCredentials_t * pOpensslCredentials );
+
+/**
+ * @brief Check the result of the server certificate verification after a
+ * completed handshake.
+ *
+ * @param[in] pOpensslParams Parameters holding the SSL object.
+ *
+ * @return #OPENSSL_SUCCESS or #OPENSSL_HANDSHAKE_FAILED.
+ */
+static OpensslStatus_t verifyPeer( const OpensslParams_t * pOpensslParams );
+
+/**
+ * @brief Create the SSL object of a connection, loading the credentials into
+ * a new SSL context or reusing a shared one.
+ *
+ * @param[in] pOpensslParams Parameters receiving the SSL object.
+ * @param[in] pServerInfo Server connection info.
+ * @param[in] pOpensslCredentials TLS credentials of the connection.
+ *
+ * @return #OPENSSL_SUCCESS, #OPENSSL_API_ERROR, or #OPENSSL_INVALID_CREDENTIALS.
+ * On failure #OpensslParams_t.pSsl is NULL.
+ */
+static OpensslStatus_t createSession( OpensslParams_t * pOpensslParams,
+                                      const ServerInfo_t * pServerInfo,
+                                      const OpensslCredentials_t * pOpensslCredentials );
+
 /**
  * @brief Establish TLS session by performing handshake with the server.
  *
@@ -172,6 +286,280 @@ static OpensslStatus_t tlsHandshake( const ServerInfo_t * pServerInfo,
  * @return 1 on success; 0 on failure.
  */
 static int32_t isValidNetworkContext( const NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Read application data from the TLS session.
+ *
+ * Polls the socket first when a single byte is requested and no processed
+ * data is pending, so that the start of a packet does not block for the
+ * whole receive timeout.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[out] pBuffer Buffer to read into.
+ * @param[in] bufferLength Number of bytes @p pBuffer can hold.
+ * @param[in] bytesToRecv Number of bytes requested by the caller of
+ * #Openssl_Recv.
+ *
+ * @return Number of bytes read, 0 if no data is available yet, or a negative
+ * value on error.
+ */
+static int32_t sslRead( OpensslParams_t * pOpensslParams,
+                        void * pBuffer,
+                        size_t bufferLength,
+                        size_t bytesToRecv );
+
+/**
+ * @brief Write application data to an established TLS session.
+ *
+ * Polls the socket first, so that a full send buffer makes the call return
+ * 0 rather than block.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[in] pBuffer Bytes to send.
+ * @param[in] bytesToSend Number of bytes to send.
+ *
+ * @return Number of bytes sent, 0 if the socket is not ready, or a negative
+ * value on error.
+ */
+static int32_t sslWrite( const OpensslParams_t * pOpensslParams,
+                         const void * pBuffer,
+                         size_t bytesToSend );
+
+/**
+ * @brief Copy buffered read-ahead data to the caller.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[out] pBuffer Buffer to copy into.
+ * @param[in] bytesToRecv Maximum number of bytes to copy.
+ *
+ * @return Number of bytes copied.
+ */
+static size_t consumeReadAhead( OpensslParams_t * pOpensslParams,
+                                void * pBuffer,
+                                size_t bytesToRecv );
+
+/**
+ * @brief Compare two optional NULL-terminated strings.
+ *
+ * @param[in] pLeft First string, or NULL.
+ * @param[in] pRight Second string, or NULL.
+ *
+ * @return true if both are NULL or both hold the same characters.
+ */
+static bool stringsEqual( const char * pLeft,
+                          const char * pRight );
+
+/**
+ * @brief Duplicate at most @p maxLength characters of an optional string.
+ *
+ * @param[in] pString String to copy, or NULL.
+ * @param[in] maxLength Maximum number of characters to copy; 0 copies the
+ * whole NULL-terminated string.
+ *
+ * @return A NULL-terminated copy to be released with free, or NULL if
+ * @p pString is NULL or the allocation failed.
+ */
+static char * copyString( const char * pString,
+                          size_t maxLength );
+
+/**
+ * @brief Find the cache entry created for the given credentials and server.
+ *
+ * @note #contextCacheMutex must be held by the caller.
+ *
+ * @param[in] pServerInfo Server connection info.
+ * @param[in] pOpensslCredentials TLS credentials of the connection.
+ *
+ * @return The matching entry, or NULL if there is none.
+ */
+static ContextCacheEntry_t * findCacheEntry( const ServerInfo_t * pServerInfo,
+                                             const OpensslCredentials_t * pOpensslCredentials );
+
+/**
+ * @brief Find the cache entry holding the given SSL context.
+ *
+ * @note #contextCacheMutex must be held by the caller.
+ *
+ * @param[in] pSslContext SSL context to look up.
+ *
+ * @return The matching entry, or NULL if the context is not cached.
+ */
+static ContextCacheEntry_t * findCacheEntryByContext( const SSL_CTX * pSslContext );
+
+/**
+ * @brief Free everything owned by a cache entry and mark its slot as free.
+ *
+ * @note #contextCacheMutex must be held by the caller.
+ *
+ * @param[in] pEntry Entry to release.
+ */
+static void releaseCacheEntry( ContextCacheEntry_t * pEntry );
+
+/**
+ * @brief Take a reference to the shared context for the given credentials
+ * and server.
+ *
+ * @param[in] pServerInfo Server connection info.
+ * @param[in] pOpensslCredentials TLS credentials of the connection.
+ *
+ * @return A referenced SSL context which the caller must free with
+ * #SSL_CTX_free, or NULL on a cache miss.
+ */
+static SSL_CTX * acquireCachedContext( const ServerInfo_t * pServerInfo,
+                                       const OpensslCredentials_t * pOpensslCredentials );
+
+/**
+ * @brief Share a freshly configured SSL context with later connections.
+ *
+ * The cache takes its own reference to the context and enables client-side
+ * session caching on it. A failure to allocate the entry only means the
+ * context is not shared.
+ *
+ * @param[in] pSslContext SSL context with the credentials loaded.
+ * @param[in] pServerInfo Server connection info.
+ * @param[in] pOpensslCredentials TLS credentials of the connection.
+ */
+static void insertCachedContext( SSL_CTX * pSslContext,
+                                 const ServerInfo_t * pServerInfo,
+                                 const OpensslCredentials_t * pOpensslCredentials );
+
+/**
+ * @brief Offer the last session negotiated through a shared context for
+ * resumption by a new connection.
+ *
+ * @param[in] pSslContext Shared SSL context of the connection.
+ * @param[in] pSsl SSL object of the new connection.
+ */
+static void resumeCachedSession( const SSL_CTX * pSslContext,
+                                 SSL * pSsl );
+
+/**
+ * @brief OpenSSL new-session callback storing the session in the cache entry
+ * of the connection's context.
+ *
+ * @param[in] pSsl SSL object which negotiated the session.
+ * @param[in] pSession The new session.
+ *
+ * @return 1 if the cache kept a reference to @p pSession; 0 otherwise.
+ */
+static int storeNewSession( SSL * pSsl,
+                            SSL_SESSION * pSession );
+
+/**
+ * @brief Check whether the handshake of a connection is deferred to send
+ * early data.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ *
+ * @return true while the handshake is pending.
+ */
+static bool isHandshakePending( const OpensslParams_t * pOpensslParams );
+
+/**
+ * @brief Defer the handshake of a new connection if its resumed session
+ * allows early data.
+ *
+ * @param[in] pOpensslParams Parameters holding the SSL object.
+ * @param[in] startUs Start of the connect, from #TransportMetrics_Start.
+ *
+ * @return true if the handshake is deferred.
+ */
+static bool deferHandshake( OpensslParams_t * pOpensslParams,
+                            uint64_t startUs );
+
+/**
+ * @brief Get the length of an MQTT packet which may be sent as early data.
+ *
+ * @param[in] pBuffer Start of the packet.
+ * @param[in] length Number of bytes available at @p pBuffer.
+ *
+ * @return Length of the whole packet; 0 if it is neither a CONNECT nor a QoS 0
+ * PUBLISH, or if its fixed header is not entirely in @p pBuffer.
+ */
+static size_t earlyDataPacketLength( const uint8_t * pBuffer,
+                                     size_t length );
+
+/**
+ * @brief Send bytes as early data and keep a copy of them.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[in] pBuffer Bytes to send.
+ * @param[in] length Number of bytes to send; they must fit in the early data
+ * budget.
+ *
+ * @return Number of bytes sent, or -1 on error.
+ */
+static int32_t writeEarlyData( OpensslParams_t * pOpensslParams,
+                               const uint8_t * pBuffer,
+                               size_t length );
+
+/**
+ * @brief Send bytes of an #Openssl_Send call while the handshake is pending.
+ *
+ * Bytes of a packet allowed by the replay-safety rules of
+ * #OpensslCredentials_t.allowEarlyData are sent as early data, followed by
+ * #OpensslEarlyData_t.pFirstPublish after the CONNECT packet. Any other
+ * packet completes the handshake instead.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[in] pBuffer Bytes to send.
+ * @param[in] bytesToSend Number of bytes to send.
+ *
+ * @return Number of bytes sent as early data; 0 once the handshake is
+ * complete and the bytes must be sent normally; -1 on error.
+ */
+static int32_t sendEarlyData( OpensslParams_t * pOpensslParams,
+                              const uint8_t * pBuffer,
+                              size_t bytesToSend );
+
+/**
+ * @brief Complete a deferred handshake, and send the early data again as
+ * normal data if the server rejected it.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ *
+ * @return #OPENSSL_SUCCESS or #OPENSSL_HANDSHAKE_FAILED.
+ */
+static OpensslStatus_t finishHandshake( OpensslParams_t * pOpensslParams );
+
+/**
+ * @brief Receive one chunk of #Openssl_RecvToFile through a buffer, and
+ * write it to the file.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[in] fileDescriptor File to write to.
+ * @param[in] offset Offset in the file of the first byte received.
+ * @param[in] bytesToRecv Maximum number of bytes to receive.
+ *
+ * @return Number of bytes written, 0 if no data is available yet, or -1 on
+ * error.
+ */
+static int32_t copyToFile( OpensslParams_t * pOpensslParams,
+                           int32_t fileDescriptor,
+                           off_t offset,
+                           size_t bytesToRecv );
+
+/**
+ * @brief Splice one chunk of #Openssl_RecvToFile, decrypted by the kernel,
+ * from the socket into the file.
+ *
+ * @param[in] pOpensslParams Parameters of the connection.
+ * @param[in] pPipe Pipe carrying the data between the socket and the file.
+ * @param[in] fileDescriptor File to write to.
+ * @param[in] offset Offset in the file of the first byte received.
+ * @param[in] bytesToRecv Maximum number of bytes to receive.
+ * @param[out] pNotData Set to true if the next record is not application
+ * data, which only OpenSSL can process.
+ *
+ * @return Number of bytes written, 0 if no data is available yet, or -1 on
+ * error.
+ */
+static int32_t spliceToFile( const OpensslParams_t * pOpensslParams,
+                             const int pPipe[ 2 ],
+                             int32_t fileDescriptor,
+                             off_t offset,
+                             size_t bytesToRecv,
+                             bool * pNotData );
 /*-----------------------------------------------------------*/
 
 #if ( LIBRARY_LOG_LEVEL == LOG_DEBUG )
@@ -236,12 +624,12 @@ static OpensslStatus_t convertToOpensslStatus( SocketStatus_t socketStatus )
 }
 /*-----------------------------------------------------------*/
 
-static OpensslStatus_t tlsHandshake( const ServerInfo_t * pServerInfo,
-                                     OpensslParams_t * pOpensslParams,
-                                     const OpensslCredentials_t * pOpensslCredentials )
+static OpensslStatus_t prepareHandshake( const ServerInfo_t * pServerInfo,
+                                         OpensslParams_t * pOpensslParams,
+                                         const OpensslCredentials_t * pOpensslCredentials )
 {
     OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
-    int32_t sslStatus = -1, verifyPeerCertStatus = X509_V_OK;
+    int32_t sslStatus = -1;
 
     /* Validate the hostname against the server's certificate. */
     sslStatus = SSL_set1_host( pOpensslParams->pSsl, pServerInfo->pHostName );
@@ -268,11 +656,46 @@ static OpensslStatus_t tlsHandshake( const ServerInfo_t * pServerInfo,
         }
     }
 
-    /* Perform the TLS handshake. */
     if( returnStatus == OPENSSL_SUCCESS )
     {
         setOptionalConfigurations( pOpensslParams->pSsl, pOpensslCredentials );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static OpensslStatus_t verifyPeer( const OpensslParams_t * pOpensslParams )
+{
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    int32_t verifyPeerCertStatus = X509_V_OK;
+
+    /* Verify X509 certificate from peer. */
+    verifyPeerCertStatus = ( int32_t ) SSL_get_verify_result( pOpensslParams->pSsl );
+
+    if( verifyPeerCertStatus != X509_V_OK )
+    {
+        LogError( ( "SSL_get_verify_result failed to verify X509 "
+                    "certificate from peer." ) );
+        returnStatus = OPENSSL_HANDSHAKE_FAILED;
+    }
 
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static OpensslStatus_t tlsHandshake( const ServerInfo_t * pServerInfo,
+                                     OpensslParams_t * pOpensslParams,
+                                     const OpensslCredentials_t * pOpensslCredentials )
+{
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    int32_t sslStatus = -1;
+
+    returnStatus = prepareHandshake( pServerInfo, pOpensslParams, pOpensslCredentials );
+
+    /* Perform the TLS handshake. */
+    if( returnStatus == OPENSSL_SUCCESS )
+    {
         sslStatus = SSL_connect( pOpensslParams->pSsl );
 
         if( sslStatus != 1 )
@@ -282,17 +705,9 @@ static OpensslStatus_t tlsHandshake( const ServerInfo_t * pServerInfo,
         }
     }
 
-    /* Verify X509 certificate from peer. */
     if( returnStatus == OPENSSL_SUCCESS )
     {
-        verifyPeerCertStatus = ( int32_t ) SSL_get_verify_result( pOpensslParams->pSsl );
-
-        if( verifyPeerCertStatus != X509_V_OK )
-        {
-            LogError( ( "SSL_get_verify_result failed to verify X509 "
-                        "certificate from peer." ) );
-            returnStatus = OPENSSL_HANDSHAKE_FAILED;
-        }
+        returnStatus = verifyPeer( pOpensslParams );
     }
 
     return returnStatus;
@@ -554,6 +969,18 @@ static void setOptionalConfigurations( SSL * pSsl,
                         pOpensslCredentials->sniHostName ) );
         }
     }
+
+    /* Let OpenSSL hand the record layer to the kernel after the handshake. */
+    if( pOpensslCredentials->enableKernelTls )
+    {
+        #ifdef SSL_OP_ENABLE_KTLS
+            LogDebug( ( "Enabling kernel TLS." ) );
+            ( void ) SSL_set_options( pSsl, SSL_OP_ENABLE_KTLS );
+        #else
+            LogWarn( ( "OpenSSL has no kernel TLS support; records are "
+                       "processed in user space." ) );
+        #endif
+    }
 }
 /*-----------------------------------------------------------*/
 
@@ -579,66 +1006,305 @@ static int32_t isValidNetworkContext( const NetworkContext_t * pNetworkContext )
 }
 /*-----------------------------------------------------------*/
 
-OpensslStatus_t Openssl_Connect( NetworkContext_t * pNetworkContext,
-                                 const ServerInfo_t * pServerInfo,
-                                 const OpensslCredentials_t * pOpensslCredentials,
-                                 uint32_t sendTimeoutMs,
-                                 uint32_t recvTimeoutMs )
+static bool stringsEqual( const char * pLeft,
+                          const char * pRight )
 {
-    OpensslParams_t * pOpensslParams = NULL;
-    SocketStatus_t socketStatus = SOCKETS_SUCCESS;
-    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
-    int32_t sslStatus = 0;
-    uint8_t sslObjectCreated = 0;
-    SSL_CTX * pSslContext = NULL;
+    bool isEqual = false;
 
-    /* Validate parameters. */
-    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) )
+    if( ( pLeft == NULL ) || ( pRight == NULL ) )
     {
-        LogError( ( "Parameter check failed: pNetworkContext is NULL." ) );
-        returnStatus = OPENSSL_INVALID_PARAMETER;
+        isEqual = ( pLeft == pRight );
     }
-    else if( pOpensslCredentials == NULL )
+    else
     {
-        LogError( ( "Parameter check failed: pOpensslCredentials is NULL." ) );
-        returnStatus = OPENSSL_INVALID_PARAMETER;
+        isEqual = ( strcmp( pLeft, pRight ) == 0 );
+    }
+
+    return isEqual;
+}
+/*-----------------------------------------------------------*/
+
+static char * copyString( const char * pString,
+                          size_t maxLength )
+{
+    char * pCopy = NULL;
+
+    if( ( pString != NULL ) && ( maxLength == 0U ) )
+    {
+        pCopy = strdup( pString );
+    }
+    else if( pString != NULL )
+    {
+        pCopy = strndup( pString, maxLength );
     }
     else
     {
         /* Empty else. */
     }
 
-    /* Establish the TCP connection. */
-    if( returnStatus == OPENSSL_SUCCESS )
-    {
-        pOpensslParams = pNetworkContext->pParams;
-        socketStatus = Sockets_Connect( &pOpensslParams->socketDescriptor,
-                                        pServerInfo, sendTimeoutMs, recvTimeoutMs );
+    return pCopy;
+}
+/*-----------------------------------------------------------*/
 
-        /* Convert socket wrapper status to openssl status. */
-        returnStatus = convertToOpensslStatus( socketStatus );
-    }
+static ContextCacheEntry_t * findCacheEntry( const ServerInfo_t * pServerInfo,
+                                             const OpensslCredentials_t * pOpensslCredentials )
+{
+    ContextCacheEntry_t * pFound = NULL;
+    ContextCacheEntry_t * pEntry = NULL;
+    size_t i;
 
-    /* Create SSL context. */
-    if( returnStatus == OPENSSL_SUCCESS )
+    for( i = 0U; ( i < OPENSSL_CONTEXT_CACHE_SIZE ) && ( pFound == NULL ); i++ )
     {
-        pSslContext = SSL_CTX_new( TLS_client_method() );
-
-        if( pSslContext == NULL )
+        pEntry = &contextCache[ i ];
+
+        if( ( pEntry->pSslContext != NULL ) &&
+            ( pEntry->port == pServerInfo->port ) &&
+            ( strlen( pEntry->pHostName ) == pServerInfo->hostNameLength ) &&
+            ( strncmp( pEntry->pHostName, pServerInfo->pHostName, pServerInfo->hostNameLength ) == 0 ) &&
+            stringsEqual( pEntry->pRootCaPath, pOpensslCredentials->pRootCaPath ) &&
+            stringsEqual( pEntry->pClientCertPath, pOpensslCredentials->pClientCertPath ) &&
+            stringsEqual( pEntry->pPrivateKeyPath, pOpensslCredentials->pPrivateKeyPath ) )
         {
-            LogError( ( "Creation of a new SSL_CTX object failed." ) );
-            returnStatus = OPENSSL_API_ERROR;
+            pFound = pEntry;
         }
     }
 
-    /* Setup credentials. */
-    if( returnStatus == OPENSSL_SUCCESS )
-    {
-        /* Enable partial writes for blocking calls to SSL_write to allow a
-         * payload larger than the maximum fragment length.
-         * The mask returned by SSL_CTX_set_mode does not need to be checked. */
+    return pFound;
+}
+/*-----------------------------------------------------------*/
 
-        /* MISRA Directive 4.6 flags the following line for using basic
+static ContextCacheEntry_t * findCacheEntryByContext( const SSL_CTX * pSslContext )
+{
+    ContextCacheEntry_t * pFound = NULL;
+    size_t i;
+
+    for( i = 0U; ( i < OPENSSL_CONTEXT_CACHE_SIZE ) && ( pFound == NULL ); i++ )
+    {
+        if( ( pSslContext != NULL ) && ( contextCache[ i ].pSslContext == pSslContext ) )
+        {
+            pFound = &contextCache[ i ];
+        }
+    }
+
+    return pFound;
+}
+/*-----------------------------------------------------------*/
+
+static void releaseCacheEntry( ContextCacheEntry_t * pEntry )
+{
+    assert( pEntry != NULL );
+
+    if( pEntry->pSession != NULL )
+    {
+        SSL_SESSION_free( pEntry->pSession );
+    }
+
+    /* Connections still using the context hold their own reference, so
+     * the context itself is destroyed once the last of them is freed. */
+    if( pEntry->pSslContext != NULL )
+    {
+        SSL_CTX_free( pEntry->pSslContext );
+    }
+
+    free( pEntry->pRootCaPath );
+    free( pEntry->pClientCertPath );
+    free( pEntry->pPrivateKeyPath );
+    free( pEntry->pHostName );
+    ( void ) memset( pEntry, 0, sizeof( ContextCacheEntry_t ) );
+}
+/*-----------------------------------------------------------*/
+
+static SSL_CTX * acquireCachedContext( const ServerInfo_t * pServerInfo,
+                                       const OpensslCredentials_t * pOpensslCredentials )
+{
+    SSL_CTX * pSslContext = NULL;
+    ContextCacheEntry_t * pEntry = NULL;
+
+    ( void ) pthread_mutex_lock( &contextCacheMutex );
+
+    pEntry = findCacheEntry( pServerInfo, pOpensslCredentials );
+
+    /* The reference taken here keeps the context valid even if the entry is
+     * evicted before the connection has created its SSL object. */
+    if( ( pEntry != NULL ) && ( SSL_CTX_up_ref( pEntry->pSslContext ) == 1 ) )
+    {
+        pSslContext = pEntry->pSslContext;
+        pEntry->lastUsed = ++contextCacheClock;
+        LogDebug( ( "Reusing cached SSL context for %.*s:%u.",
+                    ( int32_t ) pServerInfo->hostNameLength,
+                    pServerInfo->pHostName,
+                    pServerInfo->port ) );
+    }
+
+    ( void ) pthread_mutex_unlock( &contextCacheMutex );
+
+    return pSslContext;
+}
+/*-----------------------------------------------------------*/
+
+static void insertCachedContext( SSL_CTX * pSslContext,
+                                 const ServerInfo_t * pServerInfo,
+                                 const OpensslCredentials_t * pOpensslCredentials )
+{
+    ContextCacheEntry_t * pEntry = NULL;
+    size_t i;
+
+    assert( pSslContext != NULL );
+
+    ( void ) pthread_mutex_lock( &contextCacheMutex );
+
+    /* Another connection may have filled the entry while this one was
+     * loading the credentials; keep the existing context in that case. */
+    if( findCacheEntry( pServerInfo, pOpensslCredentials ) == NULL )
+    {
+        /* Prefer a free slot, otherwise evict the least recently used one. */
+        pEntry = &contextCache[ 0 ];
+
+        for( i = 0U; ( i < OPENSSL_CONTEXT_CACHE_SIZE ) && ( pEntry->pSslContext != NULL ); i++ )
+        {
+            if( ( contextCache[ i ].pSslContext == NULL ) ||
+                ( contextCache[ i ].lastUsed < pEntry->lastUsed ) )
+            {
+                pEntry = &contextCache[ i ];
+            }
+        }
+
+        releaseCacheEntry( pEntry );
+
+        pEntry->pRootCaPath = copyString( pOpensslCredentials->pRootCaPath, 0U );
+        pEntry->pClientCertPath = copyString( pOpensslCredentials->pClientCertPath, 0U );
+        pEntry->pPrivateKeyPath = copyString( pOpensslCredentials->pPrivateKeyPath, 0U );
+        pEntry->pHostName = copyString( pServerInfo->pHostName, pServerInfo->hostNameLength );
+        pEntry->port = pServerInfo->port;
+
+        if( ( ( pOpensslCredentials->pRootCaPath != NULL ) && ( pEntry->pRootCaPath == NULL ) ) ||
+            ( ( pOpensslCredentials->pClientCertPath != NULL ) && ( pEntry->pClientCertPath == NULL ) ) ||
+            ( ( pOpensslCredentials->pPrivateKeyPath != NULL ) && ( pEntry->pPrivateKeyPath == NULL ) ) ||
+            ( pEntry->pHostName == NULL ) )
+        {
+            LogWarn( ( "Failed to allocate SSL context cache entry; the context will not be shared." ) );
+            releaseCacheEntry( pEntry );
+        }
+        else if( SSL_CTX_up_ref( pSslContext ) != 1 )
+        {
+            LogWarn( ( "SSL_CTX_up_ref failed; the context will not be shared." ) );
+            releaseCacheEntry( pEntry );
+        }
+        else
+        {
+            /* Keep client sessions out of OpenSSL's internal store and hand
+             * them to #storeNewSession instead. */
+
+            /* MISRA Directive 4.6 flags the following line for using basic
+             * numerical type long. This directive is suppressed because openssl
+             * function #SSL_CTX_set_session_cache_mode takes an argument of type long. */
+            /* coverity[misra_c_2012_directive_4_6_violation] */
+            ( void ) SSL_CTX_set_session_cache_mode( pSslContext,
+                                                     ( long ) ( SSL_SESS_CACHE_CLIENT |
+                                                                SSL_SESS_CACHE_NO_INTERNAL_STORE ) );
+            SSL_CTX_sess_set_new_cb( pSslContext, storeNewSession );
+
+            pEntry->pSslContext = pSslContext;
+            pEntry->lastUsed = ++contextCacheClock;
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &contextCacheMutex );
+}
+/*-----------------------------------------------------------*/
+
+static void resumeCachedSession( const SSL_CTX * pSslContext,
+                                 SSL * pSsl )
+{
+    ContextCacheEntry_t * pEntry = NULL;
+
+    ( void ) pthread_mutex_lock( &contextCacheMutex );
+
+    pEntry = findCacheEntryByContext( pSslContext );
+
+    /* SSL_set_session takes its own reference, so the entry may replace or
+     * free its session while this connection is still using it. A failure
+     * only means a full handshake is performed. */
+    if( ( pEntry != NULL ) && ( pEntry->pSession != NULL ) )
+    {
+        if( SSL_set_session( pSsl, pEntry->pSession ) != 1 )
+        {
+            LogWarn( ( "SSL_set_session failed; performing a full handshake." ) );
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &contextCacheMutex );
+}
+/*-----------------------------------------------------------*/
+
+static int storeNewSession( SSL * pSsl,
+                            SSL_SESSION * pSession )
+{
+    ContextCacheEntry_t * pEntry = NULL;
+    int keptReference = 0;
+
+    ( void ) pthread_mutex_lock( &contextCacheMutex );
+
+    pEntry = findCacheEntryByContext( SSL_get_SSL_CTX( pSsl ) );
+
+    if( pEntry != NULL )
+    {
+        if( pEntry->pSession != NULL )
+        {
+            SSL_SESSION_free( pEntry->pSession );
+        }
+
+        pEntry->pSession = pSession;
+        keptReference = 1;
+    }
+
+    ( void ) pthread_mutex_unlock( &contextCacheMutex );
+
+    return keptReference;
+}
+/*-----------------------------------------------------------*/
+
+static OpensslStatus_t createSession( OpensslParams_t * pOpensslParams,
+                                      const ServerInfo_t * pServerInfo,
+                                      const OpensslCredentials_t * pOpensslCredentials )
+{
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    int32_t sslStatus = 0;
+    uint8_t sslContextCached = 0;
+    SSL_CTX * pSslContext = NULL;
+
+    assert( pOpensslParams != NULL );
+    assert( pOpensslCredentials != NULL );
+
+    pOpensslParams->pSsl = NULL;
+
+    /* Reuse a shared SSL context with the credentials already loaded. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) && pOpensslCredentials->reuseSslContext )
+    {
+        pSslContext = acquireCachedContext( pServerInfo, pOpensslCredentials );
+        sslContextCached = ( pSslContext != NULL ) ? 1U : 0U;
+    }
+
+    /* Create SSL context. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) && ( sslContextCached == 0U ) )
+    {
+        pSslContext = SSL_CTX_new( TLS_client_method() );
+
+        if( pSslContext == NULL )
+        {
+            LogError( ( "Creation of a new SSL_CTX object failed." ) );
+            returnStatus = OPENSSL_API_ERROR;
+        }
+    }
+
+    /* Setup credentials. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) && ( sslContextCached == 0U ) )
+    {
+        /* Enable partial writes for blocking calls to SSL_write to allow a
+         * payload larger than the maximum fragment length.
+         * The mask returned by SSL_CTX_set_mode does not need to be checked. */
+
+        /* MISRA Directive 4.6 flags the following line for using basic
         * numerical type long. This directive is suppressed because openssl
         * function #SSL_CTX_set_mode takes an argument of type long. */
         /* coverity[misra_c_2012_directive_4_6_violation] */
@@ -651,53 +1317,492 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * pNetworkContext,
             LogError( ( "Setting up credentials failed." ) );
             returnStatus = OPENSSL_INVALID_CREDENTIALS;
         }
+        else if( pOpensslCredentials->reuseSslContext )
+        {
+            insertCachedContext( pSslContext, pServerInfo, pOpensslCredentials );
+        }
+        else
+        {
+            /* Empty else. */
+        }
     }
 
     /* Create a new SSL session. */
     if( returnStatus == OPENSSL_SUCCESS )
     {
-        pOpensslParams->pSsl = SSL_new( pSslContext );
-
-        if( pOpensslParams->pSsl == NULL )
-        {
-            LogError( ( "SSL_new failed to create a new SSL context." ) );
-            returnStatus = OPENSSL_API_ERROR;
-        }
-        else
-        {
-            sslObjectCreated = 1u;
-        }
+        pOpensslParams->pSsl = SSL_new( pSslContext );
+
+        if( pOpensslParams->pSsl == NULL )
+        {
+            LogError( ( "SSL_new failed to create a new SSL context." ) );
+            returnStatus = OPENSSL_API_ERROR;
+        }
+        else
+        {
+            /* With a read-ahead buffer, let OpenSSL fetch as many records as
+             * the socket holds with each read call. */
+            if( ( pOpensslParams->pReadAheadBuffer != NULL ) &&
+                !pOpensslCredentials->enableKernelTls )
+            {
+                SSL_set_read_ahead( pOpensslParams->pSsl, 1 );
+            }
+
+            if( pOpensslCredentials->reuseSslContext )
+            {
+                resumeCachedSession( pSslContext, pOpensslParams->pSsl );
+            }
+        }
+    }
+
+    /* Free the SSL context. The SSL object and the context cache hold their
+     * own references to it. */
+    if( pSslContext != NULL )
+    {
+        SSL_CTX_free( pSslContext );
+        pSslContext = NULL;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static bool isHandshakePending( const OpensslParams_t * pOpensslParams )
+{
+    return ( pOpensslParams->pEarlyData != NULL ) &&
+           pOpensslParams->pEarlyData->handshakePending;
+}
+/*-----------------------------------------------------------*/
+
+static bool deferHandshake( OpensslParams_t * pOpensslParams,
+                            uint64_t startUs )
+{
+    OpensslEarlyData_t * pEarlyData = pOpensslParams->pEarlyData;
+    const SSL_SESSION * pSession = NULL;
+    size_t maxLength = 0U;
+
+    pEarlyData->handshakePending = false;
+    pEarlyData->length = 0U;
+    pEarlyData->packetType = 0U;
+    pEarlyData->packetRemaining = 0U;
+
+    /* Only a session offered by #resumeCachedSession, from a server which
+     * announced a limit for early data, can carry it. */
+    pSession = SSL_get_session( pOpensslParams->pSsl );
+
+    if( pSession != NULL )
+    {
+        maxLength = ( size_t ) SSL_SESSION_get_max_early_data( pSession );
+    }
+
+    if( maxLength > pEarlyData->bufferSize )
+    {
+        maxLength = pEarlyData->bufferSize;
+    }
+
+    if( maxLength > 0U )
+    {
+        pEarlyData->maxLength = maxLength;
+        pEarlyData->handshakeStartUs = startUs;
+        pEarlyData->handshakePending = true;
+        LogDebug( ( "Deferring the TLS handshake to send up to %lu bytes of early data.",
+                    ( unsigned long ) maxLength ) );
+    }
+
+    return pEarlyData->handshakePending;
+}
+/*-----------------------------------------------------------*/
+
+static size_t earlyDataPacketLength( const uint8_t * pBuffer,
+                                     size_t length )
+{
+    size_t packetLength = 0U, remainingLength = 0U, multiplier = 1U, i = 1U;
+    bool lengthDecoded = false;
+
+    /* CONNECT, or PUBLISH with QoS 0. Packets which the broker acknowledges
+     * are never sent early, since their replay can't be told apart. */
+    if( ( pBuffer[ 0 ] == EARLY_DATA_CONNECT ) ||
+        ( ( pBuffer[ 0 ] & EARLY_DATA_PUBLISH_MASK ) == EARLY_DATA_PUBLISH_QOS0 ) )
+    {
+        /* Decode the remaining length, of at most 4 bytes. */
+        while( ( lengthDecoded == false ) && ( i < length ) && ( i <= 4U ) )
+        {
+            remainingLength += ( size_t ) ( pBuffer[ i ] & 0x7FU ) * multiplier;
+            multiplier *= 128U;
+            lengthDecoded = ( ( pBuffer[ i ] & 0x80U ) == 0U );
+            i++;
+        }
+    }
+
+    if( lengthDecoded == true )
+    {
+        packetLength = i + remainingLength;
+    }
+
+    return packetLength;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t writeEarlyData( OpensslParams_t * pOpensslParams,
+                               const uint8_t * pBuffer,
+                               size_t length )
+{
+    OpensslEarlyData_t * pEarlyData = pOpensslParams->pEarlyData;
+    int32_t bytesSent = -1;
+    size_t written = 0U;
+
+    assert( ( pEarlyData->length + length ) <= pEarlyData->maxLength );
+
+    if( SSL_write_early_data( pOpensslParams->pSsl, pBuffer, length, &written ) == 1 )
+    {
+        /* Keep the bytes in case the server rejects them. */
+        ( void ) memcpy( &pEarlyData->pBuffer[ pEarlyData->length ], pBuffer, written );
+        pEarlyData->length += written;
+        bytesSent = ( int32_t ) written;
+    }
+    else
+    {
+        LogError( ( "SSL_write_early_data failed to send early data: "
+                    "ErrorStatus=%s.",
+                    ERR_reason_error_string( SSL_get_error( pOpensslParams->pSsl, 0 ) ) ) );
+    }
+
+    return bytesSent;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t sendEarlyData( OpensslParams_t * pOpensslParams,
+                              const uint8_t * pBuffer,
+                              size_t bytesToSend )
+{
+    OpensslEarlyData_t * pEarlyData = pOpensslParams->pEarlyData;
+    int32_t bytesSent = 0;
+    size_t packetLength = 0U;
+
+    /* A new packet is sent early only if the whole of it fits. */
+    if( pEarlyData->packetRemaining == 0U )
+    {
+        packetLength = earlyDataPacketLength( pBuffer, bytesToSend );
+
+        if( ( packetLength > 0U ) &&
+            ( packetLength <= ( pEarlyData->maxLength - pEarlyData->length ) ) )
+        {
+            pEarlyData->packetType = pBuffer[ 0 ];
+            pEarlyData->packetRemaining = packetLength;
+        }
+    }
+
+    if( pEarlyData->packetRemaining == 0U )
+    {
+        bytesSent = ( finishHandshake( pOpensslParams ) == OPENSSL_SUCCESS ) ? 0 : -1;
+    }
+    else
+    {
+        bytesSent = writeEarlyData( pOpensslParams, pBuffer,
+                                    ( bytesToSend < pEarlyData->packetRemaining ) ?
+                                    bytesToSend : pEarlyData->packetRemaining );
+
+        if( bytesSent > 0 )
+        {
+            pEarlyData->packetRemaining -= ( size_t ) bytesSent;
+        }
+    }
+
+    /* Follow the CONNECT packet with the first publish of the application. */
+    if( ( bytesSent > 0 ) &&
+        ( pEarlyData->packetRemaining == 0U ) &&
+        ( pEarlyData->packetType == EARLY_DATA_CONNECT ) &&
+        ( pEarlyData->pFirstPublish != NULL ) )
+    {
+        packetLength = earlyDataPacketLength( pEarlyData->pFirstPublish,
+                                              pEarlyData->firstPublishLength );
+
+        if( ( packetLength != pEarlyData->firstPublishLength ) ||
+            ( ( pEarlyData->pFirstPublish[ 0 ] & EARLY_DATA_PUBLISH_MASK ) != EARLY_DATA_PUBLISH_QOS0 ) ||
+            ( packetLength > ( pEarlyData->maxLength - pEarlyData->length ) ) )
+        {
+            LogWarn( ( "The first publish is not a QoS 0 PUBLISH fitting in the early data; "
+                       "it is left to the application." ) );
+        }
+        else if( writeEarlyData( pOpensslParams, pEarlyData->pFirstPublish,
+                                 packetLength ) == ( int32_t ) packetLength )
+        {
+            pEarlyData->pFirstPublish = NULL;
+        }
+        else
+        {
+            bytesSent = -1;
+        }
+    }
+
+    return bytesSent;
+}
+/*-----------------------------------------------------------*/
+
+static OpensslStatus_t finishHandshake( OpensslParams_t * pOpensslParams )
+{
+    OpensslEarlyData_t * pEarlyData = pOpensslParams->pEarlyData;
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    size_t offset = 0U;
+    int32_t sslStatus = -1;
+
+    pEarlyData->handshakePending = false;
+
+    /* Sends the end of the early data, and completes the handshake. */
+    sslStatus = SSL_connect( pOpensslParams->pSsl );
+
+    if( sslStatus != 1 )
+    {
+        LogError( ( "SSL_connect failed to perform TLS handshake." ) );
+        returnStatus = OPENSSL_HANDSHAKE_FAILED;
+    }
+
+    if( returnStatus == OPENSSL_SUCCESS )
+    {
+        returnStatus = verifyPeer( pOpensslParams );
+    }
+
+    /* A server which rejects early data drops it, so the same bytes are sent
+     * again, now after the handshake. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) &&
+        ( pEarlyData->length > 0U ) &&
+        ( SSL_get_early_data_status( pOpensslParams->pSsl ) == SSL_EARLY_DATA_REJECTED ) )
+    {
+        LogDebug( ( "The server rejected %lu bytes of early data; sending them again.",
+                    ( unsigned long ) pEarlyData->length ) );
+
+        while( ( returnStatus == OPENSSL_SUCCESS ) && ( offset < pEarlyData->length ) )
+        {
+            sslStatus = ( int32_t ) SSL_write( pOpensslParams->pSsl,
+                                               &pEarlyData->pBuffer[ offset ],
+                                               ( int32_t ) ( pEarlyData->length - offset ) );
+
+            if( sslStatus > 0 )
+            {
+                offset += ( size_t ) sslStatus;
+            }
+            else
+            {
+                LogError( ( "SSL_write failed to send the rejected early data." ) );
+                returnStatus = OPENSSL_HANDSHAKE_FAILED;
+            }
+        }
+    }
+
+    TransportMetrics_RecordHandshake( pOpensslParams->pMetrics,
+                                      returnStatus == OPENSSL_SUCCESS,
+                                      pEarlyData->handshakeStartUs );
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+OpensslStatus_t Openssl_Connect( NetworkContext_t * pNetworkContext,
+                                 const ServerInfo_t * pServerInfo,
+                                 const OpensslCredentials_t * pOpensslCredentials,
+                                 uint32_t sendTimeoutMs,
+                                 uint32_t recvTimeoutMs )
+{
+    OpensslParams_t * pOpensslParams = NULL;
+    SocketStatus_t socketStatus = SOCKETS_SUCCESS;
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    uint8_t sslObjectCreated = 0;
+    bool handshakeDeferred = false;
+    uint64_t startUs = 0U;
+
+    /* Validate parameters. */
+    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pNetworkContext is NULL." ) );
+        returnStatus = OPENSSL_INVALID_PARAMETER;
+    }
+    else if( pOpensslCredentials == NULL )
+    {
+        LogError( ( "Parameter check failed: pOpensslCredentials is NULL." ) );
+        returnStatus = OPENSSL_INVALID_PARAMETER;
+    }
+    else if( pOpensslCredentials->allowEarlyData &&
+             ( !pOpensslCredentials->reuseSslContext ||
+               ( pNetworkContext->pParams->pEarlyData == NULL ) ||
+               ( pNetworkContext->pParams->pEarlyData->pBuffer == NULL ) ) )
+    {
+        LogError( ( "Parameter check failed: early data requires reuseSslContext "
+                    "and an early data buffer." ) );
+        returnStatus = OPENSSL_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    /* Establish the TCP connection. */
+    if( returnStatus == OPENSSL_SUCCESS )
+    {
+        pOpensslParams = pNetworkContext->pParams;
+        pOpensslParams->readAheadOffset = 0U;
+        pOpensslParams->readAheadLength = 0U;
+        startUs = TransportMetrics_Start( pOpensslParams->pMetrics );
+        socketStatus = Sockets_Connect( &pOpensslParams->socketDescriptor,
+                                        pServerInfo, sendTimeoutMs, recvTimeoutMs );
+
+        /* Convert socket wrapper status to openssl status. */
+        returnStatus = convertToOpensslStatus( socketStatus );
+    }
+
+    /* Create the SSL object with the credentials loaded. */
+    if( returnStatus == OPENSSL_SUCCESS )
+    {
+        returnStatus = createSession( pOpensslParams, pServerInfo, pOpensslCredentials );
+        sslObjectCreated = ( pOpensslParams->pSsl != NULL ) ? 1U : 0U;
+    }
+
+    /* A resumed session may let the first packets go out as early data, in
+     * which case the handshake is completed by #Openssl_Send or
+     * #Openssl_Recv. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) && pOpensslCredentials->allowEarlyData )
+    {
+        handshakeDeferred = deferHandshake( pOpensslParams, startUs );
+    }
+
+    /* Setup the socket to use for communication. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) && handshakeDeferred )
+    {
+        returnStatus = prepareHandshake( pServerInfo, pOpensslParams, pOpensslCredentials );
+
+        if( returnStatus == OPENSSL_SUCCESS )
+        {
+            SSL_set_connect_state( pOpensslParams->pSsl );
+        }
+        else
+        {
+            pOpensslParams->pEarlyData->handshakePending = false;
+        }
+    }
+    else if( returnStatus == OPENSSL_SUCCESS )
+    {
+        returnStatus =
+            tlsHandshake( pServerInfo, pOpensslParams, pOpensslCredentials );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    /* Clean up on error. */
+    if( ( returnStatus != OPENSSL_SUCCESS ) && ( sslObjectCreated == 1u ) )
+    {
+        SSL_free( pOpensslParams->pSsl );
+        pOpensslParams->pSsl = NULL;
+    }
+
+    /* A deferred handshake is recorded once it completes. */
+    if( ( pOpensslParams != NULL ) && !isHandshakePending( pOpensslParams ) )
+    {
+        TransportMetrics_RecordHandshake( pOpensslParams->pMetrics,
+                                          returnStatus == OPENSSL_SUCCESS,
+                                          startUs );
+    }
+
+    /* Log failure or success depending on status. */
+    if( returnStatus != OPENSSL_SUCCESS )
+    {
+        LogError( ( "Failed to establish a TLS connection." ) );
+    }
+    else
+    {
+        LogDebug( ( "Established a TLS connection." ) );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+OpensslStatus_t Openssl_HandshakeStart( NetworkContext_t * pNetworkContext,
+                                        const ServerInfo_t * pServerInfo,
+                                        const OpensslCredentials_t * pOpensslCredentials )
+{
+    OpensslParams_t * pOpensslParams = NULL;
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+
+    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pNetworkContext is NULL." ) );
+        returnStatus = OPENSSL_INVALID_PARAMETER;
+    }
+    else if( ( pServerInfo == NULL ) || ( pOpensslCredentials == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pServerInfo or pOpensslCredentials is NULL." ) );
+        returnStatus = OPENSSL_INVALID_PARAMETER;
+    }
+    else
+    {
+        pOpensslParams = pNetworkContext->pParams;
+        pOpensslParams->readAheadOffset = 0U;
+        pOpensslParams->readAheadLength = 0U;
+        returnStatus = createSession( pOpensslParams, pServerInfo, pOpensslCredentials );
     }
 
-    /* Setup the socket to use for communication. */
     if( returnStatus == OPENSSL_SUCCESS )
     {
-        returnStatus =
-            tlsHandshake( pServerInfo, pOpensslParams, pOpensslCredentials );
+        returnStatus = prepareHandshake( pServerInfo, pOpensslParams, pOpensslCredentials );
     }
 
-    /* Free the SSL context. */
-    if( pSslContext != NULL )
+    if( returnStatus == OPENSSL_SUCCESS )
     {
-        SSL_CTX_free( pSslContext );
-        pSslContext = NULL;
+        SSL_set_connect_state( pOpensslParams->pSsl );
     }
-
-    /* Clean up on error. */
-    if( ( returnStatus != OPENSSL_SUCCESS ) && ( sslObjectCreated == 1u ) )
+    else if( ( pOpensslParams != NULL ) && ( pOpensslParams->pSsl != NULL ) )
     {
         SSL_free( pOpensslParams->pSsl );
         pOpensslParams->pSsl = NULL;
     }
+    else
+    {
+        /* Empty else. */
+    }
 
-    /* Log failure or success depending on status. */
-    if( returnStatus != OPENSSL_SUCCESS )
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+OpensslStatus_t Openssl_HandshakeContinue( NetworkContext_t * pNetworkContext )
+{
+    OpensslParams_t * pOpensslParams = NULL;
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    int32_t sslStatus = -1, sslError = 0;
+
+    if( !isValidNetworkContext( pNetworkContext ) )
     {
-        LogError( ( "Failed to establish a TLS connection." ) );
+        returnStatus = OPENSSL_INVALID_PARAMETER;
     }
     else
     {
-        LogDebug( ( "Established a TLS connection." ) );
+        pOpensslParams = pNetworkContext->pParams;
+        sslStatus = SSL_do_handshake( pOpensslParams->pSsl );
+
+        if( sslStatus == 1 )
+        {
+            returnStatus = verifyPeer( pOpensslParams );
+        }
+        else
+        {
+            sslError = SSL_get_error( pOpensslParams->pSsl, sslStatus );
+
+            if( sslError == SSL_ERROR_WANT_READ )
+            {
+                returnStatus = OPENSSL_HANDSHAKE_WANT_READ;
+            }
+            else if( sslError == SSL_ERROR_WANT_WRITE )
+            {
+                returnStatus = OPENSSL_HANDSHAKE_WANT_WRITE;
+            }
+            else
+            {
+                LogError( ( "SSL_do_handshake failed to perform TLS handshake: "
+                            "ErrorStatus=%s.",
+                            ERR_reason_error_string( ( unsigned long ) sslError ) ) );
+                returnStatus = OPENSSL_HANDSHAKE_FAILED;
+            }
+        }
     }
 
     return returnStatus;
@@ -721,6 +1826,14 @@ OpensslStatus_t Openssl_Disconnect( const NetworkContext_t * pNetworkContext )
     {
         pOpensslParams = pNetworkContext->pParams;
 
+        /* A session whose handshake never completed has nothing to close. */
+        if( isHandshakePending( pOpensslParams ) )
+        {
+            pOpensslParams->pEarlyData->handshakePending = false;
+            SSL_free( pOpensslParams->pSsl );
+            pOpensslParams->pSsl = NULL;
+        }
+
         if( pOpensslParams->pSsl != NULL )
         {
             /* SSL shutdown should be called twice: once to send "close notify" and
@@ -734,6 +1847,10 @@ OpensslStatus_t Openssl_Disconnect( const NetworkContext_t * pNetworkContext )
             pOpensslParams->pSsl = NULL;
         }
 
+        /* Drop data read ahead from the closed session. */
+        pOpensslParams->readAheadOffset = 0U;
+        pOpensslParams->readAheadLength = 0U;
+
         /* Tear down the socket connection, pNetworkContext != NULL here. */
         socketStatus = Sockets_Disconnect( pOpensslParams->socketDescriptor );
     }
@@ -742,6 +1859,171 @@ OpensslStatus_t Openssl_Disconnect( const NetworkContext_t * pNetworkContext )
 }
 /*-----------------------------------------------------------*/
 
+void Openssl_ClearContextCache( void )
+{
+    size_t i;
+
+    ( void ) pthread_mutex_lock( &contextCacheMutex );
+
+    for( i = 0U; i < OPENSSL_CONTEXT_CACHE_SIZE; i++ )
+    {
+        if( contextCache[ i ].pSslContext != NULL )
+        {
+            releaseCacheEntry( &contextCache[ i ] );
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &contextCacheMutex );
+}
+/*-----------------------------------------------------------*/
+
+static int32_t sslRead( OpensslParams_t * pOpensslParams,
+                        void * pBuffer,
+                        size_t bufferLength,
+                        size_t bytesToRecv )
+{
+    int32_t bytesReceived = 0;
+    int32_t pollStatus = 1, readStatus = 1, sslError = 0;
+    uint8_t shouldRead = 0U, dataBuffered = 0U;
+    struct pollfd pollFds;
+
+    assert( pOpensslParams != NULL );
+    assert( pBuffer != NULL );
+
+    /* Initialize the file descriptor.
+     * #POLLPRI corresponds to high-priority data while #POLLIN corresponds
+     * to any other data that may be read. */
+    pollFds.events = POLLIN | POLLPRI;
+    pollFds.revents = 0;
+    /* Set the file descriptor for poll. */
+    pollFds.fd = pOpensslParams->socketDescriptor;
+
+    /* #SSL_pending returns a value > 0 if application data
+     * from the last processed TLS record remains to be read. With read-ahead
+     * enabled, OpenSSL may also hold whole records that are not processed
+     * yet, which only #SSL_has_pending reports. */
+    if( ( bytesToRecv == 1 ) && ( pOpensslParams->pReadAheadBuffer != NULL ) )
+    {
+        dataBuffered = ( SSL_has_pending( pOpensslParams->pSsl ) == 1 ) ? 1U : 0U;
+    }
+    else if( bytesToRecv == 1 )
+    {
+        dataBuffered = ( SSL_pending( pOpensslParams->pSsl ) > 0 ) ? 1U : 0U;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    /* This implementation will ALWAYS block when the number of bytes
+     * requested is greater than 1. Otherwise, poll the socket first
+     * as blocking may negatively impact performance by waiting for the
+     * entire duration of the socket timeout even when no data is available. */
+    if( ( bytesToRecv > 1 ) || ( dataBuffered == 1U ) )
+    {
+        shouldRead = 1U;
+    }
+    else
+    {
+        /* Speculative read for the start of a payload.
+         * Note: This is done to avoid blocking when no
+         * data is available to be read from the socket. */
+        pollStatus = poll( &pollFds, 1, 0 );
+    }
+
+    if( pollStatus < 0 )
+    {
+        bytesReceived = -1;
+    }
+    else if( pollStatus == 0 )
+    {
+        /* No data available to be read from the socket. */
+        bytesReceived = 0;
+    }
+    else
+    {
+        shouldRead = 1U;
+    }
+
+    if( shouldRead == 1U )
+    {
+        /* Blocking SSL read of data.
+         * Note: The TLS record may only be partially received or unprocessed,
+         * so it is possible that no processed application data is returned
+         * even though the socket has data available to be read. */
+        readStatus = ( int32_t ) SSL_read( pOpensslParams->pSsl, pBuffer,
+                                           ( int32_t ) bufferLength );
+
+        /* Successfully read of application data. */
+        if( readStatus > 0 )
+        {
+            bytesReceived = readStatus;
+        }
+    }
+
+    /* Handle error return status if transport read did not succeed. */
+    if( readStatus <= 0 )
+    {
+        sslError = SSL_get_error( pOpensslParams->pSsl, readStatus );
+
+        if( sslError == SSL_ERROR_WANT_READ )
+        {
+            /* The OpenSSL documentation mentions that SSL_Read can provide a
+             * return code of SSL_ERROR_WANT_READ in blocking mode, if the SSL
+             * context is not configured with with the SSL_MODE_AUTO_RETRY. This
+             * error code means that the SSL_read() operation needs to be retried
+             * to complete the read operation. Thus, setting the return value of
+             * this function as zero to represent that no data was received from
+             * the network. */
+            bytesReceived = 0;
+        }
+        else
+        {
+            LogError( ( "Failed to receive data over network: SSL_read failed: "
+                        "ErrorStatus=%s.",
+                        ERR_reason_error_string( sslError ) ) );
+
+            /* The transport interface requires zero return code only when the
+             * receive operation can be retried to achieve success. Thus, convert
+             * a zero error code to a negative return value as this cannot be
+             * retried. */
+            bytesReceived = -1;
+        }
+    }
+
+    return bytesReceived;
+}
+/*-----------------------------------------------------------*/
+
+static size_t consumeReadAhead( OpensslParams_t * pOpensslParams,
+                                void * pBuffer,
+                                size_t bytesToRecv )
+{
+    size_t bytesCopied = bytesToRecv;
+
+    assert( pOpensslParams != NULL );
+    assert( pBuffer != NULL );
+
+    if( bytesCopied > pOpensslParams->readAheadLength )
+    {
+        bytesCopied = pOpensslParams->readAheadLength;
+    }
+
+    ( void ) memcpy( pBuffer,
+                     &pOpensslParams->pReadAheadBuffer[ pOpensslParams->readAheadOffset ],
+                     bytesCopied );
+    pOpensslParams->readAheadOffset += bytesCopied;
+    pOpensslParams->readAheadLength -= bytesCopied;
+
+    if( pOpensslParams->readAheadLength == 0U )
+    {
+        pOpensslParams->readAheadOffset = 0U;
+    }
+
+    return bytesCopied;
+}
+/*-----------------------------------------------------------*/
+
 /* MISRA Rule 8.13 flags the following line for not using the const qualifier
  * on `pNetworkContext`. Indeed, the object pointed by it is not modified
  * by OpenSSL, but other implementations of `TransportRecv_t` may do so. */
@@ -761,102 +2043,320 @@ int32_t Openssl_Recv( NetworkContext_t * pNetworkContext,
     }
     else
     {
-        int32_t pollStatus = 1, readStatus = 1, sslError = 0;
-        uint8_t shouldRead = 0U;
-        struct pollfd pollFds;
-        pOpensslParams = pNetworkContext->pParams;
+        uint64_t startUs;
 
-        /* Initialize the file descriptor.
-         * #POLLPRI corresponds to high-priority data while #POLLIN corresponds
-         * to any other data that may be read. */
-        pollFds.events = POLLIN | POLLPRI;
-        pollFds.revents = 0;
-        /* Set the file descriptor for poll. */
-        pollFds.fd = pOpensslParams->socketDescriptor;
+        pOpensslParams = pNetworkContext->pParams;
+        startUs = TransportMetrics_Start( pOpensslParams->pMetrics );
 
-        /* #SSL_pending returns a value > 0 if application data
-         * from the last processed TLS record remains to be read.
-         * This implementation will ALWAYS block when the number of bytes
-         * requested is greater than 1. Otherwise, poll the socket first
-         * as blocking may negatively impact performance by waiting for the
-         * entire duration of the socket timeout even when no data is available. */
-        if( ( bytesToRecv > 1 ) || ( SSL_pending( pOpensslParams->pSsl ) > 0 ) )
+        if( isHandshakePending( pOpensslParams ) &&
+            ( finishHandshake( pOpensslParams ) != OPENSSL_SUCCESS ) )
         {
-            shouldRead = 1U;
+            /* The response to the early data needs a complete handshake. */
+            bytesReceived = -1;
+        }
+        else if( pOpensslParams->readAheadLength > 0U )
+        {
+            /* Serve the request from data buffered by an earlier call. A
+             * short read is allowed by the transport interface. */
+            bytesReceived = ( int32_t ) consumeReadAhead( pOpensslParams, pBuffer, bytesToRecv );
+        }
+        else if( ( pOpensslParams->pReadAheadBuffer != NULL ) &&
+                 ( bytesToRecv < pOpensslParams->readAheadBufferSize ) )
+        {
+            /* Read as much of the available TLS record as fits, and hand out
+             * the requested bytes from the read-ahead buffer. */
+            bytesReceived = sslRead( pOpensslParams,
+                                     pOpensslParams->pReadAheadBuffer,
+                                     pOpensslParams->readAheadBufferSize,
+                                     bytesToRecv );
+
+            if( bytesReceived > 0 )
+            {
+                pOpensslParams->readAheadOffset = 0U;
+                pOpensslParams->readAheadLength = ( size_t ) bytesReceived;
+                bytesReceived = ( int32_t ) consumeReadAhead( pOpensslParams, pBuffer, bytesToRecv );
+            }
         }
         else
         {
-            /* Speculative read for the start of a payload.
-             * Note: This is done to avoid blocking when no
-             * data is available to be read from the socket. */
-            pollStatus = poll( &pollFds, 1, 0 );
+            bytesReceived = sslRead( pOpensslParams, pBuffer, bytesToRecv, bytesToRecv );
         }
 
-        if( pollStatus < 0 )
+        TransportMetrics_RecordRecv( pOpensslParams->pMetrics,
+                                     TransportMetrics_ResultOf( bytesReceived ),
+                                     ( bytesReceived > 0 ) ? ( size_t ) bytesReceived : 0U,
+                                     startUs );
+    }
+
+    return bytesReceived;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t copyToFile( OpensslParams_t * pOpensslParams,
+                           int32_t fileDescriptor,
+                           off_t offset,
+                           size_t bytesToRecv )
+{
+    uint8_t buffer[ OPENSSL_RECV_TO_FILE_CHUNK_SIZE ];
+    size_t length = ( bytesToRecv < sizeof( buffer ) ) ? bytesToRecv : sizeof( buffer );
+    int32_t bytesReceived = 0;
+    size_t bytesWritten = 0U;
+    ssize_t writeSize = 0;
+
+    if( pOpensslParams->readAheadLength > 0U )
+    {
+        bytesReceived = ( int32_t ) consumeReadAhead( pOpensslParams, buffer, length );
+    }
+    else
+    {
+        bytesReceived = sslRead( pOpensslParams, buffer, length, length );
+    }
+
+    while( ( bytesReceived > 0 ) && ( bytesWritten < ( size_t ) bytesReceived ) )
+    {
+        writeSize = pwrite( fileDescriptor, &buffer[ bytesWritten ],
+                            ( size_t ) bytesReceived - bytesWritten,
+                            offset + ( off_t ) bytesWritten );
+
+        if( writeSize > 0 )
         {
+            bytesWritten += ( size_t ) writeSize;
+        }
+        else
+        {
+            LogError( ( "Failed to write received data to file: errno=%d.", errno ) );
             bytesReceived = -1;
         }
-        else if( pollStatus == 0 )
+    }
+
+    return bytesReceived;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t spliceToFile( const OpensslParams_t * pOpensslParams,
+                             const int pPipe[ 2 ],
+                             int32_t fileDescriptor,
+                             off_t offset,
+                             size_t bytesToRecv,
+                             bool * pNotData )
+{
+    size_t length = ( bytesToRecv < OPENSSL_RECV_TO_FILE_CHUNK_SIZE ) ?
+                    bytesToRecv : OPENSSL_RECV_TO_FILE_CHUNK_SIZE;
+    int32_t bytesReceived = 0;
+    size_t bytesWritten = 0U;
+    ssize_t spliceSize = 0;
+    loff_t fileOffset = ( loff_t ) offset;
+
+    /* The kernel returns the plaintext of at most one record. It honours the
+     * receive timeout of the socket. */
+    spliceSize = splice( pOpensslParams->socketDescriptor, NULL, pPipe[ 1 ], NULL,
+                         length, SPLICE_F_MOVE );
+
+    if( spliceSize > 0 )
+    {
+        bytesReceived = ( int32_t ) spliceSize;
+    }
+    else if( ( spliceSize < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) )
+    {
+        /* No data before the receive timeout. */
+        bytesReceived = 0;
+    }
+    else if( ( spliceSize < 0 ) && ( ( errno == EINVAL ) || ( errno == EIO ) ) )
+    {
+        /* A record such as a new session ticket or a key update, which
+         * SSL_read handles. */
+        *pNotData = true;
+    }
+    else
+    {
+        LogError( ( "Failed to splice TLS data from the socket: errno=%d.",
+                    ( spliceSize == 0 ) ? 0 : errno ) );
+        bytesReceived = -1;
+    }
+
+    /* The data is in the pipe now, so it must reach the file. */
+    while( ( bytesReceived > 0 ) && ( bytesWritten < ( size_t ) bytesReceived ) )
+    {
+        spliceSize = splice( pPipe[ 0 ], NULL, fileDescriptor, &fileOffset,
+                             ( size_t ) bytesReceived - bytesWritten, SPLICE_F_MOVE );
+
+        if( spliceSize > 0 )
         {
-            /* No data available to be read from the socket. */
-            bytesReceived = 0;
+            bytesWritten += ( size_t ) spliceSize;
         }
         else
         {
-            shouldRead = 1U;
+            LogError( ( "Failed to splice received data into the file: errno=%d.", errno ) );
+            bytesReceived = -1;
         }
+    }
+
+    return bytesReceived;
+}
+/*-----------------------------------------------------------*/
+
+int32_t Openssl_RecvToFile( NetworkContext_t * pNetworkContext,
+                            int32_t fileDescriptor,
+                            off_t offset,
+                            size_t bytesToRecv )
+{
+    OpensslParams_t * pOpensslParams = NULL;
+    int32_t bytesReceived = 0, chunkStatus = 1;
+    size_t totalReceived = 0U;
+    int pipeFds[ 2 ] = { -1, -1 };
+    bool kernelRecv = false, useSplice = false, notData = false;
+    uint64_t startUs = 0U;
+
+    if( !isValidNetworkContext( pNetworkContext ) ||
+        ( fileDescriptor < 0 ) ||
+        ( offset < 0 ) ||
+        ( bytesToRecv == 0U ) ||
+        ( bytesToRecv > ( size_t ) INT32_MAX ) )
+    {
+        LogError( ( "Parameter check failed: invalid input, pNetworkContext is invalid or "
+                    "fileDescriptor = %d, bytesToRecv = %lu",
+                    ( int ) fileDescriptor, ( unsigned long ) bytesToRecv ) );
+        bytesReceived = -1;
+    }
+    else
+    {
+        pOpensslParams = pNetworkContext->pParams;
+        startUs = TransportMetrics_Start( pOpensslParams->pMetrics );
 
-        if( shouldRead == 1U )
+        if( isHandshakePending( pOpensslParams ) &&
+            ( finishHandshake( pOpensslParams ) != OPENSSL_SUCCESS ) )
         {
-            /* Blocking SSL read of data.
-             * Note: The TLS record may only be partially received or unprocessed,
-             * so it is possible that no processed application data is returned
-             * even though the socket has data available to be read. */
-            readStatus = ( int32_t ) SSL_read( pOpensslParams->pSsl, pBuffer,
-                                               ( int32_t ) bytesToRecv );
+            chunkStatus = -1;
+        }
 
-            /* Successfully read of application data. */
-            if( readStatus > 0 )
-            {
-                bytesReceived = readStatus;
-            }
+        /* Splice only if the kernel decrypts the records. Without a pipe, the
+         * data is copied. */
+        if( ( chunkStatus > 0 ) &&
+            ( BIO_get_ktls_recv( SSL_get_rbio( pOpensslParams->pSsl ) ) != 0 ) )
+        {
+            kernelRecv = ( pipe2( pipeFds, O_CLOEXEC ) == 0 );
         }
 
-        /* Handle error return status if transport read did not succeed. */
-        if( readStatus <= 0 )
+        while( ( chunkStatus > 0 ) && ( totalReceived < bytesToRecv ) )
         {
-            sslError = SSL_get_error( pOpensslParams->pSsl, readStatus );
+            /* Data OpenSSL already decrypted comes before the socket's. */
+            useSplice = kernelRecv &&
+                        ( pOpensslParams->readAheadLength == 0U ) &&
+                        ( SSL_pending( pOpensslParams->pSsl ) == 0 );
+            notData = false;
 
-            if( sslError == SSL_ERROR_WANT_READ )
+            if( useSplice )
             {
-                /* The OpenSSL documentation mentions that SSL_Read can provide a
-                 * return code of SSL_ERROR_WANT_READ in blocking mode, if the SSL
-                 * context is not configured with with the SSL_MODE_AUTO_RETRY. This
-                 * error code means that the SSL_read() operation needs to be retried
-                 * to complete the read operation. Thus, setting the return value of
-                 * this function as zero to represent that no data was received from
-                 * the network. */
-                bytesReceived = 0;
+                chunkStatus = spliceToFile( pOpensslParams, pipeFds, fileDescriptor,
+                                            offset + ( off_t ) totalReceived,
+                                            bytesToRecv - totalReceived, &notData );
             }
-            else
+
+            if( !useSplice || notData )
             {
-                LogError( ( "Failed to receive data over network: SSL_read failed: "
-                            "ErrorStatus=%s.",
-                            ERR_reason_error_string( sslError ) ) );
+                chunkStatus = copyToFile( pOpensslParams, fileDescriptor,
+                                          offset + ( off_t ) totalReceived,
+                                          bytesToRecv - totalReceived );
+            }
 
-                /* The transport interface requires zero return code only when the
-                 * receive operation can be retried to achieve success. Thus, convert
-                 * a zero error code to a negative return value as this cannot be
-                 * retried. */
-                bytesReceived = -1;
+            if( chunkStatus > 0 )
+            {
+                totalReceived += ( size_t ) chunkStatus;
             }
         }
+
+        if( kernelRecv )
+        {
+            ( void ) close( pipeFds[ 0 ] );
+            ( void ) close( pipeFds[ 1 ] );
+        }
+
+        /* Bytes already in the file are reported; an error ends the next call. */
+        bytesReceived = ( totalReceived > 0U ) ? ( int32_t ) totalReceived : chunkStatus;
+
+        TransportMetrics_RecordRecv( pOpensslParams->pMetrics,
+                                     TransportMetrics_ResultOf( bytesReceived ),
+                                     totalReceived,
+                                     startUs );
     }
 
     return bytesReceived;
 }
 /*-----------------------------------------------------------*/
 
+static int32_t sslWrite( const OpensslParams_t * pOpensslParams,
+                         const void * pBuffer,
+                         size_t bytesToSend )
+{
+    int32_t bytesSent = 0;
+    int32_t pollStatus;
+    struct pollfd pollFds;
+
+    assert( pOpensslParams != NULL );
+    assert( pBuffer != NULL );
+
+    /* Initialize the file descriptor. */
+    pollFds.events = POLLOUT;
+    pollFds.revents = 0;
+    /* Set the file descriptor for poll. */
+    pollFds.fd = pOpensslParams->socketDescriptor;
+
+    /* `poll` checks if the socket is ready to send data.
+     * Note: This is done to avoid blocking on SSL_write()
+     * when TCP socket is not ready to accept more data for
+     * network transmission (possibly due to a full TX buffer). */
+    pollStatus = poll( &pollFds, 1, 0 );
+
+    if( pollStatus > 0 )
+    {
+        /* SSL write of data. */
+        bytesSent = ( int32_t ) SSL_write( pOpensslParams->pSsl, pBuffer,
+                                           ( int32_t ) bytesToSend );
+
+        if( bytesSent <= 0 )
+        {
+            LogError(
+                ( "Failed to send data over network: SSL_write of OpenSSL failed: "
+                  "ErrorStatus=%s.",
+                  ERR_reason_error_string( SSL_get_error( pOpensslParams->pSsl, bytesSent ) ) ) );
+
+            /* As the SSL context is configured for blocking mode, the SSL_write()
+             * function does not return an SSL_ERROR_WANT_READ or
+             * SSL_ERROR_WANT_WRITE error code. The SSL_ERROR_WANT_READ and
+             * SSL_ERROR_WANT_WRITE error codes signify that the write operation can
+             * be retried. However, in the blocking mode, as the SSL_write()
+             * function does not return either of the error codes, we cannot retry
+             * the operation on failure, and thus, this function will never return a
+             * zero error code.
+             */
+
+            /* The transport interface requires zero return code only when the send
+             * operation can be retried to achieve success. Thus, convert a zero
+             * error code to a negative return value as this cannot be retried. */
+            if( bytesSent == 0 )
+            {
+                bytesSent = -1;
+            }
+        }
+    }
+    else if( pollStatus < 0 )
+    {
+        /* An error occurred while polling. */
+        LogError( ( "Unable to send TLS data on network: "
+                    "An error occurred while checking availability of TCP socket %d.",
+                    pOpensslParams->socketDescriptor ) );
+        bytesSent = -1;
+    }
+    else
+    {
+        /* Socket is not available for sending data. Set return code for retrying send. */
+        bytesSent = 0;
+    }
+
+    return bytesSent;
+}
+/*-----------------------------------------------------------*/
+
 /* MISRA Rule 8.13 flags the following line for not using the const qualifier
  * on `pNetworkContext`. Indeed, the object pointed by it is not modified
  * by OpenSSL, but other implementations of `TransportSend_t` may do so. */
@@ -876,68 +2376,27 @@ int32_t Openssl_Send( NetworkContext_t * pNetworkContext,
     }
     else
     {
-        struct pollfd pollFds;
-        int32_t pollStatus;
+        uint64_t startUs;
 
         pOpensslParams = pNetworkContext->pParams;
+        startUs = TransportMetrics_Start( pOpensslParams->pMetrics );
 
-        /* Initialize the file descriptor. */
-        pollFds.events = POLLOUT;
-        pollFds.revents = 0;
-        /* Set the file descriptor for poll. */
-        pollFds.fd = pOpensslParams->socketDescriptor;
-
-        /* `poll` checks if the socket is ready to send data.
-         * Note: This is done to avoid blocking on SSL_write()
-         * when TCP socket is not ready to accept more data for
-         * network transmission (possibly due to a full TX buffer). */
-        pollStatus = poll( &pollFds, 1, 0 );
-
-        if( pollStatus > 0 )
-        {
-            /* SSL write of data. */
-            bytesSent = ( int32_t ) SSL_write( pOpensslParams->pSsl, pBuffer,
-                                               ( int32_t ) bytesToSend );
-
-            if( bytesSent <= 0 )
-            {
-                LogError(
-                    ( "Failed to send data over network: SSL_write of OpenSSL failed: "
-                      "ErrorStatus=%s.",
-                      ERR_reason_error_string( SSL_get_error( pOpensslParams->pSsl, bytesSent ) ) ) );
-
-                /* As the SSL context is configured for blocking mode, the SSL_write()
-                 * function does not return an SSL_ERROR_WANT_READ or
-                 * SSL_ERROR_WANT_WRITE error code. The SSL_ERROR_WANT_READ and
-                 * SSL_ERROR_WANT_WRITE error codes signify that the write operation can
-                 * be retried. However, in the blocking mode, as the SSL_write()
-                 * function does not return either of the error codes, we cannot retry
-                 * the operation on failure, and thus, this function will never return a
-                 * zero error code.
-                 */
-
-                /* The transport interface requires zero return code only when the send
-                 * operation can be retried to achieve success. Thus, convert a zero
-                 * error code to a negative return value as this cannot be retried. */
-                if( bytesSent == 0 )
-                {
-                    bytesSent = -1;
-                }
-            }
-        }
-        else if( pollStatus < 0 )
+        /* While the handshake is deferred, the packet is either sent early or
+         * completes the handshake and is then sent normally. */
+        if( isHandshakePending( pOpensslParams ) )
         {
-            /* An error occurred while polling. */
-            LogError( ( "Unable to send TLS data on network: "
-                        "An error occurred while checking availability of TCP socket %d.",
-                        pOpensslParams->socketDescriptor ) );
-            bytesSent = -1;
+            bytesSent = sendEarlyData( pOpensslParams, pBuffer, bytesToSend );
         }
-        else
+
+        if( ( bytesSent == 0 ) && !isHandshakePending( pOpensslParams ) )
         {
-            /* Socket is not available for sending data. Set return code for retrying send. */
-            bytesSent = 0;
+            bytesSent = sslWrite( pOpensslParams, pBuffer, bytesToSend );
         }
+
+        TransportMetrics_RecordSend( pOpensslParams->pMetrics,
+                                     TransportMetrics_ResultOf( bytesSent ),
+                                     ( bytesSent > 0 ) ? ( size_t ) bytesSent : 0U,
+                                     startUs );
     }
 
     return bytesSent;
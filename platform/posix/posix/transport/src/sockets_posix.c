@@ -22,11 +22,16 @@
 
 /* Standard includes. */
 #include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* POSIX sockets includes. */
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
@@ -47,6 +52,71 @@
  */
 #define ONE_MS_TO_US     ( 1000 )
 
+/**
+ * @brief Number of nanoseconds in one millisecond.
+ */
+#define ONE_MS_TO_NS     ( 1000000 )
+
+/**
+ * @brief Number of host names whose resolved addresses are cached once
+ * #Sockets_SetDnsCacheTtl enables the cache. The least recently used unused
+ * entry is evicted once the cache is full.
+ */
+#ifndef SOCKETS_DNS_CACHE_SIZE
+    #define SOCKETS_DNS_CACHE_SIZE          8U
+#endif
+
+/**
+ * @brief Number of resolved addresses raced against each other once
+ * #Sockets_SetConnectAttemptDelay enables parallel connects. Further
+ * addresses are not tried.
+ */
+#ifndef SOCKETS_MAX_CONNECT_ATTEMPTS
+    #define SOCKETS_MAX_CONNECT_ATTEMPTS    8U
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Addresses resolved for a host name.
+ */
+typedef struct DnsCacheEntry
+{
+    char * pHostName;              /**< @brief NULL-terminated copy of the host name; NULL when the slot is free. */
+    struct addrinfo * pAddresses;  /**< @brief Result of getaddrinfo, owned by the entry. */
+    uint64_t expiresMs;            /**< @brief Monotonic time after which the entry is resolved again. */
+    uint64_t lastUsed;             /**< @brief Value of #dnsCacheClock at the last lookup. */
+    uint32_t users;                /**< @brief Connects currently walking #DnsCacheEntry_t.pAddresses. */
+    bool stale;                    /**< @brief Set to free the entry once it has no users. */
+} DnsCacheEntry_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Resolved addresses shared between connects, guarded by #dnsCacheMutex.
+ */
+static DnsCacheEntry_t dnsCache[ SOCKETS_DNS_CACHE_SIZE ];
+
+/**
+ * @brief Monotonic lookup counter used to pick the least recently used entry.
+ */
+static uint64_t dnsCacheClock = 0U;
+
+/**
+ * @brief Lifetime of a cached DNS result; 0 disables the cache.
+ */
+static uint32_t dnsCacheTtlMs = 0U;
+
+/**
+ * @brief Delay before racing the next address; 0 tries addresses one by one.
+ */
+static uint32_t connectAttemptDelayMs = 0U;
+
+/**
+ * @brief Mutex guarding #dnsCache, #dnsCacheClock and the connect settings.
+ */
+static pthread_mutex_t dnsCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -63,6 +133,76 @@ static SocketStatus_t resolveHostName( const char * pHostName,
                                        size_t hostNameLength,
                                        struct addrinfo ** pListHead );
 
+/**
+ * @brief Resolve a host name through the DNS cache when it is enabled.
+ *
+ * @param[in] pServerInfo Server connection info.
+ * @param[out] pListHead The output parameter to return the list containing
+ * resolved DNS records.
+ * @param[out] pCacheEntry The cache entry holding the list, or NULL if the
+ * list is owned by the caller.
+ *
+ * @return #SOCKETS_SUCCESS if successful; #SOCKETS_DNS_FAILURE, #SOCKETS_CONNECT_FAILURE on error.
+ */
+static SocketStatus_t resolveAddresses( const ServerInfo_t * pServerInfo,
+                                        struct addrinfo ** pListHead,
+                                        DnsCacheEntry_t ** pCacheEntry );
+
+/**
+ * @brief Release the records returned by #resolveAddresses.
+ *
+ * @param[in] pListHead List containing resolved DNS records.
+ * @param[in] pCacheEntry The cache entry holding the list, or NULL.
+ * @param[in] connected Whether a connection to one of the records succeeded.
+ * A cached list that failed on every record is resolved again next time.
+ */
+static void releaseAddresses( struct addrinfo * pListHead,
+                              DnsCacheEntry_t * pCacheEntry,
+                              bool connected );
+
+/**
+ * @brief Find a valid cache entry for a host name.
+ *
+ * @param[in] pHostName Server host name.
+ * @param[in] hostNameLength Length associated with host name.
+ * @param[in] nowMs Current monotonic time.
+ *
+ * @return The entry, or NULL if the host name is not cached.
+ */
+static DnsCacheEntry_t * findDnsCacheEntry( const char * pHostName,
+                                            size_t hostNameLength,
+                                            uint64_t nowMs );
+
+/**
+ * @brief Store freshly resolved records in the cache.
+ *
+ * @param[in] pHostName Server host name.
+ * @param[in] hostNameLength Length associated with host name.
+ * @param[in] pListHead List containing resolved DNS records.
+ * @param[in] expiresMs Monotonic time at which the entry expires.
+ *
+ * @return The entry now owning @p pListHead with one user, or NULL if no
+ * entry could be freed.
+ */
+static DnsCacheEntry_t * insertDnsCacheEntry( const char * pHostName,
+                                              size_t hostNameLength,
+                                              struct addrinfo * pListHead,
+                                              uint64_t expiresMs );
+
+/**
+ * @brief Free the records and host name of a cache entry.
+ *
+ * @param[in] pEntry The entry to clear.
+ */
+static void releaseDnsCacheEntry( DnsCacheEntry_t * pEntry );
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return Time in milliseconds.
+ */
+static uint64_t getTimeMs( void );
+
 /**
  * @brief Traverse list of DNS records until a connection is established.
  *
@@ -74,24 +214,65 @@ static SocketStatus_t resolveHostName( const char * pHostName,
  *
  * @return #SOCKETS_SUCCESS if successful; #SOCKETS_CONNECT_FAILURE on error.
  */
-static SocketStatus_t attemptConnection( struct addrinfo * pListHead,
+static SocketStatus_t attemptConnection( const struct addrinfo * pListHead,
                                          const char * pHostName,
                                          size_t hostNameLength,
                                          uint16_t port,
                                          int32_t * pTcpSocket );
 
+/**
+ * @brief Connect to the DNS records in parallel, RFC 8305 style.
+ *
+ * Records of the two address families are interleaved. Each attempt gets
+ * @p attemptDelayMs to complete before the next one is started alongside it,
+ * and a failed attempt starts the next one at once. The first connected
+ * socket wins and the other attempts are closed.
+ *
+ * @param[in] pListHead List containing resolved DNS records.
+ * @param[in] pHostName Server host name.
+ * @param[in] hostNameLength Length associated with host name.
+ * @param[in] port Server port in host-order.
+ * @param[in] attemptDelayMs Delay before starting the next attempt.
+ * @param[out] pTcpSocket The output parameter to return the created socket.
+ *
+ * @return #SOCKETS_SUCCESS if successful; #SOCKETS_CONNECT_FAILURE on error.
+ */
+static SocketStatus_t attemptParallelConnection( const struct addrinfo * pListHead,
+                                                 const char * pHostName,
+                                                 size_t hostNameLength,
+                                                 uint16_t port,
+                                                 uint32_t attemptDelayMs,
+                                                 int32_t * pTcpSocket );
+
+/**
+ * @brief Interleave the DNS records of the two address families.
+ *
+ * @param[in] pListHead List containing resolved DNS records.
+ * @param[out] pOrdered Records in the order to try them, up to
+ * #SOCKETS_MAX_CONNECT_ATTEMPTS.
+ *
+ * @return Number of records written to @p pOrdered.
+ */
+static size_t orderAddresses( const struct addrinfo * pListHead,
+                              const struct addrinfo ** pOrdered );
+
 /**
  * @brief Connect to server using the provided address record.
  *
- * @param[in, out] pAddrInfo Address record of the server.
+ * @param[in] pAddrInfo Address record of the server. It is not modified, so
+ * cached records can be shared by concurrent connects.
  * @param[in] port Server port in host-order.
  * @param[in] pTcpSocket Socket handle.
+ * @param[out] pInProgress For a non-blocking socket, set to true when the
+ * connect is still in progress. NULL for a blocking socket.
  *
- * @return #SOCKETS_SUCCESS if successful; #SOCKETS_CONNECT_FAILURE on error.
+ * @return #SOCKETS_SUCCESS if successful or in progress; #SOCKETS_CONNECT_FAILURE
+ * on error, in which case the socket has been closed.
  */
-static SocketStatus_t connectToAddress( struct sockaddr * pAddrInfo,
+static SocketStatus_t connectToAddress( const struct sockaddr * pAddrInfo,
                                         uint16_t port,
-                                        int32_t tcpSocket );
+                                        int32_t tcpSocket,
+                                        bool * pInProgress );
 
 /**
  * @brief Log possible error using errno and return appropriate status.
@@ -143,15 +324,17 @@ static SocketStatus_t resolveHostName( const char * pHostName,
 }
 /*-----------------------------------------------------------*/
 
-static SocketStatus_t connectToAddress( struct sockaddr * pAddrInfo,
+static SocketStatus_t connectToAddress( const struct sockaddr * pAddrInfo,
                                         uint16_t port,
-                                        int32_t tcpSocket )
+                                        int32_t tcpSocket,
+                                        bool * pInProgress )
 {
     SocketStatus_t returnStatus = SOCKETS_SUCCESS;
     int32_t connectStatus = 0;
     char resolvedIpAddr[ INET6_ADDRSTRLEN ];
     socklen_t addrInfoLength;
     uint16_t netPort = 0;
+    struct sockaddr_storage address;
     struct sockaddr_in * pIpv4Address;
     struct sockaddr_in6 * pIpv6Address;
 
@@ -164,16 +347,18 @@ static SocketStatus_t connectToAddress( struct sockaddr * pAddrInfo,
 
     if( pAddrInfo->sa_family == ( sa_family_t ) AF_INET )
     {
+        addrInfoLength = ( socklen_t ) sizeof( struct sockaddr_in );
+        ( void ) memcpy( &address, pAddrInfo, sizeof( struct sockaddr_in ) );
+
         /* MISRA Rule 11.3 flags the following line for casting a pointer of
          * a object type to a pointer of a different object type. This rule
-         * is suppressed because casting from a struct sockaddr pointer to
-         * a struct sockaddr_in pointer is supported in POSIX and is used
+         * is suppressed because casting from a struct sockaddr_storage pointer
+         * to a struct sockaddr_in pointer is supported in POSIX and is used
          * to obtain the IP address from the address record. */
         /* coverity[misra_c_2012_rule_11_3_violation] */
-        pIpv4Address = ( struct sockaddr_in * ) pAddrInfo;
+        pIpv4Address = ( struct sockaddr_in * ) &address;
         /* Store IPv4 in string to log. */
         pIpv4Address->sin_port = netPort;
-        addrInfoLength = ( socklen_t ) sizeof( struct sockaddr_in );
         ( void ) inet_ntop( ( int32_t ) pAddrInfo->sa_family,
                             &pIpv4Address->sin_addr,
                             resolvedIpAddr,
@@ -181,16 +366,18 @@ static SocketStatus_t connectToAddress( struct sockaddr * pAddrInfo,
     }
     else
     {
+        addrInfoLength = ( socklen_t ) sizeof( struct sockaddr_in6 );
+        ( void ) memcpy( &address, pAddrInfo, sizeof( struct sockaddr_in6 ) );
+
         /* MISRA Rule 11.3 flags the following line for casting a pointer of
          * a object type to a pointer of a different object type. This rule
-         * is suppressed because casting from a struct sockaddr pointer to
-         * a struct sockaddr_in6 pointer is supported in POSIX and is used
+         * is suppressed because casting from a struct sockaddr_storage pointer
+         * to a struct sockaddr_in6 pointer is supported in POSIX and is used
          * to obtain the IPv6 address from the address record. */
         /* coverity[misra_c_2012_rule_11_3_violation] */
-        pIpv6Address = ( struct sockaddr_in6 * ) pAddrInfo;
+        pIpv6Address = ( struct sockaddr_in6 * ) &address;
         /* Store IPv6 in string to log. */
         pIpv6Address->sin6_port = netPort;
-        addrInfoLength = ( socklen_t ) sizeof( struct sockaddr_in6 );
         ( void ) inet_ntop( ( int32_t ) pAddrInfo->sa_family,
                             &pIpv6Address->sin6_addr,
                             resolvedIpAddr,
@@ -202,21 +389,220 @@ static SocketStatus_t connectToAddress( struct sockaddr * pAddrInfo,
                 resolvedIpAddr ) );
 
     /* Attempt to connect. */
-    connectStatus = connect( tcpSocket, pAddrInfo, addrInfoLength );
+    connectStatus = connect( tcpSocket, ( struct sockaddr * ) &address, addrInfoLength );
 
-    if( connectStatus == -1 )
+    if( ( connectStatus == -1 ) && ( pInProgress != NULL ) && ( errno == EINPROGRESS ) )
+    {
+        *pInProgress = true;
+    }
+    else if( connectStatus == -1 )
     {
         LogWarn( ( "Failed to connect to server using the resolved IP address: IP address=%s.",
                    resolvedIpAddr ) );
         ( void ) close( tcpSocket );
         returnStatus = SOCKETS_CONNECT_FAILURE;
     }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t getTimeMs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * ( uint64_t ) ONE_SEC_TO_MS ) +
+           ( ( uint64_t ) now.tv_nsec / ( uint64_t ) ONE_MS_TO_NS );
+}
+/*-----------------------------------------------------------*/
+
+static DnsCacheEntry_t * findDnsCacheEntry( const char * pHostName,
+                                            size_t hostNameLength,
+                                            uint64_t nowMs )
+{
+    DnsCacheEntry_t * pFound = NULL;
+    DnsCacheEntry_t * pEntry = NULL;
+    size_t i;
+
+    for( i = 0U; ( i < SOCKETS_DNS_CACHE_SIZE ) && ( pFound == NULL ); i++ )
+    {
+        pEntry = &dnsCache[ i ];
+
+        if( ( pEntry->pHostName != NULL ) &&
+            ( pEntry->stale == false ) &&
+            ( nowMs < pEntry->expiresMs ) &&
+            ( strlen( pEntry->pHostName ) == hostNameLength ) &&
+            ( strncmp( pEntry->pHostName, pHostName, hostNameLength ) == 0 ) )
+        {
+            pFound = pEntry;
+        }
+    }
+
+    return pFound;
+}
+/*-----------------------------------------------------------*/
+
+static void releaseDnsCacheEntry( DnsCacheEntry_t * pEntry )
+{
+    assert( pEntry != NULL );
+    assert( pEntry->users == 0U );
+
+    if( pEntry->pAddresses != NULL )
+    {
+        freeaddrinfo( pEntry->pAddresses );
+    }
+
+    free( pEntry->pHostName );
+    ( void ) memset( pEntry, 0, sizeof( DnsCacheEntry_t ) );
+}
+/*-----------------------------------------------------------*/
+
+static DnsCacheEntry_t * insertDnsCacheEntry( const char * pHostName,
+                                              size_t hostNameLength,
+                                              struct addrinfo * pListHead,
+                                              uint64_t expiresMs )
+{
+    DnsCacheEntry_t * pEntry = NULL;
+    size_t i;
+
+    ( void ) pthread_mutex_lock( &dnsCacheMutex );
+
+    /* Prefer a free slot, otherwise evict the least recently used entry that
+     * no connect is walking. */
+    for( i = 0U; i < SOCKETS_DNS_CACHE_SIZE; i++ )
+    {
+        if( dnsCache[ i ].pHostName == NULL )
+        {
+            pEntry = &dnsCache[ i ];
+            break;
+        }
+
+        if( ( dnsCache[ i ].users == 0U ) &&
+            ( ( pEntry == NULL ) || ( dnsCache[ i ].lastUsed < pEntry->lastUsed ) ) )
+        {
+            pEntry = &dnsCache[ i ];
+        }
+    }
+
+    if( pEntry != NULL )
+    {
+        releaseDnsCacheEntry( pEntry );
+        pEntry->pHostName = strndup( pHostName, hostNameLength );
+
+        if( pEntry->pHostName == NULL )
+        {
+            LogWarn( ( "Failed to allocate DNS cache entry; the result will not be cached." ) );
+            pEntry = NULL;
+        }
+        else
+        {
+            pEntry->pAddresses = pListHead;
+            pEntry->expiresMs = expiresMs;
+            pEntry->lastUsed = ++dnsCacheClock;
+            pEntry->users = 1U;
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+
+    return pEntry;
+}
+/*-----------------------------------------------------------*/
+
+static SocketStatus_t resolveAddresses( const ServerInfo_t * pServerInfo,
+                                        struct addrinfo ** pListHead,
+                                        DnsCacheEntry_t ** pCacheEntry )
+{
+    SocketStatus_t returnStatus = SOCKETS_SUCCESS;
+    DnsCacheEntry_t * pEntry = NULL;
+    uint32_t ttlMs = 0U;
+    uint64_t nowMs = 0U;
+
+    ( void ) pthread_mutex_lock( &dnsCacheMutex );
+
+    ttlMs = dnsCacheTtlMs;
+
+    if( ttlMs != 0U )
+    {
+        nowMs = getTimeMs();
+        pEntry = findDnsCacheEntry( pServerInfo->pHostName,
+                                    pServerInfo->hostNameLength,
+                                    nowMs );
+    }
+
+    /* The user count keeps the records alive while this connect walks them,
+     * even if the entry expires or is cleared meanwhile. */
+    if( pEntry != NULL )
+    {
+        pEntry->users++;
+        pEntry->lastUsed = ++dnsCacheClock;
+        *pListHead = pEntry->pAddresses;
+        LogDebug( ( "Using cached DNS records: Hostname=%.*s.",
+                    ( int32_t ) pServerInfo->hostNameLength,
+                    pServerInfo->pHostName ) );
+    }
+
+    ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+
+    if( pEntry == NULL )
+    {
+        returnStatus = resolveHostName( pServerInfo->pHostName,
+                                        pServerInfo->hostNameLength,
+                                        pListHead );
+
+        if( ( returnStatus == SOCKETS_SUCCESS ) && ( ttlMs != 0U ) )
+        {
+            pEntry = insertDnsCacheEntry( pServerInfo->pHostName,
+                                          pServerInfo->hostNameLength,
+                                          *pListHead,
+                                          nowMs + ttlMs );
+        }
+    }
+
+    *pCacheEntry = pEntry;
 
     return returnStatus;
 }
 /*-----------------------------------------------------------*/
 
-static SocketStatus_t attemptConnection( struct addrinfo * pListHead,
+static void releaseAddresses( struct addrinfo * pListHead,
+                              DnsCacheEntry_t * pCacheEntry,
+                              bool connected )
+{
+    if( pCacheEntry == NULL )
+    {
+        freeaddrinfo( pListHead );
+    }
+    else
+    {
+        ( void ) pthread_mutex_lock( &dnsCacheMutex );
+
+        pCacheEntry->users--;
+
+        /* None of the cached records accepted a connection, so they may be
+         * outdated after a server failover. */
+        if( connected == false )
+        {
+            pCacheEntry->stale = true;
+        }
+
+        if( ( pCacheEntry->stale == true ) && ( pCacheEntry->users == 0U ) )
+        {
+            releaseDnsCacheEntry( pCacheEntry );
+        }
+
+        ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static SocketStatus_t attemptConnection( const struct addrinfo * pListHead,
                                          const char * pHostName,
                                          size_t hostNameLength,
                                          uint16_t port,
@@ -251,7 +637,7 @@ static SocketStatus_t attemptConnection( struct addrinfo * pListHead,
         }
 
         /* Attempt to connect to a resolved DNS address of the host. */
-        returnStatus = connectToAddress( pIndex->ai_addr, port, *pTcpSocket );
+        returnStatus = connectToAddress( pIndex->ai_addr, port, *pTcpSocket, NULL );
 
         /* If connected to an IP address successfully, exit from the loop. */
         if( returnStatus == SOCKETS_SUCCESS )
@@ -273,7 +659,211 @@ static SocketStatus_t attemptConnection( struct addrinfo * pListHead,
                     pHostName ) );
     }
 
-    freeaddrinfo( pListHead );
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static size_t orderAddresses( const struct addrinfo * pListHead,
+                              const struct addrinfo ** pOrdered )
+{
+    const struct addrinfo * pPrimary = pListHead;
+    const struct addrinfo * pSecondary = pListHead;
+    int32_t primaryFamily = pListHead->ai_family;
+    bool takePrimary = true;
+    size_t count = 0U;
+
+    /* getaddrinfo already sorts the records by preference, so the family of
+     * the first record goes first and the families alternate from there. */
+    while( count < SOCKETS_MAX_CONNECT_ATTEMPTS )
+    {
+        while( ( pPrimary != NULL ) && ( pPrimary->ai_family != primaryFamily ) )
+        {
+            pPrimary = pPrimary->ai_next;
+        }
+
+        while( ( pSecondary != NULL ) && ( pSecondary->ai_family == primaryFamily ) )
+        {
+            pSecondary = pSecondary->ai_next;
+        }
+
+        if( ( pPrimary != NULL ) && ( ( takePrimary == true ) || ( pSecondary == NULL ) ) )
+        {
+            pOrdered[ count ] = pPrimary;
+            pPrimary = pPrimary->ai_next;
+        }
+        else if( pSecondary != NULL )
+        {
+            pOrdered[ count ] = pSecondary;
+            pSecondary = pSecondary->ai_next;
+        }
+        else
+        {
+            break;
+        }
+
+        count++;
+        takePrimary = !takePrimary;
+    }
+
+    return count;
+}
+/*-----------------------------------------------------------*/
+
+static SocketStatus_t attemptParallelConnection( const struct addrinfo * pListHead,
+                                                 const char * pHostName,
+                                                 size_t hostNameLength,
+                                                 uint16_t port,
+                                                 uint32_t attemptDelayMs,
+                                                 int32_t * pTcpSocket )
+{
+    SocketStatus_t returnStatus = SOCKETS_CONNECT_FAILURE;
+    const struct addrinfo * pOrdered[ SOCKETS_MAX_CONNECT_ATTEMPTS ];
+    struct pollfd attempts[ SOCKETS_MAX_CONNECT_ATTEMPTS ];
+    size_t addressCount = 0U, nextAddress = 0U, activeCount = 0U, i;
+    int32_t tcpSocket = -1, connectedSocket = -1, pollStatus = 0;
+    int32_t socketError = 0, flags = 0;
+    socklen_t errorLength = 0;
+    bool startNext = true, inProgress = false, pollFailed = false;
+
+    assert( pListHead != NULL );
+    assert( pHostName != NULL );
+    assert( hostNameLength > 0 );
+    assert( pTcpSocket != NULL );
+
+    /* Unused parameters when logging is disabled. */
+    ( void ) pHostName;
+    ( void ) hostNameLength;
+
+    LogDebug( ( "Attempting parallel connects to: Host=%.*s.",
+                ( int32_t ) hostNameLength,
+                pHostName ) );
+
+    addressCount = orderAddresses( pListHead, pOrdered );
+
+    while( ( connectedSocket < 0 ) && ( pollFailed == false ) &&
+           ( ( nextAddress < addressCount ) || ( activeCount > 0U ) ) )
+    {
+        if( ( nextAddress < addressCount ) && ( ( startNext == true ) || ( activeCount == 0U ) ) )
+        {
+            tcpSocket = socket( pOrdered[ nextAddress ]->ai_family,
+                                pOrdered[ nextAddress ]->ai_socktype | SOCK_NONBLOCK,
+                                pOrdered[ nextAddress ]->ai_protocol );
+
+            if( tcpSocket != -1 )
+            {
+                inProgress = false;
+
+                /* A failed attempt has been closed and the next one is
+                 * started at once. */
+                if( connectToAddress( pOrdered[ nextAddress ]->ai_addr,
+                                      port,
+                                      tcpSocket,
+                                      &inProgress ) == SOCKETS_SUCCESS )
+                {
+                    if( inProgress == true )
+                    {
+                        attempts[ activeCount ].fd = tcpSocket;
+                        attempts[ activeCount ].events = POLLOUT;
+                        attempts[ activeCount ].revents = 0;
+                        activeCount++;
+                        startNext = false;
+                    }
+                    else
+                    {
+                        connectedSocket = tcpSocket;
+                    }
+                }
+            }
+
+            nextAddress++;
+        }
+        else
+        {
+            /* Wait for an attempt to finish, or until the next one is due. */
+            pollStatus = poll( attempts,
+                               ( nfds_t ) activeCount,
+                               ( nextAddress < addressCount ) ? ( int32_t ) attemptDelayMs : -1 );
+
+            if( pollStatus == 0 )
+            {
+                startNext = true;
+            }
+            else if( ( pollStatus < 0 ) && ( errno != EINTR ) )
+            {
+                LogError( ( "Polling connect attempts failed: %s.", strerror( errno ) ) );
+                pollFailed = true;
+            }
+            else
+            {
+                /* Walk backwards so finished attempts can be swapped out. */
+                for( i = activeCount; ( i > 0U ) && ( pollStatus > 0 ); i-- )
+                {
+                    if( attempts[ i - 1U ].revents != 0 )
+                    {
+                        socketError = 0;
+                        errorLength = ( socklen_t ) sizeof( socketError );
+
+                        if( ( connectedSocket < 0 ) &&
+                            ( getsockopt( attempts[ i - 1U ].fd,
+                                          SOL_SOCKET,
+                                          SO_ERROR,
+                                          &socketError,
+                                          &errorLength ) == 0 ) &&
+                            ( socketError == 0 ) )
+                        {
+                            connectedSocket = attempts[ i - 1U ].fd;
+                        }
+                        else
+                        {
+                            LogWarn( ( "Connect attempt failed: %s.", strerror( socketError ) ) );
+                            ( void ) close( attempts[ i - 1U ].fd );
+                            startNext = true;
+                        }
+
+                        activeCount--;
+                        attempts[ i - 1U ] = attempts[ activeCount ];
+                    }
+                }
+            }
+        }
+    }
+
+    /* Only the winning attempt is kept. */
+    for( i = 0U; i < activeCount; i++ )
+    {
+        ( void ) close( attempts[ i ].fd );
+    }
+
+    /* The transports rely on blocking sockets with timeouts. */
+    if( connectedSocket >= 0 )
+    {
+        flags = fcntl( connectedSocket, F_GETFL );
+
+        if( ( flags < 0 ) ||
+            ( fcntl( connectedSocket, F_SETFL, flags & ~O_NONBLOCK ) < 0 ) )
+        {
+            LogError( ( "Failed to switch socket to blocking mode: %s.", strerror( errno ) ) );
+            ( void ) close( connectedSocket );
+        }
+        else
+        {
+            *pTcpSocket = connectedSocket;
+            returnStatus = SOCKETS_SUCCESS;
+        }
+    }
+
+    if( returnStatus == SOCKETS_SUCCESS )
+    {
+        LogDebug( ( "Established TCP connection: Server=%.*s.\n",
+                    ( int32_t ) hostNameLength,
+                    pHostName ) );
+    }
+    else
+    {
+        LogError( ( "Could not connect to any resolved IP address from %.*s.",
+                    ( int32_t ) hostNameLength,
+                    pHostName ) );
+    }
 
     return returnStatus;
 }
@@ -309,8 +899,8 @@ SocketStatus_t Sockets_Connect( int32_t * pTcpSocket,
 {
     SocketStatus_t returnStatus = SOCKETS_SUCCESS;
     struct addrinfo * pListHead = NULL;
-    struct timeval transportTimeout;
-    int32_t setTimeoutStatus = -1;
+    DnsCacheEntry_t * pCacheEntry = NULL;
+    uint32_t attemptDelayMs = 0U;
 
     if( pServerInfo == NULL )
     {
@@ -339,27 +929,60 @@ SocketStatus_t Sockets_Connect( int32_t * pTcpSocket,
 
     if( returnStatus == SOCKETS_SUCCESS )
     {
-        returnStatus = resolveHostName( pServerInfo->pHostName,
-                                        pServerInfo->hostNameLength,
-                                        &pListHead );
+        returnStatus = resolveAddresses( pServerInfo, &pListHead, &pCacheEntry );
     }
 
     if( returnStatus == SOCKETS_SUCCESS )
     {
-        returnStatus = attemptConnection( pListHead,
-                                          pServerInfo->pHostName,
-                                          pServerInfo->hostNameLength,
-                                          pServerInfo->port,
-                                          pTcpSocket );
+        ( void ) pthread_mutex_lock( &dnsCacheMutex );
+        attemptDelayMs = connectAttemptDelayMs;
+        ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+
+        if( attemptDelayMs == 0U )
+        {
+            returnStatus = attemptConnection( pListHead,
+                                              pServerInfo->pHostName,
+                                              pServerInfo->hostNameLength,
+                                              pServerInfo->port,
+                                              pTcpSocket );
+        }
+        else
+        {
+            returnStatus = attemptParallelConnection( pListHead,
+                                                      pServerInfo->pHostName,
+                                                      pServerInfo->hostNameLength,
+                                                      pServerInfo->port,
+                                                      attemptDelayMs,
+                                                      pTcpSocket );
+        }
+
+        releaseAddresses( pListHead, pCacheEntry, ( returnStatus == SOCKETS_SUCCESS ) );
+    }
+
+    if( returnStatus == SOCKETS_SUCCESS )
+    {
+        returnStatus = Sockets_SetTimeouts( *pTcpSocket, sendTimeoutMs, recvTimeoutMs );
     }
 
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+SocketStatus_t Sockets_SetTimeouts( int32_t tcpSocket,
+                                    uint32_t sendTimeoutMs,
+                                    uint32_t recvTimeoutMs )
+{
+    SocketStatus_t returnStatus = SOCKETS_SUCCESS;
+    struct timeval transportTimeout;
+    int32_t setTimeoutStatus = -1;
+
     /* Set the send timeout. */
     if( returnStatus == SOCKETS_SUCCESS )
     {
         transportTimeout.tv_sec = ( ( ( int64_t ) sendTimeoutMs ) / ONE_SEC_TO_MS );
         transportTimeout.tv_usec = ( ONE_MS_TO_US * ( ( ( int64_t ) sendTimeoutMs ) % ONE_SEC_TO_MS ) );
 
-        setTimeoutStatus = setsockopt( *pTcpSocket,
+        setTimeoutStatus = setsockopt( tcpSocket,
                                        SOL_SOCKET,
                                        SO_SNDTIMEO,
                                        &transportTimeout,
@@ -385,7 +1008,7 @@ SocketStatus_t Sockets_Connect( int32_t * pTcpSocket,
         transportTimeout.tv_sec = ( ( ( int64_t ) recvTimeoutMs ) / ONE_SEC_TO_MS );
         transportTimeout.tv_usec = ( ONE_MS_TO_US * ( ( ( int64_t ) recvTimeoutMs ) % ONE_SEC_TO_MS ) );
 
-        setTimeoutStatus = setsockopt( *pTcpSocket,
+        setTimeoutStatus = setsockopt( tcpSocket,
                                        SOL_SOCKET,
                                        SO_RCVTIMEO,
                                        &transportTimeout,
@@ -427,3 +1050,51 @@ SocketStatus_t Sockets_Disconnect( int32_t tcpSocket )
     return returnStatus;
 }
 /*-----------------------------------------------------------*/
+
+void Sockets_SetDnsCacheTtl( uint32_t ttlMs )
+{
+    ( void ) pthread_mutex_lock( &dnsCacheMutex );
+    dnsCacheTtlMs = ttlMs;
+    ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+
+    if( ttlMs == 0U )
+    {
+        Sockets_ClearDnsCache();
+    }
+}
+/*-----------------------------------------------------------*/
+
+void Sockets_ClearDnsCache( void )
+{
+    size_t i;
+
+    ( void ) pthread_mutex_lock( &dnsCacheMutex );
+
+    for( i = 0U; i < SOCKETS_DNS_CACHE_SIZE; i++ )
+    {
+        if( dnsCache[ i ].pHostName == NULL )
+        {
+            /* Free slot. */
+        }
+        else if( dnsCache[ i ].users == 0U )
+        {
+            releaseDnsCacheEntry( &dnsCache[ i ] );
+        }
+        else
+        {
+            /* The last connect walking the records frees them. */
+            dnsCache[ i ].stale = true;
+        }
+    }
+
+    ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+}
+/*-----------------------------------------------------------*/
+
+void Sockets_SetConnectAttemptDelay( uint32_t attemptDelayMs )
+{
+    ( void ) pthread_mutex_lock( &dnsCacheMutex );
+    connectAttemptDelayMs = attemptDelayMs;
+    ( void ) pthread_mutex_unlock( &dnsCacheMutex );
+}
+/*-----------------------------------------------------------*/
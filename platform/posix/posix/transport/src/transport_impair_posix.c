@@ -0,0 +1,778 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file transport_impair_posix.c
+ * @brief Implementation of the impairment transport.
+ *
+ * Each queue is a ring of bytes, with a ring of the chunks they were queued
+ * in. A chunk is due at a time drawn when it is queued, and no earlier than
+ * the chunk before it, so the head chunk is always the first due.
+ */
+
+/* Standard includes. */
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "transport_impair_posix.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The most times in a row a segment is lost, so that a loss of 100%
+ * still lets the data through, slowly.
+ */
+#define MAX_LOSSES_IN_A_ROW    6U
+
+/**
+ * @brief The longest line of a scenario file.
+ */
+#define MAX_LINE_LENGTH        256U
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    ImpairParams_t * pParams;
+};
+
+/*-----------------------------------------------------------*/
+
+static uint64_t nowUs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000U ) + ( ( uint64_t ) now.tv_nsec / 1000U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void sleepUs( uint64_t durationUs )
+{
+    struct timespec duration;
+
+    duration.tv_sec = ( time_t ) ( durationUs / 1000000U );
+    duration.tv_nsec = ( long ) ( ( durationUs % 1000000U ) * 1000U );
+
+    ( void ) nanosleep( &duration, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The next number of an xorshift64* sequence.
+ */
+static uint64_t nextRandom( ImpairParams_t * pParams )
+{
+    uint64_t x = pParams->random;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    pParams->random = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A random number in [0, 1).
+ */
+static double randomUnit( ImpairParams_t * pParams )
+{
+    return ( double ) ( nextRandom( pParams ) >> 11 ) / ( double ) ( 1ULL << 53 );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Draws when a chunk of @a length bytes queued now has crossed the
+ * link of @a pQueue.
+ */
+static uint64_t scheduleChunk( ImpairParams_t * pParams,
+                               TransportImpairQueue_t * pQueue,
+                               size_t length,
+                               uint64_t queuedUs )
+{
+    const TransportImpairProfile_t * pProfile = &pParams->profile;
+    uint64_t sentUs = ( pQueue->linkFreeUs > queuedUs ) ? pQueue->linkFreeUs : queuedUs;
+    uint64_t delayUs = ( uint64_t ) pProfile->latencyMs * 1000U;
+    uint64_t retransmitUs = 0U;
+    uint64_t longestRetransmitUs = 0U;
+    uint64_t dueUs = 0U;
+    size_t segments = ( length + TRANSPORT_IMPAIR_SEGMENT_SIZE - 1U ) / TRANSPORT_IMPAIR_SEGMENT_SIZE;
+    uint32_t losses = 0U;
+    size_t i;
+
+    if( pQueue->kbps > 0U )
+    {
+        sentUs += ( ( uint64_t ) length * 8000U ) / pQueue->kbps;
+    }
+
+    pQueue->linkFreeUs = sentUs;
+
+    if( pProfile->jitterMs > 0U )
+    {
+        delayUs += nextRandom( pParams ) % ( ( ( uint64_t ) pProfile->jitterMs * 1000U ) + 1U );
+    }
+
+    /* The chunk is there once its last segment is, however many times the
+     * segments before were lost. */
+    for( i = 0U; ( pProfile->lossPercent > 0.0 ) && ( i < segments ); i++ )
+    {
+        retransmitUs = 0U;
+
+        for( losses = 0U;
+             ( losses < MAX_LOSSES_IN_A_ROW ) && ( ( randomUnit( pParams ) * 100.0 ) < pProfile->lossPercent );
+             losses++ )
+        {
+            retransmitUs += ( ( uint64_t ) pProfile->retransmitMs * 1000U ) << losses;
+            pParams->stats.segmentsLost++;
+        }
+
+        if( retransmitUs > longestRetransmitUs )
+        {
+            longestRetransmitUs = retransmitUs;
+        }
+    }
+
+    dueUs = sentUs + delayUs + longestRetransmitUs;
+
+    /* A byte stream isn't reordered: a late chunk holds up the next ones. */
+    if( dueUs < pQueue->lastDueUs )
+    {
+        dueUs = pQueue->lastDueUs;
+    }
+
+    pQueue->lastDueUs = dueUs;
+
+    return dueUs;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The free bytes after the tail of a queue, before the ring wraps.
+ */
+static size_t contiguousFree( const TransportImpairQueue_t * pQueue )
+{
+    size_t tail = ( pQueue->head + pQueue->length ) % TRANSPORT_IMPAIR_QUEUE_SIZE;
+    size_t space = 0U;
+
+    if( ( pQueue->length < TRANSPORT_IMPAIR_QUEUE_SIZE ) &&
+        ( pQueue->chunkCount < TRANSPORT_IMPAIR_MAX_CHUNKS ) )
+    {
+        space = ( tail >= pQueue->head ) ? ( TRANSPORT_IMPAIR_QUEUE_SIZE - tail ) : ( pQueue->head - tail );
+    }
+
+    return space;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Adds a chunk of the @a length bytes written after the tail.
+ */
+static void commitChunk( ImpairParams_t * pParams,
+                         TransportImpairQueue_t * pQueue,
+                         size_t length,
+                         uint64_t queuedUs )
+{
+    TransportImpairChunk_t * pChunk = NULL;
+
+    pChunk = &pQueue->chunks[ ( pQueue->firstChunk + pQueue->chunkCount ) % TRANSPORT_IMPAIR_MAX_CHUNKS ];
+    pChunk->queuedUs = queuedUs;
+    pChunk->dueUs = scheduleChunk( pParams, pQueue, length, queuedUs );
+    pChunk->length = length;
+
+    pQueue->chunkCount++;
+    pQueue->length += length;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The due bytes at the head of a queue, before the ring wraps.
+ */
+static size_t contiguousDue( const TransportImpairQueue_t * pQueue,
+                             uint64_t now )
+{
+    const TransportImpairChunk_t * pChunk = &pQueue->chunks[ pQueue->firstChunk ];
+    size_t due = 0U;
+
+    if( ( pQueue->chunkCount > 0U ) && ( pChunk->dueUs <= now ) )
+    {
+        due = pChunk->length;
+
+        if( due > ( TRANSPORT_IMPAIR_QUEUE_SIZE - pQueue->head ) )
+        {
+            due = TRANSPORT_IMPAIR_QUEUE_SIZE - pQueue->head;
+        }
+    }
+
+    return due;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The wait until the head chunk of a queue is due, if shorter than
+ * @a waitUs.
+ */
+static uint64_t earlierWait( const TransportImpairQueue_t * pQueue,
+                             uint64_t now,
+                             uint64_t waitUs )
+{
+    const TransportImpairChunk_t * pChunk = &pQueue->chunks[ pQueue->firstChunk ];
+    uint64_t wait = waitUs;
+
+    if( pQueue->chunkCount > 0U )
+    {
+        wait = ( pChunk->dueUs > now ) ? ( pChunk->dueUs - now ) : 0U;
+        wait = ( wait < waitUs ) ? wait : waitUs;
+    }
+
+    return wait;
+}
+
+/**
+ * @brief Removes @a length due bytes from the head of a queue.
+ */
+static void consume( ImpairParams_t * pParams,
+                     TransportImpairQueue_t * pQueue,
+                     size_t length )
+{
+    TransportImpairChunk_t * pChunk = &pQueue->chunks[ pQueue->firstChunk ];
+
+    pQueue->head = ( pQueue->head + length ) % TRANSPORT_IMPAIR_QUEUE_SIZE;
+    pQueue->length -= length;
+    pChunk->length -= length;
+
+    if( pChunk->length == 0U )
+    {
+        pParams->stats.queuedUs += pChunk->dueUs - pChunk->queuedUs;
+        pParams->stats.chunks++;
+        pQueue->firstChunk = ( pQueue->firstChunk + 1U ) % TRANSPORT_IMPAIR_MAX_CHUNKS;
+        pQueue->chunkCount--;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Empties a queue, keeping its bandwidth.
+ */
+static void clearQueue( TransportImpairQueue_t * pQueue,
+                        uint32_t kbps )
+{
+    pQueue->head = 0U;
+    pQueue->length = 0U;
+    pQueue->firstChunk = 0U;
+    pQueue->chunkCount = 0U;
+    pQueue->kbps = kbps;
+    pQueue->linkFreeUs = 0U;
+    pQueue->lastDueUs = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether the connection was reset, resetting it if its time came.
+ */
+static bool isReset( ImpairParams_t * pParams,
+                     uint64_t now )
+{
+    if( ( pParams->reset == false ) && ( pParams->resetAtUs != 0U ) && ( now >= pParams->resetAtUs ) )
+    {
+        pParams->reset = true;
+        pParams->stats.resets++;
+        LogWarn( ( "Reset the connection." ) );
+    }
+
+    return pParams->reset;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Passes the due sends to the wrapped transport.
+ *
+ * @return The bytes left in the queue, or -1 if the transport failed.
+ */
+static int32_t flushSends( ImpairParams_t * pParams,
+                           uint64_t now )
+{
+    TransportImpairQueue_t * pQueue = &pParams->up;
+    int32_t sent = 0;
+    size_t due = contiguousDue( pQueue, now );
+
+    while( ( due > 0U ) && ( sent >= 0 ) )
+    {
+        sent = pParams->inner.send( pParams->inner.pNetworkContext, &pQueue->buffer[ pQueue->head ], due );
+
+        if( sent > 0 )
+        {
+            consume( pParams, pQueue, ( size_t ) sent );
+            pParams->stats.bytesSent += ( uint64_t ) sent;
+            due = contiguousDue( pQueue, now );
+        }
+        else
+        {
+            /* The socket buffer is full, or the connection failed. */
+            due = 0U;
+        }
+    }
+
+    return ( sent < 0 ) ? -1 : ( int32_t ) pQueue->length;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Queues what the wrapped transport received.
+ *
+ * Without @a wait, it only asks for one byte, which the transports return
+ * without blocking, and then for the rest of what arrived. With @a wait, it
+ * asks for as much as fits, waiting as the transport does.
+ *
+ * @return The bytes queued, or -1 if the transport failed.
+ */
+static int32_t ingest( ImpairParams_t * pParams,
+                       bool wait,
+                       uint64_t now )
+{
+    TransportImpairQueue_t * pQueue = &pParams->down;
+    size_t space = contiguousFree( pQueue );
+    uint8_t * pTail = &pQueue->buffer[ ( pQueue->head + pQueue->length ) % TRANSPORT_IMPAIR_QUEUE_SIZE ];
+    int32_t received = 0;
+    int32_t more = 0;
+
+    if( space > 0U )
+    {
+        received = pParams->inner.recv( pParams->inner.pNetworkContext, pTail, wait ? space : 1U );
+    }
+
+    /* Data arrives in segments, so the rest of the segment of that byte is
+     * there to take. */
+    if( ( wait == false ) && ( received == 1 ) && ( space > 1U ) )
+    {
+        more = pParams->inner.recv( pParams->inner.pNetworkContext, &pTail[ 1 ], space - 1U );
+        received = ( more < 0 ) ? more : ( received + more );
+    }
+
+    if( received > 0 )
+    {
+        commitChunk( pParams, pQueue, ( size_t ) received, now );
+    }
+
+    return ( received < 0 ) ? -1 : received;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Parses an unsigned value of a scenario.
+ */
+static bool parseUnsigned( const char * pValue,
+                           uint64_t max,
+                           uint64_t * pResult )
+{
+    char * pEnd = NULL;
+    unsigned long long value = strtoull( pValue, &pEnd, 0 );
+
+    *pResult = ( uint64_t ) value;
+
+    return ( pEnd != pValue ) && ( *pEnd == '\0' ) && ( pValue[ 0 ] != '-' ) && ( value <= max );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sets the key of a line of a scenario.
+ */
+static bool parseLine( TransportImpairProfile_t * pProfile,
+                       const char * pKey,
+                       const char * pValue )
+{
+    uint64_t value = 0U;
+    char * pEnd = NULL;
+    bool valid = true;
+
+    if( strcmp( pKey, "loss_percent" ) == 0 )
+    {
+        pProfile->lossPercent = strtod( pValue, &pEnd );
+        valid = ( pEnd != pValue ) && ( *pEnd == '\0' ) &&
+                ( pProfile->lossPercent >= 0.0 ) && ( pProfile->lossPercent <= 100.0 );
+    }
+    else if( strcmp( pKey, "seed" ) == 0 )
+    {
+        valid = parseUnsigned( pValue, UINT64_MAX, &pProfile->seed );
+    }
+    else
+    {
+        valid = parseUnsigned( pValue, UINT32_MAX, &value );
+
+        if( strcmp( pKey, "latency_ms" ) == 0 )
+        {
+            pProfile->latencyMs = ( uint32_t ) value;
+        }
+        else if( strcmp( pKey, "jitter_ms" ) == 0 )
+        {
+            pProfile->jitterMs = ( uint32_t ) value;
+        }
+        else if( strcmp( pKey, "up_kbps" ) == 0 )
+        {
+            pProfile->upKbps = ( uint32_t ) value;
+        }
+        else if( strcmp( pKey, "down_kbps" ) == 0 )
+        {
+            pProfile->downKbps = ( uint32_t ) value;
+        }
+        else if( strcmp( pKey, "retransmit_ms" ) == 0 )
+        {
+            pProfile->retransmitMs = ( uint32_t ) value;
+        }
+        else if( strcmp( pKey, "reset_interval_s" ) == 0 )
+        {
+            pProfile->resetIntervalS = ( uint32_t ) value;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Removes the spaces around a string, in place.
+ */
+static char * trim( char * pString )
+{
+    size_t length = strlen( pString );
+
+    while( ( length > 0U ) && ( isspace( ( unsigned char ) pString[ length - 1U ] ) != 0 ) )
+    {
+        pString[ --length ] = '\0';
+    }
+
+    while( isspace( ( unsigned char ) *pString ) != 0 )
+    {
+        pString++;
+    }
+
+    return pString;
+}
+
+/*-----------------------------------------------------------*/
+
+TransportImpairStatus_t TransportImpair_LoadScenario( TransportImpairProfile_t * pProfile,
+                                                      const char * pPath )
+{
+    TransportImpairStatus_t status = TRANSPORT_IMPAIR_SUCCESS;
+    char line[ MAX_LINE_LENGTH ];
+    char * pKey = NULL;
+    char * pValue = NULL;
+    FILE * pFile = NULL;
+    uint32_t lineNumber = 0U;
+
+    if( ( pProfile == NULL ) || ( pPath == NULL ) )
+    {
+        status = TRANSPORT_IMPAIR_INVALID_PARAMETER;
+    }
+    else
+    {
+        ( void ) memset( pProfile, 0, sizeof( TransportImpairProfile_t ) );
+        pFile = fopen( pPath, "r" );
+
+        if( pFile == NULL )
+        {
+            LogError( ( "Failed to open the scenario %s.", pPath ) );
+            status = TRANSPORT_IMPAIR_FILE_ERROR;
+        }
+    }
+
+    while( ( status == TRANSPORT_IMPAIR_SUCCESS ) && ( fgets( line, sizeof( line ), pFile ) != NULL ) )
+    {
+        lineNumber++;
+        line[ strcspn( line, "#\r\n" ) ] = '\0';
+        pKey = trim( line );
+        pValue = strchr( pKey, '=' );
+
+        if( *pKey == '\0' )
+        {
+            continue;
+        }
+
+        if( pValue != NULL )
+        {
+            *pValue = '\0';
+            pValue = trim( &pValue[ 1 ] );
+            pKey = trim( pKey );
+        }
+
+        if( ( pValue == NULL ) || ( parseLine( pProfile, pKey, pValue ) == false ) )
+        {
+            LogError( ( "%s:%u: expected a known key and its value.", pPath, ( unsigned ) lineNumber ) );
+            status = TRANSPORT_IMPAIR_INVALID_SCENARIO;
+        }
+    }
+
+    if( pFile != NULL )
+    {
+        ( void ) fclose( pFile );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+TransportImpairStatus_t TransportImpair_Init( ImpairParams_t * pParams,
+                                              const TransportImpairProfile_t * pProfile,
+                                              const TransportInterface_t * pInner,
+                                              uint32_t recvWaitMs )
+{
+    TransportImpairStatus_t status = TRANSPORT_IMPAIR_SUCCESS;
+
+    if( ( pParams == NULL ) || ( pProfile == NULL ) || ( pInner == NULL ) ||
+        ( pInner->send == NULL ) || ( pInner->recv == NULL ) )
+    {
+        status = TRANSPORT_IMPAIR_INVALID_PARAMETER;
+    }
+    else
+    {
+        pParams->inner = *pInner;
+        pParams->profile = *pProfile;
+        pParams->recvWaitMs = recvWaitMs;
+
+        /* xorshift never leaves 0. */
+        pParams->random = ( pProfile->seed != 0U ) ? pProfile->seed : 0x9E3779B97F4A7C15ULL;
+        pParams->resetAtUs = 0U;
+        pParams->reset = false;
+        clearQueue( &pParams->up, pProfile->upKbps );
+        clearQueue( &pParams->down, pProfile->downKbps );
+        ( void ) memset( &pParams->stats, 0, sizeof( TransportImpairStats_t ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+TransportImpairStatus_t TransportImpair_Start( NetworkContext_t * pNetworkContext )
+{
+    TransportImpairStatus_t status = TRANSPORT_IMPAIR_SUCCESS;
+    ImpairParams_t * pParams = NULL;
+    double intervalS = 0.0;
+
+    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) )
+    {
+        status = TRANSPORT_IMPAIR_INVALID_PARAMETER;
+    }
+    else
+    {
+        pParams = pNetworkContext->pParams;
+        clearQueue( &pParams->up, pParams->profile.upKbps );
+        clearQueue( &pParams->down, pParams->profile.downKbps );
+        pParams->reset = false;
+        pParams->resetAtUs = 0U;
+
+        /* Resets come at random, an exponential time apart. */
+        if( pParams->profile.resetIntervalS > 0U )
+        {
+            intervalS = -log( 1.0 - randomUnit( pParams ) ) * ( double ) pParams->profile.resetIntervalS;
+            pParams->resetAtUs = nowUs() + ( uint64_t ) ( intervalS * 1000000.0 ) + 1U;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TransportImpair_Pump( NetworkContext_t * pNetworkContext )
+{
+    ImpairParams_t * pParams = NULL;
+    uint64_t now = nowUs();
+    int32_t status = -1;
+
+    if( ( pNetworkContext != NULL ) && ( pNetworkContext->pParams != NULL ) )
+    {
+        pParams = pNetworkContext->pParams;
+
+        if( isReset( pParams, now ) == false )
+        {
+            status = flushSends( pParams, now );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TransportImpair_Recv( NetworkContext_t * pNetworkContext,
+                              void * pBuffer,
+                              size_t bytesToRecv )
+{
+    ImpairParams_t * pParams = NULL;
+    TransportImpairQueue_t * pQueue = NULL;
+    uint8_t * pBytes = pBuffer;
+    uint64_t now = nowUs();
+    uint64_t waitUs = 0U;
+    size_t received = 0U;
+    size_t due = 0U;
+
+    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) ||
+        ( pBuffer == NULL ) || ( bytesToRecv == 0U ) )
+    {
+        return -1;
+    }
+
+    pParams = pNetworkContext->pParams;
+    pQueue = &pParams->down;
+
+    if( ( isReset( pParams, now ) == true ) ||
+        ( flushSends( pParams, now ) < 0 ) ||
+        ( ingest( pParams, false, now ) < 0 ) )
+    {
+        return -1;
+    }
+
+    /* A receive of one byte only checks for data, as on the other
+     * transports. Others wait for data when nothing is queued either way,
+     * then for the next chunk of either queue to be due. */
+    if( ( contiguousDue( pQueue, now ) == 0U ) && ( bytesToRecv > 1U ) )
+    {
+        if( ( pQueue->chunkCount == 0U ) && ( pParams->up.chunkCount == 0U ) &&
+            ( ingest( pParams, true, now ) < 0 ) )
+        {
+            return -1;
+        }
+
+        /* Nothing queued after the wait of the transport: nothing came. */
+        if( ( pQueue->chunkCount > 0U ) || ( pParams->up.chunkCount > 0U ) )
+        {
+            now = nowUs();
+            waitUs = ( uint64_t ) pParams->recvWaitMs * 1000U;
+            waitUs = earlierWait( &pParams->down, now, waitUs );
+            waitUs = earlierWait( &pParams->up, now, waitUs );
+            sleepUs( waitUs );
+        }
+
+        now = nowUs();
+
+        if( flushSends( pParams, now ) < 0 )
+        {
+            return -1;
+        }
+    }
+
+    due = contiguousDue( pQueue, now );
+
+    while( ( received < bytesToRecv ) && ( due > 0U ) )
+    {
+        if( due > ( bytesToRecv - received ) )
+        {
+            due = bytesToRecv - received;
+        }
+
+        ( void ) memcpy( &pBytes[ received ], &pQueue->buffer[ pQueue->head ], due );
+        consume( pParams, pQueue, due );
+        received += due;
+        due = contiguousDue( pQueue, now );
+    }
+
+    pParams->stats.bytesReceived += received;
+
+    return ( int32_t ) received;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TransportImpair_Send( NetworkContext_t * pNetworkContext,
+                              const void * pBuffer,
+                              size_t bytesToSend )
+{
+    ImpairParams_t * pParams = NULL;
+    TransportImpairQueue_t * pQueue = NULL;
+    const uint8_t * pBytes = pBuffer;
+    uint64_t now = nowUs();
+    size_t accepted = 0U;
+    size_t space = 0U;
+    size_t tail = 0U;
+
+    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) ||
+        ( pBuffer == NULL ) || ( bytesToSend == 0U ) )
+    {
+        return -1;
+    }
+
+    pParams = pNetworkContext->pParams;
+    pQueue = &pParams->up;
+
+    if( ( isReset( pParams, now ) == true ) || ( flushSends( pParams, now ) < 0 ) )
+    {
+        return -1;
+    }
+
+    /* The bytes of one send are one chunk, across the end of the ring. */
+    if( pQueue->chunkCount < TRANSPORT_IMPAIR_MAX_CHUNKS )
+    {
+        accepted = TRANSPORT_IMPAIR_QUEUE_SIZE - pQueue->length;
+        accepted = ( accepted < bytesToSend ) ? accepted : bytesToSend;
+        accepted = ( accepted < ( size_t ) INT32_MAX ) ? accepted : ( size_t ) INT32_MAX;
+    }
+
+    if( accepted > 0U )
+    {
+        tail = ( pQueue->head + pQueue->length ) % TRANSPORT_IMPAIR_QUEUE_SIZE;
+        space = TRANSPORT_IMPAIR_QUEUE_SIZE - tail;
+        space = ( space < accepted ) ? space : accepted;
+
+        ( void ) memcpy( &pQueue->buffer[ tail ], pBytes, space );
+        ( void ) memcpy( pQueue->buffer, &pBytes[ space ], accepted - space );
+        commitChunk( pParams, pQueue, accepted, now );
+
+        /* Due at once when nothing is impaired. */
+        if( flushSends( pParams, now ) < 0 )
+        {
+            return -1;
+        }
+    }
+
+    return ( int32_t ) accepted;
+}
+
+/*-----------------------------------------------------------*/
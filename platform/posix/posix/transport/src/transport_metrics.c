@@ -0,0 +1,269 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <time.h>
+
+/**************************************************/
+/******* DO NOT CHANGE the following order ********/
+/**************************************************/
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the transport metrics. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "TransportMetrics"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+/************ End of logging configuration ****************/
+
+#include "transport_metrics.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Upper bounds of all but the last histogram bucket, in microseconds.
+ */
+static const uint64_t histogramBoundsUs[ TRANSPORT_METRICS_HISTOGRAM_BUCKETS - 1 ] =
+{
+    100U, 1000U, 10000U, 100000U, 1000000U
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Get the current monotonic time.
+ *
+ * @return Time in microseconds.
+ */
+static uint64_t getTimeUs( void );
+
+/**
+ * @brief Get the time elapsed since @p startUs.
+ *
+ * @param[in] startUs Value returned by #TransportMetrics_Start.
+ *
+ * @return Elapsed time in microseconds.
+ */
+static uint64_t elapsedUs( uint64_t startUs );
+
+/**
+ * @brief Log one histogram.
+ *
+ * @param[in] pName Name of the histogram.
+ * @param[in] pHistogram Histogram to log.
+ */
+static void logHistogram( const char * pName,
+                          const TransportHistogram_t * pHistogram );
+
+/*-----------------------------------------------------------*/
+
+static uint64_t getTimeUs( void )
+{
+    uint64_t nowUs = 0U;
+    struct timespec now;
+
+    if( clock_gettime( CLOCK_MONOTONIC, &now ) == 0 )
+    {
+        nowUs = ( ( uint64_t ) now.tv_sec * 1000000U ) + ( ( uint64_t ) now.tv_nsec / 1000U );
+    }
+
+    return nowUs;
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t elapsedUs( uint64_t startUs )
+{
+    uint64_t nowUs = getTimeUs();
+
+    return ( nowUs > startUs ) ? ( nowUs - startUs ) : 0U;
+}
+/*-----------------------------------------------------------*/
+
+static void logHistogram( const char * pName,
+                          const TransportHistogram_t * pHistogram )
+{
+    const uint32_t * pBuckets = pHistogram->buckets;
+
+    LogInfo( ( "%s: <100us=%u <1ms=%u <10ms=%u <100ms=%u <1s=%u >=1s=%u max=%uus total=%luus",
+               pName,
+               pBuckets[ 0 ], pBuckets[ 1 ], pBuckets[ 2 ],
+               pBuckets[ 3 ], pBuckets[ 4 ], pBuckets[ 5 ],
+               pHistogram->maxUs,
+               ( unsigned long ) pHistogram->totalUs ) );
+}
+/*-----------------------------------------------------------*/
+
+TransportMetricsResult_t TransportMetrics_ResultOf( int32_t transportStatus )
+{
+    TransportMetricsResult_t result = TRANSPORT_METRICS_ERROR;
+
+    if( transportStatus > 0 )
+    {
+        result = TRANSPORT_METRICS_OK;
+    }
+    else if( transportStatus == 0 )
+    {
+        result = TRANSPORT_METRICS_WOULD_BLOCK;
+    }
+    else
+    {
+        /* Empty else marker. */
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+uint64_t TransportMetrics_Start( const TransportMetrics_t * pMetrics )
+{
+    return ( pMetrics != NULL ) ? getTimeUs() : 0U;
+}
+/*-----------------------------------------------------------*/
+
+void TransportMetrics_RecordDuration( TransportHistogram_t * pHistogram,
+                                      uint64_t durationUs )
+{
+    size_t bucket = 0U;
+
+    if( pHistogram != NULL )
+    {
+        while( ( bucket < ( TRANSPORT_METRICS_HISTOGRAM_BUCKETS - 1U ) ) &&
+               ( durationUs >= histogramBoundsUs[ bucket ] ) )
+        {
+            bucket++;
+        }
+
+        pHistogram->buckets[ bucket ]++;
+        pHistogram->totalUs += durationUs;
+
+        if( durationUs > pHistogram->maxUs )
+        {
+            pHistogram->maxUs = ( durationUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) durationUs;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void TransportMetrics_RecordSend( TransportMetrics_t * pMetrics,
+                                  TransportMetricsResult_t result,
+                                  size_t bytes,
+                                  uint64_t startUs )
+{
+    if( pMetrics != NULL )
+    {
+        TransportMetrics_RecordDuration( &pMetrics->sendLatency, elapsedUs( startUs ) );
+        pMetrics->sendCalls++;
+
+        if( result == TRANSPORT_METRICS_OK )
+        {
+            pMetrics->bytesSent += bytes;
+        }
+        else if( result == TRANSPORT_METRICS_WOULD_BLOCK )
+        {
+            pMetrics->sendWantCount++;
+        }
+        else
+        {
+            pMetrics->sendErrors++;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void TransportMetrics_RecordRecv( TransportMetrics_t * pMetrics,
+                                  TransportMetricsResult_t result,
+                                  size_t bytes,
+                                  uint64_t startUs )
+{
+    if( pMetrics != NULL )
+    {
+        TransportMetrics_RecordDuration( &pMetrics->recvLatency, elapsedUs( startUs ) );
+        pMetrics->recvCalls++;
+
+        if( result == TRANSPORT_METRICS_OK )
+        {
+            pMetrics->bytesReceived += bytes;
+        }
+        else if( result == TRANSPORT_METRICS_WOULD_BLOCK )
+        {
+            pMetrics->recvWantCount++;
+        }
+        else
+        {
+            pMetrics->recvErrors++;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void TransportMetrics_RecordHandshake( TransportMetrics_t * pMetrics,
+                                       bool success,
+                                       uint64_t startUs )
+{
+    if( pMetrics != NULL )
+    {
+        if( success )
+        {
+            TransportMetrics_RecordDuration( &pMetrics->handshake, elapsedUs( startUs ) );
+        }
+        else
+        {
+            pMetrics->handshakeFailures++;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void TransportMetrics_Reset( TransportMetrics_t * pMetrics )
+{
+    if( pMetrics != NULL )
+    {
+        ( void ) memset( pMetrics, 0, sizeof( TransportMetrics_t ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+void TransportMetrics_Log( const TransportMetrics_t * pMetrics )
+{
+    if( pMetrics != NULL )
+    {
+        LogInfo( ( "Sent %lu bytes in %u calls (%u would block, %u errors).",
+                   ( unsigned long ) pMetrics->bytesSent, pMetrics->sendCalls,
+                   pMetrics->sendWantCount, pMetrics->sendErrors ) );
+        LogInfo( ( "Received %lu bytes in %u calls (%u would block, %u errors).",
+                   ( unsigned long ) pMetrics->bytesReceived, pMetrics->recvCalls,
+                   pMetrics->recvWantCount, pMetrics->recvErrors ) );
+        LogInfo( ( "Handshake failures: %u.", pMetrics->handshakeFailures ) );
+        logHistogram( "Send latency", &pMetrics->sendLatency );
+        logHistogram( "Receive latency", &pMetrics->recvLatency );
+        logHistogram( "Handshake", &pMetrics->handshake );
+    }
+}
+/*-----------------------------------------------------------*/
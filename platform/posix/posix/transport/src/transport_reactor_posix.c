@@ -0,0 +1,901 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* POSIX includes. */
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "transport_reactor_posix.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Each compilation unit that consumes the NetworkContext must define it.
+ * It should contain a single pointer to the type of your desired transport.
+ * This reactor drives the OpenSSL transport.
+ */
+struct NetworkContext
+{
+    OpensslParams_t * pParams;
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of milliseconds in one second.
+ */
+#define ONE_SEC_TO_MS     ( 1000U )
+
+/**
+ * @brief Number of nanoseconds in one millisecond.
+ */
+#define ONE_MS_TO_NS      ( 1000000U )
+
+/**
+ * @brief Value of an unused socket descriptor.
+ */
+#define INVALID_SOCKET    ( -1 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return Time in milliseconds.
+ */
+static uint64_t getTimeMs( void );
+
+/**
+ * @brief Register a socket with the epoll instance or change its events.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection Connection reported with the events.
+ * @param[in] operation EPOLL_CTL_ADD or EPOLL_CTL_MOD.
+ * @param[in] events Events to wait for.
+ *
+ * @return #REACTOR_SUCCESS if successful; #REACTOR_API_ERROR on error.
+ */
+static ReactorStatus_t watchSocket( const Reactor_t * pReactor,
+                                    ReactorConnection_t * pConnection,
+                                    int operation,
+                                    uint32_t events );
+
+/**
+ * @brief Add a connection to the pending-connect list.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ */
+static void insertPending( Reactor_t * pReactor,
+                           ReactorConnection_t * pConnection );
+
+/**
+ * @brief Remove a connection from the pending-connect list.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ */
+static void removePending( Reactor_t * pReactor,
+                           ReactorConnection_t * pConnection );
+
+/**
+ * @brief Free the TLS session and socket of an unfinished connect.
+ *
+ * @param[in] pConnection The connection.
+ */
+static void releaseConnect( ReactorConnection_t * pConnection );
+
+/**
+ * @brief Fail a connect and report it to the application.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ * @param[in] status Status passed to the connect callback.
+ */
+static void failConnect( Reactor_t * pReactor,
+                         ReactorConnection_t * pConnection,
+                         ReactorStatus_t status );
+
+/**
+ * @brief Start a non-blocking TCP connect to the next resolved address.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ *
+ * @return #REACTOR_SUCCESS if a connect is in progress;
+ * #REACTOR_CONNECT_FAILURE, #REACTOR_API_ERROR on error.
+ */
+static ReactorStatus_t connectNextAddress( const Reactor_t * pReactor,
+                                           ReactorConnection_t * pConnection );
+
+/**
+ * @brief Advance the TLS handshake and wait for the socket as needed.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ */
+static void continueHandshake( Reactor_t * pReactor,
+                               ReactorConnection_t * pConnection );
+
+/**
+ * @brief Switch an established connection to blocking receive notifications.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ *
+ * @return #REACTOR_SUCCESS if successful; #REACTOR_API_ERROR on error.
+ */
+static ReactorStatus_t finishConnect( Reactor_t * pReactor,
+                                      ReactorConnection_t * pConnection );
+
+/**
+ * @brief Handle the socket becoming writable while connecting.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] pConnection The connection.
+ */
+static void handleConnecting( Reactor_t * pReactor,
+                              ReactorConnection_t * pConnection );
+
+/**
+ * @brief Check for received data that the socket no longer reports.
+ *
+ * @param[in] pConnection The connection.
+ *
+ * @return true if the TLS session or the read-ahead buffer holds data.
+ */
+static bool hasBufferedData( const ReactorConnection_t * pConnection );
+
+/**
+ * @brief Fail every pending connect whose deadline has passed.
+ *
+ * @param[in] pReactor The reactor.
+ */
+static void expireConnects( Reactor_t * pReactor );
+
+/**
+ * @brief Compute how long to wait in epoll_wait.
+ *
+ * @param[in] pReactor The reactor.
+ * @param[in] timeoutMs Timeout requested by the application.
+ *
+ * @return Timeout for epoll_wait, limited by the earliest connect deadline.
+ */
+static int computeWaitTimeout( const Reactor_t * pReactor,
+                               uint32_t timeoutMs );
+
+/*-----------------------------------------------------------*/
+
+static uint64_t getTimeMs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * ONE_SEC_TO_MS ) +
+           ( ( uint64_t ) now.tv_nsec / ONE_MS_TO_NS );
+}
+/*-----------------------------------------------------------*/
+
+static ReactorStatus_t watchSocket( const Reactor_t * pReactor,
+                                    ReactorConnection_t * pConnection,
+                                    int operation,
+                                    uint32_t events )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    struct epoll_event event;
+
+    ( void ) memset( &event, 0, sizeof( event ) );
+    event.events = events;
+    event.data.ptr = pConnection;
+
+    if( epoll_ctl( pReactor->epollDescriptor,
+                   operation,
+                   pConnection->socketDescriptor,
+                   &event ) != 0 )
+    {
+        LogError( ( "Failed to watch socket: Socket=%d, errno=%d.",
+                    ( int ) pConnection->socketDescriptor,
+                    errno ) );
+        returnStatus = REACTOR_API_ERROR;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static void insertPending( Reactor_t * pReactor,
+                           ReactorConnection_t * pConnection )
+{
+    pConnection->pNextPending = pReactor->pPendingHead;
+    pReactor->pPendingHead = pConnection;
+}
+/*-----------------------------------------------------------*/
+
+static void removePending( Reactor_t * pReactor,
+                           ReactorConnection_t * pConnection )
+{
+    ReactorConnection_t ** ppLink = &pReactor->pPendingHead;
+
+    while( ( *ppLink != NULL ) && ( *ppLink != pConnection ) )
+    {
+        ppLink = &( *ppLink )->pNextPending;
+    }
+
+    if( *ppLink != NULL )
+    {
+        *ppLink = pConnection->pNextPending;
+    }
+
+    pConnection->pNextPending = NULL;
+}
+/*-----------------------------------------------------------*/
+
+static void releaseConnect( ReactorConnection_t * pConnection )
+{
+    OpensslParams_t * pOpensslParams = pConnection->pNetworkContext->pParams;
+
+    if( pOpensslParams->pSsl != NULL )
+    {
+        SSL_free( pOpensslParams->pSsl );
+        pOpensslParams->pSsl = NULL;
+    }
+
+    /* Closing the socket also removes it from the epoll instance. */
+    if( pConnection->socketDescriptor != INVALID_SOCKET )
+    {
+        ( void ) close( pConnection->socketDescriptor );
+        pConnection->socketDescriptor = INVALID_SOCKET;
+    }
+
+    if( pConnection->pAddresses != NULL )
+    {
+        freeaddrinfo( pConnection->pAddresses );
+        pConnection->pAddresses = NULL;
+        pConnection->pNextAddress = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void failConnect( Reactor_t * pReactor,
+                         ReactorConnection_t * pConnection,
+                         ReactorStatus_t status )
+{
+    LogError( ( "Connect failed: Host=%.*s, status=%d.",
+                ( int ) pConnection->connectInfo.pServerInfo->hostNameLength,
+                pConnection->connectInfo.pServerInfo->pHostName,
+                ( int ) status ) );
+
+    removePending( pReactor, pConnection );
+    releaseConnect( pConnection );
+    pConnection->state = REACTOR_STATE_IDLE;
+
+    pConnection->connectInfo.connectCallback( pConnection,
+                                              status,
+                                              pConnection->connectInfo.pUserContext );
+}
+/*-----------------------------------------------------------*/
+
+static ReactorStatus_t connectNextAddress( const Reactor_t * pReactor,
+                                           ReactorConnection_t * pConnection )
+{
+    ReactorStatus_t returnStatus = REACTOR_CONNECT_FAILURE;
+    struct addrinfo * pAddress = NULL;
+    socklen_t addressLength = 0;
+    uint16_t netPort = htons( pConnection->connectInfo.pServerInfo->port );
+    int32_t connectStatus = -1;
+
+    while( ( returnStatus == REACTOR_CONNECT_FAILURE ) &&
+           ( pConnection->pNextAddress != NULL ) )
+    {
+        pAddress = pConnection->pNextAddress;
+        pConnection->pNextAddress = pAddress->ai_next;
+
+        if( pConnection->socketDescriptor != INVALID_SOCKET )
+        {
+            ( void ) close( pConnection->socketDescriptor );
+            pConnection->socketDescriptor = INVALID_SOCKET;
+        }
+
+        if( pAddress->ai_family == AF_INET )
+        {
+            ( ( struct sockaddr_in * ) pAddress->ai_addr )->sin_port = netPort;
+            addressLength = ( socklen_t ) sizeof( struct sockaddr_in );
+        }
+        else if( pAddress->ai_family == AF_INET6 )
+        {
+            ( ( struct sockaddr_in6 * ) pAddress->ai_addr )->sin6_port = netPort;
+            addressLength = ( socklen_t ) sizeof( struct sockaddr_in6 );
+        }
+        else
+        {
+            addressLength = 0;
+        }
+
+        if( addressLength != 0 )
+        {
+            pConnection->socketDescriptor = socket( pAddress->ai_family,
+                                                    pAddress->ai_socktype | SOCK_NONBLOCK,
+                                                    pAddress->ai_protocol );
+        }
+
+        if( pConnection->socketDescriptor < 0 )
+        {
+            pConnection->socketDescriptor = INVALID_SOCKET;
+        }
+        else
+        {
+            connectStatus = connect( pConnection->socketDescriptor,
+                                     pAddress->ai_addr,
+                                     addressLength );
+
+            /* A connect that completes at once is reported as writable by
+             * epoll just like one in progress. */
+            if( ( connectStatus == 0 ) || ( errno == EINPROGRESS ) )
+            {
+                returnStatus = watchSocket( pReactor,
+                                            pConnection,
+                                            EPOLL_CTL_ADD,
+                                            ( uint32_t ) EPOLLOUT );
+            }
+        }
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static void continueHandshake( Reactor_t * pReactor,
+                               ReactorConnection_t * pConnection )
+{
+    OpensslStatus_t opensslStatus = OPENSSL_SUCCESS;
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+
+    opensslStatus = Openssl_HandshakeContinue( pConnection->pNetworkContext );
+
+    if( opensslStatus == OPENSSL_HANDSHAKE_WANT_READ )
+    {
+        returnStatus = watchSocket( pReactor, pConnection, EPOLL_CTL_MOD, ( uint32_t ) EPOLLIN );
+    }
+    else if( opensslStatus == OPENSSL_HANDSHAKE_WANT_WRITE )
+    {
+        returnStatus = watchSocket( pReactor, pConnection, EPOLL_CTL_MOD, ( uint32_t ) EPOLLOUT );
+    }
+    else if( opensslStatus == OPENSSL_SUCCESS )
+    {
+        returnStatus = finishConnect( pReactor, pConnection );
+
+        if( returnStatus == REACTOR_SUCCESS )
+        {
+            pConnection->connectInfo.connectCallback( pConnection,
+                                                      REACTOR_SUCCESS,
+                                                      pConnection->connectInfo.pUserContext );
+        }
+    }
+    else
+    {
+        returnStatus = REACTOR_HANDSHAKE_FAILED;
+    }
+
+    if( returnStatus != REACTOR_SUCCESS )
+    {
+        failConnect( pReactor, pConnection, returnStatus );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static ReactorStatus_t finishConnect( Reactor_t * pReactor,
+                                      ReactorConnection_t * pConnection )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    int flags = fcntl( pConnection->socketDescriptor, F_GETFL );
+
+    /* The send and receive functions of the transport rely on blocking
+     * sockets with timeouts. */
+    if( ( flags < 0 ) ||
+        ( fcntl( pConnection->socketDescriptor, F_SETFL, flags & ~O_NONBLOCK ) < 0 ) )
+    {
+        LogError( ( "Failed to switch socket to blocking mode: errno=%d.", errno ) );
+        returnStatus = REACTOR_API_ERROR;
+    }
+    else if( Sockets_SetTimeouts( pConnection->socketDescriptor,
+                                  pConnection->connectInfo.sendTimeoutMs,
+                                  pConnection->connectInfo.recvTimeoutMs ) != SOCKETS_SUCCESS )
+    {
+        returnStatus = REACTOR_API_ERROR;
+    }
+    else
+    {
+        returnStatus = watchSocket( pReactor, pConnection, EPOLL_CTL_MOD, ( uint32_t ) EPOLLIN );
+    }
+
+    if( returnStatus == REACTOR_SUCCESS )
+    {
+        removePending( pReactor, pConnection );
+        freeaddrinfo( pConnection->pAddresses );
+        pConnection->pAddresses = NULL;
+        pConnection->pNextAddress = NULL;
+        pConnection->pOpensslParams = pConnection->pNetworkContext->pParams;
+        pConnection->deadlineMs = 0U;
+        pConnection->state = REACTOR_STATE_READY;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static void handleConnecting( Reactor_t * pReactor,
+                              ReactorConnection_t * pConnection )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    OpensslParams_t * pOpensslParams = pConnection->pNetworkContext->pParams;
+    int socketError = 0;
+    socklen_t errorLength = ( socklen_t ) sizeof( socketError );
+
+    if( ( getsockopt( pConnection->socketDescriptor,
+                      SOL_SOCKET,
+                      SO_ERROR,
+                      &socketError,
+                      &errorLength ) != 0 ) ||
+        ( socketError != 0 ) )
+    {
+        LogDebug( ( "Connect attempt failed, trying next address: error=%d.", socketError ) );
+        returnStatus = connectNextAddress( pReactor, pConnection );
+
+        if( returnStatus != REACTOR_SUCCESS )
+        {
+            failConnect( pReactor, pConnection, returnStatus );
+        }
+    }
+    else
+    {
+        pOpensslParams->socketDescriptor = pConnection->socketDescriptor;
+
+        if( Openssl_HandshakeStart( pConnection->pNetworkContext,
+                                    pConnection->connectInfo.pServerInfo,
+                                    pConnection->connectInfo.pOpensslCredentials ) != OPENSSL_SUCCESS )
+        {
+            failConnect( pReactor, pConnection, REACTOR_HANDSHAKE_FAILED );
+        }
+        else
+        {
+            pConnection->state = REACTOR_STATE_HANDSHAKING;
+            continueHandshake( pReactor, pConnection );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool hasBufferedData( const ReactorConnection_t * pConnection )
+{
+    const OpensslParams_t * pOpensslParams = pConnection->pOpensslParams;
+    bool hasData = false;
+
+    if( pOpensslParams != NULL )
+    {
+        hasData = ( pOpensslParams->readAheadLength > 0U ) ||
+                  ( ( pOpensslParams->pSsl != NULL ) &&
+                    ( SSL_has_pending( pOpensslParams->pSsl ) == 1 ) );
+    }
+
+    return hasData;
+}
+/*-----------------------------------------------------------*/
+
+static void expireConnects( Reactor_t * pReactor )
+{
+    ReactorConnection_t * pConnection = pReactor->pPendingHead;
+    uint64_t nowMs = getTimeMs();
+
+    /* Restart from the head after each failure, as the connect callback may
+     * change the list. */
+    while( pConnection != NULL )
+    {
+        if( ( pConnection->deadlineMs != 0U ) && ( nowMs >= pConnection->deadlineMs ) )
+        {
+            failConnect( pReactor, pConnection, REACTOR_TIMEOUT );
+            pConnection = pReactor->pPendingHead;
+        }
+        else
+        {
+            pConnection = pConnection->pNextPending;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int computeWaitTimeout( const Reactor_t * pReactor,
+                               uint32_t timeoutMs )
+{
+    const ReactorConnection_t * pConnection = NULL;
+    uint64_t nowMs = getTimeMs();
+    uint64_t waitMs = timeoutMs;
+
+    for( pConnection = pReactor->pPendingHead;
+         pConnection != NULL;
+         pConnection = pConnection->pNextPending )
+    {
+        if( pConnection->deadlineMs != 0U )
+        {
+            if( pConnection->deadlineMs <= nowMs )
+            {
+                waitMs = 0U;
+            }
+            else if( ( pConnection->deadlineMs - nowMs ) < waitMs )
+            {
+                waitMs = pConnection->deadlineMs - nowMs;
+            }
+            else
+            {
+                /* Empty else. */
+            }
+        }
+    }
+
+    /* epoll_wait takes an int, so the requested timeout is capped. */
+    if( waitMs > ( uint64_t ) INT32_MAX )
+    {
+        waitMs = ( uint64_t ) INT32_MAX;
+    }
+
+    return ( int ) waitMs;
+}
+/*-----------------------------------------------------------*/
+
+ReactorStatus_t Reactor_Init( Reactor_t * pReactor )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    struct epoll_event event;
+
+    if( pReactor == NULL )
+    {
+        LogError( ( "Parameter check failed: pReactor is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else
+    {
+        pReactor->pPendingHead = NULL;
+        pReactor->epollDescriptor = epoll_create1( EPOLL_CLOEXEC );
+        pReactor->wakeDescriptor = eventfd( 0U, EFD_NONBLOCK | EFD_CLOEXEC );
+
+        if( ( pReactor->epollDescriptor < 0 ) || ( pReactor->wakeDescriptor < 0 ) )
+        {
+            LogError( ( "Failed to create epoll instance: errno=%d.", errno ) );
+            returnStatus = REACTOR_API_ERROR;
+        }
+    }
+
+    if( returnStatus == REACTOR_SUCCESS )
+    {
+        /* The wake descriptor is reported with a NULL connection. */
+        ( void ) memset( &event, 0, sizeof( event ) );
+        event.events = ( uint32_t ) EPOLLIN;
+        event.data.ptr = NULL;
+
+        if( epoll_ctl( pReactor->epollDescriptor,
+                       EPOLL_CTL_ADD,
+                       pReactor->wakeDescriptor,
+                       &event ) != 0 )
+        {
+            LogError( ( "Failed to watch wake descriptor: errno=%d.", errno ) );
+            returnStatus = REACTOR_API_ERROR;
+        }
+    }
+
+    if( returnStatus == REACTOR_API_ERROR )
+    {
+        Reactor_Deinit( pReactor );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+void Reactor_Deinit( Reactor_t * pReactor )
+{
+    if( pReactor != NULL )
+    {
+        if( pReactor->epollDescriptor >= 0 )
+        {
+            ( void ) close( pReactor->epollDescriptor );
+            pReactor->epollDescriptor = INVALID_SOCKET;
+        }
+
+        if( pReactor->wakeDescriptor >= 0 )
+        {
+            ( void ) close( pReactor->wakeDescriptor );
+            pReactor->wakeDescriptor = INVALID_SOCKET;
+        }
+
+        pReactor->pPendingHead = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+ReactorStatus_t Reactor_Connect( Reactor_t * pReactor,
+                                 ReactorConnection_t * pConnection,
+                                 NetworkContext_t * pNetworkContext,
+                                 const ReactorConnectInfo_t * pConnectInfo )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    struct addrinfo hints;
+    int32_t dnsStatus = -1;
+
+    if( ( pReactor == NULL ) || ( pConnection == NULL ) || ( pConnectInfo == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pReactor, pConnection or pConnectInfo is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pNetworkContext is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else if( ( pConnectInfo->pServerInfo == NULL ) ||
+             ( pConnectInfo->pServerInfo->pHostName == NULL ) ||
+             ( pConnectInfo->pOpensslCredentials == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pServerInfo or pOpensslCredentials is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else if( ( pConnectInfo->connectCallback == NULL ) ||
+             ( pConnectInfo->receiveCallback == NULL ) )
+    {
+        LogError( ( "Parameter check failed: Callbacks must be set." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else
+    {
+        ( void ) memset( pConnection, 0, sizeof( ReactorConnection_t ) );
+        pConnection->socketDescriptor = INVALID_SOCKET;
+        pConnection->pNetworkContext = pNetworkContext;
+        pConnection->connectInfo = *pConnectInfo;
+        pNetworkContext->pParams->pSsl = NULL;
+
+        ( void ) memset( &hints, 0, sizeof( hints ) );
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = ( int32_t ) SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+
+        dnsStatus = getaddrinfo( pConnectInfo->pServerInfo->pHostName,
+                                 NULL,
+                                 &hints,
+                                 &pConnection->pAddresses );
+
+        if( dnsStatus != 0 )
+        {
+            LogError( ( "Failed to resolve DNS: Hostname=%.*s, ErrorCode=%d.",
+                        ( int ) pConnectInfo->pServerInfo->hostNameLength,
+                        pConnectInfo->pServerInfo->pHostName,
+                        ( int ) dnsStatus ) );
+            pConnection->pAddresses = NULL;
+            returnStatus = REACTOR_DNS_FAILURE;
+        }
+    }
+
+    if( returnStatus == REACTOR_SUCCESS )
+    {
+        pConnection->pNextAddress = pConnection->pAddresses;
+        returnStatus = connectNextAddress( pReactor, pConnection );
+
+        if( returnStatus != REACTOR_SUCCESS )
+        {
+            releaseConnect( pConnection );
+        }
+    }
+
+    if( returnStatus == REACTOR_SUCCESS )
+    {
+        if( pConnectInfo->connectTimeoutMs != 0U )
+        {
+            pConnection->deadlineMs = getTimeMs() + pConnectInfo->connectTimeoutMs;
+        }
+
+        pConnection->state = REACTOR_STATE_CONNECTING;
+        insertPending( pReactor, pConnection );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+ReactorStatus_t Reactor_Add( Reactor_t * pReactor,
+                             ReactorConnection_t * pConnection,
+                             int32_t socketDescriptor,
+                             OpensslParams_t * pOpensslParams,
+                             ReactorReceiveCallback_t receiveCallback,
+                             void * pUserContext )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+
+    if( ( pReactor == NULL ) || ( pConnection == NULL ) || ( receiveCallback == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pReactor, pConnection or receiveCallback is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else if( socketDescriptor < 0 )
+    {
+        LogError( ( "Parameter check failed: socketDescriptor is invalid." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else
+    {
+        ( void ) memset( pConnection, 0, sizeof( ReactorConnection_t ) );
+        pConnection->socketDescriptor = socketDescriptor;
+        pConnection->pOpensslParams = pOpensslParams;
+        pConnection->connectInfo.receiveCallback = receiveCallback;
+        pConnection->connectInfo.pUserContext = pUserContext;
+
+        returnStatus = watchSocket( pReactor, pConnection, EPOLL_CTL_ADD, ( uint32_t ) EPOLLIN );
+    }
+
+    if( returnStatus == REACTOR_SUCCESS )
+    {
+        pConnection->state = REACTOR_STATE_READY;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+ReactorStatus_t Reactor_Remove( Reactor_t * pReactor,
+                                ReactorConnection_t * pConnection )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+
+    if( ( pReactor == NULL ) || ( pConnection == NULL ) )
+    {
+        LogError( ( "Parameter check failed: pReactor or pConnection is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else if( pConnection->state == REACTOR_STATE_READY )
+    {
+        ( void ) epoll_ctl( pReactor->epollDescriptor,
+                            EPOLL_CTL_DEL,
+                            pConnection->socketDescriptor,
+                            NULL );
+        pConnection->state = REACTOR_STATE_IDLE;
+    }
+    else if( pConnection->state != REACTOR_STATE_IDLE )
+    {
+        removePending( pReactor, pConnection );
+        releaseConnect( pConnection );
+        pConnection->state = REACTOR_STATE_IDLE;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+ReactorStatus_t Reactor_Dispatch( Reactor_t * pReactor,
+                                  uint32_t timeoutMs )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    struct epoll_event events[ REACTOR_MAX_EVENTS ];
+    ReactorConnection_t * pConnection = NULL;
+    int eventCount = 0, i = 0;
+    uint64_t wakeCount = 0U;
+
+    if( pReactor == NULL )
+    {
+        LogError( ( "Parameter check failed: pReactor is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else
+    {
+        eventCount = epoll_wait( pReactor->epollDescriptor,
+                                 events,
+                                 REACTOR_MAX_EVENTS,
+                                 computeWaitTimeout( pReactor, timeoutMs ) );
+
+        if( eventCount < 0 )
+        {
+            if( errno == EINTR )
+            {
+                eventCount = 0;
+            }
+            else
+            {
+                LogError( ( "epoll_wait failed: errno=%d.", errno ) );
+                returnStatus = REACTOR_API_ERROR;
+            }
+        }
+    }
+
+    for( i = 0; i < eventCount; i++ )
+    {
+        pConnection = ( ReactorConnection_t * ) events[ i ].data.ptr;
+
+        if( pConnection == NULL )
+        {
+            ( void ) read( pReactor->wakeDescriptor, &wakeCount, sizeof( wakeCount ) );
+        }
+        else if( pConnection->state == REACTOR_STATE_CONNECTING )
+        {
+            handleConnecting( pReactor, pConnection );
+        }
+        else if( pConnection->state == REACTOR_STATE_HANDSHAKING )
+        {
+            continueHandshake( pReactor, pConnection );
+        }
+        else if( pConnection->state == REACTOR_STATE_READY )
+        {
+            /* Data already decrypted or read ahead does not make the socket
+             * readable again, so keep calling back until it is drained. */
+            do
+            {
+                pConnection->connectInfo.receiveCallback( pConnection,
+                                                          pConnection->connectInfo.pUserContext );
+            } while( ( pConnection->state == REACTOR_STATE_READY ) &&
+                     hasBufferedData( pConnection ) );
+        }
+        else
+        {
+            /* The connection was removed by an earlier callback. */
+        }
+    }
+
+    if( returnStatus == REACTOR_SUCCESS )
+    {
+        expireConnects( pReactor );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+ReactorStatus_t Reactor_Wakeup( Reactor_t * pReactor )
+{
+    ReactorStatus_t returnStatus = REACTOR_SUCCESS;
+    uint64_t wakeCount = 1U;
+
+    if( pReactor == NULL )
+    {
+        LogError( ( "Parameter check failed: pReactor is NULL." ) );
+        returnStatus = REACTOR_INVALID_PARAMETER;
+    }
+    else if( write( pReactor->wakeDescriptor, &wakeCount, sizeof( wakeCount ) ) < 0 )
+    {
+        LogError( ( "Failed to wake reactor: errno=%d.", errno ) );
+        returnStatus = REACTOR_API_ERROR;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
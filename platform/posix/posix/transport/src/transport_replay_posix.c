@@ -0,0 +1,412 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file transport_replay_posix.c
+ * @brief Implementation of the replay transport.
+ *
+ * The receives and the sends walk the records of the connection with cursors
+ * of their own, each skipping the records of the other, so the code replayed
+ * may send more or less than the device did without losing its place in the
+ * data received.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX includes. */
+#include <unistd.h>
+
+#include "transport_replay_posix.h"
+#include "transport_capture.h"
+
+/*-----------------------------------------------------------*/
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    ReplayParams_t * pParams;
+};
+
+/**
+ * @brief A record of the capture.
+ */
+typedef struct ReplayRecord
+{
+    uint32_t deltaUs;      /**< @brief Time since the previous record. */
+    int32_t result;        /**< @brief What the call returned. */
+    uint8_t type;          /**< @brief A #TransportCaptureRecordType_t. */
+    size_t dataLength;     /**< @brief Bytes of data after the header. */
+    const uint8_t * pData; /**< @brief The data. */
+} ReplayRecord_t;
+
+/*-----------------------------------------------------------*/
+
+static uint64_t nowUs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000U ) + ( ( uint64_t ) now.tv_nsec / 1000U );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t getUint32( const uint8_t * pBytes )
+{
+    return ( uint32_t ) pBytes[ 0 ] | ( ( uint32_t ) pBytes[ 1 ] << 8 ) |
+           ( ( uint32_t ) pBytes[ 2 ] << 16 ) | ( ( uint32_t ) pBytes[ 3 ] << 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read the record at @a offset; false at the end of the capture.
+ */
+static bool readRecord( const ReplayParams_t * pParams,
+                        size_t offset,
+                        ReplayRecord_t * pRecord )
+{
+    const uint8_t * pHeader = &pParams->pCapture[ offset ];
+    bool valid = ( offset + TRANSPORT_CAPTURE_RECORD_HEADER_SIZE ) <= pParams->captureLength;
+
+    if( valid == true )
+    {
+        pRecord->deltaUs = getUint32( pHeader );
+        pRecord->result = ( int32_t ) getUint32( &pHeader[ 4 ] );
+        pRecord->type = pHeader[ 8 ];
+        pRecord->dataLength = 0U;
+        pRecord->pData = &pHeader[ TRANSPORT_CAPTURE_RECORD_HEADER_SIZE ];
+
+        valid = ( pRecord->type == ( uint8_t ) TransportCaptureConnect ) ||
+                ( pRecord->type == ( uint8_t ) TransportCaptureSend ) ||
+                ( pRecord->type == ( uint8_t ) TransportCaptureRecv );
+    }
+
+    if( ( valid == true ) && ( pRecord->result > 0 ) &&
+        ( ( pRecord->type == ( uint8_t ) TransportCaptureRecv ) ||
+          ( ( pRecord->type == ( uint8_t ) TransportCaptureSend ) && ( pParams->sendData == true ) ) ) )
+    {
+        pRecord->dataLength = ( size_t ) pRecord->result;
+
+        /* A capture cut short in a record ends before it. */
+        valid = ( pRecord->dataLength <= ( pParams->captureLength - offset - TRANSPORT_CAPTURE_RECORD_HEADER_SIZE ) );
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read the record at @a offset if it is of the current connection.
+ */
+static bool readConnectionRecord( const ReplayParams_t * pParams,
+                                  size_t offset,
+                                  ReplayRecord_t * pRecord )
+{
+    return ( readRecord( pParams, offset, pRecord ) == true ) &&
+           ( pRecord->type != ( uint8_t ) TransportCaptureConnect );
+}
+
+/*-----------------------------------------------------------*/
+
+TransportReplayStatus_t TransportReplay_Open( ReplayParams_t * pParams,
+                                              const char * pPath,
+                                              uint32_t speed,
+                                              uint32_t recvTimeoutMs )
+{
+    TransportReplayStatus_t status = TRANSPORT_REPLAY_SUCCESS;
+    FILE * pFile = NULL;
+    long length = 0;
+
+    if( ( pParams == NULL ) || ( pPath == NULL ) )
+    {
+        status = TRANSPORT_REPLAY_INVALID_PARAMETER;
+    }
+    else
+    {
+        ( void ) memset( pParams, 0, sizeof( ReplayParams_t ) );
+        pFile = fopen( pPath, "rb" );
+
+        if( ( pFile == NULL ) ||
+            ( fseek( pFile, 0, SEEK_END ) != 0 ) ||
+            ( ( length = ftell( pFile ) ) < 0 ) ||
+            ( fseek( pFile, 0, SEEK_SET ) != 0 ) ||
+            ( ( pParams->pCapture = malloc( ( size_t ) length + 1U ) ) == NULL ) ||
+            ( fread( pParams->pCapture, 1U, ( size_t ) length, pFile ) != ( size_t ) length ) )
+        {
+            LogError( ( "Failed to read the capture %s.", pPath ) );
+            status = TRANSPORT_REPLAY_FILE_ERROR;
+        }
+    }
+
+    if( pFile != NULL )
+    {
+        ( void ) fclose( pFile );
+    }
+
+    if( status == TRANSPORT_REPLAY_SUCCESS )
+    {
+        pParams->captureLength = ( size_t ) length;
+
+        if( ( pParams->captureLength < TRANSPORT_CAPTURE_HEADER_SIZE ) ||
+            ( memcmp( pParams->pCapture, TRANSPORT_CAPTURE_MAGIC, 4U ) != 0 ) ||
+            ( pParams->pCapture[ 4 ] != TRANSPORT_CAPTURE_VERSION ) )
+        {
+            LogError( ( "%s is not a capture of version %u.", pPath, TRANSPORT_CAPTURE_VERSION ) );
+            status = TRANSPORT_REPLAY_INVALID_CAPTURE;
+        }
+        else
+        {
+            pParams->sendData = ( pParams->pCapture[ 5 ] & TRANSPORT_CAPTURE_FLAG_SEND_DATA ) != 0U;
+            pParams->speed = speed;
+            pParams->recvTimeoutMs = recvTimeoutMs;
+            TransportReplay_Rewind( pParams );
+        }
+    }
+
+    if( ( status != TRANSPORT_REPLAY_SUCCESS ) && ( status != TRANSPORT_REPLAY_INVALID_PARAMETER ) )
+    {
+        TransportReplay_Close( pParams );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+TransportReplayStatus_t TransportReplay_Connect( NetworkContext_t * pNetworkContext )
+{
+    TransportReplayStatus_t status = TRANSPORT_REPLAY_SUCCESS;
+    ReplayParams_t * pParams = NULL;
+    ReplayRecord_t record;
+    size_t offset = 0U;
+
+    if( ( pNetworkContext == NULL ) || ( pNetworkContext->pParams == NULL ) ||
+        ( pNetworkContext->pParams->pCapture == NULL ) )
+    {
+        status = TRANSPORT_REPLAY_INVALID_PARAMETER;
+    }
+    else if( readRecord( pNetworkContext->pParams, pNetworkContext->pParams->connectionStart, &record ) == false )
+    {
+        status = TRANSPORT_REPLAY_NO_CONNECTION;
+    }
+    else
+    {
+        pParams = pNetworkContext->pParams;
+        offset = pParams->connectionStart;
+
+        /* The time of the connection counts from its mark. */
+        if( record.type == ( uint8_t ) TransportCaptureConnect )
+        {
+            offset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE;
+        }
+
+        pParams->recvOffset = offset;
+        pParams->recvConsumed = 0U;
+        pParams->recvTimeUs = 0U;
+        pParams->sendOffset = offset;
+        pParams->sendConsumed = 0U;
+        pParams->startUs = nowUs();
+        pParams->stats.connections++;
+
+        while( readConnectionRecord( pParams, offset, &record ) == true )
+        {
+            offset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE + record.dataLength;
+        }
+
+        /* A capture cut short ends here for good. */
+        pParams->connectionStart = ( readRecord( pParams, offset, &record ) == true ) ? offset : pParams->captureLength;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void TransportReplay_Rewind( ReplayParams_t * pParams )
+{
+    pParams->connectionStart = TRANSPORT_CAPTURE_HEADER_SIZE;
+    pParams->recvOffset = pParams->captureLength;
+    pParams->sendOffset = pParams->captureLength;
+    ( void ) memset( &pParams->stats, 0, sizeof( pParams->stats ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void TransportReplay_Close( ReplayParams_t * pParams )
+{
+    if( pParams != NULL )
+    {
+        free( pParams->pCapture );
+        pParams->pCapture = NULL;
+        pParams->captureLength = 0U;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TransportReplay_Recv( NetworkContext_t * pNetworkContext,
+                              void * pBuffer,
+                              size_t bytesToRecv )
+{
+    ReplayParams_t * pParams = pNetworkContext->pParams;
+    ReplayRecord_t record;
+    uint64_t dueUs = 0U, timeUs = 0U, deadlineUs = 0U;
+    size_t length = 0U;
+    int32_t result = 0;
+    bool waiting = true;
+
+    /* Skip the sends, keeping their time. */
+    while( ( readConnectionRecord( pParams, pParams->recvOffset, &record ) == true ) &&
+           ( record.type != ( uint8_t ) TransportCaptureRecv ) )
+    {
+        pParams->recvTimeUs += record.deltaUs;
+        pParams->recvOffset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE + record.dataLength;
+    }
+
+    if( readConnectionRecord( pParams, pParams->recvOffset, &record ) == false )
+    {
+        /* The device's connection ended here. */
+        result = -1;
+    }
+    else
+    {
+        if( pParams->speed > 0U )
+        {
+            dueUs = pParams->startUs + ( ( pParams->recvTimeUs + record.deltaUs ) / pParams->speed );
+            timeUs = nowUs();
+            deadlineUs = timeUs + ( ( uint64_t ) pParams->recvTimeoutMs * 1000U );
+
+            if( dueUs > timeUs )
+            {
+                waiting = ( dueUs > deadlineUs );
+                ( void ) usleep( ( useconds_t ) ( ( ( waiting == true ) ? deadlineUs : dueUs ) - timeUs ) );
+            }
+            else
+            {
+                waiting = false;
+            }
+        }
+        else
+        {
+            waiting = false;
+        }
+
+        if( waiting == true )
+        {
+            /* Nothing arrived within the timeout. */
+        }
+        else if( record.result < 0 )
+        {
+            result = record.result;
+            pParams->recvTimeUs += record.deltaUs;
+            pParams->recvOffset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE;
+        }
+        else
+        {
+            length = record.dataLength - pParams->recvConsumed;
+            length = ( length < bytesToRecv ) ? length : bytesToRecv;
+            ( void ) memcpy( pBuffer, &record.pData[ pParams->recvConsumed ], length );
+            pParams->recvConsumed += length;
+
+            if( pParams->recvConsumed == record.dataLength )
+            {
+                pParams->recvTimeUs += record.deltaUs;
+                pParams->recvOffset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE + record.dataLength;
+                pParams->recvConsumed = 0U;
+            }
+
+            result = ( int32_t ) length;
+            pParams->stats.recvCalls++;
+            pParams->stats.bytesReceived += length;
+        }
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TransportReplay_Send( NetworkContext_t * pNetworkContext,
+                              const void * pBuffer,
+                              size_t bytesToSend )
+{
+    ReplayParams_t * pParams = pNetworkContext->pParams;
+    const uint8_t * pBytes = pBuffer;
+    ReplayRecord_t record;
+    size_t compared = 0U, length = 0U;
+    bool matches = true;
+
+    while( compared < bytesToSend )
+    {
+        /* Skip the receives and the sends that failed on the device. */
+        while( ( readConnectionRecord( pParams, pParams->sendOffset, &record ) == true ) &&
+               ( ( record.type != ( uint8_t ) TransportCaptureSend ) || ( record.result <= 0 ) ) )
+        {
+            pParams->sendOffset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE + record.dataLength;
+        }
+
+        if( readConnectionRecord( pParams, pParams->sendOffset, &record ) == false )
+        {
+            /* More is sent than the device did. */
+            matches = false;
+            break;
+        }
+
+        length = ( size_t ) record.result - pParams->sendConsumed;
+        length = ( length < ( bytesToSend - compared ) ) ? length : ( bytesToSend - compared );
+
+        if( ( pParams->sendData == true ) &&
+            ( memcmp( &pBytes[ compared ], &record.pData[ pParams->sendConsumed ], length ) != 0 ) )
+        {
+            matches = false;
+        }
+
+        compared += length;
+        pParams->sendConsumed += length;
+
+        if( pParams->sendConsumed == ( size_t ) record.result )
+        {
+            pParams->sendOffset += TRANSPORT_CAPTURE_RECORD_HEADER_SIZE + record.dataLength;
+            pParams->sendConsumed = 0U;
+        }
+    }
+
+    if( matches == false )
+    {
+        LogDebug( ( "A send of %lu bytes differs from the capture.", ( unsigned long ) bytesToSend ) );
+        pParams->stats.sendMismatches++;
+    }
+
+    pParams->stats.sendCalls++;
+    pParams->stats.bytesSent += bytesToSend;
+
+    return ( int32_t ) bytesToSend;
+}
+
+/*-----------------------------------------------------------*/
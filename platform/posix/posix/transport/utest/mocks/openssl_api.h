@@ -59,6 +59,16 @@ struct ssl_method_st
     int filler;
 };
 
+struct ssl_session_st
+{
+    int filler;
+};
+
+struct bio_st
+{
+    int filler;
+};
+
 /* The functions prototypes below are used by CMock to generate mocks
  * for any OpenSSL API calls used by the OpenSSL transport wrapper.
  *
@@ -112,10 +122,26 @@ extern int SSL_set1_host( SSL * s,
 
 extern int SSL_connect( SSL * ssl );
 
+extern void SSL_set_connect_state( SSL * ssl );
+
+extern int SSL_do_handshake( SSL * ssl );
+
 extern long SSL_get_verify_result( const SSL * ssl );
 
 extern void SSL_CTX_free( SSL_CTX * );
 
+extern int SSL_CTX_up_ref( SSL_CTX * ctx );
+
+extern void SSL_CTX_sess_set_new_cb( SSL_CTX * ctx,
+                                     int ( * new_session_cb )( struct ssl_st *, SSL_SESSION * ) );
+
+extern SSL_CTX * SSL_get_SSL_CTX( const SSL * ssl );
+
+extern int SSL_set_session( SSL * to,
+                            SSL_SESSION * session );
+
+extern void SSL_SESSION_free( SSL_SESSION * ses );
+
 extern void SSL_free( SSL * ssl );
 
 /* Macro wrappers:
@@ -148,6 +174,33 @@ extern int SSL_write( SSL * ssl,
 
 extern int SSL_pending( const SSL * ssl );
 
+extern int SSL_has_pending( const SSL * s );
+
+extern void SSL_set_read_ahead( SSL * s,
+                                int yes );
+
+extern SSL_SESSION * SSL_get_session( const SSL * ssl );
+
+extern uint32_t SSL_SESSION_get_max_early_data( const SSL_SESSION * s );
+
+extern int SSL_write_early_data( SSL * s,
+                                 const void * buf,
+                                 size_t num,
+                                 size_t * written );
+
+extern int SSL_get_early_data_status( const SSL * s );
+
+extern uint64_t SSL_set_options( SSL * s,
+                                 uint64_t op );
+
+extern BIO * SSL_get_rbio( const SSL * s );
+
+/* BIO_get_ktls_recv */
+extern long BIO_ctrl( BIO * bp,
+                      int cmd,
+                      long larg,
+                      void * parg );
+
 const char * ERR_reason_error_string( unsigned long e );
 
 void X509_free( X509 * a );
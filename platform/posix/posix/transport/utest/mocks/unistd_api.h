@@ -23,6 +23,8 @@
 #ifndef UNISTD_API_H_
 #define UNISTD_API_H_
 
+#include <sys/types.h>
+
 /**
  * @file unistd_api.h
  * @brief This file is used to generate a mock for any functions from
@@ -46,4 +48,23 @@ extern int close( int __fd );
 extern char * getcwd( char * __buf,
                       size_t __size );
 
+/* Write N bytes of BUF to FD at the given position OFFSET without
+ * changing the file pointer.  Return the number written, or -1.  */
+extern ssize_t pwrite( int __fd,
+                       const void * __buf,
+                       size_t __n,
+                       off_t __offset );
+
+/* Create a one-way communication channel (pipe) with the given flags.  */
+extern int pipe2( int __pipedes[ 2 ],
+                  int __flags );
+
+/* Splice two files together, from fcntl.h.  */
+extern ssize_t splice( int __fdin,
+                       loff_t * __offin,
+                       int __fdout,
+                       loff_t * __offout,
+                       size_t __len,
+                       unsigned int __flags );
+
 #endif /* ifndef UNISTD_API_H_ */
@@ -80,6 +80,15 @@ static SSL_CTX sslCtx;
 static FILE rootCaFile;
 static X509 rootCa;
 static X509_STORE CaStore;
+static SSL_SESSION sslSession;
+static BIO readBio;
+
+/* New-session callback registered by the transport on a shared SSL_CTX. */
+static int ( * newSessionCallback )( SSL *, SSL_SESSION * ) = NULL;
+
+/* An MQTT CONNECT packet and a QoS 0 PUBLISH, which may be sent as early data. */
+static const uint8_t mqttConnect[] = { 0x10, 0x04, 'M', 'Q', 'T', 'T' };
+static const uint8_t mqttPublish[] = { 0x30, 0x05, 0x00, 0x01, 't', 'h', 'i' };
 
 /**
  * @brief OpenSSL Connect / Disconnect return status.
@@ -142,6 +151,69 @@ int suiteTearDown( int numFailures )
 
 /* ========================================================================== */
 
+/**
+ * @brief Stub for #SSL_CTX_sess_set_new_cb which stores the callback so that
+ * tests can simulate the server issuing a session.
+ */
+static void captureNewSessionCallback( SSL_CTX * ctx,
+                                       int ( * new_session_cb )( struct ssl_st *, SSL_SESSION * ),
+                                       int cmock_num_calls )
+{
+    ( void ) ctx;
+    ( void ) cmock_num_calls;
+
+    newSessionCallback = new_session_cb;
+}
+
+/**
+ * @brief Stub for #SSL_write_early_data which accepts every byte.
+ */
+static int writeAllEarlyData( SSL * s,
+                              const void * buf,
+                              size_t num,
+                              size_t * written,
+                              int cmock_num_calls )
+{
+    ( void ) s;
+    ( void ) buf;
+    ( void ) cmock_num_calls;
+
+    *written = num;
+
+    return 1;
+}
+
+/**
+ * @brief Stub for #splice which moves a record of two bytes from the socket
+ * to the pipe and then to the file, and then finds a record which is not
+ * application data.
+ */
+static ssize_t spliceRecordThenControl( int fdin,
+                                        loff_t * offin,
+                                        int fdout,
+                                        loff_t * offout,
+                                        size_t len,
+                                        unsigned int flags,
+                                        int cmock_num_calls )
+{
+    ssize_t spliceSize = 2;
+
+    ( void ) fdin;
+    ( void ) offin;
+    ( void ) fdout;
+    ( void ) offout;
+    ( void ) len;
+    ( void ) flags;
+
+    if( cmock_num_calls >= 2 )
+    {
+        errno = EINVAL;
+        spliceSize = -1;
+    }
+
+    return spliceSize;
+}
+
 /**
  * @brief Converts the sockets wrapper status to openssl status.
  *
@@ -683,6 +755,318 @@ void test_Openssl_Connect_Succeeds( void )
     TEST_ASSERT_EQUAL( OPENSSL_SUCCESS, returnStatus );
 }
 
+/**
+ * @brief Test that a connection with #OpensslCredentials_t.reuseSslContext set
+ * shares its SSL context and session with the next connection to the same
+ * server, which then skips loading the credentials.
+ */
+void test_Openssl_Connect_Reuses_Cached_Context( void )
+{
+    OpensslStatus_t returnStatus;
+
+    opensslCredentials.reuseSslContext = true;
+    newSessionCallback = NULL;
+
+    /* The first connection loads the credentials and shares the context. */
+    ( void ) failFunctionFrom_Openssl_Connect( SSL_get_verify_result_fn + 1,
+                                               NULL );
+    SSL_CTX_ctrl_ExpectAnyArgsAndReturn( 0 );
+    SSL_CTX_sess_set_new_cb_Stub( captureNewSessionCallback );
+    SSL_CTX_up_ref_ExpectAndReturn( &sslCtx, 1 );
+    returnStatus = Openssl_Connect( &networkContext,
+                                    &serverInfo,
+                                    &opensslCredentials,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_SUCCESS, returnStatus );
+    TEST_ASSERT_NOT_NULL( newSessionCallback );
+
+    /* The server issues a session which the cache keeps. */
+    SSL_get_SSL_CTX_ExpectAndReturn( &ssl, &sslCtx );
+    TEST_ASSERT_EQUAL( 1, newSessionCallback( &ssl, &sslSession ) );
+
+    /* The second connection neither creates a context nor reads any file,
+     * and offers the cached session for resumption. */
+    Sockets_Connect_ExpectAnyArgsAndReturn( SOCKETS_SUCCESS );
+    SSL_CTX_up_ref_ExpectAndReturn( &sslCtx, 1 );
+    SSL_new_ExpectAndReturn( &sslCtx, &ssl );
+    SSL_set_session_ExpectAndReturn( &ssl, &sslSession, 1 );
+    SSL_set1_host_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_verify_ExpectAnyArgs();
+    SSL_set_fd_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_alpn_protos_ExpectAnyArgsAndReturn( 0 );
+    SSL_ctrl_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_default_read_buffer_len_ExpectAnyArgs();
+    SSL_ctrl_ExpectAnyArgsAndReturn( 1 );
+    SSL_connect_ExpectAnyArgsAndReturn( 1 );
+    SSL_get_verify_result_ExpectAnyArgsAndReturn( X509_V_OK );
+    SSL_CTX_free_Expect( &sslCtx );
+    returnStatus = Openssl_Connect( &networkContext,
+                                    &serverInfo,
+                                    &opensslCredentials,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_SUCCESS, returnStatus );
+
+    /* Clearing the cache drops its references to the session and context. */
+    SSL_SESSION_free_Expect( &sslSession );
+    SSL_CTX_free_Expect( &sslCtx );
+    Openssl_ClearContextCache();
+}
+
+/**
+ * @brief Test that #Openssl_HandshakeContinue reports which socket event the
+ * handshake waits for and verifies the peer once it completes.
+ */
+void test_Openssl_HandshakeContinue_Status( void )
+{
+    OpensslStatus_t returnStatus;
+
+    opensslParams.pSsl = &ssl;
+
+    SSL_do_handshake_ExpectAnyArgsAndReturn( -1 );
+    SSL_get_error_ExpectAnyArgsAndReturn( SSL_ERROR_WANT_READ );
+    returnStatus = Openssl_HandshakeContinue( &networkContext );
+    TEST_ASSERT_EQUAL( OPENSSL_HANDSHAKE_WANT_READ, returnStatus );
+
+    SSL_do_handshake_ExpectAnyArgsAndReturn( -1 );
+    SSL_get_error_ExpectAnyArgsAndReturn( SSL_ERROR_WANT_WRITE );
+    returnStatus = Openssl_HandshakeContinue( &networkContext );
+    TEST_ASSERT_EQUAL( OPENSSL_HANDSHAKE_WANT_WRITE, returnStatus );
+
+    SSL_do_handshake_ExpectAnyArgsAndReturn( 0 );
+    SSL_get_error_ExpectAnyArgsAndReturn( SSL_ERROR_SSL );
+    returnStatus = Openssl_HandshakeContinue( &networkContext );
+    TEST_ASSERT_EQUAL( OPENSSL_HANDSHAKE_FAILED, returnStatus );
+
+    SSL_do_handshake_ExpectAnyArgsAndReturn( 1 );
+    SSL_get_verify_result_ExpectAnyArgsAndReturn( X509_V_OK );
+    returnStatus = Openssl_HandshakeContinue( &networkContext );
+    TEST_ASSERT_EQUAL( OPENSSL_SUCCESS, returnStatus );
+
+    /* A handshake that was never started is rejected. */
+    opensslParams.pSsl = NULL;
+    returnStatus = Openssl_HandshakeContinue( &networkContext );
+    TEST_ASSERT_EQUAL( OPENSSL_INVALID_PARAMETER, returnStatus );
+}
+
+/**
+ * @brief Test that #OpensslCredentials_t.allowEarlyData is rejected without a
+ * shared context or early data storage.
+ */
+void test_Openssl_Connect_Early_Data_Invalid_Params( void )
+{
+    OpensslStatus_t returnStatus;
+    uint8_t earlyDataBuffer[ 16 ];
+    OpensslEarlyData_t earlyData = { 0 };
+
+    opensslCredentials.allowEarlyData = true;
+    opensslParams.pEarlyData = NULL;
+    opensslCredentials.reuseSslContext = true;
+    returnStatus = Openssl_Connect( &networkContext, &serverInfo, &opensslCredentials,
+                                    SEND_RECV_TIMEOUT, SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_INVALID_PARAMETER, returnStatus );
+
+    opensslParams.pEarlyData = &earlyData;
+    returnStatus = Openssl_Connect( &networkContext, &serverInfo, &opensslCredentials,
+                                    SEND_RECV_TIMEOUT, SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_INVALID_PARAMETER, returnStatus );
+
+    earlyData.pBuffer = earlyDataBuffer;
+    earlyData.bufferSize = sizeof( earlyDataBuffer );
+    opensslCredentials.reuseSslContext = false;
+    returnStatus = Openssl_Connect( &networkContext, &serverInfo, &opensslCredentials,
+                                    SEND_RECV_TIMEOUT, SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_INVALID_PARAMETER, returnStatus );
+
+    opensslParams.pEarlyData = NULL;
+}
+
+/**
+ * @brief Test that a connection resuming a session which allows early data
+ * defers its handshake, sends CONNECT and the first publish early, and sends
+ * them again once the server rejects them.
+ */
+void test_Openssl_Connect_Sends_Early_Data( void )
+{
+    OpensslStatus_t returnStatus;
+    int32_t bytesTransferred;
+    uint8_t earlyDataBuffer[ 16 ];
+    OpensslEarlyData_t earlyData = { 0 };
+
+    earlyData.pBuffer = earlyDataBuffer;
+    earlyData.bufferSize = sizeof( earlyDataBuffer );
+    earlyData.pFirstPublish = mqttPublish;
+    earlyData.firstPublishLength = sizeof( mqttPublish );
+    opensslParams.pEarlyData = &earlyData;
+    opensslCredentials.reuseSslContext = true;
+    opensslCredentials.allowEarlyData = true;
+    newSessionCallback = NULL;
+
+    /* Without a session to resume, the first connection performs a full
+     * handshake. */
+    ( void ) failFunctionFrom_Openssl_Connect( SSL_get_verify_result_fn + 1,
+                                               NULL );
+    SSL_CTX_ctrl_ExpectAnyArgsAndReturn( 0 );
+    SSL_CTX_sess_set_new_cb_Stub( captureNewSessionCallback );
+    SSL_CTX_up_ref_ExpectAndReturn( &sslCtx, 1 );
+    SSL_get_session_ExpectAndReturn( &ssl, NULL );
+    returnStatus = Openssl_Connect( &networkContext, &serverInfo, &opensslCredentials,
+                                    SEND_RECV_TIMEOUT, SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_SUCCESS, returnStatus );
+    TEST_ASSERT_FALSE( earlyData.handshakePending );
+
+    SSL_get_SSL_CTX_ExpectAndReturn( &ssl, &sslCtx );
+    TEST_ASSERT_EQUAL( 1, newSessionCallback( &ssl, &sslSession ) );
+
+    /* The second connection resumes the session and stops before SSL_connect. */
+    Sockets_Connect_ExpectAnyArgsAndReturn( SOCKETS_SUCCESS );
+    SSL_CTX_up_ref_ExpectAndReturn( &sslCtx, 1 );
+    SSL_new_ExpectAndReturn( &sslCtx, &ssl );
+    SSL_set_session_ExpectAndReturn( &ssl, &sslSession, 1 );
+    SSL_CTX_free_Expect( &sslCtx );
+    SSL_get_session_ExpectAndReturn( &ssl, &sslSession );
+    SSL_SESSION_get_max_early_data_ExpectAndReturn( &sslSession, 16384 );
+    SSL_set1_host_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_verify_ExpectAnyArgs();
+    SSL_set_fd_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_alpn_protos_ExpectAnyArgsAndReturn( 0 );
+    SSL_ctrl_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_default_read_buffer_len_ExpectAnyArgs();
+    SSL_ctrl_ExpectAnyArgsAndReturn( 1 );
+    SSL_set_connect_state_Expect( &ssl );
+    returnStatus = Openssl_Connect( &networkContext, &serverInfo, &opensslCredentials,
+                                    SEND_RECV_TIMEOUT, SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( OPENSSL_SUCCESS, returnStatus );
+    TEST_ASSERT_TRUE( earlyData.handshakePending );
+    TEST_ASSERT_EQUAL( sizeof( earlyDataBuffer ), earlyData.maxLength );
+
+    /* CONNECT is followed by the first publish, both without a poll. */
+    SSL_write_early_data_Stub( writeAllEarlyData );
+    bytesTransferred = Openssl_Send( &networkContext, mqttConnect, sizeof( mqttConnect ) );
+    TEST_ASSERT_EQUAL( sizeof( mqttConnect ), bytesTransferred );
+    TEST_ASSERT_NULL( earlyData.pFirstPublish );
+    TEST_ASSERT_EQUAL( sizeof( mqttConnect ) + sizeof( mqttPublish ), earlyData.length );
+    TEST_ASSERT_EQUAL_MEMORY( mqttConnect, earlyDataBuffer, sizeof( mqttConnect ) );
+    TEST_ASSERT_EQUAL_MEMORY( mqttPublish, &earlyDataBuffer[ sizeof( mqttConnect ) ],
+                              sizeof( mqttPublish ) );
+    SSL_write_early_data_Stub( NULL );
+
+    /* The first receive completes the handshake, and the rejected bytes are
+     * sent again. */
+    SSL_connect_ExpectAndReturn( &ssl, 1 );
+    SSL_get_verify_result_ExpectAnyArgsAndReturn( X509_V_OK );
+    SSL_get_early_data_status_ExpectAndReturn( &ssl, SSL_EARLY_DATA_REJECTED );
+    SSL_write_ExpectAndReturn( &ssl, earlyDataBuffer, ( int ) earlyData.length, ( int ) earlyData.length );
+    SSL_read_ExpectAnyArgsAndReturn( BYTES_TO_RECV );
+    bytesTransferred = Openssl_Recv( &networkContext, opensslBuffer, BYTES_TO_RECV );
+    TEST_ASSERT_EQUAL( BYTES_TO_RECV, bytesTransferred );
+    TEST_ASSERT_FALSE( earlyData.handshakePending );
+
+    /* Later packets are sent normally. */
+    poll_ExpectAnyArgsAndReturn( 1 );
+    SSL_write_ExpectAnyArgsAndReturn( sizeof( mqttPublish ) );
+    bytesTransferred = Openssl_Send( &networkContext, mqttPublish, sizeof( mqttPublish ) );
+    TEST_ASSERT_EQUAL( sizeof( mqttPublish ), bytesTransferred );
+
+    SSL_SESSION_free_Expect( &sslSession );
+    SSL_CTX_free_Expect( &sslCtx );
+    Openssl_ClearContextCache();
+    opensslParams.pEarlyData = NULL;
+}
+
+/**
+ * @brief Test that a packet which may not be replayed completes a deferred
+ * handshake before it is sent.
+ */
+void test_Openssl_Send_Completes_Handshake_For_Unsafe_Packet( void )
+{
+    int32_t bytesSent;
+    uint8_t earlyDataBuffer[ 16 ];
+    OpensslEarlyData_t earlyData = { 0 };
+    /* SUBSCRIBE, which the broker acknowledges. */
+    const uint8_t mqttSubscribe[] = { 0x82, 0x02, 0x00, 0x01 };
+
+    earlyData.pBuffer = earlyDataBuffer;
+    earlyData.bufferSize = sizeof( earlyDataBuffer );
+    earlyData.maxLength = sizeof( earlyDataBuffer );
+    earlyData.handshakePending = true;
+    opensslParams.pEarlyData = &earlyData;
+    opensslParams.pSsl = &ssl;
+
+    SSL_connect_ExpectAndReturn( &ssl, 1 );
+    SSL_get_verify_result_ExpectAnyArgsAndReturn( X509_V_OK );
+    poll_ExpectAnyArgsAndReturn( 1 );
+    SSL_write_ExpectAnyArgsAndReturn( sizeof( mqttSubscribe ) );
+    bytesSent = Openssl_Send( &networkContext, mqttSubscribe, sizeof( mqttSubscribe ) );
+    TEST_ASSERT_EQUAL( sizeof( mqttSubscribe ), bytesSent );
+    TEST_ASSERT_FALSE( earlyData.handshakePending );
+    TEST_ASSERT_EQUAL( 0, earlyData.length );
+
+    /* A failed handshake fails the send. */
+    earlyData.handshakePending = true;
+    SSL_connect_ExpectAndReturn( &ssl, -1 );
+    bytesSent = Openssl_Send( &networkContext, mqttSubscribe, sizeof( mqttSubscribe ) );
+    TEST_ASSERT_EQUAL( -1, bytesSent );
+
+    opensslParams.pEarlyData = NULL;
+}
+
+/**
+ * @brief Test that #Openssl_RecvToFile writes data decrypted by OpenSSL to
+ * the file when the kernel does not decrypt the records.
+ */
+void test_Openssl_RecvToFile_Copies_In_User_Space( void )
+{
+    int32_t bytesReceived;
+
+    opensslParams.pSsl = &ssl;
+
+    bytesReceived = Openssl_RecvToFile( &networkContext, -1, 0, BYTES_TO_RECV );
+    TEST_ASSERT_EQUAL( -1, bytesReceived );
+
+    SSL_get_rbio_ExpectAndReturn( &ssl, &readBio );
+    BIO_ctrl_ExpectAnyArgsAndReturn( 0 );
+    SSL_read_ExpectAnyArgsAndReturn( BYTES_TO_RECV );
+    pwrite_ExpectAnyArgsAndReturn( BYTES_TO_RECV );
+    bytesReceived = Openssl_RecvToFile( &networkContext, 3, 100, BYTES_TO_RECV );
+    TEST_ASSERT_EQUAL( BYTES_TO_RECV, bytesReceived );
+
+    /* A failed write fails the receive. */
+    SSL_get_rbio_ExpectAndReturn( &ssl, &readBio );
+    BIO_ctrl_ExpectAnyArgsAndReturn( 0 );
+    SSL_read_ExpectAnyArgsAndReturn( BYTES_TO_RECV );
+    pwrite_ExpectAnyArgsAndReturn( -1 );
+    bytesReceived = Openssl_RecvToFile( &networkContext, 3, 0, BYTES_TO_RECV );
+    TEST_ASSERT_EQUAL( -1, bytesReceived );
+}
+
+/**
+ * @brief Test that #Openssl_RecvToFile splices the records decrypted by the
+ * kernel into the file, and leaves the other records to #SSL_read.
+ */
+void test_Openssl_RecvToFile_Splices_Kernel_Tls( void )
+{
+    int32_t bytesReceived;
+
+    opensslParams.pSsl = &ssl;
+
+    /* A record of two bytes, then one which is not application data. */
+    SSL_get_rbio_ExpectAndReturn( &ssl, &readBio );
+    BIO_ctrl_ExpectAnyArgsAndReturn( 1 );
+    pipe2_ExpectAnyArgsAndReturn( 0 );
+    SSL_pending_ExpectAnyArgsAndReturn( 0 );
+    SSL_pending_ExpectAnyArgsAndReturn( 0 );
+    splice_Stub( spliceRecordThenControl );
+    SSL_read_ExpectAnyArgsAndReturn( BYTES_TO_RECV - 2 );
+    pwrite_ExpectAnyArgsAndReturn( BYTES_TO_RECV - 2 );
+    close_ExpectAnyArgsAndReturn( 0 );
+    close_ExpectAnyArgsAndReturn( 0 );
+    bytesReceived = Openssl_RecvToFile( &networkContext, 3, 0, BYTES_TO_RECV );
+    TEST_ASSERT_EQUAL( BYTES_TO_RECV, bytesReceived );
+    splice_Stub( NULL );
+}
+
 /**
  * @brief Test that #Openssl_Disconnect is able to return
  * #OPENSSL_INVALID_PARAMETER when #NetworkContext_t is NULL.
@@ -869,6 +1253,96 @@ void test_Openssl_Recv_All_Bytes_Received_Successfully( void )
     TEST_ASSERT_EQUAL( 1U, bytesReceived );
 }
 
+/**
+ * @brief Test that #Openssl_Recv serves small reads from the read-ahead buffer
+ * without polling the socket or calling #SSL_read again.
+ */
+void test_Openssl_Recv_Read_Ahead( void )
+{
+    int32_t bytesReceived;
+    uint8_t readAheadBuffer[ 16 ];
+    uint8_t recvBuffer[ 8 ] = { 0 };
+    size_t i;
+
+    for( i = 0; i < sizeof( readAheadBuffer ); i++ )
+    {
+        readAheadBuffer[ i ] = ( uint8_t ) i;
+    }
+
+    opensslParams.pSsl = &ssl;
+    opensslParams.pReadAheadBuffer = readAheadBuffer;
+    opensslParams.readAheadBufferSize = sizeof( readAheadBuffer );
+
+    /* The first 1-byte read polls and fills the read-ahead buffer. The mocked
+     * SSL_read leaves the buffer untouched, so its pattern is returned. */
+    SSL_has_pending_ExpectAnyArgsAndReturn( 0 );
+    poll_ExpectAnyArgsAndReturn( 1 );
+    SSL_read_ExpectAnyArgsAndReturn( 6 );
+    bytesReceived = Openssl_Recv( &networkContext, recvBuffer, 1U );
+    TEST_ASSERT_EQUAL( 1, bytesReceived );
+    TEST_ASSERT_EQUAL( 0, recvBuffer[ 0 ] );
+
+    /* The following reads are served from user space, with a short read once
+     * the buffered data runs out. */
+    bytesReceived = Openssl_Recv( &networkContext, recvBuffer, 1U );
+    TEST_ASSERT_EQUAL( 1, bytesReceived );
+    TEST_ASSERT_EQUAL( 1, recvBuffer[ 0 ] );
+
+    bytesReceived = Openssl_Recv( &networkContext, recvBuffer, BYTES_TO_RECV + 2U );
+    TEST_ASSERT_EQUAL( 4, bytesReceived );
+    TEST_ASSERT_EQUAL_UINT8_ARRAY( &readAheadBuffer[ 2 ], recvBuffer, 4 );
+    TEST_ASSERT_EQUAL( 0, opensslParams.readAheadLength );
+
+    /* Reads at least as large as the read-ahead buffer bypass it. */
+    SSL_read_ExpectAnyArgsAndReturn( BYTES_TO_RECV );
+    opensslParams.readAheadBufferSize = sizeof( recvBuffer );
+    bytesReceived = Openssl_Recv( &networkContext, recvBuffer, sizeof( recvBuffer ) );
+    TEST_ASSERT_EQUAL( BYTES_TO_RECV, bytesReceived );
+    TEST_ASSERT_EQUAL( 0, opensslParams.readAheadLength );
+
+    opensslParams.pReadAheadBuffer = NULL;
+    opensslParams.readAheadBufferSize = 0U;
+}
+
+/**
+ * @brief Test that #Openssl_Send and #Openssl_Recv account bytes, calls and
+ * errors in the metrics block attached to the OpenSSL parameters.
+ */
+void test_Openssl_Metrics_Recorded( void )
+{
+    int32_t bytesTransferred;
+    TransportMetrics_t metrics = { 0 };
+
+    opensslParams.pSsl = &ssl;
+    opensslParams.pMetrics = &metrics;
+
+    poll_ExpectAnyArgsAndReturn( 1 );
+    SSL_write_ExpectAnyArgsAndReturn( BYTES_TO_SEND );
+    bytesTransferred = Openssl_Send( &networkContext, opensslBuffer, BYTES_TO_SEND );
+    TEST_ASSERT_EQUAL( BYTES_TO_SEND, bytesTransferred );
+
+    SSL_read_ExpectAnyArgsAndReturn( BYTES_TO_RECV );
+    bytesTransferred = Openssl_Recv( &networkContext, opensslBuffer, BYTES_TO_RECV );
+    TEST_ASSERT_EQUAL( BYTES_TO_RECV, bytesTransferred );
+
+    poll_ExpectAnyArgsAndReturn( -1 );
+    bytesTransferred = Openssl_Send( &networkContext, opensslBuffer, BYTES_TO_SEND );
+    TEST_ASSERT_EQUAL( -1, bytesTransferred );
+
+    TEST_ASSERT_EQUAL( BYTES_TO_SEND, metrics.bytesSent );
+    TEST_ASSERT_EQUAL( BYTES_TO_RECV, metrics.bytesReceived );
+    TEST_ASSERT_EQUAL( 2, metrics.sendCalls );
+    TEST_ASSERT_EQUAL( 1, metrics.recvCalls );
+    TEST_ASSERT_EQUAL( 1, metrics.sendErrors );
+    TEST_ASSERT_EQUAL( 0, metrics.recvErrors );
+
+    TransportMetrics_Reset( &metrics );
+    TEST_ASSERT_EQUAL( 0, metrics.sendCalls );
+    TEST_ASSERT_EQUAL( 0, metrics.bytesSent );
+
+    opensslParams.pMetrics = NULL;
+}
+
 /**
  * @brief Test that #Openssl_Recv returns an error when #SSL_read fails to
  * receive data over the network stack.
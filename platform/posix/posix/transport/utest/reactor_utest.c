@@ -0,0 +1,189 @@
+/*
+ * AWS IoT Device SDK for Embedded C 202108.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+#include "unity.h"
+
+/* Include paths for public enums, structures, and macros. */
+#include "transport_reactor_posix.h"
+
+#include "mock_unistd_api.h"
+#include "mock_openssl_api.h"
+#include "mock_sockets_posix.h"
+
+/* Size of the read-ahead buffer of the connection. */
+#define READ_AHEAD_BUFFER_LEN    16U
+
+/* Bytes buffered when the socket is reported readable. */
+#define BUFFERED_BYTES           10U
+
+/* Bytes consumed by the first receive callback, leaving fewer bytes buffered
+ * than the read position. */
+#define FIRST_READ_BYTES         6U
+
+/* Each compilation unit must define the NetworkContext struct. */
+struct NetworkContext
+{
+    OpensslParams_t * pParams;
+};
+
+/* Objects used by the reactor. */
+static Reactor_t reactor;
+static ReactorConnection_t connection;
+static OpensslParams_t opensslParams;
+static uint8_t readAheadBuffer[ READ_AHEAD_BUFFER_LEN ];
+static int readableDescriptor = -1;
+
+/* Objects from the OpenSSL API. */
+static SSL ssl;
+
+/* Number of calls to the receive callback. */
+static uint32_t receiveCount = 0U;
+
+/* ============================   UNITY FIXTURES ============================ */
+
+/* Called before each test method. */
+void setUp()
+{
+    memset( &connection, 0, sizeof( ReactorConnection_t ) );
+    memset( &opensslParams, 0, sizeof( OpensslParams_t ) );
+    opensslParams.pSsl = &ssl;
+    opensslParams.pReadAheadBuffer = readAheadBuffer;
+    opensslParams.readAheadBufferSize = sizeof( readAheadBuffer );
+    receiveCount = 0U;
+
+    TEST_ASSERT_EQUAL( REACTOR_SUCCESS, Reactor_Init( &reactor ) );
+
+    /* An eventfd with a non-zero count stands in for a readable socket. */
+    readableDescriptor = eventfd( 1U, EFD_NONBLOCK );
+    TEST_ASSERT_TRUE( readableDescriptor >= 0 );
+}
+
+/* Called after each test method. */
+void tearDown()
+{
+    close_IgnoreAndReturn( 0 );
+    Reactor_Deinit( &reactor );
+}
+
+/* Called at the beginning of the whole suite. */
+void suiteSetUp()
+{
+}
+
+/* Called at the end of the whole suite. */
+int suiteTearDown( int numFailures )
+{
+    return numFailures;
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Receive callback that consumes the read-ahead buffer the way
+ * #Openssl_Recv does, reading at most #FIRST_READ_BYTES the first time and
+ * the rest after that.
+ */
+static void consumeReadAhead( ReactorConnection_t * pConnection,
+                              void * pUserContext )
+{
+    OpensslParams_t * pParams = pConnection->pOpensslParams;
+    size_t bytesRead = pParams->readAheadLength;
+
+    ( void ) pUserContext;
+
+    if( ( receiveCount == 0U ) && ( bytesRead > FIRST_READ_BYTES ) )
+    {
+        bytesRead = FIRST_READ_BYTES;
+    }
+
+    pParams->readAheadOffset += bytesRead;
+    pParams->readAheadLength -= bytesRead;
+
+    if( pParams->readAheadLength == 0U )
+    {
+        pParams->readAheadOffset = 0U;
+    }
+
+    receiveCount++;
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Test that #Reactor_Dispatch keeps calling back while the read-ahead
+ * buffer holds data after a partial read, even once the read position has
+ * passed the number of bytes left.
+ */
+void test_Reactor_Dispatch_Drains_Read_Ahead_After_Partial_Read( void )
+{
+    ReactorStatus_t returnStatus;
+
+    TEST_ASSERT_EQUAL( REACTOR_SUCCESS, Reactor_Add( &reactor,
+                                                     &connection,
+                                                     readableDescriptor,
+                                                     &opensslParams,
+                                                     consumeReadAhead,
+                                                     NULL ) );
+
+    opensslParams.readAheadOffset = 0U;
+    opensslParams.readAheadLength = BUFFERED_BYTES;
+
+    /* Once the buffer is empty, the TLS session is checked for data. */
+    SSL_has_pending_ExpectAndReturn( &ssl, 0 );
+
+    returnStatus = Reactor_Dispatch( &reactor, 0U );
+
+    TEST_ASSERT_EQUAL( REACTOR_SUCCESS, returnStatus );
+    TEST_ASSERT_EQUAL( 2U, receiveCount );
+    TEST_ASSERT_EQUAL( 0U, opensslParams.readAheadLength );
+}
+
+/**
+ * @brief Test that #Reactor_Dispatch calls back again while the TLS session
+ * holds decrypted data and the read-ahead buffer is empty.
+ */
+void test_Reactor_Dispatch_Drains_Pending_Tls_Data( void )
+{
+    ReactorStatus_t returnStatus;
+
+    opensslParams.pReadAheadBuffer = NULL;
+    opensslParams.readAheadBufferSize = 0U;
+
+    TEST_ASSERT_EQUAL( REACTOR_SUCCESS, Reactor_Add( &reactor,
+                                                     &connection,
+                                                     readableDescriptor,
+                                                     &opensslParams,
+                                                     consumeReadAhead,
+                                                     NULL ) );
+
+    SSL_has_pending_ExpectAndReturn( &ssl, 1 );
+    SSL_has_pending_ExpectAndReturn( &ssl, 0 );
+
+    returnStatus = Reactor_Dispatch( &reactor, 0U );
+
+    TEST_ASSERT_EQUAL( REACTOR_SUCCESS, returnStatus );
+    TEST_ASSERT_EQUAL( 2U, receiveCount );
+}
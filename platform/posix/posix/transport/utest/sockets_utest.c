@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include "/usr/include/errno.h"
 
 #include "unity.h"
@@ -35,6 +36,7 @@
 #include "mock_inet.h"
 #include "mock_unistd_api.h"
 #include "mock_stdio_api.h"
+#include "mock_poll.h"
 
 /* The number of #addrinfo objects to create in the linked list. */
 #define NUM_ADDR_INFO        3
@@ -49,6 +51,9 @@
 static struct addrinfo * addrInfo;
 static ServerInfo_t serverInfo;
 
+/* Number of calls made to #connect through #connectInProgressThenSucceed. */
+static int connectCallCount;
+
 /**
  * @brief Allocate a linked list that mocks a set of DNS records returned from
  * a call to #getaddrinfo.
@@ -73,7 +78,7 @@ static void allocateAddrInfoLinkedList( struct addrinfo ** head )
         next->ai_next = NULL;
 
         /* Every other IP address will be IPv4 for coverage. */
-        ai_addr = malloc( sizeof( struct sockaddr ) );
+        ai_addr = malloc( sizeof( struct sockaddr_storage ) );
 
         if( i % 2 )
         {
@@ -385,3 +390,147 @@ void test_Sockets_Connect_Succeed_On_Nth_IP_Address( void )
                                     SEND_RECV_TIMEOUT );
     TEST_ASSERT_EQUAL( SOCKETS_SUCCESS, socketStatus );
 }
+
+/**
+ * @brief Test that a second #Sockets_Connect to the same host reuses the
+ * cached DNS records, and that disabling the cache frees them.
+ */
+void test_Sockets_Connect_Uses_Dns_Cache( void )
+{
+    SocketStatus_t socketStatus;
+    int tcpSocket = 1;
+
+    Sockets_SetDnsCacheTtl( 60000U );
+
+    getaddrinfo_ExpectAnyArgsAndReturn( 0 );
+    getaddrinfo_ReturnThruPtr___pai( &addrInfo );
+    socket_ExpectAnyArgsAndReturn( 1 );
+    inet_ntop_ExpectAnyArgsAndReturn( NULL );
+    connect_ExpectAnyArgsAndReturn( 0 );
+    setsockopt_ExpectAnyArgsAndReturn( 0 );
+    setsockopt_ExpectAnyArgsAndReturn( 0 );
+
+    socketStatus = Sockets_Connect( &tcpSocket,
+                                    &serverInfo,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( SOCKETS_SUCCESS, socketStatus );
+
+    /* No DNS lookup and no #freeaddrinfo this time. */
+    socket_ExpectAnyArgsAndReturn( 1 );
+    inet_ntop_ExpectAnyArgsAndReturn( NULL );
+    connect_ExpectAnyArgsAndReturn( 0 );
+    setsockopt_ExpectAnyArgsAndReturn( 0 );
+    setsockopt_ExpectAnyArgsAndReturn( 0 );
+
+    socketStatus = Sockets_Connect( &tcpSocket,
+                                    &serverInfo,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( SOCKETS_SUCCESS, socketStatus );
+
+    freeaddrinfo_ExpectAnyArgs();
+    Sockets_SetDnsCacheTtl( 0U );
+}
+
+/**
+ * @brief Test that a cached host whose addresses all refuse the connection is
+ * resolved again on the next connect.
+ */
+void test_Sockets_Connect_Dns_Cache_Dropped_On_Failure( void )
+{
+    SocketStatus_t socketStatus;
+    int tcpSocket = 1;
+
+    Sockets_SetDnsCacheTtl( 60000U );
+
+    /* The records are freed as soon as the failed connect releases them. */
+    expectSocketsConnectCalls( -1 );
+
+    socketStatus = Sockets_Connect( &tcpSocket,
+                                    &serverInfo,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( SOCKETS_CONNECT_FAILURE, socketStatus );
+
+    getaddrinfo_ExpectAnyArgsAndReturn( -1 );
+
+    socketStatus = Sockets_Connect( &tcpSocket,
+                                    &serverInfo,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( SOCKETS_DNS_FAILURE, socketStatus );
+
+    Sockets_SetDnsCacheTtl( 0U );
+}
+
+/**
+ * @brief #connect stub whose first call is left in progress.
+ */
+static int connectInProgressThenSucceed( int fd,
+                                         __CONST_SOCKADDR_ARG addr,
+                                         socklen_t len,
+                                         int numCalls )
+{
+    int returnStatus = 0;
+
+    ( void ) fd;
+    ( void ) addr;
+    ( void ) len;
+    ( void ) numCalls;
+
+    if( connectCallCount == 0 )
+    {
+        errno = EINPROGRESS;
+        returnStatus = -1;
+    }
+
+    connectCallCount++;
+
+    return returnStatus;
+}
+
+/**
+ * @brief Test that with parallel connects enabled, an attempt that does not
+ * complete within the attempt delay is raced by the next address, and that
+ * the losing attempt is closed.
+ */
+void test_Sockets_Connect_Parallel_Attempts( void )
+{
+    SocketStatus_t socketStatus;
+    int tcpSocket = -1;
+    int winningSocket = open( "/dev/null", O_RDONLY );
+
+    TEST_ASSERT_TRUE( winningSocket >= 0 );
+
+    Sockets_SetConnectAttemptDelay( 250U );
+    connectCallCount = 0;
+
+    getaddrinfo_ExpectAnyArgsAndReturn( 0 );
+    getaddrinfo_ReturnThruPtr___pai( &addrInfo );
+    connect_Stub( connectInProgressThenSucceed );
+
+    /* The first attempt stays in progress past the attempt delay. */
+    socket_ExpectAnyArgsAndReturn( 100 );
+    inet_ntop_ExpectAnyArgsAndReturn( NULL );
+    poll_ExpectAnyArgsAndReturn( 0 );
+
+    /* The second attempt connects at once and the first is closed. */
+    socket_ExpectAnyArgsAndReturn( winningSocket );
+    inet_ntop_ExpectAnyArgsAndReturn( NULL );
+    close_ExpectAndReturn( 100, 0 );
+
+    freeaddrinfo_ExpectAnyArgs();
+    setsockopt_ExpectAnyArgsAndReturn( 0 );
+    setsockopt_ExpectAnyArgsAndReturn( 0 );
+
+    socketStatus = Sockets_Connect( &tcpSocket,
+                                    &serverInfo,
+                                    SEND_RECV_TIMEOUT,
+                                    SEND_RECV_TIMEOUT );
+    TEST_ASSERT_EQUAL( SOCKETS_SUCCESS, socketStatus );
+    TEST_ASSERT_EQUAL( winningSocket, tcpSocket );
+    TEST_ASSERT_EQUAL( 2, connectCallCount );
+
+    Sockets_SetConnectAttemptDelay( 0U );
+}
@@ -33,6 +33,9 @@
 /* The amount of time to sleep, which is a parameter passed to #Clock_SleepMs. */
 #define SLEEP_TIME_MS                  ( 500 )
 
+/* The amount of time to sleep, which is a parameter passed to #Clock_SleepUs. */
+#define SLEEP_TIME_US                  ( 2500250ULL )
+
 /* Parameters to set for the #timespec in #Clock_GetTimeMs. */
 #define GET_TIME_S                     ( 50 )
 #define GET_TIME_NS                    ( 2500 )
@@ -40,6 +43,8 @@
 /* Time conversion constants. */
 #define NANOSECONDS_PER_MILLISECOND    ( 1000000L )    /**< @brief Nanoseconds per millisecond. */
 #define MILLISECONDS_PER_SECOND        ( 1000L )
+#define NANOSECONDS_PER_MICROSECOND    ( 1000L )
+#define MICROSECONDS_PER_SECOND        ( 1000000L )
 
 /**
  * @brief Used to make assertions on the arguments passed to #nanosleep
@@ -68,6 +73,33 @@ int nanosleep_validate_args( const struct timespec * requested_time,
     return 0;
 }
 
+/**
+ * @brief Used to make assertions on the arguments passed to #nanosleep
+ * from #Clock_SleepUs.
+ *
+ * @param[in] requested_time The requested time to sleep.
+ * @param[in] remaining The remaining time left to sleep.
+ *
+ * @return Successful status returned by #nanosleep or 0
+ */
+int nanosleep_validate_us_args( const struct timespec * requested_time,
+                                struct timespec * remaining,
+                                int numCalls )
+{
+    /* Suppress unused parameter warning. */
+    ( void ) numCalls;
+
+    TEST_ASSERT_NOT_NULL( requested_time );
+    TEST_ASSERT_NULL( remaining );
+    TEST_ASSERT_EQUAL( ( time_t ) ( SLEEP_TIME_US / MICROSECONDS_PER_SECOND ),
+                       requested_time->tv_sec );
+    TEST_ASSERT_EQUAL( ( long ) ( SLEEP_TIME_US % MICROSECONDS_PER_SECOND )
+                       * NANOSECONDS_PER_MICROSECOND,
+                       requested_time->tv_nsec );
+
+    return 0;
+}
+
 /* ============================   UNITY FIXTURES ============================ */
 
 /* Called before each test method. */
@@ -153,3 +185,37 @@ void test_Clock_SleepMs_Passes_Expected_Values_To_nanosleep()
     nanosleep_Stub( nanosleep_validate_args );
     Clock_SleepMs( sleepTimeMs );
 }
+
+/**
+ * @brief Test that #Clock_GetTimeUs returns the expected time, in 64 bits,
+ * for a time whose milliseconds don't fit in 32 bits.
+ */
+void test_Clock_GetTimeUs_Returns_Expected_Time_Without_Wrapping( void )
+{
+    uint64_t actualTimeUs, expectedTimeUs;
+    struct timespec timeSpec;
+
+    /* Past the 49.7 days at which the time in milliseconds wraps. */
+    timeSpec.tv_sec = 5000000;
+    timeSpec.tv_nsec = 123456789;
+
+    clock_gettime_ExpectAnyArgsAndReturn( 0 );
+    clock_gettime_ReturnThruPtr_time_point( &timeSpec );
+    actualTimeUs = Clock_GetTimeUs();
+
+    expectedTimeUs = ( ( uint64_t ) timeSpec.tv_sec * MICROSECONDS_PER_SECOND )
+                     + ( ( uint64_t ) timeSpec.tv_nsec / NANOSECONDS_PER_MICROSECOND );
+
+    TEST_ASSERT_EQUAL_UINT64( expectedTimeUs, actualTimeUs );
+    TEST_ASSERT_EQUAL_UINT64( 5000000123456ULL, actualTimeUs );
+}
+
+/**
+ * @brief Test that the call to #nanosleep in #Clock_SleepUs receives the
+ * expected parameter values.
+ */
+void test_Clock_SleepUs_Passes_Expected_Values_To_nanosleep()
+{
+    nanosleep_Stub( nanosleep_validate_us_args );
+    Clock_SleepUs( SLEEP_TIME_US );
+}